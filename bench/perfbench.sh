@@ -0,0 +1,114 @@
+#!/bin/sh
+
+# End to end performance benchmark of the main tools.
+#
+# Usage: perfbench.sh [topdir [workdir]]
+#
+# topdir is the top of the built source tree (default ..), and workdir
+# is where the corpus is created and the tools run (default perfbench.dir).
+#
+# The corpus is generated from the reference profiles in ref, so that
+# every run works on identical data. The timings are written to stdout
+# and to workdir/perfbench.txt, one line per workload:
+#
+#   name  elapsed_seconds  peak_rss_kbytes
+#
+# Peak RSS needs GNU or BSD /usr/bin/time, and is "-" otherwise.
+
+# This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+# see the License.txt file for licencing details.
+
+TOP=${1:-..}
+WORK=${2:-perfbench.dir}
+
+TOP=`cd "$TOP" && pwd` || exit 1
+mkdir -p "$WORK" || exit 1
+cd "$WORK" || exit 1
+
+REF=$TOP/ref
+TARGEN=$TOP/target/targen
+FAKEREAD=$TOP/spectro/fakeread
+COLPROF=$TOP/profile/colprof
+COLLINK=$TOP/link/collink
+INVPROFCHECK=$TOP/profile/invprofcheck
+TIMAGE=$TOP/render/timage
+CCTIFF=$TOP/imdi/cctiff
+
+for tool in $TARGEN $FAKEREAD $COLPROF $COLLINK $INVPROFCHECK $TIMAGE $CCTIFF ; do
+	if [ ! -x $tool ] ; then
+		echo "perfbench: '$tool' hasn't been built" 1>&2
+		exit 1
+	fi
+done
+
+# Figure out how to measure the peak RSS
+if /usr/bin/time -f "%e %M" -o tcheck true 2>/dev/null ; then
+	TIMER=gnu
+elif /usr/bin/time -l true 2>/dev/null ; then
+	TIMER=bsd
+else
+	TIMER=none
+fi
+rm -f tcheck
+
+RESULTS=perfbench.txt
+echo "# name seconds peak_rss_kb" > $RESULTS
+
+# run name command args...
+run() {
+	name=$1
+	shift
+	case $TIMER in
+	gnu)
+		/usr/bin/time -f "%e %M" -o time.out "$@" > $name.log 2>&1 || fail $name
+		set -- `tail -1 time.out`
+		secs=$1
+		rss=$2
+		;;
+	bsd)
+		/usr/bin/time -l "$@" > $name.log 2> time.out || fail $name
+		secs=`awk '/ real / { print $1 }' time.out`
+		rss=`awk '/maximum resident set size/ { print int($1/1024) }' time.out`
+		;;
+	*)
+		start=`msecs`
+		"$@" > $name.log 2>&1 || fail $name
+		secs=`msecs | awk '{ printf("%.2f", ($1 - '$start')/1000.0) }'`
+		rss=-
+		;;
+	esac
+	echo "$name $secs $rss" | tee -a $RESULTS
+}
+
+# Current time in msec, to the nearest second if date doesn't do %N
+msecs() {
+	case `date +%N` in
+	*[!0-9]*) expr `date +%s` \* 1000 ;;
+	*) expr `date +%s%N` / 1000000 ;;
+	esac
+}
+
+fail() {
+	echo "perfbench: $1 failed - see $WORK/$1.log" 1>&2
+	exit 1
+}
+
+# Generate the corpus. (This isn't timed.)
+# An RGB and a CMYK test chart, "measured" using the reference profiles.
+$TARGEN -d3 -f1000 rgb > /dev/null || fail targen
+$FAKEREAD $REF/sRGB.icm rgb > /dev/null || fail fakeread
+$TARGEN -d4 -l300 -f1500 cmyk > /dev/null || fail targen
+$FAKEREAD $REF/cmyk.icm cmyk > /dev/null || fail fakeread
+$TIMAGE -t -s image.tif > /dev/null || fail timage
+
+# The timed workloads
+run targen_cmyk $TARGEN -d4 -l300 -f3000 tcmyk
+run colprof_rgb_qm $COLPROF -qm rgb
+run colprof_cmyk_qm $COLPROF -qm -kr -l300 cmyk
+cp cmyk.icc cmyk_m.icc || fail colprof_cmyk_qm
+run colprof_cmyk_qh $COLPROF -qh -kr -l300 cmyk
+run collink_G $COLLINK -qm -G -ip $REF/sRGB.icm cmyk_m.icc link.icc
+run cctiff $CCTIFF link.icc image.tif out.tif
+run invprofcheck $INVPROFCHECK -u -l300 cmyk_m.icc
+
+exit 0
@@ -1014,10 +1014,11 @@ static int load_ccast(
 
 	/* Success */
 	p->loaded1 = 1;		/* Loaded at least once */
+	p->load_time = msec_time();
 
 	/* Currently there is a 1.5 second fade up delay imposed by */
 	/* the base ChromeCast software or default receiver. */
-	if (p->load_delay > 0.0)
+	if (p->load_delay > 0.0 && !p->defer_load_delay)
 		msec_sleep(p->load_delay);
 
 	return rv;
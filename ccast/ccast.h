@@ -66,6 +66,9 @@ struct _ccast {
 	int forcedef;					/* Force using default reciever rather than patgen */
 	int patgenrcv;					/* nz if pattern generator receiver, else default receiver */
 	int load_delay;					/* Delay needed after succesful LOAD */
+	int defer_load_delay;			/* nz if load() returns without the load_delay, */
+									/* leaving the caller to allow for it */
+	unsigned int load_time;			/* msec_time() the last load was confirmed */
 
 	struct _ccast *next;			/* Next in static list for signal cleanup */
 }; typedef struct _ccast ccast;
@@ -544,7 +544,7 @@ static int receive_mDNS(SOCKET sock, ccast_id ***ids, int *nids, int emsec) {
 /* Get a list of Video output capable Chromecasts. Return NULL on error */
 /* Last pointer in array is NULL */
 /* Takes 1.5 second to return */
-ccast_id **get_ccids() {
+static ccast_id **get_ccids_mDNS() {
 	ccast_id **ids = NULL;
 	int nids = 0;
 	int i, j, k;
@@ -552,8 +552,6 @@ ccast_id **get_ccids() {
 	int waittime = 200;
 	SOCKET sock;
 
-	DBG2((g_log,DLEV,"get_ccids: called\n"))
-
 	if (init_mDNS()) {
 		DBG2((g_log,0,"get_ccids: init_mDNS() failed\n"))
 		return NULL;
@@ -623,6 +621,159 @@ ccast_id **get_ccids() {
 	return ids;
 }
 
+/* The mDNS search costs every tool that wants a ChromeCast up to 1.6 seconds, */
+/* so remember what was found for a short while, so that a sequence of */
+/* invocations (ie. dispcal then dispread) only pays for it once. */
+/* The lifetime is well inside the 120 second TTL ChromeCasts give their */
+/* A records, so a cached IP address is no staler than one an mDNS */
+/* resolver would hand out. An empty result is never cached. */
+#define CCIDS_CACHE_NAME "ArgyllCMS/.ccast_ids"
+#define CCIDS_CACHE_TTL 60			/* Seconds */
+
+/* Return a list read from the cache file if it is present and fresh, */
+/* NULL otherwise. */
+static ccast_id **restore_ccids() {
+	char **cache_paths = NULL;
+	int no_paths = 0;
+	FILE *fp;
+	char buf[500];
+	unsigned long stime;
+	time_t now;
+	ccast_id **ids = NULL;
+	int nids = 0;
+
+	if ((no_paths = xdg_bds(NULL, &cache_paths, xdg_cache, xdg_read, xdg_user, xdg_none,
+		                                                            CCIDS_CACHE_NAME)) < 1) {
+		DBG2((g_log,DLEV,"restore_ccids: no cache file\n"))
+		return NULL;
+	}
+
+	if ((fp = fopen(cache_paths[0], "r")) == NULL) {
+		xdg_free(cache_paths, no_paths);
+		return NULL;
+	}
+
+	now = time(NULL);
+	if (fgets(buf, sizeof(buf), fp) == NULL
+	 || sscanf(buf, "CCIDS %lu", &stime) != 1
+	 || (unsigned long)now < stime
+	 || ((unsigned long)now - stime) > CCIDS_CACHE_TTL) {
+		DBG2((g_log,DLEV,"restore_ccids: '%s' is stale or invalid\n",cache_paths[0]))
+		fclose(fp);
+		xdg_free(cache_paths, no_paths);
+		return NULL;
+	}
+
+	/* Each line is "type ip name" - the name is the rest of the line */
+	while (fgets(buf, sizeof(buf), fp) != NULL) {
+		int typ, nn;
+		char ip[100], *name;
+		ccast_id **nlist;
+
+		if ((nn = strlen(buf)) > 0 && buf[nn-1] == '\n')
+			buf[--nn] = '\000';
+
+		if (sscanf(buf, "%d %99s %n", &typ, ip, &nn) != 2
+		 || typ < cctyp_unkn || typ > cctyp_Other
+		 || buf[nn] == '\000') {
+			DBG2((g_log,DLEV,"restore_ccids: '%s' has a bad entry\n",cache_paths[0]))
+			free_ccids(ids);
+			ids = NULL;
+			break;
+		}
+		name = buf + nn;
+
+		if ((nlist = realloc(ids, (nids + 2) * sizeof(ccast_id *))) == NULL) {
+			free_ccids(ids);
+			ids = NULL;
+			break;
+		}
+		ids = nlist;
+		ids[nids+1] = NULL;
+		if ((ids[nids] = calloc(sizeof(ccast_id), 1)) == NULL) {
+			free_ccids(ids);
+			ids = NULL;
+			break;
+		}
+		ids[nids]->typ = (cctype)typ;
+		if ((ids[nids]->name = strdup(name)) == NULL
+		 || (ids[nids]->ip = strdup(ip)) == NULL) {
+			nids++;
+			free_ccids(ids);
+			ids = NULL;
+			break;
+		}
+		nids++;
+	}
+	fclose(fp);
+
+	if (ids != NULL) {
+		DBG2((g_log,DLEV,"restore_ccids: restored %d devices from '%s'\n",nids,cache_paths[0]))
+	}
+	xdg_free(cache_paths, no_paths);
+
+	return ids;
+}
+
+/* Save a list to the cache file */
+static void save_ccids(ccast_id **ids) {
+	char **cache_paths = NULL;
+	int no_paths = 0;
+	FILE *fp;
+	int i, ef = 0;
+
+	if ((no_paths = xdg_bds(NULL, &cache_paths, xdg_cache, xdg_write, xdg_user, xdg_none,
+		                                                             CCIDS_CACHE_NAME)) < 1) {
+		DBG2((g_log,DLEV,"save_ccids: xdg_bds returned no paths\n"))
+		return;
+	}
+
+	if (create_parent_directories(cache_paths[0])
+	 || (fp = fopen(cache_paths[0], "w")) == NULL) {
+		DBG2((g_log,DLEV,"save_ccids: failed to open '%s' for writing\n",cache_paths[0]))
+		xdg_free(cache_paths, no_paths);
+		return;
+	}
+
+	if (fprintf(fp, "CCIDS %lu\n", (unsigned long)time(NULL)) < 0)
+		ef = 1;
+	for (i = 0; ef == 0 && ids[i] != NULL; i++) {
+		/* Names with line breaks would corrupt the file, so skip saving */ 
+		if (strchr(ids[i]->name, '\n') != NULL
+		 || fprintf(fp, "%d %s %s\n", (int)ids[i]->typ, ids[i]->ip, ids[i]->name) < 0)
+			ef = 1;
+	}
+	if (fclose(fp) != 0)
+		ef = 2;
+
+	if (ef != 0) {
+		DBG2((g_log,DLEV,"save_ccids: writing '%s' failed with %d\n",cache_paths[0],ef))
+		delete_file(cache_paths[0]);
+	}
+	xdg_free(cache_paths, no_paths);
+}
+
+/* Get a list of Video output capable Chromecasts. Return NULL on error */
+/* Last pointer in array is NULL */
+/* Returns immediately if a recent search result is cached, */
+/* otherwise takes up to 1.6 seconds to return. */
+ccast_id **get_ccids() {
+	ccast_id **ids;
+
+	DBG2((g_log,DLEV,"get_ccids: called\n"))
+
+	if (getenv("ARGYLL_CCAST_NO_CACHE") == NULL
+	 && (ids = restore_ccids()) != NULL) {
+		DBG2((g_log,DLEV,"get_ccids: Returning cached devices\n"))
+		return ids;
+	}
+
+	if ((ids = get_ccids_mDNS()) != NULL && ids[0] != NULL)
+		save_ccids(ids);
+
+	return ids;
+}
+
 void ccast_id_copy(ccast_id *dst, ccast_id *src) {
 	dst->name = strdup(src->name);
 	dst->ip = strdup(src->ip);
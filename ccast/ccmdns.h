@@ -41,7 +41,7 @@ struct _ccast_id {
 
 /* Get a list of Video out capable Chromecasts. Return NULL on error */
 /* Last pointer in array is NULL */ 
-/* Takes 0.5 second to return */
+/* Takes up to 1.6 seconds to return, unless a recent result is cached. */
 ccast_id **get_ccids(void);
 
 /* Free up what get_ccids returned */
@@ -74,9 +74,13 @@ extern void error(const char *fmt, ...), warning(const char *fmt, ...);
 #undef  EMIT_KEYWORDS		/* [und] Emit unknown keywords by default */
 #define REAL_SIGDIG 6		/* [6] Number of significant digits in real representation */
 
+#define CGATSB_MAGIC "\211CGATSB\n"	/* Binary form file identifier */
+#define CGATSB_MAGIC_LEN 8
+
 static int cgats_read(cgats *p, cgatsFile *fp);
 static int find_kword(cgats *p, int table, const char *ksym);
 static int find_field(cgats *p, int table, const char *fsym);
+static int find_fields(cgats *p, int table, int nf, char **fsyms, int *fix);
 static int add_table(cgats *p, table_type tt, int oi);
 static int set_table_type(cgats *p, int table, table_type tt, int oi);
 static int set_table_flags(cgats *p, int table, int sup_id, int sup_kwords, int sup_fields);
@@ -89,11 +93,21 @@ static int add_set(cgats *p, int table, ...);
 static int add_setarr(cgats *p, int table, cgats_set_elem *args);
 static int get_setarr(cgats *p, int table, int set_index, cgats_set_elem *args);
 static int cgats_write(cgats *p, cgatsFile *fp);
+static int write_table(cgats *p, cgatsFile *fp, int table, int stream);
+static int write_set(cgats *p, cgatsFile *fp, cgats_table *t, int *sfield, void **set);
+static int stream_start(cgats *p, cgatsFile *fp, int table);
+static int stream_setarr(cgats *p, cgats_set_elem *args);
+static int stream_end(cgats *p);
 static int cgats_error(cgats *p, char **mes);
 static void cgats_del(cgats *p);
 
 static void cgats_table_free(cgats_table *t);
 static void *alloc_copy_data_type(cgatsAlloc *al, data_type ktype, void *dpoint);
+static void **alloc_set(cgatsAlloc *al, cgats_table *t, cgats_set_elem *args);
+static void *alloc_rfab(cgatsAlloc *al, cgats_table *t, size_t size);
+static int grow_sets(cgatsAlloc *al, cgats_table *t, int rf);
+static int cgats_read_bin(cgats *p, cgatsFile *fp);
+static int cgats_write_bin(cgats *p, cgatsFile *fp);
 static int reserved_kword(const char *ksym);
 static int standard_kword(const char *ksym);
 static data_type standard_field(const char *fsym);
@@ -129,6 +143,7 @@ cgatsAlloc *al			/* memory allocator */
 	/* Initialize the methods */
 	p->find_kword = find_kword;
 	p->find_field = find_field;
+	p->find_fields = find_fields;
 	p->read       = cgats_read;
 	p->add_table  = add_table;
 	p->set_table_type = set_table_type;
@@ -143,6 +158,9 @@ cgatsAlloc *al			/* memory allocator */
 	p->add_setarr = add_setarr;
 	p->get_setarr = get_setarr;
 	p->write      = cgats_write;
+	p->stream_start  = stream_start;
+	p->stream_setarr = stream_setarr;
+	p->stream_end    = stream_end;
 	p->error      = cgats_error;
 	p->del        = cgats_del;
 	
@@ -233,6 +251,12 @@ cgats_del(cgats *p) {
 		al->free(al, p->others);
 	}
 
+	/* Free any unfinished stream state */
+	if (p->ssfield != NULL)
+		al->free(al, p->ssfield);
+	if (p->svals != NULL)
+		al->free(al, p->svals);
+
 	/* Free contents of all the tables */
 	for (i = 0; i < p->ntables; i++)
 		cgats_table_free(&p->t[i]);
@@ -285,30 +309,100 @@ cgats_table_free(cgats_table *t) {
 	/* Free array of field types */
 	if (t->ftype != NULL)
 		al->free(al, t->ftype);
-	/* Free all the original fields text values */
-	if (t->rfdata != NULL) {
-		for (j = 0; j < t->nsets; j++)
-			if (t->rfdata[j] != NULL) {
-				for (i = 0; i < t->nfields; i++)
-					if(t->rfdata[j][i] != NULL)
-						al->free(al, t->rfdata[j][i]);
-				al->free(al, t->rfdata[j]);
-			}
-		al->free(al, t->rfdata);
+	/* Free the name hash indexes */
+	if (t->khash != NULL)
+		al->free(al, t->khash);
+	if (t->fhash != NULL)
+		al->free(al, t->fhash);
+	/* Free the blocks holding the original fields text values */
+	/* (Each block starts with a pointer to the previous block) */
+	while (t->rfab != NULL) {
+		char *pb = *((char **)t->rfab);
+		al->free(al, t->rfab);
+		t->rfab = pb;
 	}
-	/* Free all the fields values */
+	if (t->rfdata != NULL)
+		al->free(al, t->rfdata);
+	/* Free all the fields values. Each set is a single allocation. */
 	if (t->fdata != NULL) {
 		for (j = 0; j < t->nsets; j++)
-			if (t->fdata[j] != NULL) {
-				for (i = 0; i < t->nfields; i++)
-					if(t->fdata[j][i] != NULL)
-						al->free(al, t->fdata[j][i]);
+			if (t->fdata[j] != NULL)
 				al->free(al, t->fdata[j]);
-			}
 		al->free(al, t->fdata);
 	}
 }
 
+/* Hash a keyword or field name */
+static unsigned int
+sym_hash(const char *sym) {
+	unsigned int h = 2166136261u;		/* FNV-1a */
+
+	for (; *sym != '\000'; sym++) {
+		h ^= (unsigned char)*sym;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/* Bring a name hash index up to date with the first n names in sym[]. */
+/* Entries with a NULL name, or a NULL data[] value if data is not NULL, */
+/* are skipped, and a repeated name keeps the index of its first occurance, */
+/* so that lookups return the same index as a linear search. */
+/* (*phashn is reset to 0 to force a rebuild after a name is replaced.) */
+/* Return nz on a malloc failure */
+static int
+update_sym_hash(cgatsAlloc *al, int **phash, int *phashs, int *phashn,
+                char **sym, char **data, int n) {
+	int *hash;
+	unsigned int i, j, h, mask;
+
+	if (*phashn == n)
+		return 0;
+
+	if (*phashs < 2 * n) {				/* Grow to at most 50% full */
+		int ns;
+		for (ns = 16; ns < 4 * n; ns *= 2)
+			;
+		if (*phash != NULL)
+			al->free(al, *phash);
+		*phashs = *phashn = 0;
+		if ((*phash = (int *)al->calloc(al, ns, sizeof(int))) == NULL)
+			return 1;
+		*phashs = ns;
+	} else if (*phashn == 0 || *phashn > n) {
+		memset(*phash, 0, *phashs * sizeof(int));
+		*phashn = 0;
+	}
+	hash = *phash;
+	mask = *phashs - 1;
+
+	for (i = *phashn; i < (unsigned int)n; i++) {
+		if (sym[i] == NULL || (data != NULL && data[i] == NULL))
+			continue;
+		for (h = sym_hash(sym[i]) & mask; (j = hash[h]) != 0; h = (h + 1) & mask) {
+			if (strcmp(sym[j-1], sym[i]) == 0)
+				break;
+		}
+		if (j == 0)
+			hash[h] = i + 1;
+	}
+	*phashn = n;
+
+	return 0;
+}
+
+/* Lookup a name in a name hash index. Return -1 if not found */
+static int
+lookup_sym_hash(int *hash, int hashs, char **sym, const char *name) {
+	unsigned int h, j, mask = hashs - 1;
+
+	for (h = sym_hash(name) & mask; (j = hash[h]) != 0; h = (h + 1) & mask) {
+		if (strcmp(sym[j-1], name) == 0)
+			return j-1;
+	}
+	return -1;
+}
+
 /* Return index of the keyword, -1 on fail */
 /* -2 on illegal table index, message in err & errc */
 static int
@@ -323,9 +417,14 @@ find_kword(cgats *p, int table, const char *ksym) {
 		return err(p, -2, "cgats.find_kword(), table number '%d' is out of range",table);
 	t = &p->t[table];
 
-	if (ksym == NULL || ksym[0] == '\000')
+	if (ksym == NULL || ksym[0] == '\000' || t->nkwords == 0)
 		return -1;
 
+	if (update_sym_hash(p->al, &t->khash, &t->khashs, &t->khashn,
+	                    t->ksym, t->kdata, t->nkwords) == 0)
+		return lookup_sym_hash(t->khash, t->khashs, t->ksym, ksym);
+
+	/* Fall back to a linear search if the index couldn't be allocated */
 	for (i = 0; i < t->nkwords; i ++) {
 		if (t->ksym[i] != NULL && t->kdata[i] != NULL
 		    && strcmp(t->ksym[i],ksym) == 0)
@@ -349,9 +448,14 @@ find_field(cgats *p, int table, const char *fsym) {
 		return err(p, -2, "cgats.find_field(), table number '%d' is out of range",table);
 	t = &p->t[table];
 
-	if (fsym == NULL || fsym[0] == '\000')
+	if (fsym == NULL || fsym[0] == '\000' || t->nfields == 0)
 		return -1;
 
+	if (update_sym_hash(p->al, &t->fhash, &t->fhashs, &t->fhashn,
+	                    t->fsym, NULL, t->nfields) == 0)
+		return lookup_sym_hash(t->fhash, t->fhashs, t->fsym, fsym);
+
+	/* Fall back to a linear search if the index couldn't be allocated */
 	for (i = 0; i < t->nfields; i ++)
 		if (strcmp(t->fsym[i],fsym) == 0)
 			return i;
@@ -359,6 +463,22 @@ find_field(cgats *p, int table, const char *fsym) {
 	return -1;
 }
 
+/* Set fix[nf] to the index of each of the fields fsyms[nf], -1 if not present. */
+/* Return the number of fields found, */
+/* -2 on illegal table index, message in err & errc */
+static int
+find_fields(cgats *p, int table, int nf, char **fsyms, int *fix) {
+	int i, nfound = 0;
+
+	for (i = 0; i < nf; i++) {
+		if ((fix[i] = find_field(p, table, fsyms[i])) < -1)
+			return fix[i];
+		if (fix[i] >= 0)
+			nfound++;
+	}
+	return nfound;
+}
+
 /* Read a cgats file into structure */
 /* returns 0 normally, -ve if there was an error, */
 /* and p->errc and p->err will be valid */
@@ -375,15 +495,31 @@ cgats_read(cgats *p, cgatsFile *fp) {
 	int tablef = 0;		/* Current table we should be filling */
 	int expsets = 0;	/* Expected number of sets */
 	char *kw = NULL;	/* keyword symbol */
+	unsigned char mag[CGATSB_MAGIC_LEN];
+	size_t nmag;
 
 	p->errc = 0;
 	p->err[0] = '\000';
 
+	/* See if it is the binary form */
+	nmag = fp->read(fp, mag, 1, CGATSB_MAGIC_LEN);
+	if (nmag == CGATSB_MAGIC_LEN && memcmp(mag, CGATSB_MAGIC, CGATSB_MAGIC_LEN) == 0) {
+		DBGF((DBGA,"Reading binary form\n"));
+		return cgats_read_bin(p, fp);
+	}
+
 	if ((pp = new_parse_al(p->al, fp)) == NULL) {
 		DBGF((DBGA,"Failed to open parser for file\n"));
 		return err(p, -1, "Unable to create file parser for file '%s'",fp->fname(fp));
 	}
 
+	/* Have the parser start with what we've read */
+	if (pp->unread(pp, mag, nmag) != 0) {
+		err(p, -1, "%s", pp->err);
+		pp->del(pp);
+		return p->errc;
+	}
+
 	/* Setup our token parsing charaters */
 	/* Terminators, Not Read, Comment start, Quote characters */
 	pp->add_del(pp, " \t"," \t", "#", "\"");
@@ -711,50 +847,48 @@ cgats_read(cgats *p, cgatsFile *fp) {
 							return p->errc;
 						}
 
-						/* Set field type, and then convert the fields to correct type. */
+						/* Set field type */
 						ct->ftype[i] = bt;
+					}
+
+					/* Convert each set of fields to the correct types, */
+					/* and store them in a single allocation per set. */
+					if (ct->nsets > 0) {
+						cgats_set_elem *args;
+
+						if ((args = (cgats_set_elem *)p->al->malloc(p->al,
+						                     ct->nfields * sizeof(cgats_set_elem))) == NULL) {
+							err(p, -2, "cgats.read(), malloc fail");
+							pp->del(pp);
+							return p->errc;
+						}
 						for (j = 0; j < ct->nsets; j++) {
-							switch(bt) {
-								case r_t: {
-									double dv;
-									dv = atof((char *)ct->rfdata[j][i]);
-									if ((ct->fdata[j][i] = alloc_copy_data_type(p->al, bt, (void *)&dv)) == NULL) {
-										err(p, -2, "cgats.alloc_copy_data_type() malloc fail");
-										pp->del(pp);
-										DBGF((DBGA,"Alloc copy data type failed\n"));
-										return p->errc;
-									}
-									break;
+							for (i = 0; i < ct->nfields; i++) {
+								switch(ct->ftype[i]) {
+									case r_t:
+										args[i].d = atof(ct->rfdata[j][i]);
+										break;
+									case i_t:
+										args[i].i = atoi(ct->rfdata[j][i]);
+										break;
+									default:
+										args[i].c = ct->rfdata[j][i];
+										break;
 								}
-								case i_t: {
-									int iv;
-									iv = atoi((char *)ct->rfdata[j][i]);
-									if ((ct->fdata[j][i] = alloc_copy_data_type(p->al, bt, (void *)&iv)) == NULL) {
-										err(p, -2, "cgats.alloc_copy_data_type() malloc fail");
-										pp->del(pp);
-										DBGF((DBGA,"Alloc copy data type failed\n"));
-										return p->errc = -2;
-									}
-									break;
-								}
-								case cs_t:
-								case nqcs_t: {
-									char *cv;
-									cv = ct->rfdata[j][i];
-									if ((ct->fdata[j][i]
-= alloc_copy_data_type(p->al, bt, (void *)cv)) == NULL) {
-										err(p, -2, "cgats.alloc_copy_data_type() malloc fail");
-										pp->del(pp);
-										DBGF((DBGA,"Alloc copy data type failed\n"));
-										return p->errc = -2;
-									}
+							}
+							if ((ct->fdata[j] = alloc_set(p->al, ct, args)) == NULL) {
+								p->al->free(p->al, args);
+								err(p, -2, "cgats.alloc_set() malloc fail");
+								pp->del(pp);
+								DBGF((DBGA,"Alloc set failed\n"));
+								return p->errc;
+							}
+							for (i = 0; i < ct->nfields; i++) {
+								if (ct->ftype[i] == cs_t || ct->ftype[i] == nqcs_t)
 									unquote_cs((char *)ct->fdata[j][i]);
-									break;
-								}
-								case none_t:
-									break;
 							}
 						}
+						p->al->free(p->al, args);
 					}
 					
 					tablef = p->ntables;	/* Finished data for current table */
@@ -962,6 +1096,7 @@ add_kword_at(cgats *p, int table, int pos, const char *ksym, const char *kdata,
 		}
 		pos = t->nkwords-1;
 	} else {	/* This is a replacement */
+		t->khashn = 0;			/* Force a rebuild of the keyword index */
 		if (t->ksym[pos] != NULL)
 			al->free(al, t->ksym[pos]);
 		if (t->kdata[pos] != NULL)
@@ -1080,6 +1215,13 @@ clear_fields(cgats *p, int table) {
 		al->free(al, t->ftype);
 	t->ftype = NULL;
 
+	/* Free the field name index */
+	if (t->fhash != NULL)
+		al->free(al, t->fhash);
+	t->fhash = NULL;
+	t->fhashs = 0;
+	t->fhashn = 0;
+
 	/* Zero all the field counters */
 	t->nfields = 0;
 	t->nfieldsa = 0;
@@ -1094,8 +1236,9 @@ static int
 add_set(cgats *p, int table, ...) {
 	cgatsAlloc *al = p->al;
 	va_list args;
-	int i;
+	int i, rv;
 	cgats_table *t;
+	cgats_set_elem *vals;
 
 	va_start(args, table);
 
@@ -1108,50 +1251,32 @@ add_set(cgats *p, int table, ...) {
 	if (t->nfields == 0)
 		return err(p,-1,"cgats.add_set(), attempt to add set when no fields are defined");
 
-	t->nsets++;
-	
-	if (t->nsets > t->nsetsa) /* Allocate space for more sets */ {
-		/* Allocate set pointers in groups of 100 */
-		t->nsetsa += 100;
-		if ((t->fdata = (void ***)al->realloc(al, t->fdata, t->nsetsa * sizeof(void **))) == NULL)
-			return err(p,-2,"cgats.add_set(), realloc failed!");
-	}
-	/* Allocate set pointer to data element values */
-	if ((t->fdata[t->nsets-1] = (void **)al->malloc(al, t->nfields * sizeof(void *))) == NULL)
+	if ((vals = (cgats_set_elem *)al->malloc(al, t->nfields * sizeof(cgats_set_elem))) == NULL)
 		return err(p,-2,"cgats.add_set(), malloc failed!");
 
-	/* Allocate and copy data to new set */
 	for (i = 0; i < t->nfields; i++) {
 		switch(t->ftype[i]) {
-			case r_t: {
-				double dv;
-				dv = va_arg(args, double);
-				if ((t->fdata[t->nsets-1][i] = alloc_copy_data_type(al, t->ftype[i], (void *)&dv)) == NULL)
-					return err(p,-2,"cgats.alloc_copy_data_type() malloc fail");
+			case r_t:
+				vals[i].d = va_arg(args, double);
 				break;
-			}
-			case i_t: {
-				int iv;
-				iv = va_arg(args, int);
-				if ((t->fdata[t->nsets-1][i] = alloc_copy_data_type(al, t->ftype[i], (void *)&iv)) == NULL)
-					return err(p,-2,"cgats.alloc_copy_data_type() malloc fail");
+			case i_t:
+				vals[i].i = va_arg(args, int);
 				break;
-			}
 			case cs_t:
-			case nqcs_t: {
-				char *sv;
-				sv = va_arg(args, char *);
-				if ((t->fdata[t->nsets-1][i] = alloc_copy_data_type(al, t->ftype[i], (void *)sv)) == NULL)
-					return err(p,-2,"cgats.alloc_copy_data_type() malloc fail");
+			case nqcs_t:
+				vals[i].c = va_arg(args, char *);
 				break;
-			}
 			default:
+				al->free(al, vals);
 				return err(p,-1,"cgats.add_set(), field has unknown data type");
 		}
 	}
 	va_end(args);
 
-	return 0;
+	rv = add_setarr(p, table, vals);
+	al->free(al, vals);
+
+	return rv;
 }
 
 /* Add a set of data from void array */
@@ -1173,47 +1298,22 @@ add_setarr(cgats *p, int table, cgats_set_elem *args) {
 	if (t->nfields == 0)
 		return err(p,-1,"cgats.add_setarr(), attempt to add set when no fields are defined");
 
-	t->nsets++;
-	
-	if (t->nsets > t->nsetsa) /* Allocate space for more sets */ {
-		/* Allocate set pointers in groups of 100 */
-		t->nsetsa += 100;
-		if ((t->fdata = (void ***)al->realloc(al,t->fdata, t->nsetsa * sizeof(void **))) == NULL)
+	for (i = 0; i < t->nfields; i++) {
+		if (t->ftype[i] != r_t && t->ftype[i] != i_t
+		 && t->ftype[i] != cs_t && t->ftype[i] != nqcs_t)
+			return err(p,-1,"cgats.add_set(), field has unknown data type");
+	}
+
+	if (t->nsets >= t->nsetsa) { /* Allocate space for more sets */
+		if (grow_sets(al, t, 0))
 			return err(p,-2,"cgats.add_set(), realloc failed!");
 	}
-	/* Allocate set pointer to data element values */
-	if ((t->fdata[t->nsets-1] = (void **)al->malloc(al,t->nfields * sizeof(void *))) == NULL)
-		return err(p,-2,"cgats.add_set(), malloc failed!");
 
 	/* Allocate and copy data to new set */
-	for (i = 0; i < t->nfields; i++) {
-		switch(t->ftype[i]) {
-			case r_t: {
-				double dv;
-				dv = args[i].d;
-				if ((t->fdata[t->nsets-1][i] = alloc_copy_data_type(al, t->ftype[i], (void *)&dv)) == NULL)
-					return err(p,-2,"cgats.alloc_copy_data_type() malloc fail");
-				break;
-			}
-			case i_t: {
-				int iv;
-				iv = args[i].i;
-				if ((t->fdata[t->nsets-1][i] = alloc_copy_data_type(al, t->ftype[i], (void *)&iv)) == NULL)
-					return err(p,-2,"cgats.alloc_copy_data_type() malloc fail");
-				break;
-			}
-			case cs_t:
-			case nqcs_t: {
-				char *sv;
-				sv = args[i].c;
-				if ((t->fdata[t->nsets-1][i] = alloc_copy_data_type(al, t->ftype[i], (void *)sv)) == NULL)
-					return err(p,-2,"cgats.alloc_copy_data_type() malloc fail");
-				break;
-			}
-			default:
-				return err(p,-1,"cgats.add_set(), field has unknown data type");
-		}
-	}
+	if ((t->fdata[t->nsets] = alloc_set(al, t, args)) == NULL)
+		return err(p,-2,"cgats.add_set(), malloc failed!");
+	t->nsets++;
+
 	return 0;
 }
 
@@ -1271,28 +1371,23 @@ add_data_item(cgats *p, int table, void *data) {
 		return err(p,-1,"cgats.add_item(), attempt to add data when no fields are defined");
 
 	if (t->ndf == 0) {	/* We're about to do the first element of a new set */
-		t->nsets++;
 		
-		if (t->nsets > t->nsetsa) { /* Allocate space for more sets */
-			/* Allocate set pointers in groups of 100 */
-			t->nsetsa += 100;
-			if ((t->rfdata = (char ***)al->realloc(al, t->rfdata, t->nsetsa * sizeof(void **)))
-			                                                                        == NULL)
-				return err(p,-2,"cgats.add_item(), realloc failed!");
-			if ((t->fdata = (void ***)al->realloc(al, t->fdata, t->nsetsa * sizeof(void **)))
-			                                                                        == NULL)
+		if (t->nsets >= t->nsetsa) { /* Allocate space for more sets */
+			if (grow_sets(al, t, 1))
 				return err(p,-2,"cgats.add_item(), realloc failed!");
 		}
-		/* Allocate set pointer to data element values */
-		if ((t->rfdata[t->nsets-1] = (char **)al->malloc(al, t->nfields * sizeof(void *))) == NULL)
-			return err(p,-2,"cgats.add_item(), malloc failed!");
-		if ((t->fdata[t->nsets-1] = (void **)al->malloc(al, t->nfields * sizeof(void *))) == NULL)
+		/* Allocate set pointer to read text values. The set values */
+		/* are allocated by cgats_read() once their types are known. */
+		if ((t->rfdata[t->nsets] = (char **)alloc_rfab(al, t, t->nfields * sizeof(char *))) == NULL)
 			return err(p,-2,"cgats.add_item(), malloc failed!");
+		t->fdata[t->nsets] = NULL;
+		t->nsets++;
 	}
 
 	/* Data type is always cs_t at this point, because we haven't decided the type */
-	if ((t->rfdata[t->nsets-1][t->ndf] = alloc_copy_data_type(al, cs_t, data)) == NULL)
-		return err(p,-2,"cgats.alloc_copy_data_type() malloc fail");
+	if ((t->rfdata[t->nsets-1][t->ndf] = (char *)alloc_rfab(al, t, strlen((char *)data)+1)) == NULL)
+		return err(p,-2,"cgats.add_item(), malloc failed!");
+	strcpy(t->rfdata[t->nsets-1][t->ndf], (char *)data);
 
 	if (++t->ndf >= t->nfields)
 		t->ndf = 0;
@@ -1304,308 +1399,303 @@ add_data_item(cgats *p, int table, void *data) {
 /* Return -ve, errc & err if there was an error */
 static int
 cgats_write(cgats *p, cgatsFile *fp) {
-	cgatsAlloc *al = p->al;
-	int i;
-	int table,set,field;
-	int *sfield = NULL;	/* Standard field flag */
+	int table;
+
+	if (p->binary)
+		return cgats_write_bin(p, fp);
+
 	p->errc = 0;
 	p->err[0] = '\000';
 
 	DBGF((DBGA,"CGATS write called, ntables = %d\n",p->ntables));
 	for (table = 0; table < p->ntables; table++) {
-		cgats_table *t = &p->t[table];
+		if (write_table(p, fp, table, 0) < 0)
+			return p->errc;
+	}
+	return 0;
+}
 
-		DBGF((DBGA,"CGATS writing table %d\n",table));
+/* Write one table. If stream is nz, the NUMBER_OF_SETS value is padded */
+/* so that it can be patched later, its position is noted in p->snsoff, */
+/* and the table is left open for more sets, with its standard field */
+/* flags in p->ssfield. */
+/* Return -ve, errc & err if there was an error */
+static int
+write_table(cgats *p, cgatsFile *fp, int table, int stream) {
+	cgatsAlloc *al = p->al;
+	cgats_table *t = &p->t[table];
+	int i;
+	int set,field;
+	int *sfield = NULL;	/* Standard field flag */
 
-		/* Figure out the standard and non-standard fields */
-		if (t->nfields > 0)
-			if ((sfield = (int *)al->malloc(al, t->nfields * sizeof(int))) == NULL)
-				return err(p,-2,"cgats.write(), malloc failed!");
-		for (field = 0; field < t->nfields; field++) {
-				if (standard_field(t->fsym[field]) != none_t)
-					sfield[field] = 1;	/* Is standard */
-				else
-					sfield[field] = 0;
-			}
-	
-		if (!t->sup_kwords)	/* If not suppressed */ {
-			/* Make sure table has basic keywords */
-			if ((i = p->find_kword(p,table,"ORIGINATOR")) < 0)	/* Create it */
-				if (p->add_kword(p,table,"ORIGINATOR","Not specified", NULL) < 0) {
-					al->free(al, sfield);
-					return p->errc;
-				}
-			if ((i = p->find_kword(p,table,"DESCRIPTOR")) < 0)	/* Create it */
-				if (p->add_kword(p,table,"DESCRIPTOR","Not specified", NULL) < 0) {
-					al->free(al, sfield);
-					return p->errc;
-				}
-			if ((i = p->find_kword(p,table,"CREATED")) < 0) {	/* Create it */
-				static char *amonths[] = {"January","February","March","April",
-				                          "May","June","July","August","September",
-				                          "October","November","December"};
-				time_t ctime;
-				struct tm *ptm;
-				char tcs[100];
-				ctime = time(NULL);
-				ptm = localtime(&ctime);
-				sprintf(tcs,"%s %d, %d",amonths[ptm->tm_mon],ptm->tm_mday,1900+ptm->tm_year);
-				if (p->add_kword(p,table,"CREATED",tcs, NULL) < 0) {
-					al->free(al, sfield);
-					return p->errc;
-				}
-			}
-	
-			/* And table type specific keywords */
-			/* (Not sure this is correct - CGATS.5 appendix J is not specific enough) */
-			switch(t->tt) {
-				case it8_7_1:
-				case it8_7_2:	/* Physical target reference files */
-					if ((i = p->find_kword(p,table,"MANUFACTURER")) < 0)	/* Create it */
-						if (p->add_kword(p,table,"MANUFACTURER","Not specified", NULL) < 0) {
-							al->free(al, sfield);
-							return p->errc;
-						}
-					if ((i = p->find_kword(p,table,"PROD_DATE")) < 0)	/* Create it */
-						if (p->add_kword(p,table,"PROD_DATE","Not specified", NULL) < 0) {
-							al->free(al, sfield);
-							return p->errc;
-						}
-					if ((i = p->find_kword(p,table,"SERIAL")) < 0)	/* Create it */
-						if (p->add_kword(p,table,"SERIAL","Not specified", NULL) < 0) {
-							al->free(al, sfield);
-							return p->errc;
-						}
-					if ((i = p->find_kword(p,table,"MATERIAL")) < 0)	/* Create it */
-						if (p->add_kword(p,table,"MATERIAL","Not specified", NULL) < 0) {
-							al->free(al, sfield);
-							return p->errc;
-						}
-					break;
-				case it8_7_3:	/* Target measurement files */
-				case it8_7_4:
-				case cgats_5:
-				case cgats_X:
-					if ((i = p->find_kword(p,table,"INSTRUMENTATION")) < 0)	/* Create it */
-						if (p->add_kword(p,table,"INSTRUMENTATION","Not specified", NULL) < 0) {
-							al->free(al, sfield);
-							return p->errc;
-						}
-					if ((i = p->find_kword(p,table,"MEASUREMENT_SOURCE")) < 0)	/* Create it */
-						if (p->add_kword(p,table,"MEASUREMENT_SOURCE","Not specified", NULL) < 0) {
-							al->free(al, sfield);
-							return p->errc;
-						}
-					if ((i = p->find_kword(p,table,"PRINT_CONDITIONS")) < 0)	/* Create it */
-						if (p->add_kword(p,table,"PRINT_CONDITIONS","Not specified", NULL) < 0) {
-							al->free(al, sfield);
-							return p->errc;
-						}
-					break;
-				case tt_other:
-					/* We enforce no pre-defined keywords for user defined file types */
-					break;
-				default:
-					break;
-			}
+	DBGF((DBGA,"CGATS writing table %d\n",table));
+
+	/* Figure out the standard and non-standard fields */
+	if (t->nfields > 0)
+		if ((sfield = (int *)al->malloc(al, t->nfields * sizeof(int))) == NULL)
+			return err(p,-2,"cgats.write(), malloc failed!");
+	for (field = 0; field < t->nfields; field++) {
+			if (standard_field(t->fsym[field]) != none_t)
+				sfield[field] = 1;	/* Is standard */
+			else
+				sfield[field] = 0;
 		}
 
-		/* Output the table */
-
-		/* First the table identifier */
-		if (!t->sup_id)	/* If not suppressed */ {
-			switch(t->tt) {
-				case it8_7_1:
-					if (fp->gprintf(fp,"IT8.7/1\n\n") < 0)
-						goto write_error;
-					break;
-				case it8_7_2:
-					if (fp->gprintf(fp,"IT8.7/2\n\n") < 0)
-						goto write_error;
-					break;
-				case it8_7_3:
-					if (fp->gprintf(fp,"IT8.7/3\n\n") < 0)
-						goto write_error;
-					break;
-				case it8_7_4:
-					if (fp->gprintf(fp,"IT8.7/4\n\n") < 0)
-						goto write_error;
-					break;
-				case cgats_5:
-					if (fp->gprintf(fp,"CGATS.5\n\n") < 0)
-						goto write_error;
-					break;
-				case cgats_X:				/* variable CGATS type */
-					if (p->cgats_type == NULL)
-						goto write_error;
-					if (fp->gprintf(fp,"%-7s\n\n", p->cgats_type) < 0)
-						goto write_error;
-					break;
-				case tt_other:	/* User defined file identifier */
-					if (fp->gprintf(fp,"%-7s\n\n",p->others[t->oi]) < 0)
-						goto write_error;
-					break;
-				case tt_none:
-					break;
+	if (!t->sup_kwords)	/* If not suppressed */ {
+		/* Make sure table has basic keywords */
+		if ((i = p->find_kword(p,table,"ORIGINATOR")) < 0)	/* Create it */
+			if (p->add_kword(p,table,"ORIGINATOR","Not specified", NULL) < 0) {
+				al->free(al, sfield);
+				return p->errc;
 			}
-		} else {	/* At least space the next table out a bit */
-			if (table == 0) {
+		if ((i = p->find_kword(p,table,"DESCRIPTOR")) < 0)	/* Create it */
+			if (p->add_kword(p,table,"DESCRIPTOR","Not specified", NULL) < 0) {
 				al->free(al, sfield);
-				return err(p,-1,"cgats_write(), ID should not be suppressed on first table");
+				return p->errc;
 			}
-			if (t->tt != p->t[table-1].tt || (t->tt == tt_other && t->oi != p->t[table-1].oi)) {
+		if ((i = p->find_kword(p,table,"CREATED")) < 0) {	/* Create it */
+			static char *amonths[] = {"January","February","March","April",
+			                          "May","June","July","August","September",
+			                          "October","November","December"};
+			time_t ctime;
+			struct tm *ptm;
+			char tcs[100];
+			ctime = time(NULL);
+			ptm = localtime(&ctime);
+			sprintf(tcs,"%s %d, %d",amonths[ptm->tm_mon],ptm->tm_mday,1900+ptm->tm_year);
+			if (p->add_kword(p,table,"CREATED",tcs, NULL) < 0) {
 				al->free(al, sfield);
-				return err(p,-1,"cgats_write(), ID should not be suppressed when table %d type is not the same as previous table",table);
+				return p->errc;
 			}
-			if (fp->gprintf(fp,"\n\n") < 0)
-				goto write_error;
 		}
 
-		/* Then all the keywords */
-		for (i = 0; i < t->nkwords; i++) {
-			char *qs = NULL;
-
-			DBGF((DBGA,"CGATS writing keyword %d\n",i));
-
-			/* Keyword and data if it is present */
-			if (t->ksym[i] != NULL && t->kdata[i] != NULL) {
-				if (p->emit_keywords && !standard_kword(t->ksym[i])) {	/* Do the right thing */
-					if ((qs = quote_cs(al, t->ksym[i])) == NULL) {
+		/* And table type specific keywords */
+		/* (Not sure this is correct - CGATS.5 appendix J is not specific enough) */
+		switch(t->tt) {
+			case it8_7_1:
+			case it8_7_2:	/* Physical target reference files */
+				if ((i = p->find_kword(p,table,"MANUFACTURER")) < 0)	/* Create it */
+					if (p->add_kword(p,table,"MANUFACTURER","Not specified", NULL) < 0) {
+						al->free(al, sfield);
+						return p->errc;
+					}
+				if ((i = p->find_kword(p,table,"PROD_DATE")) < 0)	/* Create it */
+					if (p->add_kword(p,table,"PROD_DATE","Not specified", NULL) < 0) {
 						al->free(al, sfield);
-						return err(p,-2,"quote_cs() malloc failed!");
+						return p->errc;
 					}
-					if (fp->gprintf(fp,"KEYWORD %s\n",qs) < 0) {
-						al->free(al, qs);
-						goto write_error;
+				if ((i = p->find_kword(p,table,"SERIAL")) < 0)	/* Create it */
+					if (p->add_kword(p,table,"SERIAL","Not specified", NULL) < 0) {
+						al->free(al, sfield);
+						return p->errc;
 					}
-					al->free(al, qs);
-				}
-	
-				if ((qs = quote_cs(al, t->kdata[i])) == NULL) {
+				if ((i = p->find_kword(p,table,"MATERIAL")) < 0)	/* Create it */
+					if (p->add_kword(p,table,"MATERIAL","Not specified", NULL) < 0) {
+						al->free(al, sfield);
+						return p->errc;
+					}
+				break;
+			case it8_7_3:	/* Target measurement files */
+			case it8_7_4:
+			case cgats_5:
+			case cgats_X:
+				if ((i = p->find_kword(p,table,"INSTRUMENTATION")) < 0)	/* Create it */
+					if (p->add_kword(p,table,"INSTRUMENTATION","Not specified", NULL) < 0) {
+						al->free(al, sfield);
+						return p->errc;
+					}
+				if ((i = p->find_kword(p,table,"MEASUREMENT_SOURCE")) < 0)	/* Create it */
+					if (p->add_kword(p,table,"MEASUREMENT_SOURCE","Not specified", NULL) < 0) {
+						al->free(al, sfield);
+						return p->errc;
+					}
+				if ((i = p->find_kword(p,table,"PRINT_CONDITIONS")) < 0)	/* Create it */
+					if (p->add_kword(p,table,"PRINT_CONDITIONS","Not specified", NULL) < 0) {
+						al->free(al, sfield);
+						return p->errc;
+					}
+				break;
+			case tt_other:
+				/* We enforce no pre-defined keywords for user defined file types */
+				break;
+			default:
+				break;
+		}
+	}
+
+	/* Output the table */
+
+	/* First the table identifier */
+	if (!t->sup_id)	/* If not suppressed */ {
+		switch(t->tt) {
+			case it8_7_1:
+				if (fp->gprintf(fp,"IT8.7/1\n\n") < 0)
+					goto write_error;
+				break;
+			case it8_7_2:
+				if (fp->gprintf(fp,"IT8.7/2\n\n") < 0)
+					goto write_error;
+				break;
+			case it8_7_3:
+				if (fp->gprintf(fp,"IT8.7/3\n\n") < 0)
+					goto write_error;
+				break;
+			case it8_7_4:
+				if (fp->gprintf(fp,"IT8.7/4\n\n") < 0)
+					goto write_error;
+				break;
+			case cgats_5:
+				if (fp->gprintf(fp,"CGATS.5\n\n") < 0)
+					goto write_error;
+				break;
+			case cgats_X:				/* variable CGATS type */
+				if (p->cgats_type == NULL)
+					goto write_error;
+				if (fp->gprintf(fp,"%-7s\n\n", p->cgats_type) < 0)
+					goto write_error;
+				break;
+			case tt_other:	/* User defined file identifier */
+				if (fp->gprintf(fp,"%-7s\n\n",p->others[t->oi]) < 0)
+					goto write_error;
+				break;
+			case tt_none:
+				break;
+		}
+	} else {	/* At least space the next table out a bit */
+		if (table == 0) {
+			al->free(al, sfield);
+			return err(p,-1,"cgats_write(), ID should not be suppressed on first table");
+		}
+		if (t->tt != p->t[table-1].tt || (t->tt == tt_other && t->oi != p->t[table-1].oi)) {
+			al->free(al, sfield);
+			return err(p,-1,"cgats_write(), ID should not be suppressed when table %d type is not the same as previous table",table);
+		}
+		if (fp->gprintf(fp,"\n\n") < 0)
+			goto write_error;
+	}
+
+	/* Then all the keywords */
+	for (i = 0; i < t->nkwords; i++) {
+		char *qs = NULL;
+
+		DBGF((DBGA,"CGATS writing keyword %d\n",i));
+
+		/* Keyword and data if it is present */
+		if (t->ksym[i] != NULL && t->kdata[i] != NULL) {
+			if (p->emit_keywords && !standard_kword(t->ksym[i])) {	/* Do the right thing */
+				if ((qs = quote_cs(al, t->ksym[i])) == NULL) {
 					al->free(al, sfield);
 					return err(p,-2,"quote_cs() malloc failed!");
 				}
-				if (fp->gprintf(fp,"%s %s%s",t->ksym[i],qs,
-				    t->kcom[i] == NULL ? "\n":"\t") < 0) {
+				if (fp->gprintf(fp,"KEYWORD %s\n",qs) < 0) {
 					al->free(al, qs);
 					goto write_error;
 				}
 				al->free(al, qs);
 			}
-			/* Comment if its present */
-			if (t->kcom[i] != NULL) {
-				if (fp->gprintf(fp,"# %s\n",t->kcom[i]) < 0) {
-					al->free(al, qs);
-					goto write_error;
-				}
-			}
-		}
 
-		/* Then the field specification */
-		if (!t->sup_fields) {	/* If not suppressed */
-			if (fp->gprintf(fp,"\n") < 0)
-				goto write_error;
-	
-			/* Declare any non-standard fields */
-			for (field = 0; field < t->nfields; field++) {
-				if (p->emit_keywords && !sfield[field])	/* Non-standard */ {
-					char *qs;
-					if ((qs = quote_cs(al, t->fsym[field])) == NULL) {
-						al->free(al, sfield);
-						return err(p,-2,"quote_cs() malloc failed!");
-					}
-					if (fp->gprintf(fp,"KEYWORD %s\n",qs) < 0) {
-						al->free(al, qs);
-						goto write_error;
-					}
-					al->free(al, qs);
-				}
+			if ((qs = quote_cs(al, t->kdata[i])) == NULL) {
+				al->free(al, sfield);
+				return err(p,-2,"quote_cs() malloc failed!");
 			}
-	
-			if (fp->gprintf(fp,"NUMBER_OF_FIELDS %d\n",t->nfields) < 0)
-				goto write_error;
-			if (fp->gprintf(fp,"BEGIN_DATA_FORMAT\n") < 0)
+			if (fp->gprintf(fp,"%s %s%s",t->ksym[i],qs,
+			    t->kcom[i] == NULL ? "\n":"\t") < 0) {
+				al->free(al, qs);
 				goto write_error;
-			for (field = 0; field < t->nfields; field ++) {
-				DBGF((DBGA,"CGATS writing field %d\n",field));
-				if (fp->gprintf(fp,"%s ",t->fsym[field]) < 0)
-					goto write_error;
 			}
-			if (fp->gprintf(fp,"\nEND_DATA_FORMAT\n") < 0)
+			al->free(al, qs);
+		}
+		/* Comment if its present */
+		if (t->kcom[i] != NULL) {
+			if (fp->gprintf(fp,"# %s\n",t->kcom[i]) < 0) {
+				al->free(al, qs);
 				goto write_error;
-		} else { /* Check that it is safe to suppress fields */
-			cgats_table *pt = &p->t[table-1];
-			if (table == 0) {
-				al->free(al, sfield);
-				return err(p,-1,"cgats_write(), Fields should not be suppressed on first table");
 			}
-			if (t->nfields != pt->nfields) {
-				al->free(al, sfield);
-				return err(p,-1,"cgats_write(), Fields should not be suppressed when table %d different number than previous table",table);
-			}
-			for (field = 0; field < t->nfields; field ++)
-				if (strcmp(t->fsym[field],pt->fsym[field]) != 0
-				 || t->ftype[field] != pt->ftype[field]) {
-					al->free(al, sfield);
-					return err(p,-1,"cgats_write(), Fields should not be suppressed when table %d types is not the same as previous table",table);
-				}
 		}
+	}
 
-		/* Then the actual data */
-		if (fp->gprintf(fp,"\nNUMBER_OF_SETS %d\n",t->nsets) < 0)
-			goto write_error;
-		if (fp->gprintf(fp,"BEGIN_DATA\n") < 0)
+	/* Then the field specification */
+	if (!t->sup_fields) {	/* If not suppressed */
+		if (fp->gprintf(fp,"\n") < 0)
 			goto write_error;
-		for (set = 0; set < t->nsets; set++) {
-			DBGF((DBGA,"CGATS writing set %d\n",set));
-			for (field = 0; field < t->nfields; field++) {
-				data_type tt;
-				if (t->ftype[field] == r_t) {
-					char fmt[30];
-					double val = *((double *)t->fdata[set][field]);
-					real_format(val, REAL_SIGDIG, fmt);
- 					strcat(fmt," ");
-					if (fp->gprintf(fp,fmt,val) < 0)
-						goto write_error;
-				} else if (t->ftype[field] == i_t) {
-					if (fp->gprintf(fp,"%d ",*((int *)t->fdata[set][field])) < 0)
-						goto write_error;
-				} else if (t->ftype[field] == nqcs_t
-				      && !cs_has_ws((char *)t->fdata[set][field])
-				      && (sfield[field] || (tt = guess_type((char *)t->fdata[set][field]),
-				                            tt != i_t && tt != r_t))) {
-					/* We can only print a non-quote string if it doesn't contain white space, */
-					/* quote or comment characters, and if it is a standard field or */
-					/* can't be mistaken for a number. */
-					if (fp->gprintf(fp,"%s ",(char *)t->fdata[set][field]) < 0)
-						goto write_error;
-				} else if (t->ftype[field] == nqcs_t
-				      || t->ftype[field] == cs_t) {
-					char *qs;
-					if ((qs = quote_cs(al, (char *)t->fdata[set][field])) == NULL) {
-						al->free(al, sfield);
-						return err(p,-2,"quote_cs() malloc failed!");
-					}
-					if (fp->gprintf(fp,"%s ",qs) < 0) {
-						al->free(al, qs);
-						goto write_error;
-					}
-					al->free(al, qs);
-				} else {
+
+		/* Declare any non-standard fields */
+		for (field = 0; field < t->nfields; field++) {
+			if (p->emit_keywords && !sfield[field])	/* Non-standard */ {
+				char *qs;
+				if ((qs = quote_cs(al, t->fsym[field])) == NULL) {
 					al->free(al, sfield);
-					return err(p,-1,"cgats_write(), illegal data type found");
+					return err(p,-2,"quote_cs() malloc failed!");
 				}
+				if (fp->gprintf(fp,"KEYWORD %s\n",qs) < 0) {
+					al->free(al, qs);
+					goto write_error;
+				}
+				al->free(al, qs);
 			}
-			if (fp->gprintf(fp,"\n") < 0)
+		}
+
+		if (fp->gprintf(fp,"NUMBER_OF_FIELDS %d\n",t->nfields) < 0)
+			goto write_error;
+		if (fp->gprintf(fp,"BEGIN_DATA_FORMAT\n") < 0)
+			goto write_error;
+		for (field = 0; field < t->nfields; field ++) {
+			DBGF((DBGA,"CGATS writing field %d\n",field));
+			if (fp->gprintf(fp,"%s ",t->fsym[field]) < 0)
 				goto write_error;
 		}
-		if (fp->gprintf(fp,"END_DATA\n") < 0)
+		if (fp->gprintf(fp,"\nEND_DATA_FORMAT\n") < 0)
 			goto write_error;
+	} else { /* Check that it is safe to suppress fields */
+		cgats_table *pt = &p->t[table-1];
+		if (table == 0) {
+			al->free(al, sfield);
+			return err(p,-1,"cgats_write(), Fields should not be suppressed on first table");
+		}
+		if (t->nfields != pt->nfields) {
+			al->free(al, sfield);
+			return err(p,-1,"cgats_write(), Fields should not be suppressed when table %d different number than previous table",table);
+		}
+		for (field = 0; field < t->nfields; field ++)
+			if (strcmp(t->fsym[field],pt->fsym[field]) != 0
+			 || t->ftype[field] != pt->ftype[field]) {
+				al->free(al, sfield);
+				return err(p,-1,"cgats_write(), Fields should not be suppressed when table %d types is not the same as previous table",table);
+			}
+	}
 
-		if (sfield != NULL)
+	/* Then the actual data */
+	if (stream) {
+		if (fp->gprintf(fp,"\nNUMBER_OF_SETS ") < 0)
+			goto write_error;
+		if ((p->snsoff = fp->tell(fp)) < 0) {
 			al->free(al, sfield);
-		sfield = NULL;
+			return err(p,-1,"cgats.stream_start(), can't stream to file '%s'",fp->fname(fp));
+		}
+		if (fp->gprintf(fp,"%-10d\n",t->nsets) < 0)
+			goto write_error;
+	} else {
+		if (fp->gprintf(fp,"\nNUMBER_OF_SETS %d\n",t->nsets) < 0)
+			goto write_error;
+	}
+	if (fp->gprintf(fp,"BEGIN_DATA\n") < 0)
+		goto write_error;
+	for (set = 0; set < t->nsets; set++) {
+		DBGF((DBGA,"CGATS writing set %d\n",set));
+		if (write_set(p, fp, t, sfield, t->fdata[set]) < 0) {
+			al->free(al, sfield);
+			return p->errc;
+		}
+	}
+	if (stream) {
+		p->ssfield = sfield;
+		return 0;
 	}
+	if (fp->gprintf(fp,"END_DATA\n") < 0)
+		goto write_error;
+
+	if (sfield != NULL)
+		al->free(al, sfield);
 	return 0;
 
 write_error:
@@ -1615,6 +1705,697 @@ write_error:
 	return p->errc;
 }
 
+/* Write a line of set values of table t, given the standard field */
+/* flags sfield[], and pointers to the values of each field. */
+/* Return -ve, errc & err if there was an error */
+static int
+write_set(cgats *p, cgatsFile *fp, cgats_table *t, int *sfield, void **set) {
+	cgatsAlloc *al = p->al;
+	int field;
+
+	for (field = 0; field < t->nfields; field++) {
+		data_type tt;
+		if (t->ftype[field] == r_t) {
+			char fmt[30];
+			double val = *((double *)set[field]);
+			real_format(val, REAL_SIGDIG, fmt);
+			strcat(fmt," ");
+			if (fp->gprintf(fp,fmt,val) < 0)
+				goto write_error;
+		} else if (t->ftype[field] == i_t) {
+			if (fp->gprintf(fp,"%d ",*((int *)set[field])) < 0)
+				goto write_error;
+		} else if (t->ftype[field] == nqcs_t
+		      && !cs_has_ws((char *)set[field])
+		      && (sfield[field] || (tt = guess_type((char *)set[field]),
+		                            tt != i_t && tt != r_t))) {
+			/* We can only print a non-quote string if it doesn't contain white space, */
+			/* quote or comment characters, and if it is a standard field or */
+			/* can't be mistaken for a number. */
+			if (fp->gprintf(fp,"%s ",(char *)set[field]) < 0)
+				goto write_error;
+		} else if (t->ftype[field] == nqcs_t
+		      || t->ftype[field] == cs_t) {
+			char *qs;
+			if ((qs = quote_cs(al, (char *)set[field])) == NULL)
+				return err(p,-2,"quote_cs() malloc failed!");
+			if (fp->gprintf(fp,"%s ",qs) < 0) {
+				al->free(al, qs);
+				goto write_error;
+			}
+			al->free(al, qs);
+		} else {
+			return err(p,-1,"cgats_write(), illegal data type found");
+		}
+	}
+	if (fp->gprintf(fp,"\n") < 0)
+		goto write_error;
+	return 0;
+
+write_error:
+	return err(p,-1,"Write error to file '%s'",fp->fname(fp));
+}
+
+/* Start writing the tables to fp, with the sets of the given table */
+/* streamed rather than held in memory. */
+/* Return -ve, errc & err if there was an error */
+static int
+stream_start(cgats *p, cgatsFile *fp, int table) {
+	cgatsAlloc *al = p->al;
+	int i;
+
+	p->errc = 0;
+	p->err[0] = '\000';
+	if (p->sfp != NULL)
+		return err(p,-1,"cgats.stream_start(), already streaming");
+	if (table < 0 || table >= p->ntables)
+		return err(p,-1,"cgats.stream_start(), table parameter out of range");
+	if (p->binary)
+		return err(p,-1,"cgats.stream_start(), the binary form can't be streamed");
+
+	/* The set count is patched on close, so the file must be seekable */
+	if (fp->tell(fp) < 0 || fp->seek(fp, fp->tell(fp)) != 0)
+		return err(p,-1,"cgats.stream_start(), can't stream to file '%s'",fp->fname(fp));
+
+	/* Write the preceding tables */
+	for (i = 0; i < table; i++) {
+		if (write_table(p, fp, i, 0) < 0)
+			return p->errc;
+	}
+
+	if (p->t[table].nfields > 0) {
+		if ((p->svals = (void **)al->malloc(al, p->t[table].nfields * sizeof(void *))) == NULL)
+			return err(p,-2,"cgats.stream_start(), malloc failed!");
+	}
+	if (write_table(p, fp, table, 1) < 0) {
+		if (p->svals != NULL)
+			al->free(al, p->svals);
+		p->svals = NULL;
+		return p->errc;
+	}
+	p->sfp = fp;
+	p->stable = table;
+	p->snsets = 0;
+
+	return 0;
+}
+
+/* Write a set of data from an array to the streamed table */
+/* Return -ve, errc & err if there was an error */
+static int
+stream_setarr(cgats *p, cgats_set_elem *args) {
+	cgats_table *t;
+	int i;
+
+	p->errc = 0;
+	p->err[0] = '\000';
+	if (p->sfp == NULL)
+		return err(p,-1,"cgats.stream_setarr(), not streaming");
+	t = &p->t[p->stable];
+
+	if (t->nfields == 0)
+		return err(p,-1,"cgats.stream_setarr(), attempt to add set when no fields are defined");
+
+	for (i = 0; i < t->nfields; i++) {
+		switch(t->ftype[i]) {
+			case r_t:
+				p->svals[i] = (void *)&args[i].d;
+				break;
+			case i_t:
+				p->svals[i] = (void *)&args[i].i;
+				break;
+			case cs_t:
+			case nqcs_t:
+				p->svals[i] = (void *)args[i].c;
+				break;
+			default:
+				return err(p,-1,"cgats.stream_setarr(), field has unknown data type");
+		}
+	}
+
+	if (write_set(p, p->sfp, t, p->ssfield, p->svals) < 0)
+		return p->errc;
+	p->snsets++;
+
+	return 0;
+}
+
+/* Finish the streamed table, and write any following tables. */
+/* Return -ve, errc & err if there was an error */
+static int
+stream_end(cgats *p) {
+	cgatsAlloc *al = p->al;
+	cgatsFile *fp = p->sfp;
+	long eoff;
+	char nsbuf[20];
+	int i, rv = 0;
+
+	p->errc = 0;
+	p->err[0] = '\000';
+	if (fp == NULL)
+		return err(p,-1,"cgats.stream_end(), not streaming");
+
+	/* Finish the table, and patch its NUMBER_OF_SETS */
+	sprintf(nsbuf,"%-10d",p->t[p->stable].nsets + p->snsets);
+	if (fp->gprintf(fp,"END_DATA\n") < 0
+	 || (eoff = fp->tell(fp)) < 0
+	 || fp->seek(fp, p->snsoff) != 0
+	 || fp->write(fp, nsbuf, 1, 10) != 10
+	 || fp->seek(fp, eoff) != 0)
+		rv = err(p,-1,"Write error to file '%s'",fp->fname(fp));
+
+	if (p->ssfield != NULL)
+		al->free(al, p->ssfield);
+	if (p->svals != NULL)
+		al->free(al, p->svals);
+	p->ssfield = NULL;
+	p->svals = NULL;
+	p->sfp = NULL;
+	if (rv < 0)
+		return rv;
+
+	/* Write the following tables */
+	for (i = p->stable+1; i < p->ntables; i++) {
+		if (write_table(p, fp, i, 0) < 0)
+			return p->errc;
+	}
+	return 0;
+}
+
+/* ------------------------------------------- */
+/* Binary form of a cgats file. */
+/* This holds exactly the in-memory tables, with each field stored */
+/* as a column of its type, so that it can be loaded without any text */
+/* parsing or conversion, and written back out as text identically. */
+/*
+	Layout (all integers 32 bit little endian):
+
+	magic[8]				CGATSB_MAGIC
+	version					CGATSB_VERSION
+	cgats_type				string
+	ntables
+	per table:
+		tt					table_type
+		identifier			string, only if tt == tt_other
+		nkwords
+		per keyword:		ksym, kdata, kcom strings
+		nfields
+		per field:			fsym string, ftype
+		nsets
+		per field:			the column of nsets values -
+							r_t:  8 byte little endian IEEE doubles
+							i_t:  integers
+							cs_t, nqcs_t: byte count, then nul terminated strings
+	checksum				Adler-32 of everything after the magic number
+
+	A string is its length followed by its characters, with a
+	length of 0xffffffff for a NULL pointer.
+ */
+
+#define CGATSB_VERSION 1
+#define CGATSB_NULLSTR 0xffffffff
+
+/* Binary I/O context */
+typedef struct {
+	cgats *p;
+	cgatsFile *fp;
+	unsigned int s1, s2;	/* Adler-32 sums */
+	size_t fsize;			/* File size if known, 0 if not */
+} cgatsb_io;
+
+static int cgatsb_le = -1;	/* nz if host is little endian, -1 if unknown */
+
+/* Return nz if the host is little endian */
+static int cgatsb_is_le(void) {
+	if (cgatsb_le < 0) {
+		unsigned int t = 1;
+		cgatsb_le = *((unsigned char *)&t) == 1;
+	}
+	return cgatsb_le;
+}
+
+/* Add bytes to the checksum */
+static void cgatsb_sum(cgatsb_io *b, unsigned char *buf, size_t len) {
+	unsigned int s1 = b->s1, s2 = b->s2;
+
+	while (len > 0) {
+		size_t n = len > 5552 ? 5552 : len;	/* Max before s2 can overflow */
+		len -= n;
+		for (; n > 0; n--) {
+			s1 += *buf++;
+			s2 += s1;
+		}
+		s1 %= 65521;
+		s2 %= 65521;
+	}
+	b->s1 = s1;
+	b->s2 = s2;
+}
+
+static unsigned int cgatsb_adler(cgatsb_io *b) {
+	return (b->s2 << 16) | b->s1;
+}
+
+/* Write bytes. Return nz on error */
+static int cgatsb_write(cgatsb_io *b, void *buf, size_t len) {
+	if (len == 0)
+		return 0;
+	cgatsb_sum(b, (unsigned char *)buf, len);
+	return b->fp->write(b->fp, buf, 1, len) != len;
+}
+
+/* Read bytes. Return nz on error */
+static int cgatsb_read(cgatsb_io *b, void *buf, size_t len) {
+	if (len == 0)
+		return 0;
+	if (b->fp->read(b->fp, buf, 1, len) != len)
+		return 1;
+	cgatsb_sum(b, (unsigned char *)buf, len);
+	return 0;
+}
+
+static void cgatsb_enc32(unsigned char *bp, unsigned int v) {
+	bp[0] = (unsigned char)v;
+	bp[1] = (unsigned char)(v >> 8);
+	bp[2] = (unsigned char)(v >> 16);
+	bp[3] = (unsigned char)(v >> 24);
+}
+
+static unsigned int cgatsb_dec32(unsigned char *bp) {
+	return bp[0] | (bp[1] << 8) | (bp[2] << 16) | ((unsigned int)bp[3] << 24);
+}
+
+/* Encode/decode a double as 8 little endian bytes */
+static void cgatsb_encd(unsigned char *bp, double v) {
+	if (cgatsb_is_le())
+		memcpy(bp, &v, 8);
+	else {
+		unsigned char *sp = (unsigned char *)&v;
+		int i;
+		for (i = 0; i < 8; i++)
+			bp[i] = sp[7-i];
+	}
+}
+
+static double cgatsb_decd(unsigned char *bp) {
+	double v;
+	if (cgatsb_is_le())
+		memcpy(&v, bp, 8);
+	else {
+		unsigned char *dp = (unsigned char *)&v;
+		int i;
+		for (i = 0; i < 8; i++)
+			dp[i] = bp[7-i];
+	}
+	return v;
+}
+
+static int cgatsb_w32(cgatsb_io *b, unsigned int v) {
+	unsigned char buf[4];
+	cgatsb_enc32(buf, v);
+	return cgatsb_write(b, buf, 4);
+}
+
+static int cgatsb_r32(cgatsb_io *b, unsigned int *v) {
+	unsigned char buf[4];
+	if (cgatsb_read(b, buf, 4))
+		return 1;
+	*v = cgatsb_dec32(buf);
+	return 0;
+}
+
+static int cgatsb_wstr(cgatsb_io *b, const char *s) {
+	size_t len;
+
+	if (s == NULL)
+		return cgatsb_w32(b, CGATSB_NULLSTR);
+	len = strlen(s);
+	if (cgatsb_w32(b, (unsigned int)len))
+		return 1;
+	return cgatsb_write(b, (void *)s, len);
+}
+
+/* Return nz if a count of elements of size bytes can't fit in the file */
+static int cgatsb_toobig(cgatsb_io *b, unsigned int count, size_t size) {
+	if (size > 0 && (size_t)count > ((size_t)-1)/size)
+		return 1;
+	return b->fsize > 0 && (size_t)count * size > b->fsize;
+}
+
+/* Read a string allocated with the cgats allocator. */
+/* Return nz on error, and *s = NULL */
+static int cgatsb_rstr(cgatsb_io *b, char **s) {
+	cgatsAlloc *al = b->p->al;
+	unsigned int len;
+
+	*s = NULL;
+	if (cgatsb_r32(b, &len))
+		return 1;
+	if (len == CGATSB_NULLSTR)
+		return 0;
+	if (cgatsb_toobig(b, len, 1)
+	 || (*s = (char *)al->malloc(al, len + 1)) == NULL)
+		return 1;
+	if (cgatsb_read(b, *s, len)) {
+		al->free(al, *s);
+		*s = NULL;
+		return 1;
+	}
+	(*s)[len] = '\000';
+	return 0;
+}
+
+/* Write the tables in binary form */
+/* Return -ve, errc & err if there was an error */
+static int
+cgats_write_bin(cgats *p, cgatsFile *fp) {
+	cgatsAlloc *al = p->al;
+	cgatsb_io b;
+	unsigned char *cbuf = NULL;		/* Column buffer */
+	size_t cbufs = 0;
+	int table, i, j;
+
+	p->errc = 0;
+	p->err[0] = '\000';
+
+	b.p = p;
+	b.fp = fp;
+	b.s1 = 1;
+	b.s2 = 0;
+	b.fsize = 0;
+
+	if (fp->write(fp, (void *)CGATSB_MAGIC, 1, CGATSB_MAGIC_LEN) != CGATSB_MAGIC_LEN
+	 || cgatsb_w32(&b, CGATSB_VERSION)
+	 || cgatsb_wstr(&b, p->cgats_type)
+	 || cgatsb_w32(&b, p->ntables))
+		goto write_error;
+
+	for (table = 0; table < p->ntables; table++) {
+		cgats_table *t = &p->t[table];
+
+		if (cgatsb_w32(&b, t->tt)
+		 || (t->tt == tt_other && cgatsb_wstr(&b, p->others[t->oi]))
+		 || cgatsb_w32(&b, t->nkwords))
+			goto write_error;
+		for (i = 0; i < t->nkwords; i++) {
+			if (cgatsb_wstr(&b, t->ksym[i])
+			 || cgatsb_wstr(&b, t->kdata[i])
+			 || cgatsb_wstr(&b, t->kcom[i]))
+				goto write_error;
+		}
+
+		if (cgatsb_w32(&b, t->nfields))
+			goto write_error;
+		for (i = 0; i < t->nfields; i++) {
+			if (cgatsb_wstr(&b, t->fsym[i])
+			 || cgatsb_w32(&b, t->ftype[i]))
+				goto write_error;
+		}
+
+		if (cgatsb_w32(&b, t->nsets))
+			goto write_error;
+		for (i = 0; i < t->nfields; i++) {
+			size_t cs = 0;
+
+			/* Size of the column */
+			if (t->ftype[i] == r_t)
+				cs = 8 * t->nsets;
+			else if (t->ftype[i] == i_t)
+				cs = 4 * t->nsets;
+			else if (t->ftype[i] == cs_t || t->ftype[i] == nqcs_t) {
+				for (j = 0; j < t->nsets; j++)
+					cs += strlen((char *)t->fdata[j][i]) + 1;
+			} else {
+				if (cbuf != NULL)
+					al->free(al, cbuf);
+				return err(p,-1,"cgats.write(), field has unknown data type");
+			}
+
+			if (cs > cbufs) {
+				unsigned char *nb;
+				if ((nb = (unsigned char *)al->realloc(al, cbuf, cs)) == NULL) {
+					if (cbuf != NULL)
+						al->free(al, cbuf);
+					return err(p,-2,"cgats.write(), realloc failed!");
+				}
+				cbuf = nb;
+				cbufs = cs;
+			}
+
+			/* Encode it */
+			if (t->ftype[i] == r_t) {
+				for (j = 0; j < t->nsets; j++)
+					cgatsb_encd(cbuf + 8 * j, *((double *)t->fdata[j][i]));
+			} else if (t->ftype[i] == i_t) {
+				for (j = 0; j < t->nsets; j++)
+					cgatsb_enc32(cbuf + 4 * j, (unsigned int)*((int *)t->fdata[j][i]));
+			} else {
+				unsigned char *bp = cbuf;
+				for (j = 0; j < t->nsets; j++) {
+					size_t len = strlen((char *)t->fdata[j][i]) + 1;
+					memcpy(bp, t->fdata[j][i], len);
+					bp += len;
+				}
+				if (cgatsb_w32(&b, (unsigned int)cs))
+					goto write_error;
+			}
+			if (cgatsb_write(&b, cbuf, cs))
+				goto write_error;
+		}
+	}
+
+	{
+		unsigned char buf[4];
+		cgatsb_enc32(buf, cgatsb_adler(&b));
+		if (fp->write(fp, buf, 1, 4) != 4)
+			goto write_error;
+	}
+
+	if (cbuf != NULL)
+		al->free(al, cbuf);
+	return 0;
+
+write_error:
+	if (cbuf != NULL)
+		al->free(al, cbuf);
+	return err(p,-1,"Write error to file '%s'",fp->fname(fp));
+}
+
+/* Free a binary read table column buffers */
+static void cgatsb_free_cols(cgatsAlloc *al, unsigned char **cols, int nfields) {
+	int k;
+
+	if (cols == NULL)
+		return;
+	for (k = 0; k < nfields; k++) {
+		if (cols[k] != NULL)
+			al->free(al, cols[k]);
+	}
+	al->free(al, cols);
+}
+
+/* Read the binary form, after the magic number has been read. */
+/* return -ve and errc and err set on error */
+static int
+cgats_read_bin(cgats *p, cgatsFile *fp) {
+	cgatsAlloc *al = p->al;
+	cgatsb_io b;
+	unsigned int ver, ntables, tn;
+	unsigned int nfields = 0, k;
+	unsigned char **cols = NULL;	/* Column data for each field, then cursors */
+	cgats_set_elem *args = NULL;	/* Values of a set */
+	char *s1 = NULL, *s2 = NULL, *s3 = NULL;
+	unsigned char buf[4];
+
+	p->errc = 0;
+	p->err[0] = '\000';
+
+	b.p = p;
+	b.fp = fp;
+	b.s1 = 1;
+	b.s2 = 0;
+	b.fsize = fp->get_size(fp);
+
+	if (cgatsb_r32(&b, &ver))
+		goto read_error;
+	if (ver != CGATSB_VERSION)
+		return err(p,-1,"Binary CGATS file '%s' has unknown version %u",fp->fname(fp),ver);
+
+	if (cgatsb_rstr(&b, &s1))
+		goto read_error;
+	if (s1 != NULL) {
+		if (p->cgats_type != NULL)
+			al->free(al, p->cgats_type);
+		p->cgats_type = s1;
+		s1 = NULL;
+	}
+
+	if (cgatsb_r32(&b, &ntables))
+		goto read_error;
+
+	for (tn = 0; tn < ntables; tn++) {
+		unsigned int tt, nkwords, nsets, j;
+		int oi = 0, table;
+		cgats_table *t;
+
+		if (cgatsb_r32(&b, &tt) || tt >= tt_none)
+			goto read_error;
+
+		if (tt == tt_other) {		/* Match the identifier to an "other" */
+			int iswild = 0;
+
+			if (cgatsb_rstr(&b, &s1) || s1 == NULL)
+				goto read_error;
+			for (oi = 0; oi < p->nothers; oi++) {
+				if (p->others[oi][0] == '\000')
+					iswild = 1;
+				else if (strcmp(s1, p->others[oi]) == 0)
+					break;
+			}
+			if (oi >= p->nothers) {
+				if (!iswild) {
+					err(p,-1,"Error in file '%s': Unknown file identifier '%s'",fp->fname(fp),s1);
+					goto error;
+				}
+				if ((oi = add_other(p, s1)) == -2)
+					goto error;
+			}
+			al->free(al, s1);
+			s1 = NULL;
+		}
+
+		if ((table = add_table(p, (table_type)tt, oi)) < 0)
+			goto error;
+		t = &p->t[table];
+
+		if (cgatsb_r32(&b, &nkwords))
+			goto read_error;
+		for (k = 0; k < nkwords; k++) {
+			if (cgatsb_rstr(&b, &s1) || cgatsb_rstr(&b, &s2) || cgatsb_rstr(&b, &s3))
+				goto read_error;
+			if (add_kword_at(p, table, -1, s1, s2, s3) < 0)
+				goto error;
+			if (s1 != NULL)
+				al->free(al, s1);
+			if (s2 != NULL)
+				al->free(al, s2);
+			if (s3 != NULL)
+				al->free(al, s3);
+			s1 = s2 = s3 = NULL;
+		}
+
+		if (cgatsb_r32(&b, &nfields) || cgatsb_toobig(&b, nfields, 8))
+			goto read_error;
+		for (k = 0; k < nfields; k++) {
+			unsigned int ft;
+			if (cgatsb_rstr(&b, &s1) || s1 == NULL || cgatsb_r32(&b, &ft) || ft >= none_t)
+				goto read_error;
+			if (add_field(p, table, s1, none_t) < 0)
+				goto error;
+			t->ftype[k] = (data_type)ft;
+			al->free(al, s1);
+			s1 = NULL;
+		}
+
+		if (cgatsb_r32(&b, &nsets) || cgatsb_toobig(&b, nsets, nfields))
+			goto read_error;
+		if (nsets == 0)
+			continue;
+		if (nfields == 0)
+			goto read_error;
+
+		/* Read each column into its own buffer */
+		if ((cols = (unsigned char **)al->calloc(al, 2 * nfields, sizeof(unsigned char *))) == NULL
+		 || (args = (cgats_set_elem *)al->malloc(al, nfields * sizeof(cgats_set_elem))) == NULL) {
+			err(p,-2,"cgats.read(), malloc failed!");
+			goto error;
+		}
+		for (k = 0; k < nfields; k++) {
+			unsigned int cs, l, nz;
+
+			if (t->ftype[k] == r_t || t->ftype[k] == i_t) {
+				size_t es = t->ftype[k] == r_t ? 8 : 4;
+				if (cgatsb_toobig(&b, nsets, es))
+					goto read_error;
+				cs = nsets * es;
+			} else if (cgatsb_r32(&b, &cs) || cs == 0 || cgatsb_toobig(&b, cs, 1))
+				goto read_error;
+			if ((cols[k] = (unsigned char *)al->malloc(al, cs)) == NULL) {
+				err(p,-2,"cgats.read(), malloc failed!");
+				goto error;
+			}
+			cols[nfields + k] = cols[k];
+			if (cgatsb_read(&b, cols[k], cs))
+				goto read_error;
+
+			/* Check the strings are all there */
+			if (t->ftype[k] == cs_t || t->ftype[k] == nqcs_t) {
+				for (nz = l = 0; l < cs; l++) {
+					if (cols[k][l] == '\000')
+						nz++;
+				}
+				if (nz != nsets || cols[k][cs-1] != '\000')
+					goto read_error;
+			}
+		}
+
+		/* Assemble the sets */
+		for (j = 0; j < nsets; j++) {
+			for (k = 0; k < nfields; k++) {
+				unsigned char *cp = cols[nfields + k];
+
+				if (t->ftype[k] == r_t) {
+					args[k].d = cgatsb_decd(cp);
+					cp += 8;
+				} else if (t->ftype[k] == i_t) {
+					args[k].i = (int)cgatsb_dec32(cp);
+					cp += 4;
+				} else {
+					args[k].c = (char *)cp;
+					cp += strlen((char *)cp) + 1;
+				}
+				cols[nfields + k] = cp;
+			}
+			if (t->nsets >= t->nsetsa && grow_sets(al, t, 0)) {
+				err(p,-2,"cgats.read(), realloc failed!");
+				goto error;
+			}
+			if ((t->fdata[t->nsets] = alloc_set(al, t, args)) == NULL) {
+				err(p,-2,"cgats.read(), malloc failed!");
+				goto error;
+			}
+			t->nsets++;
+		}
+
+		cgatsb_free_cols(al, cols, nfields);
+		cols = NULL;
+		al->free(al, args);
+		args = NULL;
+	}
+
+	/* Check the checksum */
+	if (fp->read(fp, buf, 1, 4) != 4)
+		goto read_error;
+	if (cgatsb_dec32(buf) != cgatsb_adler(&b))
+		return err(p,-1,"Binary CGATS file '%s' has a bad checksum",fp->fname(fp));
+
+	return 0;
+
+read_error:
+	err(p,-1,"Binary CGATS file '%s' is truncated or corrupt",fp->fname(fp));
+error:
+	if (s1 != NULL)
+		al->free(al, s1);
+	if (s2 != NULL)
+		al->free(al, s2);
+	if (s3 != NULL)
+		al->free(al, s3);
+	cgatsb_free_cols(al, cols, nfields);
+	if (args != NULL)
+		al->free(al, args);
+	return p->errc;
+}
+
 /* Allocate space for data with given type, and copy it from source */
 /* Return NULL if alloc failed, or unknown data type */
 static void *
@@ -1649,6 +2430,110 @@ alloc_copy_data_type(cgatsAlloc *al, data_type dtype, void *dpoint) {
 	return NULL;	/* Shut the compiler up */
 }
 
+/* Allocate a set of values for table t, and copy them from args[]. */
+/* The pointers to the values and the values themselves are in a */
+/* single allocation, to avoid a heap allocation per value. */
+/* Return NULL if alloc failed */
+static void **
+alloc_set(cgatsAlloc *al, cgats_table *t, cgats_set_elem *args) {
+	size_t sz, vo;
+	int i;
+	void **set;
+	char *bp;
+
+	/* Pointers, then 8 byte aligned numbers, then strings */
+	vo = (t->nfields * sizeof(void *) + sizeof(double)-1) & ~(sizeof(double)-1);
+	sz = vo;
+	for (i = 0; i < t->nfields; i++) {
+		if (t->ftype[i] == r_t || t->ftype[i] == i_t)
+			sz += sizeof(double);
+	}
+	for (i = 0; i < t->nfields; i++) {
+		if (t->ftype[i] == cs_t || t->ftype[i] == nqcs_t)
+			sz += strlen(args[i].c) + 1;
+	}
+
+	if ((set = (void **)al->malloc(al, sz)) == NULL)
+		return NULL;
+	bp = (char *)set + vo;
+
+	for (i = 0; i < t->nfields; i++) {
+		if (t->ftype[i] == r_t) {
+			*((double *)bp) = args[i].d;
+			set[i] = (void *)bp;
+			bp += sizeof(double);
+		} else if (t->ftype[i] == i_t) {
+			*((int *)bp) = args[i].i;
+			set[i] = (void *)bp;
+			bp += sizeof(double);
+		} else
+			set[i] = NULL;
+	}
+	for (i = 0; i < t->nfields; i++) {
+		if (t->ftype[i] == cs_t || t->ftype[i] == nqcs_t) {
+			strcpy(bp, args[i].c);
+			set[i] = (void *)bp;
+			bp += strlen(bp) + 1;
+		}
+	}
+	return set;
+}
+
+#define RFAB_SIZE 65536		/* Read text block size */
+
+/* Allocate pointer aligned space in the read text blocks of table t. */
+/* These are only freed when the table is. */
+/* Return NULL if alloc failed */
+static void *
+alloc_rfab(cgatsAlloc *al, cgats_table *t, size_t size) {
+	char *rv;
+
+	size = (size + sizeof(char *)-1) & ~(sizeof(char *)-1);
+
+	if (t->rfab == NULL || (t->rfabo + size) > t->rfabs) {
+		size_t bs = RFAB_SIZE;
+		char *nb;
+
+		if ((size + sizeof(double)) > bs)
+			bs = size + sizeof(double);
+		if ((nb = (char *)al->malloc(al, bs)) == NULL)
+			return NULL;
+		*((char **)nb) = t->rfab;		/* Link to previous block */
+		t->rfab = nb;
+		t->rfabo = sizeof(double);
+		t->rfabs = bs;
+	}
+	rv = t->rfab + t->rfabo;
+	t->rfabo += size;
+
+	return (void *)rv;
+}
+
+/* Grow the allocation of set pointers of table t, */
+/* including the read text pointers if rf is nz or they exist. */
+/* Return nz if the realloc failed */
+static int
+grow_sets(cgatsAlloc *al, cgats_table *t, int rf) {
+	int nsetsa;
+	void ***fdata;
+
+	/* Double the allocation, starting at 100 */
+	nsetsa = t->nsetsa < 50 ? 100 : 2 * t->nsetsa;
+
+	if (rf || t->rfdata != NULL) {
+		char ***rfdata;
+		if ((rfdata = (char ***)al->realloc(al, t->rfdata, nsetsa * sizeof(char **))) == NULL)
+			return 1;
+		t->rfdata = rfdata;
+	}
+	if ((fdata = (void ***)al->realloc(al, t->fdata, nsetsa * sizeof(void **))) == NULL)
+		return 1;
+	t->fdata = fdata;
+	t->nsetsa = nsetsa;
+
+	return 0;
+}
+
 /* See if the keyword name is a standard one */
 /* Return non-zero if it is standard */
 static int
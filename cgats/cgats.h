@@ -67,6 +67,15 @@ struct _cgats_table {
 	int nsetsa;			/* Number of sets allocated */
 	char **kcom;		/* Pointer to [nkwords] array of pointers to keyword comments */
 	int ndf;			/* Next data field - used by add_data_item() */
+	char *rfab;			/* Current block of read file text, used by add_data_item() */
+	size_t rfabo;		/* Next offset in current block */
+	size_t rfabs;		/* Size of current block */
+	int *khash;			/* Keyword name hash index of keyword index + 1, 0 if empty */
+	int khashs;			/* Size of khash[], a power of 2 */
+	int khashn;			/* Number of keywords entered in khash[] */
+	int *fhash;			/* Field name hash index of field index + 1, 0 if empty */
+	int fhashs;			/* Size of fhash[], a power of 2 */
+	int fhashn;			/* Number of fields entered in fhash[] */
 	int sup_id;			/* Set to non-zero if table ID output is to be suppressed */
 	int sup_kwords;		/* Set to non-zero if table default keyword output is to be suppressed */
 	int sup_fields;		/* Set to non-zero if table field output is to be suppressed */
@@ -76,6 +85,12 @@ struct _cgats {
 	/* Private */
 	cgatsAlloc *al;		/* Memory allocator */
 	int del_al;			/* Flag to indicate we al->del() */
+	cgatsFile *sfp;		/* File sets are being streamed to, NULL if none */
+	int stable;			/* Table being streamed */
+	int snsets;			/* Number of sets streamed */
+	long snsoff;		/* File offset of the NUMBER_OF_SETS value */
+	int *ssfield;		/* Standard field flags of the streamed table */
+	void **svals;		/* Pointers to streamed set values */
 
 	/* Read only Variables */
 	int ntables;		/* Number of tables */
@@ -91,6 +106,9 @@ struct _cgats {
 
 	/* Options */
 	int emit_keywords;	/* NZ to emit "KEYWORD" for non-standard keywords (default no) */
+	int binary;			/* NZ to write the binary form (default no). The binary form */
+						/* holds the tables exactly, and is recognised by read(), */
+						/* but read file text values (rfdata) are not available. */
 
 	/* Public Methods */
 	int (*set_cgats_type)(struct _cgats *p, const char *osym);
@@ -120,6 +138,11 @@ struct _cgats {
 	int (*find_field)(struct _cgats *p, int table, const char *fsym);
 												/* Return index of the field, -1 on fail */
 												/* -2 on illegal table index, errc & err */
+	int (*find_fields)(struct _cgats *p, int table, int nf, char **fsyms, int *fix);
+												/* Set fix[nf] to the index of each of the */
+												/* fields fsyms[nf], -1 if not present. */
+												/* Return the number of fields found, */
+												/* -2 on illegal table index, errc & err */
 
 	int (*add_table)(struct _cgats *p, table_type tt, int oi);
 	                                        /* Add a new (empty) table to the structure */
@@ -147,6 +170,19 @@ struct _cgats {
 	int (*write)(struct _cgats *p, cgatsFile *fp);	/* Write structure into cgats file */
 										/* return -ve and errc and err set on error */
 
+	int (*stream_start)(struct _cgats *p, cgatsFile *fp, int table);
+						/* Start writing the structure to a seekable file, with the sets */
+						/* of the given table streamed, for bounded memory use. The */
+						/* tables before it, its header and any sets it has are written. */
+						/* Return -ve, errc & err on error */
+	int (*stream_setarr)(struct _cgats *p, cgats_set_elem *ary);
+						/* Write a set of the streamed table, without adding it */
+						/* Return -ve, errc & err on error */
+	int (*stream_end)(struct _cgats *p);
+						/* Finish the streamed table, setting its NUMBER_OF_SETS, */
+						/* and write the tables after it. */
+						/* Return -ve, errc & err on error */
+
 	int (*get_setarr)(struct _cgats *p, int table, int set_index, cgats_set_elem *ary);
 						/* Fill a suitable set_element with a line of data */
 						/* Return 0 normally, -1, -2, errc & err if error */
@@ -59,6 +59,7 @@ static void reset_del(parse *p);
 static void add_del(struct _parse *p, char *t,
                     char *nr, char *c, char *q);
 static char *get_token(parse *p);
+static int unread(parse *p, unsigned char *buf, size_t len);
 
 /* Open the file, allocate and initialize the parse structure */
 /* Return pointer to parse structure. Return NULL on error */
@@ -80,6 +81,9 @@ cgatsFile *fp		/* File to read from */
 	p->bo = 0;
 	p->tb = NULL;	/* Init token buffer */
 	p->tbs = 0;
+	p->ib = NULL;	/* Input buffer allocated on first read */
+	p->ibo = 0;
+	p->ibe = 0;
 	p->to = 0;
 	p->line = 0;
 	p->token = 0;
@@ -97,6 +101,7 @@ cgatsFile *fp		/* File to read from */
 	p->reset_del = reset_del;
 	p->add_del   = add_del;
 	p->get_token = get_token;
+	p->unread    = unread;
 
 	return p;
 }
@@ -152,12 +157,21 @@ unsigned int offset
 	unsigned char *np;
 
 	np = p->start + offset;
-	if (np < p->start || np >= p->end)
+	if (np < p->start || np > p->end)
 		return 1;
 	p->cur = np;
 	return 0;
 }
 
+/* Return the current position */
+static long cgatsFileMem_tell(
+cgatsFile *pp
+) {
+	cgatsFileMem *p = (cgatsFileMem *)pp;
+
+	return (long)(p->cur - p->start);
+}
+
 /* Read count items of size length. Return number of items successfully read. */
 static size_t cgatsFileMem_read(
 cgatsFile *pp,
@@ -370,6 +384,7 @@ cgatsAlloc *al		/* heap allocator */
 	p->al       = al;				/* Heap allocator */
 	p->get_size = cgatsFileMem_get_size;
 	p->seek     = cgatsFileMem_seek;
+	p->tell     = cgatsFileMem_tell;
 	p->read     = cgatsFileMem_read;
 	p->getch    = cgatsFileMem_getch;
 	p->write    = cgatsFileMem_write;
@@ -409,6 +424,8 @@ del_parse(parse *p) {
 		al->free(al, p->b);
 	if (p->tb != NULL)
 		al->free(al, p->tb);
+	if (p->ib != NULL)
+		al->free(al, p->ib);
 	al->free(al, p);
 
 	if (del_al)			/* We are responsible for deleting allocator */
@@ -416,6 +433,48 @@ del_parse(parse *p) {
 }
 
 
+/* Refill the input buffer and return the next character, or EOF. */
+/* The file is read in blocks rather than a character at a time, */
+/* so the parser reads ahead of the line it has returned. */
+static int fill_ibuf(parse *p) {
+	if (p->ib == NULL) {
+		if ((p->ib = (unsigned char *) p->al->malloc(p->al, PARS_IBSIZE)) == NULL)
+			return p->fp->getch(p->fp);		/* Fall back to unbuffered */
+	}
+	p->ibo = 0;
+	if ((p->ibe = p->fp->read(p->fp, p->ib, 1, PARS_IBSIZE)) == 0)
+		return EOF;
+	return p->ib[p->ibo++];
+}
+
+/* Return bytes already read from the file, to be read before the */
+/* rest of it. Only valid before the first read_line(). */
+/* Return nz and set err and errc on error */
+static int unread(parse *p, unsigned char *buf, size_t len) {
+
+	p->errc = 0;
+	p->err[0] = '\000';
+	if (len == 0)
+		return 0;
+	if (p->ibo != p->ibe || len > PARS_IBSIZE) {
+		sprintf(p->err,"parse.unread(), too much data!");
+		return (p->errc = -1);
+	}
+	if (p->ib == NULL) {
+		if ((p->ib = (unsigned char *) p->al->malloc(p->al, PARS_IBSIZE)) == NULL) {
+			sprintf(p->err,"parse.unread(), malloc failed!");
+			return (p->errc = -1);
+		}
+	}
+	memcpy(p->ib, buf, len);
+	p->ibo = 0;
+	p->ibe = len;
+	return 0;
+}
+
+/* Get the next character from the input buffer */
+#define GETCH(p) ((p)->ibo < (p)->ibe ? (int)(p)->ib[(p)->ibo++] : fill_ibuf(p))
+
 /* Read the next line from the file into the line buffer. */
 /* Return 0 if the read fails due to reaching EOF before */
 /* putting anything in the buffer. */
@@ -429,7 +488,7 @@ read_line(parse *p) {
 	p->errc = 0;		/* Reset error status */
 	p->err[0] = '\000';
 	do {
-		if ((c = p->fp->getch(p->fp)) == EOF) {
+		if ((c = GETCH(p)) == EOF) {
 			if (p->bo == 0) {	/* If there is nothing in the buffer */
 				p->line = 0;
 #ifdef DEBUG
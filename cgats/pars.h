@@ -96,6 +96,9 @@ cgatsAlloc *new_cgatsAllocStd(void);
 	/* Set current position to offset. Return 0 on success, nz on failure. */				\
 	int    (*seek) (struct _cgatsFile *p, unsigned int offset);									\
 																							\
+	/* Return the current position, -1 if it can't be determined. */						\
+	long   (*tell) (struct _cgatsFile *p);														\
+																							\
 	/* Read count items of size length. Return number of items successfully read. */ 		\
 	size_t (*read) (struct _cgatsFile *p, void *buffer, size_t size, size_t count);			\
 																							\
@@ -214,6 +217,9 @@ struct _parse {
 												/* -1 on other error */
 	char *(*get_token)(struct _parse *p);		/* Return a pointer to the next token, */
 												/* NULL if no tokens. set errc NZ on other error */
+	int (*unread)(struct _parse *p,				/* Return bytes already read from the file, */
+	    unsigned char *buf, size_t len);		/* to be parsed first. Only valid before */
+												/* the first read_line(). nz on error */
 
 	/* Private */
 	cgatsAlloc *al;	/* Memory allocator */
@@ -227,6 +233,10 @@ struct _parse {
 	int to;			/* Token parsing offset into b */
 	char *tb;		/* Token buffer */
 	int tbs;		/* Token buffer size */
+	unsigned char *ib;	/* Input buffer, filled a block at a time from fp */
+	size_t ibo;		/* Next input buffer offset */
+	size_t ibe;		/* End of valid data in input buffer */
+#define PARS_IBSIZE 65536	/* Input buffer size */
 	char delf[256];		/* Parsing delimiter flags */
 	/* Parsing flags */
 #define PARS_TERM	0x01		/* Terminates a token */
@@ -215,6 +215,15 @@ unsigned int offset
 	return fseek(p->fp, offset, SEEK_SET);
 }
 
+/* Return the current position, -1 if it can't be determined. */
+static long cgatsFileStd_tell(
+cgatsFile *pp
+) {
+	cgatsFileStd *p = (cgatsFileStd *)pp;
+
+	return ftell(p->fp);
+}
+
 /* Read count items of size length. Return number of items successfully read. */
 static size_t cgatsFileStd_read(
 cgatsFile *pp,
@@ -351,6 +360,7 @@ cgatsAlloc *al		/* heap allocator, NULL for default */
 	p->del_al   = del_al;			/* Flag noting whether we delete it */
 	p->get_size = cgatsFileStd_get_size;
 	p->seek     = cgatsFileStd_seek;
+	p->tell     = cgatsFileStd_tell;
 	p->read     = cgatsFileStd_read;
 	p->getch    = cgatsFileStd_getch;
 	p->write    = cgatsFileStd_write;
@@ -1,5 +1,6 @@
 
 /* Generate the visual gamut in L*a*b* space */
+/* for a choice of CIE observer. */
 /* Copyright 2006 by Graeme W. Gill */
 /* All rights reserved. */
 
@@ -9,8 +10,11 @@
 #include <fcntl.h>
 #include <string.h>
 #include <math.h>
+#include "copyright.h"
+#include "aconfig.h"
 #include "numlib.h"
 #include "icc.h"
+#include "xicc.h"
 #include "gamut.h"
 #if defined(__IBMC__) && defined(_M_IX86)
 #include <float.h>
@@ -88,21 +92,154 @@ double sl[65][4] = {
 
 #define GAMRES 5.0		/* Default surface resolution */
 
+#define LOC_SHORT 380.0		/* Range of the locus used */
+#define LOC_LONG  700.0
+#define LOC_STEP  5.0
+
+#define MAX_LOC 65
+
+void usage(char *diag, ...) {
+	fprintf(stderr,"Generate the visual gamut, Version %s\n",ARGYLL_VERSION_STR);
+	fprintf(stderr,"Author: Graeme W. Gill, licensed under the AGPL Version 3\n");
+	if (diag != NULL) {
+		va_list args;
+		fprintf(stderr,"Diagnostic: ");
+		va_start(args, diag);
+		vfprintf(stderr, diag, args);
+		va_end(args);
+		fprintf(stderr,"\n");
+	}
+	fprintf(stderr,"usage: GenVisGam [-options] [outfile.gam]\n");
+	fprintf(stderr," -o observer     Choose CIE Observer for spectrum locus:\n");
+	fprintf(stderr,"                 1931_2 (def), 1964_10, 2012_2, 2012_10,\n");
+	fprintf(stderr,"                 1955_2, 1978_2, shaw\n");
+	fprintf(stderr," -d sres         Gamut surface resolution (default %.1f)\n",GAMRES);
+	fprintf(stderr," -b nlod         Write a binary gamut with nlod coarser levels of detail (0..8)\n");
+	fprintf(stderr," outfile.gam     Output gamut file (default VisGamut.gam)\n");
+	exit(1);
+}
+
 int
 main(int argc, char *argv[]) {
+	int fa,nfa;				/* argument we're looking at */
 	int i, j, e;
 	double Yxy[3], XYZ[3], Lab[3];
-	char out_name[100];			/* VRML output file */
+	char out_name[MAXNAMEL+1];	/* Gamut output file */
 	double big[3] = { 0.0, 0.0, 0.0 }, bc;
 	double low[3] = { 1e6, 1e6, 1e6 };
 	double high[3] = { -1e6, -1e6, -1e6 };
 //	double limit = 5.0;			/* Limit multiplier of light at maximum sensitivity */
+	icxObserverType obType = icxOT_default;	/* Observer for the spectrum locus */
+	double loc[MAX_LOC][2];		/* Spectrum locus xy */
+	int nloc = 0;
+	int nlod = -1;				/* >= 0 to write binary gamut */
 
 	double gamres = GAMRES;				/* Surface resolution */
 	gamut *gam;
 
+	error_program = argv[0];
 	strcpy(out_name, "VisGamut.gam");
 
+	/* Process the arguments */
+	for(fa = 1;fa < argc;fa++) {
+		nfa = fa;					/* skip to nfa if next argument is used */
+		if (argv[fa][0] == '-') {	/* Look for any flags */
+			char *na = NULL;		/* next argument after flag, null if none */
+
+			if (argv[fa][2] != '\000')
+				na = &argv[fa][2];		/* next is directly after flag */
+			else {
+				if ((fa+1) < argc) {
+					if (argv[fa+1][0] != '-') {
+						nfa = fa + 1;
+						na = argv[nfa];		/* next is seperate non-flag argument */
+					}
+				}
+			}
+
+			if (argv[fa][1] == '?')
+				usage(NULL);
+
+			/* Spectral Observer type */
+			else if (argv[fa][1] == 'o') {
+				fa = nfa;
+				if (na == NULL) usage("Expect parameter to -o");
+				if (strcmp(na, "1931_2") == 0) {			/* Classic 2 degree */
+					obType = icxOT_CIE_1931_2;
+				} else if (strcmp(na, "1964_10") == 0) {	/* Classic 10 degree */
+					obType = icxOT_CIE_1964_10;
+				} else if (strcmp(na, "2012_2") == 0) {		/* Latest 2 degree */
+					obType = icxOT_CIE_2012_2;
+				} else if (strcmp(na, "2012_10") == 0) {	/* Latest 10 degree */
+					obType = icxOT_CIE_2012_10;
+				} else if (strcmp(na, "1955_2") == 0) {		/* Stiles and Burch 1955 2 degree */
+					obType = icxOT_Stiles_Burch_2;
+				} else if (strcmp(na, "1978_2") == 0) {		/* Judd and Voss 1978 2 degree */
+					obType = icxOT_Judd_Voss_2;
+				} else if (strcmp(na, "shaw") == 0) {		/* Shaw and Fairchilds 1997 2 degree */
+					obType = icxOT_Shaw_Fairchild_2;
+				} else
+					usage("Observer '%s' not recognised",na);
+			}
+
+			/* Surface resolution */
+			else if (argv[fa][1] == 'd') {
+				fa = nfa;
+				if (na == NULL) usage("Expect parameter to -d");
+				gamres = atof(na);
+				if (gamres < 0.1 || gamres > 50.0)
+					usage("Surface resolution %f out of range",gamres);
+			}
+
+			/* Binary output */
+			else if (argv[fa][1] == 'b') {
+				fa = nfa;
+				if (na == NULL) usage("Expect parameter to -b");
+				nlod = atoi(na);
+				if (nlod < 0 || nlod > 8)
+					usage("Binary levels of detail %d out of range",nlod);
+			}
+
+			else 
+				usage("Unknown flag '%c'",argv[fa][1]);
+		} else
+			break;
+	}
+
+	if (fa < argc && argv[fa][0] != '-') {
+		strncpy(out_name,argv[fa++],MAXNAMEL); out_name[MAXNAMEL] = '\000';
+	}
+
+	/* Setup the spectrum locus in xy */
+	if (obType == icxOT_default || obType == icxOT_CIE_1931_2) {
+		for (i = 0; i < 65; i++) {
+			loc[i][0] = sl[i][1];
+			loc[i][1] = sl[i][2];
+		}
+		nloc = 65;
+
+	} else {
+		double wl, min_wl, max_wl;
+
+		if (icx_spectrum_locus_range(&min_wl, &max_wl, obType))
+			error("Unable to get spectrum locus range of observer");
+
+		if (min_wl < LOC_SHORT)
+			min_wl = LOC_SHORT;
+		if (max_wl > LOC_LONG)
+			max_wl = LOC_LONG;
+
+		for (wl = min_wl; wl <= (max_wl + 1e-6) && nloc < MAX_LOC; wl += LOC_STEP) {
+			icx_spectrum_locus(XYZ, wl, obType);
+			icmXYZ2Yxy(Yxy, XYZ);
+			loc[nloc][0] = Yxy[1];
+			loc[nloc][1] = Yxy[2];
+			nloc++;
+		}
+		if (nloc < 2)
+			error("Spectrum locus of observer has too small a range");
+	}
+
 	/* Creat a gamut surface */
 	gam = new_gamut(gamres, 0, 0);
 
@@ -114,12 +251,12 @@ main(int argc, char *argv[]) {
 
 		Y = Y * Y;
 
-		for (i = 0; i < 65; i++) {
+		for (i = 0; i < nloc; i++) {
 //			Yxy[0] = Y * limit * sl[i][3];
 //			if (Yxy[0] > Y)
 				Yxy[0] = Y;
-			Yxy[1] = sl[i][1];
-			Yxy[2] = sl[i][2];
+			Yxy[1] = loc[i][0];
+			Yxy[2] = loc[i][1];
 
 			icmYxy2XYZ(XYZ, Yxy);
 			icmXYZ2Lab(&icmD50, Lab, XYZ);
@@ -145,8 +282,8 @@ main(int argc, char *argv[]) {
 //			Yxy[0] = (b * sl[0][3] + (1.0 - b) * sl[64][3]) * limit * Y;
 //			if (Yxy[0] > Y)
 				Yxy[0] = Y;
-			Yxy[1] = b * sl[0][1] + (1.0 - b) * sl[64][1];
-			Yxy[2] = b * sl[0][2] + (1.0 - b) * sl[64][2];
+			Yxy[1] = b * loc[0][0] + (1.0 - b) * loc[nloc-1][0];
+			Yxy[2] = b * loc[0][1] + (1.0 - b) * loc[nloc-1][1];
 			icmYxy2XYZ(XYZ, Yxy);
 			icmXYZ2Lab(&icmD50, Lab, XYZ);
 
@@ -179,8 +316,13 @@ main(int argc, char *argv[]) {
 	printf("Low    = %f %f %f\n",low[0],low[1],low[2]);
 	printf("High   = %f %f %f\n",high[0],high[1],high[2]);
 
-	if (gam->write_gam(gam, out_name))
-		error ("write gamut failed on '%s'",out_name);
+	if (nlod >= 0) {
+		if (gam->write_bgam(gam, out_name, nlod))
+			error ("write binary gamut failed on '%s'",out_name);
+	} else {
+		if (gam->write_gam(gam, out_name))
+			error ("write gamut failed on '%s'",out_name);
+	}
 
 	gam->del(gam);
 
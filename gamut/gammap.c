@@ -155,6 +155,9 @@ struct {
 #include <fcntl.h>
 #include <string.h>
 #include <math.h>
+#ifdef UNIX
+# include <unistd.h>
+#endif
 #include "aconfig.h"
 #include "icc.h"
 #include "numlib.h"
@@ -1535,10 +1538,12 @@ typedef struct {
 
 		/* Create the near point mapping, which is our fundamental gamut */
 		/* hull to gamut hull mapping. */
+		a1tm_start("near smooth");
 		nsm = near_smooth(verb, &nnsm, scl_gam, sil_gam, d_gam, src_kbp, dst_kbp,
 		                  dr_cs_bp, xwh, gmi->gamcknf, gmi->gamxknf,
 		                  gmi->gamcpf > 1e-6, gmi->gamexf > 1e-6,
 		                  xvra, mapres, smooth, 1.10, surfpnts, il, ih, ol, oh);
+		a1tm_end();
 		if (nsm == NULL) {
 			fprintf(stderr,"Creating smoothed near points failed\n");
 			s->grey->del(s->grey);
@@ -1731,10 +1736,12 @@ typedef struct {
 			avgdev[j] = GAMMAP_RSPLAVGDEV;
 		}
 		s->map = new_rspl(RSPL_NOFLAGS, 3, 3);	/* Allocate 3D -> 3D */
+		a1tm_start("map fit");
 		if (s->map->fit_rspl_w(s->map, GAMMAP_RSPLFLAGS, gpnts, ngamp, il, ih, gres, ol, oh, smooth, avgdev, NULL)) {
 			if (verb)
 				fprintf(stderr,"Warning: Gamut mapping is non-monotonic - may not be very smooth !\n");
 		}
+		a1tm_end();
 		/* return the min and max of the input values valid in the grid */
 		s->map->get_in_range(s->map, s->imin, s->imax); 
 
@@ -2306,6 +2313,319 @@ typedef struct {
 	return s;
 }
 
+/* ============================================ */
+/* Gamut map cache files. */
+
+/* A cache entry is a header file holding the matrices and input range, */
+/* plus one save_rspl() file for each of the grey, igrey and map rspls. */
+/* The header is written last, so that an entry is only used once it */
+/* is complete. Entries can only be used by the same build on the same */
+/* type of machine. */
+
+#define GMC_MAGIC "GMAPC01"
+#define GMC_ENDIAN 0x01020304	/* Check for byte order */
+
+typedef struct {
+	char magic[8];
+	int hsize;					/* sizeof(gammap_chdr) */
+	unsigned int endian;		/* GMC_ENDIAN */
+	ORD8 key[16];				/* Key the entry was created for */
+	double grot[3][4];			/* Grey axis rotation matrix */
+	double igrot[3][4];			/* Inverse of above */
+	double imin[3], imax[3];	/* Input range limits of map */
+	int hasgrey, hasigrey, hasmap;
+} gammap_chdr;
+
+/* Compute the cache key from everything that determines the map. */
+/* Return nz on error */
+static int gammap_key(
+	ORD8 key[16],
+	gamut *sc_gam, gamut *isi_gam, gamut *d_gam, icxGMappingIntent *gmi, gamut *sh_gam,
+	int src_kbp, int dst_kbp, int dst_cmymap, int rel_oride, int mapres,
+	double *mn, double *mx
+) {
+	icmMD5 *md5;
+	gamut *gams[4];
+	ORD8 chsum[16];
+	int iv[10];
+	double dv[16];
+	int i;
+
+	if ((md5 = new_icmMD5()) == NULL)
+		return 1;
+
+	md5->add(md5, (ORD8 *)GMC_MAGIC, 8);
+	md5->add(md5, (ORD8 *)ARGYLL_VERSION_STR, strlen(ARGYLL_VERSION_STR) + 1);
+
+	gams[0] = sc_gam;
+	gams[1] = isi_gam;
+	gams[2] = d_gam;
+	gams[3] = sh_gam;
+	for (i = 0; i < 4; i++) {
+		if (gams[i] == NULL) {
+			memset((void *)chsum, 0, 16);
+		} else if (gams[i]->get_hash(gams[i], chsum) != 0) {
+			md5->del(md5);
+			return 1;
+		}
+		md5->add(md5, chsum, 16);
+	}
+
+	/* The intent. (The alias and description don't affect the map) */
+	iv[0] = gmi->usecas;
+	iv[1] = gmi->usemap;
+	iv[2] = (int)gmi->bph;
+	iv[3] = src_kbp;
+	iv[4] = dst_kbp;
+	iv[5] = dst_cmymap;
+	iv[6] = rel_oride;
+	iv[7] = mapres;
+	iv[8] = mn != NULL;
+	iv[9] = mx != NULL;
+	md5->add(md5, (ORD8 *)iv, sizeof(iv));
+
+	dv[0] = gmi->greymf;
+	dv[1] = gmi->glumwcpf;
+	dv[2] = gmi->glumwexf;
+	dv[3] = gmi->glumbcpf;
+	dv[4] = gmi->glumbexf;
+	dv[5] = gmi->glumknf;
+	dv[6] = gmi->gamcpf;
+	dv[7] = gmi->gamexf;
+	dv[8] = gmi->gamcknf;
+	dv[9] = gmi->gamxknf;
+	dv[10] = gmi->gampwf;
+	dv[11] = gmi->gamlpwf;
+	dv[12] = gmi->gamswf;
+	dv[13] = gmi->satenh;
+	dv[14] = gmi->hkscale;
+	dv[15] = 0.0;
+	md5->add(md5, (ORD8 *)dv, sizeof(dv));
+
+	if (mn != NULL)
+		md5->add(md5, (ORD8 *)mn, 3 * sizeof(double));
+	if (mx != NULL)
+		md5->add(md5, (ORD8 *)mx, 3 * sizeof(double));
+
+	md5->get(md5, key);
+	md5->del(md5);
+
+	return 0;
+}
+
+/* Return the name of one of the files of a cache entry. */
+/* Free the name after use. */
+static char *gammap_cfname(char *cname, char *ext) {
+	char *fname;
+
+	if ((fname = malloc(strlen(cname) + strlen(ext) + 1)) == NULL)
+		error("gammap: malloc of cache file name failed");
+	strcpy(fname, cname);
+	strcat(fname, ext);
+	return fname;
+}
+
+/* Save a rspl to one of the files of a cache entry. */
+/* Return nz on error */
+static int gammap_save_rspl(rspl *r, char *cname, char *ext) {
+	char *fname;
+	int rv;
+
+	if (r == NULL)
+		return 0;
+	fname = gammap_cfname(cname, ext);
+	rv = r->save_rspl(r, fname);
+	free(fname);
+	return rv;
+}
+
+/* Load a rspl from one of the files of a cache entry. */
+/* Return NULL on error */
+static rspl *gammap_load_rspl(char *cname, char *ext, int di, int fdi) {
+	char *fname;
+	rspl *r;
+
+	if ((r = new_rspl(RSPL_NOFLAGS, di, fdi)) == NULL)
+		return NULL;
+	fname = gammap_cfname(cname, ext);
+	if (r->load_rspl(r, fname) != 0) {
+		r->del(r);
+		r = NULL;
+	}
+	free(fname);
+	return r;
+}
+
+/* Save a gammap to a cache entry. Return nz on error */
+static int save_gammap(gammap *s, char *cname, ORD8 key[16]) {
+	gammap_chdr h;
+	char *tname;
+	FILE *fp;
+	int rv = 0;
+
+	if (gammap_save_rspl(s->grey, cname, ".grey") != 0
+	 || gammap_save_rspl(s->igrey, cname, ".igrey") != 0
+	 || gammap_save_rspl(s->map, cname, ".map") != 0)
+		return 1;
+
+	memset((void *)&h, 0, sizeof(gammap_chdr));	/* Make padding repeatable */
+	strcpy(h.magic, GMC_MAGIC);
+	h.hsize = sizeof(gammap_chdr);
+	h.endian = GMC_ENDIAN;
+	memcpy((void *)h.key, (void *)key, 16);
+	memcpy((void *)h.grot, (void *)s->grot, sizeof(h.grot));
+	memcpy((void *)h.igrot, (void *)s->igrot, sizeof(h.igrot));
+	icmCpy3(h.imin, s->imin);
+	icmCpy3(h.imax, s->imax);
+	h.hasgrey = s->grey != NULL;
+	h.hasigrey = s->igrey != NULL;
+	h.hasmap = s->map != NULL;
+
+	if ((tname = malloc(strlen(cname) + 30)) == NULL)
+		return 1;
+#ifdef UNIX
+	sprintf(tname, "%s.%d.tmp", cname, (int)getpid());
+#else
+	sprintf(tname, "%s.tmp", cname);
+#endif
+	if ((fp = fopen(tname, "wb")) == NULL) {
+		free(tname);
+		return 1;
+	}
+	if (fwrite((void *)&h, sizeof(gammap_chdr), 1, fp) != 1)
+		rv = 1;
+	if (fclose(fp) != 0)
+		rv = 1;
+	if (rv == 0) {
+#ifndef UNIX
+		remove(cname);			/* MSWin rename() won't replace a file */
+#endif
+		if (rename(tname, cname) != 0)
+			rv = 1;
+	}
+	if (rv != 0)
+		remove(tname);
+	free(tname);
+
+	return rv;
+}
+
+/* Create a gammap from a cache entry. */
+/* Return NULL if it doesn't exist or doesn't match the key */
+static gammap *load_gammap(char *cname, ORD8 key[16]) {
+	gammap_chdr h;
+	gammap *s;
+	FILE *fp;
+
+	if ((fp = fopen(cname, "rb")) == NULL)
+		return NULL;
+	if (fread((void *)&h, sizeof(gammap_chdr), 1, fp) != 1) {
+		fclose(fp);
+		return NULL;
+	}
+	fclose(fp);
+
+	if (strncmp(h.magic, GMC_MAGIC, 8) != 0
+	 || h.hsize != sizeof(gammap_chdr)
+	 || h.endian != GMC_ENDIAN
+	 || memcmp((void *)h.key, (void *)key, 16) != 0
+	 || !h.hasgrey)
+		return NULL;
+
+	if ((s = (gammap *)calloc(1, sizeof(gammap))) == NULL)
+		error("gammap: calloc failed on gammap object");
+
+	s->del = del_gammap;
+	s->domap = domap;
+	s->invdomap1 = invdomap1;
+
+	memcpy((void *)s->grot, (void *)h.grot, sizeof(h.grot));
+	memcpy((void *)s->igrot, (void *)h.igrot, sizeof(h.igrot));
+	icmCpy3(s->imin, h.imin);
+	icmCpy3(s->imax, h.imax);
+
+	if ((s->grey = gammap_load_rspl(cname, ".grey", 1, 1)) == NULL
+	 || (h.hasigrey && (s->igrey = gammap_load_rspl(cname, ".igrey", 1, 1)) == NULL)
+	 || (h.hasmap && (s->map = gammap_load_rspl(cname, ".map", 3, 3)) == NULL)) {
+		del_gammap(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+/* Return a gammap to map from the input space to the output space, */
+/* using a cache directory if cachedir != NULL. */
+/* Return NULL on error. */
+gammap *new_gammap_cache(
+	char *cachedir,		/* Cache directory, NULL if none */
+	int verb,			/* Verbose flag */
+	gamut *sc_gam,		/* Source colorspace gamut (L gamut if sh_gam != NULL) */
+	gamut *isi_gam,		/* Input source image gamut (NULL if none) */
+	gamut *d_gam,		/* Destination colorspace gamut */
+	icxGMappingIntent *gmi,	/* Gamut mapping specification */
+	gamut *sh_gam,		/* If not NULL, then use sc_gam for the luminence */
+						/* mapping, and sh_gam for the hull mapping (i.e. general compression) */
+	int src_kbp,		/* Use K only black point as src gamut black point */
+	int dst_kbp,		/* Use K only black point as dst gamut black point */
+	int dst_cmymap,		/* masks C = 1, M = 2, Y = 4 to force 100% cusp map */
+	int rel_oride,		/* 0 = normal, 1 = clip like, 2 = max relative */
+	int    mapres,		/* Gamut map resolution, typically 9 - 33 */
+	double *mn,			/* If not NULL, set minimum mapping input range */
+	double *mx,			/* for rspl grid. */
+	char *diagname		/* If non-NULL, write a gamut mapping diagnostic WRL */
+) {
+	gammap *s;
+	ORD8 key[16];
+	char *cname = NULL;
+	rand_state rst;
+
+	/* The diagnostic output needs the map to be created */
+	if (cachedir != NULL && diagname == NULL
+	 && gammap_key(key, sc_gam, isi_gam, d_gam, gmi, sh_gam, src_kbp, dst_kbp,
+	               dst_cmymap, rel_oride, mapres, mn, mx) == 0) {
+		int i;
+
+		if ((cname = malloc(strlen(cachedir) + 50)) == NULL)
+			error("gammap: malloc of cache file name failed");
+		sprintf(cname, "%s/gammap_", cachedir);
+		for (i = 0; i < 16; i++)
+			sprintf(cname + strlen(cname), "%02x", key[i]);
+
+		if ((s = load_gammap(cname, key)) != NULL) {
+			if (verb)
+				printf(" Using cached gamut map '%s'\n",cname);
+			free(cname);
+			return s;
+		}
+	}
+
+	/* Creating the map uses the global random number generator, so restore */
+	/* its state afterwards, so that what follows is the same for a cache hit. */
+	if (cname != NULL)
+		rand_copy(&rst, NULL);
+	a1tm_start("gamut map");
+	s = new_gammap(verb, sc_gam, isi_gam, d_gam, gmi, sh_gam, src_kbp, dst_kbp,
+	               dst_cmymap, rel_oride, mapres, mn, mx, diagname);
+	a1tm_end();
+	if (cname != NULL)
+		rand_copy(NULL, &rst);
+
+	/* Failing to write the cache isn't fatal */
+	if (s != NULL && cname != NULL) {
+		if (save_gammap(s, cname, key) != 0) {
+			if (verb)
+				printf(" Warning: failed to write gamut map cache '%s'\n",cname);
+		} else if (verb) {
+			printf(" Saved gamut map to cache '%s'\n",cname);
+		}
+	}
+	if (cname != NULL)
+		free(cname);
+
+	return s;
+}
+
 #ifdef PLOT_GAMUTS
 
 /* Debug */
@@ -70,5 +70,28 @@ gammap *new_gammap(
 	char *diagname		/* If non-NULL, write a gamut mapping diagnostic WRL */
 );
 
+/* Creator using a cache directory. If cachedir is not NULL, a map */
+/* created before from the same gamuts and parameters is loaded from */
+/* it, else the map is created and saved to it. The cache files can */
+/* be deleted at any time. */
+gammap *new_gammap_cache(
+	char *cachedir,		/* Cache directory, NULL if none */
+	int verb,			/* Verbose flag */
+	gamut *sc_gam,		/* Source colorspace gamut */
+	gamut *s_gam,		/* Source image gamut (NULL if none) */
+	gamut *d_gam,		/* Destination colorspace gamut */
+	icxGMappingIntent *gmi, /* Gamut mapping specification */
+	gamut *sh_gam,		/* If not NULL, then use sc_gam for the luminence */
+						/* mapping, and sh_gam for the hull mapping (i.e. general compression) */
+	int src_kbp,		/* Use K only black point as src gamut black point */
+	int dst_kbp,		/* Use K only black point as dst gamut black point */
+	int dst_cmymap,		/* masks C = 1, M = 2, Y = 4 to force 100% cusp map */
+	int rel_oride,		/* 0 = normal, 1 = override min relative, 2 = max relative */
+	int    mapres,		/* Gamut map resolution, typically 9 - 33 */
+	double *mn,			/* If not NULL, set minimum mapping input range */
+	double *mx,			/* for rspl grid */
+	char *diagname		/* If non-NULL, write a gamut mapping diagnostic WRL */
+);
+
 
 #endif /* GAMMAP_H */
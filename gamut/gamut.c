@@ -55,6 +55,15 @@
 #define FAKE_SEED_SIZE 0.1	/* [0.1] */
 #define TRIANG_TOL 1e-10	/* [1e-10] Triangulation tollerance */
 
+#define EXPN_BLKS 16			/* [16] Number of blocks expand_n() splits points into */
+#define EXPN_MINPTS 4096	/* [4096] Minimum points per expand_n() block */
+
+#define USE_BVH				/* [def] Use BVH for nearest and vector intersect searches */
+#define BVH_LEAF 4			/* [4] Maximum triangles in a BVH leaf */
+#define BVH_STACK 128		/* BVH search stack depth */
+#define BVH_EPS 1e-6		/* BVH bounding box expansion */
+#define NQRY_MIN 64			/* [64] Minimum batch queries per thread */
+
 #define NORM_LOG_POW 0.25	/* [0.25] Normal, colorspace lopow value */
 #define RAST_LOG_POW 0.10	/* [0.10] Raster lopow value (is 0.05 too extreme ??) */
 
@@ -137,6 +146,7 @@
 static void triangulate(gamut *s);
 static void del_gamut(gamut *s);
 static gvert *expand_gamut(gamut *s, double in[3]);
+static void expand_n_gamut(gamut *s, double *in, int n, int nthreads);
 static void set_cs_bp_kp_ovrd(gamut *s, double *bk, double *kp);
 static double getsres(gamut *s);
 static int getisjab(gamut *s);
@@ -160,12 +170,18 @@ static int write_to_vrml(gamut *s, vrml *wrl, double trans, int docusps);
 static int write_trans_vrml(gamut *s, char *filename, int doaxes, int docusps,
 	void (*transform)(void *cntx, double out[3], double in[3]), void *cntx);
 static int write_vrml(gamut *s, char *filename, int doaxes, int docusps);
+static int get_hash(gamut *s, unsigned char chsum[16]);
 static int write_gam(gamut *s, char *filename);
 static int read_gam(gamut *s, char *filename);
+static int write_bgam(gamut *s, char *filename, int nlod);
+static int read_gam_lod(gamut *s, char *filename, int lod);
+static int read_bgam(gamut *s, char *filename, int lod);
 static double radial(gamut *s, double out[3], double in[3]);
 static double nradial(gamut *s, double out[3], double in[3]);
 static void nearest(gamut *s, double out[3], double in[3]);
 static void nearest_tri(gamut *s, double out[3], double in[3], gtri **ctri);
+static void radial_n(gamut *s, double *rad, double *out, double *in, int n, int nthreads);
+static void nearest_n(gamut *s, double *out, double *in, int n, int nthreads);
 static void setwb(gamut *s, double *wp, double *bp, double *kp);
 static int getwb(gamut *s, double *cswp, double *csbp, double *cskp, double *gawp, double *gabp, double *gakp);
 static void setcusps(gamut *s, int flag, double in[3]);
@@ -173,6 +189,9 @@ static int getcusps(gamut *s, double cusps[6][3]);
 static int compute_vector_isect(gamut *s, double *p1, double *p2, double *min, double *max,
                                  double *mint, double *maxt, gtri **mntri, gtri **mxtri);
 static int compute_vector_isectns(gamut *s, double *p1, double *p2, gispnt *lp, int ll); 
+static void compute_vector_isect_n(gamut *s, int *rv, double *min, double *max,
+                 double *mint, double *maxt, double *p1, double *p2, int n, int nthreads);
+static int init_query(gamut *s);
 static double log_scale(gamut *s, double ss);
 static int intersect(gamut *s, gamut *s1, gamut *s2);
 static int exp_cyl(gamut *s, gamut *s1, double ratio);
@@ -180,6 +199,7 @@ static int nexpintersect(gamut *s, gamut *s1, gamut *s2);
 static int expdstbysrcmdst(gamut *s, gamut *s1, gamut *s2, gamut *s3,
                            void (*cvect)(void *cntx, double *p2, double *p1), void *cntx);
 static int vect_intersect(gamut *s, double *rvp, double *ip, double *p1, double *p2, gtri *t);
+static void bvh_edge_isect(gamut *s, gamut *s1, gamut *s2, double *p1, double *p2);
 static void compgawb(gamut *s);
 
 /* in isecvol.c: */
@@ -255,6 +275,7 @@ double ch[3]		/* Point mapped for convex hull testing, relative to center */
 			fprintf(stderr,"gamut: malloc failed on gvert object\n");
 			exit (-1);
 		}
+		a1ma_inc(a1ma_gamut, sizeof(gvert));
 		s->verts[s->nv] = v;
 		v->n = s->nv++;
 	}
@@ -366,6 +387,7 @@ static void del_gverts(gamut *s) {
 	int i;
 	for (i = 0; i < s->nv; i++) {
 		free(s->verts[i]);
+		a1ma_dec(a1ma_gamut, sizeof(gvert));
 	}
 	if (s->verts != NULL) {
 		free(s->verts);
@@ -386,6 +408,7 @@ int i				/* Intended node in quad */
 		fprintf(stderr,"gamut: calloc failed on gquad object\n");
 		exit (-1);
 	}
+	a1ma_inc(a1ma_gamut, sizeof(gquad));
 	q->tag = 2;
 
 	q->w = 0.5 * p->w;
@@ -419,6 +442,7 @@ double t		/* Bottom border */
 		fprintf(stderr,"gamut: calloc failed on gquad object\n");
 		exit (-1);
 	}
+	a1ma_inc(a1ma_gamut, sizeof(gquad));
 	q->tag = 2;
 	q->w = r - l;
 	q->h = t - b;
@@ -439,6 +463,7 @@ del_gquad(gquad *q) {
 			del_gquad((gquad *)n);		/* Recurse */
 	}
 	free(q);
+	a1ma_dec(a1ma_gamut, sizeof(gquad));
 }
 
 /* Helper functions */
@@ -479,6 +504,7 @@ gbspn *new_gbspn(void) {
 		fprintf(stderr,"gamut: malloc failed - bspn node\n");
 		exit(-1);
 	}
+	a1ma_inc(a1ma_gamut, sizeof(gbspn));
 	t->tag = 1;		/* bspn decision node */
 	t->n = n++;
 
@@ -488,6 +514,7 @@ gbspn *new_gbspn(void) {
 /* Delete a BSP decision node struture */
 void del_gbspn(gbspn *t) {
 	free(t);
+	a1ma_dec(a1ma_gamut, sizeof(gbspn));
 }
 
 /* ------------------------------------ */
@@ -503,6 +530,7 @@ gtri **t		/* List of triangles to copy into structure */
 		fprintf(stderr,"gamut: malloc failed - bspl triangle tree node\n");
 		exit(-1);
 	}
+	a1ma_inc(a1ma_gamut, sizeof(gbspl) + nt * sizeof(gtri *));
 	l->tag = 3;		/* bspl triangle list node */
 	l->n = n++;
 	l->nt = nt;
@@ -514,6 +542,7 @@ gtri **t		/* List of triangles to copy into structure */
 
 /* Delete a BSP tree triangle list structure */
 void del_gbspl(gbspl *l) {
+	a1ma_dec(a1ma_gamut, sizeof(gbspl) + l->nt * sizeof(gtri *));
 	free(l);
 }
 
@@ -526,6 +555,7 @@ gtri *new_gtri(void) {
 		fprintf(stderr,"gamut: malloc failed - gamut surface triangle\n");
 		exit(-1);
 	}
+	a1ma_inc(a1ma_gamut, sizeof(gtri));
 	t->tag = 2;		/* Triangle */
 	t->n = n++;
 
@@ -535,6 +565,7 @@ gtri *new_gtri(void) {
 /* Delete a triangle struture */
 void del_gtri(gtri *t) {
 	free(t);
+	a1ma_dec(a1ma_gamut, sizeof(gtri));
 }
 
 /* ------------------------------------ */
@@ -546,6 +577,7 @@ gedge *new_gedge(void) {
 		fprintf(stderr,"gamut: malloc failed - triangle edge\n");
 		exit(-1);
 	}
+	a1ma_inc(a1ma_gamut, sizeof(gedge));
 	t->n = n++;
 	return t;
 }
@@ -553,6 +585,7 @@ gedge *new_gedge(void) {
 /* Delete an edge struture */
 void del_gedge(gedge *t) {
 	free(t);
+	a1ma_dec(a1ma_gamut, sizeof(gedge));
 }
 
 /* ------------------------------------ */
@@ -639,6 +672,7 @@ int isRast				/* Flag indicating Raster rather than colorspace, */
 	/* Setup methods */
 	s->del         = del_gamut;
 	s->expand      = expand_gamut;
+	s->expand_n    = expand_n_gamut;
 	s->set_cs_bp_kp_ovrd = set_cs_bp_kp_ovrd;
 	s->getsres     = getsres;
 	s->getisjab    = getisjab;
@@ -667,7 +701,11 @@ int isRast				/* Flag indicating Raster rather than colorspace, */
 	s->nradial     = nradial;
 	s->nearest     = nearest;
 	s->nearest_tri = nearest_tri;
+	s->radial_n    = radial_n;
+	s->nearest_n   = nearest_n;
 	s->vector_isect = compute_vector_isect;
+	s->vector_isect_n = compute_vector_isect_n;
+	s->init_query  = init_query;
 	s->vector_isectns = compute_vector_isectns;
 	s->setwb       = setwb;
 	s->getwb       = getwb;
@@ -676,14 +714,18 @@ int isRast				/* Flag indicating Raster rather than colorspace, */
 	s->write_to_vrml  = write_to_vrml;
 	s->write_vrml  = write_vrml;
 	s->write_trans_vrml = write_trans_vrml;
+	s->get_hash    = get_hash;
 	s->write_gam   = write_gam;
 	s->read_gam    = read_gam;
+	s->write_bgam  = write_bgam;
+	s->read_gam_lod = read_gam_lod;
 
 	return s;
 }
 
 static void del_gnn(gnn *p);
 static void del_gbsp(gbsp *n);
+static void del_gbvh(gbvh *p);
 
 /* Free and clear the triangulation structures, */
 /* and clear the triangulation vertex flags. */
@@ -727,6 +769,12 @@ static void del_triang(gamut *s) {
 	}
 	s->ne_inited = 0;
 
+	if (s->bvh != NULL) {
+		del_gbvh(s->bvh);
+		s->bvh = NULL;
+	}
+	s->bv_inited = 0;
+
 	/* Reset the vertex flags triangulation changes */
 	for (i = 0; i < s->nv; i++) {
 		s->verts[i]->f &= ~GVERT_TRI;
@@ -1068,18 +1116,119 @@ double pp[3]		/* rectangular coordinate of point */
 	return NULL;
 }
 
+/* ------------------------------------ */
+/* Bulk expand */
+
+/* The points are split into (up to) EXPN_BLKS contiguous blocks, */
+/* and each block is filtered into its own local segmented maxima */
+/* structure, with the blocks shared between the threads. The vertices */
+/* that survive in each local structure are then added to the gamut */
+/* in block order, so the result doesn't depend on the number of threads. */
+
+typedef struct {
+	gamut *s;
+	gamut **lg;			/* Local gamut for each block */
+	double *in;			/* Points */
+	int n;				/* Number of points */
+	int nblk;			/* Number of blocks */
+} expn_cx;
+
+static int expand_n_thread(void *cntx, int ix, int nth) {
+	expn_cx *cx = (expn_cx *)cntx;
+	gamut *s = cx->s;
+	int b, i, j;
+
+	for (b = ix; b < cx->nblk; b += nth) {
+		gamut *l;
+		int st = (int)((double)b * cx->n/cx->nblk);
+		int en = (int)((double)(b+1) * cx->n/cx->nblk);
+
+		l = cx->lg[b] = new_gamut(s->sres, s->isJab, s->isRast);
+		for (j = 0; j < 3; j++)
+			l->cent[j] = s->cent[j];
+		l->logpow = s->logpow;
+
+		for (i = st; i < en; i++)
+			expand_gamut(l, cx->in + 3 * i);
+	}
+	return 0;
+}
+
+/* Expand the gamut by adding n points, in[n * 3], */
+/* using nthreads threads (0 = default) */
+static void expand_n_gamut(
+gamut *s,
+double *in,			/* n rectangular coordinate points */
+int n,				/* Number of points */
+int nthreads		/* Number of threads, 0 = default */
+) {
+	expn_cx cx;
+	int b, i, j;
+
+	/* No filtering means all points are compared, so do it serially */
+	if (s->nofilter || s->doingfake || n < (2 * EXPN_MINPTS)) {
+		for (i = 0; i < n; i++)
+			expand_gamut(s, in + 3 * i);
+		return;
+	}
+
+	if (s->tris != NULL || s->read_inited || s->lu_inited || s->ne_inited) {
+		fprintf(stderr,"Can't add points to gamut now!\n");
+		exit(-1);
+	}
+
+	cx.s = s;
+	cx.in = in;
+	cx.n = n;
+	if ((cx.nblk = n/EXPN_MINPTS) > EXPN_BLKS)
+		cx.nblk = EXPN_BLKS;
+	if ((cx.lg = (gamut **)calloc(cx.nblk, sizeof(gamut *))) == NULL) {
+		fprintf(stderr,"gamut: calloc failed on %d local gamuts\n",cx.nblk);
+		exit (-1);
+	}
+
+	if (nthreads <= 0)
+		nthreads = num_threads();
+	if (nthreads > cx.nblk)
+		nthreads = cx.nblk;
+
+	par_exec(nthreads, expand_n_thread, (void *)&cx);
+
+	/* Merge the local maxima into the gamut */
+	for (b = 0; b < cx.nblk; b++) {
+		gamut *l = cx.lg[b];
+
+		for (j = 0; j < 3; j++) {
+			if (l->mx[j] > s->mx[j])
+				s->mx[j] = l->mx[j];
+			if (l->mn[j] < s->mn[j])
+				s->mn[j] = l->mn[j];
+		}
+		for (i = 0; i < l->nv; i++) {
+			if (l->verts[i]->f & GVERT_SET)
+				expand_gamut(s, l->verts[i]->p);
+		}
+		l->del(l);
+	}
+	free(cx.lg);
+}
+
 /* ------------------------------------ */
 
 /* intersect implementation */
 /* Assumes s has been initialised. */
+/* sa and sb are only read, so once they have been triangulated */
+/* and have their search structures (see init_query()), */
+/* several threads may intersect them with other gamuts at once. */
 static void intersect_imp(gamut *s, gamut *sa, gamut *sb) {
 	int i, j, k;
 	gamut *s1, *s2;
+	char *vos;		/* Per s1 vertex "outside s2" flag */
 
 	/* Add each source gamuts verticies that lie within */
 	/* the other gamut */
 	for (k = 0; k < 2; k++) {
-		gtri *tp1, *tp2;		/* Triangle pointers */
+		gtri *tp1;		/* Triangle pointer */
 
 		if (k == 0) {
 			s1 = sa;
@@ -1088,6 +1237,12 @@ static void intersect_imp(gamut *s, gamut *sa, gamut *sb) {
 			s1 = sb;
 			s2 = sa;
 		}
+
+		if ((vos = (char *) calloc(s1->nv + 1, sizeof(char))) == NULL) {
+			fprintf(stderr,"gamut: calloc failed - intersect vertex flags\n");
+			exit(-1);
+		}
+
 		for (i = 0; i < s1->nv; i++) {
 			double pl;
 	
@@ -1098,9 +1253,8 @@ static void intersect_imp(gamut *s, gamut *sa, gamut *sb) {
 
 			if (pl <= (1.0 + 1e-9)) {
 				expand_gamut(s, s1->verts[i]->p);
-				s1->verts[i]->f &= ~GVERT_ISOS;		/* s1 vert is not outside s2 */
 			} else {
-				s1->verts[i]->f |= GVERT_ISOS;		/* s1 vert is outside s2 */
+				vos[i] = 1;		/* s1 vert is outside s2 */
 			}
 		}
 
@@ -1110,7 +1264,12 @@ static void intersect_imp(gamut *s, gamut *sa, gamut *sb) {
 
 			for (j = 0; j < 3; j++) {	/* For all edges in s1 triangle */
 				/* If edge passes through the other gamut */
-				if ((tp1->e[j]->v[0]->f ^ tp1->e[j]->v[1]->f) & GVERT_ISOS) {
+				if (vos[tp1->e[j]->v[0]->n] ^ vos[tp1->e[j]->v[1]->n]) {
+#ifdef USE_BVH
+					/* Search just the s2 triangles near the edge */
+					bvh_edge_isect(s, s1, s2, tp1->e[j]->v[0]->p, tp1->e[j]->v[1]->p);
+#else
+					gtri *tp2;
 
 					/* Exhaustive search of other triangles in s2, */
 					/* to find the one that the edge intersects with. */
@@ -1133,10 +1292,13 @@ static void intersect_imp(gamut *s, gamut *sa, gamut *sb) {
 							expand_gamut(s, tt);
 						}
 					} END_FOR_ALL_ITEMS(tp2);
+#endif /* !USE_BVH */
 				}
 			}
 
 		} END_FOR_ALL_ITEMS(tp1);
+
+		free(vos);
 	}
 }
 
@@ -2675,8 +2837,10 @@ gamut *s
 			s->verts[i]->f &= ~GVERT_ESTP;		/* Unmark  non-fake establishment points */
 			if (!(s->verts[i]->f & GVERT_FAKE))
 				s->verts[j++] = s->verts[i];
-			else
+			else {
 				free(s->verts[i]);
+				a1ma_dec(a1ma_gamut, sizeof(gvert));
+			}
 		}
 		s->nv = j;
 
@@ -4140,7 +4304,7 @@ double *q		/* Target point (absolute) */
 /* Given an absolute point, return the point on the gamut */
 /* surface that is closest to it. */
 static void
-nearest_tri(
+nearest_tri_nn(
 gamut *s,
 double *rout,	/* result point (absolute) */
 double *q,		/* Target point (absolute) */
@@ -4407,6 +4571,24 @@ gtri **ctri		/* If not NULL, return pointer to nearest triangle */
 	}
 }
 
+static void bvh_nearest_tri(gamut *s, double *rout, double *q, gtri **ctri);
+
+/* Given an absolute point, return the point on the gamut */
+/* surface that is closest to it, and the triangle it's in. */
+static void
+nearest_tri(
+gamut *s,
+double *rout,	/* result point (absolute) */
+double *q,		/* Target point (absolute) */
+gtri **ctri		/* If not NULL, return pointer to nearest triangle */
+) {
+#ifdef USE_BVH
+	bvh_nearest_tri(s, rout, q, ctri);
+#else
+	nearest_tri_nn(s, rout, q, ctri);
+#endif
+}
+
 /* Given an absolute point, return the point on the gamut */
 /* surface that is closest to it. */
 static void
@@ -4525,167 +4707,819 @@ static void del_gnn(gnn *p) {
 }
 
 /* ===================================================== */
-/* Define the colorspaces white and black point. May be NULL if unknown. */
-/* Note that as in all of the gamut library, we assume that we are in */
-/* an L*a*b* or Jab type color space. */
-static void setwb(
-gamut *s,
-double *wp,
-double *bp,
-double *kp
+/* Bounding volume hierarchy accelerated searches. */
+
+/* The BVH is a binary tree of triangle bounding boxes, split at the */
+/* median triangle centroid along the longest axis. Unlike the nearest */
+/* neighbor structure, searching it doesn't modify anything, so */
+/* once it has been created it can be searched by several threads. */
+
+/* Partition tix[st..en-1] about the k'th element by centroid axis a */
+static void bvh_select(int *tix, double (*cen)[3], int a, int st, int en, int k) {
+	en--;
+	while (en > st) {
+		double pv = cen[tix[(st + en)/2]][a];
+		int i = st, j = en;
+
+		while (i <= j) {
+			while (cen[tix[i]][a] < pv)
+				i++;
+			while (cen[tix[j]][a] > pv)
+				j--;
+			if (i <= j) {
+				int tt = tix[i];
+				tix[i] = tix[j];
+				tix[j] = tt;
+				i++;
+				j--;
+			}
+		}
+		if (k <= j)
+			en = j;
+		else if (k >= i)
+			st = i;
+		else
+			break;
+	}
+}
+
+/* Recursively create the BVH nodes for triangles tix[st..en-1] */
+/* Return the node index */
+static int bvh_build(
+gbvh *p,
+int *tix,					/* Triangle indexes */
+double (*tbb)[2][3],		/* Triangle bounding boxes */
+double (*cen)[3],			/* Triangle centroids */
+int st, int en
 ) {
-	if (wp != NULL) {
-		s->cs_wp[0] = wp[0];
-		s->cs_wp[1] = wp[1];
-		s->cs_wp[2] = wp[2];
-	} else {
-		s->cs_wp[0] = 100.0;
-		s->cs_wp[1] = 0.0;
-		s->cs_wp[2] = 0.0;
+	gbvhn *n;
+	double cmin[3], cmax[3];
+	int ni, i, j, a;
+
+	ni = p->nn++;
+	n = &p->nodes[ni];
+
+	for (j = 0; j < 3; j++) {
+		n->bb[0][j] = cmin[j] = 1e38;
+		n->bb[1][j] = cmax[j] = -1e38;
+	}
+	for (i = st; i < en; i++) {
+		for (j = 0; j < 3; j++) {
+			if (tbb[tix[i]][0][j] < n->bb[0][j])
+				n->bb[0][j] = tbb[tix[i]][0][j];
+			if (tbb[tix[i]][1][j] > n->bb[1][j])
+				n->bb[1][j] = tbb[tix[i]][1][j];
+			if (cen[tix[i]][j] < cmin[j])
+				cmin[j] = cen[tix[i]][j];
+			if (cen[tix[i]][j] > cmax[j])
+				cmax[j] = cen[tix[i]][j];
+		}
 	}
 
-	if (bp != NULL) {
-		s->cs_bp[0] = bp[0];
-		s->cs_bp[1] = bp[1];
-		s->cs_bp[2] = bp[2];
-	} else {
-		s->cs_bp[0] = 0.0;
-		s->cs_bp[1] = 0.0;
-		s->cs_bp[2] = 0.0;
+	/* Split along the longest centroid axis */
+	for (a = 0, j = 1; j < 3; j++) {
+		if ((cmax[j] - cmin[j]) > (cmax[a] - cmin[a]))
+			a = j;
 	}
 
-	if (kp != NULL) {
-		s->cs_kp[0] = kp[0];
-		s->cs_kp[1] = kp[1];
-		s->cs_kp[2] = kp[2];
-	} else {
-		s->cs_kp[0] = s->cs_bp[0];
-		s->cs_kp[1] = s->cs_bp[1];
-		s->cs_kp[2] = s->cs_bp[2];
+	if ((en - st) <= BVH_LEAF || (cmax[a] - cmin[a]) < 1e-12) {
+		n->ix = st;
+		n->nt = en - st;
+		return ni;
 	}
 
-	s->cswbset = 1;
-}
+	bvh_select(tix, cen, a, st, en, (st + en)/2);
+	n->nt = 0;
+	bvh_build(p, tix, tbb, cen, st, (st + en)/2);
+	i = bvh_build(p, tix, tbb, cen, (st + en)/2, en);
+	p->nodes[ni].ix = i;		/* (n may be stale) */
 
+	return ni;
+}
 
-/* Compute the gamut white/black points, assuming */
-/* that the colorspace white/black points have been set. */
-/* The gamut white/black are the points on the colorspace */
-/* white/black axis that have the same L values as the */
-/* extremes within the gamut. */
-static void compgawb(gamut *s) {
-	int i;
-	double ff, Lmax, Lmin, LKmin;
+/* Setup the BVH acceleration structure */
+static void init_bv(gamut *s) {
+	gbvh *p;
+	gtri *tp;
+	gtri **tlist;
+	double (*tbb)[2][3], (*cen)[3];
+	int *tix;
+	int i, j, k, ntris;
 
-	if (s->cswbset == 0 || s->gawbset != 0)
-		return;		/* Nothing to do */
+	if ((s->bvh = p = (gbvh *) calloc(1, sizeof(gbvh))) == NULL) {
+		fprintf(stderr,"gamut: calloc failed - gbvh structure\n");
+		exit(-1);
+	}
 
-	Lmax = -1000.0;
-	Lmin =  1000.0;
+	ntris = 0;
+	tp = s->tris; 
+	FOR_ALL_ITEMS(gtri, tp) {
+		ntris++;
+	} END_FOR_ALL_ITEMS(tp);
 
-	/* Discover min and max L values */
-	for (i = 0; i < s->nv; i++) {
-		if ((s->verts[i]->f & GVERT_SET) == 0 )
-			continue;
-	
-		if (s->verts[i]->p[0] > Lmax)
-			Lmax = s->verts[i]->p[0];
-		if (s->verts[i]->p[0] < Lmin)
-			Lmin = s->verts[i]->p[0];
+	if ((tlist = (gtri **) malloc(ntris * sizeof(gtri *))) == NULL
+	 || (p->tris = (gtri **) malloc(ntris * sizeof(gtri *))) == NULL
+	 || (p->nodes = (gbvhn *) malloc(2 * ntris * sizeof(gbvhn))) == NULL
+	 || (tbb = (double (*)[2][3]) malloc(ntris * sizeof(double [2][3]))) == NULL
+	 || (cen = (double (*)[3]) malloc(ntris * sizeof(double [3]))) == NULL
+	 || (tix = (int *) malloc(ntris * sizeof(int))) == NULL) {
+		fprintf(stderr,"gamut: malloc failed - BVH (%d triangles)\n",ntris);
+		exit(-1);
 	}
 
-	LKmin = Lmin;
+	/* Triangle bounding boxes and centroids */
+	i = 0;
+	tp = s->tris; 
+	FOR_ALL_ITEMS(gtri, tp) {
+		for (j = 0; j < 3; j++) {
+			tbb[i][0][j] = 1e38;
+			tbb[i][1][j] = -1e38;
+			cen[i][j] = 0.0;
+		}
+		for (k = 0; k < 3; k++) {
+			for (j = 0; j < 3; j++) {
+				double vv = tp->v[k]->p[j];
+				if (vv < tbb[i][0][j])
+					tbb[i][0][j] = vv;
+				if (vv > tbb[i][1][j])
+					tbb[i][1][j] = vv;
+				cen[i][j] += vv/3.0;
+			}
+		}
+		for (j = 0; j < 3; j++) {
+			tbb[i][0][j] -= BVH_EPS;
+			tbb[i][1][j] += BVH_EPS;
+		}
+		tlist[i] = tp;
+		tix[i] = i;
+		i++;
+	} END_FOR_ALL_ITEMS(tp);
 
-	if (Lmax > s->cs_wp[0])		/* Slightly Strange */
-		Lmax = s->cs_wp[0];
-	if (Lmin < s->cs_bp[0])		/* Also Slightly strange */
-		Lmin = s->cs_bp[0];
-	if (LKmin < s->cs_kp[0])	/* Expected */
-		LKmin = s->cs_kp[0];
+	p->nt = ntris;
+	p->nn = 0;
+	if (ntris > 0)
+		bvh_build(p, tix, tbb, cen, 0, ntris);
 
-	/* Locate points along colorspace grey axis */
-	/* that correspond to the L extremes */
-	ff = (Lmax - s->cs_bp[0])/(s->cs_wp[0] - s->cs_bp[0]);
-	s->ga_wp[0] = Lmax;
-	s->ga_wp[1] = ff * (s->cs_wp[1] - s->cs_bp[1]) + s->cs_bp[1];
-	s->ga_wp[2] = ff * (s->cs_wp[2] - s->cs_bp[2]) + s->cs_bp[2];
+	for (i = 0; i < ntris; i++)
+		p->tris[i] = tlist[tix[i]];
 
-	ff = (Lmin - s->cs_bp[0])/(s->cs_wp[0] - s->cs_bp[0]);
-	s->ga_bp[0] = Lmin;
-	s->ga_bp[1] = ff * (s->cs_wp[1] - s->cs_bp[1]) + s->cs_bp[1];
-	s->ga_bp[2] = ff * (s->cs_wp[2] - s->cs_bp[2]) + s->cs_bp[2];
-	
-	ff = (LKmin - s->cs_kp[0])/(s->cs_wp[0] - s->cs_kp[0]);
-	s->ga_kp[0] = LKmin;
-	s->ga_kp[1] = ff * (s->cs_wp[1] - s->cs_kp[1]) + s->cs_kp[1];
-	s->ga_kp[2] = ff * (s->cs_wp[2] - s->cs_kp[2]) + s->cs_kp[2];
-	
-	s->gawbset = 1;
+	free(tix);
+	free(cen);
+	free(tbb);
+	free(tlist);
+
+	s->bv_inited = 1;
 }
 
-/* Get the colorspace and gamut white & black points. */
-/* Return pointers may be NULL */
-/* Return non-zero if not possible. */
-static int getwb(
+/* Free everything */
+static void del_gbvh(gbvh *p) {
+	free(p->nodes);
+	free(p->tris);
+	free(p);
+}
+
+/* Return the distance squared from a point to a BVH node box */
+static double bvh_bdist(gbvhn *n, double *q) {
+	double tt, ds = 0.0;
+	int j;
+
+	for (j = 0; j < 3; j++) {
+		if (q[j] < n->bb[0][j]) {
+			tt = n->bb[0][j] - q[j];
+			ds += tt * tt;
+		} else if (q[j] > n->bb[1][j]) {
+			tt = q[j] - n->bb[1][j];
+			ds += tt * tt;
+		}
+	}
+	return ds;
+}
+
+/* Given an absolute point, return the point on the gamut */
+/* surface that is closest to it, using the BVH. */
+static void bvh_nearest_tri(
 gamut *s,
-double *cswp,		/* Color space */
-double *csbp,
-double *cskp,
-double *gawp,		/* Gamut */
-double *gabp,
-double *gakp
+double *rout,	/* result point (absolute) (may be NULL) */
+double *q,		/* Target point (absolute) */
+gtri **ctri		/* If not NULL, return pointer to nearest triangle */
 ) {
-//printf("~1 getwb() called\n");
-	if (s->cswbset == 0) {
-		return 1;
-	}
+	gbvh *p;
+	int stack[BVH_STACK], sp = 0;
+	double r[3], out[3] = { 0.0, 0.0, 0.0 };
+	double bdist = 1e308;
+	gtri *bobj = NULL;
 
-	if (cswp != NULL) {
-		cswp[0] = s->cs_wp[0];
-		cswp[1] = s->cs_wp[1];
-		cswp[2] = s->cs_wp[2];
-	}
-	
-	if (csbp != NULL) {
-		csbp[0] = s->cs_bp[0];
-		csbp[1] = s->cs_bp[1];
-		csbp[2] = s->cs_bp[2];
-	}
+	if IS_LIST_EMPTY(s->tris)
+		triangulate(s);
 
-	if (cskp != NULL) {
-		cskp[0] = s->cs_kp[0];
-		cskp[1] = s->cs_kp[1];
-		cskp[2] = s->cs_kp[2];
-	}
-//printf("~1 colorspace white %f %f %f, black %f %f %f, kblack %f %f %f\n", s->cs_wp[0], s->cs_wp[1], s->cs_wp[2], s->cs_bp[0], s->cs_bp[1], s->cs_bp[2], s->cs_kp[0],s->cs_kp[1],s->cs_kp[2]);
-	
-	if (gawp != NULL || gabp != NULL || gakp != NULL) {
-//printf("~1 computing gamut white & black\n");
-		if (s->nv == 0)
-			return 1;
-		compgawb(s);		/* make sure we have gamut white/black available */
-	}
+	if (s->bv_inited == 0)
+		init_bv(s);
+	p = s->bvh;
 
-	if (gawp != NULL) {
-		gawp[0] = s->ga_wp[0];
-		gawp[1] = s->ga_wp[1];
-		gawp[2] = s->ga_wp[2];
-	}
+	if (p->nn > 0)
+		stack[sp++] = 0;
 
-	if (gabp != NULL) {
-		gabp[0] = s->ga_bp[0];
-		gabp[1] = s->ga_bp[1];
-		gabp[2] = s->ga_bp[2];
+	while (sp > 0) {
+		int ni = stack[--sp];
+		gbvhn *n = &p->nodes[ni];
+
+		if (bvh_bdist(n, q) >= bdist)
+			continue;
+
+		if (n->nt > 0) {		/* Leaf */
+			int i;
+			for (i = n->ix; i < (n->ix + n->nt); i++) {
+				double tdist;
+
+				tdist = ne_point_on_tri(s, p->tris[i], r, q);
+				if (tdist < bdist) {
+					bdist = tdist;
+					bobj = p->tris[i];
+					out[0] = r[0];
+					out[1] = r[1];
+					out[2] = r[2];
+				}
+			}
+		} else {				/* Push the nearest child last so it's searched first */
+			int c0 = ni + 1, c1 = n->ix;
+			double d0 = bvh_bdist(&p->nodes[c0], q);
+			double d1 = bvh_bdist(&p->nodes[c1], q);
+
+			if ((sp + 2) > BVH_STACK)
+				error("gamut: BVH stack overflow");
+			if (d0 <= d1) {
+				if (d1 < bdist)
+					stack[sp++] = c1;
+				if (d0 < bdist)
+					stack[sp++] = c0;
+			} else {
+				if (d0 < bdist)
+					stack[sp++] = c0;
+				if (d1 < bdist)
+					stack[sp++] = c1;
+			}
+		}
 	}
 
-	if (gakp != NULL) {
-		gakp[0] = s->ga_kp[0];
-		gakp[1] = s->ga_kp[1];
-		gakp[2] = s->ga_kp[2];
+	if (rout != NULL) {
+		rout[0] = out[0];
+		rout[1] = out[1];
+		rout[2] = out[2];
 	}
-//printf("~1 gamut white %f %f %f, black %f %f %f, kblack %f %f %f\n", s->ga_wp[0], s->ga_wp[1], s->ga_wp[2], s->ga_bp[0], s->ga_bp[1], s->ga_bp[2], s->ga_kp[0],s->ga_kp[1],s->ga_kp[2]);
 
-	return 0;
+	if (ctri != NULL)
+		*ctri = bobj;
+}
+
+/* Compute the parameter range t0..t1 of the line p1 + t * vv */
+/* that lies within a BVH node box. Return nz if there is none. */
+static int bvh_slab(gbvhn *n, double *p1, double *vv, double *t0, double *t1) {
+	double ta = *t0, tb = *t1;
+	int j;
+
+	for (j = 0; j < 3; j++) {
+		if (fabs(vv[j]) < 1e-300) {
+			if (p1[j] < n->bb[0][j] || p1[j] > n->bb[1][j])
+				return 1;
+		} else {
+			double ti0 = (n->bb[0][j] - p1[j])/vv[j];
+			double ti1 = (n->bb[1][j] - p1[j])/vv[j];
+			if (ti0 > ti1) {
+				double tt = ti0;
+				ti0 = ti1;
+				ti1 = tt;
+			}
+			if (ti0 > ta)
+				ta = ti0;
+			if (ti1 < tb)
+				tb = ti1;
+			if (ta > tb)
+				return 1;
+		}
+	}
+	*t0 = ta;
+	*t1 = tb;
+	return 0;
+}
+
+/* Given a vector, find the two extreme intersection with */
+/* the gamut surface using the BVH. */
+/* Return 0 if there is no intersection */
+static int bvh_vector_isect(
+gamut *s,
+double *p1,		/* First point (ie param value 0.0) */
+double *p2,		/* Second point (ie param value 1.0) */
+double *omin,	/* Return gamut surface points, min = closest to p1 */
+double *omax,	/* max = farthest from p1 */
+double *omnt,	/* Return parameter values for p1 and p2, 0 being at p1, */
+double *omxt,	/* and 1 being at p2 */
+gtri **omntri,	/* Return the intersection triangles */
+gtri **omxtri
+) {
+	gbvh *p;
+	int stack[BVH_STACK], sp = 0;
+	double vv[3], tt;
+	gispnt islist[2];		/* min and max result */
+	int j;
+
+	if IS_LIST_EMPTY(s->tris)
+		triangulate(s);
+
+	if (s->bv_inited == 0)
+		init_bv(s);
+	p = s->bvh;
+
+	for (tt = 0.0, j = 0; j < 3; j++) {
+		vv[j] = p2[j] - p1[j];
+		tt += vv[j] * vv[j];
+	}
+	/* If vector is too small to have a valid direction */
+	if (tt < 1e-12)
+		return 0;
+
+	islist[0].pv =  1e68;
+	islist[1].pv = -1e68;	/* Setup to find min/max */
+	islist[0].tri = islist[1].tri = NULL;
+
+	if (p->nn > 0)
+		stack[sp++] = 0;
+
+	while (sp > 0) {
+		int ni = stack[--sp];
+		gbvhn *n = &p->nodes[ni];
+		double t0 = -1e6, t1 = 1e6;
+
+		/* Skip if it misses, or can't improve either min or max */
+		if (bvh_slab(n, p1, vv, &t0, &t1)
+		 || (t0 >= islist[0].pv && t1 <= islist[1].pv))
+			continue;
+
+		if (n->nt > 0) {		/* Leaf */
+			int i;
+			for (i = n->ix; i < (n->ix + n->nt); i++) {
+				gtri *t = p->tris[i];
+				double den, ti, ip[3];
+
+				den = t->pe[0] * vv[0] + t->pe[1] * vv[1] + t->pe[2] * vv[2];
+				if (fabs(den) < 1e-12)
+					continue;
+
+				ti = -(t->pe[0] * p1[0] + t->pe[1] * p1[1] + t->pe[2] * p1[2] + t->pe[3])/den;
+				if (ti >= islist[0].pv && ti <= islist[1].pv)
+					continue;			/* Can't improve */
+
+				/* Center relative intersection point */
+				for (j = 0; j < 3; j++)
+					ip[j] = p1[j] + ti * vv[j] - s->cent[j];
+
+				/* Check if the intersection point is within the triangle */
+				for (j = 0; j < 3; j++) {
+					double ds;
+					ds = t->ee[j][0] * ip[0]
+					   + t->ee[j][1] * ip[1]
+				       + t->ee[j][2] * ip[2]
+					   + t->ee[j][3];
+					if (ds > 1e-8)
+						break;
+				}
+				if (j < 3)
+					continue;		/* Not within triangle */
+
+				if (ti < islist[0].pv) {
+					islist[0].pv = ti;
+					icmAdd3(islist[0].ip, ip, s->cent);
+					islist[0].tri = t;
+				}
+				if (ti > islist[1].pv) {
+					islist[1].pv = ti;
+					icmAdd3(islist[1].ip, ip, s->cent);
+					islist[1].tri = t;
+				}
+			}
+		} else {
+			if ((sp + 2) > BVH_STACK)
+				error("gamut: BVH stack overflow");
+			stack[sp++] = n->ix;
+			stack[sp++] = ni + 1;
+		}
+	}
+
+	/* If we failed to locate a requested intersection */
+	if (((omin != NULL || omnt != NULL || omntri != NULL) && islist[0].pv == 1e68)
+	 || ((omax != NULL || omxt != NULL || omxtri != NULL) && islist[1].pv == -1e68))
+		return 0;
+
+	if (omin != NULL)
+		icmCpy3(omin,islist[0].ip);
+
+	if (omax != NULL)
+		icmCpy3(omax,islist[1].ip);
+
+	if (omnt != NULL)
+		*omnt = islist[0].pv;
+
+	if (omxt != NULL)
+		*omxt = islist[1].pv;
+
+	if (omntri != NULL)
+		*omntri = islist[0].tri;
+
+	if (omxtri != NULL)
+		*omxtri = islist[1].tri;
+
+	return 1;
+}
+
+/* Add to s the points at which the edge p1 -> p2 of s1 */
+/* crosses the surface of s2, using the s2 BVH to only */
+/* test the triangles whose boxes the edge passes through. */
+static void bvh_edge_isect(
+gamut *s,		/* Gamut to expand */
+gamut *s1,		/* Gamut the edge is from */
+gamut *s2,		/* Gamut whose surface is being crossed */
+double *p1,		/* Edge start point */
+double *p2		/* Edge end point */
+) {
+	gbvh *p;
+	int stack[BVH_STACK], sp = 0;
+	double vv[3];
+	int j;
+
+	if (s2->bv_inited == 0)
+		init_bv(s2);
+	p = s2->bvh;
+
+	for (j = 0; j < 3; j++)
+		vv[j] = p2[j] - p1[j];
+
+	if (p->nn > 0)
+		stack[sp++] = 0;
+
+	while (sp > 0) {
+		int ni = stack[--sp];
+		gbvhn *n = &p->nodes[ni];
+		double t0 = 0.0 - 1e-6, t1 = 1.0 + 1e-6;
+
+		if (bvh_slab(n, p1, vv, &t0, &t1))
+			continue;		/* Edge misses this box */
+
+		if (n->nt > 0) {		/* Leaf */
+			int i;
+			for (i = n->ix; i < (n->ix + n->nt); i++) {
+				double pv;
+				double tt[3];
+
+				if (vect_intersect(s1, &pv, tt, p1, p2, p->tris[i])
+				 && pv >= (0.0 - 1e-10) && pv <= (1.0 + 1e-10)) {
+					expand_gamut(s, tt);
+				}
+			}
+		} else {
+			if ((sp + 2) > BVH_STACK)
+				error("gamut: BVH stack overflow");
+			stack[sp++] = n->ix;
+			stack[sp++] = ni + 1;
+		}
+	}
+}
+
+/* ===================================================== */
+/* Batch searches, using multiple threads. */
+
+/* Once the search structures have been created, radial(), */
+/* nearest() using the BVH and vector_isect() only read them, */
+/* so the queries can be split between threads. */
+
+typedef struct {
+	gamut *s;
+	int op;				/* 0 = radial, 1 = nearest, 2 = vector isect */
+	int n;				/* Number of queries */
+	double *in, *in2;	/* Input points */
+	double *out, *out2;	/* Output points */
+	double *rad, *rad2;	/* Output values */
+	int *rv;			/* Return values */
+} gqry_cx;
+
+static int query_n_thread(void *cntx, int ix, int nth) {
+	gqry_cx *cx = (gqry_cx *)cntx;
+	gamut *s = cx->s;
+	int i, st, en;
+
+	st = (int)((double)ix * cx->n/nth);
+	en = (int)((double)(ix+1) * cx->n/nth);
+
+	for (i = st; i < en; i++) {
+		double *out = cx->out != NULL ? cx->out + 3 * i : NULL;
+		double *out2 = cx->out2 != NULL ? cx->out2 + 3 * i : NULL;
+		double *rad = cx->rad != NULL ? cx->rad + i : NULL;
+		double *rad2 = cx->rad2 != NULL ? cx->rad2 + i : NULL;
+
+		if (cx->op == 0) {
+			double rr = radial(s, out, cx->in + 3 * i);
+			if (rad != NULL)
+				*rad = rr;
+		} else if (cx->op == 1) {
+			nearest(s, out, cx->in + 3 * i);
+		} else {
+			cx->rv[i] = compute_vector_isect(s, cx->in + 3 * i, cx->in2 + 3 * i,
+			                                 out, out2, rad, rad2, NULL, NULL);
+		}
+	}
+	return 0;
+}
+
+/* Run the queries with the given number of threads */
+static void query_n(gqry_cx *cx, int nthreads) {
+
+	if (nthreads <= 0)
+		nthreads = num_threads();
+	if (nthreads > (cx->n/NQRY_MIN))
+		nthreads = cx->n/NQRY_MIN;
+	if (nthreads > NUMTHR_MAX)
+		nthreads = NUMTHR_MAX;
+
+	if (nthreads <= 1)
+		query_n_thread((void *)cx, 0, 1);
+	else
+		par_exec(nthreads, query_n_thread, (void *)cx);
+}
+
+/* Given n points, return the points in the same directions */
+/* that lie on the gamut surface, and their radial radius. */
+static void radial_n(
+gamut *s,
+double *rad,	/* Return n radial radii (may be NULL) */
+double *out,	/* Return n result points (absolute) (may be NULL) */
+double *in,		/* n input points (absolute) */
+int n,
+int nthreads	/* Number of threads, 0 = default */
+) {
+	gqry_cx cx;
+
+	if IS_LIST_EMPTY(s->tris)
+		triangulate(s);
+	if (s->lu_inited == 0)
+		init_lu(s);
+
+	memset((void *)&cx, 0, sizeof(gqry_cx));
+	cx.s = s;
+	cx.op = 0;
+	cx.n = n;
+	cx.in = in;
+	cx.out = out;
+	cx.rad = rad;
+	query_n(&cx, nthreads);
+}
+
+/* Given n points, return the points on the gamut */
+/* surface that are closest to them. */
+static void nearest_n(
+gamut *s,
+double *out,	/* Return n result points (absolute) */
+double *in,		/* n input points (absolute) */
+int n,
+int nthreads	/* Number of threads, 0 = default */
+) {
+	gqry_cx cx;
+
+	if IS_LIST_EMPTY(s->tris)
+		triangulate(s);
+#ifdef USE_BVH
+	if (s->bv_inited == 0)
+		init_bv(s);
+#else
+	nthreads = 1;		/* nearest_tri_nn() isn't thread safe */
+#endif
+
+	memset((void *)&cx, 0, sizeof(gqry_cx));
+	cx.s = s;
+	cx.op = 1;
+	cx.n = n;
+	cx.in = in;
+	cx.out = out;
+	query_n(&cx, nthreads);
+}
+
+/* Given n vectors, find the two extreme intersections */
+/* of each with the gamut surface. */
+static void compute_vector_isect_n(
+gamut *s,
+int *rv,		/* Return n flags, 0 if there is no intersection */
+double *min,	/* Return n min points (may be NULL) */
+double *max,	/* Return n max points (may be NULL) */
+double *mint,	/* Return n min parameter values (may be NULL) */
+double *maxt,	/* Return n max parameter values (may be NULL) */
+double *p1,		/* n first points */
+double *p2,		/* n second points */
+int n,
+int nthreads	/* Number of threads, 0 = default */
+) {
+	gqry_cx cx;
+
+	if IS_LIST_EMPTY(s->tris)
+		triangulate(s);
+#ifdef USE_BVH
+	if (s->bv_inited == 0)
+		init_bv(s);
+#else
+	if (s->lu_inited == 0)
+		init_lu(s);
+#endif
+
+	cx.s = s;
+	cx.op = 2;
+	cx.n = n;
+	cx.in = p1;
+	cx.in2 = p2;
+	cx.out = min;
+	cx.out2 = max;
+	cx.rad = mint;
+	cx.rad2 = maxt;
+	cx.rv = rv;
+	query_n(&cx, nthreads);
+}
+
+/* Create the query acceleration structures, so that */
+/* the surface queries can be made from several threads. */
+/* Return nz if they are then thread safe. */
+static int init_query(
+gamut *s
+) {
+	if IS_LIST_EMPTY(s->tris)
+		triangulate(s);
+	if (s->lu_inited == 0)
+		init_lu(s);
+#ifdef USE_BVH
+	if (s->bv_inited == 0)
+		init_bv(s);
+	return 1;
+#else
+	return 0;			/* nearest_tri_nn() isn't thread safe */
+#endif
+}
+
+/* ===================================================== */
+/* Define the colorspaces white and black point. May be NULL if unknown. */
+/* Note that as in all of the gamut library, we assume that we are in */
+/* an L*a*b* or Jab type color space. */
+static void setwb(
+gamut *s,
+double *wp,
+double *bp,
+double *kp
+) {
+	if (wp != NULL) {
+		s->cs_wp[0] = wp[0];
+		s->cs_wp[1] = wp[1];
+		s->cs_wp[2] = wp[2];
+	} else {
+		s->cs_wp[0] = 100.0;
+		s->cs_wp[1] = 0.0;
+		s->cs_wp[2] = 0.0;
+	}
+
+	if (bp != NULL) {
+		s->cs_bp[0] = bp[0];
+		s->cs_bp[1] = bp[1];
+		s->cs_bp[2] = bp[2];
+	} else {
+		s->cs_bp[0] = 0.0;
+		s->cs_bp[1] = 0.0;
+		s->cs_bp[2] = 0.0;
+	}
+
+	if (kp != NULL) {
+		s->cs_kp[0] = kp[0];
+		s->cs_kp[1] = kp[1];
+		s->cs_kp[2] = kp[2];
+	} else {
+		s->cs_kp[0] = s->cs_bp[0];
+		s->cs_kp[1] = s->cs_bp[1];
+		s->cs_kp[2] = s->cs_bp[2];
+	}
+
+	s->cswbset = 1;
+}
+
+
+/* Compute the gamut white/black points, assuming */
+/* that the colorspace white/black points have been set. */
+/* The gamut white/black are the points on the colorspace */
+/* white/black axis that have the same L values as the */
+/* extremes within the gamut. */
+static void compgawb(gamut *s) {
+	int i;
+	double ff, Lmax, Lmin, LKmin;
+
+	if (s->cswbset == 0 || s->gawbset != 0)
+		return;		/* Nothing to do */
+
+	Lmax = -1000.0;
+	Lmin =  1000.0;
+
+	/* Discover min and max L values */
+	for (i = 0; i < s->nv; i++) {
+		if ((s->verts[i]->f & GVERT_SET) == 0 )
+			continue;
+	
+		if (s->verts[i]->p[0] > Lmax)
+			Lmax = s->verts[i]->p[0];
+		if (s->verts[i]->p[0] < Lmin)
+			Lmin = s->verts[i]->p[0];
+	}
+
+	LKmin = Lmin;
+
+	if (Lmax > s->cs_wp[0])		/* Slightly Strange */
+		Lmax = s->cs_wp[0];
+	if (Lmin < s->cs_bp[0])		/* Also Slightly strange */
+		Lmin = s->cs_bp[0];
+	if (LKmin < s->cs_kp[0])	/* Expected */
+		LKmin = s->cs_kp[0];
+
+	/* Locate points along colorspace grey axis */
+	/* that correspond to the L extremes */
+	ff = (Lmax - s->cs_bp[0])/(s->cs_wp[0] - s->cs_bp[0]);
+	s->ga_wp[0] = Lmax;
+	s->ga_wp[1] = ff * (s->cs_wp[1] - s->cs_bp[1]) + s->cs_bp[1];
+	s->ga_wp[2] = ff * (s->cs_wp[2] - s->cs_bp[2]) + s->cs_bp[2];
+
+	ff = (Lmin - s->cs_bp[0])/(s->cs_wp[0] - s->cs_bp[0]);
+	s->ga_bp[0] = Lmin;
+	s->ga_bp[1] = ff * (s->cs_wp[1] - s->cs_bp[1]) + s->cs_bp[1];
+	s->ga_bp[2] = ff * (s->cs_wp[2] - s->cs_bp[2]) + s->cs_bp[2];
+	
+	ff = (LKmin - s->cs_kp[0])/(s->cs_wp[0] - s->cs_kp[0]);
+	s->ga_kp[0] = LKmin;
+	s->ga_kp[1] = ff * (s->cs_wp[1] - s->cs_kp[1]) + s->cs_kp[1];
+	s->ga_kp[2] = ff * (s->cs_wp[2] - s->cs_kp[2]) + s->cs_kp[2];
+	
+	s->gawbset = 1;
+}
+
+/* Get the colorspace and gamut white & black points. */
+/* Return pointers may be NULL */
+/* Return non-zero if not possible. */
+static int getwb(
+gamut *s,
+double *cswp,		/* Color space */
+double *csbp,
+double *cskp,
+double *gawp,		/* Gamut */
+double *gabp,
+double *gakp
+) {
+//printf("~1 getwb() called\n");
+	if (s->cswbset == 0) {
+		return 1;
+	}
+
+	if (cswp != NULL) {
+		cswp[0] = s->cs_wp[0];
+		cswp[1] = s->cs_wp[1];
+		cswp[2] = s->cs_wp[2];
+	}
+	
+	if (csbp != NULL) {
+		csbp[0] = s->cs_bp[0];
+		csbp[1] = s->cs_bp[1];
+		csbp[2] = s->cs_bp[2];
+	}
+
+	if (cskp != NULL) {
+		cskp[0] = s->cs_kp[0];
+		cskp[1] = s->cs_kp[1];
+		cskp[2] = s->cs_kp[2];
+	}
+//printf("~1 colorspace white %f %f %f, black %f %f %f, kblack %f %f %f\n", s->cs_wp[0], s->cs_wp[1], s->cs_wp[2], s->cs_bp[0], s->cs_bp[1], s->cs_bp[2], s->cs_kp[0],s->cs_kp[1],s->cs_kp[2]);
+	
+	if (gawp != NULL || gabp != NULL || gakp != NULL) {
+//printf("~1 computing gamut white & black\n");
+		if (s->nv == 0)
+			return 1;
+		compgawb(s);		/* make sure we have gamut white/black available */
+	}
+
+	if (gawp != NULL) {
+		gawp[0] = s->ga_wp[0];
+		gawp[1] = s->ga_wp[1];
+		gawp[2] = s->ga_wp[2];
+	}
+
+	if (gabp != NULL) {
+		gabp[0] = s->ga_bp[0];
+		gabp[1] = s->ga_bp[1];
+		gabp[2] = s->ga_bp[2];
+	}
+
+	if (gakp != NULL) {
+		gakp[0] = s->ga_kp[0];
+		gakp[1] = s->ga_kp[1];
+		gakp[2] = s->ga_kp[2];
+	}
+//printf("~1 gamut white %f %f %f, black %f %f %f, kblack %f %f %f\n", s->ga_wp[0], s->ga_wp[1], s->ga_wp[2], s->ga_bp[0], s->ga_bp[1], s->ga_bp[2], s->ga_kp[0],s->ga_kp[1],s->ga_kp[2]);
+
+	return 0;
 }
 
 
@@ -5390,7 +6224,7 @@ double *vv		/* Vector direction from base */
 /* the gamut surface. */
 /* BSP accellerated version */
 /* Return 0 if there is no intersection */
-static int compute_vector_isect(
+static int compute_vector_isect_bsp(
 gamut *s,
 double *p1,		/* First point (ie param value 0.0) */
 double *p2,		/* Second point (ie param value 1.0) */
@@ -5512,6 +6346,27 @@ gtri **omxtri
 	return rv;
 }
 
+/* Given a vector, find the two extreme intersection with */
+/* the gamut surface. */
+/* Return 0 if there is no intersection */
+static int compute_vector_isect(
+gamut *s,
+double *p1,		/* First point (ie param value 0.0) */
+double *p2,		/* Second point (ie param value 1.0) */
+double *omin,	/* Return gamut surface points, min = closest to p1 */
+double *omax,	/* max = farthest from p1 */
+double *omnt,	/* Return parameter values for p1 and p2, 0 being at p1, */
+double *omxt,	/* and 1 being at p2 */
+gtri **omntri,	/* Return the intersection triangles */
+gtri **omxtri
+) {
+#ifdef USE_BVH
+	return bvh_vector_isect(s, p1, p2, omin, omax, omnt, omxt, omntri, omxtri);
+#else
+	return compute_vector_isect_bsp(s, p1, p2, omin, omax, omnt, omxt, omntri, omxtri);
+#endif
+}
+
 #ifdef INTERSECT_VERIFY
 #undef compute_vector_isect
 
@@ -6193,6 +7048,55 @@ void *cntx
 	return 0;
 }
 
+/* ----------------------------------- */
+/* Compute an MD5 checksum of everything the surface is created from. */
+/* The checksum is only comparable on the same type of machine. */
+/* Return non-zero on error */
+static int get_hash(
+gamut *s,
+unsigned char chsum[16]
+) {
+	icmMD5 *md5;
+	int iv[4];
+	double vv[3];
+	int ix;
+
+	if ((md5 = new_icmMD5()) == NULL)
+		return 1;
+
+	iv[0] = s->isJab;
+	iv[1] = s->isRast;
+	iv[2] = s->nofilter;
+	iv[3] = s->no2pass;
+	md5->add(md5, (ORD8 *)iv, sizeof(iv));
+	md5->add(md5, (ORD8 *)&s->sres, sizeof(double));
+	md5->add(md5, (ORD8 *)s->cent, sizeof(s->cent));
+	md5->add(md5, (ORD8 *)&s->logpow, sizeof(double));
+
+	for (ix = 0;;) {
+		if ((ix = getrawvert(s, vv, ix)) < 0)
+			break;
+		md5->add(md5, (ORD8 *)vv, sizeof(vv));
+	}
+
+	/* (The gamut white & black points are computed from the surface) */
+	iv[0] = s->cswbset;
+	iv[1] = s->cu_inited;
+	md5->add(md5, (ORD8 *)iv, 2 * sizeof(int));
+	if (s->cswbset) {
+		md5->add(md5, (ORD8 *)s->cs_wp, sizeof(s->cs_wp));
+		md5->add(md5, (ORD8 *)s->cs_bp, sizeof(s->cs_bp));
+		md5->add(md5, (ORD8 *)s->cs_kp, sizeof(s->cs_kp));
+	}
+	if (s->cu_inited)
+		md5->add(md5, (ORD8 *)s->cusps, sizeof(s->cusps));
+
+	md5->get(md5, chsum);
+	md5->del(md5);
+
+	return 0;
+}
+
 /* ----------------------------------- */
 /* Write to a CGATS .gam file */
 /* Return non-zero on error */
@@ -6289,18 +7193,202 @@ char *filename
 	gam->add_field(gam, 1, "VERTEX_1", i_t);
 	gam->add_field(gam, 1, "VERTEX_2", i_t);
 
-	tp = s->tris; 
-	FOR_ALL_ITEMS(gtri, tp) {
-		gam->add_set(gam, 1, tp->v[0]->tn, tp->v[1]->tn, tp->v[2]->tn);
-	} END_FOR_ALL_ITEMS(tp);
+	tp = s->tris; 
+	FOR_ALL_ITEMS(gtri, tp) {
+		gam->add_set(gam, 1, tp->v[0]->tn, tp->v[1]->tn, tp->v[2]->tn);
+	} END_FOR_ALL_ITEMS(tp);
+
+
+	if (gam->write_name(gam, filename)) {
+		fprintf(stderr,"Error writing to file '%s' : '%s'\n",filename, gam->err);
+		return 2;
+	}
+
+	gam->del(gam);		/* Clean up */
+	return 0;
+}
+
+/* ----------------------------------- */
+/* Create the triangulated surface of a gamut being read from a file, */
+/* given nverts vertex locations vp[] and ntris triangles of vertex */
+/* indexes tv[]. Return non-zero on error */
+
+/* Triangle half edge, used to match up the triangles sharing each edge */
+typedef struct {
+	int v0, v1;			/* Vertex indexes in triangle order */
+	int t, e;			/* Triangle index, edge within triangle */
+} ghedge;
+
+/* Sort order for half edges */
+static int ghedge_cmp(const void *aa, const void *bb) {
+	ghedge *a = (ghedge *)aa, *b = (ghedge *)bb;
+
+	if (a->v0 != b->v0)
+		return a->v0 < b->v0 ? -1 : 1;
+	if (a->v1 != b->v1)
+		return a->v1 < b->v1 ? -1 : 1;
+	if (a->t != b->t)
+		return a->t < b->t ? -1 : 1;
+	return a->e - b->e;
+}
+
+static int set_surface(
+gamut *s,
+int nverts,
+double (*vp)[3],	/* Vertex locations */
+int ntris,
+int (*tv)[3]		/* Triangle vertex indexes */
+) {
+	int i, j;
+	gtri *tp;
+	gtri **tlist;		/* Triangles in order */
+	ghedge *hl;			/* Sorted list of half edges */
+
+	/* Allocate an array to point at the verts */
+	if ((s->verts = (gvert **)malloc(nverts * sizeof(gvert *))) == NULL) {
+		fprintf(stderr,"gamut: malloc failed on gvert pointer\n");
+		return 2;
+	}
+	s->nv = s->na = nverts;
+	
+	for (i = 0; i < nverts; i++) {
+		gvert *v;
+
+		/* Allocate and fill in each verticies basic information */
+		if ((v = (gvert *)calloc(1, sizeof(gvert))) == NULL) {
+			fprintf(stderr,"gamut: malloc failed on gvert object\n");
+			return 2;
+		}
+		a1ma_inc(a1ma_gamut, sizeof(gvert));
+		s->verts[i] = v;
+		v->tag = 1;
+		v->tn = v->n = i;
+		v->f = GVERT_SET | GVERT_TRI;		/* Will be part of the triangulation */
+
+		v->p[0] = vp[i][0];
+		v->p[1] = vp[i][1];
+		v->p[2] = vp[i][2];
+
+		gamut_rect2radial(s, v->r, v->p);
+	}
+	s->ntv = i;
+
+	/* Compute the other vertex values */
+	compute_vertex_coords(s);
+
+	if ((tlist = (gtri **)malloc(ntris * sizeof(gtri *))) == NULL
+	 || (hl = (ghedge *)malloc(3 * ntris * sizeof(ghedge))) == NULL) {
+		fprintf(stderr,"gamut: malloc failed on triangle list\n");
+		return 2;
+	}
+
+	/* Create all the triangles */
+	for (i = 0; i < ntris; i++) {
+		gtri *t;
+
+		for (j = 0; j < 3; j++) {
+			if (tv[i][j] < 0 || tv[i][j] >= nverts) {
+				fprintf(stderr,".gam file triangle vertex index %d is out of range\n",tv[i][j]);
+				free(hl);
+				free(tlist);
+				return 1;
+			}
+		}
+
+		t = new_gtri();
+		ADD_ITEM_TO_BOT(s->tris, t);	/* Append to triangulation list */
+		tlist[i] = t;
+
+		t->v[0] = s->verts[tv[i][0]];
+		t->v[1] = s->verts[tv[i][1]];
+		t->v[2] = s->verts[tv[i][2]];
+
+		comptriattr(s, t);		/* Compute triangle attributes */
+
+		for (j = 0; j < 3; j++) {
+			hl[3 * i + j].v0 = tv[i][j];
+			hl[3 * i + j].v1 = tv[i][j < 2 ? j+1 : 0];
+			hl[3 * i + j].t = i;
+			hl[3 * i + j].e = j;
+		}
+	}
+
+	/* Sort the half edges so that the other triangle of each */
+	/* edge can be found quickly. */
+	qsort(hl, 3 * ntris, sizeof(ghedge), ghedge_cmp);
+
+	/* Connect edge information */
+	for (i = 0; i < ntris; i++) {
+		int en;
+
+		tp = tlist[i];
+		for (en = 0; en < 3; en++) {	/* For each edge */
+			gedge *e;
+			gvert *v0, *v1;				/* The two verticies of the edge */
+			gtri *tp2;					/* The other triangle */
+			int em;						/* The other edge */
+			int lo, hi;
+			
+			v0 = tp->v[en];
+			v1 = tp->v[en < 2 ? en+1 : 0];
+		
+			if (v0->n > v1->n)
+				continue;				/* Skip every other edge */
+
+			/* Find the first half edge going the other way */
+			for (lo = 0, hi = 3 * ntris; lo < hi;) {
+				int mid = (lo + hi)/2;
+				if (hl[mid].v0 < v1->n
+				 || (hl[mid].v0 == v1->n && hl[mid].v1 < v0->n))
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			if (lo >= (3 * ntris) || hl[lo].v0 != v1->n || hl[lo].v1 != v0->n) {
+				/* Should clean up ? */
+				fprintf(stderr,".gam file triangle data is not consistent\n");
+				free(hl);
+				free(tlist);
+				return 1;
+			}
+			tp2 = tlist[hl[lo].t];
+			em = hl[lo].e;
+
+			if (tp->e[en] != NULL
+			 || tp2->e[em] != NULL) {
+				fprintf(stderr,".gam file triangle data is not consistent\n");
+				fprintf(stderr,"tp1->e[%d] = 0x%p, tp2->e[%d]= 0x%p\n",en,
+						(void *)tp->e[en],em,(void *)tp2->e[em]);
+				free(hl);
+				free(tlist);
+				return 1;
+			}
+
+			/* Creat the edge structure */
+			e = new_gedge();
+			ADD_ITEM_TO_BOT(s->edges, e);	/* Append to edge list */
+			tp->e[en] = e;			/* This edge */
+			tp->ei[en] = 0;			/* 0th triangle in edge */
+			e->t[0] = tp;			/* 0th triangle is tp */
+			e->ti[0] = en;			/* 0th triangles en edge */
+			tp2->e[em] = e;			/* This edge */
+			tp2->ei[em] = 1;		/* 1st triangle in edge */
+			e->t[1] = tp2;			/* 1st triangle is tp2 */
+			e->ti[1] = em;			/* 1st triangles em edge */
+			e->v[0] = v0;			/* The two verticies */
+			e->v[1] = v1;
+		}
+	}
+
+	free(hl);
+	free(tlist);
 
+	s->read_inited = 1;			/* It's now valid */
 
-	if (gam->write_name(gam, filename)) {
-		fprintf(stderr,"Error writing to file '%s' : '%s'\n",filename, gam->err);
-		return 2;
-	}
+#ifdef ASSERTS
+	check_triangulation(s, 1);	/* Check out our work */
+#endif
 
-	gam->del(gam);		/* Clean up */
 	return 0;
 }
 
@@ -6311,11 +7399,23 @@ static int read_gam(
 gamut *s,
 char *filename
 ) {
-	int i;
+	return read_gam_lod(s, filename, 0);
+}
+
+/* Read from a CGATS or binary .gam file, using level of */
+/* detail lod of a binary file. */
+/* Return non-zero on error */
+static int read_gam_lod(
+gamut *s,
+char *filename,
+int lod
+) {
+	int i, rv;
 	cgats *gam;
-	gtri *tp;
 	int nverts;
 	int ntris;
+	double (*vp)[3];		/* Vertex locations */
+	int (*tv)[3];			/* Triangle vertex indexes */
 	int Lf, af, bf;			/* Fields holding L, a & b data */
 	int v0f, v1f, v2f;		/* Fields holding verticies 0, 1 & 2 */
 	int cw, cb;				/* Colorspace white, black keyword indexes */
@@ -6326,6 +7426,9 @@ char *filename
 		return 1;
 	}
 
+	if (gamut_is_bgam(filename))
+		return read_bgam(s, filename, lod);
+
 	gam = new_cgats();	/* Create a CGATS structure */
 
 	gam->add_other(gam, "GAMUT");		/* Setup to cope with a gamut file */
@@ -6461,37 +7564,6 @@ char *filename
 		return 1;
 	}
 
-	/* Allocate an array to point at the verts */
-	if ((s->verts = (gvert **)malloc(nverts * sizeof(gvert *))) == NULL) {
-		fprintf(stderr,"gamut: malloc failed on gvert pointer\n");
-		return 2;
-	}
-	s->nv = s->na = nverts;
-	
-	for (i = 0; i < nverts; i++) {
-		gvert *v;
-
-		/* Allocate and fill in each verticies basic information */
-		if ((v = (gvert *)calloc(1, sizeof(gvert))) == NULL) {
-			fprintf(stderr,"gamut: malloc failed on gvert object\n");
-			return 2;
-		}
-		s->verts[i] = v;
-		v->tag = 1;
-		v->tn = v->n = i;
-		v->f = GVERT_SET | GVERT_TRI;		/* Will be part of the triangulation */
-
-		v->p[0] = *((double *)gam->t[0].fdata[i][Lf]);
-		v->p[1] = *((double *)gam->t[0].fdata[i][af]);
-		v->p[2] = *((double *)gam->t[0].fdata[i][bf]);
-
-		gamut_rect2radial(s, v->r, v->p);
-	}
-	s->ntv = i;
-
-	/* Compute the other vertex values */
-	compute_vertex_coords(s);
-
 	/* Get ready to read the triangle data */
 	if ((v0f = gam->find_field(gam, 1, "VERTEX_0")) < 0) {
 		fprintf(stderr,"Input file doesn't contain field VERTEX_0");
@@ -6518,95 +7590,459 @@ char *filename
 		return 1;
 	}
 
-	/* Create all the triangles */
+	/* Copy the verticies */
+	if ((vp = (double (*)[3])malloc(nverts * sizeof(double [3]))) == NULL
+	 || (tv = (int (*)[3])malloc(ntris * sizeof(int [3]))) == NULL) {
+		fprintf(stderr,"gamut: malloc failed on vertex and triangle arrays\n");
+		return 2;
+	}
+	for (i = 0; i < nverts; i++) {
+		vp[i][0] = *((double *)gam->t[0].fdata[i][Lf]);
+		vp[i][1] = *((double *)gam->t[0].fdata[i][af]);
+		vp[i][2] = *((double *)gam->t[0].fdata[i][bf]);
+	}
+
+	/* Copy the triangles */
 	for (i = 0; i < ntris; i++) {
-		gtri *t;
-		int v0, v1, v2;
+		tv[i][0] = *((int *)gam->t[1].fdata[i][v0f]);
+		tv[i][1] = *((int *)gam->t[1].fdata[i][v1f]);
+		tv[i][2] = *((int *)gam->t[1].fdata[i][v2f]);
+	}
 
-		t = new_gtri();
-		ADD_ITEM_TO_BOT(s->tris, t);	/* Append to triangulation list */
+	gam->del(gam);			/* Clean up */
 
-		v0 = *((int *)gam->t[1].fdata[i][v0f]);
-		v1 = *((int *)gam->t[1].fdata[i][v1f]);
-		v2 = *((int *)gam->t[1].fdata[i][v2f]);
+	rv = set_surface(s, nverts, vp, ntris, tv);
 
-		t->v[0] = s->verts[v0];
-		t->v[1] = s->verts[v1];
-		t->v[2] = s->verts[v2];
+	free(tv);
+	free(vp);
 
-		comptriattr(s, t);		/* Compute triangle attributes */
+	return rv;
+}
+
+/* ----------------------------------- */
+/* Binary .gam files. */
+/* These hold the same information as a CGATS .gam file, */
+/* together with any number of coarser levels of detail */
+/* of the surface, so that large gamuts can be loaded quickly, */
+/* and at a resolution appropriate to the task. */
+/* All values are little endian. The layout is: */
+/*
+	"ARGYLLBG"			8 byte magic number
+	version				32 bit
+	flags				32 bit, BGAM_JAB etc.
+	cent[3]				64 bit IEEE doubles
+	cs_wp[3], cs_bp[3]	Colorspace white and black if BGAM_CSWB
+	ga_wp[3], ga_bp[3]	Gamut white and black if BGAM_CSWB
+	cusps[6][3]			Cusps if BGAM_CUSPS
+	nlod				32 bit number of levels of detail
+	nlod x				Level of detail directory, finest first
+		nverts, ntris	32 bit
+		sres			64 bit double
+	nlod x				Level of detail surface data, finest first
+		nverts x L,a,b	64 bit doubles
+		ntris x v0,v1,v2 32 bit vertex indexes
+*/
+
+#define BGAM_MAGIC "ARGYLLBG"		/* Magic number */
+#define BGAM_VERSION 1				/* File format version */
+#define BGAM_MAXLOD 8				/* Maximum number of levels of detail */
+#define BGAM_MINSRES 5.0			/* Finest level of detail sres */
+
+#define BGAM_JAB   0x0001			/* Colorspace is Jab */
+#define BGAM_RAST  0x0002			/* Surface is a raster gamut */
+#define BGAM_CSWB  0x0004			/* Colorspace and gamut white and black are set */
+#define BGAM_CUSPS 0x0008			/* Cusps are set */
+
+/* Write n 32 bit values */
+static int bgam_write32(FILE *fp, unsigned int *v, int n) {
+	unsigned char buf[4];
+	int i;
+
+	for (i = 0; i < n; i++) {
+		buf[0] = (unsigned char)(v[i]);
+		buf[1] = (unsigned char)(v[i] >> 8);
+		buf[2] = (unsigned char)(v[i] >> 16);
+		buf[3] = (unsigned char)(v[i] >> 24);
+		if (fwrite(buf, 1, 4, fp) != 4)
+			return 1;
+	}
+	return 0;
+}
+
+/* Read n 32 bit values */
+static int bgam_read32(FILE *fp, unsigned int *v, int n) {
+	unsigned char buf[4];
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (fread(buf, 1, 4, fp) != 4)
+			return 1;
+		v[i] = buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((unsigned int)buf[3] << 24);
+	}
+	return 0;
+}
+
+/* Return nz if this machine is big endian */
+static int bgam_isbe(void) {
+	unsigned int x = 1;
+	return *((unsigned char *)&x) == 0;
+}
+
+/* Write n doubles */
+static int bgam_writed(FILE *fp, double *v, int n) {
+	unsigned char buf[8];
+	int i, j, be = bgam_isbe();
+
+	for (i = 0; i < n; i++) {
+		memcpy(buf, &v[i], 8);
+		if (be) {
+			for (j = 0; j < 4; j++) {
+				unsigned char tt = buf[j];
+				buf[j] = buf[7-j];
+				buf[7-j] = tt;
+			}
+		}
+		if (fwrite(buf, 1, 8, fp) != 8)
+			return 1;
+	}
+	return 0;
+}
+
+/* Read n doubles */
+static int bgam_readd(FILE *fp, double *v, int n) {
+	int i, j;
+
+	if (fread((void *)v, sizeof(double), n, fp) != n)
+		return 1;
+
+	if (bgam_isbe()) {
+		for (i = 0; i < n; i++) {
+			unsigned char *buf = (unsigned char *)&v[i];
+			for (j = 0; j < 4; j++) {
+				unsigned char tt = buf[j];
+				buf[j] = buf[7-j];
+				buf[7-j] = tt;
+			}
+		}
+	}
+	return 0;
+}
+
+/* Return nz if the file is a binary .gam file */
+int gamut_is_bgam(char *filename) {
+	FILE *fp;
+	char buf[8];
+	int rv = 0;
+
+	if ((fp = fopen(filename, "rb")) == NULL)
+		return 0;
+
+	if (fread(buf, 1, 8, fp) == 8 && strncmp(buf, BGAM_MAGIC, 8) == 0)
+		rv = 1;
+
+	fclose(fp);
+	return rv;
+}
+
+/* Write the triangulated surface of a gamut */
+static int bgam_write_surf(FILE *fp, gamut *s) {
+	gtri *tp;
+	int i;
+
+	for (i = 0; i < s->nv; i++) {
+		if (!(s->verts[i]->f & GVERT_TRI))
+			continue;
+		if (bgam_writed(fp, s->verts[i]->p, 3))
+			return 1;
 	}
 
-	/* Connect edge information */
 	tp = s->tris; 
 	FOR_ALL_ITEMS(gtri, tp) {
-		int en;
+		unsigned int iv[3];
+		iv[0] = tp->v[0]->tn;
+		iv[1] = tp->v[1]->tn;
+		iv[2] = tp->v[2]->tn;
+		if (bgam_write32(fp, iv, 3))
+			return 1;
+	} END_FOR_ALL_ITEMS(tp);
 
-		for (en = 0; en < 3; en++) {	/* For each edge */
-			gedge *e;
-			gvert *v0, *v1;				/* The two verticies of the edge */
-			gtri *tp2;					/* The other triangle */
-			int em;						/* The other edge */
-			gvert *w0, *w1;				/* The other verticies */
-			
-			v0 = tp->v[en];
-			v1 = tp->v[en < 2 ? en+1 : 0];
-		
-			if (v0->n > v1->n)
-				continue;				/* Skip every other edge */
+	return 0;
+}
 
-			/* Find the corresponding edge of the other triangle */
-			w0 = w1 = NULL;
-			tp2 = s->tris; 
-			FOR_ALL_ITEMS(gtri, tp2) {
-				for (em = 0; em < 3; em++) {	/* For each edge */
-					w0 = tp2->v[em];
-					w1 = tp2->v[em < 2 ? em+1 : 0];
-					if (v0 == w1 && v1 == w0)	/* Found it */
-						break;
-				}
-				if (em < 3)
+/* Write to a binary .gam file, with up to nlod coarser */
+/* levels of detail as well as the full detail surface. */
+/* Return non-zero on error */
+static int write_bgam(
+gamut *s,
+char *filename,
+int nlod
+) {
+	FILE *fp;
+	gamut *lg[BGAM_MAXLOD+1];		/* Gamut for each level of detail */
+	unsigned int iv[4];
+	int i, k, ntris[BGAM_MAXLOD+1];
+	double lsres;				/* Level of detail sres */
+	gtri *tp;
+
+	if IS_LIST_EMPTY(s->tris)
+		triangulate(s);
+
+	if (s->cswbset)
+		compgawb(s);		/* make sure we have gamut white/black available */
+
+	if (nlod < 0)
+		nlod = 0;
+	if (nlod > BGAM_MAXLOD)
+		nlod = BGAM_MAXLOD;
+
+	/* Create each coarser level of detail by re-creating the surface from */
+	/* the full detail verticies, with twice the surface resolution */
+	/* distance of the level above. (We deliberately bypass new_gamut()'s */
+	/* limit on sres, since a coarse surface is what we want.) */
+	/* A surface that has been read from a file may be much finer than */
+	/* sres, so start from its mean edge length if that is smaller, */
+	/* but no finer than BGAM_MINSRES, since that is slow to create. */
+	lg[0] = s;
+	lsres = s->sres;
+	if (nlod > 0) {
+		gedge *ep;
+		double el = 0.0;
+		int nel = 0;
+
+		ep = s->edges; 
+		FOR_ALL_ITEMS(gedge, ep) {
+			el += icmNorm33(ep->v[0]->p, ep->v[1]->p);
+			nel++;
+		} END_FOR_ALL_ITEMS(ep);
+		if (nel > 0 && (el /= (double)nel) < lsres)
+			lsres = el;
+		if (lsres < (0.5 * BGAM_MINSRES))
+			lsres = 0.5 * BGAM_MINSRES;
+	}
+
+	for (k = 0; k <= nlod; k++) {
+
+		if (k > 0) {
+			double pos[3];
+			int ix;
+
+			if ((lg[k] = new_gamut(s->sres, s->isJab, s->isRast)) == NULL) {
+				fprintf(stderr,"gamut: new_gamut failed for level of detail %d\n",k);
+				break;
+			}
+			lsres *= 2.0;
+			lg[k]->sres = lsres;
+			for (i = 0; i < 3; i++)
+				lg[k]->cent[i] = s->cent[i];
+			if (s->cswbset)
+				lg[k]->setwb(lg[k], s->cs_wp, s->cs_bp, s->cs_kp);
+
+			for (ix = 0;;) {
+				if ((ix = getvert(s, NULL, pos, ix)) < 0)
 					break;
-			} END_FOR_ALL_ITEMS(tp2);
-			if (w0 == NULL) {
-				/* Should clean up ? */
-				fprintf(stderr,".gam file triangle data is not consistent\n");
-				return 1;
+				expand_gamut(lg[k], pos);
 			}
+			triangulate(lg[k]);
+		}
 
-			if (tp->e[en] != NULL
-			 || tp2->e[em] != NULL) {
-				fprintf(stderr,".gam file triangle data is not consistent\n");
-				fprintf(stderr,"tp1->e[%d] = 0x%p, tp2->e[%d]= 0x%p\n",en,
-						(void *)tp->e[en],em,(void *)tp2->e[em]);
-				return 1;
-			}
+		ntris[k] = 0;
+		tp = lg[k]->tris; 
+		FOR_ALL_ITEMS(gtri, tp) {
+			ntris[k]++;
+		} END_FOR_ALL_ITEMS(tp);
 
-			/* Creat the edge structure */
-			e = new_gedge();
-			ADD_ITEM_TO_BOT(s->edges, e);	/* Append to edge list */
-			tp->e[en] = e;			/* This edge */
-			tp->ei[en] = 0;			/* 0th triangle in edge */
-			e->t[0] = tp;			/* 0th triangle is tp */
-			e->ti[0] = en;			/* 0th triangles en edge */
-			tp2->e[em] = e;			/* This edge */
-			tp2->ei[em] = 1;		/* 1st triangle in edge */
-			e->t[1] = tp2;			/* 1st triangle is tp2 */
-			e->ti[1] = em;			/* 1st triangles em edge */
-			e->v[0] = v0;			/* The two verticies */
-			e->v[1] = v1;
+		/* Stop if this level is no coarser than the one above */
+		if (k > 0 && ntris[k] >= ntris[k-1]) {
+			lg[k]->del(lg[k]);
+			break;
 		}
-	} END_FOR_ALL_ITEMS(tp);
+	}
+	nlod = k;			/* Number of levels we ended up with */
 
-	gam->del(gam);			/* Clean up */
+	if ((fp = fopen(filename, "wb")) == NULL) {
+		fprintf(stderr,"Error opening output file '%s'\n",filename);
+		for (k = 1; k < nlod; k++)
+			lg[k]->del(lg[k]);
+		return 2;
+	}
 
-	s->read_inited = 1;			/* It's now valid */
+	iv[0] = BGAM_VERSION;
+	iv[1] = (s->isJab ? BGAM_JAB : 0)
+	      | (s->isRast ? BGAM_RAST : 0)
+	      | (s->cswbset ? BGAM_CSWB : 0)
+	      | (s->cu_inited ? BGAM_CUSPS : 0);
 
-#ifdef ASSERTS
-	check_triangulation(s, 1);	/* Check out our work */
-#endif
+	if (fwrite(BGAM_MAGIC, 1, 8, fp) != 8
+	 || bgam_write32(fp, iv, 2)
+	 || bgam_writed(fp, s->cent, 3)
+	 || (s->cswbset && (bgam_writed(fp, s->cs_wp, 3)
+	                 || bgam_writed(fp, s->cs_bp, 3)
+	                 || bgam_writed(fp, s->ga_wp, 3)
+	                 || bgam_writed(fp, s->ga_bp, 3)))
+	 || (s->cu_inited && bgam_writed(fp, &s->cusps[0][0], 6 * 3)))
+		goto write_err;
+
+	iv[0] = nlod;
+	if (bgam_write32(fp, iv, 1))
+		goto write_err;
+
+	for (k = 0; k < nlod; k++) {
+		iv[0] = lg[k]->ntv;
+		iv[1] = ntris[k];
+		if (bgam_write32(fp, iv, 2)
+		 || bgam_writed(fp, &lg[k]->sres, 1))
+			goto write_err;
+	}
+
+	for (k = 0; k < nlod; k++) {
+		if (bgam_write_surf(fp, lg[k]))
+			goto write_err;
+	}
+
+	for (k = 1; k < nlod; k++)
+		lg[k]->del(lg[k]);
+
+	if (fclose(fp) != 0) {
+		fprintf(stderr,"Error closing output file '%s'\n",filename);
+		return 2;
+	}
 
 	return 0;
+
+  write_err:;
+	fprintf(stderr,"Error writing to file '%s'\n",filename);
+	fclose(fp);
+	for (k = 1; k < nlod; k++)
+		lg[k]->del(lg[k]);
+	return 2;
+}
+
+/* Read from a binary .gam file, using level of detail lod, */
+/* or the coarsest level there is if lod is larger than that. */
+/* Return non-zero on error */
+static int read_bgam(
+gamut *s,
+char *filename,
+int lod
+) {
+	FILE *fp;
+	char buf[8];
+	unsigned int iv[4];
+	unsigned int nlod, nverts = 0, ntris = 0;
+	double sres = s->sres;
+	long off = 0;
+	double (*vp)[3];		/* Vertex locations */
+	int (*tv)[3];			/* Triangle vertex indexes */
+	unsigned int k;
+	int rv;
+
+	if ((fp = fopen(filename, "rb")) == NULL) {
+		fprintf(stderr,"Can't open input file '%s'\n",filename);
+		return 1;
+	}
+
+	if (fread(buf, 1, 8, fp) != 8 || strncmp(buf, BGAM_MAGIC, 8) != 0
+	 || bgam_read32(fp, iv, 2)) {
+		fprintf(stderr,"Input file '%s' isn't a binary gamut file\n",filename);
+		fclose(fp);
+		return 1;
+	}
+	if (iv[0] > BGAM_VERSION) {
+		fprintf(stderr,"Input file '%s' is a newer binary gamut format (%d)\n",filename,iv[0]);
+		fclose(fp);
+		return 1;
+	}
+
+	s->isJab = (iv[1] & BGAM_JAB) ? 1 : 0;
+	s->isRast = (iv[1] & BGAM_RAST) ? 1 : 0;
+	if (s->isRast) {
+		s->logpow = RAST_LOG_POW;	/* Wrap the surface more closely */
+		s->no2pass = 1;				/* Only do one pass */
+	} else {
+		s->logpow = NORM_LOG_POW;	/* Convex hull compression power */
+		s->no2pass = 0;				/* Do two passes */
+	}
+
+	if (bgam_readd(fp, s->cent, 3))
+		goto read_err;
+
+	if (iv[1] & BGAM_CSWB) {
+		if (bgam_readd(fp, s->cs_wp, 3)
+		 || bgam_readd(fp, s->cs_bp, 3)
+		 || bgam_readd(fp, s->ga_wp, 3)
+		 || bgam_readd(fp, s->ga_bp, 3))
+			goto read_err;
+		s->cswbset = 1;
+		s->gawbset = 1;
+	}
+
+	if (iv[1] & BGAM_CUSPS) {
+		if (bgam_readd(fp, &s->cusps[0][0], 6 * 3))
+			goto read_err;
+		s->cu_inited = 1;
+	}
+
+	if (bgam_read32(fp, &nlod, 1) || nlod < 1 || nlod > (BGAM_MAXLOD+1))
+		goto read_err;
+
+	if (lod < 0)
+		lod = 0;
+	if (lod >= nlod)
+		lod = nlod-1;
+
+	/* Locate the level of detail we want */
+	for (k = 0; k < nlod; k++) {
+		if (bgam_read32(fp, iv, 2)
+		 || bgam_readd(fp, &sres, 1))
+			goto read_err;
+		if (k < lod) {
+			off += iv[0] * 3 * 8 + iv[1] * 3 * 4;
+		} else if (k == lod) {
+			nverts = iv[0];
+			ntris = iv[1];
+			s->sres = sres;
+		}
+	}
+	if (nverts == 0) {
+		fprintf(stderr,"No verticies");
+		fclose(fp);
+		return 1;
+	}
+	if (ntris == 0) {
+		fprintf(stderr,"No triangles");
+		fclose(fp);
+		return 1;
+	}
+
+	if (off > 0 && fseek(fp, off, SEEK_CUR) != 0)
+		goto read_err;
+
+	if ((vp = (double (*)[3])malloc(nverts * sizeof(double [3]))) == NULL
+	 || (tv = (int (*)[3])malloc(ntris * sizeof(int [3]))) == NULL) {
+		fprintf(stderr,"gamut: malloc failed on vertex and triangle arrays\n");
+		fclose(fp);
+		return 2;
+	}
+
+	if (bgam_readd(fp, &vp[0][0], nverts * 3)
+	 || bgam_read32(fp, (unsigned int *)&tv[0][0], ntris * 3)) {
+		free(tv);
+		free(vp);
+		goto read_err;
+	}
+	fclose(fp);
+
+	rv = set_surface(s, nverts, vp, ntris, tv);
+
+	free(tv);
+	free(vp);
+
+	return rv;
+
+  read_err:;
+	fprintf(stderr,"Error reading binary gamut file '%s'\n",filename);
+	fclose(fp);
+	return 1;
 }
 
 /* ===================================================== */
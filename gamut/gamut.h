@@ -186,6 +186,25 @@ struct _gnn {
 
 /* ------------------------------------ */
 
+/* A bounding volume hierarchy node. The nodes are in depth first */
+/* order, so the first child of a node is the following node. */
+struct _gbvhn {
+	double bb[2][3];		/* Bounding box min and max */
+	int ix;					/* Leaf: index of first triangle, node: index of second child */
+	int nt;					/* Leaf: number of triangles, node: 0 */
+}; typedef struct _gbvhn gbvhn;
+
+/* The gamut bounding volume hierarchy over the surface triangles */
+/* (Read only once created, so may be searched by several threads) */
+struct _gbvh {
+	int nn;					/* Number of nodes */
+	gbvhn *nodes;			/* Nodes, root at [0] */
+	int nt;					/* Number of triangles */
+	struct _gtri **tris;	/* Triangles in leaf order */
+}; typedef struct _gbvh gbvh; 
+
+/* ------------------------------------ */
+
 /* A vector intersction point */
 struct _gispnt {
 	double ip[3];			/* Intersecion Point */
@@ -215,6 +234,7 @@ struct _gamut {
 	int read_inited;	/* Flag set if gamut was initialised from a read */
 	int lu_inited;		/* Flag set if radial surface lookup is inited */
 	int ne_inited;		/* Flag set if nearest lookup is inited */
+	int bv_inited;		/* Flag set if BVH is inited */
 	int cu_inited;		/* Flag set if cusp values inited and trustworthy */
 	int nofilter;		/* Flag, skip segmented maxima filtering */
 	int no2pass;		/* Flag, do only one pass of convex hull */
@@ -229,6 +249,7 @@ struct _gamut {
 
 	gbsp  *lutree;		/* Lookup function BSP tree root */
 	gnn   *nns;			/* nearest neighbor acceleration structure */
+	gbvh  *bvh;			/* Triangle bounding volume hierarchy */
 
 	int cswbset;		/* Flag to indicate that the cs white & black points are set */
 	double cs_wp[3];	/* Color spaces white point */
@@ -259,6 +280,10 @@ struct _gamut {
 
 	gvert *(*expand)(struct _gamut *s, double in[3]);		/* Expand the gamut surface */
 
+	void (*expand_n)(struct _gamut *s, double *in, int n, int nthreads);
+								/* Expand the gamut surface by n points, in[n * 3], */
+								/* using nthreads threads, 0 = default. */
+
 	void (*set_cs_bp_kp_ovrd)(struct _gamut *s, double *bk, double *kp);	/* Override cs black points */
 
 	int (*getisjab)(struct _gamut *s);	/* Return the isJab flag value */
@@ -348,6 +373,15 @@ struct _gamut {
 	void (*nearest_tri)(struct _gamut *s, double out[3], double in[3], gtri **ctri);
 	                          /* return point on surface closest to input & triangle */
 
+	void (*radial_n)(struct _gamut *s, double *rad, double *out, double *in, int n, int nthreads);
+	                          /* radial() of n points, in[n * 3], returning radius in rad[n] */
+	                          /* and points in out[n * 3], using nthreads threads, 0 = default. */
+	                          /* rad or out may be NULL */
+
+	void (*nearest_n)(struct _gamut *s, double *out, double *in, int n, int nthreads);
+	                          /* nearest() of n points, in[n * 3], returning out[n * 3] */
+	                          /* using nthreads threads, 0 = default. */
+
 	int (*vector_isect)(struct _gamut *s, double *p1, double *p2, double *min, double *max,
 	                                                               double *mint, double *maxt,
 	                                                               gtri **mntri, gtri **mxtri);
@@ -361,6 +395,18 @@ struct _gamut {
 							/* mintri & maxtri  may be NULL */
 							/* Return 0 if there is no intersection with the gamut. */
 
+	void (*vector_isect_n)(struct _gamut *s, int *rv, double *min, double *max,
+	                       double *mint, double *maxt, double *p1, double *p2, int n, int nthreads);
+							/* vector_isect() of n vectors p1[n * 3] -> p2[n * 3], returning */
+							/* min[n * 3], max[n * 3], mint[n], maxt[n] and rv[n], using */
+							/* nthreads threads, 0 = default. min, max, mint & maxt may be NULL */
+
+	int (*init_query)(struct _gamut *s);
+							/* Create the surface query structures now rather than on */
+							/* first use. Return nz if radial(), nradial(), nearest(), */
+							/* nearest_tri() and vector_isect() may then be called from */
+							/* several threads at once. */
+
 	int (*vector_isectns)(struct _gamut *s, double *p1, double *p2, gispnt *lp, int ll); 
 							/* Compute all the intersection pairs of the vector p1->p2 with */
 							/* the gamut surface.  lp points to an array of ll gispnt to be */
@@ -395,8 +441,21 @@ struct _gamut {
 	                    /* Append gamut surface to vrml. See also vrml->make_gamut_surface() etc. */
 	int (*write_vrml)(struct _gamut *s, char *filename,
 	                              int doaxes, int docusps); /* Write to a VRML .wrl/.x3d file */
+	int (*get_hash)(struct _gamut *s, unsigned char chsum[16]);
+							/* Return an MD5 checksum of the gamut vertex values, white */
+							/* and black points, cusps and creation parameters, to identify */
+							/* the surface. Return nz on error. */
+
 	int (*write_gam)(struct _gamut *s, char *filename);		/* Write to a CGATS .gam file */
-	int (*read_gam)(struct _gamut *s, char *filename);		/* Read from a CGATS .gam file */
+	int (*read_gam)(struct _gamut *s, char *filename);		/* Read from a CGATS or */
+															/* binary .gam file */
+	int (*write_bgam)(struct _gamut *s, char *filename, int nlod);
+							/* Write to a binary .gam file, with up to nlod coarser */
+							/* levels of detail as well as the full detail surface. */
+	int (*read_gam_lod)(struct _gamut *s, char *filename, int lod);
+							/* Read from a CGATS or binary .gam file, using level of */
+							/* detail lod of a binary file, 0 = full detail. If lod is */
+							/* beyond the coarsest level in the file, use the coarsest. */
 
 	int (*write_trans_vrml)(struct _gamut *s, char *filename, /* Write transformed VRML/X3D .wrl */
 		int doaxes, int docusps, void (*transform)(void *cntx, double out[3], double in[3]), /* with xform */
@@ -411,6 +470,7 @@ gamut *new_gamut(double sres, int isJab, int isRast);	/* Surface resolution, 0.0
 void gamut_rect2radial(gamut *s, double out[3], double in[3]);
 void gamut_radial2rect(gamut *s, double out[3], double in[3]);
 void gamut_Lab2RGB(double *in, double *out);
+int gamut_is_bgam(char *filename);	/* Return nz if file is a binary .gam file */
 extern double gam_hues[2][7];	/* Generic Lab & Jab color hues in degrees */
 
 
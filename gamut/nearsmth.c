@@ -1799,6 +1799,230 @@ int near_smooth_np(
 }
 
 
+/* ============================================ */
+/* The per point optimisation passes. Each point is optimised */
+/* independently, so the points are shared between threads. */
+/* The random trial offsets are seeded per point, so that the */
+/* result doesn't depend on the number of threads. */
+
+#define NSPASS_MIN 16	/* Minimum number of points per thread */
+
+/* Context for a pass */
+typedef struct {
+	smthopt *opts;		/* Template optimisation context */
+	nearsmth *smp;		/* Points being optimised */
+	int nmpts;			/* Number of points */
+	int op;				/* 0 = weighted nearest, 1 = weighted mapping, 2 = shrunk dest. */
+	int useexp;			/* Flag indicating whether expansion is permitted */
+	gamut *shgam;		/* Shrunk destination gamut for op 2 */
+} nspass_cx;
+
+/* Optimise one point. Return nz if powell failed */
+static int nspass_point(
+nspass_cx *cx,
+smthopt *s,			/* This threads optimisation context */
+rand_state *rs,		/* This threads random state */
+int i				/* Index of point to optimise */
+) {
+	nearsmth *smp = cx->smp;
+	double ss[2] = { 20.0, 20.0 };		/* 2D search area */
+	double iv[3];						/* Initial start value */
+	double nv[2];						/* 2D New value */
+	double tp[3];						/* Resultint value */
+	double bnv[2];						/* Best 2d value */
+	double brv;							/* Best return value */
+	double (*func)(void *fdata, double tp[]);
+	int trial;
+
+	s->pass = 0;		/* Itteration pass */
+	s->ix = i;			/* Point to optimise */
+	s->p = &smp[i];
+
+	/* Seed the trial offsets from the pass and point */
+	rand32_th(rs, (unsigned int)(cx->op * cx->nmpts + i + 1));
+
+	if (cx->op == 0) {
+		/* If the img point is within the destination, then we're */
+		/* expanding, so temporarily swap src and radial dest. */
+		/* (??? should we use the cvect() direction to determine swap, */
+		/*      rather than radial ???) */
+		smp[i].swap = 0;
+		if (cx->useexp && smp[i].dr > (smp[i].sr + 1e-9)) {
+			gamut *tt;
+
+			smp[i].swap = 1;
+			tt = smp[i].dgam; smp[i].dgam = smp[i].sgam; smp[i].sgam = tt;
+
+			smp[i].dr = smp[i].sr;
+			smp[i].dv[0] = smp[i].sv[0];
+			smp[i].dv[1] = smp[i].sv[1];
+			smp[i].dv[2] = smp[i].sv[2];
+
+			smp[i].sr = smp[i].drr;
+			smp[i].sv[0] = smp[i].drv[0];
+			smp[i].sv[1] = smp[i].drv[1];
+			smp[i].sv[2] = smp[i].drv[2];
+		}
+		s->wngam = smp[i].dgam;		/* Nearest to dgam */ 
+		s->wn = smp[i].sv;			/* minimize optfunc1 sv -> dgam */
+		func = optfunc1;
+
+		/* Convert our start value from 3D to 2D for speed. */
+		icmMul3By3x4(iv, smp[i].m2d, smp[i].dv);
+
+	} else if (cx->op == 1) {
+		func = optfunc2;
+		icmMul3By3x4(iv, smp[i].m2d, smp[i].aodv);
+
+	} else {
+		s->wngam = cx->shgam;
+		s->wn = smp[i].dv;			/* minimize optfunc1a dv -> shgam */
+		func = optfunc1a;
+		icmMul3By3x4(iv, smp[i].m2d, smp[i].nrdv);
+	}
+	nv[0] = iv[0] = iv[1];
+	nv[1] = iv[1] = iv[2];
+
+	/* Do several trials from different starting points to avoid */
+	/* any local minima, particularly with nearest mapping. */
+	brv = 1e38;
+	for (trial = 0; trial < NO_TRIALS; trial++) {
+		double rv;			/* Temporary */
+
+		/* Optimise the point */
+		if (powell(&rv, 2, nv, ss, 0.01, 1000, func, (void *)s, NULL, NULL) == 0
+		    && rv < brv) {
+			brv = rv;
+			bnv[0] = nv[0];
+			bnv[1] = nv[1];
+		}
+		/* Adjust the starting point with a random offset to avoid local minima */
+		nv[0] = iv[0] + d_rand_th(rs, -20.0, 20.0);
+		nv[1] = iv[1] + d_rand_th(rs, -20.0, 20.0);
+	}
+	if (brv == 1e38) {		/* We failed to get a result */
+#ifdef DEBUG_POWELL_FAILS
+		/* Optimise the point with debug on */
+		s->debug = 1;
+		nv[0] = iv[0];
+		nv[1] = iv[1];
+		powell(NULL, 2, nv, ss, 0.01, 1000, func, (void *)s, NULL, NULL);
+		s->debug = 0;
+#endif
+		return 1;
+	}
+
+	/* Convert best result 2D -> 3D */
+	tp[2] = bnv[1];
+	tp[1] = bnv[0];
+	tp[0] = 50.0;
+	icmMul3By3x4(tp, smp[i].m3d, tp);
+
+	if (cx->op == 0) {
+		/* Remap it to the destinaton gamut surface */
+		smp[i].dgam->radial(smp[i].dgam, tp, tp);
+		icmCpy3(smp[i].aodv, tp);
+
+		/* Undo any swap */
+		if (smp[i].swap) {
+			gamut *tt;
+
+			tt = smp[i].dgam; smp[i].dgam = smp[i].sgam; smp[i].sgam = tt;
+
+			/* We get the point on the real src gamut out when swap */
+			smp[i]._sv[0] = smp[i].aodv[0];
+			smp[i]._sv[1] = smp[i].aodv[1];
+			smp[i]._sv[2] = smp[i].aodv[2];
+
+			/* So we need to compute cusp mapped sv */
+			comp_ce(s, smp[i].sv, smp[i]._sv, &smp[i].wt);
+			smp[i].sr = icmNorm33(smp[i].sv, smp[i].sgam->cent);
+
+			VB(("Exp Src %d = %f %f %f\n",i,smp[i]._sv[0],smp[i]._sv[1],smp[i]._sv[2]));
+			smp[i].aodv[0] = smp[i].drv[0];
+			smp[i].aodv[1] = smp[i].drv[1];
+			smp[i].aodv[2] = smp[i].drv[2];
+		}
+
+	} else if (cx->op == 1) {
+		/* Remap it to the destinaton gamut surface */
+		smp[i].dgam->radial(smp[i].dgam, tp, tp);
+
+		icmCpy3(smp[i].dv, tp);			/* Default current solution */
+		icmCpy3(smp[i].nrdv, tp);		/* Non smoothed result */
+		icmCpy3(smp[i].anv, tp);		/* Starting point for smoothing */
+		smp[i].dr = icmNorm33(smp[i].dv, smp[i].dgam->cent);
+
+	} else {
+		gtri *ctri = NULL;
+		double tmp[3];
+
+		/* Remap it to the shrunk destinaton gamut surface */
+		cx->shgam->radial(cx->shgam, tp, tp);
+
+		/* Compute mapping vector from dst to shdst */
+		icmSub3(smp[i].temp, tp, smp[i].nrdv);
+
+		/* In case shrunk vector is very short, add a small part */
+		/* of the nearest normal.  */
+		smp[i].dgam->nearest_tri(smp[i].dgam, NULL, smp[i].nrdv, &ctri);
+		icmScale3(tmp, ctri->pe, 0.1);		/* Scale to small inwards */
+		icmAdd3(smp[i].temp, smp[i].temp, tmp);
+
+		/* evector */
+		icmNormalize3(smp[i].temp, smp[i].temp, 1.0);
+	}
+	return 0;
+}
+
+/* Thread to optimise every nth point */
+static int nspass_thread(void *cntx, int ix, int nth) {
+	nspass_cx *cx = (nspass_cx *)cntx;
+	smthopt s = *cx->opts;		/* Private copy of the optimisation context */
+	rand_state rs;
+	int i;
+
+	a1tr_begin("nearsmth pass");
+	rand_init(&rs);
+	for (i = ix; i < cx->nmpts; i += nth) {
+		if (nspass_point(cx, &s, &rs, i)) {
+			a1tr_end();
+			return 1;
+		}
+	}
+	a1tr_end();
+	return 0;
+}
+
+/* Optimise all the points using nthreads threads. */
+/* Return nz if powell failed on any point. */
+static int nspass(
+smthopt *opts,
+nearsmth *smp,
+int nmpts,
+int op,				/* 0 = weighted nearest, 1 = weighted mapping, 2 = shrunk dest. */
+int useexp,
+gamut *shgam,		/* Shrunk destination gamut for op 2, else NULL */
+int nthreads
+) {
+	nspass_cx cx;
+
+	cx.opts = opts;
+	cx.smp = smp;
+	cx.nmpts = nmpts;
+	cx.op = op;
+	cx.useexp = useexp;
+	cx.shgam = shgam;
+
+	if (nthreads > nmpts/NSPASS_MIN)
+		nthreads = nmpts/NSPASS_MIN;
+	if (nthreads < 1)
+		nthreads = 1;
+
+	return par_exec(nthreads, nspass_thread, (void *)&cx);
+}
+
+
 /* ============================================ */
 /* Return a list of points. Free list after use */
 /* Return NULL on error */
@@ -1847,6 +2071,7 @@ datao map_oh
 	int hmapres;	/* Half mapres */
 	int hdmapres;	/* Half change in mapres */
 	rspl *lastmap = NULL;	/* Last gamut mapping map created, if any */
+	int nthreads;	/* Number of threads for per point optimisation */
 
 	/* Check gamuts are compatible */
 	if (sc_gam->compatible(sc_gam, dc_gam) == 0
@@ -2379,213 +2604,41 @@ datao map_oh
 	/* Optimise the location of the source to destination mapping. */
 	if (verb) printf("Optimizing source to destination mapping...\n");
 
+	/* The per point optimisations are done in parallel, */
+	/* if the gamut surface queries are thread safe. */
+	nthreads = num_threads();
+	for (i = 0; i < nmpts; i++) {
+		if (!smp[i].sgam->init_query(smp[i].sgam)
+		 || !smp[i].dgam->init_query(smp[i].dgam))
+			nthreads = 1;
+	}
+
 	VA(("Doing first pass to locate the nearest point\n"));
 	/* First pass to locate the weighted nearest point, to use in subsequent passes */
-	{
-		double s[2] = { 20.0, 20.0 };		/* 2D search area */
-		double iv[3];						/* Initial start value */
-		double nv[2];						/* 2D New value */
-		double tp[3];						/* Resultint value */
-		double ne;							/* New error */
-		int notrials = NO_TRIALS;
-
-		for (i = 0; i < nmpts; i++) {		/* Move all the points */
-			double bnv[2];					/* Best 2d value */
-			double brv;						/* Best return value */
-			int trial;
-			double mv;
-
-			opts.pass = 0;		/* Itteration pass */
-			opts.ix = i;		/* Point to optimise */
-			opts.p = &smp[i];
-
-			/* If the img point is within the destination, then we're */
-			/* expanding, so temporarily swap src and radial dest. */
-			/* (??? should we use the cvect() direction to determine swap, */
-			/*      rather than radial ???) */
-			smp[i].swap = 0;
-			if (useexp && smp[i].dr > (smp[i].sr + 1e-9)) {
-				gamut *tt;
-				double dd;
-
-				smp[i].swap = 1;
-				tt = smp[i].dgam; smp[i].dgam = smp[i].sgam; smp[i].sgam = tt;
-
-				smp[i].dr = smp[i].sr;
-				smp[i].dv[0] = smp[i].sv[0];
-				smp[i].dv[1] = smp[i].sv[1];
-				smp[i].dv[2] = smp[i].sv[2];
-
-				smp[i].sr = smp[i].drr;
-				smp[i].sv[0] = smp[i].drv[0];
-				smp[i].sv[1] = smp[i].drv[1];
-				smp[i].sv[2] = smp[i].drv[2];
-			}
-			opts.wngam = smp[i].dgam;		/* Nearest to dgam */ 
-			opts.wn = smp[i].sv;			/* minimize optfunc1 sv -> dgam */
-			
-			/* Convert our start value from 3D to 2D for speed. */
-			icmMul3By3x4(iv, smp[i].m2d, smp[i].dv);
-			nv[0] = iv[0] = iv[1];
-			nv[1] = iv[1] = iv[2];
-
-			/* Do several trials from different starting points to avoid */
-			/* any local minima, particularly with nearest mapping. */
-			brv = 1e38;
-			for (trial = 0; trial < notrials; trial++) {
-				double rv;			/* Temporary */
-
-				/* Optimise the point */
-				if (powell(&rv, 2, nv, s, 0.01, 1000, optfunc1, (void *)(&opts), NULL, NULL) == 0
-				    && rv < brv) {
-					brv = rv;
-//printf("~1 point %d, trial %d, new best %f\n",i,trial,sqrt(rv));
-					bnv[0] = nv[0];
-					bnv[1] = nv[1];
-				}
-//else printf("~1 powell failed with rv = %f\n",rv);
-				/* Adjust the starting point with a random offset to avoid local minima */
-				nv[0] = iv[0] + d_rand(-20.0, 20.0);
-				nv[1] = iv[1] + d_rand(-20.0, 20.0);
-			}
-			if (brv == 1e38) {		/* We failed to get a result */
-				fprintf(stderr, "multiple powells failed to get a result (1)\n");
-#ifdef DEBUG_POWELL_FAILS
-				/* Optimise the point with debug on */
-				opts.debug = 1;
-				icmMul3By3x4(iv, smp[i].m2d, smp[i].dv);
-				nv[0] = iv[0] = iv[1];
-				nv[1] = iv[1] = iv[2];
-				powell(NULL, 2, nv, s, 0.01, 1000, optfunc1, (void *)(&opts), NULL, NULL);
-#endif
-				if (src_gam != sc_gam)
-					src_gam->del(src_gam);
-				if (dst_gam != src_gam && dst_gam != dc_gam)
-					dst_gam->del(dst_gam);
-				free_nearsmth(smp, nmpts);
-				*npp = 0;
-				return NULL;
-			}
-		
-			/* Convert best result 2D -> 3D */
-			tp[2] = bnv[1];
-			tp[1] = bnv[0];
-			tp[0] = 50.0;
-			icmMul3By3x4(tp, smp[i].m3d, tp);
-
-			/* Remap it to the destinaton gamut surface */
-			smp[i].dgam->radial(smp[i].dgam, tp, tp);
-			icmCpy3(smp[i].aodv, tp);
-
-			/* Undo any swap */
-			if (smp[i].swap) {
-				gamut *tt;
-				double dd;
-
-				tt = smp[i].dgam; smp[i].dgam = smp[i].sgam; smp[i].sgam = tt;
-
-				/* We get the point on the real src gamut out when swap */
-				smp[i]._sv[0] = smp[i].aodv[0];
-				smp[i]._sv[1] = smp[i].aodv[1];
-				smp[i]._sv[2] = smp[i].aodv[2];
-
-				/* So we need to compute cusp mapped sv */
-				comp_ce(&opts, smp[i].sv, smp[i]._sv, &smp[i].wt);
-				smp[i].sr = icmNorm33(smp[i].sv, smp[i].sgam->cent);
-
-				VB(("Exp Src %d = %f %f %f\n",i,smp[i]._sv[0],smp[i]._sv[1],smp[i]._sv[2]));
-				smp[i].aodv[0] = smp[i].drv[0];
-				smp[i].aodv[1] = smp[i].drv[1];
-				smp[i].aodv[2] = smp[i].drv[2];
-			}
-		}
+	if (nspass(&opts, smp, nmpts, 0, useexp, NULL, nthreads)) {
+		fprintf(stderr, "multiple powells failed to get a result (1)\n");
+		if (src_gam != sc_gam)
+			src_gam->del(src_gam);
+		if (dst_gam != src_gam && dst_gam != dc_gam)
+			dst_gam->del(dst_gam);
+		free_nearsmth(smp, nmpts);
+		*npp = 0;
+		return NULL;
 	}
 
 	VA(("Locating weighted mapping vectors without smoothing\n"));
 
 	/* Second pass to locate the optimized overall weighted point nrdv[], */
 	/* which is a balance of absolute error, radial error, depth room weighting */
-	{
-		double s[2] = { 20.0, 20.0 };		/* 2D search area */
-		double iv[3];						/* Initial start value */
-		double nv[2];						/* 2D New value */
-		double tp[3];						/* Resultint value */
-		double ne;							/* New error */
-		int notrials = NO_TRIALS;
-
-		for (i = 0; i < nmpts; i++) {		/* Move all the points */
-			double bnv[2];					/* Best 2d value */
-			double brv;						/* Best return value */
-			int trial;
-			double mv;
-
-			opts.pass = 0;		/* Itteration pass */
-			opts.ix = i;		/* Point to optimise */
-			opts.p = &smp[i];
-
-//printf("~1 point %d, sv %f %f %f\n",i,smp[i].sv[0],smp[i].sv[1],smp[i].sv[2]);
-
-			/* Convert our start value from 3D to 2D for speed. */
-			icmMul3By3x4(iv, smp[i].m2d, smp[i].aodv);
-
-			nv[0] = iv[0] = iv[1];
-			nv[1] = iv[1] = iv[2];
-//printf("~1 point %d, iv %f %f %f, 2D %f %f\n",i, smp[i].aodv[0], smp[i].aodv[1], smp[i].aodv[2], iv[0], iv[1]);
-
-			/* Do several trials from different starting points to avoid */
-			/* any local minima, particularly with nearest mapping. */
-			brv = 1e38;
-			for (trial = 0; trial < notrials; trial++) {
-				double rv;			/* Temporary */
-
-				/* Optimise the point */
-				if (powell(&rv, 2, nv, s, 0.01, 1000, optfunc2, (void *)(&opts), NULL, NULL) == 0
-				    && rv < brv) {
-					brv = rv;
-//printf("~1 point %d, trial %d, new best %f at xy %f %f\n",i,trial,sqrt(rv), nv[0],nv[1]);
-					bnv[0] = nv[0];
-					bnv[1] = nv[1];
-				}
-//else printf("~1 powell failed with rv = %f\n",rv);
-				/* Adjust the starting point with a random offset to avoid local minima */
-				nv[0] = iv[0] + d_rand(-20.0, 20.0);
-				nv[1] = iv[1] + d_rand(-20.0, 20.0);
-			}
-			if (brv == 1e38) {		/* We failed to get a result */
-				fprintf(stderr, "multiple powells failed to get a result (2)\n");
-#ifdef DEBUG_POWELL_FAILS
-				/* Optimise the point with debug on */
-				opts.debug = 1;
-				icmMul3By3x4(iv, smp[i].m2d, smp[i].dv);
-				nv[0] = iv[0] = iv[1];
-				nv[1] = iv[1] = iv[2];
-				powell(NULL, 2, nv, s, 0.01, 1000, optfunc2, (void *)(&opts), NULL, NULL);
-#endif
-				if (src_gam != sc_gam)
-					src_gam->del(src_gam);
-				if (dst_gam != src_gam && dst_gam != dc_gam)
-					dst_gam->del(dst_gam);
-				free_nearsmth(smp, nmpts);
-				*npp = 0;
-				return NULL;
-			}
-		
-			/* Convert best result 3D -> 2D */
-			tp[2] = bnv[1];
-			tp[1] = bnv[0];
-			tp[0] = 50.0;
-			icmMul3By3x4(tp, smp[i].m3d, tp);
-
-			/* Remap it to the destinaton gamut surface */
-			smp[i].dgam->radial(smp[i].dgam, tp, tp);
-
-			icmCpy3(smp[i].dv, tp);			/* Default current solution */
-			icmCpy3(smp[i].nrdv, tp);		/* Non smoothed result */
-			icmCpy3(smp[i].anv, tp);		/* Starting point for smoothing */
-			smp[i].dr = icmNorm33(smp[i].dv, smp[i].dgam->cent);
-//printf("~1 %d: dv %f %f %f\n", i, smp[i].dv[0], smp[i].dv[1], smp[i].dv[2]);
-
-		}
+	if (nspass(&opts, smp, nmpts, 1, useexp, NULL, nthreads)) {
+		fprintf(stderr, "multiple powells failed to get a result (2)\n");
+		if (src_gam != sc_gam)
+			src_gam->del(src_gam);
+		if (dst_gam != src_gam && dst_gam != dc_gam)
+			dst_gam->del(dst_gam);
+		free_nearsmth(smp, nmpts);
+		*npp = 0;
+		return NULL;
 	}
 
 	/* Make sure the input and output ranges encompas the points */ 
@@ -2668,13 +2721,6 @@ datao map_oh
 		double p[3], p2[3], rad;
 		int i;
 
-		double s[2] = { 20.0, 20.0 };		/* 2D search area */
-		double iv[3];						/* Initial start value */
-		double nv[2];						/* 2D New value */
-		double tp[3];						/* Resultint value */
-		double ne;							/* New error */
-		int notrials = NO_TRIALS;
-
 		cow *gpnts = NULL;	/* Mapping points to create 3D -> 3D mapping */
 		datai il, ih;
 		datao ol, oh;
@@ -2737,83 +2783,22 @@ datao map_oh
 
 		/* Now locate the closest points on the shrunken gamut */
 		/* and set them up for creating a rspl */
-		opts.wngam = shgam;
-		for (i = 0; i < nmpts; i++) {		/* Move all the points */
-			gtri *ctri = NULL;
-			double tmp[3];
-			double bnv[2];					/* Best 2d value */
-			double brv;						/* Best return value */
-			int trial;
-			double mv;
-
-			opts.pass = 0;		/* Itteration pass */
-			opts.ix = i;		/* Point to optimise */
-			opts.p = &smp[i];
-			opts.wn = smp[i].dv;		/* minimize optfunc1a dv -> shgam */
-
-			/* Convert our start value from 3D to 2D for speed. */
-			icmMul3By3x4(iv, smp[i].m2d, smp[i].nrdv);
-			nv[0] = iv[0] = iv[1];
-			nv[1] = iv[1] = iv[2];
-
-			/* Do several trials from different starting points to avoid */
-			/* any local minima, particularly with nearest mapping. */
-			brv = 1e38;
-			for (trial = 0; trial < notrials; trial++) {
-				double rv;			/* Temporary */
-
-				/* Optimise the point */
-				if (powell(&rv, 2, nv, s, 0.01, 1000, optfunc1a, (void *)(&opts), NULL, NULL) == 0
-				    && rv < brv) {
-					brv = rv;
-					bnv[0] = nv[0];
-					bnv[1] = nv[1];
-				}
-				/* Adjust the starting point with a random offset to avoid local minima */
-				nv[0] = iv[0] + d_rand(-20.0, 20.0);
-				nv[1] = iv[1] + d_rand(-20.0, 20.0);
-			}
-			if (brv == 1e38) {		/* We failed to get a result */
-				fprintf(stderr, "multiple powells failed to get a result (3)\n");
-#ifdef DEBUG_POWELL_FAILS
-				/* Optimise the point with debug on */
-				opts.debug = 1;
-				icmMul3By3x4(iv, smp[i].m2d, smp[i].nrdv);
-				nv[0] = iv[0] = iv[1];
-				nv[1] = iv[1] = iv[2];
-				powell(NULL, 2, nv, s, 0.01, 1000, optfunc1a, (void *)(&opts), NULL, NULL);
-#endif
-				shgam->del(shgam);		/* Done with this */
-				if (src_gam != sc_gam)
-					src_gam->del(src_gam);
-				if (dst_gam != src_gam && dst_gam != dc_gam)
-					dst_gam->del(dst_gam);
-				free_nearsmth(smp, nmpts);
-				*npp = 0;
-				return NULL;
-			}
-		
-			/* Convert best result 2D -> 3D */
-			tp[2] = bnv[1];
-			tp[1] = bnv[0];
-			tp[0] = 50.0;
-			icmMul3By3x4(tp, smp[i].m3d, tp);
-
-			/* Remap it to the destinaton gamut surface */
-			shgam->radial(shgam, tp, tp);
-
-			/* Compute mapping vector from dst to shdst */
-			icmSub3(smp[i].temp, tp, smp[i].nrdv);
-
-			/* In case shrunk vector is very short, add a small part */
-			/* of the nearest normal.  */
-			smp[i].dgam->nearest_tri(smp[i].dgam, NULL, smp[i].nrdv, &ctri);
-			icmScale3(tmp, ctri->pe, 0.1);		/* Scale to small inwards */
-			icmAdd3(smp[i].temp, smp[i].temp, tmp);
-
-			/* evector */
-			icmNormalize3(smp[i].temp, smp[i].temp, 1.0);
+		if (!shgam->init_query(shgam))
+			nthreads = 1;
+		if (nspass(&opts, smp, nmpts, 2, useexp, shgam, nthreads)) {
+			fprintf(stderr, "multiple powells failed to get a result (3)\n");
+			free(gpnts);
+			shgam->del(shgam);		/* Done with this */
+			if (src_gam != sc_gam)
+				src_gam->del(src_gam);
+			if (dst_gam != src_gam && dst_gam != dc_gam)
+				dst_gam->del(dst_gam);
+			free_nearsmth(smp, nmpts);
+			*npp = 0;
+			return NULL;
+		}
 
+		for (i = 0; i < nmpts; i++) {
 			/* Place it in rspl setup array */
 			icmCpy3(gpnts[i].p, smp[i].nrdv);
 			icmCpy3(gpnts[i].v, smp[i].temp);
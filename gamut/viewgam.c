@@ -24,6 +24,7 @@
 #include "copyright.h"
 #include "aconfig.h"
 #include "numlib.h"
+#include "icc.h"
 #include "gamut.h"
 #include "cgats.h"
 #include "vrml.h"
@@ -43,6 +44,11 @@
 
 #undef HALF_HACK /* 27.0 */		/* Crude cutting plane */
 
+#define DEC_MAXLEV 8		/* Maximum number of levels of detail for -D */
+#define DEC_LEVRAT 4		/* Triangle count ratio between levels of detail */
+#define DEC_RANGE 400.0		/* Viewing distance to switch to the second level */
+#define DEC_RANGEF 1.5		/* Factor between the following switching distances */
+
 void usage(char *diag, ...) {
 	fprintf(stderr,"View gamuts Version %s\n",ARGYLL_VERSION_STR);
 	fprintf(stderr,"Author: Graeme W. Gill, licensed under the AGPL Version 3\n");
@@ -67,6 +73,12 @@ void usage(char *diag, ...) {
 	fprintf(stderr," -k             Add markers for prim. & sec. \"cusp\" points\n");
 	fprintf(stderr," -i             Compute and print intersecting volume of first 2 gamuts\n");
 	fprintf(stderr," -I isect.gam   Same as -i, but save intersection gamut to isect.gam\n");
+	fprintf(stderr," -m             Print the matrix of intersecting volumes of all the gamuts,\n");
+	fprintf(stderr,"                rather than creating an outfile\n");
+	fprintf(stderr," -j n           Use n threads for -m (default %d)\n",num_threads());
+	fprintf(stderr," -l lod         Use level of detail lod of binary gamut files (default 0 = full)\n");
+	fprintf(stderr," -d ntris       Decimate each surface to no more than ntris triangles\n");
+	fprintf(stderr," -D nlev        Output nlev levels of detail, each 1/%d the triangles (max %d)\n",DEC_LEVRAT,DEC_MAXLEV);
 	fprintf(stderr,"                (Set env. ARGYLL_3D_DISP_FORMAT to VRML, X3D or X3DOM to change format)\n");
 	fprintf(stderr," outfile        Base name of output %s file\n",vrml_ext());
 	fprintf(stderr,"\n");
@@ -112,6 +124,372 @@ struct _gamdisp {
 }; typedef struct _gamdisp gamdisp;  
 
 
+/* Context for computing the intersection matrix */
+typedef struct {
+	gamut **gams;		/* Input gamuts */
+	int ng;				/* Number of gamuts */
+	double *vol;		/* ng x ng volumes, intersections off the diagonal */
+} isect_cx;
+
+/* Compute the volume of this threads share of the gamut pairs */
+static int isect_thread(void *cntx, int ix, int nth) {
+	isect_cx *cx = (isect_cx *)cntx;
+	int i, j, k;
+
+	for (k = i = 0; i < cx->ng; i++) {
+		for (j = i+1; j < cx->ng; j++, k++) {
+			gamut *s;
+			double vi;
+
+			if ((k % nth) != ix)
+				continue;
+
+			if ((s = new_gamut(0.0, 0, 0)) == NULL)
+				return 1;
+			if (s->intersect(s, cx->gams[i], cx->gams[j])) {
+				s->del(s);
+				return 2;
+			}
+			vi = s->volume(s);
+			s->del(s);
+
+			cx->vol[i * cx->ng + j] = cx->vol[j * cx->ng + i] = vi;
+		}
+	}
+	return 0;
+}
+
+/* Load all the gamuts and print their pairwise intersecting volumes */
+static void isect_matrix(gamdisp *gds, int ng, int lod, int nthreads) {
+	isect_cx cx;
+	int i, j, rv;
+
+	cx.ng = ng;
+	if ((cx.gams = (gamut **)calloc(ng, sizeof(gamut *))) == NULL
+	 || (cx.vol = (double *)calloc(ng * ng, sizeof(double))) == NULL)
+		error("Malloc failed on intersection matrix");
+
+	/* Read each gamut once, and create its search structures */
+	/* so that the intersections can be done in parallel. */
+	for (i = 0; i < ng; i++) {
+		if ((cx.gams[i] = new_gamut(0.0, 0, 0)) == NULL)
+			error("Creating gamut object failed");
+		if (cx.gams[i]->read_gam_lod(cx.gams[i], gds[i].in_name, lod))
+			error("Input file '%s' read failed",gds[i].in_name);
+		cx.vol[i * ng + i] = cx.gams[i]->volume(cx.gams[i]);
+		if (cx.gams[i]->init_query(cx.gams[i]) == 0)
+			nthreads = 1;
+	}
+
+	if (nthreads > (ng * (ng-1))/2)
+		nthreads = (ng * (ng-1))/2;
+	if (nthreads < 1)
+		nthreads = 1;
+
+	if ((rv = par_exec(nthreads, isect_thread, (void *)&cx)) != 0) {
+		if (rv == 2)
+			error("Gamuts are not compatible! (Colorspace, gamut center ?)");
+		error("Creating gamut object failed");
+	}
+
+	/* Print the matrix, with the gamuts own volume on the diagonal */
+	printf("Intersecting volume (cubic units)\n");
+	for (j = 0; j < ng; j++)
+		printf("\t'%s'",gds[j].in_name);
+	printf("\n");
+	for (i = 0; i < ng; i++) {
+		printf("'%s'",gds[i].in_name);
+		for (j = 0; j < ng; j++)
+			printf("\t%.1f",cx.vol[i * ng + j]);
+		printf("\n");
+	}
+
+	for (i = 0; i < ng; i++)
+		cx.gams[i]->del(cx.gams[i]);
+	free(cx.gams);
+	free(cx.vol);
+}
+
+/* An edge that is a candidate for collapse */
+typedef struct {
+	double len;			/* Squared length */
+	int v[2];			/* Vertex indexes */
+} dc_edge;
+
+static int dc_edge_cmp(const void *a, const void *b) {
+	double d = ((dc_edge *)a)->len - ((dc_edge *)b)->len;
+	return d < 0.0 ? -1 : d > 0.0 ? 1 : 0;
+}
+
+/* Un-normalized normal of a triangle */
+static void dc_norm(double n[3], double *p0, double *p1, double *p2) {
+	double d1[3], d2[3];
+
+	icmSub3(d1, p1, p0);
+	icmSub3(d2, p2, p0);
+	icmCross3(n, d1, d2);
+}
+
+/* Reduce a closed triangle mesh to no more than targ triangles, */
+/* by collapsing the shortest edges to their mid points. Collapses that */
+/* would make the surface non-manifold or fold a triangle over are skipped, */
+/* so fewer triangles than asked for may be removed. The vertex and triangle */
+/* arrays are compacted in place, and the counts updated. */
+static void decimate(double (*vp)[3], int *pnverts, int (*tv)[3], int *pntris, int targ) {
+	int nverts = *pnverts, ntris = *pntris;
+	int i, j, k, e;
+	int *vto, *vtl;			/* Vertex to triangle list offsets and lists */
+	int *mark, *mark2, stamp = 0;
+	int *lock;				/* Vertex has been changed in this pass */
+	int *map;
+	dc_edge *edges;
+	int nedges;
+
+	if (targ < 4)
+		targ = 4;
+	if (ntris <= targ)
+		return;
+
+	if ((vto = (int *)malloc((nverts + 1) * sizeof(int))) == NULL
+	 || (vtl = (int *)malloc(3 * ntris * sizeof(int))) == NULL
+	 || (mark = (int *)calloc(nverts, sizeof(int))) == NULL
+	 || (mark2 = (int *)calloc(nverts, sizeof(int))) == NULL
+	 || (lock = (int *)malloc(nverts * sizeof(int))) == NULL
+	 || (edges = (dc_edge *)malloc(3 * ntris * sizeof(dc_edge))) == NULL)
+		error("Malloc failed on decimation");
+
+	/* Each pass collapses edges shortest first, touching each vertex at most once. */
+	/* Removed triangles are marked with a vertex index of -1. */
+	while (ntris > targ) {
+		int ontris = ntris;
+
+		/* Index the live triangles of each vertex */
+		for (i = 0; i <= nverts; i++)
+			vto[i] = 0;
+		for (i = 0; i < *pntris; i++) {
+			if (tv[i][0] < 0)
+				continue;
+			for (j = 0; j < 3; j++)
+				vto[tv[i][j] + 1]++;
+		}
+		for (i = 0; i < nverts; i++)
+			vto[i+1] += vto[i];
+		for (i = 0; i < nverts; i++)
+			lock[i] = vto[i];		/* Use lock[] as fill pointer */
+		for (i = 0; i < *pntris; i++) {
+			if (tv[i][0] < 0)
+				continue;
+			for (j = 0; j < 3; j++)
+				vtl[lock[tv[i][j]]++] = i;
+		}
+
+		/* Each edge appears in one direction in each of its two triangles */
+		for (nedges = i = 0; i < *pntris; i++) {
+			if (tv[i][0] < 0)
+				continue;
+			for (j = 0; j < 3; j++) {
+				int v0 = tv[i][j], v1 = tv[i][(j+1) % 3];
+				if (v0 > v1)
+					continue;
+				edges[nedges].len = icmNorm33sq(vp[v0], vp[v1]);
+				edges[nedges].v[0] = v0;
+				edges[nedges].v[1] = v1;
+				nedges++;
+			}
+		}
+		qsort(edges, nedges, sizeof(dc_edge), dc_edge_cmp);
+
+		for (i = 0; i < nverts; i++)
+			lock[i] = 0;
+
+		for (e = 0; e < nedges && ntris > targ; e++) {
+			int a = edges[e].v[0], b = edges[e].v[1];
+			int ncom, nshared;
+			double np[3];
+
+			if (lock[a] || lock[b])
+				continue;
+
+			/* Link condition: a and b must share exactly two neighbours, */
+			/* the apexes of the two triangles on the edge. */
+			stamp++;
+			for (k = vto[a]; k < vto[a+1]; k++) {
+				int t = vtl[k];
+				if (tv[t][0] < 0)		/* Removed in this pass */
+					continue;
+				for (j = 0; j < 3; j++) {
+					if (tv[t][j] != a)
+						mark[tv[t][j]] = stamp;
+				}
+			}
+			ncom = nshared = 0;
+			for (k = vto[b]; k < vto[b+1]; k++) {
+				int t = vtl[k], hasa = 0;
+				if (tv[t][0] < 0)
+					continue;
+				for (j = 0; j < 3; j++) {
+					int v = tv[t][j];
+					if (v == a)
+						hasa = 1;
+					else if (v != b && mark[v] == stamp && mark2[v] != stamp) {
+						mark2[v] = stamp;
+						ncom++;
+					}
+				}
+				nshared += hasa;
+			}
+			if (ncom != 2 || nshared != 2)
+				continue;
+
+			/* Check that none of the remaining triangles fold over */
+			icmBlend3(np, vp[a], vp[b], 0.5);
+			for (i = 0; i < 2; i++) {
+				int v = i == 0 ? a : b, o = i == 0 ? b : a;
+				for (k = vto[v]; k < vto[v+1]; k++) {
+					int t = vtl[k];
+					double *pp[3], n0[3], n1[3];
+					if (tv[t][0] < 0 || tv[t][0] == o || tv[t][1] == o || tv[t][2] == o)
+						continue;
+					for (j = 0; j < 3; j++)
+						pp[j] = vp[tv[t][j]];
+					dc_norm(n0, pp[0], pp[1], pp[2]);
+					for (j = 0; j < 3; j++) {
+						if (tv[t][j] == v)
+							pp[j] = np;
+					}
+					dc_norm(n1, pp[0], pp[1], pp[2]);
+					if (icmDot3(n0, n1) <= 0.2 * icmNorm3(n0) * icmNorm3(n1))
+						break;
+				}
+				if (k < vto[v+1])
+					break;
+			}
+			if (i < 2)
+				continue;
+
+			/* Collapse b into a */
+			icmCpy3(vp[a], np);
+			for (k = vto[b]; k < vto[b+1]; k++) {
+				int t = vtl[k];
+				if (tv[t][0] < 0)
+					continue;
+				if (tv[t][0] == a || tv[t][1] == a || tv[t][2] == a) {
+					tv[t][0] = tv[t][1] = tv[t][2] = -1;
+					ntris--;
+				} else {
+					for (j = 0; j < 3; j++) {
+						if (tv[t][j] == b)
+							tv[t][j] = a;
+					}
+				}
+			}
+			lock[a] = lock[b] = 1;
+		}
+
+		if (ntris == ontris)		/* Can't go any further */
+			break;
+	}
+
+	/* Compact the vertexes and triangles */
+	map = lock;
+	for (i = 0; i < nverts; i++)
+		map[i] = -1;
+	for (i = 0; i < *pntris; i++) {
+		if (tv[i][0] >= 0) {
+			for (j = 0; j < 3; j++)
+				map[tv[i][j]] = 0;
+		}
+	}
+	for (k = i = 0; i < nverts; i++) {
+		if (map[i] >= 0) {
+			map[i] = k;
+			icmCpy3(vp[k], vp[i]);
+			k++;
+		}
+	}
+	*pnverts = k;
+	for (k = i = 0; i < *pntris; i++) {
+		if (tv[i][0] >= 0) {
+			for (j = 0; j < 3; j++)
+				tv[k][j] = map[tv[i][j]];
+			k++;
+		}
+	}
+	*pntris = k;
+
+	free(edges);
+	free(lock);
+	free(mark2);
+	free(mark);
+	free(vtl);
+	free(vto);
+}
+
+/* Add a gamut surface to the plot */
+static void write_surface(vrml *wrl, gamdisp *gd, double (*vp)[3], int nverts, int (*tv)[3], int ntris) {
+	int i;
+
+	wrl->start_line_set(wrl, 0);
+
+	/* Spit out the point values, in order. */
+	/* Note that a->x, b->y, L->z */
+	for (i = 0; i < nverts; i++)
+		wrl->add_vertex(wrl, 0, vp[i]);
+
+	/* Write the triangles/wires out */
+	for (i = 0; i < ntris; i++) {
+		int v0, v1, v2;
+		v0 = tv[i][0];
+		v1 = tv[i][1];
+		v2 = tv[i][2];
+
+#ifdef HALF_HACK 
+		if (vp[v0][0] < HALF_HACK
+		 || vp[v1][0] < HALF_HACK
+		 || vp[v2][0] < HALF_HACK)
+			continue;
+#endif /* HALF_HACK */
+
+		if (gd->in_rep == gam_wire) {
+			int ix[2];
+			if (v0 < v1) {				/* Only output 1 wire of two on an edge */
+				ix[0] = v0;
+				ix[1] = v1;
+				wrl->add_line(wrl, 0, ix);
+			}
+			if (v1 < v2) {
+				ix[0] = v1;
+				ix[1] = v2;
+				wrl->add_line(wrl, 0, ix);
+			}
+			if (v2 < v0) {
+				ix[0] = v2;
+				ix[1] = v0;
+				wrl->add_line(wrl, 0, ix);
+			}
+		} else {
+			int ix[3];
+			ix[0] = v0;
+			ix[1] = v1;
+			ix[2] = v2;
+			wrl->add_triangle(wrl, 0, ix);
+		}
+	}
+
+	/* Write the wires or triangles out */
+	if (gd->in_rep == gam_wire) {
+		if (gd->in_colors == gam_natural)
+			wrl->make_lines_vc(wrl, 0, gd->in_trans);
+		else
+			wrl->make_lines_cc(wrl, 0, gd->in_trans, color_rgb[gd->in_colors].rgb);
+	} else {
+		if (gd->in_colors == gam_natural)
+			wrl->make_triangles_vc(wrl, 0, gd->in_trans);
+		else
+			wrl->make_triangles(wrl, 0, gd->in_trans, color_rgb[gd->in_colors].rgb);
+	}
+}
+
 /* Set a default for a given gamut */
 static void set_default(gamdisp *gds, int n) {
 	gds[n].in_name[0] = '\000';
@@ -172,6 +550,11 @@ main(int argc, char *argv[]) {
 	int doaxes = 1;
 	int docusps = 0;
 	int isect = 0;
+	int domatrix = 0;		/* Print intersection matrix */
+	int nthreads = 0;		/* Threads for matrix, 0 = default */
+	int lod = 0;			/* Binary gamut file level of detail */
+	int dectris = 0;		/* Decimation target triangle count, 0 = none */
+	int nlevs = 1;			/* Number of levels of detail to output */
 	vrml *wrl;
 	char out_name[MAXNAMEL+1+10];
 	char iout_name[MAXNAMEL+1] = "\000";;
@@ -294,6 +677,47 @@ main(int argc, char *argv[]) {
 				}
 			}
 
+			/* Print intersecting volume matrix */
+			else if (argv[fa][1] == 'm' || argv[fa][1] == 'M') {
+				domatrix = 1;
+			}
+
+			/* Number of threads */
+			else if (argv[fa][1] == 'j' || argv[fa][1] == 'J') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument after flag -j");
+				nthreads = atoi(na);
+				if (nthreads < 1)
+					usage("Number of threads must be 1 or more");
+			}
+
+			/* Level of detail */
+			else if (argv[fa][1] == 'l' || argv[fa][1] == 'L') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument after flag -l");
+				lod = atoi(na);
+				if (lod < 0)
+					usage("Level of detail must be 0 or more");
+			}
+
+			/* Decimate to a triangle count */
+			else if (argv[fa][1] == 'd') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument after flag -d");
+				dectris = atoi(na);
+				if (dectris < 4)
+					usage("Decimation triangle count must be 4 or more");
+			}
+
+			/* Number of output levels of detail */
+			else if (argv[fa][1] == 'D') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument after flag -D");
+				nlevs = atoi(na);
+				if (nlevs < 1 || nlevs > DEC_MAXLEV)
+					usage("Number of levels of detail must be 1 to %d",DEC_MAXLEV);
+			}
+
 			else 
 				usage("Unknown flag '%c'",argv[fa][1]);
 
@@ -309,6 +733,17 @@ main(int argc, char *argv[]) {
 		}
 	}
 
+	/* All the arguments are input gamuts for the matrix */
+	if (domatrix) {
+		if (ng < 2)
+			usage("Need at least two gamuts for -m");
+		if (nthreads <= 0)
+			nthreads = num_threads();
+		isect_matrix(gds, ng, lod, nthreads);
+		free(gds);
+		return 0;
+	}
+
 	/* The last "gamut" is actually the output VRML filename, */
 	/* so unwind it. */
 
@@ -335,146 +770,163 @@ main(int argc, char *argv[]) {
 	/* Read each input in turn */
 	for (n = 0; n < ng; n++) {
 		int i;
-		cgats *pp;
 		int nverts;
 		int ntris;
-		int Lf, af, bf;			/* Fields holding L, a & b data */
-		int v0f, v1f, v2f;		/* Fields holding verticies 0, 1 & 2 */
-
-		pp = new_cgats();	/* Create a CGATS structure */
-	
-		/* Setup to cope with a gamut file */
-		pp->add_other(pp, "GAMUT");
-	
-		if (pp->read_name(pp, gds[n].in_name))
-			error("Input file '%s' error : %s",gds[n].in_name, pp->err);
-	
-		if (pp->t[0].tt != tt_other || pp->t[0].oi != 0)
-			error("Input file isn't a GAMUT format file");
-		if (pp->ntables != 2)
-			error("Input file doesn't contain exactly two tables");
-
-		if ((nverts = pp->t[0].nsets) <= 0)
-			error("No verticies");
-		if ((ntris = pp->t[1].nsets) <= 0)
-			error("No triangles");
-
-		if ((Lf = pp->find_field(pp, 0, "LAB_L")) < 0)
-			error("Input file doesn't contain field LAB_L");
-		if (pp->t[0].ftype[Lf] != r_t)
-			error("Field LAB_L is wrong type");
-		if ((af = pp->find_field(pp, 0, "LAB_A")) < 0)
-			error("Input file doesn't contain field LAB_A");
-		if (pp->t[0].ftype[af] != r_t)
-			error("Field LAB_A is wrong type");
-		if ((bf = pp->find_field(pp, 0, "LAB_B")) < 0)
-			error("Input file doesn't contain field LAB_B");
-		if (pp->t[0].ftype[bf] != r_t)
-			error("Field LAB_B is wrong type");
-
-		wrl->start_line_set(wrl, 0);
-
-		/* Spit out the point values, in order. */
-		/* Note that a->x, b->y, L->z */
-		for (i = 0; i < nverts; i++) {
-			double pos[3];
-			pos[0] = *((double *)pp->t[0].fdata[i][Lf]);
-			pos[1] = *((double *)pp->t[0].fdata[i][af]);
-			pos[2] = *((double *)pp->t[0].fdata[i][bf]);
-			
-			wrl->add_vertex(wrl, 0, pos);
-		}
+		double (*vp)[3];		/* Vertex locations */
+		int (*tv)[3];			/* Triangle vertex indexes */
+		int ncusps = 0;			/* Number of cusp values */
+		double cusps[6][3];		/* Cusp values */
+
+		/* Read a binary gamut file using the gamut library, */
+		/* so that we can choose the level of detail. */
+		if (gamut_is_bgam(gds[n].in_name)) {
+			gamut *gam;
+			int ix, v[3];
+
+			if ((gam = new_gamut(0.0, 0, 0)) == NULL)
+				error("Creating gamut object failed");
+			if (gam->read_gam_lod(gam, gds[n].in_name, lod))
+				error("Input file '%s' read failed",gds[n].in_name);
+
+			nverts = gam->nverts(gam);
+			for (ntris = 0, gam->startnexttri(gam); gam->getnexttri(gam, v) == 0; ntris++)
+				;
+
+			if ((vp = (double (*)[3])malloc(nverts * sizeof(double [3]))) == NULL
+			 || (tv = (int (*)[3])malloc(ntris * sizeof(int [3]))) == NULL)
+				error("Malloc failed on gamut surface");
+
+			for (i = ix = 0; i < nverts; i++) {
+				if ((ix = gam->getvert(gam, NULL, vp[i], ix)) < 0)
+					error("Gamut '%s' verticies are inconsistent",gds[n].in_name);
+			}
+			gam->startnexttri(gam);
+			for (i = 0; i < ntris; i++)
+				gam->getnexttri(gam, tv[i]);
 
-		/* Write the triangles/wires out */
-		if ((v0f = pp->find_field(pp, 1, "VERTEX_0")) < 0)
-			error("Input file doesn't contain field VERTEX_0");
-		if (pp->t[1].ftype[v0f] != i_t)
-			error("Field VERTEX_0 is wrong type");
-		if ((v1f = pp->find_field(pp, 1, "VERTEX_1")) < 0)
-			error("Input file doesn't contain field VERTEX_1");
-		if (pp->t[1].ftype[v1f] != i_t)
-			error("Field VERTEX_1 is wrong type");
-		if ((v2f = pp->find_field(pp, 1, "VERTEX_2")) < 0)
-			error("Input file doesn't contain field VERTEX_2");
-		if (pp->t[1].ftype[v2f] != i_t)
-			error("Field VERTEX_2 is wrong type");
-
-		for (i = 0; i < ntris; i++) {
-			int v0, v1, v2;
-			v0 = *((int *)pp->t[1].fdata[i][v0f]);
-			v1 = *((int *)pp->t[1].fdata[i][v1f]);
-			v2 = *((int *)pp->t[1].fdata[i][v2f]);
+			if (gam->getcusps(gam, cusps) == 0)
+				ncusps = 6;
 
-#ifdef HALF_HACK 
-			if (*((double *)pp->t[0].fdata[v0][Lf]) < HALF_HACK
-			 || *((double *)pp->t[0].fdata[v1][Lf]) < HALF_HACK
-			 || *((double *)pp->t[0].fdata[v2][Lf]) < HALF_HACK)
-				continue;
-#endif /* HALF_HACK */
+			gam->del(gam);
 
-			if (gds[n].in_rep == gam_wire) {
-				int ix[2];
-				if (v0 < v1) {				/* Only output 1 wire of two on an edge */
-					ix[0] = v0;
-					ix[1] = v1;
-					wrl->add_line(wrl, 0, ix);
-				}
-				if (v1 < v2) {
-					ix[0] = v1;
-					ix[1] = v2;
-					wrl->add_line(wrl, 0, ix);
-				}
-				if (v2 < v0) {
-					ix[0] = v2;
-					ix[1] = v0;
-					wrl->add_line(wrl, 0, ix);
-				}
-			} else {
-				int ix[3];
-				ix[0] = v0;
-				ix[1] = v1;
-				ix[2] = v2;
-				wrl->add_triangle(wrl, 0, ix);
-			}
-		}
-
-		/* Write the wires or triangles out */
-		if (gds[n].in_rep == gam_wire) {
-			if (gds[n].in_colors == gam_natural)
-				wrl->make_lines_vc(wrl, 0, gds[n].in_trans);
-			else
-				wrl->make_lines_cc(wrl, 0, gds[n].in_trans, color_rgb[gds[n].in_colors].rgb);
 		} else {
-			if (gds[n].in_colors == gam_natural)
-				wrl->make_triangles_vc(wrl, 0, gds[n].in_trans);
-			else
-				wrl->make_triangles(wrl, 0, gds[n].in_trans, color_rgb[gds[n].in_colors].rgb);
-		}
-
-		/* See if there are cusp values */
-		if (docusps) {
+			cgats *pp;
+			int Lf, af, bf;			/* Fields holding L, a & b data */
+			int v0f, v1f, v2f;		/* Fields holding verticies 0, 1 & 2 */
 			int kk;
-			double rgb[3], Lab[3];
 			char buf1[50];
 			char *cnames[6] = { "RED", "YELLOW", "GREEN", "CYAN", "BLUE", "MAGENTA" };
-	
-			for (i = 0; i < 6; i++) {
-				sprintf(buf1,"CUSP_%s", cnames[i]);
+
+			pp = new_cgats();	/* Create a CGATS structure */
+		
+			/* Setup to cope with a gamut file */
+			pp->add_other(pp, "GAMUT");
+		
+			if (pp->read_name(pp, gds[n].in_name))
+				error("Input file '%s' error : %s",gds[n].in_name, pp->err);
+		
+			if (pp->t[0].tt != tt_other || pp->t[0].oi != 0)
+				error("Input file isn't a GAMUT format file");
+			if (pp->ntables != 2)
+				error("Input file doesn't contain exactly two tables");
+
+			if ((nverts = pp->t[0].nsets) <= 0)
+				error("No verticies");
+			if ((ntris = pp->t[1].nsets) <= 0)
+				error("No triangles");
+
+			if ((Lf = pp->find_field(pp, 0, "LAB_L")) < 0)
+				error("Input file doesn't contain field LAB_L");
+			if (pp->t[0].ftype[Lf] != r_t)
+				error("Field LAB_L is wrong type");
+			if ((af = pp->find_field(pp, 0, "LAB_A")) < 0)
+				error("Input file doesn't contain field LAB_A");
+			if (pp->t[0].ftype[af] != r_t)
+				error("Field LAB_A is wrong type");
+			if ((bf = pp->find_field(pp, 0, "LAB_B")) < 0)
+				error("Input file doesn't contain field LAB_B");
+			if (pp->t[0].ftype[bf] != r_t)
+				error("Field LAB_B is wrong type");
+
+			if ((v0f = pp->find_field(pp, 1, "VERTEX_0")) < 0)
+				error("Input file doesn't contain field VERTEX_0");
+			if (pp->t[1].ftype[v0f] != i_t)
+				error("Field VERTEX_0 is wrong type");
+			if ((v1f = pp->find_field(pp, 1, "VERTEX_1")) < 0)
+				error("Input file doesn't contain field VERTEX_1");
+			if (pp->t[1].ftype[v1f] != i_t)
+				error("Field VERTEX_1 is wrong type");
+			if ((v2f = pp->find_field(pp, 1, "VERTEX_2")) < 0)
+				error("Input file doesn't contain field VERTEX_2");
+			if (pp->t[1].ftype[v2f] != i_t)
+				error("Field VERTEX_2 is wrong type");
+
+			if ((vp = (double (*)[3])malloc(nverts * sizeof(double [3]))) == NULL
+			 || (tv = (int (*)[3])malloc(ntris * sizeof(int [3]))) == NULL)
+				error("Malloc failed on gamut surface");
+
+			for (i = 0; i < nverts; i++) {
+				vp[i][0] = *((double *)pp->t[0].fdata[i][Lf]);
+				vp[i][1] = *((double *)pp->t[0].fdata[i][af]);
+				vp[i][2] = *((double *)pp->t[0].fdata[i][bf]);
+			}
+
+			for (i = 0; i < ntris; i++) {
+				tv[i][0] = *((int *)pp->t[1].fdata[i][v0f]);
+				tv[i][1] = *((int *)pp->t[1].fdata[i][v1f]);
+				tv[i][2] = *((int *)pp->t[1].fdata[i][v2f]);
+			}
+
+			/* See if there are cusp values */
+			for (ncusps = 0; ncusps < 6; ncusps++) {
+				sprintf(buf1,"CUSP_%s", cnames[ncusps]);
 				if ((kk = pp->find_kword(pp, 0, buf1)) < 0)
 					break;
 	
 				if (sscanf(pp->t[0].kdata[kk], "%lf %lf %lf",
-			           &Lab[0], &Lab[1], &Lab[2]) != 3) {
+			           &cusps[ncusps][0], &cusps[ncusps][1], &cusps[ncusps][2]) != 3) {
 					break;
 				}
+			}
+
+			pp->del(pp);		/* Clean up */
+		}
 
+		/* Reduce the detail to the target triangle count */
+		if (dectris > 0)
+			decimate(vp, &nverts, tv, &ntris, dectris);
+
+		if (nlevs > 1) {
+			double range[DEC_MAXLEV];
+			int k;
+
+			for (k = 0; k < (nlevs-1); k++)
+				range[k] = DEC_RANGE * pow(DEC_RANGEF, (double)k);
+			wrl->start_lod(wrl, nlevs, range);
+			for (k = 0;;) {
+				write_surface(wrl, &gds[n], vp, nverts, tv, ntris);
+				if (++k >= nlevs)
+					break;
+				wrl->next_lod(wrl);
+				decimate(vp, &nverts, tv, &ntris, ntris/DEC_LEVRAT);
+			}
+			wrl->end_lod(wrl);
+		} else {
+			write_surface(wrl, &gds[n], vp, nverts, tv, ntris);
+		}
+
+		/* Add cusp markers */
+		if (docusps) {
+			for (i = 0; i < ncusps; i++) {
 				if (gds[n].in_colors != gam_natural)
-					wrl->add_marker(wrl, Lab, color_rgb[gds[n].in_colors].rgb, 2.0);
+					wrl->add_marker(wrl, cusps[i], color_rgb[gds[n].in_colors].rgb, 2.0);
 				else
-					wrl->add_marker(wrl, Lab, NULL, 2.0);
+					wrl->add_marker(wrl, cusps[i], NULL, 2.0);
 			}
 		}
-		pp->del(pp);		/* Clean up */
+
+		free(tv);
+		free(vp);
 	}
 
 	/* Write the file out */
@@ -495,10 +947,10 @@ main(int argc, char *argv[]) {
 		if ((s2 = new_gamut(0.0, 0, 0)) == NULL)
 			error("Creating gamut object failed");
 		
-		if (s1->read_gam(s1, gds[0].in_name))
+		if (s1->read_gam_lod(s1, gds[0].in_name, lod))
 			error("Input file '%s' read failed",gds[n].in_name[0]);
 
-		if (s2->read_gam(s2, gds[1].in_name))
+		if (s2->read_gam_lod(s2, gds[1].in_name, lod))
 			error("Input file '%s' read failed",gds[n].in_name[1]);
 
 		v1 = s1->volume(s1);
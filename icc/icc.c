@@ -761,6 +761,53 @@ static int write_DCS16Number(double d, char *p) {
 	return 0;
 }
 
+/* Write an array of n device coordinates as 8 bit values. */
+/* The range check is deferred to the end of the loop, so that the */
+/* loop is free of branches, and the compiler can vectorize it. */
+/* Return n on success, or the index of the first value out of range. */
+static unsigned int write_DCS8Numbers(double *d, char *p, unsigned int n) {
+	unsigned int i;
+	double mn = 0.0, mx = 0.0;
+
+	for (i = 0; i < n; i++) {
+		double v = d[i] * 255.0 + 0.5;
+		mn = v < mn ? v : mn;
+		mx = v > mx ? v : mx;
+		((ORD8 *)p)[i] = (ORD8)(int)v;
+	}
+	if (mn < 0.0 || mx >= 256.0) {
+		for (i = 0; i < n; i++) {
+			if (write_DCS8Number(d[i], p + i))
+				break;
+		}
+	}
+	return i;
+}
+
+/* Write an array of n device coordinates as 16 bit values. */
+/* Return n on success, or the index of the first value out of range. */
+static unsigned int write_DCS16Numbers(double *d, char *p, unsigned int n) {
+	unsigned int i;
+	double mn = 0.0, mx = 0.0;
+
+	for (i = 0; i < n; i++) {
+		double v = d[i] * 65535.0 + 0.5;
+		int o;
+		mn = v < mn ? v : mn;
+		mx = v > mx ? v : mx;
+		o = (int)v;
+		((ORD8 *)p)[2 * i]     = (ORD8)(o >> 8);
+		((ORD8 *)p)[2 * i + 1] = (ORD8)(o);
+	}
+	if (mn < 0.0 || mx >= 65536.0) {
+		for (i = 0; i < n; i++) {
+			if (write_DCS16Number(d[i], p + 2 * i))
+				break;
+		}
+	}
+	return i;
+}
+
 static void Lut_Lut2XYZ(double *out, double *in);
 static void Lut_XYZ2Lut(double *out, double *in);
 static void Lut_Lut2Lab_8(double *out, double *in);
@@ -3795,6 +3842,23 @@ static int icmTable_lookup_bwd(
 
 /* - - - - - - - - - - - - */
 
+/* Setup the reverse lookup table of a Table curve, if it */
+/* hasn't been already. Return 0 on success, 2 on malloc error. */
+static int icmCurve_init_bwd(
+	icmCurve *p
+) {
+	icc *icp = p->icp;
+	int rv = 0;
+
+	if (p->flag == icmCurveSpec && p->size != 0 && p->rt.inited == 0) {
+		if ((rv = icmTable_setup_bwd(icp, &p->rt, p->size, p->data)) != 0) {
+			sprintf(icp->err,"icmCurve_lookup: Malloc failure in reverse lookup init.");
+			return icp->errc = rv;
+		}
+	}
+	return rv;
+}
+
 /* Do a reverse lookup through the curve */
 /* Return 0 on success, 1 if clipping occured, 2 on other error */
 /* (Note that clipping means mathematical clipping, and is not */
@@ -3804,7 +3868,6 @@ static int icmCurve_lookup_bwd(
 	double *out,
 	double *in
 ) {
-	icc *icp = p->icp;
 	int rv = 0;
 	if (p->flag == icmCurveLin) {
 		*out = *in;
@@ -3817,13 +3880,8 @@ static int icmCurve_lookup_bwd(
 	} else if (p->size == 0) { /* Table of 0 size */
 		*out = *in;
 	} else { /* Use linear interpolation */
-		if (p->rt.inited == 0) {	
-			rv = icmTable_setup_bwd(icp, &p->rt, p->size, p->data);
-			if (rv != 0) {
-				sprintf(icp->err,"icmCurve_lookup: Malloc failure in reverse lookup init.");
-				return icp->errc = rv;
-			}
-		}
+		if (p->rt.inited == 0 && (rv = icmCurve_init_bwd(p)) != 0)
+			return rv;
 		rv = icmTable_lookup_bwd(&p->rt, out, in);
 	}
 	return rv;
@@ -4941,6 +4999,62 @@ static int icmLut_nu_matrix(
 	return 0;
 }
 
+/* Decode a cLUT whose decoding was deferred by icmLut_read(). */
+/* Return 0 on success, error code on failure */
+static int icmLut_get_clut(
+	icmLut *p		/* Pointer to Lut object */
+) {
+	unsigned int i, size;
+	char *bp;
+	int rv;
+
+	if ((bp = (char *)p->clutRaw) == NULL)
+		return 0;
+
+	p->clutRaw = NULL;
+	if ((rv = p->allocate((icmBase *)p)) != 0)
+		return rv;
+
+	size = p->clutRawSize;
+	if (p->ttype == icSigLut8Type) {
+		for (i = 0; i < size; i++, bp += 1)
+			p->clutTable[i] = read_DCS8Number(bp);
+	} else {
+		for (i = 0; i < size; i++, bp += 2)
+			p->clutTable[i] = read_DCS16Number(bp);
+	}
+	return 0;
+}
+
+/* Setup the reverse lookup tables for the input and output */
+/* tables, if they haven't been already. */
+/* Return 0 on success, 2 on malloc error. */
+static int icmLut_init_bwd(
+	icmLut *p		/* Pointer to Lut object */
+) {
+	icc *icp = p->icp;
+	unsigned int i;
+	int rv;
+
+	for (i = 0; i < p->inputChan; i++) {
+		if (p->rit[i].inited == 0
+		 && (rv = icmTable_setup_bwd(icp, &p->rit[i], p->inputEnt,
+		                             p->inputTable + i * p->inputEnt)) != 0) {
+			sprintf(icp->err,"icc_Lut_inv_input: Malloc failure in inverse lookup init.");
+			return icp->errc = rv;
+		}
+	}
+	for (i = 0; i < p->outputChan; i++) {
+		if (p->rot[i].inited == 0
+		 && (rv = icmTable_setup_bwd(icp, &p->rot[i], p->outputEnt,
+		                             p->outputTable + i * p->outputEnt)) != 0) {
+			sprintf(icp->err,"icc_Lut_inv_output: Malloc failure in inverse lookup init.");
+			return icp->errc = rv;
+		}
+	}
+	return 0;
+}
+
 /* return the locations of the minimum and */
 /* maximum values of the given channel, in the clut */
 static void icmLut_min_max(
@@ -4954,6 +5068,9 @@ static void icmLut_min_max(
 	unsigned int e, ee, f;
 	int gc[MAX_CHAN];	/* Grid coordinate */
 
+	if (icmLut_get_clut(p) != 0)
+		return;
+
 	minv = 1e6;
 	maxv = -1e6;
 
@@ -5058,6 +5175,9 @@ double *in		/* Input array[outputChan] */
 	double co[MAX_CHAN];		/* Coordinate offset with the grid cell */
 	double *gw, GW[1 << 8];		/* weight for each grid cube corner */
 
+	if (p->clutRaw != NULL && (rv = icmLut_get_clut(p)) != 0)
+		return rv;
+
 	if (p->inputChan <= 8) {
 		gw = GW;				/* Use stack allocation */
 	} else {
@@ -5146,6 +5266,9 @@ double *in		/* Input array[outputChan] */
 	double co[MAX_CHAN];		/* Coordinate offset with the grid cell */
 	int    si[MAX_CHAN];		/* co[] Sort index, [0] = smallest */
 
+	if (p->clutRaw != NULL && (rv = icmLut_get_clut(p)) != 0)
+		return rv;
+
 	/* We are using a simplex (ie. tetrahedral for 3D input) interpolation. */
 	/* This method is more appropriate for XYZ/RGB/CMYK input spaces, */
 
@@ -5294,6 +5417,9 @@ double *in		/* Input array[outputChan] */
 	double *gw, GW[1 << 8];		/* weight for each grid cube corner */
 	double cout[MAX_CHAN];		/* Current output value */
 
+	if (p->clutRaw != NULL && (rv = icmLut_get_clut(p)) != 0)
+		return rv;
+
 	if (p->inputChan <= 8) {
 		gw = GW;				/* Use stack allocation */
 	} else {
@@ -5404,6 +5530,9 @@ double *in		/* Input array[outputChan] */
 	double co[MAX_CHAN];		/* Coordinate offset with the grid cell */
 	int    si[MAX_CHAN];		/* co[] Sort index, [0] = smallest */
 
+	if (p->clutRaw != NULL && (rv = icmLut_get_clut(p)) != 0)
+		return rv;
+
 	/* We are using a simplex (ie. tetrahedral for 3D input) interpolation. */
 	/* This method is more appropriate for XYZ/RGB/CMYK input spaces, */
 
@@ -5805,6 +5934,13 @@ int icmSetMultiLutTables(
 		}
 	}
 
+	/* Any deferred cLUT must be in place before it is overwritten */
+	for (tn = 0; tn < ntables; tn++) {
+		int rv;
+		if ((rv = icmLut_get_clut(pp[tn])) != 0)
+			return rv;
+	}
+
 	if (getNormFunc(icp, insig, p->ttype, icmFromLuti, &ifromindex) != 0) {
 		sprintf(icp->err,"icmLut_set_tables index to input colorspace function lookup failed");
 		return icp->errc = 1;
@@ -6402,6 +6538,19 @@ int icmSetMultiLutTables(
 		}
 	}
 
+	/* Any reverse lookup tables made from the old 1D tables are now stale */
+	for (tn = 0; tn < ntables; tn++) {
+		pn = pp[tn];
+		for (f = 0; f < pn->inputChan; f++) {
+			icmTable_delete_bwd(icp, &pn->rit[f]);
+			pn->rit[f].inited = 0;
+		}
+		for (f = 0; f < pn->outputChan; f++) {
+			icmTable_delete_bwd(icp, &pn->rot[f]);
+			pn->rot[f].inited = 0;
+		}
+	}
+
 	icp->al->free(icp->al, _iv);
 
 	icp->warnc = 0;
@@ -6481,45 +6630,59 @@ static int icmLut_read(
 	int rv = 0;
 	unsigned int i, j, g, size;
 	char *bp, *buf;
+	unsigned char *fbuf;
+	size_t flen;
+	int inplace = 0;	/* NZ if buf points into the icmFile memory buffer */
 
 	if (len < 4) {
 		sprintf(icp->err,"icmLut_read: Tag too small to be legal");
 		return icp->errc = 1;
 	}
 
-	/* Allocate a file read buffer */
-	if ((buf = (char *) icp->al->malloc(icp->al, len)) == NULL) {
-		sprintf(icp->err,"icmLut_read: malloc() failed");
-		return icp->errc = 2;
-	}
-	bp = buf;
+	/* If the file is memory based, read the tag in place */
+	if (icp->fp->get_buf(icp->fp, &fbuf, &flen) == 0
+	 && fbuf != NULL && of <= flen && len <= (flen - of)) {
+		buf = (char *)fbuf + of;
+		inplace = 1;
 
-	/* Read portion of file into buffer */
-	if (   icp->fp->seek(icp->fp, of) != 0
-	    || icp->fp->read(icp->fp, bp, 1, len) != len) {
-		sprintf(icp->err,"icmLut_read: fseek() or fread() failed");
-		icp->al->free(icp->al, buf);
-		return icp->errc = 1;
+	} else {
+		/* Allocate a file read buffer */
+		if ((buf = (char *) icp->al->malloc(icp->al, len)) == NULL) {
+			sprintf(icp->err,"icmLut_read: malloc() failed");
+			return icp->errc = 2;
+		}
+
+		/* Read portion of file into buffer */
+		if (   icp->fp->seek(icp->fp, of) != 0
+		    || icp->fp->read(icp->fp, buf, 1, len) != len) {
+			sprintf(icp->err,"icmLut_read: fseek() or fread() failed");
+			icp->al->free(icp->al, buf);
+			return icp->errc = 1;
+		}
 	}
+	bp = buf;
 
 	/* Read type descriptor from the buffer */
 	p->ttype = (icTagTypeSignature)read_SInt32Number(bp);
 	if (p->ttype != icSigLut8Type && p->ttype != icSigLut16Type) {
 		sprintf(icp->err,"icmLut_read: Wrong tag type for icmLut");
-		icp->al->free(icp->al, buf);
+		if (!inplace)
+			icp->al->free(icp->al, buf);
 		return icp->errc = 1;
 	}
 
 	if (p->ttype == icSigLut8Type) {
 		if (len < 48) {
 			sprintf(icp->err,"icmLut_read: Tag too small to be legal");
-			icp->al->free(icp->al, buf);
+			if (!inplace)
+				icp->al->free(icp->al, buf);
 			return icp->errc = 1;
 		}
 	} else {
 		if (len < 52) {
 			sprintf(icp->err,"icmLut_read: Tag too small to be legal");
-			icp->al->free(icp->al, buf);
+			if (!inplace)
+				icp->al->free(icp->al, buf);
 			return icp->errc = 1;
 		}
 	}
@@ -6554,14 +6717,26 @@ static int icmLut_read(
 	if ((size = icmLut_get_size((icmBase *)p)) == UINT_MAX
 	 || size > len) {
 		sprintf(icp->err,"icmLut_read: Tag wrong size for contents");
-		icp->al->free(icp->al, buf);
+		if (!inplace)
+			icp->al->free(icp->al, buf);
 		return icp->errc = 1;
 	}
 
+	/* If the cLUT can stay in the file buffer, defer decoding it */
+	/* until it is first used (see icmLut_get_clut()). */
+	p->clutRaw = NULL;
+	if (inplace && icp->lazyclut) {
+		p->clutRaw = (unsigned char *)bp + (p->inputChan * p->inputEnt)
+		           * (p->ttype == icSigLut8Type ? 1 : 2);
+		p->clutRawSize = p->outputChan * sat_pow(p->clutPoints,p->inputChan);
+	}
+
 	/* Sanity check the dimensions and resolution values agains limits, */
 	/* allocate space for them and generate internal offset tables. */
 	if ((rv = p->allocate((icmBase *)p)) != 0) {
-		icp->al->free(icp->al, buf);
+		p->clutRaw = NULL;
+		if (!inplace)
+			icp->al->free(icp->al, buf);
 		return rv;
 	}
 
@@ -6577,7 +6752,9 @@ static int icmLut_read(
 
 	/* Read the clut table */
 	size = (p->outputChan * sat_pow(p->clutPoints,p->inputChan));
-	if (p->ttype == icSigLut8Type) {
+	if (p->clutRaw != NULL) {
+		bp += size * (p->ttype == icSigLut8Type ? 1 : 2);
+	} else if (p->ttype == icSigLut8Type) {
 		for (i = 0; i < size; i++, bp += 1)
 			p->clutTable[i] = read_DCS8Number(bp);
 	} else {
@@ -6595,10 +6772,13 @@ static int icmLut_read(
 			p->outputTable[i] = read_DCS16Number(bp);
 	}
 
-	icp->al->free(icp->al, buf);
+	if (!inplace)
+		icp->al->free(icp->al, buf);
 	return 0;
 }
 
+#define ICM_LUT_WCHUNK 65536	/* Bytes of clut converted and written at a time */
+
 /* Write the contents of the object. Return 0 on sucess, error code on failure */
 static int icmLut_write(
 	icmBase *pp,
@@ -6608,15 +6788,30 @@ static int icmLut_write(
 	icc *icp = p->icp;
 	unsigned int i,j;
 	unsigned int len, size;
+	unsigned int esz, hlen, n;
 	char *bp, *buf;		/* Buffer to write from */
 	int rv = 0;
 
-	/* Allocate a file write buffer */
+	if ((rv = icmLut_get_clut(p)) != 0)
+		return rv;
+
+	/* The clut table is converted and written a chunk at a time, so the */
+	/* buffer only needs to hold the header and input tables, the output */
+	/* tables, or one chunk, rather than the whole tag. */
 	if ((len = p->get_size((icmBase *)p)) == UINT_MAX) {
 		sprintf(icp->err,"icmLut_write get_size overflow");
 		return icp->errc = 1;
 	}
-	if ((buf = (char *) icp->al->malloc(icp->al, len)) == NULL) {
+	esz = p->ttype == icSigLut8Type ? 1 : 2;
+	hlen = (p->ttype == icSigLut8Type ? 48 : 52) + esz * p->inputChan * p->inputEnt;
+	size = ICM_LUT_WCHUNK;
+	if (hlen > size)
+		size = hlen;
+	if ((esz * p->outputChan * p->outputEnt) > size)
+		size = esz * p->outputChan * p->outputEnt;
+	if (size > len)
+		size = len;
+	if ((buf = (char *) icp->al->malloc(icp->al, size)) == NULL) {
 		sprintf(icp->err,"icmLut_write malloc() failed");
 		return icp->errc = 2;
 	}
@@ -6699,67 +6894,68 @@ static int icmLut_write(
 	/* Write the input tables */
 	size = (p->inputChan * p->inputEnt);
 	if (p->ttype == icSigLut8Type) {
-		for (i = 0; i < size; i++, bp += 1) {
-			if ((rv = write_DCS8Number(p->inputTable[i], bp)) != 0) {
-				sprintf(icp->err,"icmLut_write: inputTable write_DCS8Number() failed");
-				icp->al->free(icp->al, buf);
-				return icp->errc = rv;
-			}
+		if ((n = write_DCS8Numbers(p->inputTable, bp, size)) != size) {
+			sprintf(icp->err,"icmLut_write: inputTable write_DCS8Number() failed");
+			icp->al->free(icp->al, buf);
+			return icp->errc = 1;
 		}
 	} else {
-		for (i = 0; i < size; i++, bp += 2) {
-			if ((rv = write_DCS16Number(p->inputTable[i], bp)) != 0) {
-				sprintf(icp->err,"icmLut_write: inputTable write_DCS16Number(%.8f) failed",p->inputTable[i]);
-				icp->al->free(icp->al, buf);
-				return icp->errc = rv;
-			}
+		if ((n = write_DCS16Numbers(p->inputTable, bp, size)) != size) {
+			sprintf(icp->err,"icmLut_write: inputTable write_DCS16Number(%.8f) failed",p->inputTable[n]);
+			icp->al->free(icp->al, buf);
+			return icp->errc = 1;
 		}
 	}
 
-	/* Write the clut table */
+	if (   icp->fp->seek(icp->fp, of) != 0
+	    || icp->fp->write(icp->fp, buf, 1, hlen) != hlen) {
+		sprintf(icp->err,"icmLut_write fseek() or fwrite() failed");
+		icp->al->free(icp->al, buf);
+		return icp->errc = 2;
+	}
+
+	/* Write the clut table a chunk at a time */
 	size = (p->outputChan * sat_pow(p->clutPoints,p->inputChan));
-	if (p->ttype == icSigLut8Type) {
-		for (i = 0; i < size; i++, bp += 1) {
-			if ((rv = write_DCS8Number(p->clutTable[i], bp)) != 0) {
+	for (i = 0; i < size; i += j) {
+		if ((j = ICM_LUT_WCHUNK/esz) > (size - i))
+			j = size - i;
+		if (p->ttype == icSigLut8Type) {
+			if ((n = write_DCS8Numbers(p->clutTable + i, buf, j)) != j) {
 				sprintf(icp->err,"icmLut_write: clutTable write_DCS8Number() failed");
 				icp->al->free(icp->al, buf);
-				return icp->errc = rv;
+				return icp->errc = 1;
 			}
-		}
-	} else {
-		for (i = 0; i < size; i++, bp += 2) {
-			if ((rv = write_DCS16Number(p->clutTable[i], bp)) != 0) {
-				sprintf(icp->err,"icmLut_write: clutTable write_DCS16Number(%.8f) failed",p->clutTable[i]);
+		} else {
+			if ((n = write_DCS16Numbers(p->clutTable + i, buf, j)) != j) {
+				sprintf(icp->err,"icmLut_write: clutTable write_DCS16Number(%.8f) failed",p->clutTable[i+n]);
 				icp->al->free(icp->al, buf);
-				return icp->errc = rv;
+				return icp->errc = 1;
 			}
 		}
+		if (icp->fp->write(icp->fp, buf, esz, j) != j) {
+			sprintf(icp->err,"icmLut_write fwrite() failed");
+			icp->al->free(icp->al, buf);
+			return icp->errc = 2;
+		}
 	}
 
 	/* Write the output tables */
 	size = (p->outputChan * p->outputEnt);
 	if (p->ttype == icSigLut8Type) {
-		for (i = 0; i < size; i++, bp += 1) {
-			if ((rv = write_DCS8Number(p->outputTable[i], bp)) != 0) {
-				sprintf(icp->err,"icmLut_write: outputTable write_DCS8Number() failed");
-				icp->al->free(icp->al, buf);
-				return icp->errc = rv;
-			}
+		if ((n = write_DCS8Numbers(p->outputTable, buf, size)) != size) {
+			sprintf(icp->err,"icmLut_write: outputTable write_DCS8Number() failed");
+			icp->al->free(icp->al, buf);
+			return icp->errc = 1;
 		}
 	} else {
-		for (i = 0; i < size; i++, bp += 2) {
-			if ((rv = write_DCS16Number(p->outputTable[i], bp)) != 0) {
-				sprintf(icp->err,"icmLut_write: outputTable write_DCS16Number(%.8f) failed",p->outputTable[i]);
-				icp->al->free(icp->al, buf);
-				return icp->errc = rv;
-			}
+		if ((n = write_DCS16Numbers(p->outputTable, buf, size)) != size) {
+			sprintf(icp->err,"icmLut_write: outputTable write_DCS16Number(%.8f) failed",p->outputTable[n]);
+			icp->al->free(icp->al, buf);
+			return icp->errc = 1;
 		}
 	}
-
-	/* Write buffer to the file */
-	if (   icp->fp->seek(icp->fp, of) != 0
-	    || icp->fp->write(icp->fp, buf, 1, len) != len) {
-		sprintf(icp->err,"icmLut_write fseek() or fwrite() failed");
+	if (icp->fp->write(icp->fp, buf, esz, size) != size) {
+		sprintf(icp->err,"icmLut_write fwrite() failed");
 		icp->al->free(icp->al, buf);
 		return icp->errc = 2;
 	}
@@ -6806,6 +7002,8 @@ static void icmLut_dump(
 		op->gprintf(op,"\n  CLUT table:\n");
 		if (p->inputChan > MAX_CHAN) {
 			op->gprintf(op,"  !!Can't dump > %d input channel CLUT table!!\n",MAX_CHAN);
+		} else if (icmLut_get_clut(p) != 0) {
+			op->gprintf(op,"  !!Decoding CLUT table failed!!\n");
 		} else {
 			size = (p->outputChan * sat_pow(p->clutPoints,p->inputChan));
 			for (j = 0; j < p->inputChan; j++)
@@ -6889,7 +7087,14 @@ static int icmLut_allocate(
 		sprintf(icp->err,"icmLut_alloc size overflow");
 		return icp->errc = 1;
 	}
-	if (size != p->clutTable_size) {
+	if (p->clutRaw != NULL && size != p->clutRawSize)
+		p->clutRaw = NULL;		/* Dimensions have changed, so deferred cLUT is stale */
+	if (p->clutRaw != NULL) {	/* Deferred cLUT, allocated by icmLut_get_clut() */
+		if (p->clutTable != NULL)
+			icp->al->free(icp->al, p->clutTable);
+		p->clutTable = NULL;
+		p->clutTable_size = 0;
+	} else if (size != p->clutTable_size) {
 		if (ovr_mul(size, sizeof(double))) {
 			sprintf(icp->err,"icmLut_alloc: size overflow");
 			return icp->errc = 1;
@@ -11256,6 +11461,11 @@ static struct {
 
 /*	To be added:
 	icSigMultiProcessElementsType
+
+	(When it is, its lookup should convert the element chain into
+	 flat float curve/matrix/clut stages when the Lu is created,
+	 merging adjacent matrices, and provide a lookup of many
+	 values at a time, rather than walking the elements per value.)
 */
 	{icMaxEnumType,                NULL}
 }; 
@@ -11896,45 +12106,50 @@ static int icc_read(
 	return icc_read_x(p, fp, of, 0);
 }
 
-/* Check the profiles ID. We assume the file has already been read. */
-/* Return 0 if OK, 1 if no ID to check, 2 if doesn't match, 3 if some other error. */
-/* NOTE: this reads the whole file again, to compute the checksum. */
-static int icc_check_id(
+/* Compute the MD5 profile ID of the profile that has been read, */
+/* using the file buffer in place if it is memory based. */
+/* Return 0 if OK, 3 on error. */
+static int icc_compute_id(
 	icc *p,
-	ORD8 *rid		/* Optionaly return computed ID */
+	ORD8 id[16]		/* Return computed ID */
 ) {
-	unsigned char buf[128];
-	ORD8 id[16];
+	unsigned char buf[128], *fbuf;
 	icmMD5 *md5 = NULL;
 	unsigned int len;
-	
+	size_t flen;
+
 	if (p->header == NULL) {
-		sprintf(p->err,"icc_check_id: No header defined");
+		sprintf(p->err,"icc_compute_id: No header defined");
 		return p->errc = 3;
 	}
-	len = p->header->size;		/* Claimed size of profile */
-
-	/* See if there is an ID to compare against */
-	for (len = 0; len < 16; len++) {
-		if (p->header->id[len] != 0)
-			break;
-	}
-	if (len >= 16) {
-		return 1; 
+	if (p->header->size < 128) {
+		sprintf(p->err,"icc_compute_id: Profile size is too small");
+		return p->errc = 3;
 	}
+	len = p->header->size - 128;		/* Claimed size of profile after header */
 
 	if ((md5 = new_icmMD5_a(p->al)) == NULL) {
-		sprintf(p->err,"icc_check_id: new_icmMD5 failed");
-		return p->errc = 3;
-	}
-		
-	/* Check the header */
-	if (   p->fp->seek(p->fp, p->of) != 0
-	    || p->fp->read(p->fp, buf, 1, 128) != 128) {
-		sprintf(p->err,"icc_check_id: fseek() or fread() failed");
+		sprintf(p->err,"icc_compute_id: new_icmMD5 failed");
 		return p->errc = 3;
 	}
 
+	/* Use a memory based file in place */
+	if (p->fp->get_buf(p->fp, &fbuf, &flen) == 0
+	 && fbuf != NULL && p->of <= flen && (flen - p->of) >= 128
+	 && len <= (flen - p->of - 128)) {
+		fbuf += p->of;
+		memcpy(buf, fbuf, 128);
+		fbuf += 128;
+	} else {
+		fbuf = NULL;
+		if (   p->fp->seek(p->fp, p->of) != 0
+		    || p->fp->read(p->fp, buf, 1, 128) != 128) {
+			sprintf(p->err,"icc_compute_id: fseek() or fread() failed");
+			md5->del(md5);
+			return p->errc = 3;
+		}
+	}
+		
 	/* Zero the appropriate bytes in the header */
 	buf[44] = buf[45] = buf[46] = buf[47] = 0;
 	buf[64] = buf[65] = buf[66] = buf[67] = 0;
@@ -11946,37 +12161,103 @@ static int icc_check_id(
 	md5->add(md5, buf, 128);
 
 	/* Suck in the rest of the profile */
-	for (;len > 0;) {
-		unsigned int rsize = 128;
-		if (rsize > len)
-			rsize = len;
-		if (p->fp->read(p->fp, buf, 1, rsize) != rsize) {
-			sprintf(p->err,"icc_check_id: fread() failed");
-			return p->errc = 3;
+	if (fbuf != NULL) {
+		md5->add(md5, fbuf, len);
+	} else {
+		for (;len > 0;) {
+			unsigned int rsize = 128;
+			if (rsize > len)
+				rsize = len;
+			if (p->fp->read(p->fp, buf, 1, rsize) != rsize) {
+				sprintf(p->err,"icc_compute_id: fread() failed");
+				md5->del(md5);
+				return p->errc = 3;
+			}
+			md5->add(md5, buf, rsize);
+			len -= rsize;
 		}
-		md5->add(md5, buf, rsize);
-		len -= rsize;
 	}
 
 	md5->get(md5, id);
 	md5->del(md5);
 
+	return 0;
+}
+
+/* Check the profiles ID. We assume the file has already been read. */
+/* Return 0 if OK, 1 if no ID to check, 2 if doesn't match, 3 if some other error. */
+/* NOTE: this reads the whole file again, to compute the checksum. */
+static int icc_check_id(
+	icc *p,
+	ORD8 *rid		/* Optionaly return computed ID */
+) {
+	ORD8 id[16];
+	unsigned int i;
+	int rv;
+	
+	if (p->header == NULL) {
+		sprintf(p->err,"icc_check_id: No header defined");
+		return p->errc = 3;
+	}
+
+	/* See if there is an ID to compare against */
+	for (i = 0; i < 16; i++) {
+		if (p->header->id[i] != 0)
+			break;
+	}
+	if (i >= 16) {
+		return 1; 
+	}
+
+	if ((rv = icc_compute_id(p, id)) != 0)
+		return rv;
+
 	if (rid != NULL) {
-		for (len = 0; len < 16; len++)
-			rid[len] = id[len];
+		for (i = 0; i < 16; i++)
+			rid[i] = id[i];
 	}
 
 	/* Check the ID */
-	for (len = 0; len < 16; len++) {
-		if (p->header->id[len] != id[len])
+	for (i = 0; i < 16; i++) {
+		if (p->header->id[i] != id[i])
 			break;
 	}
-	if (len >= 16) {
+	if (i >= 16) {
 		return 0;		/* Matched */ 
 	}
 	return 2;			/* Didn't match */
 }
 
+/* Return a hash of the profile contents that can be used as a cache key. */
+/* This is the profile ID if one is present, and otherwise the MD5 */
+/* computed the same way as the profile ID. The profile ID is assumed */
+/* to be valid without checking it, so that this is fast. */
+/* We assume the file has already been read. */
+/* Return 0 if OK, 3 on error */
+static int icc_get_hash(
+	icc *p,
+	ORD8 hash[16]		/* Return the hash */
+) {
+	unsigned int i;
+
+	if (p->header == NULL) {
+		sprintf(p->err,"icc_get_hash: No header defined");
+		return p->errc = 3;
+	}
+
+	for (i = 0; i < 16; i++) {
+		if (p->header->id[i] != 0)
+			break;
+	}
+	if (i < 16) {			/* Use the profile ID */
+		for (i = 0; i < 16; i++)
+			hash[i] = p->header->id[i];
+		return 0;
+	}
+
+	return icc_compute_id(p, hash);
+}
+
 static void icc_setup_wpchtmx(icc *p);
 void icmQuantize3x3S15Fixed16(double targ[3], double mat[3][3], double in[3]);
 
@@ -15751,25 +16032,231 @@ ICCLIB_API double icmXYZCIE2K(icmXYZNumber *w, double *in0, double *in1) {
 	return sqrt(icmCIE2Ksq(lab0, lab1));
 }
 
+/* Return a fast approximation of atan2(y, x) in degrees, 0.0 .. 360.0, */
+/* with a maximum error of about 0.0006 degrees. */
+static double icm_fatan2d(double y, double x) {
+	double ax = fabs(x), ay = fabs(y);
+	double t, tt, a;
+
+	if (ax < 1e-300 && ay < 1e-300)
+		return 0.0;
+	t = ax < ay ? ax/ay : ay/ax;		/* 0.0 .. 1.0 */
+	tt = t * t;
+	a = t * (0.99997726 + tt * (-0.33262347 + tt * (0.19354346
+	  + tt * (-0.11643287 + tt * (0.05265332 + tt * -0.01172120)))));
+	if (ay > ax)
+		a = 0.5 * M_PI - a;
+	if (x < 0.0)
+		a = M_PI - a;
+	a *= 180.0/M_PI;
+	if (y < 0.0)
+		a = 360.0 - a;
+	return a;
+}
+
+/* Return a fast approximation of the CIEDE2000 Delta E squared, for two Lab values. */
+/* The hue difference and the hue weighting are computed from the hue vectors, */
+/* which leaves only the hue rotation term approximate, giving an error */
+/* of less than 0.00002 x the Delta E. */
+double icmCIE2Kfsq(double *Lab0, double *Lab1) {
+	double a1, a2, b1 = Lab0[2], b2 = Lab1[2];
+	double C1, C2;
+	double dL, dC, dH;
+	double ha, hb, hl;		/* Mean hue vector */
 
+	/* Compute Cromanance */
+	{
+		double C1ab, C2ab;
+		double Cab, Cab2, Cab7, G;
+
+		C1ab = sqrt(Lab0[1] * Lab0[1] + b1 * b1);
+		C2ab = sqrt(Lab1[1] * Lab1[1] + b2 * b2);
+		Cab = 0.5 * (C1ab + C2ab);
+		Cab2 = Cab * Cab;
+		Cab7 = Cab2 * Cab2 * Cab2 * Cab;
+		G = 0.5 * (1.0 - sqrt(Cab7/(Cab7 + 6103515625.0)));
+		a1 = (1.0 + G) * Lab0[1];
+		a2 = (1.0 + G) * Lab1[1];
+		C1 = sqrt(a1 * a1 + b1 * b1);
+		C2 = sqrt(a2 * a2 + b2 * b2);
+	}
+
+	/* Compute delta L, C and H, and the mean hue vector. */
+	/* 2.0 * sqrt(C1 * C2) * sin(0.5 * dh) is sqrt(C1 * C2) times the */
+	/* chord between the unit hue vectors, with the sign of their cross product. */
+	dL = Lab1[0] - Lab0[0];
+	dC = C2 - C1;
+	if (C1 < 1e-9 || C2 < 1e-9) {
+		dH = 0.0;
+		ha = hb = 0.0;
+		if (C1 >= 1e-9) {
+			ha = a1/C1;
+			hb = b1/C1;
+		} else if (C2 >= 1e-9) {
+			ha = a2/C2;
+			hb = b2/C2;
+		} else {
+			ha = 1.0;		/* Hue angle 0 */
+		}
+	} else {
+		double ua1 = a1/C1, ub1 = b1/C1, ua2 = a2/C2, ub2 = b2/C2;
+		double du, dv;
+
+		du = ua1 - ua2;
+		dv = ub1 - ub2;
+		dH = sqrt(C1 * C2 * (du * du + dv * dv));
+		if ((ua1 * ub2 - ua2 * ub1) < 0.0)
+			dH = -dH;
+
+		ha = ua1 + ua2;
+		hb = ub1 + ub2;
+	}
+
+	/* The mean of near opposite hues is ill conditioned */
+	if ((hl = sqrt(ha * ha + hb * hb)) < 1e-4)
+		return icmCIE2Ksq(Lab0, Lab1);
+	ha /= hl;
+	hb /= hl;
+
+	{
+		double L, C, T;
+		double c2, s2, c3, s3, c4, s4;
+		double C2_, C7, RC, L50sq, SL, SC, SH, RT;
+		double dLsq, dCsq, dHsq, RCH;
+
+		L = 0.5 * (Lab0[0]  + Lab1[0]);
+		C = 0.5 * (C1 + C2);
+
+		/* Multiples of the mean hue angle */
+		c2 = ha * ha - hb * hb;
+		s2 = 2.0 * ha * hb;
+		c3 = c2 * ha - s2 * hb;
+		s3 = s2 * ha + c2 * hb;
+		c4 = c2 * c2 - s2 * s2;
+		s4 = 2.0 * s2 * c2;
+
+		/* cos(h-30), cos(2h), cos(3h+6), cos(4h-63) */
+		T = 1.0 - 0.17 * (0.86602540378443865 * ha + 0.5 * hb)
+		  + 0.24 * c2
+		  + 0.32 * (0.99452189536827333 * c3 - 0.10452846326765347 * s3)
+		  - 0.2 * (0.45399049973954680 * c4 + 0.89100652418836786 * s4);
+		L50sq = (L - 50.0) * (L - 50.0);
+
+		SL = 1.0 + (0.015 * L50sq)/sqrt(20.0 + L50sq);
+		SC = 1.0 + 0.045 * C;
+		SH = 1.0 + 0.015 * C * T;
+
+		dLsq = dL/SL;
+		dCsq = dC/SC;
+		dHsq = dH/SH;
+
+		/* Hue rotation term, which is negligible away from blue */
+		RT = 0.0;
+		if (hb < 0.5) {			/* h outside 30 .. 150 */
+			double h, hh, ddeg;
+
+			h = icm_fatan2d(hb, ha);
+			hh = (h - 275.0)/25.0;
+			ddeg = 30.0 * exp(-hh * hh);
+			C2_ = C * C;
+			C7 = C2_ * C2_ * C2_ * C;
+			RC = 2.0 * sqrt(C7/(C7 + 6103515625.0));
+			RT = -sin(M_PI/180.0 * 2.0 * ddeg) * RC;
+		}
+
+		RCH = RT * dCsq * dHsq;
+
+		dLsq *= dLsq;
+		dCsq *= dCsq;
+		dHsq *= dHsq;
+
+		return dLsq + dCsq + dHsq + RCH;
+	}
+}
+
+/* Return a fast approximation of the CIEDE2000 Delta E for two Lab values */
+double icmCIE2Kf(double *Lab0, double *Lab1) {
+	return sqrt(icmCIE2Kfsq(Lab0, Lab1));
+}
+
+/* Set de[i] to the Delta E of n pairs of pixel interleaved Lab values */
+void icmLabDE_n(double *de, double *Lab0, double *Lab1, int n) {
+	int i;
+
+	for (i = 0; i < n; i++, Lab0 += 3, Lab1 += 3) {
+		double t0, t1, t2;
+
+		t0 = Lab0[0] - Lab1[0];
+		t1 = Lab0[1] - Lab1[1];
+		t2 = Lab0[2] - Lab1[2];
+		de[i] = sqrt(t0 * t0 + t1 * t1 + t2 * t2);
+	}
+}
+
+/* Set de[i] to the CIE94 Delta E of n pairs of pixel interleaved Lab values */
+void icmCIE94_n(double *de, double *Lab0, double *Lab1, int n) {
+	int i;
+
+	for (i = 0; i < n; i++, Lab0 += 3, Lab1 += 3) {
+		double dl, da, db, dc, c1, c2, c12;
+		double desq, dlsq, dcsq, dhsq, sc, sh;
+
+		dl = Lab0[0] - Lab1[0];
+		da = Lab0[1] - Lab1[1];
+		db = Lab0[2] - Lab1[2];
+		dlsq = dl * dl;
+
+		c1 = sqrt(Lab0[1] * Lab0[1] + Lab0[2] * Lab0[2]);
+		c2 = sqrt(Lab1[1] * Lab1[1] + Lab1[2] * Lab1[2]);
+		c12 = sqrt(c1 * c2);
+		dc = c1 - c2;
+		dcsq = dc * dc;
+
+		desq = dlsq + da * da + db * db;
+		dhsq = desq - dlsq - dcsq;
+		dhsq = dhsq < 0.0 ? 0.0 : dhsq;
+
+		sc = 1.0 + 0.045 * c12;
+		sh = 1.0 + 0.015 * c12;
+		de[i] = sqrt(dlsq + dcsq/(sc * sc) + dhsq/(sh * sh));
+	}
+}
+
+/* Set de[i] to the CIEDE2000 Delta E of n pairs of pixel interleaved Lab values */
+void icmCIE2K_n(double *de, double *Lab0, double *Lab1, int n) {
+	int i;
+
+	for (i = 0; i < n; i++, Lab0 += 3, Lab1 += 3)
+		de[i] = sqrt(icmCIE2Ksq(Lab0, Lab1));
+}
+
+/* Set de[i] to the fast approximate CIEDE2000 Delta E of n pairs */
+/* of pixel interleaved Lab values */
+void icmCIE2Kf_n(double *de, double *Lab0, double *Lab1, int n) {
+	int i;
+
+	for (i = 0; i < n; i++, Lab0 += 3, Lab1 += 3)
+		de[i] = sqrt(icmCIE2Kfsq(Lab0, Lab1));
+}
+
+
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Independent chromatic adaptation transform utility. */
+/* Return a 3x3 chromatic adaptation matrix */
+/* Use icmMulBy3x3(dst, mat, src) */
+/* NOTE that to transform primaries they */
+/* must be mat[XYZ][RGB] format! */
+void icmChromAdaptMatrix(
+	int flags,				/* Use Bradford flag, Transform given matrix flag */
+	icmXYZNumber d_wp,		/* Destination white point */
+	icmXYZNumber s_wp,		/* Source white point */
+	double mat[3][3]		/* Destination matrix */
+) {
+	double dst[3], src[3];			/* Source & destination white points */
+	double vkmat[3][3];				/* Von Kries matrix */
+	double ibradford[3][3];			/* Inverse Bradford */
 
-/* - - - - - - - - - - - - - - - - - - - - - - - - */
-/* Independent chromatic adaptation transform utility. */
-/* Return a 3x3 chromatic adaptation matrix */
-/* Use icmMulBy3x3(dst, mat, src) */
-/* NOTE that to transform primaries they */
-/* must be mat[XYZ][RGB] format! */
-void icmChromAdaptMatrix(
-	int flags,				/* Use Bradford flag, Transform given matrix flag */
-	icmXYZNumber d_wp,		/* Destination white point */
-	icmXYZNumber s_wp,		/* Source white point */
-	double mat[3][3]		/* Destination matrix */
-) {
-	double dst[3], src[3];			/* Source & destination white points */
-	double vkmat[3][3];				/* Von Kries matrix */
-	static int inited = 0;			/* Compute inverse bradford once */
-	static double ibradford[3][3];	/* Inverse Bradford */
-
 	/* Set initial matrix to unity if creating from scratch */
 	if (!(flags & ICM_CAM_MULMATRIX)) {
 		icmSetUnity3x3(mat);
@@ -15801,10 +16288,9 @@ void icmChromAdaptMatrix(
 
 	/* Transform from Bradford space */
 	if (flags & ICM_CAM_BRADFORD) {
-		if (inited == 0) {
-			icmInverse3x3(ibradford, icmBradford);
-			inited = 1;
-		}
+		/* (Computed each time rather than cached in a static, */
+		/*  so that this is reentrant.) */
+		icmInverse3x3(ibradford, icmBradford);
 		icmMul3x3(mat, ibradford);
 	}
 
@@ -16805,7 +17291,7 @@ static void icmMD5_add(icmMD5 *p, ORD8 *ibuf, unsigned int len) {
 		}
 
 		memmove(np, ibuf, bs);	/* Now got one full buffer */
-		icmMD5_accume(p, np);
+		icmMD5_accume(p, p->buf);
 		ibuf += bs;
 		len -= bs;
 	}
@@ -17320,6 +17806,231 @@ icmLu_get_ranges (
 	getRange(p->icp, p->e_outSpace, tagType, outmin, outmax);
 }
 
+/* Translate n pixel interleaved values through any lookup, */
+/* by calling lookup() on each one. */
+/* Return 0 on success, 1 if clipping occured, 2 on other error */
+static int
+icmLu_lookup_n (
+icmLuBase *p,		/* This */
+double *out,		/* n * outn output values */
+double *in,			/* n * inn input values */
+int n				/* Number of values */
+) {
+	int inn, outn, i, rv = 0;
+
+	p->spaces(p, NULL, &inn, NULL, &outn, NULL, NULL, NULL, NULL, NULL);
+
+	for (i = 0; i < n; i++, in += inn, out += outn)
+		rv |= p->lookup(p, out, in);
+
+	return (rv & 2) ? 2 : rv;
+}
+
+/* Compiled lookup grid table (see compile()) */
+struct _icmLuCTable {
+	int inn, outn;				/* Input and output dimensions */
+	int res;					/* Grid resolution */
+	double imin[MAX_CHAN];		/* Input value at grid index 0 */
+	double iscale[MAX_CHAN];	/* Input value to grid index scale */
+	int dinc[MAX_CHAN];			/* Dimensional increment through table (in floats) */
+	float *t;					/* Table [res ^ inn][outn] */
+};
+
+/* Free any compiled grid table */
+static void icmLu_free_ctab(icmLuBase *p) {
+	icc *icp = p->icp;
+
+	if (p->ctab != NULL) {
+		if (p->ctab->t != NULL)
+			icp->al->free(icp->al, p->ctab->t);
+		icp->al->free(icp->al, p->ctab);
+		p->ctab = NULL;
+	}
+}
+
+/* Lookup through the compiled grid table, using simplex interpolation. */
+/* Return 0 on success, 1 if the input was clipped to the grid */
+static int
+icmLu_ctab_lookup (
+icmLuBase *p,		/* This */
+double *out,		/* Vector of output values */
+double *in			/* Vector of input values */
+) {
+	struct _icmLuCTable *ct = p->ctab;
+	float *gp = ct->t;			/* Pointer to grid cube base */
+	double co[MAX_CHAN];		/* Coordinate offset with the grid cell */
+	int    si[MAX_CHAN];		/* co[] Sort index, [0] = smallest */
+	double res_1 = (double)(ct->res-1);
+	int e, f, g, vg;
+	double v, w;
+	int rv = 0;
+
+	/* Compute base index into grid and coordinate offsets */
+	for (e = 0; e < ct->inn; e++) {
+		int x;
+		v = (in[e] - ct->imin[e]) * ct->iscale[e];
+		if (v < 0.0) {
+			v = 0.0;
+			rv |= 1;
+		} else if (v > res_1) {
+			v = res_1;
+			rv |= 1;
+		}
+		x = (int)v;
+		if (x > (ct->res-2))
+			x = ct->res-2;
+		co[e] = v - (double)x;
+		gp += x * ct->dinc[e];
+	}
+
+	/* Do insertion sort on coordinates, smallest to largest. */
+	for (e = 0; e < ct->inn; e++)
+		si[e] = e;
+	for (e = 1; e < ct->inn; e++) {
+		g = e;
+		v = co[si[g]];
+		vg = g;
+		while (g > 0 && co[si[g-1]] > v) {
+			si[g] = si[g-1];
+			g--;
+		}
+		si[g] = vg;
+	}
+
+	/* Compute the weightings, simplex vertices and output values */
+	w = 1.0 - co[si[ct->inn-1]];		/* Vertex at base of cell */
+	for (f = 0; f < ct->outn; f++)
+		out[f] = w * gp[f];
+
+	for (e = ct->inn-1; e > 0; e--) {	/* Middle verticies */
+		w = co[si[e]] - co[si[e-1]];
+		gp += ct->dinc[si[e]];
+		for (f = 0; f < ct->outn; f++)
+			out[f] += w * gp[f];
+	}
+
+	w = co[si[0]];
+	gp += ct->dinc[si[0]];		/* Far corner from base of cell */
+	for (f = 0; f < ct->outn; f++)
+		out[f] += w * gp[f];
+
+	return rv;
+}
+
+/* Resample the current lookup into a grid table, and substitute */
+/* the table lookup. Return 0 on success, error code on failure. */
+static int icmLu_compile_table(icmLuBase *p, int res) {
+	icc *icp = p->icp;
+	struct _icmLuCTable *ct;
+	double inmin[MAX_CHAN], inmax[MAX_CHAN];
+	double outmin[MAX_CHAN], outmax[MAX_CHAN];
+	double iv[MAX_CHAN], ov[MAX_CHAN];
+	int gc[MAX_CHAN];			/* Grid coordinate */
+	unsigned int npts, tsize, i;
+	int inn, outn, e, f, rv;
+	float *tp;
+
+	p->spaces(p, NULL, &inn, NULL, &outn, NULL, NULL, NULL, NULL, NULL);
+
+	if (res <= 0) {				/* Default resolution */
+		switch (inn) {
+			case 1:  res = 256; break;
+			case 2:  res = 65;  break;
+			case 3:  res = 33;  break;
+			case 4:  res = 17;  break;
+			case 5:  res = 11;  break;
+			default: res = 7;   break;
+		}
+	}
+	if (res < 2)
+		res = 2;
+
+	if ((npts = sat_pow(res, inn)) == UINT_MAX
+	 || (tsize = sat_mul(npts, outn)) == UINT_MAX
+	 || ovr_mul(tsize, sizeof(float))) {
+		sprintf(icp->err,"icmLu_compile: table size overflow");
+		return icp->errc = 1;
+	}
+	if ((ct = (struct _icmLuCTable *) icp->al->calloc(icp->al, 1, sizeof(struct _icmLuCTable)))
+	                                                                                   == NULL
+	 || (ct->t = (float *) icp->al->malloc(icp->al, tsize * sizeof(float))) == NULL) {
+		if (ct != NULL)
+			icp->al->free(icp->al, ct);
+		sprintf(icp->err,"icmLu_compile: malloc() of table failed");
+		return icp->errc = 2;
+	}
+	ct->inn = inn;
+	ct->outn = outn;
+	ct->res = res;
+
+	p->get_ranges(p, inmin, inmax, outmin, outmax);
+	for (e = 0; e < inn; e++) {
+		ct->imin[e] = inmin[e];
+		if (inmax[e] > inmin[e])
+			ct->iscale[e] = (res-1.0)/(inmax[e] - inmin[e]);
+		else
+			ct->iscale[e] = 0.0;
+	}
+
+	/* First channel varies least rapidly, as in a Lut clut */
+	ct->dinc[inn-1] = outn;
+	for (e = inn-2; e >= 0; e--)
+		ct->dinc[e] = ct->dinc[e+1] * res;
+
+	/* Fill the table from the current lookup */
+	for (e = 0; e < inn; e++)
+		gc[e] = 0;
+	for (tp = ct->t, i = 0; i < npts; i++, tp += outn) {
+		for (e = 0; e < inn; e++)
+			iv[e] = inmin[e] + gc[e] * (inmax[e] - inmin[e])/(res-1.0);
+		if ((rv = p->lookup(p, ov, iv)) > 1) {
+			icp->al->free(icp->al, ct->t);
+			icp->al->free(icp->al, ct);
+			return rv;
+		}
+		for (f = 0; f < outn; f++)
+			tp[f] = (float)ov[f];
+
+		/* Increment grid coordinate, last channel fastest */
+		for (e = inn-1; e >= 0; e--) {
+			if (++gc[e] < res)
+				break;
+			gc[e] = 0;
+		}
+	}
+
+	p->ctab    = ct;
+	p->ulookup = p->lookup;
+	p->lookup  = icmLu_ctab_lookup;
+
+	return 0;
+}
+
+/* Restore the uncompiled lookup */
+static void icmLu_uncompile(icmLuBase *p) {
+	if (p->ulookup != NULL) {
+		p->lookup = p->ulookup;
+		p->ulookup = NULL;
+	}
+	icmLu_free_ctab(p);
+}
+
+/* Compile the lookup into a grid table, or restore the uncompiled lookup. */
+/* Return 0 on success, error code on failure. */
+static int
+icmLu_compile (
+icmLuBase *p,		/* This */
+int flags,			/* ICM_LU_COMPILE_XXX flags */
+int res				/* Grid table resolution, <= 0 for default */
+) {
+	icmLu_uncompile(p);
+
+	if (flags & ICM_LU_COMPILE_TABLE)
+		return icmLu_compile_table(p, res);
+
+	return 0;
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - */
 /* Forward and Backward Monochrome type methods: */
 /* Return 0 on success, 1 if clipping occured, 2 on other error */
@@ -17651,6 +18362,7 @@ icmLuBase *p
 ) {
 	icc *icp = p->icp;
 
+	icmLu_free_ctab(p);
 	icp->al->free(icp->al, p);
 }
 
@@ -17682,6 +18394,8 @@ new_icmLuMono(
 	p->init_wh_bk = icmLuInit_Wh_bk;
 	p->wh_bk_points = icmLuWh_bk_points;
 	p->lu_wh_bk_points = icmLuLu_wh_bk_points;
+	p->lookup_n   = icmLu_lookup_n;
+	p->compile    = icmLu_compile;
 	p->fwd_lookup = icmLuMonoFwd_lookup;
 	p->fwd_curve  = icmLuMonoFwd_curve;
 	p->fwd_map    = icmLuMonoFwd_map;
@@ -17726,6 +18440,13 @@ new_icmLuMono(
 		return NULL;
 	}
 
+	/* Setup the reverse curve table now, rather than on the first */
+	/* bwd lookup, so that lookup() doesn't modify any shared state. */
+	if (icmCurve_init_bwd(p->grayCurve) != 0) {
+		p->del((icmLuBase *)p);
+		return NULL;
+	}
+
 	p->pcswht = icp->header->illuminant;
 	p->intent   = intent;
 	p->function = func;
@@ -17786,6 +18507,36 @@ double *in			/* Vector of input values */
 	icc *icp = p->icp;
 	int rv = 0;
 
+	/* Use the dense gamma tables if they've been created */
+	if (p->fwdres != 0) {
+		icmCurve *curves[3];
+		int ch;
+
+		curves[0] = p->redCurve;
+		curves[1] = p->greenCurve;
+		curves[2] = p->blueCurve;
+		for (ch = 0; ch < 3; ch++) {
+			double val = in[ch];
+
+			if (p->fwdtab[ch] != NULL && val >= 0.0 && val < 1.0) {
+				double *tab = p->fwdtab[ch];
+				unsigned int ix;
+				double w;
+
+				val *= (double)(p->fwdres-1);
+				ix = (unsigned int)val;
+				w = val - (double)ix;
+				out[ch] = tab[ix] + w * (tab[ix+1] - tab[ix]);
+
+			} else if ((rv |= curves[ch]->lookup_fwd(curves[ch],&out[ch],&in[ch])) > 1) {
+				sprintf(icp->err,"icc_lookup: Curve->lookup_fwd() failed");
+				icp->errc = rv;
+				return 2;
+			}
+		}
+		return rv;
+	}
+
 	/* Curve lookups */
 	if ((rv |= p->redCurve->lookup_fwd(  p->redCurve,  &out[0],&in[0])) > 1
 	 || (rv |= p->greenCurve->lookup_fwd(p->greenCurve,&out[1],&in[1])) > 1
@@ -17954,6 +18705,144 @@ double *in			/* Vector of input values */
 	return rv;
 }
 
+/* Do a reverse curve lookup using the dense inverse table */
+/* of channel ch, rather than inverting the curve itself. */
+/* Return 0 on success, 1 if clipping occured, */
+/* -1 if the cell isn't accurate and the curve should be used. */
+static int icmLuMatrix_bwdtab_lookup(
+icmLuMatrix *p,		/* This */
+int ch,				/* Channel */
+double *out,		/* Output value */
+double *in			/* Input value */
+) {
+	double *tab = p->bwdtab[ch];
+	double val, w;
+	int rv = 0;
+	unsigned int ix;
+
+	val = (*in - p->bwdmin[ch]) * p->bwdscale[ch];
+	if (val < 0.0) {
+		val = 0.0;
+		rv |= 1;
+	} else if (val > (double)(p->bwdres-1)) {
+		val = (double)(p->bwdres-1);
+		rv |= 1;
+	}
+	ix = (unsigned int)val;
+	if (ix > (p->bwdres-2))
+		ix = p->bwdres-2;
+	if (rv == 0 && p->bwdexact[ch][ix] != 0)
+		return -1;
+	w = val - (double)ix;
+	*out = tab[ix] + w * (tab[ix+1] - tab[ix]);
+	return rv;
+}
+
+/* Create the dense inverse curve tables, for any curves that */
+/* are strictly monotonic tables. Cells where linear interpolation */
+/* of the table isn't within ICM_BWDTAB_TOL of the curve inverse */
+/* (typically near the infinite slope at 0 of a gamma > 1 curve) */
+/* are flagged to use the curve itself. */
+/* Return 0 on success, 2 on malloc error. */
+
+#define ICM_BWDTAB_TOL 2e-6
+
+static int icmLuMatrix_init_bwdtab(
+icmLuMatrix *p,		/* This */
+unsigned int res	/* Resolution of the tables */
+) {
+	icc *icp = p->icp;
+	icmCurve *curves[3];
+	unsigned int i, ch;
+
+	curves[0] = p->redCurve;
+	curves[1] = p->greenCurve;
+	curves[2] = p->blueCurve;
+
+	p->bwdres = res;
+	for (ch = 0; ch < 3; ch++) {
+		icmRevTable *rt = &curves[ch]->rt;
+		int up = 0, dn = 0;
+
+		if (curves[ch]->flag != icmCurveSpec || curves[ch]->size < 2
+		 || rt->inited == 0 || rt->rmax <= rt->rmin)
+			continue;		/* Use the curve itself */
+
+		/* A non-monotonic curve has no unique inverse to tabulate */
+		for (i = 1; i < curves[ch]->size; i++) {
+			if (curves[ch]->data[i] > curves[ch]->data[i-1])
+				up = 1;
+			else if (curves[ch]->data[i] < curves[ch]->data[i-1])
+				dn = 1;
+			else
+				up = dn = 1;
+		}
+		if (up == dn)
+			continue;		/* Use the curve itself */
+
+		if ((p->bwdtab[ch] = (double *) icp->al->malloc(icp->al, sat_mul(res, sizeof(double)))) == NULL
+		 || (p->bwdexact[ch] = (unsigned char *) icp->al->calloc(icp->al, res, sizeof(unsigned char))) == NULL) {
+			sprintf(icp->err,"icc_new_iccLuMatrix: malloc() of inverse curve table failed");
+			return icp->errc = 2;
+		}
+		p->bwdmin[ch] = rt->rmin;
+		p->bwdscale[ch] = (res - 1.0)/(rt->rmax - rt->rmin);
+		for (i = 0; i < res; i++) {
+			double val = rt->rmin + (rt->rmax - rt->rmin) * i/(res - 1.0);
+			icmTable_lookup_bwd(rt, &p->bwdtab[ch][i], &val);
+		}
+
+		/* Check each cell at its quarter, middle and three quarter points */
+		for (i = 0; i < (res-1); i++) {
+			int k;
+			for (k = 1; k < 4; k++) {
+				double val = rt->rmin + (rt->rmax - rt->rmin) * (i + 0.25 * k)/(res - 1.0);
+				double ev, tv;
+				icmTable_lookup_bwd(rt, &ev, &val);
+				tv = p->bwdtab[ch][i] + 0.25 * k * (p->bwdtab[ch][i+1] - p->bwdtab[ch][i]);
+				if (fabs(tv - ev) > ICM_BWDTAB_TOL) {
+					p->bwdexact[ch][i] = 1;
+					break;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+#undef ICM_BWDTAB_TOL
+
+/* Create the dense forward curve tables, for any curves that are */
+/* gamma curves with a gamma of at least 1.0. (Smaller gammas have an */
+/* infinite slope at 0.0, so aren't well approximated by a table.) */
+/* Return 0 on success, 2 on malloc error. */
+static int icmLuMatrix_init_fwdtab(
+icmLuMatrix *p,		/* This */
+unsigned int res	/* Resolution of the tables */
+) {
+	icc *icp = p->icp;
+	icmCurve *curves[3];
+	unsigned int i, ch;
+
+	curves[0] = p->redCurve;
+	curves[1] = p->greenCurve;
+	curves[2] = p->blueCurve;
+
+	p->fwdres = res;
+	for (ch = 0; ch < 3; ch++) {
+		if (curves[ch]->flag != icmCurveGamma || curves[ch]->data[0] < 1.0)
+			continue;		/* Use the curve itself */
+
+		if ((p->fwdtab[ch] = (double *) icp->al->malloc(icp->al, sat_mul(res, sizeof(double)))) == NULL) {
+			sprintf(icp->err,"icc_new_iccLuMatrix: malloc() of gamma curve table failed");
+			return icp->errc = 2;
+		}
+		for (i = 0; i < res; i++)
+			p->fwdtab[ch][i] = pow(i/(res - 1.0), curves[ch]->data[0]);
+	}
+	return 0;
+}
+
 static int
 icmLuMatrixBwd_curve (
 icmLuMatrix *p,		/* This */
@@ -17963,6 +18852,28 @@ double *in			/* Vector of input values */
 	icc *icp = p->icp;
 	int rv = 0;
 
+	/* Use the dense inverse tables if they've been created */
+	if (p->bwdres != 0) {
+		icmCurve *curves[3];
+		int ch;
+
+		curves[0] = p->redCurve;
+		curves[1] = p->greenCurve;
+		curves[2] = p->blueCurve;
+		for (ch = 0; ch < 3; ch++) {
+			int trv;
+			if (p->bwdtab[ch] != NULL
+			 && (trv = icmLuMatrix_bwdtab_lookup(p, ch, &out[ch], &in[ch])) >= 0)
+				rv |= trv;
+			else if ((rv |= curves[ch]->lookup_bwd(curves[ch],&out[ch],&in[ch])) > 1) {
+				sprintf(icp->err,"icc_lookup: Curve->lookup_bwd() failed");
+				icp->errc = rv;
+				return 2;
+			}
+		}
+		return rv;
+	}
+
 	/* Curves */
 	if ((rv |= p->redCurve->lookup_bwd(p->redCurve,&out[0],&in[0])) > 1
 	 ||	(rv |= p->greenCurve->lookup_bwd(p->greenCurve,&out[1],&in[1])) > 1
@@ -18032,10 +18943,21 @@ double *in			/* Vector of input values */
 
 static void
 icmLuMatrix_delete(
-icmLuBase *p
+icmLuBase *pp
 ) {
+	icmLuMatrix *p = (icmLuMatrix *)pp;
 	icc *icp = p->icp;
+	int ch;
 
+	for (ch = 0; ch < 3; ch++) {
+		if (p->bwdtab[ch] != NULL)
+			icp->al->free(icp->al, p->bwdtab[ch]);
+		if (p->bwdexact[ch] != NULL)
+			icp->al->free(icp->al, p->bwdexact[ch]);
+		if (p->fwdtab[ch] != NULL)
+			icp->al->free(icp->al, p->fwdtab[ch]);
+	}
+	icmLu_free_ctab(pp);
 	icp->al->free(icp->al, p);
 }
 
@@ -18069,6 +18991,8 @@ new_icmLuMatrix(
 	p->init_wh_bk = icmLuInit_Wh_bk;
 	p->wh_bk_points = icmLuWh_bk_points;
 	p->lu_wh_bk_points = icmLuLu_wh_bk_points;
+	p->lookup_n   = icmLu_lookup_n;
+	p->compile    = icmLu_compile;
 	p->fwd_lookup = icmLuMatrixFwd_lookup;
 	p->fwd_curve  = icmLuMatrixFwd_curve;
 	p->fwd_matrix = icmLuMatrixFwd_matrix;
@@ -18119,6 +19043,29 @@ new_icmLuMatrix(
 		return NULL;
 	}
 
+	/* Setup the reverse curve tables now, rather than on the first */
+	/* bwd lookup, so that lookup() doesn't modify any shared state. */
+	if (icmCurve_init_bwd(p->redCurve) != 0
+	 || icmCurve_init_bwd(p->greenCurve) != 0
+	 || icmCurve_init_bwd(p->blueCurve) != 0) {
+		p->del((icmLuBase *)p);
+		return NULL;
+	}
+
+	/* Create dense inverse curve tables if requested */
+	if (icp->bwdcurveres > 1
+	 && icmLuMatrix_init_bwdtab(p, icp->bwdcurveres) != 0) {
+		p->del((icmLuBase *)p);
+		return NULL;
+	}
+
+	/* Create dense gamma curve tables if requested */
+	if (icp->fwdcurveres > 1
+	 && icmLuMatrix_init_fwdtab(p, icp->fwdcurveres) != 0) {
+		p->del((icmLuBase *)p);
+		return NULL;
+	}
+
 	/* Setup the matrix */
 	p->mx[0][0] = p->redColrnt->data[0].X;
 	p->mx[0][1] = p->greenColrnt->data[0].X;
@@ -18394,6 +19341,203 @@ double *in			/* Vector of input values */
 	return rv;
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - */
+/* Bulk lookup. Values are converted a block of ICM_LU_NBLK at a time, */
+/* transposed into structure of arrays [chan][ICM_LU_NBLK] form, so that */
+/* the per channel table and cLUT cell location stages are simple */
+/* loops over the block that the compiler can vectorize. The arithmetic */
+/* is the same as the single value lookup, so the results are identical. */
+
+#define ICM_LU_NBLK 64		/* Values per block */
+
+/* Lookup a block through per channel input or output tables. */
+/* Return 0 on success, 1 if clipping occured */
+static int icmLut_lookup_tables_blk(
+double *table,		/* Tables [nch][ent] */
+unsigned int ent,	/* Number of entries in each table */
+unsigned int nch,	/* Number of channels */
+double *v,			/* In/out values [nch][ICM_LU_NBLK] */
+int m				/* Number of values in block */
+) {
+	int rv = 0;
+	unsigned int n;
+	int k;
+	double ent_1 = (double)(ent-1);
+
+	if (ent == 0)		/* Hmm. */
+		return 0;
+
+	/* Use linear interpolation */
+	for (n = 0; n < nch; n++, table += ent, v += ICM_LU_NBLK) {
+		for (k = 0; k < m; k++) {
+			unsigned int ix;
+			double val, w;
+			val = v[k] * ent_1;
+			rv |= (val < 0.0) | (val > ent_1);				/* Clip without branches */
+			val = val < 0.0 ? 0.0 : val;
+			val = val > ent_1 ? ent_1 : val;
+			ix = (unsigned int)val;			/* Grid coordinate (== floor, since val >= 0) */
+			ix = ix > (ent-2) ? (ent-2) : ix;
+			w = val - (double)ix;		/* weight */
+			val = table[ix];
+			v[k] = val + w * (table[ix+1] - val);
+		}
+	}
+	return rv;
+}
+
+/* Lookup a block through the clut using simplex interpolation, */
+/* as icmLut_lookup_clut_sx(). in[] is overwritten. */
+/* Return 0 on success, 1 if clipping occured, 2 on other error */
+static int icmLut_lookup_clut_sx_blk(
+icmLut *p,		/* Pointer to Lut object */
+double *out,	/* Output values [outputChan][ICM_LU_NBLK] */
+double *in,		/* Input values [inputChan][ICM_LU_NBLK] */
+int m			/* Number of values in block */
+) {
+	int rv = 0;
+	unsigned int e, f;
+	int k;
+	double clutPoints_1 = (double)(p->clutPoints-1);
+	int    clutPoints_2 = p->clutPoints-2;
+	int    gi[ICM_LU_NBLK];		/* Offset to base of grid cube for each value */
+
+	if (p->clutRaw != NULL && (rv = icmLut_get_clut(p)) != 0)
+		return rv;
+
+	/* Compute base index into grid and coordinate offsets, */
+	/* one input channel at a time. */
+	for (k = 0; k < m; k++)
+		gi[k] = 0;
+	for (e = 0; e < p->inputChan; e++) {
+		double *co = in + e * ICM_LU_NBLK;
+		int dinc = p->dinc[e];
+
+		for (k = 0; k < m; k++) {
+			unsigned int x;
+			double val;
+			val = co[k] * clutPoints_1;
+			rv |= (val < 0.0) | (val > clutPoints_1);
+			val = val < 0.0 ? 0.0 : val;
+			val = val > clutPoints_1 ? clutPoints_1 : val;
+			x = (unsigned int)val;				/* Grid coordinate */
+			x = x > clutPoints_2 ? clutPoints_2 : x;
+			co[k] = val - (double)x;	/* 1.0 - weight */
+			gi[k] += x * dinc;			/* Add index offset for base of cube */
+		}
+	}
+
+	/* Sort the coordinates and compute the simplex vertex weightings */
+	/* and output values for each value. */
+	for (k = 0; k < m; k++) {
+		double *gp = p->clutTable + gi[k];
+		double *co = in + k;			/* co[e * ICM_LU_NBLK] is coordinate e */
+		double *op = out + k;			/* op[f * ICM_LU_NBLK] is output f */
+		int si[MAX_CHAN];				/* co[] Sort index, [0] = smallest */
+		int g, vg;
+		double v, w;
+
+		/* Do insertion sort on coordinates, smallest to largest. */
+		for (e = 0; e < p->inputChan; e++)
+			si[e] = e;						/* Initial unsorted indexes */
+		for (e = 1; e < p->inputChan; e++) {
+			g = e;
+			v = co[si[g] * ICM_LU_NBLK];
+			vg = g;
+			while (g > 0 && co[si[g-1] * ICM_LU_NBLK] > v) {
+				si[g] = si[g-1];
+				g--;
+			}
+			si[g] = vg;
+		}
+
+		w = 1.0 - co[si[p->inputChan-1] * ICM_LU_NBLK];	/* Vertex at base of cell */
+		for (f = 0; f < p->outputChan; f++)
+			op[f * ICM_LU_NBLK] = w * gp[f];
+
+		for (e = p->inputChan-1; e > 0; e--) {	/* Middle verticies */
+			w = co[si[e] * ICM_LU_NBLK] - co[si[e-1] * ICM_LU_NBLK];
+			gp += p->dinc[si[e]];				/* Move to top of cell in next largest dimension */
+			for (f = 0; f < p->outputChan; f++)
+				op[f * ICM_LU_NBLK] += w * gp[f];
+		}
+
+		w = co[si[0] * ICM_LU_NBLK];
+		gp += p->dinc[si[0]];		/* Far corner from base of cell */
+		for (f = 0; f < p->outputChan; f++)
+			op[f * ICM_LU_NBLK] += w * gp[f];
+	}
+	return rv;
+}
+
+/* Overall bulk lookup */
+static int
+icmLuLut_lookup_n (
+icmLuBase *pp,		/* This */
+double *out,		/* n * outputChan output values */
+double *in,			/* n * inputChan input values */
+int n				/* Number of values */
+) {
+	int rv = 0;
+	icmLuLut *p = (icmLuLut *)pp;
+	icmLut *lut = p->lut;
+	unsigned int ic = lut->inputChan, oc = lut->outputChan, e;
+	double iv[MAX_CHAN * ICM_LU_NBLK];		/* Input side values [ic][ICM_LU_NBLK] */
+	double ov[MAX_CHAN * ICM_LU_NBLK];		/* Output side values [oc][ICM_LU_NBLK] */
+	double temp[MAX_CHAN];
+	int i, k, m;
+
+	/* Lookup has been overridden or compiled */
+	if (p->lookup != icmLuLut_lookup)
+		return icmLu_lookup_n(pp, out, in, n);
+
+	for (i = 0; i < n; i += m, in += m * ic, out += m * oc) {
+		if ((m = n - i) > ICM_LU_NBLK)
+			m = ICM_LU_NBLK;
+
+		/* Possible absolute conversion, matrix and normalization */
+		for (k = 0; k < m; k++) {
+			rv |= p->in_abs(p,temp,in + k * ic);
+			if (p->usematrix)
+				rv |= lut->lookup_matrix(lut,temp,temp);
+			p->in_normf(temp, temp);
+			for (e = 0; e < ic; e++)
+				iv[e * ICM_LU_NBLK + k] = temp[e];
+		}
+
+		/* Lookup though input tables */
+		rv |= icmLut_lookup_tables_blk(lut->inputTable, lut->inputEnt, ic, iv, m);
+
+		/* Lookup though clut tables */
+		if (p->lookup_clut == lut->lookup_clut_sx) {
+			rv |= icmLut_lookup_clut_sx_blk(lut, ov, iv, m);
+		} else {
+			for (k = 0; k < m; k++) {
+				double tout[MAX_CHAN];
+				for (e = 0; e < ic; e++)
+					temp[e] = iv[e * ICM_LU_NBLK + k];
+				rv |= p->lookup_clut(lut,tout,temp);
+				for (e = 0; e < oc; e++)
+					ov[e * ICM_LU_NBLK + k] = tout[e];
+			}
+		}
+
+		/* Lookup though output tables */
+		rv |= icmLut_lookup_tables_blk(lut->outputTable, lut->outputEnt, oc, ov, m);
+
+		/* Normalize for output color space and possible absolute conversion */
+		for (k = 0; k < m; k++) {
+			double *op = out + k * oc;
+			for (e = 0; e < oc; e++)
+				temp[e] = ov[e * ICM_LU_NBLK + k];
+			p->out_denormf(op,temp);
+			rv |= p->out_abs(p,op,op);
+		}
+	}
+
+	return (rv & 2) ? 2 : rv;
+}
+
 #ifdef NEVER	/* The following should be identical in effect to the above. */
 
 /* Overall lookup */
@@ -18593,21 +19737,12 @@ static int icmLuLut_inv_out_abs(icmLuLut *p, double *out, double *in) {
 
 /* Do output->output' inverse lookup */
 static int icmLuLut_inv_output(icmLuLut *p, double *out, double *in) {
-	icc *icp = p->icp;
 	icmLut *lut = p->lut;
 	int i;
 	int rv = 0;
 
-	if (lut->rot[0].inited == 0) {	
-		for (i = 0; i < lut->outputChan; i++) {
-			rv = icmTable_setup_bwd(icp, &lut->rot[i], lut->outputEnt,
-			                             lut->outputTable + i * lut->outputEnt);
-			if (rv != 0) {
-				sprintf(icp->err,"icc_Lut_inv_input: Malloc failure in inverse lookup init.");
-				return icp->errc = rv;
-			}
-		}
-	}
+	if (lut->rot[lut->outputChan-1].inited == 0 && (rv = icmLut_init_bwd(lut)) != 0)
+		return rv;
 
 	p->out_normf(out,in);						/* Normalize from output color space */
 	for (i = 0; i < lut->outputChan; i++) {
@@ -18623,21 +19758,12 @@ static int icmLuLut_inv_output(icmLuLut *p, double *out, double *in) {
 
 /* Do input' -> input inverse lookup */
 static int icmLuLut_inv_input(icmLuLut *p, double *out, double *in) {
-	icc *icp = p->icp;
 	icmLut *lut = p->lut;
 	int i;
 	int rv = 0;
 
-	if (lut->rit[0].inited == 0) {	
-		for (i = 0; i < lut->inputChan; i++) {
-			rv = icmTable_setup_bwd(icp, &lut->rit[i], lut->inputEnt,
-			                             lut->inputTable + i * lut->inputEnt);
-			if (rv != 0) {
-				sprintf(icp->err,"icc_Lut_inv_input: Malloc failure in inverse lookup init.");
-				return icp->errc = rv;
-			}
-		}
-	}
+	if (lut->rit[lut->inputChan-1].inited == 0 && (rv = icmLut_init_bwd(lut)) != 0)
+		return rv;
 
 	p->in_normf(out, in); 						/* Normalize from input color space */
 	for (i = 0; i < lut->inputChan; i++) {
@@ -18841,6 +19967,7 @@ icmLuBase *p
 ) {
 	icc *icp = p->icp;
 
+	icmLu_free_ctab(p);
 	icp->al->free(icp->al, p);
 }
 
@@ -18873,6 +20000,8 @@ icc_new_icmLuLut(
 	p->lu_wh_bk_points = icmLuLu_wh_bk_points;
 
 	p->lookup        = icmLuLut_lookup;
+	p->lookup_n      = icmLuLut_lookup_n;
+	p->compile       = icmLu_compile;
 	p->lookup_in     = icmLuLut_lookup_in;
 	p->lookup_core   = icmLuLut_lookup_core;
 	p->lookup_out    = icmLuLut_lookup_out;
@@ -18918,6 +20047,15 @@ icc_new_icmLuLut(
 		return NULL;
 	}
 
+	/* Decode any deferred cLUT and setup the reverse input and output */
+	/* table lookups now, rather than on first use, so that lookups */
+	/* don't modify the Lut tag. */
+	if (icmLut_get_clut(p->lut) != 0
+	 || icmLut_init_bwd(p->lut) != 0) {
+		p->del((icmLuBase *)p);
+		return NULL;
+	}
+
 	/* Check if matrix should be used */
 	if (inSpace == icSigXYZData && p->lut->nu_matrix(p->lut))
 		p->usematrix = 1;
@@ -19769,6 +20907,10 @@ void *cntx
 		max[f] = 0.0;
 
 	lut = ll->lut;
+	if (icmLut_get_clut(lut) != 0) {
+		luo->del(luo);
+		return -1.0;
+	}
 	gp = lut->clutTable;		/* Base of grid array */
 	size = sat_pow(lut->clutPoints,lut->inputChan);
 	for (i = 0; i < size; i++) {
@@ -19836,6 +20978,7 @@ icmAlloc *al			/* Memory allocator */
 	p->read_all_tags = icc_read_all_tags;
 	p->delete_tag    = icc_delete_tag;
 	p->check_id      = icc_check_id;
+	p->get_hash      = icc_get_hash;
 	p->get_tac       = icm_get_tac;
 	p->get_luobj     = icc_get_luobj;
 	p->new_clutluobj = icc_new_icmLuLut;
@@ -234,6 +234,23 @@ struct _icmAllocStd {
 /* Create a standard alloc object */
 icmAlloc *new_icmAllocStd(void);
 
+/* - - - - - - - - - - - - - - - - - - - - -  */
+
+/* Implementation of heap class that sub-allocates from large blocks */
+/* obtained from the standard system malloc. free() only recovers */
+/* the space of the most recent or large allocations, and everything */
+/* is released when the allocator is deleted. Not thread safe. */
+struct _icmAllocArena {
+	ICM_ALLOC_BASE
+
+	/* Private: */
+	size_t bsize;				/* Block size */
+	union _icmArenaBlk *blks;	/* Current block, then older blocks */
+}; typedef struct _icmAllocArena icmAllocArena;
+
+/* Create an arena alloc object, bsize = 0 for default block size */
+icmAlloc *new_icmAllocArena(size_t bsize);
+
 /* File access class interface definition */
 #define ICM_FILE_BASE																		\
 	/* Public: */																			\
@@ -333,6 +350,18 @@ icmFile *new_icmFileMem(void *base, size_t length);
 /* and delete buffer when icmFile is deleted. */
 icmFile *new_icmFileMem_d(void *base, size_t length);
 
+/* - - - - - - - - - - - - - - - - - - - - -  */
+/* Implementation of a read only file access class based on a memory */
+/* mapping of the file (or a copy read into memory where mmap() isn't */
+/* available). This is an icmFileMem, so get_buf() returns the */
+/* file contents, and tags are read from it in place. */
+
+/* Create given a file name */
+icmFile *new_icmFileMap_name(char *name);
+
+/* Create given a file name with allocator */
+icmFile *new_icmFileMap_name_a(char *name, icmAlloc *al);
+
 /* --------------------------------- */
 /* Assumed constants                 */
 
@@ -756,6 +785,8 @@ struct _icmLut {
 	unsigned int inputTable_size;	/* size allocated to input table */
 	unsigned int clutTable_size;	/* size allocated to clut table */
 	unsigned int outputTable_size;	/* size allocated to output table */
+	unsigned char *clutRaw;			/* If not NULL, undecoded clut data in icp->fp buffer */
+	unsigned int clutRawSize;		/* Size of each raw clut table entry value in bytes */
 
 	/* Optimised simplex orientation information. oso_ffa is NZ if valid. */
 	/* Only valid if inputChan > 1 && clutPoints > 1 */
@@ -1245,10 +1276,27 @@ typedef enum {
 	void           (*XYZ_Abs2Rel)(struct _icmLuBase *p, double *xyzout, double *xyzin);		\
 
 
+/* compile() flags */
+#define ICM_LU_COMPILE_NONE  0x0000	/* Restore the uncompiled lookup */
+#define ICM_LU_COMPILE_TABLE 0x0001	/* Resample the lookup into a float grid table */
+
+/* Once created, a lookup object is not modified by its lookup methods, */
+/* and neither are the tags it uses, all temporary values being kept on */
+/* the stack. A lookup object can therefore be shared by several threads, */
+/* as long as compile(), del() and the icc's tag modifying methods aren't */
+/* called while it is being shared. Note that icc->err and errc are */
+/* not per thread, and that N-linear Lut lookups of more than 8 input */
+/* channels allocate their weights using icc->al, so the icmAlloc */
+/* must itself be thread safe (an arena icmAlloc isn't). */
+
 /* Non-algorithm specific lookup class. Used as base class of algorithm specific class. */
 #define LU_ICM_NN_BASE_MEMBERS															\
     LU_ICM_BASE_MEMBERS                                                                 \
 																						\
+	/* Private: */																			\
+	struct _icmLuCTable *ctab;			/* Compiled grid table, NULL if none */				\
+	int (*ulookup) (struct _icmLuBase *p, double *out, double *in);	/* Uncompiled lookup */	\
+																							\
 	/* Public: */																		\
 																							\
 	/* Get the native input space and output space ranges */								\
@@ -1286,6 +1334,19 @@ typedef enum {
 	/* in the lookup(bwd) call for clut based profiles. */									\
 	int (*lookup) (struct _icmLuBase *p, double *out, double *in);							\
 																							\
+	/* Translate n pixel interleaved color values through the profile, */					\
+	/* with the same result as n calls to lookup(), returning the worst */					\
+	/* of their return values. Lut based profiles are converted a block */					\
+	/* of values at a time, one stage and channel at a time. */								\
+	int (*lookup_n) (struct _icmLuBase *p, double *out, double *in, int n);					\
+																							\
+	/* Replace lookup() with a faster one. ICM_LU_COMPILE_TABLE fuses the whole */			\
+	/* conversion into a res^inn grid of floats covering the get_ranges() input */			\
+	/* range (res <= 0 for a default), that is then simplex interpolated. */				\
+	/* This is an approximation, and only reports clipping of the input to the grid. */		\
+	/* ICM_LU_COMPILE_NONE restores the original lookup. Return nz on error. */				\
+	int (*compile) (struct _icmLuBase *p, int flags, int res);								\
+																							\
 																							\
 	/* Alternate to above, splits color conversion into three steps. */						\
 	/* Colorspace of _in and _out and _core are the effective in and out */					\
@@ -1342,6 +1403,14 @@ struct _icmLuMatrix {
     double		mx[3][3];	/* 3 * 3 conversion matrix */
     double		bmx[3][3];	/* 3 * 3 backwards conversion matrix */
 
+	/* Private: */
+	unsigned int bwdres;		/* Resolution of bwdtab[], 0 if not used */
+	double      *bwdtab[3];	/* Dense inverse curve tables, NULL to use the curve */
+	double       bwdmin[3], bwdscale[3];	/* Input offset and scale to bwdtab[] index */
+	unsigned char *bwdexact[3];	/* Per bwdtab[] cell flag, nz to use the curve itself */
+	unsigned int fwdres;		/* Resolution of fwdtab[], 0 if not used */
+	double      *fwdtab[3];	/* Dense gamma curve tables, NULL to use the curve */
+
 	/* Overall lookups */
 	int (*fwd_lookup) (struct _icmLuBase *p, double *out, double *in);
 	int (*bwd_lookup) (struct _icmLuBase *p, double *out, double *in);
@@ -1512,6 +1581,9 @@ struct _icc {
 	int          (*delete_tag)(struct _icc *p, icTagSignature sig);
 															/* Returns 0 if deleted OK */
 	int          (*check_id)(struct _icc *p, ORD8 *id); /* Returns 0 if ID is OK, 1 if not present etc. */
+	int          (*get_hash)(struct _icc *p, ORD8 hash[16]);
+								/* Return a content hash for use as a cache key, the */
+								/* profile ID if present, else computed. 0 if OK */
 	double       (*get_tac)(struct _icc *p, double *chmax,
 	                        void (*calfunc)(void *cntx, double *out, double *in), void *cntx);
  	                           /* Returns total ink limit and channel maximums */
@@ -1567,6 +1639,16 @@ struct _icc {
 
 	/* - - - - - - - - tweaks - - - - - - - */
 	int              allowclutPoints256; /* Non standard - allow 256 res cLUT */
+	int              lazyclut;			/* Defer decoding Lut cLUTs until first use, when */
+										/* the file is memory based (default false). */
+										/* The icmFile must outlive the icc. */
+	unsigned int     bwdcurveres;		/* If > 1, Matrix lookup objects created after this is */
+										/* set do bwd lookups through monotonic table TRCs using */
+										/* dense inverse tables of this resolution, rather than */
+										/* by inverting the curve (default 0, 1 = never). */
+	unsigned int     fwdcurveres;		/* If > 1, Matrix lookup objects created after this is */
+										/* set do fwd lookups through gamma TRCs using dense */
+										/* tables of this resolution, rather than pow() (default 0). */
 
 	int              useLinWpchtmx;		/* Force Wrong Von Kries for output class (default false) */
 										/* Could be set by code, and is set set by */
@@ -1744,6 +1826,7 @@ extern ICCLIB_API icc *new_icc_a(icmAlloc *al);		/* With allocator class */
 
 /* If SEPARATE_STD not defined: */
 extern ICCLIB_API icc *new_icc(void);				/* Default allocator */
+extern ICCLIB_API icc *new_icc_arena(void);		/* Arena allocator, bulk freed by del() */
 
 /* - - - - - - - - - - - - - */
 /* Some useful utilities: */
@@ -2266,6 +2349,21 @@ extern ICCLIB_API double icmCIE2Ksq(double *in0, double *in1);
 /* Return the CIEDE2000 Delta E color difference measure for two XYZ values */
 extern ICCLIB_API double icmXYZCIE2K(icmXYZNumber *w, double *in0, double *in1);
 
+/* Return a fast approximation of the CIEDE2000 Delta E for two Lab values, */
+/* for use in optimization and search loops. The error is less than */
+/* 0.00002 x the Delta E. Use icmCIE2K() for reporting. */
+extern ICCLIB_API double icmCIE2Kf(double *in0, double *in1);
+
+/* Return a fast approximation of the CIEDE2000 Delta E squared, for two Lab values */
+extern ICCLIB_API double icmCIE2Kfsq(double *in0, double *in1);
+
+/* Batch versions: set de[i] to the Delta E of the n pairs of */
+/* pixel interleaved Lab values in0[3 * i] and in1[3 * i]. */
+extern ICCLIB_API void icmLabDE_n(double *de, double *in0, double *in1, int n);
+extern ICCLIB_API void icmCIE94_n(double *de, double *in0, double *in1, int n);
+extern ICCLIB_API void icmCIE2K_n(double *de, double *in0, double *in1, int n);
+extern ICCLIB_API void icmCIE2Kf_n(double *de, double *in0, double *in1, int n);
+
 
 /* - - - - - - - - - - - - - - - - - - - - - - - */
 /* Clip Lab, while maintaining hue angle. */
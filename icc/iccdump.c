@@ -31,9 +31,10 @@ void error(char *fmt, ...), warning(char *fmt, ...);
 void usage(void) {
 	fprintf(stderr,"Dump an ICC file in human readable form, V%s\n",ICCLIB_VERSION_STR);
 	fprintf(stderr,"Author: Graeme W. Gill\n");
-	fprintf(stderr,"usage: iccdump [-v level] [-t tagname] [-s] infile\n");
+	fprintf(stderr,"usage: iccdump [-v level] [-t tagname] [-h] [-s] infile\n");
 	fprintf(stderr," -v level                 Verbose level 1-3 (default 2)\n");
 	fprintf(stderr," -t tag                   Dump this tag only (can be used multiple times)\n");
+	fprintf(stderr," -h                       Dump the header and tag table only\n");
 	fprintf(stderr," -s                       Search for embedded profile\n");
 	fprintf(stderr," -i                       Check V4 ID value\n");
 	exit(1);
@@ -49,6 +50,7 @@ main(int argc, char *argv[]) {
 	char tag_names[MXTGNMS][5];
 	int verb = 2;
 	int search = 0;
+	int hdronly = 0;	/* Header and tag table only */
 	int chid = 0;		/* Check V4 ID */
 	int ecount = 1;		/* Embedded count */
 	int offset = 0;		/* Offset to read profile from */
@@ -95,6 +97,10 @@ main(int argc, char *argv[]) {
 				strncpy(tag_names[ntag_names],na,4);
 				tag_names[ntag_names++][4] = '\000';
 			}
+			/* Header and tag table only */
+			else if (argv[fa][1] == 'h' || argv[fa][1] == 'H') {
+				hdronly = 1;
+			}
 			/* Search */
 			else if (argv[fa][1] == 's' || argv[fa][1] == 'S') {
 				search = 1;
@@ -185,7 +191,20 @@ main(int argc, char *argv[]) {
 			if (icco->header->cmmId == str2tag("argl"))
 				icco->allowclutPoints256 = 1;
 
-			if (ntag_names > 0) {
+			if (hdronly) {
+				unsigned int i;
+
+				/* The tags aren't read, only the tag table is listed */
+				if (icco->header != NULL)
+					icco->header->dump(icco->header, op, verb);
+				for (i = 0; i < icco->count; i++) {
+					op->gprintf(op,"tag %d:\n",i);
+					op->gprintf(op,"  sig      %s\n",tag2str(icco->data[i].sig)); 
+					op->gprintf(op,"  type     %s\n",tag2str(icco->data[i].ttype)); 
+					op->gprintf(op,"  offset   %d\n", icco->data[i].offset);
+					op->gprintf(op,"  size     %d\n", icco->data[i].size);
+				}
+			} else if (ntag_names > 0) {
 				int i;
 				for (i = 0; i < ntag_names; i++) {
 
@@ -31,10 +31,119 @@
 #include <fcntl.h>
 #include <string.h>
 #include <math.h>
+#if defined(O_BINARY) || defined(_O_BINARY)
+# include <io.h>
+#endif
 #include "icc.h"
 
+#define STRM_BLOCK 4096			/* Colors per binary stream block */
+
 void error(char *fmt, ...), warning(char *fmt, ...);
 
+/* Return nz if the colorspace is a device space that -s scale applies to */
+static int is_dev(icColorSpaceSignature sig) {
+	return sig != icSigXYZData
+	    && sig != icSigLabData
+	    && sig != icSigLuvData
+	    && sig != icSigYCbCrData
+	    && sig != icSigYxyData
+	    && sig != icSigHsvData
+	    && sig != icSigHlsData;
+}
+
+/* Translate a binary stream of packed float (dsz = 4) or double (dsz = 8) */
+/* values from stdin to stdout, a block of colors at a time. */
+/* Return the worst lookup return value. */
+static int stream_lu(
+icc *icco,
+icmLuBase *luo,
+int dsz,
+icColorSpaceSignature ins, int inn,
+icColorSpaceSignature outs, int outn,
+double scale,
+int repYxy
+) {
+	unsigned char *ibuf, *obuf;
+	double *in, *out;
+	int rv = 0;
+
+#if defined(O_BINARY) || defined(_O_BINARY)
+	setmode(fileno(stdin), O_BINARY);
+	setmode(fileno(stdout), O_BINARY);
+#endif
+
+	if ((ibuf = (unsigned char *)malloc(STRM_BLOCK * inn * dsz)) == NULL
+	 || (obuf = (unsigned char *)malloc(STRM_BLOCK * outn * dsz)) == NULL
+	 || (in = (double *)malloc(STRM_BLOCK * inn * sizeof(double))) == NULL
+	 || (out = (double *)malloc(STRM_BLOCK * outn * sizeof(double))) == NULL)
+		error("Malloc of stream buffers failed");
+
+	for (;;) {
+		size_t nr;
+		int i, n, ni, no;
+
+		if ((nr = fread(ibuf, inn * dsz, STRM_BLOCK, stdin)) == 0)
+			break;
+		n = (int)nr;
+		ni = n * inn;
+		no = n * outn;
+
+		if (dsz == 4) {
+			float *fp = (float *)ibuf;
+			for (i = 0; i < ni; i++)
+				in[i] = (double)fp[i];
+		} else {
+			memcpy(in, ibuf, ni * sizeof(double));
+		}
+
+		if (scale > 0.0 && is_dev(ins)) {
+			for (i = 0; i < ni; i++)
+				in[i] /= scale;
+		}
+		if (repYxy && ins == icSigYxyData) {
+			for (i = 0; i < ni; i += inn)
+				icmYxy2XYZ(in + i, in + i);
+		}
+
+		if ((i = luo->lookup_n(luo, out, in, n)) > 1)
+			error ("%d, %s",icco->errc,icco->err);
+		if (i > rv)
+			rv = i;
+
+		if (repYxy && outs == icSigYxyData) {
+			for (i = 0; i < no; i += outn)
+				icmXYZ2Yxy(out + i, out + i);
+		}
+		if (scale > 0.0 && is_dev(outs)) {
+			for (i = 0; i < no; i++)
+				out[i] *= scale;
+		}
+
+		if (dsz == 4) {
+			float *fp = (float *)obuf;
+			for (i = 0; i < no; i++)
+				fp[i] = (float)out[i];
+		} else {
+			memcpy(obuf, out, no * sizeof(double));
+		}
+		if (fwrite(obuf, outn * dsz, n, stdout) != nr)
+			error("Write to stdout failed");
+
+		if (nr < STRM_BLOCK)
+			break;
+	}
+	if (ferror(stdin))
+		error("Read from stdin failed");
+	fflush(stdout);
+
+	free(out);
+	free(in);
+	free(obuf);
+	free(ibuf);
+
+	return rv;
+}
+
 void usage(void) {
 	fprintf(stderr,"Translate colors through an ICC profile, V%s\n",ICCLIB_VERSION_STR);
 	fprintf(stderr,"Author: Graeme W. Gill\n");
@@ -48,11 +157,14 @@ void usage(void) {
 	fprintf(stderr," -o order      n = normal (priority: lut > matrix > monochrome)\n");
 	fprintf(stderr,"               r = reverse (priority: monochrome > matrix > lut)\n");
 	fprintf(stderr," -s scale      Scale device range 0.0 - scale rather than 0.0 - 1.0\n");
+	fprintf(stderr," -x f|d        Binary stream of packed float or double values in and out\n");
 	fprintf(stderr,"\n");
 	fprintf(stderr,"    The colors to be translated should be fed into standard input,\n");
 	fprintf(stderr,"    one input color per line, white space separated.\n");
 	fprintf(stderr,"    A line starting with a # will be ignored.\n");
 	fprintf(stderr,"    A line not starting with a number will terminate the program.\n");
+	fprintf(stderr,"    With -x, input is native byte order packed input channel values,\n");
+	fprintf(stderr,"    and output is packed output channel values, until end of input.\n");
 	exit(1);
 }
 
@@ -66,6 +178,7 @@ main(int argc, char *argv[]) {
 	double scale = 0.0;		/* Device value scale factor */
 	int rv = 0;
 	int repYxy = 0;			/* Report Yxy */
+	int strm = 0;			/* Binary stream value size, 0 for text */
 	char buf[200];
 	double oin[MAX_CHAN], in[MAX_CHAN], out[MAX_CHAN];
 
@@ -226,6 +339,24 @@ main(int argc, char *argv[]) {
 				if (scale <= 0.0) usage();
 			}
 
+			/* Binary stream */
+			else if (argv[fa][1] == 'x' || argv[fa][1] == 'X') {
+				fa = nfa;
+				if (na == NULL) usage();
+    			switch (na[0]) {
+					case 'f':
+					case 'F':
+						strm = sizeof(float);
+						break;
+					case 'd':
+					case 'D':
+						strm = sizeof(double);
+						break;
+					default:
+						usage();
+				}
+			}
+
 			else 
 				usage();
 		} else
@@ -235,12 +366,18 @@ main(int argc, char *argv[]) {
 	if (fa >= argc || argv[fa][0] == '-') usage();
 	strcpy(prof_name,argv[fa]);
 
-	/* Open up the profile for reading */
-	if ((fp = new_icmFileStd_name(prof_name,"r")) == NULL)
+	/* Keep stdout clean for the binary stream */
+	if (strm != 0)
+		verb = 0;
+
+	/* Open up the profile for reading. Map it, so that only the */
+	/* cLUT needed for the conversion gets decoded. */
+	if ((fp = new_icmFileMap_name(prof_name)) == NULL)
 		error ("Can't open file '%s'",prof_name);
 
 	if ((icco = new_icc()) == NULL)
 		error ("Creation of ICC object failed");
+	icco->lazyclut = 1;
 
 	if ((rv = icco->read(icco,fp,0)) != 0)
 		error ("%d, %s",rv,icco->err);
@@ -269,6 +406,14 @@ main(int argc, char *argv[]) {
 		if (outs == icSigXYZData)
 			outs = icSigYxyData; 
 	}
+
+	if (strm != 0) {
+		stream_lu(icco, luo, strm, ins, inn, outs, outn, scale, repYxy);
+		luo->del(luo);
+		icco->del(icco);
+		fp->del(fp);
+		return 0;
+	}
 		
 	/* Process colors to translate */
 	for (;;) {
@@ -299,14 +444,7 @@ main(int argc, char *argv[]) {
 			break;
 
 		/* If device data and scale */
-		if(scale > 0.0
-    	 && ins != icSigXYZData
-		 && ins != icSigLabData
-		 && ins != icSigLuvData
-		 && ins != icSigYCbCrData
-		 && ins != icSigYxyData
-		 && ins != icSigHsvData
-		 && ins != icSigHlsData) {
+		if (scale > 0.0 && is_dev(ins)) {
 			for (i = 0; i < MAX_CHAN; i++) {
 				in[i] /= scale;
 			}
@@ -337,14 +475,7 @@ main(int argc, char *argv[]) {
 		}
 
 		/* If device data and scale */
-		if(scale > 0.0
-    	 && outs != icSigXYZData
-		 && outs != icSigLabData
-		 && outs != icSigLuvData
-		 && outs != icSigYCbCrData
-		 && outs != icSigYxyData
-		 && outs != icSigHsvData
-		 && outs != icSigHlsData) {
+		if (scale > 0.0 && is_dev(outs)) {
 			for (i = 0; i < MAX_CHAN; i++) {
 				out[i] *= scale;
 			}
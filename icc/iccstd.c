@@ -196,6 +196,322 @@ icmAlloc *new_icmAllocStd() {
 
 #endif	/* ICC_DEBUG_MALLOC */
 
+/* ------------------------------------------------- */
+/* Arena heap allocator icmAlloc compatible class */
+/* Allocations are carved out of large blocks obtained from the */
+/* standard system malloc, and free() does nothing unless the */
+/* allocation was the most recent one or was given its own block. */
+/* Everything is released at once when the allocator */
+/* is deleted, so an icc created with it may be freed in bulk. */
+
+#ifdef ICC_DEBUG_MALLOC
+
+/* Make sure that inline malloc #defines are turned off for this file */
+#undef was_debug_malloc
+#ifdef malloc
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+#define was_debug_malloc
+#endif	/* dmalloc */
+
+#endif	/* ICC_DEBUG_MALLOC */
+
+#define ICM_ARENA_DEF_BSIZE 65536		/* Default block size */
+
+/* Allocation header, sized to keep the allocations aligned */
+typedef union {
+	size_t size;			/* Size of the allocation excluding header */
+	double d;
+	void *p;
+	long l;
+} icmArenaHdr;
+
+/* Block header */
+typedef union _icmArenaBlk {
+	struct {
+		union _icmArenaBlk *next;	/* Next (older) block */
+		size_t len;			/* Usable length of block */
+		size_t used;		/* Amount used */
+		size_t last;		/* Offset of the most recent allocation header */
+	} b;
+	icmArenaHdr align;
+} icmArenaBlk;
+
+/* Allocate without clearing */
+static void *icmAllocArena_alloc(
+icmAllocArena *p,
+size_t size
+) {
+	icmArenaBlk *bp = p->blks;
+	icmArenaHdr *hp;
+	size_t asize;
+
+	/* Round up to keep the alignment */
+	if (size > (SIZE_MAX - 2 * sizeof(icmArenaHdr)))
+		return NULL;
+	size = (size + sizeof(icmArenaHdr) - 1)/sizeof(icmArenaHdr) * sizeof(icmArenaHdr);
+	asize = size + sizeof(icmArenaHdr);
+
+	/* Large allocations get a block of their own, placed after */
+	/* the current block, so that they can be freed. */
+	if (asize > p->bsize/4) {
+		icmArenaBlk *nbp;
+
+		if (asize > (SIZE_MAX - sizeof(icmArenaBlk))
+		 || (nbp = (icmArenaBlk *)malloc(sizeof(icmArenaBlk) + asize)) == NULL)
+			return NULL;
+		nbp->b.len = nbp->b.used = asize;
+		nbp->b.last = 0;
+		if (bp != NULL) {
+			nbp->b.next = bp->b.next;
+			bp->b.next = nbp;
+		} else {
+			nbp->b.next = NULL;
+			p->blks = nbp;
+		}
+		hp = (icmArenaHdr *)(nbp + 1);
+		hp->size = size;
+		return (void *)(hp + 1);
+	}
+
+	/* Start a new block if there isn't room in the current one */
+	if (bp == NULL || bp->b.used == bp->b.len || (bp->b.len - bp->b.used) < asize) {
+		if ((bp = (icmArenaBlk *)malloc(sizeof(icmArenaBlk) + p->bsize)) == NULL)
+			return NULL;
+		bp->b.len = p->bsize;
+		bp->b.used = 0;
+		bp->b.last = 0;
+		bp->b.next = p->blks;
+		p->blks = bp;
+	}
+
+	hp = (icmArenaHdr *)((char *)(bp + 1) + bp->b.used);
+	hp->size = size;
+	bp->b.last = bp->b.used;
+	bp->b.used += asize;
+
+	return (void *)(hp + 1);
+}
+
+/* Free an allocation if we can */
+static void icmAllocArena_release(
+icmAllocArena *p,
+void *ptr
+) {
+	icmArenaBlk *bp = p->blks, *pbp;
+	icmArenaHdr *hp;
+
+	if (ptr == NULL || bp == NULL)
+		return;
+	hp = (icmArenaHdr *)ptr - 1;
+
+	/* The most recent allocation in the current block */
+	if (bp->b.used > 0 && hp == (icmArenaHdr *)((char *)(bp + 1) + bp->b.last)) {
+		bp->b.used = bp->b.last;
+		return;
+	}
+
+	/* A large allocation that has its own block */
+	if (hp->size + sizeof(icmArenaHdr) > p->bsize/4) {
+		for (pbp = bp, bp = bp->b.next; bp != NULL; pbp = bp, bp = bp->b.next) {
+			if (hp == (icmArenaHdr *)(bp + 1)) {
+				pbp->b.next = bp->b.next;
+				free(bp);
+				return;
+			}
+		}
+		/* Must be the only block */
+		bp = p->blks;
+		if (hp == (icmArenaHdr *)(bp + 1)) {
+			p->blks = bp->b.next;
+			free(bp);
+		}
+	}
+}
+
+static void *icmAllocArena_resize(
+icmAllocArena *p,
+void *ptr,
+size_t size
+) {
+	icmArenaBlk *bp = p->blks;
+	icmArenaHdr *hp;
+	void *nptr;
+
+	if (ptr == NULL)
+		return icmAllocArena_alloc(p, size);
+
+	hp = (icmArenaHdr *)ptr - 1;
+	if (size <= hp->size)
+		return ptr;
+
+	/* Grow the most recent allocation in place if there is room */
+	if (bp != NULL && bp->b.used > 0 && hp == (icmArenaHdr *)((char *)(bp + 1) + bp->b.last)
+	 && size <= (SIZE_MAX - 2 * sizeof(icmArenaHdr))) {
+		size_t nsize = (size + sizeof(icmArenaHdr) - 1)/sizeof(icmArenaHdr) * sizeof(icmArenaHdr);
+		if ((nsize + sizeof(icmArenaHdr)) <= p->bsize/4
+		 && (bp->b.len - bp->b.last) >= (nsize + sizeof(icmArenaHdr))) {
+			hp->size = nsize;
+			bp->b.used = bp->b.last + nsize + sizeof(icmArenaHdr);
+			return ptr;
+		}
+	}
+
+	if ((nptr = icmAllocArena_alloc(p, size)) == NULL)
+		return NULL;
+	memmove(nptr, ptr, hp->size);
+	icmAllocArena_release(p, ptr);
+	return nptr;
+}
+
+/* Free all the blocks */
+static void icmAllocArena_release_all(
+icmAllocArena *p
+) {
+	icmArenaBlk *bp, *nbp;
+
+	for (bp = p->blks; bp != NULL; bp = nbp) {
+		nbp = bp->b.next;
+		free(bp);
+	}
+	p->blks = NULL;
+}
+
+#ifdef ICC_DEBUG_MALLOC
+
+static void *icmAllocArena_dmalloc(
+struct _icmAlloc *pp,
+size_t size,
+char *name,
+int line
+) {
+	return icmAllocArena_alloc((icmAllocArena *)pp, size);
+}
+
+static void *icmAllocArena_dcalloc(
+struct _icmAlloc *pp,
+size_t num,
+size_t size,
+char *name,
+int line
+) {
+	void *rv;
+
+	if (size != 0 && num > (SIZE_MAX/size))
+		return NULL;
+	if ((rv = icmAllocArena_alloc((icmAllocArena *)pp, num * size)) != NULL)
+		memset(rv, 0, num * size);
+	return rv;
+}
+
+static void *icmAllocArena_drealloc(
+struct _icmAlloc *pp,
+void *ptr,
+size_t size,
+char *name,
+int line
+) {
+	return icmAllocArena_resize((icmAllocArena *)pp, ptr, size);
+}
+
+static void icmAllocArena_dfree(
+struct _icmAlloc *pp,
+void *ptr,
+char *name,
+int line
+) {
+	icmAllocArena_release((icmAllocArena *)pp, ptr);
+}
+
+#else /* !ICC_DEBUG_MALLOC */
+
+static void *icmAllocArena_malloc(
+struct _icmAlloc *pp,
+size_t size
+) {
+	return icmAllocArena_alloc((icmAllocArena *)pp, size);
+}
+
+static void *icmAllocArena_calloc(
+struct _icmAlloc *pp,
+size_t num,
+size_t size
+) {
+	void *rv;
+
+	if (size != 0 && num > (SIZE_MAX/size))
+		return NULL;
+	if ((rv = icmAllocArena_alloc((icmAllocArena *)pp, num * size)) != NULL)
+		memset(rv, 0, num * size);
+	return rv;
+}
+
+static void *icmAllocArena_realloc(
+struct _icmAlloc *pp,
+void *ptr,
+size_t size
+) {
+	return icmAllocArena_resize((icmAllocArena *)pp, ptr, size);
+}
+
+static void icmAllocArena_free(
+struct _icmAlloc *pp,
+void *ptr
+) {
+	icmAllocArena_release((icmAllocArena *)pp, ptr);
+}
+
+#endif	/* !ICC_DEBUG_MALLOC */
+
+/* we're done with the AllocArena object, and everything allocated from it */
+static void icmAllocArena_delete(
+icmAlloc *pp
+) {
+	icmAllocArena *p = (icmAllocArena *)pp;
+
+	icmAllocArena_release_all(p);
+	free(p);
+}
+
+/* Create icmAllocArena */
+icmAlloc *new_icmAllocArena(
+size_t bsize		/* Block size, 0 for default */
+) {
+	icmAllocArena *p;
+	if ((p = (icmAllocArena *) calloc(1,sizeof(icmAllocArena))) == NULL)
+		return NULL;
+#ifdef ICC_DEBUG_MALLOC
+	p->dmalloc  = icmAllocArena_dmalloc;
+	p->dcalloc  = icmAllocArena_dcalloc;
+	p->drealloc = icmAllocArena_drealloc;
+	p->dfree    = icmAllocArena_dfree;
+#else
+	p->malloc  = icmAllocArena_malloc;
+	p->calloc  = icmAllocArena_calloc;
+	p->realloc = icmAllocArena_realloc;
+	p->free    = icmAllocArena_free;
+#endif
+	p->del     = icmAllocArena_delete;
+
+	if (bsize == 0)
+		bsize = ICM_ARENA_DEF_BSIZE;
+	if (bsize < 1024)
+		bsize = 1024;
+	p->bsize = (bsize + sizeof(icmArenaHdr) - 1)/sizeof(icmArenaHdr) * sizeof(icmArenaHdr);
+
+	return (icmAlloc *)p;
+}
+
+#ifdef was_debug_malloc
+#undef was_debug_malloc
+#define malloc( p, size )	    dmalloc( p, size, __FILE__, __LINE__ )
+#define calloc( p, num, size )	dcalloc( p, num, size, __FILE__, __LINE__ )
+#define realloc( p, ptr, size )	drealloc( p, ptr, size, __FILE__, __LINE__ )
+#define free( p, ptr )	        dfree( p, ptr , __FILE__, __LINE__ )
+#endif	/* was_debug_malloc */
+
 /* ------------------------------------------------- */
 /* Standard Stream file I/O icmFile compatible class */
 
@@ -421,6 +737,145 @@ size_t length		/* Number of bytes in buffer */
 	return fp;
 }
 
+/* ------------------------------------------------- */
+/* Read only memory mapped file icmFile compatible class. */
+/* This is an icmFileMem whose buffer is the mmap()'d file on */
+/* systems that support it, or a copy of the whole file read into */
+/* memory otherwise. Since the buffer is presented by get_buf(), */
+/* tags can be decoded straight from it without any intermediate copy. */
+
+#if defined(UNIX) && !defined(NT)
+# include <unistd.h>
+# include <sys/mman.h>
+# define ICM_HAVE_MMAP
+#endif
+
+/* Writing isn't supported */
+static size_t icmFileMap_write(
+icmFile *pp,
+void *buffer,
+size_t size,
+size_t count
+) {
+	return 0;
+}
+
+static int icmFileMap_printf(
+icmFile *pp,
+const char *format,
+...
+) {
+	return 0;
+}
+
+/* we're done with the file object, return nz on failure */
+static int icmFileMap_delete(
+icmFile *pp
+) {
+	icmFileMem *p = (icmFileMem *)pp;
+	icmAlloc *al = p->al;
+	int del_al   = p->del_al;
+
+	if (p->del_buf)		/* Buffer is a copy of the file */
+		al->free(al, p->start);
+#ifdef ICM_HAVE_MMAP
+	else if (p->start != NULL)
+		munmap((void *)p->start, p->end - p->start);
+#endif
+	al->free(al, p);	/* Free object */
+	if (del_al)			/* We are responsible for deleting allocator */
+		al->del(al);
+	return 0;
+}
+
+/* Create a read only memory mapped icmFile given a file name */
+icmFile *new_icmFileMap_name(
+char *name
+) {
+	return new_icmFileMap_name_a(name, NULL);
+}
+
+/* Create a read only memory mapped icmFile given a file name and allocator */
+icmFile *new_icmFileMap_name_a(
+char *name,
+icmAlloc *al			/* heap allocator, NULL for default */
+) {
+	icmFile *fp;
+	icmFileMem *p;
+	unsigned char *buf = NULL;
+	size_t len = 0;
+	int del_al = 0, del_buf = 0;
+
+	if (al == NULL) {	/* None provided, create default */
+		if ((al = new_icmAllocStd()) == NULL)
+			return NULL;
+		del_al = 1;		/* We need to delete the allocator we created */
+	}
+
+#ifdef ICM_HAVE_MMAP
+	{
+		int fd;
+		struct stat sbuf;
+
+		if ((fd = open(name, O_RDONLY)) < 0) {
+			if (del_al)
+				al->del(al);
+			return NULL;
+		}
+		if (fstat(fd, &sbuf) == 0 && sbuf.st_size > 0) {
+			len = (size_t)sbuf.st_size;
+			if ((buf = (unsigned char *)mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0))
+			                                                               == MAP_FAILED)
+				buf = NULL;
+		}
+		close(fd);
+	}
+#endif /* ICM_HAVE_MMAP */
+
+	/* Fall back to reading the whole file into memory */
+	if (buf == NULL) {
+		icmFile *rfp;
+
+		if ((rfp = new_icmFileStd_name_a(name, "r", al)) == NULL) {
+			if (del_al)
+				al->del(al);
+			return NULL;
+		}
+		len = rfp->get_size(rfp);
+		if ((buf = (unsigned char *)al->malloc(al, len > 0 ? len : 1)) == NULL
+		 || rfp->read(rfp, buf, 1, len) != len) {
+			if (buf != NULL)
+				al->free(al, buf);
+			rfp->del(rfp);
+			if (del_al)
+				al->del(al);
+			return NULL;
+		}
+		rfp->del(rfp);
+		del_buf = 1;
+	}
+
+	if ((fp = new_icmFileMem_a(buf, len, al)) == NULL) {
+		if (del_buf)
+			al->free(al, buf);
+#ifdef ICM_HAVE_MMAP
+		else
+			munmap((void *)buf, len);
+#endif
+		if (del_al)
+			al->del(al);
+		return NULL;
+	}
+	p = (icmFileMem *)fp;
+	p->del_al  = del_al;
+	p->del_buf = del_buf;
+	p->write   = icmFileMap_write;
+	p->gprintf = icmFileMap_printf;
+	p->del     = icmFileMap_delete;
+
+	return fp;
+}
+
 /* ------------------------------------------------- */
 
 /* Create an icc with the std allocator */
@@ -440,6 +895,24 @@ icc *new_icc(void) {
 	return p;
 }
 
+/* Create an icc with an arena allocator, so that all its */
+/* tags and other objects are released in bulk by icc->del(). */
+icc *new_icc_arena(void) {
+	icc *p;
+	icmAlloc *al;			/* memory allocator */
+
+	if ((al = new_icmAllocArena(0)) == NULL)
+		return NULL;
+
+	if ((p = new_icc_a(al)) == NULL) {
+		al->del(al);
+		return NULL;
+	}
+
+	p->del_al = 1;		/* Get icc->del to cleanup allocator */
+	return p;
+}
+
 /* ------------------------------------------------- */
 
 /* Create an icmMD5 with the std allocator */
@@ -88,6 +88,39 @@ int main(void) {
 			printf("DeltaE is %f, should be %f\n\n",de,ref[i].de);
 			rv = 1;
 		}
+
+		/* Fast approximation */
+		de = icmCIE2Kf(ref[i].Lab1, ref[i].Lab2);
+		if (fabs(de - ref[i].de) > 0.0001) {
+			printf("Fast error at index %d:\n",i);
+			printf("Lab1 = %f %f %f\n", ref[i].Lab1[0], ref[i].Lab1[1], ref[i].Lab1[2]);
+			printf("Lab2 = %f %f %f\n", ref[i].Lab2[0], ref[i].Lab2[1], ref[i].Lab2[2]);
+			printf("DeltaE is %f, should be %f\n\n",de,ref[i].de);
+			rv = 1;
+		}
+	}
+
+	/* Batch versions */
+	{
+		double lab1[NTESTS * 3], lab2[NTESTS * 3], de[NTESTS], fde[NTESTS];
+		int j;
+
+		for (i = 0; i < NTESTS; i++) {
+			for (j = 0; j < 3; j++) {
+				lab1[i * 3 + j] = ref[i].Lab1[j];
+				lab2[i * 3 + j] = ref[i].Lab2[j];
+			}
+		}
+		icmCIE2K_n(de, lab1, lab2, NTESTS);
+		icmCIE2Kf_n(fde, lab1, lab2, NTESTS);
+		for (i = 0; i < NTESTS; i++) {
+			if (fabs(de[i] - ref[i].de) > 0.0001
+			 || fabs(fde[i] - ref[i].de) > 0.0001) {
+				printf("Batch error at index %d:\n",i);
+				printf("DeltaE is %f and %f, should be %f\n\n",de[i],fde[i],ref[i].de);
+				rv = 1;
+			}
+		}
 	}
 
 	printf("Test Finished\n");
@@ -91,11 +91,13 @@
 #include "aconfig.h"
 #include "numlib.h"
 #include "tiffio.h"
+#include "zlib.h"
 #include "jpeglib.h"
 #include "iccjpeg.h"
 #include "icc.h"
 #include "xicc.h"
 #include "imdi.h"
+#include "conv.h"
 
 #undef DEBUG		/* Print detailed debug info */
 
@@ -105,6 +107,11 @@
 #endif
 
 #define DEFJPGQ 80		/* Default JPEG quality */
+#define MAXTHREADS 64	/* Maximum number of conversion threads */
+#define THRLINES 16		/* Number of lines per thread in each batch */
+#define DEFTILE 256		/* Default output tile width and height */
+#define ZSTRIPSZ (1024 * 1024)	/* Target Deflate output strip size */
+#define PCACHESIZE 4093	/* Floating point conversion pixel cache size (prime) */
 
 void usage(char *diag, ...) {
 	fprintf(stderr,"Color Correct a TIFF or JPEG file using any sequence of ICC profiles or Calibrations, V%s\n",ARGYLL_VERSION_STR);
@@ -130,6 +137,11 @@ void usage(char *diag, ...) {
 	fprintf(stderr," -I              Ignore any file or profile colorspace mismatches\n");
 	fprintf(stderr," -D              Don't append or set the output TIFF or JPEG description\n");
 	fprintf(stderr," -N              Output uncompressed TIFF (default LZW)\n");
+	fprintf(stderr," -Z              Output Deflate compressed TIFF, compressing on separate threads\n");
+	fprintf(stderr," -T [WxH]        Output tiled TIFF, with W x H pixel tiles (default %dx%d)\n",DEFTILE,DEFTILE);
+	fprintf(stderr," -B              Output BigTIFF (default if the output may exceed 4GB)\n");
+	fprintf(stderr," -j n            Use n threads for the fast conversion (default 1)\n");
+	fprintf(stderr," -m dir          Cache the fast conversion tables in directory dir\n");
 	fprintf(stderr," -e profile.[%s | tiff | jpg]  Optionally embed a profile in the destination TIFF or JPEG file.\n",ICC_FILE_EXT_ND);
 	fprintf(stderr,"\n");
 	fprintf(stderr,"                 Then for each profile in sequence:\n");
@@ -664,7 +676,7 @@ struct _profinfo {
 typedef struct {
 	/* Overall parameters */
 	int verb;				/* Non-zero if verbose */
-	int compr;				/* NZ to use TIFF LZW */
+	int compr;				/* 0 = none, 1 = TIFF LZW, 2 = Deflate */
 	icColorSpaceSignature ins, outs;	/* Input/Output spaces */
 	int iinv, oinv;			/* Space inversion */	
 	int id, od, md;			/* Input/Output dimensions and max(id,od) */
@@ -970,6 +982,387 @@ J_COLOR_SPACE cspace
 	return buf;
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Cache of floating point conversion results, indexed by a hash */
+/* of the input pixel value. Graphics and flat colour images contain */
+/* few distinct pixel values, so this skips most of the per pixel */
+/* floating point lookups. The result for a given pixel value is */
+/* always the same, so a cache hit doesn't change the output. */
+
+typedef struct {
+	int valid;						/* Non-zero if entry is in use */
+	unsigned short in[MAX_CHAN];	/* Raw input pixel value */
+	unsigned short out[MAX_CHAN];	/* Raw output pixel value */
+} pcentry;
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Multi-threaded fast conversion of a batch of lines. */
+/* The lines are read and written in order by the main thread, */
+/* while the imdi interp() is run in parallel on interleaved lines. */
+
+typedef struct {
+	imdi *s;				/* imdi to use (shared) */
+	int ix, nth;			/* This threads index, and total number of threads */
+	int nlines;				/* Number of lines in this batch */
+	unsigned char **inl;	/* Input line buffers */
+	unsigned char **outl;	/* Output line buffers */
+	int inst;				/* Input stride */
+	int width;				/* Pixels per line */
+} linethr;
+
+static int linethr_main(void *cntx) {
+	linethr *p = (linethr *)cntx;
+	unsigned char *inp[MAX_CHAN];
+	unsigned char *outp[MAX_CHAN];
+	int i;
+
+	for (i = p->ix; i < p->nlines; i += p->nth) {
+		inp[0] = p->inl[i];
+		outp[0] = p->outl[i];
+		p->s->interp(p->s, (void **)outp, 0, (void **)inp, p->inst, p->width);
+	}
+	return 0;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* TIFF line access, using whole tiles or strips at a time. */
+/* A band of lines the height of a tile or strip is held, */
+/* so that tiled files can be read and written, and striped */
+/* files are decoded/encoded a strip at a time. */
+
+#define MAXBANDSZ (64 * 1024 * 1024)	/* Maximum band size, else use scanlines */
+
+typedef struct {
+	TIFF *h;				/* TIFF file */
+	int wr;					/* nz if writing */
+	int tiled;				/* nz if tiled */
+	int width, height;		/* Image size */
+	tsize_t lsize;			/* Bytes per line */
+	int psize;				/* Bytes per pixel */
+	uint32 tw, bh;			/* Tile width, band height (tile length or rows per strip) */
+	int by;					/* First line of band held, -1 if none */
+	unsigned char *band;	/* Band of lines, NULL if using scanlines */
+	unsigned char *tile;	/* Tile buffer */
+	tsize_t tsize;			/* Tile buffer size */
+
+	/* Deflate compression of written strips or tiles on worker threads */
+	int nz;					/* Number of compression slots, 0 if not used */
+	struct _zslot *zs;		/* Compression slots, used as a FIFO */
+	int zh, zn;				/* Index of oldest slot, number of slots in use */
+} tiffband;
+
+/* A strip or tile being compressed */
+typedef struct _zslot {
+	uint32 chunk;			/* Strip or tile number */
+	unsigned char *in;		/* Raw data */
+	uLong insz;				/* Raw data size */
+	unsigned char *out;		/* Compressed data */
+	uLongf outsz;			/* Compressed data size */
+	int rv;					/* zlib return value */
+	athread *th;			/* Thread compressing it */
+} zslot;
+
+static int zslot_main(void *cntx) {
+	zslot *p = (zslot *)cntx;
+
+	p->outsz = compressBound(p->insz);
+	p->rv = compress2(p->out, &p->outsz, p->in, p->insz, Z_DEFAULT_COMPRESSION);
+	return 0;
+}
+
+/* Setup line access to an opened TIFF file. */
+/* For writing, the tiling, strip and compression fields must have been set. */
+/* If writing Deflate compressed, nz is the number of strips or tiles */
+/* that can be compressed at once. */
+static void tb_init(tiffband *p, TIFF *h, int wr, int width, int height, int nz) {
+	uint16 compr;
+
+	memset((void *)p, 0, sizeof(tiffband));
+	p->h = h;
+	p->wr = wr;
+	p->width = width;
+	p->height = height;
+	p->lsize = TIFFScanlineSize(h);
+	p->psize = (int)(p->lsize / width);
+	p->by = -1;
+
+	if ((p->tiled = TIFFIsTiled(h)) != 0) {
+		uint32 tl;
+		TIFFGetField(h, TIFFTAG_TILEWIDTH, &p->tw);
+		TIFFGetField(h, TIFFTAG_TILELENGTH, &tl);
+		p->bh = tl;
+		p->tsize = TIFFTileSize(h);
+		if ((p->tile = (unsigned char *)_TIFFmalloc(p->tsize)) == NULL)
+			error("Malloc failed on TIFF tile buffer");
+	} else {
+		TIFFGetFieldDefaulted(h, TIFFTAG_ROWSPERSTRIP, &p->bh);
+		if (p->bh > (uint32)height)
+			p->bh = height;
+		if ((p->bh * p->lsize) > MAXBANDSZ)
+			return;			/* Use scanlines */
+	}
+	if ((p->band = (unsigned char *)_TIFFmalloc(p->bh * p->lsize)) == NULL)
+		error("Malloc failed on TIFF band buffer");
+
+	/* Compress strips or tiles ourselves, so that it can be done in */
+	/* parallel, and overlapped with the conversion. */
+	TIFFGetFieldDefaulted(h, TIFFTAG_COMPRESSION, &compr);
+	if (wr && compr == COMPRESSION_ADOBE_DEFLATE && nz > 0) {
+		uLong msz = p->tiled ? p->tsize : p->bh * p->lsize;
+		int i;
+
+		if ((p->zs = (zslot *)calloc(nz, sizeof(zslot))) == NULL)
+			error("Malloc failed on compression slots");
+		for (i = 0; i < nz; i++) {
+			if ((p->zs[i].in = (unsigned char *)malloc(msz)) == NULL
+			 || (p->zs[i].out = (unsigned char *)malloc(compressBound(msz))) == NULL)
+				error("Malloc failed on compression buffers");
+		}
+		p->nz = nz;
+	}
+}
+
+/* Wait for the oldest strip or tile being compressed, and write it. */
+/* Return < 0 on error */
+static int tb_zwrite(tiffband *p) {
+	zslot *z = &p->zs[p->zh];
+	tsize_t rv;
+
+	z->th->wait(z->th);
+	z->th->del(z->th);
+	z->th = NULL;
+	p->zh = (p->zh + 1) % p->nz;
+	p->zn--;
+
+	if (z->rv != Z_OK)
+		return -1;
+	if (p->tiled)
+		rv = TIFFWriteRawTile(p->h, z->chunk, (tdata_t)z->out, z->outsz);
+	else
+		rv = TIFFWriteRawStrip(p->h, z->chunk, (tdata_t)z->out, z->outsz);
+	return rv < 0 ? -1 : 1;
+}
+
+/* Start compressing a strip or tile. Return < 0 on error */
+static int tb_zstart(tiffband *p, uint32 chunk, unsigned char *buf, tsize_t sz) {
+	zslot *z;
+
+	if (p->zn >= p->nz && tb_zwrite(p) < 0)
+		return -1;
+	z = &p->zs[(p->zh + p->zn) % p->nz];
+	z->chunk = chunk;
+	memcpy(z->in, buf, sz);
+	z->insz = sz;
+	if ((z->th = new_athread(zslot_main, (void *)z)) == NULL)
+		error("Failed to create compression thread");
+	p->zn++;
+	return 1;
+}
+
+/* Read line y into buf. Return < 0 on error */
+static int tb_read_line(tiffband *p, tdata_t buf, int y) {
+	int by, nl;
+
+	if (p->band == NULL)
+		return TIFFReadScanline(p->h, buf, y, 0);
+
+	by = y - (y % p->bh);
+	if (by != p->by) {		/* Read the band y is in */
+		nl = p->height - by;
+		if (nl > (int)p->bh)
+			nl = p->bh;
+
+		if (p->tiled) {
+			uint32 tx;
+			int i, tn;
+
+			for (tx = 0; tx < (uint32)p->width; tx += p->tw) {
+				tn = p->width - tx;
+				if (tn > (int)p->tw)
+					tn = p->tw;
+				if (TIFFReadTile(p->h, (tdata_t)p->tile, tx, by, 0, 0) < 0)
+					return -1;
+				for (i = 0; i < nl; i++)
+					memcpy(p->band + i * p->lsize + tx * p->psize,
+					       p->tile + i * p->tw * p->psize, tn * p->psize);
+			}
+		} else {
+			if (TIFFReadEncodedStrip(p->h, TIFFComputeStrip(p->h, by, 0),
+			                         (tdata_t)p->band, nl * p->lsize) < 0)
+				return -1;
+		}
+		p->by = by;
+	}
+	memcpy(buf, p->band + (y - by) * p->lsize, p->lsize);
+	return 1;
+}
+
+/* Write line y from buf. Lines must be written in order. */
+/* Return < 0 on error */
+static int tb_write_line(tiffband *p, tdata_t buf, int y) {
+	int by, nl;
+
+	if (p->band == NULL)
+		return TIFFWriteScanline(p->h, buf, y, 0);
+
+	by = y - (y % p->bh);
+	memcpy(p->band + (y - by) * p->lsize, buf, p->lsize);
+
+	nl = y - by + 1;
+	if (nl < (int)p->bh && y < (p->height-1))
+		return 1;			/* Band isn't complete yet */
+
+	/* Write the band */
+	if (p->tiled) {
+		uint32 tx;
+		int i, tn;
+
+		for (tx = 0; tx < (uint32)p->width; tx += p->tw) {
+			tn = p->width - tx;
+			if (tn > (int)p->tw)
+				tn = p->tw;
+			if (tn < (int)p->tw || nl < (int)p->bh)
+				memset(p->tile, 0, p->tsize);		/* Pad edge tiles */
+			for (i = 0; i < nl; i++)
+				memcpy(p->tile + i * p->tw * p->psize,
+				       p->band + i * p->lsize + tx * p->psize, tn * p->psize);
+			if (p->nz > 0) {
+				if (tb_zstart(p, TIFFComputeTile(p->h, tx, by, 0, 0), p->tile, p->tsize) < 0)
+					return -1;
+			} else if (TIFFWriteTile(p->h, (tdata_t)p->tile, tx, by, 0, 0) < 0)
+				return -1;
+		}
+	} else if (p->nz > 0) {
+		if (tb_zstart(p, TIFFComputeStrip(p->h, by, 0), p->band, nl * p->lsize) < 0)
+			return -1;
+	} else {
+		if (TIFFWriteEncodedStrip(p->h, TIFFComputeStrip(p->h, by, 0),
+		                          (tdata_t)p->band, nl * p->lsize) < 0)
+			return -1;
+	}
+	return 1;
+}
+
+static void tb_done(tiffband *p) {
+	int i;
+
+	/* Write any strips or tiles still being compressed */
+	while (p->zn > 0) {
+		if (tb_zwrite(p) < 0)
+			error("Failed to write compressed TIFF data");
+	}
+	for (i = 0; i < p->nz; i++) {
+		free(p->zs[i].in);
+		free(p->zs[i].out);
+	}
+	if (p->zs != NULL)
+		free(p->zs);
+	p->zs = NULL;
+	p->nz = 0;
+
+	if (p->band != NULL)
+		_TIFFfree(p->band);
+	if (p->tile != NULL)
+		_TIFFfree(p->tile);
+	p->band = p->tile = NULL;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Reading or writing of a batch of lines on its own thread, so that */
+/* the TIFF or JPEG decoding and encoding is overlapped with the */
+/* conversion of the previous or next batch. */
+
+typedef struct {
+	tiffband *tb;			/* TIFF line access, NULL if JPEG */
+	struct jpeg_decompress_struct *rj;	/* JPEG being read, NULL if writing */
+	struct jpeg_compress_struct *wj;	/* JPEG being written, NULL if reading */
+	jpegerrorinfo *jerr;	/* JPEG error information */
+	int inv;				/* nz if JPEG values are to be inverted */
+	int bpl;				/* JPEG bytes per line */
+	unsigned char **l;		/* Line buffers */
+	int y, nl;				/* First line and number of lines */
+	athread *th;			/* Thread doing the reading or writing, NULL if none */
+} lineio;
+
+/* Invert a JPEG line */
+static void lineio_inv(lineio *p, unsigned char *l) {
+	unsigned char *cp, *ep = l + p->bpl;
+	for (cp = l; cp < ep; cp++)
+		*cp = ~*cp;
+}
+
+static int lineio_read_main(void *cntx) {
+	lineio *p = (lineio *)cntx;
+	jmp_buf env;
+	int j;
+
+	if (p->tb != NULL) {
+		for (j = 0; j < p->nl; j++) {
+			if (tb_read_line(p->tb, (tdata_t)p->l[j], p->y + j) < 0)
+				error ("Failed to read TIFF line %d",p->y + j);
+		}
+		return 0;
+	}
+
+	/* JPEG errors must longjmp on this thread */
+	memcpy(env, p->jerr->env, sizeof(jmp_buf));
+	if (setjmp(p->jerr->env))
+		error("failed to read JPEG line [%s]",p->jerr->message);
+
+	for (j = 0; j < p->nl; j++) {
+		jpeg_read_scanlines(p->rj, (JSAMPARRAY)&p->l[j], 1);
+		if (p->inv)
+			lineio_inv(p, p->l[j]);
+	}
+	memcpy(p->jerr->env, env, sizeof(jmp_buf));
+	return 0;
+}
+
+static int lineio_write_main(void *cntx) {
+	lineio *p = (lineio *)cntx;
+	jmp_buf env;
+	int j;
+
+	if (p->tb != NULL) {
+		for (j = 0; j < p->nl; j++) {
+			if (tb_write_line(p->tb, (tdata_t)p->l[j], p->y + j) < 0)
+				error ("Failed to write TIFF line %d",p->y + j);
+		}
+		return 0;
+	}
+
+	/* JPEG errors must longjmp on this thread */
+	memcpy(env, p->jerr->env, sizeof(jmp_buf));
+	if (setjmp(p->jerr->env))
+		error("failed to write JPEG line [%s]",p->jerr->message);
+
+	for (j = 0; j < p->nl; j++) {
+		if (p->inv)
+			lineio_inv(p, p->l[j]);
+		jpeg_write_scanlines(p->wj, (JSAMPARRAY)&p->l[j], 1);
+	}
+	memcpy(p->jerr->env, env, sizeof(jmp_buf));
+	return 0;
+}
+
+/* Start reading or writing a batch of lines */
+static void lineio_start(lineio *p, int wr, unsigned char **l, int y, int nl) {
+	p->l = l;
+	p->y = y;
+	p->nl = nl;
+	if ((p->th = new_athread(wr ? lineio_write_main : lineio_read_main, (void *)p)) == NULL)
+		error("Failed to create %s thread", wr ? "write" : "read");
+}
+
+/* Wait for any batch being read or written */
+static void lineio_wait(lineio *p) {
+	if (p->th != NULL) {
+		p->th->wait(p->th);
+		p->th->del(p->th);
+		p->th = NULL;
+	}
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 int
@@ -995,6 +1388,11 @@ main(int argc, char *argv[]) {
 	int ignoremm = 0;		/* Ignore any colorspace mismatches */
 	int nodesc = 0;			/* Don't append or set the description */
 	int copydct = 0;		/* For jpeg->jpeg with no changes, copy DCT cooeficients */
+	int nthreads = 1;		/* Number of threads to use for fast conversion */
+	char *cachedir = NULL;	/* Fast conversion table cache directory */
+	int tilew = 0, tileh = 0;	/* Output tile size, 0 if striped */
+	int bigtiff = 0;		/* Output BigTIFF */
+	tiffband rtb, wtb;		/* TIFF line access */
 	int i, j, rv = 0;
 
 	/* TIFF file info */
@@ -1017,6 +1415,7 @@ main(int argc, char *argv[]) {
 	char *wdesc = NULL;							/* Written desciption */
 
 	tdata_t *inbuf = NULL, *outbuf = NULL, *hprecbuf = NULL;
+	pcentry *pcache = NULL;		/* Floating point conversion pixel cache */
 	int inbpix, outbpix;				/* Number of pixels in jpeg in/out buf */
 
 	/* JPEG file info */
@@ -1024,7 +1423,7 @@ main(int argc, char *argv[]) {
 	FILE *rf = NULL, *wf = NULL;
 	struct jpeg_decompress_struct rj;
 	struct jpeg_compress_struct wj;
-	struct jpeg_error_mgr jerr;
+	struct jpeg_error_mgr jerr, wjerr;	/* Separate, so can read and write on different threads */
 
 	/* IMDI */
 	imdi *s = NULL;
@@ -1032,6 +1431,7 @@ main(int argc, char *argv[]) {
 	unsigned char *inp[MAX_CHAN];
 	unsigned char *outp[MAX_CHAN];
 	int clutres = 0;		/* Default */
+	char *cname = NULL;		/* Table cache file name */
 
 	/* Error check */
 	int mxerr = 0;
@@ -1041,6 +1441,7 @@ main(int argc, char *argv[]) {
 	error_program = "cctiff";
 	if (argc < 2)
 		usage("Too few arguments");
+	a1tm_start("cctiff");
 
 	/* Set defaults */
 	memset((void *)&su, 0, sizeof(sucntx));
@@ -1052,6 +1453,8 @@ main(int argc, char *argv[]) {
 	/* JPEG */
 	jpeg_std_error(&jerr);
 	jerr.error_exit = jpeg_error;
+	jpeg_std_error(&wjerr);
+	wjerr.error_exit = jpeg_error;
 
 	/* Process the arguments */
 	for(fa = 1;fa < argc;fa++) {
@@ -1218,6 +1621,40 @@ main(int argc, char *argv[]) {
 			else if (argv[fa][1] == 'N')
 				su.compr = 0;
 
+			else if (argv[fa][1] == 'Z')
+				su.compr = 2;
+
+			/* Tiled output */
+			else if (argv[fa][1] == 'T') {
+				tilew = tileh = DEFTILE;
+				if (na != NULL && na[0] >= '0' && na[0] <= '9') {
+					fa = nfa;
+					if (sscanf(na, " %d x %d ", &tilew, &tileh) != 2)
+						usage("Expect WxH argument to -T flag");
+					if (tilew < 16 || tileh < 16 || (tilew % 16) != 0 || (tileh % 16) != 0)
+						usage("-T tile width and height must be multiples of 16");
+				}
+			}
+
+			else if (argv[fa][1] == 'B')
+				bigtiff = 1;
+
+			/* Number of threads */
+			else if (argv[fa][1] == 'j') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -j flag");
+				nthreads = atoi(na);
+				if (nthreads < 1 || nthreads > MAXTHREADS)
+					usage("-j argument must be 1..%d",MAXTHREADS);
+			}
+
+			/* Table cache directory */
+			else if (argv[fa][1] == 'm') {
+				fa = nfa;
+				if (na == NULL) usage("Expect directory argument to -m flag");
+				cachedir = na;
+			}
+
 
 			/* Verbosity */
 			else if (argv[fa][1] == 'v' || argv[fa][1] == 'V') {
@@ -1640,8 +2077,12 @@ main(int argc, char *argv[]) {
 	/* - - - - - - - - - - - - - - - */
 	/* Create a TIFF file */
 	if (dojpg == 0) {
+		/* Use BigTIFF if the uncompressed raster may not fit in a TIFF */
+		if (((double)width * height * su.od * bitspersample/8.0) > 4.0e9)
+			bigtiff = 1;
+
 		/* Open up the output TIFF file for writing */
-		if ((wh = TIFFOpen(out_name, "w")) == NULL)
+		if ((wh = TIFFOpen(out_name, bigtiff ? "w8" : "w")) == NULL)
 			error("Can\'t create TIFF file '%s'!",out_name);
 		
 		wsamplesperpixel = su.od;
@@ -1660,8 +2101,19 @@ main(int argc, char *argv[]) {
 		TIFFSetField(wh, TIFFTAG_SAMPLESPERPIXEL, wsamplesperpixel);
 		TIFFSetField(wh, TIFFTAG_BITSPERSAMPLE, bitspersample);
 		TIFFSetField(wh, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+		if (tilew > 0) {
+			TIFFSetField(wh, TIFFTAG_TILEWIDTH, tilew);
+			TIFFSetField(wh, TIFFTAG_TILELENGTH, tileh);
+		} else if (su.compr == 2) {		/* Larger strips compress better */
+			int rps = ZSTRIPSZ / (width * su.od * bitspersample/8);
+			TIFFSetField(wh, TIFFTAG_ROWSPERSTRIP, rps < 1 ? 1 : rps);
+		} else {
+			TIFFSetField(wh, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(wh, 0));
+		}
 
-		if (su.compr)
+		if (su.compr == 2)
+			TIFFSetField(wh, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
+		else if (su.compr)
 			TIFFSetField(wh, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
 		else
 			TIFFSetField(wh, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
@@ -1783,7 +2235,7 @@ main(int argc, char *argv[]) {
 			error("Can\'t create JPEG file '%s'! [%s]",out_name, jpeg_werr.message);
 		}
 
-		wj.err = &jerr;
+		wj.err = &wjerr;
 		wj.client_data = &jpeg_werr;
 		jpeg_create_compress(&wj);
 
@@ -1999,7 +2451,82 @@ main(int argc, char *argv[]) {
 		if (su.verb)
 			printf("Using CLUT resolution %d\n",clutres);
 	
-		s = new_imdi(
+		/* Create a cache file name that is unique to everything that */
+		/* determines the table contents. new_imdi_cache() checks the rest. */
+		if (cachedir != NULL) {
+			icmMD5 *md5;
+			ORD8 chsum[16];
+			FILE *fp;
+			int iv[12];
+
+			if ((md5 = new_icmMD5()) == NULL)
+				error("new_icmMD5 failed");
+
+			/* All the options and profile names, except the ones */
+			/* that don't affect the conversion, and the image file names. */
+			for (i = 1; i < (argc-2); i++) {
+				if (argv[i][0] == '-'
+				 && (argv[i][1] == 'j' || argv[i][1] == 'm')) {
+					if (argv[i][2] == '\000' && (i+1) < (argc-2) && argv[i+1][0] != '-')
+						i++;
+					continue;
+				}
+				if (argv[i][0] == '-' && argv[i][1] == 'T') {
+					if (argv[i][2] == '\000' && (i+1) < (argc-2)
+					 && argv[i+1][0] >= '0' && argv[i+1][0] <= '9')
+						i++;
+					continue;
+				}
+				if (argv[i][0] == '-' && (argv[i][1] == 'v' || argv[i][1] == 'V'
+				                       || argv[i][1] == 'B'))
+					continue;
+				md5->add(md5, (ORD8 *)argv[i], strlen(argv[i]) + 1);
+			}
+
+			/* The profile and calibration file contents */
+			for (i = 0; i < su.nprofs; i++) {
+				ORD8 buf[8192];
+				size_t n;
+				if ((fp = fopen(su.profs[i].name, "rb")) == NULL)
+					error("Can't open file '%s'",su.profs[i].name);
+				while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+					md5->add(md5, buf, (unsigned int)n);
+				fclose(fp);
+			}
+
+			/* The image encodings */
+			memset((void *)iv, 0, sizeof(iv));
+			iv[0] = su.ins;
+			iv[1] = su.outs;
+			iv[2] = su.id;
+			iv[3] = su.od;
+			iv[4] = su.isign_mask;
+			iv[5] = su.osign_mask;
+			iv[6] = su.iinv;
+			iv[7] = su.oinv;
+			iv[8] = bitspersample;
+			iv[9] = rh != NULL ? rphotometric : -1;
+			iv[10] = wh != NULL ? wphotometric : -1;
+			iv[11] = clutres;
+			md5->add(md5, (ORD8 *)iv, sizeof(iv));
+
+			md5->get(md5, chsum);
+			md5->del(md5);
+
+			if ((cname = malloc(strlen(cachedir) + 50)) == NULL)
+				error("malloc of cache file name failed");
+			sprintf(cname, "%s/cctiff_", cachedir);
+			for (i = 0; i < 16; i++)
+				sprintf(cname + strlen(cname), "%02x", chsum[i]);
+			strcat(cname, ".imdi");
+
+			if (su.verb)
+				printf("Using table cache file '%s'\n",cname);
+		}
+
+		a1tm_start("table setup");
+		s = new_imdi_cache(
+			cname,			/* Table cache file, NULL if none */
 			su.id,			/* Number of input dimensions */
 			su.od,			/* Number of output dimensions */
 							/* Input pixel representation */
@@ -2020,6 +2547,7 @@ main(int argc, char *argv[]) {
 			output_curves,
 			(void *)&su		/* Context to callbacks */
 		);
+		a1tm_end();
 		
 		if (s == NULL) {
 	#ifdef NEVER
@@ -2035,6 +2563,39 @@ main(int argc, char *argv[]) {
 		}
 	}
 
+	/* Report how the sequence maps onto the per pixel passes. */
+	/* All the stages are folded into the input curves, multi-d table */
+	/* and output curves of the one conversion, so each image line */
+	/* is converted in a single pass, whatever the sequence. */
+	if (su.verb) {
+		int nin, nclut, nout;		/* Stages in input curves, table, output curves */
+
+		nin = su.fclut - su.first;
+		nclut = su.lclut - su.fclut + 1;
+		nout = su.last - su.lclut;
+		if (su.icombine) {
+			nclut += nin;
+			nin = 0;
+		}
+		if (su.ocombine) {
+			nclut += nout;
+			nout = 0;
+		}
+
+		if (su.nprofs == 0) {
+			printf("No conversion stages, 1 copy pass per line\n");
+		} else {
+			printf("%d conversion stages (%d in input curves, %d in table, %d in output curves)\n",
+			       su.nprofs, nin, nclut, nout);
+			if (doimdi && dofloat)
+				printf("fused into 1 integer pass per line, plus 1 floating point check pass\n");
+			else if (doimdi)
+				printf("fused into 1 integer pass per line\n");
+			else
+				printf("fused into 1 floating point pass per line\n");
+		}
+	}
+
 	if (rh != NULL) 
 		inbuf  = _TIFFmalloc(TIFFScanlineSize(rh));
 	else {
@@ -2061,6 +2622,10 @@ main(int argc, char *argv[]) {
 			if ((hprecbuf = (tdata_t *)malloc(outbpix)) == NULL)
 				error("Malloc failed on high precision line buffer");
 		}
+		if (su.nprofs > 0) {
+			if ((pcache = (pcentry *)calloc(PCACHESIZE, sizeof(pcentry))) == NULL)
+				error("Malloc failed on pixel cache");
+		}
 	}
 
 	if (rh == NULL) {
@@ -2179,140 +2744,307 @@ main(int argc, char *argv[]) {
 
 		/* We're not doing a lossless copy */
 
+		/* Setup the TIFF tile/strip line access */
+		if (rh != NULL)
+			tb_init(&rtb, rh, 0, width, height, 0);
+		if (wh != NULL) {
+			tb_init(&wtb, wh, 1, width, height, nthreads + 1);
+			if (su.verb) {
+				if (wtb.tiled)
+					printf("Writing %s %d x %d tiled TIFF\n",bigtiff ? "BigTIFF" : "classic", wtb.tw, wtb.bh);
+				else
+					printf("Writing %s TIFF with %d lines per strip\n",bigtiff ? "BigTIFF" : "classic", wtb.bh);
+			}
+		}
 
 		/* - - - - - - - - - - - - - - - */
 		/* Process colors to translate */
 		/* (Should fix this to process a group of lines at a time ?) */
 
-		for (y = 0; y < height; y++) {
-			tdata_t *obuf;
+		a1tm_start("conversion");
+
+		if (nthreads > 1 && doimdi && su.nprofs > 0 && !dofloat) {
+			/* Multi-threaded fast conversion, a batch of lines at a time. */
+			/* Two sets of line buffers are used, so that the next batch can */
+			/* be read and the previous batch written while a batch is converted. */
+			int nbl = nthreads * THRLINES;		/* Lines per batch */
+			int inlsz, outlsz;					/* Line buffer sizes */
+			unsigned char **inl[2], **outl[2];	/* Double buffered batch of line buffers */
+			lineio rd, wr;						/* Batch reader and writer */
+			linethr thi[MAXTHREADS];
+			athread *th[MAXTHREADS];
+			int k;
+
+			if (nbl > height)
+				nbl = height;
+
+			inlsz = rh != NULL ? TIFFScanlineSize(rh) : inbpix;
+			outlsz = wh != NULL ? TIFFScanlineSize(wh) : outbpix;
+
+			for (k = 0; k < 2; k++) {
+				if ((inl[k] = (unsigned char **)malloc(nbl * sizeof(unsigned char *))) == NULL
+				 || (outl[k] = (unsigned char **)malloc(nbl * sizeof(unsigned char *))) == NULL)
+					error("Malloc failed on line batch pointers");
+				for (i = 0; i < nbl; i++) {
+					if ((inl[k][i] = (unsigned char *)malloc(inlsz)) == NULL
+					 || (outl[k][i] = (unsigned char *)malloc(outlsz)) == NULL)
+						error("Malloc failed on line batch buffers");
+				}
+			}
 
-			/* Read in the next line */
-			if (rh) {
-				if (TIFFReadScanline(rh, inbuf, y, 0) < 0)
-					error ("Failed to read TIFF line %d",y);
-			} else {
-				jpeg_read_scanlines(&rj, (JSAMPARRAY)&inbuf, 1);
-				if (su.iinv) {
-					unsigned char *cp, *ep = (unsigned char *)inbuf + inbpix;
-					for (cp = (unsigned char *)inbuf; cp < ep; cp++)
-						*cp = ~*cp;
+			memset((void *)&rd, 0, sizeof(lineio));
+			if (rh != NULL)
+				rd.tb = &rtb;
+			rd.rj = &rj;
+			rd.jerr = &jpeg_rerr;
+			rd.inv = su.iinv;
+			rd.bpl = inbpix;
+
+			memset((void *)&wr, 0, sizeof(lineio));
+			if (wh != NULL)
+				wr.tb = &wtb;
+			wr.wj = &wj;
+			wr.jerr = &jpeg_werr;
+			wr.inv = su.oinv;
+			wr.bpl = outbpix;
+
+			if (su.verb)
+				printf("Using %d threads for conversion\n",nthreads);
+
+			/* Start reading the first batch */
+			lineio_start(&rd, 0, inl[0], 0, nbl);
+
+			for (k = 0, y = 0; y < height; y += nbl, k ^= 1) {
+				int nl = height - y;		/* Lines in this batch */
+
+				if (nl > nbl)
+					nl = nbl;
+
+				/* Wait for this batch to be read, and start reading the next */
+				lineio_wait(&rd);
+				if ((y + nbl) < height) {
+					int nnl = height - y - nbl;
+					if (nnl > nbl)
+						nnl = nbl;
+					lineio_start(&rd, 0, inl[k ^ 1], y + nbl, nnl);
+				}
+
+				/* Convert them in parallel */
+				for (i = 0; i < nthreads; i++) {
+					thi[i].s = s;
+					thi[i].ix = i;
+					thi[i].nth = nthreads;
+					thi[i].nlines = nl;
+					thi[i].inl = inl[k];
+					thi[i].outl = outl[k];
+					thi[i].inst = su.id;
+					thi[i].width = width;
+					if ((th[i] = new_athread(linethr_main, (void *)&thi[i])) == NULL)
+						error("Failed to create conversion thread");
+				}
+				for (i = 0; i < nthreads; i++) {
+					th[i]->wait(th[i]);
+					th[i]->del(th[i]);
 				}
+
+				/* Wait for the previous batch to be written, and start writing */
+				/* this one. Lines are written in order by the one writer. */
+				lineio_wait(&wr);
+				lineio_start(&wr, 1, outl[k], y, nl);
 			}
+			lineio_wait(&wr);
 
-			if (doimdi && su.nprofs > 0) {
-				/* Do fast conversion */
-				s->interp(s, (void **)outp, 0, (void **)inp, su.id, width);
+			for (k = 0; k < 2; k++) {
+				for (i = 0; i < nbl; i++) {
+					free(inl[k][i]);
+					free(outl[k][i]);
+				}
+				free(inl[k]);
+				free(outl[k]);
 			}
+
+		} else {
+			for (y = 0; y < height; y++) {
+				tdata_t *obuf;
+
+				/* Read in the next line */
+				if (rh) {
+					if (tb_read_line(&rtb, inbuf, y) < 0)
+						error ("Failed to read TIFF line %d",y);
+				} else {
+					jpeg_read_scanlines(&rj, (JSAMPARRAY)&inbuf, 1);
+					if (su.iinv) {
+						unsigned char *cp, *ep = (unsigned char *)inbuf + inbpix;
+						for (cp = (unsigned char *)inbuf; cp < ep; cp++)
+							*cp = ~*cp;
+					}
+				}
+
+				if (doimdi && su.nprofs > 0) {
+					/* Do fast conversion */
+					s->interp(s, (void **)outp, 0, (void **)inp, su.id, width);
+				}
 			
-			if (dofloat || su.nprofs == 0) {
-				/* Do floating point conversion into the hprecbuf[] */
-				for (x = 0; x < width; x++) {
-					int i;
-					double in[MAX_CHAN], out[MAX_CHAN];
+				if (dofloat || su.nprofs == 0) {
+					/* Do floating point conversion into the hprecbuf[] */
+					for (x = 0; x < width; x++) {
+						int i;
+						double in[MAX_CHAN], out[MAX_CHAN];
+						unsigned short iv[MAX_CHAN];	/* Raw input pixel value */
+						pcentry *pc = NULL;
 					
-//printf("\n");
-					if (bitspersample == 8) {
-						for (i = 0; i < su.id; i++) {
-							int v = ((unsigned char *)inbuf)[x * su.id + i];
-//printf("~1 8 bit pixel value chan %d = %d\n",i,v);
-							if (su.isign_mask & (1 << i))		/* Treat input as signed */
-								v = (v & 0x80) ? v - 0x80 : v + 0x80;
-//printf("~1 8 bit after treat as signed chan %d = %d\n",i,v);
-							in[i] = v/255.0;
-//printf("~1 8 bit fp chan %d value = %f\n",i,in[i]);
+	//printf("\n");
+						if (bitspersample == 8) {
+							for (i = 0; i < su.id; i++)
+								iv[i] = ((unsigned char *)inbuf)[x * su.id + i];
+						} else {
+							for (i = 0; i < su.id; i++)
+								iv[i] = ((unsigned short *)inbuf)[x * su.id + i];
 						}
-					} else {
-						for (i = 0; i < su.id; i++) {
-							int v = ((unsigned short *)inbuf)[x * su.id + i];
-//printf("~1 16 bit pixel value chan %d = %d\n",i,v);
-							if (su.isign_mask & (1 << i))		/* Treat input as signed */
-								v = (v & 0x8000) ? v - 0x8000 : v + 0x8000;
-//printf("~1 16 bit after treat as signed chan %d = %d\n",i,v);
-							in[i] = v/65535.0;
-//printf("~1 16 bit fp chan %d value = %f\n",i,in[i]);
+
+						/* See if we've already converted this pixel value */
+						if (pcache != NULL) {
+							unsigned int hash = 0;
+
+							for (i = 0; i < su.id; i++)
+								hash = hash * 65599 + iv[i];
+							pc = &pcache[hash % PCACHESIZE];
+
+							if (pc->valid) {
+								for (i = 0; i < su.id; i++) {
+									if (pc->in[i] != iv[i])
+										break;
+								}
+								if (i >= su.id) {		/* Hit */
+									if (bitspersample == 8) {
+										for (i = 0; i < su.od; i++)
+											((unsigned char *)hprecbuf)[x * su.od + i] = (unsigned char)pc->out[i];
+									} else {
+										for (i = 0; i < su.od; i++)
+											((unsigned short *)hprecbuf)[x * su.od + i] = pc->out[i];
+									}
+									continue;
+								}
+							}
 						}
-					}
 
-					if (su.nprofs > 0) {
-						/* Apply the reference conversion */
-						input_curves((void *)&su, out, in);
-//for (i = 0; i < su.id; i++) printf("~1 after input curve chan %d = %f\n",i,out[i]);
-						md_table((void *)&su, out, out);
-//for (i = 0; i < su.od; i++) printf("~1 after md table chan %d = %f\n",i,out[i]);
-						output_curves((void *)&su, out, out);
-//for (i = 0; i < su.od; i++) printf("~1 after output curve chan %d = %f\n",i,out[i]);
-					} else {
-						for (i = 0; i < su.od; i++)
-							 out[i] = in[i];
-					}
+						if (bitspersample == 8) {
+							for (i = 0; i < su.id; i++) {
+								int v = iv[i];
+	//printf("~1 8 bit pixel value chan %d = %d\n",i,v);
+								if (su.isign_mask & (1 << i))		/* Treat input as signed */
+									v = (v & 0x80) ? v - 0x80 : v + 0x80;
+	//printf("~1 8 bit after treat as signed chan %d = %d\n",i,v);
+								in[i] = v/255.0;
+	//printf("~1 8 bit fp chan %d value = %f\n",i,in[i]);
+							}
+						} else {
+							for (i = 0; i < su.id; i++) {
+								int v = iv[i];
+	//printf("~1 16 bit pixel value chan %d = %d\n",i,v);
+								if (su.isign_mask & (1 << i))		/* Treat input as signed */
+									v = (v & 0x8000) ? v - 0x8000 : v + 0x8000;
+	//printf("~1 16 bit after treat as signed chan %d = %d\n",i,v);
+								in[i] = v/65535.0;
+	//printf("~1 16 bit fp chan %d value = %f\n",i,in[i]);
+							}
+						}
 
-					if (bitspersample == 8) {
-						for (i = 0; i < su.od; i++) {
-							int v = (int)(out[i] * 255.0 + 0.5);
-//printf("~1 8 bit chan %d = %d\n",i,v);
-							if (v < 0)
-								v = 0;
-							else if (v > 255)
-								v = 255;
-//printf("~1 8 bit after clip curve chan %d = %d\n",i,v);
-							if (su.osign_mask & (1 << i))		/* Treat input as offset */
-								v = (v & 0x80) ? v - 0x80 : v + 0x80;
-//printf("~1 8 bit after treat as offset chan %d = %d\n",i,v);
-							((unsigned char *)hprecbuf)[x * su.od + i] = v;
+						if (su.nprofs > 0) {
+							/* Apply the reference conversion */
+							input_curves((void *)&su, out, in);
+	//for (i = 0; i < su.id; i++) printf("~1 after input curve chan %d = %f\n",i,out[i]);
+							md_table((void *)&su, out, out);
+	//for (i = 0; i < su.od; i++) printf("~1 after md table chan %d = %f\n",i,out[i]);
+							output_curves((void *)&su, out, out);
+	//for (i = 0; i < su.od; i++) printf("~1 after output curve chan %d = %f\n",i,out[i]);
+						} else {
+							for (i = 0; i < su.od; i++)
+								 out[i] = in[i];
 						}
-					} else {
-						for (i = 0; i < su.od; i++) {
-							int v = (int)(out[i] * 65535.0 + 0.5);
-//printf("~1 16 bit chan %d = %d\n",i,v);
-							if (v < 0)
-								v = 0;
-							else if (v > 65535)
-								v = 65535;
-//printf("~1 16 bit after clip curve chan %d = %d\n",i,v);
-							if (su.osign_mask & (1 << i))		/* Treat input as offset */
-								v = (v & 0x8000) ? v - 0x8000 : v + 0x8000;
-//printf("~1 16 bit after treat as offset chan %d = %d\n",i,v);
-							((unsigned short *)hprecbuf)[x * su.od + i] = v;
+
+						if (bitspersample == 8) {
+							for (i = 0; i < su.od; i++) {
+								int v = (int)(out[i] * 255.0 + 0.5);
+	//printf("~1 8 bit chan %d = %d\n",i,v);
+								if (v < 0)
+									v = 0;
+								else if (v > 255)
+									v = 255;
+	//printf("~1 8 bit after clip curve chan %d = %d\n",i,v);
+								if (su.osign_mask & (1 << i))		/* Treat input as offset */
+									v = (v & 0x80) ? v - 0x80 : v + 0x80;
+	//printf("~1 8 bit after treat as offset chan %d = %d\n",i,v);
+								((unsigned char *)hprecbuf)[x * su.od + i] = v;
+							}
+						} else {
+							for (i = 0; i < su.od; i++) {
+								int v = (int)(out[i] * 65535.0 + 0.5);
+	//printf("~1 16 bit chan %d = %d\n",i,v);
+								if (v < 0)
+									v = 0;
+								else if (v > 65535)
+									v = 65535;
+	//printf("~1 16 bit after clip curve chan %d = %d\n",i,v);
+								if (su.osign_mask & (1 << i))		/* Treat input as offset */
+									v = (v & 0x8000) ? v - 0x8000 : v + 0x8000;
+	//printf("~1 16 bit after treat as offset chan %d = %d\n",i,v);
+								((unsigned short *)hprecbuf)[x * su.od + i] = v;
+							}
+						}
+
+						/* Remember the result */
+						if (pc != NULL) {
+							for (i = 0; i < su.id; i++)
+								pc->in[i] = iv[i];
+							if (bitspersample == 8) {
+								for (i = 0; i < su.od; i++)
+									pc->out[i] = ((unsigned char *)hprecbuf)[x * su.od + i];
+							} else {
+								for (i = 0; i < su.od; i++)
+									pc->out[i] = ((unsigned short *)hprecbuf)[x * su.od + i];
+							}
+							pc->valid = 1;
 						}
 					}
-				}
 
-				if (check) {
-					/* Compute the errors */
-					for (x = 0; x < (width * su.od); x++) {
-						int err;
-						if (bitspersample == 8)
-							err = ((unsigned char *)outbuf)[x] - ((unsigned char *)hprecbuf)[x];
-						else
-							err = ((unsigned short *)outbuf)[x] - ((unsigned short *)hprecbuf)[x];
-						if (err < 0)
-							err = -err;
-						if (err > mxerr)
-							mxerr = err;
-						avgerr += (double)err;
-						avgcount++;
+					if (check) {
+						/* Compute the errors */
+						for (x = 0; x < (width * su.od); x++) {
+							int err;
+							if (bitspersample == 8)
+								err = ((unsigned char *)outbuf)[x] - ((unsigned char *)hprecbuf)[x];
+							else
+								err = ((unsigned short *)outbuf)[x] - ((unsigned short *)hprecbuf)[x];
+							if (err < 0)
+								err = -err;
+							if (err > mxerr)
+								mxerr = err;
+							avgerr += (double)err;
+							avgcount++;
+						}
 					}
 				}
-			}
 				
-			if (dofloat || su.nprofs == 0) 	/* Use the results of the f.p. conversion */
-				obuf = hprecbuf;
-			else
-				obuf = outbuf;
-
-			if (wh != NULL) {
-				if (TIFFWriteScanline(wh, obuf, y, 0) < 0)
-					error ("Failed to write TIFF line %d",y);
-			} else {	
-				if (su.oinv) {
-					unsigned char *cp, *ep = (unsigned char *)obuf + outbpix;
-					for (cp = (unsigned char *)obuf; cp < ep; cp++)
-						*cp = ~(*cp);
+				if (dofloat || su.nprofs == 0) 	/* Use the results of the f.p. conversion */
+					obuf = hprecbuf;
+				else
+					obuf = outbuf;
+
+				if (wh != NULL) {
+					if (tb_write_line(&wtb, obuf, y) < 0)
+						error ("Failed to write TIFF line %d",y);
+				} else {	
+					if (su.oinv) {
+						unsigned char *cp, *ep = (unsigned char *)obuf + outbpix;
+						for (cp = (unsigned char *)obuf; cp < ep; cp++)
+							*cp = ~(*cp);
+					}
+					jpeg_write_scanlines(&wj, (JSAMPARRAY)&obuf, 1);
 				}
-				jpeg_write_scanlines(&wj, (JSAMPARRAY)&obuf, 1);
 			}
 		}
+		a1tm_end();
 
 		if (check) {
 			printf("Worst error = %d bits, average error = %f bits\n", mxerr, avgerr/avgcount);
@@ -2324,6 +3056,10 @@ main(int argc, char *argv[]) {
 				       mxerr/655.35, avgerr/(655.35 * avgcount));
 		}
 
+		if (rh != NULL)
+			tb_done(&rtb);
+		if (wh != NULL)
+			tb_done(&wtb);
 	}
 
 	if (wh != NULL) {
@@ -2342,6 +3078,8 @@ main(int argc, char *argv[]) {
 		if (fclose(wf))
 			error("Error closing output file '%s'\n",out_name);
 	}
+	if (pcache != NULL)
+		free(pcache);
 
 	/* Release buffers and close files */
 	if (rh != NULL) {
@@ -2360,6 +3098,8 @@ main(int argc, char *argv[]) {
 	/* Done with lookup object */
 	if (s != NULL)
 		s->del(s);
+	if (cname != NULL)
+		free(cname);
 
 	/* Free up all the profiles etc. in the sequence. */
 	for (i = 0; i < su.nprofs; i++) {
@@ -2376,6 +3116,9 @@ main(int argc, char *argv[]) {
 	if (wdesc != NULL)
 		free(wdesc);
 
+	a1tm_end();
+	a1tm_report(g_log);
+
 	return 0;
 }
 
@@ -33,6 +33,7 @@
 #define INSTHRESH 4		/* Use inserion sort of di >= INSTHRESH for best performance. */
 #undef ROUND			/* Round the division after accumulation */
 						/* Improves accuracy at the cost of a little speed */
+						/* (16 bit precision kernels are always rounded) */
 
 /* ------------------------------------ */
 /* Generator context */
@@ -149,6 +150,18 @@ char *hmask(int bits) {
 	return buf;
 }
 
+/* return a hexadecimal string of the given bit, */
+/* taking care of the case when bit >= 32 */
+char *hbit(int bit) {
+	static char buf[20];
+
+	if (bit < 32)
+		sprintf(buf, "0x%x",1 << bit);
+	else
+		sprintf(buf, "0x%x00000000",1 << (bit-32));
+	return buf;
+}
+
 /* Generate a source file to implement the specified */
 /* interpolation kernel. Fill in return values and return 0 if OK. */
 /* g->opt should be set to opts_splx_sort or opts_sort_splx if both */
@@ -206,6 +219,15 @@ int gen_c_kernel(
 		exit(-1);
 	}
 
+	/* Round the interpolated value to the nearest integer, rather than */
+	/* truncating it. The accumulators have room for the rounding carry, */
+	/* since the table values are less than 1 << prec. */
+#ifdef ROUND
+	t->im_rd = 1;
+#else
+	t->im_rd = g->prec == 16;
+#endif
+
 	/* Compute input read and input table lookup stuff */
 
 	/* Compute number of input pointers */
@@ -1499,26 +1521,24 @@ int gen_c_kernel(
 	
 				if (a->shfm || size > 32) {
 					/* Extract using just shifts */
-#ifdef ROUND
-					line(f,"oti = (((ova%d + (1 << %d)) << %d) >> %d);	"
-					     "/* Extract integer part of result */",
-					     i, off-1, a->ords[oat].bits - off - size, a->ords[oat].bits - size);
-#else
-					line(f,"oti = ((ova%d << %d) >> %d);	"
-					     "/* Extract integer part of result */",
-					     i, a->ords[oat].bits - off - size, a->ords[oat].bits - size);
-#endif
+					if (t->im_rd)
+						line(f,"oti = (((ova%d + %s) << %d) >> %d);	"
+						     "/* Extract rounded integer part of result */",
+						     i, hbit(off-1), a->ords[oat].bits - off - size, a->ords[oat].bits - size);
+					else
+						line(f,"oti = ((ova%d << %d) >> %d);	"
+						     "/* Extract integer part of result */",
+						     i, a->ords[oat].bits - off - size, a->ords[oat].bits - size);
 				} else {
 					/* Extract using shift and mask */
-#ifdef ROUND
-					line(f,"oti = (((ova%d + 0x%x) >> %d) & %s);	"
-					     "/* Extract integer part of result */",
-					     i, (1 << off-1), off, hmask(size));
-#else
-					line(f,"oti = ((ova%d >> %d) & %s);	"
-					     "/* Extract integer part of result */",
-					     i, off, hmask(size));
-#endif
+					if (t->im_rd)
+						line(f,"oti = (((ova%d + %s) >> %d) & %s);	"
+						     "/* Extract rounded integer part of result */",
+						     i, hbit(off-1), off, hmask(size));
+					else
+						line(f,"oti = ((ova%d >> %d) & %s);	"
+						     "/* Extract integer part of result */",
+						     i, off, hmask(size));
 				}
 	
 				if (g->oopt & OOPT(oopts_check,e)) {	/* Lookup with check */
@@ -1728,6 +1748,7 @@ int gen_c_kernel(
 		TSET_ENTRY(vo_eo);
 		TSET_ENTRY(vo_om);
 		TSET_ENTRY(im_cd);
+		TSET_ENTRY(im_rd);
 		TSET_ENTRY(im_ts);
 		TSET_ENTRY(im_oc);
 		TSET_ENTRY(im_fs);
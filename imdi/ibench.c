@@ -0,0 +1,341 @@
+
+/* Integer Multi-Dimensional Interpolation */
+
+/*
+ * Copyright 2020 Graeme W. Gill
+ * All rights reserved.
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * Benchmark for the imdi kernels.
+ *
+ * Sweeps combinations of input and output channels, pixel precisions
+ * and grid resolutions, and reports the throughput of each
+ * as comma separated values, one line per combination, suitable for
+ * reading into a spreadsheet or comparing between runs.
+ *
+ * Each combination is timed with two sets of input values.
+ * "smooth" is a slowly varying ramp, so that successive pixels
+ * mostly hit the same few cells of the interpolation table, while
+ * "random" is uniformly random, so that every pixel is likely to miss
+ * in the cache once the tables are larger than it. The ratio
+ * of the two is a proxy for how sensitive the kernel is to cache misses.
+ *
+ * (See itest for checking the accuracy of the kernels.)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include "copyright.h"
+#include "aconfig.h"
+#include "numlib.h"
+#include "imdi.h"
+
+#define MAXLIST 20
+#define DEF_NPIX 500000		/* Default number of pixels per pass */
+#define DEF_MSEC 200		/* Default minimum time per measurement */
+
+void usage(char *diag, ...) {
+	fprintf(stderr,"Benchmark imdi kernels, Version %s\n",ARGYLL_VERSION_STR);
+	if (diag != NULL) {
+		va_list args;
+		fprintf(stderr,"  Diagnostic: ");
+		va_start(args, diag);
+		vfprintf(stderr, diag, args);
+		va_end(args);
+		fprintf(stderr,"\n");
+	}
+	fprintf(stderr,"usage: ibench [options]\n");
+	fprintf(stderr," -i n,n,...      Input channel counts (default 1,3,4,6,8)\n");
+	fprintf(stderr," -o n,n,...      Output channel counts (default 1,3,4,6,8)\n");
+	fprintf(stderr," -p i:o,i:o,...  Input:output bits per channel (default 8:8,8:16,16:16)\n");
+	fprintf(stderr," -r n,n,...      Grid resolutions (default is one typical for each input count)\n");
+	fprintf(stderr," -n npix         Pixels per pass (default %d)\n",DEF_NPIX);
+	fprintf(stderr," -t msec         Minimum time per measurement (default %d)\n",DEF_MSEC);
+	exit(1);
+}
+
+/* Parse a comma separated list of integers. Return the number found. */
+static int parse_list(int *list, char *s, char *flag) {
+	int n = 0;
+	char *cp;
+
+	for (cp = s; *cp != '\000';) {
+		if (n >= MAXLIST)
+			usage("Too many values for %s",flag);
+		if (sscanf(cp, "%d", &list[n]) != 1)
+			usage("Can't parse argument to %s",flag);
+		n++;
+		if ((cp = strchr(cp, ',')) == NULL)
+			break;
+		cp++;
+	}
+	return n;
+}
+
+/* Callback context */
+typedef struct {
+	int id, od;
+} bcntx;
+
+static void input_curves(void *cntx, double *out_vals, double *in_vals) {
+	bcntx *x = (bcntx *)cntx;
+	int e;
+
+	for (e = 0; e < x->id; e++)
+		out_vals[e] = pow(in_vals[e], 1.2);
+}
+
+static void md_table(void *cntx, double *out_vals, double *in_vals) {
+	bcntx *x = (bcntx *)cntx;
+	int e;
+
+	for (e = 0; e < x->od; e++) {
+		int a = e % x->id, b = (e + 1) % x->id;
+		out_vals[e] = 0.4 * in_vals[a] + 0.6 * in_vals[a] * in_vals[b];
+	}
+}
+
+static void output_curves(void *cntx, double *out_vals, double *in_vals) {
+	bcntx *x = (bcntx *)cntx;
+	int e;
+
+	for (e = 0; e < x->od; e++)
+		out_vals[e] = sqrt(in_vals[e]);
+}
+
+/* Return a typical grid resolution for the given input dimension */
+static int def_res(int id) {
+	switch (id) {
+		case 1:
+			return 256;
+		case 2:
+			return 65;
+		case 3:
+			return 33;
+		case 4:
+			return 18;
+		case 5:
+			return 16;
+		case 6:
+			return 12;
+		case 7:
+			return 8;
+		case 8:
+			return 7;
+		case 9:
+			return 6;
+		default:
+			return 5;
+	}
+}
+
+/* Time the conversion, and return Mpix/sec */
+static double do_time(imdi *s, void *ibuf, void *obuf, int npix, int mintime) {
+	void *inp[1], *outp[1];
+	unsigned int stime, ttime;
+	int iters = 0;
+
+	inp[0] = ibuf;
+	outp[0] = obuf;
+
+	s->interp(s, outp, 0, inp, 0, npix);		/* Warm up */
+
+	stime = msec_time();
+	do {
+		s->interp(s, outp, 0, inp, 0, npix);
+		iters++;
+		ttime = msec_time() - stime;
+	} while (ttime < mintime);
+
+	if (ttime == 0)
+		ttime = 1;
+	return 1e-3 * (double)iters * (double)npix / (double)ttime;
+}
+
+int
+main(int argc, char *argv[]) {
+	int fa, nfa;				/* argument we're up to */
+	int ids[MAXLIST] = { 1, 3, 4, 6, 8 }, nids = 5;
+	int ods[MAXLIST] = { 1, 3, 4, 6, 8 }, nods = 5;
+	int iprs[MAXLIST] = { 8, 8,  16 };
+	int oprs[MAXLIST] = { 8, 16, 16 }, nprs = 3;
+	int ress[MAXLIST], nress = 0;
+	int npix = DEF_NPIX;
+	int mintime = DEF_MSEC;
+	int iix, oix, pix, rix;
+	unsigned char *ibuf, *obuf;
+	bcntx x;
+
+	error_program = "ibench";
+
+	/* Process the arguments */
+	for (fa = 1; fa < argc; fa++) {
+		nfa = fa;					/* skip to nfa if next argument is used */
+		if (argv[fa][0] == '-') {	/* Look for any flags */
+			char *na = NULL;		/* next argument after flag, null if none */
+
+			if (argv[fa][2] != '\000')
+				na = &argv[fa][2];		/* next is directly after flag */
+			else {
+				if ((fa+1) < argc) {
+					if (argv[fa+1][0] != '-') {
+						nfa = fa + 1;
+						na = argv[nfa];		/* next is seperate non-flag argument */
+					}
+				}
+			}
+
+			if (argv[fa][1] == '?')
+				usage(NULL);
+
+			else if (argv[fa][1] == 'i') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -i");
+				nids = parse_list(ids, na, "-i");
+			}
+
+			else if (argv[fa][1] == 'o') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -o");
+				nods = parse_list(ods, na, "-o");
+			}
+
+			else if (argv[fa][1] == 'p') {
+				char *cp;
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -p");
+				for (nprs = 0, cp = na; *cp != '\000'; nprs++) {
+					if (nprs >= MAXLIST)
+						usage("Too many values for -p");
+					if (sscanf(cp, "%d:%d", &iprs[nprs], &oprs[nprs]) != 2
+					 || (iprs[nprs] != 8 && iprs[nprs] != 16)
+					 || (oprs[nprs] != 8 && oprs[nprs] != 16))
+						usage("Can't parse argument to -p");
+					if ((cp = strchr(cp, ',')) == NULL) {
+						nprs++;
+						break;
+					}
+					cp++;
+				}
+			}
+
+			else if (argv[fa][1] == 'r') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -r");
+				nress = parse_list(ress, na, "-r");
+			}
+
+			else if (argv[fa][1] == 'n') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -n");
+				npix = atoi(na);
+				if (npix < 1)
+					usage("-n argument must be > 0");
+			}
+
+			else if (argv[fa][1] == 't') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -t");
+				mintime = atoi(na);
+				if (mintime < 1)
+					usage("-t argument must be > 0");
+			}
+
+			else
+				usage("Unknown flag '%c'",argv[fa][1]);
+		} else
+			break;
+	}
+
+	for (iix = 0; iix < nids; iix++) {
+		if (ids[iix] < 1 || ids[iix] > IXDI)
+			error("Input channels must be 1..%d",IXDI);
+	}
+	for (oix = 0; oix < nods; oix++) {
+		if (ods[oix] < 1 || ods[oix] > IXDO)
+			error("Output channels must be 1..%d",IXDO);
+	}
+
+	if ((ibuf = (unsigned char *)malloc(2 * IXDI * npix)) == NULL
+	 || (obuf = (unsigned char *)malloc(2 * IXDO * npix)) == NULL)
+		error("Malloc of pixel buffers failed");
+
+	printf("id,od,ibits,obits,res,gres,sres,tabsize,smooth_mpix,random_mpix,random_ratio\n");
+	fflush(stdout);
+
+	for (iix = 0; iix < nids; iix++) {
+		for (oix = 0; oix < nods; oix++) {
+			for (pix = 0; pix < nprs; pix++) {
+				for (rix = 0; rix < (nress > 0 ? nress : 1); rix++) {
+					int id = ids[iix], od = ods[oix];
+					int ip = iprs[pix], op = oprs[pix];
+					int res = nress > 0 ? ress[rix] : def_res(id);
+					unsigned long size = 0;
+					int gres = 0, sres = 0;
+					double smooth, rnd;
+					imdi *s;
+					int i, e;
+
+					x.id = id;
+					x.od = od;
+
+					s = new_imdi(id, od, ip == 8 ? pixint8 : pixint16, 0, NULL,
+					             prec_min, op == 8 ? pixint8 : pixint16, 0, NULL,
+					             res, oopts_none, NULL, opts_none,
+					             input_curves, md_table, output_curves, (void *)&x);
+
+					if (s == NULL) {
+						printf("%d,%d,%d,%d,%d,,,,,,\n",id,od,ip,op,res);
+						fflush(stdout);
+						continue;
+					}
+					s->info(s, &size, &gres, &sres);
+
+					/* Smooth ramp, each channel at a different rate */
+					for (i = 0; i < npix; i++) {
+						for (e = 0; e < id; e++) {
+							unsigned int v = (unsigned int)((i * (e + 1) * 7) % 65536);
+							if (ip == 8)
+								ibuf[i * id + e] = (unsigned char)(v >> 8);
+							else
+								((unsigned short *)ibuf)[i * id + e] = (unsigned short)v;
+						}
+					}
+					smooth = do_time(s, ibuf, obuf, npix, mintime);
+
+					/* Uniformly random */
+					rand32(0x12345678);
+					for (i = 0; i < npix; i++) {
+						for (e = 0; e < id; e++) {
+							unsigned int v = rand32(0) & 0xffff;
+							if (ip == 8)
+								ibuf[i * id + e] = (unsigned char)(v >> 8);
+							else
+								((unsigned short *)ibuf)[i * id + e] = (unsigned short)v;
+						}
+					}
+					rnd = do_time(s, ibuf, obuf, npix, mintime);
+
+					printf("%d,%d,%d,%d,%d,%d,%d,%lu,%.2f,%.2f,%.3f\n",
+					       id, od, ip, op, res, gres, sres, size,
+					       smooth, rnd, rnd/smooth);
+					fflush(stdout);
+
+					s->del(s);
+				}
+			}
+		}
+	}
+
+	free(ibuf);
+	free(obuf);
+
+	return 0;
+}
@@ -33,13 +33,16 @@ static void imdi_info(imdi *s, unsigned long *size, int *gres, int *sres);
 static void imdi_del(imdi *im);
 static void interp_match(imdi *s, void **outp, int outst, void **inp, int inst,
                          unsigned int npixels);
+static void interp_float(imdi *s, void **outp, int outst, void **inp, int inst,
+                         unsigned int npixels);
 
 
-/* Create a new imdi */
+/* Create a new imdi, using the cache file if cname != NULL */
 /* Return NULL if request is not supported */
 /* Note that we use the high level pixel layout description to locate */
 /* a suitable run-time. */
-imdi *new_imdi(
+static imdi *new_imdi_imp(
+	char *cname,		  /* Table cache file name, NULL if none */
 	int id,				  /* Number of input dimensions */
 	int od,				  /* Number of output lookup dimensions */
 	                      /* Number of output channels written = od - no. of oopt skip flags */
@@ -73,6 +76,10 @@ imdi *new_imdi(
 	genspec bgs;				/* Best gen spec */
 	tabspec bts;				/* Best tab spec */
 	imdi_conv bcnv = conv_none;	/* Best tables conversion flags */
+	imdi_conv fcnv = conv_none;	/* Float conversion flags */
+	imdi_pixrep cfirep = invalid_rep;	/* Float input representation */
+	imdi_pixrep cforep = invalid_rep;	/* Float output representation */
+	imdi_options copt = opt;	/* Options called with */
 	imdi_ooptions Ooopt;		/* oopt re-aranged to correspond to output channel index */
 	
 	imdi *im;
@@ -94,6 +101,37 @@ imdi *new_imdi(
 	printf("about to checking %d kernels\n", no_kfuncs);
 #endif
 
+	/* Float representations are converted to and from pixint16 by interp_float(), */
+	/* which uses its own buffers, and so takes care of stride and direction itself. */
+	if (in == pixfloat32 || in == pixfloat16) {
+		if (out == planeint8 || out == planeint16) {
+#ifdef VERBOSE
+			printf("new_imdi failed - can't mix float and plane interleaved\n");
+#endif
+			return NULL;
+		}
+		cfirep = in;
+		in = pixint16;
+		in_signed = 0;
+		opt &= ~opts_istride;
+		fcnv |= conv_ifloat;
+	}
+	if (out == pixfloat32 || out == pixfloat16) {
+		if (in == planeint8 || in == planeint16) {
+#ifdef VERBOSE
+			printf("new_imdi failed - can't mix float and plane interleaved\n");
+#endif
+			return NULL;
+		}
+		cforep = out;
+		out = pixint16;
+		out_signed = 0;
+		opt &= ~opts_ostride;
+		fcnv |= conv_ofloat;
+	}
+	if (fcnv != conv_none)
+		opt &= ~(opts_fwd | opts_bwd);
+
 	/* Figure out the internal precision requested */
 	COMPUTE_IPREC(prec, in, iprec, out)
 
@@ -384,9 +422,24 @@ imdi *new_imdi(
 #endif
 
 	/* Allocate and initialise the appropriate tables */
-	im->impl = (void *)imdi_tab(&bgs, &bts, bcnv, in, out, ktable[bk].interp,
-	                            inm, outm, oopt, checkv, input_curves, md_table,
-	                            output_curves, cntx);
+	im->impl = NULL;
+	if (cname != NULL)			/* Try the cache first */
+		im->impl = (void *)imdi_tab_load(cname, &bgs, &bts, bcnv, in, out, ktable[bk].interp,
+		                                 inm, outm, oopt, checkv);
+	if (im->impl == NULL) {
+		im->impl = (void *)imdi_tab(&bgs, &bts, bcnv, in, out, ktable[bk].interp,
+		                            inm, outm, oopt, checkv, input_curves, md_table,
+		                            output_curves, cntx);
+
+		/* Failing to write the cache isn't fatal */
+		if (im->impl != NULL && cname != NULL
+		 && imdi_tab_save((imdi_imp *)im->impl, cname, &bgs, &bts, bcnv, in, out,
+		                  inm, outm, oopt, checkv) != 0) {
+#ifdef VERBOSE
+			printf("imdi_tab_save to '%s' failed\n",cname);
+#endif
+		}
+	}
 
 	if (im->impl == NULL) {
 #ifdef VERBOSE
@@ -401,10 +454,22 @@ imdi *new_imdi(
 		printf("imdi_tab: using a runtime match, cnv flags 0x%x\n",bcnv);
 #endif
 
-	if (bcnv == conv_none)		/* No runtime match conversion needed */
-		im->interp  = ktable[bk].interp;	
-	else
+	if (bcnv == conv_none) {	/* No runtime match conversion needed */
+		/* Use a vector version of the kernel if there is one */
+		if ((im->interp = imdi_vec_kernel(&bgs, &bts, (imdi_imp *)im->impl)) == NULL)
+			im->interp  = ktable[bk].interp;	
+	} else
 		im->interp  = interp_match;
+
+	if (fcnv != conv_none) {	/* Float conversion wraps pixint16 conversion */
+		imdi_imp *impl = (imdi_imp *)im->impl;
+		impl->cnv |= fcnv;
+		impl->cfirep = cfirep;
+		impl->cforep = cforep;
+		impl->copt = copt;
+		impl->finterp = im->interp;
+		im->interp = interp_float;
+	}
 	im->get_check   = imdi_get_check;
 	im->reset_check = imdi_reset_check;
 	im->info        = imdi_info;
@@ -416,6 +481,57 @@ imdi *new_imdi(
 	return im;
 }
 
+/* Create a new imdi */
+/* Return NULL if request is not supported */
+imdi *new_imdi(
+	int id,				  /* Number of input dimensions */
+	int od,				  /* Number of output lookup dimensions */
+	imdi_pixrep in,		  /* Input pixel representation */
+	int in_signed,		  /* Bit flag per channel, NZ if treat as signed */
+	int *inm,			  /* Input raster channel to callback channel mapping, NULL for none. */
+	imdi_iprec iprec,	  /* Internal processing precision */
+	imdi_pixrep out,	  /* Output pixel representation */
+	int out_signed,		  /* Bit flag per channel, NZ if treat as signed */
+	int *outm,			  /* Output raster channel to callback channel mapping, NULL for none. */
+	int res,			  /* Desired table resolution */
+	imdi_ooptions oopt,   /* Output per channel options (by callback channel) */
+	unsigned int *checkv, /* Output channel check values (by callback channel, NULL == 0) */
+	imdi_options opt,	  /* Direction and stride options */
+	void (*input_curves) (void *cntx, double *out_vals, double *in_vals),
+	void (*md_table)     (void *cntx, double *out_vals, double *in_vals),
+	void (*output_curves)(void *cntx, double *out_vals, double *in_vals),
+	void *cntx		/* Context to callbacks */
+) {
+	return new_imdi_imp(NULL, id, od, in, in_signed, inm, iprec, out, out_signed, outm,
+	                    res, oopt, checkv, opt, input_curves, md_table, output_curves, cntx);
+}
+
+/* Create a new imdi, using a table cache file */
+/* Return NULL if request is not supported */
+imdi *new_imdi_cache(
+	char *cname,		  /* Cache file name */
+	int id,				  /* Number of input dimensions */
+	int od,				  /* Number of output lookup dimensions */
+	imdi_pixrep in,		  /* Input pixel representation */
+	int in_signed,		  /* Bit flag per channel, NZ if treat as signed */
+	int *inm,			  /* Input raster channel to callback channel mapping, NULL for none. */
+	imdi_iprec iprec,	  /* Internal processing precision */
+	imdi_pixrep out,	  /* Output pixel representation */
+	int out_signed,		  /* Bit flag per channel, NZ if treat as signed */
+	int *outm,			  /* Output raster channel to callback channel mapping, NULL for none. */
+	int res,			  /* Desired table resolution */
+	imdi_ooptions oopt,   /* Output per channel options (by callback channel) */
+	unsigned int *checkv, /* Output channel check values (by callback channel, NULL == 0) */
+	imdi_options opt,	  /* Direction and stride options */
+	void (*input_curves) (void *cntx, double *out_vals, double *in_vals),
+	void (*md_table)     (void *cntx, double *out_vals, double *in_vals),
+	void (*output_curves)(void *cntx, double *out_vals, double *in_vals),
+	void *cntx		/* Context to callbacks */
+) {
+	return new_imdi_imp(cname, id, od, in, in_signed, inm, iprec, out, out_signed, outm,
+	                    res, oopt, checkv, opt, input_curves, md_table, output_curves, cntx);
+}
+
 /* Runtime matching adapter */
 /* We can emulate many combinations of interpolation function */
 /* by converting to a routine that supports stride, or one that */
@@ -533,6 +649,139 @@ unsigned int npixels		/* Number of pixels */
 	impl->interp(s, moutp, outst, minp, inst, npixels);
 }
 
+/* Convert an IEEE half float to a float */
+static float half2float(unsigned short h) {
+	unsigned int sign = (h >> 15) & 1;
+	int exp = (h >> 10) & 0x1f;
+	unsigned int man = h & 0x3ff;
+	float v;
+
+	if (exp == 0)				/* Zero or denormal */
+		v = (float)ldexp((double)man, -24);
+	else if (exp == 0x1f)		/* Inf or NaN */
+		v = man == 0 ? 1e30f : 0.0f;
+	else
+		v = (float)ldexp((double)(man | 0x400), exp - 25);
+	return sign ? -v : v;
+}
+
+/* Convert a value in the range 0 - 65535 to an IEEE half float */
+/* (Rounded to nearest) */
+static unsigned short int2half(unsigned int iv) {
+	double v = iv/65535.0;
+	int exp;
+	unsigned int man;
+
+	if (iv == 0)
+		return 0;
+	frexp(v, &exp);				/* v = f * 2^exp, 0.5 <= f < 1.0 */
+	exp -= 1;					/* v = 1.m * 2^exp */
+	if (exp < -14) {			/* Denormal */
+		man = (unsigned int)floor(ldexp(v, 24) + 0.5);
+		return (unsigned short)man;		/* Rounding up to normal works too */
+	}
+	man = (unsigned int)floor(ldexp(v, 10 - exp) + 0.5);	/* 11 bits incl. hidden bit */
+	if (man >= 0x800) {			/* Rounded up to next exponent */
+		man >>= 1;
+		exp++;
+	}
+	return (unsigned short)(((exp + 15) << 10) | (man & 0x3ff));
+}
+
+/* Convert a float value to pixint16, clipping to the range 0.0 - 1.0 */
+#define FLT2INT16(vv) ((vv) > 0.0f ? ((vv) < 1.0f ? (unsigned short)((vv) * 65535.0f + 0.5f) \
+                                                 : 65535) : 0)
+
+#define FCHUNK 128		/* Number of pixels converted at a time */
+
+/* Runtime float adapter */
+/* Float input or output is converted to pixint16 in chunks, */
+/* and the pixint16 conversion function is called on each chunk. */
+/* Note that in place conversion only works if the output pixels */
+/* are no larger than the input pixels. */
+static void interp_float(
+imdi *s,
+void **outp, int outst,		/* Output pointers and stride */
+void **inp, int inst,		/* Input pointers and stride */
+unsigned int npixels		/* Number of pixels */
+) {
+	imdi_imp *impl = (imdi_imp *)s->impl;
+	imdi_conv cnv = impl->cnv;
+	int id = impl->id, wod = impl->wod;
+	unsigned short ibuf[FCHUNK * IXDI];
+	unsigned short obuf[FCHUNK * IXDO];
+	void *minp[1], *moutp[1];
+	int ibpc, obpc;				/* Non-float bytes per component */
+	unsigned int i, n, j;
+	int e;
+
+	/* Default stride is the pixel interleaved one */
+	if ((impl->copt & opts_istride) == 0)
+		inst = id;
+	if ((impl->copt & opts_ostride) == 0)
+		outst = wod;
+
+	ibpc = impl->cirep == pixint8 ? 1 : 2;
+	obpc = impl->corep == pixint8 ? 1 : 2;
+
+	for (i = 0; i < npixels; i += n) {
+		int minst, moutst;
+
+		n = npixels - i;
+		if (n > FCHUNK)
+			n = FCHUNK;
+
+		if (cnv & conv_ifloat) {
+			if (impl->cfirep == pixfloat32) {
+				float *ip = (float *)inp[0] + i * inst;
+				for (j = 0; j < n; j++, ip += inst) {
+					for (e = 0; e < id; e++)
+						ibuf[j * id + e] = FLT2INT16(ip[e]);
+				}
+			} else {
+				unsigned short *ip = (unsigned short *)inp[0] + i * inst;
+				for (j = 0; j < n; j++, ip += inst) {
+					for (e = 0; e < id; e++) {
+						float vv = half2float(ip[e]);
+						ibuf[j * id + e] = FLT2INT16(vv);
+					}
+				}
+			}
+			minp[0] = (void *)ibuf;
+			minst = id;
+		} else {
+			minp[0] = (void *)((char *)inp[0] + i * inst * ibpc);
+			minst = inst;
+		}
+
+		if (cnv & conv_ofloat) {
+			moutp[0] = (void *)obuf;
+			moutst = wod;
+		} else {
+			moutp[0] = (void *)((char *)outp[0] + i * outst * obpc);
+			moutst = outst;
+		}
+
+		impl->finterp(s, moutp, moutst, minp, minst, n);
+
+		if (cnv & conv_ofloat) {
+			if (impl->cforep == pixfloat32) {
+				float *op = (float *)outp[0] + i * outst;
+				for (j = 0; j < n; j++, op += outst) {
+					for (e = 0; e < wod; e++)
+						op[e] = obuf[j * wod + e]/65535.0f;
+				}
+			} else {
+				unsigned short *op = (unsigned short *)outp[0] + i * outst;
+				for (j = 0; j < n; j++, op += outst) {
+					for (e = 0; e < wod; e++)
+						op[e] = int2half(obuf[j * wod + e]);
+				}
+			}
+		}
+	}
+}
+
 /* Get the per output channel check flags - bit corresponds to output interpolation channel */
 static unsigned int imdi_get_check(imdi *im) {
 	imdi_imp *impl = (imdi_imp *)im->impl;
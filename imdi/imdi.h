@@ -84,6 +84,56 @@ imdi *new_imdi(
 	void *cntx		/* Context to callbacks */
 );
 
+/* Create a new imdi, using a table cache file. */
+/* If the cache file exists and was created by the same build of imdi */
+/* with the same arguments, the tables are loaded (mapped read only */
+/* where possible) from it rather than being created using the callbacks. */
+/* Otherwise the tables are created and written to the cache file. */
+/* The caller is responsible for making the file name unique to */
+/* the callbacks, (ie. by including a hash of the profiles used). */
+/* Return NULL if request is not supported */
+imdi *new_imdi_cache(
+	char *cname,		  /* Cache file name */
+	int id,				  /* Number of input dimensions */
+	int od,				  /* Number of output lookup dimensions */
+	imdi_pixrep in,		  /* Input pixel representation */
+	int in_signed,		  /* Bit flag per channel, NZ if treat as signed */
+	int *inm,			  /* Input raster channel to callback channel mapping, NULL for none. */
+	imdi_iprec iprec,	  /* Internal processing precision */
+	imdi_pixrep out,	  /* Output pixel representation */
+	int out_signed,		  /* Bit flag per channel, NZ if treat as signed */
+	int *outm,			  /* Output raster channel to callback channel mapping, NULL for none. */
+	int res,			  /* Desired table resolution */
+	imdi_ooptions oopt,   /* Output per channel options (by callback channel) */
+	unsigned int *checkv, /* Output channel check values (by callback channel, NULL == 0) */
+	imdi_options opt,	  /* Direction and stride options */
+	void (*input_curves) (void *cntx, double *out_vals, double *in_vals),
+	void (*md_table)     (void *cntx, double *out_vals, double *in_vals),
+	void (*output_curves)(void *cntx, double *out_vals, double *in_vals),
+	void *cntx		/* Context to callbacks */
+);
+
+/* Convert a stream of pixels through an imdi, overlapping the */
+/* reading, conversion and writing of chunks of pixels using threads. */
+/* The imdi must be pixel interleaved, and is called with no stride. */
+/* read() is called from a separate thread to fill buf with up to maxpix */
+/* pixels, and should return the number of pixels read, 0 at the end */
+/* of the stream, or -1 on an error. write() is called from the calling */
+/* thread with each chunk of converted pixels in order, and should */
+/* return nz on an error. (Needs linking with libconv.) */
+/* Return 0 on success, 1 on a read error, 2 on a write error, */
+/* 3 on a memory or thread creation error. */
+int imdi_stream(
+	imdi *s,			/* imdi to convert with */
+	int (*read)(void *cntx, void *buf, int maxpix),
+	int (*write)(void *cntx, void *buf, int npix),
+	void *cntx,			/* Context to read and write callbacks */
+	int ibpp,			/* Input bytes per pixel */
+	int obpp,			/* Output bytes per pixel */
+	int chunkpix,		/* Pixels per chunk, 0 for default */
+	int nthreads		/* Number of conversion threads, 0 for default of 1 */
+);
+
 #endif /* IMDI_H */
 
 
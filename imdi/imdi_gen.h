@@ -38,9 +38,16 @@ typedef enum {
 	pixint8     = 0x01,		/* 8 Bits per value, pixel interleaved, no padding */
 	planeint8   = 0x02,		/* 8 bits per value, plane interleaved */
 	pixint16    = 0x03,		/* 16 Bits per value, pixel interleaved, no padding */
-	planeint16  = 0x04		/* 16 bits per value, plane interleaved */
+	planeint16  = 0x04,		/* 16 bits per value, plane interleaved */
+	pixfloat32  = 0x05,		/* 32 bit IEEE float per value, pixel interleaved, no padding */
+	pixfloat16  = 0x06		/* 16 bit IEEE half float per value, pixel interleaved, no padding */
 } imdi_pixrep;
 
+/* Note that there are no float kernels. The float representations are */
+/* run time converted to/from pixint16 in small chunks, the nominal float */
+/* range 0.0 - 1.0 being mapped to 0 - 65535, with out of range values clipped. */
+/* The in_signed & out_signed flags are ignored for float channels. */
+
 /* The internal processing precision */
 typedef enum {
 	prec_min   = 0,		/* Minimum of input and output precision */
@@ -203,6 +210,8 @@ int set_genspec(genspec *gs, gendesc *gd, int comb, mach_arch *a);
 			break;													\
 		case pixint16:												\
 		case planeint16:											\
+		case pixfloat32:											\
+		case pixfloat16:											\
 			_iprec = 16;											\
 			break;													\
 	}																\
@@ -214,6 +223,8 @@ int set_genspec(genspec *gs, gendesc *gd, int comb, mach_arch *a);
 			break;													\
 		case pixint16:												\
 		case planeint16:											\
+		case pixfloat32:											\
+		case pixfloat16:											\
 			_oprec = 16;											\
 			break;													\
 	}																\
@@ -84,11 +84,11 @@ gendesc descs[] = {
 								/* * means multiplies combination */
 								/* + means lockstep with previous line */
 	{
-		{ 1,    3,  4,  5,  6,  7,  8, 9, 10, 0 },	/* * Input dimension combinations */
-		{ 256, 33, 18, 16, 12,  8,  7, 6, 5,  0 }, 	/* + Min Interpolation table resolutions */
-		{ 1,    8, 17,  1,  1,  1,  1, 1, 1,  0 }, 	/* + Min Simplex table resolutions */
+		{ 1,    2,  3,  4,  5,  6,  7,  8, 9, 10, 0 },	/* * Input dimension combinations */
+		{ 256, 65, 33, 18, 16, 12,  8,  7, 6, 5,  0 }, 	/* + Min Interpolation table resolutions */
+		{ 1,    4,  8, 17,  1,  1,  1,  1, 1, 1,  0 }, 	/* + Min Simplex table resolutions */
 
-		{ 1, 3, 4, 5, 6, 7, 8, 9, 10, 0 },				/* * Output dimension combinations */
+		{ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 0 },				/* * Output dimension combinations */
 		{oopts_none, oopts_none, oopts_none, oopts_none, oopts_none, oopts_none,
 		 oopts_none, oopts_none, oopts_none, oopts_none, oopts_none, oopts_none},
 														/* + Output channel options */
@@ -0,0 +1,291 @@
+
+/* Integer Multi-Dimensional Interpolation */
+
+/*
+ * Copyright 2020 Graeme W. Gill
+ * All rights reserved.
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * Streaming conversion of pixels through an imdi.
+ *
+ * The caller supplies a read callback that decodes the next chunk of
+ * (pixel interleaved) input pixels into a buffer, and a write callback
+ * that encodes a chunk of output pixels. The reading, conversion
+ * and writing are overlapped by running them in separate threads,
+ * passing a bounded ring of chunk buffers between them, so that
+ * (for instance) decoding chunk n+2 and encoding chunk n can both be
+ * under way while chunk n+1 is being converted.
+ *
+ * Each buffer cycles through the states free -> read -> converted -> free,
+ * and there are two buffers for each stage, so that no stage need wait
+ * for another to hand a buffer back unless it is actually the bottleneck.
+ * More than one conversion thread may be used, in which case chunks
+ * may finish converting out of order, but are always written in order.
+ *
+ * The read callback is called from a thread of its own, the
+ * write callback from the calling thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "numlib.h"
+#include "conv.h"
+#include "imdi.h"
+
+#undef DEBUG
+
+#define DEF_CHUNKPIX 8192		/* Default pixels per chunk */
+#define MAX_CTHREADS 32			/* Maximum number of conversion threads */
+
+/* Chunk buffer states */
+#define CH_FREE  0		/* Available to be read into */
+#define CH_READ  1		/* Has been read, waiting to be converted */
+#define CH_CONV  2		/* Being converted */
+#define CH_DONE  3		/* Has been converted, waiting to be written */
+
+typedef struct {
+	int state;				/* CH_XXX */
+	int seq;				/* Chunk sequence number */
+	int npix;				/* Number of pixels in chunk */
+	unsigned char *ibuf;	/* Input pixels */
+	unsigned char *obuf;	/* Output pixels */
+} imdi_chunk;
+
+typedef struct {
+	imdi *s;
+	int (*read)(void *cntx, void *buf, int maxpix);
+	void *cntx;
+	int chunkpix;			/* Pixels per chunk */
+
+	int nbuf;				/* Number of chunk buffers */
+	imdi_chunk *ch;			/* nbuf chunks, chunk seq n is ch[n % nbuf] */
+
+	amutex lock;			/* Lock for all the following */
+	acond rcond;			/* Reader waits for a free buffer */
+	acond ccond;			/* Converters wait for a chunk to convert */
+	acond wcond;			/* Writer waits for a chunk to be converted */
+
+	int rseq;				/* Next chunk to be read */
+	int cseq;				/* Next chunk to be converted */
+	int eseq;				/* Sequence number of the end of stream, -1 if unknown */
+	int rerr;				/* Read error */
+	int abort;				/* Writer has given up */
+} imdi_stream_ctx;
+
+/* Reader thread */
+static int stream_reader(void *cntx) {
+	imdi_stream_ctx *x = (imdi_stream_ctx *)cntx;
+
+	for (;;) {
+		imdi_chunk *ch;
+		int npix;
+
+		amutex_lock(x->lock);
+		ch = &x->ch[x->rseq % x->nbuf];
+		while (ch->state != CH_FREE && !x->abort)
+			acond_wait(x->rcond, x->lock);
+		if (x->abort) {
+			amutex_unlock(x->lock);
+			break;
+		}
+		amutex_unlock(x->lock);
+
+		/* Decode into the free buffer without holding the lock */
+		npix = x->read(x->cntx, (void *)ch->ibuf, x->chunkpix);
+		if (npix > x->chunkpix)
+			npix = -1;
+
+		amutex_lock(x->lock);
+		if (npix <= 0) {
+			if (npix < 0)
+				x->rerr = 1;
+			x->eseq = x->rseq;
+			acond_signal(x->ccond);
+			acond_signal(x->wcond);
+			amutex_unlock(x->lock);
+			break;
+		}
+		ch->seq = x->rseq++;
+		ch->npix = npix;
+		ch->state = CH_READ;
+		acond_signal(x->ccond);
+		amutex_unlock(x->lock);
+	}
+	return 0;
+}
+
+/* Conversion thread */
+static int stream_converter(void *cntx) {
+	imdi_stream_ctx *x = (imdi_stream_ctx *)cntx;
+	imdi *s = x->s;
+
+	for (;;) {
+		imdi_chunk *ch = NULL;
+		void *inp[1], *outp[1];
+
+		amutex_lock(x->lock);
+		for (;;) {
+			if (x->abort || (x->eseq >= 0 && x->cseq >= x->eseq))
+				break;
+			ch = &x->ch[x->cseq % x->nbuf];
+			if (ch->state == CH_READ && ch->seq == x->cseq)
+				break;
+			acond_wait(x->ccond, x->lock);
+		}
+		if (x->abort || (x->eseq >= 0 && x->cseq >= x->eseq)) {
+			acond_signal(x->ccond);		/* Pass the news on to any other converter */
+			amutex_unlock(x->lock);
+			break;
+		}
+		ch->state = CH_CONV;
+		x->cseq++;
+		acond_signal(x->ccond);		/* In case another converter can take the next one */
+		amutex_unlock(x->lock);
+
+		inp[0] = (void *)ch->ibuf;
+		outp[0] = (void *)ch->obuf;
+		s->interp(s, outp, 0, inp, 0, ch->npix);
+
+		amutex_lock(x->lock);
+		ch->state = CH_DONE;
+		acond_signal(x->wcond);
+		amutex_unlock(x->lock);
+	}
+	return 0;
+}
+
+/* Convert a stream of pixel interleaved pixels through an imdi. */
+/* Return 0 on success, 1 on a read error, 2 on a write error, */
+/* 3 on a memory or thread creation error. */
+int imdi_stream(
+	imdi *s,				/* imdi to convert with (must be pixel interleaved, no stride) */
+	int (*read)(void *cntx, void *buf, int maxpix),
+	int (*write)(void *cntx, void *buf, int npix),
+	void *cntx,				/* Context to read and write callbacks */
+	int ibpp,				/* Input bytes per pixel */
+	int obpp,				/* Output bytes per pixel */
+	int chunkpix,			/* Pixels per chunk, 0 for default */
+	int nthreads			/* Number of conversion threads, 0 for default of 1 */
+) {
+	imdi_stream_ctx x;
+	athread *rth = NULL, *cth[MAX_CTHREADS];
+	int wseq, i;
+	int rv = 0;
+
+	if (chunkpix <= 0)
+		chunkpix = DEF_CHUNKPIX;
+	if (nthreads <= 0)
+		nthreads = 1;
+	if (nthreads > MAX_CTHREADS)
+		nthreads = MAX_CTHREADS;
+
+	memset((void *)&x, 0, sizeof(imdi_stream_ctx));
+	x.s = s;
+	x.read = read;
+	x.cntx = cntx;
+	x.chunkpix = chunkpix;
+	x.eseq = -1;
+
+	/* Two buffers for the reader, each converter and the writer */
+	x.nbuf = 2 * (nthreads + 2);
+
+	if ((x.ch = (imdi_chunk *)calloc(x.nbuf, sizeof(imdi_chunk))) == NULL)
+		return 3;
+	for (i = 0; i < x.nbuf; i++) {
+		if ((x.ch[i].ibuf = (unsigned char *)malloc(chunkpix * ibpp)) == NULL
+		 || (x.ch[i].obuf = (unsigned char *)malloc(chunkpix * obpp)) == NULL) {
+			rv = 3;
+			goto done;
+		}
+		x.ch[i].state = CH_FREE;
+		x.ch[i].seq = -1;
+	}
+
+	amutex_init(x.lock);
+	acond_init(x.rcond);
+	acond_init(x.ccond);
+	acond_init(x.wcond);
+
+	for (i = 0; i < nthreads; i++)
+		cth[i] = NULL;
+
+	if ((rth = new_athread(stream_reader, (void *)&x)) == NULL) {
+		rv = 3;
+		goto cleanup;
+	}
+	for (i = 0; i < nthreads; i++) {
+		if ((cth[i] = new_athread(stream_converter, (void *)&x)) == NULL) {
+			amutex_lock(x.lock);
+			x.abort = 1;
+			acond_signal(x.rcond);
+			acond_signal(x.ccond);
+			amutex_unlock(x.lock);
+			rv = 3;
+			goto cleanup;
+		}
+	}
+
+	/* Write the chunks in order from this thread */
+	for (wseq = 0;; wseq++) {
+		imdi_chunk *ch = &x.ch[wseq % x.nbuf];
+
+		amutex_lock(x.lock);
+		while (!(ch->state == CH_DONE && ch->seq == wseq)
+		    && !(x.eseq >= 0 && wseq >= x.eseq))
+			acond_wait(x.wcond, x.lock);
+		if (x.eseq >= 0 && wseq >= x.eseq) {
+			if (x.rerr)
+				rv = 1;
+			amutex_unlock(x.lock);
+			break;
+		}
+		amutex_unlock(x.lock);
+
+		if (write(cntx, (void *)ch->obuf, ch->npix)) {
+			amutex_lock(x.lock);
+			x.abort = 1;
+			acond_signal(x.rcond);
+			acond_signal(x.ccond);
+			amutex_unlock(x.lock);
+			rv = 2;
+			break;
+		}
+
+		amutex_lock(x.lock);
+		ch->state = CH_FREE;
+		ch->seq = -1;
+		acond_signal(x.rcond);
+		amutex_unlock(x.lock);
+	}
+
+  cleanup:;
+	if (rth != NULL) {
+		rth->wait(rth);
+		rth->del(rth);
+	}
+	for (i = 0; i < nthreads; i++) {
+		if (cth[i] != NULL) {
+			cth[i]->wait(cth[i]);
+			cth[i]->del(cth[i]);
+		}
+	}
+
+	acond_del(x.wcond);
+	acond_del(x.ccond);
+	acond_del(x.rcond);
+	amutex_del(x.lock);
+
+  done:;
+	for (i = 0; i < x.nbuf; i++) {
+		free(x.ch[i].ibuf);
+		free(x.ch[i].obuf);
+	}
+	free(x.ch);
+
+	return rv;
+}
@@ -23,6 +23,14 @@
 #include <stdarg.h>
 #include <string.h>
 
+#ifdef UNIX
+# include <unistd.h>
+# include <fcntl.h>
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/mman.h>
+#endif
+
 #include "imdi.h"
 #include "imdi_tab.h"
 
@@ -268,6 +276,7 @@ imdi_tab(
 			return NULL;	/* Should we signal error ? How ? */
 		}
 		it->size += ts->it_ts * ne;
+		it->in_tsize[e] = ts->it_ts * ne;
 #ifdef VERBOSE
 		printf("Allocated input table %d size %u = %u * %u\n",e, ts->it_ts * ne,ts->it_ts,ne);
 #endif /* VERBOSE */
@@ -394,7 +403,10 @@ imdi_tab(
 			vsize = (gs->prec * 2)/8;	/* Fixed point entry & computation size */
 		else
 			vsize = gs->prec/8;			/* Fixed point entry size */
-		vscale = (1 << gs->prec) -0.50000001;
+		if (ts->im_rd)					/* Kernel rounds the interpolated value */
+			vscale = (1 << gs->prec) - 1.0;
+		else
+			vscale = (1 << gs->prec) -0.50000001;
 										/* Value scale for fixed point padding */
 										/* -0.5 is to prevent carry/rollover after accumulation */
 										/* Could get better accuracy with saturation arithmatic */
@@ -407,6 +419,7 @@ imdi_tab(
 			return NULL;	/* Should we signal error ? How ? */
 		}
 		it->size += ibdinc[it->id];
+		it->im_tsize = ibdinc[it->id];
 #ifdef VERBOSE
 		printf("Allocated grid table = %u bytes, composed of %d dim of res %d entry %d\n",ibdinc[it->id], it->id, gs->itres, ts->im_ts);
 #endif /* VERBOSE */
@@ -522,6 +535,7 @@ imdi_tab(
 			return NULL;	/* Should we signal error ? How ? */
 		}
 		it->size += sbdinc[it->id];
+		it->sw_tsize = sbdinc[it->id];
 #ifdef VERBOSE
 		printf("Allocated simplex table = %u bytes, composed of %d dim of res %d entry %d\n",sbdinc[it->id], it->id, gs->stres, ts->sm_ts);
 #endif /* VERBOSE */
@@ -699,6 +713,7 @@ imdi_tab(
 			return NULL;	/* Should we signal error ? How ? */
 		}
 		it->size += ts->ot_ts * ne;
+		it->out_tsize[e] = ts->ot_ts * ne;
 #ifdef VERBOSE
 		printf("Allocated output table %d size %u = %u * %u\n",e, ts->ot_ts * ne,ts->ot_ts,ne);
 #endif /* VERBOSE */
@@ -772,6 +787,16 @@ imdi_imp *it
 ) {
 	int e;
 
+	if (it->cbase != NULL) {		/* Tables are in a cache file image */
+#ifdef UNIX
+		munmap(it->cbase, it->csize);
+#else
+		free(it->cbase);
+#endif
+		free(it);
+		return;
+	}
+
 	for (e = 0; e < it->nintabs; e++)
 		free(it->in_tables[e]);
 
@@ -801,3 +826,277 @@ imdi_imp *it
 
 
 
+
+/* - - - - - - - - - - - - - - - - - - - - - - - */
+/* Table cache file support. */
+
+/* A cache file is a header that identifies the kernel and the run time setup */
+/* that the tables were created for, followed by a copy of the imdi_imp, */
+/* followed by each table, aligned to CALIGN bytes. */
+/* The file is only valid for the same build of imdi on the same type */
+/* of machine, so it is only used if the header matches exactly. */
+
+#define CMAGIC "IMDICT1"
+#define CALIGN 64
+
+typedef struct {
+	char magic[8];
+	int hsize;					/* sizeof(imdi_chdr) */
+	int isize;					/* sizeof(imdi_imp) */
+	genspec gs;					/* Kernel gen spec */
+	tabspec ts;					/* Kernel tab spec */
+	imdi_conv cnv;				/* Runtime argument conversion */
+	imdi_pixrep irep, orep;		/* Representation interp is called with */
+	int inm[IXDI];				/* Input channel mapping */
+	int outm[IXDO];				/* Output channel mapping */
+	imdi_ooptions oopt;			/* Output per channel options */
+	unsigned int checkv[IXDO];	/* Output channel check values */
+	unsigned long tsize;		/* Total file size */
+} imdi_chdr;
+
+/* Setup a header for the given kernel and run time setup */
+static void set_chdr(
+	imdi_chdr *h,
+	genspec *gs,
+	tabspec *ts,
+	imdi_conv cnv,
+	imdi_pixrep irep,
+	imdi_pixrep orep,
+	int *inm,
+	int *outm,
+	imdi_ooptions oopt,
+	unsigned int *checkv
+) {
+	int e;
+
+	memset((void *)h, 0, sizeof(imdi_chdr));	/* Make padding repeatable */
+	strcpy(h->magic, CMAGIC);
+	h->hsize = sizeof(imdi_chdr);
+	h->isize = sizeof(imdi_imp);
+	h->gs = *gs;
+	h->ts = *ts;
+	h->ts.interp = NULL;
+	h->cnv = cnv;
+	h->irep = irep;
+	h->orep = orep;
+	for (e = 0; e < gs->id; e++)
+		h->inm[e] = inm != NULL ? inm[e] : e;
+	for (e = 0; e < gs->od; e++) {
+		h->outm[e] = outm != NULL ? outm[e] : e;
+		h->checkv[e] = checkv != NULL ? checkv[e] : 0;
+	}
+	h->oopt = oopt;
+}
+
+/* Round up to the table alignment */
+static unsigned long calign(unsigned long off) {
+	return (off + CALIGN - 1) & ~((unsigned long)CALIGN - 1);
+}
+
+/* Save the tables of an imdi_imp to a cache file. */
+/* The file is written to a temporary name and then renamed, */
+/* so that other processes never see a partial file. */
+/* Return nz on error */
+int imdi_tab_save(
+	imdi_imp *it,		/* Tables to save */
+	char *fname,		/* Cache file name */
+	genspec *gs,		/* Pointer to gen spec used to create it */
+	tabspec *ts,		/* Pointer to table spec used to create it */
+	imdi_conv cnv,		/* Runtime argument conversion needed */
+	imdi_pixrep irep,	/* High level input pixel representation */
+	imdi_pixrep orep,	/* High level output pixel representation */
+	int *inm,			/* Input raster channel to callback channel mapping, NULL for none. */
+	int *outm,			/* Output raster channel to callback channel mapping, NULL for none. */
+	imdi_ooptions oopt,	  /* Output per channel options */
+	unsigned int *checkv  /* Output channel check values, NULL for none */
+) {
+	imdi_chdr h;
+	char *tname;
+	FILE *fp;
+	unsigned long off;
+	void *tabs[IXDI + 2 + IXDO];
+	unsigned long tsizes[IXDI + 2 + IXDO];
+	int ntabs = 0, e, rv = 0;
+	static char zbuf[CALIGN] = { 0 };
+
+	if (it->cbase != NULL)		/* Came from a cache file already */
+		return 0;
+
+	for (e = 0; e < it->nintabs; e++) {
+		tabs[ntabs] = it->in_tables[e];
+		tsizes[ntabs++] = it->in_tsize[e];
+	}
+	tabs[ntabs] = it->sw_table;
+	tsizes[ntabs++] = it->sw_table != NULL ? it->sw_tsize : 0;
+	tabs[ntabs] = it->im_table;
+	tsizes[ntabs++] = it->im_tsize;
+	for (e = 0; e < it->nouttabs; e++) {
+		tabs[ntabs] = it->out_tables[e];
+		tsizes[ntabs++] = it->out_tsize[e];
+	}
+
+	set_chdr(&h, gs, ts, cnv, irep, orep, inm, outm, oopt, checkv);
+	off = calign(sizeof(imdi_chdr) + sizeof(imdi_imp));
+	for (e = 0; e < ntabs; e++)
+		off = calign(off + tsizes[e]);
+	h.tsize = off;
+
+	if ((tname = malloc(strlen(fname) + 30)) == NULL)
+		return 1;
+#ifdef UNIX
+	sprintf(tname, "%s.%d.tmp", fname, (int)getpid());
+#else
+	sprintf(tname, "%s.tmp", fname);
+#endif
+
+	if ((fp = fopen(tname, "wb")) == NULL) {
+		free(tname);
+		return 1;
+	}
+
+	if (fwrite((void *)&h, sizeof(imdi_chdr), 1, fp) != 1
+	 || fwrite((void *)it, sizeof(imdi_imp), 1, fp) != 1)
+		rv = 1;
+	off = sizeof(imdi_chdr) + sizeof(imdi_imp);
+	for (e = 0; rv == 0 && e <= ntabs; e++) {
+		unsigned long pad = calign(off) - off;
+		if (pad > 0 && fwrite((void *)zbuf, 1, pad, fp) != pad)
+			rv = 1;
+		off += pad;
+		if (e < ntabs && tsizes[e] > 0) {
+			if (fwrite(tabs[e], 1, tsizes[e], fp) != tsizes[e])
+				rv = 1;
+			off += tsizes[e];
+		}
+	}
+	if (fclose(fp) != 0)
+		rv = 1;
+
+	if (rv == 0) {
+#ifndef UNIX
+		remove(fname);			/* MSWin rename() won't replace a file */
+#endif
+		if (rename(tname, fname) != 0)
+			rv = 1;
+	}
+	if (rv != 0)
+		remove(tname);
+	free(tname);
+
+	return rv;
+}
+
+/* Create an imdi_imp from a cache file. */
+/* Return NULL if the file doesn't exist, or doesn't match. */
+/* On UNIX the file is mapped read only, so that the tables are */
+/* shared between all the processes using the same file. */
+imdi_imp *
+imdi_tab_load(
+	char *fname,		/* Cache file name */
+	genspec *gs,		/* Pointer to gen spec */
+	tabspec *ts,		/* Pointer to table spec */
+	imdi_conv cnv,		/* Runtime argument conversion needed */
+	imdi_pixrep irep,	/* High level input pixel representation to match  */
+	imdi_pixrep orep,	/* High level output pixel representation to match */
+	void (*interp)(struct _imdi *s, void **outp, int outst,	/* Underlying conversion function */
+	                                void **inp, int inst,
+	                                unsigned int npixels),
+	int *inm,			/* Input raster channel to callback channel mapping, NULL for none. */
+	int *outm,			/* Output raster channel to callback channel mapping, NULL for none. */
+	imdi_ooptions oopt,	  /* Output per channel options */
+	unsigned int *checkv  /* Output channel check values, NULL for none */
+) {
+	imdi_chdr h;
+	imdi_imp *it;
+	char *base;
+	unsigned long size, off;
+	int e;
+
+	set_chdr(&h, gs, ts, cnv, irep, orep, inm, outm, oopt, checkv);
+
+#ifdef UNIX
+	{
+		int fd;
+		struct stat sbuf;
+
+		if ((fd = open(fname, O_RDONLY)) < 0)
+			return NULL;
+		if (fstat(fd, &sbuf) != 0 || sbuf.st_size < (off_t)sizeof(imdi_chdr)) {
+			close(fd);
+			return NULL;
+		}
+		size = (unsigned long)sbuf.st_size;
+		base = (char *)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (base == (char *)MAP_FAILED)
+			return NULL;
+	}
+#else
+	{
+		FILE *fp;
+
+		if ((fp = fopen(fname, "rb")) == NULL)
+			return NULL;
+		if (fseek(fp, 0, SEEK_END) != 0 || (long)(size = ftell(fp)) < (long)sizeof(imdi_chdr)
+		 || fseek(fp, 0, SEEK_SET) != 0 || (base = malloc(size)) == NULL) {
+			fclose(fp);
+			return NULL;
+		}
+		if (fread(base, 1, size, fp) != size) {
+			free(base);
+			fclose(fp);
+			return NULL;
+		}
+		fclose(fp);
+	}
+#endif
+
+	h.tsize = size;
+	if (memcmp((void *)&h, (void *)base, sizeof(imdi_chdr)) != 0
+	 || (it = (imdi_imp *)malloc(sizeof(imdi_imp))) == NULL) {
+#ifdef UNIX
+		munmap(base, size);
+#else
+		free(base);
+#endif
+		return NULL;
+	}
+
+	/* Restore the imdi_imp, and point it at the tables */
+	memcpy((void *)it, (void *)(base + sizeof(imdi_chdr)), sizeof(imdi_imp));
+	it->cbase = (void *)base;
+	it->csize = size;
+	it->interp = interp;
+	it->checkf = 0;
+
+	off = calign(sizeof(imdi_chdr) + sizeof(imdi_imp));
+	for (e = 0; e < it->nintabs; e++) {
+		it->in_tables[e] = (void *)(base + off);
+		off = calign(off + it->in_tsize[e]);
+	}
+	if (it->sw_table != NULL) {
+		it->sw_table = (void *)(base + off);
+		off = calign(off + it->sw_tsize);
+	} else {
+		off = calign(off);
+	}
+	it->im_table = (void *)(base + off);
+	off = calign(off + it->im_tsize);
+	for (e = 0; e < it->nouttabs; e++) {
+		it->out_tables[e] = (void *)(base + off);
+		off = calign(off + it->out_tsize[e]);
+	}
+
+	if (off != size) {		/* Shouldn't happen */
+		it->cbase = NULL;
+		free(it);
+#ifdef UNIX
+		munmap(base, size);
+#else
+		free(base);
+#endif
+		return NULL;
+	}
+
+	return it;
+}
@@ -75,6 +75,7 @@ struct _tabspec {
 	int vo_om;	/* Vertex Offset scaling multiplier */
 
 	int im_cd;	/* Non-zero if interpolation table entries are padded with fraction */
+	int im_rd;	/* Non-zero if the interpolated value is rounded rather than truncated */
 	int im_ts;	/* Interp. multidim :- total interp table entry size in bytes */
 	int im_oc;	/* # Interp. multidim :- offset scale to apply to index into interp entry */
 	int im_fs;	/* Interp. multidim :- full table entry size in bytes */
@@ -100,7 +101,9 @@ typedef enum {
 	conv_irep  = 0x04,	/* Input representation conversion */
 	conv_orep  = 0x08,	/* Output representation conversion */
 	conv_rev   = 0x10,	/* Reverse direction conversion */
-	conv_skip  = 0x20	/* Skip output channel write conversion */
+	conv_skip  = 0x20,	/* Skip output channel write conversion */
+	conv_ifloat = 0x40,	/* Input float to pixint16 conversion */
+	conv_ofloat = 0x80	/* Output pixint16 to float conversion */
 } imdi_conv;
 
 /* The actual run time table that tabspec describes */
@@ -119,6 +122,15 @@ typedef struct {
 	void (*interp)(struct _imdi *s, void **outp, int outst,	/* Underlying conversion function */
 	                                void **inp, int inst,
 	                                unsigned int npixels);
+
+	/* Float conversion data */
+	imdi_pixrep cfirep;			/* Float input representation called with, if conv_ifloat */
+	imdi_pixrep cforep;			/* Float output representation called with, if conv_ofloat */
+	imdi_options copt;			/* Stride options called with */
+	void (*finterp)(struct _imdi *s, void **outp, int outst,	/* pixint16 conversion function */
+	                                void **inp, int inst,
+	                                unsigned int npixels);
+
 	/* Output channel check data */
 	unsigned long checkv[IXDO];	/* Output per channel check values. Set flag if != checkv */
 	unsigned int checkf;		/* Output per channel check flags (one per bit) */
@@ -132,9 +144,22 @@ typedef struct {
 	int nintabs;				/* Number of input tables */
 	int nouttabs;				/* Number of output tables */
 
+	unsigned long in_tsize[IXDI];	/* Size of each input table in bytes */
+	unsigned long sw_tsize;		/* Size of simplex table in bytes */
+	unsigned long im_tsize;		/* Size of interpolation table in bytes */
+	unsigned long out_tsize[IXDO];	/* Size of each output table in bytes */
+	void *cbase;				/* If not NULL, cache file image the tables are in */
+	unsigned long csize;		/* Size of cache file image */
+
 	/* Extra reporting data */
 	unsigned long size;			/* Number of bytes allocated to imdi_imp */
 	unsigned int gres, sres;	/* Grid and simplex table resolutions. sres = 0 = sort */
+
+	/* Table layout needed by vector kernels (see imdi_vec.c) */
+	int vk_sx_ab;				/* Simplex index size in bits */
+	int vk_sm_ts;				/* Simplex table entry size in bytes */
+	int vk_im_ts;				/* Interp. table entry size in bytes */
+	int vk_im_oc;				/* Interp. table vertex offset scale */
 } imdi_imp;
 
 /*
@@ -167,4 +192,49 @@ imdi_tab(
 
 void imdi_tab_free(imdi_imp *it);
 
+/* Save the tables to a cache file. Return nz on error. */
+int imdi_tab_save(
+	imdi_imp *it,		/* Tables to save */
+	char *fname,		/* Cache file name */
+	genspec *gs,		/* Pointer to gen spec used to create it */
+	tabspec *ts,		/* Pointer to table spec used to create it */
+	imdi_conv cnv,		/* Runtime argument conversion needed */
+	imdi_pixrep irep,	/* High level input pixel representation */
+	imdi_pixrep orep,	/* High level output pixel representation */
+	int *inm,			/* Input raster channel to callback channel mapping, NULL for none. */
+	int *outm,			/* Output raster channel to callback channel mapping, NULL for none. */
+	imdi_ooptions oopt,	  /* Output per channel options */
+	unsigned int *checkv  /* Output channel check values, NULL for none */
+);
+
+/* Create the tables from a cache file written by imdi_tab_save() */
+/* with the same arguments. Return NULL if it doesn't exist or doesn't match. */
+imdi_imp *
+imdi_tab_load(
+	char *fname,		/* Cache file name */
+	genspec *gs,		/* Pointer to gen spec */
+	tabspec *ts,		/* Pointer to table spec */
+	imdi_conv cnv,		/* Runtime argument conversion needed */
+	imdi_pixrep irep,	/* High level input pixel representation to match  */
+	imdi_pixrep orep,	/* High level output pixel representation to match */
+	void (*interp)(struct _imdi *s, void **outp, int outst,	/* Underlying conversion function */
+	                                void **inp, int inst,
+	                                unsigned int npixels),
+	int *inm,			/* Input raster channel to callback channel mapping, NULL for none. */
+	int *outm,			/* Output raster channel to callback channel mapping, NULL for none. */
+	imdi_ooptions oopt,	  /* Output per channel options */
+	unsigned int *checkv  /* Output channel check values, NULL for none */
+);
+
+/*
+ * Return a vector instruction set version of the kernel
+ * that imdi_tab() has setup tables for, or NULL if there
+ * isn't one, or the CPU doesn't support it.
+ */
+void (*imdi_vec_kernel(
+	genspec *gs,		/* Pointer to gen spec of scalar kernel used */
+	tabspec *ts,		/* Pointer to table spec of scalar kernel used */
+	imdi_imp *it		/* Tables setup for the scalar kernel */
+))(struct _imdi *s, void **outp, int outst, void **inp, int inst, unsigned int npixels);
+
 #endif /* IMDI_TAB_H */
@@ -0,0 +1,244 @@
+
+/* Integer Multi-Dimensional Interpolation */
+
+/*
+ * Copyright 2020 Graeme W. Gill
+ * All rights reserved.
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * Vector instruction set versions of some of the generated kernels.
+ *
+ * These use exactly the same tables as the corresponding generated
+ * 'C' kernel (and therefore give the same results), but process
+ * 8 pixels at a time using AVX2 16 bit lane arithmetic.
+ * They can only be used if the CPU supports the instruction set
+ * (checked at run time using CPUID), and handle any tail of pixels
+ * by calling the scalar kernel, which remains the fallback.
+ *
+ * Currently covered are the commonest 8 bit kernels: pixel interleaved
+ * 8 bit in and out, 8 bit precision, simplex table (not sort), 1 to 4
+ * input channels, 3 or 4 output channels, no stride, forward direction
+ * and no per channel output options. This includes RGB->RGB, RGB->CMYK,
+ * CMYK->RGB and CMYK->CMYK 8 bit conversions as used by cctiff.
+ *
+ * The generated scalar kernels already accumulate all the output
+ * channels in a single 64 bit word, and are limited by table lookup
+ * latency rather than arithmetic, so (as measured on recent x86)
+ * the vector kernels are no faster, and AVX2 gathers are much slower.
+ * They are therefore only used if the environment variable
+ * ARGYLL_IMDI_VECTOR is set, so that they can be compared against
+ * the scalar kernels on other machines.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "imdi.h"
+#include "imdi_tab.h"
+
+#undef VERBOSE
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+# define IMDI_AVX2		/* Compiler can target AVX2 & check the CPU for it */
+#endif
+
+#ifdef IMDI_AVX2
+
+#include <immintrin.h>
+
+#define VNPIX 8			/* Pixels per vector group */
+
+/* Return nz if the CPU supports AVX2 */
+static int has_avx2(void) {
+	static int inited = 0;
+	static int avx2 = 0;
+
+	if (!inited) {
+		__builtin_cpu_init();
+		avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+		inited = 1;
+	}
+	return avx2;
+}
+
+/* AVX2 8 bit simplex table kernel body. */
+/* This is inlined with constant id and od, so that the */
+/* compiler can unroll the channel and vertex loops. */
+__attribute__((target("avx2"))) __inline__ __attribute__((always_inline))
+static void imdi_vk_avx2_i8_o8(
+imdi *s,			/* imdi context */
+void **outp,		/* pointer to output pointers */
+int  ostride,		/* optional output component stride (not supported) */
+void **inp,			/* pointer to input pointers */
+int  istride,		/* optional input component stride (not supported) */
+unsigned int npix,	/* Number of pixels to process */
+int id,				/* Number of input channels */
+int od				/* Number of output channels */
+) {
+	imdi_imp *p = (imdi_imp *)(s->impl);
+	unsigned char *ip = (unsigned char *)inp[0];
+	unsigned char *op = (unsigned char *)outp[0];
+	unsigned char *ot[IXDO];
+	unsigned char *sw_base = (unsigned char *)p->sw_table;
+	unsigned char *im_base = (unsigned char *)p->im_table;
+	unsigned int sx_ab = p->vk_sx_ab;
+	unsigned int sx_mask = (1 << p->vk_sx_ab) - 1;
+	unsigned int sm_ts = p->vk_sm_ts;
+	unsigned int im_ts = p->vk_im_ts;
+	unsigned int im_oc = p->vk_im_oc;
+	unsigned int i;
+	int e, f, j;
+
+	for (e = 0; e < od; e++)
+		ot[e] = (unsigned char *)p->out_tables[e];
+
+	for (i = 0; (npix - i) >= VNPIX; i += VNPIX, ip += VNPIX * id, op += VNPIX * od) {
+		unsigned char *imp[VNPIX];		/* Interpolation table cell pointers */
+		unsigned char *swp[VNPIX];		/* Simplex table entry pointers */
+		__m256i ova[2];				/* Accumulators for pixels 0..3 and 4..7 */
+		unsigned long long acc[VNPIX];
+
+		/* Lookup the input tables and split the combined */
+		/* interpolation and simplex index. */
+		for (j = 0; j < VNPIX; j++) {
+			unsigned int ti = 0;
+			for (e = 0; e < id; e++)
+				ti += ((unsigned int *)p->in_tables[e])[ip[j * id + e]];
+			imp[j] = im_base + (ti >> sx_ab) * im_ts;
+			swp[j] = sw_base + (ti & sx_mask) * sm_ts;
+		}
+
+		ova[0] = ova[1] = _mm256_setzero_si256();
+
+		/* For each vertex of the simplex */
+		for (f = 0; f <= id; f++) {
+			for (j = 0; j < 2; j++) {
+				unsigned char **imj = imp + 4 * j;
+				unsigned char **swj = swp + 4 * j;
+				unsigned int wo0, wo1, wo2, wo3;
+				__m256i vv, we;
+
+				/* Get the weight (low 16 bits) and vertex offset (high 16 bits) */
+				wo0 = ((unsigned int *)swj[0])[f];
+				wo1 = ((unsigned int *)swj[1])[f];
+				wo2 = ((unsigned int *)swj[2])[f];
+				wo3 = ((unsigned int *)swj[3])[f];
+
+				/* Fetch the 4 x 16 bit vertex values of 4 pixels */
+				vv = _mm256_setr_epi64x(
+				    *((long long *)(imj[0] + (wo0 >> 16) * im_oc)),
+				    *((long long *)(imj[1] + (wo1 >> 16) * im_oc)),
+				    *((long long *)(imj[2] + (wo2 >> 16) * im_oc)),
+				    *((long long *)(imj[3] + (wo3 >> 16) * im_oc)));
+
+				/* Replicate each weight into the 4 x 16 bit lanes of each pixel */
+				we = _mm256_setr_epi64x(wo0 & 0xffff, wo1 & 0xffff, wo2 & 0xffff, wo3 & 0xffff);
+				we = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(we, 0), 0);
+
+				/* Weight and accumulate. The table values are 8 bits and */
+				/* the weights sum to 256, so 16 bit lanes can't overflow. */
+				ova[j] = _mm256_add_epi16(ova[j], _mm256_mullo_epi16(vv, we));
+			}
+		}
+
+		_mm256_storeu_si256((__m256i *)&acc[0], ova[0]);
+		_mm256_storeu_si256((__m256i *)&acc[4], ova[1]);
+
+		/* Lookup the output tables and write the results */
+		for (j = 0; j < VNPIX; j++) {
+			unsigned long long ovv = acc[j];
+			for (e = 0; e < od; e++)
+				op[j * od + e] = ot[e][(ovv >> (16 * e + 8)) & 0xff];
+		}
+	}
+
+	/* Use the scalar kernel for the remaining pixels */
+	if (i < npix) {
+		void *tinp[IXDI], *toutp[IXDO];
+		tinp[0] = (void *)ip;
+		toutp[0] = (void *)op;
+		p->interp(s, toutp, ostride, tinp, istride, npix - i);
+	}
+}
+
+/* Instantiate the kernels for each combination of channels */
+#define IMDI_VK_AVX2(ID, OD)									\
+__attribute__((target("avx2")))									\
+static void imdi_vk_avx2_i8_o8_##ID##_##OD(imdi *s, void **outp, int ostride,	\
+                      void **inp, int istride, unsigned int npix) {	\
+	imdi_vk_avx2_i8_o8(s, outp, ostride, inp, istride, npix, ID, OD);	\
+}
+
+IMDI_VK_AVX2(1, 3)
+IMDI_VK_AVX2(1, 4)
+IMDI_VK_AVX2(2, 3)
+IMDI_VK_AVX2(2, 4)
+IMDI_VK_AVX2(3, 3)
+IMDI_VK_AVX2(3, 4)
+IMDI_VK_AVX2(4, 3)
+IMDI_VK_AVX2(4, 4)
+
+static void (*imdi_vk_avx2_i8_o8_tab[4][2])(imdi *s, void **outp, int ostride,
+                                     void **inp, int istride, unsigned int npix) = {
+	{ imdi_vk_avx2_i8_o8_1_3, imdi_vk_avx2_i8_o8_1_4 },
+	{ imdi_vk_avx2_i8_o8_2_3, imdi_vk_avx2_i8_o8_2_4 },
+	{ imdi_vk_avx2_i8_o8_3_3, imdi_vk_avx2_i8_o8_3_4 },
+	{ imdi_vk_avx2_i8_o8_4_3, imdi_vk_avx2_i8_o8_4_4 }
+};
+
+#endif /* IMDI_AVX2 */
+
+/* Return a vector version of the kernel described by gs and ts if */
+/* there is one and the CPU supports it, NULL otherwise. */
+/* it->interp must be the scalar kernel, since it is used for any */
+/* pixels the vector kernel doesn't handle. */
+void (*imdi_vec_kernel(
+	genspec *gs,		/* Pointer to gen spec of scalar kernel used */
+	tabspec *ts,		/* Pointer to table spec of scalar kernel used */
+	imdi_imp *it		/* Tables setup for the scalar kernel */
+))(struct _imdi *s, void **outp, int outst, void **inp, int inst, unsigned int npixels) {
+	char *ev;
+
+	if ((ev = getenv("ARGYLL_IMDI_VECTOR")) == NULL || ev[0] == '0')
+		return NULL;
+
+#ifdef IMDI_AVX2
+	/* See if this matches the table layout we can handle */
+	if (has_avx2()
+	 && gs->prec == 8
+	 && gs->irep == pixint8 && gs->orep == pixint8
+	 && (gs->opt & (opts_istride | opts_ostride | opts_bwd)) == 0
+	 && gs->oopt == oopts_none
+	 && gs->id >= 1 && gs->id <= 4
+	 && gs->od >= 3 && gs->od <= 4
+	 && it->cnv == conv_none
+	 && ts->sort == 0
+	 && ts->it_xs == 0 && ts->it_ts == 4
+	 && ts->sx_ab > 0 && ts->sx_ab < 32
+	 && ts->wo_xs != 0 && ts->wo_es == 4
+	 && ts->we_es == 2 && ts->we_eo == 0
+	 && ts->vo_es == 2 && ts->vo_eo == 2
+	 && ts->im_cd != 0 && ts->im_ts == 8
+	 && ((ts->im_fn == 1 && ts->im_fs == 8 && ts->im_pn == 0)
+	  || (ts->im_fn == 0 && ts->im_pn == 1 && ts->im_ps == 8))
+	 && ts->ot_ts == 1) {
+
+		it->vk_sx_ab = ts->sx_ab;
+		it->vk_sm_ts = ts->sm_ts;
+		it->vk_im_ts = ts->im_ts;
+		it->vk_im_oc = ts->im_oc;
+
+#ifdef VERBOSE
+		printf("imdi_vec_kernel: using AVX2 kernel for %d -> %d\n",gs->id,gs->od);
+#endif
+		return imdi_vk_avx2_i8_o8_tab[gs->id-1][gs->od-3];
+	}
+#endif /* IMDI_AVX2 */
+
+	return NULL;
+}
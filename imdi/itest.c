@@ -162,13 +162,13 @@ main(int argc, char *argv[]) {
 	int oprs[] = { 16, 0 };
 #else
 #ifndef FULL
-	int ids[] = { 1, 3, 4, 8, 0 };
-	int ods[] = { 1, 3, 4, 8, 0 };
+	int ids[] = { 1, 2, 3, 4, 8, 0 };
+	int ods[] = { 1, 2, 3, 4, 8, 0 };
 	int iprs[] = { 8, 8,  16, 0};
 	int oprs[] = { 8, 16, 16, 0};
 #else
-	int ids[] = { 1, 3, 4, 5, 6, 7, /* 8, */ 0 };
-	int ods[] = { 1, 3, 4, 5, 6, 7, /* 8, */ 0 };
+	int ids[] = { 1, 2, 3, 4, 5, 6, 7, /* 8, */ 0 };
+	int ods[] = { 1, 2, 3, 4, 5, 6, 7, /* 8, */ 0 };
 	int iprs[] = { 8, 8,  16, 0};
 	int oprs[] = { 8, 16, 16, 0};
 #endif
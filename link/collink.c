@@ -151,7 +151,9 @@
 #undef USE_APXLS			/* [und] Use least squares approximation setting cLUT */
 							/* (More accurate when on ?, but less smooth) */
 #define USE_CAM_CLIP_OPT	/* [def] Clip out of gamut in CAM space rather than XYZ or L*a*b* */
+#define USE_REV_HINT		/* [def] Start each inverse A2B search at the previous grid point */
 #define ENKHACK				/* [def] Enable K hack code */
+#define PREVIEW_RES 9		/* [9] Default preview link cLUT resolution */
 #undef PRESERVE_SYNC		/* [und] Preserve video encoded sync level values */ 		
 #undef WARN_CLUT_CLIPPING	/* [und] Print warning if setting clut clips */
 
@@ -171,6 +173,12 @@
 #include <fcntl.h>
 #include <string.h>
 #include <math.h>
+#if defined(UNIX)
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/wait.h>
+# include <unistd.h>
+#endif
 #include "copyright.h"
 #include "aconfig.h"
 #include "counters.h"
@@ -188,7 +196,7 @@
        .      
 
     abcdefghijklmnopqrstuvwxyz
-    ....... . .. ....... ..   
+    ....... ......  ....... .. .
 
     ABCDEFGHIJKLMNOPQRSTUVWXYZ
     . ....... . . ..  .. .    
@@ -207,6 +215,7 @@ void usage(char *diag, ...) {
 		fprintf(stderr,"\n");
 	}
 	fprintf(stderr,"usage: collink [options] srcprofile dstprofile linkedprofile\n");
+	fprintf(stderr,"   or: collink -S [options]   (read link jobs from stdin)\n");
 	fprintf(stderr," -v              Verbose\n");
 	fprintf(stderr," -A manufacturer Manufacturer description string\n");
 	fprintf(stderr," -M model        Model description string\n");
@@ -287,6 +296,8 @@ void usage(char *diag, ...) {
 	fprintf(stderr,"     e            eeColor .txt file\n");
 	fprintf(stderr,"     m            MadVR .3dlut\t file\n");
 	fprintf(stderr,"     c            IRIDAS .cube file\n");
+	fprintf(stderr,"     g            16 bit binary GPU texture .3dtex file\n");
+	fprintf(stderr,"     G            float binary GPU texture .3dtex file\n");
 	fprintf(stderr," -I B            Use BT.1886 source EOTF with technical gamma 2.4\n");
 	fprintf(stderr," -I b:g.g        Use BT.1886-like source EOTF with effective gamma g.g\n");
 	fprintf(stderr," -I b:p.p:g.g    Use effective gamma g.g source EOTF with p.p prop. output black point offset\n");
@@ -304,6 +315,10 @@ void usage(char *diag, ...) {
 	fprintf(stderr,"     x            xvYCC Rec601 YCbCr Rec709 Prims. SD (16-235,240)/255 \"TV\" levels\n");
 	fprintf(stderr,"     X            xvYCC Rec709 YCbCr Rec709 Prims. HD (16-235,240)/255 \"TV\" levels\n");
 	fprintf(stderr," -P              Create gamut gammap%s diagostic\n",vrml_ext());
+	fprintf(stderr," -m dir          Cache gamut maps and surfaces in directory dir\n");
+	fprintf(stderr," -W dir          Checkpoint progress to directory dir, and resume from it\n");
+	fprintf(stderr," -j n            Use n threads to compute the link (default %d)\n",num_threads());
+	fprintf(stderr," -z [res]        First write a preview link with a res cLUT (default %d)\n",PREVIEW_RES);
 	exit(1);
 }
 
@@ -362,15 +377,20 @@ struct _clink {
 	/* Overall options */
 	int verb;
 	int gamdiag;	/* nz, create gammap diagnostic */
+	char *gmcache;	/* Gamut map cache directory, NULL if none */
+	char *ckname[2];	/* Preview & link clut checkpoint file names, NULL if none */
+	int nthreads;	/* Threads used to compute the link clut, 0 = default */
 	int total, count, last;	/* Progress count information */
 	int mode;		/* 0 = simple mode, 1 = mapping mode, 2 = mapping mode with inverse A2B */
 	int quality;	/* 0 = low, 1 = medium, 2 = high, 3 = ultra */
 	int clutres;	/* 0 = quality default, !0 = override, then actual during link */
+	int prevres;	/* nz = resolution of preview link written before the full link */
 	int src_kbp;	/* nz = Use K only black point as src gamut black point */
 	int dst_kbp;	/* nz = Use K only black point as dst gamut black point */
 	int dst_cmymap;	/* masks C = 1, M = 2, Y = 4 to force 100% cusp map */
 	int tdlut;		/* nz = 3DLut output, 1 = eeColor format, 2 = MadVR format */
-					/*                    3 = .cube format */
+					/*                    3 = .cube format, 4 = 16 bit GPU texture, */
+					/*                    5 = float GPU texture */
 	double coscale[3];		/* eeColor cLUT output de-scale/"second" 1D lut scale */
 
 	icColorSpaceSignature pcsor;	/* PCS to use between in & out profiles */
@@ -1754,6 +1774,260 @@ void devop_devo(void *cntx, double *out, double *in) {
 #endif
 }
 
+/* ------------------------------------------- */
+/* Threaded link clut creation. */
+
+/* icmSetMultiLutTables() calls devip_devop() serially for each grid */
+/* point (and cell center), and nearly all the time goes in the chain */
+/* of lookups, gamut mapping and output inversion. So we run */
+/* icmSetMultiLutTables() once with a clut callback that just records */
+/* the DevIn' values it wants, compute the DevOut' values for all of */
+/* them using several threads, each with its own copy of the clink, */
+/* and then run icmSetMultiLutTables() again with a clut callback that */
+/* plays the results back in the same order. The forward lookups, gamut */
+/* mapping and rspl interpolation are shared by the threads, while each */
+/* thread gets its own copy of any icxLuLut that gets inverted (see */
+/* icxLuLut inv_thread_ctx()). If a checkpoint file is being used, the */
+/* leading points that have been computed are saved every CKPT_MSEC, */
+/* and restored when re-run. */
+
+#define CLUT_THR_CHUNK 32		/* Number of points a thread computes at a time */
+#define CKPT_MSEC (120 * 1000)	/* Interval between link checkpoint saves */
+
+typedef struct {
+	clink *li;				/* Link being created */
+	int npts, apts;			/* Number of points recorded, allocated */
+	double *in;				/* npts DevIn' values */
+	double *out;			/* npts DevOut' values */
+	int ix;					/* Next point to play back */
+
+	clink *tli;				/* Per thread link contexts */
+	amutex lock;			/* Lock for next and the progress count */
+	int next;				/* Next point to be computed */
+
+	char *ckname;			/* Checkpoint file name, NULL if none */
+	char *cdone;			/* Flag per chunk, nz when computed */
+	int ndone;				/* Number of leading points computed */
+	unsigned int lastsave;	/* msec_time() of last checkpoint save */
+	rand_state rst;			/* Random state at the start of the computation */
+} clut_thr;
+
+/* Input and output table callbacks for recording and playback */
+static void devi_devip_thr(void *cntx, double *out, double *in) {
+	devi_devip((void *)((clut_thr *)cntx)->li, out, in);
+}
+
+static void devop_devo_thr(void *cntx, double *out, double *in) {
+	devop_devo((void *)((clut_thr *)cntx)->li, out, in);
+}
+
+/* Record clut callback */
+static void devip_devop_rec(void *cntx, double *out, double *in) {
+	clut_thr *p = (clut_thr *)cntx;
+	int i;
+
+	if (p->npts >= p->apts) {
+		p->apts = p->apts * 2 + 1024;
+		if ((p->in = (double *)realloc(p->in, p->apts * p->li->in.chan * sizeof(double))) == NULL
+		 || (p->out = (double *)realloc(p->out, p->apts * p->li->out.chan * sizeof(double))) == NULL)
+			error("Malloc of link point list failed");
+	}
+	for (i = 0; i < p->li->in.chan; i++)
+		p->in[p->npts * p->li->in.chan + i] = in[i];
+	p->npts++;
+
+	/* Return something harmless */
+	for (i = 0; i < p->li->out.chan; i++)
+		out[i] = 0.0;
+}
+
+/* Playback clut callback */
+static void devip_devop_play(void *cntx, double *out, double *in) {
+	clut_thr *p = (clut_thr *)cntx;
+	int i;
+
+	if (p->ix >= p->npts)
+		error("Internal, link playback doesn't match the recording");
+	for (i = 0; i < p->li->in.chan; i++) {
+		if (in[i] != p->in[p->ix * p->li->in.chan + i])
+			error("Internal, link playback doesn't match the recording");
+	}
+
+	for (i = 0; i < p->li->out.chan; i++)
+		out[i] = p->out[p->ix * p->li->out.chan + i];
+	p->ix++;
+}
+
+/* Compute thread. Threads take CLUT_THR_CHUNK points at a time, */
+/* so that each thread's reverse cache sees neighbouring points. */
+static int devip_devop_thread(void *cntx, int ix, int nth) {
+	clut_thr *p = (clut_thr *)cntx;
+	clink *li = p->li;
+	int i = 0, j, done = 0;
+
+	for (;;) {
+		amutex_lock(p->lock);
+		if (li->verb && done > 0) {		/* Output percent intervals */
+			int pc;
+			li->count += done;
+			pc = (int)(li->count * 100.0/li->total + 0.5);
+			if (pc != li->last) {
+				printf("%c%2d%%",cr_char,pc); fflush(stdout);
+				li->last = pc;
+			}
+		}
+		if (p->ckname != NULL && done > 0) {	/* i is the end of the chunk done */
+			p->cdone[(i-1)/CLUT_THR_CHUNK] = 1;
+			while (p->ndone < p->npts && p->cdone[p->ndone/CLUT_THR_CHUNK])
+				p->ndone += CLUT_THR_CHUNK;
+			if (p->ndone > p->npts)
+				p->ndone = p->npts;
+			if ((msec_time() - p->lastsave) >= CKPT_MSEC) {
+				if (ckpt_save_pts(p->ckname, li->in.chan, li->out.chan, p->npts, p->in,
+				                  p->ndone, p->out, &p->rst, sizeof(rand_state)) != 0)
+					warning("Saving link checkpoint '%s' failed",p->ckname);
+				p->lastsave = msec_time();
+			}
+		}
+		i = p->next;
+		p->next += CLUT_THR_CHUNK;
+		amutex_unlock(p->lock);
+
+		if (i >= p->npts)
+			break;
+		if ((j = i + CLUT_THR_CHUNK) > p->npts)
+			j = p->npts;
+		for (done = 0; i < j; i++, done++)
+			devip_devop((void *)&p->tli[ix], p->out + i * li->out.chan,
+			                                 p->in + i * li->in.chan);
+	}
+	return 0;
+}
+
+/* Set the link tables using li->nthreads to compute the clut, */
+/* 0 for the default number. If ckname != NULL, checkpoint the */
+/* computed points to it. Return as icmSetMultiLutTables(). */
+static int set_link_tables(
+	clink *li,
+	char *ckname,
+	icmLut *wo,
+	int flags,
+	int *apxls_min,
+	int *apxls_max
+) {
+	clut_thr tx;
+	int nthreads = li->nthreads;
+	int incp, outcp;		/* nz if the in/out icxLuLut need a copy per thread */
+	int i, rv;
+
+	if (nthreads <= 0)
+		nthreads = num_threads();
+	if (nthreads > NUMTHR_MAX)
+		nthreads = NUMTHR_MAX;
+
+	/* The input icxLuLut is inverted to get the K locus or value, */
+	/* and the output icxLuLut is inverted when using its A2B. */
+	incp = !li->calonly && li->in.alg == icmLutType
+	    && (li->out.inking == 0 || li->out.inking == 6);
+	outcp = !li->calonly && li->out.alg == icmLutType && li->mode >= 2;
+
+	/* Inverting a CMYK output with an inking rule that targets a K locus, */
+	/* or a K value from another lookup, can resolve a few clipped points */
+	/* differently depending on what each thread's reverse cache has seen, */
+	/* so do these serially to make the link independent of nthreads. */
+	/* These can't be checkpointed either. */
+	if ((nthreads == 1 && ckname == NULL)
+	 || (outcp && ((icxLuLut *)li->out.luo)->clutTable->di > ((icxLuLut *)li->out.luo)->clutTable->fdi
+	  && li->out.ink.k_rule != icxKluma5k && li->out.ink.k_rule != icxKl5lk)) {
+		return icmSetMultiLutTables(1, &wo, flags, li, li->in.csp, li->out.csp,
+		                            devi_devip, NULL, NULL, devip_devop, NULL, NULL,
+		                            devop_devo, apxls_min, apxls_max);
+	}
+
+	memset((void *)&tx, 0, sizeof(clut_thr));
+	tx.li = li;
+
+	/* Find out what points are needed */
+	if ((rv = icmSetMultiLutTables(1, &wo, flags, &tx, li->in.csp, li->out.csp,
+	                            devi_devip_thr, NULL, NULL, devip_devop_rec, NULL, NULL,
+	                            devop_devo_thr, apxls_min, apxls_max)) != 0) {
+		free(tx.in);
+		free(tx.out);
+		return rv;
+	}
+
+	/* Restore any points computed by a previous run, and the random */
+	/* state it started with, in case the lookups use random numbers. */
+	if (ckname != NULL) {
+		tx.ckname = ckname;
+		if ((tx.cdone = (char *)calloc(tx.npts/CLUT_THR_CHUNK + 1, sizeof(char))) == NULL)
+			error("Malloc of link checkpoint flags failed");
+		if ((tx.ndone = ckpt_load_pts(ckname, li->in.chan, li->out.chan, tx.npts, tx.in,
+		                              tx.out, &tx.rst, sizeof(rand_state))) >= 0) {
+			rand_copy(NULL, &tx.rst);
+			if (tx.ndone < tx.npts)		/* Saved prefixes are whole chunks */
+				tx.ndone -= tx.ndone % CLUT_THR_CHUNK;
+			for (i = 0; i < tx.ndone/CLUT_THR_CHUNK; i++)
+				tx.cdone[i] = 1;
+			tx.next = tx.ndone;
+			if (li->verb) {
+				li->count += tx.ndone;
+				printf("\nRestored %d of %d link points from checkpoint\n",tx.ndone,tx.npts);
+			}
+		} else {
+			tx.ndone = 0;
+			rand_copy(&tx.rst, NULL);
+		}
+		tx.lastsave = msec_time();
+	}
+
+	/* Create the per thread contexts */
+	if ((tx.tli = (clink *)calloc(nthreads, sizeof(clink))) == NULL)
+		error("Malloc of link thread contexts failed");
+	for (i = 0; i < nthreads; i++) {
+		tx.tli[i] = *li;
+		tx.tli[i].verb = 0;		/* Progress is done by devip_devop_thread() */
+		tx.tli[i].wphacked = tx.tli[i].bkhacked = 0;
+		if (incp && (tx.tli[i].in.luo = (icxLuBase *)((icxLuLut *)li->in.luo)->inv_thread_ctx(
+		                                (icxLuLut *)li->in.luo, nthreads)) == NULL)
+			error("Creating link thread context failed: %d, %s",li->in.x->errc,li->in.x->err);
+		if (outcp && (tx.tli[i].out.luo = (icxLuBase *)((icxLuLut *)li->out.luo)->inv_thread_ctx(
+		                                (icxLuLut *)li->out.luo, nthreads)) == NULL)
+			error("Creating link thread context failed: %d, %s",li->out.x->errc,li->out.x->err);
+	}
+	amutex_init(tx.lock);
+
+	par_exec(nthreads, devip_devop_thread, (void *)&tx);
+
+	amutex_del(tx.lock);
+	for (i = 0; i < nthreads; i++) {
+		li->wphacked += tx.tli[i].wphacked;
+		li->bkhacked += tx.tli[i].bkhacked;
+		if (incp)
+			tx.tli[i].in.luo->del(tx.tli[i].in.luo);
+		if (outcp)
+			tx.tli[i].out.luo->del(tx.tli[i].out.luo);
+	}
+	free(tx.tli);
+
+	if (ckname != NULL) {
+		if (ckpt_save_pts(ckname, li->in.chan, li->out.chan, tx.npts, tx.in, tx.npts,
+		                  tx.out, &tx.rst, sizeof(rand_state)) != 0)
+			warning("Saving link checkpoint '%s' failed",ckname);
+		free(tx.cdone);
+	}
+
+	/* Set the tables from the results */
+	tx.ix = 0;
+	rv = icmSetMultiLutTables(1, &wo, flags, &tx, li->in.csp, li->out.csp,
+	                          devi_devip_thr, NULL, NULL, devip_devop_play, NULL, NULL,
+	                          devop_devo_thr, apxls_min, apxls_max);
+
+	free(tx.in);
+	free(tx.out);
+	return rv;
+}
+
 /* ------------------------------------------- */
 /* Fixup L -> K only lookup table white and black values, */
 /* to compensate for inexact rspl fitting */
@@ -1872,8 +2146,43 @@ int write_MadVR_3DLut(clink *li, icc *icc, char *fname);
 
 int write_cube_3DLut(clink *li, icc *icc, char *fname);
 
-int
-main(int argc, char *argv[]) {
+int write_gpu_3DLut(clink *li, icc *icc, char *fname, int isflt);
+
+/* ------------------------------------------- */
+/* Profiles kept resident by the link server. The server */
+/* reads them before it forks each job, so each job gets */
+/* its own copy of the opened profile without reading it. */
+
+typedef struct {
+	char *name;			/* File name */
+	time_t mtime;		/* File modification time when read */
+	size_t size;		/* File size when read */
+	icc *c;				/* Profile with all its tags read */
+	int used;			/* nz if handed to this job */
+} rprof;
+
+static rprof *rprofs = NULL;	/* Resident profiles */
+static int nrprofs = 0;
+
+/* Open a profile, ICC or embedded in a TIFF or JPEG, */
+/* using the resident copy if there is one. */
+/* Return NULL on error */
+static icc *open_profile(char *name) {
+	int i;
+
+	for (i = 0; i < nrprofs; i++) {
+		/* A resident profile is only handed out once, */
+		/* since the job will del() what it gets. */
+		if (strcmp(rprofs[i].name, name) == 0 && !rprofs[i].used) {
+			rprofs[i].used = 1;
+			return rprofs[i].c;
+		}
+	}
+	return read_embedded_icc(name);
+}
+
+static int
+make_link(int argc, char *argv[]) {
 	int fa, nfa, mfa;				/* argument we're looking at */
 	char in_name[MAXNAMEL+1] = "\000";
 	char sgam_name[MAXNAMEL+1] = "\000";	/* Source gamut name */
@@ -1882,6 +2191,7 @@ main(int argc, char *argv[]) {
 	char out_name[MAXNAMEL+1] = "\000";
 	char link_name[MAXNAMEL+1] = "\000";
 	char tdlut_name[MAXNAMEL+1] = "\000";
+	char prev_name[MAXNAMEL+1] = "\000";
 	int verify = 0;				/* Do verify pass */
 	int outinkset = 0;			/* The user specfied an output inking */
 	int intentset = 0;			/* The user specified an intent */
@@ -1898,10 +2208,13 @@ main(int argc, char *argv[]) {
 	int in_curve_res = 0;		/* Input profile A2B input curve resolution (if known) */
 	int out_curve_res = 0;		/* Output profile B2A output curve resolution (if known) */
 	profxinf xpi;				/* Extra profile information */
+	char *ckdir = NULL;			/* Checkpoint directory, NULL if none */
+	char ckkey[33];				/* Checkpoint key */
 	int i;
 
 	error_program = argv[0];
 	check_if_not_interactive();
+	a1tm_start("collink");
 	memset((void *)&xpi, 0, sizeof(profxinf));	/* Init extra profile info to defaults */
 	memset((void *)&li, 0, sizeof(clink));
 
@@ -2499,6 +2812,12 @@ main(int argc, char *argv[]) {
 					case 'c':
 						li.tdlut = 3;
 						break;
+					case 'g':
+						li.tdlut = 4;
+						break;
+					case 'G':
+						li.tdlut = 5;
+						break;
 					default:
 						usage("3DLut format (-3) argument '%s' not recognised",na);
 				}
@@ -2607,6 +2926,40 @@ main(int argc, char *argv[]) {
 			else if (argv[fa][1] == 'P')
 				li.gamdiag = 1;
 
+			/* Gamut map cache directory */
+			else if (argv[fa][1] == 'm') {
+				fa = nfa;
+				if (na == NULL) usage("Expect directory argument to -m flag");
+				li.gmcache = na;
+			}
+
+			/* Checkpoint directory */
+			else if (argv[fa][1] == 'W') {
+				fa = nfa;
+				if (na == NULL) usage("Expect directory argument to -W flag");
+				ckdir = na;
+			}
+
+			/* Number of threads */
+			else if (argv[fa][1] == 'j') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -j flag");
+				li.nthreads = atoi(na);
+				if (li.nthreads < 1)
+					usage("Argument to -j flag must be 1 or more");
+			}
+
+			/* Preview link */
+			else if (argv[fa][1] == 'z') {
+				li.prevres = PREVIEW_RES;
+				if (na != NULL) {
+					fa = nfa;
+					li.prevres = atoi(na);
+					if (li.prevres < 2 || li.prevres > 255)
+						usage("Preview resolution flag (-z) argument out of range (%d)",li.prevres);
+				}
+			}
+
 			else 
 				usage("Unknown flag '%c'",argv[fa][1]);
 		} else
@@ -2643,6 +2996,28 @@ main(int argc, char *argv[]) {
 	if (fa >= argc || argv[fa][0] == '-') usage("Missing result profile");
 	strncpy(link_name,argv[fa++],MAXNAMEL); link_name[MAXNAMEL] = '\000';
 
+	/* Checkpoints are identified by the arguments and the files they name, */
+	/* and gamut maps are cached in the checkpoint directory by default. */
+	if (ckdir != NULL) {
+		if (ckpt_key(ckkey, argc, argv, "v", "jmW", NULL, link_name) != 0)
+			error("Unable to create checkpoint key");
+		if ((li.ckname[0] = ckpt_name(ckdir, ckkey, "prev")) == NULL
+		 || (li.ckname[1] = ckpt_name(ckdir, ckkey, "link")) == NULL)
+			error("Malloc of checkpoint file names failed");
+		if (li.gmcache == NULL)
+			li.gmcache = ckdir;
+	}
+
+	if (li.prevres > 0) {		/* Preview link name is link name with _prev */
+		char *xl, *xr;
+		strncpy(prev_name,link_name,MAXNAMEL-5); prev_name[MAXNAMEL-5] = '\000';
+		if ((xl = strrchr(prev_name, '.')) == NULL)	/* Figure where extention is */
+			xl = prev_name + strlen(prev_name);
+		xr = link_name + (xl - prev_name);
+		strcpy(xl,"_prev");
+		strncat(xl,xr,MAXNAMEL-strlen(prev_name));
+	}
+
 	if (li.tdlut) {
 		char *xl;
 		if (li.tdlut == 1) {		/* eeColor */
@@ -2673,6 +3048,15 @@ main(int argc, char *argv[]) {
 
 			if (li.clutres == 0)
 				li.clutres = 65;		/* This is good for video encoding levels */
+
+		} else {					/* GPU texture */
+			strncpy(tdlut_name,link_name,MAXNAMEL-6); tdlut_name[MAXNAMEL-6] = '\000';
+			if ((xl = strrchr(tdlut_name, '.')) == NULL)	/* Figure where extention is */
+				xl = tdlut_name + strlen(tdlut_name);
+			strcpy(xl,".3dtex");
+
+			if (li.clutres == 0)
+				li.clutres = 65;
 		}
 	} else {
 		if (li.clutres > 255) usage("Resolution flag (-r) argument out of range (%d)",li.clutres);
@@ -2788,6 +3172,19 @@ main(int argc, char *argv[]) {
 				li.out.nocurve = 1;
 			}
 		}
+
+		/* GPU texture format. The texture is the cLUT grid, with no curves */
+		else {
+
+			if (li.in.nocurve == 0) {
+				warning("Disabling input curves for GPU 3DLut creation");
+				li.in.nocurve = 1;
+			}
+			if (li.out.nocurve == 0) {
+				warning("Disabling output curves for GPU 3DLut creation");
+				li.out.nocurve = 1;
+			}
+		}
 	}
 
 	/* - - - - - - - - - - - - - - - - - - - */
@@ -2981,10 +3378,11 @@ main(int argc, char *argv[]) {
 		/* and we don't currently have a way of detecting this */
 	}
 
+	a1tm_start("profile setup");
 	if (!calonly) {
 
 		/* Open up the input device profile for reading, and read header etc. */
-		if ((li.in.c = read_embedded_icc(in_name)) == NULL)
+		if ((li.in.c = open_profile(in_name)) == NULL)
 			error ("Can't open file '%s'",in_name);
 		li.in.h = li.in.c->header;
 
@@ -2999,6 +3397,10 @@ main(int argc, char *argv[]) {
 		if ((li.in.x = new_xicc(li.in.c)) == NULL)
 			error ("Creation of input profile xicc failed");
 
+		/* Keep its gamut surfaces with the gamut maps */
+		if (li.gmcache != NULL && li.in.x->set_cache(li.in.x, li.gmcache) != 0)
+			error ("%d, %s",li.in.x->errc, li.in.x->err);
+
 		/* Set the default ink limits if not set on command line */
 		icxDefaultLimits(li.in.x, &li.in.ink.tlimit, li.in.ink.tlimit, &li.in.ink.klimit, li.in.ink.klimit);
 
@@ -3035,7 +3437,7 @@ main(int argc, char *argv[]) {
 		}
 		/* - - - - - - - - - - - - - - - - - - - */
 		/* Open up the output device output profile for reading, and read header etc. */
-		if ((li.out.c = read_embedded_icc(out_name)) == NULL)
+		if ((li.out.c = open_profile(out_name)) == NULL)
 			error ("Can't open file '%s'",out_name);
 		li.out.h = li.out.c->header;
 
@@ -3049,6 +3451,10 @@ main(int argc, char *argv[]) {
 		if ((li.out.x = new_xicc(li.out.c)) == NULL)
 			error ("Creation of output profile xicc failed");
 
+		/* Keep its gamut surfaces with the gamut maps */
+		if (li.gmcache != NULL && li.out.x->set_cache(li.out.x, li.gmcache) != 0)
+			error ("%d, %s",li.out.x->errc, li.out.x->err);
+
 		/* Set the default ink limits if not set on command line */
 		icxDefaultLimits(li.out.x, &li.out.ink.tlimit, li.out.ink.tlimit, &li.out.ink.klimit, li.out.ink.klimit);
 
@@ -3414,6 +3820,9 @@ main(int argc, char *argv[]) {
 #endif
 #ifdef USE_CAM_CLIP_OPT
 			fl |= ICX_CAM_CLIP;
+#endif
+#ifdef USE_REV_HINT
+			fl |= ICX_REV_HINT;		/* cLUT grid points are inverted in neighbour order */
 #endif
 			if (li.verb)
 				printf("Loading output inverse A2B table\n");
@@ -3660,6 +4069,16 @@ main(int argc, char *argv[]) {
 				error("Output profile must be RGB to output .cube 3DLut");
 		}
 
+		/* GPU texture format. */
+		else {
+
+			if (li.in.csp != icSigRgbData)
+				error("Input profile must be RGB to output GPU 3DLut");
+
+			if (li.out.csp != icSigRgbData)
+				error("Output profile must be RGB to output GPU 3DLut");
+		}
+
 
 		if (li.in.tvenc) {
 			if (li.in.csp != icSigRgbData)
@@ -3681,6 +4100,8 @@ main(int argc, char *argv[]) {
 	if (li.verb && li.mode > 0)
 		printf("Gamut mapping intent is '%s'\n",li.gmi.desc);
 
+	a1tm_end();
+
 	/* In gamut mapping mode, the PCS used will always be absolute */
 	/* intent from the input and output profiles, and either */
 	/* lab or Jab space, with the given in/out viewing conditions */
@@ -3692,6 +4113,7 @@ main(int argc, char *argv[]) {
 		double dgres;			/* Destination gamut surface feature resolution */
 		int    mapres;			/* Mapping rspl resolution */
 
+		a1tm_start("gamut mapping");
 		if (li.verb)
 			printf("Creating Gamut Mapping\n");
 
@@ -3757,7 +4179,7 @@ main(int argc, char *argv[]) {
 		if (li.verb)
 			printf(" Creating Gamut match\n");
 
-		li.map = new_gammap(li.verb, csgam, igam, ogam, &li.gmi,
+		li.map = new_gammap_cache(li.gmcache, li.verb, csgam, igam, ogam, &li.gmi,
 		                    NULL, li.src_kbp, li.dst_kbp, li.cmyhack, li.rel_oride,
 		                    mapres, NULL, NULL, li.gamdiag ? "gammap" : NULL
 		);
@@ -3768,7 +4190,7 @@ main(int argc, char *argv[]) {
 			if (li.verb)
 				printf(" Creating K only black to K only black Gamut match\n");
 
-			li.Kmap = new_gammap(li.verb, csgam, igam, ogam, &li.gmi,
+			li.Kmap = new_gammap_cache(li.gmcache, li.verb, csgam, igam, ogam, &li.gmi,
 			                    NULL, 1, 1, li.cmyhack, li.rel_oride,
 			                    mapres, NULL, NULL, li.gamdiag ? "gammap" : NULL
 			);
@@ -3780,6 +4202,7 @@ main(int argc, char *argv[]) {
 		if (igam != NULL)
 			igam->del(igam);
 		csgam->del(csgam);
+		a1tm_end();
 	}
 
 	/* If we've got a request for Absolute Appearance mode with scaling */
@@ -3967,7 +4390,7 @@ main(int argc, char *argv[]) {
 		if ((wr_fp = new_icmFileStd_name(link_name,"w")) == NULL)
 			error ("Write: Can't open file '%s'",link_name);
 
-		if ((wr_icc = new_icc()) == NULL)
+		if ((wr_icc = new_icc_a1ma()) == NULL)
 			error ("Write: Creation of ICC object failed");
 
 		/* Add all the tags required */
@@ -4319,6 +4742,7 @@ main(int argc, char *argv[]) {
 		/* 16 bit input device -> output device lut: */
 		{
 			int inputEnt, outputEnt, clutPoints;
+			int pass;
 			int *apxls_min = NULL, *apxls_max = NULL;
 			int tapxls_min[MAX_CHAN], tapxls_max[MAX_CHAN];
 			icmLut *wo;
@@ -4454,40 +4878,6 @@ main(int argc, char *argv[]) {
 				outputEnt = 1024;		/* Not used */
 			}
 
-			/* Limits are grid indexes that should not be adjusted by SET_APXLS */
-			/* Grid index is not adjusted if it's within 10% of device value limits */
-			if (li.in.tvenc == 1) {			/* Video encoded */
-				apxls_min = tapxls_min;
-				apxls_max = tapxls_max;
-				for (i = 0; i < li.in.chan; i++) {
-					if (clutPoints <= 65) {
-						apxls_min[i] = (int)(4.0/64.0 * (clutPoints-1.0) + 0.9);
-						apxls_max[i] = (int)(58.0/64.0 * (clutPoints-1.0) + 0.1);
-					} else {
-						apxls_min[i] = (int)(16.0/255.0 * (clutPoints-1.0) + 0.9);
-						apxls_max[i] = (int)(235.0/255.0 * (clutPoints-1.0) + 0.1);
-					}
-				}
-			} else if (li.in.tvenc >= 3) {	/* YCbCr encoded */
-				apxls_min = tapxls_min;
-				apxls_max = tapxls_max;
-				for (i = 0; i < li.in.chan; i++) {
-					if (clutPoints <= 65) {
-						apxls_min[i] = (int)(4.0/64.0 * (clutPoints-1.0) + 0.9);
-						if (i == 0)
-							apxls_max[i] = (int)(58.0/64.0 * (clutPoints-1.0) + 0.1);
-						else
-							apxls_max[i] = (int)(60.0/64.0 * (clutPoints-1.0) + 0.1);
-					} else {
-						apxls_min[i] = (int)(16.0/255.0 * (clutPoints-1.0) + 0.9);
-						if (i == 0)
-							apxls_max[i] = (int)(235.0/255.0 * (clutPoints-1.0) + 0.1);
-						else
-							apxls_max[i] = (int)(240.0/255.0 * (clutPoints-1.0) + 0.1);
-					}
-				}
-			}
-
 			/* The eeColor hard wires 1.0 input to 1.0 output in its cLUT, */
 			/* so de-scale the cLUT to match this, and re-scale in the */
 			/* output 1D lut */
@@ -4622,50 +5012,104 @@ main(int argc, char *argv[]) {
 #endif /* NEVER */
 
 #else	/* !DEBUG_ONE */
-			/* Use helper function to do the hard work. */
-			if (li.verb) {
-				unsigned int ui;
-				int itotal;
-				for (itotal = 1, ui = 0; ui < li.in.chan; ui++, itotal *= clutPoints)
-					; 
-				li.total = itotal;
-				/* Allow for extra lookups due to ICM_CLUT_SET_APXLS */
-#ifdef USE_APXLS
-				if (apxls_min != NULL && apxls_max != NULL) {
-					for (itotal = 1, ui = 0; ui < li.in.chan; ui++)
-						itotal *= (apxls_max[ui] - apxls_min[ui]);
-				} else {
-					for (itotal = 1, ui = 0; ui < li.in.chan; ui++)
-						itotal *= (clutPoints-1);
+			/* If a preview is wanted, fill in and write a coarse cLUT first, */
+			/* then refine it to the full resolution. The full pass gets a warm */
+			/* start from the reverse lookup acceleration structures and caches */
+			/* that the coarse pass has already set up. */
+			for (pass = (li.prevres > 0 && li.prevres < clutPoints) ? 0 : 1; pass < 2; pass++) {
+				int res = pass == 0 ? li.prevres : clutPoints;
+
+				if (wo->clutPoints != res) {
+					wo->clutPoints = res;
+					if (wo->allocate((icmBase *)wo) != 0)	/* Re-allocate space */
+						error("allocate failed: %d, %s",wr_icc->errc,wr_icc->err);
 				}
-				li.total += itotal;
+				li.wphacked = li.bkhacked = 0;
+
+				/* Limits are grid indexes that should not be adjusted by SET_APXLS */
+				/* Grid index is not adjusted if it's within 10% of device value limits */
+				if (li.in.tvenc == 1) {			/* Video encoded */
+					apxls_min = tapxls_min;
+					apxls_max = tapxls_max;
+					for (i = 0; i < li.in.chan; i++) {
+						if (res <= 65) {
+							apxls_min[i] = (int)(4.0/64.0 * (res-1.0) + 0.9);
+							apxls_max[i] = (int)(58.0/64.0 * (res-1.0) + 0.1);
+						} else {
+							apxls_min[i] = (int)(16.0/255.0 * (res-1.0) + 0.9);
+							apxls_max[i] = (int)(235.0/255.0 * (res-1.0) + 0.1);
+						}
+					}
+				} else if (li.in.tvenc >= 3) {	/* YCbCr encoded */
+					apxls_min = tapxls_min;
+					apxls_max = tapxls_max;
+					for (i = 0; i < li.in.chan; i++) {
+						if (res <= 65) {
+							apxls_min[i] = (int)(4.0/64.0 * (res-1.0) + 0.9);
+							if (i == 0)
+								apxls_max[i] = (int)(58.0/64.0 * (res-1.0) + 0.1);
+							else
+								apxls_max[i] = (int)(60.0/64.0 * (res-1.0) + 0.1);
+						} else {
+							apxls_min[i] = (int)(16.0/255.0 * (res-1.0) + 0.9);
+							if (i == 0)
+								apxls_max[i] = (int)(235.0/255.0 * (res-1.0) + 0.1);
+							else
+								apxls_max[i] = (int)(240.0/255.0 * (res-1.0) + 0.1);
+						}
+					}
+				}
+
+				/* Use helper function to do the hard work. */
+				if (li.verb) {
+					unsigned int ui;
+					int itotal;
+					for (itotal = 1, ui = 0; ui < li.in.chan; ui++, itotal *= res)
+						; 
+					li.total = itotal;
+					/* Allow for extra lookups due to ICM_CLUT_SET_APXLS */
+#ifdef USE_APXLS
+					if (apxls_min != NULL && apxls_max != NULL) {
+						for (itotal = 1, ui = 0; ui < li.in.chan; ui++)
+							itotal *= (apxls_max[ui] - apxls_min[ui]);
+					} else {
+						for (itotal = 1, ui = 0; ui < li.in.chan; ui++)
+							itotal *= (res-1);
+					}
+					li.total += itotal;
 #endif /* USE_APXLS */
-				li.count = 0;
-				printf(" 0%%"); fflush(stdout);
-			}
-			if (icmSetMultiLutTables(
-				1,
-				&wo,
+					li.count = 0;
+					printf(" 0%%"); fflush(stdout);
+				}
+				a1tm_start("link tables");
+				if (set_link_tables(
+					&li,
+					li.ckname[pass],
+					wo,
 #ifdef USE_APXLS
-				ICM_CLUT_SET_APXLS |			/* Use aproximate least squares */
+					ICM_CLUT_SET_APXLS |			/* Use aproximate least squares */
 #endif /* USE_APXLS */
-				0,
-				&li,						/* Context */
-//				li.in.h->colorSpace,		/* Input color space */
-				li.in.csp,					/* Input color space */
-//				li.out.h->colorSpace,		/* Output color space */
-				li.out.csp,					/* Output color space */
-				devi_devip,					/* Input transfer tables devi->devi' */
-				NULL, NULL,					/* Use default input colorspace range */
-				devip_devop,				/* devi' -> devo' transfer function */
-				NULL, NULL,					/* Default output colorspace range */
-				devop_devo,					/* Output transfer tables, devo'->devo */
-				apxls_min, apxls_max		/* Limit APXLS to inside colorspace */
-			) != 0) {
-				error("Setting 16 bit Lut failed: %d, %s",wr_icc->errc,wr_icc->err);
-			}
-			if (li.verb) {
-				printf("\n");
+					0,
+					apxls_min, apxls_max		/* Limit APXLS to inside colorspace */
+				) != 0) {
+					error("Setting 16 bit Lut failed: %d, %s",wr_icc->errc,wr_icc->err);
+				}
+				a1tm_end();
+				if (li.verb) {
+					printf("\n");
+				}
+				if (pass == 0) {
+					icmFile *prev_fp;
+
+					if (li.verb)
+						printf("Writing preview ICC file '%s'\n",prev_name);
+
+					if ((prev_fp = new_icmFileStd_name(prev_name,"w")) == NULL)
+						error ("Write: Can't open file '%s'",prev_name);
+					if ((rv = wr_icc->write(wr_icc,prev_fp,0)) != 0)
+						error ("Write file: %d, %s",rv,wr_icc->err);
+					prev_fp->del(prev_fp);
+				}
 			}
 #ifdef WARN_CLUT_CLIPPING
 			if (wr_icc->warnc)
@@ -4744,8 +5188,19 @@ main(int argc, char *argv[]) {
 			printf("Writing ICC file '%s'\n",link_name);
 
 		/* Write the file out */
+		a1tm_start("write link");
 		if ((rv = wr_icc->write(wr_icc,wr_fp,0)) != 0)
 			error ("Write file: %d, %s",rv,wr_icc->err);
+		a1tm_end();
+
+		/* The link is complete, so its checkpoints aren't needed */
+		for (i = 0; i < 2; i++) {
+			if (li.ckname[i] != NULL) {
+				remove(li.ckname[i]);
+				free(li.ckname[i]);
+				li.ckname[i] = NULL;
+			}
+		}
 
 		/* eeColor format */
 		if (li.tdlut == 1) {
@@ -4767,6 +5222,12 @@ main(int argc, char *argv[]) {
 				error ("Write file '%s' failed",tdlut_name);
 		}
 
+		/* GPU texture format */
+		else {
+			if (write_gpu_3DLut(&li, wr_icc, tdlut_name, li.tdlut == 5)) 
+				error ("Write file '%s' failed",tdlut_name);
+		}
+
 		wr_icc->del(wr_icc);
 		wr_fp->del(wr_fp);
 
@@ -4949,9 +5410,185 @@ main(int argc, char *argv[]) {
 	if (li.out.c != NULL)
 		li.out.c->del(li.out.c);
 
+	a1tm_end();
+	a1tm_report(g_log);
+
 	return 0;
 }
 
+/* ------------------------------------------- */
+/* Link server. Each line read from stdin is a link job, */
+/* holding the arguments of a normal collink invocation, */
+/* which are added to the options given after -S. */
+/* Since error() exits, each job is run in a process forked */
+/* from the server, so a failing job doesn't end the server, */
+/* while profiles stay resident in the server between jobs. */
+/* A line "Job n: OK" or "Job n: Failed" is written after each job. */
+
+#define MAX_JOB_ARGS 200		/* Maximum number of arguments of a job */
+#define MAX_JOB_LINE 8192		/* Maximum length of a job line */
+
+#if defined(UNIX)
+
+/* Make a profile resident, or update its resident copy */
+/* if the file has changed. Ignore anything that isn't */
+/* an ICC profile. */
+static void load_resident(char *name) {
+	struct stat sbuf;
+	icmFile *fp;
+	icc *c;
+	int i;
+
+	if (stat(name, &sbuf) != 0 || !S_ISREG(sbuf.st_mode))
+		return;
+
+	for (i = 0; i < nrprofs; i++) {
+		if (strcmp(rprofs[i].name, name) == 0)
+			break;
+	}
+	if (i < nrprofs) {
+		if (rprofs[i].mtime == sbuf.st_mtime && rprofs[i].size == (size_t)sbuf.st_size)
+			return;				/* Resident copy is current */
+		rprofs[i].c->del(rprofs[i].c);
+		free(rprofs[i].name);
+		rprofs[i] = rprofs[--nrprofs];
+	}
+
+	if ((fp = new_icmFileStd_name(name,"r")) == NULL)
+		return;
+	if ((c = new_icc()) == NULL)
+		error("Creation of ICC object failed");
+	if (c->read_x(c, fp, 0, 1) != 0		/* (c will fp->del()) */
+	 || c->read_all_tags(c) != 0) {
+		c->del(c);
+		return;
+	}
+
+	if ((rprofs = (rprof *)realloc(rprofs, (nrprofs + 1) * sizeof(rprof))) == NULL)
+		error("Malloc of resident profile list failed");
+	if ((rprofs[nrprofs].name = strdup(name)) == NULL)
+		error("Malloc of resident profile name failed");
+	rprofs[nrprofs].mtime = sbuf.st_mtime;
+	rprofs[nrprofs].size = (size_t)sbuf.st_size;
+	rprofs[nrprofs].c = c;
+	rprofs[nrprofs].used = 0;
+	nrprofs++;
+}
+
+/* Split a job line into arguments, allowing for double quotes. */
+/* Return the number of arguments, -1 if there are too many. */
+static int split_job(char *line, char **args, int maxargs) {
+	int nargs = 0;
+	char *s = line, *d;
+
+	for (;;) {
+		while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n')
+			s++;
+		if (*s == '\000' || (nargs == 0 && *s == '#'))	/* End or comment line */
+			break;
+		if (nargs >= maxargs)
+			return -1;
+		args[nargs++] = d = s;
+		while (*s != '\000' && *s != ' ' && *s != '\t' && *s != '\r' && *s != '\n') {
+			if (*s == '"') {	/* Copy quoted characters */
+				for (s++; *s != '\000' && *s != '"'; )
+					*d++ = *s++;
+				if (*s == '"')
+					s++;
+			} else
+				*d++ = *s++;
+		}
+		if (*s != '\000')
+			s++;
+		*d = '\000';
+	}
+	return nargs;
+}
+
+static int serve_links(int argc, char *argv[]) {
+	char line[MAX_JOB_LINE];
+	char *jargv[MAX_JOB_ARGS];
+	int jargc, nsargs;
+	int jobno = 0;
+	int i;
+
+	/* The options given after -S */
+	jargv[0] = argv[0];
+	for (nsargs = 1, i = 2; i < argc; i++) {
+		if (nsargs >= MAX_JOB_ARGS)
+			usage("Too many server options");
+		jargv[nsargs++] = argv[i];
+	}
+
+	while (fgets(line, MAX_JOB_LINE, stdin) != NULL) {
+		pid_t pid;
+		int status, ok;
+
+		if ((jargc = split_job(line, jargv + nsargs, MAX_JOB_ARGS - nsargs)) == 0)
+			continue;			/* Empty or comment line */
+		jobno++;
+		if (jargc < 0) {
+			printf("Job %d: Failed - too many arguments\n",jobno);
+			fflush(stdout);
+			continue;
+		}
+		jargc += nsargs;
+
+		/* Make any profiles resident. (The last argument is the link.) */
+		for (i = nsargs; i < (jargc-1); i++) {
+			if (jargv[i][0] != '-')
+				load_resident(jargv[i]);
+		}
+
+		fflush(stdout);
+		fflush(stderr);
+		if ((pid = fork()) < 0) {
+			printf("Job %d: Failed - fork() failed\n",jobno);
+			fflush(stdout);
+			continue;
+		}
+		if (pid == 0) {			/* Job process */
+			int rv = make_link(jargc, jargv);
+			fflush(stdout);
+			fflush(stderr);
+			_exit(rv);
+		}
+
+		while (waitpid(pid, &status, 0) < 0)
+			;
+		ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+		printf("Job %d: %s\n",jobno, ok ? "OK" : "Failed");
+		fflush(stdout);
+	}
+
+	for (i = 0; i < nrprofs; i++) {
+		rprofs[i].c->del(rprofs[i].c);
+		free(rprofs[i].name);
+	}
+	free(rprofs);
+
+	return 0;
+}
+
+#else /* !UNIX */
+
+static int serve_links(int argc, char *argv[]) {
+	error("Link server mode (-S) isn't supported on this system");
+	return 1;
+}
+
+#endif /* !UNIX */
+
+int
+main(int argc, char *argv[]) {
+
+	if (argc >= 2 && strcmp(argv[1], "-S") == 0) {
+		error_program = argv[0];
+		return serve_links(argc, argv);
+	}
+	return make_link(argc, argv);
+}
+
 /* ===================================================================== */
 
 /* Tweak for eeColor input and output value encodings, to compensate */
@@ -5151,6 +5788,125 @@ int write_eeColor1DoutputLuts(clink *li, char *tdlut_name) {
 	return 0;
 }
 
+/* ===================================================================== */
+/* Compute the node values of a 3DLut from the link. */
+
+/* If the link has linear per channel curves and its cLUT is at the */
+/* same resolution as the 3DLut, then the nodes are simply the cLUT */
+/* grid values, and can be copied directly. Otherwise the link is */
+/* resampled, with slices of the 3DLut being looked up in parallel. */
+
+/* Return nz if the 3DLut nodes can be copied from the link cLUT grid */
+static int tdlut_direct(icmLuBase *luo, int res) {
+	icmLuLut *p = (icmLuLut *)luo;
+	icmLut *lut = p->lut;
+	unsigned int e, i;
+
+	if (p->usematrix || lut->inputChan != 3 || lut->outputChan != 3
+	 || lut->clutPoints != res || lut->inputEnt < 2 || lut->outputEnt < 2)
+		return 0;
+
+	for (e = 0; e < 3; e++) {
+		for (i = 0; i < lut->inputEnt; i++) {
+			if (fabs(lut->inputTable[e * lut->inputEnt + i] - i/(lut->inputEnt-1.0)) > 1e-9)
+				return 0;
+		}
+		for (i = 0; i < lut->outputEnt; i++) {
+			if (fabs(lut->outputTable[e * lut->outputEnt + i] - i/(lut->outputEnt-1.0)) > 1e-9)
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/* Sampling thread context */
+typedef struct {
+	icmLuBase *luo;		/* Link lookup */
+	int res;			/* 3DLut resolution */
+	int *ord;			/* Input channel order, fastest to slowest */
+	int s0, s1;			/* Range of slowest index slices to do */
+	double *out;		/* Return values */
+	int rv[NUMTHR_MAX];	/* Worst lookup return value of each thread */
+} tdlut_thr;
+
+static int tdlut_sample_thread(void *cntx, int ix, int nth) {
+	tdlut_thr *p = (tdlut_thr *)cntx;
+	int res = p->res, n = res * res;
+	double *in;
+	int s, i, j, rv = 0;
+
+	if ((in = (double *)malloc(n * 3 * sizeof(double))) == NULL)
+		error("Malloc of 3DLut sampling values failed");
+
+	for (s = p->s0 + ix; s < p->s1; s += nth) {
+		for (j = 0; j < res; j++) {
+			for (i = 0; i < res; i++) {
+				double *ip = in + (j * res + i) * 3;
+				ip[p->ord[0]] = i/(res-1.0);
+				ip[p->ord[1]] = j/(res-1.0);
+				ip[p->ord[2]] = s/(res-1.0);
+			}
+		}
+		rv |= p->luo->lookup_n(p->luo, p->out + (s - p->s0) * n * 3, in, n);
+	}
+	free(in);
+	p->rv[ix] = rv;
+
+	return 0;
+}
+
+/* Put the 3DLut node output values for the slowest index slices */
+/* s0 to s1-1 into out[(s1-s0) * res * res * 3], in 3DLut order. */
+/* ord[] is the input channel order, fastest to slowest. */
+/* Return nz on a lookup error */
+static int tdlut_values(clink *li, icmLuBase *luo, int res, int *ord,
+                        int s0, int s1, double *out) {
+	int nthreads = li->nthreads;
+	tdlut_thr tx;
+	int i, rv = 0;
+
+	if (tdlut_direct(luo, res)) {
+		icmLut *lut = ((icmLuLut *)luo)->lut;
+		DCOUNT(gc, MAX_CHAN, 3, 0, 0, res);
+		int gi[3];
+
+		DC_INIT(gc);
+		gc[2] = s0;
+		while (!DC_DONE(gc) && gc[2] < s1) {
+			double *gp = lut->clutTable;
+
+			for (i = 0; i < 3; i++)
+				gi[ord[i]] = gc[i];
+			for (i = 0; i < 3; i++)
+				gp += gi[i] * lut->dinc[i];
+			for (i = 0; i < 3; i++)
+				*out++ = gp[i];
+			DC_INC(gc);
+		}
+		return 0;
+	}
+
+	if (nthreads <= 0)
+		nthreads = num_threads();
+	if (nthreads > NUMTHR_MAX)
+		nthreads = NUMTHR_MAX;
+	if (nthreads > (s1 - s0))
+		nthreads = s1 - s0;
+
+	tx.luo = luo;
+	tx.res = res;
+	tx.ord = ord;
+	tx.s0 = s0;
+	tx.s1 = s1;
+	tx.out = out;
+
+	par_exec(nthreads, tdlut_sample_thread, (void *)&tx);
+
+	for (i = 0; i < nthreads; i++)
+		rv |= tx.rv[i];
+	return rv > 1;
+}
+
 /* ===================================================================== */
 /* Write MadVR 3dlut file */
 
@@ -5251,6 +6007,8 @@ int write_MadVR_3DLut(clink *li, icc *icc, char *fname) {
 		DCOUNT(gc, MAX_CHAN, 3, 0, 0, 256);
 		int ord[3];			/* Input channel order, fastest to slowest */
 		ORD8 buf[3 * 2];
+		double *vals, *out = NULL;
+		int nslice = 16;	/* Slices of the 3dLut computed at a time */
 
 		DC_INIT(gc);
 
@@ -5261,15 +6019,18 @@ int write_MadVR_3DLut(clink *li, icc *icc, char *fname) {
 			ord[0] = 2;  ord[1] = 1;  ord[2] = 0;  /* B G R */
 		}
 
+		if ((vals = (double *)malloc(nslice * 256 * 256 * 3 * sizeof(double))) == NULL)
+			error("write_MadVR_3DLut: malloc of 3dLut values failed");
+
 		while (!DC_DONE(gc)) {
-			double in[3], out[3];
 			int iout[3];
 
-			for (i = 0; i < 3; i++)
-				in[ord[i]] = gc[i]/255.0;
-
-			if (luo->lookup(luo, out, in) > 1)
-			    error ("write_MadVR_3DLut: %d, %s",icc->errc,icc->err);
+			/* Compute the next band of slices */
+			if (gc[0] == 0 && gc[1] == 0 && (gc[2] % nslice) == 0) {
+				if (tdlut_values(li, luo, 256, ord, gc[2], gc[2] + nslice, vals))
+				    error ("write_MadVR_3DLut: %d, %s",icc->errc,icc->err);
+				out = vals;
+			}
 
 //printf("~1 %f %f %f -> %f %f %f\n", in[0], in[1], in[2], out[0], out[1], out[2]);
 
@@ -5311,8 +6072,10 @@ int write_MadVR_3DLut(clink *li, icc *icc, char *fname) {
 			if (fp->write(fp, buf, 1, 6) != 6)
 				error ("write_MadVR_3DLut: write clut data failed");
 
+			out += 3;
 			DC_INC(gc);
 		}
+		free(vals);
 	}
 
 	/* Append a MadVR cal1 table to the 3dlut. */
@@ -5411,27 +6174,26 @@ int write_cube_3DLut(clink *li, icc *icc, char *fname) {
 		int i, j, k;
 		DCOUNT(gc, MAX_CHAN, 3, 0, 0, clutsize);
 		int ord[3];			/* Input channel order, fastest to slowest */
+		double *vals, *out;
 
 		DC_INIT(gc);
 
 		/* RGB fastest to slowest is R G B */
 		ord[0] = 0;  ord[1] = 1;  ord[2] = 2;  /* R G B */
 
-		while (!DC_DONE(gc)) {
-			double in[3], out[3];
-			int iout[3];
+		if ((vals = (double *)malloc(clutsize * clutsize * clutsize * 3 * sizeof(double))) == NULL)
+			error("write_cube_3DLut: malloc of 3dLut values failed");
 
-			for (i = 0; i < 3; i++)
-				in[ord[i]] = gc[i]/(clutsize-1.0);
-
-			if (luo->lookup(luo, out, in) > 1)
-			    error ("write_cube_3DLut: %d, %s",icc->errc,icc->err);
+		if (tdlut_values(li, luo, clutsize, ord, 0, clutsize, vals))
+		    error ("write_cube_3DLut: %d, %s",icc->errc,icc->err);
 
-//printf("~1 %f %f %f -> %f %f %f\n", in[0], in[1], in[2], out[0], out[1], out[2]);
+		for (out = vals; !DC_DONE(gc); out += 3) {
+//printf("~1 %d %d %d -> %f %f %f\n", gc[0], gc[1], gc[2], out[0], out[1], out[2]);
 			fp->gprintf(fp, " %f %f %f\n",out[0], out[1], out[2]);
 
 			DC_INC(gc);
 		}
+		free(vals);
 	}
 
 	if (fp->del(fp)) 
@@ -5442,6 +6204,97 @@ int write_cube_3DLut(clink *li, icc *icc, char *fname) {
 	return 0;
 }
 
+/* ===================================================================== */
+/* Write a binary 3dLut ready for uploading as a GPU 3D texture */
+
+/* Format is (little endian):
+	4 byte magic number 'A3DT'
+	4 byte version = 1
+	4 byte grid resolution N
+	4 byte number of channels = 3
+	4 byte bytes per value, 2 = 16 bit unsigned normalized, 4 = 32 bit IEEE float
+	4 byte offset to the table data = 32
+	8 bytes of padding
+	[N][N][N][3] table values, R varying fastest, then G, then B.
+
+   This is the layout expected for a 3D RGB texture with R as the
+   x coordinate, so the data can be handed to the graphics API
+   without any parsing or re-ordering.
+*/
+
+/* Return nz on error */
+int write_gpu_3DLut(clink *li, icc *icc, char *fname, int isflt) {
+	icmFile *fp;
+	ORD8 h[32], *buf;
+	int clutsize, vsize = isflt ? 4 : 2;
+	int ord[3] = { 0, 1, 2 };	/* Input channel order, fastest to slowest R G B */
+	double *vals;
+	size_t i, n;
+
+	icmLuBase *luo;
+
+	/* Get a conversion object. We assume it is of the right type */
+	if ((luo = icc->get_luobj(icc, icmFwd, icmDefaultIntent,
+		                                 icmSigDefaultData, icmLuOrdNorm)) == NULL)
+		error ("write_gpu_3DLut: %d, %s",icc->errc, icc->err);
+
+	clutsize = ((icmLuLut *)luo)->lut->clutPoints;
+	n = (size_t)clutsize * clutsize * clutsize * 3;
+
+	if ((vals = (double *)malloc(n * sizeof(double))) == NULL
+	 || (buf = (ORD8 *)malloc(n * vsize)) == NULL)
+		error("write_gpu_3DLut: malloc of 3dLut values failed");
+
+	if (tdlut_values(li, luo, clutsize, ord, 0, clutsize, vals))
+	    error ("write_gpu_3DLut: %d, %s",icc->errc,icc->err);
+
+	/* Open up the 3dlut file for writing */
+	if ((fp = new_icmFileStd_name(fname,"w")) == NULL)
+		error("write_gpu_3DLut: Can't open file '%s'",fname);
+
+	if (li->verb)
+		printf("Writing %s GPU 3dLut '%s'\n",isflt ? "float" : "16 bit",fname);
+
+	memset(h, 0, 32);
+	h[0] = 'A'; h[1] = '3'; h[2] = 'D'; h[3] = 'T';		/* Signature */
+	write_ORD32_le(h + 4, 1);							/* File format version */
+	write_ORD32_le(h + 8, clutsize);					/* Grid resolution */
+	write_ORD32_le(h + 12, 3);							/* Channels */
+	write_ORD32_le(h + 16, vsize);						/* Bytes per value */
+	write_ORD32_le(h + 20, 32);							/* Offset to table data */
+
+	if (fp->write(fp, h, 1, 32) != 32)
+		error ("write_gpu_3DLut: write header failed");
+
+	for (i = 0; i < n; i++) {
+		double v = vals[i];
+
+		if (isflt) {
+			union { float f; ORD32 i; } fv;
+			fv.f = (float)v;
+			write_ORD32_le(buf + i * 4, fv.i);
+		} else {
+			if (v < 0.0)
+				v = 0.0;
+			else if (v > 1.0)
+				v = 1.0;
+			write_ORD16_le(buf + i * 2, (int)(v * 65535.0 + 0.5));
+		}
+	}
+
+	if (fp->write(fp, buf, vsize, n) != n)
+		error ("write_gpu_3DLut: write clut data failed");
+
+	if (fp->del(fp)) 
+		error ("write_gpu_3DLut: write to '%s' failed",fname);
+
+	free(buf);
+	free(vals);
+	luo->del(luo);
+
+	return 0;
+}
+
 
 
 
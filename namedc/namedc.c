@@ -1162,36 +1162,143 @@ static int read_nc(namedc *p, const char *filename, int options) {
 }
 
 
-/* Return the index of the best mataching color, -1 on error. */
-/* Lab[] is assumed to be D50, 2 degree standard observer based CIE value, */
-/* and the spec value should only be provided if this is a reflective or */
-/* transmissive measurement, NULL if emissive. */
-/* If named color library is expects other than D50, 2 degree, then */
-/* it will use the spectral value if not NULL, or chromatically */
-/* adapt the Lab value. */
-/* deType == 0 DE76 */
-/* deType == 1 DE94 */
-/* deType == 2 DE2000 */
-/* if de != NULL, return the delta E */
-int match(struct _namedc *p, double *de, double *pLab, xspect *rspect, int deType) {
-	int i, bix = -1;
-	double bde = 1e99;
-	double Lab[3];
+#define NC_GMAXRES 128		/* Maximum grid cells along each axis */
+#define NC_GPERCELL 2.0		/* Target number of colors per grid cell */
+
+/* Free the Lab grid index */
+static void free_index(namedc *p) {
+	if (p->gstart != NULL)
+		free(p->gstart);
+	p->gstart = NULL;
+	if (p->gix != NULL)
+		free(p->gix);
+	p->gix = NULL;
+	p->gcount = 0;
+}
+
+/* Return the grid cell index of a Lab value, clamped to the grid */
+static void index_cell(namedc *p, int cc[3], double *Lab) {
+	int e;
+
+	for (e = 0; e < 3; e++) {
+		cc[e] = (int)floor((Lab[e] - p->gmin[e])/p->gres);
+		if (cc[e] < 0)
+			cc[e] = 0;
+		else if (cc[e] >= p->gdim[e])
+			cc[e] = p->gdim[e]-1;
+	}
+}
+
+/* Create a uniform grid index of the colors Lab values, */
+/* so that match() only needs to look at nearby colors. */
+/* Return nz on error */
+static int build_index(namedc *p) {
+	double gmax[3], vol;
+	int i, e, ncells;
+	int cc[3];
+
+	free_index(p);
+	if (p->count == 0)
+		return 0;
+
+	p->gcmax = p->gldmax = 0.0;
+	for (e = 0; e < 3; e++) {
+		p->gmin[e] = 1e38;
+		gmax[e] = -1e38;
+	}
+	for (i = 0; i < p->count; i++) {
+		double *Lab = p->data[i].Lab, cv, ld;
+
+		for (e = 0; e < 3; e++) {
+			if (Lab[e] < p->gmin[e])
+				p->gmin[e] = Lab[e];
+			if (Lab[e] > gmax[e])
+				gmax[e] = Lab[e];
+		}
+		if ((cv = sqrt(Lab[1] * Lab[1] + Lab[2] * Lab[2])) > p->gcmax)
+			p->gcmax = cv;
+		if ((ld = fabs(Lab[0] - 50.0)) > p->gldmax)
+			p->gldmax = ld;
+	}
+
+	/* Choose a cell size that gives about NC_GPERCELL colors per cell */
+	for (vol = 1.0, e = 0; e < 3; e++)
+		vol *= gmax[e] - p->gmin[e] + 1.0;
+	p->gres = pow(vol * NC_GPERCELL/p->count, 1.0/3.0);
+	for (e = 0; e < 3; e++) {
+		double r = (gmax[e] - p->gmin[e])/NC_GMAXRES;
+		if (p->gres < r)
+			p->gres = r;
+	}
+	if (p->gres < 1e-3)
+		p->gres = 1e-3;
+	for (ncells = 1, e = 0; e < 3; e++) {
+		p->gdim[e] = (int)floor((gmax[e] - p->gmin[e])/p->gres) + 1;
+		if (p->gdim[e] > NC_GMAXRES)
+			p->gdim[e] = NC_GMAXRES;
+		ncells *= p->gdim[e];
+	}
+
+	if ((p->gstart = (int *)calloc(ncells + 1, sizeof(int))) == NULL
+	 || (p->gix = (int *)malloc(p->count * sizeof(int))) == NULL) {
+		free_index(p);
+		snprintf(p->err, NAMEDC_ERRL, "Malloc of color index failed");
+		return p->errc = 2;
+	}
+
+	/* Count the colors in each cell, then place them */
+	for (i = 0; i < p->count; i++) {
+		index_cell(p, cc, p->data[i].Lab);
+		p->gstart[(cc[0] * p->gdim[1] + cc[1]) * p->gdim[2] + cc[2] + 1]++;
+	}
+	for (i = 0; i < ncells; i++)
+		p->gstart[i+1] += p->gstart[i];
+	for (i = 0; i < p->count; i++) {
+		int ci;
+		index_cell(p, cc, p->data[i].Lab);
+		ci = (cc[0] * p->gdim[1] + cc[1]) * p->gdim[2] + cc[2];
+		p->gix[p->gstart[ci]++] = i;
+	}
+	for (i = ncells; i > 0; i--)		/* Restore the starts */
+		p->gstart[i] = p->gstart[i-1];
+	p->gstart[0] = 0;
+
+	p->gcount = p->count;
+
+	a1logd(p->log, 2, "build_index: %d colors in %d x %d x %d cells of %f\n",
+	           p->count, p->gdim[0], p->gdim[1], p->gdim[2], p->gres);
+	return 0;
+}
+
+/* Make sure the colors are loaded and indexed ready for matching. */
+/* Return nz on error */
+static int match_setup(namedc *p, char *fname) {
 
 	if (p->filename == NULL) {		/* We haven't been opened */
 		snprintf(p->err, NAMEDC_ERRL, "We haven't been opened");
-		a1logd(p->log, 1, "match: %s\n",p->err);
-		return -1;
+		a1logd(p->log, 1, "%s: %s\n",fname,p->err);
+		return 1;
 	}
 
 	/* If the colors haven't been read yet, read them now */
 	if (p->data == NULL || (p->options & NAMEDC_OP_NODATA)) {
 		if (read_nc(p, NULL, (p->options & ~NAMEDC_OP_NODATA))) {
-			a1logd(p->log, 1, "match: on demand data load failed with '%s'\n",p->err);
-			return -1;
+			a1logd(p->log, 1, "%s: on demand data load failed with '%s'\n",fname,p->err);
+			return 1;
 		}
-		a1logd(p->log, 1, "match: after loading there are %d colors\n",p->count);
+		a1logd(p->log, 1, "%s: after loading there are %d colors\n",fname,p->count);
+	}
+
+	if (p->gcount != p->count && build_index(p)) {
+		a1logd(p->log, 1, "%s: %s\n",fname,p->err);
+		return 1;
 	}
+	return 0;
+}
+
+/* Convert a D50 Lab value or a spectrum to the named color space Lab. */
+/* Return nz on error */
+static int match_lab(namedc *p, double *Lab, double *pLab, xspect *rspect) {
 
 	icmCpy3(Lab, pLab);
 
@@ -1202,7 +1309,7 @@ int match(struct _namedc *p, double *de, double *pLab, xspect *rspect, int deTyp
 				if ((p->sp2cie = new_xsp2cie(p->ill, 0.0, NULL, p->obs, NULL, icSigLabData, 0)) == NULL) {
 					snprintf(p->err, NAMEDC_ERRL, "creating spectral conversion failed");
 					a1logd(p->log, 1, "match: %s\n",p->err);
-					return -1;
+					return 1;
 					
 				}
 			}
@@ -1224,12 +1331,12 @@ int match(struct _namedc *p, double *de, double *pLab, xspect *rspect, int deTyp
 					if ((tt = new_xsp2cie(p->ill, 0.0, NULL, p->obs, NULL, icSigXYZData, 0)) == NULL) {
 						snprintf(p->err, NAMEDC_ERRL, "creating spectral conversion failed");
 						a1logd(p->log, 1, "match: %s\n",p->err);
-						return -1;
+						return 1;
 					}
 					if (standardIlluminant(&ts, icxIT_E, 0.0)) {
 						snprintf(p->err, NAMEDC_ERRL, "match: creating E type spectrum failed");
 						a1logd(p->log, 1, "match: %s\n",p->err);
-						return -1;
+						return 1;
 					} 
 					tt->convert(tt, wXYZ, &ts);
 					tt->del(tt);
@@ -1244,40 +1351,151 @@ int match(struct _namedc *p, double *de, double *pLab, xspect *rspect, int deTyp
 			icmXYZ2Lab(&p->dXYZ, Lab, Lab);
 		}
 	}
- 
+	return 0;
+}
+
+/* Find the closest indexed color to a named color space Lab value. */
+/* Cells are searched in rings of increasing distance from the Lab value, */
+/* until the ring is further away than any color that could beat the best */
+/* found so far. For DE94 and DE2000 this uses a lower bound of the delta E */
+/* in terms of the Lab distance, so the result is the same as a full search. */
+/* Return the index, -1 if there are no colors, and the delta E squared in *pbde */
+static int match_index(namedc *p, double *pbde, double *Lab, int deType) {
+	int bix = -1;
+	double bde = 1e99;
+	double kk;			/* Lab distance <= kk * delta E */
+	double rad;			/* Lab distance beyond which there is nothing better */
+	int c0[3], r, maxr;
+	int e;
+
+	if (p->gcount == 0)
+		return -1;
+
+	/* Work out the largest ratio of Lab distance to delta E, */
+	/* using bounds on the mean chroma and lightness of the pairs */
 	if (deType == 0) {
-		for (i = 0; i < p->count; i++) {
-			double de = icmLabDEsq(Lab, p->data[i].Lab);
-			if (de < bde) {
-				bde = de;
-				bix = i;
-			}
+		kk = 1.0;
+	} else {
+		double cq, ldq;
+
+		cq = sqrt(Lab[1] * Lab[1] + Lab[2] * Lab[2]);
+		ldq = fabs(Lab[0] - 50.0);
+
+		if (deType == 1) {			/* SC >= SH >= 1, SL == 1, geometric mean chroma */
+			kk = 1.0 + 0.045 * sqrt(cq * p->gcmax);
+
+		} else {					/* Allow for SL, a' <= 1.5 a, and the RT cross term */
+			double ldm, cm, cm7, rc, sl, sc;
+
+			ldm = 0.5 * (ldq + p->gldmax);
+			cm = 0.75 * (cq + p->gcmax);
+			cm7 = pow(cm, 7.0);
+			rc = 2.0 * sqrt(cm7/(cm7 + 6103515625.0));
+			sl = 1.0 + 0.015 * ldm * ldm/sqrt(20.0 + ldm * ldm);
+			sc = (1.0 + 0.045 * cm)/sqrt(1.0 - 0.5 * rc * sin(M_PI/3.0));
+			kk = sl > sc ? sl : sc;
+			kk *= 1.001;			/* Allow for icmCIE2Kfsq() approximation */
 		}
+	}
 
-	} else if (deType == 1) {
-		for (i = 0; i < p->count; i++) {
-			double de = icmCIE94sq(Lab, p->data[i].Lab);
-			if (de < bde) {
-				bde = de;
-				bix = i;
-			}
+	index_cell(p, c0, Lab);
+	for (maxr = e = 0; e < 3; e++) {
+		if (c0[e] > maxr)
+			maxr = c0[e];
+		if ((p->gdim[e] - 1 - c0[e]) > maxr)
+			maxr = p->gdim[e] - 1 - c0[e];
+	}
+
+	for (r = 0; r <= maxr; r++) {
+		int i0, i1;
+
+		/* Lab distance to any cell in this ring is at least (r-1) * gres */
+		if (bix >= 0) {
+			rad = kk * sqrt(bde);
+			if ((r - 1) * p->gres > rad)
+				break;
 		}
 
-	} else if (deType == 2) {
-		for (i = 0; i < p->count; i++) {
-			double de = icmCIE2Ksq(Lab, p->data[i].Lab);
-			if (de < bde) {
-				bde = de;
-				bix = i;
+		for (i0 = c0[0] - r; i0 <= c0[0] + r; i0++) {
+			if (i0 < 0 || i0 >= p->gdim[0])
+				continue;
+			for (i1 = c0[1] - r; i1 <= c0[1] + r; i1++) {
+				int i2, inc;
+
+				if (i1 < 0 || i1 >= p->gdim[1])
+					continue;
+
+				/* Only the faces of the ring cube */
+				if (i0 == (c0[0] - r) || i0 == (c0[0] + r)
+				 || i1 == (c0[1] - r) || i1 == (c0[1] + r))
+					inc = 1;
+				else
+					inc = r > 0 ? 2 * r : 1;
+
+				for (i2 = c0[2] - r; i2 <= c0[2] + r; i2 += inc) {
+					int ci, k;
+
+					if (i2 < 0 || i2 >= p->gdim[2])
+						continue;
+
+					ci = (i0 * p->gdim[1] + i1) * p->gdim[2] + i2;
+					for (k = p->gstart[ci]; k < p->gstart[ci+1]; k++) {
+						int i = p->gix[k];
+						double de;
+
+						if (deType == 0)
+							de = icmLabDEsq(Lab, p->data[i].Lab);
+						else if (deType == 1)
+							de = icmCIE94sq(Lab, p->data[i].Lab);
+						else
+							de = icmCIE2Kfsq(Lab, p->data[i].Lab);
+						if (de < bde || (de == bde && i < bix)) {
+							bde = de;
+							bix = i;
+						}
+					}
+				}
 			}
 		}
-	} else {
+	}
+
+	/* Search using the fast approximation, and return the exact DE */
+	if (deType == 2 && bix >= 0)
+		bde = icmCIE2Ksq(Lab, p->data[bix].Lab);
+
+	*pbde = bde;
+	return bix;
+}
+
+/* Return the index of the best mataching color, -1 on error. */
+/* Lab[] is assumed to be D50, 2 degree standard observer based CIE value, */
+/* and the spec value should only be provided if this is a reflective or */
+/* transmissive measurement, NULL if emissive. */
+/* If named color library is expects other than D50, 2 degree, then */
+/* it will use the spectral value if not NULL, or chromatically */
+/* adapt the Lab value. */
+/* deType == 0 DE76 */
+/* deType == 1 DE94 */
+/* deType == 2 DE2000 */
+/* if de != NULL, return the delta E */
+int match(struct _namedc *p, double *de, double *pLab, xspect *rspect, int deType) {
+	int bix;
+	double bde;
+	double Lab[3];
+
+	if (deType < 0 || deType > 2) {
 		snprintf(p->err, NAMEDC_ERRL, "Unnown deType %d",deType);
 		a1logd(p->log, 1, "match: %s\n",p->err);
 		return -1;
 	}
 
-	if (bix < 0) {
+	if (match_setup(p, "match"))
+		return -1;
+
+	if (match_lab(p, Lab, pLab, rspect))
+		return -1;
+ 
+	if ((bix = match_index(p, &bde, Lab, deType)) < 0) {
 		snprintf(p->err, NAMEDC_ERRL, "No colors to match against");
 		a1logd(p->log, 1, "match: %s\n",p->err);
 		return -1;
@@ -1288,6 +1506,38 @@ int match(struct _namedc *p, double *de, double *pLab, xspect *rspect, int deTyp
 	return bix;
 }
 
+/* Match n colors. */
+/* Return nz on error */
+static int match_n(struct _namedc *p, int *ix, double *de, double (*pLab)[3], xspect *rspect,
+                   int deType, int n) {
+	int i;
+
+	if (deType < 0 || deType > 2) {
+		snprintf(p->err, NAMEDC_ERRL, "Unnown deType %d",deType);
+		a1logd(p->log, 1, "match_n: %s\n",p->err);
+		return 1;
+	}
+
+	if (match_setup(p, "match_n"))
+		return 1;
+
+	for (i = 0; i < n; i++) {
+		double Lab[3], bde;
+
+		if (match_lab(p, Lab, pLab[i], rspect != NULL ? &rspect[i] : NULL))
+			return 1;
+ 
+		if ((ix[i] = match_index(p, &bde, Lab, deType)) < 0) {
+			snprintf(p->err, NAMEDC_ERRL, "No colors to match against");
+			a1logd(p->log, 1, "match_n: %s\n",p->err);
+			return 1;
+		}
+		if (de != NULL)
+			de[i] = sqrt(bde);
+	}
+	return 0;
+}
+
 /* Free an entry */
 static void clear_nce(nce *p) {
 	if (p != NULL) {
@@ -1320,6 +1570,7 @@ static void clear_namedc(namedc *p) {
 			p->data = NULL;
 		}
 		p->count = 0;
+		free_index(p);
 	}
 }
 
@@ -1354,6 +1605,7 @@ namedc *new_namedc(a1log *log) {
 	p->read_icc   = read_icc;
 	p->read       = read_nc;
 	p->match      = match;
+	p->match_n    = match_n;
 
 	p->chrom[0][0] = -1e38;
 
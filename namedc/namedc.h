@@ -93,6 +93,13 @@ struct _namedc {
 	/* if de != NULL, return the delta E */
 	int (*match)(struct _namedc *p, double *de, double *Lab, xspect *spect, int deType);
 
+	/* Match n colors, as for match(). The index of the best match for each */
+	/* is returned in ix[], and the delta E in de[] if de != NULL. */
+	/* spect may be NULL, or an array of n spectra. */
+	/* Return nz on error */
+	int (*match_n)(struct _namedc *p, int *ix, double *de, double (*Lab)[3], xspect *spect,
+	               int deType, int n);
+
 	/* Houskeeping - should switch this to a1log ? */
 #define NAMEDC_ERRL 1000
 	int errc;				/* Error code */
@@ -114,6 +121,16 @@ struct _namedc {
 	double chrom[3][3];		/* Chromatic transform to this namedc space */
 	icmXYZNumber dXYZ;		/* Named color white point */
 
+	/* Lab grid index of the colors, to speed up matching */
+	unsigned int gcount;	/* Number of colors indexed, 0 if no index */
+	int gdim[3];			/* Number of grid cells in L, a and b */
+	double gmin[3];			/* Lab of the grid origin */
+	double gres;			/* Grid cell size */
+	int *gstart;			/* Start of each cell in gix[], plus end of the last */
+	int *gix;				/* Color indexes in cell order */
+	double gcmax;			/* Largest chroma of the colors */
+	double gldmax;			/* Largest |L - 50| of the colors */
+
 }; typedef struct _namedc namedc;
 
 /* Create a new, uninitialised namedc */
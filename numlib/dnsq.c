@@ -12,6 +12,7 @@
 
 #include "numsup.h"
 #include "dnsq.h"		/* Public interface definitions */
+#include "numthr.h"
 
 #undef DEBUG
 
@@ -64,11 +65,76 @@ static int ddoglg(int n, double *r, double *diag, double *qtb,
 
 /***************************************************************/
 
+/* Core of dnsq(), using the given working storage */
+static int dnsq_imp(dnsqws *ws, void *fdata,
+	int (*fcn)(void *fdata, int n, double *x, double *fvec, int iflag),
+	int (*jac)(void *fdata, int n, double *x, double *fvec, double **fjac),
+	double **sjac, int startsjac, int n, double x[], double fvec[],
+	double dtol, double atol, int maxfev, int ml, int mu, double epsfcn,
+	double diag[], double factor, double maxstep, int nprint,
+	int *nfev, int *njev);
+
+/***************************************************************/
+
+/* Allocate working storage for solving n dimensional systems. */
+/* Return NULL on error */
+dnsqws *new_dnsqws(int n) {
+	dnsqws *ws;
+
+	if (n <= 0 || (ws = (dnsqws *)calloc(1, sizeof(dnsqws))) == NULL)
+		return NULL;
+	ws->n = n;
+	ws->diag = dvector(0,n-1);
+	ws->fjac = dvector(0,(n * n)-1);
+	ws->jjac = convert_dmatrix(ws->fjac,0,n-1,0,n-1);
+	ws->r    = dvector(0,((n * (n+1))/2)-1);
+	ws->qtf  = dvector(0,n-1);
+	ws->wa1  = dvector(0,n-1);
+	ws->wa2  = dvector(0,n-1);
+	ws->wa3  = dvector(0,n-1);
+	ws->wa4  = dvector(0,n-1);
+
+	return ws;
+}
+
+/* Free working storage */
+void del_dnsqws(dnsqws *ws) {
+	int n;
+
+	if (ws == NULL)
+		return;
+	n = ws->n;
+	free_dvector(ws->diag,0,n-1);
+	free_dvector(ws->fjac,0,(n * n)-1);
+	free_convert_dmatrix(ws->jjac,0,n-1,0,n-1);
+	free_dvector(ws->r,0,((n * (n+1))/2)-1);
+	free_dvector(ws->qtf,0,n-1);
+	free_dvector(ws->wa1,0,n-1);
+	free_dvector(ws->wa2,0,n-1);
+	free_dvector(ws->wa3,0,n-1);
+	free_dvector(ws->wa4,0,n-1);
+	free(ws);
+}
+
+/***************************************************************/
+
 /*
  * A simplified interface to dnsq().
  */
 
 int dnsqe(
+	void *fdata,	/* Opaque pointer to pass to fcn() and jac() */
+	int (*fcn)(void *fdata, int n, double *x, double *fvec, int iflag),
+	int (*jac)(void *fdata, int n, double *x, double *fvec, double **fjac),
+	int n, double x[], double ss, double fvec[],
+	double dtol, double atol, int maxfev, int nprint
+) {
+	return dnsqew(NULL, fdata, fcn, jac, n, x, ss, fvec, dtol, atol, maxfev, nprint);
+}
+
+/* dnsqe() using the working storage ws (if not NULL) */
+int dnsqew(
+	dnsqws *ws,		/* Working storage for n, NULL to allocate it */
 	void *fdata,	/* Opaque pointer to pass to fcn() and jac() */
 	int (*fcn)(void *fdata, int n, double *x, double *fvec, int iflag),
 					/* Pointer to function we are solving */
@@ -103,7 +169,7 @@ int dnsqe(
 	index = n * 6 + lr;
 
 	/* Call dnsq. */
-	info = dnsq(fdata, fcn, jac, NULL, 0,
+	info = dnsqw(ws, fdata, fcn, jac, NULL, 0,
 			n, &x[0], &fvec[0], dtol, atol,
 			maxfev, ml, mu, epsfcn, NULL, factor, maxstep, nprint, 
 			&nfev, &njev);
@@ -116,6 +182,82 @@ int dnsqe(
 	return info;
 } /* dnsqe */
 
+/***************************************************************/
+
+/* Batch solving context */
+typedef struct {
+	void **fdata;
+	int (*fcn)(void *fdata, int n, double *x, double *fvec, int iflag);
+	int (*jac)(void *fdata, int n, double *x, double *fvec, double **fjac);
+	int n;
+	double **x;
+	double *ss;
+	double **fvec;
+	double dtol, atol;
+	int maxfev;
+	int *info;
+	dnsqws *ws[NUMTHR_MAX];	/* Per thread working storage */
+} dnsqe_batch_cx;
+
+static int dnsqe_batch_thr(void *cntx, int i0, int i1, int thix) {
+	dnsqe_batch_cx *cx = (dnsqe_batch_cx *)cntx;
+	int i;
+
+	if (cx->ws[thix] == NULL
+	 && (cx->ws[thix] = new_dnsqws(cx->n)) == NULL)
+		return 1;
+
+	for (i = i0; i < i1; i++) {
+		cx->info[i] = dnsqew(cx->ws[thix], cx->fdata[i], cx->fcn, cx->jac, cx->n,
+		                     cx->x[i], cx->ss[i], cx->fvec[i], cx->dtol, cx->atol,
+		                     cx->maxfev, 0);
+	}
+	return 0;
+}
+
+/* Solve nsys independent systems with dnsqe(), using up to nth threads */
+/* (nth <= 0 for num_threads()). fcn() and jac() must be reentrant. */
+/* Return nz on an allocation failure. */
+int dnsqe_batch(
+	int nsys,		/* Number of systems to solve */
+	void **fdata,	/* Opaque pointer for each system, to pass to fcn() and jac() */
+	int (*fcn)(void *fdata, int n, double *x, double *fvec, int iflag),
+	int (*jac)(void *fdata, int n, double *x, double *fvec, double **fjac),
+	int n,			/* Number of functions and variables of every system */
+	double **x,		/* Initial solution estimate for each, RETURNs final solutions */
+	double *ss,		/* Initial search area for each */
+	double **fvec,	/* Arrays RETURNed with the function values at the solutions */
+	double dtol,	/* Desired delta tollerance of the solution */
+	double atol,	/* Desired absolute tollerance of the solution */
+	int maxfev,		/* Maximum number of function calls. set to 0 for automatic */
+	int *info,		/* RETURNs the dnsqe() return value of each system */
+	int nth			/* Number of threads to use */
+) {
+	dnsqe_batch_cx cx;
+	int i, rv;
+
+	cx.fdata = fdata;
+	cx.fcn = fcn;
+	cx.jac = jac;
+	cx.n = n;
+	cx.x = x;
+	cx.ss = ss;
+	cx.fvec = fvec;
+	cx.dtol = dtol;
+	cx.atol = atol;
+	cx.maxfev = maxfev;
+	cx.info = info;
+	for (i = 0; i < NUMTHR_MAX; i++)
+		cx.ws[i] = NULL;
+
+	rv = par_for(nth, 0, nsys, 0, dnsqe_batch_thr, (void *)&cx);
+
+	for (i = 0; i < NUMTHR_MAX; i++)
+		del_dnsqws(cx.ws[i]);
+
+	return rv;
+}
+
 
 
 /***************************************************************/
@@ -445,6 +587,21 @@ int dnsqe(
 
 /* Returns status. 0 = OK. */
 int dnsq(
+	void *fdata,
+	int (*fcn)(void *fdata, int n, double *x, double *fvec, int iflag),
+	int (*jac)(void *fdata, int n, double *x, double *fvec, double **fjac),
+	double **sjac, int startsjac, int n, double x[], double fvec[],
+	double dtol, double atol, int maxfev, int ml, int mu, double epsfcn,
+	double diag[], double factor, double maxstep, int nprint,
+	int *nfev, int *njev
+) {
+	return dnsqw(NULL, fdata, fcn, jac, sjac, startsjac, n, x, fvec, dtol, atol,
+	             maxfev, ml, mu, epsfcn, diag, factor, maxstep, nprint, nfev, njev);
+}
+
+/* dnsq() using the working storage ws (if not NULL) */
+int dnsqw(
+	dnsqws *ws,		/* Working storage for n, NULL to allocate it */
 	void *fdata,	/* Opaque data pointer, passed to called functions */
 	int (*fcn)(void *fdata, int n, double *x, double *fvec, int iflag),
 					/* Pointer to function we are solving */
@@ -468,6 +625,46 @@ int dnsq(
 	int nprint, 	/* Turn on debugging printouts from func() every nprint itterations */
 	int *nfev,		/* RETURNs the number of calls to fcn() */ 
 	int *njev		/* RETURNs the number of calls to jac() */
+) {
+	dnsqws *tws = NULL;
+	int info;
+
+	if (ws == NULL || ws->n != n) {
+		if ((tws = new_dnsqws(n)) == NULL) {
+			*nfev = *njev = 0;
+			return 0;
+		}
+		ws = tws;
+	}
+	info = dnsq_imp(ws, fdata, fcn, jac, sjac, startsjac, n, x, fvec, dtol, atol,
+	                maxfev, ml, mu, epsfcn, diag, factor, maxstep, nprint, nfev, njev);
+	del_dnsqws(tws);
+
+	return info;
+}
+
+static int dnsq_imp(
+	dnsqws *ws,
+	void *fdata,
+	int (*fcn)(void *fdata, int n, double *x, double *fvec, int iflag),
+	int (*jac)(void *fdata, int n, double *x, double *fvec, double **fjac),
+	double **sjac,
+	int startsjac,
+	int n,
+	double x[],
+	double fvec[],
+	double dtol,
+	double atol,
+	int maxfev,
+	int ml,
+	int mu,
+	double epsfcn,
+	double diag[],
+	double factor,
+	double maxstep,
+	int nprint,
+	int *nfev,
+	int *njev
 ) {
 	int info = 0;	/* Return status  - invalid argument */
 	int smode = 0;	/* Scaling mode, 1 = internal */
@@ -505,19 +702,19 @@ int dnsq(
 	double actred, prered;
 	double sum;
 
-	/* Allocate out working arrays */
+	/* Use the supplied working arrays */
 	if (diag == NULL) {	/* Internal scaling */
 		smode = 1;
-		diag = dvector(0,n-1);
+		diag = ws->diag;
 	}
-	fjac = dvector(0,(n * n)-1);
-	jjac = convert_dmatrix(fjac,0,n-1,0,ldfjac-1);
-	r    = dvector(0,((n * (n+1))/2)-1);
-	qtf  = dvector(0,n-1);
-	wa1  = dvector(0,n-1);
-	wa2  = dvector(0,n-1);
-	wa3  = dvector(0,n-1);
-	wa4  = dvector(0,n-1);
+	fjac = ws->fjac;
+	jjac = ws->jjac;
+	r    = ws->r;
+	qtf  = ws->qtf;
+	wa1  = ws->wa1;
+	wa2  = ws->wa2;
+	wa3  = ws->wa3;
+	wa4  = ws->wa4;
 
 	qrflag = 0;
 	iflag = 0;
@@ -895,18 +1092,6 @@ func_exit:
 		}
 	}
 
-	/* Free our working arrays */
-	if (smode)
-		free_dvector(diag,0,n-1);
-	free_dvector(fjac,0,(n * n)-1);
-	free_convert_dmatrix(jjac,0,n-1,0,ldfjac-1);
-	free_dvector(r,0,((n * (n+1))/2)-1);
-	free_dvector(qtf,0,n-1);
-	free_dvector(wa1,0,n-1);
-	free_dvector(wa2,0,n-1);
-	free_dvector(wa3,0,n-1);
-	free_dvector(wa4,0,n-1);
-
 
 	if (iflag < 0)
 		info = iflag;
@@ -37,6 +37,19 @@
        point.
  */
 
+/* Reusable working storage for solving n dimensional systems, */
+/* to avoid allocating it on every call. A workspace may only be */
+/* used by one call at a time. */
+struct _dnsqws {
+	int n;			/* Dimensionality */
+	double *diag, *fjac, **jjac, *r, *qtf;
+	double *wa1, *wa2, *wa3, *wa4;
+}; typedef struct _dnsqws dnsqws;
+
+/* Return NULL on error */
+dnsqws *new_dnsqws(int n);
+void del_dnsqws(dnsqws *ws);
+
 /* dnsq function */
 int dnsq(
 	void *fdata,	/* Opaque data pointer, passed to called functions */
@@ -63,6 +76,19 @@ int dnsq(
 	int *njev		/* RETURNs the number of calls to jac() */
 );
 
+/* dnsq() using the working storage ws. */
+/* If ws is NULL or not for n, temporary storage is allocated. */
+int dnsqw(
+	dnsqws *ws,
+	void *fdata,
+	int (*fcn)(void *fdata, int n, double *x, double *fvec, int iflag),
+	int (*jac)(void *fdata, int n, double *x, double *fvec, double **fjac),
+	double **sjac, int startsjac, int n, double x[], double fvec[],
+	double dtol, double tol, int maxfev, int ml, int mu, double epsfcn,
+	double diag[], double factor, double maxstep, int nprint,
+	int *nfev, int *njev
+);
+
 /* User supplied functions */
 
 /* calculate the functions at x[] */
@@ -104,6 +130,39 @@ int dnsqe(
 	int nprint	 	/* Turn on debugging printouts from func() every nprint itterations */
 );
 
+/* dnsqe() using the working storage ws. */
+/* If ws is NULL or not for n, temporary storage is allocated. */
+int dnsqew(
+	dnsqws *ws,
+	void *fdata,
+	int (*fcn)(void *fdata, int n, double *x, double *fvec, int iflag),
+	int (*jac)(void *fdata, int n, double *x, double *fvec, double **fjac),
+	int n, double x[], double ss, double fvec[],
+	double dtol, double tol, int maxfev, int nprint
+);
+
+/* Solve nsys independent n dimensional systems with dnsqe(), */
+/* spread over up to nth threads (nth <= 0 for num_threads()), */
+/* each thread re-using one workspace. fcn() and jac() must be */
+/* reentrant. The result of each system is the same as that of */
+/* calling dnsqe() on it. info[] RETURNs each dnsqe() return value. */
+/* Return nz on an allocation failure. */
+int dnsqe_batch(
+	int nsys,
+	void **fdata,	/* Opaque pointer for each system */
+	int (*fcn)(void *fdata, int n, double *x, double *fvec, int iflag),
+	int (*jac)(void *fdata, int n, double *x, double *fvec, double **fjac),
+	int n,
+	double **x,		/* Initial solutions, RETURNs final solutions */
+	double *ss,		/* Initial search area for each system */
+	double **fvec,	/* RETURNs function values at the solutions */
+	double dtol,
+	double tol,
+	int maxfev,
+	int *info,
+	int nth
+);
+
 #ifdef __cplusplus
 	}
 #endif
@@ -162,12 +162,9 @@ int      n	/* Dimensionality */
 }
 
 /* Decompose the square matrix A[][] into lower and upper triangles */
-/* NOTE that it returns transposed inverse by normal convention. */
-/* NOTE that rows get swaped by swapping matrix pointers! */ 
-/* Use sym_matrix_trans() to fix this. */
-/* Return 1 if the matrix is singular. */
-int
-lu_decomp(
+/* (Implementation, inlined so that it gets specialised for small constant n) */
+static INLINE int
+lu_decomp_imp(
 double **a,		/* A input array, output upper and lower triangles. */
 int      n,		/* Dimensionality */
 int     *pivx,	/* Return pivoting row permutations record */
@@ -261,10 +258,31 @@ double  *rip	/* Row interchange parity, +/- 1.0, used for determinant */
 	return 0;
 }
 
+/* Decompose the square matrix A[][] into lower and upper triangles */
+/* NOTE that it returns transposed inverse by normal convention. */
+/* NOTE that rows get swaped by swapping matrix pointers! */ 
+/* Use sym_matrix_trans() to fix this. */
+/* Return 1 if the matrix is singular. */
+int
+lu_decomp(
+double **a,		/* A input array, output upper and lower triangles. */
+int      n,		/* Dimensionality */
+int     *pivx,	/* Return pivoting row permutations record */
+double  *rip	/* Row interchange parity, +/- 1.0, used for determinant */
+) {
+	/* Fixed size versions for the common rspl simplex sizes */
+	if (n == 3)
+		return lu_decomp_imp(a, 3, pivx, rip);
+	if (n == 4)
+		return lu_decomp_imp(a, 4, pivx, rip);
+	return lu_decomp_imp(a, n, pivx, rip);
+}
+
 /* Solve a set of simultaneous equations A.x = b from the */
 /* LU decomposition, by back substitution. */
-void
-lu_backsub(
+/* (Implementation, inlined so that it gets specialised for small constant n) */
+static INLINE void
+lu_backsub_imp(
 double **a,		/* A[][] LU decomposed matrix */
 int      n,		/* Dimensionality */
 int     *pivx,	/* Pivoting row permutations record */
@@ -301,6 +319,24 @@ double  *b		/* Input B[] vector, return X[] */
 	}
 }
 
+/* Solve a set of simultaneous equations A.x = b from the */
+/* LU decomposition, by back substitution. */
+void
+lu_backsub(
+double **a,		/* A[][] LU decomposed matrix */
+int      n,		/* Dimensionality */
+int     *pivx,	/* Pivoting row permutations record */
+double  *b		/* Input B[] vector, return X[] */
+) {
+	/* Fixed size versions for the common rspl simplex sizes */
+	if (n == 3)
+		lu_backsub_imp(a, 3, pivx, b);
+	else if (n == 4)
+		lu_backsub_imp(a, 4, pivx, b);
+	else
+		lu_backsub_imp(a, n, pivx, b);
+}
+
 
 /* Improve a solution of equations */
 void
@@ -18,5 +18,6 @@
 #include "aatree.h"		/* Anderson balanced binary tree */
 #include "quadprog.h"	/* Quadradic Programming solution */
 #include "roots.h"		/* Quadratic, Cubic and Quartic root solving */
+#include "numthr.h"		/* Simple multi-threading support */
 
 #endif /* NUMLIB_H */
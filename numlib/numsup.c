@@ -26,6 +26,7 @@
 #include <unistd.h>
 #include <sys/param.h>
 #include <sys/utsname.h>
+#include <sys/resource.h>
 #include <pthread.h>
 #endif
 #ifndef SALONEINSTLIB
@@ -69,6 +70,7 @@ void set_exe_path(char *argv0) {
 	int i;
 
 	g_log->tag = argv0;
+	a1ma_enabled();			/* Latch memory accounting state while single threaded */
 	i = strlen(argv0);
 	if ((exe_path = malloc(i + 5)) == NULL) {
 		a1loge(g_log, 1, "set_exe_path: malloc %d bytes failed\n",i+5);
@@ -397,6 +399,33 @@ static void va_loge(a1log *p, char *fmt, ...) {
 	va_end(args);
 }
 
+/* Call log->logd() with variags */
+static void va_logd(a1log *p, char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	p->logd(p->cntx, p, fmt, args);
+	va_end(args);
+}
+
+/* One threads ring of debug messages. Only the owning thread writes to it. */
+typedef struct _a1log_tring {
+	struct _a1log_tring *next;	/* Next thread's ring */
+	unsigned int n;				/* Number of messages written since last flush */
+	char *lines;				/* [nlines][A1_LOG_RINGLINE] messages */
+} a1log_tring;
+
+/* Ring mode state */
+struct _a1log_ring {
+	int nlines;					/* Number of messages held per thread */
+	a1log_tring *rings;			/* List of per thread rings */
+#ifdef NT
+	DWORD key;					/* Thread local storage index of a1log_tring */
+#endif
+#ifdef UNIX
+	pthread_key_t key;			/* Thread local storage key of a1log_tring */
+#endif
+};
+
 /* Global log */
 a1log default_log = {
 	1,			/* Refcount of 1 because this is not allocated or free'd */
@@ -471,6 +500,7 @@ a1log *new_a1log_d(a1log *log) {
 a1log *del_a1log(a1log *log) {
 	if (log != NULL) {
 		if (--log->refc <= 0) {
+			a1log_ring(log, 0);
 #ifdef NT
 			DeleteCriticalSection(&log->lock);
 #endif
@@ -504,6 +534,122 @@ void a1log_tag(a1log *log, char *tag) {
 	}
 }
 
+/* Set debug ring mode, holding the last nlines debug messages of each thread. */
+/* nlines = 0 flushes any held messages and turns ring mode off. */
+/* Return nz on malloc failure. */
+int a1log_ring(a1log *log, int nlines) {
+	struct _a1log_ring *ring;
+
+	if (log == NULL)
+		return 0;
+
+	/* Flush and free any existing ring mode state */
+	if ((ring = log->ring) != NULL) {
+		a1log_flush(log);
+		log->ring = NULL;
+		while (ring->rings != NULL) {
+			a1log_tring *tr = ring->rings;
+			ring->rings = tr->next;
+			free(tr->lines);
+			free(tr);
+		}
+#ifdef NT
+		TlsFree(ring->key);
+#endif
+#ifdef UNIX
+		pthread_key_delete(ring->key);
+#endif
+		free(ring);
+	}
+
+	if (nlines <= 0)
+		return 0;
+
+	if ((ring = (struct _a1log_ring *)calloc(sizeof(struct _a1log_ring), 1)) == NULL)
+		return 1;
+	ring->nlines = nlines;
+#ifdef NT
+	if ((ring->key = TlsAlloc()) == TLS_OUT_OF_INDEXES) {
+		free(ring);
+		return 1;
+	}
+#endif
+#ifdef UNIX
+	if (pthread_key_create(&ring->key, NULL) != 0) {
+		free(ring);
+		return 1;
+	}
+#endif
+	log->ring = ring;
+
+	return 0;
+}
+
+/* Output and empty the debug messages held in ring mode, */
+/* oldest first for each thread. */
+void a1log_flush(a1log *log) {
+	a1log_tring *tr;
+	int nlines;
+
+	if (log == NULL || log->ring == NULL)
+		return;
+	nlines = log->ring->nlines;
+
+	A1LOG_LOCK(log, 1);
+	for (tr = log->ring->rings; tr != NULL; tr = tr->next) {
+		unsigned int i = 0;
+
+		if (tr->n > (unsigned int)nlines) {
+			va_logd(log, "[%u earlier debug messages dropped]\n", tr->n - nlines);
+			i = tr->n - nlines;
+		}
+		for (; i < tr->n; i++)
+			va_logd(log, "%s", tr->lines + (i % nlines) * A1_LOG_RINGLINE);
+		tr->n = 0;
+	}
+	A1LOG_UNLOCK(log);
+}
+
+/* Format a debug message into the calling threads ring. */
+/* Return nz if the thread has no ring and one can't be allocated. */
+static int a1log_ring_logd(a1log *log, char *fmt, va_list args) {
+	struct _a1log_ring *ring = log->ring;
+	a1log_tring *tr;
+
+#ifdef NT
+	tr = (a1log_tring *)TlsGetValue(ring->key);
+#endif
+#ifdef UNIX
+	tr = (a1log_tring *)pthread_getspecific(ring->key);
+#endif
+
+	/* First message from this thread, so create its ring */
+	if (tr == NULL) {
+		if ((tr = (a1log_tring *)calloc(sizeof(a1log_tring), 1)) == NULL)
+			return 1;
+		if ((tr->lines = (char *)malloc(ring->nlines * A1_LOG_RINGLINE)) == NULL) {
+			free(tr);
+			return 1;
+		}
+		A1LOG_LOCK(log, 0);
+		tr->next = ring->rings;
+		ring->rings = tr;
+		A1LOG_UNLOCK(log);
+#ifdef NT
+		TlsSetValue(ring->key, (LPVOID)tr);
+#endif
+#ifdef UNIX
+		pthread_setspecific(ring->key, (void *)tr);
+#endif
+	}
+
+	vsnprintf(tr->lines + (tr->n % ring->nlines) * A1_LOG_RINGLINE,
+	          A1_LOG_RINGLINE, fmt, args);
+	tr->n++;
+
+	return 0;
+}
+
 /* Log a verbose message if level >= verb */
 void a1logv(a1log *log, int level, char *fmt, ...) {
 
@@ -526,6 +672,14 @@ void a1logd(a1log *log, int level, char *fmt, ...) {
 		if (log->debug >= level) {
 			va_list args;
 	
+			if (log->ring != NULL) {		/* Lock free ring mode */
+				int rv;
+				va_start(args, fmt);
+				rv = a1log_ring_logd(log, fmt, args);
+				va_end(args);
+				if (rv == 0)
+					return;
+			}
 			A1LOG_LOCK(log, 1);
 			va_start(args, fmt);
 			log->logd(log->cntx, log, fmt, args);
@@ -3405,6 +3559,453 @@ double usec_time() {
 
 #endif /* UNIX */
 
+/*******************************/
+/* Hierarchical phase timing */
+/*******************************/
+
+#define A1TM_MAXPH 256		/* Maximum number of distinct phases */
+#define A1TM_MAXDEPTH 32	/* Maximum phase nesting depth */
+
+typedef struct {
+	char *name;			/* Phase name */
+	int parent;			/* Index of parent phase, -1 if none */
+	double time;		/* Total time in usec */
+	int count;			/* Number of times run */
+	double mem;			/* Peak process memory in Mbytes at phase end, 0 if unknown */
+} a1tm_phase;
+
+static int a1tm_on = -1;			/* -1 if not set yet */
+static a1tm_phase a1tm_ph[A1TM_MAXPH];
+static int a1tm_nph = 0;			/* Number of phases */
+static int a1tm_stk[A1TM_MAXDEPTH];	/* Stack of running phases */
+static double a1tm_stt[A1TM_MAXDEPTH];	/* Their start times */
+static int a1tm_sp = 0;			/* Stack depth, including overflow */
+
+/* Return the peak process memory in Mbytes, 0 if unknown */
+static double a1tm_peakmem() {
+#ifdef UNIX
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+		return 0.0;
+# ifdef __APPLE__
+	return ru.ru_maxrss/(1024.0 * 1024.0);		/* bytes */
+# else
+	return ru.ru_maxrss/1024.0;					/* Kbytes */
+# endif
+#else
+	return 0.0;
+#endif
+}
+
+void a1tm_enable(int en) {
+	a1tm_on = en ? 1 : 0;
+}
+
+int a1tm_enabled() {
+	if (a1tm_on < 0) {
+		char *ev = getenv("ARGYLL_PHASE_TIMES");
+		a1tm_on = (ev != NULL && ev[0] != '\000' && strcmp(ev, "0") != 0) ? 1 : 0;
+	}
+	return a1tm_on;
+}
+
+void a1tm_start(char *name) {
+	int i, parent;
+
+	a1tr_begin(name);
+	if (!a1tm_enabled())
+		return;
+	if (a1tm_sp >= A1TM_MAXDEPTH) {
+		a1tm_sp++;			/* Too deep - not timed */
+		return;
+	}
+	parent = a1tm_sp > 0 ? a1tm_stk[a1tm_sp-1] : -1;
+	for (i = 0; i < a1tm_nph; i++) {
+		if (a1tm_ph[i].parent == parent && strcmp(a1tm_ph[i].name, name) == 0)
+			break;
+	}
+	if (i >= a1tm_nph) {
+		if (a1tm_nph >= A1TM_MAXPH) {
+			a1tm_stk[a1tm_sp] = -1;		/* Too many - not timed */
+			a1tm_stt[a1tm_sp++] = 0.0;
+			return;
+		}
+		a1tm_ph[i].name = name;
+		a1tm_ph[i].parent = parent;
+		a1tm_ph[i].time = 0.0;
+		a1tm_ph[i].count = 0;
+		a1tm_ph[i].mem = 0.0;
+		a1tm_nph++;
+	}
+	a1tm_stk[a1tm_sp] = i;
+	a1tm_stt[a1tm_sp++] = usec_time();
+}
+
+void a1tm_end() {
+	a1tm_phase *p;
+	double mem;
+
+	a1tr_end();
+	if (!a1tm_enabled() || a1tm_sp <= 0)
+		return;
+	if (--a1tm_sp >= A1TM_MAXDEPTH || a1tm_stk[a1tm_sp] < 0)
+		return;
+	p = &a1tm_ph[a1tm_stk[a1tm_sp]];
+	p->time += usec_time() - a1tm_stt[a1tm_sp];
+	p->count++;
+	if ((mem = a1tm_peakmem()) > p->mem)
+		p->mem = mem;
+}
+
+/* Log a phase and its children */
+static void a1tm_report_ph(a1log *log, int ix, int depth) {
+	a1tm_phase *p = &a1tm_ph[ix];
+	char name[60];
+	int i;
+
+	sprintf(name, "%*s%.*s", 2 * depth, "", 50, p->name);
+	if (p->mem > 0.0)
+		a1logv(log, 0, " %-40s %10.3f %7d %9.1f\n",name, p->time/1e6, p->count, p->mem);
+	else
+		a1logv(log, 0, " %-40s %10.3f %7d %9s\n",name, p->time/1e6, p->count, "-");
+
+	for (i = ix+1; i < a1tm_nph; i++) {
+		if (a1tm_ph[i].parent == ix)
+			a1tm_report_ph(log, i, depth+1);
+	}
+}
+
+void a1tm_report(a1log *log) {
+	int i;
+
+	if (!a1tm_enabled() || a1tm_nph == 0)
+		return;
+
+	a1logv(log, 0, " %-40s %10s %7s %9s\n","Phase","Seconds","Count","Peak MB");
+	for (i = 0; i < a1tm_nph; i++) {
+		if (a1tm_ph[i].parent < 0)
+			a1tm_report_ph(log, i, 0);
+	}
+}
+
+/*******************************/
+/* Memory use accounting       */
+/*******************************/
+
+static char *a1ma_names[a1ma_no] = { "icc", "cgats", "rspl", "rev", "gamut" };
+
+static int a1ma_on = -1;			/* -1 if not set yet */
+static size_t a1ma_cur[a1ma_no];	/* Current bytes in use per subsystem */
+static size_t a1ma_peak[a1ma_no];	/* Peak bytes in use per subsystem */
+static size_t a1ma_tcur = 0;		/* Current total */
+static size_t a1ma_tpeak = 0;		/* Peak total */
+
+#ifdef NT
+static CRITICAL_SECTION a1ma_lock;
+# define A1MA_LOCK() EnterCriticalSection(&a1ma_lock)
+# define A1MA_UNLOCK() LeaveCriticalSection(&a1ma_lock)
+#endif
+#ifdef UNIX
+static pthread_mutex_t a1ma_lock = PTHREAD_MUTEX_INITIALIZER;
+# define A1MA_LOCK() pthread_mutex_lock(&a1ma_lock)
+# define A1MA_UNLOCK() pthread_mutex_unlock(&a1ma_lock)
+#endif
+
+/* Allocation header used by a1ma_malloc() etc. */
+/* (The union members ensure that the block alignment is preserved) */
+typedef union {
+	size_t size;
+	double d;
+	void *p;
+	long double ld;
+} a1ma_hdr;
+
+static void a1ma_atexit() {
+	a1ma_report(g_log);
+}
+
+/* Note that the first call is expected to be from the main thread */
+/* before any others are started. */
+int a1ma_enabled() {
+	if (a1ma_on < 0) {
+		char *ev = getenv("ARGYLL_MEM_REPORT");
+		if (ev != NULL && ev[0] != '\000' && strcmp(ev, "0") != 0) {
+#ifdef NT
+			InitializeCriticalSection(&a1ma_lock);
+#endif
+			atexit(a1ma_atexit);
+			a1ma_on = 1;
+		} else {
+			a1ma_on = 0;
+		}
+	}
+	return a1ma_on;
+}
+
+void a1ma_inc(a1ma_ss ss, size_t size) {
+	if (a1ma_on == 0 || (a1ma_on < 0 && !a1ma_enabled()))
+		return;
+	A1MA_LOCK();
+	a1ma_cur[ss] += size;
+	if (a1ma_cur[ss] > a1ma_peak[ss])
+		a1ma_peak[ss] = a1ma_cur[ss];
+	a1ma_tcur += size;
+	if (a1ma_tcur > a1ma_tpeak)
+		a1ma_tpeak = a1ma_tcur;
+	A1MA_UNLOCK();
+}
+
+void a1ma_dec(a1ma_ss ss, size_t size) {
+	if (a1ma_on == 0 || (a1ma_on < 0 && !a1ma_enabled()))
+		return;
+	A1MA_LOCK();
+	a1ma_cur[ss] = a1ma_cur[ss] > size ? a1ma_cur[ss] - size : 0;
+	a1ma_tcur = a1ma_tcur > size ? a1ma_tcur - size : 0;
+	A1MA_UNLOCK();
+}
+
+void *a1ma_malloc(a1ma_ss ss, size_t size) {
+	a1ma_hdr *hp;
+
+	if ((hp = (a1ma_hdr *)malloc(sizeof(a1ma_hdr) + size)) == NULL)
+		return NULL;
+	hp->size = size;
+	a1ma_inc(ss, size);
+	return (void *)(hp + 1);
+}
+
+void *a1ma_calloc(a1ma_ss ss, size_t num, size_t size) {
+	a1ma_hdr *hp;
+
+	if (num != 0 && size > ((size_t)-1 - sizeof(a1ma_hdr))/num)
+		return NULL;
+	size *= num;
+	if ((hp = (a1ma_hdr *)calloc(1, sizeof(a1ma_hdr) + size)) == NULL)
+		return NULL;
+	hp->size = size;
+	a1ma_inc(ss, size);
+	return (void *)(hp + 1);
+}
+
+void *a1ma_realloc(a1ma_ss ss, void *ptr, size_t size) {
+	a1ma_hdr *hp;
+	size_t osize;
+
+	if (ptr == NULL)
+		return a1ma_malloc(ss, size);
+
+	hp = (a1ma_hdr *)ptr - 1;
+	osize = hp->size;
+	if ((hp = (a1ma_hdr *)realloc(hp, sizeof(a1ma_hdr) + size)) == NULL)
+		return NULL;
+	hp->size = size;
+	if (size > osize)
+		a1ma_inc(ss, size - osize);
+	else
+		a1ma_dec(ss, osize - size);
+	return (void *)(hp + 1);
+}
+
+void a1ma_free(a1ma_ss ss, void *ptr) {
+	a1ma_hdr *hp;
+
+	if (ptr == NULL)
+		return;
+	hp = (a1ma_hdr *)ptr - 1;
+	a1ma_dec(ss, hp->size);
+	free(hp);
+}
+
+void a1ma_report(a1log *log) {
+	int i;
+
+	if (!a1ma_enabled())
+		return;
+
+	A1MA_LOCK();
+	a1logv(log, 0, " %-20s %12s %12s\n","Memory use","Current MB","Peak MB");
+	for (i = 0; i < a1ma_no; i++) {
+		a1logv(log, 0, " %-20s %12.3f %12.3f\n",a1ma_names[i],
+		                         a1ma_cur[i]/1e6, a1ma_peak[i]/1e6);
+	}
+	a1logv(log, 0, " %-20s %12.3f %12.3f\n","total", a1ma_tcur/1e6, a1ma_tpeak/1e6);
+	A1MA_UNLOCK();
+}
+
+/*******************************/
+/* Event tracing               */
+/*******************************/
+
+#define A1TR_MAXEV (1 << 20)	/* Maximum events recorded per thread */
+#define A1TR_INCEV 4096			/* Event buffer allocation increment */
+
+typedef struct {
+	char *name;			/* Begin event name, NULL for an end event */
+	double ts;			/* usec_time() time stamp */
+} a1tr_ev;
+
+/* One threads event buffer. Only the owning thread writes to it. */
+typedef struct _a1tr_tbuf {
+	struct _a1tr_tbuf *next;	/* Next thread's buffer */
+	int tid;					/* Thread number in order of first event */
+	int n, na;					/* Number of events, number allocated */
+	int depth;					/* Number of begins not yet ended */
+	unsigned int dropped;		/* Number of events dropped when full */
+	a1tr_ev *ev;				/* Events */
+} a1tr_tbuf;
+
+static int a1tr_on = -1;			/* -1 if not set yet */
+static char *a1tr_fname = NULL;		/* File to write the trace to */
+static a1tr_tbuf *a1tr_bufs = NULL;	/* List of per thread buffers */
+static int a1tr_ntid = 0;			/* Number of thread buffers created */
+
+#ifdef NT
+static CRITICAL_SECTION a1tr_lock;
+static DWORD a1tr_key;				/* Thread local storage index of a1tr_tbuf */
+# define A1TR_LOCK() EnterCriticalSection(&a1tr_lock)
+# define A1TR_UNLOCK() LeaveCriticalSection(&a1tr_lock)
+# define A1TR_GETBUF() ((a1tr_tbuf *)TlsGetValue(a1tr_key))
+# define A1TR_SETBUF(tb) TlsSetValue(a1tr_key, (LPVOID)(tb))
+#endif
+#ifdef UNIX
+static pthread_mutex_t a1tr_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t a1tr_key;		/* Thread local storage key of a1tr_tbuf */
+# define A1TR_LOCK() pthread_mutex_lock(&a1tr_lock)
+# define A1TR_UNLOCK() pthread_mutex_unlock(&a1tr_lock)
+# define A1TR_GETBUF() ((a1tr_tbuf *)pthread_getspecific(a1tr_key))
+# define A1TR_SETBUF(tb) pthread_setspecific(a1tr_key, (void *)(tb))
+#endif
+
+/* Write a string as a JSON string */
+static void a1tr_jstr(FILE *fp, char *s) {
+	fputc('"', fp);
+	for (; *s != '\000'; s++) {
+		if (*s == '"' || *s == '\\')
+			fputc('\\', fp);
+		if ((unsigned char)*s >= ' ')
+			fputc(*s, fp);
+	}
+	fputc('"', fp);
+}
+
+/* Write the trace file in Chrome trace event format */
+static void a1tr_atexit() {
+	a1tr_tbuf *tb;
+	double ts = usec_time();
+	FILE *fp;
+	int i, first = 1;
+
+	if ((fp = fopen(a1tr_fname, "w")) == NULL) {
+		a1logw(g_log, "Unable to open trace file '%s'\n",a1tr_fname);
+		return;
+	}
+
+	A1TR_LOCK();
+	fprintf(fp, "{\"traceEvents\":[\n");
+	for (tb = a1tr_bufs; tb != NULL; tb = tb->next) {
+		fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+		            "\"args\":{\"name\":\"%s %d\"}}",
+		            first ? "" : ",\n", tb->tid, tb->tid == 0 ? "main" : "thread", tb->tid);
+		first = 0;
+		for (i = 0; i < tb->n; i++) {
+			if (tb->ev[i].name != NULL) {
+				fprintf(fp, ",\n{\"name\":");
+				a1tr_jstr(fp, tb->ev[i].name);
+				fprintf(fp, ",\"ph\":\"B\",\"pid\":1,\"tid\":%d,\"ts\":%.1f}",tb->tid,tb->ev[i].ts);
+			} else {
+				fprintf(fp, ",\n{\"ph\":\"E\",\"pid\":1,\"tid\":%d,\"ts\":%.1f}",tb->tid,tb->ev[i].ts);
+			}
+		}
+		/* Close any regions still open, or whose end was dropped */
+		for (i = 0; i < tb->depth; i++)
+			fprintf(fp, ",\n{\"ph\":\"E\",\"pid\":1,\"tid\":%d,\"ts\":%.1f}",tb->tid,ts);
+		if (tb->dropped > 0)
+			fprintf(fp, ",\n{\"name\":\"%u events dropped\",\"ph\":\"i\",\"s\":\"t\","
+			            "\"pid\":1,\"tid\":%d,\"ts\":%.1f}",tb->dropped,tb->tid,ts);
+	}
+	fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	A1TR_UNLOCK();
+
+	fclose(fp);
+}
+
+/* Note that the first call is expected to be from the main thread */
+/* before any others are started. par_exec() makes sure of this. */
+int a1tr_enabled() {
+	if (a1tr_on < 0) {
+		char *ev = getenv("ARGYLL_TRACE");
+		a1tr_on = 0;
+		if (ev != NULL && ev[0] != '\000' && strcmp(ev, "0") != 0) {
+			a1tr_fname = ev;
+#ifdef NT
+			if ((a1tr_key = TlsAlloc()) == TLS_OUT_OF_INDEXES)
+				return 0;
+			InitializeCriticalSection(&a1tr_lock);
+#endif
+#ifdef UNIX
+			if (pthread_key_create(&a1tr_key, NULL) != 0)
+				return 0;
+#endif
+			usec_time();		/* Make sure time zero is set */
+			atexit(a1tr_atexit);
+			a1tr_on = 1;
+		}
+	}
+	return a1tr_on;
+}
+
+/* Add an event to the calling threads buffer */
+static void a1tr_event(char *name) {
+	a1tr_tbuf *tb;
+
+	/* First event from this thread, so create its buffer */
+	if ((tb = A1TR_GETBUF()) == NULL) {
+		if ((tb = (a1tr_tbuf *)calloc(sizeof(a1tr_tbuf), 1)) == NULL)
+			return;
+		A1TR_LOCK();
+		tb->tid = a1tr_ntid++;
+		tb->next = a1tr_bufs;
+		a1tr_bufs = tb;
+		A1TR_UNLOCK();
+		A1TR_SETBUF(tb);
+	}
+
+	if (name == NULL && tb->depth <= 0)
+		return;				/* Begin was never recorded */
+
+	if (tb->n >= tb->na) {
+		a1tr_ev *nev = NULL;
+
+		if (tb->na < A1TR_MAXEV)
+			nev = (a1tr_ev *)realloc(tb->ev, (tb->na + A1TR_INCEV) * sizeof(a1tr_ev));
+		if (nev == NULL) {		/* Full, so stop recording this thread */
+			tb->dropped++;
+			return;
+		}
+		A1TR_LOCK();			/* Exclude a1tr_atexit() */
+		tb->ev = nev;
+		tb->na += A1TR_INCEV;
+		A1TR_UNLOCK();
+	}
+	tb->ev[tb->n].name = name;
+	tb->ev[tb->n].ts = usec_time();
+	tb->n++;
+	tb->depth += name != NULL ? 1 : -1;
+}
+
+void a1tr_begin(char *name) {
+	if (a1tr_on == 0 || (a1tr_on < 0 && !a1tr_enabled()))
+		return;
+	a1tr_event(name);
+}
+
+void a1tr_end() {
+	if (a1tr_on == 0 || (a1tr_on < 0 && !a1tr_enabled()))
+		return;
+	a1tr_event(NULL);
+}
+
 /*******************************/
 /* Debug convenience functions */
 /*******************************/
@@ -271,9 +271,16 @@
 	treated as a warning at a higher calling level by calling
 	a1logue (unlatch error) to reset the error code and message.
 
+	For high rate debug logging (e.g. inside instrument measurement loops)
+	the log can be put into ring mode with a1log_ring(). Debug messages are
+	then formatted into a ring of the most recent messages held per thread,
+	without taking the log lock or calling logd(), and are only output
+	by a1log_flush().
+
  */
 
 #define A1_LOG_BUFSIZE 500
+#define A1_LOG_RINGLINE 256		/* Maximum length of a ring mode message */
 
 
 struct _a1log {
@@ -299,6 +306,7 @@ struct _a1log {
 #ifdef UNIX
 	pthread_mutex_t lock;
 #endif
+	struct _a1log_ring *ring;	/* Debug ring mode state, NULL if not in ring mode */
 }; typedef struct _a1log a1log;
 	
 	
@@ -335,6 +343,17 @@ void a1log_verb(a1log *log, int level);
 /* Set the tag. Note that the tag string is NOT copied, just referenced */
 void a1log_tag(a1log *log, char *tag);
 
+/* Set debug ring mode, holding the last nlines debug messages of each thread. */
+/* nlines = 0 flushes any held messages and turns ring mode off. */
+/* No thread should be logging to the log while this is called. */
+/* Return nz on malloc failure. */
+int a1log_ring(a1log *log, int nlines);
+
+/* Output and empty the debug messages held in ring mode, */
+/* oldest first for each thread. No thread should be logging */
+/* to the log while this is called. */
+void a1log_flush(a1log *log);
+
 /* Log a verbose message if level >= verb */
 void a1logv(a1log *log, int level, char *fmt, ...);
 
@@ -770,6 +789,87 @@ unsigned int msec_time();
 /* (The first invokation of usec_time() returns zero) */
 double usec_time();
 
+/*******************************************/
+/* Hierarchical phase timing. */
+/* Phases are bracketed by a1tm_start() and a1tm_end(), and may be */
+/* nested. The time, number of times run and peak process memory */
+/* of each phase is accumulated per phase name and parent phase, */
+/* and a1tm_report() logs them as an indented tree. */
+/* Timing is off unless the ARGYLL_PHASE_TIMES environment variable */
+/* is set, or a1tm_enable() has been called. */
+/* (Only call these from the main thread.) */
+
+/* Turn phase timing on or off */
+void a1tm_enable(int en);
+
+/* Return nz if phase timing is on */
+int a1tm_enabled();
+
+/* Start a phase. The name string is referenced, not copied. */
+void a1tm_start(char *name);
+
+/* End the current phase */
+void a1tm_end();
+
+/* Log the phase time report, if timing is on */
+void a1tm_report(a1log *log);
+
+/*******************************************/
+/* Memory use accounting by subsystem. */
+/* Subsystems either note the sizes of their allocations using */
+/* a1ma_inc() and a1ma_dec(), or allocate using the a1ma_malloc() */
+/* family, which record the size ahead of each block. The current */
+/* and peak bytes in use are tracked per subsystem and in total, */
+/* and a1ma_report() logs them. Accounting is off unless the */
+/* ARGYLL_MEM_REPORT environment variable is set, in which case */
+/* the report is also logged on exit. */
+
+typedef enum {
+	a1ma_icc   = 0,		/* icclib objects */
+	a1ma_cgats = 1,		/* CGATS tables */
+	a1ma_rspl  = 2,		/* rspl grids */
+	a1ma_rev   = 3,		/* rspl reverse lookup acceleration structures */
+	a1ma_gamut = 4,		/* gamut surfaces */
+	a1ma_no    = 5		/* Number of subsystems */
+} a1ma_ss;
+
+/* Return nz if memory accounting is on */
+int a1ma_enabled();
+
+/* Note that size bytes have been allocated or freed */
+void a1ma_inc(a1ma_ss ss, size_t size);
+void a1ma_dec(a1ma_ss ss, size_t size);
+
+/* malloc(), calloc(), realloc() and free() that account for the memory */
+/* (Blocks from these must only be resized or freed using them) */
+void *a1ma_malloc(a1ma_ss ss, size_t size);
+void *a1ma_calloc(a1ma_ss ss, size_t num, size_t size);
+void *a1ma_realloc(a1ma_ss ss, void *ptr, size_t size);
+void a1ma_free(a1ma_ss ss, void *ptr);
+
+/* Log the current and peak memory use, if accounting is on */
+void a1ma_report(a1log *log);
+
+/*******************************************/
+/* Event tracing. */
+/* Regions of code are bracketed by a1tr_begin() and a1tr_end(), */
+/* which record time stamped begin and end events into a buffer */
+/* belonging to the calling thread, so they may be used in threads */
+/* and hot loops. a1tm_start() and a1tm_end() phases are also */
+/* recorded. Tracing is off unless the ARGYLL_TRACE environment */
+/* variable is set to a file name, in which case the events are */
+/* written to it on exit in Chrome trace event JSON format, for */
+/* viewing with chrome://tracing or ui.perfetto.dev. */
+
+/* Return nz if tracing is on */
+int a1tr_enabled();
+
+/* Begin a region. The name string is referenced, not copied. */
+void a1tr_begin(char *name);
+
+/* End the calling threads current region */
+void a1tr_end();
+
 /*******************************************/
 /* Debug convenience functions (duplicated in icc) */
 
@@ -0,0 +1,366 @@
+
+/*
+ * Simple portable multi-threading support.
+ *
+ * Copyright 2020 Graeme W. Gill
+ * All rights reserved.
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+#include "numsup.h"
+#include "numthr.h"
+#ifdef UNIX
+# include <unistd.h>
+#endif
+
+/* Return the number of processors in the system, 1 if unknown */
+int num_processors(void) {
+	static int nproc = 0;
+
+	if (nproc == 0) {
+#ifdef NT
+		SYSTEM_INFO sysinfo;
+		GetSystemInfo(&sysinfo);
+		nproc = (int)sysinfo.dwNumberOfProcessors;
+#endif
+#if defined(UNIX) && defined(_SC_NPROCESSORS_ONLN)
+		nproc = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		if (nproc < 1)
+			nproc = 1;
+	}
+	return nproc;
+}
+
+/* Return the default number of threads to use */
+int num_threads(void) {
+	char *ev;
+	int nth;
+
+	if ((ev = getenv("ARGYLL_NUM_THREADS")) != NULL
+	 && (nth = atoi(ev)) > 0) {
+		if (nth > NUMTHR_MAX)
+			nth = NUMTHR_MAX;
+		return nth;
+	}
+
+	nth = num_processors();
+	if (nth > NUMTHR_MAX)
+		nth = NUMTHR_MAX;
+	return nth;
+}
+
+/* Per thread information */
+typedef struct {
+	int (*func)(void *cntx, int ix, int nth);
+	void *cntx;
+	int ix, nth;
+	int rv;			/* Return value */
+#ifdef NT
+	HANDLE th;
+#endif
+#ifdef UNIX
+	pthread_t thid;
+#endif
+	int started;	/* Thread was created */
+} par_thr;
+
+#ifdef NT
+static DWORD WINAPI par_thr_main(LPVOID lpParameter) {
+	par_thr *p = (par_thr *)lpParameter;
+	p->rv = p->func(p->cntx, p->ix, p->nth);
+	return 0;
+}
+#endif
+#ifdef UNIX
+static void *par_thr_main(void *context) {
+	par_thr *p = (par_thr *)context;
+	p->rv = p->func(p->cntx, p->ix, p->nth);
+	return NULL;
+}
+#endif
+
+/* Execute func(cntx, ix, nth) for ix = 0 .. nth-1 in parallel, */
+/* using a new thread for each. */
+static int par_exec_thr(int nth, int (*func)(void *cntx, int ix, int nth), void *cntx) {
+	par_thr th[NUMTHR_MAX];
+	int i, rv = 0;
+
+	for (i = 0; i < nth; i++) {
+		th[i].func = func;
+		th[i].cntx = cntx;
+		th[i].ix = i;
+		th[i].nth = nth;
+		th[i].rv = 0;
+		th[i].started = 0;
+	}
+
+	/* Start all but the last one in their own thread */
+	for (i = 0; i < (nth-1); i++) {
+#ifdef NT
+		if ((th[i].th = CreateThread(NULL, 0, par_thr_main, (LPVOID)&th[i], 0, NULL)) != NULL)
+			th[i].started = 1;
+#endif
+#ifdef UNIX
+		if (pthread_create(&th[i].thid, NULL, par_thr_main, (void *)&th[i]) == 0)
+			th[i].started = 1;
+#endif
+	}
+
+	/* Do the last one, and any that didn't start, in this thread */
+	th[nth-1].rv = func(cntx, nth-1, nth);
+	for (i = 0; i < (nth-1); i++) {
+		if (!th[i].started)
+			th[i].rv = func(cntx, i, nth);
+	}
+
+	/* Wait for them all to finish */
+	for (i = 0; i < (nth-1); i++) {
+		if (!th[i].started)
+			continue;
+#ifdef NT
+		WaitForSingleObject(th[i].th, INFINITE);
+		CloseHandle(th[i].th);
+#endif
+#ifdef UNIX
+		pthread_join(th[i].thid, NULL);
+#endif
+	}
+
+	for (i = 0; i < nth; i++) {
+		if (th[i].rv != 0) {
+			rv = th[i].rv;
+			break;
+		}
+	}
+	return rv;
+}
+
+/* - - - - - - - - - - - - - - - - - - -- */
+/* Persistent pool of worker threads, so that par_exec() */
+/* doesn't have to create threads on every call. */
+
+/* Per worker information */
+typedef struct {
+	int ix;			/* Index the worker executes */
+	int go;			/* Set to start executing */
+	int rv;			/* Return value */
+	acond cond;		/* Signal to start */
+#ifdef NT
+	HANDLE th;
+#endif
+#ifdef UNIX
+	pthread_t thid;
+#endif
+} par_wkr;
+
+static amutex_static(par_lock);	/* Lock for the pool */
+static struct {
+	int inited;		/* done has been initialised */
+	int busy;		/* Pool is being used by a par_exec() */
+	int nwkr;		/* Number of workers created */
+	par_wkr wkr[NUMTHR_MAX-1];
+	int (*func)(void *cntx, int ix, int nth);
+	void *cntx;
+	int nth;
+	int nrun;		/* Number of workers still running */
+	acond done;		/* Signal that the last worker has finished */
+} par_pool;
+
+#ifdef NT
+static DWORD WINAPI par_wkr_main(LPVOID lpParameter) {
+	par_wkr *w = (par_wkr *)lpParameter;
+#endif
+#ifdef UNIX
+static void *par_wkr_main(void *context) {
+	par_wkr *w = (par_wkr *)context;
+#endif
+
+	amutex_lock(par_lock);
+	for (;;) {
+		while (!w->go)
+			acond_wait(w->cond, par_lock);
+		w->go = 0;
+		amutex_unlock(par_lock);
+
+		w->rv = par_pool.func(par_pool.cntx, w->ix, par_pool.nth);
+
+		amutex_lock(par_lock);
+		if (--par_pool.nrun == 0)
+			acond_signal(par_pool.done);
+	}
+#ifdef NT
+	return 0;
+#endif
+#ifdef UNIX
+	return NULL;
+#endif
+}
+
+/* Create workers so that there are at least n. */
+/* Return the number of workers. (Called with par_lock held.) */
+static int par_wkr_create(int n) {
+	for (; par_pool.nwkr < n; par_pool.nwkr++) {
+		par_wkr *w = &par_pool.wkr[par_pool.nwkr];
+
+		w->ix = par_pool.nwkr;
+		w->go = 0;
+		acond_init(w->cond);
+#ifdef NT
+		if ((w->th = CreateThread(NULL, 0, par_wkr_main, (LPVOID)w, 0, NULL)) == NULL) {
+			acond_del(w->cond);
+			break;
+		}
+#endif
+#ifdef UNIX
+		if (pthread_create(&w->thid, NULL, par_wkr_main, (void *)w) != 0) {
+			acond_del(w->cond);
+			break;
+		}
+		pthread_detach(w->thid);
+#endif
+	}
+	return par_pool.nwkr;
+}
+
+/* Execute func(cntx, ix, nth) for ix = 0 .. nth-1 in parallel */
+int par_exec(int nth, int (*func)(void *cntx, int ix, int nth), void *cntx) {
+	int i, nw, rv = 0;
+
+	if (nth <= 0)
+		nth = num_threads();
+	if (nth > NUMTHR_MAX)
+		nth = NUMTHR_MAX;
+
+	if (nth == 1)
+		return func(cntx, 0, 1);
+
+	a1tr_enabled();		/* Set tracing state before threads use it */
+
+	/* If the pool is already in use (i.e. a nested or concurrent */
+	/* call), fall back to creating threads. */
+	amutex_lock(par_lock);
+	if (par_pool.busy) {
+		amutex_unlock(par_lock);
+		return par_exec_thr(nth, func, cntx);
+	}
+	par_pool.busy = 1;
+	if (!par_pool.inited) {
+		acond_init(par_pool.done);
+		par_pool.inited = 1;
+	}
+	if ((nw = par_wkr_create(nth-1)) > (nth-1))
+		nw = nth-1;
+
+	/* Start the workers */
+	par_pool.func = func;
+	par_pool.cntx = cntx;
+	par_pool.nth = nth;
+	par_pool.nrun = nw;
+	for (i = 0; i < nw; i++) {
+		par_pool.wkr[i].rv = 0;
+		par_pool.wkr[i].go = 1;
+		acond_signal(par_pool.wkr[i].cond);
+	}
+	amutex_unlock(par_lock);
+
+	/* Do the last one, and any that had no worker, in this thread */
+	for (i = nth-1; i >= nw; i--) {
+		int trv = func(cntx, i, nth);
+		if (trv != 0)
+			rv = trv;
+	}
+
+	/* Wait for the workers to finish */
+	amutex_lock(par_lock);
+	while (par_pool.nrun > 0)
+		acond_wait(par_pool.done, par_lock);
+	for (i = 0; i < nw; i++) {
+		if (par_pool.wkr[i].rv != 0) {
+			rv = par_pool.wkr[i].rv;
+			break;
+		}
+	}
+	par_pool.busy = 0;
+	amutex_unlock(par_lock);
+
+	return rv;
+}
+
+/* - - - - - - - - - - - - - - - - - - -- */
+
+/* par_for() context */
+typedef struct {
+	int (*func)(void *cntx, int i0, int i1, int thix);
+	void *cntx;
+	int next, end, grain;
+	int rv;				/* First non-zero return value */
+	amutex lock;
+} par_for_cx;
+
+static int par_for_thr(void *cntx, int ix, int nth) {
+	par_for_cx *cx = (par_for_cx *)cntx;
+
+	for (;;) {
+		int i0, i1, rv;
+
+		/* Take the next chunk */
+		amutex_lock(cx->lock);
+		if (cx->rv != 0 || cx->next >= cx->end) {
+			amutex_unlock(cx->lock);
+			break;
+		}
+		i0 = cx->next;
+		i1 = cx->end - i0 > cx->grain ? i0 + cx->grain : cx->end;
+		cx->next = i1;
+		amutex_unlock(cx->lock);
+
+		if ((rv = cx->func(cx->cntx, i0, i1, ix)) != 0) {
+			amutex_lock(cx->lock);
+			if (cx->rv == 0)
+				cx->rv = rv;
+			amutex_unlock(cx->lock);
+			break;
+		}
+	}
+	return 0;
+}
+
+/* Execute func(cntx, i0, i1, thix) over the index range start .. end-1 */
+/* in chunks of up to grain indexes, handing chunks out to nth threads */
+/* as they become free, so that uneven work is balanced. */
+int par_for(int nth, int start, int end, int grain,
+            int (*func)(void *cntx, int i0, int i1, int thix), void *cntx) {
+	par_for_cx cx;
+	int n = end - start;
+
+	if (n <= 0)
+		return 0;
+	if (nth <= 0)
+		nth = num_threads();
+	if (nth > NUMTHR_MAX)
+		nth = NUMTHR_MAX;
+	if (grain <= 0)
+		grain = (n + PAR_FOR_CHUNKS * nth - 1)/(PAR_FOR_CHUNKS * nth);
+	if (nth > ((n + grain - 1)/grain))
+		nth = (n + grain - 1)/grain;
+
+	if (nth == 1)
+		return func(cntx, start, end, 0);
+
+	cx.func = func;
+	cx.cntx = cntx;
+	cx.next = start;
+	cx.end = end;
+	cx.grain = grain;
+	cx.rv = 0;
+	amutex_init(cx.lock);
+
+	par_exec(nth, par_for_thr, (void *)&cx);
+
+	amutex_del(cx.lock);
+
+	return cx.rv;
+}
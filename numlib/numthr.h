@@ -0,0 +1,102 @@
+#ifndef NUMTHR_H
+#define NUMTHR_H
+
+/*
+ * Simple portable multi-threading support, for parallelising
+ * loops in the libraries that only depend on numlib.
+ */
+
+/*
+ * Copyright 2020 Graeme W. Gill
+ * All rights reserved.
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+/* - - - - - - - - - - - - - - - - - - -- */
+/* Mutex and condition. These are identical to the spectro/conv.h */
+/* ones, so that code can use either. */
+
+#ifndef amutex_init
+
+#ifdef NT
+# define amutex CRITICAL_SECTION
+# define amutex_static(lock) CRITICAL_SECTION lock = {(void*)-1,-1 }
+# define amutex_init(lock) InitializeCriticalSection(&(lock))
+# define amutex_del(lock) DeleteCriticalSection(&(lock))
+# define amutex_lock(lock) EnterCriticalSection(&(lock))
+# define amutex_trylock(lock) (!TryEnterCriticalSection(&(lock)))
+# define amutex_unlock(lock) LeaveCriticalSection(&(lock))
+
+# define acond HANDLE
+# define acond_init(cond) (cond = CreateEvent(NULL, 0, 0, NULL))
+# define acond_del(cond) CloseHandle(cond)
+# define acond_wait(cond, lock) (LeaveCriticalSection(&(lock)),	\
+                          WaitForSingleObject(cond, INFINITE),	\
+                          EnterCriticalSection(&(lock)))
+# define acond_signal(cond) SetEvent(cond)
+#endif
+
+#ifdef UNIX
+# define amutex pthread_mutex_t
+# define amutex_static(lock) pthread_mutex_t (lock) = PTHREAD_MUTEX_INITIALIZER
+# define amutex_init(lock) pthread_mutex_init(&(lock), NULL)
+# define amutex_del(lock) pthread_mutex_destroy(&(lock))
+# define amutex_lock(lock) pthread_mutex_lock(&(lock))
+# define amutex_trylock(lock) pthread_mutex_trylock(&(lock))
+# define amutex_unlock(lock) pthread_mutex_unlock(&(lock))
+
+# define acond pthread_cond_t
+# define acond_static(cond) pthread_cond_t (cond) = PTHREAD_COND_INITIALIZER
+# define acond_init(cond) pthread_cond_init(&(cond), NULL)
+# define acond_del(cond) pthread_cond_destroy(&(cond))
+# define acond_wait(cond, lock) pthread_cond_wait(&(cond), &(lock))
+# define acond_signal(cond) pthread_cond_signal(&(cond))
+#endif
+
+#endif /* !amutex_init */
+
+/* - - - - - - - - - - - - - - - - - - -- */
+
+#define NUMTHR_MAX 64		/* Maximum number of threads par_exec() will use */
+
+/* Return the number of processors in the system, 1 if unknown */
+int num_processors(void);
+
+/* Return the default number of threads to use for parallel */
+/* operations. This is the number of processors, unless overridden */
+/* by the ARGYLL_NUM_THREADS environment variable. */
+int num_threads(void);
+
+/* Execute func(cntx, ix, nth) for ix = 0 .. nth-1 in parallel, */
+/* and wait for them all to complete. The last is executed in */
+/* the calling thread. If a thread can't be created, its share is */
+/* executed in the calling thread instead. nth <= 0 means use num_threads(). */
+/* Return the first non-zero value returned by func(), 0 otherwise. */
+int par_exec(int nth, int (*func)(void *cntx, int ix, int nth), void *cntx);
+
+/* The threads used by par_exec() are kept in a pool and re-used. */
+/* A nested or concurrent call creates threads for its own use. */
+
+#define PAR_FOR_CHUNKS 8	/* Default number of chunks per thread for par_for() */
+
+/* Execute func(cntx, i0, i1, thix) over the index range start .. end-1 */
+/* in chunks of up to grain indexes (grain <= 0 for a default), with */
+/* chunks handed out to nth threads as they become free, so that uneven */
+/* work is balanced. thix is the 0 .. nth-1 index of the thread, for use */
+/* with per thread workspace. nth <= 0 means use num_threads(). */
+/* Return the first non-zero value returned by func(), 0 otherwise. */
+/* No more chunks are started once func() has returned non-zero. */
+int par_for(int nth, int start, int end, int grain,
+            int (*func)(void *cntx, int i0, int i1, int thix), void *cntx);
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif /* NUMTHR_H */
@@ -38,6 +38,7 @@
 /* Note that all arrays are indexed from 0 */
 
 #include "numsup.h"
+#include "numthr.h"
 #include "powell.h"
 
 #undef SLOPE_SANITY_CHECK		/* [und] expermental */
@@ -1137,3 +1138,127 @@ void *fdata)		/* Opaque data for func() */
 #undef POWELL_GOLD
 #undef POWELL_MAXIT
 
+
+/* -------------------------------------- */
+/* Multi-start versions. These run the optimiser from each of */
+/* several starting points in parallel, and return the best result. */
+
+typedef struct {
+	int cg;					/* NZ for conjgrad, else powell */
+	int di;
+	double *sps;			/* [nsp][di] starting points, replaced by results */
+	double *rvs;			/* [nsp] residual errors */
+	int *rets;				/* [nsp] return values */
+	double *s;
+	double ftol;
+	int maxit;
+	double (*func)(void *fdata, double tp[]);
+	double (*dfunc)(void *fdata, double dp[], double tp[]);
+	void *fdata;
+} ms_cx;
+
+static int ms_thread(void *cntx, int i0, int i1, int thix) {
+	ms_cx *cx = (ms_cx *)cntx;
+	int i;
+
+	for (i = i0; i < i1; i++) {
+		if (cx->cg)
+			cx->rets[i] = conjgrad(&cx->rvs[i], cx->di, cx->sps + i * cx->di, cx->s,
+			                 cx->ftol, cx->maxit, cx->func, cx->dfunc, cx->fdata, NULL, NULL);
+		else
+			cx->rets[i] = powell(&cx->rvs[i], cx->di, cx->sps + i * cx->di, cx->s,
+			                 cx->ftol, cx->maxit, cx->func, cx->fdata, NULL, NULL);
+	}
+	return 0;
+}
+
+/* Run the optimisations and return the best in cp[]. */
+static int ms_optimise(ms_cx *cx, double *rv, int nsp, double *sps, double cp[]) {
+	int i, bi = -1, rr;
+
+	cx->sps = dvector(0, nsp * cx->di -1);
+	cx->rvs = dvector(0, nsp-1);
+	cx->rets = ivector(0, nsp-1);
+	for (i = 0; i < (nsp * cx->di); i++)
+		cx->sps[i] = sps[i];
+
+	par_for(0, 0, nsp, 1, ms_thread, (void *)cx);
+
+	/* Choose the best result, prefering ones that converged */
+	for (i = 0; i < nsp; i++) {
+		if (bi < 0
+		 || (cx->rets[i] == 0 && cx->rets[bi] != 0)
+		 || (cx->rets[i] == cx->rets[bi] && cx->rvs[i] < cx->rvs[bi]))
+			bi = i;
+	}
+	for (i = 0; i < cx->di; i++)
+		cp[i] = cx->sps[bi * cx->di + i];
+	if (rv != NULL)
+		*rv = cx->rvs[bi];
+	rr = cx->rets[bi];
+
+	free_dvector(cx->sps, 0, nsp * cx->di -1);
+	free_dvector(cx->rvs, 0, nsp-1);
+	free_ivector(cx->rets, 0, nsp-1);
+
+	return rr;
+}
+
+/* Multi-start powell(). func() must be thread safe. */
+/* return 0 on sucess, 1 on failure due to excessive itterations */
+/* Result will be in cp */
+int powell_ms(
+double *rv,				/* If not NULL, return the residual error */
+int di,					/* Dimentionality */
+int nsp,				/* Number of starting points */
+double *sps,			/* [nsp][di] starting points */
+double cp[],			/* Returned best point */
+double s[],				/* Size of initial search area */
+double ftol,			/* Tollerance of error change to stop on */
+int maxit,				/* Maximum iterations allowed */
+double (*func)(void *fdata, double tp[]),		/* Error function to evaluate */
+void *fdata				/* Opaque data needed by func() */
+) {
+	ms_cx cx;
+
+	cx.cg = 0;
+	cx.di = di;
+	cx.s = s;
+	cx.ftol = ftol;
+	cx.maxit = maxit;
+	cx.func = func;
+	cx.dfunc = NULL;
+	cx.fdata = fdata;
+
+	return ms_optimise(&cx, rv, nsp, sps, cp);
+}
+
+/* Multi-start conjgrad(). func() and dfunc() must be thread safe. */
+/* return 0 on sucess, 1 on failure due to excessive itterations */
+/* Result will be in cp */
+int conjgrad_ms(
+double *rv,				/* If not NULL, return the residual error */
+int di,					/* Dimentionality */
+int nsp,				/* Number of starting points */
+double *sps,			/* [nsp][di] starting points */
+double cp[],			/* Returned best point */
+double s[],				/* Size of initial search area */
+double ftol,			/* Tollerance of error change to stop on */
+int maxit,				/* Maximum iterations allowed */
+double (*func)(void *fdata, double tp[]),		/* Error function to evaluate */
+double (*dfunc)(void *fdata, double dp[], double tp[]),		/* Gradient & function to evaluate */
+void *fdata				/* Opaque data needed by function */
+) {
+	ms_cx cx;
+
+	cx.cg = 1;
+	cx.di = di;
+	cx.s = s;
+	cx.ftol = ftol;
+	cx.maxit = maxit;
+	cx.func = func;
+	cx.dfunc = dfunc;
+	cx.fdata = fdata;
+
+	return ms_optimise(&cx, rv, nsp, sps, cp);
+}
@@ -52,6 +52,37 @@ void (*prog)(void *pdata, int perc),		/* Optional progress percentage callback *
 void *pdata				/* Opaque data needed by prog() */
 );
 
+/* Multi-start versions of powell() and conjgrad(). These run the */
+/* optimiser from each of nsp starting points in parallel, and return */
+/* the best result (prefering ones that converged) in cp. func() and */
+/* dfunc() must be thread safe. */
+int powell_ms(
+double *rv,				/* If not NULL, return the residual error */
+int di,					/* Dimentionality */
+int nsp,				/* Number of starting points */
+double *sps,			/* [nsp][di] starting points */
+double cp[],			/* Returned best point */
+double s[],				/* Size of initial search area */
+double ftol,			/* Tollerance of error change to stop on */
+int maxit,				/* Maximum iterations allowed */
+double (*funk)(void *fdata, double tp[]),		/* Error function to evaluate */
+void *fdata				/* Opaque data needed by func() */
+);
+
+int conjgrad_ms(
+double *rv,				/* If not NULL, return the residual error */
+int di,					/* Dimentionality */
+int nsp,				/* Number of starting points */
+double *sps,			/* [nsp][di] starting points */
+double cp[],			/* Returned best point */
+double s[],				/* Size of initial search area */
+double ftol,			/* Tollerance of error change to stop on */
+int maxit,				/* Maximum iterations allowed */
+double (*func)(void *fdata, double tp[]),		/* Error function to evaluate */
+double (*dfunc)(void *fdata, double dp[], double tp[]),		/* Gradient & function to evaluate */
+void *fdata				/* Opaque data needed by function */
+);
+
 /* Example user function declarations */
 double powell_funk(		/* Return function value */
 	void *fdata,		/* Opaque data pointer */
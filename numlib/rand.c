@@ -74,6 +74,16 @@ void rand_init(rand_state *p) {
 	memset((void *)p, 0, sizeof(rand_state));
 }
 
+/* Copy the state from src to dst */
+void rand_copy(rand_state *dst, rand_state *src) {
+	if (dst == NULL)
+		dst = &g_rand;
+	if (src == NULL)
+		src = &g_rand;
+	if (dst != src)
+		*dst = *src;
+}
+
 /* Return a 32 bit number between 0 and 4294967295 */
 /* Use Knuth shuffle to improve PSRAND32 sequence */
 unsigned int
@@ -164,3 +174,155 @@ double norm_rand_th(rand_state *p) {
 
 
 
+
+/* - - - - - - - - - - - - - - - */
+/* Jumpable stream random generator */
+
+/* 64 bit constant from two 32 bit halves */
+#define RS_C64(hi, lo) (((ORD64)(hi) << 32) | (ORD64)(lo))
+
+/* 64 bit rotate left */
+#define RS_ROTL(x, k) (((x) << (k)) | ((x) >> (64 - (k))))
+
+/* Scale a 53 bit integer to 0.0 to 1.0 inclusive */
+#define RS_SCALE53 (1.0/9007199254740991.0)
+
+/* Init the rand_stream to stream number ix of the given seed */
+void rand_stream_init(rand_stream *p, unsigned int seed, unsigned int ix) {
+	ORD64 x = seed;
+	int i;
+
+	/* Expand the seed using splitmix64, so that the state is never all zero */
+	for (i = 0; i < 4; i++) {
+		ORD64 z;
+		x += RS_C64(0x9e3779b9, 0x7f4a7c15);
+		z = x;
+		z = (z ^ (z >> 30)) * RS_C64(0xbf58476d, 0x1ce4e5b9);
+		z = (z ^ (z >> 27)) * RS_C64(0x94d049bb, 0x133111eb);
+		p->s[i] = z ^ (z >> 31);
+	}
+	p->r2 = 0;
+
+	for (; ix > 0; ix--)
+		rand_stream_jump(p);
+}
+
+/* Return a 64 bit random number */
+ORD64 rand64_st(rand_stream *p) {
+	ORD64 *s = p->s;
+	ORD64 rv, t;
+
+	rv = RS_ROTL(s[1] * 5, 7) * 9;
+	t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = RS_ROTL(s[3], 45);
+
+	return rv;
+}
+
+/* Advance the rand_stream by 2^128 values, i.e. to the next stream */
+void rand_stream_jump(rand_stream *p) {
+	static ORD64 jump[4] = {
+		RS_C64(0x180ec6d3, 0x3cfd0aba), RS_C64(0xd5a61266, 0xf0c9392c),
+		RS_C64(0xa9582618, 0xe03fc9aa), RS_C64(0x39abdc45, 0x29b1661c)
+	};
+	ORD64 s[4] = { 0, 0, 0, 0 };
+	int i, b;
+
+	for (i = 0; i < 4; i++) {
+		for (b = 0; b < 64; b++) {
+			if (jump[i] & ((ORD64)1 << b)) {
+				s[0] ^= p->s[0];
+				s[1] ^= p->s[1];
+				s[2] ^= p->s[2];
+				s[3] ^= p->s[3];
+			}
+			rand64_st(p);
+		}
+	}
+	p->s[0] = s[0];
+	p->s[1] = s[1];
+	p->s[2] = s[2];
+	p->s[3] = s[3];
+	p->r2 = 0;
+}
+
+/* Return a uniform random double in the range min to max inclusive */
+double d_rand_st(rand_stream *p, double min, double max) {
+	return min + (max - min) * RS_SCALE53 * (rand64_st(p) >> 11);
+}
+
+/* Return a random floating point number with a gausian/normal */
+/* distribution, centered about 0.0, with standard deviation 1.0 */
+/* This uses the Box-Muller transformation */
+double norm_rand_st(rand_stream *p) {
+	if (p->r2 == 0) {				/* No previously calculated number */
+		double v1, v2, t1, t2;
+		do {
+			v1 = d_rand_st(p, -1.0, 1.0);
+			v2 = d_rand_st(p, -1.0, 1.0);
+			t1 = v1 * v1 + v2 * v2;
+		} while (t1 == 0.0 || t1 >= 1.0);
+		t2 = sqrt(-2.0 * log(t1)/t1);
+		p->nr2 = v2 * t2;			/* One for next time */
+		p->r2 = 1;
+		return v1 * t2;
+	} else {						/* Return previously calculated number */
+		p->r2 = 0;
+		return p->nr2;
+	}
+}
+
+/* Fill out[n] with uniform random doubles in the range min to max inclusive */
+void d_rand_vst(rand_stream *p, double *out, int n, double min, double max) {
+	ORD64 s0 = p->s[0], s1 = p->s[1], s2 = p->s[2], s3 = p->s[3], t;
+	double sc = (max - min) * RS_SCALE53;
+	int i;
+
+	/* Same as d_rand_st(), with the state kept in registers */
+	for (i = 0; i < n; i++) {
+		out[i] = min + sc * (RS_ROTL(s1 * 5, 7) * 9 >> 11);
+		t = s1 << 17;
+		s2 ^= s0;
+		s3 ^= s1;
+		s1 ^= s2;
+		s0 ^= s3;
+		s2 ^= t;
+		s3 = RS_ROTL(s3, 45);
+	}
+	p->s[0] = s0;
+	p->s[1] = s1;
+	p->s[2] = s2;
+	p->s[3] = s3;
+}
+
+/* Fill out[n] with normal distribution random doubles */
+void norm_rand_vst(rand_stream *p, double *out, int n) {
+	int i = 0;
+
+	/* Use up any left over value */
+	if (n > 0 && p->r2 != 0) {
+		out[i++] = p->nr2;
+		p->r2 = 0;
+	}
+
+	/* Generate pairs directly into out[] */
+	for (; (i + 1) < n; i += 2) {
+		double v1, v2, t1, t2;
+		do {
+			v1 = d_rand_st(p, -1.0, 1.0);
+			v2 = d_rand_st(p, -1.0, 1.0);
+			t1 = v1 * v1 + v2 * v2;
+		} while (t1 == 0.0 || t1 >= 1.0);
+		t2 = sqrt(-2.0 * log(t1)/t1);
+		out[i] = v1 * t2;
+		out[i+1] = v2 * t2;
+	}
+
+	if (i < n)
+		out[i] = norm_rand_st(p);
+}
@@ -59,6 +59,10 @@ typedef struct {
 /* Init rand_state to default */
 void rand_init(rand_state *p);
 
+/* Copy the state from src to dst, so that a sequence can be */
+/* resumed where it left off */
+void rand_copy(rand_state *dst, rand_state *src);
+
 /* Return a random number between 0 and 4294967294 */
 unsigned int
 rand32_th(rand_state *p,
@@ -78,6 +82,45 @@ double d2_rand_th(rand_state *p, double min, double max);
 /* and an average deviation of 0.564 */
 double norm_rand_th(rand_state *p);
 
+/* - - - - - - - - - - - - - - - */
+/* Jumpable stream random generator */
+/* (xoshiro256** by Blackman & Vigna) */
+
+/* This has a small state that can be given to each thread. Each stream */
+/* of a given seed starts 2^128 values into the sequence from the */
+/* previous one, so a computation divided into streams by a fixed rule */
+/* gives the same results no matter how many threads are used. */
+
+typedef struct {
+	ORD64 s[4];
+
+	/* normal distribution 2nd value */
+	int r2;			/* 2nd value available */
+	double nr2;		/* 2nd value */
+} rand_stream;
+
+/* Init the rand_stream to stream number ix of the given seed */
+void rand_stream_init(rand_stream *p, unsigned int seed, unsigned int ix);
+
+/* Advance the rand_stream by 2^128 values, i.e. to the next stream */
+void rand_stream_jump(rand_stream *p);
+
+/* Return a 64 bit random number */
+ORD64 rand64_st(rand_stream *p);
+
+/* Return a uniform random double in the range min to max inclusive */
+double d_rand_st(rand_stream *p, double min, double max);
+
+/* Return a random floating point number with a gausian/normal */
+/* distribution, centered about 0.0, with standard deviation 1.0 */
+double norm_rand_st(rand_stream *p);
+
+/* Fill out[n] with uniform random doubles in the range min to max inclusive */
+void d_rand_vst(rand_stream *p, double *out, int n, double min, double max);
+
+/* Fill out[n] with normal distribution random doubles */
+void norm_rand_vst(rand_stream *p, double *out, int n);
+
 #ifdef __cplusplus
 	}
 #endif
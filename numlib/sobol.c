@@ -112,7 +112,7 @@ static int next_sobol(sobol *s, double *v) {
 	for (c = s->count, p = 0; (c & 1) == 0; p++, c >>= 1)
 		;
 
-	if(p > SOBOL_MAXBIT)
+	if(p >= SOBOL_MAXBIT)
 		return 1;	/* Run out */
 
 	for (i = 0; i < s->dim; i++) {
@@ -123,6 +123,57 @@ static int next_sobol(sobol *s, double *v) {
 	return 0;
 }
 
+/* Get the next n sobol vectors into v[n * dim] */
+/* return nz if we've run out */
+static int nextn_sobol(sobol *s, double *v, int n) {
+	int i, p, k;
+	unsigned int c;
+
+	for (k = 0; k < n; k++, v += s->dim) {
+		s->count++;
+
+		/* Find the position of the right-hand zero in count */
+		for (c = s->count, p = 0; (c & 1) == 0; p++, c >>= 1)
+			;
+
+		if(p >= SOBOL_MAXBIT)
+			return 1;	/* Run out */
+
+		for (i = 0; i < s->dim; i++) {
+			s->lastq[i] ^= s->dir[p][i];
+			v[i] = s->lastq[i] * s->recipd;
+		}
+	}
+
+	return 0;
+}
+
+/* Skip the next n vectors. This is O(log(count)), so the sequence can */
+/* be partitioned into reproducible sub-sequences for parallel use. */
+/* return nz if we've run out */
+static int skip_sobol(sobol *s, unsigned int n) {
+	unsigned int g;
+	int i, p;
+
+	if (n > ((1u << SOBOL_MAXBIT) - 1 - s->count))
+		return 1;	/* Run out */
+	s->count += n;
+
+	/* The vector after count steps is the xor of the direction */
+	/* numbers selected by the bits of the Gray code of count. */
+	for (i = 0; i < s->dim; i++)
+		s->lastq[i] = 0;
+	g = s->count ^ (s->count >> 1);
+	for (p = 0; g != 0; p++, g >>= 1) {
+		if (g & 1) {
+			for (i = 0; i < s->dim; i++)
+				s->lastq[i] ^= s->dir[p][i];
+		}
+	}
+
+	return 0;
+}
+
 /* Free up the object */
 static void del_sobol(sobol *s) {
 	if (s != NULL)
@@ -154,6 +205,8 @@ sobol *new_sobol(int dim) {
 
 	s->dim  = dim;
 	s->next  = next_sobol;
+	s->nextn = nextn_sobol;
+	s->skip  = skip_sobol;
 	s->reset = reset_sobol;
 	s->del   = del_sobol;
 
@@ -24,6 +24,14 @@ struct _sobol {
 	/* Values are between 0.0 and 1.0 */
 	int (*next)(struct _sobol *s, double *v);
 
+	/* Get the next n sobol vectors into v[n * dim], return nz if we've run out */
+	int (*nextn)(struct _sobol *s, double *v, int n);
+
+	/* Skip the next n vectors in O(log) time, return nz if we've run out. */
+	/* (Independent objects can reset and skip to generate disjoint, */
+	/*  reproducible parts of the sequence in parallel.) */
+	int (*skip)(struct _sobol *s, unsigned int n);
+
 	/* Rest to the begining of the sequence */
 	void (*reset)(struct _sobol *s);
 
@@ -81,24 +81,34 @@ void *fdata								/* Opaque data pointer */
 
 #define ZBRENT_MAXIT 100
 
-/* Root finder */
+/* Evaluations remembered from one root search to bracket the next */
+typedef struct {
+	int n;
+	double x[ZBRENT_MAXIT + 4];		/* Points */
+	double f[ZBRENT_MAXIT + 4];		/* Function values at the points */
+} zbrent_evals;
+
+/* Core root finder, given the function values at the bracket ends. */
+/* Finds the root of func() - tv. If ev != NULL, record the */
+/* points evaluated. */
 /* return  0 on sucess */
 /*        -1 on root not bracketed */
 /*        -2 on too many itterations */
-int zbrent(
+static int zbrent_core(
 double *rv,								/* Return value */
 double ax,								/* Bracket to search */
-double bx,								/* (Min, Max) */
+double af,								/* func(ax) - tv */
+double bx,
+double bf,								/* func(bx) - tv */
 double tol,								/* Desired tollerance */
 double (*func)(void *fdata, double tp),	/* function to evaluate */
-void *fdata								/* Opaque data pointer */
+void *fdata,							/* Opaque data pointer */
+double tv,								/* Target value */
+zbrent_evals *ev						/* If not NULL, record evaluations */
 ) {
 	int i;
 	double         cx;			/* Trial points, bx = best current */
-	double af ,bf, cf;			/* Function values at those points */
-
-	af = (*func)(fdata, ax);
-	bf = (*func)(fdata, bx);
+	double cf;					/* Function values at those points */
 
 	/* Sanity check bracketing */
 	if (af * bf > 0.0)
@@ -178,10 +188,122 @@ void *fdata								/* Opaque data pointer */
 		else
 			bx += (xdel > 0.0 ? tol1 : -tol1);	/* Do minimum move in direction of bisection */
 		bf = (*func)(fdata, bx);
+		if (ev != NULL) {
+			ev->x[ev->n] = bx;
+			ev->f[ev->n++] = bf;
+		}
+		bf -= tv;
 	}
 	return -2;			/* Too many iterations */
 }
 
+/* Root finder */
+/* return  0 on sucess */
+/*        -1 on root not bracketed */
+/*        -2 on too many itterations */
+int zbrent(
+double *rv,								/* Return value */
+double ax,								/* Bracket to search */
+double bx,								/* (Min, Max) */
+double tol,								/* Desired tollerance */
+double (*func)(void *fdata, double tp),	/* function to evaluate */
+void *fdata								/* Opaque data pointer */
+) {
+	double af ,bf;
+
+	af = (*func)(fdata, ax);
+	bf = (*func)(fdata, bx);
+
+	return zbrent_core(rv, ax, af, bx, bf, tol, func, fdata, 0.0, NULL);
+}
+
+/* Batch root finder for a monotonic function. */
+/* For each of the n target values tv[], find rv[] such that */
+/* func(rv[]) = tv[], within the bracket ax..bx. The function */
+/* must be monotonic over the bracket, so that the points evaluated */
+/* while finding one root can be used to tighten the bracket for */
+/* the next. Any order of targets will work, but if they are sorted */
+/* (as when building an inverse lookup table) each search usually */
+/* starts with a very small bracket, and needs few evaluations. */
+/* A target outside the range of the function is clipped to the */
+/* closest end of the bracket. */
+/* return  0 on sucess */
+/*        -1 if some targets were not bracketed (and have been clipped) */
+/*        -2 on too many itterations */
+int zbrent_n(
+double *rv,								/* Return n root values */
+double *tv,								/* n target values */
+int n,									/* Number of targets */
+double ax,								/* Bracket to search */
+double bx,								/* (Min, Max) */
+double tol,								/* Desired tollerance */
+double (*func)(void *fdata, double tp),	/* Monotonic function to evaluate */
+void *fdata								/* Opaque data pointer */
+) {
+	zbrent_evals ev[2], *lev, *cev;		/* Last and current searches evaluations */
+	double afx, bfx;		/* Function values at bracket ends */
+	int i, j, rc = 0;
+
+	afx = (*func)(fdata, ax);
+	bfx = (*func)(fdata, bx);
+
+	lev = &ev[0];
+	cev = &ev[1];
+	lev->n = 0;
+
+	for (i = 0; i < n; i++) {
+		double t = tv[i];
+		double x1 = ax, f1 = afx - t;
+		double x2 = bx, f2 = bfx - t;
+		int erv;
+
+		if (f1 * f2 > 0.0) {	/* Not bracketed */
+			rv[i] = fabs(f1) < fabs(f2) ? ax : bx;
+			rc = -1;
+			continue;
+		}
+
+		/* Tighten the bracket using the last search's points. Since the */
+		/* function is monotonic, a point on the same side of the root */
+		/* with a smaller error is closer to it. */
+		for (j = 0; j < lev->n; j++) {
+			double d = lev->f[j] - t;
+
+			if (d == 0.0) {
+				x1 = x2 = lev->x[j];
+				f1 = f2 = 0.0;
+				break;
+			}
+			if (d * f1 > 0.0 && fabs(d) < fabs(f1)) {
+				x1 = lev->x[j];
+				f1 = d;
+			} else if (d * f2 > 0.0 && fabs(d) < fabs(f2)) {
+				x2 = lev->x[j];
+				f2 = d;
+			}
+		}
+
+		/* Keep the tightened bracket ends for the next search */
+		cev->n = 0;
+		cev->x[cev->n] = x1;
+		cev->f[cev->n++] = f1 + t;
+		cev->x[cev->n] = x2;
+		cev->f[cev->n++] = f2 + t;
+
+		if (f1 == 0.0) {
+			rv[i] = x1;
+		} else if (f2 == 0.0) {
+			rv[i] = x2;
+		} else if ((erv = zbrent_core(&rv[i], x1, f1, x2, f2, tol, func, fdata, t, cev)) != 0) {
+			return erv;
+		}
+
+		lev = cev;				/* Swap evaluation records */
+		cev = &ev[lev == &ev[0] ? 1 : 0];
+	}
+	return rc;
+}
+
 
 
 
@@ -37,6 +37,23 @@ double tol,								/* Desired tollerance */
 double (*func)(void *fdata, double tp),	/* function to evaluate */
 void *fdata);							/* Opaque data pointer */
 
+/* Batch root finder for a monotonic function. */
+/* Find rv[i] such that func(rv[i]) = tv[i] for n targets. */
+/* Sorted targets make use of the previous search to */
+/* bracket the next. Out of range targets are clipped. */
+/* return  0 on sucess */
+/*        -1 if some targets were not bracketed (and have been clipped) */
+/*        -2 on too many itterations */
+int zbrent_n(
+double *rv,								/* Return n root values */
+double *tv,								/* n target values */
+int n,									/* Number of targets */
+double x1,								/* Bracket to search */
+double x2,								/* (Min, Max) */
+double tol,								/* Desired tollerance */
+double (*func)(void *fdata, double tp),	/* Monotonic function to evaluate */
+void *fdata);							/* Opaque data pointer */
+
 #ifdef __cplusplus
 	}
 #endif
@@ -9,11 +9,15 @@
  */
 
 /* Solves (3 - 2*X) * X = -1  */
+/* and inverts a gamma curve using the batch root finder */
 
 #include "numlib.h"
 
 int its = 0;
 double fcn(void *fdata, double tp);
+double gcn(void *fdata, double tp);
+
+#define NTARG 256
 
 /* Expected solution */
 double expect = -2.80776403408306e-01;
@@ -22,6 +26,8 @@ int main(void)
 {
 	int rv;
 	double x1, x2, soln;
+	double tv[NTARG], rvs[NTARG], merr;
+	int i, sits;
 
 	/* Attempt bracket the solution */
 	x1 = -0.1; 
@@ -40,6 +46,30 @@ int main(void)
 	}
 
 	printf("Solution = %f, expected = %f in %d itterations\n",soln, expect, its);
+
+	/* Invert a curve one value at a time */
+	for (i = 0; i < NTARG; i++)
+		tv[i] = i/(NTARG-1.0);
+	its = 0;
+	for (i = 0; i < NTARG; i++) {
+		if ((rv = zbrent(&soln, 0.0, 1.0, 1e-8, gcn, (void *)&tv[i])) != 0)
+			break;
+	}
+	sits = its;
+
+	/* and as a batch */
+	its = 0;
+	rv = zbrent_n(rvs, tv, NTARG, 0.0, 1.0, 1e-8, gcn, NULL);
+	if (rv != 0) {
+		error("zbrent_n failed with rv = %d\n",rv);
+	}
+	for (merr = 0.0, i = 0; i < NTARG; i++) {
+		double err = fabs(rvs[i] - pow(tv[i], 1.0/2.4));
+		if (err > merr)
+			merr = err;
+	}
+	printf("Batch inverted %d values with max error %e in %d evaluations (%d one at a time)\n",
+	                                                          NTARG, merr, its, sits);
 	return 0;
 
 } /* main() */
@@ -54,3 +84,12 @@ double fcn(void *fdata, double tp)
 	return temp;
 }
 
+/* Monotonic curve being inverted, less the target if given */
+double gcn(void *fdata, double tp)
+{
+	its++;
+	if (fdata != NULL)
+		return pow(tp, 2.4) - *((double *)fdata);
+	return pow(tp, 2.4);
+}
+
@@ -1054,6 +1054,77 @@ void clear_g(plot_g *g) {
 	memset((void *)g, 0, sizeof(plot_g));
 }
 
+/* ************************** Common graph helpers ********************** */
+
+#define MAXPLINE 16384		/* Maximum points in one polyline drawing call */
+
+/* A graph point in pixel units, relative to the plot origin */
+typedef struct {
+	int x, y;
+} plot_pt;
+
+/* Convert a graph to a polyline of pixel points. Runs of points that */
+/* land in the same pixel column are reduced to their first, lowest, */
+/* highest and last points, which draw the same as the whole run, so */
+/* that the drawing cost depends on the window size rather than n. */
+/* Return the number of points, and a malloced array that the caller */
+/* must free, or NULL if there are no points. */
+static plot_pt *graph_pline(plot_info *pdp, double *yp, int *pnp) {
+	plot_pt *pts;
+	int i, k, np = 0;
+	int f = 0, mn = 0, mx = 0;		/* First, lowest & highest index of current column */
+	int cx = 0, cy, lcx = 0;
+
+	*pnp = 0;
+	if (pdp->n <= 0)
+		return NULL;
+
+	/* At most 4 points per column, and never more than the input */
+	if ((pts = (plot_pt *)malloc(pdp->n * sizeof(plot_pt))) == NULL)
+		error("plot malloc failed in %s line %d",__FILE__,__LINE__);
+
+	for (i = 0; i <= pdp->n; i++) {
+		if (i < pdp->n)
+			cx = (int)((pdp->x1[i] - pdp->mnx) * pdp->scx + 0.5);
+
+		/* End of a column: emit its distinct key points in order */
+		if (i > 0 && (i == pdp->n || cx != lcx)) {
+			int ix[4], l = i-1;
+
+			ix[0] = f;
+			ix[1] = mn < mx ? mn : mx;
+			ix[2] = mn < mx ? mx : mn;
+			ix[3] = l;
+			for (k = 0; k < 4; k++) {
+				if (k > 0 && ix[k] <= ix[k-1])
+					continue;
+				cy = (int)((yp[ix[k]] - pdp->mny) * pdp->scy + 0.5);
+				if (np > 0 && pts[np-1].x == lcx && pts[np-1].y == cy)
+					continue;
+				pts[np].x = lcx;
+				pts[np].y = cy;
+				np++;
+			}
+		}
+		if (i == pdp->n)
+			break;
+
+		/* Start a new column */
+		if (i == 0 || cx != lcx) {
+			f = mn = mx = i;
+			lcx = cx;
+		} else {
+			if (yp[i] < yp[mn])
+				mn = i;
+			if (yp[i] > yp[mx])
+				mx = i;
+		}
+	}
+
+	*pnp = np;
+	return pts;
+}
+
 
 /* ********************************** NT version ********************** */
 #ifdef NT
@@ -1413,6 +1484,9 @@ plot_info *p
 ) {
 	int i, j;
 	int lx,ly;		/* Last x,y */
+	plot_pt *gpts;	/* Graph polyline */
+	int ngpts;
+	POINT *wpts;
 	HPEN pen;
 
 	pen = CreatePen(PS_DOT,0,RGB(200,200,200));
@@ -1442,23 +1516,36 @@ plot_info *p
 			pen = CreatePen(PS_SOLID,ILTHICK,RGB(plot_colors[j][0],plot_colors[j][1],plot_colors[j][2]));
 			SelectObject(hdc,pen);
 
-			lx = (int)((p->x1[0] - p->mnx) * p->scx + 0.5);
-			ly = (int)((     yp[0] - p->mny) * p->scy + 0.5);
+			/* Draw the graph as polylines */
+			if ((gpts = graph_pline(p, yp, &ngpts)) != NULL) {
+				if ((wpts = (POINT *)malloc(ngpts * sizeof(POINT))) == NULL)
+					error("plot malloc failed in %s line %d",__FILE__,__LINE__);
+				for (i = 0; i < ngpts; i++) {
+					wpts[i].x = 10 + gpts[i].x;
+					wpts[i].y = p->sh - 10 - gpts[i].y;
+				}
+				if (ngpts == 1)
+					SetPixel(hdc, wpts[0].x, wpts[0].y, RGB(plot_colors[j][0],plot_colors[j][1],plot_colors[j][2]));
+				for (i = 0; i < (ngpts-1); i += MAXPLINE-1) {
+					int nn = ngpts - i;
+					if (nn > MAXPLINE)
+						nn = MAXPLINE;
+					Polyline(hdc, wpts + i, nn);
+				}
+				free(wpts);
+				free(gpts);
+			}
 
-			for (i = 0; i < p->n; i++) {
-				int cx,cy;
-				cx = (int)((p->x1[i] - p->mnx) * p->scx + 0.5);
-				cy = (int)((   yp[i] - p->mny) * p->scy + 0.5);
-	
-				MoveToEx(hdc, 10 + lx, p->sh - 10 - ly, NULL);
-				LineTo(hdc,   10 + cx, p->sh - 10 - cy);
-				if (p->flags & PLOTF_GRAPHCROSSES) {
+			if (p->flags & PLOTF_GRAPHCROSSES) {
+				for (i = 0; i < p->n; i++) {
+					int cx,cy;
+					cx = (int)((p->x1[i] - p->mnx) * p->scx + 0.5);
+					cy = (int)((   yp[i] - p->mny) * p->scy + 0.5);
+		
 					MoveToEx(hdc, 10 + cx - 5, p->sh - 10 - cy - 5, NULL);
 					LineTo(hdc,   10 + cx + 5, p->sh - 10 - cy + 5);
 					LineTo(hdc,   10 + cx - 5, p->sh - 10 - cy + 5);
 				}
-				lx = cx;
-				ly = cy;
 			}
 			DeleteObject(pen);
 		}
@@ -2170,6 +2257,8 @@ void (*pfunc)(plot_info *pdp, NSBezierPath *path, NSColor *lcol, NSColor *tcol,
 static void DoPlot(NSRect *rect, plot_info *pdp) {
 	int i, j;
 	int lx,ly;		/* Last x,y */
+	plot_pt *gpts;	/* Graph polyline */
+	int ngpts;
 	CGFloat dash_list[2] = {7.0, 2.0};
 	/* Note path and tcol are autorelease */
 	NSBezierPath *path = [NSBezierPath bezierPath];		/* Path to use */
@@ -2222,23 +2311,25 @@ static void DoPlot(NSRect *rect, plot_info *pdp) {
 			                            blue: plot_colors[j][2]/255.0
 			                           alpha: 1.0] setStroke];
 
-			if (pdp->n > 0) {
-				lx = (int)((pdp->x1[0] - pdp->mnx) * pdp->scx + 0.5);
-				ly = (int)((     yp[0] - pdp->mny) * pdp->scy + 0.5);
+			/* Draw the graph as one path */
+			if ((gpts = graph_pline(pdp, yp, &ngpts)) != NULL) {
+				[path removeAllPoints ];
+				[path moveToPoint:NSMakePoint(20.0 + gpts[0].x, 20.0 + gpts[0].y)];
+				for (i = 1; i < ngpts; i++)
+					[path lineToPoint:NSMakePoint(20.0 + gpts[i].x, 20.0 + gpts[i].y)];
+				[path stroke];
+				free(gpts);
 			}
 
-			for (i = 1; i < pdp->n; i++) {
-				int cx,cy;
-				cx = (int)((pdp->x1[i] - pdp->mnx) * pdp->scx + 0.5);
-				cy = (int)((     yp[i] - pdp->mny) * pdp->scy + 0.5);
+			if (pdp->flags & PLOTF_GRAPHCROSSES) {
+				for (i = 1; i < pdp->n; i++) {
+					int cx,cy;
+					cx = (int)((pdp->x1[i] - pdp->mnx) * pdp->scx + 0.5);
+					cy = (int)((     yp[i] - pdp->mny) * pdp->scy + 0.5);
 
-				ADrawLine(path, 20.0 + lx, 20.0 + ly, 20 + cx, 20.0 + cy);
-				if (pdp->flags & PLOTF_GRAPHCROSSES) {
 					ADrawLine(path, 20.0 + cx - 5, 20.0 - cy - 5, 20.0 + cx + 5, 20.0 + cy + 5);
 					ADrawLine(path, 20.0 + cx + 5, 20.0 - cy - 5, 20.0 + cx - 5, 20.0 + cy + 5);
 				}
-				lx = cx;
-				ly = cy;
 			}
 		}
 
@@ -2746,6 +2837,9 @@ plot_info *pdp
 ) {
 	int i, j;
 	int lx,ly;		/* Last x,y */
+	plot_pt *gpts;	/* Graph polyline */
+	int ngpts;
+	XPoint *xpts;
 	char dash_list[2] = {5, 1};
 	Colormap mycmap;
 	XColor col;
@@ -2783,21 +2877,35 @@ plot_info *pdp
 			XSetForeground(mydisplay,mygc, col.pixel);
 			XSetLineAttributes(mydisplay, mygc, ILTHICK, LineSolid, CapButt, JoinBevel);
 
-			lx = (int)((pdp->x1[0] - pdp->mnx) * pdp->scx + 0.5);
-			ly = (int)((     yp[0] - pdp->mny) * pdp->scy + 0.5);
+			/* Draw the graph as polylines */
+			if ((gpts = graph_pline(pdp, yp, &ngpts)) != NULL) {
+				if ((xpts = (XPoint *)malloc(ngpts * sizeof(XPoint))) == NULL)
+					error("plot malloc failed in %s line %d",__FILE__,__LINE__);
+				for (i = 0; i < ngpts; i++) {
+					xpts[i].x = 10 + gpts[i].x;
+					xpts[i].y = pdp->sh - 10 - gpts[i].y;
+				}
+				if (ngpts == 1)
+					XDrawPoint(mydisplay, mywindow, mygc, xpts[0].x, xpts[0].y);
+				for (i = 0; i < (ngpts-1); i += MAXPLINE-1) {
+					int nn = ngpts - i;
+					if (nn > MAXPLINE)
+						nn = MAXPLINE;
+					XDrawLines(mydisplay, mywindow, mygc, xpts + i, nn, CoordModeOrigin);
+				}
+				free(xpts);
+				free(gpts);
+			}
 
-			for (i = 0; i < pdp->n; i++) {
-				int cx,cy;
-				cx = (int)((pdp->x1[i] - pdp->mnx) * pdp->scx + 0.5);
-				cy = (int)((     yp[i] - pdp->mny) * pdp->scy + 0.5);
+			if (pdp->flags & PLOTF_GRAPHCROSSES) {
+				for (i = 0; i < pdp->n; i++) {
+					int cx,cy;
+					cx = (int)((pdp->x1[i] - pdp->mnx) * pdp->scx + 0.5);
+					cy = (int)((     yp[i] - pdp->mny) * pdp->scy + 0.5);
 
-				XDrawLine(mydisplay, mywindow, mygc, 10 + lx, pdp->sh - 10 - ly, 10 + cx, pdp->sh - 10 - cy);
-				if (pdp->flags & PLOTF_GRAPHCROSSES) {
 					XDrawLine(mydisplay, mywindow, mygc, 10 + cx - 5, pdp->sh - 10 - cy - 5, 10 + cx + 5, pdp->sh - 10 - cy + 5);
 					XDrawLine(mydisplay, mywindow, mygc, 10 + cx + 5, pdp->sh - 10 - cy - 5, 10 + cx - 5, pdp->sh - 10 - cy + 5);
 				}
-				lx = cx;
-				ly = cy;
 			}
 		}
 
@@ -76,12 +76,61 @@ static void cs2xyz(vrml *s, double *out, double *in) {
 	}
 } 
 
+/* Return the index of the marker definition with the given key, */
+/* adding it if it hasn't been written, and setting *isnew to nz. */
+/* Return -1 if instancing isn't possible (malloc failure). */
+static int get_mdef(vrml *s, char *key, int *isnew) {
+	unsigned int h = 0;
+	char *cp;
+	int ix;
+
+	*isnew = 1;
+	if (s->mhash == NULL) {
+		if ((s->mhash = (int *)malloc(sizeof(int) * VRML_MHASH)) == NULL)
+			return -1;
+		for (ix = 0; ix < VRML_MHASH; ix++)
+			s->mhash[ix] = -1;
+	}
+
+	for (cp = key; *cp != '\000'; cp++)
+		h = h * 31 + (unsigned char)*cp;
+	h %= VRML_MHASH;
+
+	for (ix = s->mhash[h]; ix >= 0; ix = s->mdefs[ix].next) {
+		if (strcmp(s->mdefs[ix].key, key) == 0) {
+			*isnew = 0;
+			return ix;
+		}
+	}
+
+	if (s->nmdefs >= s->amdefs) {
+		int namdefs = s->amdefs * 2 + 100;
+		struct vrml_mdef *nmdefs;
+		if ((nmdefs = (struct vrml_mdef *)realloc(s->mdefs,
+		                         sizeof(struct vrml_mdef) * namdefs)) == NULL)
+			return -1;
+		s->mdefs = nmdefs;
+		s->amdefs = namdefs;
+	}
+	ix = s->nmdefs++;
+	strncpy(s->mdefs[ix].key, key, 99);
+	s->mdefs[ix].key[99] = '\000';
+	s->mdefs[ix].next = s->mhash[h];
+	s->mhash[h] = ix;
+
+	return ix;
+}
+
 /* Add a sphere at the given location, with transparency. */
 /* If col[] is NULL, use natural color. */
 /* rad is in normalized delta E scale units */
 /* Need to do this before or after start_line_set()/dd_vertex()/make_lines() ! */
+/* Markers with the same color, transparency and radius are instanced */
+/* from the first one, and all the spheres of a radius share their geometry. */
 static void add_marker_trans(vrml *s, double pos[3], double col[3], double trans, double rad) {
 	double rgb[3], xyz[3];
+	char key[100];
+	int mix, six, isnew, snew;
 
 	if (rad <= 0.0)
 		rad = 1.0;
@@ -100,36 +149,56 @@ static void add_marker_trans(vrml *s, double pos[3], double col[3], double trans
 	}
 
 	cs2xyz(s, xyz, pos);
+
+	/* Locate or create the shape and sphere definitions */
+	sprintf(key, "M %f %f %f %f %f", rgb[0], rgb[1], rgb[2], trans > 0.0 ? trans : 0.0, rad);
+	if ((mix = get_mdef(s, key, &isnew)) >= 0 && !isnew) {
+		if (s->fmt == fmt_vrml)
+			fprintf(s->fp,"    Transform { translation %f %f %f children [ USE M%d ] }\n",
+			                                               xyz[0], xyz[1], xyz[2], mix);
+		else
+			fprintf(s->fp,"    <Transform translation='%f %f %f'><Shape USE='M%d'></Shape></Transform>\n",
+			                                               xyz[0], xyz[1], xyz[2], mix);
+		return;
+	}
+	sprintf(key, "S %f", rad);
+	six = get_mdef(s, key, &snew);
+
+	/* Sphere marker on one line */
 	if (s->fmt == fmt_vrml) {
-		fprintf(s->fp,"    # Shere\n");
-		fprintf(s->fp,"    Transform { translation %f %f %f\n", xyz[0], xyz[1], xyz[2]);
-		fprintf(s->fp,"      children [\n");
-		fprintf(s->fp,"        Shape{\n");
-		fprintf(s->fp,"          geometry Sphere { radius %f }\n", rad);
-		fprintf(s->fp,"          appearance Appearance { material Material { \n");
-		if (trans > 0.0) {
-			fprintf(s->fp,"              transparency %f, \n",trans);
-		} 
-		fprintf(s->fp,"                  diffuseColor %f %f %f } }\n", rgb[0], rgb[1], rgb[2]);
-		fprintf(s->fp,"        }\n");
-		fprintf(s->fp,"      ]\n");
-		fprintf(s->fp,"    }\n");
+		fprintf(s->fp,"    Transform { translation %f %f %f children [ ", xyz[0], xyz[1], xyz[2]);
+		if (mix >= 0)
+			fprintf(s->fp,"DEF M%d ",mix);
+		fprintf(s->fp,"Shape { geometry ");
+		if (six >= 0 && !snew)
+			fprintf(s->fp,"USE M%d ", six);
+		else {
+			if (six >= 0)
+				fprintf(s->fp,"DEF M%d ", six);
+			fprintf(s->fp,"Sphere { radius %f } ", rad);
+		}
+		fprintf(s->fp,"appearance Appearance { material Material { ");
+		if (trans > 0.0)
+			fprintf(s->fp,"transparency %f ",trans);
+		fprintf(s->fp,"diffuseColor %f %f %f } } } ] }\n", rgb[0], rgb[1], rgb[2]);
 
 	} else {
-		fprintf(s->fp,"    <!-- Shere -->\n");
-		fprintf(s->fp,"    <Transform translation='%f %f %f'>\n", xyz[0], xyz[1], xyz[2]);
-		fprintf(s->fp,"      <Shape>\n");
-		fprintf(s->fp,"        <Appearance>\n");
-		if (trans > 0.0) {
-			fprintf(s->fp,"          <Material diffuseColor='%f %f %f'\n", rgb[0], rgb[1], rgb[2]);
-			fprintf(s->fp,"                    transparency='%f'></Material>\n", trans);
-		} else {
-			fprintf(s->fp,"          <Material diffuseColor='%f %f %f'></Material>\n", rgb[0], rgb[1], rgb[2]);
-		}
-		fprintf(s->fp,"        </Appearance>\n");
-		fprintf(s->fp,"        <Sphere radius='%f'></Sphere>\n",rad);
-		fprintf(s->fp,"      </Shape>\n");
-		fprintf(s->fp,"    </Transform>\n");
+		fprintf(s->fp,"    <Transform translation='%f %f %f'>", xyz[0], xyz[1], xyz[2]);
+		if (mix >= 0)
+			fprintf(s->fp,"<Shape DEF='M%d'>",mix);
+		else
+			fprintf(s->fp,"<Shape>");
+		fprintf(s->fp,"<Appearance><Material diffuseColor='%f %f %f'", rgb[0], rgb[1], rgb[2]);
+		if (trans > 0.0)
+			fprintf(s->fp," transparency='%f'", trans);
+		fprintf(s->fp,"></Material></Appearance>");
+		if (six < 0)
+			fprintf(s->fp,"<Sphere radius='%f'></Sphere>",rad);
+		else if (snew)
+			fprintf(s->fp,"<Sphere DEF='M%d' radius='%f'></Sphere>",six,rad);
+		else
+			fprintf(s->fp,"<Sphere USE='M%d'></Sphere>",six);
+		fprintf(s->fp,"</Shape></Transform>\n");
 	}
 }
 
@@ -1167,6 +1236,66 @@ double cc[3]	/* Surface color, cc[0] < 0.0 for natural color, NULL for default *
 	}
 }
 
+/* Start a level of detail group with nlev levels, finest first */
+static void start_lod(vrml *s, int nlev, double *range) {
+	int i;
+
+	if (s->lodlev >= 0)
+		error("vrml start_lod called within a level of detail group");
+	if (nlev < 1)
+		error("vrml start_lod nlev %d out of range",nlev);
+
+	if (s->fmt == fmt_vrml) {
+		fprintf(s->fp,"    LOD {\n");
+		fprintf(s->fp,"      range [");
+		for (i = 0; i < (nlev-1); i++)
+			fprintf(s->fp," %f",s->scale * range[i]);
+		fprintf(s->fp," ]\n");
+		fprintf(s->fp,"      level [\n");
+		fprintf(s->fp,"    Group { children [\n");
+	} else {
+		fprintf(s->fp,"    <LOD range='");
+		for (i = 0; i < (nlev-1); i++)
+			fprintf(s->fp,"%s%f",i > 0 ? " " : "",s->scale * range[i]);
+		fprintf(s->fp,"'>\n");
+		fprintf(s->fp,"    <Group>\n");
+	}
+	s->lodlev = 0;
+}
+
+/* Start the next coarser level of the current level of detail group */
+static void next_lod(vrml *s) {
+
+	if (s->lodlev < 0)
+		error("vrml next_lod called outside a level of detail group");
+
+	if (s->fmt == fmt_vrml) {
+		fprintf(s->fp,"    ] }\n");
+		fprintf(s->fp,"    Group { children [\n");
+	} else {
+		fprintf(s->fp,"    </Group>\n");
+		fprintf(s->fp,"    <Group>\n");
+	}
+	s->lodlev++;
+}
+
+/* Finish the current level of detail group */
+static void end_lod(vrml *s) {
+
+	if (s->lodlev < 0)
+		error("vrml end_lod called outside a level of detail group");
+
+	if (s->fmt == fmt_vrml) {
+		fprintf(s->fp,"    ] }\n");
+		fprintf(s->fp,"      ]\n");
+		fprintf(s->fp,"    }\n");
+	} else {
+		fprintf(s->fp,"    </Group>\n");
+		fprintf(s->fp,"    </LOD>\n");
+	}
+	s->lodlev = -1;
+}
+
 /* Clear verticies and triangles */
 static void clear(vrml *s) {
 	int i;
@@ -1420,6 +1549,9 @@ double vdist
 	s->make_gamut_surface    = make_gamut_surface;
 	s->make_gamut_surface_2  = make_gamut_surface_2;
 	s->add_cusps             = add_cusps;
+	s->start_lod             = start_lod;
+	s->next_lod              = next_lod;
+	s->end_lod               = end_lod;
 	s->clear                 = clear;
 	s->Lab2RGB               = Lab2RGB;
 	s->XYZ2RGB               = XYZ2RGB;
@@ -1429,6 +1561,7 @@ double vdist
 	s->fmt = g_fmt;			/* Use global format */
 
 	s->ispace = ispace;
+	s->lodlev = -1;
 
 	if (s->ispace == vrml_rgb) {	/* RGB, scale 0..1 to 0..100 */
 		s->scale = 100.0;
@@ -1738,6 +1871,9 @@ static int do_flush(vrml *s) {
 
 	if (!s->written) {
 		
+		if (s->lodlev >= 0)
+			end_lod(s);
+
 		if (s->fmt == fmt_vrml) {
 			fprintf(s->fp,"\n");
 			fprintf(s->fp,"  ] # end of children for world\n");
@@ -1852,6 +1988,10 @@ static void del_vrml(vrml *s) {
 		if (s->set[i].tqary)
 			free(s->set[i].tqary);
 	}
+	if (s->mdefs != NULL)
+		free(s->mdefs);
+	if (s->mhash != NULL)
+		free(s->mhash);
 	if (s->name != NULL)
 		free(s->name);
     free(s);
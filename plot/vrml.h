@@ -55,6 +55,15 @@ struct vrml_triquad {
 	double cc[3];			/* Per polygon color if ppoly, natural if cc[0] < 0 */
 };
 
+/* A marker shape or geometry that has been written with a DEF name, */
+/* so that repeats of it can be instanced with USE */
+struct vrml_mdef {
+	char key[100];			/* Printed parameters of the definition */
+	int next;				/* Next in hash chain, -1 if none */
+};
+
+#define VRML_MHASH 4099		/* Marker definition hash table size (prime) */
+
 struct _vrml {
 
 /* Private: */
@@ -85,6 +94,13 @@ struct _vrml {
 
 	} set[10];		/* Up to ten sets */
 
+	/* Marker definitions already written */
+	int nmdefs, amdefs;
+	struct vrml_mdef *mdefs;
+	int *mhash;			/* VRML_MHASH chain heads, -1 if empty */
+
+	int lodlev;			/* Current level of an open level of detail group, -1 if none */
+
 /* Public: */
 
 	/* Methods */
@@ -196,6 +212,19 @@ struct _vrml {
 	void (*make_quads)(struct _vrml *s, int set, double trans, double col[3]);
 
 
+	/* Start a level of detail group with nlev levels, finest first. range[] holds */
+	/* the nlev-1 viewing distances (delta E scale units from the center) at which */
+	/* to switch to the next coarser level. Everything output up until next_lod() */
+	/* is the finest level. Groups can't be nested. */
+	void (*start_lod)(struct _vrml *s, int nlev, double *range);
+
+	/* Start the next coarser level of the current level of detail group */
+	void (*next_lod)(struct _vrml *s);
+
+	/* Finish the current level of detail group */
+	void (*end_lod)(struct _vrml *s);
+
+
 	/* Clear verticies and lines/triangles/quads */
 	void (*clear)(struct _vrml *s);
 	
@@ -47,6 +47,21 @@ usage(void) {
 	exit(1);
 	}
 
+/* An input file to be read */
+typedef struct {
+	cgats *c;
+	char *name;
+	int rv;			/* nz if the read failed */
+} rfile;
+
+/* Read input file ix */
+static int read_rfile(void *cntx, int ix, int nth) {
+	rfile *rf = (rfile *)cntx + ix;
+
+	rf->rv = rf->c->read_name(rf->c, rf->name);
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	int i;
@@ -64,6 +79,7 @@ int main(int argc, char *argv[])
 	struct tm *tsp = localtime(&clk);
 	char *atm = asctime(tsp); /* Ascii time */
 	int npat = 0;		/* Number of patches */
+	rfile rfs[2];		/* The two input files */
 
 	error_program = "cb2ti3";
 
@@ -116,10 +132,20 @@ int main(int argc, char *argv[])
 	strcpy(outname, argv[fa++]);
 	strcat(outname,".ti3");
 
-	/* Open up the Input CMY reference file */
+	/* Read the Input CMY reference file and the nCIE device data file in parallel */
 	cmy = new_cgats();	/* Create a CGATS structure */
 	cmy->add_other(cmy, "CBTA"); 	/* Colorblind Target file */
-	if (cmy->read_name(cmy, inname))
+	ncie = new_cgats();	/* Create a CGATS structure */
+	ncie->add_other(ncie, "CBPR"); 	/* Colorblind Printer Response file */
+
+	rfs[0].c = cmy;
+	rfs[0].name = inname;
+	rfs[1].c = ncie;
+	rfs[1].name = tarname;
+	par_exec(2, read_rfile, (void *)rfs);
+
+	/* Check the Input CMY reference file */
+	if (rfs[0].rv != 0)
 		error ("Read: Can't open file '%s'",inname);
 	if (cmy->ntables == 0 || cmy->t[0].tt != tt_other || cmy->t[0].oi != 0)
 		error ("Input file isn't a 'CBTA' format file");
@@ -149,10 +175,8 @@ int main(int argc, char *argv[])
 	if (cmy->t[0].ftype[f_y] != r_t)
 		error("Field Y is wrong type");
 
-	/* Open up the input nCIE device data file */
-	ncie = new_cgats();	/* Create a CGATS structure */
-	ncie->add_other(ncie, "CBPR"); 	/* Colorblind Printer Response file */
-	if (ncie->read_name(ncie, tarname))
+	/* Check the input nCIE device data file */
+	if (rfs[1].rv != 0)
 		error ("Read: Can't open file '%s'",tarname);
 	if (ncie->ntables == 0 || ncie->t[0].tt != tt_other || ncie->t[0].oi != 0)
 		error ("Input file isn't a 'CBTA' format file");
@@ -72,7 +72,7 @@
   Flags used:
 
          ABCDEFGHIJKLMNOPQRSTUVWXYZ
-  upper  ....    . ... .. ....    .
+  upper  ....    ..... .. ....    .
   lower  .... .. . .. .........    
 
 */
@@ -102,6 +102,7 @@ void usage(char *diag, ...) {
 //	fprintf(stderr," -q fmsu         Speed - Fast, Medium (def), Slow, Ultra Slow\n");
 	fprintf(stderr," -b [lmhun]      Low quality B2A table - or specific B2A quality or none for input device\n");
 //	fprintf(stderr," -b [fmsun]      B2A Speed - Fast, Medium, Slow, Ultra Slow, None, same as -q (def)\n");
+	fprintf(stderr," -j n            Use n threads to create output B2A tables (default %d)\n",num_threads());
 	fprintf(stderr," -ni             Don't create input (Device) shaper curves\n");
 	fprintf(stderr," -np             Don't create input (Device) grid position curves\n");
 	fprintf(stderr," -no             Don't create output (PCS) shaper curves\n");
@@ -172,11 +173,125 @@ void usage(char *diag, ...) {
 		fprintf(stderr,"             %s\n",vc.desc);
 	}
 	fprintf(stderr," -P              Create gamut gammap_p.wrl and gammap_s.wrl diagostics\n");
+	fprintf(stderr," -m dir          Cache gamut maps, surfaces and A2B fits in directory dir\n");
+	fprintf(stderr," -W dir          Checkpoint progress to directory dir, and resume from it\n");
 	fprintf(stderr," -O outputfile   Override the default output filename.\n");
+	fprintf(stderr," -J              Batch mode, final argument is a job list file of colprof arguments\n");
 	fprintf(stderr," inoutfile       Base name for input.ti3/output%s file\n",ICC_FILE_EXT);
 	exit(1);
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Batch mode. Each non-empty line of the job list that doesn't start */
+/* with '#' holds the arguments for one colprof run. The jobs are */
+/* run as separate colprof processes, several at once, with the */
+/* threads shared out between them and a common -m cache directory, */
+/* so that gamut maps, gamut surfaces and A2B fits made by one job */
+/* are re-used by the others. */
+
+typedef struct {
+	char *prog;			/* colprof executable */
+	int verb;
+	int nthr;			/* Threads for each job */
+	char *gmcache;		/* Shared cache directory, NULL if none */
+	char **jobs;		/* Job arguments */
+	int *rc;			/* Job return codes */
+} batch_cntx;
+
+static int batch_jobs(void *cntx, int i0, int i1, int thix) {
+	batch_cntx *cx = (batch_cntx *)cntx;
+	char *cmd;
+	int i;
+
+	for (i = i0; i < i1; i++) {
+		/* Job arguments follow, so they override our -j and -m */
+		if ((cmd = malloc(strlen(cx->prog) + strlen(cx->jobs[i])
+		            + (cx->gmcache != NULL ? strlen(cx->gmcache) : 0) + 50)) == NULL) {
+			cx->rc[i] = -1;
+			continue;
+		}
+		sprintf(cmd, "\"%s\" -j %d", cx->prog, cx->nthr);
+		if (cx->gmcache != NULL)
+			sprintf(cmd + strlen(cmd), " -m \"%s\"", cx->gmcache);
+		sprintf(cmd + strlen(cmd), " %s", cx->jobs[i]);
+
+		if (cx->verb)
+			printf("Starting job %d: %s\n",i+1,cx->jobs[i]);
+		cx->rc[i] = system(cmd);
+		if (cx->rc[i] != 0)
+			warning("Job %d '%s' failed with status %d",i+1,cx->jobs[i],cx->rc[i]);
+		else if (cx->verb)
+			printf("Finished job %d: %s\n",i+1,cx->jobs[i]);
+		free(cmd);
+	}
+	return 0;
+}
+
+/* Run the jobs in the job list file. Return the number of failed jobs. */
+static int do_batch(char *prog, int verb, int nthreads, char *gmcache, char *jname) {
+	batch_cntx cx;
+	FILE *fp;
+	char buf[2000], *cp, *ep;
+	int njobs = 0, _njobs = 0;
+	int nconc, nfail, i;
+
+	if ((fp = fopen(jname, "r")) == NULL)
+		error("Unable to open job list file '%s'",jname);
+
+	memset((void *)&cx, 0, sizeof(batch_cntx));
+	while (fgets(buf, 2000, fp) != NULL) {
+		for (cp = buf; *cp != '\000' && isspace(*cp); cp++)
+			;
+		for (ep = cp + strlen(cp); ep > cp && isspace(ep[-1]); ep--)
+			;
+		*ep = '\000';
+		if (*cp == '\000' || *cp == '#')
+			continue;
+		if (njobs >= _njobs) {
+			_njobs = 2 * _njobs + 10;
+			if ((cx.jobs = (char **)realloc(cx.jobs, _njobs * sizeof(char *))) == NULL)
+				error("Malloc of job list failed");
+		}
+		if ((cx.jobs[njobs++] = strdup(cp)) == NULL)
+			error("Malloc of job list failed");
+	}
+	fclose(fp);
+
+	if (njobs == 0)
+		error("No jobs in job list file '%s'",jname);
+
+	if ((cx.rc = (int *)calloc(njobs, sizeof(int))) == NULL)
+		error("Malloc of job return codes failed");
+
+	/* Run as many jobs at once as there are threads, and share */
+	/* the threads out between them. */
+	if (nthreads <= 0)
+		nthreads = num_threads();
+	nconc = njobs < nthreads ? njobs : nthreads;
+	cx.prog = prog;
+	cx.verb = verb;
+	cx.nthr = nthreads/nconc;
+	cx.gmcache = gmcache;
+
+	if (verb)
+		printf("Running %d jobs, %d at a time with %d threads each\n",njobs,nconc,cx.nthr);
+
+	par_for(nconc, 0, njobs, 1, batch_jobs, (void *)&cx);
+
+	for (nfail = i = 0; i < njobs; i++) {
+		if (cx.rc[i] != 0)
+			nfail++;
+		free(cx.jobs[i]);
+	}
+	free(cx.jobs);
+	free(cx.rc);
+
+	if (verb)
+		printf("%d of %d jobs succeeded\n",njobs - nfail, njobs);
+
+	return nfail;
+}
+
 int main(int argc, char *argv[]) {
 	int fa,nfa,mfa;				/* current argument we're looking at */
 #ifdef DO_TIME			/* Time the operation */
@@ -185,6 +300,11 @@ int main(int argc, char *argv[]) {
 	int verb = 0;
 	int iquality = 1;			/* A2B quality */
 	int oquality = -1;			/* B2A quality same as A2B */
+	int nthreads = 0;			/* B2A threads, 0 = default */
+	int batch = 0;				/* Final argument is a job list */
+	char *gmcache = NULL;		/* Gamut map cache directory */
+	char *ckdir = NULL;			/* Checkpoint directory */
+	char ckkey[33];				/* Checkpoint key */
 	int verify = 0;				/* Not used anymore */
 	int noisluts = 0;			/* No input shaper luts */
 	int noipluts = 0;			/* No input position luts */
@@ -246,6 +366,7 @@ int main(int argc, char *argv[]) {
 #ifdef DO_TIME			/* Time the operation */
 	stime = clock();
 #endif /* DO_TIME */
+	a1tm_start("colprof");
 	error_program = argv[0];
 	check_if_not_interactive();
 	memset((void *)&xpi, 0, sizeof(profxinf));	/* Init extra profile info to defaults */
@@ -451,6 +572,33 @@ int main(int argc, char *argv[]) {
 					oquality = 0;
 			}
 
+			/* Number of B2A threads */
+			else if (argv[fa][1] == 'j') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to threads flag -j");
+				nthreads = atoi(na);
+				if (nthreads < 1)
+					usage("Threads flag -j argument must be 1 or more");
+			}
+
+			/* Batch mode */
+			else if (argv[fa][1] == 'J')
+				batch = 1;
+
+			/* Gamut map cache directory */
+			else if (argv[fa][1] == 'm') {
+				fa = nfa;
+				if (na == NULL) usage("Expect directory argument to -m flag");
+				gmcache = na;
+			}
+
+			/* Checkpoint directory */
+			else if (argv[fa][1] == 'W') {
+				fa = nfa;
+				if (na == NULL) usage("Expect directory argument to -W flag");
+				ckdir = na;
+			}
+
 			/* Disable input or output luts */
 			else if (argv[fa][1] == 'n') {
 				if (na == NULL) {	/* Backwards compatible */
@@ -983,6 +1131,11 @@ int main(int argc, char *argv[]) {
 			break;
 	}
 
+	if (batch) {
+		if (fa >= argc || argv[fa][0] == '-') usage("Missing job list file name");
+		return do_batch(argv[0], verb, nthreads, gmcache, argv[fa]) != 0 ? 1 : 0;
+	}
+
 	/* Get the file name argument */
 	if (fa >= argc || argv[fa][0] == '-') usage("Missing input .ti3 and output ICC basename");
 	strncpy(baname,argv[fa++],MAXNAMEL-4); baname[MAXNAMEL-4] = '\000';
@@ -1002,6 +1155,14 @@ int main(int argc, char *argv[]) {
 		strcat(outname, ICC_FILE_EXT);
 	}
 
+	/* A re-run with the same arguments and files resumes from the checkpoints */
+	if (ckdir != NULL) {
+		if (ckpt_key(ckkey, argc, argv, "v", "jmW", inname, outname) != 0)
+			error("Creating checkpoint key failed");
+		if (gmcache == NULL)
+			gmcache = ckdir;		/* Keep the gamut maps too */
+	}
+
 	/* Issue some errors & warnings for strange combinations */
 	if (fwacomp && spec == 0)
 		error("FWA compensation only works when viewer and/or illuminant selected");
@@ -1031,12 +1192,14 @@ int main(int argc, char *argv[]) {
 	}
 
 	/* Open and look at the .ti3 profile patches file */
-	icg = new_cgats();			/* Create a CGATS structure */
+	icg = new_cgats_a1ma();			/* Create a CGATS structure */
 	icg->add_other(icg, "CTI3"); 	/* our special input type is Calibration Target Information 3 */
 	icg->add_other(icg, "CAL"); 	/* our special device Calibration state */
 
+	a1tm_start("read .ti3");
 	if (icg->read_name(icg, inname))
 		error("CGATS file read error : %s",icg->err);
+	a1tm_end();
 
 	if (icg->ntables == 0 || icg->t[0].tt != tt_other || icg->t[0].oi != 0)
 		error ("Input file isn't a CTI3 format file");
@@ -1218,7 +1381,7 @@ int main(int argc, char *argv[]) {
 		if (clipovwp)
 			error ("Input cLUT clipping above WP mode isn't applicable to an output device");
 
-		make_output_icc(ptype, 0, iccver, verb, iquality, oquality,
+		make_output_icc(ptype, 0, iccver, verb, iquality, oquality, nthreads, gmcache, ckdir, ckkey,
 		                noisluts, noipluts, nooluts, nocied, noptop, nostos,
 		                gamdiag, verify, clipprims, iwpscale,
 //		                NULL,		/* bpo */
@@ -1267,7 +1430,7 @@ int main(int argc, char *argv[]) {
 			ptype = prof_clutLab;		/* ?? or should it default to prof_shamat ?? */
 
 		/* If a source gamut is provided for a Display, then a V2.4.0 profile will be created */
-		make_output_icc(ptype, mtxtoo, iccver, verb, iquality, oquality,
+		make_output_icc(ptype, mtxtoo, iccver, verb, iquality, oquality, nthreads, gmcache, ckdir, ckkey,
 		                noisluts, noipluts, nooluts, nocied, noptop, nostos,
 		                gamdiag, verify, clipprims, iwpscale,
 //		                bpo[1] >= 0.0 ? bpo : NULL,
@@ -1286,6 +1449,9 @@ int main(int argc, char *argv[]) {
 
 	icg->del(icg);		/* Clean up */
 
+	a1tm_end();
+	a1tm_report(g_log);
+
 #ifdef DO_TIME			/* Time the operation */
 	ttime = clock() - stime;
 	printf("Exectution time = %f seconds\n",(double)ttime/(double)CLOCKS_PER_SEC);
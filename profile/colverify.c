@@ -104,6 +104,34 @@ typedef struct {
 	double ide[3];		/* Lab Component DE */
 } pval;
 
+#define GCHK_CHUNK 16		/* Number of patches a thread gamut checks at a time */
+
+/* Gamut check context */
+typedef struct {
+	icxLuBase *tluo[NUMTHR_MAX];	/* Gamut profile lookup for each thread */
+	pval *pat;						/* Patches */
+	double chmat[3][3];				/* Chromatic adapation matrix */
+	double *de;						/* Returned round trip delta E of each patch */
+} gchkcntx;
+
+/* Compute the gamut profile round trip delta E of patches i0 .. i1-1 */
+static int gamut_check_thread(void *cntx, int i0, int i1, int thix) {
+	gchkcntx *p = (gchkcntx *)cntx;
+	icxLuBase *luo = p->tluo[thix];
+	double out[MAX_CHAN], in[3], check[3];
+	int i;
+
+	for (i = i0; i < i1; i++) {
+		icmMulBy3x3(in, p->chmat, p->pat[i].xyz);
+
+		/* Clipped values are used as well */
+		luo->inv_lookup(luo, out, in);
+		luo->lookup(luo, check, out);
+		p->de[i] = icmXYZLabDE(&icmD50,check, in);
+	}
+	return 0;
+}
+
 /* Histogram bin type */
 typedef struct {
 	int count;			/* Raw count */
@@ -982,9 +1010,10 @@ int main(int argc, char *argv[])
 	/* Figure out which patches to skip because they are out of gamut */
 	if (luo != NULL) {
 		double chmat[3][3];				/* Chromatic adapation matrix */
-		double out[MAX_CHAN], in[3], check[3];
 		icmXYZNumber s_wp;
-		int rv;
+		icmLuAlgType alg;
+		gchkcntx cx;
+		int nthreads;
 
 		DBG(("Figuring out of gamut patches\n"))
 
@@ -1001,27 +1030,47 @@ int main(int argc, char *argv[])
 //printf("   %f %f %f\n", chmat[1][0], chmat[1][1], chmat[1][2]);
 //printf("   %f %f %f\n", chmat[2][0], chmat[2][1], chmat[2][2]);
 
-		for (i = 0; i < cg[0].npat; i++) {
-			icmMulBy3x3(in, chmat, cg[0].pat[i].xyz);
-
-//printf("~1 %d: xyz %f %f %f, rel %f %f %f\n", i+1, cg[0].pat[i].xyz[0], cg[0].pat[i].xyz[1], cg[0].pat[i].xyz[2], in[0], in[1], in[2]);
+		/* Compute the round trip errors in parallel */
+		cx.pat = cg[0].pat;
+		icmCpy3x3(cx.chmat, chmat);
+		if ((cx.de = (double *)malloc(sizeof(double) * cg[0].npat)) == NULL)
+			error("Malloc failed - de[]");
+
+		nthreads = num_threads();
+		if (nthreads > NUMTHR_MAX)
+			nthreads = NUMTHR_MAX;
+		if (nthreads > (cg[0].npat + GCHK_CHUNK - 1)/GCHK_CHUNK)
+			nthreads = (cg[0].npat + GCHK_CHUNK - 1)/GCHK_CHUNK;
+		if (nthreads < 1)
+			nthreads = 1;
+
+		/* An icxLuLut inverse needs a copy per thread */
+		luo->spaces(luo, NULL, NULL, NULL, NULL, &alg, NULL, NULL, NULL);
+		for (i = 0; i < nthreads; i++) {
+			if (nthreads > 1 && alg == icmLutType) {
+				if ((cx.tluo[i] = (icxLuBase *)((icxLuLut *)luo)->inv_thread_ctx(
+				                                (icxLuLut *)luo, nthreads)) == NULL)
+					error ("%d, %s",xicco->errc, xicco->err);
+			} else
+				cx.tluo[i] = luo;
+		}
 
-			if ((rv = luo->inv_lookup(luo, out, in)) > 0 || 1) {
-				double de;
+		par_for(nthreads, 0, cg[0].npat, GCHK_CHUNK, gamut_check_thread, (void *)&cx);
 
-				luo->lookup(luo, check, out);
-				de = icmXYZLabDE(&icmD50,check, in);
-//printf("~1 %d: rv %d, de %f, check XYZ %f %f %f\n",i+1,rv, de, check[0],check[1],check[2]);
+		for (i = 0; i < nthreads; i++) {
+			if (cx.tluo[i] != luo)
+				cx.tluo[i]->del(cx.tluo[i]);
+		}
 
-				if (de >= 0.01) {
-					cg[0].pat[i].og = 1;
-//printf("~1 Patch %d is out of gamut by DE %f RGB %f %f %f\n",i+1,de,out[0],out[1],out[2]);
-					if (verb >= 3)
-						printf("Patch %d is out of gamut by DE %f\n",i+1,de);
-					cg[0].nig--;
-				}
+		for (i = 0; i < cg[0].npat; i++) {
+			if (cx.de[i] >= 0.01) {
+				cg[0].pat[i].og = 1;
+				if (verb >= 3)
+					printf("Patch %d is out of gamut by DE %f\n",i+1,cx.de[i]);
+				cg[0].nig--;
 			}
 		}
+		free(cx.de);
 		if (verb)
 			fprintf(verbo,"No of test patches in gamut = %d/%d\n",cg[0].nig,cg[0].npat);
 	}
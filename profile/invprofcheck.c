@@ -44,6 +44,17 @@
 #define HTRES 27
 #define UHTRES 61
 
+#define RT_BLOCK 8192		/* Number of test points looked up at a time */
+#define RT_GRAIN 256		/* Number of test points per parallel chunk */
+
+#define AS_TOL 0.1			/* Default adaptive sampling delta E tolerance */
+#define AS_BLOCK 1024		/* Number of quasi-random points per adaptive round */
+#define AS_NWORST 16		/* Number of worst points to refine around */
+#define AS_NREFINE 32		/* Number of refinement points around each worst point */
+#define AS_RAD 0.1			/* Initial refinement radius, as a fraction of the range */
+#define AS_MINRAD 0.002		/* Refinement radius at which the max. is taken as found */
+#define AS_MAXSAMPS (1 << 24)	/* Maximum number of quasi-random points */
+
 /* ------------------------------------------------------- */
 /* Macros for an di or fdi dimensional counter */
 /* Declare the counter name nn, dimensions di, & count */
@@ -93,6 +104,7 @@ void usage(void) {
 	fprintf(stderr," -h           high res test (%d)\n",HTRES);
 	fprintf(stderr," -u           Ultra high res test (%d)\n",UHTRES);
 	fprintf(stderr," -R res       Specific grid resolution\n");
+	fprintf(stderr," -a [tol]     Sample adaptively until max. and avg. are within tol DE (def. %.1f)\n",AS_TOL);
 	fprintf(stderr," -I           Do bwd to fwd check\n");
 	fprintf(stderr," -c           Show CIE94 delta E values\n");
 	fprintf(stderr," -k           Show CIEDE2000 delta E values\n");
@@ -105,6 +117,181 @@ void usage(void) {
 
 static void DE2RGB(double *out, double in);
 
+/* Round trip check context */
+typedef struct {
+	icc *icco;
+	icmLuBase *luo1, *luo2;		/* Device to PCS, PCS to Device */
+	int inv;					/* nz if PCS -> Device -> PCS */
+	int inn;					/* Number of device channels */
+	int di;						/* Test point dimensions, inn or 3 if inv */
+	xcal *cal;					/* Device calibration curves, NULL if none */
+	double tlimit, klimit;		/* Ink limits, <= 0.0 if none */
+	int kch;					/* Black channel, -1 if not known/applicable */
+	int cie94, cie2k;			/* Delta E type */
+	int verb;
+	vrml *wrl;					/* Visualisation, NULL if none */
+	int dodecol;				/* Color vectors acording to delta E */
+
+	double *uv;					/* Test points in unit range, MAX_CHAN per point */
+	double *dev, *pcsin, *devout, *pcsout;	/* Test point values */
+	double *de;					/* Test point round trip delta E */
+
+	double merr;				/* Max */
+	double aerr;				/* Avg */
+	double rerr;				/* RMS */
+	double nsamps;
+} rtcntx;
+
+/* One of the worst test points found */
+typedef struct {
+	double uv[MAX_CHAN];		/* Unit range test point */
+	double de;					/* Its round trip delta E */
+} rtworst;
+
+/* Set test point bn from the values co[] / sc, */
+/* and return nz if it is over the ink limits. */
+static int rt_setpoint(rtcntx *p, int bn, double *co, double sc) {
+	double *uv = p->uv + bn * MAX_CHAN;
+	int n;
+
+	for (n = 0; n < p->di; n++)
+		uv[n] = co[n]/sc;
+
+	/* Device -> PCS -> Device */
+	if (!p->inv) {
+		double *dev = p->dev + bn * p->inn;
+		double sum, cdev[MAX_CHAN];
+
+		/* Check the (possibly calibrated) device values */
+		/* end reject any over the limits. */
+		for (sum = 0, n = 0; n < p->inn; n++) {
+			cdev[n] = dev[n] = uv[n];
+			sum += cdev[n];
+		}
+		if (p->cal != NULL) {
+			p->cal->interp(p->cal, cdev, dev);
+			for (sum = 0, n = 0; n < p->inn; n++)
+				sum += cdev[n];
+		}
+
+		if ((p->tlimit > 0.0 && sum > p->tlimit)
+		 || (p->klimit > 0.0 && p->kch >= 0 && cdev[p->kch] > p->klimit))
+			return 1;
+
+	/* PCS -> Device -> PCS */
+	} else {
+		double *pcsin = p->pcsin + bn * 3;
+
+		pcsin[0] = 100.0 * co[0]/sc;
+		pcsin[1] = (127.0 * 2.0 * co[1]/sc) - 127.0;
+		pcsin[2] = (127.0 * 2.0 * co[2]/sc) - 127.0;
+	}
+	return 0;
+}
+
+/* Do the round trip lookups of test points i0 .. i1-1 */
+static int rtrip_thread(void *cntx, int i0, int i1, int thix) {
+	rtcntx *p = (rtcntx *)cntx;
+	int n = i1 - i0, inn = p->inn;
+
+	/* Generate the in-gamut PCS test point */
+	/* by converting device to pcsin */
+	if (!p->inv
+	 && p->luo1->lookup_n(p->luo1, p->pcsin + 3 * i0, p->dev + inn * i0, n) > 1)
+		return 1;
+
+	/* PCS -> Device */
+	if (p->luo2->lookup_n(p->luo2, p->devout + inn * i0, p->pcsin + 3 * i0, n) > 1)
+		return 1;
+
+	/* Device to PCS */
+	if (p->luo1->lookup_n(p->luo1, p->pcsout + 3 * i0, p->devout + inn * i0, n) > 1)
+		return 1;
+
+	/* Check the result */
+	if (p->cie2k)
+		icmCIE2K_n(p->de + i0, p->pcsout + 3 * i0, p->pcsin + 3 * i0, n);
+	else if (p->cie94)
+		icmCIE94_n(p->de + i0, p->pcsout + 3 * i0, p->pcsin + 3 * i0, n);
+	else
+		icmLabDE_n(p->de + i0, p->pcsout + 3 * i0, p->pcsin + 3 * i0, n);
+
+	return 0;
+}
+
+/* Do the round trip lookups of test points 0 .. bn-1 in parallel */
+static void rt_lookup(rtcntx *p, int bn) {
+	if (par_for(0, 0, bn, RT_GRAIN, rtrip_thread, (void *)p) != 0)
+		error ("%d, %s",p->icco->errc,p->icco->err);
+}
+
+/* Accumulate the results of test points 0 .. bn-1 in order. */
+/* If dostats is zero, only the max. is accumulated. */
+static void rt_accum(rtcntx *p, int bn, int dostats) {
+	int i, n;
+
+	for (i = 0; i < bn; i++) {
+		double *pcsin = p->pcsin + i * 3, *pcsout = p->pcsout + i * 3;
+		double *devout = p->devout + i * p->inn;
+		double de = p->de[i];
+
+		/* Delta E */
+		if (p->wrl != NULL) {
+			vrml *wrl = p->wrl;
+			int ix[2];
+
+			/* Add the verticies */
+			ix[0] = wrl->add_vertex(wrl, 0, pcsin);
+			ix[1] = wrl->add_vertex(wrl, 0, pcsout);
+
+			/* Add the line */
+			if (p->dodecol) {		/* Lines with color determined by length */
+				double rgb[3];
+				DE2RGB(rgb, icmNorm33(pcsin, pcsout));
+				wrl->add_col_line(wrl, 0, ix, rgb);
+
+			} else {	/* Natural color */
+				wrl->add_line(wrl, 0, ix);
+			}
+		}
+
+		if (dostats) {
+			p->aerr += de;
+			p->rerr += de * de;
+			p->nsamps++;
+		}
+		if (de > p->merr)
+			p->merr = de;
+
+		if (p->verb > 1) {
+			printf("[%f] %f %f %f -> ",de, pcsin[0], pcsin[1], pcsin[2]);
+			for (n = 0; n < p->inn; n++)
+				printf("%f ",devout[n]);
+			printf("-> %f %f %f\n",pcsout[0], pcsout[1], pcsout[2]);
+		}
+	}
+}
+
+/* Add any of test points 0 .. bn-1 that are amongst the */
+/* worst found to the list w[*nw], sorted worst first. */
+static void rt_worst(rtcntx *p, int bn, rtworst *w, int *nw) {
+	int i, j, n;
+
+	for (i = 0; i < bn; i++) {
+		double de = p->de[i];
+
+		if (*nw >= AS_NWORST && de <= w[*nw-1].de)
+			continue;
+		if (*nw < AS_NWORST)
+			(*nw)++;
+		for (j = *nw-1; j > 0 && w[j-1].de < de; j--)
+			w[j] = w[j-1];
+		for (n = 0; n < p->di; n++)
+			w[j].uv[n] = p->uv[i * MAX_CHAN + n];
+		w[j].de = de;
+	}
+}
+
 #if defined(__IBMC__) && defined(_M_IX86)
 void bug_workaround(int *co) { };			/* Workaround optimiser bug */
 #endif
@@ -128,6 +315,7 @@ main(
 	int rv = 0;
 	int inv = 0;
 	int tres = TRES;
+	double astol = 0.0;				/* Adaptive sampling tolerance, 0.0 for grid */
 	double tlimit = -1.0;
 	double klimit = -1.0;
 	icRenderingIntent intent = icRelativeColorimetric;	/* Default */
@@ -187,6 +375,17 @@ main(
 				tres = res;
 			}
 
+			/* Adaptive sampling */
+			else if (argv[fa][1] == 'a' || argv[fa][1] == 'A') {
+				astol = AS_TOL;
+				if (na != NULL && (isdigit(na[0]) || na[0] == '.')) {
+					fa = nfa;
+					astol = atof(na);
+					if (astol <= 0.0)
+						usage();
+				}
+			}
+
 			/* Inverse */
 			else if (argv[fa][1] == 'I') {
 				inv = 1;
@@ -339,160 +538,141 @@ main(
 				printf("Input black ink limit assumed is %3.1f%%\n",100.0 * klimit);
 		}
 
-		/* Device -> PCS -> Device */
-		if (!inv) {
-			double dev[MAX_CHAN], cdev[MAX_CHAN], pcsin[3], devout[MAX_CHAN], pcsout[3];
-			DCOUNT(co, inn, 0, 0, tres);		/* Multi-D counter */
+		/* Generate the test points a block at a time, and do the */
+		/* round trip lookups of each block in parallel. */
+		{
+			rtcntx cx;
+			int bn, i, j, n;
+
+			memset((void *)&cx, 0, sizeof(rtcntx));
+			cx.icco = icco;
+			cx.luo1 = luo1;
+			cx.luo2 = luo2;
+			cx.inv = inv;
+			cx.inn = inn;
+			cx.di = inv ? 3 : inn;
+			cx.cal = cal;
+			cx.tlimit = tlimit;
+			cx.klimit = klimit;
+			cx.kch = kch;
+			cx.cie94 = cie94;
+			cx.cie2k = cie2k;
+			cx.verb = verb;
+			cx.wrl = wrl;
+			cx.dodecol = dodecol;
+
+			if ((cx.uv = (double *)malloc(sizeof(double) * RT_BLOCK * (MAX_CHAN + 2 * inn + 7))) == NULL)
+				error("Malloc of test point block failed");
+			cx.dev = cx.uv + RT_BLOCK * MAX_CHAN;
+			cx.pcsin = cx.dev + RT_BLOCK * inn;
+			cx.devout = cx.pcsin + RT_BLOCK * 3;
+			cx.pcsout = cx.devout + RT_BLOCK * inn;
+			cx.de = cx.pcsout + RT_BLOCK * 3;
+
+			/* Go through the chosen device or Lab grid */
+			if (astol <= 0.0) {
+				double dco[MAX_CHAN];
+				DCOUNT(co, cx.di, 0, 0, tres);		/* Multi-D counter */
 	
-			/* Go through the chosen device grid */
-			DC_INIT(co)
-			for (; !DC_DONE(co);) {
-				int n, rv1, rv2;
-				double sum;
-				double de;
-
-				/* Check the (possibly calibrated) device values */
-				/* end reject any over the limits. */
-				for (sum = 0, n = 0; n < inn; n++) {
-					cdev[n] = dev[n] = co[n]/(tres-1.0);
-					sum += cdev[n];
-				}
-				if (cal != NULL) {
-					cal->interp(cal, cdev, dev);
-					for (sum = 0, n = 0; n < inn; n++)
-						sum += cdev[n];
-				}
-
-				if ((tlimit > 0.0 && sum > tlimit)
-				 || (klimit > 0.0 && kch >= 0 && cdev[kch] > klimit)) {
-					DC_INC(co);
-					continue;
+				DC_INIT(co)
+				for (; !DC_DONE(co);) {
+
+					/* Gather a block of test points */
+					for (bn = 0; bn < RT_BLOCK && !DC_DONE(co);) {
+						for (n = 0; n < cx.di; n++)
+							dco[n] = co[n];
+						if (rt_setpoint(&cx, bn, dco, tres-1.0) == 0)
+							bn++;
+						DC_INC(co);
+					}
+					rt_lookup(&cx, bn);
+					rt_accum(&cx, bn, 1);
 				}
 
-				/* Generate the in-gamut PCS test point */
-				/* by converting device to pcsin */
-				if ((rv1 = luo1->lookup(luo1, pcsin, dev)) > 1)
-					error ("%d, %s",icco->errc,icco->err);
-
-				/* Now do the check */
-				/* PCS -> Device */
-				if ((rv2 = luo2->lookup(luo2, devout, pcsin)) > 1)
-					error ("%d, %s",icco->errc,icco->err);
-
-				/* Device to PCS */
-				if ((rv2 = luo1->lookup(luo1, pcsout, devout)) > 1)
-					error ("%d, %s",icco->errc,icco->err);
-
-				/* Delta E */
-				if (dovrml) {
-					int ix[2];
-
-					/* Add the verticies */
-					ix[0] = wrl->add_vertex(wrl, 0, pcsin);
-					ix[1] = wrl->add_vertex(wrl, 0, pcsout);
-
-					/* Add the line */
-					if (dodecol) {		/* Lines with color determined by length */
-						double rgb[3];
-						DE2RGB(rgb, icmNorm33(pcsin, pcsout));
-						wrl->add_col_line(wrl, 0, ix, rgb);
-	
-					} else {	/* Natural color */
-						wrl->add_line(wrl, 0, ix);
+			/* Sample adaptively, using quasi-random points for the error statistics, */
+			/* and random points around the worst points found to locate the max. */
+			/* Stop once the 95% confidence interval of the avg. is within astol, */
+			/* and closer refinement no longer increases the max. by astol. */
+			} else {
+				sobol *so;
+				rtworst worst[AS_NWORST];
+				int nworst = 0;
+				double rad = AS_RAD;	/* Refinement radius */
+				double hw = 1e38;		/* Avg. 95% confidence interval half width */
+				double nlookups = 0.0;
+				int nsobol = 0, done = 0;
+
+				if ((so = new_sobol(cx.di)) == NULL)
+					error("Creating sobol sequence failed");
+
+				while (!done) {
+					double pmerr = cx.merr;
+					double uv[MAX_CHAN];
+
+					/* A block of quasi-random points */
+					for (bn = 0; bn < AS_BLOCK; nsobol++) {
+						if (nsobol >= AS_MAXSAMPS || so->next(so, uv)) {
+							done = 1;
+							break;
+						}
+						if (rt_setpoint(&cx, bn, uv, 1.0) == 0)
+							bn++;
+					}
+					rt_lookup(&cx, bn);
+					rt_accum(&cx, bn, 1);
+					rt_worst(&cx, bn, worst, &nworst);
+					nlookups += bn;
+
+					/* Points around the worst ones */
+					for (bn = i = 0; i < nworst; i++) {
+						for (j = 0; j < AS_NREFINE; j++) {
+							for (n = 0; n < cx.di; n++) {
+								uv[n] = worst[i].uv[n] + d_rand(-rad, rad);
+								if (uv[n] < 0.0)
+									uv[n] = 0.0;
+								else if (uv[n] > 1.0)
+									uv[n] = 1.0;
+							}
+							if (rt_setpoint(&cx, bn, uv, 1.0) == 0)
+								bn++;
+						}
+					}
+					rt_lookup(&cx, bn);
+					rt_accum(&cx, bn, 0);
+					rt_worst(&cx, bn, worst, &nworst);
+					nlookups += bn;
+
+					/* Once the max. stops increasing, refine more closely */
+					if ((cx.merr - pmerr) < astol)
+						rad *= 0.5;
+
+					if (cx.nsamps > 1.0) {
+						double var;
+						var = (cx.rerr - cx.aerr * cx.aerr/cx.nsamps)/(cx.nsamps - 1.0);
+						hw = var > 0.0 ? 1.96 * sqrt(var/cx.nsamps) : 0.0;
 					}
-				}
-	
-				/* Check the result */
-				if (cie2k)
-					de = icmCIE2K(pcsout, pcsin);
-				else if (cie94)
-					de = icmCIE94(pcsout, pcsin);
-				else
-					de = icmLabDE(pcsout, pcsin);
-	
-				aerr += de;
-				rerr += de * de;
-				if (de > merr)
-					merr = de;
-				nsamps++;
-
-				if (verb > 1) {
-					printf("[%f] %f %f %f -> ",de, pcsin[0], pcsin[1], pcsin[2]);
-					for (n = 0; n < inn; n++)
-						printf("%f ",devout[n]);
-					printf("-> %f %f %f\n",pcsout[0], pcsout[1], pcsout[2]);
-				}
 
-				DC_INC(co);
-			}
+					if (verb > 1)
+						printf("%.0f lookups, max. = %f, avg. = %f +/- %f\n",
+						       nlookups, cx.merr, cx.aerr/cx.nsamps, hw);
 
-		/* PCS -> Device -> PCS */
-		} else {
-			double dev[MAX_CHAN], cdev[MAX_CHAN], pcsin[3], devout[MAX_CHAN], pcsout[3];
-			DCOUNT(co, 3, 0, 0, tres);		/* Multi-D counter */
-	
-			/* Go through the chosen Lab grid */
-			DC_INIT(co)
-			for (; !DC_DONE(co);) {
-				int n, rv1, rv2;
-				double sum;
-				double de;
-
-				pcsin[0] = 100.0 * co[0]/(tres-1.0);
-				pcsin[1] = (127.0 * 2.0 * co[1]/(tres-1.0)) - 127.0;
-				pcsin[2] = (127.0 * 2.0 * co[2]/(tres-1.0)) - 127.0;
-
-				/* PCS -> Device */
-				if ((rv2 = luo2->lookup(luo2, devout, pcsin)) > 1)
-					error ("%d, %s",icco->errc,icco->err);
-
-				/* Device to PCS */
-				if ((rv2 = luo1->lookup(luo1, pcsout, devout)) > 1)
-					error ("%d, %s",icco->errc,icco->err);
-
-				/* Delta E */
-				if (dovrml) {
-//				if (fabs(pcsin[0] - 5.0) < 0.1 && dovrml) {
-					int ix[2];
-
-					/* Add the verticies */
-					ix[0] = wrl->add_vertex(wrl, 0, pcsin);
-					ix[1] = wrl->add_vertex(wrl, 0, pcsout);
-
-					/* Add the line */
-					if (dodecol) {		/* Lines with color determined by length */
-						double rgb[3];
-						DE2RGB(rgb, icmNorm33(pcsin, pcsout));
-						wrl->add_col_line(wrl, 0, ix, rgb);
-	
-					} else {	/* Natural color */
-						wrl->add_line(wrl, 0, ix);
-					}
-				}
-	
-				/* Check the result */
-				if (cie2k)
-					de = icmCIE2K(pcsout, pcsin);
-				else if (cie94)
-					de = icmCIE94(pcsout, pcsin);
-				else
-					de = icmLabDE(pcsout, pcsin);
-	
-				aerr += de;
-				rerr += de * de;
-				if (de > merr)
-					merr = de;
-				nsamps++;
-
-				if (verb > 1) {
-					printf("[%f] %f %f %f -> ",de, pcsin[0], pcsin[1], pcsin[2]);
-					for (n = 0; n < inn; n++)
-						printf("%f ",devout[n]);
-					printf("-> %f %f %f\n",pcsout[0], pcsout[1], pcsout[2]);
+					if (hw <= astol && rad < AS_MINRAD)
+						break;
+					if (done)
+						warning("Adaptive sampling didn't reach tolerance %f",astol);
 				}
+				so->del(so);
 
-				DC_INC(co);
+				if (verb)
+					printf("Adaptive sampling used %.0f lookups, avg. 95%% confidence +/- %f\n",
+					       nlookups, hw);
 			}
+			free(cx.uv);
+
+			merr = cx.merr;
+			aerr = cx.aerr;
+			rerr = cx.rerr;
+			nsamps = cx.nsamps;
 		}
 		if (dovrml) {
 			wrl->make_lines_vc(wrl, 0, 0.0);
@@ -50,6 +50,23 @@ usage(void) {
 	exit(1);
 	}
 
+/* Spectral lookup context */
+typedef struct {
+	mpp *p;
+	mppcol *cols;			/* Test patches */
+	xspect *sout;			/* Returned spectral value for each patch */
+} spec_cntx;
+
+/* Lookup the spectral values for patches i0 .. i1-1 */
+static int lookup_spec_thread(void *cntx, int i0, int i1, int thix) {
+	spec_cntx *cx = (spec_cntx *)cntx;
+	int i;
+
+	for (i = i0; i < i1; i++)
+		cx->p->lookup_spec(cx->p, &cx->sout[i], cx->cols[i].nv);
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	int fa,nfa;							/* current argument we're looking at */
@@ -77,6 +94,8 @@ int main(int argc, char *argv[])
 	int nodp;				/* Number of test patches */
 	mppcol *cols;			/* Test patches */
 	mpp *p;					/* Model Printer Profile */
+	double *dev;			/* Device value of each patch */
+	double *pout;			/* Profile PCS value of each patch */
 
 	double merr = 0.0;
 	double aerr = 0.0;
@@ -419,12 +438,19 @@ int main(int argc, char *argv[])
 	/* Set just PCS and use XYZ model */
 	p->set_ilob(p, icxIT_default, NULL, icxOT_default, NULL, icSigLabData, 0);
 
+	/* Lookup the profile PCS values for all the data points at once */
+	if ((dev = (double *)malloc(sizeof(double) * nodp * devchan)) == NULL
+	 || (pout = (double *)malloc(sizeof(double) * nodp * 3)) == NULL)
+		error("Malloc failed");
 	for (i = 0; i < nodp; i++) {
-		double out[3], ref[3];
-		double mxd;
+		for (j = 0; j < devchan; j++)
+			dev[i * devchan + j] = cols[i].nv[j];
+	}
+	p->lookup_n(p, pout, dev, nodp);
 
-		/* Lookup the profile PCS value for this data point */
-		p->lookup(p, out, cols[i].nv);
+	for (i = 0; i < nodp; i++) {
+		double *out = pout + i * 3, ref[3];
+		double mxd;
 	
 		/* Convert our cols data to Lab */
 		icmXYZ2Lab(&icmD50, ref, cols[i].band);
@@ -450,17 +476,23 @@ int main(int argc, char *argv[])
 		    cie2k ? "CIEDE2000" : cie94 ? "CIE94" : "Lab", aerr/nsamps, merr); fflush(stdout);
 
 	if (ospec) {
+		spec_cntx cx;
+
 		merr = 0.0;
 		aerr = 0.0;
 		nsamps = 0.0;
 
+		/* Lookup the profile spectral values for all the data points */
+		cx.p = p;
+		cx.cols = cols;
+		if ((cx.sout = (xspect *)malloc(sizeof(xspect) * nodp)) == NULL)
+			error("Malloc failed");
+		par_for(0, 0, nodp, 0, lookup_spec_thread, (void *)&cx);
+
 		for (i = 0; i < nodp; i++) {
-			xspect out;
+			xspect out = cx.sout[i];
 			double avd, mxd;
 
-			/* Lookup the profile spectral value for this data point */
-			p->lookup_spec(p, &out, cols[i].nv);
-		
 			if (spec_n != out.spec_n)
 				error("Mismatch between original spectral and returned");
 
@@ -496,6 +528,7 @@ int main(int argc, char *argv[])
 		}
 		printf("profile spectral check complete, avg err = %f%%, max err = %f%%\n",
 		       aerr * 100.0/nsamps, merr * 100.0); fflush(stdout);
+		free(cx.sout);
 
 		/* Check spectrally derived Lab values */
 		{
@@ -512,12 +545,12 @@ int main(int argc, char *argv[])
 			aerr = 0.0;
 			nsamps = 0.0;
 
+			/* Lookup the profile PCS values for all the data points at once */
+			p->lookup_n(p, pout, dev, nodp);
+
 			for (i = 0; i < nodp; i++) {
-				double out[3], ref[3];
+				double *out = pout + i * 3, ref[3];
 				double mxd;
-
-				/* Lookup the profile PCS value for this data point */
-				p->lookup(p, out, cols[i].nv);
 			
 				/* Convert our cols ref data to Lab */
 				sp.spec_n = spec_n;
@@ -556,6 +589,8 @@ int main(int argc, char *argv[])
 	p->del(p);
 
 	/* Clean up */
+	free(pout);
+	free(dev);
 	del_mppcols(cols, nodp, devchan, spec_n);
 
 	return 0;
@@ -78,13 +78,15 @@ usage(void) {
 	fprintf(stderr," -m         Generate ink mixing model\n");
 	fprintf(stderr," -y [level] Verify profile, 2 = read/write verify\n");
 	fprintf(stderr," -L         Output Lab values\n");
+	fprintf(stderr," -j n       Use n threads to fit the model (default %d)\n",num_threads());
+	fprintf(stderr," -b         Fit the spectral bands in parallel\n");
 	fprintf(stderr," outfile    Base name for input.ti3/output.mpp file\n");
 	exit(1);
 	}
 
 /* Worker function */
 static int make_output_mpp(int verb, int quality, int verify, char *inname, char *outname,
-int dolab, double ilimit, int ospec, int omix, profxinf *xpi);
+int dolab, double ilimit, int ospec, int omix, int nthreads, int bandpar, profxinf *xpi);
 
 int main(int argc, char *argv[])
 {
@@ -96,6 +98,8 @@ int main(int argc, char *argv[])
 	double limit = -1.0;				/* Ink limit */
 	int ospec = 0;						/* Output spectral model flag */
 	int omix = 0;						/* Output mixing model flag */
+	int nthreads = 0;					/* Fitting threads, 0 = default */
+	int bandpar = 0;					/* Fit spectral bands in parallel */
 	static char inname[200] = { 0 };	/* Input cgats file base name */
 	static char outname[200] = { 0 };		/* Output cgats file base name */
 	profxinf xpi;						/* Extra profile information */
@@ -203,6 +207,19 @@ int main(int argc, char *argv[])
 			else if (argv[fa][1] == 'L')
 				dolab = 1;
 
+			/* Number of fitting threads */
+			else if (argv[fa][1] == 'j') {
+				if (na == NULL) usage();
+				fa = nfa;
+				nthreads = atoi(na);
+				if (nthreads < 1)
+					usage();
+			}
+
+			/* Fit spectral bands in parallel */
+			else if (argv[fa][1] == 'b')
+				bandpar = 1;
+
 			else 
 				usage();
 		} else
@@ -217,7 +234,7 @@ int main(int argc, char *argv[])
 	strcat(outname,".mpp");
 
 	if (make_output_mpp(verb, iquality, verify, inname, outname,
-	                dolab, limit, ospec, omix, &xpi) != 0) {
+	                dolab, limit, ospec, omix, nthreads, bandpar, &xpi) != 0) {
 		error ("making mpp failed");
 	}
 		
@@ -238,6 +255,8 @@ make_output_mpp(
 	double limit,			/* Ink limit, -1.0 == default */
 	int ospec,				/* Output spectral model */
 	int omix,				/* Output ink mixing model */
+	int nthreads,			/* Fitting threads, 0 = default */
+	int bandpar,			/* NZ to fit spectral bands in parallel */
 	profxinf *xpi			/* Optional Profile creation extra data */
 ) {
 	int i, j;
@@ -571,6 +590,8 @@ make_output_mpp(
 	if ((p = new_mpp()) == NULL)
 		return 1;
 
+	p->set_threads(p, nthreads, bandpar);
+
 	/* Create from scattered data */
 	if (p->create(p, verb, quality, isDisplay, limit, devmask, spec_n, spec_wl_short, spec_wl_long,
 	              norm, itype, nodp, cols) != 0) {
@@ -65,7 +65,8 @@
 #define MIN_SLOPE_A 8.0	/* Criteria for Auto max, DE/dDev at max */
 #define MIN_SLOPE_O 3.0	/* Criteria for Auto max, min DE/dDev below max */
 
-#define CAL_RES 256		/* Resolution saved to .cal file */
+#define CAL_RES 256		/* Default resolution saved to .cal file */
+#define MAX_CAL_RES 65536	/* Maximum resolution saved to .cal file */
 
 #define PRES 256		/* Plotting resolution */
 
@@ -103,6 +104,7 @@ void usage(char *diag, ...) {
 	fprintf(stderr,"       y, b, 2	 Third channel\n");
 	fprintf(stderr,"       k,    3	 Fourth channel, etc.\n");
 	fprintf(stderr," -a              Create an Adobe Photoshop .AMP file as well as a .cal\n");
+	fprintf(stderr," -R res          Calibration curve resolution (default %d, max %d)\n",CAL_RES,MAX_CAL_RES);
 	fprintf(stderr," prevcal         Base name of previous .cal file for recal or verify.\n");
 	fprintf(stderr," inoutname       Base name of input .ti3 file, output .cal file\n");
 	exit(1);
@@ -545,6 +547,93 @@ static double rspl_ilookup(rspl *r, double dir, double in) {
 	return pp[k].p[0];
 }
 
+/* A 1D rspl tabulated at its grid points, for fast inverse lookup. */
+/* Since a 1D rspl interpolates linearly between its grid points, */
+/* the inverse of each grid span can be computed directly. */
+typedef struct {
+	int res;			/* Number of grid points */
+	double *v;			/* Value at each grid point */
+} icurve;
+
+static icurve *new_icurve(rspl *r) {
+	icurve *p;
+	int i;
+
+	if ((p = (icurve *)calloc(1, sizeof(icurve))) == NULL)
+		error("Malloc of icurve failed");
+	p->res = r->g.res[0];
+	if ((p->v = (double *)malloc(sizeof(double) * p->res)) == NULL)
+		error("Malloc of icurve values failed");
+
+	for (i = 0; i < p->res; i++) {
+		co tp;
+		tp.p[0] = i/(p->res-1.0);
+		r->interp(r, &tp);
+		p->v[i] = tp.v[0];
+	}
+	return p;
+}
+
+static void icurve_del(icurve *p) {
+	if (p != NULL) {
+		free(p->v);
+		free(p);
+	}
+}
+
+/* Do an inverse lookup of an icurve, the same as rspl_ilookup(), */
+/* clipping to the nearest value if there is no solution. */
+/* dir is value to favour if there are multiple solutions. */
+static double icurve_ilookup(icurve *p, double dir, double in) {
+	double bdist = 1e300;
+	double bsoln = -1.0;
+	int i;
+
+	for (i = 0; i < (p->res-1); i++) {
+		double v0 = p->v[i], v1 = p->v[i+1];
+		double x, tt;
+
+		if ((in < v0 && in < v1) || (in > v0 && in > v1))
+			continue;
+
+		if (v0 == v1) {		/* Flat span, so choose closest to dir */
+			x = dir * (p->res-1.0);
+			if (x < (double)i)
+				x = (double)i;
+			else if (x > (i+1.0))
+				x = i+1.0;
+		} else {
+			x = i + (in - v0)/(v1 - v0);
+		}
+		x /= (p->res-1.0);
+
+		tt = x - dir;
+		tt *= tt;
+		if (tt < bdist) {	/* Better solution */
+			bdist = tt;
+			bsoln = x;
+		}
+	}
+
+	/* No solution, so clip to the nearest value */
+	if (bsoln < 0.0) {
+		double bde = 1e300;
+		for (i = 0; i < p->res; i++) {
+			double de, tt, x;
+
+			de = fabs(p->v[i] - in);
+			x = i/(p->res-1.0);
+			tt = (x - dir) * (x - dir);
+			if (de < bde || (de == bde && tt < bdist)) {
+				bde = de;
+				bdist = tt;
+				bsoln = x;
+			}
+		}
+	}
+	return bsoln;
+}
+
 int main(int argc, char *argv[]) {
 	int fa,nfa,mfa;				/* current argument we're looking at */
 	int verb = 0;
@@ -588,6 +677,7 @@ int main(int argc, char *argv[]) {
 	rspl *pcade[MAX_CHAN];		/* Previous calibrated absolute delta E */
 	double mxade[MAX_CHAN];		/* Maximum ade value */
 	double idpow[MAX_CHAN] = { -1.0 };		/* Ideal power-like of targen values */
+	int cal_res = CAL_RES;		/* Resolution of calibration curves */
 	int n_cvals;				/* Number of calibration curve values */
 	wval *cvals[MAX_CHAN];		/* Calibration curve tables */
 	rspl *tcurves[MAX_CHAN];	/* Tweak target curves */
@@ -716,6 +806,15 @@ int main(int argc, char *argv[]) {
 			else if (argv[fa][1] == 'a')
 				doamp = 1;			/* write AMP file */
 
+			/* Calibration curve resolution */
+			else if (argv[fa][1] == 'R') {
+				if (na == NULL) usage("Expect argument to resolution flag -R");
+				fa = nfa;
+				cal_res = atoi(na);
+				if (cal_res < 2 || cal_res > MAX_CAL_RES)
+					usage("Calibration curve resolution %d out of range 2 - %d",cal_res,MAX_CAL_RES);
+			}
+
 			/* Smoothing modfider */
 			else if (argv[fa][1] == 's') {
 				if (na == NULL) usage("Expect argument to smoothing flag -s");
@@ -2003,10 +2102,11 @@ int main(int argc, char *argv[]) {
 		}
 
 		/* Do inverse lookup to create relative linearization curves */
-		n_cvals = CAL_RES;
+		n_cvals = cal_res;
 		for (j = 0; j < devchan; j++) {
 			co tp;
 			double rdemin, rdemax;	/* Relative DE min and max targets */
+			icurve *irde;
 
 			/* Convert absolute de aims to relative */
 			if ((rdemax = rspl_ilookup(ade[j], 0.0, pct->ademax[j])) < 0.0)
@@ -2030,6 +2130,7 @@ int main(int argc, char *argv[]) {
 				error("Malloc of %d cvals failed",n_cvals);
 
 			/* Convert relative delta E aim to device value */
+			irde = new_icurve(rde[j]);
 			for (i = 0; i < n_cvals; i++) {
 				double x = i/(n_cvals-1.0);
 				double inv;
@@ -2045,33 +2146,35 @@ int main(int argc, char *argv[]) {
 
 				inv = x * (rdemax - rdemin) + rdemin;
 
-				if ((cvals[j][i].dev = rspl_ilookup(rde[j], 0.5, inv)) < 0.0)
-					error("Unexpected failure to invert curve %d for DE %f",j,inv); 
+				cvals[j][i].dev = icurve_ilookup(irde, 0.5, inv);
 //printf("~1 chan %d, step %d, inv %f, detarg %f, got dev %f\n",j,i,x,pp[0].v[0],pp[k].p[0]);
 			}
+			icurve_del(irde);
 		}
 
 	} else if (recal || imitate) {
 
-		n_cvals = CAL_RES;
+		n_cvals = cal_res;
 		for (j = 0; j < devchan; j++) {
 			co tp;
+			icurve *iade;
 
 			if ((cvals[j] = (wval *)malloc(sizeof(wval) * n_cvals)) == NULL)
 				error("Malloc of %d cvals failed",n_cvals);
 
 			/* Lookup the expected ade for each input device value, and */
 			/* then translate it into the required output device value */
+			iade = new_icurve(ade[j]);
 			for (i = 0; i < n_cvals; i++) {
 				double x = i/(n_cvals-1.0);
 
 				cvals[j][i].inv = tp.p[0] = x;
 				pcade[j]->interp(pcade[j], &tp);
 
-				if ((cvals[j][i].dev = rspl_ilookup(ade[j], 0.5, tp.v[0])) < 0.0)
-					error("Unexpected failure to invert curve %d for DE %f",j,tp.v[0]); 
+				cvals[j][i].dev = icurve_ilookup(iade, 0.5, tp.v[0]);
 //printf("~1 chan %d, ix %d, inv %f, pcade %f, iade %f\n",j,i,x,tp.v[0],cvals[j][i].dev);
 			}
+			icurve_del(iade);
 		}
 	}
 
@@ -2095,10 +2198,11 @@ int main(int argc, char *argv[]) {
 
 			printf("Calibration curve plot:\n");
 
-			for (i = 0; i < n_cvals; i++) {
-				xx[i] = cvals[0][i].inv;
+			for (i = 0; i < PRES; i++) {
+				int ix = (int)(i * (n_cvals-1.0)/(PRES-1.0) + 0.5);
+				xx[i] = cvals[0][ix].inv;
 				for (j = 0; j < 10 && j < devchan; j++) {
-					yy[j][i] = cvals[j][i].dev;
+					yy[j][i] = cvals[j][ix].dev;
 				}
 			}
 			do_plot10(xx, devchan > 3 ? yy[3] : NULL,	/* Black */
@@ -2285,10 +2389,11 @@ int main(int argc, char *argv[]) {
 			for (j = 0; j < devchan; j++) {
 				for (i = 0; i < 256; i++) {
 					int x;
+					int ix = (int)(i * (n_cvals-1.0)/255.0 + 0.5);		/* Sample the curves */
 					if (devmask & ICX_ADDITIVE)
-						x = (int)(cvals[j][i].dev * 255.0 + 0.5);		/* ??? */
+						x = (int)(cvals[j][ix].dev * 255.0 + 0.5);		/* ??? */
 					else
-						x = 255 - (int)(cvals[j][255 - i].dev * 255.0 + 0.5);
+						x = 255 - (int)(cvals[j][n_cvals-1 - ix].dev * 255.0 + 0.5);
 					if (putc(x,fp) == EOF)
 						error("Error writing to fle '%s'",ampname);
 //printf("~1 chan %d, inv %d, dev %d\n",j,i,x);
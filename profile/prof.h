@@ -40,6 +40,10 @@ void make_output_icc(
 	int verb,				/* Vebosity level, 0 = none */
 	int iquality,			/* A2B table quality, 0..2 */
 	int oquality,			/* B2A table quality, 0..2 */
+	int nthreads,			/* Threads to use to create the B2A tables, 0 for default */
+	char *gmcache,			/* Gamut map cache directory, NULL if none */
+	char *ckdir,			/* Checkpoint directory, NULL if none */
+	char *ckkey,			/* Checkpoint key from ckpt_key() */
 	int noiluts,			/* nz to supress creation of input (Device) shaper luts */
 	int noisluts,			/* nz to supress creation of input sub-grid (Device) shaper luts */
 	int nooluts,			/* nz to supress creation of output (PCS) shaper luts */
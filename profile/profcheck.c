@@ -94,6 +94,35 @@ typedef struct {
 	double dv;			/* Delta E from CIE value */
 } pval;
 
+/* Patch delta E context */
+typedef struct {
+	icmLuBase *luo;		/* Device to PCS lookup */
+	pval *tpat;			/* Patches */
+	int cie94, cie2k;	/* Delta E type */
+} pdecntx;
+
+/* Lookup the profile value and compute the delta E of patches i0 .. i1-1 */
+static int patch_de_thread(void *cntx, int i0, int i1, int thix) {
+	pdecntx *p = (pdecntx *)cntx;
+	pval *tpat = p->tpat;
+	int i;
+
+	for (i = i0; i < i1; i++) {
+
+		/* Lookup the patch value in the profile */
+		if (p->luo->lookup(p->luo, tpat[i].pv, tpat[i].p) > 1)
+			return 1;
+
+		if (p->cie2k)
+			tpat[i].de = icmCIE2K(tpat[i].v, tpat[i].pv);
+		else if (p->cie94)
+			tpat[i].de = icmCIE94(tpat[i].v, tpat[i].pv);
+		else
+			tpat[i].de = icmLabDE(tpat[i].v, tpat[i].pv);
+	}
+	return 0;
+}
+
 /* Histogram bin type */
 typedef struct {
 	int count;			/* Raw count */
@@ -960,18 +989,16 @@ int main(int argc, char *argv[])
 		error("%d, %s",rd_icco->errc, rd_icco->err);
 	}
 
-	for (i = 0; i < npat; i++) {
+	/* Lookup the patch values in parallel */
+	{
+		pdecntx cx;
 
-		/* Lookup the patch value in the profile */
-		if (luo->lookup(luo, tpat[i].pv, tpat[i].p) > 1)
+		cx.luo = luo;
+		cx.tpat = tpat;
+		cx.cie94 = cie94;
+		cx.cie2k = cie2k;
+		if (par_for(0, 0, npat, 0, patch_de_thread, (void *)&cx) != 0)
 			error("%d, %s",rd_icco->errc,rd_icco->err);
-
-		if (cie2k)
-			tpat[i].de = icmCIE2K(tpat[i].v, tpat[i].pv);
-		else if (cie94)
-			tpat[i].de = icmCIE94(tpat[i].v, tpat[i].pv);
-		else
-			tpat[i].de = icmLabDE(tpat[i].v, tpat[i].pv);
 	}
 
 	/* - - - - - - - - - - */
@@ -755,6 +755,7 @@ make_input_icc(
 			char buf[100];
 			int  spi[XSPECT_MAX_BANDS];	/* CGATS indexes for each wavelength */
 			xsp2cie *sp2cie;	/* Spectral conversion object */
+			double *spv, *spo;	/* Spectral values and converted values */
 
 			if ((ii = icg->find_kword(icg, 0, "SPECTRAL_BANDS")) < 0)
 				error ("Input file doesn't contain keyword SPECTRAL_BANDS");
@@ -793,6 +794,10 @@ make_input_icc(
 			                          wantLab ? icSigLabData : icSigXYZData, icxClamp)) == NULL)
 				error("Creation of spectral conversion object failed");
 
+			if ((spv = (double *)malloc(sizeof(double) * npat * sp.spec_n)) == NULL
+			 || (spo = (double *)malloc(sizeof(double) * npat * 3)) == NULL)
+				error("Malloc failed - spectral values");
+
 			for (i = 0; i < npat; i++) {
 				tpat[i].w = 1.0;
 				tpat[i].p[0] = *((double *)icg->t[0].fdata[i][ri]) / 100.0;
@@ -806,12 +811,18 @@ make_input_icc(
 
 				/* Read the spectral values for this patch */
 				for (j = 0; j < sp.spec_n; j++) {
-					sp.spec[j] = *((double *)icg->t[0].fdata[i][spi[j]]);
+					spv[i * sp.spec_n + j] = *((double *)icg->t[0].fdata[i][spi[j]]);
 				}
+			}
 
-				/* Convert it to CIE space */
-				sp2cie->convert(sp2cie, tpat[i].v, &sp);
+			/* Convert them all to CIE space */
+			sp2cie->convert_n(sp2cie, spo, &sp, spv, npat);
+			for (i = 0; i < npat; i++) {
+				for (j = 0; j < 3; j++)
+					tpat[i].v[j] = spo[i * 3 + j];
 			}
+			free(spv);
+			free(spo);
 
 			sp2cie->del(sp2cie);		/* Done with this */
 
@@ -848,6 +859,7 @@ make_input_icc(
         flags |= ICX_WRITE_WBL;		/* Matrix: write white/black/luminence */
 
 		/* Setup Device -> XYZ conversion (Fwd) object from scattered data. */
+		a1tm_start("matrix fit");
 		if ((xluo = wr_xicc->set_luobj(
 //		               wr_xicc, icmFwd, icRelativeColorimetric,
 		               wr_xicc, icmFwd, icmDefaultIntent,
@@ -858,6 +870,7 @@ make_input_icc(
 			           smooth, avgdev, 1.0,
 		               NULL, NULL, NULL, iquality)) == NULL)
 			error("%d, %s",wr_xicc->errc, wr_xicc->err);
+		a1tm_end();
 
 		/* Free up xicc stuff */
 		xluo->del(xluo);
@@ -1132,6 +1145,7 @@ make_input_icc(
 		/* Setup RGB -> Lab conversion object from scattered data. */
 		/* Note that we've layered it on a native XYZ icc profile. */
 		/* (The skeleton model is not used - it doesn't seem to help) */
+		a1tm_start("A2B fit");
 		if ((AtoB = wr_xicc->set_luobj(
 		               wr_xicc, icmFwd, icmDefaultIntent,
 		               icmLuOrdNorm,
@@ -1147,6 +1161,7 @@ make_input_icc(
 			           smooth, avgdev, 1.0,
 			           NULL, NULL, NULL, iquality)) == NULL)
 			error ("%d, %s",wr_xicc->errc, wr_xicc->err);
+		a1tm_end();
 
 		if (mm != NULL)
 			mm->del(mm);
@@ -1252,8 +1267,10 @@ make_input_icc(
 	}
 
 	/* Write the file (including all tags) out */
+	a1tm_start("write profile");
 	if ((rv = wr_icco->write(wr_icco,wr_fp,0)) != 0)
 		error ("Write file: %d, %s",rv,wr_icco->err);
+	a1tm_end();
 
 	/* Close the file */
 	wr_icco->del(wr_icco);
@@ -78,6 +78,7 @@
 #define IGNORE_DISP_ZEROS	    /* [def] Ignore points with zero value if not at dev. zero */
 #define NO_B2A_PCS_CURVES		/* [def] PCS curves seem to make B2A less accurate. Why ? */
 #define USE_CAM_CLIP_OPT		/* [def] Clip out of gamut in CAM space rather than PCS */
+#define USE_REV_HINT			/* [def] Start each B2A inverse search at the previous grid point */
 #undef USE_LEASTSQUARES_APROX	/* [und] Use least squares fitting approximation in B2A */
 								/* (This improves robustness ?, but makes it less smooth) */
 //#undef USE_EXTRA_FITTING		/* [und] Turn on data point error compensation in A2B */
@@ -542,6 +543,278 @@ void out_b2a_output(void *cntx, double out[4], double in[4]) {
 }
 
 /* --------------------------------------------------------- */
+/* Threaded B2A table creation. */
+
+/* icmSetMultiLutTables() calls out_b2a_clut() serially for each grid */
+/* point (and cell center), and nearly all the time goes in the inversion. */
+/* So we run icmSetMultiLutTables() once with a clut callback that just */
+/* records the PCS' values it wants, compute the Dev' values for all of */
+/* them using several threads, each with its own copy of the A2B icxLuLut */
+/* (see icxLuLut inv_thread_ctx()), and then run icmSetMultiLutTables() */
+/* again with a clut callback that plays the results back in the same order. */
+/* If a checkpoint file is being used, the leading points that have been */
+/* computed are saved every CKPT_MSEC, and restored when re-run. */
+
+#define B2A_THR_CHUNK 32		/* Number of points a thread computes at a time */
+#define CKPT_MSEC (120 * 1000)	/* Interval between B2A checkpoint saves */
+
+typedef struct {
+	out_b2a_callback *cx;	/* Callback context used by the recording and playback */
+	int olen;				/* Doubles per point, ntables filter radiuses + ntables Dev' */
+	int npts, apts;			/* Number of points recorded, allocated */
+	double *in;				/* npts PCS' values */
+	double *out;			/* npts results of olen each */
+	int ix;					/* Next point to play back */
+
+	out_b2a_callback *tcx;	/* Per thread callback contexts */
+	amutex lock;			/* Lock for next and the progress count */
+	int next;				/* Next point to be computed */
+
+	char *ckname;			/* Checkpoint file name, NULL if none */
+	char *cdone;			/* Flag per chunk, nz when computed */
+	int ndone;				/* Number of leading points computed */
+	unsigned int lastsave;	/* msec_time() of last checkpoint save */
+	rand_state rst;			/* Random state at the start of the computation */
+} out_b2a_thr;
+
+/* Input and output table callbacks for recording and playback */
+static void out_b2a_input_thr(void *cntx, double out[3], double in[3]) {
+	out_b2a_input((void *)((out_b2a_thr *)cntx)->cx, out, in);
+}
+
+static void out_b2a_output_thr(void *cntx, double out[4], double in[4]) {
+	out_b2a_output((void *)((out_b2a_thr *)cntx)->cx, out, in);
+}
+
+/* Record clut callback */
+static void out_b2a_clut_rec(void *cntx, double *out, double in[3]) {
+	out_b2a_thr *p = (out_b2a_thr *)cntx;
+	int i;
+
+	if (p->npts >= p->apts) {
+		p->apts = p->apts * 2 + 1024;
+		if ((p->in = (double *)realloc(p->in, p->apts * 3 * sizeof(double))) == NULL
+		 || (p->out = (double *)realloc(p->out, p->apts * p->olen * sizeof(double))) == NULL)
+			error("Malloc of B2A point list failed");
+	}
+	p->in[p->npts * 3 + 0] = in[0];
+	p->in[p->npts * 3 + 1] = in[1];
+	p->in[p->npts * 3 + 2] = in[2];
+	p->npts++;
+
+	/* Return something harmless */
+	for (i = 0; i < (p->cx->ntables * p->cx->ochan); i++)
+		out[i] = 0.0;
+	if (p->cx->filter) {
+		for (i = 0; i < p->cx->ntables; i++)
+			out[-1-i] = 0.0;
+	}
+}
+
+/* Playback clut callback */
+static void out_b2a_clut_play(void *cntx, double *out, double in[3]) {
+	out_b2a_thr *p = (out_b2a_thr *)cntx;
+	double *res;
+	int i, nt = p->cx->ntables;
+
+	if (p->ix >= p->npts
+	 || in[0] != p->in[p->ix * 3 + 0]
+	 || in[1] != p->in[p->ix * 3 + 1]
+	 || in[2] != p->in[p->ix * 3 + 2])
+		error("Internal, B2A playback doesn't match the recording");
+
+	res = p->out + p->ix * p->olen;
+	for (i = 0; i < (nt * p->cx->ochan); i++)
+		out[i] = res[nt + i];
+	if (p->cx->filter) {
+		for (i = 0; i < nt; i++)
+			out[-1-i] = res[nt-1-i];
+	}
+	p->ix++;
+}
+
+/* Compute thread. Threads take B2A_THR_CHUNK points at a time, */
+/* so that each thread's reverse cache sees neighbouring points. */
+static int out_b2a_clut_thread(void *cntx, int ix, int nth) {
+	out_b2a_thr *p = (out_b2a_thr *)cntx;
+	out_b2a_callback *cx = p->cx;
+	int i = 0, j, done = 0;
+
+	for (;;) {
+		amutex_lock(p->lock);
+		if (cx->verb && done > 0) {		/* Output percent intervals */
+			int pc;
+			cx->count += done;
+			pc = (int)(cx->count * 100.0/cx->total + 0.5);
+			if (pc != cx->last) {
+				printf("%c%2d%%",cr_char,pc); fflush(stdout);
+				cx->last = pc;
+			}
+		}
+		if (p->ckname != NULL && done > 0) {	/* i is the end of the chunk done */
+			p->cdone[(i-1)/B2A_THR_CHUNK] = 1;
+			while (p->ndone < p->npts && p->cdone[p->ndone/B2A_THR_CHUNK])
+				p->ndone += B2A_THR_CHUNK;
+			if (p->ndone > p->npts)
+				p->ndone = p->npts;
+			if ((msec_time() - p->lastsave) >= CKPT_MSEC) {
+				if (ckpt_save_pts(p->ckname, 3, p->olen, p->npts, p->in, p->ndone, p->out,
+				                  &p->rst, sizeof(rand_state)) != 0)
+					warning("Saving B2A checkpoint '%s' failed",p->ckname);
+				p->lastsave = msec_time();
+			}
+		}
+		i = p->next;
+		p->next += B2A_THR_CHUNK;
+		amutex_unlock(p->lock);
+
+		if (i >= p->npts)
+			break;
+		if ((j = i + B2A_THR_CHUNK) > p->npts)
+			j = p->npts;
+		for (done = 0; i < j; i++, done++) {
+			double *out = p->out + i * p->olen + cx->ntables;
+			out[0] = p->in[i * 3 + 0];		/* Same aliasing as icmSetMultiLutTables() */
+			out[1] = p->in[i * 3 + 1];
+			out[2] = p->in[i * 3 + 2];
+			out_b2a_clut((void *)&p->tcx[ix], out, out);
+		}
+	}
+	return 0;
+}
+
+/* Set the B2A tables using nthreads to do the inversion, */
+/* 0 for the default number. If ckname != NULL, checkpoint the */
+/* computed points to it. Return as icmSetMultiLutTables(). */
+static int out_b2a_set_tables(
+	int nthreads,
+	char *ckname,
+	out_b2a_callback *cx,
+	icmLut **wo,
+	int flags,
+	icColorSpaceSignature devspace
+) {
+	out_b2a_thr tx;
+	icxLuLut **tx_x;
+	int i, rv;
+
+	if (nthreads <= 0)
+		nthreads = num_threads();
+	if (nthreads > NUMTHR_MAX)
+		nthreads = NUMTHR_MAX;
+
+	/* Inking rules that take their target from the previous out[] */
+	/* values aren't used here, but they would need the serial order, */
+	/* and so can't be checkpointed either. */
+	if ((nthreads == 1 && ckname == NULL)
+	 || (cx->x->clutTable->di > cx->x->clutTable->fdi
+	  && cx->x->ink.k_rule != icxKluma5 && cx->x->ink.k_rule != icxKluma5k)) {
+		return icmSetMultiLutTables(cx->ntables, wo, flags, cx, cx->pcsspace, devspace,
+		                            out_b2a_input, NULL, NULL, out_b2a_clut, NULL, NULL,
+		                            out_b2a_output, NULL, NULL);
+	}
+
+	memset((void *)&tx, 0, sizeof(out_b2a_thr));
+	tx.cx = cx;
+	tx.olen = cx->ntables * (1 + cx->ochan);
+
+	/* Find out what points are needed */
+	if ((rv = icmSetMultiLutTables(cx->ntables, wo, flags, &tx, cx->pcsspace, devspace,
+	                            out_b2a_input_thr, NULL, NULL, out_b2a_clut_rec, NULL, NULL,
+	                            out_b2a_output_thr, NULL, NULL)) != 0) {
+		free(tx.in);
+		free(tx.out);
+		return rv;
+	}
+
+	/* Restore any points computed by a previous run, and the random */
+	/* state it started with, since the inversion may use random numbers. */
+	if (ckname != NULL) {
+		tx.ckname = ckname;
+		if ((tx.cdone = (char *)calloc(tx.npts/B2A_THR_CHUNK + 1, sizeof(char))) == NULL)
+			error("Malloc of B2A checkpoint flags failed");
+		if ((tx.ndone = ckpt_load_pts(ckname, 3, tx.olen, tx.npts, tx.in, tx.out,
+		                              &tx.rst, sizeof(rand_state))) >= 0) {
+			rand_copy(NULL, &tx.rst);
+			if (tx.ndone < tx.npts)		/* Saved prefixes are whole chunks */
+				tx.ndone -= tx.ndone % B2A_THR_CHUNK;
+			for (i = 0; i < tx.ndone/B2A_THR_CHUNK; i++)
+				tx.cdone[i] = 1;
+			tx.next = tx.ndone;
+			if (cx->verb) {
+				cx->count += tx.ndone;
+				printf("\nRestored %d of %d B2A points from checkpoint\n",tx.ndone,tx.npts);
+			}
+		} else {
+			tx.ndone = 0;
+			rand_copy(&tx.rst, NULL);
+		}
+		tx.lastsave = msec_time();
+	}
+
+	/* Create the per thread contexts */
+	if ((tx.tcx = (out_b2a_callback *)calloc(nthreads, sizeof(out_b2a_callback))) == NULL
+	 || (tx_x = (icxLuLut **)calloc(nthreads, sizeof(icxLuLut *))) == NULL)
+		error("Malloc of B2A thread contexts failed");
+	for (i = 0; i < nthreads; i++) {
+		tx.tcx[i] = *cx;
+		tx.tcx[i].verb = 0;		/* Progress is done by out_b2a_clut_thread() */
+		if ((tx_x[i] = cx->x->inv_thread_ctx(cx->x, nthreads)) == NULL)
+			error("Creating B2A thread context failed: %d, %s",cx->x->pp->errc,cx->x->pp->err);
+		tx.tcx[i].x = tx_x[i];
+	}
+	amutex_init(tx.lock);
+
+	par_exec(nthreads, out_b2a_clut_thread, (void *)&tx);
+
+	amutex_del(tx.lock);
+	for (i = 0; i < nthreads; i++)
+		tx_x[i]->del((icxLuBase *)tx_x[i]);
+	free(tx_x);
+	free(tx.tcx);
+
+	if (ckname != NULL) {
+		if (ckpt_save_pts(ckname, 3, tx.olen, tx.npts, tx.in, tx.npts, tx.out,
+		                  &tx.rst, sizeof(rand_state)) != 0)
+			warning("Saving B2A checkpoint '%s' failed",ckname);
+		free(tx.cdone);
+	}
+
+	/* Set the tables from the results */
+	tx.ix = 0;
+	rv = icmSetMultiLutTables(cx->ntables, wo, flags, &tx, cx->pcsspace, devspace,
+	                          out_b2a_input_thr, NULL, NULL, out_b2a_clut_play, NULL, NULL,
+	                          out_b2a_output_thr, NULL, NULL);
+
+	free(tx.in);
+	free(tx.out);
+	return rv;
+}
+
+/* --------------------------------------------------------- */
+
+/* Lab PCS point, its normalised radial value and the gamut surface */
+/* point in its direction -> gamut table value */
+static double bdist_value(double nrad, double np[3], double pcs[3]) {
+	double gdist;				/* Out of gamut distance */
+
+	/* Radial rather than nearest distance seems the best overall. */
+
+	gdist = icmNorm33(np, pcs);
+	if (nrad <= 1.0)
+		gdist = -gdist;		/* -ve delta E if within gamut */
+	
+//printf("~1 gdist %f\n",gdist);
+
+	/* Distance in PCS space will be roughly -128 -> 128 */
+	/* Clip to range -20 - +20, then scale to 0.0 - 1.0 */
+	if (gdist < -20.0)
+		gdist = -20.0;
+	else if (gdist > 20.0)
+		gdist = 20.0;
+
+	return (gdist + 20.0)/40.0;
+}
 
 /* PCS' -> distance to gamut boundary */
 static void PCSp_bdist(void *cntx, double out[1], double in[3]) {
@@ -549,7 +822,6 @@ static void PCSp_bdist(void *cntx, double out[1], double in[3]) {
 	double pcs[3];				/* PCS value of input */
 	double nrad;				/* normalised radial value of point */
 	double np[3];				/* Nearest point */
-	double gdist;				/* Out of gamut distance */
 	
 //printf("~1 bdist got PCS %f %f %f\n",in[0],in[1],in[2]);
 	/* Do PCS' -> PCS */
@@ -567,22 +839,7 @@ static void PCSp_bdist(void *cntx, double out[1], double in[3]) {
 
 //printf("~1 nrad = %f\n",nrad);
 
-	/* Radial rather than nearest distance seems the best overall. */
-
-	gdist = icmNorm33(np, pcs);
-	if (nrad <= 1.0)
-		gdist = -gdist;		/* -ve delta E if within gamut */
-	
-//printf("~1 gdist %f\n",gdist);
-
-	/* Distance in PCS space will be roughly -128 -> 128 */
-	/* Clip to range -20 - +20, then scale to 0.0 - 1.0 */
-	if (gdist < -20.0)
-		gdist = -20.0;
-	else if (gdist > 20.0)
-		gdist = 20.0;
-
-	out[0] = (gdist + 20.0)/40.0;
+	out[0] = bdist_value(nrad, np, pcs);
 //printf("~1 bdist returning %f\n",out[0]);
 
 	if (p->verb) {		/* Output percent intervals */
@@ -611,6 +868,130 @@ static void gamut_output(void *cntx, double out[1], double in[1]) {
 	out[0] = ov;
 }
 
+/* Threaded gamut table creation, in the same way as the B2A tables. */
+/* The clut points are recorded, their gamut surface points found */
+/* in parallel using the gamut radial_n(), and then played back. */
+
+typedef struct {
+	out_b2a_callback *cx;	/* Callback context */
+	int npts, apts;			/* Number of points recorded, allocated */
+	double *in;				/* npts PCS' values */
+	double *out;			/* npts boundary distance values */
+	int ix;					/* Next point to play back */
+} out_gam_thr;
+
+/* Input table callback for recording and playback */
+static void out_gam_input_thr(void *cntx, double out[3], double in[3]) {
+	out_b2a_input((void *)((out_gam_thr *)cntx)->cx, out, in);
+}
+
+/* Record clut callback */
+static void out_gam_clut_rec(void *cntx, double out[1], double in[3]) {
+	out_gam_thr *p = (out_gam_thr *)cntx;
+
+	if (p->npts >= p->apts) {
+		p->apts = p->apts * 2 + 1024;
+		if ((p->in = (double *)realloc(p->in, p->apts * 3 * sizeof(double))) == NULL)
+			error("Malloc of gamut point list failed");
+	}
+	p->in[p->npts * 3 + 0] = in[0];
+	p->in[p->npts * 3 + 1] = in[1];
+	p->in[p->npts * 3 + 2] = in[2];
+	p->npts++;
+	out[0] = 0.0;
+}
+
+/* Playback clut callback */
+static void out_gam_clut_play(void *cntx, double out[1], double in[3]) {
+	out_gam_thr *p = (out_gam_thr *)cntx;
+
+	if (p->ix >= p->npts
+	 || in[0] != p->in[p->ix * 3 + 0]
+	 || in[1] != p->in[p->ix * 3 + 1]
+	 || in[2] != p->in[p->ix * 3 + 2])
+		error("Internal, gamut playback doesn't match the recording");
+	out[0] = p->out[p->ix++];
+}
+
+/* Set the gamut table using nthreads to locate the gamut */
+/* surface, 0 for the default number. Return as set_tables(). */
+static int out_gam_set_tables(
+	int nthreads,
+	out_b2a_callback *cx,
+	icmLut *wo
+) {
+	out_gam_thr tx;
+	double *pcs, *np, *rad, cent[3];
+	int i, j, rv;
+
+	if (nthreads <= 0)
+		nthreads = num_threads();
+
+	if (nthreads == 1) {
+		return wo->set_tables(wo, ICM_CLUT_SET_EXACT, cx, cx->pcsspace, icSigGrayData,
+		                      out_b2a_input, NULL, NULL, PCSp_bdist, NULL, NULL,
+		                      gamut_output, NULL, NULL);
+	}
+
+	memset((void *)&tx, 0, sizeof(out_gam_thr));
+	tx.cx = cx;
+
+	/* Find out what points are needed */
+	if ((rv = wo->set_tables(wo, ICM_CLUT_SET_EXACT, &tx, cx->pcsspace, icSigGrayData,
+	                      out_gam_input_thr, NULL, NULL, out_gam_clut_rec, NULL, NULL,
+	                      gamut_output, NULL, NULL)) != 0) {
+		free(tx.in);
+		return rv;
+	}
+
+	if ((pcs = (double *)malloc(tx.npts * 3 * sizeof(double))) == NULL
+	 || (np = (double *)malloc(tx.npts * 3 * sizeof(double))) == NULL
+	 || (rad = (double *)malloc(tx.npts * sizeof(double))) == NULL
+	 || (tx.out = (double *)malloc(tx.npts * sizeof(double))) == NULL)
+		error("Malloc of gamut point values failed");
+
+	/* Do PCS' -> Lab PCS */
+	for (i = 0; i < tx.npts; i++) {
+		if (cx->x->inv_output(cx->x, pcs + 3 * i, tx.in + 3 * i) > 1)
+			error("%d, %s",cx->x->pp->errc,cx->x->pp->err);
+		if (cx->wantLab == 0)
+			icmXYZ2Lab(&icmD50, pcs + 3 * i, pcs + 3 * i);
+	}
+
+	/* Locate the surface points */
+	cx->gam->radial_n(cx->gam, rad, np, pcs, tx.npts, nthreads);
+
+	/* Compute the distances the same way as nradial() */
+	cx->gam->getcent(cx->gam, cent);
+	for (i = 0; i < tx.npts; i++) {
+		double ss;
+
+		for (ss = 0.0, j = 0; j < 3; j++) {
+			double tt = pcs[3 * i + j] - cent[j];
+			ss += tt * tt;
+		}
+		ss = sqrt(ss);
+		tx.out[i] = bdist_value(ss/rad[i], np + 3 * i, pcs + 3 * i);
+	}
+	free(rad);
+	free(np);
+	free(pcs);
+
+	if (cx->verb) {
+		printf("%c100%%",cr_char); fflush(stdout);
+	}
+
+	/* Set the table from the results */
+	tx.ix = 0;
+	rv = wo->set_tables(wo, ICM_CLUT_SET_EXACT, &tx, cx->pcsspace, icSigGrayData,
+	                    out_gam_input_thr, NULL, NULL, out_gam_clut_play, NULL, NULL,
+	                    gamut_output, NULL, NULL);
+
+	free(tx.in);
+	free(tx.out);
+	return rv;
+}
+
 /* -------------------------------------------------------------- */
 /* powell() callback to set XYZ white scaling factor for */
 /* Absolute Appearance mode with scaling intent */
@@ -654,6 +1035,122 @@ static double xyzoptfunc(void *cntx, double *v) {
 	return rv;
 }
 
+/* -------------------------------------------------------------- */
+/* A2B checkpoint. This holds the A2B table and the white, black */
+/* and luminance tags that xicc set_luobj() sets from the fit, */
+/* as well as the random state that the fit leaves behind. */
+
+static icTagSignature a2b_ckpt_xyz[3] = {
+	icSigMediaWhitePointTag, icSigMediaBlackPointTag, icSigLuminanceTag
+};
+
+/* Save (save nz) or restore the A2B checkpoint file ckname. */
+/* Return nz if a restore or save fails. */
+static int out_a2b_ckpt(icc *icco, icTagSignature a2bsig, char *ckname, int save) {
+	icmLut *lut;
+	icmXYZArray *xyz[3];
+	double *buf, *bp;
+	rand_state rst;
+	int i, n, rv = 0;
+
+	if ((lut = (icmLut *)icco->read_tag(icco, a2bsig)) == NULL
+	 || lut->inputTable == NULL || lut->clutTable == NULL || lut->outputTable == NULL)
+		return 1;
+
+	n = lut->inputTable_size + lut->clutTable_size + lut->outputTable_size + 9;
+	for (i = 0; i < 3; i++) {
+		if ((xyz[i] = (icmXYZArray *)icco->read_tag(icco, a2b_ckpt_xyz[i])) != NULL
+		 && xyz[i]->ttype == icSigXYZArrayType && xyz[i]->size == 1)
+			n += 3;
+		else
+			xyz[i] = NULL;
+	}
+	if ((buf = (double *)malloc(n * sizeof(double))) == NULL)
+		error("Malloc of A2B checkpoint buffer failed");
+
+	if (save) {
+		bp = buf;
+		memcpy((void *)bp, (void *)lut->inputTable, lut->inputTable_size * sizeof(double));
+		bp += lut->inputTable_size;
+		memcpy((void *)bp, (void *)lut->clutTable, lut->clutTable_size * sizeof(double));
+		bp += lut->clutTable_size;
+		memcpy((void *)bp, (void *)lut->outputTable, lut->outputTable_size * sizeof(double));
+		bp += lut->outputTable_size;
+		memcpy((void *)bp, (void *)lut->e, 9 * sizeof(double));
+		bp += 9;
+		for (i = 0; i < 3; i++) {
+			if (xyz[i] != NULL) {
+				icmXYZ2Ary(bp, xyz[i]->data[0]);
+				bp += 3;
+			}
+		}
+		rand_copy(&rst, NULL);
+		rv = ckpt_save_pts(ckname, 0, n, 1, NULL, 1, buf, &rst, sizeof(rand_state));
+
+	} else if ((rv = (ckpt_load_pts(ckname, 0, n, 1, NULL, buf,
+	                                &rst, sizeof(rand_state)) != 1)) == 0) {
+		rand_copy(NULL, &rst);
+		bp = buf;
+		memcpy((void *)lut->inputTable, (void *)bp, lut->inputTable_size * sizeof(double));
+		bp += lut->inputTable_size;
+		memcpy((void *)lut->clutTable, (void *)bp, lut->clutTable_size * sizeof(double));
+		bp += lut->clutTable_size;
+		memcpy((void *)lut->outputTable, (void *)bp, lut->outputTable_size * sizeof(double));
+		bp += lut->outputTable_size;
+		memcpy((void *)lut->e, (void *)bp, 9 * sizeof(double));
+		bp += 9;
+		for (i = 0; i < 3; i++) {
+			if (xyz[i] != NULL) {
+				icmAry2XYZ(xyz[i]->data[0], bp);
+				bp += 3;
+			}
+		}
+	}
+	free(buf);
+
+	return rv;
+}
+
+/* Return an allocated A2B cache file name in the directory dir. The name */
+/* is made from an MD5 of the .ti3 file contents and of everything that */
+/* set_luobj() fits the A2B table from, so that profiles made from the */
+/* same data with different B2A options can share the fitted A2B. */
+/* Return NULL on error. */
+static char *out_a2b_cache_name(
+	char *dir,				/* Cache directory */
+	char *in_name,			/* .ti3 file name */
+	int npat, cow *tpat,	/* Fitted points */
+	int devchan,			/* Device chanels */
+	int *ivals, int nivals,	/* Integer fit parameters */
+	double *dvals, int ndvals	/* Real fit parameters */
+) {
+	char key[33];
+	icmMD5 *md5;
+	ORD8 chsum[16];
+	int i;
+
+	if (ckpt_key(key, 1, NULL, NULL, NULL, in_name, NULL) != 0
+	 || (md5 = new_icmMD5()) == NULL)
+		return NULL;
+
+	md5->add(md5, (ORD8 *)"A2B", 4);
+	md5->add(md5, (ORD8 *)key, 32);
+	md5->add(md5, (ORD8 *)ivals, nivals * sizeof(int));
+	md5->add(md5, (ORD8 *)dvals, ndvals * sizeof(double));
+	for (i = 0; i < npat; i++) {
+		md5->add(md5, (ORD8 *)tpat[i].p, devchan * sizeof(double));
+		md5->add(md5, (ORD8 *)tpat[i].v, 3 * sizeof(double));
+		md5->add(md5, (ORD8 *)&tpat[i].w, sizeof(double));
+	}
+	md5->get(md5, chsum);
+	md5->del(md5);
+
+	for (i = 0; i < 16; i++)
+		sprintf(key + 2 * i, "%02x", chsum[i]);
+
+	return ckpt_name(dir, key, "a2bfit");
+}
+
 /* -------------------------------------------------------------- */
 /* Make an output device profile, where a forward mapping is from */
 /* RGB/CMYK to XYZ/Lab space */
@@ -666,6 +1163,10 @@ make_output_icc(
 	int verb,				/* Vebosity level, 0 = none */
 	int iquality,			/* A2B table quality, 0..3 */
 	int oquality,			/* B2A table quality, 0..3 */
+	int nthreads,			/* Threads to use to create the B2A tables, 0 for default */
+	char *gmcache,			/* Gamut map cache directory, NULL if none */
+	char *ckdir,			/* Checkpoint directory, NULL if none */
+	char *ckkey,			/* Checkpoint key from ckpt_key() */
 	int noisluts,			/* nz to supress creation of input (Device) shaper luts */
 	int noipluts,			/* nz to supress creation of input (Device) position luts */
 	int nooluts,			/* nz to supress creation of output (PCS) shaper luts */
@@ -735,11 +1236,19 @@ make_output_icc(
 	int b2aoutres = 0;		/* B2A output (device) table resolution */
 	xcal *cal = NULL;		/* Calibration if present, NULL if none */
 	icxInk iink;			/* Source profile ink limit values */
+	char *a2bckpt = NULL;	/* A2B checkpoint file name, NULL if none */
+	char *b2ackpt = NULL;	/* B2A checkpoint file name, NULL if none */
 
 	memset((void *)&iink, 0, sizeof(icxInk));
 	iink.tlimit = -1.0;		/* default to unknown */
 	iink.klimit = -1.0;
 
+	if (ckdir != NULL) {
+		if ((a2bckpt = ckpt_name(ckdir, ckkey, "a2b")) == NULL
+		 || (b2ackpt = ckpt_name(ckdir, ckkey, "b2a")) == NULL)
+			error("Malloc of checkpoint file names failed");
+	}
+
 	if (ptype == prof_clutLab) {		/* Lab lut */
 		wantLab = 1;
 		isLut = 1;
@@ -1044,7 +1553,7 @@ make_output_icc(
 	if ((wr_fp = new_icmFileStd_name(file_name,"w")) == NULL)
 		error("Write: Can't open file '%s'",file_name);
 
-	if ((wr_icco = new_icc()) == NULL)
+	if ((wr_icco = new_icc_a1ma()) == NULL)
 		error("Write: Creation of ICC object failed");
 
 	/* Add all the tags required */
@@ -1751,6 +2260,7 @@ make_output_icc(
 			char buf[100];
 			int  spi[XSPECT_MAX_BANDS];	/* CGATS indexes for each wavelength */
 			xsp2cie *sp2cie;	/* Spectral conversion object */
+			double *spv, *spo;	/* Spectral values and converted values */
 
 			if ((ii = icg->find_kword(icg, 0, "SPECTRAL_BANDS")) < 0)
 				error ("Input file doesn't contain keyword SPECTRAL_BANDS");
@@ -1807,6 +2317,10 @@ make_output_icc(
 			                          wantLab ? icSigLabData : icSigXYZData, icxClamp)) == NULL)
 				error("Creation of spectral conversion object failed");
 
+			if ((spv = (double *)malloc(sizeof(double) * npat * sp.spec_n)) == NULL
+			 || (spo = (double *)malloc(sizeof(double) * npat * 3)) == NULL)
+				error("Malloc failed - spectral values");
+
 			/* If Fluorescent Whitening Agent compensation is enabled */
 			if (!isdisp && fwacomp) {
 				double nw = 0.0;		/* Number of media white patches */
@@ -1929,12 +2443,18 @@ make_output_icc(
 
 				/* Read the spectral values for this patch */
 				for (j = 0; j < sp.spec_n; j++) {
-					sp.spec[j] = *((double *)icg->t[0].fdata[i][spi[j]]);
+					spv[i * sp.spec_n + j] = *((double *)icg->t[0].fdata[i][spi[j]]);
 				}
+			}
 
-				/* Convert it to CIE space */
-				sp2cie->convert(sp2cie, tpat[i].v, &sp);
+			/* Convert them all to CIE space */
+			sp2cie->convert_n(sp2cie, spo, &sp, spv, npat);
+			for (i = 0; i < npat; i++) {
+				for (j = 0; j < 3; j++)
+					tpat[i].v[j] = spo[i * 3 + j];
 			}
+			free(spv);
+			free(spo);
 
 			sp2cie->del(sp2cie);		/* Done with this */
 		}
@@ -2072,6 +2592,8 @@ make_output_icc(
 		/* Create A2B clut */
 		{
 			int flags = 0;
+			char *a2bcache = NULL;	/* A2B cache file name, NULL if none */
+			char *rfrom = NULL;		/* File the A2B was restored from */
 
 			/* Wrap with an expanded icc */
 			if ((wr_xicc = new_xicc(wr_icco)) == NULL)
@@ -2097,24 +2619,76 @@ make_output_icc(
 
 			flags |= ICX_SET_WHITE | ICX_SET_BLACK; 		/* Compute & use white & black */
 
-			/* Setup Device -> PCS conversion (Fwd) object from scattered data. */
-			if ((AtoB = wr_xicc->set_luobj(
-			               wr_xicc, icmFwd, !allintents ? icmDefaultIntent : icRelativeColorimetric,
-			               icmLuOrdNorm,
+			/* The B2A options don't affect the A2B fit, so it can be */
+			/* shared through the cache by runs that differ only in those. */
+			if (gmcache != NULL) {
+				int ivals[9];
+				double dvals[7];
+
+				ivals[0] = flags & ~ICX_VERBOSE;
+				ivals[1] = allintents;
+				ivals[2] = iquality;
+				ivals[3] = (int)devspace;
+				ivals[4] = wantLab;
+				ivals[5] = a2binres;
+				ivals[6] = a2bres;
+				ivals[7] = a2boutres;
+				ivals[8] = (int)iccver;
+				dvals[0] = dispLuminance;
+				dvals[1] = wpscale;
+				dvals[2] = smooth;
+				dvals[3] = avgdev;
+				dvals[4] = demph;
+				dvals[5] = oink != NULL ? oink->tlimit : -1.0;	/* Used for the black point */
+				dvals[6] = oink != NULL ? oink->klimit : -1.0;
+
+				if ((a2bcache = out_a2b_cache_name(gmcache, in_name, npat, tpat, devchan,
+				                                   ivals, 9, dvals, 7)) == NULL)
+					warning("Computing A2B cache file name failed");
+			}
+
+			/* Setup Device -> PCS conversion (Fwd) object from scattered data, */
+			/* or restore the result of a previous run from its checkpoint, */
+			/* or of a run with the same A2B fit from the cache. */
+			a1tm_start("A2B fit");
+			if ((a2bckpt != NULL && out_a2b_ckpt(wr_icco, !allintents ? icSigAToB0Tag
+			                                 : icSigAToB1Tag, a2bckpt, 0) == 0 && (rfrom = a2bckpt))
+			 || (a2bcache != NULL && out_a2b_ckpt(wr_icco, !allintents ? icSigAToB0Tag
+			                                 : icSigAToB1Tag, a2bcache, 0) == 0 && (rfrom = a2bcache))) {
+				if (cal != NULL) {			/* As set_luobj() would */
+					wr_xicc->cal = cal;
+					wr_xicc->nodel_cal = 1;
+				}
+				if (verb)
+					printf("Restored A2B table from '%s'\n",rfrom);
+			} else {
+				if ((AtoB = wr_xicc->set_luobj(
+				               wr_xicc, icmFwd, !allintents ? icmDefaultIntent : icRelativeColorimetric,
+				               icmLuOrdNorm,
 #ifdef USE_EXTRA_FITTING
-			               ICX_EXTRA_FIT |
+				               ICX_EXTRA_FIT |
 #endif
 #ifdef USE_2PASSSMTH
-			               ICX_2PASSSMTH |
+				               ICX_2PASSSMTH |
 #endif
-			               flags,
-			               npat, npat, tpat, NULL, dispLuminance, wpscale,
-//				           bpo,
-				           smooth, avgdev, demph, 
-			               NULL, oink, cal, iquality)) == NULL)
-				error("%d, %s",wr_xicc->errc, wr_xicc->err);
-
-			AtoB->del(AtoB);		/* Done with lookup */
+				               flags,
+				               npat, npat, tpat, NULL, dispLuminance, wpscale,
+//					           bpo,
+					           smooth, avgdev, demph, 
+				               NULL, oink, cal, iquality)) == NULL)
+					error("%d, %s",wr_xicc->errc, wr_xicc->err);
+
+				AtoB->del(AtoB);		/* Done with lookup */
+
+				if (a2bckpt != NULL && out_a2b_ckpt(wr_icco, !allintents ? icSigAToB0Tag
+				                                 : icSigAToB1Tag, a2bckpt, 1) != 0)
+					warning("Saving A2B checkpoint '%s' failed",a2bckpt);
+				if (a2bcache != NULL && out_a2b_ckpt(wr_icco, !allintents ? icSigAToB0Tag
+				                                 : icSigAToB1Tag, a2bcache, 1) != 0)
+					warning("Saving A2B cache file '%s' failed",a2bcache);
+			}
+			free(a2bcache);
+			a1tm_end();
 		}
 
 		/* Create B2A clut */
@@ -2132,6 +2706,7 @@ make_output_icc(
 
 			if (verb)
 				printf("Setting up B to A table lookup\n");
+			a1tm_start("B2A setup");
 
 #ifdef FILTER_B2ACLIP
 			cx.filter = 1;
@@ -2154,6 +2729,10 @@ make_output_icc(
 				/* Wrap with an expanded icc */
 				if ((src_xicc = new_xicc(src_icco)) == NULL)
 					error ("Creation of src_xicc failed");
+
+				/* Keep its gamut surfaces with the gamut maps */
+				if (gmcache != NULL && src_xicc->set_cache(src_xicc, gmcache) != 0)
+					error ("%d, %s",src_xicc->errc, src_xicc->err);
 			}
 
 			/* Figure out the final src & dst viewing conditions */
@@ -2267,6 +2846,10 @@ make_output_icc(
 				warning("!!!! USE_CAM_CLIP_OPT in profout.c is off !!!!");
 #endif
 
+#ifdef USE_REV_HINT
+				flags |= ICX_REV_HINT;			/* B2A grid points are inverted in neighbour order */
+#endif
+
 				if ((AtoB = wr_xicc->get_luobj(wr_xicc, flags, icmFwd,
 				                  !allintents ? icmDefaultIntent : icRelativeColorimetric,
 				                  wantLab ? icSigLabData : icSigXYZData,
@@ -2603,7 +3186,7 @@ make_output_icc(
 					/* values outside the grid range. */
 
 					/* setup perceptual gamut mapping */
-					cx.pmap = new_gammap(verb, csgamp, igam, ogam, pgmi,
+					cx.pmap = new_gammap_cache(gmcache, verb, csgamp, igam, ogam, pgmi,
 					                     ihgam, 0, 0, 0, 0, mapres,
 					                     NULL, NULL, gamdiag ? "gammap_p.wrl" : NULL
 					);
@@ -2632,7 +3215,7 @@ make_output_icc(
 						}
 
 						/* setup saturation gamut mapping */
-						cx.smap = new_gammap(verb, csgams, igam, ogam, sgmi,
+						cx.smap = new_gammap_cache(gmcache, verb, csgams, igam, ogam, sgmi,
 						                     ihgam, 0, 0, 0, 0, mapres,
 						                     NULL, NULL, gamdiag ? "gammap_s.wrl" : NULL
 						);
@@ -2874,6 +3457,7 @@ make_output_icc(
 			}
 #endif /* NEVER (Setup optimised B2A per channel curves) */
 // ====================================================================
+			a1tm_end();
 
 			/* We now setup an exact inverse, colorimetric style, plus gamut mapping */
 			/* for perceptual and saturation intents */
@@ -2917,8 +3501,13 @@ make_output_icc(
 			}
 #else /* !DEBUG_ONE */
 
-			if (icmSetMultiLutTables(
-			        cx.ntables,
+			/* (Uses icmSetMultiLutTables() with out_b2a_input(), out_b2a_clut() */
+			/*  and out_b2a_output(), and the default ranges.) */
+			a1tm_start("B2A tables");
+			if (out_b2a_set_tables(
+			        nthreads,
+			        b2ackpt,
+			        &cx,					/* Context */
 			        wo,
 #ifdef USE_LEASTSQUARES_APROX
 					ICM_CLUT_SET_APXLS | 
@@ -2927,17 +3516,10 @@ make_output_icc(
 					ICM_CLUT_SET_FILTER | 
 #endif
 					0,
-					&cx,					/* Context */
-					cx.pcsspace,			/* Input color space */
-					devspace, 				/* Output color space */
-					out_b2a_input,			/* Input transform PCS->PCS' */
-					NULL, NULL,				/* Use default PCS range */
-					out_b2a_clut,			/* Lab' -> Device' transfer function */
-					NULL, NULL,				/* Use default Device' range */
-					out_b2a_output,			/* Output transfer function, Device'->Device */
-					NULL, NULL				/* Use default APXLS range */
+					devspace 				/* Output color space */
 				) != 0)
 				error("Setting 16 bit PCS->Device Lut failed: %d, %s",wr_icco->errc,wr_icco->err);
+			a1tm_end();
 			if (cx.verb) {
 				printf("\n");
 			}
@@ -3024,6 +3606,7 @@ make_output_icc(
 
 			if (verb)
 				printf("Creating gamut boundary table\n");
+			a1tm_start("gamut table");
 
 			/* Need to switch AtoB to be override Lab PCS */
 			/* Do this the dirty way, by delving into xicclu and icclu. Alternatively */
@@ -3048,10 +3631,15 @@ make_output_icc(
 	  	 		gres = 15.0;
 			}
 
-			/* Creat a gamut surface */
+			/* Creat a gamut surface. */
+			/* (This isn't a full resampling of the profile - get_gamut() */
+			/*  scans the A2B clut nodes already computed by set_luobj(), */
+			/*  and only adds a few thousand device face points in parallel, */
+			/*  so it costs a small fraction of a second. Collecting the */
+			/*  surface nodes during the A2B fit wouldn't save anything.) */
 			if ((cx.gam = AtoB->get_gamut(AtoB, gres)) == NULL)
 				error("Get_gamut failed: %d, %s",AtoB->pp->errc,AtoB->pp->err);
-			
+
 			if ((wo = (icmLut *)wr_icco->read_tag(
 			           wr_icco, icSigGamutTag)) == NULL) 
 				error("read_tag failed: %d, %s",wr_icco->errc,wr_icco->err);
@@ -3065,18 +3653,9 @@ make_output_icc(
 				printf(" 0%%"); fflush(stdout);
 			}
 #ifndef DEBUG_ONE	/* Skip this when debugging */
-			if (wo->set_tables(wo,
-					ICM_CLUT_SET_EXACT,
-					&cx,				/* Context */
-					cx.pcsspace,		/* Input color space */
-					icSigGrayData,		/* Output color space */
-					out_b2a_input,		/* Input transform PCS->PCS' */
-					NULL, NULL,			/* Use default Lab' range */
-					PCSp_bdist,			/* Lab' -> Boundary distance */
-					NULL, NULL,			/* Use default Device' range */
-					gamut_output,		/* Boundary distance to out of gamut value */
-					NULL, NULL	
-				) != 0)
+			/* (Uses set_tables() with out_b2a_input(), PCSp_bdist() */
+			/*  and gamut_output(), and the default ranges.) */
+			if (out_gam_set_tables(nthreads, &cx, wo) != 0)
 				error("Setting 16 bit PCS->Device Gamut Lut failed: %d, %s",wr_icco->errc,wr_icco->err);
 #endif /* !DEBUG_ONE */
 			if (cx.verb) {
@@ -3089,6 +3668,7 @@ make_output_icc(
 
 			cx.gam->del(cx.gam);		/* Done with gamut object */
 			cx.gam = NULL;
+			a1tm_end();
 
 			if (verb)
 				printf("Done gamut boundary table\n");
@@ -3127,6 +3707,7 @@ make_output_icc(
 			flags |= ICX_WRITE_WBL;
 
 		/* Setup Device -> XYZ conversion (Fwd) object from scattered data. */
+		a1tm_start("matrix fit");
 		if ((xluo = wr_xicc->set_luobj(
 		               wr_xicc, icmFwd, isdisp ? icmDefaultIntent : icRelativeColorimetric,
 		               icmLuOrdRev,
@@ -3136,6 +3717,7 @@ make_output_icc(
 			           smooth, avgdev, demph,
 		               NULL, oink, cal, iquality)) == NULL)
 			error("%d, %s",wr_xicc->errc, wr_xicc->err);
+		a1tm_end();
 
 		/* Free up xicc stuff */
 		xluo->del(xluo);
@@ -3178,9 +3760,21 @@ make_output_icc(
 		cal->del(cal);
 
 	/* Write the file (including all tags) out */
+	a1tm_start("write profile");
 	if ((rv = wr_icco->write(wr_icco,wr_fp,0)) != 0) {
 		error("Write file: %d, %s",rv,wr_icco->err);
 	}
+	a1tm_end();
+
+	/* The checkpoints aren't needed once the profile has been written */
+	if (a2bckpt != NULL) {
+		remove(a2bckpt);
+		free(a2bckpt);
+	}
+	if (b2ackpt != NULL) {
+		remove(b2ackpt);
+		free(b2ackpt);
+	}
 
 	/* Close the file */
 	wr_icco->del(wr_icco);
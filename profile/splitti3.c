@@ -62,6 +62,21 @@ usage(void) {
 	exit(1);
 }
 
+/* An output file to be written */
+typedef struct {
+	cgats *cg;
+	char *name;
+	int rv;			/* nz if the write failed */
+} ofile;
+
+/* Write output file ix */
+static int write_ofile(void *cntx, int ix, int nth) {
+	ofile *of = (ofile *)cntx + ix;
+
+	of->rv = of->cg->write_name(of->cg, of->name);
+	return 0;
+}
+
 int main(int argc, char *argv[]) {
 	int fa,nfa;				/* current argument we're looking at */
 	int verb = 0;
@@ -81,6 +96,7 @@ int main(int argc, char *argv[]) {
 
 	cgats_set_elem *setel;		/* Array of set value elements */
 	int *flags;					/* Point to destination of set */
+	ofile ofs[2];				/* The two output files */
 
 	int i, j, n;
 
@@ -186,7 +202,7 @@ int main(int argc, char *argv[]) {
 		cg2->add_table(cg2, tt_other, 0);
 	} else {
 		cg1->add_table(cg1, cgf->t[0].tt, 0);
-		cg2->add_table(cg1, cgf->t[0].tt, 0);
+		cg2->add_table(cg2, cgf->t[0].tt, 0);
 	}
 
 	/* Duplicate all the keywords */
@@ -381,13 +397,21 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	/* Write out the files */
-	if (cg1->write_name(cg1, out_name1))
-		error("CGATS file '%s' write error : %s",out_name1,cg1->err);
-	if (cg2->write_name(cg2, out_name2))
-		error("CGATS file '%s' write error : %s",out_name2,cg2->err);
-	
+	/* Write out the files in parallel */
+	ofs[0].cg = cg1;
+	ofs[0].name = out_name1;
+	ofs[1].cg = cg2;
+	ofs[1].name = out_name2;
+	par_exec(2, write_ofile, (void *)ofs);
+
+	for (i = 0; i < 2; i++) {
+		if (ofs[i].rv != 0)
+			error("CGATS file '%s' write error : %s",ofs[i].name,ofs[i].cg->err);
+	}
 
+	cg2->del(cg2);
+	cg1->del(cg1);
+	cgf->del(cgf);
 	free(flags);
 	free(setel);
 	
@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include "copyright.h"
 #include "aconfig.h"
@@ -42,6 +43,7 @@
 #endif	/* TIFF */
 #ifdef RENDER_PNG
 # include "png.h"
+# include "zlib.h"
 #endif	/* PNG */
 #include "render.h"
 #include "thscreen.h"
@@ -133,6 +135,172 @@ static void mem_flush_data(png_structp png_ptr) {
 	return;
 }
 
+/* To allow the PNG compression to be done in parallel, collections */
+/* of rows are filtered and then deflated as independent blocks, */
+/* each block ending on a byte boundary using a sync flush, so that */
+/* they can be concatenated into a single zlib stream. The blocks */
+/* are written out as IDAT chunks directly, rather than through */
+/* png_write_rows(). */
+
+/* A block of filtered PNG rows to be deflated */
+typedef struct {
+	unsigned char *raw;		/* Filtered rows, each starting with the filter type */
+	size_t rlen;			/* Bytes of filtered rows */
+	unsigned char *cbuf;	/* Deflated data */
+	size_t clen;			/* Bytes of deflated data */
+	size_t csize;			/* Allocated size of cbuf */
+	uLong adler;			/* Adler32 of the filtered rows */
+	int first;				/* nz if first block of the image, so add zlib header */
+	int last;				/* nz if last block of the image, so finish the stream */
+	int err;				/* nz if deflate failed */
+} pngblk;
+
+/* Paeth predictor */
+static int png_paeth(int a, int b, int c) {
+	int p = a + b - c;
+	int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+	if (pa <= pb && pa <= pc)
+		return a;
+	if (pb <= pc)
+		return b;
+	return c;
+}
+
+/* Filter a row of PNG pixel data, choosing the filter type that */
+/* has the minimum sum of absolute (signed) differences, */
+/* and append it to the block. */
+static void png_filter_row(
+	pngblk *blk,
+	unsigned char *row,		/* Row to add, in PNG byte order */
+	unsigned char *prow,	/* Previous row, zero for the first row */
+	unsigned char *frow,	/* Scratch space for 4 filtered rows */
+	size_t rowbytes,		/* Bytes in a row */
+	int bpp					/* Bytes per pixel */
+) {
+	unsigned char *op = blk->raw + blk->rlen;
+	unsigned char *best = row;
+	unsigned long sum, bsum = 0;
+	size_t i;
+	int f, bf = 0;
+
+	for (i = 0; i < rowbytes; i++)			/* None */
+		bsum += row[i] < 128 ? row[i] : 256 - row[i];
+
+	for (f = 1; f <= 4; f++) {
+		unsigned char *fp = frow + (f-1) * rowbytes;
+
+		for (sum = 0, i = 0; i < rowbytes; i++) {
+			int a = i >= (size_t)bpp ? row[i - bpp] : 0;
+			int b = prow[i];
+			int c = i >= (size_t)bpp ? prow[i - bpp] : 0;
+			int v;
+
+			if (f == 1)				/* Sub */
+				v = row[i] - a;
+			else if (f == 2)		/* Up */
+				v = row[i] - b;
+			else if (f == 3)		/* Average */
+				v = row[i] - ((a + b) >> 1);
+			else					/* Paeth */
+				v = row[i] - png_paeth(a, b, c);
+			v &= 0xff;
+			fp[i] = (unsigned char)v;
+			sum += v < 128 ? v : 256 - v;
+		}
+		if (sum < bsum) {
+			bsum = sum;
+			bf = f;
+			best = fp;
+		}
+	}
+
+	*op++ = (unsigned char)bf;
+	memcpy(op, best, rowbytes);
+	blk->rlen += rowbytes + 1;
+}
+
+/* Deflate a block of filtered rows */
+static void png_deflate_blk(pngblk *blk) {
+	z_stream zs;
+	size_t off = 0;
+
+	blk->err = 0;
+	blk->clen = 0;
+	blk->adler = adler32(adler32(0L, Z_NULL, 0), blk->raw, (uInt)blk->rlen);
+
+	memset((void *)&zs, 0, sizeof(z_stream));
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_FILTERED) != Z_OK) {
+		blk->err = 1;
+		return;
+	}
+
+	/* Room for the data, the zlib header and sync marker, and the zlib trailer */
+	if (blk->csize < (deflateBound(&zs, (uLong)blk->rlen) + 16)) {
+		free(blk->cbuf);
+		blk->csize = deflateBound(&zs, (uLong)blk->rlen) + 16;
+		if ((blk->cbuf = malloc(blk->csize)) == NULL) {
+			blk->csize = 0;
+			blk->err = 1;
+			deflateEnd(&zs);
+			return;
+		}
+	}
+
+	if (blk->first) {			/* zlib header for deflate, 32K window, default level */
+		blk->cbuf[off++] = 0x78;
+		blk->cbuf[off++] = 0x9c;
+	}
+
+	zs.next_in = blk->raw;
+	zs.avail_in = (uInt)blk->rlen;
+	zs.next_out = blk->cbuf + off;
+	zs.avail_out = (uInt)(blk->csize - off - 4);	/* Leave room for the trailer */
+
+	if (blk->last) {
+		if (deflate(&zs, Z_FINISH) != Z_STREAM_END)
+			blk->err = 1;
+	} else {
+		if (deflate(&zs, Z_SYNC_FLUSH) != Z_OK || zs.avail_in != 0 || zs.avail_out == 0)
+			blk->err = 1;
+	}
+	blk->clen = zs.next_out - blk->cbuf;
+	deflateEnd(&zs);
+}
+
+/* Write a pass worth of deflated blocks as IDAT chunks. */
+/* The adler32 of the image data so far is accumulated in *adler, */
+/* and appended to the last block. Return nz on error. */
+static int png_write_blks(png_structp png_ptr, pngblk *blks, int nblks, uLong *adler) {
+	int i;
+
+	for (i = 0; i < nblks; i++) {
+		pngblk *blk = &blks[i];
+
+		if (blk->err) {
+			a1loge(g_log, 1, "render2d: deflate of PNG image data failed\n");
+			return 1;
+		}
+		*adler = adler32_combine(*adler, blk->adler, (z_off_t)blk->rlen);
+		if (blk->last) {
+			blk->cbuf[blk->clen++] = (unsigned char)(*adler >> 24);
+			blk->cbuf[blk->clen++] = (unsigned char)(*adler >> 16);
+			blk->cbuf[blk->clen++] = (unsigned char)(*adler >> 8);
+			blk->cbuf[blk->clen++] = (unsigned char)(*adler);
+		}
+		png_write_chunk(png_ptr, (png_const_bytep)"IDAT", blk->cbuf, blk->clen);
+	}
+	return 0;
+}
+
+/* Deflate one of the blocks in parallel */
+static int png_deflate_thread(void *cntx, int ix, int nth) {
+	pngblk *blks = (pngblk *)cntx;
+
+	png_deflate_blk(&blks[ix]);
+	return 0;
+}
+
 #endif	/* PNG */
 
 /* ------------------------------------------------------------- */
@@ -303,6 +471,396 @@ static int colordiff(render2d *s, color2d c1, color2d c2) {
 
 #define MIXPOW 2.0			// Blending power
 #define OSAMLS 16			// [16] Oversampling
+#define RBANDH 32			// Lines in each rendering band
+
+/* Per thread rendering band workspace */
+typedef struct {
+	prim2d **xlist;				/* X sorted start list */
+	prim2d **xact;				/* Active X list */
+	color2d *_pixv0, *_pixv1;	/* Storage for pixel values around current */
+	sobol *so;					/* Random sampler for anti-aliasing */
+	unsigned char *lbuf;		/* RBANDH lines of rendered output values */
+	unsigned char *bgf;			/* RBANDH lines of background only flags if dithfgo */
+	unsigned char *obuf;		/* RBANDH lines of screened output values if screen */
+	int foundfg[RBANDH];		/* Found a forground object in each line */
+} rband2d;
+
+/* Context for rendering bands in parallel */
+typedef struct {
+	render2d *s;
+	int nbands;					/* Number of bands in the page */
+	int *bstart;				/* nbands+1 start indexes of each bands primitives in bix */
+	prim2d **bix;				/* Primitives that overlap each band */
+	rband2d *bands;				/* Per thread band workspace */
+	thscreens *screen;			/* Threshold screen to apply to bands, NULL if none */
+	size_t lbsz;				/* Bytes per line in lbuf */
+	int yb;						/* First line of this pass */
+#ifdef RENDER_PNG
+	pngblk *zblks;				/* Previous pass PNG blocks to deflate, NULL if none */
+	int nzblks;					/* Number of blocks in zblks */
+#endif
+} rbandcx;
+
+/* Return the Y coordinate range sampled by band b */
+static void render2d_band_yrange(render2d *s, int b, double *rymin, double *rymax) {
+	int ys = b * RBANDH, ye = ys + RBANDH;
+
+	if (ye > s->ph)
+		ye = s->ph;
+	*rymax = (((s->ph-1) - (ys-1)) + 0.5) / s->vres;
+	*rymin = (((s->ph-1) - (ye-1)) - 0.5) / s->vres;
+}
+
+/* Return the inclusive range of bands that a primitive overlaps. */
+/* *b1 < *b0 if it overlaps none. */
+static void render2d_prim_bands(render2d *s, int nbands, prim2d *th, int *b0, int *b1) {
+	double rymin, rymax;
+
+	/* Estimate the range, and then refine it with the exact test */
+	*b0 = (int)floor((s->ph - 0.5 - th->y1 * s->vres)/RBANDH) - 1;
+	*b1 = (int)floor((s->ph + 0.5 - th->y0 * s->vres)/RBANDH) + 1;
+	if (*b0 < 0)
+		*b0 = 0;
+	if (*b1 >= nbands)
+		*b1 = nbands-1;
+	for (; *b0 <= *b1; (*b0)++) {
+		render2d_band_yrange(s, *b0, &rymin, &rymax);
+		if (rymin < th->y1 && rymax >= th->y0)
+			break;
+	}
+	for (; *b1 >= *b0; (*b1)--) {
+		render2d_band_yrange(s, *b1, &rymin, &rymax);
+		if (rymin < th->y1 && rymax >= th->y0)
+			break;
+	}
+}
+
+/* Dither or screen a line of 16 bit values into 8 bit output values */
+static void render2d_dither_line(
+	render2d *s,
+	thscreens *screen,			/* Screening object */
+	unsigned char *outbuf,		/* Output line */
+	unsigned char *dithbuf16,	/* 16 bit values to dither from */
+	unsigned char *bp,			/* Background only flags if dithfgo */
+	int foundfg,				/* NZ if there are forground objects in the line */
+	int y						/* Line number */
+) {
+	int x, j;
+
+	// If we need to screen this line
+	if (!s->dithfgo || foundfg) {
+		/* If we are dithering only the foreground colors, */
+		/* Subsitute the quantized un-dithered color for any */
+		/* pixels soley from the background */
+		if (s->dithfgo) {
+			int st, ed;
+			unsigned short *ip = ((unsigned short *)dithbuf16);
+			unsigned char *op = ((unsigned char *)outbuf);
+
+			/* Copy pixels up to first non-BG */
+			for (st = 0; st < s->pw; st++, ip += s->ncc, op += s->ncc) {
+				if (bp[st]) {
+					for (j = 0; j < s->ncc; j++)
+						op[j] = (ip[j] * 255 + 128)/65535;
+				} else {
+					break;
+				}
+			}
+			if (st < s->pw) {	/* If there are some FG pixels */
+
+				/* Copy down to first non-BG */
+				ip = ((unsigned short *)dithbuf16) + (s->pw-1) * s->ncc;
+				op = ((unsigned char *)outbuf) + (s->pw-1) * s->ncc;
+				for (ed = s->pw-1; ed >= st; ed--, ip -= s->ncc, op -= s->ncc) {
+					if (bp[ed]) {
+						for (j = 0; j < s->ncc; j++)
+							op[j] = (ip[j] * 255 + 128)/65535;
+					} else {
+						break;
+					}
+				}
+				/* Screen just the FG pixels */
+				ip = ((unsigned short *)dithbuf16) + st * s->ncc;
+				op = ((unsigned char *)outbuf) + st * s->ncc;
+				screen->screen(screen, ed-st+1, 1, st, y,
+			                       op, s->pw * s->ncc,
+			                       (unsigned char*)ip, s->pw * s->ncc);
+			}
+
+		/* Dither/screen the whole lot */
+		} else {
+			screen->screen(screen, s->pw, 1, 0, y,
+			                       (unsigned char *)outbuf, s->pw * s->ncc,
+			                       dithbuf16, s->pw * s->ncc);
+		}
+	// Don't need to screen this line - quantize from 16 bit
+	} else {
+		unsigned short *ip = ((unsigned short *)dithbuf16);
+		unsigned char *op = ((unsigned char *)outbuf);
+		for (x = 0; x < s->pw; x++, ip += s->ncc, op += s->ncc) {
+			for (j = 0; j < s->ncc; j++)
+				op[j] = (ip[j] * 255 + 128)/65535;
+		}
+	}
+}
+
+/* Render the RBANDH lines starting at yb + ix * RBANDH into band ix. */
+/* Each band first renders the line above it, so that anti-aliasing */
+/* can be done independently of the other bands. */
+static int render2d_band(void *cntx, int ix, int nth) {
+	rbandcx *cx = (rbandcx *)cntx;
+	render2d *s = cx->s;
+	rband2d *bd = &cx->bands[ix];
+	sobol *so = bd->so;
+	prim2d *th, **blist, **xlist = bd->xlist, **xact = bd->xact;
+	int nbl, noix, noxa, xli;
+	color2d *pixv0, *pixv1;
+	double rx0, rx1, ry0, ry1;	/* Box being processed, newest sample is rx1, ry1 */
+	int ys, ye;					/* Band start and end + 1 lines */
+	int x, y, i, j, k;
+
+#ifdef RENDER_PNG
+	/* Deflate a block of the previous pass while rendering this one */
+	if (cx->zblks != NULL && ix < cx->nzblks)
+		png_deflate_blk(&cx->zblks[ix]);
+#endif
+
+	ys = cx->yb + ix * RBANDH;
+	ye = ys + RBANDH;
+	if (ys >= s->ph)
+		return 0;
+	if (ye > s->ph)
+		ye = s->ph;
+
+	pixv0 = bd->_pixv0+1;
+	pixv1 = bd->_pixv1+1;
+
+	/* The primitives that overlap the band */
+	blist = cx->bix + cx->bstart[ys/RBANDH];
+	nbl = cx->bstart[ys/RBANDH + 1] - cx->bstart[ys/RBANDH];
+
+	/* Render each line in raster order. */
+	/* We sample +- half a pixel around the pixel we want. */
+	/* We make the active element list encompass this region, */
+	/* so that we can super sample it for anti-aliasing. */
+	for (y = ys-1; y < ye; y++) {
+		int foundfg = 0;
+
+		/* Convert to coordinate order */
+		ry0 = (((s->ph-1) - y) - 0.5) / s->vres;
+		ry1 = (((s->ph-1) - y) + 0.5) / s->vres;
+
+		/* Initialise the current X list from the objects within this range */
+		for (i = noix = 0; i < nbl; i++) {
+			th = blist[i];
+			if (ry0 < th->y1 && ry1 >= th->y0)
+				xlist[noix++] = th;
+		}
+		
+		/* Sort the X lists by x0 */
+#define HEAP_COMPARE(A,B) (A->x0 < B->x0)
+		HEAPSORT(prim2d *,xlist,noix)
+#undef HEAP_COMPARE
+		xli = 0;
+		noxa = 0;
+
+		for (x = -1; x < s->pw; x++) {
+			color2d rv;
+
+			rx0 = (x - 0.5) / s->hres;
+			rx1 = (x + 0.5) / s->hres;
+
+			/* Add any objects that are now within this range to our x list */
+			for(; xli < noix && rx1 > xlist[xli]->x0; xli++)
+				xact[noxa++] = xlist[xli];
+
+			/* Set the default current color */
+			for (j = 0; j < s->ncc; j++)
+				pixv1[x][j] = s->defc[j];
+			pixv1[x][PRIX2D] = -1;			/* Make sure all primitive ovewrite the default */
+
+			/* Allow callback to set per pixel background color (or not) */
+			if (s->bgfunc != NULL)
+				s->bgfunc(s->cntx, pixv1[x], x, y);
+
+			/* Overwrite it with any primitives, */
+			/* and remove any that are out of range now */
+			for (i = k = 0; i < noxa; i++) {
+				th = xact[i];
+				if (rx0 > th->x1)
+					continue;
+				xact[k++] = th;
+
+				if (th->rend(th, rv, rx1, ry0) && th->ix > pixv1[x][PRIX2D]) {
+					/* Overwrite the current color */
+					/* (This is where we should handle depth and opacity */
+					for (j = 0; j < s->ncc; j++)
+						pixv1[x][j] = rv[j];
+					pixv1[x][PRIX2D] = rv[PRIX2D];
+				}
+			}
+			noxa = k;
+
+			/* Check if anti-aliasing is needed for previous lines previous pixel */
+			if (y >= ys && x >= 0) {
+				color2d cc;
+				unsigned char *lp = bd->lbuf + (y - ys) * cx->lbsz;
+
+				for (j = 0; j < s->ncc; j++)
+					cc[j] = pixv1[x][j];
+				cc[PRIX2D] = pixv1[x][PRIX2D];
+
+				/* See if anti aliasing is needed */
+				if (!s->noavg
+				 && ((pixv0[x+0][PRIX2D] != cc[PRIX2D] && colordiff(s, pixv0[x+0], cc))
+				  || (pixv0[x-1][PRIX2D] != cc[PRIX2D] && colordiff(s, pixv0[x-1], cc))
+				  || (pixv1[x-1][PRIX2D] != cc[PRIX2D] && colordiff(s, pixv1[x-1], cc)))) {
+					double nn = 0;
+
+					so->reset(so);
+
+					for (j = 0; j < s->ncc; j++)
+						cc[j] = 0.0;
+					cc[PRIX2D] = -1;
+
+					/* Compute the sample value by re-sampling the region */
+					/* around the pixel. */
+					for (nn = 0; nn < OSAMLS; nn++) {
+						double pos[2];
+						double rx, ry;
+						color2d ccc;
+
+						so->next(so, pos);
+
+						rx = (rx1 - rx0) * pos[0] + rx0;
+						ry = (ry1 - ry0) * pos[1] + ry0;
+
+						/* Set the default current color */
+						for (j = 0; j < s->ncc; j++)
+							ccc[j] = s->defc[j];
+						ccc[PRIX2D] = -1;
+
+						for (i = 0; i < noxa; i++) {
+							th = xact[i];
+							if (th->rend(th, rv, rx, ry) && th->ix > ccc[PRIX2D]) {
+								/* Overwrite the current color */
+								/* (This is where we should handle depth and opacity */
+								for (j = 0; j < s->ncc; j++)
+									ccc[j] = rv[j];
+								ccc[PRIX2D] = rv[PRIX2D];
+							}
+						}
+						for (j = 0; j < s->ncc; j++)
+							cc[j] += pow(ccc[j], MIXPOW);
+						if (ccc[PRIX2D] > cc[PRIX2D])
+							cc[PRIX2D] = ccc[PRIX2D];	/* Note if not BG */
+					}
+					for (j = 0; j < s->ncc; j++)
+						cc[j] = pow(cc[j]/nn, 1.0/MIXPOW);
+
+#ifdef NEVER	/* Mark aliased pixels */
+					cc[0] = 0.5;
+					cc[1] = 0.0;
+					cc[2] = 1.0;
+#endif
+				} else if (s->noavg) {
+					/* Compute output value directly from primitive */
+
+					for (j = 0; j < s->ncc; j++)
+						cc[j] = cc[j];
+
+				} else {
+
+					/* Compute output value as mean of surrounding samples */
+					for (j = 0; j < s->ncc; j++) {
+						cc[j] = cc[j]
+						      + pixv0[x-1][j]
+						      + pixv0[x][j]
+						      + pixv1[x-1][j];
+						cc[j] = cc[j] * 0.25;
+					}
+					/* Note if not BG */
+					if (pixv0[x-1][PRIX2D] > cc[PRIX2D])
+						cc[PRIX2D] = pixv0[x-1][PRIX2D];
+					if (pixv0[x][PRIX2D] > cc[PRIX2D])
+						cc[PRIX2D] = pixv0[x][PRIX2D];
+					if (pixv1[x-1][PRIX2D] > cc[PRIX2D])
+						cc[PRIX2D] = pixv1[x-1][PRIX2D];
+				}
+				if (cc[PRIX2D] != -1)		/* Line is no longer background */
+					foundfg = 1;
+
+				/* Translate from render value to output pixel value */
+				if (s->dpth == bpc8_2d) {
+
+					/* if dithering and dithering all or found FG in line, */
+					/* start with 16 bit values to dither from */
+					if (s->dither) {
+						unsigned short *p = ((unsigned short *)lp) + x * s->ncc;
+
+						if (s->csp == lab_2d) {
+							cvt_Lab_to_CIELAB16(cc, cc);
+							for (j = 0; j < s->ncc; j++)
+								p[j] = (int)(cc[j] + 0.5);
+						} else {
+							for (j = 0; j < s->ncc; j++)
+								p[j] = (int)(65535.0 * cc[j] + 0.5);
+						}
+
+					/* Else quantize to 8 bits */
+					} else {
+						unsigned char *p = lp + x * s->ncc;
+						if (s->csp == lab_2d) {
+							cvt_Lab_to_CIELAB8(cc, cc);
+							for (j = 0; j < s->ncc; j++)
+								p[j] = (int)(cc[j] + 0.5);
+						} else {
+							for (j = 0; j < s->ncc; j++)
+								p[j] = (int)(255.0 * cc[j] + 0.5);
+						}
+					}
+				} else {
+					unsigned short *p = ((unsigned short *)lp) + x * s->ncc;
+					if (s->csp == lab_2d) {
+						cvt_Lab_to_CIELAB16(cc, cc);
+						for (j = 0; j < s->ncc; j++)
+							p[j] = (int)(cc[j] + 0.5);
+					} else {
+						for (j = 0; j < s->ncc; j++)
+							p[j] = (int)(65535.0 * cc[j] + 0.5);
+					}
+				}
+			}
+		}
+
+		if (y >= ys) {
+			bd->foundfg[y - ys] = foundfg;
+
+			/* Note which pixels are soley from the background */
+			if (bd->bgf != NULL) {
+				unsigned char *bp = bd->bgf + (y - ys) * s->pw;
+				for (x = 0; x < s->pw; x++)
+					bp[x] = pixv1[x][PRIX2D] == -1;
+			}
+
+			/* Threshold screening doesn't depend on other lines, */
+			/* so it can be done here. */
+			if (cx->screen != NULL)
+				render2d_dither_line(s, cx->screen, bd->obuf + (y - ys) * s->pw * s->ncc,
+				      bd->lbuf + (y - ys) * cx->lbsz,
+				      bd->bgf != NULL ? bd->bgf + (y - ys) * s->pw : NULL, foundfg, y);
+		}
+
+		/* Shuffle the pointers */
+		{
+			color2d *ttt;
+			ttt = pixv0;
+			pixv0 = pixv1;
+			pixv1 = ttt;
+		}
+	}
+	return 0;
+}
 
 /* Render and write to a TIFF or PNG file or memory buffer */
 /* Return NZ on error */
@@ -332,23 +890,22 @@ static int render2d_write(
 	png_uint_32 png_width = 0, png_height = 0;
 	int png_bit_depth = 0, png_color_type = 0;
 	int png_samplesperpixel = 0;
+	size_t png_rowbytes = 0;
+	pngblk *zblks[2] = { NULL, NULL };	/* Blocks of this and the previous pass */
+	int zcur = 0;				/* zblks[] of this pass */
+	int nzprev = 0;				/* Number of blocks in the previous pass */
+	unsigned char *prow = NULL;	/* Previous PNG row, and then filter rows */
+	uLong adler = 1;			/* Adler32 of the image data written */
 #endif
 
 	unsigned char *outbuf = NULL;
-	unsigned char *dithbuf16 = NULL;	/* 16 bit buffer for dithering */
 	thscreens *screen = NULL;			/* dithering object */
-	int foundfg;						/* Found a forground object in this line */
-	prim2d *th, **pthp;
-	prim2d **xlist, **ylist;	/* X, Y sorted start lists */
-	int xli, yli;				/* Indexes into X, Y list */
-	int noix;					/* Number in x list */
-	color2d *pixv0, *_pixv0;	/* Storage for pixel values around current */
-	color2d *pixv1, *_pixv1;
-	sobol *so;					/* Random sampler for anti-aliasing */
-	int i, j;
+	prim2d *th;
+	rbandcx cx;					/* Band rendering context */
+	int nth;					/* Number of threads */
+	int i, j, k;
 
-	double rx0, rx1, ry0, ry1;	/* Box being processed, newest sample is rx1, ry1 */
-	int x, y;					/* Pixel x & y index */
+	int y;						/* Pixel y index */
 
 #ifdef CCTEST_PATTERN		// For testing by making screen visible
 #pragma message("######### render.c TEST_PATTERN defined ! ##")
@@ -366,9 +923,6 @@ static int render2d_write(
 	}
 #endif
 
-	if ((so = new_sobol(2)) == NULL)
-		return 1;
-
 	if (fmt == tiff_file) {
 #ifdef RENDER_TIFF
 		switch (s->csp) {
@@ -582,15 +1136,11 @@ static int render2d_write(
 		/* Write the header */
 		png_write_info(png_ptr, png_info);
 
-		/* PNG expects network (BE) 16 bit values */
-		if (png_bit_depth == 16) {
-			png_uint_16 tt = 0x0001;
-			if (*((unsigned char *)&tt) == 0x01) 	/* Little endian */
-				png_set_swap(png_ptr);
-		}
-
-		/* Allocate one PNG line buffer */
-		if ((outbuf = malloc((png_bit_depth >> 3) * png_samplesperpixel * s->pw) ) == NULL) {
+		/* Allocate one PNG line buffer, and the previous and filtered */
+		/* line buffers. */
+		png_rowbytes = (png_bit_depth >> 3) * png_samplesperpixel * s->pw;
+		if ((outbuf = malloc(png_rowbytes)) == NULL
+		 || (prow = calloc(6, png_rowbytes)) == NULL) {
 			a1loge(g_log, 1, "malloc of PNG line buffer failed\n");
 			return 1;
 		}
@@ -605,14 +1155,6 @@ static int render2d_write(
 		return 1;
 	}
 
-	/* Allocate pixel value storage for aliasing detection */
-	if ((_pixv0 = malloc(sizeof(color2d) * (s->pw+2))) == NULL)
-		return 1;
-	pixv0 = _pixv0+1;
-	if ((_pixv1 = malloc(sizeof(color2d) * (s->pw+2))) == NULL)
-		return 1;
-	pixv1 = _pixv1+1;
-
 	if (s->dpth == bpc8_2d && s->dither) {
 #ifdef TEST_SCREENING		// For testing by making screen visible
 #pragma message("######### render TEST_SCREENING defined! ##")
@@ -630,307 +1172,151 @@ static int render2d_write(
 		                           s->dither == 2 ? 1 : 0, s->quant, s->qcntx, s->mxerr)) == NULL)
 #endif
 			return 1;
-		if ((dithbuf16 = malloc(s->pw * s->ncc * 2)) == NULL)
-			return 1;
 	}
 
-	/* To accelerate rendering, we keep sorted Y and X lists, */
-	/* and Y and X active linked lists derived from them. */
-	/* Typically this means that we're calling render on */
+	/* To accelerate rendering, we index the primitives by the bands */
+	/* of lines they overlap, and keep sorted X and active X lists for */
+	/* each line. Typically this means that we're calling render on */
 	/* none, 1 or a handful of the primitives, greatly speeding up */
-	/* rendering. */
+	/* rendering. Bands of lines are rendered in parallel, */
+	/* while dithering and writing is done in raster order. */
 
-	/* Allocate X and Y ordered lists */
-	if ((ylist = malloc(sizeof(prim2d *) * s->ix)) == NULL)
+	/* Count the primitives in each band */
+	cx.nbands = (s->ph + RBANDH - 1)/RBANDH;
+	if ((cx.bstart = calloc(cx.nbands + 1, sizeof(int))) == NULL)
 		return 1;
-	if ((xlist = malloc(sizeof(prim2d *) * s->ix)) == NULL)
-		return 1;
-
-	/* Initialise the Y list */
-	for (th = s->head, i = 0; th != NULL; th = th->next, i++)
-		ylist[i] = th;
-	
-	/* Sort the Y lists by y1 (because we rasterise top to bottom) */
-#define HEAP_COMPARE(A,B) (A->y1 > B->y1)
-	HEAPSORT(prim2d *,ylist,s->ix)
-#undef HEAP_COMPARE
-	yli = 0;
-	s->yl = NULL;
-
-	/* Render each line and write it, in raster order. */
-	/* We sample +- half a pixel around the pixel we want. */
-	/* We make the active element list encompass this region, */
-	/* so that we can super sample it for anti-aliasing. */
-	for (y = -1; y < s->ph; y++) {
-		foundfg = 0;
-
-		/* Convert to coordinate order */
-		ry0 = (((s->ph-1) - y) - 0.5) / s->vres;
-		ry1 = (((s->ph-1) - y) + 0.5) / s->vres;
+	for (th = s->head; th != NULL; th = th->next) {
+		int b0, b1;
+		render2d_prim_bands(s, cx.nbands, th, &b0, &b1);
+		for (; b0 <= b1; b0++)
+			cx.bstart[b0+1]++;
+	}
+	for (i = 0; i < cx.nbands; i++)
+		cx.bstart[i+1] += cx.bstart[i];
 
-		/* Remove any objects from the y list that are now out of range */
-		for (pthp = &s->yl, th = s->yl; th != NULL;) {
-			if (ry1 < th->y0) {
-				*pthp = th->yl;
-				th = th->yl;
-			} else {
-				pthp = &th->yl;
-				th = th->yl;
-			}
+	/* Fill in the band index */
+	if ((cx.bix = malloc(sizeof(prim2d *) * (cx.bstart[cx.nbands] + 1))) == NULL)
+		return 1;
+	for (th = s->head; th != NULL; th = th->next) {
+		int b0, b1;
+		render2d_prim_bands(s, cx.nbands, th, &b0, &b1);
+		for (; b0 <= b1; b0++)
+			cx.bix[cx.bstart[b0]++] = th;
+	}
+	for (i = cx.nbands; i > 0; i--)		/* Restore start indexes */
+		cx.bstart[i] = cx.bstart[i-1];
+	cx.bstart[0] = 0;
+
+	/* The background callback may not be re-entrant */
+	nth = s->bgfunc != NULL ? 1 : num_threads();
+	if (nth > cx.nbands)
+		nth = cx.nbands;
+	if (nth > NUMTHR_MAX)
+		nth = NUMTHR_MAX;
+	if (nth < 1)
+		nth = 1;
+
+	/* Allocate per thread band workspaces */
+	cx.s = s;
+	cx.screen = NULL;
+	if (screen != NULL && s->dither != 2)	/* Not error diffusion */
+		cx.screen = screen;
+	if (s->dpth == bpc8_2d && !s->dither)
+		cx.lbsz = s->pw * s->ncc;
+	else
+		cx.lbsz = s->pw * s->ncc * 2;
+	if ((cx.bands = calloc(nth, sizeof(rband2d))) == NULL)
+		return 1;
+	for (i = 0; i < nth; i++) {
+		rband2d *bd = &cx.bands[i];
+		if ((bd->xlist = malloc(sizeof(prim2d *) * s->ix)) == NULL
+		 || (bd->xact = malloc(sizeof(prim2d *) * s->ix)) == NULL
+		 || (bd->_pixv0 = malloc(sizeof(color2d) * (s->pw+2))) == NULL
+		 || (bd->_pixv1 = malloc(sizeof(color2d) * (s->pw+2))) == NULL
+		 || (bd->so = new_sobol(2)) == NULL
+		 || (bd->lbuf = malloc(cx.lbsz * RBANDH)) == NULL)
+			return 1;
+		if (s->dpth == bpc8_2d && s->dither && s->dithfgo) {
+			if ((bd->bgf = malloc(s->pw * RBANDH)) == NULL)
+				return 1;
 		}
-
-		/* Add any objects that are now within this range to our y list */
-		for(; yli < s->ix && ry0 < ylist[yli]->y1; yli++) {
-			ylist[yli]->yl = s->yl;
-			s->yl = ylist[yli];
+		if (cx.screen != NULL) {
+			if ((bd->obuf = malloc(s->pw * s->ncc * RBANDH)) == NULL)
+				return 1;
 		}
-
-		/* Initialise the current X list */
-		for (th = s->yl, noix = 0; th != NULL; th = th->yl, noix++)
-			xlist[noix] = th;
-		
-		/* Sort the X lists by x0 */
-#define HEAP_COMPARE(A,B) (A->x0 < B->x0)
-		HEAPSORT(prim2d *,xlist,noix)
-#undef HEAP_COMPARE
-		xli = 0;
-		s->xl = NULL;
-
-		for (x = -1; x < s->pw; x++) {
-			int j;
-			color2d rv;
-
-			rx0 = (x - 0.5) / s->hres;
-			rx1 = (x + 0.5) / s->hres;
-
-			/* Add any objects that are now within this range to our x list */
-			for(; xli < noix && rx1 > xlist[xli]->x0; xli++) {
-				xlist[xli]->xl = s->xl;
-				s->xl = xlist[xli];
-			}
-
-			/* Set the default current color */
-			for (j = 0; j < s->ncc; j++)
-				pixv1[x][j] = s->defc[j];
-			pixv1[x][PRIX2D] = -1;			/* Make sure all primitive ovewrite the default */
-
-			/* Allow callback to set per pixel background color (or not) */
-			if (s->bgfunc != NULL)
-				s->bgfunc(s->cntx, pixv1[x], x, y);
-
-			/* Overwrite it with any primitives, */
-			/* and remove any that are out of range now */
-			for (pthp = &s->xl, th = s->xl; th != NULL;) {
-				if (rx0 > th->x1) {
-					*pthp = th->xl;
-					th = th->xl;
-				} else {
-//printf("x %d y %d, rx1 %f, ry0 %f\n",x,y,rx1, ry0);
-
-					if (th->rend(th, rv, rx1, ry0) && th->ix > pixv1[x][PRIX2D]) {
-						/* Overwrite the current color */
-						/* (This is where we should handle depth and opacity */
-						for (j = 0; j < s->ncc; j++)
-							pixv1[x][j] = rv[j];
-						pixv1[x][PRIX2D] = rv[PRIX2D];
-//printf("x %d y %d, set %f %f %f ix %f\n",x,y,rv[0],rv[1],rv[2], rv[PRIX2D]);
-					}
-					pthp = &th->xl;
-					th = th->xl;
-				}
+	}
+#ifdef RENDER_PNG
+	cx.zblks = NULL;
+	cx.nzblks = 0;
+	if (fmt == png_file
+	 || fmt == png_mem) {
+		for (k = 0; k < 2; k++) {
+			if ((zblks[k] = calloc(nth, sizeof(pngblk))) == NULL)
+				return 1;
+			for (i = 0; i < nth; i++) {
+				if ((zblks[k][i].raw = malloc(RBANDH * (png_rowbytes + 1))) == NULL)
+					return 1;
 			}
-			/* Check if anti-aliasing is needed for previous lines previous pixel */
-			if (y >= 0 && x >= 0) {
-				color2d cc;
-
-				for (j = 0; j < s->ncc; j++)
-					cc[j] = pixv1[x][j];
-				cc[PRIX2D] = pixv1[x][PRIX2D];
-
-				/* See if anti aliasing is needed */
-				if (!s->noavg
-				 && ((pixv0[x+0][PRIX2D] != cc[PRIX2D] && colordiff(s, pixv0[x+0], cc))
-				  || (pixv0[x-1][PRIX2D] != cc[PRIX2D] && colordiff(s, pixv0[x-1], cc))
-				  || (pixv1[x-1][PRIX2D] != cc[PRIX2D] && colordiff(s, pixv1[x-1], cc)))) {
-					double nn = 0;
-
-					so->reset(so);
-
-					for (j = 0; j < s->ncc; j++)
-						cc[j] = 0.0;
-					cc[PRIX2D] = -1;
-
-					/* Compute the sample value by re-sampling the region */
-					/* around the pixel. */
-					for (nn = 0; nn < OSAMLS; nn++) {
-						double pos[2];
-						double rx, ry;
-						color2d ccc;
-
-						so->next(so, pos);
-
-						rx = (rx1 - rx0) * pos[0] + rx0;
-						ry = (ry1 - ry0) * pos[1] + ry0;
-
-						/* Set the default current color */
-						for (j = 0; j < s->ncc; j++)
-							ccc[j] = s->defc[j];
-						ccc[PRIX2D] = -1;
-
-						for (th = s->xl; th != NULL; th = th->xl) {
-							if (th->rend(th, rv, rx, ry) && th->ix > ccc[PRIX2D]) {
-								/* Overwrite the current color */
-								/* (This is where we should handle depth and opacity */
-								for (j = 0; j < s->ncc; j++)
-									ccc[j] = rv[j];
-								ccc[PRIX2D] = rv[PRIX2D];
-							}
-						}
-						for (j = 0; j < s->ncc; j++)
-							cc[j] += pow(ccc[j], MIXPOW);
-						if (ccc[PRIX2D] > cc[PRIX2D])
-							cc[PRIX2D] = ccc[PRIX2D];	/* Note if not BG */
-					}
-					for (j = 0; j < s->ncc; j++)
-						cc[j] = pow(cc[j]/nn, 1.0/MIXPOW);
-
-#ifdef NEVER	/* Mark aliased pixels */
-					cc[0] = 0.5;
-					cc[1] = 0.0;
-					cc[2] = 1.0;
+		}
+	}
 #endif
-				} else if (s->noavg) {
-					/* Compute output value directly from primitive */
-
-					for (j = 0; j < s->ncc; j++)
-						cc[j] = cc[j];
 
-				} else {
+	for (cx.yb = 0; cx.yb < s->ph; cx.yb += nth * RBANDH) {
+		int ye = cx.yb + nth * RBANDH;
+		if (ye > s->ph)
+			ye = s->ph;
 
-					/* Compute output value as mean of surrounding samples */
-					for (j = 0; j < s->ncc; j++) {
-						cc[j] = cc[j]
-						      + pixv0[x-1][j]
-						      + pixv0[x][j]
-						      + pixv1[x-1][j];
-						cc[j] = cc[j] * 0.25;
-					}
-					/* Note if not BG */
-					if (pixv0[x-1][PRIX2D] > cc[PRIX2D])
-						cc[PRIX2D] = pixv0[x-1][PRIX2D];
-					if (pixv0[x][PRIX2D] > cc[PRIX2D])
-						cc[PRIX2D] = pixv0[x][PRIX2D];
-					if (pixv1[x-1][PRIX2D] > cc[PRIX2D])
-						cc[PRIX2D] = pixv1[x-1][PRIX2D];
-				}
-				if (cc[PRIX2D] != -1)		/* Line is no longer background */
-					foundfg = 1;
-
-				/* Translate from render value to output pixel value */
-				if (s->dpth == bpc8_2d) {
+#ifdef RENDER_PNG
+		/* Deflate the previous pass's PNG blocks while rendering */
+		if (nzprev > 0) {
+			cx.zblks = zblks[1 - zcur];
+			cx.nzblks = nzprev;
+		}
+#endif
 
-					/* if dithering and dithering all or found FG in line, */
-					/* start with 16 bit values to dither from */
-					if (s->dither) {
-						unsigned short *p = ((unsigned short *)dithbuf16) + x * s->ncc;
+		/* Render the next nth bands */
+		par_exec(nth, render2d_band, (void *)&cx);
 
-						if (s->csp == lab_2d) {
-							cvt_Lab_to_CIELAB16(cc, cc);
-							for (j = 0; j < s->ncc; j++)
-								p[j] = (int)(cc[j] + 0.5);
-						} else {
-							for (j = 0; j < s->ncc; j++)
-								p[j] = (int)(65535.0 * cc[j] + 0.5);
-						}
-
-					/* Else quantize to 8 bits */
-					} else {
-						unsigned char *p = ((unsigned char *)outbuf) + x * s->ncc;
-						if (s->csp == lab_2d) {
-							cvt_Lab_to_CIELAB8(cc, cc);
-							for (j = 0; j < s->ncc; j++)
-								p[j] = (int)(cc[j] + 0.5);
-						} else {
-							for (j = 0; j < s->ncc; j++)
-								p[j] = (int)(255.0 * cc[j] + 0.5);
-						}
-					}
-				} else {
-					unsigned short *p = ((unsigned short *)outbuf) + x * s->ncc;
-					if (s->csp == lab_2d) {
-						cvt_Lab_to_CIELAB16(cc, cc);
-						for (j = 0; j < s->ncc; j++)
-							p[j] = (int)(cc[j] + 0.5);
-					} else {
-						for (j = 0; j < s->ncc; j++)
-							p[j] = (int)(65535.0 * cc[j] + 0.5);
-					}
-				}
+#ifdef RENDER_PNG
+		if (nzprev > 0) {
+			if (png_write_blks(png_ptr, zblks[1 - zcur], nzprev, &adler))
+				return 1;
+			cx.zblks = NULL;
+			nzprev = 0;
+		}
+		if (fmt == png_file
+		 || fmt == png_mem) {
+			for (i = 0; i < nth; i++) {
+				zblks[zcur][i].rlen = 0;
+				zblks[zcur][i].first = (cx.yb == 0 && i == 0);
+				zblks[zcur][i].last = 0;
 			}
 		}
+#endif
 
-		if (y >= 0) {
-			/* if dithering and dithering all or found FG in line */
-			if (s->dpth == bpc8_2d && s->dither) {
-				// If we need to screen this line
-				if (!s->dithfgo || foundfg) {
-					/* If we are dithering only the foreground colors, */
-					/* Subsitute the quantized un-dithered color for any */
-					/* pixels soley from the background */
-					if (s->dithfgo) {
-						int st, ed;
-						unsigned short *ip = ((unsigned short *)dithbuf16);
-						unsigned char *op = ((unsigned char *)outbuf);
-
-						/* Copy pixels up to first non-BG */
-						for (st = 0; st < s->pw; st++, ip += s->ncc, op += s->ncc) {
-							if (pixv1[st][PRIX2D] == -1) {
-								for (j = 0; j < s->ncc; j++)
-									op[j] = (ip[j] * 255 + 128)/65535;
-							} else {
-								break;
-							}
-						}
-						if (st < s->pw) {	/* If there are some FG pixels */
-
-							/* Copy down to first non-BG */
-							ip = ((unsigned short *)dithbuf16) + (s->pw-1) * s->ncc;
-							op = ((unsigned char *)outbuf) + (s->pw-1) * s->ncc;
-							for (ed = s->pw-1; ed >= st; ed--, ip -= s->ncc, op -= s->ncc) {
-								if (pixv1[ed][PRIX2D] == -1) {
-									for (j = 0; j < s->ncc; j++)
-										op[j] = (ip[j] * 255 + 128)/65535;
-								} else {
-									break;
-								}
-							}
-							/* Screen just the FG pixels */
-							ip = ((unsigned short *)dithbuf16) + st * s->ncc;
-							op = ((unsigned char *)outbuf) + st * s->ncc;
-							screen->screen(screen, ed-st+1, 1, st, y,
-						                       op, s->pw * s->ncc,
-						                       (unsigned char*)ip, s->pw * s->ncc);
-						}
+		/* Dither and write them in raster order */
+		for (y = cx.yb; y < ye; y++) {
+			rband2d *bd = &cx.bands[(y - cx.yb)/RBANDH];
+			unsigned char *lp = bd->lbuf + ((y - cx.yb) % RBANDH) * cx.lbsz;
+			unsigned char *bp = NULL;		/* Background only flags if dithfgo */
+			int foundfg = bd->foundfg[(y - cx.yb) % RBANDH];
 
-					/* Dither/screen the whole lot */
-					} else {
-						screen->screen(screen, s->pw, 1, 0, y,
-						                       (unsigned char *)outbuf, s->pw * s->ncc,
-						                       dithbuf16, s->pw * s->ncc);
-					}
-				// Don't need to screen this line - quantize from 16 bit
-				} else {
-					unsigned short *ip = ((unsigned short *)dithbuf16);
-					unsigned char *op = ((unsigned char *)outbuf);
-					for (x = 0; x < s->pw; x++, ip += s->ncc, op += s->ncc) {
-						for (j = 0; j < s->ncc; j++)
-							op[j] = (ip[j] * 255 + 128)/65535;
-					}
+			if (s->dpth == bpc8_2d && s->dither) {
+				if (cx.screen == NULL) {		/* Error diffuse in raster order */
+					if (s->dithfgo)
+						bp = bd->bgf + ((y - cx.yb) % RBANDH) * s->pw;
+					render2d_dither_line(s, screen, outbuf, lp, bp, foundfg, y);
+				} else {						/* Already screened by band */
+					memcpy(outbuf, bd->obuf + ((y - cx.yb) % RBANDH) * s->pw * s->ncc,
+					       s->pw * s->ncc);
 				}
+			} else {
+				memcpy(outbuf, lp, cx.lbsz);
 			}
 
 #ifdef CCTEST_PATTERN		// Substitute the testing pattern
 			if (do_test_pattern) {
+				int x;
 				for (x = 0; x < s->pw; x++)
 					test_value(s, outbuf, x, y);
 			}
@@ -946,28 +1332,71 @@ static int render2d_write(
 			} else if (fmt == png_file
 			        || fmt == png_mem) {
 #ifdef RENDER_PNG
-				png_bytep pixdata = (png_bytep)outbuf;
-				png_write_rows(png_ptr, &pixdata, 1);
+				/* PNG expects network (BE) 16 bit values */
+				if (png_bit_depth == 16) {
+					png_uint_16 tt = 0x0001;
+					if (*((unsigned char *)&tt) == 0x01) {	/* Little endian */
+						size_t j;
+						for (j = 0; j < png_rowbytes; j += 2) {
+							unsigned char t = outbuf[j];
+							outbuf[j] = outbuf[j+1];
+							outbuf[j+1] = t;
+						}
+					}
+				}
+				png_filter_row(&zblks[zcur][(y - cx.yb)/RBANDH], outbuf, prow,
+				      prow + png_rowbytes, png_rowbytes, (png_bit_depth >> 3) * png_samplesperpixel);
+				memcpy(prow, outbuf, png_rowbytes);
 #endif	/* PNG */
 			}
 		}
 
-		/* Shuffle the pointers */
-		{
-			color2d *ttt;
-			ttt = pixv0;
-			pixv0 = pixv1;
-			pixv1 = ttt;
+#ifdef RENDER_PNG
+		if (fmt == png_file
+		 || fmt == png_mem) {
+			nzprev = (ye - cx.yb + RBANDH - 1)/RBANDH;
+			zcur = 1 - zcur;
 		}
+#endif
 	}
 
-	free(ylist);
-	free(xlist);
-	free(_pixv0);
-	free(_pixv1);
+#ifdef RENDER_PNG
+	/* Deflate and write the last pass */
+	if (nzprev > 0) {
+		zblks[1 - zcur][nzprev-1].last = 1;
+		par_exec(nzprev, png_deflate_thread, (void *)zblks[1 - zcur]);
+		if (png_write_blks(png_ptr, zblks[1 - zcur], nzprev, &adler))
+			return 1;
+	}
+	for (k = 0; k < 2; k++) {
+		if (zblks[k] != NULL) {
+			for (i = 0; i < nth; i++) {
+				free(zblks[k][i].raw);
+				free(zblks[k][i].cbuf);
+			}
+			free(zblks[k]);
+		}
+	}
+	free(prow);
+#endif
+
+	free(cx.bstart);
+	free(cx.bix);
+	for (i = 0; i < nth; i++) {
+		rband2d *bd = &cx.bands[i];
+		free(bd->xlist);
+		free(bd->xact);
+		free(bd->_pixv0);
+		free(bd->_pixv1);
+		bd->so->del(bd->so);
+		free(bd->lbuf);
+		if (bd->bgf != NULL)
+			free(bd->bgf);
+		if (bd->obuf != NULL)
+			free(bd->obuf);
+	}
+	free(cx.bands);
 
-	if (dithbuf16 != NULL)
-		free(dithbuf16);
 	if (screen != NULL)
 		screen->del(screen);
 
@@ -982,7 +1411,7 @@ static int render2d_write(
 
 #ifdef RENDER_PNG
 		free(outbuf);
-		png_write_end(png_ptr, NULL);
+		png_write_chunk(png_ptr, (png_const_bytep)"IEND", NULL, 0);
 //		png_destroy_info_struct(png_ptr, &png_info);
 		png_destroy_write_struct(&png_ptr, &png_info);
 		if (fmt == png_file) {
@@ -994,8 +1423,6 @@ static int render2d_write(
 #endif	/* PNG */
 	}
 
-	so->del(so);
-
 	return 0;
 }
 
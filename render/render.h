@@ -72,9 +72,6 @@ struct _render2d;
 	int    ix;				/* Index (order added) */ \
 	int    ncc;				/* Number of color components */	\
 	struct _prim2d *next;	/* Linked list to next primitive */ \
-	struct _prim2d *yl0;	/* Previous lines Y list linked list */ \
-	struct _prim2d *yl;		/* Active Y list linked list */ \
-	struct _prim2d *xl;		/* Active X list linked list */ \
 	double x0, y0, x1, y1;	/* Extent, top & left inclusive, bot & right non-inclusive */ \
 	void (*del)(struct _prim2d *s);		/* Delete the object */ \
 							/* Render the object at location. Return nz if in primitive */ \
@@ -313,8 +310,6 @@ struct _render2d {
 	void *cntx;
 
 	prim2d *head;			/* Start of list of primitives in rendering order */
-	prim2d *yl;				/* Active Y list linked list head */
-	prim2d *xl;				/* Active X list linked list head */
 
 /* Public: */
 	/* Methods */
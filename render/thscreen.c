@@ -48,6 +48,36 @@
 
 #include "screens.h"	/* Pre-generated screen patterns */
 
+#define THS_MT_MIN 65536	/* Minimum pixels to screen using multiple threads */
+
+/* Context for screening bands of lines in parallel */
+typedef struct {
+	thscreens *t;
+	int width, height;
+	int xoff, yoff;
+	unsigned char *out;
+	unsigned long opitch;
+	unsigned char *in;
+	unsigned long ipitch;
+} thsbands;
+
+/* Screen the ix'th of nth bands of lines */
+static int screen_thsband(void *cntx, int ix, int nth) {
+	thsbands *b = (thsbands *)cntx;
+	thscreens *t = b->t;
+	int y0 = (b->height * ix)/nth;
+	int y1 = (b->height * (ix+1))/nth;
+	int i;
+
+	if (y1 <= y0)
+		return 0;
+	for (i = 0; i < t->np; i++)
+		t->sc[i]->screen(t->sc[i], b->width, y1 - y0, b->xoff, b->yoff + y0,
+		                           b->out + y0 * b->opitch + i, t->np, b->opitch,
+		                           b->in + 2 * (y0 * b->ipitch + i), t->np, b->ipitch);
+	return 0;
+}
+
 /* Threshold screen lines of multiplane pixels */
 void screen_thscreens(
 	thscreens *t,			/* Screening object pointer */
@@ -59,6 +89,30 @@ void screen_thscreens(
 	unsigned long ipitch	/* Increment between input lines in components */
 ) {
 	int i;
+
+	/* Each line is screened independently, so large areas */
+	/* can be screened as bands of lines in parallel. */
+	if (height > 1 && ((double)width * height) >= THS_MT_MIN) {
+		thsbands b;
+		int nth = num_threads();
+
+		if (nth > height)
+			nth = height;
+		if (nth > 1) {
+			b.t = t;
+			b.width = width;
+			b.height = height;
+			b.xoff = xoff;
+			b.yoff = yoff;
+			b.out = out;
+			b.opitch = opitch;
+			b.in = in;
+			b.ipitch = ipitch;
+			par_exec(nth, screen_thsband, (void *)&b);
+			return;
+		}
+	}
+
 	for (i = 0; i < t->np; i++)
 		t->sc[i]->screen(t->sc[i], width, height, xoff, yoff,
 		                           out + i, t->np, opitch,
@@ -450,7 +504,6 @@ void thscreen16_8(
 	unsigned short *in = (unsigned short *)_in;	/* Pointer to input pixel sized values */
 	int *lut = t->lut;			/* Copy of 8 or 16 -> 16 bit lookup table */
 	unsigned short *ein = in + height * ipitch;	/* Vertical end pixel marker */
-	unsigned short *ein1;				/* Horizontal end pixel markers */
 	unsigned char **oth, **eth; /* Current lines start, origin and end in screening table. */
 	int thtsize;				/* Overall size of threshold table */
 	unsigned char **eeth;		/* Very end of threshold table */
@@ -464,19 +517,32 @@ void thscreen16_8(
 		eeth = t->thp + thtsize;			/* very end of table */
 	}
 
-	ein1 = in + ipinc * width;
-	
 	/* For each line: */
-	for (; in < ein; in += ipitch, ein1 += ipitch, out += opitch) {
+	for (; in < ein; in += ipitch, out += opitch) {
 		unsigned char **th = oth;	/* Threshold table origin */
 		unsigned short *ip = in;	/* Horizontal input pointer */
 		unsigned char *op = out;	/* Horizontal output pointer */
-
-		/* Do pixels one output byte at a time */
-		for (; ip < ein1; ip += ipinc, op += opinc) {
-			int tt = lut[*ip];
-			*op = (unsigned char)th[0][tt];
-			if (++th >= eth)
+		int npix = width;			/* Pixels remaining in line */
+
+		/* Do pixels in runs up to the horizontal wrap of the screen, */
+		/* so that the inner loop has independent iterations. */
+		while (npix > 0) {
+			int i, n = eth - th;
+
+			if (n > npix)
+				n = npix;
+
+			if (t->idlut) {			/* Skip the (large) identity lookup */
+				for (i = 0; i < n; i++)
+					op[i * opinc] = th[i][ip[i * ipinc]];
+			} else {
+				for (i = 0; i < n; i++)
+					op[i * opinc] = th[i][lut[ip[i * ipinc]]];
+			}
+			ip += n * ipinc;
+			op += n * opinc;
+			npix -= n;
+			if ((th += n) >= eth)
 				th -= t->swidth;
 		}
 
@@ -586,6 +652,7 @@ thscreen *new_thscreen(
 		DBG(("new_thscreen() malloc of 16 bit LUT failed\n"));
 		return NULL;
 	}
+	t->idlut = (lutfunc == NULL);
 	for (i = 0; i < 65536; i++) {
 		if (lutfunc != NULL) {
 			double v = i/65535.0;
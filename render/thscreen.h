@@ -133,6 +133,7 @@ struct _thscreen {
 	double asp;					/* Aspect ratio (== dpiX/dpiY) */
 	double overlap;				/* Overlap between levels, 0 - 1.0 */
 	int *lut;					/* Lookup table */
+	int idlut;					/* NZ if lut is the identity */
 	unsigned char _tht[65536 * 3];/* Threshold table */
 	unsigned char *tht;			/* Pointer to base of threshold table */
 	unsigned char **thp;		/* Pointers to threshold table (offset int _tht) */
@@ -86,6 +86,16 @@
 	that then ties in with rev code to mark such
 	areas out of gamut.
 
+	Speeding this up by threading isn't simply a matter of splitting
+	up the boundary cells, since the surface is followed one edge
+	at a time, and each new triangle depends on the edges created so far.
+	The node values are grid values (plus the optional outf() lookup),
+	so there are no interpolations to batch with interp_batch() either.
+	Once the surface following works (see above), the per-edge candidate
+	node evaluation (get_ssimplex_nodes() + the baricentric tests) of
+	all the currently open edges could be done in parallel, with the
+	triangle creation then done serially in edge order.
+
  */
 
 #include <stdio.h>
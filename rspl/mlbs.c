@@ -352,25 +352,32 @@ void basis(double b[4], double t) {
 }
 
 
-/* Improve an slbs to make it closer to the scattered data */
-static void improve_slbs(
-slbs *s
-) {
-	int i, e, f;
+#define MLBS_THR_MIN 256		/* Minimum points per thread in improve_slbs() */
+
+/* improve_slbs() thread context. Each thread accumulates the */
+/* contributions of a contiguous range of points into its own */
+/* delta and omega latices, which are summed afterwards. */
+typedef struct {
+	slbs *s;
+	double *delta[NUMTHR_MAX];	/* Per thread delta accumulation (based at 0 corner) */
+	double *omega[NUMTHR_MAX];	/* Per thread omega accumulation (based at 0 corner) */
+	double *nw[NUMTHR_MAX];		/* Per thread neighbor weight cache */
+} improve_thr;
+
+static int improve_slbs_thread(void *cntx, int tix, int nth) {
+	improve_thr *tx = (improve_thr *)cntx;
+	slbs *s = tx->s;
 	mlbs *p = s->p;		/* Parent object */
-	double *delta;		/* Delta accumulation */
-	double *omega;		/* Omega accumulation */
+	double *delta = tx->delta[tix];
+	double *omega = tx->omega[tix];
+	double *nw = tx->nw[tix];
+	int i, ie, e, f;
 
-	/* Allocate temporary accumulation arrays */
-	if ((delta = (double *)calloc(sizeof(double), s->lsize)) == NULL)
-		error("Malloc slbs temp latice failed");
-	delta += s->loff;
-	if ((omega = (double *)calloc(sizeof(double), s->lsize)) == NULL)
-		error("Malloc slbs temp latice failed");
-	omega += s->loff;
+	i  = (int)((double)p->npts * tix / nth);
+	ie = (int)((double)p->npts * (tix+1) / nth);
 
 	/* For each scattered data point */
-	for (i = 0; i < p->npts; i++) {
+	for (; i < ie; i++) {
 		int    ix;			/* Latice index of base of neighborhood */
 		double b[MXDI][4];	/* B-spline basis factors for each dimension */
 		double sws;			/* Sum of all the basis factors squared */
@@ -398,7 +405,7 @@ slbs *s
 			double w;
 			for (w = 1.0, e = 0; e < p->di; e++)
 				w *= b[e][s->n[nn].c[e]];
-			s->n[nn].w = w;		/* cache weighting */
+			nw[nn] = w;			/* cache weighting */
 			sws += w * w;
 			for (f = 0; f < p->fdi; f++)
 				ve[f] -= w * s->lat[ix + s->n[nn].xo + f];	/* Subtract current aprox value */
@@ -408,8 +415,8 @@ slbs *s
 		/* Accumulate the delta and omega factors */
 		/* for this resolutions improvement. */
 		for (nn = 0; nn < s->nsize; nn++) {
-			double ws, ww, w = s->n[nn].w;
-			int xo = ix + s->n[nn].xo;		/* Latice offset */
+			double ws, ww, w = nw[nn];
+			int xo = s->loff + ix + s->n[nn].xo;		/* Latice offset */
 			ww = w * w;
 			ws = ww * w/sws;				/* Scale factor for delta */
 			omega[xo] += ww;				/* Accumulate omega */
@@ -419,9 +426,54 @@ slbs *s
 //printf("Distributing delta %f to %d %d\n",ws * ve[0],s->n[nn].c[0],s->n[nn].c[1]);
 		}
 	}
+	return 0;
+}
 
-	omega -= s->loff;	/* Base them back to -1 corner */
-	delta -= s->loff;
+/* Improve an slbs to make it closer to the scattered data */
+static void improve_slbs(
+slbs *s
+) {
+	int i, j, f;
+	mlbs *p = s->p;		/* Parent object */
+	improve_thr tx;
+	double *delta;		/* Delta accumulation */
+	double *omega;		/* Omega accumulation */
+	int nth;
+
+	/* Use as many threads as there are points to keep them busy */
+	nth = num_threads();
+	if (nth > NUMTHR_MAX)
+		nth = NUMTHR_MAX;
+	if (nth > p->npts/MLBS_THR_MIN)
+		nth = p->npts/MLBS_THR_MIN;
+	if (nth < 1)
+		nth = 1;
+
+	/* Allocate temporary accumulation arrays for each thread */
+	tx.s = s;
+	for (j = 0; j < nth; j++) {
+		if ((tx.delta[j] = (double *)calloc(sizeof(double), s->lsize)) == NULL)
+			error("Malloc slbs temp latice failed");
+		if ((tx.omega[j] = (double *)calloc(sizeof(double), s->lsize)) == NULL)
+			error("Malloc slbs temp latice failed");
+		if ((tx.nw[j] = (double *)malloc(sizeof(double) * s->nsize)) == NULL)
+			error("Malloc slbs temp weights failed");
+	}
+
+	if (nth == 1)
+		improve_slbs_thread((void *)&tx, 0, 1);
+	else
+		par_exec(nth, improve_slbs_thread, (void *)&tx);
+
+	/* Sum the per thread accumulations */
+	omega = tx.omega[0];
+	delta = tx.delta[0];
+	for (j = 1; j < nth; j++) {
+		for (i = 0; i < s->lsize; i++) {
+			omega[i] += tx.omega[j][i];
+			delta[i] += tx.delta[j][i];
+		}
+	}
 
 	/* Go through the delta and omega arrays, */
 	/* compute and add the refinements to the current */
@@ -436,8 +488,11 @@ slbs *s
 	}
 
 	/* Done with temporary arrays */
-	free(omega);
-	free(delta);
+	for (j = 0; j < nth; j++) {
+		free(tx.nw[j]);
+		free(tx.omega[j]);
+		free(tx.delta[j]);
+	}
 }
 
 /* Return the interpolated value for a given point */
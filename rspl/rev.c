@@ -148,8 +148,9 @@ int thissz, lastsz = -1;
                      fprintf(stderr,"%s, %d: rev.sz -= %d\n",__FILE__, __LINE__, bbb)
 #endif
 #else
-#define INCSZ(s, bbb) (s)->rev.sz += (bbb)
-#define DECSZ(s, bbb) (s)->rev.sz -= (bbb)
+#define INCSZ(s, bbb) ((s)->rev.sz += (bbb), a1ma_inc(a1ma_rev, (bbb)),		\
+                      (s)->rev.sz > (s)->rev.peak_sz ? ((s)->rev.peak_sz = (s)->rev.sz) : 0)
+#define DECSZ(s, bbb) ((s)->rev.sz -= (bbb), a1ma_dec(a1ma_rev, (bbb)))
 #endif
 
 /* Set STATS in rev.h */
@@ -239,6 +240,7 @@ static char *pcellorange(fxcell *c);
  */
 
 #define	EPS (2e-6)			/* 2e-6 Allowance for numeric error */
+#define HINT_EPS (1e-9)		/* Auxiliary distance that ends an RSPL_HINT search */
 
 static void make_rev(rspl *s);
 static void init_revaccell(rspl *s);
@@ -247,10 +249,13 @@ static fxcell *get_fxcell(schbase *b, int ix, int force);
 static void uncache_fxcell(revcache *r, fxcell *cp);
 #define unget_fxcell(r, cp) uncache_fxcell(r, cp)		/* These are the same */
 static void invalidate_revaccell(rspl *s);
+static rspl *rev_thread_ctx_rspl(rspl *s, int nctx);
+static void rev_cache_stats_rspl(rspl *s, rspl_rcstats *st, int reset);
 static int decrease_revcache(revcache *rc);
 
 /* ====================================================== */
 
+static schbase *alloc_sb(rspl *s);
 static schbase *init_search(rspl *s, int flags, double *av, int *auxm,
                         double *v, double *cdir, co *cpp, int mxsoln, enum ops op);
 static void adjust_search(rspl *s, int flags, double *av, enum ops op);
@@ -259,6 +264,7 @@ static schbase *set_search_limit(rspl *s, double (*limit)(void *vcntx, double *i
 static void set_lsearch(rspl *s, int e);
 static void free_search(schbase *b);
 
+static int calc_rev_index(rspl *s, double *v);
 static int *calc_fwd_cell_list(rspl *s, double *v);
 
 static int *calc_fwd_nn_cell_list(rspl *s, double *v);
@@ -279,14 +285,23 @@ static char *opnames[6] = { "exact", "clipv", "clipn", "auxil", "locus" };
 
 #define INF_DIST 1e38		/* Stands for infinite "current best" distance */
 
+/* Fwd cell touched flag. A thread context has its own copy of these */
+/* rather than using the ones in the shared grid. */
+#define REV_TOUCHF(s, ix, fcb) (*((s)->rev.thtouch != NULL ? &(s)->rev.thtouch[ix] : &TOUCHF(fcb)))
+
 /* ====================================================== */
 /* Globals that track overall usage of reverse cache to aportion memory */
 /* This is incremented for rspl with di > 1 when rev.rev_valid != 0 */
 size_t g_avail_ram = 0;			/* Total maximum memory to be used */
+size_t g_budget_ram = 0;		/* Explicit total set by rspl_set_rev_cache_budget(), 0 if none */
 size_t g_test_ram = 0;			/* Amount of memory that has been tested to be allocatable */
 int g_no_rev_cache_instances = 0;
 rev_struct *g_rev_instances = NULL;
 
+/* Lock for g_test_ram and cache reduction, since thread contexts */
+/* (see rev_thread_ctx()) may be allocating at the same time. */
+static amutex_static(rev_mem_lock);
+
 /* ------------------------------------------------------ */
 /* Retry allocation routines - if the malloc fails,       */
 /* try reducing the cache size and trying again */
@@ -315,6 +330,8 @@ static void rev_reduce_cache(size_t size) {
 	for (rsi = g_rev_instances; rsi != NULL; rsi = rsi->next) {
 		revcache *rc = rsi->cache;
 
+		if (rsi->nthctx > 0)		/* Cache may be in use by another thread */
+			continue;
 		rsi->max_sz = ram;
 		while (rc->nunlocked > 0 && rsi->sz > rsi->max_sz) {
 			if (decrease_revcache(rc) == 0)
@@ -365,6 +382,7 @@ static void rev_test_vram(size_t size) {
 static void *rev_malloc(rspl *s, size_t size) {
 	void *rv;
 
+	amutex_lock(rev_mem_lock);
 	if ((size + 1 * 1024 * 1024) > g_test_ram)
 		rev_test_vram(size);
 	if ((rv = malloc(size)) == NULL) {
@@ -373,6 +391,7 @@ static void *rev_malloc(rspl *s, size_t size) {
 	}
 	if (rv != NULL)
 		g_test_ram -= size;
+	amutex_unlock(rev_mem_lock);
 
 	return rv;
 }
@@ -380,6 +399,7 @@ static void *rev_malloc(rspl *s, size_t size) {
 static void *rev_calloc(rspl *s, size_t num, size_t size) {
 	void *rv;
 
+	amutex_lock(rev_mem_lock);
 	if (((num * size) + 1 * 1024 * 1024) > g_test_ram)
 		rev_test_vram(size);
 	if ((rv = calloc(num, size)) == NULL) {
@@ -388,6 +408,7 @@ static void *rev_calloc(rspl *s, size_t num, size_t size) {
 	}
 	if (rv != NULL)
 		g_test_ram -= size;
+	amutex_unlock(rev_mem_lock);
 
 	return rv;
 }
@@ -395,6 +416,7 @@ static void *rev_calloc(rspl *s, size_t num, size_t size) {
 static void *rev_realloc(rspl *s, void *ptr, size_t size) {
 	void *rv;
 
+	amutex_lock(rev_mem_lock);
 	if ((size + 1 * 1024 * 1024) > g_test_ram)
 		rev_test_vram(size);
 	if ((rv = realloc(ptr, size)) == NULL) {
@@ -403,6 +425,7 @@ static void *rev_realloc(rspl *s, void *ptr, size_t size) {
 	}
 	if (rv != NULL)
 		g_test_ram -= size;
+	amutex_unlock(rev_mem_lock);
 
 	return rv;
 }
@@ -436,8 +459,11 @@ rev_set_limit_rspl(
 		invalidate_revaccell(s);		/* Invalidate the reverse cache */
 	}
 
-	/* Invalidate any ink limit values cached with the fwd grid data */
-	clear_limitv(s);
+	/* Invalidate any ink limit values cached with the fwd grid data, */
+	/* unless they were just restored by load_rspl() */
+	if (!s->g.limitv_loaded || limit == NULL)
+		clear_limitv(s);
+	s->g.limitv_loaded = 0;
 }
 
 /* Get the ink limit information for any reverse interpolation. */
@@ -496,6 +522,44 @@ static void rev_set_lchw(
 	}
 }
 
+/* Set the RSPL_HINT input space value */
+static void rev_hint_rspl(
+	struct _rspl *s,	/* this */
+	double p[MXRI]		/* Input space hint value, NULL if none */
+) {
+	int e, di = s->di;
+	int ix;
+
+	if (p == NULL) {
+		s->rev.hintcell = -1;
+		return;
+	}
+
+	/* Fwd cell index is that of the cells base vertex */
+	for (ix = e = 0; e < di; e++) {
+		int mi = (int)floor((p[e] - s->g.l[e])/s->g.w[e]);
+		if (mi < 0)
+			mi = 0;
+		else if (mi > (s->g.res[e]-2))
+			mi = s->g.res[e]-2;
+		ix += mi * s->g.ci[e];
+	}
+	s->rev.hintcell = ix;
+}
+
+/* Return nz if the solution found by searching the hint cell */
+/* can't be improved on by searching the rest of the candidates. */
+static int hint_done(schbase *b) {
+	if (b->nsoln == 0)
+		return 0;
+	if (b->op == exact)
+		return b->mxsoln == 1;
+	if (b->op == auxil)
+		return b->idist <= HINT_EPS
+		    && (!(b->flags & RSPL_MAXAUX) || b->iabove == b->naux);
+	return 0;
+}
+
 #define RSPL_CERTAIN 0x80000000 						/* WILLCLIP hint is certain */
 #define RSPL_WILLCLIP2 (RSPL_CERTAIN | RSPL_WILLCLIP)	/* Clipping will certainly be needed */
 
@@ -532,6 +596,7 @@ rev_interp_rspl(
 	int fastsetup;			/* fastsetup on entry */
 	
 	DBGV(("\nrev interp called with out targets", fdi, " %f", cpp[0].v, "\n"));
+	a1tr_begin("rev_interp");
 
 	/* This is a restricted size function */
 	if (di > MXRI)
@@ -615,19 +680,48 @@ rev_interp_rspl(
 	/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 	/* If hinted that we will not need to clip, look for exact solution. */
 	if (!(flags & RSPL_WILLCLIP)) {
+		int hdone = 0;		/* nz if hint cell solution is final */
+
 		DBG(("Hint we won't clip, so trying exact search\n"));
 
 		/* First do an exact search (init will select auxil if requested) */
 		adjust_search(s, flags, NULL, exact);
+
+		/* Search the hint cell on its own first */
+		if ((flags & RSPL_HINT) && s->rev.hintcell >= 0) {
+			int pauxcell = b->pauxcell;
+			int hrip[5];
+
+			hrip[0] = 1;				/* Allocation for fwd cells in list */
+			hrip[1] = 4;				/* Next free entry index */
+			hrip[2] = 0;				/* Reference count */
+			hrip[3] = s->rev.hintcell;
+			hrip[4] = -1;
+
+			search_list(b, hrip + 3, s->get_next_touch(s));
+			hdone = hint_done(b);
+			DBG(("Hint cell %d search got %d solutions%s\n",s->rev.hintcell,b->nsoln,
+			                                      hdone ? ", skipping full search" : ""));
+
+			/* Start the full search afresh, so that its */
+			/* result doesn't depend on the hint. */
+			if (!hdone) {
+				adjust_search(s, flags, NULL, exact);
+				b->pauxcell = pauxcell;
+				b->iclip = 0;
+			}
+		}
 	
 		/* Figure out the reverse grid index appropriate for this request */
-		if (rip == NULL)	/* Not done this yet */
+		if (!hdone && rip == NULL)	/* Not done this yet */
 			rip = calc_fwd_cell_list(s, cpp[0].v);
 	
 #ifdef STATS
 			s->rev.st[b->op].searchcalls++;
 #endif	/* STATS */
-		if (rip != NULL) {
+		if (hdone) {
+			DBG(("Using hint cell solution\n"));
+		} else if (rip != NULL) {
 			/* Setup, sort and search the list */
 			search_list(b, rip, s->get_next_touch(s));
 		} else {
@@ -799,6 +893,7 @@ rev_interp_rspl(
 
 	s->rev.fastsetup = fastsetup;	/* retore fastsetup state */
 
+	a1tr_end();
 	return b->nsoln | didclip;
 }
 
@@ -808,19 +903,22 @@ rev_interp_rspl(
 /* Return number of locus segments found, up to mxsoln. 0 will be returned if no solutions */
 /* are found. */
 
+/* (If gotrip is nz, rip is the fwd cell list for cpp[0].v[], as returned */
+/* by calc_fwd_cell_list(), otherwise it is computed as needed.) */
 static int
-rev_locus_segs_rspl (
+rev_locus_segs_rip (
 	rspl *s,		/* this */
 	int *auxm,		/* Array of di mask flags, !=0 for valid auxliaries (NULL if no auxiliaries) */
 	co *cpp,		/* Input value in cpp[0].v[] */
 	int mxsoln,		/* Maximum number of solutions allowed for */
 	double min[][MXRI],	/* Array of min[MXRI] to hold return segment minimum values. */
-	double max[][MXRI]	/* Array of max[MXRI] to hold return segment maximum values. */
+	double max[][MXRI],	/* Array of max[MXRI] to hold return segment maximum values. */
+	int *rip,		/* Fwd cell list if gotrip */
+	int gotrip		/* nz if rip is valid */
 ) {
 	int e, di = s->di;
 	int f, fdi = s->fdi;
 	int six;		/* solution index */
-	int *rip = NULL;
 	int rv = 1;				/* Return value */
 	schbase *b = NULL;		/* Base search information */
 	
@@ -873,13 +971,14 @@ rev_locus_segs_rspl (
 		else
 			set_lsearch(s, e);		/* Reset locus search for next auxiliary */
 
-		if (rip == NULL) {		/* Not done this yet */
+		if (!gotrip) {		/* Not done this yet */
 			rip = calc_fwd_cell_list(s, cpp[0].v); /* Reverse grid index for this request */
-			if (rip == NULL) {
-				DBG(("Got NULL list (point outside range) for auxiliary locus search\n"));
-				rv = 0;
-				break;
-			}
+			gotrip = 1;
+		}
+		if (rip == NULL) {
+			DBG(("Got NULL list (point outside range) for auxiliary locus search\n"));
+			rv = 0;
+			break;
 		}
 
 		search_list(b, rip, s->get_next_touch(s)); /* Setup, sort and search the list */
@@ -987,6 +1086,18 @@ printf("\n");
 	return rv;
 }
 
+static int
+rev_locus_segs_rspl (
+	rspl *s,		/* this */
+	int *auxm,		/* Array of di mask flags, !=0 for valid auxliaries (NULL if no auxiliaries) */
+	co *cpp,		/* Input value in cpp[0].v[] */
+	int mxsoln,		/* Maximum number of solutions allowed for */
+	double min[][MXRI],	/* Array of min[MXRI] to hold return segment minimum values. */
+	double max[][MXRI]	/* Array of max[MXRI] to hold return segment maximum values. */
+) {
+	return rev_locus_segs_rip(s, auxm, cpp, mxsoln, min, max, NULL, 0);
+}
+
 /* ------------------------------------------------------------------------------------ */
 typedef double mxdi_ary[MXRI];
 
@@ -1005,6 +1116,77 @@ rev_locus_rspl(
 	return rev_locus_segs_rspl (s, auxm, cpp, 1, (mxdi_ary *)min, (mxdi_ary *)max);
 }
 
+/* Batch locus target, and the index of its reverse grid cell */
+typedef struct {
+	int ix;			/* Target index */
+	int rix;		/* Reverse grid cell index, -1 if outside */
+} locus_tgt;
+
+/* Do reverse searches for the locus of the auxiliary input values of n targets. */
+/* The targets are searched in order of reverse acceleration grid cell, so that */
+/* targets sharing a cell share its fwd cell list, and find the previous locus */
+/* cells and the fwd cells they need still in the cache. */
+/* Return the number of targets with a valid locus. */
+static int
+rev_locus_n_rspl(
+	rspl *s,		/* this */
+	int *auxm,		/* Array of di mask flags, !=0 for valid auxliaries (NULL if no auxiliaries) */
+	co *cpp,		/* n targets in cpp[].v[] */
+	int n,			/* Number of targets */
+	double (*min)[MXRI],	/* Return n minimum auxiliary values */
+	double (*max)[MXRI],	/* Return n maximum auxiliary values */
+	int *rv			/* If not NULL, return n rev_locus() return values */
+) {
+	locus_tgt *tl;
+	int i, nvalid = 0;
+	int prix = -2;			/* Previous reverse grid index */
+	int *rip = NULL;		/* Fwd cell list for prix */
+
+	if (n <= 0)
+		return 0;
+
+	/* Make sure the reverse grid exists, so we can index it */
+	if (s->rev.inited == 0)
+		make_rev(s);
+	if (s->rev.sb == NULL)
+		alloc_sb(s);
+	if (s->rev.rev_valid == 0)
+		init_revaccell(s);
+
+	if ((tl = (locus_tgt *)malloc(n * sizeof(locus_tgt))) == NULL)
+		error("rspl malloc failed - rev_locus_n target list");
+
+	for (i = 0; i < n; i++) {
+		tl[i].ix = i;
+		tl[i].rix = calc_rev_index(s, cpp[i].v);
+	}
+
+	/* Group the targets by reverse grid cell, keeping their order within a cell */
+#define 	HEAP_COMPARE(A,B) (A.rix < B.rix || (A.rix == B.rix && A.ix < B.ix))
+	HEAPSORT(locus_tgt, tl, n)
+#undef 		HEAP_COMPARE
+
+	for (i = 0; i < n; i++) {
+		int ix = tl[i].ix;
+		int trv;
+
+		if (tl[i].rix != prix) {
+			rip = calc_fwd_cell_list(s, cpp[ix].v);
+			prix = tl[i].rix;
+		}
+
+		trv = rev_locus_segs_rip(s, auxm, &cpp[ix], 1, &min[ix], &max[ix],
+		                         rip, 1);
+		if (trv != 0)
+			nvalid++;
+		if (rv != NULL)
+			rv[ix] = trv;
+	}
+	free(tl);
+
+	return nvalid;
+}
+
 /* ------------------------------------------------------------------------------------ */
 
 #ifdef DEBUG2
@@ -1394,6 +1576,29 @@ schbase *b	/* Base search information */
 	free_sb(b);
 }
 
+/* Return the index of the reverse grid cell containing the */
+/* target output values, or -1 if it is outside the reverse range. */
+static int
+calc_rev_index(
+	rspl *s,		/* this */
+	double *v		/* Output values */
+) {
+	int f, fdi = s->fdi;
+	int rix;
+	int rgres_1 = s->rev.res - 1;
+
+	for (rix = 0, f = 0; f < fdi; f++) {
+		int mi;
+		double t = (v[f] - s->rev.gl[f])/s->rev.gw[f];
+		mi = (int)floor(t);				/* Grid coordinate */
+		if (mi < 0 || mi > rgres_1) { 	/* If outside valid reverse range */
+			return -1;
+		}
+		rix += mi * s->rev.coi[f];	/* Accumulate reverse grid index */
+	}
+	return rix;
+}
+
 /* Return the pointer to the list of fwd cells given */
 /* the target output values. The pointer will be to the first */
 /* index in the list (ie. list address + 3) */
@@ -1403,23 +1608,16 @@ calc_fwd_cell_list(
 	rspl *s,		/* this */
 	double *v		/* Output values */
 ) {
-	int f, fdi = s->fdi;
 	int **rpp;
-	int rgres_1 = s->rev.res - 1;
+	int rix;
 
 	if (s->rev.rev_valid == 0)
 		init_revaccell(s);
 		
-	for (rpp = s->rev.rev, f = 0; f < fdi; f++) {
-		int mi;
-		double t = (v[f] - s->rev.gl[f])/s->rev.gw[f];
-		mi = (int)floor(t);				/* Grid coordinate */
-		if (mi < 0 || mi > rgres_1) { 	/* If outside valid reverse range */
-			return NULL;
-		}
-		rpp += mi * s->rev.coi[f];	/* Accumulate reverse grid pointer */
-	}
-	s->rev.sb->rix = rpp - s->rev.rev;	/* Set diagnostic value */
+	if ((rix = calc_rev_index(s, v)) < 0)
+		return NULL;
+	rpp = s->rev.rev + rix;
+	s->rev.sb->rix = rix;	/* Set diagnostic value */
 
 	if (*rpp == NULL)
 		return NULL;
@@ -1498,7 +1696,7 @@ unsigned int tcount		/* grid touch count for this operation */
 			float *fcb = s->g.a + ix * s->g.pss;	/* Pointer to base float of fwd cell */
 			fxcell *c;
 
-			if (TOUCHF(fcb) >= tcount) {	/* If we have visited this cell before */
+			if (REV_TOUCHF(s, ix, fcb) >= tcount) {	/* If we have visited this cell before */
 				DBG((" Already touched cell index %d\n",ix));
 				continue;
 			}
@@ -1529,7 +1727,7 @@ unsigned int tcount		/* grid touch count for this operation */
 			}
 
 			DBG(("checking out cell %d range %s\n",ix,pcellorange(c)));
-			TOUCHF(fcb) = tcount;			/* Touch it */
+			REV_TOUCHF(s, ix, fcb) = tcount;	/* Touch it */
 
 			/* Check mandatory conditions, and compute search key */
 			if (!b->setsort(b, c)) {
@@ -2423,7 +2621,7 @@ calc_fwd_nn_cell_list(
 
 	rpp = s->rev.nnrev + ix;
 	if (*rpp == NULL) {
-		if (s->rev.fastsetup)
+		if (s->rev.fastsetup && s->rev.thparent == NULL && s->rev.nthctx == 0)
 			fill_nncell(s, mi, ix);		/* Fill on-demand */
 		if (*rpp == NULL)
 			rpp = s->rev.rev + ix;		/* fall back to in-gamut lookup */ 
@@ -2588,6 +2786,7 @@ static int exact_compute(schbase *b, simplex *x) {
 		b->nsoln++;
 	if (wsrv == 2)					/* Is above (disabled) ink limit */
 		b->iclip = 1;
+	s->rev.hintcell = x->ix;		/* Start of next RSPL_HINT search */
 	return 0;
 }
 
@@ -2806,6 +3005,7 @@ static int auxil_compute(schbase *b, simplex *x) {
 	b->iabove = nabove;
 	b->nsoln = 1;
 	b->pauxcell = x->ix;
+	s->rev.hintcell = x->ix;		/* Start of next RSPL_HINT search */
 	if (wsrv == 2)					/* Is above (disabled) ink limit */
 		b->iclip = 1;
 
@@ -6103,6 +6303,7 @@ revcache *rc		/* Reverse cache structure */
 	
 	/* If it has been used before, free up the simplexes */
 	free_cell_contents(cp);
+	rc->s->rev.ch_evict++;
 
 	/* Remove from current hash index (if it is in it) */
 	hash = HASH(rc,cp->ix);			/* Old hash */
@@ -6173,6 +6374,7 @@ int force			/* if nz, force memory allocation, so that we have at least one fxce
 	for (cp = rc->hashtop[hash]; cp != NULL; cp = cp->hlink) {
 		if (ix == cp->ix) {	/* Hit */
 			hit = 1;
+			rc->s->rev.ch_hits++;
 #ifdef STATS
 			rc->s->rev.st[rc->s->rev.sb->op].chits++;
 #endif /* STATS */
@@ -6205,6 +6407,7 @@ int force			/* if nz, force memory allocation, so that we have at least one fxce
 	
 				/* If it has been used before, free up the simplexes */
 				free_cell_contents(cp);
+				rc->s->rev.ch_evict++;
 
 				/* Remove from current hash index (if it is in it) */
 				ohash = HASH(rc,cp->ix);			/* Old hash */
@@ -6242,6 +6445,7 @@ int force			/* if nz, force memory allocation, so that we have at least one fxce
 			}
 		}
 
+		rc->s->rev.ch_miss++;
 #ifdef STATS
 		rc->s->rev.st[rc->s->rev.sb->op].cmiss++;
 #endif /* STATS */
@@ -6300,6 +6504,7 @@ static void free_sharelist(rspl *s);
 static void free_indexlist(rspl *s, int **rp);
 static void free_surfhash(rspl *s, int del);
 static void free_surflist(rspl *s);
+static void free_revkd(rspl *s);
 
 /* Called by rspl initialisation */
 /* Note that fxcell lookup tables are not */
@@ -6317,20 +6522,32 @@ init_rev(rspl *s) {
 	/* Second section */
 	s->rev.rev_valid = 0;
 	s->rev.nnrev = NULL;
+	s->rev.revkd = NULL;
+	s->rev.revkdno = 0;
 
 	/* Third section */
 	s->rev.cache = NULL;
 
 	/* Fourth section */
 	s->rev.sb = NULL;
+	s->rev.hintcell = -1;
+
+	/* Thread contexts */
+	s->rev.thparent = NULL;
+	s->rev.nthctx = 0;
+	s->rev.thtouch = NULL;
 
 	/* Methods */
 	s->rev_set_limit   = rev_set_limit_rspl;
 	s->rev_get_limit   = rev_get_limit_rspl;
 	s->rev_set_lchw    = rev_set_lchw;
+	s->rev_hint        = rev_hint_rspl;
 	s->rev_interp      = rev_interp_rspl;
 	s->rev_locus       = rev_locus_rspl;
 	s->rev_locus_segs  = rev_locus_segs_rspl;
+	s->rev_locus_n     = rev_locus_n_rspl;
+	s->rev_thread_ctx  = rev_thread_ctx_rspl;
+	s->rev_cache_stats = rev_cache_stats_rspl;
 }
 
 /* Free up all the reverse interpolation info */
@@ -6339,6 +6556,9 @@ rspl *s		/* Pointer to rspl grid */
 ) {
 	int e, di = s->di;
 	int **rpp, *rp;
+
+	if (s->rev.nthctx > 0)
+		error("rspl: reverse information freed while it has thread contexts");
 		
 #ifdef STATS
 	{
@@ -6404,6 +6624,7 @@ rspl *s		/* Pointer to rspl grid */
 		DECSZ(s, s->rev.no * sizeof(int *));
 		s->rev.nnrev = NULL;
 	}
+	free_revkd(s);
 
 	if (di > 1 && s->rev.rev_valid) {
 		rev_struct *rsi, **rsp;
@@ -6472,6 +6693,210 @@ rspl *s		/* Pointer to rspl grid */
 #endif /* CHECK_NNLU */
 }
 
+/* ====================================================== */
+/* Cache memory budget and statistics. */
+
+/* Return the explicit cache budget, 0 if none */
+static size_t rev_cache_budget(void) {
+	char *ev;
+
+	if (g_budget_ram != 0)
+		return g_budget_ram;
+
+	if ((ev = getenv("ARGYLL_REV_CACHE_MB")) != NULL) {
+		double mb, gg;
+		if ((mb = atof(ev)) >= 1.0) {		/* Make it sane */
+			gg = mb * 1000000.0 + 0.5;
+			if (gg > (double)(((size_t)0)-1))
+				gg  = (double)(((size_t)0)-1);
+			return (size_t)gg;
+		}
+	}
+	return 0;
+}
+
+void rspl_set_rev_cache_budget(size_t bytes) {
+	rev_struct *rsi;
+	size_t ram;
+
+	amutex_lock(rev_mem_lock);
+	g_budget_ram = bytes;
+
+	if (bytes != 0) {
+		g_avail_ram = bytes;
+
+		/* Re-aportion the memory, and reduce the caches to match */
+		if (g_no_rev_cache_instances > 0) {
+			ram = g_avail_ram / g_no_rev_cache_instances; 
+			for (rsi = g_rev_instances; rsi != NULL; rsi = rsi->next) {
+				revcache *rc = rsi->cache;
+		
+				if (rsi->nthctx > 0)		/* Cache may be in use by another thread */
+					continue;
+				rsi->max_sz = ram;
+				while (rc->nunlocked > 0 && rsi->sz > rsi->max_sz) {
+					if (decrease_revcache(rc) == 0)
+						break;
+				}
+			}
+		}
+	}
+	amutex_unlock(rev_mem_lock);
+}
+
+size_t rspl_get_rev_cache_budget(void) {
+	size_t rv;
+
+	amutex_lock(rev_mem_lock);
+	rv = g_avail_ram;
+	amutex_unlock(rev_mem_lock);
+
+	return rv;
+}
+
+/* Return the cache statistics */
+static void rev_cache_stats_rspl(
+rspl *s,			/* this */
+rspl_rcstats *st,	/* Return the statistics */
+int reset			/* nz to reset counters after returning them */
+) {
+	st->sz = s->rev.sz;
+	st->max_sz = s->rev.max_sz;
+	st->peak_sz = s->rev.peak_sz;
+	st->ncells = s->rev.cache != NULL ? s->rev.cache->nacells : 0;
+	st->hits = s->rev.ch_hits;
+	st->misses = s->rev.ch_miss;
+	st->evicts = s->rev.ch_evict;
+
+	if (reset) {
+		s->rev.peak_sz = s->rev.sz;
+		s->rev.ch_hits = s->rev.ch_miss = s->rev.ch_evict = 0;
+	}
+}
+
+/* ====================================================== */
+/* Thread contexts. */
+
+/* A thread context is a copy of the rspl that shares everything except */
+/* the search base, fxcell/simplex cache and fwd cell touched flags, */
+/* so the reverse search code can use it unchanged. So that the shared */
+/* structures are never written to by a search, they are all completed */
+/* before the context is created. */
+
+/* The next touch generation count for a context */
+static unsigned int rev_thr_next_touch(
+rspl *s
+) {
+	unsigned int tg;
+
+	if ((tg = ++s->g.touch) == 0) {
+		memset((void *)s->rev.thtouch, 0, s->g.no * sizeof(unsigned int));
+		tg = ++s->g.touch;		/* return 1 */
+	}
+	return tg;
+}
+
+/* Setting the limit or LCh weighting would invalidate the shared information */
+static void rev_thr_set_limit(rspl *s, double (*limit)(void *lcntx, double *in),
+                              void *lcntx, double limitv) {
+	error("rspl: rev_set_limit can't be called on a thread context");
+}
+
+static void rev_thr_set_lchw(rspl *s, double lchw[MXRO]) {
+	error("rspl: rev_set_lchw can't be called on a thread context");
+}
+
+/* Free a thread context */
+static void rev_thr_del(
+rspl *s
+) {
+	if (s->rev.sb != NULL)
+		free_search(s->rev.sb);
+	if (s->rev.cache != NULL)
+		free_revcache(s->rev.cache);
+	free(s->rev.thtouch);
+	s->rev.thparent->rev.nthctx--;
+	free((void *)s);
+}
+
+/* Create a reverse interpolation context for another thread */
+static rspl *rev_thread_ctx_rspl(
+rspl *s,	/* this */
+int nctx	/* Total number of contexts that will be created */
+) {
+	rspl *t;
+
+	/* This is a restricted size function */
+	if (s->di > MXRI)
+		error("rspl: rev_thread_ctx can't handle di = %d",s->di);
+	if (s->fdi > MXRO)
+		error("rspl: rev_thread_ctx can't handle fdi = %d",s->fdi);
+
+	if (s->rev.thparent != NULL)		/* Context of a context */
+		s = s->rev.thparent;
+
+	/* Complete all the shared reverse information now, */
+	/* rather than on demand. */
+	if (s->rev.inited == 0)
+		make_rev(s);
+	if (s->rev.fastsetup) {			/* nnrev[] would be filled on demand */
+		s->rev.fastsetup = 0;
+		if (s->rev.rev_valid)
+			invalidate_revaccell(s);
+	}
+	if (s->rev.rev_valid == 0)
+		init_revaccell(s);
+
+	if (s->limitf != NULL) {		/* Cache all the ink limit values in the grid */
+		int i, e, di = s->di;
+		float *gp;
+		ECOUNT(gc, MXDIDO, s->di, 0, s->g.res, 0);    /* coordinates */
+		double iv[MXDI];				/* Input value corresponding to grid */
+
+		EC_INIT(gc);
+		for (i = 0, gp = s->g.a; i < s->g.no; i++, gp += s->g.pss) {
+			if (gp[-1] == L_UNINIT) {
+				for (e = 0; e < di; e++)
+					iv[e] = s->g.l[e] + gc[e] * s->g.w[e];  /* Input sample values */
+				gp[-1] = (float)(INKSCALE * s->limitf(s->lcntx, iv));
+			}
+			EC_INC(gc);
+		}
+		s->g.limitv_cached = 1;
+	}
+	s->get_out_scale(s);			/* Make sure output range is valid */
+
+	if ((t = (rspl *)malloc(sizeof(rspl))) == NULL)
+		return NULL;
+	*t = *s;
+
+	t->rev.thparent = s;
+	t->rev.nthctx = 0;
+	t->rev.next = NULL;
+	t->rev.sb = NULL;
+	t->rev.hintcell = -1;
+	t->rev.stouch = 0;
+	t->rev.sz = t->rev.peak_sz = 0;
+	t->rev.ch_hits = t->rev.ch_miss = t->rev.ch_evict = 0;
+	if (nctx < 1)
+		nctx = 1;
+	t->rev.max_sz = s->rev.max_sz / (nctx + 1);	/* Share of our cache memory */
+	t->g.touch = 0;
+	if ((t->rev.thtouch = (unsigned int *)calloc(s->g.no, sizeof(unsigned int))) == NULL) {
+		free((void *)t);
+		return NULL;
+	}
+	t->rev.cache = alloc_revcache(t);
+
+	t->del = rev_thr_del;
+	t->get_next_touch = rev_thr_next_touch;
+	t->rev_set_limit = rev_thr_set_limit;
+	t->rev_set_lchw = rev_thr_set_lchw;
+
+	s->rev.nthctx++;
+
+	return t;
+}
 
 /* ========================================================== */
 /* reverse lookup acceleration structure initialisation code. */
@@ -7647,6 +8072,7 @@ double emax			/* smallest emax in solution list */
 	int *dp = NULL, *sp;
 	double *eminlist;
 	unsigned int hashk;
+	unsigned int tcount;
 
 	DBG(("create_nnrev_list: di %d target cell ix %d co[] %s emax = %f\n",s->di, tx->ix,debPiv(s->fdi, tx->gc),emax));
 
@@ -7681,7 +8107,11 @@ double emax			/* smallest emax in solution list */
 #endif
 
 	/* Create an initial list of fwd cells from all bxcells */
-	/* on the solution list that have ->emin <= emax */
+	/* on the solution list that have ->emin <= emax. */
+	/* The bxcell lists overlap heavily, so use the fwd cell touch */
+	/* flags to only add each fwd cell once, rather than sorting */
+	/* out the duplicates later. */
+	tcount = s->get_next_touch(s);
 	for (bx = ss; bx != NULL; bx = bx->tlist) {
 //printf("~1 checking solution cell ix %d co %s\n",bx->ix,debPiv(s->fdi, bx->gc));
 		if (bx->emin <= emax) {
@@ -7689,8 +8119,13 @@ double emax			/* smallest emax in solution list */
 			sp = bx->sl;
 			if (sp == NULL)
 				error("rev create_nnrev_list: found empty surface bxcell %d",ss->ix);
-			for (sp += 3; *sp != -1; sp++)
+			for (sp += 3; *sp != -1; sp++) {
+				float *fcb = s->g.a + *sp * s->g.pss;
+				if (REV_TOUCHF(s, *sp, fcb) == tcount)
+					continue;
+				REV_TOUCHF(s, *sp, fcb) = tcount;
 				add2indexlist(s, &dp, *sp, 0);
+			}
 		}
 	}
 
@@ -7714,21 +8149,6 @@ double emax			/* smallest emax in solution list */
 		printf("  %d: ix %d\n",i-3,dp[i]);
 #endif
 
-	/* Delete any duplicates */
-	for (i = 3, j = i+1; ; j++) {
-		if (dp[i] != dp[j])
-			dp[++i] = dp[j];
-		if (dp[j] == -1)
-			break;
-	}
-	dp[1] = i;
-
-#ifdef DEBUG2
-	printf(" After de-duplication (length %d, alloc %d):\n",dp[1],dp[0]);
-	for (i = 3; dp[i] != -1; i++)
-		printf("  %d: ix %d\n",i-3,dp[i]);
-#endif
-
 	/* Filter fwd cells against emin/emax. */
 	/* (Don't bother for 1D, as there's no point in filling up the cache */
 	/* at this point, since 1D ins't participating in RAM management ?) */
@@ -8013,6 +8433,234 @@ double emax			/* smallest emax in solution list */
 	DBG(("create_nnrev_list done, total fwd cells = %d\n",s->rev.nnrev[tx->ix][1]-3));
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* k-d tree index of the non-empty rev[] cells, used to locate the */
+/* fill_nncell() search seed in logarithmic rather than linear time. */
+/* The tree is implicit - each sub-range of the index array is split */
+/* at its median, cycling through the bwd dimensions with depth, and */
+/* is built once per rev[] setup, with the lower sub-trees built in parallel. */
+
+#define REVKD_LEAF 8		/* Sub-ranges this size or smaller are searched linearly */
+
+/* Context for building the k-d tree */
+typedef struct {
+	rspl *s;
+	int nsr;					/* Number of sub-ranges to build in parallel */
+	int lo[NUMTHR_MAX], hi[NUMTHR_MAX], dp[NUMTHR_MAX];	/* sub-ranges and their depth */
+} revkd_ctx;
+
+/* Swap two k-d tree entries */
+static void revkd_swap(int *kix, int *kco, int fdi, int i, int j) {
+	int f, tt;
+
+	tt = kix[i]; kix[i] = kix[j]; kix[j] = tt;
+	for (f = 0; f < fdi; f++) {
+		tt = kco[i * fdi + f]; kco[i * fdi + f] = kco[j * fdi + f]; kco[j * fdi + f] = tt;
+	}
+}
+
+/* Partition kix[lo..hi-1] about its median in dimension d, */
+/* so that entries before the median are <= it and those after are >= it. */
+static void revkd_select(int *kix, int *kco, int fdi, int lo, int hi, int d) {
+	int m = (lo + hi)/2;
+
+	hi--;
+	while (lo < hi) {
+		int i, j, pv;
+
+		pv = kco[((lo + hi)/2) * fdi + d];
+		for (i = lo, j = hi; i <= j;) {
+			while (kco[i * fdi + d] < pv)
+				i++;
+			while (kco[j * fdi + d] > pv)
+				j--;
+			if (i <= j)
+				revkd_swap(kix, kco, fdi, i++, j--);
+		}
+		if (m <= j)
+			hi = j;
+		else if (m >= i)
+			lo = i;
+		else
+			break;
+	}
+}
+
+/* Build the sub-tree kix[lo..hi-1] at depth dp. */
+/* If bc != NULL, stop at depth bd and record the sub-ranges in it instead. */
+static void revkd_build(rspl *s, int lo, int hi, int dp, revkd_ctx *bc, int bd) {
+	int fdi = s->fdi;
+	int *kix = s->rev.revkd, *kco = s->rev.revkd + s->rev.revkdno;
+
+	for (;;) {
+		int m = (lo + hi)/2;
+
+		if (bc != NULL && dp >= bd) {
+			bc->lo[bc->nsr] = lo;
+			bc->hi[bc->nsr] = hi;
+			bc->dp[bc->nsr] = dp;
+			bc->nsr++;
+			return;
+		}
+		if ((hi - lo) <= REVKD_LEAF)
+			return;
+		revkd_select(kix, kco, fdi, lo, hi, dp % fdi);
+		revkd_build(s, lo, m, dp+1, bc, bd);
+		lo = m + 1;
+		dp++;
+	}
+}
+
+/* Build every nth sub-range, starting with ix */
+static int revkd_build_thr(void *cntx, int ix, int nth) {
+	revkd_ctx *x = (revkd_ctx *)cntx;
+	int j;
+
+	for (j = ix; j < x->nsr; j += nth)
+		revkd_build(x->s, x->lo[j], x->hi[j], x->dp[j], NULL, 0);
+	return 0;
+}
+
+/* Free the k-d tree */
+static void free_revkd(rspl *s) {
+	if (s->rev.revkd != NULL) {
+		free(s->rev.revkd);
+		DECSZ(s, s->rev.revkdno * (1 + s->fdi) * sizeof(int));
+		s->rev.revkd = NULL;
+		s->rev.revkdno = 0;
+	}
+}
+
+/* Create the k-d tree from the current rev[] */
+static void create_revkd(rspl *s) {
+	int f, fdi = s->fdi;
+	DCOUNT(gg, MXRO, fdi, 0, 0, s->rev.res);
+	int i, n, *kix, *kco;
+	int nth;
+
+	free_revkd(s);
+
+	for (n = i = 0; i < s->rev.no; i++) {
+		if (s->rev.rev[i] != NULL)
+			n++;
+	}
+	if (n == 0)
+		return;
+
+	if ((s->rev.revkd = (int *) rev_malloc(s, n * (1 + fdi) * sizeof(int))) == NULL)
+		error("rspl malloc failed - rev k-d tree");
+	INCSZ(s, n * (1 + fdi) * sizeof(int));
+	s->rev.revkdno = n;
+	kix = s->rev.revkd;
+	kco = s->rev.revkd + n;
+
+	DC_INIT(gg);
+	for (n = i = 0; i < s->rev.no; i++) {
+		if (s->rev.rev[i] != NULL) {
+			kix[n] = i;
+			for (f = 0; f < fdi; f++)
+				kco[n * fdi + f] = gg[f];
+			n++;
+		}
+		DC_INC(gg);
+	}
+
+	/* Split the top levels in this thread, then build */
+	/* the resulting sub-trees in parallel. */
+	if ((nth = num_threads()) > 1 && n >= (64 * REVKD_LEAF)) {
+		revkd_ctx bc;
+		int bd;
+
+		for (bd = 0; (1 << bd) < nth && (1 << (bd+1)) <= NUMTHR_MAX; bd++)
+			;
+		bc.s = s;
+		bc.nsr = 0;
+		revkd_build(s, 0, n, 0, &bc, bd);
+		par_exec(nth < bc.nsr ? nth : bc.nsr, revkd_build_thr, (void *)&bc);
+	} else {
+		revkd_build(s, 0, n, 0, NULL, 0);
+	}
+}
+
+/* Search the sub-tree kix[lo..hi-1] at depth dp for the cell closest */
+/* to co[], updating *bdist and *bix. Ties are resolved in favour of */
+/* the smallest rev[] index, so that the result is the same as a linear search. */
+static void revkd_search(rspl *s, int *co, int lo, int hi, int dp, int *bdist, int *bi) {
+	int f, fdi = s->fdi;
+	int *kix = s->rev.revkd, *kco = s->rev.revkd + s->rev.revkdno;
+
+	for (;;) {
+		int i, m, d, tt;
+
+		if ((hi - lo) <= REVKD_LEAF) {
+			for (i = lo; i < hi; i++) {
+				int dist;
+				for (dist = 0, f = 0; f < fdi; f++) {
+					tt = co[f] - kco[i * fdi + f];
+					dist += tt * tt;
+				}
+				if (dist < *bdist || (dist == *bdist && kix[i] < kix[*bi])) {
+					*bdist = dist;
+					*bi = i;
+				}
+			}
+			return;
+		}
+
+		m = (lo + hi)/2;
+		d = dp % fdi;
+
+		/* Check the median entry */
+		{
+			int dist;
+			for (dist = 0, f = 0; f < fdi; f++) {
+				tt = co[f] - kco[m * fdi + f];
+				dist += tt * tt;
+			}
+			if (dist < *bdist || (dist == *bdist && kix[m] < kix[*bi])) {
+				*bdist = dist;
+				*bi = m;
+			}
+		}
+
+		/* Search the nearer side, then the further side if it could */
+		/* contain one as close. */
+		tt = co[d] - kco[m * fdi + d];
+		if (tt < 0) {
+			revkd_search(s, co, lo, m, dp+1, bdist, bi);
+			if ((tt * tt) > *bdist)
+				return;
+			lo = m + 1;
+		} else {
+			revkd_search(s, co, m+1, hi, dp+1, bdist, bi);
+			if ((tt * tt) > *bdist)
+				return;
+			hi = m;
+		}
+		dp++;
+	}
+}
+
+/* Return the index of the non-empty rev[] cell closest to */
+/* the bwd cell coordinate co[], and its coordinate in nn[]. */
+/* Return -1 if rev[] is empty. */
+static int revkd_nearest(rspl *s, int *co, int *nn) {
+	int f, fdi = s->fdi;
+	int bdist = 0x7fffffff, bi = -1;
+
+	if (s->rev.revkd == NULL)
+		create_revkd(s);
+	if (s->rev.revkdno == 0)
+		return -1;
+
+	bi = 0;
+	revkd_search(s, co, 0, s->rev.revkdno, 0, &bdist, &bi);
+
+	for (f = 0; f < fdi; f++)
+		nn[f] = s->rev.revkd[s->rev.revkdno + bi * fdi + f];
+	return s->rev.revkd[bi];
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /* This is the routine used to fill nnrev[] cells on demand, */
 /* because s->rev.fastsetup is set. */
@@ -8024,9 +8672,7 @@ static void fill_nncell(
 	int ix		/* Index of cell to be filled */
 ) {
 	int f, fdi = s->fdi;
-	DCOUNT(gg, MXRO, fdi, 0, 0, s->rev.res);	/* search seed coordinate */
 	int i, six = -1, nn[MXRO];
-	double bdist = 1e200;
 	bxcell *tx, *ss;
 	DCOUNT(cc, MXRO, fdi, -1, -1, 2);	/* bwd neighborhood offset counter */
 	int nix;						/* Neighbor offset index */
@@ -8041,25 +8687,9 @@ static void fill_nncell(
 	create_surfhash(s);
 
 	/* Locate a starting search cell. */
-	/* We use a simple full search of rev[] for the cell */
+	/* We use the k-d tree of rev[] to find the cell */
 	/* closest to our target. */
-	DC_INIT(gg);
-	for (i = 0; i < s->rev.no; i++) {
-		if (s->rev.rev[i] != NULL) {
-			double dist;
-			for (dist = 0.0, f = 0; f < fdi; f++) {
-				double tt = co[f] - gg[f];
-				dist += tt * tt;
-			}
-			if (dist < bdist) {
-				bdist = dist; 
-				six = i;
-				for (f = 0; f < fdi; f++)
-					nn[f] = gg[f];
-			}
-		}
-		DC_INC(gg);
-	}
+	six = revkd_nearest(s, co, nn);
 	if (six < 0)
 		error("fill_nncell: rev[] is empty");
 
@@ -11864,6 +12494,7 @@ rspl *s		/* Pointer to rspl grid */
 				free_indexlist(s, rpp);
 		}
 	}
+	free_revkd(s);
 
 	if (di > 1 && s->rev.rev_valid) {
 		rev_struct *rsi, **rsp;
@@ -12288,6 +12919,7 @@ rspl *s
 	char *ev;
 	size_t avail_ram = 256 * 1024 * 1024;	/* Default assumed RAM in the system */
 	size_t ram1, ram2;						/* First Gig and rest */
+	size_t budget;							/* Explicit budget */
 	static int repsr = 0;					/* Have we reported system RAM size ? */
 	size_t max_vmem = 0;
 
@@ -12296,7 +12928,11 @@ rspl *s
 	/* Figure out how much RAM we can use for the rev cache. */
 	/* (We compute this for each rev instance, to account for any VM */
 	/* limit changes due to intervening allocations) */
-	if (di > 1 || g_avail_ram == 0) {
+	/* An explicit budget overrides this. */
+	if ((budget = rev_cache_budget()) != 0) {
+		g_avail_ram = budget;
+
+	} else if (di > 1 || g_avail_ram == 0) {
 	#ifdef NT 
 		{
 			BOOL (WINAPI* pGlobalMemoryStatusEx)(MEMORYSTATUSEX *) = NULL;
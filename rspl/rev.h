@@ -452,6 +452,12 @@ struct _rev_struct {
 	struct _rev_struct *next;	/* Linked list of global instances sharing memory */
 	size_t max_sz;		/* Maximum size permitted */
 	size_t sz;			/* Total memory current allocated by rev */
+	size_t peak_sz;		/* Largest value sz has had */
+
+	/* fxcell cache counters, returned by rev_cache_stats() */
+	unsigned long ch_hits;		/* Cache hits */
+	unsigned long ch_miss;		/* Cache misses */
+	unsigned long ch_evict;		/* Cells evicted to stay within max_sz */
 
 #ifdef NEVER
 	int thissz, lastsz;	/* Debug reporting */
@@ -486,6 +492,11 @@ struct _rev_struct {
 	int surf_hash_size;	/* Current size of bxcell hash list */
 	bxcell **surfhash;	/* bxcell hash index list */
 
+	int *revkd;			/* k-d tree of non-empty rev[] cells, used to seed fill_nncell(). */
+						/* [revkdno] rev[] indexes followed by [revkdno][fdi] coordinates. */
+						/* NULL until needed. */
+	int revkdno;		/* Number of entries in revkd */
+
 	int **sharelist;	/* Array of pointers to shared (fwd grid list sharer) records. */ 
 						/* Each record is same format as rev[]/nnrev[], except */
 						/* [2] is used to detect scanning the same list. */
@@ -500,6 +511,7 @@ struct _rev_struct {
 	/* Fourth section */
 	/* Has been initialise if sb != NULL */
 	schbase *sb;		/* Structure holding calculated per-search call information */
+	int hintcell;		/* Fwd cell index to search first with RSPL_HINT, -1 if none */
 
 	unsigned int stouch; /* Simplex touch count to avoid searching shared simplexs twice */
 #ifdef STATS
@@ -508,6 +520,11 @@ struct _rev_struct {
 
 	int primsecwarn;	/* Not primary or secondary warning has been issued */
 
+	/* Thread context support */
+	struct _rspl *thparent;	/* rspl this is a thread context of, NULL if not a context */
+	int nthctx;			/* Number of thread contexts created from this rspl */
+	unsigned int *thtouch;	/* Context private fwd cell touched flags [g.no] */
+
 #ifdef CHECK_NNLU
 int cknn_no;			/* Number checked */
 double cknn_we;			/* Worst DE */
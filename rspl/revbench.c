@@ -1,6 +1,6 @@
 
 /************************************************/
-/* Benchmark RSPL reverse lookup                */ 
+/* Benchmark RSPL reverse lookup                */
 /************************************************/
 
 /* Author: Graeme Gill
@@ -12,103 +12,170 @@
  * see the License.txt file for licencing details.
  */
 
+/*
+ * Sweeps combinations of input dimension, forward grid resolution,
+ * ink limit and type of reverse search, and reports the throughput,
+ * fxcell cache behaviour and peak memory of each as comma separated
+ * values, one line per combination, suitable for reading into a
+ * spreadsheet or comparing between runs.
+ *
+ * The search types are:
+ *
+ *  exact  Exact match to the target, with any auxiliary inputs at a fixed value.
+ *  aux    Exact match, with the auxiliary inputs at the middle of their locus.
+ *  clipv  As aux, clipping out of gamut targets along a vector to the center.
+ *  clipn  As aux, clipping out of gamut targets to the nearest point.
+ *
+ * The forward function is a dummy device with 3 colorant inputs plus 0 or more
+ * black like inputs, and 3 outputs. The inputs beyond the first 3 are the
+ * auxiliaries, so aux is the same as exact for 3 input dimensions, and is skipped.
+ * (Reverse lookup is restricted to MXRI inputs, so higher dimensions, such as 6
+ * colorant devices, can only be benchmarked if it is increased.)
+ * A fresh rspl is used for each measurement, so that the setup time (the time
+ * taken by the first lookup) can be reported separately from the lookup rate.
+ */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
 #include <fcntl.h>
 #include <math.h>
-#include <time.h>
 #include "copyright.h"
 #include "aconfig.h"
 #include "rspl.h"
 #include "numlib.h"
-//#include "ui.h"
-
-#undef DOLIMIT			/* Define to have ink limit */
-#define LIMITVAL 2.5	/* Total ink limit sum */
-#undef DOCHECK
-#define TESTNN			/* Test Nearest Clipping */
-
-#define SHOW_OUTPUT		/* Define for printf on each conversion */
 
-/* 11, 19 give about 60 seconds */
-#define GRES 17			/* Default grid resolution */
-#define RRES 43			/* Default reverse test resolution */
-#define DI 4			/* Dimensions in */
+#define MAXLIST 20
+#define RRES 17			/* Default reverse test resolution */
 #define FDI 3			/* Function (out) Dimensions */
 #define NIP 10			/* Number of solutions allowed */
+#define LIMITR 0.625	/* Total ink limit as a proportion of the number of inputs */
 
 #define flimit(vv) ((vv) < 0.0 ? 0.0 : ((vv) > 1.0 ? 1.0 : (vv)))
-#define fmin(a,b) ((a) < (b) ? (a) : (b))
-#define fmin3(a,b,c)  (fmin((a), fmin((b),(c))))
-#define fmax(a,b) ((a) > (b) ? (a) : (b))
-#define fmax3(a,b,c)  (fmax((a), fmax((b),(c))))
+
+/* Search types */
+#define S_EXACT 0
+#define S_AUX   1
+#define S_CLIPV 2
+#define S_CLIPN 3
+#define S_NO 4
+static char *snames[S_NO] = { "exact", "aux", "clipv", "clipn" };
 
 /* Fwd function approximated by rspl */
-/* Dummy cmyk->rgb conversion. This simulates our device */
+/* Dummy cmy + black(s) -> rgb conversion. This simulates our device. */
+/* Each colorant absorbs a proportion of each of r, g & b. The 4th input */
+/* is a neutral black, and any others are dark colorants, so that there */
+/* is always a locus of solutions. */
+static double absorb[6][3] = {
+	{ 0.90, 0.20, 0.05 },		/* Cyan */
+	{ 0.10, 0.85, 0.20 },		/* Magenta */
+	{ 0.02, 0.10, 0.90 },		/* Yellow */
+	{ 0.80, 0.80, 0.80 },		/* Black */
+	{ 0.70, 0.60, 0.20 },		/* Dark blue */
+	{ 0.10, 0.60, 0.70 }		/* Dark red */
+};
+
 void func(
 void *cbctx,
 double *out,
 double *in) {
-	double kk;
-	double ci = in[0];
-	double mi = in[1];
-	double yi = in[2];
-	double ki = in[3];
-	double r,g,b;
-
-	ci += ki;			/* Add black back in */
-	mi += ki;
-	yi += ki;
-	kk = fmax3(ci,mi,yi);
-	if (kk > 1.0) {
-		ci /= kk;
-		mi /= kk;
-		yi /= kk;
+	int di = *((int *)cbctx);
+	int e, f;
+
+	for (f = 0; f < FDI; f++)
+		out[f] = 1.0;
+	for (e = 0; e < di; e++) {
+		for (f = 0; f < FDI; f++)
+			out[f] *= 1.0 - absorb[e % 6][f] * flimit(in[e]);
 	}
-	r = 1.0 - ci;
-	g = 1.0 - mi;
-	b = 1.0 - yi;
-	out[0] = flimit(r);
-	out[1] = flimit(g);
-	out[2] = flimit(b);
 }
 
 /* Simplex ink limit function */
 double limitf(
 void *lcntx,
-float *in
+double *in
 ) {
+	int di = *((int *)lcntx);
 	int i;
 	double ov;
 
-	for (ov = 0.0, i = 0; i < DI; i++) {
+	for (ov = 0.0, i = 0; i < di; i++) {
 		ov += in[i];
-	} 
+	}
 	return ov;
 }
 
-
-void usage(void) {
+void usage(char *diag, ...) {
 	fprintf(stderr,"Benchmark rspl reverse, Version %s\n",ARGYLL_VERSION_STR);
-	fprintf(stderr,"usage: revbench [-f fwdres] [-r revres] [-v level] iccin iccout\n");
+	if (diag != NULL) {
+		va_list args;
+		fprintf(stderr,"  Diagnostic: ");
+		va_start(args, diag);
+		vfprintf(stderr, diag, args);
+		va_end(args);
+		fprintf(stderr,"\n");
+	}
+	fprintf(stderr,"usage: revbench [options]\n");
 	fprintf(stderr," -v            Verbose\n");
-	fprintf(stderr," -f res        Set forward grid res\n");
-	fprintf(stderr," -r res        Set reverse test res\n");
+	fprintf(stderr," -d n,n,...    Input dimensions, %d..%d (default 3,4)\n",FDI,MXRI);
+	fprintf(stderr," -f n,n,...    Forward grid resolutions (default is two typical for each dimension)\n");
+	fprintf(stderr," -s s,s,...    Searches, from exact,aux,clipv,clipn (default all)\n");
+	fprintf(stderr," -l n,n,...    Ink limit off (0) and/or on (1) (default 0,1)\n");
+	fprintf(stderr," -r res        Set reverse test resolution (default %d)\n",RRES);
+	fprintf(stderr," -F            Use fast reverse setup\n");
 	exit(1);
 }
 
+/* Parse a comma separated list of integers. Return the number found. */
+static int parse_list(int *list, char *s, char *flag) {
+	int n = 0;
+	char *cp;
+
+	for (cp = s; *cp != '\000';) {
+		if (n >= MAXLIST)
+			usage("Too many values for %s",flag);
+		if (sscanf(cp, "%d", &list[n]) != 1)
+			usage("Can't parse argument to %s",flag);
+		n++;
+		if ((cp = strchr(cp, ',')) == NULL)
+			break;
+		cp++;
+	}
+	return n;
+}
+
+/* Return the default forward grid resolutions for the given input dimension */
+static int def_res(int *list, int di) {
+	switch (di) {
+		case 1:
+		case 2:
+		case 3:
+			list[0] = 17; list[1] = 33;
+			return 2;
+		case 4:
+			list[0] = 9; list[1] = 17;
+			return 2;
+		case 5:
+			list[0] = 7; list[1] = 11;
+			return 2;
+		default:
+			list[0] = 5; list[1] = 7;
+			return 2;
+	}
+}
+
 int
 main(int argc, char *argv[]) {
 	int fa,nfa;				/* argument we're looking at */
-	int clutres = GRES;
+	int dis[MAXLIST] = { 3, 4 }, ndis = 2;
+	int ress[MAXLIST], nress = 0;
+	int srchs[MAXLIST] = { S_EXACT, S_AUX, S_CLIPV, S_CLIPN }, nsrchs = 4;
+	int lims[MAXLIST] = { 0, 1 }, nlims = 2;
 	int rres = RRES;
+	int fast = 0;
 	int verb = 0;
-	int gres[MXDI];
-	int e;
-
-	clock_t stime,ttime;
-	rspl *rss;	/* Multi-resolution regularized spline structure */
+	int dix, rix, lix, six;
 
 	error_program = argv[0];
 
@@ -130,182 +197,213 @@ main(int argc, char *argv[]) {
 			}
 
 			if (argv[fa][1] == '?')
-				usage();
+				usage(NULL);
 
 			/* Verbosity */
 			else if (argv[fa][1] == 'v' || argv[fa][1] == 'V') {
 				verb = 1;
 			}
-			else if (argv[fa][1] == 'f' || argv[fa][1] == 'F') {
+			else if (argv[fa][1] == 'd') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -d");
+				ndis = parse_list(dis, na, "-d");
+			}
+			else if (argv[fa][1] == 'f') {
 				fa = nfa;
-				if (na == NULL) usage();
-				clutres = atoi(na);
+				if (na == NULL) usage("Expect argument to -f");
+				nress = parse_list(ress, na, "-f");
+			}
+			else if (argv[fa][1] == 's') {
+				char *cp;
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -s");
+				for (nsrchs = 0, cp = na; *cp != '\000'; nsrchs++) {
+					int i, len;
+					if (nsrchs >= MAXLIST)
+						usage("Too many values for -s");
+					for (len = 0; cp[len] != '\000' && cp[len] != ','; len++)
+						;
+					for (i = 0; i < S_NO; i++) {
+						if (strlen(snames[i]) == len && strncmp(snames[i], cp, len) == 0)
+							break;
+					}
+					if (i >= S_NO)
+						usage("Unknown search type in -s");
+					srchs[nsrchs] = i;
+					if (cp[len] == '\000') {
+						nsrchs++;
+						break;
+					}
+					cp += len + 1;
+				}
+			}
+			else if (argv[fa][1] == 'l') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -l");
+				nlims = parse_list(lims, na, "-l");
 			}
 			else if (argv[fa][1] == 'r' || argv[fa][1] == 'R') {
 				fa = nfa;
-				if (na == NULL) usage();
+				if (na == NULL) usage("Expect argument to -r");
 				rres = atoi(na);
+				if (rres < 2)
+					usage("-r argument must be > 1");
+			}
+			else if (argv[fa][1] == 'F') {
+				fast = 1;
 			}
-			else 
-				usage();
+			else
+				usage("Unknown flag '%c'",argv[fa][1]);
 		} else
 			break;
 	}
 
-	printf("Started benchmark\n");
-	/* Create the object */
-	rss =  new_rspl(RSPL_NOFLAGS, DI, FDI);
-
-	for (e = 0; e < DI; e++)
-		gres[e] = clutres;
-
-	printf("Rspl allocated\n");
-	rss->set_rspl(rss, 0, (void *)NULL, func,
-	               NULL, NULL, gres, NULL, NULL);
-
-	printf("Rspl set\n");
-
-	/* Start exploring the reverse test grid */
-	{
-		int ops = 0;
-		double secs;
-		rpsh counter;
-		unsigned rcount;
-		int ii[10];
-		int f, rgres[MXDO];
-
-		int flags = 0;		/* rev hint flags */
-		co tp[NIP];			/* Test point */
-		double cvec[4];		/* Text clip vector */
-		int auxm[4];		/* Auxiliary target value valid flag */
-#ifdef DOCHECK
-		int j;
-#endif
-#ifdef NEVER
-		double lmin[4], lmax[4];	/* Locus min/max values */
-#endif
-
-#ifdef DOCHECK
-		char *check;		/* Check that we hit every cell */
-#endif /* DOCHECK */
-
-		/* Set auxiliary target mask */
-		auxm[0] = 0;
-		auxm[1] = 0;
-		auxm[2] = 0;
-		auxm[3] = 1;
-
-#ifdef DOLIMIT
-		rss->rev_set_limit(rss,
-			limitf,
-			NULL,
-			LIMITVAL	/* limit maximum value */
-		);
-#endif /* DOLIMIT */
-
-		printf("Forward resolution %d\n",clutres);
-		printf("Reverse resolution %d\n",rres);
-
-#ifdef DOCHECK
-		if ((check = (char *)calloc(1, rcount)) == NULL)
-			error("Malloc of check array\n");
-#endif /* DOCHECK */
-
-		for (f = 0; f < FDI; f++)
-			rgres[f] = rres;
-
-		rcount = rpsh_init(&counter, FDI, (unsigned int *)rgres, ii);	/* Initialise counter */
-		
-		stime = clock();
-
-#ifdef TESTNN
-		flags |= RSPL_NEARCLIP;
-#endif
-		/* Itterate though the grid */
-		for (ops = 0;; ops++) {
-			int r;
-			int e;			/* Table index */
-	
-#ifdef DOCHECK
-			check[((ii[2] * rres + ii[1]) * rres) + ii[0]] = 1;
-#endif /* DOCHECK */
-
-			for (e = 0; e < FDI; e++) { 	/* Input tables */
-				tp[0].v[e] = ii[e]/(rres-1.0);		/* Vertex coordinates */
-			}
-	
-			if (verb)
-				printf("Input = %f %f %f\n",tp[0].v[0], tp[0].v[1], tp[0].v[2]);
-
-#ifdef NEVER	/* Do locus lookup explicitly ? */
-			/* Lookup the locus for the auxiliary (Black) chanel */
-			if ((r = rss->rev_locus(rss,
-				auxm, 	/* auxm Auxiliary mask flags */
-				tp,		/* Input and auxiliary values */
-				lmin,	/* Locus min/max return values */
-				lmax
-				)) == 0) {
-				/* Rev locus failed - means that it will clip ? */
-				tp[0].p[3] = 0.5;
-				flags = RSPL_WILLCLIP;	/* Since there was no locus, we expect to clip */
-			} else {
-				/* Set the auxiliary target */
-				tp[0].p[3] = (lmin[3] + lmax[3])/2.0;
-				flags = RSPL_EXACTAUX;	/* Since we got locus, expect exact auxiliary match */
-			}
-#else
-				tp[0].p[3] = 0.5;
-				flags = RSPL_AUXLOCUS;	/* Auxiliary target is proportion of locus */
-#endif	/* NEVER */
-
-			/* Clip vector to 0.5 */
-			cvec[0] = 0.5 - tp[0].v[0];
-			cvec[1] = 0.5 - tp[0].v[1];
-			cvec[2] = 0.5 - tp[0].v[2];
-			cvec[3] = 0.5 - tp[0].v[3];
-
-			/* Do reverse interpolation */
-			if ((r = rss->rev_interp(rss,
-				flags,	/* Hint flags */
-				NIP,	/* Number of solutions allowed */
-				auxm, 	/* auxm Auxiliary mask flags */
-				cvec, 	/* cvec Clip vector direction & length */
-				tp)		/* Input and output values */
-				) == 0) {
-				error("rev_interp failed\n");
-			}
-			
-			r &= RSPL_NOSOLNS;		/* Get number of solutions */
-
-			if (verb)
-				printf("Output 1 of %d: %f, %f, %f, %f%s\n",
-				  r & RSPL_NOSOLNS, tp[0].p[0], tp[0].p[1], tp[0].p[2], tp[0].p[3],
-			      (r & RSPL_DIDCLIP) ? " [Clipped]" : "");
+	for (dix = 0; dix < ndis; dix++) {
+		if (dis[dix] < FDI || dis[dix] > MXRI)
+			error("Input dimensions must be %d..%d",FDI,MXRI);
+	}
 
+	printf("di,fres,limit,search,lookups,found,clipped,setup_sec,lookups_per_sec,hits,misses,evicts,hit_ratio,peak_mb\n");
+	fflush(stdout);
 
-			if (rpsh_inc(&counter, ii))
-				break;
+	for (dix = 0; dix < ndis; dix++) {
+		int di = dis[dix];
+		int dress[MXRI], ndress;
+		int *lress;
 
-		}		/* Next grid point */
+		if (nress > 0) {
+			lress = ress;
+			ndress = nress;
+		} else {
+			ndress = def_res(dress, di);
+			lress = dress;
+		}
 
-		ttime = clock() - stime;
-		secs = (double)ttime/CLOCKS_PER_SEC;
-		printf("Done - %d ops in %f seconds, rate = %f ops/sec\n",ops, secs,ops/secs);
-#ifdef DOCHECK
-		for (j = 0; j < rcount; j++) {
-			if (check[j] != 1) {
-				printf("~~CHeck error at %d\n",j);
+		for (rix = 0; rix < ndress; rix++) {
+			for (lix = 0; lix < nlims; lix++) {
+				for (six = 0; six < nsrchs; six++) {
+					int fres = lress[rix];
+					int srch = srchs[six];
+					int gres[MXDI];
+					int auxm[MXDI];		/* Auxiliary target value valid flag */
+					rspl *rss;
+					rspl_rcstats st;
+					double omin[MXDO], omax[MXDO];
+					rpsh counter;
+					int ii[MXDO];
+					int f, e, rgres[MXDO];
+					int ops, found = 0, clipped = 0;
+					unsigned int stime, setime = 0, ttime;
+					double rate;
+
+					if (srch == S_AUX && di <= FDI)		/* No auxiliaries */
+						continue;
+
+					/* Create the object */
+					rss = new_rspl(fast ? RSPL_FASTREVSETUP : RSPL_NOFLAGS, di, FDI);
+
+					for (e = 0; e < di; e++)
+						gres[e] = fres;
+
+					rss->set_rspl(rss, 0, (void *)&di, func,
+					               NULL, NULL, gres, NULL, NULL);
+
+					if (lims[lix])
+						rss->rev_set_limit(rss, limitf, (void *)&di, LIMITR * di);
+
+					/* Set auxiliary target mask */
+					for (e = 0; e < di; e++)
+						auxm[e] = e >= FDI ? 1 : 0;
+
+					/* Test values span the output range */
+					rss->get_out_range(rss, omin, omax);
+					for (f = 0; f < FDI; f++)
+						rgres[f] = rres;
+
+					rpsh_init(&counter, FDI, (unsigned int *)rgres, ii);	/* Initialise counter */
+
+					stime = msec_time();
+
+					/* Itterate though the grid */
+					for (ops = 0;; ops++) {
+						int r, flags = 0;
+						co tp[NIP];			/* Test point */
+						double cvec[MXDO];	/* Test clip vector */
+
+						for (f = 0; f < FDI; f++)
+							tp[0].v[f] = omin[f] + (omax[f] - omin[f]) * ii[f]/(rres-1.0);
+
+						if (srch == S_EXACT) {
+							for (e = FDI; e < di; e++)
+								tp[0].p[e] = 0.2;
+							if (di > FDI)
+								flags = RSPL_EXACTAUX;
+						} else {
+							for (e = FDI; e < di; e++)
+								tp[0].p[e] = 0.5;
+							if (di > FDI)
+								flags = RSPL_AUXLOCUS;	/* Auxiliary target is proportion of locus */
+						}
+
+						/* Clip vector to the center of the output range */
+						for (f = 0; f < FDI; f++)
+							cvec[f] = 0.5 * (omin[f] + omax[f]) - tp[0].v[f];
+
+						if (srch == S_CLIPN)
+							flags |= RSPL_NEARCLIP;
+
+						if (verb)
+							printf("Input = %f %f %f\n",tp[0].v[0], tp[0].v[1], tp[0].v[2]);
+
+						/* Do reverse interpolation */
+						r = rss->rev_interp(rss,
+							flags,					/* Hint flags */
+							NIP,					/* Number of solutions allowed */
+							di > FDI ? auxm : NULL,	/* auxm Auxiliary mask flags */
+							srch == S_CLIPV ? cvec : NULL, 	/* Clip vector */
+							tp);					/* Input and output values */
+
+						if ((r & RSPL_NOSOLNS) > 0)
+							found++;
+						if (r & RSPL_DIDCLIP)
+							clipped++;
+
+						if (verb && (r & RSPL_NOSOLNS) > 0)
+							printf("Output 1 of %d: %f, %f, %f, %f%s\n",
+							  r & RSPL_NOSOLNS, tp[0].p[0], tp[0].p[1], tp[0].p[2], tp[0].p[3],
+						      (r & RSPL_DIDCLIP) ? " [Clipped]" : "");
+
+						/* The first lookup does the reverse setup */
+						if (ops == 0) {
+							setime = msec_time() - stime;
+							stime = msec_time();
+						}
+
+						if (rpsh_inc(&counter, ii))
+							break;
+					}		/* Next grid point */
+					ops++;
+
+					ttime = msec_time() - stime;
+					if (ttime == 0)
+						ttime = 1;
+					rate = 1000.0 * (ops-1)/(double)ttime;
+
+					rss->rev_cache_stats(rss, &st, 0);
+
+					printf("%d,%d,%d,%s,%d,%d,%d,%.3f,%.1f,%lu,%lu,%lu,%.4f,%.1f\n",
+					       di, fres, lims[lix], snames[srch], ops, found, clipped,
+					       setime/1000.0, rate, st.hits, st.misses, st.evicts,
+					       (st.hits + st.misses) > 0 ? st.hits/(double)(st.hits + st.misses) : 0.0,
+					       st.peak_sz/1000000.0);
+					fflush(stdout);
+
+					rss->del(rss);
+				}
 			}
 		}
-#endif /* DOCHECK */
 	}
 
-	rss->del(rss);
 	return 0;
 }
 
-
-
-
-
-
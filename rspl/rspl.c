@@ -29,6 +29,14 @@
 #include <stdarg.h>
 #include <math.h>
 #include <time.h>
+#include <string.h>
+#ifdef UNIX
+# include <unistd.h>
+# include <fcntl.h>
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/mman.h>
+#endif
 #if defined(__IBMC__) && defined(_M_IX86)
 #include <float.h>
 #endif
@@ -54,7 +62,9 @@
 rspl *new_rspl(int flags, int di, int fdi);
 static void free_rspl(rspl *s);
 static void init_grid(rspl *s);
-static void free_grid(rspl *s);
+void free_grid(rspl *s);
+static int save_rspl(rspl *s, char *fname);
+static int load_rspl(rspl *s, char *fname);
 static void get_in_range(rspl *s, double *min, double *max);
 static void get_out_range(rspl *s, double *min, double *max);
 static void get_out_range_points(rspl *s, int *minp, int *maxp);
@@ -63,6 +73,7 @@ static unsigned int get_next_touch(rspl *s);
 static int *get_res(rspl *s);
 static int within_restrictedsize(rspl *s);
 static int interp_rspl_sx(rspl *s, co *pp);
+static int interp_batch_rspl_sx(rspl *s, co *p, int n);
 static int part_interp_rspl_sx(rspl *s, co *p1, co *p2);
 static int interp_rspl_nl(rspl *s, co *p);
 int is_mono(rspl *s);
@@ -170,6 +181,7 @@ new_rspl(
 printf("!!!! rspl.c using interp_rspl_nl !!!!");
 	s->interp        = interp_rspl_nl;
 #endif
+	s->interp_batch  = interp_batch_rspl_sx;
 	s->part_interp   = part_interp_rspl_sx;
 	s->set_rspl      = set_rspl;
 	s->scan_rspl     = scan_rspl;
@@ -177,6 +189,8 @@ printf("!!!! rspl.c using interp_rspl_nl !!!!");
 	s->tune_value    = tune_value;
 	s->opt_rspl      = opt_rspl_imp;
 	s->filter_rspl   = filter_rspl;
+	s->save_rspl     = save_rspl;
+	s->load_rspl     = load_rspl;
 	s->get_in_range  = get_in_range;
 	s->get_out_range = get_out_range;
 	s->get_out_range_points = get_out_range_points;
@@ -213,18 +227,13 @@ static void free_rspl(rspl *s) {
 }
 
 /* ======================================================== */
-/* Allocate rspl grid data, and initialise grid associated stuff */
-void
-alloc_grid(rspl *s) {
+/* Compute the grid size and the offsets into the grid array */
+/* for the current resolution. */
+static void
+grid_offsets(rspl *s) {
 	int di = s->di, fdi = s->fdi;
 	int e,g,i;
 	int gno;				/* Number of points in grid */
-	ECOUNT(gc, MXDIDO, di, 0, s->g.res, 0);/* coordinates */
-	float *gp;				/* Grid point pointer */
-
-#ifdef DEBUG
-	fprintf(stderr,"rspl allocating grid res %s\n",icmPiv(di, s->g.res));
-#endif
 
 	/* Compute total number of elements in the grid */
 	for (gno = 1, e = 0; e < di; gno *= s->g.res[e], e++)
@@ -248,10 +257,59 @@ alloc_grid(rspl *s) {
 	/* same as hi, but in floats */
 	for (i = 0; i < (1 << di); i++)
 		s->g.fhi[i] = s->g.hi[i] * s->g.pss;	/* In floats */
-	
+
+	/* Simplex vertex tables for each ordering of the cell coordinates */
+	if (di == 3 || di == 4) {
+		int np = di * (di-1)/2;		/* Number of pairs compared */
+
+		for (g = 0; g < (1 << np); g++) {
+			int rank[4], j, k;
+
+			/* Count the number of dimensions each dimension is above */
+			for (e = 0; e < di; e++)
+				rank[e] = 0;
+			for (k = e = 0; e < di; e++) {
+				for (j = e+1; j < di; j++, k++) {
+					if (g & (1 << k))
+						rank[e]++;
+					else
+						rank[j]++;
+				}
+			}
+			for (e = 0; e < di; e++)
+				s->g.sxd[g][e] = e;
+			for (e = 0; e < di; e++) {
+				if (rank[e] < di)		/* (Inconsistent codes can't occur) */
+					s->g.sxd[g][di-1-rank[e]] = e;
+			}
+			for (i = e = 0; e < di; e++) {
+				i += s->g.fci[s->g.sxd[g][e]];
+				s->g.sxfo[g][e] = i;
+			}
+		}
+	}
+}
+
+/* Allocate rspl grid data, and initialise grid associated stuff */
+void
+alloc_grid(rspl *s) {
+	int di = s->di;
+	int e,i;
+	ECOUNT(gc, MXDIDO, di, 0, s->g.res, 0);/* coordinates */
+	float *gp;				/* Grid point pointer */
+
+#ifdef DEBUG
+	fprintf(stderr,"rspl allocating grid res %s\n",icmPiv(di, s->g.res));
+#endif
+
+	free_grid(s);			/* Free any existing grid */
+	grid_offsets(s);
+
 	/* Allocate space for grid */
-	if ((s->g.alloc = (float *) malloc(sizeof(float) * gno * s->g.pss)) == NULL)
+	s->g.asize = sizeof(float) * s->g.no * s->g.pss;
+	if ((s->g.alloc = (float *) malloc(s->g.asize)) == NULL)
 		error("rspl malloc failed - grid points");
+	a1ma_inc(a1ma_rspl, s->g.asize);
 	s->g.a = s->g.alloc + G_XTRA;	/* make -1 be nme, and -2 be (unsigned int) flags */
 
 	/* Set initial value of cell touch count */
@@ -281,19 +339,282 @@ alloc_grid(rspl *s) {
 		EC_INC(gc);
 	}
 	s->g.limitv_cached = 0;		/* No limit values are current cached */
+	s->g.limitv_loaded = 0;
 }
 
 /* Init grid related elements of rspl */
 static void
 init_grid(rspl *s) {
 	s->g.alloc = NULL;
+	s->g.asize = 0;
+	s->g.mbase = NULL;
+	s->g.msize = 0;
 }
 
 /* Free the grid allocation */
-static void
+void
 free_grid(rspl *s) {
-	if (s->g.alloc != NULL)
+	if (s->g.mbase != NULL) {	/* Grid is in a file image */
+#ifdef UNIX
+		munmap(s->g.mbase, s->g.msize);
+#else
+		free(s->g.mbase);
+#endif
+		s->g.mbase = NULL;
+		s->g.msize = 0;
+	} else if (s->g.alloc != NULL) {
 		free((void *)s->g.alloc);
+		a1ma_dec(a1ma_rspl, s->g.asize);
+	}
+	s->g.alloc = NULL;
+	s->g.asize = 0;
+	s->g.a = NULL;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - */
+/* Grid file support. */
+
+/* A grid file is a header that records the grid setup, followed by */
+/* the grid array (including the G_XTRA floats of each point), aligned */
+/* to GALIGN bytes. The file is only valid for the same build on */
+/* the same type of machine, so it is only loaded if the header matches. */
+
+#define GMAGIC "RSPLGF1"
+#define GALIGN 64
+#define GENDIAN 0x01020304		/* Check for byte order */
+
+typedef struct {
+	char magic[8];
+	int hsize;					/* sizeof(rspl_ghdr) */
+	int flsize;					/* sizeof(float) */
+	unsigned int endian;		/* GENDIAN */
+	int di, fdi;				/* Dimensionality */
+	int pss;					/* Grid point structure size */
+	int res[MXDI];				/* Grid resolution */
+	datai l, h, w;				/* Grid low, high, grid cell width */
+	datao vl, vw;				/* Data value normalisation */
+	datao fmin, fmax;			/* Grid output value range */
+	int fminx[MXDO], fmaxx[MXDO];
+	double fscale;
+	int fminmax_valid;
+	int limitv_cached;			/* Ink limit values are in the grid */
+	unsigned int touch;			/* Cell touched flag count */
+	unsigned long tsize;		/* Total file size */
+} rspl_ghdr;
+
+/* Round up to the grid alignment */
+static unsigned long galign(unsigned long off) {
+	return (off + GALIGN - 1) & ~((unsigned long)GALIGN - 1);
+}
+
+/* Save the grid to a file. */
+/* The file is written to a temporary name and then renamed, */
+/* so that other processes never see a partial file. */
+/* Return nz on error */
+static int save_rspl(
+	rspl *s,		/* this */
+	char *fname		/* File name */
+) {
+	rspl_ghdr h;
+	char *tname;
+	FILE *fp;
+	unsigned long off, gsize;
+	int e, f, rv = 0;
+	static char zbuf[GALIGN] = { 0 };
+
+	if (s->g.alloc == NULL || s->spline.spline != 0)
+		return 1;
+
+	if (s->g.fminmax_valid == 0) {	/* Save the min/max too */
+		double min[MXDO], max[MXDO];
+		s->get_out_range(s, min, max);
+	}
+
+	memset((void *)&h, 0, sizeof(rspl_ghdr));	/* Make padding repeatable */
+	strcpy(h.magic, GMAGIC);
+	h.hsize = sizeof(rspl_ghdr);
+	h.flsize = sizeof(float);
+	h.endian = GENDIAN;
+	h.di = s->di;
+	h.fdi = s->fdi;
+	h.pss = s->g.pss;
+	for (e = 0; e < s->di; e++) {
+		h.res[e] = s->g.res[e];
+		h.l[e] = s->g.l[e];
+		h.h[e] = s->g.h[e];
+		h.w[e] = s->g.w[e];
+	}
+	for (f = 0; f < s->fdi; f++) {
+		h.vl[f] = s->d.vl[f];
+		h.vw[f] = s->d.vw[f];
+		h.fmin[f] = s->g.fmin[f];
+		h.fmax[f] = s->g.fmax[f];
+		h.fminx[f] = s->g.fminx[f];
+		h.fmaxx[f] = s->g.fmaxx[f];
+	}
+	h.fscale = s->g.fscale;
+	h.fminmax_valid = s->g.fminmax_valid;
+	h.limitv_cached = s->g.limitv_cached;
+	h.touch = s->g.touch;
+
+	gsize = sizeof(float) * s->g.no * s->g.pss;
+	h.tsize = galign(galign(sizeof(rspl_ghdr)) + gsize);
+
+	if ((tname = malloc(strlen(fname) + 30)) == NULL)
+		return 1;
+#ifdef UNIX
+	sprintf(tname, "%s.%d.tmp", fname, (int)getpid());
+#else
+	sprintf(tname, "%s.tmp", fname);
+#endif
+
+	if ((fp = fopen(tname, "wb")) == NULL) {
+		free(tname);
+		return 1;
+	}
+
+	off = sizeof(rspl_ghdr);
+	if (fwrite((void *)&h, sizeof(rspl_ghdr), 1, fp) != 1
+	 || fwrite((void *)zbuf, 1, galign(off) - off, fp) != (galign(off) - off)
+	 || fwrite((void *)s->g.alloc, 1, gsize, fp) != gsize)
+		rv = 1;
+	off = galign(off) + gsize;
+	if (rv == 0 && fwrite((void *)zbuf, 1, galign(off) - off, fp) != (galign(off) - off))
+		rv = 1;
+	if (fclose(fp) != 0)
+		rv = 1;
+
+	if (rv == 0) {
+#ifndef UNIX
+		remove(fname);			/* MSWin rename() won't replace a file */
+#endif
+		if (rename(tname, fname) != 0)
+			rv = 1;
+	}
+	if (rv != 0)
+		remove(tname);
+	free(tname);
+
+	return rv;
+}
+
+/* Replace the grid with one from a file. */
+/* Return nz if the file doesn't exist or doesn't match */
+static int load_rspl(
+	rspl *s,		/* this */
+	char *fname		/* File name */
+) {
+	rspl_ghdr h;
+	char *base;
+	unsigned long size, gsize;
+	int e, f, gno;
+
+#ifdef UNIX
+	{
+		int fd;
+		struct stat sbuf;
+
+		if ((fd = open(fname, O_RDONLY)) < 0)
+			return 1;
+		if (fstat(fd, &sbuf) != 0 || sbuf.st_size < (off_t)sizeof(rspl_ghdr)) {
+			close(fd);
+			return 1;
+		}
+		size = (unsigned long)sbuf.st_size;
+		/* Private so that the grid can be modified (i.e. touch flags) */
+		/* without affecting the file or other processes. */
+		base = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (base == (char *)MAP_FAILED)
+			return 1;
+	}
+#else
+	{
+		FILE *fp;
+
+		if ((fp = fopen(fname, "rb")) == NULL)
+			return 1;
+		if (fseek(fp, 0, SEEK_END) != 0 || (long)(size = ftell(fp)) < (long)sizeof(rspl_ghdr)
+		 || fseek(fp, 0, SEEK_SET) != 0 || (base = malloc(size)) == NULL) {
+			fclose(fp);
+			return 1;
+		}
+		if (fread(base, 1, size, fp) != size) {
+			free(base);
+			fclose(fp);
+			return 1;
+		}
+		fclose(fp);
+	}
+#endif
+
+	/* Check that the header matches this rspl */
+	memcpy((void *)&h, (void *)base, sizeof(rspl_ghdr));
+	for (gno = 1, e = 0; e < s->di && e < MXDI; e++) {
+		if (h.res[e] < 2)
+			break;
+		gno *= h.res[e];
+	}
+	gsize = sizeof(float) * gno * (s->fdi + G_XTRA);
+	if (strncmp(h.magic, GMAGIC, 8) != 0
+	 || h.hsize != sizeof(rspl_ghdr)
+	 || h.flsize != sizeof(float)
+	 || h.endian != GENDIAN
+	 || h.di != s->di
+	 || h.fdi != s->fdi
+	 || h.pss != (s->fdi + G_XTRA)
+	 || e != s->di
+	 || h.tsize != size
+	 || galign(galign(sizeof(rspl_ghdr)) + gsize) != size) {
+#ifdef UNIX
+		munmap(base, size);
+#else
+		free(base);
+#endif
+		return 1;
+	}
+
+	/* Discard the existing grid and anything that depends on it */
+	free_grid(s);
+	free_data(s);
+	free_rev(s);
+
+	s->g.mbase = (void *)base;
+	s->g.msize = size;
+	s->g.alloc = (float *)(base + galign(sizeof(rspl_ghdr)));
+	s->g.a = s->g.alloc + G_XTRA;
+
+	s->g.mres = 1.0;
+	s->g.bres = 0;
+	for (e = 0; e < s->di; e++) {
+		s->g.res[e] = h.res[e];
+		s->g.mres *= h.res[e];
+		if (h.res[e] > s->g.bres) {
+			s->g.bres = h.res[e];
+			s->g.brix = e;
+		}
+		s->g.l[e] = h.l[e];
+		s->g.h[e] = h.h[e];
+		s->g.w[e] = h.w[e];
+	}
+	s->g.mres = pow(s->g.mres, 1.0/e);		/* geometric mean */
+	grid_offsets(s);
+
+	for (f = 0; f < s->fdi; f++) {
+		s->d.vl[f] = h.vl[f];
+		s->d.vw[f] = h.vw[f];
+		s->g.fmin[f] = h.fmin[f];
+		s->g.fmax[f] = h.fmax[f];
+		s->g.fminx[f] = h.fminx[f];
+		s->g.fmaxx[f] = h.fmaxx[f];
+	}
+	s->g.fscale = h.fscale;
+	s->g.fminmax_valid = h.fminmax_valid;
+	s->g.limitv_cached = h.limitv_cached;
+	s->g.limitv_loaded = h.limitv_cached;
+	s->g.touch = h.touch;
+
+	return 0;
 }
 
 /* ============================================ */
@@ -441,12 +762,28 @@ rspl *s
 // ~~999
 //int rspldb = 0;
 
-static int interp_rspl_sx(
+/* Return the index into g.sxd[] and g.sxfo[] for the cell */
+/* coordinates we[] of a 3 or 4 input cell. Each bit records whether */
+/* the lower index of a pair of dimensions has the larger value, */
+/* so that equal values are ordered consistently. */
+#define SX_CODE3(we) (((we)[0] > (we)[1])			\
+                   | (((we)[0] > (we)[2]) << 1)	\
+                   | (((we)[1] > (we)[2]) << 2))
+
+#define SX_CODE4(we) (((we)[0] > (we)[1])			\
+                   | (((we)[0] > (we)[2]) << 1)	\
+                   | (((we)[0] > (we)[3]) << 2)	\
+                   | (((we)[1] > (we)[2]) << 3)	\
+                   | (((we)[1] > (we)[3]) << 4)	\
+                   | (((we)[2] > (we)[3]) << 5))
+
+static INLINE int interp_rspl_sx_imp(
 rspl *s,
-co *p			/* Input value and returned function value */
+co *p,			/* Input value and returned function value */
+int di,			/* Input dimensions, == s->di */
+int fdi			/* Output dimensions, == s->fdi */
 ) {
-	int e, di  = s->di;
-	int f, fdi = s->fdi;
+	int e, f;
 	double we[MXDI];		/* Coordinate offset within the grid cell */
 	int    si[MXDI];		/* we[] Sort index, [0] = smallest */
 	float *gp;				/* Pointer to grid cube base */
@@ -485,6 +822,33 @@ co *p			/* Input value and returned function value */
 		DEBLU(("ix %d, we %s\n", (gp - s->g.a)/s->g.pss, icmPdv(di, p->p)));
 	}
 
+	/* 3 and 4 inputs use the vertex tables rather than sorting */
+	if (di == 3 || di == 4) {
+		int cx = di == 3 ? SX_CODE3(we) : SX_CODE4(we);
+		int *sd = s->g.sxd[cx];			/* Dimensions in decreasing we[] order */
+		int *fo = s->g.sxfo[cx];		/* Vertex offsets */
+		float *vp;
+		double w;
+
+		w = 1.0 - we[sd[0]];			/* Vertex at base of cell */
+		for (f = 0; f < fdi; f++)
+			p->v[f] = w * gp[f];
+
+		for (e = 0; e < (di-1); e++) {	/* Middle verticies */
+			w = we[sd[e]] - we[sd[e+1]];
+			vp = gp + fo[e];
+			for (f = 0; f < fdi; f++)
+				p->v[f] += w * vp[f];
+		}
+
+		w = we[sd[di-1]];
+		vp = gp + fo[di-1];				/* Far corner from base of cell */
+		for (f = 0; f < fdi; f++)
+			p->v[f] += w * vp[f];
+		DEBLU(("Outval  %s\n", icmPdv(fdi, p->v)));
+		return rv;
+	}
+
 	/* Do selection sort on coordinates */
 	{
 		for (e = 0; e < di; e++)
@@ -533,6 +897,86 @@ co *p			/* Input value and returned function value */
 	return rv;
 }
 
+static int interp_rspl_sx(
+rspl *s,
+co *p			/* Input value and returned function value */
+) {
+	/* Specialise for the common input dimensions, */
+	/* so that the per dimension loops are unrolled. */
+	switch (s->di) {
+		case 3:
+			return interp_rspl_sx_imp(s, p, 3, s->fdi);
+		case 4:
+			return interp_rspl_sx_imp(s, p, 4, s->fdi);
+		default:
+			return interp_rspl_sx_imp(s, p, s->di, s->fdi);
+	}
+}
+
+/* ============================================ */
+/* Do forward interpolation of an array of n values. */
+/* The common input and output dimension combinations use */
+/* versions of the simplex interpolation specialised for */
+/* them, so that the compiler can unroll the per channel loops. */
+/* Results are identical to interp(). */
+/* Return the number of values clipped to the grid */
+
+/* The values are interpolated in array order. Visiting a scattered */
+/* batch in the Morton order of its grid cells was tried, but the */
+/* sort and the resulting scattered access to the co[] array cost */
+/* more than the grid cache misses saved, even for grids much larger */
+/* than the cache. Regular sampling should use the rpsh pseudo-Hilbert */
+/* sequencer instead (see set_rspl()). */
+
+/* Interpolate n values with constant DI and FDI */
+#define IBATCH_SX(DI, FDI)							\
+	for (i = 0; i < n; i++)							\
+		nclip += interp_rspl_sx_imp(s, &p[i], DI, FDI);
+
+static int interp_batch_rspl_sx(
+rspl *s,
+co *p,			/* Input values and returned function values */
+int n			/* Number of values */
+) {
+	int i, nclip = 0;
+
+	if (s->interp != interp_rspl_sx) {	/* Not using simplex interpolation */
+		for (i = 0; i < n; i++)
+			nclip += s->interp(s, &p[i]) != 0;
+		return nclip;
+	}
+
+	switch ((s->di << 4) | s->fdi) {
+		case 0x13:
+			IBATCH_SX(1, 3)
+			break;
+		case 0x31:
+			IBATCH_SX(3, 1)
+			break;
+		case 0x33:
+			IBATCH_SX(3, 3)
+			break;
+		case 0x34:
+			IBATCH_SX(3, 4)
+			break;
+		case 0x41:
+			IBATCH_SX(4, 1)
+			break;
+		case 0x43:
+			IBATCH_SX(4, 3)
+			break;
+		case 0x44:
+			IBATCH_SX(4, 4)
+			break;
+		default:
+			IBATCH_SX(s->di, s->fdi)
+			break;
+	}
+	return nclip;
+}
+
+#undef IBATCH_SX
+
 /* ============================================ */
 /* Do forward (partial) interpolation to allow input & output curves to be applied, */
 /* and allow input delta E to be estimated from output delta E. */
@@ -874,6 +1318,142 @@ rspl *s
 	return min < mcinc;
 }
 
+/* ============================================ */
+/* Setting, re-setting or scanning the grid points from */
+/* a callback, possibly using multiple threads. */
+
+#define SET_RSPL_BLK 256	/* Points per block handed to each thread in turn */
+
+typedef struct {
+	rspl *s;
+	void *cbctx;		/* Opaque function context */
+	void (*func)(void *cbntx, double *out, double *in);
+	float *cc;			/* For RSPL_SET_APXLS, cell center values, NULL if not */
+	int change;			/* nz if values are to be set */
+	int scan;			/* nz if existing values are to be supplied to func() */
+} set_rspl_ctx;
+
+/* Process every nth block of points in pseudo-hilbert order. */
+/* ix is the block this thread starts with, nth the total number of threads. */
+static int set_rspl_thr(void *cntx, int ix, int nth) {
+	set_rspl_ctx *x = (set_rspl_ctx *)cntx;
+	rspl *s = x->s;
+	int e, f;
+	rpsh counter;		/* Pseudo-hilbert counter */
+	int gc[MXDI];		/* Grid index value */
+	float *gp;			/* Pointer to grid data */
+	double _iv[2 * MXDI], *iv = &_iv[MXDI];	/* Real index value/table value */
+	double ov[MXDO];
+	unsigned int k;
+
+	a1tr_begin("set_rspl fill");
+
+	/* To make this clut function cache friendly, we use the pseudo-hilbert */
+	/* count sequence. This keeps each point close to the last in the */
+	/* multi-dimensional space. When using multiple threads, each thread */
+	/* processes every nth block of the sequence. */ 
+	rpsh_init(&counter, s->di, (unsigned int *)s->g.res, gc);	/* Initialise counter */
+	for (k = 0;; k++) {
+
+		if (nth > 1 && ((k / SET_RSPL_BLK) % nth) != ix) {
+			if (rpsh_inc(&counter, gc))
+				break;
+			continue;
+		}
+
+		/* Compute grid pointer and input sample values */
+		gp = s->g.a;	/* Base of grid data */
+		for (e = 0; e < s->di; e++) { 				/* Input tables */
+			gp += s->g.fci[e] * gc[e];				/* Grid value pointer */
+			iv[e] = s->g.l[e] + gc[e] * s->g.w[e];	/* Input sample values */
+			*((int *)&iv[-e-1]) = gc[e];			/* Trick to supply grid index in iv[] */
+		}
+
+		if (x->scan) {
+			for (f = 0; f < s->fdi; f++) 	/* Output chans */
+				ov[f] = gp[f];
+		}
+
+		/* Let function scan the input and output values, or */
+		/* Apply incolor -> outcolor, or oldoutcolor->outcolor function we want to represent */
+		x->func(x->cbctx, ov, iv);
+
+		if (x->change) {		/* Put new output values back */
+			for (f = 0; f < s->fdi; f++) 	/* Output chans */
+				gp[f] = (float)ov[f];
+		}
+
+		/* For RSPL_SET_APXLS, get the center of the cell values as well. */
+		if (x->cc != NULL) {
+			float *ccp;
+
+			ccp = x->cc;
+			for (e = 0; e < s->di; e++) { 				/* Input tables */
+				if (gc[e] >=  (s->g.res[e]-1))
+					break;								/* No center for outer row */
+				iv[e] = s->g.l[e] + (gc[e] + 0.5) * s->g.w[e];	/* Input sample values */
+				ccp += gc[e] * s->g.ci[e] * s->fdi;		/* cc location */
+			}
+	
+			if (e >= s->di) {			/* Not outer row */
+				/* Apply incolor -> outcolor function we want to represent */
+				x->func(x->cbctx, ov, iv);
+	
+				for (f = 0; f < s->fdi; f++) { 	/* Output chans */
+					ccp[f] = (float)ov[f];		/* Set output value */
+				}
+			}
+		}
+
+		/* Increment counter */
+		if (rpsh_inc(&counter, gc))
+			break;
+	}
+	a1tr_end();
+	return 0;
+}
+
+/* Set the output min/max from the grid values, */
+/* scanning in the same order as they were set. */
+static void set_rspl_minmax(rspl *s) {
+	int e, f;
+	rpsh counter;		/* Pseudo-hilbert counter */
+	int gc[MXDI];		/* Grid index value */
+	float *gp;			/* Pointer to grid data */
+
+	/* Reset output min/max */
+	for (f = 0; f < s->fdi; f++) {
+		s->g.fmin[f] = 1e30;
+		s->g.fmax[f] = -1e30;
+		s->g.fminx[f] = -1;
+		s->g.fmaxx[f] = -1;
+	}
+
+	rpsh_init(&counter, s->di, (unsigned int *)s->g.res, gc);	/* Initialise counter */
+	for (;;) {
+
+		gp = s->g.a;	/* Base of grid data */
+		for (e = 0; e < s->di; e++)
+			gp += s->g.fci[e] * gc[e];				/* Grid value pointer */
+
+		for (f = 0; f < s->fdi; f++) { 	/* Output chans */
+			if (s->g.fmin[f] > gp[f]) {
+				 s->g.fmin[f] = gp[f];
+				 s->g.fminx[f] = (gp - s->g.a)/s->g.pss;
+			}
+			if (s->g.fmax[f] < gp[f]) {
+				 s->g.fmax[f] = gp[f];
+				 s->g.fmaxx[f] = (gp - s->g.a)/s->g.pss;
+			}
+		}
+
+		/* Increment counter */
+		if (rpsh_inc(&counter, gc))
+			break;
+	}
+}
+
+
 /* ============================================ */
 /* Initialize the grid from a provided function. By default the grid */
 /* values are set to exactly the value returned by func(), unless the */
@@ -897,12 +1477,9 @@ static int set_rspl(
 	datao vhigh		/* Data value high normalize - NULL = default 1.0 */
 ) {
 	int e, f, j;
-	rpsh counter;		/* Pseudo-hilbert counter */
 	int gc[MXDI];		/* Grid index value */
 	float *gp;			/* Pointer to grid data */
 	float *cc = NULL;			/* Pointer to cell center data */
-	double _iv[2 * MXDI], *iv = &_iv[MXDI];	/* Real index value/table value */
-	double ov[MXDO];
 
 	if (flags & RSPL_VERBOSE)	/* Turn on progress messages to stdout */
 		s->verbose = 1;
@@ -962,72 +1539,26 @@ static int set_rspl(
 			error("rspl malloc failed - center cell points");
 	}
 
-	/* Reset output min/max */
-	for (f = 0; f < s->fdi; f++) {
-		s->g.fmin[f] = 1e30;
-		s->g.fmax[f] = -1e30;
-		s->g.fminx[f] = -1;
-		s->g.fmaxx[f] = -1;
-	}
-
 	/* Set the grid points value from the provided function */
+	{
+		set_rspl_ctx x;
 
-	/* To make this clut function cache friendly, we use the pseudo-hilbert */
-	/* count sequence. This keeps each point close to the last in the */
-	/* multi-dimensional space. */ 
-	rpsh_init(&counter, s->di, (unsigned int *)gres, gc);	/* Initialise counter */
-	for (;;) {
-
-		/* Compute grid pointer and input sample values */
-		gp = s->g.a;	/* Base of grid data */
-		for (e = 0; e < s->di; e++) { 				/* Input tables */
-			gp += gc[e] * s->g.fci[e];				/* Grid value pointer */
-			iv[e] = s->g.l[e] + gc[e] * s->g.w[e];	/* Input sample values */
-			*((int *)&iv[-e-1]) = gc[e];			/* Trick to supply grid index in iv[] */
-		}
-
-		/* Apply incolor -> outcolor function we want to represent */
-		func(cbctx, ov, iv);
-
-		for (f = 0; f < s->fdi; f++) { 	/* Output chans */
-			gp[f] = (float)ov[f];		/* Set output value */
-			if (s->g.fmin[f] > gp[f]) {
-				 s->g.fmin[f] = gp[f];
-				 s->g.fminx[f] = (gp - s->g.a)/s->g.pss;
-			}
-			if (s->g.fmax[f] < gp[f]) {
-				 s->g.fmax[f] = gp[f];
-				 s->g.fmaxx[f] = (gp - s->g.a)/s->g.pss;
-			}
-		}
-
-		/* For RSPL_SET_APXLS, get the center of the cell values as well. */
-		if (cc != NULL) {
-			float *ccp;
-
-			ccp = cc;
-			for (e = 0; e < s->di; e++) { 				/* Input tables */
-				if (gc[e] >=  (gres[e]-1))
-					break;								/* No center for outer row */
-				iv[e] = s->g.l[e] + (gc[e] + 0.5) * s->g.w[e];	/* Input sample values */
-				ccp += gc[e] * s->g.ci[e] * s->fdi;		/* cc location */
-			}
-	
-			if (e >= s->di) {			/* Not outer row */
-				/* Apply incolor -> outcolor function we want to represent */
-				func(cbctx, ov, iv);
-	
-				for (f = 0; f < s->fdi; f++) { 	/* Output chans */
-					ccp[f] = (float)ov[f];		/* Set output value */
-				}
-			}
-		}
+		x.s = s;
+		x.cbctx = cbctx;
+		x.func = func;
+		x.cc = cc;
+		x.change = 1;
+		x.scan = 0;
 
-		/* Increment counter */
-		if (rpsh_inc(&counter, gc))
-			break;
+		if (flags & RSPL_MTHREAD)
+			par_exec(0, set_rspl_thr, (void *)&x);
+		else
+			set_rspl_thr((void *)&x, 0, 1);
 	}
 
+	/* Set the output min/max */
+	set_rspl_minmax(s);
+
 	/* For RSPL_SET_APXLS, deal with cell center value, aproximate least squares adjustment */
 	if (cc != NULL) {
 		int ee;
@@ -1141,75 +1672,35 @@ void *cbctx,	/* Opaque function context */
 void (*func)(void *cbntx, double *out, double *in), /* Function to get/set from */
 int change		/* Flag - nz means change values, 0 means scan values */
 ) {
-	int e, f;
-	rpsh counter;		/* Pseudo-hilbert counter */
-	int gc[MXDI];		/* Grid index value */
-	float *gp;			/* Pointer to grid data */
-	double _iv[2 * MXDI], *iv = &_iv[MXDI];	/* Real index value/table value */
-	double ov[MXDO];
+	int f;
+	set_rspl_ctx x;
 
 	if (flags & RSPL_VERBOSE)	/* Turn on progress messages to stdout */
 		s->verbose = 1;
 	if (flags & RSPL_NOVERBOSE)	/* Turn off progress messages to stdout */
 		s->verbose = 0;
 
-	if (change) {
-		/* Reset output min/max */
-		for (f = 0; f < s->fdi; f++) {
-			s->g.fmin[f] = 1e30;
-			s->g.fmax[f] = -1e30;
-			s->g.fminx[f] = -1;
-			s->g.fmaxx[f] = -1;
-		}
-	}
-
 	/* Set the grid points value from the provided function */
 	/* Give the function both the grid position and the existing output values */
-
-	/* To make this clut function cache friendly, we use the pseudo-hilbert */
-	/* count sequence. This keeps each point close to the last in the */
-	/* multi-dimensional space. */ 
-	rpsh_init(&counter, s->di, (unsigned int *)s->g.res, gc);	/* Initialise counter */
-	for (;;) {
-
-		/* Compute grid pointer and input sample values */
-		gp = s->g.a;	/* Base of grid data */
-		for (e = 0; e < s->di; e++) { 				/* Input tables */
-			gp += s->g.fci[e] * gc[e];				/* Grid value pointer */
-			iv[e] = s->g.l[e] + gc[e] * s->g.w[e];	/* Input sample values */
-			*((int *)&iv[-e-1]) = gc[e];			/* Trick to supply grid index in iv[] */
-		}
-
-		for (f = 0; f < s->fdi; f++) 	/* Output chans */
-			ov[f] = gp[f];
-
-		/* Let function scan the input and output values, or */
-		/* Apply incolor -> outcolor, or oldoutcolor->outcolor function we want to represent */
-		func(cbctx, ov, iv);
-
-		if (change) {		/* Put new output values back */
-			for (f = 0; f < s->fdi; f++) { 	/* Output chans */
-				gp[f] = (float)ov[f];
-				if (s->g.fmin[f] > gp[f]) {
-					 s->g.fmin[f] = gp[f];
-					 s->g.fminx[f] = (gp - s->g.a)/s->g.pss;
-				}
-				if (s->g.fmax[f] < gp[f]) {
-					 s->g.fmax[f] = gp[f];
-					 s->g.fmaxx[f] = (gp - s->g.a)/s->g.pss;
-				}
-			}
-		}
-
-		/* Increment counter */
-		if (rpsh_inc(&counter, gc))
-			break;
-	}
+	x.s = s;
+	x.cbctx = cbctx;
+	x.func = func;
+	x.cc = NULL;
+	x.change = change;
+	x.scan = 1;
+
+	if (flags & RSPL_MTHREAD)
+		par_exec(0, set_rspl_thr, (void *)&x);
+	else
+		set_rspl_thr((void *)&x, 0, 1);
 
 	if (change == 0) {
 		return 0;
 	}
 
+	/* Set the output min/max */
+	set_rspl_minmax(s);
+
 	/* Compute overall output scale */
 	for (s->g.fscale = 0.0, f = 0; f < s->fdi; f++) {
 		double tt = s->g.fmax[f] - s->g.fmin[f];
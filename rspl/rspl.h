@@ -92,6 +92,17 @@ typedef struct {
 	double w[MXDO];		/* Weight to give this point, nominally 1.0 */ 
 } coww;
 
+/* Reverse interpolation cache statistics, returned by rev_cache_stats() */
+typedef struct {
+	size_t sz;				/* Memory currently used by the reverse interpolation */
+	size_t max_sz;			/* Current share of the cache memory budget */
+	size_t peak_sz;			/* Largest memory used since creation or reset */
+	int ncells;				/* Number of fxcells currently in the cache */
+	unsigned long hits;		/* fxcell cache hits since creation or reset */
+	unsigned long misses;	/* fxcell cache misses since creation or reset */
+	unsigned long evicts;	/* fxcells evicted to stay within max_sz */
+} rspl_rcstats;
+
 /* Scattered data Per data point data (internal) */
 struct _rpnts {
 	double p[MXDI];		/* Data position [di] */
@@ -173,9 +184,16 @@ struct _rspl {
 						/* appropriately. */
 		int fminmax_valid;	/* Min/max/scale cached values valid flag. */
 		int limitv_cached;	/* Flag: Ink limit values have been set in the grid array */
+		int limitv_loaded;	/* Flag: Ink limit values were restored by load_rspl() */
 
+		/* The grid values are always stored as single precision floats, */
+		/* with the interpolation weighting and sums done in double, */
+		/* so the storage is fdi+G_XTRA floats per grid point. */
 #define G_XTRA 3		/* Extra floats per grid point */
 		float *alloc;	/* Grid points allocated address */
+		size_t asize;	/* Size of alloc in bytes if malloc'd, for memory accounting */
+		void *mbase;	/* Non-NULL if grid is in a load_rspl() file image */
+		unsigned long msize;	/* Size of file image */
 		float *a;		/* Grid point flags + data */
 						/* Array is res[] ^ di entries float[fdi+G_XTRA], offset by G_XTRA */
 						/* (But is expanded when spline interpolaton is active) */
@@ -222,6 +240,11 @@ struct _rspl {
 							/* 2^di points, starting at base, in floats */
 		int a_fhi[DEF2MXDI];/* Default allocation for *hi */
 
+		/* Simplex vertex tables for 3 and 4 input interp(), indexed by */
+		/* the outcome of comparing each pair of cell coordinates (see rspl.c SX_CODE3/4) */
+		int sxd[1 << 6][4];		/* Dimensions in decreasing cell coordinate order */
+		int sxfo[1 << 6][4];	/* Offset from base of each following vertex, in floats */
+
 		unsigned int touch;	/* Cell touched flag count */
 	} g;
 
@@ -258,6 +281,9 @@ struct _rspl {
 #define RSPL_SYMDOMAIN    0x0004	/* Maintain symetric smoothness with nonsym. resolution */
 #define RSPL_SET_APXLS    0x0020	/* For set_rspl, adjust samples for aproximate least squares */
 #define RSPL_FASTREVSETUP 0x0010	/* Do a fast reverse setup at the cost of subsequent speed */
+#define RSPL_MTHREAD      0x0040	/* For set_rspl, re_set_rspl & scan_rspl, func() is thread */
+									/* safe, so call it from multiple threads in parallel. */
+									/* For fit_rspl*, fit output planes in parallel. */
 #define RSPL_VERBOSE      0x8000	/* Turn on print progress messages */
 #define RSPL_NOVERBOSE    0x4000	/* Turn off print progress messages */
 
@@ -377,11 +403,50 @@ struct _rspl {
 		void (*func)(void *cbntx, double *out, double *in)		/* Function to set from */
 	);
 
+	/* Add more scattered data points to a grid previously created */
+	/* with one of the fit_rspl functions, and refit it. The solution starts */
+	/* from the current grid values at the final resolution, so adding a */
+	/* modest number of points costs much less than a complete re-fit. */
+	/* The data points from the previous fit are retained, and the */
+	/* smoothing, grid resolution and grid range are kept the same, */
+	/* so the new points must lie within the existing grid range. */
+	/* Return non-zero if result is non-monotonic */
+	int
+	(*refit_rspl)(
+		struct _rspl *s,	/* this */
+		int flags,		/* Combination of flags */
+		co *d,			/* Array holding position and function values of data points */
+		int ndp			/* Number of data points to add */
+	);
+
+	/* Add more scattered data points with per point weighting, and refit. */
+	/* Return non-zero if result is non-monotonic */
+	int
+	(*refit_rspl_w)(
+		struct _rspl *s,	/* this */
+		int flags,		/* Combination of flags */
+		cow *d,			/* Array holding position, function and weight values of data points */
+		int ndp			/* Number of data points to add */
+	);
+
+	/* Add more scattered data points with per point individual out */
+	/* weighting, and refit. */
+	/* Return non-zero if result is non-monotonic */
+	int
+	(*refit_rspl_ww)(
+		struct _rspl *s,	/* this */
+		int flags,		/* Combination of flags */
+		coww *d,		/* Array holding position, function and weight values of data points */
+		int ndp			/* Number of data points to add */
+	);
+
 	/* Initialize the grid from a provided function. By default the grid */
 	/* values are set to exactly the value returned by func(), unless the */
 	/* RSPL_SET_APXLS flag is set, in which case an attempt is made to have */
 	/* the grid points represent a least squares aproximation to the underlying */
 	/* surface. */
+	/* If the RSPL_MTHREAD flag is set, func() is called from several threads */
+	/* at once (see num_threads()), and so must be thread safe. */
 	/* Grid index values are supplied "under" in[] at *((int*)&in[-e-1]) */
 	/* Return non-monotonic status */
 	int
@@ -402,10 +467,11 @@ struct _rspl {
 	/* Return non-monotonic status. Clears all the reverse lookup information. */
 	/* It is assumed that the output range remains unchanged. */
 	/* Existing output values are supplied in out[] */
+	/* RSPL_MTHREAD may be set, as for set_rspl(). */
 	int
 	(*re_set_rspl)(
 		struct _rspl *s,/* this */
-		int flags,		/* Combination of flags (not used) */
+		int flags,		/* Combination of flags */
 		void *cbntx,	/* Opaque function context */
 		void (*func)(void *cbntx, double *out, double *in) /* Function to set from */
 	);
@@ -456,12 +522,44 @@ struct _rspl {
 		void (*func)(void *cbntx, float **out, double *in, int cvi) /* Function to set from */
 	);
 
+	/* Save the grid to a file, so that it can be re-loaded with load_rspl() */
+	/* rather than being re-created. The grid values, output range */
+	/* and any cached ink limit values are saved. The file is binary, */
+	/* and can only be loaded by the same build on the same type of machine. */
+	/* Spline interpolation data is not saved. */
+	/* Return nz on error */
+	int (*save_rspl)(
+		struct _rspl *s,	/* this */
+		char *fname);		/* File name */
+
+	/* Replace the grid with one saved by save_rspl(). The file must have */
+	/* the same di and fdi as this rspl. Clears all the reverse lookup information. */
+	/* On UNIX the file is memory mapped copy on write, so that the pages */
+	/* of the grid are shared between all the processes that load the same file */
+	/* until they are modified. */
+	/* Any cached ink limit values are retained by the next rev_set_limit() */
+	/* with a non-NULL limit function, which must be the same function as */
+	/* the one they were created with. */
+	/* Return nz if the file doesn't exist or doesn't match */
+	int (*load_rspl)(
+		struct _rspl *s,	/* this */
+		char *fname);		/* File name */
+
 	/* Do forward interpolation */
 	/* Return 0 if OK, 1 if input was clipped to grid */
 	int (*interp)(
 		struct _rspl *s,	/* this */
 		co *p);				/* Input and output values */
 
+	/* Do forward interpolation of an array of values. */
+	/* This gives the same results as calling interp() for each */
+	/* value, but is faster for large numbers of values. */
+	/* Return the number of values that were clipped to the grid */
+	int (*interp_batch)(
+		struct _rspl *s,	/* this */
+		co *p,				/* Array of input and output values */
+		int n);				/* Number of values */
+
 	/* Do forward (partial) interpolation to allow input & output curves to be applied, */
 	/* and allow input delta E to be estimated from output delta E. */
 	/* Call with input value in p1[0].p[], */
@@ -539,6 +637,10 @@ struct _rspl {
 									/* rather than the one in the clip direction. */
 #define RSPL_NONNSETUP 0x0020		/* Sets RSPL_FASTREVSETUP flag, which avoids NN grid */
 									/* setup if this is the first call using RSPL_NEARCLIP. */
+#define RSPL_HINT      0x0040		/* Search the fwd cell of the rev_hint() value first, */
+									/* and skip the full search if it holds a solution that */
+									/* can't be improved on (ie. mxsoln == 1, or an exact */
+									/* auxiliary match). */
 	/* Return value masks */
 #define RSPL_DIDCLIP 0x8000		/* If this bit is set, at least one soln. and clipping occured */
 #define RSPL_NOSOLNS 0x7fff		/* And return value with this mask to get number of solutions */
@@ -557,6 +659,14 @@ struct _rspl {
 							/* input space solutions in cpp[0..retval-1].p[], and */
 							/* (possibly) clipped target values in cpp[0].v[] */
 
+	/* Set the input space value of a nearby solution, such as that of a neighbouring */
+	/* grid point, as the hint for rev_interp() calls made with RSPL_HINT. */
+	/* Each exact solution found then becomes the hint for the next call. */
+	/* NULL clears the hint. */
+	void (*rev_hint)(
+		struct _rspl *s,	/* this */
+		double p[MXRI]);	/* Input space hint value, NULL if none */
+
 	/* Do reverse search for the locus of the auxiliary input values given a target output. */
 	/* Return 1 on finding a valid solution, and 0 if no solutions are found. RESTRICTED SIZE */
 	int (*rev_locus)(
@@ -579,6 +689,44 @@ struct _rspl {
 		double max[][MXRI]	/* Array of max[MXRI] to hold return segment maximum values. */
 	);
 
+	/* Do rev_locus() for the n targets in cpp[0..n-1].v[]. The targets are searched */
+	/* grouped by reverse acceleration grid cell, so that nearby targets share the */
+	/* candidate cell list and cached cells. rev_locus() return values are */
+	/* returned in rv[n] if it is not NULL. Return the number of targets with a */
+	/* valid locus. RESTRICTED SIZE */
+	int (*rev_locus_n)(
+		struct _rspl *s,/* this */
+		int *auxm,		/* Array of di mask flags, !=0 for valid auxliaries (NULL if no aux) */
+		co *cpp,		/* n input targets in cpp[].v[] */
+		int n,			/* Number of targets */
+		double (*min)[MXRI],	/* Return n minimum auxiliary values */
+		double (*max)[MXRI],	/* Return n maximum auxiliary values */
+		int *rv);		/* Return n rev_locus() return values (may be NULL) */
+
+
+	/* Create a reverse interpolation context for use by another thread. */
+	/* The rev_interp(), rev_locus(), rev_locus_segs() and rev_locus_n() methods of the */
+	/* returned object may be called at the same time as those of this rspl */
+	/* and of any of its other contexts. A context shares the grid and the */
+	/* reverse acceleration structures, but has its own search state and */
+	/* fxcell/simplex cache. The reverse setup of this rspl is completed */
+	/* (including the full nnrev[] setup, even if RSPL_FASTREVSETUP was used), */
+	/* so the ink limit and LCh weighting must be set before creating contexts. */
+	/* Each context's cache is limited to 1/(nctx+1) of the memory allowed for */
+	/* the reverse cache of this rspl. */
+	/* Contexts must be created and del()'d from one thread, and all must */
+	/* be del()'d before this rspl is modified or deleted. RESTRICTED SIZE */
+	/* Return NULL on a memory allocation failure. */
+	struct _rspl *(*rev_thread_ctx)(
+		struct _rspl *s,	/* this */
+		int nctx);			/* Total number of contexts that will be created */
+
+	/* Return the reverse interpolation cache statistics, and if reset is nz, */
+	/* reset the counters and peak memory. A thread context returns its own. */
+	void (*rev_cache_stats)(
+		struct _rspl *s,	/* this */
+		rspl_rcstats *st,	/* Return the statistics */
+		int reset);			/* nz to reset counters after returning them */
 
 	/* ------------------------------- */
 
@@ -618,6 +766,18 @@ struct _rspl {
 /* Create a new, empty rspl object */
 rspl *new_rspl(int flags, int di, int fdi);	/* Input and output dimentiality */
 
+/* Set the total memory in bytes that the reverse interpolation caches of */
+/* all the rspl's in this process may use between them. This overrides */
+/* the default, which is based on the system RAM size (see also the */
+/* ARGYLL_REV_CACHE_MB and ARGYLL_REV_CACHE_MULT environment variables). */
+/* Existing caches are shrunk immediately if necessary. */
+/* 0 restores the default for subsequent reverse setups. */
+void rspl_set_rev_cache_budget(size_t bytes);
+
+/* Return the current total reverse interpolation cache memory budget in bytes. */
+/* (This is 0 until the first reverse setup if no budget has been set.) */
+size_t rspl_get_rev_cache_budget(void);
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 /* Utility functions */
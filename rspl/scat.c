@@ -140,6 +140,11 @@
 						/* - started implementing this using shadow grid map of */
 						/* smoothness (see  see mgtmp *sm), then switch to */
 						/* Leave One Out Cross Validation (LOOCV) idea. */
+						/* Note that opt_smooth() is a table lookup, so when this */
+						/* is finished, the LOOCV trial fits should be kept to the */
+						/* coarse multigrid levels, with the trial smoothness factors */
+						/* evaluated in parallel, and the chosen factor remembered */
+						/* (keyed by di, gres, dno and avgdev) for re-use by refits. */
 
 # define CW2 0.9
 # define CW ((1.0 - CW2) * 0.4)
@@ -180,6 +185,12 @@
 
 #endif
 
+/* Refit coarse grid correction cycle parameters */
+#define CGC_NU 2		/* Relaxation itterations before and after each correction */
+#define CGC_TOL 1e-2	/* Tollerance of the coarse correction solution */
+#define CGC_IMP 0.9		/* Minimum error improvement per cycle to continue */
+#define CGC_MAX 50		/* Maximum number of cycles */
+
 #undef NEVER
 #define ALWAYS
 
@@ -188,6 +199,9 @@ extern void alloc_grid(rspl *s);
 
 extern int is_mono(rspl *s);
 
+/* Implemented in rev.c: */
+extern void free_rev(rspl *s);
+
 /* Convention is to use:
    i to index grid points u.a
    n to index data points d.a
@@ -197,12 +211,28 @@ extern int is_mono(rspl *s);
    k misc
  */
 
+/* ================================================= */
+/* Compact sparse (compressed row) form of the A matrix, used by the solver. */
+/* Both halves of the symetric matrix are stored, so that each row can */
+/* be multiplied without reference to the other rows. The off diagonal */
+/* values of a row are stored right of diagonal in increasing column order, */
+/* then left of diagonal in decreasing column order, and zero values are */
+/* not stored. */
+typedef struct {
+	int no;			/* Number of rows */
+	double *d;		/* Diagonal values [no] */
+	int *rs;		/* Start index of each rows off diagonal values [no+1] */
+	int *c;			/* Column of each off diagonal value [rs[no]] */
+	double *v;		/* Off diagonal values [rs[no]] */
+} csrmat;
+
 /* ================================================= */
 /* Structure to hold temporary data for multi-grid calculations */
 /* One is created for each resolution. Only used in this file. */
 struct _mgtmp {
 	rspl *s;	/* Associated rspl */
 	int f;		/* Output dimension being calculated */
+	int dno;	/* Number of data points being fitted, from the start of s->d.a[] */
 
 	/* Weak default function stuff */
 	double wdfw;			/* Weight per grid point */
@@ -254,6 +284,8 @@ struct _mgtmp {
 		double *b;			/* b vector for RHS of simultabeous equation b[g.no] */
 		double normb;		/* normal of b vector */
 		double *x;			/* x solution to A . x = b */
+		csrmat sA;			/* A converted to compressed rows for solving. */
+							/* (A[][] is freed once sA has been created) */
 	} q;
 
 #ifdef AUTOSM
@@ -311,15 +343,19 @@ typedef struct {
 	double *z, *xx, *q, *r;
 	double *n;
 	int l_nid;
+	int nth;		/* Number of threads available to soln_err() */
 } cj_arrays;
 static void init_cj_arrays(cj_arrays *ta);
 static void free_cj_arrays(cj_arrays *ta);
 
-static int add_rspl_imp(rspl *s, int flags, void *d, int dtp, int dno);
-static mgtmp *new_mgtmp(rspl *s, int gres[MXDI], double smooth, double avgdev, int f, int issm);
+static int add_rspl_imp(rspl *s, int flags, void *d, int dtp, int dno, int warm);
+static mgtmp *new_mgtmp(rspl *s, int gres[MXDI], double smooth, double avgdev, int f, int issm, int dno);
 static void free_mgtmp(mgtmp *m);
 static void setup_solve(mgtmp *m, mgtmp *sm);
+static void setup_csrmat(csrmat *sA, double **A, int gno, int acols, int *xcol);
+static void free_csrmat(csrmat *sA);
 static void solve_gres(mgtmp *m, cj_arrays *ta, double tol, int final);
+static void solve_gres_cgc(mgtmp *m, mgtmp *cm, cj_arrays *ta, double tol);
 static void init_soln(mgtmp  *m1, mgtmp  *m2);
 static double mgtmp_interp(mgtmp  *m, double p[MXDI]);
 #ifdef AUTOSM
@@ -620,7 +656,7 @@ printf("~1 rspl: flags = 0x%x\n",flags);
 	set_it_info(s, s->g.res, &s->ii);
 
 	/* Do the data point fitting */
-	return add_rspl_imp(s, 0, d, dtp, dno);
+	return add_rspl_imp(s, flags & RSPL_MTHREAD, d, dtp, dno, 0);
 }
 
 /* Weighting adjustment values */
@@ -640,6 +676,7 @@ fit_rspl_plane_imp(
 rspl *s,		/* this */
 int f,			/* Output plane */
 it_info *ii,	/* resolution info */
+int dno,		/* Number of data points to fit, from the start of s->d.a[] */
 double smooth,	/* Smoothing factor */
 double avgdev,	/* Average deviation to use to set smoothness */
 //mgtmp *sm,		/* Optional smoothness map */
@@ -652,7 +689,7 @@ cj_arrays *ta	/* Temporary array */
 	/* For each resolution (itteration) */
 	for (nn = 0; nn < ii->niters; nn++, pm = m) {
 
-		m = new_mgtmp(s, ii->ires[nn], smooth, avgdev, f, 0);
+		m = new_mgtmp(s, ii->ires[nn], smooth, avgdev, f, 0, dno);
 
 		// ~~~ want setup solve after creating sm,
 		// but can't setup initial values until after setup_solve
@@ -663,7 +700,7 @@ cj_arrays *ta	/* Temporary array */
 #ifdef AUTOSM
 			Create sm and set initial values
 ~~~~
-			sm = new_mgtmp(s, ii->ires[nn], smooth, avgdev, f, 1);
+			sm = new_mgtmp(s, ii->ires[nn], smooth, avgdev, f, 1, dno);
 			for (i = 0; i < sm->g.no; i++)
 				sm->as.sm[i] = m->sf.cw[e];		/* Value from opt_smooth() */
 												/* ?? how to handle cw2[] etc. ? */
@@ -717,93 +754,90 @@ cj_arrays *ta	/* Temporary array */
 	return m;
 }
 
-/* Do the work of initialising from initial data points. */
-/* Return non-zero if non-monotonic */
-static int
-add_rspl_imp(
-	rspl *s,		/* this */
-	int flags,		/* Combination of flags */
-	void *d,		/* Array holding position and function values of data points */
-	int dtp,		/* Flag indicating data type, 0 = (co *), 1 = (cow *), 2 = (coww *) */
-	int dno			/* Number of data points */
+/* Re-do the fitting for one output plane after adding data points, */
+/* starting from the current grid values. Relaxation alone is slow */
+/* to spread the influence of the new points, so the change in the */
+/* solution is first estimated at the coarser resolutions, as the */
+/* difference between fits with and without the new points, and added */
+/* to the current grid values to give the starting point at */
+/* the final resolution. The remaining smooth error is then removed */
+/* using the next coarser resolution as a correction grid. */
+static mgtmp *
+fit_rspl_plane_warm(
+rspl *s,		/* this */
+int f,			/* Output plane */
+it_info *ii,	/* resolution info */
+int odno,		/* Number of data points in the previous fit */
+double smooth,	/* Smoothing factor */
+double avgdev,	/* Average deviation to use to set smoothness */
+cj_arrays *ta	/* Temporary array */
 ) {
-	int fdi = s->fdi;
-	int i, n, e, f;
-	cj_arrays ta;	/* cj_line temporary arrays */
-
-	if (flags & RSPL_VERBOSE)	/* Turn on progress messages to stdout */
-		s->verbose = 1;
-	if (flags & RSPL_NOVERBOSE)	/* Turn off progress messages to stdout */
-		s->verbose = 0;
-
-	if (dno == 0) {	/* There are no points to initialise from */
-		return 0;
+	int i;
+	float *gp;
+	mgtmp *m, *nm = NULL, *om = NULL;
+
+	/* Coarser resolution estimate of the change */
+	if (ii->niters > 1) {
+		it_info cii = *ii;		/* All but the final resolution */
+
+		cii.niters--;
+		nm = fit_rspl_plane_imp(s, f, &cii, s->d.no, smooth, avgdev, ta);
+		om = fit_rspl_plane_imp(s, f, &cii, odno, smooth, avgdev, ta);
+		for (i = 0; i < om->g.no; i++)
+			om->q.x[i] = nm->q.x[i] - om->q.x[i];
 	}
 
-#ifdef DEBUG
-	printf("add_rspl_imp: flags 0x%x, dno %d, dtp %d\n",flags,dno,dtp);
-#endif
+	m = new_mgtmp(s, ii->ires[ii->niters-1], smooth, avgdev, f, 0, s->d.no);
+	setup_solve(m, NULL);
 
-	/* Allocate space for points */
-	/* Allocate the scattered data space */
-	if ((s->d.a = (rpnts *) malloc(sizeof(rpnts) * dno)) == NULL)
-		error("rspl malloc failed - data points");
+	if (om != NULL) {
+		init_soln(m, om);				/* Scale change up to final resolution */
+		free_mgtmp(om);
+	} else {
+		for (i = 0; i < m->g.no; i++)
+			m->q.x[i] = 0.0;
+	}
 
-	/* Add the points */
-	if (dtp == 0) {			/* Default weight */
-		co *dp = (co *)d;
+	/* Add the change to the existing solution */
+	for (gp = s->g.a, i = 0; i < m->g.no; gp += s->g.pss, i++)
+		m->q.x[i] += (double)gp[f];
 
-		/* Append the list into data points */
-		for (i = 0, n = s->d.no; i < dno; i++, n++) {
-			for (e = 0; e < s->di; e++)
-				s->d.a[n].p[e] = dp[i].p[e];
-			for (f = 0; f < s->fdi; f++) {
-				s->d.a[n].v[f] = dp[i].v[f];
-				s->d.a[n].k[f] = 1.0;		/* Assume all data points have same weight */
-//				s->d.a[n].fe = 0.0;
-			}
-		}
-	} else if (dtp == 1) {			/* Per data point weight */
-		cow *dp = (cow *)d;
+	if (nm != NULL) {
+		solve_gres_cgc(m, nm, ta, TOL);
+		free_mgtmp(nm);
+	} else {
+		solve_gres(m, ta, TOL, 1);
+	}
 
-		/* Append the list into data points */
-		for (i = 0, n = s->d.no; i < dno; i++, n++) {
-			for (e = 0; e < s->di; e++)
-				s->d.a[n].p[e] = dp[i].p[e];
-			for (f = 0; f < s->fdi; f++) {
-				s->d.a[n].v[f] = dp[i].v[f];
-				s->d.a[n].k[f] = dp[n].w;	/* Weight specified */
-//				s->d.a[n].fe = 0.0; 
-			}
-		}
-	} else {				/* Per data point output weight */
-		coww *dp = (coww *)d;
+	return m;
+}
 
-		/* Append the list into data points */
-		for (i = 0, n = s->d.no; i < dno; i++, n++) {
-			for (e = 0; e < s->di; e++)
-				s->d.a[n].p[e] = dp[i].p[e];
-			for (f = 0; f < s->fdi; f++) {
-				s->d.a[n].v[f] = dp[i].v[f];
-				s->d.a[n].k[f] = dp[n].w[f];	/* Weight specified */
-//				s->d.a[n].fe = 0.0;
-			}
-		}
-	}
-	s->d.no = dno;
+/* Context for fitting output planes in parallel */
+typedef struct {
+	rspl *s;
+	int nth;		/* Total number of threads to use */
+	int nch;		/* Number of output planes being fitted at once */
+	int odno;		/* If > 0, refit from the current grid values, */
+					/* which are the fit to this many data points */
+} add_rspl_ctx;
+
+/* Fit every nth output plane, starting with plane ix */
+static int add_rspl_thr(void *cntx, int ix, int nth) {
+	add_rspl_ctx *x = (add_rspl_ctx *)cntx;
+	rspl *s = x->s;
+	int fdi = s->fdi;
+	int i, f;
+	cj_arrays ta;	/* cj_line temporary arrays */
 
 	init_cj_arrays(&ta);		/* Zero temporary arrays */
-	
-	if (s->verbose && s->ausm) {
-#ifdef AUTOSM
-		printf("Doing automatic local smoothing optimization\n");
-#else
-		printf("Automatic local smoothing flag ignored !!!\n");
-#endif
-	}
+
+	/* Share out any threads not used for planes, to soln_err() */
+	ta.nth = x->nth / x->nch;
+	if (ix < (x->nth % x->nch))
+		ta.nth++;
 
 	/* Do fit of grid to data for each output dimension */
-	for (f = 0; f < fdi; f++) {
+	for (f = ix; f < fdi; f += nth) {
 		float *gp;
 		mgtmp *m = NULL;
 
@@ -855,7 +889,10 @@ plot_mgtmp1(sm);
 #endif /* NEVER */
 
 		/* Fit data for this plane */
-		m = fit_rspl_plane_imp(s, f, &s->ii, s->smooth, s->avgdev[f], /* sm, */ &ta);
+		if (x->odno > 0)
+			m = fit_rspl_plane_warm(s, f, &s->ii, x->odno, s->smooth, s->avgdev[f], &ta);
+		else
+			m = fit_rspl_plane_imp(s, f, &s->ii, s->d.no, s->smooth, s->avgdev[f], /* sm, */ &ta);
 //printf("Final fit for output %d:\n",f);
 //plot_mgtmp1(m);
 
@@ -873,6 +910,106 @@ plot_mgtmp1(sm);
 	/* Free up cj_line temporary arrays */
 	free_cj_arrays(&ta);
 
+	return 0;
+}
+
+/* Do the work of initialising from initial data points. */
+/* Return non-zero if non-monotonic */
+static int
+add_rspl_imp(
+	rspl *s,		/* this */
+	int flags,		/* Combination of flags */
+	void *d,		/* Array holding position and function values of data points */
+	int dtp,		/* Flag indicating data type, 0 = (co *), 1 = (cow *), 2 = (coww *) */
+	int dno,		/* Number of data points */
+	int warm		/* Non-zero to refit from the current grid values */
+) {
+	int fdi = s->fdi;
+	int i, n, e, f;
+	add_rspl_ctx x;
+
+	if (flags & RSPL_VERBOSE)	/* Turn on progress messages to stdout */
+		s->verbose = 1;
+	if (flags & RSPL_NOVERBOSE)	/* Turn off progress messages to stdout */
+		s->verbose = 0;
+
+	if (dno == 0) {	/* There are no points to initialise from */
+		return 0;
+	}
+
+#ifdef DEBUG
+	printf("add_rspl_imp: flags 0x%x, dno %d, dtp %d, warm %d\n",flags,dno,dtp,warm);
+#endif
+
+	/* Allocate (or expand) the scattered data space */
+	if ((s->d.a = (rpnts *) realloc(s->d.a, sizeof(rpnts) * (s->d.no + dno))) == NULL)
+		error("rspl malloc failed - data points");
+	x.odno = warm ? s->d.no : 0;
+
+	/* Add the points */
+	if (dtp == 0) {			/* Default weight */
+		co *dp = (co *)d;
+
+		/* Append the list into data points */
+		for (i = 0, n = s->d.no; i < dno; i++, n++) {
+			for (e = 0; e < s->di; e++)
+				s->d.a[n].p[e] = dp[i].p[e];
+			for (f = 0; f < s->fdi; f++) {
+				s->d.a[n].v[f] = dp[i].v[f];
+				s->d.a[n].k[f] = 1.0;		/* Assume all data points have same weight */
+//				s->d.a[n].fe = 0.0;
+			}
+		}
+	} else if (dtp == 1) {			/* Per data point weight */
+		cow *dp = (cow *)d;
+
+		/* Append the list into data points */
+		for (i = 0, n = s->d.no; i < dno; i++, n++) {
+			for (e = 0; e < s->di; e++)
+				s->d.a[n].p[e] = dp[i].p[e];
+			for (f = 0; f < s->fdi; f++) {
+				s->d.a[n].v[f] = dp[i].v[f];
+				s->d.a[n].k[f] = dp[i].w;	/* Weight specified */
+//				s->d.a[n].fe = 0.0; 
+			}
+		}
+	} else {				/* Per data point output weight */
+		coww *dp = (coww *)d;
+
+		/* Append the list into data points */
+		for (i = 0, n = s->d.no; i < dno; i++, n++) {
+			for (e = 0; e < s->di; e++)
+				s->d.a[n].p[e] = dp[i].p[e];
+			for (f = 0; f < s->fdi; f++) {
+				s->d.a[n].v[f] = dp[i].v[f];
+				s->d.a[n].k[f] = dp[i].w[f];	/* Weight specified */
+//				s->d.a[n].fe = 0.0;
+			}
+		}
+	}
+	s->d.no += dno;
+
+	if (s->verbose && s->ausm) {
+#ifdef AUTOSM
+		printf("Doing automatic local smoothing optimization\n");
+#else
+		printf("Automatic local smoothing flag ignored !!!\n");
+#endif
+	}
+
+	/* Do fit of grid to data for each output dimension, */
+	/* using a thread for each if RSPL_MTHREAD */
+	x.s = s;
+	x.nth = 1;
+	if (flags & RSPL_MTHREAD)
+		x.nth = num_threads();
+	x.nch = fdi < x.nth ? fdi : x.nth;
+
+	if (x.nch > 1)
+		par_exec(x.nch, add_rspl_thr, (void *)&x);
+	else
+		add_rspl_thr((void *)&x, 0, 1);
+
 	/* Return non-mono check */
 	return is_mono(s);
 }
@@ -1003,6 +1140,105 @@ fit_rspl_w_df(
 	                    smooth, avgdev, ipos, weak, cbntx, func);
 }
 
+/* Add more scattered data points to an existing fit, and refit */
+/* starting from the current grid values. */
+/* Return non-zero if non-monotonic */
+static int
+refit_rspl_imp(
+	rspl *s,		/* this */
+	int flags,		/* Combination of flags */
+	void *d,		/* Array holding position and function values of data points */
+	int dtp,		/* Flag indicating data type, 0 = (co *), 1 = (cow *), 2 = (coww *) */
+	int dno			/* Number of data points */
+) {
+	int i, e, f;
+
+	if (s->d.a == NULL || s->ii.ires == NULL)
+		error("rspl: refit_rspl called without a previous fit_rspl");
+
+	/* The grid can't be moved, so the new points must be within it. */
+	/* Expand the data value normalizing range to enclose the new values. */
+	for (f = 0; f < s->fdi; f++)
+		s->d.vw[f] += s->d.vl[f];		/* Convert to high */
+	for (i = 0; i < dno; i++) {
+		double *p, *v;
+
+		if (dtp == 0) {
+			p = ((co *)d)[i].p;
+			v = ((co *)d)[i].v;
+		} else if (dtp == 1) {
+			p = ((cow *)d)[i].p;
+			v = ((cow *)d)[i].v;
+		} else {
+			p = ((coww *)d)[i].p;
+			v = ((coww *)d)[i].v;
+		}
+		for (e = 0; e < s->di; e++) {
+			if (p[e] < s->g.l[e] || p[e] > s->g.h[e])
+				error("rspl: refit_rspl point %d input %d value %f is outside grid range %f - %f",
+				      i,e,p[e],s->g.l[e],s->g.h[e]);
+		}
+		for (f = 0; f < s->fdi; f++) {
+			if (v[f] > s->d.vw[f])
+				s->d.vw[f] = v[f];
+			if (v[f] < s->d.vl[f])
+				s->d.vl[f] = v[f];
+		}
+	}
+	for (f = 0; f < s->fdi; f++)
+		s->d.vw[f] -= s->d.vl[f];		/* Back to width */
+
+	if (flags & RSPL_VERBOSE)
+		s->verbose = 1;
+	if (flags & RSPL_NOVERBOSE)
+		s->verbose = 0;
+
+	if (dno == 0)
+		return is_mono(s);
+
+	/* Anything derived from the grid values is now stale */
+	s->g.fminmax_valid = 0;
+	free_rev(s);
+
+	return add_rspl_imp(s, flags & RSPL_MTHREAD, d, dtp, dno, 1);
+}
+
+/* Add more scattered data points and refit */
+/* Return non-zero if non-monotonic */
+static int
+refit_rspl(
+	rspl *s,		/* this */
+	int flags,		/* Combination of flags */
+	co *d,			/* Array holding position and function values of data points */
+	int dno			/* Number of data points */
+) {
+	return refit_rspl_imp(s, flags, (void *)d, 0, dno);
+}
+
+/* Add more scattered data points with weights and refit */
+/* Return non-zero if non-monotonic */
+static int
+refit_rspl_w(
+	rspl *s,		/* this */
+	int flags,		/* Combination of flags */
+	cow *d,			/* Array holding position, function and weight values of data points */
+	int dno			/* Number of data points */
+) {
+	return refit_rspl_imp(s, flags, (void *)d, 1, dno);
+}
+
+/* Add more scattered data points with individual weights and refit */
+/* Return non-zero if non-monotonic */
+static int
+refit_rspl_ww(
+	rspl *s,		/* this */
+	int flags,		/* Combination of flags */
+	coww *d,		/* Array holding position, function and weight values of data points */
+	int dno			/* Number of data points */
+) {
+	return refit_rspl_imp(s, flags, (void *)d, 2, dno);
+}
+
 /* Init scattered data elements in rspl */
 void
 init_data(rspl *s) {
@@ -1013,6 +1249,9 @@ init_data(rspl *s) {
 	s->fit_rspl_ww   = fit_rspl_ww;
 	s->fit_rspl_df   = fit_rspl_df;
 	s->fit_rspl_w_df = fit_rspl_w_df;
+	s->refit_rspl    = refit_rspl;
+	s->refit_rspl_w  = refit_rspl_w;
+	s->refit_rspl_ww = refit_rspl_ww;
 }
 
 /* Free the scattered data allocation */
@@ -1364,11 +1603,11 @@ static mgtmp *new_mgtmp(
 	double smooth,	/* Smoothing factor */
 	double avgdev,	/* Average deviation to use to set smoothness */
 	int f,			/* output dimension */
-	int issm		/* We are creating a smoothness map */
+	int issm,		/* We are creating a smoothness map */
+	int dno			/* Number of data points to fit, from the start of s->d.a[] */
 ) {
 	mgtmp *m;
 	int di = s->di;
-	int dno = s->d.no;
 	int gno, nigc;
 	int gres_1[MXDI];
 	int e, g, n, i;
@@ -1383,6 +1622,7 @@ static mgtmp *new_mgtmp(
 	/* General stuff */
 	m->s = s;
 	m->f = f;
+	m->dno = dno;
 
 	/* Grid related */
 	for (gno = 1, e = 0; e < di; gno *= gres[e], e++)
@@ -1480,7 +1720,7 @@ static mgtmp *new_mgtmp(
 //			} else {	
 
 			/* Table lookup for optimum smoothing factor */
-			smval = opt_smooth(s, di, s->d.no, avgdev, f);
+			smval = opt_smooth(s, di, dno, avgdev, f);
 //printf("~1 opt_smooth returned %e\n",smval);
 #ifdef SMOOTH2
 			m->sf.cw[e]  = CW * smooth * smval * rsm;
@@ -1594,6 +1834,7 @@ static mgtmp *new_mgtmp(
 
 	/* Set the solution matricies to unalocated */
 	m->q.A = NULL;
+	memset((void *)&m->q.sA, 0, sizeof(csrmat));
 	m->q.xcol = NULL;
 	m->q.ixcol = NULL;
 	m->q.b = NULL;
@@ -1630,6 +1871,7 @@ static void free_mgtmp(mgtmp  *m) {
 	free((void *)m->q.xcol);
 	free((void *)m->q.ixcol);
 	free_dmatrix(m->q.A,0,gno-1,0,m->q.acols-1);
+	free_csrmat(&m->q.sA);
 	free((void *)m->d);
 
 #ifdef AUTOSM
@@ -1748,7 +1990,7 @@ mgtmp *sm		/* Optional smoothing map for ausm mode */
 ) {
 	rspl *s = m->s;
 	int di   = s->di;
-	int gno  = m->g.no,   dno = s->d.no;
+	int gno  = m->g.no,   dno = m->dno;
 	int *gres = m->g.res, *gci = m->g.ci;
 	int f = m->f;				/* Output dimensions being worked on */
 
@@ -2335,9 +2577,82 @@ mgtmp *sm		/* Optional smoothing map for ausm mode */
 	}
 #endif /* DEBUG */
 
+	/* Convert A[][] into compressed rows for the solver, and free it. */
+	setup_csrmat(&m->q.sA, A, gno, acols, xcol);
+	free_dmatrix(A,0,gno-1,0,acols-1);
+	m->q.A = NULL;
+
 //	exit(0);
 }
 
+/* Create the compressed row form of the packed diagonal A[][] matrix */
+static void setup_csrmat(
+	csrmat *sA,		/* Matrix to setup */
+	double **A,		/* Packed diagonal A[][] matrix */
+	int gno,		/* Number of rows */
+	int acols,		/* Columns used in A[][] */
+	int *xcol		/* A array column translation from packed to sparse index */
+) {
+	int i, k, k3, n;
+
+	free_csrmat(sA);
+	sA->no = gno;
+
+	/* Count the non-zero off diagonal values */
+	if ((sA->rs = ivector(0, gno)) == NULL)
+		error("Malloc of sA.rs[] failed");
+	for (n = i = 0; i < gno; i++) {
+		sA->rs[i] = n;
+		for (k = 1, k3 = i + xcol[k]; k < acols && k3 < gno; k++, k3 = i + xcol[k]) {
+			if (A[i][k] != 0.0)
+				n++;
+		}
+		for (k = 1, k3 = i - xcol[k]; k < acols && k3 >= 0; k++, k3 = i - xcol[k]) {
+			if (A[k3][k] != 0.0)
+				n++;
+		}
+	}
+	sA->rs[i] = n;
+
+	if ((sA->d = dvector(0, gno-1)) == NULL)
+		error("Malloc of sA.d[] failed");
+	if ((sA->c = ivector(0, n > 0 ? n-1 : 0)) == NULL)
+		error("Malloc of sA.c[] failed with %d",n);
+	if ((sA->v = dvector(0, n > 0 ? n-1 : 0)) == NULL)
+		error("Malloc of sA.v[] failed with %d",n);
+
+	/* Copy them */
+	for (n = i = 0; i < gno; i++) {
+		sA->d[i] = A[i][0];
+		for (k = 1, k3 = i + xcol[k]; k < acols && k3 < gno; k++, k3 = i + xcol[k]) {
+			if (A[i][k] != 0.0) {
+				sA->c[n] = k3;
+				sA->v[n++] = A[i][k];
+			}
+		}
+		for (k = 1, k3 = i - xcol[k]; k < acols && k3 >= 0; k++, k3 = i - xcol[k]) {
+			if (A[k3][k] != 0.0) {
+				sA->c[n] = k3;
+				sA->v[n++] = A[k3][k];
+			}
+		}
+	}
+}
+
+/* Free the contents of a csrmat */
+static void free_csrmat(csrmat *sA) {
+	int n;
+
+	if (sA->rs == NULL)
+		return;
+	n = sA->rs[sA->no];
+	free_dvector(sA->d, 0, sA->no-1);
+	free_ivector(sA->c, 0, n > 0 ? n-1 : 0);
+	free_dvector(sA->v, 0, n > 0 ? n-1 : 0);
+	free_ivector(sA->rs, 0, sA->no);
+	memset((void *)sA, 0, sizeof(csrmat));
+}
+
 #ifdef AUTOSM
 
 ~~~~9999
@@ -2354,7 +2669,7 @@ static void comp_fit_errors(
 ) {
 	rspl *s = m->s;
 	int n;
-	int dno = s->d.no;
+	int dno = m->dno;
 	int di = s->di;
 	double *x = m->q.x;		/* Grid solution values */
 	int f = m->f;			/* Output dimensions being worked on */
@@ -2440,6 +2755,55 @@ static double mgtmp_interp(
 	return val;
 }
 
+/* Accumulate the values v[] at the grid points of m1 into the */
+/* b[] values of the grid points of m2, distributing each value */
+/* by the same weights that mgtmp_interp() would use to interpolate */
+/* the m2 grid at that point. This is the transpose of init_soln(). */
+static void restrict_soln(
+	mgtmp  *m2,		/* Destination (coarser) */
+	mgtmp  *m1,		/* Source */
+	double *v		/* Source values */
+) {
+	rspl *s = m1->s;
+	int di  = s->di;
+	int gno = m1->g.no;
+	int e, n, i, g;
+	ECOUNT(gc, MXDIDO, di, 0, m1->g.res, 0);	/* Counter for source points */
+
+	for (i = 0; i < m2->g.no; i++)
+		m2->q.b[i] = 0.0;
+
+	/* For all source grid points */
+	EC_INIT(gc);
+	for (n = 0; n < gno; n++) {
+		double we[MXDI];		/* 1.0 - Weight in each dimension */
+		double gw[POW2MXDI];	/* weight for each grid cube corner */
+		double *bp = m2->q.b;	/* Pointer to b[] grid cube base */
+
+		for (e = 0; e < di; e++) {
+			double t = (double)gc[e]/(m1->g.res[e] - 1.0) * (m2->g.res[e] - 1.0);
+			int mi = (int)floor(t);
+			if (mi < 0)
+				mi = 0;
+			else if (mi >= (m2->g.res[e] - 1))
+				mi = m2->g.res[e] - 2;
+			bp += mi * m2->g.ci[e];
+			we[e] = t - (double)mi;
+		}
+		gw[0] = 1.0;
+		for (e = 0, g = 1; e < di; g *= 2, e++) {
+			for (i = 0; i < g; i++) {
+				gw[g+i] = gw[i] * we[e];
+				gw[i] *= (1.0 - we[e]);
+			}
+		}
+		for (i = 0; i < (1 << di); i++)
+			bp[m2->g.hi[i]] += gw[i] * v[n];
+
+		EC_INC(gc);
+	}
+}
+
 /* Transfer a solution from one mgtmp to another */
 /* (We assume that they are for the same problem) */
 static void init_soln(
@@ -2493,14 +2857,20 @@ void plot_mgtmp1(mgtmp *m) {
 
 /* - - - - - - - - - - - - - - - - - - - -*/
 
-static double one_itter1(cj_arrays *ta, double **A, double *x, double *b, double normb,
-                         int gno, int acols, int *xcol, int di, int *gres, int *gci,
-                         int max_it, double tol);
-static void one_itter2(double **A, double *x, double *b, int gno, int acols, int *xcol,
+static double one_itter1(cj_arrays *ta, csrmat *A, double *x, double *b, double normb,
+                         int di, int *gres, int *gci, int max_it, double tol);
+static void one_itter2(csrmat *A, double *x, double *b,
                  int di, int *gres, int *gci, double ovsh);
-static double soln_err(double **A, double *x, double *b, double normb, int gno, int acols, int *xcol);
-static double cj_line(cj_arrays *ta, double **A, double *x, double *b, int gno, int acols,
-                      int *xcol, int sof, int nid, int inc, int max_it, double tol);
+static double soln_err(csrmat *A, double *x, double *b, double normb, int nth);
+static double cj_line(cj_arrays *ta, csrmat *A, double *x, double *b,
+                      int sof, int nid, int inc, int max_it, double tol);
+
+/* Return row i of A times x, not including the diagonal */
+#define CSR_ROW_OFFD(sm, A, x, i) {					\
+		int _p, _pe = (A)->rs[(i)+1];				\
+		for (_p = (A)->rs[i]; _p < _pe; _p++)		\
+			sm += (A)->v[_p] * x[(A)->c[_p]];		\
+	}
 
 /* Solve scattered data to grid point fit */
 static void
@@ -2510,9 +2880,7 @@ solve_gres(mgtmp *m, cj_arrays *ta, double tol, int final)
 	int di = s->di;
 	int gno = m->g.no, *gres = m->g.res, *gci = m->g.ci;
 	int i;
-	double **A = m->q.A;		/* A matrix of interpoint weights */
-	int acols  = m->q.acols;	/* A matrix columns needed */
-	int *xcol  = m->q.xcol;		/* A array column translation from packed to sparse index */ 
+	csrmat *A  = &m->q.sA;		/* A matrix of interpoint weights */
 	double *b  = m->q.b;		/* b vector for RHS of simultabeous equation */
 	double *x  = m->q.x;		/* x vector for result */
 
@@ -2578,7 +2946,7 @@ solve_gres(mgtmp *m, cj_arrays *ta, double tol, int final)
 	 *
 	 */
 
-	/* Note that we process the A[][] sparse columns in compact form */
+	/* Note that we process A[][] in compressed row form (see csrmat) */
 
 #ifdef DEBUG_PROGRESS
 	printf("Target tol = %e\n",tol);
@@ -2587,7 +2955,7 @@ solve_gres(mgtmp *m, cj_arrays *ta, double tol, int final)
 	/* dimensional, solve it more directly. */
 	if (m->g.bres <= 4) {	/* Don't want to multigrid below this */
 		/* Solve using just conjugate-gradient */
-		cj_line(ta, A, x, b, gno, acols, xcol, 0, gno, 1, 10 * gno, tol);
+		cj_line(ta, A, x, b, 0, gno, 1, 10 * gno, tol);
 #ifdef DEBUG_PROGRESS
 		printf("Solved at res %d using conjugate-gradient\n",gres[0]);
 #endif
@@ -2596,7 +2964,7 @@ solve_gres(mgtmp *m, cj_arrays *ta, double tol, int final)
 		int jitters = JITTERS;
 
 		/* Compute an initial error */
-		err = soln_err(A, x, b, m->q.normb, gno, acols, xcol);
+		err = soln_err(A, x, b, m->q.normb, ta->nth);
 #ifdef DEBUG_PROGRESS
 		printf("Initial error res %d is %f\n",gres[0],err);
 #endif
@@ -2604,7 +2972,7 @@ solve_gres(mgtmp *m, cj_arrays *ta, double tol, int final)
 		for (i = 0; i < 500; i++) {
 			if (i < jitters) {	/* conjugate-gradient and relaxation */
 				lerr = err;
-				err = one_itter1(ta, A, x, b, m->q.normb, gno, acols, xcol, di, gres, gci, (int)m->g.mres, tol * CONJ_TOL);
+				err = one_itter1(ta, A, x, b, m->q.normb, di, gres, gci, (int)m->g.mres, tol * CONJ_TOL);
 			
 				derr = err/lerr;
 				if (derr > 0.8)			/* We're not improving using itter1() fast enough */
@@ -2624,9 +2992,9 @@ solve_gres(mgtmp *m, cj_arrays *ta, double tol, int final)
 						ni = MAXNI;		/* Maximum of MAXNI at a time */
 				}
 				for (j = 0; j < ni; j++)	/* Do them in groups for efficiency */
-					one_itter2(A, x, b, gno, acols, xcol, di, gres, gci, ovsh);
+					one_itter2(A, x, b, di, gres, gci, ovsh);
 				lerr = err;
-				err = soln_err(A, x, b, m->q.normb, gno, acols, xcol);
+				err = soln_err(A, x, b, m->q.normb, ta->nth);
 				derr = pow(err/lerr, 1.0/ni);
 #ifdef DEBUG_PROGRESS
 				printf("%d * one_itter2 at res %d has err %f, derr %f\n",ni,gres[0],err,derr);
@@ -2646,6 +3014,81 @@ solve_gres(mgtmp *m, cj_arrays *ta, double tol, int final)
 	}
 }
 
+/* Solve scattered data to grid point fit, given a close initial x[]. */
+/* Relaxation is quick to remove the local error, but slow to remove */
+/* smooth error, so cycles of relaxation are alternated with solving */
+/* for the remaining error at the coarser resolution cm, which */
+/* must be set up for the same data. cm's b[] and x[] are overwritten. */
+static void
+solve_gres_cgc(mgtmp *m, mgtmp *cm, cj_arrays *ta, double tol)
+{
+	rspl *s = m->s;
+	int di = s->di;
+	int gno = m->g.no, *gres = m->g.res, *gci = m->g.ci;
+	csrmat *A  = &m->q.sA;
+	double *b  = m->q.b;
+	double *x  = m->q.x;
+	double *r, err, lerr;
+	int i, j, k;
+	ECOUNT(gc, MXDIDO, di, 0, gres, 0);
+
+	if ((r = dvector(0, gno-1)) == NULL)
+		error("Malloc of r[] failed");
+
+	err = soln_err(A, x, b, m->q.normb, ta->nth);
+
+	for (k = 0; k < CGC_MAX && err >= tol; k++) {
+		double normr;
+
+		for (j = 0; j < CGC_NU; j++)
+			one_itter2(A, x, b, di, gres, gci, 1.0);
+
+		/* Residual at this resolution */
+		for (i = 0; i < gno; i++) {
+			double sm = A->d[i] * x[i];
+			CSR_ROW_OFFD(sm, A, x, i);
+			r[i] = b[i] - sm;
+		}
+
+		/* Solve for the error at the coarser resolution */
+		restrict_soln(cm, m, r);
+		for (normr = 0.0, i = 0; i < cm->g.no; i++) {
+			normr += cm->q.b[i] * cm->q.b[i];
+			cm->q.x[i] = 0.0;
+		}
+		if ((normr = sqrt(normr)) < 1e-20)
+			break;
+		cm->q.normb = normr;
+		solve_gres(cm, ta, CGC_TOL, 0);
+
+		/* Correct by the interpolated error */
+		EC_INIT(gc);
+		for (i = 0; i < gno; i++) {
+			double p[MXDI];
+			for (j = 0; j < di; j++)
+				p[j] = (double)gc[j]/(gres[j] - 1.0);
+			x[i] += mgtmp_interp(cm, p);
+			EC_INC(gc);
+		}
+
+		for (j = 0; j < CGC_NU; j++)
+			one_itter2(A, x, b, di, gres, gci, 1.0);
+
+		lerr = err;
+		err = soln_err(A, x, b, m->q.normb, ta->nth);
+		if (s->verbose) {
+			printf("*"); fflush(stdout);
+		}
+		if (err > (CGC_IMP * lerr))		/* Not worth continuing */
+			break;
+	}
+	free_dvector(r, 0, gno-1);
+
+	/* Finish off with relaxation if the cycles didn't get there */
+	if (err >= tol)
+		solve_gres(m, ta, tol, 1);
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - -*/
 /* Do one relaxation itteration of applying       */
 /* cj_line to solve each line of x[] values, in   */
@@ -2654,13 +3097,10 @@ solve_gres(mgtmp *m, cj_arrays *ta, double tol, int final)
 static double
 one_itter1(
 	cj_arrays *ta,	/* cj_line temporary arrays */
-	double **A,		/* Sparse A[][] matrix */
+	csrmat *A,		/* Sparse A[][] matrix */
 	double *x,		/* x[] matrix */
 	double *b,		/* b[] matrix */
 	double normb,	/* Norm of b[] */
-	int gno,		/* Total number of unknowns */
-	int acols,		/* Use colums in A[][] */
-	int *xcol,		/* sparse expansion lookup array */
 	int di,			/* number of dimensions */
 	int *gres,		/* Grid resolution */
 	int *gci,		/* Array increment for each dimension */
@@ -2684,7 +3124,7 @@ one_itter1(
 
 			/* Solve a line */
 //printf("~~solve line start %d, inc %d, len %d\n",sof,gci[d],gres[d]);
-			cj_line(ta, A, x, b, gno, acols, xcol, sof, gres[d], gci[d], max_it, tol);
+			cj_line(ta, A, x, b, sof, gres[d], gci[d], max_it, tol);
 
 			/* Increment index */
 			for (e = 0; e < di; e++) {
@@ -2719,7 +3159,7 @@ one_itter1(
 		}
 	}
 
-	return soln_err(A, x, b, normb, gno, acols, xcol);
+	return soln_err(A, x, b, normb, ta->nth);
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - -*/
@@ -2728,60 +3168,30 @@ one_itter1(
 /* red/black order */
 static void
 one_itter2(
-	double **A,		/* Sparse A[][] matrix */
+	csrmat *A,		/* Sparse A[][] matrix */
 	double *x,		/* x[] matrix */
 	double *b,		/* b[] matrix */
-	int gno,		/* Total number of unknowns */
-	int acols,		/* Use colums in A[][] */
-	int *xcol,		/* sparse expansion lookup array */
 	int di,			/* number of dimensions */
 	int *gres,		/* Grid resolution */
 	int *gci,		/* Array increment for each dimension */
 	double ovsh		/* Overshoot to use, 1.0 for none */
 ) {
-	int e,i,k;
+	int gno = A->no;
+	int e,i;
 	int gc[MXDI];
 
 	for (i = e = 0; e < di; e++)
 		gc[e] = 0;	/* init coords */
 
 	for (e = 0; e < di;) {
-		int k0,k1,k2,k3;
 		double sm = 0.0;
 
-		/* Right of diagonal in 4's */
-		for (k = 1, k3 = i+xcol[k+3]; (k+3) < acols && k3 < gno; k += 4, k3 = i+xcol[k+3]) {
-			k0 = i + xcol[k+0];
-			k1 = i + xcol[k+1];
-			k2 = i + xcol[k+2];
-			sm += A[i][k+0] * x[k0];
-			sm += A[i][k+1] * x[k1];
-			sm += A[i][k+2] * x[k2];
-			sm += A[i][k+3] * x[k3];
-		}
-		/* Finish any remaining */
-		for (k3 = i + xcol[k]; k < acols && k3 < gno; k++, k3 = i + xcol[k])
-			sm += A[i][k] * x[k3];
-
-		/* Left of diagonal in 4's */
-		/* (We take advantage of A[][] symetry: what would be in the row */
-		/*  to the left is repeated in the column above.) */
-		for (k = 1, k3 = i-xcol[k+3]; (k+3) < acols && k3 >= 0; k += 4, k3 = i-xcol[k+3]) {
-			k0 = i-xcol[k+0];
-			k1 = i-xcol[k+1];
-			k2 = i-xcol[k+2];
-			sm += A[k0][k+0] * x[k0];
-			sm += A[k1][k+1] * x[k1];
-			sm += A[k2][k+2] * x[k2];
-			sm += A[k3][k+3] * x[k3];
-		}
-		/* Finish any remaining */
-		for (k3 = i-xcol[k]; k < acols && k3 >= 0; k++, k3 = i-xcol[k])
-			sm += A[k3][k] * x[k3];
+		/* Off diagonal values */
+		CSR_ROW_OFFD(sm, A, x, i);
 
 		/* Compute x value that solves equation just for this point */
-//		x[i] = (b[i] - sm)/A[i][0];
-		x[i] += ovsh * ((b[i] - sm)/A[i][0] - x[i]);
+//		x[i] = (b[i] - sm)/A->d[i];
+		x[i] += ovsh * ((b[i] - sm)/A->d[i] - x[i]);
 
 #ifdef RED_BLACK
 		/* Increment index */
@@ -2815,58 +3225,93 @@ one_itter2(
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - -*/
+/* Return the sum of the squares of b - A * x for rows i0 to i1-1 */
+static double
+soln_err_rows(
+	csrmat *A,		/* Sparse A[][] matrix */
+	double *x,		/* x[] matrix */
+	double *b,		/* b[] matrix */
+	int i0,			/* First row */
+	int i1			/* Last row + 1 */
+) {
+	int i;
+	double resid;
+
+	resid = 0.0;
+	for (i = i0; i < i1; i++) {
+		double sm;
+
+		/* Diagonal then off diagonal */
+		sm = A->d[i] * x[i];
+		CSR_ROW_OFFD(sm, A, x, i);
+
+		sm = b[i] - sm;
+		resid += sm * sm;
+	}
+	return resid;
+}
+
+#define SOLN_MT_BLK 4096		/* Rows per block when using threads */
+
+/* Context for computing the solution error in parallel */
+typedef struct {
+	csrmat *A;
+	double *x, *b;
+	int gno;
+	int nblk;		/* Number of blocks */
+	double *bres;	/* Per block sum of squares */
+} soln_err_ctx;
+
+/* Compute every nth block, starting with block ix */
+static int soln_err_thr(void *cntx, int ix, int nth) {
+	soln_err_ctx *x = (soln_err_ctx *)cntx;
+	int j;
+
+	for (j = ix; j < x->nblk; j += nth) {
+		int i0 = j * SOLN_MT_BLK;
+		int i1 = i0 + SOLN_MT_BLK;
+		if (i1 > x->gno)
+			i1 = x->gno;
+		x->bres[j] = soln_err_rows(x->A, x->x, x->b, i0, i1);
+	}
+	return 0;
+}
+
 /* This function returns the current solution error. */
+/* If nth > 1 and there are enough rows, the rows are */
+/* evaluated in blocks using nth threads, and the block sums */
+/* added in order, so that the result doesn't depend on nth. */
 static double
 soln_err(
-	double **A,		/* Sparse A[][] matrix */
+	csrmat *A,		/* Sparse A[][] matrix */
 	double *x,		/* x[] matrix */
 	double *b,		/* b[] matrix */
 	double normb,	/* Norm of b[] */
-	int gno,		/* Total number of unknowns */
-	int acols,		/* Use colums in A[][] */
-	int *xcol		/* sparse expansion lookup array */
+	int nth			/* Number of threads to use */
 ) {
-	int i, k;
+	int gno = A->no;
 	double resid;
 
 	/* Compute norm of b - A * x */
-	resid = 0.0;
-	for (i = 0; i < gno; i++) {
-		int k0,k1,k2,k3;
-		double sm = 0.0;
+	if (nth > 1 && gno >= (4 * SOLN_MT_BLK)) {
+		soln_err_ctx cx;
+		int j;
 
-		/* Diagonal and to right in 4's */
-		for (k = 0, k3 = i+xcol[k+3]; (k+3) < acols && k3 < gno; k += 4, k3 = i+xcol[k+3]) {
-			k0 = i + xcol[k+0];
-			k1 = i + xcol[k+1];
-			k2 = i + xcol[k+2];
-			sm += A[i][k+0] * x[k0];
-			sm += A[i][k+1] * x[k1];
-			sm += A[i][k+2] * x[k2];
-			sm += A[i][k+3] * x[k3];
-		}
-		/* Finish any remaining */
-		for (k3 = i + xcol[k]; k < acols && k3 < gno; k++, k3 = i + xcol[k])
-			sm += A[i][k] * x[k3];
+		cx.A = A;
+		cx.x = x;
+		cx.b = b;
+		cx.gno = gno;
+		cx.nblk = (gno + SOLN_MT_BLK - 1)/SOLN_MT_BLK;
+		if ((cx.bres = dvector(0, cx.nblk-1)) == NULL)
+			error("Malloc of soln_err bres[] failed");
 
-		/* Left of diagonal in 4's */
-		/* (We take advantage of the symetry: what would be in the row */
-		/*  to the left is repeated in the column above.) */
-		for (k = 1, k3 = i-xcol[k+3]; (k+3) < acols && k3 >= 0; k += 4, k3 = i-xcol[k+3]) {
-			k0 = i-xcol[k+0];
-			k1 = i-xcol[k+1];
-			k2 = i-xcol[k+2];
-			sm += A[k0][k+0] * x[k0];
-			sm += A[k1][k+1] * x[k1];
-			sm += A[k2][k+2] * x[k2];
-			sm += A[k3][k+3] * x[k3];
-		}
-		/* Finish any remaining */
-		for (k3 = i-xcol[k]; k < acols && k3 >= 0; k++, k3 = i-xcol[k])
-			sm += A[k3][k] * x[k3];
+		par_exec(nth < cx.nblk ? nth : cx.nblk, soln_err_thr, (void *)&cx);
 
-		sm = b[i] - sm;
-		resid += sm * sm;
+		for (resid = 0.0, j = 0; j < cx.nblk; j++)
+			resid += cx.bres[j];
+		free_dvector(cx.bres, 0, cx.nblk-1);
+	} else {
+		resid = soln_err_rows(A, x, b, 0, gno);
 	}
 	resid = sqrt(resid);
 
@@ -2926,19 +3371,16 @@ static void free_cj_arrays(cj_arrays *ta) {
 static double
 cj_line(
 	cj_arrays *ta,	/* Temporary array data */
-	double **A,		/* Sparse A[][] matrix */
+	csrmat *A,		/* Sparse A[][] matrix */
 	double *x,		/* x[] matrix */
 	double *b,		/* b[] matrix */
-	int gno,		/* Total number of unknowns */
-	int acols,		/* Use colums in A[][] */
-	int *xcol,		/* sparse expansion lookup array */
 	int sof,		/* start offset of x[] to be found */
 	int nid,		/* Number in dimension */
 	int inc,		/* Increment to move in lines dimension */
 	int max_it,		/* maximum number of itterations to use (min nid) */
 	double tol		/* Normalised tollerance to stop on */
 ) {
-	int i, ii, k, it;
+	int i, ii, it;
 	double sm;
 	double resid;
 	double alpha, rho = 0.0, rho_1 = 0.0;
@@ -2957,40 +3399,8 @@ cj_line(
 
 	/* Compute r = b - A * x */
 	for (i = 0, ii = sof; i < nid; i++, ii += inc) {
-		int k0,k1,k2,k3;
-		sm = 0.0;
-
-		/* Diagonal and to right in 4's */
-		for (k = 0, k3 = ii+xcol[k+3]; (k+3) < acols && k3 < gno; k += 4, k3 = ii+xcol[k+3]) {
-			k0 = ii + xcol[k+0];
-			k1 = ii + xcol[k+1];
-			k2 = ii + xcol[k+2];
-			sm += A[ii][k+0] * x[k0];
-			sm += A[ii][k+1] * x[k1];
-			sm += A[ii][k+2] * x[k2];
-			sm += A[ii][k+3] * x[k3];
-		}
-		/* Finish any remaining */
-		for (k3 = ii + xcol[k]; k < acols && k3 < gno; k++, k3 = ii + xcol[k])
-			sm += A[ii][k] * x[k3];
-
-		/* Left of diagonal in 4's */
-		/* (We take advantage of the symetry around the diagonal: what would be in the row */
-		/*  to the left is repeated in the column above, so for an unsparse matrix */
-		/*  we simply swapt the row and column index, for sparse we use the mirror column */
-		/*  offset (ie. to the right side) and subtract the column offset from the row.) */
-		for (k = 1, k3 = ii-xcol[k+3]; (k+3) < acols && k3 >= 0; k += 4, k3 = ii-xcol[k+3]) {
-			k0 = ii-xcol[k+0];
-			k1 = ii-xcol[k+1];
-			k2 = ii-xcol[k+2];
-			sm += A[k0][k+0] * x[k0];
-			sm += A[k1][k+1] * x[k1];
-			sm += A[k2][k+2] * x[k2];
-			sm += A[k3][k+3] * x[k3];
-		}
-		/* Finish any remaining */
-		for (k3 = ii-xcol[k]; k < acols && k3 >= 0; k++, k3 = ii-xcol[k])
-			sm += A[k3][k] * x[k3];
+		sm = A->d[ii] * x[ii];
+		CSR_ROW_OFFD(sm, A, x, ii);
 
 		ta->r[i] = b[ii] - sm;
 	}
@@ -3013,11 +3423,8 @@ cj_line(
 	}
 	/* Compute n = A * 0 */
 	for (i = 0, ii = sof; i < nid; i++, ii += inc) {
-		sm = 0.0;
-		for (k = 0; k < acols && (ii+xcol[k]) < gno; k++)
-			sm += A[ii][k] * x[ii+xcol[k]];			/* Diagonal and to right */
-		for (k = 1; k < acols && (ii-xcol[k]) >= 0; k++)
-			sm += A[ii-xcol[k]][k] * x[ii-xcol[k]];	/* Left of diagonal */
+		sm = A->d[ii] * x[ii];
+		CSR_ROW_OFFD(sm, A, x, ii);
 		ta->n[i] = sm;
 	}
 
@@ -3038,7 +3445,7 @@ cj_line(
 		/* Aproximately solve for z[] given r[], */
 		/* and also compute rho = r.z */
 		for (rho = 0.0, i = 0, ii = sof; i < nid; i++, ii += inc) {
-			sm = A[ii][0];
+			sm = A->d[ii];
 			ta->z[i] = sm != 0.0 ? ta->r[i] / sm : ta->r[i]; 	/* Simple aprox soln. */
 			rho += ta->r[i] * ta->z[i];
 		}
@@ -3054,16 +3461,8 @@ cj_line(
 		/* Compute q = A * p  - n, */
 		/* and also alpha = p.q */
 		for (alpha = 0.0, i = 0, ii = sof; i < nid; i++, ii += inc) {
-			sm = A[ii][0] * x[ii];
-			for (k = 1; k < acols; k++) {
-				int pxk = xcol[k];
-				int nxk = ii-pxk;
-				pxk += ii;
-				if (pxk < gno)
-					sm += A[ii][k] * x[pxk];
-				if (nxk >= 0)
-					sm += A[nxk][k] * x[nxk];
-			}
+			sm = A->d[ii] * x[ii];
+			CSR_ROW_OFFD(sm, A, x, ii);
 			ta->q[i] = sm - ta->n[i];
 			alpha += ta->q[i] * x[ii];
 		}
@@ -32,6 +32,7 @@
 #include "numlib.h"
 
 int spline_interp_rspl(rspl *ss, co *cp);
+extern void free_grid(rspl *s);
 
 #undef DEBUG
 
@@ -224,11 +225,12 @@ rspl *s		/* Pointer to rspl grid */
 	/* Free basic grid info, and substitute tangency enhanced version */
 	/* ~~~~!! need to free any other structures in rspl that depend on */
 	/* ~~~~!! g.pss size, ie. rev stuff ??? */
-	if (s->g.alloc != NULL)
-		free((void *)s->g.alloc);
+	free_grid(s);
 
 	s->g.alloc  = tang_alloc;
+	s->g.asize  = sizeof(float) * nig * (((1 << di) * fdi)+G_XTRA);
 	s->g.a      = tang;
+	a1ma_inc(a1ma_rspl, s->g.asize);
 
 	/* Adjust index tables */
 	s->g.pss = (1 << di) * fdi + G_XTRA;
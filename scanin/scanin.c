@@ -95,6 +95,558 @@ unsigned int shash(char *c) {
 	return hash;
 }
 
+/* Open an input Grey, RGB or CMYK tiff file, and check that it is */
+/* one we can handle. Return NULL on error, with the reason in errm[]. */
+static TIFF *open_tiff_in(
+char *tiffin_name,		/* TIFF Input file name */
+int verb,				/* Verbosity level */
+int *pwidth, int *pheight,	/* Return x and y size */
+uint16 *pdepth,			/* Return useful depth */
+uint16 *ptdepth,		/* Return total depth including alpha */
+uint16 *pbps,			/* Return bits per sample */
+char *errm				/* Error message buffer */
+) {
+	TIFF *rh;
+	uint16 depth, bps;			/* Useful depth, bits per sample */
+	uint16 tdepth;				/* Total depth including alpha */
+	uint16 pconfig, photometric;
+	uint16 rextrasamples;		/* Extra "alpha" samples */
+	uint16 *rextrainfo;			/* Info about extra samples */
+
+	if ((rh = TIFFOpen(tiffin_name, "r")) == NULL) {
+		sprintf(errm,"error opening read file '%s'",tiffin_name);
+		return NULL;
+	}
+
+	TIFFGetField(rh, TIFFTAG_IMAGEWIDTH,  pwidth);
+	TIFFGetField(rh, TIFFTAG_IMAGELENGTH, pheight);
+
+	TIFFGetField(rh, TIFFTAG_BITSPERSAMPLE, &bps);
+	if (bps != 8 && bps != 16) {
+		sprintf(errm,"TIFF Input file '%s' must be 8 or 16 bits/channel",tiffin_name);
+		goto terr;
+	}
+
+	/* See if there are alpha planes */
+	TIFFGetFieldDefaulted(rh, TIFFTAG_EXTRASAMPLES, &rextrasamples, &rextrainfo);
+
+	TIFFGetField(rh, TIFFTAG_SAMPLESPERPIXEL, &depth);
+
+	if (rextrasamples > 0 && verb)
+		printf("%d extra (alpha ?) samples will be ignored\n",rextrasamples);
+
+	tdepth = depth;
+	depth = tdepth - rextrasamples;
+
+	if (depth != 1 && depth != 3 && depth != 4) {
+		sprintf(errm,"Input '%s' must be a Grey, RGB or CMYK tiff file",tiffin_name);
+		goto terr;
+	}
+
+	TIFFGetField(rh, TIFFTAG_PHOTOMETRIC, &photometric);
+	if (depth == 1 && photometric != PHOTOMETRIC_MINISBLACK
+	               && photometric != PHOTOMETRIC_MINISWHITE) {
+		sprintf(errm,"1 chanel input '%s' must be a Grey tiff file",tiffin_name);
+		goto terr;
+	} else if (depth == 3 && photometric != PHOTOMETRIC_RGB) {
+		sprintf(errm,"3 chanel input '%s' must be an RGB tiff file",tiffin_name);
+		goto terr;
+	} else if (depth == 4 && photometric != PHOTOMETRIC_SEPARATED) {
+		sprintf(errm,"4 chanel input '%s' must be a CMYK tiff file",tiffin_name);
+		goto terr;
+	}
+
+	TIFFGetField(rh, TIFFTAG_PLANARCONFIG, &pconfig);
+	if (pconfig != PLANARCONFIG_CONTIG) {
+		sprintf(errm,"TIFF Input file '%s' must be planar",tiffin_name);
+		goto terr;
+	}
+
+	*pdepth = depth;
+	*ptdepth = tdepth;
+	*pbps = bps;
+
+	return rh;
+
+  terr:;
+	TIFFClose(rh);
+	return NULL;
+}
+
+/* Chart reference values read from a .cie/.q60 file, */
+/* ready to create a scanner .ti3 file with. */
+typedef struct {
+	cgats *icg;			/* input cgats structure */
+	int sx;				/* Sample id index */
+	int isLab;			/* D50 Lab reference */
+	int Xx, Yx, Zx;		/* XYZ_X, XYZ_Y, XYZ_Z index */
+	int spec_n;			/* Number of spectral bands */
+	double spec_wl_short;/* First reading wavelength in nm (shortest) */
+	double spec_wl_long; /* Last reading wavelength in nm (longest) */
+	int spi[XSPECT_MAX_BANDS];  /* CGATS indexes for each wavelength */
+	int npat;			/* Number of test patches in it8 chart */
+	unsigned int *idhash; 	/* Array of reference id hashes */
+} chtref;
+
+/* Read the chart reference values. Errors are fatal. */
+static void read_chtref(
+chtref *cr,
+char *datin_name		/* Data input name (.cie/.q60) */
+) {
+	cgats *icg;			/* input cgats structure */
+	int ti;				/* Temp index */
+	int i, j;
+
+	memset((void *)cr, 0, sizeof(chtref));
+
+	icg = cr->icg = new_cgats();	/* Create a CGATS structure */
+	icg->add_other(icg, ""); 	/* Accept any type */
+	if (icg->read_name(icg, datin_name))
+		error("CGATS file '%s' read error : %s",datin_name,icg->err);
+
+	/* ~~ should accept ti2 file and convert RGB to XYZ using    */
+	/*    device cal., to make W/RGB/CMYK ->XYZ reading chart ~~ */
+	if (icg->ntables < 1)
+		error("Input file '%s' doesn't contain at least one table",datin_name);
+
+	if ((cr->npat = icg->t[0].nsets) <= 0)
+		error("File '%s' no sets of data in first table",datin_name);
+
+	/* Fields we want from input chart reference file */
+	if ((cr->sx = icg->find_field(icg, 0, "Sample_Name")) < 0) {
+		if ((cr->sx = icg->find_field(icg, 0, "SAMPLE_NAME")) < 0) {
+			if ((cr->sx = icg->find_field(icg, 0, "SAMPLE_LOC")) < 0) {
+				if ((cr->sx = icg->find_field(icg, 0, "SAMPLE_ID")) < 0) {
+					error("Input file '%s' doesn't contain field SAMPLE_ID, Sample_Name or SAMPLE_NAME",datin_name);
+				}
+			}
+		}
+	}
+	if (icg->t[0].ftype[cr->sx] != nqcs_t && icg->t[0].ftype[cr->sx] != cs_t)
+		error("Input file '%s' field %s is wrong type", datin_name, icg->t[0].fsym[cr->sx]);
+
+	if ((cr->Xx = icg->find_field(icg, 0, "XYZ_X")) < 0) {
+		if ((cr->Xx = icg->find_field(icg, 0, "LAB_L")) < 0)
+			error("Input file '%s' doesn't contain field XYZ_X or LAB_L",datin_name);
+
+		cr->isLab = 1;
+		if (icg->t[0].ftype[cr->Xx] != r_t)
+			error("Input file '%s' field LAB_L is wrong type",datin_name);
+		if ((cr->Yx = icg->find_field(icg, 0, "LAB_A")) < 0)
+			error("Input file doesn't contain field LAB_A",datin_name);
+		if (icg->t[0].ftype[cr->Yx] != r_t)
+			error("Input file '%s' field LAB_A is wrong type",datin_name);
+		if ((cr->Zx = icg->find_field(icg, 0, "LAB_B")) < 0)
+			error("Input file '%s' doesn't contain field LAB_B",datin_name);
+		if (icg->t[0].ftype[cr->Zx] != r_t)
+			error("Input file '%s' field LAB_B is wrong type",datin_name);
+	} else {
+		if (icg->t[0].ftype[cr->Xx] != r_t)
+			error("Input file '%s' field XYZ_X is wrong type",datin_name);
+		if ((cr->Yx = icg->find_field(icg, 0, "XYZ_Y")) < 0)
+			error("Input file '%s' doesn't contain field XYZ_Y",datin_name);
+		if (icg->t[0].ftype[cr->Yx] != r_t)
+			error("Input file '%s' field XYZ_Y is wrong type",datin_name);
+		if ((cr->Zx = icg->find_field(icg, 0, "XYZ_Z")) < 0)
+			error("Input file '%s' doesn't contain field XYZ_Z",datin_name);
+		if (icg->t[0].ftype[cr->Zx] != r_t)
+			error("Input file '%s' field XYZ_Z is wrong type",datin_name);
+	}
+
+	/* Find possible spectral fields in reference */
+	if ((ti = icg->find_kword(icg, 0, "SPECTRAL_BANDS")) >= 0) {
+		cr->spec_n = atoi(icg->t[0].kdata[ti]);
+		if ((ti = icg->find_kword(icg, 0, "SPECTRAL_START_NM")) < 0)
+			error ("Input file '%s' doesn't contain keyword SPECTRAL_START_NM",datin_name);
+		cr->spec_wl_short = atof(icg->t[0].kdata[ti]);
+		if ((ti = icg->find_kword(icg, 0, "SPECTRAL_END_NM")) < 0)
+			error ("Input file '%s' doesn't contain keyword SPECTRAL_END_NM",datin_name);
+		cr->spec_wl_long = atof(icg->t[0].kdata[ti]);
+
+		/* Find the fields for spectral values */
+		for (i = 0; i < cr->spec_n; i++) {
+			char buf[100];
+			int nm;
+
+			/* Compute nearest integer wavelength */
+			nm = (int)(cr->spec_wl_short + ((double)i/(cr->spec_n-1.0))
+			            * (cr->spec_wl_long - cr->spec_wl_short) + 0.5);
+
+			sprintf(buf,"SPEC_%03d",nm);
+
+			if ((cr->spi[i] = icg->find_field(icg, 0, buf)) < 0)
+				error("Input file doesn't contain field %s",datin_name);
+		}
+	}
+
+	if ((cr->idhash = (unsigned int *)malloc(sizeof(unsigned int) * cr->npat)) == NULL)
+		error("Malloc failed!");
+
+	/* Setup hash list of reference labels to speed comparisons */
+	for (j = 0; j < cr->npat; j++) {
+		char id[100];		/* Reference patch id */
+
+		/* Normalise reference labels */
+		fix_it8(id, ((char *)icg->t[0].fdata[j][cr->sx]));	/* Copy and fix */
+
+		cr->idhash[j] = shash(id);
+	}
+}
+
+static void free_chtref(chtref *cr) {
+	free(cr->idhash);
+	cr->icg->del(cr->icg);		/* Clean up */
+}
+
+/* Create a scanner .ti3 file from the chart reference values and the */
+/* patch values read by scanrd. cr is only read, so that this can be */
+/* called from several threads with the same chart reference values. */
+/* Return nz on error, with the reason in errm[]. */
+static int write_scan_ti3(
+chtref *cr,				/* Chart reference values */
+scanrd *sr,				/* Scanrd object with the values read */
+int depth,				/* Useful depth of input */
+int tmean,				/* Return true mean, rather than robust mean */
+int verb,				/* Verbosity level */
+char *atm,				/* Ascii creation time */
+char *datout_name,		/* Data output name (.ti3) */
+int *pnotscan,			/* Add number of patches that wern't scanned */
+char *errm				/* Error message buffer */
+) {
+	cgats *icg = cr->icg;	/* input cgats structure */
+	cgats *ocg;			/* output cgats structure */
+	int nsetel = 0;		/* Number of output set elements */
+	cgats_set_elem *setel;  /* Array of set value elements */
+	int i, j;
+
+	/* Setup output cgats file */
+	ocg = new_cgats();	/* Create a CGATS structure */
+	ocg->add_other(ocg, "CTI3"); 	/* our special type is Calibration Target Information 3 */
+	ocg->add_table(ocg, tt_other, 0);	/* Start the first table */
+
+	ocg->add_kword(ocg, 0, "DESCRIPTOR", "Argyll Calibration Target chart information 3",NULL);
+	ocg->add_kword(ocg, 0, "ORIGINATOR", "Argyll target", NULL);
+	ocg->add_kword(ocg, 0, "CREATED",atm, NULL);
+
+	ocg->add_kword(ocg, 0, "DEVICE_CLASS","INPUT", NULL);	/* What sort of device this is */
+	ocg->add_kword(ocg, 0, "COLOR_REP","XYZ_RGB", NULL);
+
+	ocg->add_field(ocg, 0, "SAMPLE_ID", nqcs_t);
+	nsetel += 1;
+	ocg->add_field(ocg, 0, "XYZ_X", r_t);
+	ocg->add_field(ocg, 0, "XYZ_Y", r_t);
+	ocg->add_field(ocg, 0, "XYZ_Z", r_t);
+	nsetel += 3;
+
+	/* If we have spectral information, output it too */
+	if (cr->spec_n > 0) {
+		char buf[100];
+
+		nsetel += cr->spec_n;       /* Spectral values */
+		sprintf(buf,"%d", cr->spec_n);
+		ocg->add_kword(ocg, 0, "SPECTRAL_BANDS",buf, NULL);
+		sprintf(buf,"%f", cr->spec_wl_short);
+		ocg->add_kword(ocg, 0, "SPECTRAL_START_NM",buf, NULL);
+		sprintf(buf,"%f", cr->spec_wl_long);
+		ocg->add_kword(ocg, 0, "SPECTRAL_END_NM",buf, NULL);
+
+		/* Generate fields for spectral values */
+		for (i = 0; i < cr->spec_n; i++) {
+			int nm;
+
+			/* Compute nearest integer wavelength */
+			nm = (int)(cr->spec_wl_short + ((double)i/(cr->spec_n-1.0))
+			            * (cr->spec_wl_long - cr->spec_wl_short) + 0.5);
+
+			sprintf(buf,"SPEC_%03d",nm);
+			ocg->add_field(ocg, 0, buf, r_t);
+		}
+	}
+
+	if (depth == 1) {
+		ocg->add_field(ocg, 0, "GREY", r_t);
+		ocg->add_field(ocg, 0, "STDEV_GREY", r_t);
+	} else if (depth == 3) {
+		ocg->add_field(ocg, 0, "RGB_R", r_t);
+		ocg->add_field(ocg, 0, "RGB_G", r_t);
+		ocg->add_field(ocg, 0, "RGB_B", r_t);
+		ocg->add_field(ocg, 0, "STDEV_R", r_t);
+		ocg->add_field(ocg, 0, "STDEV_G", r_t);
+		ocg->add_field(ocg, 0, "STDEV_B", r_t);
+	} else if (depth == 4) {
+		ocg->add_field(ocg, 0, "CMYK_C", r_t);
+		ocg->add_field(ocg, 0, "CMYK_M", r_t);
+		ocg->add_field(ocg, 0, "CMYK_Y", r_t);
+		ocg->add_field(ocg, 0, "CMYK_K", r_t);
+		ocg->add_field(ocg, 0, "STDEV_C", r_t);
+		ocg->add_field(ocg, 0, "STDEV_M", r_t);
+		ocg->add_field(ocg, 0, "STDEV_Y", r_t);
+		ocg->add_field(ocg, 0, "STDEV_K", r_t);
+	}
+	nsetel += 2 * depth;
+
+	if ((setel = (cgats_set_elem *)malloc(sizeof(cgats_set_elem) * nsetel)) == NULL) {
+		sprintf(errm,"Malloc failed!");
+		ocg->del(ocg);
+		return 1;
+	}
+
+	/* Initialise, ready to read out all the values */
+	for (i = sr->reset(sr); i > 0; i--) {
+		char tod[100];			/* Temp output patch id */
+		char od[100];			/* Output patch id */
+		unsigned int odhash;	/* Chart id hashes */
+		double P[4];			/* Robust/true mean values */
+		double sdP[4];			/* Standard deviation */
+		int pixcnt;				/* Pixel count */
+
+		if (tmean)
+			sr->read(sr, tod, NULL, P, sdP, &pixcnt);
+		else
+			sr->read(sr, tod, P, NULL, sdP, &pixcnt);
+
+		fix_it8(od, tod);
+
+		odhash = shash(od);
+
+		if (pixcnt == 0)
+			(*pnotscan)++;
+
+		/* Search for matching id in reference */
+		for (j = 0; j < cr->npat; j++) {
+			char id[100];		/* Reference patch id */
+
+			if (odhash != cr->idhash[j])	/* Fast reject */
+				continue;
+
+			/* Normalise reference labels */
+			fix_it8(id, ((char *)icg->t[0].fdata[j][cr->sx]));	/* Copy and fix */
+
+			if (strcmp(id, od) == 0) {
+				int k = 0, m;
+				double XYZ[3];
+
+				setel[k++].c = id;
+
+		        XYZ[0] = *((double *)icg->t[0].fdata[j][cr->Xx]);
+		        XYZ[1] = *((double *)icg->t[0].fdata[j][cr->Yx]);
+		        XYZ[2] = *((double *)icg->t[0].fdata[j][cr->Zx]);
+				if (cr->isLab) {
+					icmLab2XYZ(&icmD50, XYZ, XYZ);
+					XYZ[0] *= 100.0;
+					XYZ[1] *= 100.0;
+					XYZ[2] *= 100.0;
+				}
+
+				setel[k++].d = XYZ[0];
+				setel[k++].d = XYZ[1];
+				setel[k++].d = XYZ[2];
+
+				if (cr->spec_n > 0) {
+					for (m = 0; m < cr->spec_n; m++) {
+						setel[k++].d = *((double *)icg->t[0].fdata[j][cr->spi[m]]);
+					}
+				}
+
+				for (m = 0; m < depth; m++)
+					setel[k++].d = P[m] * 100.0/255.0;
+				for (m = 0; m < depth; m++)
+					setel[k++].d = sdP[m] * 100.0/255.0;
+
+				ocg->add_setarr(ocg, 0, setel);
+
+				break;
+			}
+			if (j >= cr->npat && verb >= 1)
+				printf("Warning: Couldn't match field '%s'\n",od);
+		}
+	}
+
+	if (verb)
+		printf("Writing output values to file '%s'\n",datout_name);
+
+	if (ocg->write_name(ocg, datout_name)) {
+		sprintf(errm,"Output file '%s' write error : %s",datout_name, ocg->err);
+		free(setel);
+		ocg->del(ocg);
+		return 1;
+	}
+
+	free(setel);
+	ocg->del(ocg);		/* Clean up */
+
+	return 0;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Batch mode, where many input files are matched */
+/* against the same chart reference. */
+
+/* Per input file batch information */
+typedef struct {
+	char tiffin_name[MAXNAMEL+1];	/* TIFF Input file name (.tif) */
+	char datout_name[MAXNAMEL+4+1];	/* Data output name (.ti3) */
+	int pnotscan;					/* Number of patches that wern't scanned */
+	int err;						/* nz if processing failed */
+	char errm[MAXNAMEL+300];		/* Error message if failed */
+} bfile;
+
+/* Batch context shared by all the threads */
+typedef struct {
+	int flags;			/* scanrd option flags */
+	int verb;			/* Verbosity level */
+	int tmean;			/* Return true mean, rather than robust mean */
+	double gamma;		/* Approximate gamma encoding of images */
+	double *sfid;		/* Specified fiducials, NULL if auto recognition */
+	scanrd *ref;		/* Chart reference from read_scanrd_ref() */
+	chtref *cr;			/* Chart reference values */
+	char *atm;			/* Ascii creation time */
+	bfile *files;		/* Input files */
+} bcntx;
+
+/* Process input files i0 .. i1-1 */
+static int batch_files(void *cntx, int i0, int i1, int thix) {
+	bcntx *cx = (bcntx *)cntx;
+	int i;
+
+	for (i = i0; i < i1; i++) {
+		bfile *bf = &cx->files[i];
+		TIFF *rh;
+		uint16 depth, bps;		/* Useful depth, bits per sample */
+		uint16 tdepth;			/* Total depth including alpha */
+		int width, height;		/* x and y size */
+		scanrd *sr;
+		char *errm;
+
+		if ((rh = open_tiff_in(bf->tiffin_name, 0, &width, &height,
+		                       &depth, &tdepth, &bps, bf->errm)) == NULL) {
+			bf->err = 1;
+			continue;
+		}
+
+		if ((sr = do_scanrd_ref(cx->flags, cx->verb, cx->gamma, cx->sfid,
+		                        width, height, depth, tdepth, bps,
+		                        read_line, (void *)rh, cx->ref, NULL, NULL)) == NULL) {
+			sprintf(bf->errm,"Unable to allocate scanrd object");
+			bf->err = 1;
+
+		} else if ((bf->err = sr->error(sr, &errm)) != 0) {
+			sprintf(bf->errm,"Scanin failed with code 0x%x, %s",bf->err,errm);
+
+		} else if (write_scan_ti3(cx->cr, sr, depth, cx->tmean, cx->verb, cx->atm,
+		                          bf->datout_name, &bf->pnotscan, bf->errm)) {
+			bf->err = 1;
+		}
+
+		if (sr != NULL)
+			sr->free(sr);
+		TIFFClose(rh);
+	}
+	return 0;
+}
+
+/* Create a scanner .ti3 file for each input file, reading the */
+/* chart reference and values just once, and processing the */
+/* input files in parallel. Return the exit code. */
+static int do_batch(
+int flags,				/* scanrd option flags */
+int verb,				/* Verbosity level */
+int tmean,				/* Return true mean, rather than robust mean */
+double gamma,			/* Approximate gamma encoding of images */
+double *sfid,			/* Specified fiducials, NULL if auto recognition */
+char *recog_name,		/* Reference chart name (.cht) */
+char *datin_name,		/* Data input name (.cie/.q60) */
+int nfiles,				/* Number of input files */
+char *fnames[]			/* Input file names */
+) {
+	bcntx cx;
+	chtref cr;
+	time_t clk = time(0);
+	struct tm *tsp = localtime(&clk);
+	char *atm = asctime(tsp); /* Ascii time */
+	unsigned int err;
+	char *errm;
+	int pnotscan = 0;		/* Number of patches that wern't scanned */
+	int nfail = 0;			/* Number of files that failed */
+	int i, j;
+
+	if ((cx.files = (bfile *)calloc(nfiles, sizeof(bfile))) == NULL)
+		error("Malloc failed!");
+
+	/* Create the desination file paths and names */
+	for (i = 0; i < nfiles; i++) {
+		bfile *bf = &cx.files[i];
+		char *xl;
+
+		strncpy(bf->tiffin_name,fnames[i],MAXNAMEL); bf->tiffin_name[MAXNAMEL] = '\000';
+		strcpy(bf->datout_name,bf->tiffin_name);
+		if ((xl = strrchr(bf->datout_name, '.')) == NULL)	/* Figure where extention is */
+			xl = bf->datout_name + strlen(bf->datout_name);
+		strcpy(xl,".ti3");
+
+		for (j = 0; j < i; j++) {
+			if (stricmp(bf->datout_name, cx.files[j].datout_name) == 0)
+				error("Inputs '%s' and '%s' would both output '%s'",
+				      cx.files[j].tiffin_name, bf->tiffin_name, bf->datout_name);
+		}
+	}
+
+	if (verb >= 2) {
+		printf("Batch of %d input files\n",nfiles);
+		printf("Data input file '%s'\n",datin_name);
+		printf("Chart reference file '%s'\n",recog_name);
+	}
+
+	/* Read the chart reference and values just once */
+	if ((cx.ref = read_scanrd_ref(verb, recog_name)) == NULL)
+		error("Unable to allocate scanrd object");
+
+	if ((err = cx.ref->error(cx.ref, &errm)) != 0)
+		error("Scanin failed with code 0x%x, %s",err,errm);
+
+	read_chtref(&cr, datin_name);
+
+	atm[strlen(atm)-1] = '\000';	/* Remove \n from end */
+
+	/* If there are at least as many files as threads, one thread */
+	/* per file is more efficient than using threads within scanrd. */
+	if (nfiles >= num_threads())
+		flags |= SI_NO_THREADS;
+
+	cx.flags = flags;
+	cx.verb = verb;
+	cx.tmean = tmean;
+	cx.gamma = gamma;
+	cx.sfid = sfid;
+	cx.cr = &cr;
+	cx.atm = atm;
+
+	par_for(0, 0, nfiles, 1, batch_files, (void *)&cx);
+
+	for (i = 0; i < nfiles; i++) {
+		bfile *bf = &cx.files[i];
+
+		if (bf->err) {
+			warning("Input file '%s' failed: %s",bf->tiffin_name,bf->errm);
+			nfail++;
+		}
+		pnotscan += bf->pnotscan;
+	}
+
+	if (pnotscan > 0)
+		warning("A total of %d patches had no value set!",pnotscan);
+
+	/* Clean up */
+	free_chtref(&cr);
+	cx.ref->free(cx.ref);
+	free(cx.files);
+
+	if (nfail > 0)
+		error("%d of %d input files failed",nfail,nfiles);
+
+	return 0;
+}
+
 void
 usage(void) {
 	fprintf(stderr,"Scanin, Version %s\n",ARGYLL_VERSION_STR);
@@ -113,7 +665,10 @@ usage(void) {
 	fprintf(stderr,"   :- inputs pbase.ti2 and outputs printer pbase.ti3, or\n");
 	fprintf(stderr,"\n");
 	fprintf(stderr,"usage: scanin -r [options] input.tif recogin.cht pbase [diag.tif]\n");
-	fprintf(stderr,"   :- inputs pbase.ti2+.ti3 and outputs pbase.ti3\n");
+	fprintf(stderr,"   :- inputs pbase.ti2+.ti3 and outputs pbase.ti3, or\n");
+	fprintf(stderr,"\n");
+	fprintf(stderr,"usage: scanin -B [options] recogin.cht valin.cie input1.tif [input2.tif ...]\n");
+	fprintf(stderr,"   :- inputs each 'inputN.tif' and outputs scanner 'inputN.ti3'\n");
 	fprintf(stderr,"\n");
 	fprintf(stderr," -g                   Generate a chart reference (.cht) file\n");
 	fprintf(stderr," -o                   Output patch values in .val file\n");
@@ -122,6 +677,7 @@ usage(void) {
 	fprintf(stderr,"                       from subsequent pages\n");
 	fprintf(stderr," -r                   Replace device values in pbase .ti2/.ti3\n");
 	fprintf(stderr,"                      Default is to create a scanner .ti3 file\n");
+	fprintf(stderr," -B                   Batch create scanner .ti3 files from many input files\n");
 	fprintf(stderr," -F x1,y1,x2,y2,x3,y3,x4,y4\n");
 	fprintf(stderr,"                      Don't auto recognize, locate using four fiducual marks\n");
 	fprintf(stderr," -p                   Compensate for perspective distortion\n");
@@ -164,14 +720,12 @@ int main(int argc, char *argv[])
 	int repl = 0;		/* Replace .ti3 device values from raster file */
 	int outo = 0;		/* Output the values read, rather than creating scanner .ti3 */
 	int colm = 0;		/* Use inage values to measure color for print profile. > 1 == append */
+	int batch = 0;		/* Batch process many input files */
 	int flags = SI_GENERAL_ROT;	/* Default allow all rotations */
 
 	TIFF *rh = NULL, *wh = NULL;
 	uint16 depth, bps;			/* Useful depth, bits per sample */
 	uint16 tdepth;				/* Total depth including alpha */
-	uint16 pconfig, photometric;
-	uint16 rextrasamples;		/* Extra "alpha" samples */
-	uint16 *rextrainfo;			/* Info about extra samples */
 	int gotres = 0;
 	uint16 resunits;
 	float resx, resy;
@@ -186,6 +740,7 @@ int main(int argc, char *argv[])
 	scanrd *sr;				/* Scanrd object */
 	int err;	
 	char *errm;
+	char em[MAXNAMEL+300];	/* Error message */
 	int pnotscan = 0;		/* Number of patches that wern't scanned */
 
 	if (argc <= 1)
@@ -224,6 +779,9 @@ int main(int argc, char *argv[])
 			} else if (argv[fa][1] == 'm') {
 				tmean = 1;
 
+			} else if (argv[fa][1] == 'B') {
+				batch = 1;
+
 			} else if (argv[fa][1] == 'g') {
 				flags |= SI_BUILD_REF;
 				repl = 0;
@@ -344,6 +902,30 @@ int main(int argc, char *argv[])
 			break;
 	}
 
+	/* Batch of TIFF Raster input files */
+	if (batch) {
+		if ((flags & (SI_BUILD_REF | SI_SHOW_FLAGS)) != 0
+		 || repl != 0 || outo != 0 || colm != 0 || datout_name[0] != '\000')
+			usage();
+
+		/* .cht Reference file in */
+		if (fa >= argc || argv[fa][0] == '-') usage();
+		strncpy(recog_name,argv[fa],MAXNAMEL); recog_name[MAXNAMEL] = '\000';
+
+		/* CGATS Data file input */
+		if (++fa >= argc || argv[fa][0] == '-') usage();
+		strncpy(datin_name,argv[fa],MAXNAMEL); datin_name[MAXNAMEL] = '\000';
+
+		if (++fa >= argc) usage();
+		for (i = fa; i < argc; i++) {
+			if (argv[i][0] == '-')
+				usage();
+		}
+
+		return do_batch(flags, verb, tmean, gamma, sfid, recog_name, datin_name,
+		                argc - fa, &argv[fa]);
+	}
+
 	/* TIFF Raster input file name */
 	if (fa >= argc || argv[fa][0] == '-') usage();
 	strncpy(tiffin_name,argv[fa],MAXNAMEL); tiffin_name[MAXNAMEL] = '\000';
@@ -403,38 +985,9 @@ int main(int argc, char *argv[])
 	/* ----------------------------------------- */
 	/* Open up input tiff file ready for reading */
 	/* Got arguments, so setup to process the file */
-	if ((rh = TIFFOpen(tiffin_name, "r")) == NULL)
-		error("error opening read file '%s'",tiffin_name);
-
-	TIFFGetField(rh, TIFFTAG_IMAGEWIDTH,  &width);
-	TIFFGetField(rh, TIFFTAG_IMAGELENGTH, &height);
-
-	TIFFGetField(rh, TIFFTAG_BITSPERSAMPLE, &bps);
-	if (bps != 8 && bps != 16)
-		error("TIFF Input file '%s' must be 8 or 16 bits/channel",tiffin_name);
-
-	/* See if there are alpha planes */
-	TIFFGetFieldDefaulted(rh, TIFFTAG_EXTRASAMPLES, &rextrasamples, &rextrainfo);
-
-	TIFFGetField(rh, TIFFTAG_SAMPLESPERPIXEL, &depth);
-
-	if (rextrasamples > 0 && verb)
-		printf("%d extra (alpha ?) samples will be ignored\n",rextrasamples);
-
-	tdepth = depth;
-	depth = tdepth - rextrasamples;
-
-	if (depth != 1 && depth != 3 && depth != 4)
-		error("Input '%s' must be a Grey, RGB or CMYK tiff file",tiffin_name);
-
-	TIFFGetField(rh, TIFFTAG_PHOTOMETRIC, &photometric);
-	if (depth == 1 && photometric != PHOTOMETRIC_MINISBLACK
-	               && photometric != PHOTOMETRIC_MINISWHITE)
-		error("1 chanel input '%s' must be a Grey tiff file",tiffin_name);
-	else if (depth == 3 && photometric != PHOTOMETRIC_RGB)
-		error("3 chanel input '%s' must be an RGB tiff file",tiffin_name);
-	else if (depth == 4 && photometric != PHOTOMETRIC_SEPARATED)
-		error("4 chanel input '%s' must be a CMYK tiff file",tiffin_name);
+	if ((rh = open_tiff_in(tiffin_name, verb, &width, &height,
+	                       &depth, &tdepth, &bps, em)) == NULL)
+		error("%s",em);
 
 	if (depth == 1)
 		tiffs = icSigGrayData;
@@ -443,11 +996,6 @@ int main(int argc, char *argv[])
 	else if (depth == 4)
 		tiffs = icSigCmykData;
 
-	TIFFGetField(rh, TIFFTAG_PLANARCONFIG, &pconfig);
-	if (pconfig != PLANARCONFIG_CONTIG)
-		error("TIFF Input file '%s' must be planar",tiffin_name);
-
-
 	if (TIFFGetField(rh, TIFFTAG_RESOLUTIONUNIT, &resunits) != 0) {
 		TIFFGetField(rh, TIFFTAG_XRESOLUTION, &resx);
 		TIFFGetField(rh, TIFFTAG_YRESOLUTION, &resy);
@@ -1169,270 +1717,19 @@ int main(int argc, char *argv[])
 		
 		/* ----------------------------------- */
 		} else {	/* Normal scan calibration */
-			cgats *icg;			/* input cgats structure */
-			cgats *ocg;			/* output cgats structure */
+			chtref cr;			/* Chart reference values */
 			time_t clk = time(0);
 			struct tm *tsp = localtime(&clk);
 			char *atm = asctime(tsp); /* Ascii time */
-			int ti;				/* Temp index */
-			int sx;				/* Sample id index */
-			int isLab = 0;		/* D50 Lab reference */
-			int Xx, Yx, Zx;		/* XYZ_X, XYZ_Y, XYZ_Z index */
-			int spec_n = 0;		/* Number of spectral bands */
-			double spec_wl_short;/* First reading wavelength in nm (shortest) */
-			double spec_wl_long; /* Last reading wavelength in nm (longest) */
-			int spi[XSPECT_MAX_BANDS];  /* CGATS indexes for each wavelength */
-			int npat;			/* Number of test patches in it8 chart */
-			int nsetel = 0;		/* Number of output set elements */
-			cgats_set_elem *setel;  /* Array of set value elements */
-			unsigned int *idhash; 	/* Array of reference id hashes */
-	
-			icg = new_cgats();			/* Create a CGATS structure */
-			icg->add_other(icg, ""); 	/* Accept any type */
-			if (icg->read_name(icg, datin_name))
-				error("CGATS file '%s' read error : %s",datin_name,icg->err);
-	
-			/* ~~ should accept ti2 file and convert RGB to XYZ using    */
-			/*    device cal., to make W/RGB/CMYK ->XYZ reading chart ~~ */
-			if (icg->ntables < 1)
-				error("Input file '%s' doesn't contain at least one table",datin_name);
-	
-			if ((npat = icg->t[0].nsets) <= 0)
-				error("File '%s' no sets of data in first table",datin_name);
-	
-			/* Setup output cgats file */
-			ocg = new_cgats();	/* Create a CGATS structure */
-			ocg->add_other(ocg, "CTI3"); 	/* our special type is Calibration Target Information 3 */
-			ocg->add_table(ocg, tt_other, 0);	/* Start the first table */
-	
-			ocg->add_kword(ocg, 0, "DESCRIPTOR", "Argyll Calibration Target chart information 3",NULL);
-			ocg->add_kword(ocg, 0, "ORIGINATOR", "Argyll target", NULL);
-			atm[strlen(atm)-1] = '\000';	/* Remove \n from end */
-			ocg->add_kword(ocg, 0, "CREATED",atm, NULL);
-	
-			ocg->add_kword(ocg, 0, "DEVICE_CLASS","INPUT", NULL);	/* What sort of device this is */
-			ocg->add_kword(ocg, 0, "COLOR_REP","XYZ_RGB", NULL);
-	
-			/* Fields we want from input chart reference file */
-			if ((sx = icg->find_field(icg, 0, "Sample_Name")) < 0) {
-				if ((sx = icg->find_field(icg, 0, "SAMPLE_NAME")) < 0) {
-					if ((sx = icg->find_field(icg, 0, "SAMPLE_LOC")) < 0) {
-						if ((sx = icg->find_field(icg, 0, "SAMPLE_ID")) < 0) {
-							error("Input file '%s' doesn't contain field SAMPLE_ID, Sample_Name or SAMPLE_NAME",datin_name);
-						}
-					}
-				}
-			}
-			if (icg->t[0].ftype[sx] != nqcs_t && icg->t[0].ftype[sx] != cs_t)
-				error("Input file '%s' field %s is wrong type", datin_name, icg->t[0].fsym[sx]);
 
-			if ((Xx = icg->find_field(icg, 0, "XYZ_X")) < 0) {
-				if ((Xx = icg->find_field(icg, 0, "LAB_L")) < 0)
-					error("Input file '%s' doesn't contain field XYZ_X or LAB_L",datin_name);
-				
-				isLab = 1;
-				if (icg->t[0].ftype[Xx] != r_t)
-					error("Input file '%s' field LAB_L is wrong type",datin_name);
-				if ((Yx = icg->find_field(icg, 0, "LAB_A")) < 0)
-					error("Input file doesn't contain field LAB_A",datin_name);
-				if (icg->t[0].ftype[Yx] != r_t)
-					error("Input file '%s' field LAB_A is wrong type",datin_name);
-				if ((Zx = icg->find_field(icg, 0, "LAB_B")) < 0)
-					error("Input file '%s' doesn't contain field LAB_B",datin_name);
-				if (icg->t[0].ftype[Zx] != r_t)
-					error("Input file '%s' field LAB_B is wrong type",datin_name);
-			} else {
-				if (icg->t[0].ftype[Xx] != r_t)
-					error("Input file '%s' field XYZ_X is wrong type",datin_name);
-				if ((Yx = icg->find_field(icg, 0, "XYZ_Y")) < 0)
-					error("Input file '%s' doesn't contain field XYZ_Y",datin_name);
-				if (icg->t[0].ftype[Yx] != r_t)
-					error("Input file '%s' field XYZ_Y is wrong type",datin_name);
-				if ((Zx = icg->find_field(icg, 0, "XYZ_Z")) < 0)
-					error("Input file '%s' doesn't contain field XYZ_Z",datin_name);
-				if (icg->t[0].ftype[Zx] != r_t)
-					error("Input file '%s' field XYZ_Z is wrong type",datin_name);
-			}
-
-			/* Find possible spectral fields in reference */
-			if ((ti = icg->find_kword(icg, 0, "SPECTRAL_BANDS")) >= 0) {
-				spec_n = atoi(icg->t[0].kdata[ti]);
-				if ((ti = icg->find_kword(icg, 0, "SPECTRAL_START_NM")) < 0)
-					error ("Input file '%s' doesn't contain keyword SPECTRAL_START_NM",datin_name);
-				spec_wl_short = atof(icg->t[0].kdata[ti]);
-				if ((ti = icg->find_kword(icg, 0, "SPECTRAL_END_NM")) < 0)
-					error ("Input file '%s' doesn't contain keyword SPECTRAL_END_NM",datin_name);
-				spec_wl_long = atof(icg->t[0].kdata[ti]);
-		
-				/* Find the fields for spectral values */
-				for (i = 0; i < spec_n; i++) {
-					char buf[100];
-					int nm;
-			
-					/* Compute nearest integer wavelength */
-					nm = (int)(spec_wl_short + ((double)i/(spec_n-1.0))
-					            * (spec_wl_long - spec_wl_short) + 0.5);
-					
-					sprintf(buf,"SPEC_%03d",nm);
-		
-					if ((spi[i] = icg->find_field(icg, 0, buf)) < 0)
-						error("Input file doesn't contain field %s",datin_name);
-				}
-			}
-
-			ocg->add_field(ocg, 0, "SAMPLE_ID", nqcs_t);
-			nsetel += 1;
-			ocg->add_field(ocg, 0, "XYZ_X", r_t);
-			ocg->add_field(ocg, 0, "XYZ_Y", r_t);
-			ocg->add_field(ocg, 0, "XYZ_Z", r_t);
-			nsetel += 3;
-
-			/* If we have spectral information, output it too */
-			if (spec_n > 0) {
-				char buf[100];
-	
-				nsetel += spec_n;       /* Spectral values */
-				sprintf(buf,"%d", spec_n);
-				ocg->add_kword(ocg, 0, "SPECTRAL_BANDS",buf, NULL);
-				sprintf(buf,"%f", spec_wl_short);
-				ocg->add_kword(ocg, 0, "SPECTRAL_START_NM",buf, NULL);
-				sprintf(buf,"%f", spec_wl_long);
-				ocg->add_kword(ocg, 0, "SPECTRAL_END_NM",buf, NULL);
-	
-				/* Generate fields for spectral values */
-				for (i = 0; i < spec_n; i++) {
-					int nm;
-			
-					/* Compute nearest integer wavelength */
-					nm = (int)(spec_wl_short + ((double)i/(spec_n-1.0))
-					            * (spec_wl_long - spec_wl_short) + 0.5);
-					
-					sprintf(buf,"SPEC_%03d",nm);
-					ocg->add_field(ocg, 0, buf, r_t);
-				}
-			}
-
-			if (depth == 1) {
-				ocg->add_field(ocg, 0, "GREY", r_t);
-				ocg->add_field(ocg, 0, "STDEV_GREY", r_t);
-			} else if (depth == 3) {
-				ocg->add_field(ocg, 0, "RGB_R", r_t);
-				ocg->add_field(ocg, 0, "RGB_G", r_t);
-				ocg->add_field(ocg, 0, "RGB_B", r_t);
-				ocg->add_field(ocg, 0, "STDEV_R", r_t);
-				ocg->add_field(ocg, 0, "STDEV_G", r_t);
-				ocg->add_field(ocg, 0, "STDEV_B", r_t);
-			} else if (depth == 4) {
-				ocg->add_field(ocg, 0, "CMYK_C", r_t);
-				ocg->add_field(ocg, 0, "CMYK_M", r_t);
-				ocg->add_field(ocg, 0, "CMYK_Y", r_t);
-				ocg->add_field(ocg, 0, "CMYK_K", r_t);
-				ocg->add_field(ocg, 0, "STDEV_C", r_t);
-				ocg->add_field(ocg, 0, "STDEV_M", r_t);
-				ocg->add_field(ocg, 0, "STDEV_Y", r_t);
-				ocg->add_field(ocg, 0, "STDEV_K", r_t);
-			}
-			nsetel += 2 * depth;
-	
-			if ((setel = (cgats_set_elem *)malloc(sizeof(cgats_set_elem) * nsetel)) == NULL)
-				error("Malloc failed!");
-
-			if ((idhash = (unsigned int *)malloc(sizeof(unsigned int) * npat)) == NULL)
-				error("Malloc failed!");
-
-			/* Setup hash list of reference labels to speed comparisons */
-			for (j = 0; j < npat; j++) {
-				char id[100];		/* Reference patch id */
-
-				/* Normalise reference labels */
-				fix_it8(id, ((char *)icg->t[0].fdata[j][sx]));	/* Copy and fix */
-
-				idhash[j] = shash(id);
-			}
-
-			/* Initialise, ready to read out all the values */
-			for (i = sr->reset(sr); i > 0; i--) {
-				char tod[100];			/* Temp output patch id */
-				char od[100];			/* Output patch id */
-				unsigned int odhash;	/* Chart id hashes */
-				double P[4];			/* Robust/true mean values */
-				double sdP[4];			/* Standard deviation */
-				int pixcnt;				/* Pixel count */
-
-				if (tmean)
-					sr->read(sr, tod, NULL, P, sdP, &pixcnt);
-				else
-					sr->read(sr, tod, P, NULL, sdP, &pixcnt);
-
-				fix_it8(od, tod);
-
-				odhash = shash(od);
-		
-				if (pixcnt == 0)
-					pnotscan++;
-
-				/* Search for matching id in reference */
-				for (j = 0; j < npat; j++) {
-					char id[100];		/* Reference patch id */
-
-					if (odhash != idhash[j])	/* Fast reject */
-						continue;
-
-					/* Normalise reference labels */
-					fix_it8(id, ((char *)icg->t[0].fdata[j][sx]));	/* Copy and fix */
-	
-					if (strcmp(id, od) == 0) {
-						int k = 0, m;
-						double XYZ[3];
-
-						setel[k++].c = id;
-
-				        XYZ[0] = *((double *)icg->t[0].fdata[j][Xx]);
-				        XYZ[1] = *((double *)icg->t[0].fdata[j][Yx]);
-				        XYZ[2] = *((double *)icg->t[0].fdata[j][Zx]);
-						if (isLab) {
-							icmLab2XYZ(&icmD50, XYZ, XYZ);
-							XYZ[0] *= 100.0;
-							XYZ[1] *= 100.0;
-							XYZ[2] *= 100.0;
-						}
-
-						setel[k++].d = XYZ[0];
-						setel[k++].d = XYZ[1];
-						setel[k++].d = XYZ[2];
-
-						if (spec_n > 0) {
-							for (m = 0; m < spec_n; m++) {
-								setel[k++].d = *((double *)icg->t[0].fdata[j][spi[m]]);
-							}
-						}
+			atm[strlen(atm)-1] = '\000';	/* Remove \n from end */
 
-						for (m = 0; m < depth; m++) 
-							setel[k++].d = P[m] * 100.0/255.0;
-						for (m = 0; m < depth; m++) 
-							setel[k++].d = sdP[m] * 100.0/255.0;
+			read_chtref(&cr, datin_name);
 
-						ocg->add_setarr(ocg, 0, setel);
-
-						break;
-					}
-					if (j >= npat && verb >= 1)
-						printf("Warning: Couldn't match field '%s'\n",od);
-				}
-			}
-	
-			if (verb)
-				printf("Writing output values to file '%s'\n",datout_name);
-				
-			if (ocg->write_name(ocg, datout_name))
-				error("Output file '%s' write error : %s",datout_name, ocg->err);
-	
-			free(idhash);
-			free(setel);
-
-			ocg->del(ocg);		/* Clean up */
-			icg->del(icg);		/* Clean up */
+			if (write_scan_ti3(&cr, sr, depth, tmean, verb, atm, datout_name, &pnotscan, em))
+				error("%s",em);
 
+			free_chtref(&cr);
 		}
 	}
 
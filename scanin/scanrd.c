@@ -73,6 +73,7 @@ static int calc_rotation(scanrd_ *s);
 static int calc_elists(scanrd_ *s, int ref);
 static int write_elists(scanrd_ *s);
 static int read_relists(scanrd_ *s);
+static int copy_relists(scanrd_ *s, scanrd_ *r);
 static int do_match(scanrd_ *s);
 static int compute_ptrans(scanrd_ *s);
 static int compute_man_ptrans(scanrd_ *s, double *sfids);
@@ -91,7 +92,7 @@ static void pval2Lab(double *out, double *in, int depth);
 
 /* Read in a chart, and either create a reference or make values available, */
 /* by using reset() and read() to get values read */
-scanrd *do_scanrd(
+static scanrd *do_scanrd_(
 int flags,			/* option flags */
 int verb,			/* verbosity level */
 
@@ -105,6 +106,7 @@ int (*read_line)(void *fdata, int y, char *dst),	/* Read RGB line of source file
 void *fdata,		/* Opaque data for read_line */
 
 char *refname,		/* reference file name */
+scanrd_ *ref,		/* Reference previously read, NULL to read refname */
 
 int (*write_line)(void *ddata, int y, char *src),	/* Write RGB line of diag file */
 void *ddata			/* Opaque data for write_line */
@@ -180,12 +182,19 @@ void *ddata			/* Opaque data for write_line */
 		if (calc_elists(s, 0))		/* match */
 			goto sierr;		/* Error */
 
-		if (s->verb >= 2)
-			DBG((dbgo,"About to read reference feature information\n"));
-		if (read_relists(s))
-			goto sierr;		/* Error */
-		if (s->verb >= 2)
-			DBG((dbgo,"Read of chart reference file succeeded\n"));
+		if (ref != NULL) {
+			if (s->verb >= 2)
+				DBG((dbgo,"About to copy reference feature information\n"));
+			if (copy_relists(s, ref))
+				goto sierr;		/* Error */
+		} else {
+			if (s->verb >= 2)
+				DBG((dbgo,"About to read reference feature information\n"));
+			if (read_relists(s))
+				goto sierr;		/* Error */
+			if (s->verb >= 2)
+				DBG((dbgo,"Read of chart reference file succeeded\n"));
+		}
 
 		if (sfid != NULL) {		/* Manual matching */
 			if (s->verb >= 2)
@@ -320,6 +329,69 @@ sierr:;
 	return (scanrd *)s;
 }
 
+/* Read in a chart, and either create a reference or make values available */
+scanrd *do_scanrd(
+int flags,			/* option flags */
+int verb,			/* verbosity level */
+double gammav,		/* Apprimate gamma encoding of image (0.0 = default 2.2) */
+double *sfid,		/* Specified four fiducials x1, y1 .. x4, y4, NULL if auto recognition */
+int w, int h, 		/* Width and Height of input raster in pixels */
+int d, int td, int p,		/* Useful plane depth, Total depth, Bit presision of input pixels */
+int (*read_line)(void *fdata, int y, char *dst),	/* Read RGB line of source file */
+void *fdata,		/* Opaque data for read_line */
+char *refname,		/* reference file name */
+int (*write_line)(void *ddata, int y, char *src),	/* Write RGB line of diag file */
+void *ddata			/* Opaque data for write_line */
+) {
+	return do_scanrd_(flags, verb, gammav, sfid, w, h, d, td, p, read_line, fdata,
+	                  refname, NULL, write_line, ddata);
+}
+
+/* Read just the chart reference file, so that it can be */
+/* shared by any number of do_scanrd_ref() calls. */
+scanrd *read_scanrd_ref(
+int verb,			/* verbosity level */
+char *refname		/* reference file name */
+) {
+	scanrd_ *s;
+
+	if ((s = new_scanrd(0, verb, 0.0, NULL, NULL, 0, 0, 0, 0, 8, NULL, NULL, refname)) == NULL)
+		return NULL;
+
+	if (s->errv != 0)
+		return (scanrd *)s;
+
+	if (s->verb >= 2)
+		DBG((dbgo,"About to read reference feature information\n"));
+	if (read_relists(s))
+		return (scanrd *)s;		/* Error */
+	if (s->verb >= 2)
+		DBG((dbgo,"Read of chart reference file succeeded\n"));
+
+	return (scanrd *)s;
+}
+
+/* Read in a chart and make values available, using a reference */
+/* previously read by read_scanrd_ref(). */
+scanrd *do_scanrd_ref(
+int flags,			/* option flags */
+int verb,			/* verbosity level */
+double gammav,		/* Apprimate gamma encoding of image (0.0 = default 2.2) */
+double *sfid,		/* Specified four fiducials x1, y1 .. x4, y4, NULL if auto recognition */
+int w, int h, 		/* Width and Height of input raster in pixels */
+int d, int td, int p,		/* Useful plane depth, Total depth, Bit presision of input pixels */
+int (*read_line)(void *fdata, int y, char *dst),	/* Read RGB line of source file */
+void *fdata,		/* Opaque data for read_line */
+scanrd *ref,		/* Reference from read_scanrd_ref() */
+int (*write_line)(void *ddata, int y, char *src),	/* Write RGB line of diag file */
+void *ddata			/* Opaque data for write_line */
+) {
+	scanrd_ *r = (scanrd_ *)ref;	/* Cast public to private */
+
+	return do_scanrd_(flags & ~SI_BUILD_REF, verb, gammav, sfid, w, h, d, td, p,
+	                  read_line, fdata, r->refname, r, write_line, ddata);
+}
+
 
 /********************************************************************************/
 
@@ -362,6 +434,7 @@ static scanrd_
 
 	s->flags = flags;
 	s->verb = verb;
+	s->nthr = (flags & SI_NO_THREADS) ? 1 : 0;		/* 0 = default number of threads */
 
 	s->errv = 0;
 	s->errm[0] = '\0';
@@ -534,19 +607,44 @@ scanrd_error(scanrd *ps, char **errm) {
 }
 
 /********************************************************************************/
-static int analize(scanrd_ *s, unsigned char *inp[6], int y);
+#define RI_BLOCK 32		/* Number of lines read_input() processes in parallel */
+
+/* Per pixel edge detection values for one line */
+typedef struct {
+	double *tdh, *tdv;		/* Horizontal/virtical detect levels */
+	unsigned char *ss;		/* Number of planes with the same sign of cross components */
+} edvals;
+
+/* Context for edge detecting a block of lines in parallel */
+typedef struct {
+	scanrd_ *s;
+	unsigned char **in;		/* Previous 5 lines followed by the block of lines */
+	edvals *ev;				/* Edge detection values for each line of the block */
+	int y0;					/* y of the first line of the block */
+} ancntx;
+
+static int analize_init(scanrd_ *s);
+static int analize_ungamma(void *cntx, int i0, int i1, int thix);
+static int analize_detect(void *cntx, int i0, int i1, int thix);
+static int analize(scanrd_ *s, edvals *ev, int y);
 
 /* Read in and process the input file */
+/* The per pixel edge detection is done in parallel on blocks */
+/* of lines, while the line by line threshold adaptation and */
+/* region tracking is done serially. */
 /* Return non-zero on error */
 static int
 read_input(scanrd_ *s) {
-	unsigned char *in[6];		/* Pointer to six input buffers */
+	unsigned char *in[5 + RI_BLOCK];	/* Previous 5 lines and block of new lines */
+	unsigned char *tin[5 + RI_BLOCK];
+	edvals ev[RI_BLOCK];		/* Edge detection values for the block */
+	ancntx cx;
 	int w = s->width;			/* Raster width */
 	int h = s->height;			/* Raster height */
-	int i, y;
+	int i, j, y, nl;
 
 	/* Allocate input line buffers */
-	for (i = 0; i < 6; i++) {
+	for (i = 0; i < (5 + RI_BLOCK); i++) {
 		if ((in[i] = malloc(s->tdepth * w * s->bypp)) == NULL) {
 			s->errv = SI_MALLOC_INPUT_BUF;
 			sprintf(s->errm,"scanrd: Failed to malloc input line buffers");
@@ -554,6 +652,20 @@ read_input(scanrd_ *s) {
 		}
 	}
 
+	/* Allocate edge detection value buffers */
+	for (i = 0; i < RI_BLOCK; i++) {
+		if ((ev[i].tdh = (double *)malloc(2 * sizeof(double) * w)) == NULL
+		 || (ev[i].ss = (unsigned char *)malloc(w)) == NULL) {
+			s->errv = SI_MALLOC_INPUT_BUF;
+			sprintf(s->errm,"scanrd: Failed to malloc edge detection buffers");
+			return 1;
+		}
+		ev[i].tdv = ev[i].tdh + w;
+	}
+
+	if (analize_init(s))
+		return 1;
+
 	/* Prime the input buffers with 5 lines */
 	for (y = 0; y < 5; y++) {
 		if (s->read_line(s->fdata, y, (char *)in[y])) {
@@ -562,27 +674,41 @@ read_input(scanrd_ *s) {
 			return 1;
 		}
 	}
-	/* Process the tiff file line by line (Assume at least 6 lines in total raster) */
-	for (; y < h; ++y) {
-		unsigned char *tt;
-		if (s->read_line(s->fdata, y, (char *)in[5])) {
-			s->errv = SI_RAST_READ_ERR;
-			sprintf(s->errm,"scanrd: read_line() returned error");
-			return 1;
-		}
+	cx.s = s;
+	cx.in = in;
+	cx.ev = ev;
 
-		if (analize(s, in, y)) {
-			return 1;
+	/* Process the tiff file a block of lines at a time (Assume at least 6 lines in total raster) */
+	for (; y < h; y += nl) {
+
+		if ((nl = h - y) > RI_BLOCK)
+			nl = RI_BLOCK;
+
+		for (j = 0; j < nl; j++) {
+			if (s->read_line(s->fdata, y + j, (char *)in[5 + j])) {
+				s->errv = SI_RAST_READ_ERR;
+				sprintf(s->errm,"scanrd: read_line() returned error");
+				return 1;
+			}
 		}
 
-		tt = in[0];		/* Shuffle buffers about */
-		in[0] = in[1];
-		in[1] = in[2];
-		in[2] = in[3];
-		in[3] = in[4];
-		in[4] = in[5];
-		in[5] = tt;
+		/* Un-gamma correct the new lines, then edge detect them */
+		cx.y0 = y;
+		par_for(s->nthr, 0, nl, 1, analize_ungamma, (void *)&cx);
+		par_for(s->nthr, 0, nl, 1, analize_detect, (void *)&cx);
 
+		/* Track the edge regions line by line */
+		for (j = 0; j < nl; j++) {
+			if (analize(s, &ev[j], y + j)) {
+				return 1;
+			}
+		}
+
+		/* Shuffle buffers about, so that the last 5 lines come first */
+		for (i = 0; i < (5 + RI_BLOCK); i++)
+			tin[i] = in[(i + nl) % (5 + RI_BLOCK)];
+		for (i = 0; i < (5 + RI_BLOCK); i++)
+			in[i] = tin[i];
 	}
 	s->adivval /= (double)s->divc;	/* Average divider value, 1.0 = 0 degrees, 0.0 = 45 degrees */
 	if (s->adivval < 0.0)
@@ -593,8 +719,12 @@ read_input(scanrd_ *s) {
 	if (s->verb >= 2)
 		DBG((dbgo,"adivval = %f\n",s->adivval));
 
-	/* Free the input line buffers */
-	for (i = 0; i < 6; i++)
+	/* Free the edge detection and input line buffers */
+	for (i = 0; i < RI_BLOCK; i++) {
+		free(ev[i].tdh);
+		free(ev[i].ss);
+	}
+	for (i = 0; i < (5 + RI_BLOCK); i++)
 		free(in[i]);
 
 	return 0;
@@ -629,6 +759,8 @@ read_input(scanrd_ *s) {
 #define MIN_POINT_TO_AREA  0.9	/* Minimum point desity over the lines area */
 #define SD_WINDOW          1.5	/* Allow += 1.5 of a standard deviation for robust angle calc. */
 #define ELISTCDIST 800		/* 1/ELISTCDIST = portion of refence edge list legth to coalesce over */
+#define MATCH_ANCHORS 2		/* Coarse match on the longest MATCH_ANCHORS x reference count target lines, */
+#define MATCH_MINANCH 24	/* or at least this many. */
 
 /* Criteria for accepting lines for improring final fit */
 #define IMP_MATCH 0.10			/* Proportion of average tick spacing */
@@ -640,192 +772,258 @@ read_input(scanrd_ *s) {
 
 static int add_region(scanrd_ *s, region *rego, int no_o, region *regn, int no_n, int y);
 
-/* Process a line of the TIFF file */
+/* Setup for analize() */
 /* return non-zero on error */
 static int
-analize(
-scanrd_ *s,
-unsigned char *inp[6],		/* current and previous 5 lines */
-int y						/* Current line y */
+analize_init(
+scanrd_ *s
 ) {
 	int w = s->width;
+	unsigned short *gamma = s->gamma;
+	int i;
+
+	/* Init gamma conversion lookup and region tracking. */
+	/* The assumption is that a typical chart has an approx. visually */
+	/* uniform distribution of samples, so that a typically gamma */
+	/* encoded scan image will have an average pixel value of 50%. */
+	/* If a the chart has a different gamma encoding (ie. linear), */
+	/* then we convert it to gamma 2.2 encoded to (hopefuly) enhance */
+	/* the patch contrast. */
+	if (s->bpp == 8)
+	    for (i = 0; i < 256; i++) {
+			int byteb1;
+		
+			byteb1 = (int)(0.5 + 255 * pow( i / 255.0, s->gammav/2.2 ));
+			gamma[i] = byteb1;
+		}
+	else
+	    for (i = 0; i < 65536; i++) {
+			int byteb1;
+		
+			byteb1 = (int)(0.5 + 65535 * pow( i / 65535.0, s->gammav/2.2 ));
+			gamma[i] = byteb1;
+		}
+
+	if ((s->vrego = (region *) malloc(sizeof(region) * (w+1)/2)) == NULL) {
+		s->errv = SI_MALLOC_VREGION;
+		sprintf(s->errm,"vreg malloc failed");
+		return 1;
+	}
+	s->no_vo = 0;
+	if ((s->vregn = (region *) malloc(sizeof(region) * (w+1)/2)) == NULL) {
+		s->errv = SI_MALLOC_VREGION;
+		sprintf(s->errm,"vreg malloc failed");
+		return 1;
+	}
+	s->no_vn = 0;
+	if ((s->hrego = (region *) malloc(sizeof(region) * (w+1)/2)) == NULL) {
+		s->errv = SI_MALLOC_VREGION;
+		sprintf(s->errm,"vreg malloc failed");
+		return 1;
+	}
+	s->no_ho = 0;
+	if ((s->hregn = (region *) malloc(sizeof(region) * (w+1)/2)) == NULL) {
+		s->errv = SI_MALLOC_VREGION;
+		sprintf(s->errm,"vreg malloc failed");
+		return 1;
+	}
+	s->no_hn = 0;
+	INIT_LIST(s->gdone);
+	s->inited = 1;
+
+	return 0;
+}
+
+/* Un-gamma correct lines i0 to i1-1 of a block */
+static int
+analize_ungamma(
+void *cntx,
+int i0, int i1,
+int thix
+) {
+	ancntx *cx = (ancntx *)cntx;
+	scanrd_ *s = cx->s;
 	int stride = s->tdepth * s->width;	/* In pixels */
 	unsigned short *gamma = s->gamma;
-	int x,i;
+	int x, j;
+
+	for (j = i0; j < i1; j++) {
+		unsigned char *inp = cx->in[5 + j];
+		unsigned short *inp2 = (unsigned short *)inp;
+
+		if (s->bpp == 8)
+			for (x = 0; x < stride; x++)
+				inp[x] = (unsigned char)gamma[inp[x]];
+		else
+			for (x = 0; x < stride; x++)
+				inp2[x] = gamma[inp2[x]];
+	}
+	return 0;
+}
+
+/* Compute the edge detection values of lines i0 to i1-1 of a block. */
+/* Each line uses its current and previous 5 (un-gamma corrected) lines. */
+static int
+analize_detect(
+void *cntx,
+int i0, int i1,
+int thix
+) {
+	ancntx *cx = (ancntx *)cntx;
+	scanrd_ *s = cx->s;
+	int w = s->width;
+	int x,i,j;
+	unsigned char  *inp[6];		/* current and previous 5 lines */
 	unsigned short *inp2[6];	/* current and previous 5 lines (16bpp) equivalent of inp[] */
 	unsigned char  *in[6];		/* six input lines (8bpp) */
 	unsigned short *in2[6];		/* six input lines (16bpp) */
-	region *tr;
 	double tdh,tdv;				/* Horizontal/virtical detect levels */
-	double tdmag;
-	double atdmag = 0.0;		/* Average magnitude over a line */
-	int atdmagc = 0;			/* Average magnitude over a line count */
-	double linedv = 0.0;		/* Lines average divider value */
-	int linedc = 0;				/* Lines average count */
 	int xo3 = s->tdepth * 3;	/* Xoffset by 3 pixels */
 	int xo2 = s->tdepth * 2;	/* Xoffset by 2 pixels */
 	int xo1 = s->tdepth * 1;	/* Xoffset by 1 pixels */
 
-	for (x = 0; x < 6; x++)		/* Create 16 bpp version of line pointers */
-		inp2[x] = (unsigned short *)inp[x];
-
-	if (s->inited == 0) {
-		/* Init gamma conversion lookup and region tracking. */
-		/* The assumption is that a typical chart has an approx. visually */
-		/* uniform distribution of samples, so that a typically gamma */
-		/* encoded scan image will have an average pixel value of 50%. */
-		/* If a the chart has a different gamma encoding (ie. linear), */
-		/* then we convert it to gamma 2.2 encoded to (hopefuly) enhance */
-		/* the patch contrast. */
-		if (s->bpp == 8)
-		    for (i = 0; i < 256; i++) {
-				int byteb1;
-			
-				byteb1 = (int)(0.5 + 255 * pow( i / 255.0, s->gammav/2.2 ));
-				gamma[i] = byteb1;
-			}
-		else
-		    for (i = 0; i < 65536; i++) {
-				int byteb1;
-			
-				byteb1 = (int)(0.5 + 65535 * pow( i / 65535.0, s->gammav/2.2 ));
-				gamma[i] = byteb1;
-			}
+	for (j = i0; j < i1; j++) {
+		int y = cx->y0 + j;
+		edvals *ev = &cx->ev[j];
 
-		if ((s->vrego = (region *) malloc(sizeof(region) * (w+1)/2)) == NULL) {
-			s->errv = SI_MALLOC_VREGION;
-			sprintf(s->errm,"vreg malloc failed");
-			return 1;
-		}
-		s->no_vo = 0;
-		if ((s->vregn = (region *) malloc(sizeof(region) * (w+1)/2)) == NULL) {
-			s->errv = SI_MALLOC_VREGION;
-			sprintf(s->errm,"vreg malloc failed");
-			return 1;
+		for (x = 0; x < 6; x++) {	/* Create 16 bpp version of line pointers */
+			inp[x] = cx->in[j + x];
+			inp2[x] = (unsigned short *)inp[x];
 		}
-		s->no_vn = 0;
-		if ((s->hrego = (region *) malloc(sizeof(region) * (w+1)/2)) == NULL) {
-			s->errv = SI_MALLOC_VREGION;
-			sprintf(s->errm,"vreg malloc failed");
-			return 1;
-		}
-		s->no_ho = 0;
-		if ((s->hregn = (region *) malloc(sizeof(region) * (w+1)/2)) == NULL) {
-			s->errv = SI_MALLOC_VREGION;
-			sprintf(s->errm,"vreg malloc failed");
-			return 1;
+
+		/* Compute difference output for line y-3 */
+		for (x = 3; x < (w-2); x++) {		/* Allow for -3 to +2 from x */
+			unsigned char *out = s->out;
+			int e;
+			int ss;
+			int idx = ((y-2) * w + x) * 3;		/* Output raster index in bytes */
+
+			if (s->bpp == 8)
+				for (i = 0; i < 6; i++)
+					in[i] = inp[i] + x * s->tdepth;	/* Strength reduce */
+			else
+				for (i = 0; i < 6; i++) {
+					in2[i] = inp2[i] + x * s->tdepth;	/* Strength reduce */
+					in[i] = (unsigned char *)in2[i];	/* track 8bpp pointers */
+				}
+
+			if (s->flags & SI_SHOW_IMAGE) {		/* Create B&W image */
+				toRGB(out + idx, in[2], s->depth, s->bpp);		/* Convert to RGB */
+				out[idx] = out[idx+1] = out[idx+2] = (2 * out[idx] + 7 * out[idx+1] + out[idx+2])/10;
+			}
+
+			ss = 0;		/* Sign of cross components the same vote */
+			tdh = tdv = 0.0;
+		
+			if (s->bpp == 8)
+				for (e = 0; e < s->depth; e++) {
+					int d1,d2;
+					/* Compute Gxp */
+					d1 = -in[0][-xo3+e] + -in[0][-xo2+e] + -in[0][-xo1+e]
+					                              + -in[0][ 0+e] + -in[0][ xo1+e] + -in[0][ xo2+e]
+					   + -in[1][-xo3+e] + -in[1][-xo2+e] + -in[1][-xo1+e]
+					                              + -in[1][ 0+e] + -in[1][ xo1+e] + -in[1][ xo2+e] 
+					   + -in[2][-xo3+e] + -in[2][-xo2+e] + -in[2][-xo1+e]
+					                              + -in[2][ 0+e] + -in[2][ xo1+e] + -in[2][ xo2+e]
+					   +  in[3][-xo3+e] +  in[3][-xo2+e] +  in[3][-xo1+e]
+					                              +  in[3][ 0+e] +  in[3][ xo1+e] +  in[3][ xo2+e]
+					   +  in[4][-xo3+e] +  in[4][-xo2+e] +  in[4][-xo1+e]
+					                              +  in[4][ 0+e] +  in[4][ xo1+e] +  in[4][ xo2+e]
+					   +  in[5][-xo3+e] +  in[5][-xo2+e] +  in[5][-xo1+e]
+					                              +  in[5][ 0+e] +  in[5][ xo1+e] +  in[5][ xo2+e];
+					/* Compute Gyp */
+					d2 = -in[0][-xo3+e] + -in[1][-xo3+e] + -in[2][-xo3+e]
+					                              + -in[3][-xo3+e] + -in[4][-xo3+e] + -in[5][-xo3+e]
+					   + -in[0][-xo2+e] + -in[1][-xo2+e] + -in[2][-xo2+e]
+					                              + -in[3][-xo2+e] + -in[4][-xo2+e] + -in[5][-xo2+e]
+					   + -in[0][-xo1+e] + -in[1][-xo1+e] + -in[2][-xo1+e]
+					                              + -in[3][-xo1+e] + -in[4][-xo1+e] + -in[5][-xo1+e]
+					   +  in[0][   0+e] +  in[1][   0+e] +  in[2][   0+e]
+					                              +  in[3][   0+e] +  in[4][   0+e] +  in[5][   0+e]
+					   +  in[0][+xo1+e] +  in[1][+xo1+e] +  in[2][+xo1+e]
+					                              +  in[3][+xo1+e] +  in[4][+xo1+e] +  in[5][+xo1+e]
+					   +  in[0][+xo2+e] +  in[1][+xo2+e] +  in[2][+xo2+e]
+					                              +  in[3][+xo2+e] +  in[4][+xo2+e] +  in[5][+xo2+e];
+
+					if ((d1 >= 0 && d2 >=0)
+					 || (d1 < 0 && d2 < 0))
+						ss++;				/* Sign was the same */
+					tdh += d1/4.5 * d1/4.5;		/* (4.5 = 6x6/4x2, to scale original tuned values) */
+					tdv += d2/4.5 * d2/4.5;
+				}
+			else
+				for (e = 0; e < s->depth; e++) {
+					int d1,d2;
+					/* Compute Gxp */
+					d1 = -in2[0][-xo3+e] + -in2[0][-xo2+e] + -in2[0][-xo1+e]
+					                              + -in2[0][ 0+e] + -in2[0][ xo1+e] + -in2[0][ xo2+e]
+					   + -in2[1][-xo3+e] + -in2[1][-xo2+e] + -in2[1][-xo1+e]
+					                              + -in2[1][ 0+e] + -in2[1][ xo1+e] + -in2[1][ xo2+e] 
+					   + -in2[2][-xo3+e] + -in2[2][-xo2+e] + -in2[2][-xo1+e]
+					                              + -in2[2][ 0+e] + -in2[2][ xo1+e] + -in2[2][ xo2+e]
+					   +  in2[3][-xo3+e] +  in2[3][-xo2+e] +  in2[3][-xo1+e]
+					                              +  in2[3][ 0+e] +  in2[3][ xo1+e] +  in2[3][ xo2+e]
+					   +  in2[4][-xo3+e] +  in2[4][-xo2+e] +  in2[4][-xo1+e]
+					                              +  in2[4][ 0+e] +  in2[4][ xo1+e] +  in2[4][ xo2+e]
+					   +  in2[5][-xo3+e] +  in2[5][-xo2+e] +  in2[5][-xo1+e]
+					                              +  in2[5][ 0+e] +  in2[5][ xo1+e] +  in2[5][ xo2+e];
+					/* Compute Gyp */
+					d2 = -in2[0][-xo3+e] + -in2[1][-xo3+e] + -in2[2][-xo3+e]
+					                              + -in2[3][-xo3+e] + -in2[4][-xo3+e] + -in2[5][-xo3+e]
+					   + -in2[0][-xo2+e] + -in2[1][-xo2+e] + -in2[2][-xo2+e]
+					                              + -in2[3][-xo2+e] + -in2[4][-xo2+e] + -in2[5][-xo2+e]
+					   + -in2[0][-xo1+e] + -in2[1][-xo1+e] + -in2[2][-xo1+e]
+					                              + -in2[3][-xo1+e] + -in2[4][-xo1+e] + -in2[5][-xo1+e]
+					   +  in2[0][   0+e] +  in2[1][   0+e] +  in2[2][   0+e]
+					                              +  in2[3][   0+e] +  in2[4][   0+e] +  in2[5][   0+e]
+					   +  in2[0][+xo1+e] +  in2[1][+xo1+e] +  in2[2][+xo1+e]
+					                              +  in2[3][+xo1+e] +  in2[4][+xo1+e] +  in2[5][+xo1+e]
+					   +  in2[0][+xo2+e] +  in2[1][+xo2+e] +  in2[2][+xo2+e]
+					                              +  in2[3][+xo2+e] +  in2[4][+xo2+e] +  in2[5][+xo2+e];
+
+					if ((d1 >= 0 && d2 >=0)
+					 || (d1 < 0 && d2 < 0))
+						ss++;				/* Sign was the same */
+				
+					tdh += d1/(4.5 * 257) * d1/(4.5 * 257);		/* Scale to 0..255 range */
+					tdv += d2/(4.5 * 257) * d2/(4.5 * 257);
+				}
+
+			ev->tdh[x] = tdh;
+			ev->tdv[x] = tdv;
+			ev->ss[x] = (unsigned char)ss;
 		}
-		s->no_hn = 0;
-		INIT_LIST(s->gdone);
-		s->inited = 1;
 	}
+	return 0;
+}
 
-	/* Un-gamma correct the latest input line */
-	if (s->bpp == 8)
-		for (x = 0; x < stride; x++)
-			inp[5][x] = (unsigned char)gamma[inp[5][x]];
-	else
-		for (x = 0; x < stride; x++)
-			inp2[5][x] = gamma[inp2[5][x]];
+/* Process a line of the TIFF file, given its edge detection values */
+/* return non-zero on error */
+static int
+analize(
+scanrd_ *s,
+edvals *ev,					/* Edge detection values for line y */
+int y						/* Current line y */
+) {
+	int w = s->width;
+	int x;
+	region *tr;
+	double tdh,tdv;				/* Horizontal/virtical detect levels */
+	double tdmag;
+	double atdmag = 0.0;		/* Average magnitude over a line */
+	int atdmagc = 0;			/* Average magnitude over a line count */
+	double linedv = 0.0;		/* Lines average divider value */
+	int linedc = 0;				/* Lines average count */
 
-	/* Compute difference output for line y-3 */
+	/* Threshold the difference output for line y-3 */
 	atdmagc = w - 5;		/* Magnitude count (to compute average) */
 	for (x = 3; x < (w-2); x++) {		/* Allow for -3 to +2 from x */
 		unsigned char *out = s->out;
-		int e;
-		int ss;
+		int ss = ev->ss[x];
 		int idx = ((y-2) * w + x) * 3;		/* Output raster index in bytes */
 
-		if (s->bpp == 8)
-			for (i = 0; i < 6; i++)
-				in[i] = inp[i] + x * s->tdepth;	/* Strength reduce */
-		else
-			for (i = 0; i < 6; i++) {
-				in2[i] = inp2[i] + x * s->tdepth;	/* Strength reduce */
-				in[i] = (unsigned char *)in2[i];	/* track 8bpp pointers */
-			}
-
-		if (s->flags & SI_SHOW_IMAGE) {		/* Create B&W image */
-			toRGB(out + idx, in[2], s->depth, s->bpp);		/* Convert to RGB */
-			out[idx] = out[idx+1] = out[idx+2] = (2 * out[idx] + 7 * out[idx+1] + out[idx+2])/10;
-		}
-
-		ss = 0;		/* Sign of cross components the same vote */
-		tdh = tdv = 0.0;
-		
-		if (s->bpp == 8)
-			for (e = 0; e < s->depth; e++) {
-				int d1,d2;
-				/* Compute Gxp */
-				d1 = -in[0][-xo3+e] + -in[0][-xo2+e] + -in[0][-xo1+e]
-				                              + -in[0][ 0+e] + -in[0][ xo1+e] + -in[0][ xo2+e]
-				   + -in[1][-xo3+e] + -in[1][-xo2+e] + -in[1][-xo1+e]
-				                              + -in[1][ 0+e] + -in[1][ xo1+e] + -in[1][ xo2+e] 
-				   + -in[2][-xo3+e] + -in[2][-xo2+e] + -in[2][-xo1+e]
-				                              + -in[2][ 0+e] + -in[2][ xo1+e] + -in[2][ xo2+e]
-				   +  in[3][-xo3+e] +  in[3][-xo2+e] +  in[3][-xo1+e]
-				                              +  in[3][ 0+e] +  in[3][ xo1+e] +  in[3][ xo2+e]
-				   +  in[4][-xo3+e] +  in[4][-xo2+e] +  in[4][-xo1+e]
-				                              +  in[4][ 0+e] +  in[4][ xo1+e] +  in[4][ xo2+e]
-				   +  in[5][-xo3+e] +  in[5][-xo2+e] +  in[5][-xo1+e]
-				                              +  in[5][ 0+e] +  in[5][ xo1+e] +  in[5][ xo2+e];
-				/* Compute Gyp */
-				d2 = -in[0][-xo3+e] + -in[1][-xo3+e] + -in[2][-xo3+e]
-				                              + -in[3][-xo3+e] + -in[4][-xo3+e] + -in[5][-xo3+e]
-				   + -in[0][-xo2+e] + -in[1][-xo2+e] + -in[2][-xo2+e]
-				                              + -in[3][-xo2+e] + -in[4][-xo2+e] + -in[5][-xo2+e]
-				   + -in[0][-xo1+e] + -in[1][-xo1+e] + -in[2][-xo1+e]
-				                              + -in[3][-xo1+e] + -in[4][-xo1+e] + -in[5][-xo1+e]
-				   +  in[0][   0+e] +  in[1][   0+e] +  in[2][   0+e]
-				                              +  in[3][   0+e] +  in[4][   0+e] +  in[5][   0+e]
-				   +  in[0][+xo1+e] +  in[1][+xo1+e] +  in[2][+xo1+e]
-				                              +  in[3][+xo1+e] +  in[4][+xo1+e] +  in[5][+xo1+e]
-				   +  in[0][+xo2+e] +  in[1][+xo2+e] +  in[2][+xo2+e]
-				                              +  in[3][+xo2+e] +  in[4][+xo2+e] +  in[5][+xo2+e];
-
-				if ((d1 >= 0 && d2 >=0)
-				 || (d1 < 0 && d2 < 0))
-					ss++;				/* Sign was the same */
-				tdh += d1/4.5 * d1/4.5;		/* (4.5 = 6x6/4x2, to scale original tuned values) */
-				tdv += d2/4.5 * d2/4.5;
-			}
-		else
-			for (e = 0; e < s->depth; e++) {
-				int d1,d2;
-				/* Compute Gxp */
-				d1 = -in2[0][-xo3+e] + -in2[0][-xo2+e] + -in2[0][-xo1+e]
-				                              + -in2[0][ 0+e] + -in2[0][ xo1+e] + -in2[0][ xo2+e]
-				   + -in2[1][-xo3+e] + -in2[1][-xo2+e] + -in2[1][-xo1+e]
-				                              + -in2[1][ 0+e] + -in2[1][ xo1+e] + -in2[1][ xo2+e] 
-				   + -in2[2][-xo3+e] + -in2[2][-xo2+e] + -in2[2][-xo1+e]
-				                              + -in2[2][ 0+e] + -in2[2][ xo1+e] + -in2[2][ xo2+e]
-				   +  in2[3][-xo3+e] +  in2[3][-xo2+e] +  in2[3][-xo1+e]
-				                              +  in2[3][ 0+e] +  in2[3][ xo1+e] +  in2[3][ xo2+e]
-				   +  in2[4][-xo3+e] +  in2[4][-xo2+e] +  in2[4][-xo1+e]
-				                              +  in2[4][ 0+e] +  in2[4][ xo1+e] +  in2[4][ xo2+e]
-				   +  in2[5][-xo3+e] +  in2[5][-xo2+e] +  in2[5][-xo1+e]
-				                              +  in2[5][ 0+e] +  in2[5][ xo1+e] +  in2[5][ xo2+e];
-				/* Compute Gyp */
-				d2 = -in2[0][-xo3+e] + -in2[1][-xo3+e] + -in2[2][-xo3+e]
-				                              + -in2[3][-xo3+e] + -in2[4][-xo3+e] + -in2[5][-xo3+e]
-				   + -in2[0][-xo2+e] + -in2[1][-xo2+e] + -in2[2][-xo2+e]
-				                              + -in2[3][-xo2+e] + -in2[4][-xo2+e] + -in2[5][-xo2+e]
-				   + -in2[0][-xo1+e] + -in2[1][-xo1+e] + -in2[2][-xo1+e]
-				                              + -in2[3][-xo1+e] + -in2[4][-xo1+e] + -in2[5][-xo1+e]
-				   +  in2[0][   0+e] +  in2[1][   0+e] +  in2[2][   0+e]
-				                              +  in2[3][   0+e] +  in2[4][   0+e] +  in2[5][   0+e]
-				   +  in2[0][+xo1+e] +  in2[1][+xo1+e] +  in2[2][+xo1+e]
-				                              +  in2[3][+xo1+e] +  in2[4][+xo1+e] +  in2[5][+xo1+e]
-				   +  in2[0][+xo2+e] +  in2[1][+xo2+e] +  in2[2][+xo2+e]
-				                              +  in2[3][+xo2+e] +  in2[4][+xo2+e] +  in2[5][+xo2+e];
-
-				if ((d1 >= 0 && d2 >=0)
-				 || (d1 < 0 && d2 < 0))
-					ss++;				/* Sign was the same */
-				
-				tdh += d1/(4.5 * 257) * d1/(4.5 * 257);		/* Scale to 0..255 range */
-				tdv += d2/(4.5 * 257) * d2/(4.5 * 257);
-			}
+		tdh = ev->tdh[x];
+		tdv = ev->tdv[x];
 
 		tdmag = tdh + tdv;
 
@@ -2308,6 +2506,54 @@ read_error:;
 	return 1;
 }
 
+/* Copy the reference information from a reference previously */
+/* read by read_scanrd_ref(). The edge lists get modified by */
+/* improve_match(), so each scanrd_ needs its own copy. */
+/* return non-zero on error */
+static int
+copy_relists(
+scanrd_ *s,
+scanrd_ *r		/* Reference to copy from */
+) {
+	int i;
+
+	for (i = 0; i < 8; i++)
+		s->fid[i] = r->fid[i];
+	s->fidsize = r->fidsize;
+	s->havefids = r->havefids;
+	s->rbox_shrink = r->rbox_shrink;
+	s->xpt = r->xpt;
+
+	s->nsbox = r->nsbox;
+	if ((s->sboxes = (sbox *) malloc(sizeof(sbox) * s->nsbox)) == NULL) {
+		s->errv = SI_MALLOC_REFREAD;
+		sprintf(s->errm,"copy_relists, malloc failed");
+		return 1;
+	}
+	memcpy(s->sboxes, r->sboxes, sizeof(sbox) * s->nsbox);
+
+	s->rxelist = r->rxelist;
+	s->ryelist = r->ryelist;
+	s->rxelist.a = (epoint *) malloc(sizeof(epoint) * r->rxelist.c);
+	s->ryelist.a = (epoint *) malloc(sizeof(epoint) * r->ryelist.c);
+	if (s->rxelist.a == NULL || s->ryelist.a == NULL) {
+		s->errv = SI_MALLOC_REFREAD;
+		sprintf(s->errm,"copy_relists, malloc failed");
+		return 1;
+	}
+	memcpy(s->rxelist.a, r->rxelist.a, sizeof(epoint) * r->rxelist.c);
+	memcpy(s->ryelist.a, r->ryelist.a, sizeof(epoint) * r->ryelist.c);
+
+	if (s->verb >= 3) {
+		DBG((dbgo,"\nrxelist:\n"));
+		debug_elist(s, &s->rxelist);
+		DBG((dbgo,"\nryelist:\n"));
+		debug_elist(s, &s->ryelist);
+	}
+
+	return 0;
+}
+
 /********************************************************************************/
 /* Create an inverted direction elist */
 /* return non-zero on error */
@@ -2504,15 +2750,19 @@ efunc(void *edata, double p[]) {
 	return rv;
 }
 
-/* return non-zero on error */
-static int
-best_match(
+/* Go through all reasonable translations and scales of the target, */
+/* anchoring the ends of the reference on pairs of the given target */
+/* lines, and return the best match to the reference. */
+static void
+search_match(
 scanrd_ *s,
 elist *r,		/* Reference list */
 elist *t,		/* Target list */
+int *aix,		/* Target line indexes to anchor on in ascending order, NULL for all */
+int na,			/* Number of anchor indexes */
 ematch *rv		/* Return values */
 ) {
-	int r0,r1,rw,t0,t1;
+	int r0,r1,rw,a0,a1,t0,t1;
 	double rwidth;
 	double cc;
 	double bcc = 0.0, boff = 0.0, bscale = 0.0;	/* best values */
@@ -2527,11 +2777,16 @@ ematch *rv		/* Return values */
 		rw = t->c/2;
 	rwidth = r->a[r1].pos - r->a[r0].pos;
 
-	for (t0 = 0; t0 < t->c-1; t0++) {
+	for (a0 = 0; a0 < na-1; a0++) {
 		double off;
-		for (t1 = t->c-1; t1 > (t0+rw); t1--) {
+		t0 = aix != NULL ? aix[a0] : a0;
+		for (a1 = na-1; a1 > a0; a1--) {
 			double scale;
 
+			t1 = aix != NULL ? aix[a1] : a1;
+			if (t1 <= (t0+rw))
+				break;
+
 			scale = rwidth/(t->a[t1].pos - t->a[t0].pos);
 			if (scale < 0.001 || scale > 100.0) {
 				break;		/* Don't bother with silly scale factors */
@@ -2598,13 +2853,84 @@ ematch *rv		/* Return values */
 			}
 		}
 	}
-	if (s->verb >= 7)
-		DBG((dbgo,"Returning best offset %f, scale %f returns %f\n\n", boff,bscale,bcc));
 
 	/* return best values */
 	rv->cc = bcc;
 	rv->off = boff;
 	rv->scale = bscale;
+}
+
+/* Find the best offset and scale match of target to reference. */
+/* A long target list is first coarsely registered by only anchoring */
+/* on its longest lines, which are the most likely to be chart edges, */
+/* with each promising match being refined against the whole list. */
+/* The exhaustive search is used if this fails to find a match. */
+/* return non-zero on error */
+static int
+best_match(
+scanrd_ *s,
+elist *r,		/* Reference list */
+elist *t,		/* Target list */
+ematch *rv		/* Return values */
+) {
+	int na;			/* Number of anchor lines */
+
+	rv->cc = rv->off = rv->scale = 0.0;
+
+	na = MATCH_ANCHORS * r->c;
+	if (na < MATCH_MINANCH)
+		na = MATCH_MINANCH;
+
+	if (t->c > na) {
+		int i, *aix;
+		double *lens, th;
+
+		if ((aix = (int *)malloc(sizeof(int) * t->c)) == NULL
+		 || (lens = (double *)malloc(sizeof(double) * t->c)) == NULL) {
+			free(aix);
+			s->errv = SI_MALLOC_ELIST;
+			sprintf(s->errm,"best_match: malloc failed");
+			return 1;
+		}
+
+		/* Locate the length threshold of the na longest lines */
+		for (i = 0; i < t->c; i++)
+			lens[i] = t->a[i].len;
+#define HEAP_COMPARE(A,B)  (A > B)
+		HEAPSORT(double, lens, t->c);
+#undef HEAP_COMPARE
+		th = lens[na-1];
+
+		for (na = i = 0; i < t->c; i++) {
+			if (t->a[i].len >= th)
+				aix[na++] = i;
+		}
+
+		if (s->verb >= 3)
+			DBG((dbgo,"Coarse matching on %d of %d lines\n",na,t->c));
+
+		search_match(s, r, t, aix, na, rv);
+
+		if (s->verb >= 3)
+			DBG((dbgo,"Coarse match offset %f, scale %f returns %f\n",
+			                                       rv->off,rv->scale,rv->cc));
+		free(lens);
+		free(aix);
+	}
+
+	/* Do an exhaustive search for short lists, */
+	/* or if the coarse match failed. */
+	if (rv->cc < MATCHCC) {
+		ematch em;
+
+		search_match(s, r, t, NULL, t->c, &em);
+		if (em.cc > rv->cc)
+			*rv = em;
+	}
+
+	if (s->verb >= 7)
+		DBG((dbgo,"Returning best offset %f, scale %f returns %f\n\n", rv->off,rv->scale,rv->cc));
+
 	return 0;
 }
 
@@ -3413,173 +3739,279 @@ double svlaf[21] = {
 	7.0898553402722982e+159
 };
 
-/* Scan the input file and accumulate the pixel values */
+#define VS_BLOCK 64		/* Number of lines do_value_scan() processes in parallel */
+
+/* Context for value scanning a block of lines in parallel */
+typedef struct {
+	scanrd_ *s;
+	unsigned char *in;		/* Block of input lines */
+	int y0, y1;				/* Range of lines in the block */
+	sbox **boxes;			/* Boxes to process */
+	int binsize;			/* Number of histogram bins */
+	double vscale;			/* Value scale for 16bpp values to range 0.0 - 255.0 */
+	double svla;			/* Scan value location adhustment */
+} vscntx;
+
+/* Accumulate the pixel values of the block of lines for boxes i0 to i1-1. */
+/* Each box has its own edge trackers and histogram, so boxes can be */
+/* processed in parallel. */
+static int
+vscan_accum(
+void *cntx,
+int i0, int i1,
+int thix
+) {
+	vscntx *cx = (vscntx *)cntx;
+	scanrd_ *s = cx->s;
+	int ox = s->width;
+	int lsize = s->tdepth * ox * s->bypp;	/* Line size in bytes */
+	int k, y, e;
+
+	for (k = i0; k < i1; k++) {
+		sbox *sp = cx->boxes[k];
+		int ys = cx->y0, ye = cx->y1;
+
+		if (sp->ymin > ys)
+			ys = sp->ymin;
+		if ((sp->ymax + 1) < ye)
+			ye = sp->ymax + 1;
+
+		for (y = ys; y < ye; y++) {
+			unsigned char *in = cx->in + (y - cx->y0) * lsize;	/* Input pixel line (8bpp) */
+			unsigned short *in2 = (unsigned short *)in;			/* Input pixel line (16bpp) */
+			int x,x1,x2,xx;	
+			unsigned char *oo = &s->out[y * ox * 3];		/* Output raster pointer if needed */
+			x1 = nextx(sp,&sp->l);		/* next in left edge */
+			x2 = nextx(sp,&sp->r);		/* next in right edge */
+			if (s->bpp == 8)
+				for (x = s->tdepth*x1, xx = 3*x1; x <= s->tdepth*x2; x += s->tdepth, xx +=3) {
+					for (e = 0; e < s->depth; e++)
+						sp->ps[e][in[x+e]]++;		/* Increment histogram bins */
+					if (s->flags & SI_SHOW_SAMPLED_AREA)
+						toRGB(oo+xx, in+x, s->depth, s->bpp);
+				}
+			else
+				for (x = s->tdepth*x1, xx = 3*x1; x <= s->tdepth*x2; x += s->tdepth, xx+=3) {
+					for (e = 0; e < s->depth; e++)
+						sp->ps[e][in2[x+e]]++;		/* Increment histogram bins */
+					if (s->flags & SI_SHOW_SAMPLED_AREA)
+						toRGB(oo+xx, (unsigned char *)(in2+x), s->depth, s->bpp);
+				}
+		}
+	}
+	return 0;
+}
+
+/* Compute the value statistics for the finished boxes i0 to i1-1, */
+/* and free their histograms. */
+static int
+vscan_stats(
+void *cntx,
+int i0, int i1,
+int thix
+) {
+	vscntx *cx = (vscntx *)cntx;
+	scanrd_ *s = cx->s;
+	int binsize = cx->binsize;
+	double vscale = cx->vscale;
+	double svla = cx->svla;
+	int k, e;
+
+	for (k = i0; k < i1; k++) {
+		sbox *sp = cx->boxes[k];
+		int i,j;
+		int cnt;
+		double P[MXDE];
+
+		/* Compute mean */
+		cnt = 0;
+		for (e = 0; e < s->depth; e++)
+		sp->mP[e] = 0.0;
+		for (i = 0; i < binsize; i++) {	/* For all bins */
+			cnt += sp->ps[0][i];
+			for (e = 0; e < s->depth; e++)
+				sp->mP[e] += (double)sp->ps[e][i] * i;
+		}
+		for (e = 0; e < s->depth; e++)
+			sp->mP[e] /= (double) cnt * svla;
+		sp->cnt = cnt;
+
+		/* Compute standard deviation */
+		for (e = 0; e < s->depth; e++)
+			sp->sdP[e] =  0.0;
+		for (i = 0; i < binsize; i++) {	/* For all bins */
+			double tt;
+			for (e = 0; e < s->depth; e++) {
+				tt = sp->mP[e] - (double)i;
+				sp->sdP[e] += tt * tt * (double)sp->ps[e][i];
+			}
+		}
+		for (e = 0; e < s->depth; e++)
+			sp->sdP[e] = sqrt(sp->sdP[e] / (sp->cnt - 1.0));
+
+		/* Compute "robust" mean */
+		/* (There are a number of ways to do this. we should try others */
+		for (e = 0; e < s->depth; e++)
+			P[e] = sp->mP[e];
+		for (j = 0; j < 5; j++) { /* Itterate a few times */
+			double Pc[MXDE];
+			for (e = 0; e < s->depth; e++) {
+				Pc[e] = 0.0;
+				sp->P[e] = 0.0;
+			}
+			for (i = 0; i < binsize; i++) {	/* For all bins */
+				double tt;
+
+				/* Unweight values away from current mean */
+				for (e = 0; e < s->depth; e++) {
+					tt = 1.0 + fabs((double)i - P[e]) * vscale;
+					Pc[e] += (double)sp->ps[e][i]/(tt * tt);
+					sp->P[e] += (double)sp->ps[e][i]/(tt * tt) * i;
+				}
+			}
+			for (e = 0; e < s->depth; e++)
+				P[e] = sp->P[e] /= Pc[e];
+		}
+
+		/* Scale all the values to be equivalent to 8bpp range */
+		for (e = 0; e < s->depth; e++) {
+			sp->mP[e]  *= vscale;
+			sp->sdP[e] *= vscale;
+			sp->P[e]   *= vscale;
+		}
+
+		free(sp->ps[0]);		/* Free up histogram array */
+		sp->active = 0;
+	}
+	return 0;
+}
+
+/* Scan the input file and accumulate the pixel values. */
+/* Blocks of lines are read, and then the boxes are */
+/* processed and their statistics computed in parallel. */
+/* Only the lines covered by sample boxes are read. */
 /* return non-zero on error */
 static int
 do_value_scan(
 scanrd_ *s
 ) {
-	int y;			/* current y */
+	int y, j;		/* current y */
 	int ox,oy;		/* x and y size */
 	int e;
-	unsigned char *in;		/* Input pixel buffer (8bpp) */
-	unsigned short *in2;	/* Input pixel buffer (16bpp) */
-	int binsize;
-	double vscale;		/* Value scale for 16bpp values to range 0.0 - 255.0 */
-	double svla;		/* Scan value location adhustment */
+	int lsize;		/* Line size in bytes */
+	int nl;			/* Number of lines in block */
+	int nb;			/* Number of boxes to process */
+	vscntx cx;
 	sbox *sp;
 
 	ox = s->width;
 	oy = s->height;
+	lsize = s->tdepth * ox * s->bypp;
 
+	cx.s = s;
 	if (s->bpp == 8) {
-		binsize = 256;
-		vscale = 1.0;
+		cx.binsize = 256;
+		cx.vscale = 1.0;
 	} else {
-		binsize = 65536;
-		vscale = 1.0/257.0;
+		cx.binsize = 65536;
+		cx.vscale = 1.0/257.0;
 	}
 
-	/* Allocate one input line buffers */
-	if ((in = malloc(s->tdepth * ox * s->bypp)) == NULL) {
+	/* Allocate a block of input line buffers */
+	if ((cx.in = malloc(VS_BLOCK * lsize)) == NULL) {
 		s->errv = SI_MALLOC_VALUE_SCAN;
 		sprintf(s->errm,"do_value_scan: Failed to malloc test output array");
 		return 1;
 	}
-	in2 = (unsigned short *)in;
+
+	/* Allocate the list of boxes to process */
+	if ((cx.boxes = (sbox **)malloc(sizeof(sbox *) * (s->nsbox + 1))) == NULL) {
+		free(cx.in);
+		s->errv = SI_MALLOC_VALUE_SCAN;
+		sprintf(s->errm,"do_value_scan: Failed to malloc box list");
+		return 1;
+	}
 
 	/* Compute the adjustment factor for these patches */
-	for (svla = 0.0, e = 1; e < (3 * 7); e++)
-		svla += svlaf[e];
-	svla *= svlaf[0];
+	for (cx.svla = 0.0, e = 1; e < (3 * 7); e++)
+		cx.svla += svlaf[e];
+	cx.svla *= svlaf[0];
+
+	/* Process the tiff file a block of lines at a time */
+	for (y = 0; y < oy; y += nl) {
+
+		/* If there are no active boxes, skip to where the next one starts */
+		if (s->alist == NULL) {
+			while (s->csi < s->nsbox && s->sbstart[s->csi]->diag != 0)
+				s->csi++;
+			if (s->csi >= s->nsbox)
+				break;			/* No more boxes */
+			if (s->sbstart[s->csi]->ymin > y) {
+				if (s->sbstart[s->csi]->ymin >= oy)
+					break;
+				y = s->sbstart[s->csi]->ymin;
+			}
+		}
 
-	/* Process the tiff file line by line */
-	for (y = 0; y < oy; y++) {
-		if (s->read_line(s->fdata, y, (char *)in)) {
-			s->errv = SI_RAST_READ_ERR;
-			sprintf(s->errm,"scanrd: do_value_scan: read_line() returned error");
-			return 1;
+		if ((nl = oy - y) > VS_BLOCK)
+			nl = VS_BLOCK;
+
+		for (j = 0; j < nl; j++) {
+			if (s->read_line(s->fdata, y + j, (char *)cx.in + j * lsize)) {
+				s->errv = SI_RAST_READ_ERR;
+				sprintf(s->errm,"scanrd: do_value_scan: read_line() returned error");
+				return 1;
+			}
 		}
+		cx.y0 = y;
+		cx.y1 = y + nl;
 
 		/* Update the active list with new boxes*/
-		while (s->csi < s->nsbox && s->sbstart[s->csi]->ymin <= y) {
-			/* If goes active on this y */
-			if (s->sbstart[s->csi]->diag == 0 && s->sbstart[s->csi]->ymin == y) {
+		while (s->csi < s->nsbox && s->sbstart[s->csi]->ymin < cx.y1) {
+			/* If goes active in this block */
+			if (s->sbstart[s->csi]->diag == 0 && s->sbstart[s->csi]->ymin >= y) {
 				sp = s->sbstart[s->csi];
 				if (s->verb >= 4)
 					DBG((dbgo,"added box %ld '%s' to the active list\n",(long)(sp - &s->sboxes[0]),sp->name));
 				ADD_ITEM_TO_TOP(s->alist,sp);	/* Add it to the active list */
 				sp->active = 1;
-				sp->ps[0] = calloc(s->tdepth * binsize,sizeof(unsigned long));
+				sp->ps[0] = calloc(s->tdepth * cx.binsize,sizeof(unsigned long));
 				if (sp->ps[0] == NULL)
 					error("do_value_scan: Failed to malloc sbox histogram array");
 				for (e = 1; e < s->depth; e++)
-					sp->ps[e] = sp->ps[e-1] + binsize;
+					sp->ps[e] = sp->ps[e-1] + cx.binsize;
 			}
 			s->csi++;
 		}
-		/* Process the line */
+
+		/* Process the lines for all the active boxes */
+		nb = 0;
 		sp = s->alist;
 		FOR_ALL_ITEMS(sbox, sp) {
-			int x,x1,x2,xx;	
-			unsigned char *oo = &s->out[y * ox * 3];		/* Output raster pointer if needed */
-			x1 = nextx(sp,&sp->l);		/* next in left edge */
-			x2 = nextx(sp,&sp->r);		/* next in right edge */
-			if (s->bpp == 8)
-				for (x = s->tdepth*x1, xx = 3*x1; x <= s->tdepth*x2; x += s->tdepth, xx +=3) {
-					for (e = 0; e < s->depth; e++)
-						sp->ps[e][in[x+e]]++;		/* Increment histogram bins */
-					if (s->flags & SI_SHOW_SAMPLED_AREA)
-						toRGB(oo+xx, in+x, s->depth, s->bpp);
-				}
-			else
-				for (x = s->tdepth*x1, xx = 3*x1; x <= s->tdepth*x2; x += s->tdepth, xx+=3) {
-					for (e = 0; e < s->depth; e++)
-						sp->ps[e][in2[x+e]]++;		/* Increment histogram bins */
-					if (s->flags & SI_SHOW_SAMPLED_AREA)
-						toRGB(oo+xx, (unsigned char *)(in2+x), s->depth, s->bpp);
-				}
+			cx.boxes[nb++] = sp;
 		} END_FOR_ALL_ITEMS(sp);
-
+		par_for(s->nthr, 0, nb, 1, vscan_accum, (void *)&cx);
 	 	
 		/* Delete finished boxes from the active list */
-		while (s->cei < s->nsbox && s->sbend[s->cei]->ymax <= y) {	/* All that finished last line */
+		nb = 0;
+		while (s->cei < s->nsbox && s->sbend[s->cei]->ymax < cx.y1) {	/* All that finished in block */
 			if (s->verb >= 4)
-				DBG((dbgo,"cei = %d, sbenc[s->cei]->ymax = %d, y = %d, active = %d\n",
-					s->cei,s->sbend[s->cei]->ymax,y,s->sbend[s->cei]->active));
-
-			/* If goes inactive after this y */
-			if (s->sbend[s->cei]->active != 0 && s->sbend[s->cei]->ymax == y) {
-				int i,j;
-				int cnt;
-				double P[MXDE];
+				DBG((dbgo,"cei = %d, sbenc[s->cei]->ymax = %d, y1 = %d, active = %d\n",
+					s->cei,s->sbend[s->cei]->ymax,cx.y1,s->sbend[s->cei]->active));
+
+			/* If goes inactive in this block */
+			if (s->sbend[s->cei]->active != 0 && s->sbend[s->cei]->ymax >= y) {
 				sp = s->sbend[s->cei];
 				if (s->verb >= 4)
 					DBG((dbgo,"deleted box %ld '%s' from the active list\n",(long)(sp - &s->sboxes[0]),sp->name));
 				DEL_LINK(s->alist,sp);		/* Remove it from active list */
-
-				/* Compute mean */
-				cnt = 0;
-				for (e = 0; e < s->depth; e++)
-				sp->mP[e] = 0.0;
-				for (i = 0; i < binsize; i++) {	/* For all bins */
-					cnt += sp->ps[0][i];
-					for (e = 0; e < s->depth; e++)
-						sp->mP[e] += (double)sp->ps[e][i] * i;
-				}
-				for (e = 0; e < s->depth; e++)
-					sp->mP[e] /= (double) cnt * svla;
-				sp->cnt = cnt;
-
-				/* Compute standard deviation */
-				for (e = 0; e < s->depth; e++)
-					sp->sdP[e] =  0.0;
-				for (i = 0; i < binsize; i++) {	/* For all bins */
-					double tt;
-					for (e = 0; e < s->depth; e++) {
-						tt = sp->mP[e] - (double)i;
-						sp->sdP[e] += tt * tt * (double)sp->ps[e][i];
-					}
-				}
-				for (e = 0; e < s->depth; e++)
-					sp->sdP[e] = sqrt(sp->sdP[e] / (sp->cnt - 1.0));
-
-				/* Compute "robust" mean */
-				/* (There are a number of ways to do this. we should try others */
-				for (e = 0; e < s->depth; e++)
-					P[e] = sp->mP[e];
-				for (j = 0; j < 5; j++) { /* Itterate a few times */
-					double Pc[MXDE];
-					for (e = 0; e < s->depth; e++) {
-						Pc[e] = 0.0;
-						sp->P[e] = 0.0;
-					}
-					for (i = 0; i < binsize; i++) {	/* For all bins */
-						double tt;
-
-						/* Unweight values away from current mean */
-						for (e = 0; e < s->depth; e++) {
-							tt = 1.0 + fabs((double)i - P[e]) * vscale;
-							Pc[e] += (double)sp->ps[e][i]/(tt * tt);
-							sp->P[e] += (double)sp->ps[e][i]/(tt * tt) * i;
-						}
-					}
-					for (e = 0; e < s->depth; e++)
-						P[e] = sp->P[e] /= Pc[e];
-				}
-
-				/* Scale all the values to be equivalent to 8bpp range */
-				for (e = 0; e < s->depth; e++) {
-					sp->mP[e]  *= vscale;
-					sp->sdP[e] *= vscale;
-					sp->P[e]   *= vscale;
-				}
-
-				free(sp->ps[0]);		/* Free up histogram array */
-				sp->active = 0;
+				cx.boxes[nb++] = sp;
 			}
 			s->cei++;
 		}
+
+		/* Compute the finished boxes values */
+		par_for(s->nthr, 0, nb, 1, vscan_stats, (void *)&cx);
 	}
 
 	/* Any boxes remaining on active list must hang */
@@ -3594,6 +4026,9 @@ scanrd_ *s
 		sp->active = 0;
 	END_FOR_ALL_ITEMS(sp);
 
+	free(cx.boxes);
+	free(cx.in);
+
 	return 0;
 }
 
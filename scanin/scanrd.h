@@ -23,6 +23,7 @@
 #define SI_PERSPECTIVE 	      0x20000	/* Allow perspective correction */
 #define SI_GENERAL_ROT 	      0x40000	/* Allow general rotation, else assume zero degrees */
 #define SI_ASISIFFAIL 	      0x80000	/* Read patch values "as is" if everything else failes */
+#define SI_NO_THREADS 	     0x100000	/* Don't use multiple threads within scanrd */
 
 /* Scanrd diagnostic flags */
 #define SI_SHOW_FLAGS         0xffff	/* Mask for all SHOW flags */
@@ -122,4 +123,35 @@ scanrd *do_scanrd(
 	void *ddata			/* Opaque data for write_line */
 );
 
+/* Read just a chart reference file, so that it can be shared by */
+/* any number of do_scanrd_ref() calls, which may be in different threads. */
+/* Use error() to check for failure, and free() when done. */
+scanrd *read_scanrd_ref(
+	int verb,			/* verbosity level */
+	char *refname		/* reference file name */
+);
+
+/* Same as do_scanrd(), but match against a reference previously */
+/* read by read_scanrd_ref() rather than reading a reference file. */
+scanrd *do_scanrd_ref(
+	int flags,			/* option flags (SI_BUILD_REF is ignored) */
+	int verb,			/* verbosity level */
+
+	double gamma,		/* Approximate gamma encoding of image (0.0 = default 1.7) */
+
+	double *sfid,		/* Specified fiducuals x1,y1, x2,y2, x3,y3, x4,y4,  */
+						/* Typically clockwise from top left, NULL if auto recognition */
+
+	int w, int h, 		/* Width and Height of input raster in pixels */
+	int d, int td, int p,	/* Useful plane depth, Total depth, Bit presision of input pixels */
+
+	int (*read_line)(void *fdata, int y, char *dst),	/* Read pixel interleaved line of source */
+	void *fdata,		/* Opaque data for read_line */
+
+	scanrd *ref,		/* Reference from read_scanrd_ref() */
+
+	int (*write_line)(void *ddata, int y, char *src),	/* Write 8bpp RGB line of diag file */
+	void *ddata			/* Opaque data for write_line */
+);
+
 
@@ -167,6 +167,7 @@ struct _scanrd_ {
 	
 	/* Private variables */
 	int flags;				/* Operation/diagnostic flags */
+	int nthr;				/* Number of threads for par_for(), 0 = default */
 	int verb;				/* verbosity level */
 							/* 0 = none */
 							/* 1 = warnings */
@@ -74,8 +74,94 @@ void usage(char *diag, ...) {
 struct _inpinfo {
 	char name[MAXNAMEL+1];
 	cgats *c;
+	int err;					/* nz if reading failed */
+	char errm[MAXNAMEL+300];	/* Error message if failed */
 }; typedef struct _inpinfo inpinfo;
 
+/* Read input files i0 .. i1-1 */
+static int read_inps(void *cntx, int i0, int i1, int thix) {
+	inpinfo *inps = (inpinfo *)cntx;
+	int n;
+
+	for (n = i0; n < i1; n++) {
+		inpinfo *ip = &inps[n];
+
+		ip->c->add_other(ip->c, ""); 	/* Allow any signature file */
+	
+		if (ip->c->read_name(ip->c, ip->name)) {
+			sprintf(ip->errm,"CGATS file '%s' read error : %s",ip->name,ip->c->err);
+			ip->err = 1;
+		} else if (ip->c->ntables < 1) {
+			sprintf(ip->errm,"Input file '%s' doesn't contain at least one table",ip->name);
+			ip->err = 1;
+		}
+	}
+	return 0;
+}
+
+/* Return a list of the patches k >= i with device values matching patch i, */
+/* in ascending order. sx[] is the patch indexes sorted by the first */
+/* device channel, so that only the patches close to it need be checked. */
+static int find_matches(
+int *mlist,				/* Return matching patch indexes */
+cgats *c,
+int nchan,				/* Number of device channels */
+int *chix,				/* Device channel indexes */
+int *sx,				/* Patch indexes sorted by first channel value */
+int i					/* Patch to match */
+) {
+	int nsets = c->t[0].nsets;
+	int npat = 0;
+	int s0, s1, k, e;
+	double v0;
+
+	if (nchan == 0) {		/* Everything matches */
+		for (k = i; k < nsets; k++)
+			mlist[npat++] = k;
+		return npat;
+	}
+
+	/* Binary search for the start of the window of possible matches */
+	v0 = *((double *)c->t[0].fdata[i][chix[0]]);
+	for (s0 = 0, s1 = nsets; s0 < s1;) {
+		int sm = (s0 + s1)/2;
+		if (*((double *)c->t[0].fdata[sx[sm]][chix[0]]) < (v0 - 0.002))
+			s0 = sm + 1;
+		else
+			s1 = sm;
+	}
+
+	for (; s0 < nsets; s0++) {
+		k = sx[s0];
+		if (*((double *)c->t[0].fdata[k][chix[0]]) > (v0 + 0.002))
+			break;
+		if (k < i)
+			continue;
+
+		/* Check if the device values match */
+		for (e = 0; e < nchan; e++) {
+			double diff;
+
+			diff = *((double *)c->t[0].fdata[i][chix[e]])
+			     - *((double *)c->t[0].fdata[k][chix[e]]);
+
+			if (fabs(diff) > 0.001)
+				break;
+		}
+		if (e < nchan)
+			continue;
+
+		mlist[npat++] = k;
+	}
+
+	/* Keep the file order, so that the sums are the same */
+#define HEAP_COMPARE(A,B) (A < B)
+	HEAPSORT(int,mlist,npat);
+#undef HEAP_COMPARE
+
+	return npat;
+}
+
 int main(int argc, char *argv[]) {
 	int fa,nfa;					/* current argument we're looking at */
 	int verb = 0;
@@ -183,21 +269,18 @@ int main(int argc, char *argv[]) {
 
 	ninps--;	/* Number of inputs */
 
-	/* Open and read each input file, and create output file */
+	/* Create the cgats objects for each input file and the output file */
 	for (n = 0; n <= ninps; n++) {
-
 		if ((inps[n].c = new_cgats()) == NULL)
 			error("Failed to create cgats object for file '%s'",inps[n].name);
-	
-		if (n < ninps) {		/* If input file, read it */
-			inps[n].c->add_other(inps[n].c, ""); 	/* Allow any signature file */
-		
-			if (inps[n].c->read_name(inps[n].c, inps[n].name))
-				error("CGATS file '%s' read error : %s",inps[n].name,inps[n].c->err);
-		
-			if (inps[n].c->ntables < 1)
-				error ("Input file '%s' doesn't contain at least one table",inps[n].name);
-		}
+	}
+
+	/* Read the input files in parallel */
+	par_for(0, 0, ninps, 1, read_inps, (void *)inps);
+
+	for (n = 0; n < ninps; n++) {
+		if (inps[n].err)
+			error("%s",inps[n].errm);
 	}
 	ocg = inps[ninps].c;		/* Alias for output file */
 
@@ -351,39 +434,65 @@ int main(int argc, char *argv[]) {
 
 	/* If averaging values within the one file */
 	if (ninps == 1) {
+		cgats *ic = inps[0].c;
+		int nsets = ic->t[0].nsets;
 		int *valdone;
+		int *sx;				/* Patch indexes sorted by first device channel */
+		int *mlist;				/* Patches matching the current one */
 		int npat;
 		double *vlist;
 		double (*v3list)[3] = NULL;
-		int k, e;
+		int k;
 		n = 0;		/* Output set index */
 
-		if ((valdone = (int *)calloc(inps[0].c->t[0].nsets, sizeof(int))) == NULL) 
+		if ((valdone = (int *)calloc(nsets, sizeof(int))) == NULL) 
+			error("Malloc failed!");
+
+		if ((sx = (int *)malloc(nsets * sizeof(int))) == NULL) 
+			error("Malloc failed!");
+
+		if ((mlist = (int *)malloc(nsets * sizeof(int))) == NULL) 
 			error("Malloc failed!");
 
-		if ((vlist = (double *)calloc(inps[0].c->t[0].nsets, sizeof(double))) == NULL) 
+		if ((vlist = (double *)calloc(nsets, sizeof(double))) == NULL) 
 			error("Malloc failed!");
 
 		if (dogeom && (haspcs[0] || haspcs[1])) {
-			if ((v3list = (double (*)[3])calloc(inps[0].c->t[0].nsets, 3 * sizeof(double))) == NULL) 
+			if ((v3list = (double (*)[3])calloc(nsets, 3 * sizeof(double))) == NULL) 
 				error("Malloc failed!");
 		}
 
+		/* Sort the patches by their first device value, so that */
+		/* each patches matches can be located without a full scan. */
+		for (i = 0; i < nsets; i++)
+			sx[i] = i;
+		if (nchan > 0) {
+#define HEAP_COMPARE(A,B) (*((double *)ic->t[0].fdata[A][chix[0]]) \
+                         < *((double *)ic->t[0].fdata[B][chix[0]]))
+			HEAPSORT(int,sx,nsets);
+#undef HEAP_COMPARE
+		}
+
 		/* For each patch */
-		for (i = 0; i < inps[0].c->t[0].nsets; i++) {
+		for (i = 0; i < nsets; i++) {
 
 			if (valdone[i])
 				continue;
 
-			inps[0].c->get_setarr(inps[0].c, 0, i, setel);
+			ic->get_setarr(ic, 0, i, setel);
 			ocg->add_setarr(ocg, 0, setel);
 
+			/* Locate any patches (including starting patch) with matching device values */
+			npat = find_matches(mlist, ic, nchan, chix, sx, i);
+			for (k = 0; k < npat; k++)
+				valdone[mlist[k]] = 1;
+
 			/* For each non-device real field values */
-			for (j = 0; j < inps[0].c->t[0].nfields; j++) {
+			for (j = 0; j < ic->t[0].nfields; j++) {
 				int jj;
 
 				/* Only real types */
-				if (inps[0].c->t[0].ftype[j] != r_t)
+				if (ic->t[0].ftype[j] != r_t)
 					continue;
 
 				/* Not device channels */
@@ -394,28 +503,9 @@ int main(int argc, char *argv[]) {
 				if (jj < nchan)
 					continue;
 
-				/* Locate any patches (including starting patch) with matching device values */
-				npat = 0;
-				for (k = i; k < inps[0].c->t[0].nsets; k++) {
-	
-					/* Check if the device values match */
-					for (e = 0; e < nchan; e++) {
-						double diff;
-	
-						diff = *((double *)inps[0].c->t[0].fdata[i][chix[e]])
-						     - *((double *)inps[0].c->t[0].fdata[k][chix[e]]);
-	
-						if (fabs(diff) > 0.001) {
-							break;
-						}
-					}
-					if (e < nchan) {
-						continue;
-					}
+				for (k = 0; k < npat; k++)
+					vlist[k] = *((double *)ic->t[0].fdata[mlist[k]][j]);
 
-					vlist[npat++] = *((double *)inps[0].c->t[0].fdata[k][j]);
-					valdone[k] = 1;
-				}
 				if (domedian)
 					*((double *)ocg->t[0].fdata[n][j]) = median(vlist, npat);
 				else
@@ -432,35 +522,15 @@ int main(int argc, char *argv[]) {
 					if (haspcs[j] == 0)
 						continue;
 
-					/* Locate any patches (including starting patch) with matching device values */
-					npat = 0;
-					for (k = i; k < inps[0].c->t[0].nsets; k++) {
-		
-						/* Check if the device values match */
-						for (e = 0; e < nchan; e++) {
-							double diff;
-		
-							diff = *((double *)inps[0].c->t[0].fdata[i][chix[e]])
-							     - *((double *)inps[0].c->t[0].fdata[k][chix[e]]);
-		
-							if (fabs(diff) > 0.001) {
-								break;
-							}
-						}
-						if (e < nchan) {
-							continue;
-						}
-	
-						v3list[npat][0] = *((double *)inps[0].c->t[0].fdata[k][pcsix[j][0]]);
-						v3list[npat][1] = *((double *)inps[0].c->t[0].fdata[k][pcsix[j][1]]);
-						v3list[npat][2] = *((double *)inps[0].c->t[0].fdata[k][pcsix[j][2]]);
+					for (k = 0; k < npat; k++) {
+						v3list[k][0] = *((double *)ic->t[0].fdata[mlist[k]][pcsix[j][0]]);
+						v3list[k][1] = *((double *)ic->t[0].fdata[mlist[k]][pcsix[j][1]]);
+						v3list[k][2] = *((double *)ic->t[0].fdata[mlist[k]][pcsix[j][2]]);
 
 						if (j == 0 && dogeom == 3)		/* Lab and want XYZ */
-							icmLab2XYZ(&icmD50_100, v3list[npat], v3list[npat]);
+							icmLab2XYZ(&icmD50_100, v3list[k], v3list[k]);
 						else if (j == 1 && dogeom == 2)	/* XYZ and want Lab */
-							icmXYZ2Lab(&icmD50_100, v3list[npat], v3list[npat]);
-
-						npat++;
+							icmXYZ2Lab(&icmD50_100, v3list[k], v3list[k]);
 					}
 					geommed(res, v3list, npat);
 	
@@ -480,6 +550,8 @@ int main(int argc, char *argv[]) {
 		if (v3list != NULL)
 			free(v3list);
 		free(vlist);
+		free(mlist);
+		free(sx);
 		free(valdone);
 
 	/* Averaging patches between identical files, */
@@ -539,7 +611,7 @@ int main(int argc, char *argv[]) {
 				error("Malloc failed!");
 
 			if (dogeom && (haspcs[0] || haspcs[1])) {
-				if ((v3list = (double (*)[3])calloc(inps[0].c->t[0].nsets, 3 * sizeof(double))) == NULL) 
+				if ((v3list = (double (*)[3])calloc(ninps, 3 * sizeof(double))) == NULL) 
 					error("Malloc failed!");
 			}
 
@@ -63,6 +63,17 @@
 
 /* ================================================================== */
 
+/* A test patch to be rendered */
+typedef struct {
+	double r_rgb[3];			/* Patch color */
+	double bg[3];				/* Background color */
+	int direct;					/* Render just the patch, rather than the whole screen */
+	double x, y;				/* position of test square in pixels */
+	double w, h;				/* size of test square in pixels */
+	unsigned char *ibuf;		/* Memory image of .png file, NULL if not rendered */
+	size_t ilen;
+} ccpatch;
+
 /* Chromwin context and (possible) web server  */
 typedef struct _chws {
 	int verb;
@@ -83,6 +94,9 @@ typedef struct _chws {
 
 	ccast *cc;					/* ChromeCast */
 
+	athread *nth;				/* Thread rendering the next patch, NULL if none */
+	ccpatch next;				/* Next patch rendered ahead of time */
+
 	/* Set a whole screen sized png image */
 	int (*set)(struct _chws *p, unsigned char *ibuf, size_t ilen);
 
@@ -96,6 +110,14 @@ typedef struct _chws {
 
 static void chws_del(chws *p) {
 
+	/* Wait for and discard any next patch */
+	if (p->nth != NULL) {
+		p->nth->wait(p->nth);
+		p->nth->del(p->nth);
+	}
+	if (p->next.ibuf != NULL)
+		free(p->next.ibuf);
+
 	/* delete mongoose, if we are using it */
 	if (p->mg != NULL)
 		mg_stop(p->mg);
@@ -452,6 +474,255 @@ icmFile *ccwin_get_profile(dispwin *p, char *name, int mxlen) {
 
 /* ----------------------------------------------- */
 
+/* Setup a test patch for the given color, using the current */
+/* patch window and background settings. */
+static void ccwin_setup_patch(
+dispwin *p,
+ccpatch *pt,
+double r, double g, double b	/* Color values 0.0 - 1.0 */
+) {
+	chws *ws = (chws *)p->pcntx;
+	int j;
+
+	pt->r_rgb[0] = r;
+	pt->r_rgb[1] = g;
+	pt->r_rgb[2] = b;
+
+	for (j = 0; j < 3; j++) {
+		if (pt->r_rgb[j] < 0.0)
+			pt->r_rgb[j] = 0.0;
+		else if (pt->r_rgb[j] > 1.0)
+			pt->r_rgb[j] = 1.0;
+		if (p->out_tvenc) {
+			pt->r_rgb[j] = ((235.0 - 16.0) * pt->r_rgb[j] + 16.0)/255.0;
+			if (p->edepth > 8)
+				pt->r_rgb[j] = (pt->r_rgb[j] * 255 * (1 << (p->edepth - 8)))
+				             /((1 << p->edepth) - 1.0); 	
+		}
+	}
+
+	/* Full screen background: */
+	if (p->fullscreen) {
+		if (p->bge == dw_bg_grey) {
+			pt->bg[0] = 0.2;
+			pt->bg[1] = 0.2;
+			pt->bg[2] = 0.2;
+		} else if (p->bge == dw_bg_cvideo) {
+			pt->bg[0] = p->area * (1.0 - r)/(1.0 - p->area); 
+			pt->bg[1] = p->area * (1.0 - g)/(1.0 - p->area); 
+			pt->bg[2] = p->area * (1.0 - b)/(1.0 - p->area); 
+ 
+		} else if (p->bge == dw_bg_clight) {
+			double gamma = 2.3;
+			pt->bg[0] = pow(p->area * (1.0 - pow(r, gamma))/(1.0 - p->area), 1.0/gamma);
+			pt->bg[1] = pow(p->area * (1.0 - pow(g, gamma))/(1.0 - p->area), 1.0/gamma);
+			pt->bg[2] = pow(p->area * (1.0 - pow(b, gamma))/(1.0 - p->area), 1.0/gamma); 
+
+		} else {		/* Assume dw_bg_black */
+			pt->bg[0] = 0.0;
+			pt->bg[1] = 0.0;
+			pt->bg[2] = 0.0;
+		}
+
+	/* Use default dark gray background */ 
+	} else {
+		pt->bg[0] = 0.2;
+		pt->bg[1] = 0.2;
+		pt->bg[2] = 0.2;
+	}
+
+	pt->direct = ws->direct;
+	pt->x = ws->x;
+	pt->y = ws->y;
+	pt->w = ws->w;
+	pt->h = ws->h;
+	pt->ibuf = NULL;
+	pt->ilen = 0;
+}
+
+/* Return nz if two test patches will render identically */
+static int ccwin_patch_match(ccpatch *a, ccpatch *b) {
+	int j;
+
+	for (j = 0; j < 3; j++) {
+		if (a->r_rgb[j] != b->r_rgb[j]
+		 || a->bg[j] != b->bg[j])
+			return 0;
+	}
+	if (a->direct != b->direct
+	 || a->x != b->x || a->y != b->y
+	 || a->w != b->w || a->h != b->h)
+		return 0;
+	return 1;
+}
+
+/* Render a test patch into a memory .png file */
+/* Return nz on error */
+static int ccwin_render_patch(ccpatch *pt) {
+	/* We want a raster of IWIDTH x IHEIGHT pixels for web server, */
+	/* or pt->w x pt->h for PNG direct. */
+	render2d *rr;
+	prim2d *rct;
+	depth2d depth = bpc8_2d;
+#if DDITHER == 1
+	int dither = 0x8002;		/* 0x8002 = error diffuse FG only */
+#elif DDITHER == 2
+	int dither = 0x4000;		/* 0x4000 = no dither but don't average pixels */
+								/* so as to allow pattern to come through. */
+#else
+	int dither = 0;				/* Don't dither in renderer */
+#endif
+	double hres = 1.0;					/* Resoltion in pix/mm */
+	double vres = 1.0;					/* Resoltion in pix/mm */
+	double iw, ih;						/* Size of page in mm (pixels) */
+	color2d c;
+	int rv;
+#ifdef DO_TIMING
+	int stime;
+#endif
+
+	if (pt->direct) {
+		iw = pt->w;		/* Requested size */
+		ih = pt->h;
+	} else {
+		iw = IWIDTH;
+		ih = IHEIGHT;	/* Size of page in mm */
+	}
+
+	debug2((errout, "ccwin_render_patch iw %f ih %f\n",iw,ih));
+
+	if ((rr = new_render2d(iw, ih, NULL, hres, vres, rgb_2d,
+	     0, depth, dither,
+#if DDITHER == 1
+		 ccastQuant, NULL, 3.0/255.0
+#else
+		 NULL, NULL, 0.0
+#endif
+		 )) == NULL) {
+		a1loge(g_log, 1,"ccwin: new_render2d() failed\n");
+		return 1;
+	}
+
+	/* Set the background color */
+	c[0] = pt->bg[0];
+	c[1] = pt->bg[1];
+	c[2] = pt->bg[2];
+	rr->set_defc(rr, c);
+
+	c[0] = pt->r_rgb[0];
+	c[1] = pt->r_rgb[1];
+	c[2] = pt->r_rgb[2];
+	if (pt->direct)
+		rr->add(rr, rct = new_rect2d(rr, 0.0, 0.0, pt->w, pt->h, c));
+	else
+		rr->add(rr, rct = new_rect2d(rr, pt->x, pt->y, pt->w, pt->h, c));
+
+#if DDITHER == 2			/* Use dither pattern */
+	{
+		double rgb[3];
+		double dpat[CCDITHSIZE][CCDITHSIZE][3];
+		double (*cpat)[MXPATSIZE][MXPATSIZE][TOTC2D];
+		int i, j;
+
+		/* Get a chrome cast dither pattern to match target color */
+		for (i = 0; i < 3; i++)
+			rgb[i] = pt->r_rgb[i] * 255.0;
+		get_ccast_dith(dpat, rgb);
+
+		if ((cpat = malloc(sizeof(double) * MXPATSIZE * MXPATSIZE * TOTC2D)) == NULL) {
+			a1loge(g_log, 1, "ccwin: malloc of dither pattern failed\n");
+			return 1;
+		}
+		
+		for (i = 0; i < CCDITHSIZE; i++) {
+			for (j = 0; j < CCDITHSIZE; j++) {
+				int k = (((int)IHEIGHT-2) - j) % CCDITHSIZE;	/* Flip to origin bot left */
+				(*cpat)[i][k][0] = dpat[i][j][0]/255.0;			/* (HEIGHT-2 is correct!) */
+				(*cpat)[i][k][1] = dpat[i][j][1]/255.0;
+				(*cpat)[i][k][2] = dpat[i][j][2]/255.0;
+			}
+		}
+		
+		set_rect2d_dpat((rect2d *)rct, cpat, CCDITHSIZE, CCDITHSIZE);
+	}
+#endif /* DDITHER == 2 */
+
+#ifdef CCTEST_PATTERN
+#pragma message("############################# ccwin.c TEST_PATTERN defined ! ##")
+	if (getenv("ARGYLL_CCAST_TEST_PATTERN") != NULL) {
+		verbose(0, "Writing test pattern to '%s'\n","testpattern.png");
+		if (r->write(r, "testpattern.png", 1, NULL, NULL, png_file)) {
+			a1loge(g_log, 1, "ccwin: render->write failed\n");
+			return 1;
+		}
+	}
+#else	/* !CCTEST_PATTERN */
+# ifdef WRITE_PNG		/* Write it to a file so that we can look at it */
+#  pragma message("############################# spectro/ccwin.c WRITE_PNG is enabled ######")
+	if (r->write(rr, "ccwin.png", 1, NULL, NULL, png_file)) {
+		a1loge(g_log, 1, "ccwin: render->write failed\n");
+		return 1;
+	}
+# endif	/* WRITE_PNG */
+#endif	/* !CCTEST_PATTERN */
+
+
+#ifdef DO_TIMING
+	stime = msec_time();
+#endif
+
+	rv = rr->write(rr, "MemoryBuf", 1, &pt->ibuf, &pt->ilen, png_mem);
+
+
+	if (rv) {
+		a1loge(g_log, 1, "ccwin: render->write failed\n");
+		return 1;
+	}
+	rr->del(rr);
+#ifdef DO_TIMING
+	stime = msec_time() - stime;
+	printf("render->write took %d msec\n",stime);
+#endif
+	return 0;
+}
+
+/* Thread that renders the next test patch ahead of time */
+static int ccwin_next_thread(void *cntx) {
+	chws *ws = (chws *)cntx;
+
+	return ccwin_render_patch(&ws->next);
+}
+
+/* Wait for any next patch thread to finish. */
+/* Return nz if there is no valid next patch. */
+static int ccwin_wait_next(chws *ws) {
+	int rv;
+
+	if (ws->nth == NULL)
+		return 1;
+
+	rv = ws->nth->wait(ws->nth);
+	ws->nth->del(ws->nth);
+	ws->nth = NULL;
+
+	if (rv != 0 && ws->next.ibuf != NULL) {
+		free(ws->next.ibuf);
+		ws->next.ibuf = NULL;
+	}
+	return ws->next.ibuf == NULL;
+}
+
+/* Discard any next patch */
+static void ccwin_discard_next(chws *ws) {
+	ccwin_wait_next(ws);
+	if (ws->next.ibuf != NULL) {
+		free(ws->next.ibuf);
+		ws->next.ibuf = NULL;
+	}
+}
+
+/* ----------------------------------------------- */
+
 /* Change the window color. */
 /* Return 1 on error, 2 on window being closed */
 /* inst_license, inst_licensenc, inst_tamper or inst_syscompat on licening problem */
@@ -464,6 +735,7 @@ double r, double g, double b	/* Color values 0.0 - 1.0 */
 	double orgb[3];		/* Previous RGB value */
 	double kr, kf;
 	int update_delay = 0;
+	ccpatch pt;
 
 	debugr2((errout, "ccwin_set_color called with %f %f %f\n",r,g,b));
 
@@ -500,170 +772,34 @@ double r, double g, double b	/* Color values 0.0 - 1.0 */
 # pragma message("############################# ccwin.c DDITHER != 1 ##")
 #endif
 
-	/* Turn the color into a png file */
-	{
-		/* We want a raster of IWIDTH x IHEIGHT pixels for web server, */
-		/* or p->w x p->h for PNG direct. */
-		render2d *rr;
-		prim2d *rct;
-		depth2d depth = bpc8_2d;
-#if DDITHER == 1
-		int dither = 0x8002;		/* 0x8002 = error diffuse FG only */
-#elif DDITHER == 2
-		int dither = 0x4000;		/* 0x4000 = no dither but don't average pixels */
-									/* so as to allow pattern to come through. */
-#else
-		int dither = 0;				/* Don't dither in renderer */
-#endif
-		double hres = 1.0;					/* Resoltion in pix/mm */
-		double vres = 1.0;					/* Resoltion in pix/mm */
-		double iw, ih;						/* Size of page in mm (pixels) */
-		color2d c;
-		unsigned char *ibuf;		/* Memory image of .png file */
-		size_t ilen;
-		int rv;
-#ifdef DO_TIMING
-		int stime;
-#endif
-
-		if (ws->direct) {
-			iw = ws->w;		/* Requested size */
-			ih = ws->h;
-		} else {
-			iw = IWIDTH;
-			ih = IHEIGHT;	/* Size of page in mm */
-		}
-
-		/* Full screen background: */
-		if (p->fullscreen) {
-			if (p->bge == dw_bg_grey) {
-				ws->bg[0] = 0.2;
-				ws->bg[1] = 0.2;
-				ws->bg[2] = 0.2;
-			} else if (p->bge == dw_bg_cvideo) {
-				ws->bg[0] = p->area * (1.0 - r)/(1.0 - p->area); 
-				ws->bg[1] = p->area * (1.0 - g)/(1.0 - p->area); 
-				ws->bg[2] = p->area * (1.0 - b)/(1.0 - p->area); 
- 
-			} else if (p->bge == dw_bg_clight) {
-				double gamma = 2.3;
-				ws->bg[0] = pow(p->area * (1.0 - pow(r, gamma))/(1.0 - p->area), 1.0/gamma);
-				ws->bg[1] = pow(p->area * (1.0 - pow(g, gamma))/(1.0 - p->area), 1.0/gamma);
-				ws->bg[2] = pow(p->area * (1.0 - pow(b, gamma))/(1.0 - p->area), 1.0/gamma); 
-
-			} else {		/* Assume dw_bg_black */
-				ws->bg[0] = 0.0;
-				ws->bg[1] = 0.0;
-				ws->bg[2] = 0.0;
-			}
-
-		/* Use default dark gray background */ 
-		} else {
-			ws->bg[0] = 0.2;
-			ws->bg[1] = 0.2;
-			ws->bg[2] = 0.2;
-		}
-
-		debugr2((errout, "ccwin_set_color iw %f ih %f\n",iw,ih));
-
-		if ((rr = new_render2d(iw, ih, NULL, hres, vres, rgb_2d,
-		     0, depth, dither,
-#if DDITHER == 1
-			 ccastQuant, NULL, 3.0/255.0
-#else
-			 NULL, NULL, 0.0
-#endif
-			 )) == NULL) {
-			a1loge(g_log, 1,"ccwin: new_render2d() failed\n");
-			return 1;
-		}
-	
-		/* Set the background color */
-		c[0] = ws->bg[0];
-		c[1] = ws->bg[1];
-		c[2] = ws->bg[2];
-		rr->set_defc(rr, c);
-	
-		c[0] = p->r_rgb[0];
-		c[1] = p->r_rgb[1];
-		c[2] = p->r_rgb[2];
-		if (ws->direct)
-			rr->add(rr, rct = new_rect2d(rr, 0.0, 0.0, ws->w, ws->h, c));
-		else
-			rr->add(rr, rct = new_rect2d(rr, ws->x, ws->y, ws->w, ws->h, c));
-
-#if DDITHER == 2			/* Use dither pattern */
-		{
-			double rgb[3];
-			double dpat[CCDITHSIZE][CCDITHSIZE][3];
-			double (*cpat)[MXPATSIZE][MXPATSIZE][TOTC2D];
-			int i, j;
-
-			/* Get a chrome cast dither pattern to match target color */
-			for (i = 0; i < 3; i++)
-				rgb[i] = p->r_rgb[i] * 255.0;
-			get_ccast_dith(dpat, rgb);
-
-			if ((cpat = malloc(sizeof(double) * MXPATSIZE * MXPATSIZE * TOTC2D)) == NULL) {
-				a1loge(g_log, 1, "ccwin: malloc of dither pattern failed\n");
-				return 1;
-			}
-			
-			for (i = 0; i < CCDITHSIZE; i++) {
-				for (j = 0; j < CCDITHSIZE; j++) {
-					int k = (((int)IHEIGHT-2) - j) % CCDITHSIZE;	/* Flip to origin bot left */
-					(*cpat)[i][k][0] = dpat[i][j][0]/255.0;			/* (HEIGHT-2 is correct!) */
-					(*cpat)[i][k][1] = dpat[i][j][1]/255.0;
-					(*cpat)[i][k][2] = dpat[i][j][2]/255.0;
-				}
-			}
-			
-			set_rect2d_dpat((rect2d *)rct, cpat, CCDITHSIZE, CCDITHSIZE);
-		}
-#endif /* DDITHER == 2 */
+	/* Turn the color into a png file, using the one rendered */
+	/* ahead of time by set_next_color() if it matches. */
+	ccwin_setup_patch(p, &pt, r, g, b);
 
-#ifdef CCTEST_PATTERN
-#pragma message("############################# ccwin.c TEST_PATTERN defined ! ##")
-		if (getenv("ARGYLL_CCAST_TEST_PATTERN") != NULL) {
-			verbose(0, "Writing test pattern to '%s'\n","testpattern.png");
-			if (r->write(r, "testpattern.png", 1, NULL, NULL, png_file)) {
-				a1loge(g_log, 1, "ccwin: render->write failed\n");
-				return 1;
-			}
-		}
-#else	/* !CCTEST_PATTERN */
-# ifdef WRITE_PNG		/* Write it to a file so that we can look at it */
-#  pragma message("############################# spectro/ccwin.c WRITE_PNG is enabled ######")
-		if (r->write(rr, "ccwin.png", 1, NULL, NULL, png_file)) {
-			a1loge(g_log, 1, "ccwin: render->write failed\n");
+	if (ccwin_wait_next(ws) == 0 && ccwin_patch_match(&pt, &ws->next)) {
+		debugr2((errout, "ccwin_set_color using pre-rendered patch\n"));
+		pt.ibuf = ws->next.ibuf;
+		pt.ilen = ws->next.ilen;
+		ws->next.ibuf = NULL;
+	} else {
+		ccwin_discard_next(ws);
+		if (ccwin_render_patch(&pt))
 			return 1;
-		}
-# endif	/* WRITE_PNG */
-#endif	/* !CCTEST_PATTERN */
-
-
-#ifdef DO_TIMING
-		stime = msec_time();
-#endif
-
-		rv = rr->write(rr, "MemoryBuf", 1, &ibuf, &ilen, png_mem);
+	}
 
+	ws->bg[0] = pt.bg[0];
+	ws->bg[1] = pt.bg[1];
+	ws->bg[2] = pt.bg[2];
 
-		if (rv) {
-			a1loge(g_log, 1, "ccwin: render->write failed\n");
-			return 1;
-		}
-		rr->del(rr);
-#ifdef DO_TIMING
-		stime = msec_time() - stime;
-		printf("render->write took %d msec\n",stime);
-#endif
-		if (ws->update(ws, ibuf, ilen, ws->bg)) {
-			a1loge(g_log, 1, "ccwin: color update failed\n");
-			return 1;
-		}
-		p->ccix = p->ncix;
+	if (ws->update(ws, pt.ibuf, pt.ilen, ws->bg)) {
+		a1loge(g_log, 1, "ccwin: color update failed\n");
+		return 1;
 	}
+	p->ccix = p->ncix;
+
+	/* The patch is presented once the receiver has had its load */
+	/* delay after confirming the load. */
+	dispwin_presented(p, ws->cc->load_time + ws->cc->get_load_delay(ws->cc));
 
 
 	/* If update is notified asyncronously ... */
@@ -677,8 +813,32 @@ double r, double g, double b	/* Color values 0.0 - 1.0 */
 	/* Allow for display update & instrument delays */
 	update_delay = dispwin_compute_delay(p, orgb);
 	debugr2((errout, "ccwin_set_color delaying %d msec\n",update_delay));
-	msec_sleep(update_delay);
+	dispwin_update_sleep(p, update_delay);
+
+	return 0;
+}
+
+/* Start rendering the color that is likely to be set next, */
+/* so that set_color() only has to send it to the ChromeCast. */
+/* Return nz on error */
+static int ccwin_set_next_color(
+dispwin *p,
+double r, double g, double b	/* Color values 0.0 - 1.0 */
+) {
+	chws *ws = (chws *)p->pcntx;
+
+	debugr2((errout, "ccwin_set_next_color called with %f %f %f\n",r,g,b));
 
+	if (p->nowin)
+		return 1;
+
+	ccwin_discard_next(ws);
+	ccwin_setup_patch(p, &ws->next, r, g, b);
+
+	if ((ws->nth = new_athread(ccwin_next_thread, (void *)ws)) == NULL) {
+		debugr2((errout, "ccwin_set_next_color: failed to create thread\n"));
+		return 1;
+	}
 	return 0;
 }
 
@@ -776,11 +936,14 @@ int ddebug						/* >0 to print debug statements to stderr */
 	p->uninstall_profile   = ccwin_uninstall_profile;
 	p->get_profile         = ccwin_get_profile;
 	p->set_color           = ccwin_set_color;
+	p->set_next_color      = ccwin_set_next_color;
 	p->set_fc              = ccwin_set_fc;
 	p->set_patch_win       = ccwin_set_patch_win;
 	p->set_update_delay    = dispwin_set_update_delay;
 	p->set_settling_delay  = dispwin_set_settling_delay;
 	p->enable_update_delay = dispwin_enable_update_delay;
+	p->defer_update_delay  = dispwin_defer_update_delay;
+	p->wait_update         = dispwin_wait_update;
 	p->set_callout         = ccwin_set_callout;
 	p->del                 = ccwin_del;
 
@@ -811,8 +974,10 @@ int ddebug						/* >0 to print debug statements to stderr */
 		return NULL;
 	}
 
-	/* Extra delay ccast adds after confirming load */
+	/* Extra delay ccast adds after confirming load. We allow for */
+	/* it as part of the update delay, rather than ccast sleeping. */
 	p->extra_update_delay = ws->cc->get_load_delay(ws->cc) / 1000.0;
+	ws->cc->defer_load_delay = 1;
 
 	p->pcntx = (void *)ws;
 
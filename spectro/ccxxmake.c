@@ -1287,7 +1287,7 @@ int main(int argc, char *argv[]) {
 				/* Should we use current cal rather than native ??? */
 				if ((dr = new_disprd(&errc, icmps->get_path(icmps, comno),
 				                     fc, ditype, sditype, 1, tele, ambient, nadaptive,
-				                     noinitcal, 0, highres, refrate, 3, NULL, NULL,
+				                     noinitcal, 0, highres, refrate, 0.0, 3, NULL, NULL,
 					                 NULL, 0, disp, 0, fullscreen,
 				                     override, webdisp, ccid,
 #ifdef NT
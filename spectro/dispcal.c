@@ -186,6 +186,8 @@
 #define POWERR_WEIGHT_POW 4.0	/* Curve to plend from equal weight to +ve extra weight */
 #define CAL_RES 256			/* Resolution of calibration table to produce. */
 #define CLIP				/* Clip RGB during refinement */
+#define PRED_START			/* Start each point from the previous point's correction */
+#define PRED_SKIP			/* Skip to the final pass if the error is already small enough */
 #define RDAC_SMOOTH 0.3		/* RAMDAC curve fitting smoothness */
 #define MEAS_RES			/* Measure the RAMNDAC entry size */ 
 
@@ -1656,8 +1658,10 @@ void usage(int flag, char *diag, ...) {
 		fprintf(stderr,"                      1931_2 (def), 1964_10, 2012_2, 2012_10, S&B 1955_2, shaw, J&V 1978_2, 1964_10c or file.cmf\n");
 	}
 	fprintf(stderr," -I b|w               Drift compensation, Black: -Ib, White: -Iw, Both: -Ibw\n");
+	fprintf(stderr," -I u                 Wait until the display has warmed up before measuring\n");
 	fprintf(stderr," -Y R:rate            Override measured refresh rate with rate Hz\n");
 	fprintf(stderr," -Y A                 Use non-adaptive integration time mode (if available).\n");
+	fprintf(stderr," -Y a:speed           Adaptive dark patch speed/accuracy, > 1 faster, < 1 more accurate\n");
 	fprintf(stderr," -Y p                 Don't wait for the instrument to be placed on the display\n");
 	fprintf(stderr," -C \"command\"         Invoke shell \"command\" each time a color is set\n");
 	fprintf(stderr," -M \"command\"         Invoke shell \"command\" each time a color is measured\n");
@@ -1702,9 +1706,11 @@ int main(int argc, char *argv[]) {
 	int noplace = 0;					/* Disable initial user placement check */
 	int highres = 0;					/* Use high res mode if available */
 	double refrate = 0.0;				/* 0.0 = default, > 0.0 = override refresh rate */ 
+	double adspeed = 0.0;				/* 0.0 = default, > 0.0 = adaptive speed/accuracy */ 
 	int nadaptive = 0;					/* Use non-adaptive mode if available */
 	int bdrift = 0;						/* Flag, nz for black drift compensation */
 	int wdrift = 0;						/* Flag, nz for white drift compensation */
+	int warmup = 0;						/* Flag, nz to wait for display to warm up */
 	double temp = 0.0;					/* Color temperature (0 = native) */
 	int planckian = 0;					/* 0 = Daylight, 1 = Planckian color locus */
 	int dovct = 1;						/* Show VXT rather than CXT for adjusting white point */
@@ -1957,6 +1963,8 @@ int main(int argc, char *argv[]) {
 						bdrift = 1;
 					else if (na[i] == 'w' || na[i] == 'W')
 						wdrift = 1;
+					else if (na[i] == 'u' || na[i] == 'U')
+						warmup = 1;
 					else
 						usage(0,"-I parameter '%c' not recognised",na[i]);
 				}
@@ -2260,6 +2268,12 @@ int main(int argc, char *argv[]) {
 						usage(0,"-Y R:rate %f Hz not in valid range",refrate);
 				} else if (na[0] == 'A') {
 					nadaptive = 1;
+				} else if (na[0] == 'a') {
+					if (na[1] != ':')
+						usage(0,"-Y a:speed syntax incorrect");
+					adspeed = atof(na+2);
+					if (adspeed < 0.1 || adspeed > 10.0)
+						usage(0,"-Y a:speed %f not in valid range",adspeed);
 				} else if (na[0] == 'p') {
 					noplace = 1;
 				} else {
@@ -2408,7 +2422,7 @@ int main(int argc, char *argv[]) {
 
 	/* Get ready to do some readings */
 	if ((dr = new_disprd(&errc, ipath, fc, ditype, -1, 0, tele, ambient, nadaptive, nocal, noplace,
-	                     highres, refrate, native, &noramdac, &nocm, NULL, 0,
+	                     highres, refrate, adspeed, native, &noramdac, &nocm, NULL, 0,
 		                 disp, out_tvenc, fullscreen, override, webdisp, ccid,
 #ifdef NT
 		                 madvrdisp,
@@ -2423,6 +2437,14 @@ int main(int argc, char *argv[]) {
 	                     "fake" ICC_FILE_EXT, g_log)) == NULL)
 		error("new_disprd() failed with '%s'\n",disprd_err(errc));
 
+	/* Wait until the display has stopped drifting */
+	if (warmup) {
+		if ((rv = dr->warm_up(dr, 0.0, 0.0, 0)) != 0) {
+			dr->del(dr);
+			error("display warm up failed with '%s'\n",disprd_err(rv));
+		}
+	}
+
 	if ((native & 1) && noramdac) {
 		warning("Unable to access to VideoLUTs so can't be sure colors are native");
 		if (doprofile)
@@ -4616,6 +4638,10 @@ int main(int argc, char *argv[]) {
 	     rsteps *= 2, errthr /= (it < mxits) ? pow(2.0,THRESH_SCALE_POW) : 1.0, it++) {
 		int totmeas = 0;		/* Total number of measurements in this pass */
 		col set[3];				/* Variable to read one to three values from the display */
+#ifdef PRED_START
+		double pcor[3];			/* Previous point's correction to the curves rgb */
+		int havepcor = 0;		/* pcor is valid */
+#endif
 
 		/* Verify pass ? */
 		if (it >= mxits)
@@ -4651,7 +4677,26 @@ int main(int argc, char *argv[]) {
 			double rgain = REFINE_GAIN;	/* Scale down if lots of repeats */
 			int mjac = 0;				/* We measured the Jacobian */
 			double ierrth = errthr;		/* This points error threshold */
+#ifdef PRED_START
+			double crgb[3];				/* rgb from the current curves */
+			int ptok = 0;				/* Point met the threshold */
+#endif
 			
+#ifdef PRED_START
+			/* The correction needed to the curves varies smoothly along the */
+			/* neutral axis, so start where the previous point's correction */
+			/* predicts this one will end up. This saves repeats. */
+			icmCpy3(crgb, asgrey.s[i].rgb);
+			if (it < mxits && havepcor) {
+				for (j = 0; j < 3; j++) {
+					asgrey.s[i].rgb[j] += pcor[j];
+					if (asgrey.s[i].rgb[j] < 0.0)
+						asgrey.s[i].rgb[j] = 0.0;
+					else if (asgrey.s[i].rgb[j] > 1.0)
+						asgrey.s[i].rgb[j] = 1.0;
+				}
+			}
+#endif
 			icmCpy3(asgrey.s[i].prgb, asgrey.s[i].rgb);		/* Init previous */
 
 			/* Setup a second termination threshold criteria based on */
@@ -5003,6 +5048,9 @@ int main(int argc, char *argv[]) {
 							else
 								printf("Point %d DE %f, W.DE %f, W.peqDE %f, OK ( < %f)\n",rsteps - i,asgrey.s[i]._de,asgrey.s[i].de, asgrey.s[i].peqde, ierrth);
 						}
+#ifdef PRED_START
+						ptok = 1;
+#endif
 						break;	/* No more retries */
 					}
 					if ((rpt+1) >= mxrpts) {
@@ -5087,6 +5135,16 @@ int main(int argc, char *argv[]) {
 				prevde = asgrey.s[i].de;
 			}	/* Next repeat */
 
+#ifdef PRED_START
+			/* Use this point's correction to predict the next one's, */
+			/* unless it failed to converge. */
+			if (it < mxits && ptok) {
+				icmSub3(pcor, asgrey.s[i].rgb, crgb);
+				havepcor = 1;
+			} else
+				havepcor = 0;
+#endif
+
 			if (verb >= 3) {
 				printf("After adjustment:\n");
 				printf("Current rgb %f %f %f -> XYZ %f %f %f, de %f, dc %f\n", 
@@ -5177,6 +5235,24 @@ int main(int argc, char *argv[]) {
 					printf("Failed to meet target %f delta E, got worst case %f\n",errthr,failerr);
 				printf("Number of measurements taken = %d\n",totmeas);
 			}
+
+#ifdef PRED_SKIP
+			/* If the neutral axis already meets the final pass threshold, */
+			/* the intermediate passes won't improve it, so skip */
+			/* straight to the final pass. */
+			if (it < (mxits-2) && !thrfail) {
+				double fthr = errthr/pow(2.0, THRESH_SCALE_POW * (mxits-1-it));
+
+				if (mnerr <= fthr) {
+					if (verb)
+						printf("Maximum neutral error is below the final threshold %f, skipping to the final iteration\n",fthr);
+					for (; it < (mxits-2); it++) {
+						rsteps *= 2;
+						errthr /= pow(2.0,THRESH_SCALE_POW);
+					}
+				}
+			}
+#endif
 		}
 
 		/* Convert our test points into calibration curves. */
@@ -87,12 +87,292 @@ static int gcc_bug_fix(int i) {
 
 /* ------------------------------------------------------------------- */
 
+#define MAX_XSTATIONS 8		/* Maximum number of additional measuring stations */
+
+/* An additional measuring station, with its own instrument */
+/* and test window, reading the same patches as the main one. */
+typedef struct {
+	int comport;			/* COM port used */
+	int dix;				/* Display list index, -1 for the main display */
+	int setpos;				/* nz if ho, vo have been set */
+	double ho, vo;			/* Test window offsets, -1.0 to 1.0 */
+	disppath *disp;			/* Display, NULL if using the main display */
+	disprd *dr;				/* Display patch read object */
+	col *cols;				/* This stations copy of the test patches */
+	cgats *ocg;				/* This stations output cgats structure */
+	char outname[MAXNAMEL+1];	/* Output cgats file name */
+	int npat;				/* Number of patches to read */
+	int rv;					/* Return value from read() */
+} station;
+
+/* Read thread for an additional station */
+static int station_read(void *cntx) {
+	station *s = (station *)cntx;
+
+	s->rv = s->dr->read(s->dr, s->cols, s->npat, 1, s->npat, 1, 0, instNoClamp);
+	return 0;
+}
+
+/* Read the test patches on the main and all the additional */
+/* stations at the same time. Return the first error. */
+static int read_stations(disprd *dr, col *cols, int npat, station *xst, int nxst) {
+	athread *th[MAX_XSTATIONS];
+	int k, rv;
+
+	for (k = 0; k < nxst; k++) {
+		xst[k].npat = npat;
+		if ((th[k] = new_athread(station_read, (void *)&xst[k])) == NULL)
+			error("Failed to create station read thread");
+	}
+
+	rv = dr->read(dr, cols, npat, 1, npat, 1, 0, instNoClamp);
+
+	for (k = 0; k < nxst; k++) {
+		th[k]->wait(th[k]);
+		th[k]->del(th[k]);
+		if (rv == 0 && xst[k].rv != 0) {
+			warning("Station %d read returned error code %d",k+2,xst[k].rv);
+			rv = xst[k].rv;
+		}
+	}
+	return rv;
+}
+
+/* Create an output cgats structure with the same header */
+/* keywords and fields as the given one. */
+static cgats *dup_ti3_header(cgats *ocg) {
+	cgats *ncg;
+	int i;
+
+	ncg = new_cgats();
+	ncg->add_other(ncg, "CTI3");
+	ncg->add_table(ncg, tt_other, 0);
+
+	for (i = 0; i < ocg->t[0].nkwords; i++)
+		ncg->add_kword(ncg, 0, ocg->t[0].ksym[i], ocg->t[0].kdata[i], NULL);
+	for (i = 0; i < ocg->t[0].nfields; i++)
+		ncg->add_field(ncg, 0, ocg->t[0].fsym[i], ocg->t[0].ftype[i]);
+
+	return ncg;
+}
+
+/* Add the readings to the output cgats structure and write it. */
+static void write_ti3(
+	cgats *ocg,				/* Output cgats structure with header set up */
+	disprd *dr,				/* Display patch read object the readings were made with */
+	col *cols,				/* [npat+1] Readings */
+	int npat,				/* Number of patches in the file */
+	int wpat,				/* Index of white patch */
+	int dim,				/* Dimensionality */
+	int donorm,				/* Enable Y = 100 normalisation */
+	double cal[3][MAX_CAL_ENT],	/* Display calibration, cal[0][0] < 0.0 if none */
+	int ncal,				/* Number of cal entries */
+	int nocaloutput,		/* NZ to omit calibration info */
+	int noramdac,			/* NZ if can't set ramdac */
+	char *atm,				/* Ascii time */
+	char *outname,			/* Output file name */
+	int verb
+) {
+	int i, j;
+	int nsetel = 0;
+	cgats_set_elem *setel;				/* Array of set value elements */
+
+	/* Note what instrument the chart was read with */
+	if (dr->it != NULL) {
+		int refrmode, cbid;
+		ocg->add_kword(ocg, 0, "TARGET_INSTRUMENT", inst_name(dr->it->get_itype(dr->it)) , NULL);
+		dr->get_disptype(dr, &refrmode, &cbid);
+		if (refrmode >= 0)
+			ocg->add_kword(ocg, 0, "DISPLAY_TYPE_REFRESH", refrmode ? "YES" : "NO", NULL);
+		if (cbid != 0) {
+			char buf[100];
+			sprintf(buf, "%d", cbid);
+			ocg->add_kword(ocg, 0, "DISPLAY_TYPE_BASE_ID", buf, NULL);
+		}
+	} else {
+		ocg->add_kword(ocg, 0, "TARGET_INSTRUMENT", "Fake" , NULL);
+	}
+
+	/* Note if the instrument is natively spectral or not */
+	if (dr->it != NULL) {
+		inst_mode cap;
+		dr->it->capabilities(dr->it, &cap, NULL, NULL);
+
+		if (dr->it != NULL && cap & inst_mode_spectral)
+			ocg->add_kword(ocg, 0, "INSTRUMENT_TYPE_SPECTRAL", "YES" , NULL);
+		else
+			ocg->add_kword(ocg, 0, "INSTRUMENT_TYPE_SPECTRAL", "NO" , NULL);
+	} else {
+		ocg->add_kword(ocg, 0, "INSTRUMENT_TYPE_SPECTRAL", "NO" , NULL);
+	}
+
+	/* And save the result: */
+
+	/* Convert from absolute XYZ to relative XYZ */
+	if (npat > 0) {
+		double nn;
+
+		/* Make sure there is a copy of the white patch beyond npat, */
+		/* so that it can be left absolute. */
+		if (wpat != npat) {
+			cols[npat].r = cols[npat].g = cols[npat].b = 1.0;
+			cols[npat].XYZ[0] = cols[wpat].XYZ[0];
+			cols[npat].XYZ[1] = cols[wpat].XYZ[1];
+			cols[npat].XYZ[2] = cols[wpat].XYZ[2];
+			cols[npat].XYZ_v = cols[wpat].XYZ_v; 
+			wpat = npat;
+		}
+
+		if (donorm) {
+			if (cols[wpat].XYZ_v == 0)
+				error("XYZ of white patch is not valid!\nCan't normalise value to white",i);
+
+			nn = 100.0 / cols[wpat].XYZ[1];		/* Normalise Y of white to 100 */
+		} else
+			nn = 1.0;
+
+		for (i = 0; i < npat; i++) {
+
+			if (cols[i].XYZ_v == 0)
+				warning("XYZ patch %d is not valid!",i+1);
+
+			for (j = 0; j < 3; j++)
+				cols[i].XYZ[j] = nn * cols[i].XYZ[j];
+		
+			/* Keep spectral aligned with normalised XYZ */
+			if (cols[i].sp.spec_n > 0) {
+				for (j = 0; j < cols[i].sp.spec_n; j++)
+					cols[i].sp.spec[j] *= nn;
+			}
+		}
+	}
+
+	nsetel += 1;		/* For id */
+	nsetel += dim;		/* For device values */
+	nsetel += 3;		/* For XYZ */
+
+	/* If we have spectral information, output it too */
+	if (npat > 0 && cols[0].sp.spec_n > 0) {
+		char buf[100];
+
+		nsetel += cols[0].sp.spec_n;		/* Spectral values */
+		sprintf(buf,"%d", cols[0].sp.spec_n);
+		ocg->add_kword(ocg, 0, "SPECTRAL_BANDS",buf, NULL);
+		sprintf(buf,"%f", cols[0].sp.spec_wl_short);
+		ocg->add_kword(ocg, 0, "SPECTRAL_START_NM",buf, NULL);
+		sprintf(buf,"%f", cols[0].sp.spec_wl_long);
+		ocg->add_kword(ocg, 0, "SPECTRAL_END_NM",buf, NULL);
+
+		/* Generate fields for spectral values */
+		for (i = 0; i < cols[0].sp.spec_n; i++) {
+			int nm;
+	
+			/* Compute nearest integer wavelength */
+			nm = (int)(cols[0].sp.spec_wl_short + ((double)i/(cols[0].sp.spec_n-1.0))
+			            * (cols[0].sp.spec_wl_long - cols[0].sp.spec_wl_short) + 0.5);
+			
+			sprintf(buf,"SPEC_%03d",nm);
+			ocg->add_field(ocg, 0, buf, r_t);
+		}
+	}
+
+	if ((setel = (cgats_set_elem *)malloc(sizeof(cgats_set_elem) * nsetel)) == NULL)
+		error("Malloc failed!");
+
+	/* Write out the patch info to the output CGATS file */
+	for (i = 0; i < npat; i++) {
+		int k = 0;
+
+		if (cols[i].XYZ_v == 0) {
+			warning("Omitting patch %d from .ti3 file!",i+1);
+			continue;
+		}
+
+		setel[k++].c = cols[i].id;
+		setel[k++].d = 100.0 * cols[i].r;
+		setel[k++].d = 100.0 * cols[i].g;
+		setel[k++].d = 100.0 * cols[i].b;
+
+		setel[k++].d = cols[i].XYZ[0];
+		setel[k++].d = cols[i].XYZ[1];
+		setel[k++].d = cols[i].XYZ[2];
+
+		for (j = 0; j < cols[i].sp.spec_n; j++) {
+			setel[k++].d = cols[i].sp.spec[j];
+		}
+
+		ocg->add_setarr(ocg, 0, setel);
+	}
+
+	free(setel);
+
+	/* If we have the absolute brightness of the display, record it */
+	if (cols[wpat].XYZ_v != 0) {
+		char buf[100];
+
+		sprintf(buf,"%f %f %f", cols[wpat].XYZ[0], cols[wpat].XYZ[1], cols[wpat].XYZ[2]);
+		ocg->add_kword(ocg, 0, "LUMINANCE_XYZ_CDM2",buf, NULL);
+	}
+
+	if (donorm) 
+		ocg->add_kword(ocg, 0, "NORMALIZED_TO_Y_100","YES", NULL);
+	else
+		ocg->add_kword(ocg, 0, "NORMALIZED_TO_Y_100","NO", NULL);
+
+	/* Write out the calibration if we have it and we want to save it */
+	if (cal[0][0] >= 0.0 && !nocaloutput) {
+		ocg->add_other(ocg, "CAL"); 		/* our special type is Calibration file */
+		ocg->add_table(ocg, tt_other, 1);	/* Add another table for RAMDAC values */
+		ocg->add_kword(ocg, 1, "DESCRIPTOR", "Argyll Device Calibration State",NULL);
+		ocg->add_kword(ocg, 1, "ORIGINATOR", "Argyll dispread", NULL);
+		ocg->add_kword(ocg, 1, "CREATED",atm, NULL);
+
+		ocg->add_kword(ocg, 1, "DEVICE_CLASS","DISPLAY", NULL);
+		ocg->add_kword(ocg, 1, "COLOR_REP","RGB", NULL);
+		ocg->add_kword(ocg, 0, "VIDEO_LUT_CALIBRATION_POSSIBLE",noramdac ? "NO" : "YES", NULL);
+
+		ocg->add_field(ocg, 1, "RGB_I", r_t);
+		ocg->add_field(ocg, 1, "RGB_R", r_t);
+		ocg->add_field(ocg, 1, "RGB_G", r_t);
+		ocg->add_field(ocg, 1, "RGB_B", r_t);
+
+		if ((setel = (cgats_set_elem *)malloc(sizeof(cgats_set_elem) * 4)) == NULL)
+			error("Malloc failed!");
+
+		for (i = 0; i < ncal; i++) {
+			double vv;
+
+#if defined(__APPLE__) && defined(__POWERPC__)
+			gcc_bug_fix(i);
+#endif
+			vv = i/(ncal-1.0);
+
+			setel[0].d = vv;
+			setel[1].d = cal[0][i];
+			setel[2].d = cal[1][i];
+			setel[3].d = cal[2][i];
+
+			ocg->add_setarr(ocg, 1, setel);
+		}
+
+		free(setel);
+	}
+
+	if (ocg->write_name(ocg, outname))
+		error("Write error : %s",ocg->err);
+
+	if (verb)
+		printf("Written '%s'\n",outname);
+}
+
+/* ------------------------------------------------------------------- */
+
 /*
 
   Flags used:
 
          ABCDEFGHIJKLMNOPQRSTUVWXYZ
-  upper    .... .... .. ..    .....
+  upper    .... .... .. .. .  .....
   lower    ..      .  . .  .  .. . 
 
 */
@@ -175,6 +455,8 @@ void usage(int flag, char *diag, ...) {
 		} else
 			fprintf(stderr,"    ** No ports found **\n");
 	}
+	fprintf(stderr," -S listno[:n[:ho,vo]] Add a station reading at the same time with the instrument\n");
+	fprintf(stderr,"                      at port listno, on display n at test window position ho,vo\n");
 	fprintf(stderr," -p                   Use telephoto mode (ie. for a projector, if available)\n");
 	fprintf(stderr," -a                   Use ambient measurement mode (ie. for a projector, if available)\n");
 	cap2 = inst_show_disptype_options(stderr, " -y                   ", icmps, 0);
@@ -206,10 +488,13 @@ void usage(int flag, char *diag, ...) {
 		fprintf(stderr,"                      1931_2 (def), 1964_10, 2012_2, 2012_10, S&B 1955_2, shaw, J&V 1978_2, 1964_10c or file.cmf\n");
 	}
 	fprintf(stderr," -I b|w               Drift compensation, Black: -Ib, White: -Iw, Both: -Ibw\n");
+	fprintf(stderr," -I u                 Wait until the display has warmed up before measuring\n");
 	fprintf(stderr," -Y R:rate            Override measured refresh rate with rate Hz\n");
 	fprintf(stderr," -Y A                 Use non-adaptive integration time mode (if available).\n");
+	fprintf(stderr," -Y a:speed           Adaptive dark patch speed/accuracy, > 1 faster, < 1 more accurate\n");
 	fprintf(stderr," -Y p                 Don't wait for the instrument to be placed on the display\n");
 	fprintf(stderr," -Y k                 Omit the file.cal information from the .ti3 file\n"); 
+	fprintf(stderr," -Y o                 Read patches in an order that reduces settling time\n");
 	fprintf(stderr," -C \"command\"         Invoke shell \"command\" each time a color is set\n");
 	fprintf(stderr," -M \"command\"         Invoke shell \"command\" each time a color is measured\n");
 //	fprintf(stderr," -x [lx]              Take manually entered values, either L*a*b* (-xl) or XYZ (-xx).\n");
@@ -242,9 +527,11 @@ int main(int argc, char *argv[]) {
 	int docalib = 0;					/* Do a calibration */
 	int highres = 0;					/* Use high res mode if available */
 	double refrate = 0.0;			    /* 0.0 = default, > 0.0 = override refresh rate */ 
+	double adspeed = 0.0;			    /* 0.0 = default, > 0.0 = adaptive speed/accuracy */ 
 	int nadaptive = 0;					/* Use non-adaptive mode if available */
 	int bdrift = 0;						/* Flag, nz for black drift compensation */
 	int wdrift = 0;						/* Flag, nz for white drift compensation */
+	int warmup = 0;						/* Flag, nz to wait for display to warm up */
 	int ditype = 0;						/* Display type selection charater(s) */
 	int tele = 0;						/* NZ if telephoto mode */
 	int ambient = 0;					/* NZ if ambient mode */
@@ -281,6 +568,7 @@ int main(int argc, char *argv[]) {
 	double cal[3][MAX_CAL_ENT];			/* Display calibration */
 	int ncal = 256;						/* Default number of cal entries used */
 	int nocaloutput = 0;				/* NZ to omit calibration info from .ti3 */
+	int settleorder = 0;				/* NZ to read in reduced settling time order */
 	cgats *icg;							/* input cgats structure */
 	cgats *ocg;							/* output cgats structure */
 	time_t clk = time(0);
@@ -294,9 +582,10 @@ int main(int argc, char *argv[]) {
 	int si;								/* Sample id index */
 	int ti;								/* Temp index */
 	int fi;								/* Colorspace index */
-	int nsetel = 0;
-	cgats_set_elem *setel;				/* Array of set value elements */
 	disprd *dr;							/* Display patch read object */
+	station xst[MAX_XSTATIONS];			/* Additional measuring stations */
+	int nxst = 0;						/* Number of additional stations */
+	int k;
 	int noramdac = 0;					/* Will be set to nz if can't set ramdac */
 	int nocm = 0;						/* Will be set to nz if can't set color management */
 	int errc;							/* Return value from new_disprd() */
@@ -430,6 +719,34 @@ int main(int argc, char *argv[]) {
 				comport = atoi(na);
 				if (comport < 1 || comport > 50) usage(0,"-c parameter %d out of range",comport);
 
+			/* Additional measuring station */
+			} else if (argv[fa][1] == 'S') {
+				station *s;
+				int nn;
+
+				fa = nfa;
+				if (na == NULL) usage(0,"Paramater expected following -S");
+				if (nxst >= MAX_XSTATIONS) usage(0,"Too many -S stations, maximum %d",MAX_XSTATIONS);
+				s = &xst[nxst];
+				memset((void *)s, 0, sizeof(station));
+				s->dix = -1;
+				nn = sscanf(na, " %d:%d:%lf,%lf ", &s->comport, &s->dix, &s->ho, &s->vo);
+				if (nn < 1) usage(0,"-S parameter '%s' not recognised",na);
+				if (s->comport < 1 || s->comport > 50)
+					usage(0,"-S port %d out of range",s->comport);
+				if (nn >= 2)
+					s->dix--;
+				if (nn == 4) {
+					if (s->ho < 0.0 || s->ho > 1.0 || s->vo < 0.0 || s->vo > 1.0)
+						usage(0,"-S position %f %f out of range",s->ho,s->vo);
+					s->ho = 2.0 * s->ho - 1.0;
+					s->vo = 2.0 * s->vo - 1.0;
+					s->setpos = 1;
+				} else if (nn != 1 && nn != 2) {
+					usage(0,"-S parameter '%s' not recognised",na);
+				}
+				nxst++;
+
 			/* Telephoto */
 			} else if (argv[fa][1] == 'p') {
 				tele = 1;
@@ -540,6 +857,8 @@ int main(int argc, char *argv[]) {
 						bdrift = 1;
 					else if (na[i] == 'w' || na[i] == 'W')
 						wdrift = 1;
+					else if (na[i] == 'u' || na[i] == 'U')
+						warmup = 1;
 					else
 						usage(0,"-I parameter '%c' not recognised",na[i]);
 				}
@@ -631,8 +950,16 @@ int main(int argc, char *argv[]) {
 					noplace = 1;
 				} else if (na[0] == 'A') {
 					nadaptive = 1;
+				} else if (na[0] == 'a') {
+					if (na[1] != ':')
+						usage(0,"-Y a:speed syntax incorrect");
+					adspeed = atof(na+2);
+					if (adspeed < 0.1 || adspeed > 10.0)
+						usage(0,"-Y a:speed %f not in valid range",adspeed);
 				} else if (na[0] == 'k') {
 					nocaloutput = 1;
+				} else if (na[0] == 'o') {
+					settleorder = 1;
 				} else {
 					usage(0,"Flag '-Y %c' not recognised",na[0]);
 				}
@@ -943,7 +1270,7 @@ int main(int argc, char *argv[]) {
 	}
 
 	if ((dr = new_disprd(&errc, ipath, fc, ditype, -1, 0, tele, ambient, nadaptive, noautocal, noplace,
-	                     highres, refrate, native, &noramdac, &nocm, cal, ncal, disp,
+	                     highres, refrate, adspeed, native, &noramdac, &nocm, cal, ncal, disp,
 		                 out_tvenc, fullscreen, override, webdisp, ccid,
 #ifdef NT
 						 madvrdisp,
@@ -958,205 +1285,122 @@ int main(int argc, char *argv[]) {
 		                 "fake" ICC_FILE_EXT, g_log)) == NULL)
 		error("new_disprd failed with '%s'\n",disprd_err(errc));
 
-	if (cmx != NULL)
-		cmx->del(cmx);
-	if (ccs != NULL)
-		ccs->del(ccs);
-
-	/* Test the CRT with all of the test points */
-	if ((rv = dr->read(dr, cols, npat + xpat, 1, npat + xpat, 1, 0, instNoClamp)) != 0) {
-		dr->del(dr);
-		error("dispd->read returned error code %d\n",rv);
-	}
-	/* Note what instrument the chart was read with */
-	if (dr->it != NULL) {
-		int refrmode, cbid;
-		ocg->add_kword(ocg, 0, "TARGET_INSTRUMENT", inst_name(dr->it->get_itype(dr->it)) , NULL);
-		dr->get_disptype(dr, &refrmode, &cbid);
-		if (refrmode >= 0)
-			ocg->add_kword(ocg, 0, "DISPLAY_TYPE_REFRESH", refrmode ? "YES" : "NO", NULL);
-		if (cbid != 0) {
-			char buf[100];
-			sprintf(buf, "%d", cbid);
-			ocg->add_kword(ocg, 0, "DISPLAY_TYPE_BASE_ID", buf, NULL);
+	/* Wait until the display has stopped drifting */
+	if (warmup) {
+		if ((rv = dr->warm_up(dr, 0.0, 0.0, 0)) != 0) {
+			dr->del(dr);
+			error("display warm up failed with '%s'\n",disprd_err(rv));
 		}
-	} else {
-		ocg->add_kword(ocg, 0, "TARGET_INSTRUMENT", "Fake" , NULL);
-	}
-
-	/* Note if the instrument is natively spectral or not */
-	if (dr->it != NULL) {
-		inst_mode cap;
-		dr->it->capabilities(dr->it, &cap, NULL, NULL);
-
-		if (dr->it != NULL && cap & inst_mode_spectral)
-			ocg->add_kword(ocg, 0, "INSTRUMENT_TYPE_SPECTRAL", "YES" , NULL);
-		else
-			ocg->add_kword(ocg, 0, "INSTRUMENT_TYPE_SPECTRAL", "NO" , NULL);
-	} else {
-		ocg->add_kword(ocg, 0, "INSTRUMENT_TYPE_SPECTRAL", "NO" , NULL);
 	}
 
-	dr->del(dr);
-
-	/* And save the result: */
-
-	/* Convert from absolute XYZ to relative XYZ */
-	if (npat > 0) {
-		double nn;
-
-		/* Make sure there is a copy of the white patch beyond npat, */
-		/* so that it can be left absolute. */
-		if (wpat != npat) {
-			cols[npat].r = cols[npat].g = cols[npat].b = 1.0;
-			cols[npat].XYZ[0] = cols[wpat].XYZ[0];
-			cols[npat].XYZ[1] = cols[wpat].XYZ[1];
-			cols[npat].XYZ[2] = cols[wpat].XYZ[2];
-			cols[npat].XYZ_v = cols[wpat].XYZ_v; 
-			wpat = npat;
+	/* Open the additional stations. These read the same patches */
+	/* at the same time as the main one, each with its own test window. */
+	for (k = 0; k < nxst; k++) {
+		station *s = &xst[k];
+		icompath *sipath;
+		int snoramdac = 0, snocm = 0;
+
+		if (fake)
+			error("Additional stations can't be used with the fake device");
+		if ((sipath = icmps->get_path(icmps, s->comport)) == NULL)
+			error("No instrument at port %d for station %d",s->comport,k+2);
+		if (s->dix >= 0 && (s->disp = get_a_display(s->dix)) == NULL)
+			error("Display %d for station %d is out of range",s->dix+1,k+2);
+		if (!s->setpos) {
+			s->ho = ho;
+			s->vo = vo;
 		}
 
-		if (donorm) {
-			if (cols[wpat].XYZ_v == 0)
-				error("XYZ of white patch is not valid!\nCan't normalise value to white",i);
-
-			nn = 100.0 / cols[wpat].XYZ[1];		/* Normalise Y of white to 100 */
-		} else
-			nn = 1.0;
-
-		for (i = 0; i < npat; i++) {
-
-			if (cols[i].XYZ_v == 0)
-				warning("XYZ patch %d is not valid!",i+1);
+		if (verb)
+			printf("Setting up station %d\n",k+2);
 
-			for (j = 0; j < 3; j++)
-				cols[i].XYZ[j] = nn * cols[i].XYZ[j];
-		
-			/* Keep spectral aligned with normalised XYZ */
-			if (cols[i].sp.spec_n > 0) {
-				for (j = 0; j < cols[i].sp.spec_n; j++)
-					cols[i].sp.spec[j] *= nn;
-			}
-		}
+		if ((s->dr = new_disprd(&errc, sipath, fc, ditype, -1, 0, tele, ambient, nadaptive,
+		                     noautocal, noplace, highres, refrate, adspeed, native,
+		                     &snoramdac, &snocm, cal, ncal, s->disp != NULL ? s->disp : disp,
+			                 out_tvenc, 0, override, 0, NULL,
+#ifdef NT
+							 0,
+#endif
+			                 0, NULL, NULL, 0,
+			                 100.0 * hpatscale, 100.0 * vpatscale, s->ho, s->vo,
+		                     ccs != NULL ? ccs->dtech : cmx != NULL ? cmx->dtech : disptech_unknown,
+		                     cmx != NULL ? cmx->cc_cbid : 0,
+		                     cmx != NULL ? cmx->matrix : NULL,
+		                     ccs != NULL ? ccs->samples : NULL, ccs != NULL ? ccs->no_samp : 0,
+			                 spec, obType, custObserver, bdrift, wdrift,
+			                 "fake" ICC_FILE_EXT, g_log)) == NULL)
+			error("new_disprd for station %d failed with '%s'\n",k+2,disprd_err(errc));
+
+		/* Each station gets its own copy of the patches and output file */
+		if ((s->cols = (col *)malloc(sizeof(col) * (npat+1))) == NULL)
+			error("Malloc failed!");
+		for (i = 0; i < (npat+1); i++)
+			s->cols[i] = cols[i];
+		s->ocg = dup_ti3_header(ocg);
+		sprintf(s->outname, "%.*s_%d.ti3", (int)strlen(outname)-4, outname, k+2);
 	}
 
-	nsetel += 1;		/* For id */
-	nsetel += dim;		/* For device values */
-	nsetel += 3;		/* For XYZ */
-
-	/* If we have spectral information, output it too */
-	if (npat > 0 && cols[0].sp.spec_n > 0) {
-		char buf[100];
-
-		nsetel += cols[0].sp.spec_n;		/* Spectral values */
-		sprintf(buf,"%d", cols[0].sp.spec_n);
-		ocg->add_kword(ocg, 0, "SPECTRAL_BANDS",buf, NULL);
-		sprintf(buf,"%f", cols[0].sp.spec_wl_short);
-		ocg->add_kword(ocg, 0, "SPECTRAL_START_NM",buf, NULL);
-		sprintf(buf,"%f", cols[0].sp.spec_wl_long);
-		ocg->add_kword(ocg, 0, "SPECTRAL_END_NM",buf, NULL);
+	if (cmx != NULL)
+		cmx->del(cmx);
+	if (ccs != NULL)
+		ccs->del(ccs);
 
-		/* Generate fields for spectral values */
-		for (i = 0; i < cols[0].sp.spec_n; i++) {
-			int nm;
-	
-			/* Compute nearest integer wavelength */
-			nm = (int)(cols[0].sp.spec_wl_short + ((double)i/(cols[0].sp.spec_n-1.0))
-			            * (cols[0].sp.spec_wl_long - cols[0].sp.spec_wl_short) + 0.5);
-			
-			sprintf(buf,"SPEC_%03d",nm);
-			ocg->add_field(ocg, 0, buf, r_t);
+	/* Test the CRT with all of the test points */
+	if (settleorder) {
+		int *order;
+		col *ocols;
+		col *tcols[MAX_XSTATIONS];
+
+		/* Read them in settling time order, and put them back in file order */
+		if ((order = disprd_settle_order(dr, cols, npat + xpat)) == NULL
+		 || (ocols = (col *)malloc(sizeof(col) * (npat + xpat) * (1 + nxst))) == NULL)
+			error("Malloc failed!");
+		for (i = 0; i < (npat + xpat); i++) {
+			ocols[i] = cols[order[i]];
+			for (k = 0; k < nxst; k++)
+				ocols[(k+1) * (npat + xpat) + i] = xst[k].cols[order[i]];
 		}
-	}
-
-	if ((setel = (cgats_set_elem *)malloc(sizeof(cgats_set_elem) * nsetel)) == NULL)
-		error("Malloc failed!");
-
-	/* Write out the patch info to the output CGATS file */
-	for (i = 0; i < npat; i++) {
-		int k = 0;
-
-		if (cols[i].XYZ_v == 0) {
-			warning("Omitting patch %d from .ti3 file!",i+1);
-			continue;
+		/* Point the stations at their reordered copies while reading */
+		for (k = 0; k < nxst; k++) {
+			tcols[k] = xst[k].cols;
+			xst[k].cols = ocols + (k+1) * (npat + xpat);
 		}
-
-		setel[k++].c = cols[i].id;
-		setel[k++].d = 100.0 * cols[i].r;
-		setel[k++].d = 100.0 * cols[i].g;
-		setel[k++].d = 100.0 * cols[i].b;
-
-		setel[k++].d = cols[i].XYZ[0];
-		setel[k++].d = cols[i].XYZ[1];
-		setel[k++].d = cols[i].XYZ[2];
-
-		for (j = 0; j < cols[i].sp.spec_n; j++) {
-			setel[k++].d = cols[i].sp.spec[j];
+		rv = read_stations(dr, ocols, npat + xpat, xst, nxst);
+		for (k = 0; k < nxst; k++)
+			xst[k].cols = tcols[k];
+		if (rv != 0) {
+			dr->del(dr);
+			error("dispd->read returned error code %d\n",rv);
 		}
+		for (i = 0; i < (npat + xpat); i++) {
+			cols[order[i]] = ocols[i];
+			for (k = 0; k < nxst; k++)
+				xst[k].cols[order[i]] = ocols[(k+1) * (npat + xpat) + i];
+		}
+		free(ocols);
+		free(order);
 
-		ocg->add_setarr(ocg, 0, setel);
+	} else if ((rv = read_stations(dr, cols, npat + xpat, xst, nxst)) != 0) {
+		dr->del(dr);
+		error("dispd->read returned error code %d\n",rv);
 	}
-
-	free(setel);
-
-	/* If we have the absolute brightness of the display, record it */
-	if (cols[wpat].XYZ_v != 0) {
-		char buf[100];
-
-		sprintf(buf,"%f %f %f", cols[wpat].XYZ[0], cols[wpat].XYZ[1], cols[wpat].XYZ[2]);
-		ocg->add_kword(ocg, 0, "LUMINANCE_XYZ_CDM2",buf, NULL);
+	/* Write the results for each station */
+	write_ti3(ocg, dr, cols, npat, wpat, dim, donorm, cal, ncal, nocaloutput, noramdac,
+	          atm, outname, verb);
+	for (k = 0; k < nxst; k++) {
+		write_ti3(xst[k].ocg, xst[k].dr, xst[k].cols, npat, wpat, dim, donorm, cal, ncal,
+		          nocaloutput, noramdac, atm, xst[k].outname, verb);
 	}
 
-	if (donorm) 
-		ocg->add_kword(ocg, 0, "NORMALIZED_TO_Y_100","YES", NULL);
-	else
-		ocg->add_kword(ocg, 0, "NORMALIZED_TO_Y_100","NO", NULL);
-
-	/* Write out the calibration if we have it and we want to save it */
-	if (cal[0][0] >= 0.0 && !nocaloutput) {
-		ocg->add_other(ocg, "CAL"); 		/* our special type is Calibration file */
-		ocg->add_table(ocg, tt_other, 1);	/* Add another table for RAMDAC values */
-		ocg->add_kword(ocg, 1, "DESCRIPTOR", "Argyll Device Calibration State",NULL);
-		ocg->add_kword(ocg, 1, "ORIGINATOR", "Argyll dispread", NULL);
-		ocg->add_kword(ocg, 1, "CREATED",atm, NULL);
-
-		ocg->add_kword(ocg, 1, "DEVICE_CLASS","DISPLAY", NULL);
-		ocg->add_kword(ocg, 1, "COLOR_REP","RGB", NULL);
-		ocg->add_kword(ocg, 0, "VIDEO_LUT_CALIBRATION_POSSIBLE",noramdac ? "NO" : "YES", NULL);
-
-		ocg->add_field(ocg, 1, "RGB_I", r_t);
-		ocg->add_field(ocg, 1, "RGB_R", r_t);
-		ocg->add_field(ocg, 1, "RGB_G", r_t);
-		ocg->add_field(ocg, 1, "RGB_B", r_t);
-
-		if ((setel = (cgats_set_elem *)malloc(sizeof(cgats_set_elem) * 4)) == NULL)
-			error("Malloc failed!");
-
-		for (i = 0; i < ncal; i++) {
-			double vv;
-
-#if defined(__APPLE__) && defined(__POWERPC__)
-			gcc_bug_fix(i);
-#endif
-			vv = i/(ncal-1.0);
-
-			setel[0].d = vv;
-			setel[1].d = cal[0][i];
-			setel[2].d = cal[1][i];
-			setel[3].d = cal[2][i];
-
-			ocg->add_setarr(ocg, 1, setel);
-		}
-
-		free(setel);
+	dr->del(dr);
+	for (k = 0; k < nxst; k++) {
+		xst[k].dr->del(xst[k].dr);
+		xst[k].ocg->del(xst[k].ocg);
+		free(xst[k].cols);
+		if (xst[k].disp != NULL)
+			free_a_disppath(xst[k].disp);
 	}
 
-	if (ocg->write_name(ocg, outname))
-		error("Write error : %s",ocg->err);
-
-	if (verb)
-		printf("Written '%s'\n",outname);
-
 	icmps->del(icmps);
 	free(cols);
 	ocg->del(ocg);		/* Clean up */
@@ -63,6 +63,14 @@
 #define DRIFT_IPERIOD	40	/* Number of samples between drift interpolation measurements */
 #define DRIFT_EPERIOD	20	/* Number of samples between drift extrapolation measurements */
 #define DRIFT_MAXSECS	60	/* Number of seconds to time out previous drift value */
+#define DRIFT_TARGDE	0.5	/* Target DE of drift between drift measurements */
+#define DRIFT_MINPERIOD	10	/* Minimum adapted drift interpolation period */
+#define DRIFT_MAXPERIOD	320	/* Maximum adapted drift interpolation period */
+
+#define WARMUP_INTERVAL	30	/* Seconds between warm-up white readings */
+#define WARMUP_DERATE	0.1	/* Default warm-up threshold in DE per minute */
+#define WARMUP_NSTABLE	3	/* Number of consecutive intervals under threshold */
+#define WARMUP_MAXMINS	90	/* Default minutes to give up waiting after */
 //#define DRIFT_IPERIOD	6	/* Test values */
 //#define DRIFT_EPERIOD	3
 
@@ -434,6 +442,161 @@ int del_set_white(void *cx) {
 	return 0;
 }
 
+/* Context for del_set_level() */
+typedef struct {
+	disprd *p;
+	double level;		/* Grey level to set */
+} del_set_cntx;
+
+/* Set color to a grey level after 200 msec delay, and timestamp the change */
+static int del_set_level(void *cx) {
+	del_set_cntx *sc = (del_set_cntx *)cx;
+	disprd *p = sc->p;
+	inst_code ev;
+	int rv;
+
+	msec_sleep(200);
+
+	if ((rv = p->dw->set_color(p->dw, sc->level, sc->level, sc->level)) != 0) {
+		a1logd(p->log,1,"set_color() returned %d\n",rv);
+		return 3;
+	}
+	if ((ev = p->it->white_change(p->it, 0)) != inst_ok) {
+		a1logd(p->log,1,"white_change() returned 0x%x\n",ev);
+		return 3;
+	}
+
+	return 0;
+}
+
+#define NRSAMPS 500		/* Maximum response samples */
+#define RSTIME 1.5		/* Response sampling time in seconds */
+
+/* Measure a display transition from one grey level to another, and */
+/* return the time taken to make 90% of the change, fitted to the */
+/* exponential settling model used by disp_settle_time(). */
+/* Return nz if it couldn't be measured. */
+static int disprd_meas_settle(disprd *p, double from, double to, double *ptime) {
+	athread *th;
+	del_set_cntx sc;
+	inst_code ev;
+	double sec[NRSAMPS], lev[NRSAMPS], sm[NRSAMPS];
+	int i, nsamp, nb;
+	double base, fin, del, t10, t90;
+
+	if (p->dw->set_color(p->dw, from, from, from) != 0)
+		return 1;
+	msec_sleep(600);		/* Wait for it to settle */
+
+	p->it->white_change(p->it, 1);
+
+	sc.p = p;
+	sc.level = to;
+	if ((th = new_athread(del_set_level, (void *)&sc)) == NULL) {
+		a1logd(p->log,1,"failed to create thread to set_color()\n");
+		return 1;
+	}
+	ev = p->it->meas_response(p->it, NRSAMPS, sec, lev, &nsamp, RSTIME);
+	th->del(th);
+
+	if (ev != inst_ok || nsamp < 20) {
+		a1logd(p->log,1,"meas_response failed with '%s' (%s), %d samples\n",
+			      p->it->inst_interp_error(p->it, ev), p->it->interp_error(p->it, ev), nsamp);
+		return 1;
+	}
+
+	/* Smooth out any flicker */
+	for (i = 0; i < nsamp; i++) {
+		int i0 = i > 0 ? i-1 : i, i1 = i < (nsamp-1) ? i+1 : i;
+		sm[i] = (lev[i0] + lev[i] + lev[i1])/3.0;
+	}
+
+	/* Level before the change */
+	for (base = 0.0, nb = i = 0; i < nsamp && sec[i] < 0.0; i++, nb++)
+		base += sm[i];
+	if (nb < 2) {
+		a1logd(p->log,1,"disprd_meas_settle: no samples before the change\n");
+		return 1;
+	}
+	base /= (double)nb;
+
+	/* Level over the last quarter of the sampling time */
+	for (fin = 0.0, nb = 0, i = nsamp-1; i >= 0 && sec[i] > (sec[nsamp-1] - 0.25 * RSTIME); i--, nb++)
+		fin += sm[i];
+	fin /= (double)nb;
+
+	del = fin - base;
+	if (fabs(del) < 0.2 * (fabs(base) > fabs(fin) ? fabs(base) : fabs(fin)) || fabs(del) < 1e-6) {
+		a1logd(p->log,1,"disprd_meas_settle: no transition seen (%f -> %f)\n",base,fin);
+		return 1;
+	}
+
+	/* First reaching 10% of the change */
+	for (i = 0; i < nsamp; i++) {
+		if (sec[i] >= 0.0 && (sm[i] - base)/del >= 0.1)
+			break;
+	}
+	if (i >= nsamp)
+		return 1;
+	t10 = sec[i];
+
+	/* Staying within 10% of the end level */
+	for (i = nsamp-1; i >= 0; i--) {
+		if ((sm[i] - base)/del < 0.9)
+			break;
+	}
+	if (i >= (nsamp-2) || (i+1) >= nsamp || sec[i+1] > (sec[nsamp-1] - 0.25 * RSTIME)) {
+		a1logd(p->log,1,"disprd_meas_settle: didn't settle in time\n");
+		return 1;
+	}
+	t90 = sec[i+1];
+	if (t90 < t10)
+		t90 = t10;
+
+	/* For an exponential the 10% point is at log(0.9)/log(0.1) of the 90% time */
+	*ptime = (t90 - t10)/(1.0 - log(0.9)/log(0.1));
+	a1logd(p->log,1,"disprd_meas_settle: %f -> %f, 10%% at %f, 90%% at %f, time %f\n",
+	                                                       from, to, t10, t90, *ptime);
+	return 0;
+}
+#undef NRSAMPS
+#undef RSTIME
+
+/* Measure the display rise and fall times, and use them for */
+/* the test window settling delay in place of the display */
+/* technology defaults. */
+static void disprd_cal_settle(disprd *p) {
+	double rise, fall;
+
+	p->settle_time_set = 1;
+
+	/* Make set_color() return as soon as the color is displayed */
+	p->dw->enable_update_delay(p->dw, 0);
+
+	if (disprd_meas_settle(p, 0.0, 1.0, &rise) != 0
+	 || disprd_meas_settle(p, 1.0, 0.0, &fall) != 0) {
+		a1logv(p->log, 1, "Measuring the display settling time failed - using defaults\n");
+		p->dw->enable_update_delay(p->dw, 1);
+		return;
+	}
+	p->dw->enable_update_delay(p->dw, 1);
+
+	/* Allow a margin, and keep them reasonable */
+	rise *= 1.25;
+	fall *= 1.25;
+	if (rise < 0.005)
+		rise = 0.005;
+	else if (rise > 2.0)
+		rise = 2.0;
+	if (fall < 0.005)
+		fall = 0.005;
+	else if (fall > 2.0)
+		fall = 2.0;
+
+	a1logv(p->log, 1, "Measured display rise time %.3f, fall time %.3f secs\n",rise,fall);
+	p->dw->set_settling_delay(p->dw, rise, fall, -1.0);
+}
+
 #ifdef NEVER
 /* Implement scallout, which reports the XYZ measured */
 static void do_scallout(disprd *p, double *xyz) {
@@ -452,7 +615,41 @@ static void do_scallout(disprd *p, double *xyz) {
 }
 #endif
 
+/* Compute the device values to display for a test patch, */
+/* applying any soft calibration. */
+/* (dispwin will apply any tvenc needed) */
+static void disprd_patch_rgb(disprd *p, double rgb[3], col *scb) {
+	rgb[0] = scb->r;
+	rgb[1] = scb->g;
+	rgb[2] = scb->b;
+
+	/* If we are doing a soft cal, apply it to the test color */
+	if ((p->native & 1) && p->cal[0][0] >= 0.0) {
+		int j;
+		double inputEnt_1 = (double)(p->ncal-1);
+
+		for (j = 0; j < 3; j++) {
+			unsigned int ix;
+			double val, w;
+			val = rgb[j] * inputEnt_1;
+			if (val < 0.0) {
+				val = 0.0;
+			} else if (val > inputEnt_1) {
+				val = inputEnt_1;
+			}
+			ix = (unsigned int)floor(val);		/* Coordinate */
+			if (ix > (p->ncal-2))
+				ix = (p->ncal-2);
+			w = val - (double)ix;		/* weight */
+			val = p->cal[j][ix];
+			rgb[j] = val + w * (p->cal[j][ix+1] - val);
+		}
+	}
+}
+
 /* Take a series of readings from the display - implementation */
+/* Each patch is displayed with the update delay deferred, so that the */
+/* next patch is prepared while the display settles. */
 /* Return nz on fail/abort - see dispsup.h */
 /* Use disprd_err() to interpret it */
 static int disprd_read_imp(
@@ -474,6 +671,8 @@ static int disprd_read_imp(
 	inst_calc_id_type idtype;
 	char id[CALIDLEN];
 	inst2_capability cap2;
+	inst3_capability cap3;
+	double rgb[3];	/* Device value of the next patch to display */
 
 	/* Setup the keyboard trigger to return our commands */
 	inst_set_uih(0x0, 0xff,  DUIH_TRIG);
@@ -485,7 +684,7 @@ static int disprd_read_imp(
 	/* Setup user termination character */
 	inst_set_uih(tc, tc, DUIH_TERM);
 
-	p->it->capabilities(p->it, NULL, &cap2, NULL);
+	p->it->capabilities(p->it, NULL, &cap2, &cap3);
 
 	/* See if we should calibrate the display update */
 	if (!p->update_delay_set && (cap2 & inst2_meas_disp_update) != 0) {
@@ -545,6 +744,10 @@ static int disprd_read_imp(
 		th->del(th);
 	}
 
+	/* See if we should measure the display settling times */
+	if (!p->settle_time_set && (cap3 & inst3_meas_disp_settle) != 0)
+		disprd_cal_settle(p);
+
 	/* See if we should do a frequency calibration or display integration time cal. first */
 	if (p->it->needs_calibration(p->it) & inst_calt_ref_freq
 	 && npat > 0
@@ -582,9 +785,11 @@ static int disprd_read_imp(
 		}
 	}
 
+	if (npat > 0)
+		disprd_patch_rgb(p, rgb, &cols[0]);
+
 	for (patch = 0; patch < npat; patch++) {
 		col *scb = &cols[patch];
-		double rgb[3];
 
 		scb->mtype = inst_mrt_none;
 		scb->XYZ_v = 0;		/* No readings are valid */
@@ -598,38 +803,24 @@ static int disprd_read_imp(
 		}
 		a1logd(p->log,1,"About to read patch %d\n",patch);
 
-		rgb[0] = scb->r;
-		rgb[1] = scb->g;
-		rgb[2] = scb->b;
-
-		/* If we are doing a soft cal, apply it to the test color */
-		/* (dispwin will apply any tvenc needed) */
-		if ((p->native & 1) && p->cal[0][0] >= 0.0) {
-			int j;
-			double inputEnt_1 = (double)(p->ncal-1);
-
-			for (j = 0; j < 3; j++) {
-				unsigned int ix;
-				double val, w;
-				val = rgb[j] * inputEnt_1;
-				if (val < 0.0) {
-					val = 0.0;
-				} else if (val > inputEnt_1) {
-					val = inputEnt_1;
-				}
-				ix = (unsigned int)floor(val);		/* Coordinate */
-				if (ix > (p->ncal-2))
-					ix = (p->ncal-2);
-				w = val - (double)ix;		/* weight */
-				val = p->cal[j][ix];
-				rgb[j] = val + w * (p->cal[j][ix+1] - val);
-			}
-		}
-		if ((rv = p->dw->set_color(p->dw, rgb[0], rgb[1], rgb[2])) != 0) {
+		/* Display the patch, but don't wait for the display to settle */
+		p->dw->defer_update_delay(p->dw, 1);
+		rv = p->dw->set_color(p->dw, rgb[0], rgb[1], rgb[2]);
+		p->dw->defer_update_delay(p->dw, 0);
+		if (rv != 0) {
 			a1logd(p->log,1,"set_color() returned %d\n",rv);
 			return 3;
 		}
 
+		/* While it settles, prepare the next patch's color */
+		if ((patch+1) < npat) {
+			disprd_patch_rgb(p, rgb, &cols[patch+1]);
+			if (p->dw->set_next_color != NULL)
+				p->dw->set_next_color(p->dw, rgb[0], rgb[1], rgb[2]);
+		}
+
+		p->dw->wait_update(p->dw);
+
 		/* Until we give up retrying */
 		for (;;) {
 			val.mtype = inst_mrt_none;
@@ -778,6 +969,57 @@ typedef struct {
 
 } dsamples;
 
+/* Adapt the drift measurement periods to the drift rate seen over */
+/* the last batch, so that the drift between b&w readings is about */
+/* DRIFT_TARGDE. We need the white to normalise the black DE. */
+static void disprd_adapt_drift(disprd *p, dsamples *dss, int ndrift) {
+	double mxrate = 0.0;	/* Maximum DE per patch */
+	double nY, iper;
+	int i, k, e;
+
+	if (!p->wdrift || !p->ref_bw_v || p->ref_bw[1].XYZ[1] <= 0.0)
+		return;
+	nY = p->ref_bw[1].XYZ[1];
+
+	for (i = 0; i < (ndrift-1); i++) {
+		if (dss[i].count <= 0)
+			continue;
+		for (k = p->bdrift ? 0 : 1; k < 2; k++) {
+			double xyz0[3], xyz1[3], de;
+
+			if (!dss[i].dcols[k].XYZ_v || !dss[i+1].dcols[k].XYZ_v)
+				continue;
+			for (e = 0; e < 3; e++) {
+				xyz0[e] = dss[i].dcols[k].XYZ[e]/nY;
+				xyz1[e] = dss[i+1].dcols[k].XYZ[e]/nY;
+			}
+			de = icmXYZLabDE(&icmD50, xyz0, xyz1);
+			if ((de/dss[i].count) > mxrate)
+				mxrate = de/dss[i].count;
+		}
+	}
+
+	if (mxrate > 1e-6)
+		iper = DRIFT_TARGDE/mxrate;
+	else
+		iper = DRIFT_MAXPERIOD;
+
+	/* Don't change too quickly, in case the batch was unrepresentative */
+	if (iper > 2.0 * p->dr_iperiod)
+		iper = 2.0 * p->dr_iperiod;
+	else if (iper < 0.5 * p->dr_iperiod)
+		iper = 0.5 * p->dr_iperiod;
+	if (iper < DRIFT_MINPERIOD)
+		iper = DRIFT_MINPERIOD;
+	else if (iper > DRIFT_MAXPERIOD)
+		iper = DRIFT_MAXPERIOD;
+
+	p->dr_iperiod = (int)(iper + 0.5);
+	p->dr_eperiod = p->dr_iperiod/2;
+
+	a1logd(p->log,2, "Drift rate %f DE/patch, drift period now %d\n",mxrate,p->dr_iperiod);
+}
+
 /* Take a series of readings from the display - drift compensation */
 /* Return nz on fail/abort - see dispsup.h */
 /* Use disprd_err() to interpret it */
@@ -796,7 +1038,7 @@ static int disprd_read_drift(
 	int off, poff;
 	int boff, eoff, dno;	/* b&w offsets and count */
 
-	DBG((dbgo,"DRIFT_EPERIOD %d, DRIFT_IPERIOD %d, npat %d\n",DRIFT_EPERIOD,DRIFT_IPERIOD,npat))
+	DBG((dbgo,"dr_eperiod %d, dr_iperiod %d, npat %d\n",p->dr_eperiod,p->dr_iperiod,npat))
 
 	/* Figure number and offset for b&w */
 	if (p->bdrift == 0) {			/* Must be just wdrift */
@@ -823,13 +1065,13 @@ static int disprd_read_drift(
 	/* or if we will use interpolation, read b&w */
 #ifdef DEBUG
 	DBG((dbgo,"last_bw_v = %d (%d)\n",p->last_bw_v,p->last_bw_v == 0))
-	DBG((dbgo,"npat = %d > %d, serno %d, last serno %d (%d)\n",npat, DRIFT_EPERIOD, p->serno,p->last_bw[eoff].serno,(npat > DRIFT_EPERIOD && p->serno > p->last_bw[eoff].serno)))
-	DBG((dbgo,"serno - lastserno %d > %d (%d)\n",p->serno - p->last_bw[eoff].serno, DRIFT_EPERIOD,(p->serno - p->last_bw[eoff].serno) > DRIFT_EPERIOD))
+	DBG((dbgo,"npat = %d > %d, serno %d, last serno %d (%d)\n",npat, p->dr_eperiod, p->serno,p->last_bw[eoff].serno,(npat > p->dr_eperiod && p->serno > p->last_bw[eoff].serno)))
+	DBG((dbgo,"serno - lastserno %d > %d (%d)\n",p->serno - p->last_bw[eoff].serno, p->dr_eperiod,(p->serno - p->last_bw[eoff].serno) > p->dr_eperiod))
 	DBG((dbgo,"msec %d - last %d = %d > %d (%d)\n",msec_time(),p->last_bw[boff].msec,msec_time() - p->last_bw[boff].msec,DRIFT_MAXSECS * 1000, (msec_time() - p->last_bw[eoff].msec) > (DRIFT_MAXSECS * 1000)))
 #endif /* DEBUG */
 	if (p->last_bw_v == 0											/* There are none */
-	 || (npat > DRIFT_EPERIOD && p->serno > p->last_bw[eoff].serno)	/* We will interpolate */
-	 || (p->serno - p->last_bw[eoff].serno - dno) > DRIFT_EPERIOD	/* extrapolate would be too far */
+	 || (npat > p->dr_eperiod && p->serno > p->last_bw[eoff].serno)	/* We will interpolate */
+	 || (p->serno - p->last_bw[eoff].serno - dno) > p->dr_eperiod	/* extrapolate would be too far */
 	 || (msec_time() - p->last_bw[eoff].msec) > (DRIFT_MAXSECS * 1000)) {	/* The current is too long ago */
 
 		DBG((dbgo,"Reading a beginning set of %d b/w drift compensation patches\n",dno))
@@ -850,12 +1092,12 @@ static int disprd_read_drift(
 	}
 
 	/* If there are enough patches to bracket with drift readings */ 
-	if (npat > DRIFT_EPERIOD) {
+	if (npat > p->dr_eperiod) {
 		int ndrift = 2;			/* Number of drift records */
 		dsamples *dss;
 
 		/* Figure out the number of drift samples we need */
-		ndrift += (npat-1)/DRIFT_IPERIOD;
+		ndrift += (npat-1)/p->dr_iperiod;
 		DBG((dbgo,"spat %d, npat = %d, tpat %d, ndrift = %d\n",spat,npat,tpat,ndrift))
 
 		if ((dss = (dsamples *)calloc(sizeof(dsamples), ndrift)) == NULL) {
@@ -920,6 +1162,9 @@ static int disprd_read_drift(
 		p->last_bw[1] = dss[i].dcols[1];
 		p->last_bw_v = 1;
 
+		/* Adjust how often we read drift to suite the drift rate */
+		disprd_adapt_drift(p, dss, ndrift);
+
 		/* Set the white drift target to be the last one for batch */
 		p->targ_w = p->last_bw[1];
 		p->targ_w_v = 1;
@@ -1166,6 +1411,91 @@ static void disprd_change_drift_comp(disprd *p,
 	}
 }
 
+/* Wait for the display to warm up, by reading white every */
+/* WARMUP_INTERVAL seconds until it changes by less than thresh */
+/* DE per minute for WARMUP_NSTABLE intervals in a row, */
+/* or maxmins minutes have passed. */
+/* Return nz on fail/abort - see dispsup.h */
+/* Use disprd_err() to interpret it */
+static int disprd_warm_up(
+	disprd *p,
+	double thresh,		/* DE per minute, 0.0 for default */
+	double maxmins,		/* Maximum minutes to wait, 0.0 for default */
+	int tc				/* If nz, termination key */
+) {
+	col wc[2];			/* Last and current white */
+	unsigned int stime;
+	int rv, i, e, ww = 0, nstable = 0;
+
+	if (thresh <= 0.0)
+		thresh = WARMUP_DERATE;
+	if (maxmins <= 0.0)
+		maxmins = WARMUP_MAXMINS;
+
+	memset(wc, 0, sizeof(col) * 2);
+	for (i = 0; i < 2; i++)
+		wc[i].r = wc[i].g = wc[i].b = 1.0;
+
+	a1logv(p->log, 1, "Waiting for the display to warm up (hit Esc or Q to give up)\n");
+	stime = msec_time();
+
+	if ((rv = disprd_read_imp(p, &wc[ww], 1, 0, 0, 0, 1, tc, 0)) != 0)
+		return rv;
+
+	for (;;) {
+		double xyz0[3], xyz1[3], de, rate;
+		int ch;
+
+		/* Wait, while allowing the user to give up */
+		for (i = 0; i < (WARMUP_INTERVAL * 5); i++) {
+			msec_sleep(200);
+			if ((ch = poll_con_char()) != 0) {
+				if (ch == 0x1b || ch == 0x3 || ch == 'q' || ch == 'Q')
+					return 1;
+				if (tc != 0 && ch == tc)
+					return 4;
+			}
+		}
+
+		ww ^= 1;
+		if ((rv = disprd_read_imp(p, &wc[ww], 1, 0, 0, 0, 1, tc, 0)) != 0)
+			return rv;
+
+		if (wc[0].XYZ_v == 0 || wc[1].XYZ_v == 0 || wc[ww ^ 1].XYZ[1] <= 0.0)
+			return 2;
+
+		for (e = 0; e < 3; e++) {
+			xyz0[e] = wc[ww ^ 1].XYZ[e]/wc[ww ^ 1].XYZ[1];
+			xyz1[e] = wc[ww].XYZ[e]/wc[ww ^ 1].XYZ[1];
+		}
+		de = icmXYZLabDE(&icmD50, xyz0, xyz1);
+		rate = de * 60000.0/(double)(wc[ww].msec - wc[ww ^ 1].msec);
+
+		a1logv(p->log, 1, "After %.1f minutes white is changing by %.3f DE/minute\n",
+		                  (msec_time() - stime)/60000.0, rate);
+
+		if (rate <= thresh) {
+			if (++nstable >= WARMUP_NSTABLE)
+				break;
+		} else {
+			nstable = 0;
+		}
+
+		if ((msec_time() - stime) > (unsigned int)(maxmins * 60000.0)) {
+			a1logv(p->log, 1, "Gave up waiting for display to warm up\n");
+			return 0;
+		}
+	}
+	a1logv(p->log, 1, "Display has warmed up\n");
+
+	/* Any existing drift readings are now stale */
+	p->ref_bw_v = 0;
+	p->last_bw_v = 0;
+	p->targ_w_v = 0;
+
+	return 0;
+}
+
 /* Take a series of readings from the display */
 /* Return nz on fail/abort - see dispsup.h */
 /* Use disprd_err() to interpret it */
@@ -2093,6 +2423,79 @@ static int disprd_fake_read_manual(disprd *p,
 	return 0;
 }
 
+/* Return an allocated array giving the order in which to read the */
+/* npat patches, so as to reduce the total predicted display settling */
+/* time. This is a nearest neighbour tour using the settling time model */
+/* and the current test window settling parameters, starting from the */
+/* color currently displayed. Return NULL on malloc failure. */
+int *disprd_settle_order(disprd *p, col *cols, int npat) {
+	int i, j, k, bj;
+	int *order;
+	char *used;
+	double (*rgbl)[3], (*tol)[3];
+	double crgbl[3], ctol[3], rgb[3];
+	double rise, fall;
+
+	if ((order = (int *)malloc(sizeof(int) * npat)) == NULL)
+		return NULL;
+
+	/* No display to settle (i.e. fake), so keep the original order */
+	if (p->dw == NULL) {
+		for (i = 0; i < npat; i++)
+			order[i] = i;
+		return order;
+	}
+
+	used = (char *)calloc(npat, sizeof(char));
+	rgbl = (double (*)[3])malloc(sizeof(double) * 3 * npat);
+	tol = (double (*)[3])malloc(sizeof(double) * 3 * npat);
+	if (used == NULL || rgbl == NULL || tol == NULL) {
+		free(order);
+		free(used);
+		free(rgbl);
+		free(tol);
+		return NULL;
+	}
+
+	rise = p->dw->rise_time * p->dw->settle_mult;
+	fall = p->dw->fall_time * p->dw->settle_mult;
+
+	/* Precompute the displayed linear light values and tolerances */
+	for (i = 0; i < npat; i++) {
+		disprd_patch_rgb(p, rgb, &cols[i]);
+		disp_settle_prep(rgbl[i], tol[i], rgb, p->dw->de_aim);
+	}
+	disp_settle_prep(crgbl, ctol, p->dw->rgb, p->dw->de_aim);
+
+	for (k = 0; k < npat; k++) {
+		double bcost = 1e300;
+
+		/* Pick the patch with the least settling time from the current one, */
+		/* breaking ties with the smallest change. */
+		for (bj = -1, j = 0; j < npat; j++) {
+			double cost;
+			if (used[j])
+				continue;
+			cost = disp_settle_time_p(crgbl, rgbl[j], tol[j], rise, fall)
+			     + 1e-6 * (fabs(rgbl[j][0] - crgbl[0]) + fabs(rgbl[j][1] - crgbl[1])
+			             + fabs(rgbl[j][2] - crgbl[2]));
+			if (cost < bcost) {
+				bcost = cost;
+				bj = j;
+			}
+		}
+		order[k] = bj;
+		used[bj] = 1;
+		icmCpy3(crgbl, rgbl[bj]);
+	}
+
+	free(used);
+	free(rgbl);
+	free(tol);
+
+	return order;
+}
+
 /* Return a string describing the error code */
 char *disprd_err(int en) {
 	switch(en) {
@@ -2370,6 +2773,15 @@ static int config_inst_displ(disprd *p) {
 		}
 	}
 
+	/* Adaptive dark measurement speed/accuracy trade-off */
+	if (p->adspeed > 0.0) {
+		if ((rv = p->it->get_set_opt(p->it, inst_opt_set_adapt_speed, p->adspeed)) != inst_ok) {
+			a1logd(p->log,1,"Setting adaptive speed failed with '%s' (%s)\n",
+		       p->it->inst_interp_error(p->it, rv), p->it->interp_error(p->it, rv));
+			a1logv(p->log, 1, "Adaptive speed ignored - instrument doesn't support it\n");
+		}
+	}
+
 	/* Set the trigger mode to program triggered */
 	if ((rv = p->it->get_set_opt(p->it,inst_opt_trig_prog)) != inst_ok) {
 		a1logd(p->log,1,"Setting program trigger mode failed failed with '%s' (%s)\n",
@@ -2402,6 +2814,7 @@ int noinitcal,		/* No initial instrument calibration */
 int noinitplace,	/* Don't wait for user to place instrument on screen */
 int highres,		/* Use high res mode if available */
 double refrate,		/* If != 0.0, set display refresh rate calibration */
+double adspeed,		/* If != 0.0, adaptive dark measurement speed/accuracy factor */
 int native,			/* X0 = use current per channel calibration curve */
 					/* X1 = set native linear output and use ramdac high precn. */
 					/* 0X = use current color management cLut (MadVR) */
@@ -2461,6 +2874,7 @@ a1log *log      	/* Verb, debug & error log */
 	p->get_disptype = disprd_get_disptype;
 	p->reset_targ_w = disprd_reset_targ_w;
 	p->change_drift_comp = disprd_change_drift_comp;
+	p->warm_up = disprd_warm_up;
 	p->meas_ambient = disprd_ambient;
 	p->fake_name = fake_name;
 
@@ -2474,6 +2888,8 @@ a1log *log      	/* Verb, debug & error log */
 	p->custObserver = custObserver;
 	p->bdrift = bdrift;
 	p->wdrift = wdrift;
+	p->dr_iperiod = DRIFT_IPERIOD;
+	p->dr_eperiod = DRIFT_EPERIOD;
 	p->ditype = ditype;
 	p->sditype = sditype;
 	p->docbid = docbid;
@@ -2488,6 +2904,7 @@ a1log *log      	/* Verb, debug & error log */
 	p->noinitplace = noinitplace;
 	p->highres = highres;
 	p->refrate = refrate;
+	p->adspeed = adspeed;
 	if (mcallout != NULL || xtern != 0)
 		ipath = &icomFakeDevice;	/* Force fake device */
 	p->mcallout = mcallout;
@@ -129,7 +129,9 @@ struct _disprd {
 	int nadaptive;		/* NZ for non-adaptive mode */
 	int highres;		/* Use high res mode if available */
 	double refrate;		/* If != 0.0, set display refresh rate calibration */
+	double adspeed;		/* If != 0.0, adaptive dark measurement speed/accuracy factor */
 	int update_delay_set;	/* NZ if we've calibrated the disp. update delay, or tried and failed */
+	int settle_time_set;	/* NZ if we've measured the disp. settling times, or tried and failed */
 	disptech cc_dtech;	/* Display tech used with ccmtx or sets */
 	int cc_cbid;		/* cbid to be used with ccmtx * or sets */
 	double (*ccmtx)[3];	/* Colorimeter Correction Matrix, NULL if none */
@@ -142,6 +144,8 @@ struct _disprd {
 	xsp2cie *sp2cie;	/* Spectral to XYZ conversion */
 	int bdrift;			/* Flag, nz for black drift compensation */
 	int wdrift;			/* Flag, nz for white drift compensation */
+	int dr_iperiod;		/* Current patches between drift interpolation measurements */
+	int dr_eperiod;		/* Current patches between drift extrapolation measurements */
 	int noinitcal;		/* No initial instrument calibration */
 	int noinitplace;	/* Don't wait for user to place instrument on screen */
 	dispwin *dw;		/* Window */
@@ -193,6 +197,16 @@ struct _disprd {
 		int wdrift			/* Flag, nz for white drift compensation */
 	);
 
+	/* Wait for the display to warm up, by taking a white reading */
+	/* periodically until its rate of change falls below thresh */
+	/* DE per minute. Returns after maxmins minutes regardless. */
+	/* return nz on fail/abort, as for read() */
+	int (*warm_up)(struct _disprd *p,
+		double thresh,		/* DE per minute, 0.0 for default */
+		double maxmins,		/* Maximum minutes to wait, 0.0 for default */
+		int tc				/* If nz, termination key */
+	);
+
 	/* Take an ambient reading if the instrument has the capability. */
 	/* return nz on fail/abort */
 	/* 1 = user aborted */
@@ -243,6 +257,7 @@ int noinitcal,		/* No initial instrument calibration */
 int noinitplace,	/* Don't wait for user to place instrument on screen */
 int highres,		/* Use high res mode if available */
 double refrate,		/* If != 0.0, set display refresh rate calibration */
+double adspeed,		/* If != 0.0, adaptive dark measurement speed/accuracy factor */
 int native,			/* X0 = use current per channel calibration curve */
 					/* X1 = set native linear output and use ramdac high precn. */
 					/* 0X = use current color management cLut (MadVR) */
@@ -286,6 +301,11 @@ a1log *log			/* Verb, debug & error log */
 /* Return a string describing the error code */
 char * disprd_err(int en);
 
+/* Return an allocated array giving the order in which to read the */
+/* npat patches, so as to reduce the total predicted display settling */
+/* time. Return NULL on malloc failure. */
+int *disprd_settle_order(disprd *p, col *cols, int npat);
+
 #define DISPSUP_H
 #endif /* DISPSUP_H */
 
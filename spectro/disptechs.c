@@ -843,7 +843,41 @@ printf("chk drgb = %f %f %f\n", xdrgb[0], xdrgb[1], xdrgb[2]);
 	return xtime;
 }
 
+/* Precompute the linear light RGB and settling tolerances of a destination color, */
+/* for evaluating the settling time to it from many colors. */
+void disp_settle_prep(double nrgbl[3], double ntol[3], double *nrgb, double dE) {
+	double drgb[3];
+	int j;
 
+	rgb2rgbl(nrgbl, nrgb);
+	drgbl2lab(drgb, nrgbl);
+	for (j = 0; j < 3; j++)
+		ntol[j] = dE/drgb[j];
+}
 
+/* Same as disp_settle_time(), given linear light RGB and the */
+/* destination values from disp_settle_prep() */
+double disp_settle_time_p(double *orgbl, double *nrgbl, double *ntol, double rise, double fall) {
+	int j;
+	double kr, kf;
+	double xtime = 0.0;
 
+	kr = rise/log(1.0 - 0.9);	/* Exponent constant for 90% change*/
+	kf = fall/log(1.0 - 0.9);	/* Exponent constant for 90% change*/
+
+	for (j = 0; j < 3; j++) {
+		double dl, t;
+
+		/* Already within tolerance */
+		if ((dl = fabs(nrgbl[j] - orgbl[j])) <= ntol[j])
+			continue;
+
+		t = (nrgbl[j] > orgbl[j] ? kr : kf) * log(ntol[j]/dl);
+
+		if (t > xtime && t < 5.0)
+			xtime = t;
+	}
+
+	return xtime;
+}
 
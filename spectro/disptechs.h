@@ -158,6 +158,14 @@ void disptechs_set_sel(int flag, int ix, char *osel, char *isel, char *usels, in
 
 double disp_settle_time(double *orgb, double *nrgb, double rise, double fall, double dE);
 
+/* Precompute the linear light RGB and settling tolerances of a destination color, */
+/* for evaluating the settling time to it from many colors. */
+void disp_settle_prep(double nrgbl[3], double ntol[3], double *nrgb, double dE);
+
+/* Same as disp_settle_time(), given linear light RGB and the */
+/* destination values from disp_settle_prep() */
+double disp_settle_time_p(double *orgbl, double *nrgbl, double *ntol, double rise, double fall);
+
 
 #define DISPTYPES_H
 #endif /* DISPTYPES_H */
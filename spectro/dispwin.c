@@ -272,6 +272,9 @@ static BOOL CALLBACK MonitorEnumProc(
 
 BOOL (WINAPI* pEnumDisplayDevices)(PVOID,DWORD,PVOID,DWORD) = NULL;
 
+/* Vista+ DWM call used to wait for a patch change to be composited */
+HRESULT (WINAPI* pDwmFlush)(void) = NULL;
+
 #if !defined(NTDDI_LONGHORN) || NTDDI_VERSION < NTDDI_LONGHORN
 
 typedef enum {
@@ -303,6 +306,12 @@ static int setup_dyn_calls() {
 		pWcsDisassociateColorProfileFromDevice = (BOOL (WINAPI*)(WCS_PROFILE_MANAGEMENT_SCOPE,PCWSTR,PCWSTR)) GetProcAddress(LoadLibrary("mscms"), "WcsDisassociateColorProfileFromDevice");
 		/* These are checked individually */
 #endif  /* NTDDI_VERSION < NTDDI_LONGHORN */
+		{
+			HMODULE hdwm;
+			if ((hdwm = LoadLibrary("dwmapi")) != NULL)
+				pDwmFlush = (HRESULT (WINAPI*)(void)) GetProcAddress(hdwm, "DwmFlush");
+			/* This is checked individually */
+		}
 	}
 
 	return dyn_inited;
@@ -4175,6 +4184,19 @@ double r, double g, double b	/* Color values 0.0 - 1.0 */
 			msec_sleep(10);
 		}
 
+		/* If the desktop is being composited, the paint won't reach the */
+		/* screen until the DWM composes its next frame, which it does in step */
+		/* with the vertical blank. DwmFlush() returns once that has happened, */
+		/* so we know when the patch is actually presented, and can count the */
+		/* update delay from there rather than guessing. (DwmFlush() fails */
+		/* immediately if composition is off, in which case the paint */
+		/* went straight to the frame buffer.) */
+		setup_dyn_calls();
+		if (pDwmFlush != NULL && pDwmFlush() == S_OK) {
+			dispwin_presented(p, msec_time());
+			debugr2((errout,"dispwin_set_color DwmFlush done\n"));
+		}
+
 		debugr2((errout,"dispwin_set_color paint done\n"));
 	}
 #endif /* NT */
@@ -4294,7 +4316,7 @@ double r, double g, double b	/* Color values 0.0 - 1.0 */
 	/* or LCD processing/update time, + display settling time (quite long for */
 	/* smaller LCD changes), and any instrument reaction time. */
 	debugr2((errout, "dispwin_set_color delaying %d msec\n",update_delay));
-	msec_sleep(update_delay);
+	dispwin_update_sleep(p, update_delay);
 
 	if (p->cberror) {	/* Callback routine failed */
 		return 1;
@@ -4338,6 +4360,61 @@ void dispwin_enable_update_delay(dispwin *p, int enable) {
 	p->do_update_del = enable;
 }
 
+/* Defer the update delay, so that set_color() returns without waiting for it, */
+/* and wait_update() does the wait. */
+void dispwin_defer_update_delay(dispwin *p, int defer) {
+	p->defer_update_del = defer;
+}
+
+/* Wait until any deferred update delay is over */
+void dispwin_wait_update(dispwin *p) {
+	int left;
+
+	if (p->update_due != 0) {
+		if ((left = (int)(p->update_due - msec_time())) > 0)
+			msec_sleep(left);
+		p->update_due = 0;
+	}
+}
+
+/* Note the msec_time() at which the display target reported that */
+/* the current patch was (or will be) presented. Remote targets call */
+/* this from set_color() so that the update delay is counted from */
+/* that point, rather than from when set_color() returns. */
+void dispwin_presented(dispwin *p, unsigned int ptime) {
+	if ((p->present_time = ptime) == 0)
+		p->present_time = 1;
+}
+
+/* Do the update delay after a set_color(), or note when */
+/* it will be over if it is being deferred. */
+void dispwin_update_sleep(dispwin *p, int update_delay) {
+	unsigned int now = msec_time();
+	unsigned int due = now + update_delay;
+	int left;
+
+	/* Count the delay from the reported presentation time. */
+	/* Don't let it start further back than the delay itself. */
+	if (p->present_time != 0) {
+		left = (int)(p->present_time - now);
+		if (left < -update_delay)
+			left = -update_delay;
+		due += left;
+		if (p->ddebug) fprintf(stderr,"dispwin: patch presented %d msec %s set_color() return\n",
+		                       left < 0 ? -left : left, left < 0 ? "before" : "after");
+		p->present_time = 0;
+	}
+
+	if (p->defer_update_del) {
+		if ((p->update_due = due) == 0)
+			p->update_due = 1;
+		return;
+	}
+	p->update_due = 0;
+	if ((left = (int)(due - now)) > 0)
+		msec_sleep(left);
+}
+
 /* Return the update delay we should use (msec) */
 int dispwin_compute_delay(dispwin *p, double *orgb) {
 	int update_delay = 0, disp_settle = 0;
@@ -4839,6 +4916,8 @@ int ddebug						/* >0 to print debug statements to stderr */
 	p->set_update_delay    = dispwin_set_update_delay;
 	p->set_settling_delay  = dispwin_set_settling_delay;
 	p->enable_update_delay = dispwin_enable_update_delay;
+	p->defer_update_delay  = dispwin_defer_update_delay;
+	p->wait_update         = dispwin_wait_update;
 	p->set_callout         = dispwin_set_callout;
 	p->del                 = dispwin_del;
 
@@ -5912,6 +5991,142 @@ int ddebug						/* >0 to print debug statements to stderr */
 /* ================================================================ */
 #if defined(UNIX_X11)
 
+/* Per display state for x11_load_displays() */
+typedef struct {
+	disppath *dp;		/* Display */
+	dispwin *dw;		/* Access to it, NULL if failed */
+	ramdac *r;			/* Current VideoLUT, then the one to load */
+	icmFile *rd_fp;		/* Installed profile */
+	char *emes;			/* Reason it failed, NULL if not */
+	int same;			/* NZ if the VideoLUT already has the calibration */
+} x11_ldisp;
+
+/* Compute the VideoLUT values from the installed profiles, */
+/* for displays i0 .. i1-1. */
+static int x11_ld_vcgt(void *cntx, int i0, int i1, int thix) {
+	x11_ldisp *ld = (x11_ldisp *)cntx;
+	int i, j, k;
+
+	for (i = i0; i < i1; i++) {
+		ramdac *r = ld[i].r;
+		icc *icco;
+		icmVideoCardGamma *wo;
+		double iv, vv[3];
+
+		if (ld[i].emes != NULL)
+			continue;
+
+		if ((icco = new_icc()) == NULL) {
+			ld[i].emes = "Failed to create profile object";
+			continue;
+		}
+
+		/* Read header etc. */
+		if (icco->read(icco, ld[i].rd_fp,0) != 0) {
+			ld[i].emes = "Failed to read profile";
+			icco->del(icco);
+			continue;
+		}
+
+		if ((wo = (icmVideoCardGamma *)icco->read_tag(icco, icSigVideoCardGammaTag)) != NULL
+		 && wo->u.table.channels != 3 && wo->u.table.channels != 1) {
+			ld[i].emes = "vcgt tag is unrecognized in profile";
+			icco->del(icco);
+			continue;
+		}
+
+		/* Set the VideoLUT values, noting whether any of them */
+		/* differ from the current contents by more than a quantization step. */
+		ld[i].same = 1;
+		for (j = 0; j < r->nent; j++) {
+			iv = j/(r->nent-1.0);
+			if (wo == NULL) {			/* Linear */
+				vv[0] = vv[1] = vv[2] = iv;
+			} else if (wo->u.table.channels == 3) {
+				vv[0] = wo->lookup(wo, 0, iv);
+				vv[1] = wo->lookup(wo, 1, iv);
+				vv[2] = wo->lookup(wo, 2, iv);
+			} else {
+				vv[0] = vv[1] = vv[2] = wo->lookup(wo, 0, iv);
+			}
+			for (k = 0; k < 3; k++) {
+				if (fabs(r->v[k][j] - vv[k]) > (0.5/65535.0))
+					ld[i].same = 0;
+				r->v[k][j] = vv[k];
+			}
+		}
+		icco->del(icco);
+	}
+	return 0;
+}
+
+/* Load the installed profile calibrations into the VideoLUTs */
+/* of all the given displays. The profiles are read and converted */
+/* in parallel, and a VideoLUT is only set if it doesn't already */
+/* hold the calibration. */
+static void x11_load_displays(disppath **dp, char *dnbuf, int verb, int ddebug) {
+	x11_ldisp *ld;
+	char calname[MAXNAMEL+1] = "\000";	/* Calibration file name */
+	int i, n;
+
+	for (n = 0; dp[n] != NULL; n++)
+		;
+
+	if ((ld = (x11_ldisp *)calloc(n, sizeof(x11_ldisp))) == NULL) {
+		if (verb) printf("Malloc of %d displays failed\n",n);
+		return;
+	}
+
+	/* Access each display and its installed profile */
+	for (i = 0; i < n; i++) {
+		ld[i].dp = dp[i];
+		if ((ld[i].dw = new_dispwin(dp[i], 0.0, 0.0, 0.0, 0.0, 1, 0, NULL, NULL, 0, 0, 0, ddebug)) == NULL) {
+			ld[i].emes = "Failed to access";
+			continue;
+		}
+		if ((ld[i].r = ld[i].dw->get_ramdac(ld[i].dw)) == NULL) {
+			ld[i].emes = "Failed to access VideoLUT of";
+			continue;
+		}
+
+		/* Grab the installed profile from the ucmm */
+		/* (Sets the X11 atom too) */
+		if ((ld[i].rd_fp = ld[i].dw->get_profile(ld[i].dw, calname, MAXNAMEL)) == NULL) {
+			ld[i].emes = "Failed to find profile of";
+			continue;
+		}
+	}
+
+	/* Convert the profiles to VideoLUT values */
+	par_for(0, 0, n, 1, x11_ld_vcgt, (void *)ld);
+
+	/* Load the VideoLUTs that need it */
+	for (i = 0; i < n; i++) {
+		if (verb) printf("Updating display %d = '%s'\n",i+1,dp[i]->description);
+
+		if (ld[i].emes != NULL) {
+			if (verb) printf("%s screen %d for display '%s'\n",ld[i].emes,i+1,dnbuf);
+
+		} else if (ld[i].same) {
+			if (verb) printf("Calibration for screen %d for display '%s' is already loaded\n",i+1,dnbuf);
+
+		} else if (ld[i].dw->set_ramdac(ld[i].dw,ld[i].r,1) != 0) {
+			if (verb) printf("Unable to set vcgt tag for screen %d for display '%s'\n",i+1,dnbuf);
+
+		} else {
+			if (verb) printf("Loaded profile and calibration for screen %d for display '%s'\n",i+1,dnbuf);
+		}
+
+		if (ld[i].rd_fp != NULL)
+			ld[i].rd_fp->del(ld[i].rd_fp);
+		if (ld[i].r != NULL)
+			ld[i].r->del(ld[i].r);
+		if (ld[i].dw != NULL)
+			ld[i].dw->del(ld[i].dw);
+	}
+	free(ld);
+}
+
 /* Set the X11 atom and load the appropriate calibrations for all */
 /* the displays. */
 int x11_load_all(disppath *disp, int verb, int ddebug) {
@@ -5919,7 +6134,6 @@ int x11_load_all(disppath *disp, int verb, int ddebug) {
 	Display *mydisplay;
 	char *pp;
 	disppath **dp;
-	ramdac *r = NULL;
 
 	/* Open the base display */
 	strncpy(dnbuf,disp->name,99); dnbuf[99] = '\000';
@@ -5947,105 +6161,8 @@ int x11_load_all(disppath *disp, int verb, int ddebug) {
 	if (dp == NULL || dp[0] == NULL) {
 		if (verb) printf("Failed to enumerate all the screens for display '%s'\n",dnbuf);
 		return 1;
-	} else {
-		int i, j;
-		dispwin *dw;
-		char calname[MAXNAMEL+1] = "\000";	/* Calibration file name */
-		icmFile *rd_fp = NULL;
-		icc *icco = NULL;
-		icmVideoCardGamma *wo;
-		double iv;
-
-		for (i = 0; ; i++) {
-			if (dp[i] == NULL)
-				break;
-			if (verb) printf("Updating display %d = '%s'\n",i+1,dp[i]->description);
-
-			if ((dw = new_dispwin(dp[i], 0.0, 0.0, 0.0, 0.0, 1, 0, NULL, NULL, 0, 0, 0, ddebug)) == NULL) {
-				if (verb) printf("Failed to access screen %d of display '%s'\n",i+1,dnbuf);
-				continue;
-			}
-			if ((r = dw->get_ramdac(dw)) == NULL) {
-				if (verb) printf("Failed to access VideoLUT of screen %d for display '%s'\n",i+1,dnbuf);
-				dw->del(dw);
-				continue;
-			}
-
-			/* Grab the installed profile from the ucmm */
-			/* (Sets the X11 atom too) */
-			if ((rd_fp = dw->get_profile(dw, calname, MAXNAMEL)) == NULL) {
-				if (verb) printf("Failed to find profile of screen %d for display '%s'\n",i+1,dnbuf);
-				r->del(r);
-				dw->del(dw);
-				continue;
-			}
-
-			if ((icco = new_icc()) == NULL) {
-				if (verb) printf("Failed to create profile object for screen %d for display '%s'\n",i+1,dnbuf);
-				rd_fp->del(rd_fp);
-				r->del(r);
-				dw->del(dw);
-				continue;
-			}
-
-			/* Read header etc. */
-			if (icco->read(icco, rd_fp,0) != 0) {		/* Read ICC OK */
-				if (verb) printf("Failed to read profile for screen %d for display '%s'\n",i+1,dnbuf);
-				icco->del(icco);
-				rd_fp->del(rd_fp);
-				r->del(r);
-				dw->del(dw);
-				continue;
-			}
-
-			if ((wo = (icmVideoCardGamma *)icco->read_tag(icco, icSigVideoCardGammaTag)) == NULL) {
-				if (verb) printf("Failed to find vcgt tagd in profile for screen %d for display '%s' so setting linear\n",i+1,dnbuf);
-				for (j = 0; j < r->nent; j++) {
-					iv = j/(r->nent-1.0);
-					r->v[0][j] = iv;
-					r->v[1][j] = iv;
-					r->v[2][j] = iv;
-				}
-			} else {
-				if (wo->u.table.channels == 3) {
-					for (j = 0; j < r->nent; j++) {
-						iv = j/(r->nent-1.0);
-						r->v[0][j] = wo->lookup(wo, 0, iv);
-						r->v[1][j] = wo->lookup(wo, 1, iv);
-						r->v[2][j] = wo->lookup(wo, 2, iv);
-					}
-				} else if (wo->u.table.channels == 1) {
-					for (j = 0; j < r->nent; j++) {
-						iv = j/(r->nent-1.0);
-						r->v[0][j] = 
-						r->v[1][j] = 
-						r->v[2][j] = wo->lookup(wo, 0, iv);
-					}
-					debug("Got monochrome vcgt calibration\n");
-				} else {
-					if (verb) printf("vcgt tag is unrecognized in profile for screen %d for display '%s'\n",i+1,dnbuf);
-					icco->del(icco);
-					rd_fp->del(rd_fp);
-					r->del(r);
-					dw->del(dw);
-					continue;
-				}
-			}
-			if (dw->set_ramdac(dw,r,1) != 0) {
-				if (verb) printf("Unable to set vcgt tag for screen %d for display '%s'\n",i+1,dnbuf);
-				icco->del(icco);
-				rd_fp->del(rd_fp);
-				r->del(r);
-				dw->del(dw);
-				continue;
-			}
-			if (verb) printf("Loaded profile and calibration for screen %d for display '%s'\n",i+1,dnbuf);
-			icco->del(icco);
-			rd_fp->del(rd_fp);
-			r->del(r);
-			dw->del(dw);
-		}
 	}
+	x11_load_displays(dp, dnbuf, verb, ddebug);
 	free_disppaths(dp);
 	XCloseDisplay(mydisplay);
 
@@ -6167,7 +6284,6 @@ int x11_daemon_mode(disppath *disp, int verb, int ddebug) {
 
 			if (update_profiles) {
 				disppath **dp;
-				ramdac *r = NULL;
 
 				if (verb) printf("Updating profiles for display '%s'\n",dnbuf);
 
@@ -6175,104 +6291,8 @@ int x11_daemon_mode(disppath *disp, int verb, int ddebug) {
 				if (dp == NULL || dp[0] == NULL) {
 					if (verb) printf("Failed to enumerate all the screens for display '%s'\n",dnbuf);
 						continue;
-				} else {
-					int i, j;
-					dispwin *dw;
-					char calname[MAXNAMEL+1] = "\000";	/* Calibration file name */
-					icmFile *rd_fp = NULL;
-					icc *icco = NULL;
-					icmVideoCardGamma *wo;
-					double iv;
-
-					for (i = 0; ; i++) {
-						if (dp[i] == NULL)
-							break;
-						if (verb) printf("Updating display %d = '%s'\n",i+1,dp[i]->description);
-		
-						if ((dw = new_dispwin(dp[i], 0.0, 0.0, 0.0, 0.0, 1, 0, NULL, NULL, 0, 0, 0, ddebug)) == NULL) {
-							if (verb) printf("Failed to access screen %d of display '%s'\n",i+1,dnbuf);
-							continue;
-						}
-						if ((r = dw->get_ramdac(dw)) == NULL) {
-							if (verb) printf("Failed to access VideoLUT of screen %d for display '%s'\n",i+1,dnbuf);
-							dw->del(dw);
-							continue;
-						}
-
-						/* Grab the installed profile from the ucmm */
-						if ((rd_fp = dw->get_profile(dw, calname, MAXNAMEL)) == NULL) {
-							if (verb) printf("Failed to find profile of screen %d for display '%s'\n",i+1,dnbuf);
-							r->del(r);
-							dw->del(dw);
-							continue;
-						}
-
-						if ((icco = new_icc()) == NULL) {
-							if (verb) printf("Failed to create profile object for screen %d for display '%s'\n",i+1,dnbuf);
-							rd_fp->del(rd_fp);
-							r->del(r);
-							dw->del(dw);
-							continue;
-						}
-
-						/* Read header etc. */
-						if (icco->read(icco, rd_fp,0) != 0) {		/* Read ICC OK */
-							if (verb) printf("Failed to read profile for screen %d for display '%s'\n",i+1,dnbuf);
-							icco->del(icco);
-							rd_fp->del(rd_fp);
-							r->del(r);
-							dw->del(dw);
-							continue;
-						}
-
-						if ((wo = (icmVideoCardGamma *)icco->read_tag(icco, icSigVideoCardGammaTag)) == NULL) {
-							if (verb) printf("Failed to find vcgt tagd in profile for screen %d for display '%s' so setting linear\n",i+1,dnbuf);
-							for (j = 0; j < r->nent; j++) {
-								iv = j/(r->nent-1.0);
-								r->v[0][j] = iv;
-								r->v[1][j] = iv;
-								r->v[2][j] = iv;
-							}
-						} else {
-							if (wo->u.table.channels == 3) {
-								for (j = 0; j < r->nent; j++) {
-									iv = j/(r->nent-1.0);
-									r->v[0][j] = wo->lookup(wo, 0, iv);
-									r->v[1][j] = wo->lookup(wo, 1, iv);
-									r->v[2][j] = wo->lookup(wo, 2, iv);
-								}
-							} else if (wo->u.table.channels == 1) {
-								for (j = 0; j < r->nent; j++) {
-									iv = j/(r->nent-1.0);
-									r->v[0][j] = 
-									r->v[1][j] = 
-									r->v[2][j] = wo->lookup(wo, 0, iv);
-								}
-								debug("Got monochrom vcgt calibration\n");
-							} else {
-								if (verb) printf("vcgt tag is unrecognized in profile for screen %d for display '%s'\n",i+1,dnbuf);
-								icco->del(icco);
-								rd_fp->del(rd_fp);
-								r->del(r);
-								dw->del(dw);
-								continue;
-							}
-						}
-						if (dw->set_ramdac(dw,r,1) != 0) {
-							if (verb) printf("Unable to set vcgt tag for screen %d for display '%s'\n",i+1,dnbuf);
-							icco->del(icco);
-							rd_fp->del(rd_fp);
-							r->del(r);
-							dw->del(dw);
-							continue;
-						}
-						if (verb) printf("Loaded profile and calibration for screen %d for display '%s'\n",i+1,dnbuf);
-						icco->del(icco);
-						rd_fp->del(rd_fp);
-						r->del(r);
-						dw->del(dw);
-					}
 				}
+				x11_load_displays(dp, dnbuf, verb, ddebug);
 				free_disppaths(dp);
 				update_profiles = 0;
 			}
@@ -228,6 +228,10 @@ struct _dispwin {
 	double settle_mult;	/* Settling time multiplier */
 	int do_resp_time_del;	/* NZ to compute and use expected display response time */
 	int do_update_del;		/* NZ to do update delay */ 
+	int defer_update_del;	/* NZ to defer the update delay to wait_update() */
+	unsigned int update_due;	/* msec_time() the deferred update delay ends, 0 if none */
+	volatile unsigned int present_time;	/* msec_time() the target reported the current patch */
+							/* was presented, 0 if it hasn't been reported */
 	double extra_update_delay;	/* Test window internal extra delay (used in delay cal.) */
 	int nowin;			/* Don't create a test window */
 	int native;			/*  X0 = use current per channel calibration curve */
@@ -365,6 +369,11 @@ struct _dispwin {
 	/* Return nz on error */
 	int (*set_color)(struct _dispwin *p, double r, double g, double b);
 
+	/* Hint the color that will most likely be set next, so that it can */
+	/* be prepared while the current one is being measured. */
+	/* Optional - may be NULL. Return nz on error */
+	int (*set_next_color)(struct _dispwin *p, double r, double g, double b);
+
 	/* Set/unset the fullscreen black flag. */
 	/* Will only change on next set_col() */
 	/* Return nz on error */
@@ -396,6 +405,14 @@ struct _dispwin {
 	/* when measuring the patch_delay and inst_reaction */
 	void (*enable_update_delay)(struct _dispwin *p, int enable);
 
+	/* Defer the update delay. While deferred, set_color() returns as soon as */
+	/* the color has been displayed, and wait_update() must be called before */
+	/* measuring it, so that other work can be done while the display settles. */
+	void (*defer_update_delay)(struct _dispwin *p, int defer);
+
+	/* Wait until any deferred update delay of the last set_color() is over */
+	void (*wait_update)(struct _dispwin *p);
+
 	/* Set a shell set color callout command line */
 	void (*set_callout)(struct _dispwin *p, char *callout);
 
@@ -428,7 +445,11 @@ void dispwin_set_default_delays(dispwin *p);
 void dispwin_set_update_delay(dispwin *p, int patch_delay, int inst_reaction);
 void dispwin_set_settling_delay(dispwin *p, double rise_time, double fall_time, double de_aim);
 void dispwin_enable_update_delay(dispwin *p, int enable);
+void dispwin_defer_update_delay(dispwin *p, int defer);
+void dispwin_wait_update(dispwin *p);
 int dispwin_compute_delay(dispwin *p, double *orgb);
+void dispwin_update_sleep(dispwin *p, int update_delay);
+void dispwin_presented(dispwin *p, unsigned int ptime);
 
 ramdac *dispwin_clone_ramdac(ramdac *r);
 void dispwin_setlin_ramdac(ramdac *r);
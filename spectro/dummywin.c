@@ -134,7 +134,7 @@ double r, double g, double b	/* Color values 0.0 - 1.0 */
 	/* Allow for display update & instrument delays */
 	update_delay = dispwin_compute_delay(p, orgb);
 	debugr2((errout, "dummywin_set_color delaying %d msec\n",update_delay));
-	msec_sleep(update_delay);
+	dispwin_update_sleep(p, update_delay);
 
 	return 0;
 }
@@ -258,6 +258,8 @@ int ddebug						/* >0 to print debug statements to stderr */
 	p->set_update_delay    = dispwin_set_update_delay;
 	p->set_settling_delay  = dispwin_set_settling_delay;
 	p->enable_update_delay = dispwin_enable_update_delay;
+	p->defer_update_delay  = dispwin_defer_update_delay;
+	p->wait_update         = dispwin_wait_update;
 	p->set_callout         = dummywin_set_callout;
 	p->del                 = dummywin_del;
 
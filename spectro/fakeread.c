@@ -92,6 +92,111 @@ void usage(char *diag, ...) {
 	exit(1);
 	}
 
+/* Patch color conversion context */
+typedef struct {
+	icmLuBase *icc_luo;			/* ICC conversion, NULL if not used */
+	int bt1886;					/* Apply BT.1886 to ICC matrix conversion */
+	bt1886_info *bt;			/* BT.1886 adjustment info */
+	int dobpt;					/* Do black point scaling */
+	double *wp;					/* ICC profile white point */
+	double (*bpt)[3];			/* Black point transform matrix */
+	mpp *mlu;					/* MPP conversion, NULL if not used */
+	cgats *ti3;					/* TI3 conversion, NULL if not used */
+	int ti3_npat;				/* Number of patches in TI3 file */
+	int *ti3_chix;				/* TI3 device chanel indexes */
+	int *ti3_pcsix;				/* TI3 PCS chanel indexes */
+	int *ti3_spi;				/* TI3 CGATS indexes for each wavelength */
+	int ti3_isLab;				/* TI3 PCS is Lab */
+	int nchan;					/* Test chart number of device chanels */
+	int dolab;					/* Output Lab rather than XYZ */
+	int spec_n;					/* Number of spectral bands, 0 if not wanted */
+	double (*psep)[ICX_MXINKS];	/* Conversion input value of each patch */
+	double (*ppcs)[3];			/* Return PCS value of each patch */
+	double *pspec;				/* Return spec_n spectral values of each patch */
+} fr_conv_cntx;
+
+/* Convert patches i0 .. i1-1 to PCS (and spectral). */
+/* MPP PCS values have already been done by lookup_n(). */
+/* Return nz on an ICC lookup error. */
+static int fr_conv_thread(void *cntx, int i0, int i1, int thix) {
+	fr_conv_cntx *p = (fr_conv_cntx *)cntx;
+	int i, j;
+
+	for (i = i0; i < i1; i++) {
+		double *sep = p->psep[i], *PCS = p->ppcs[i];
+
+		if (p->icc_luo != NULL) {
+			if (p->bt1886) {
+				icmLuMatrix *lu = (icmLuMatrix *)p->icc_luo;    /* Safe to coerce */
+				double tsep[3];
+				bt1886_fwd_curve(p->bt, tsep, sep);
+				lu->fwd_matrix(lu, PCS, tsep);
+				bt1886_wp_adjust(p->bt, PCS, PCS);
+				lu->fwd_abs(lu, PCS, PCS);
+			} else {
+				if (p->icc_luo->lookup(p->icc_luo, PCS, sep) > 1)
+					return 1;
+			}
+
+			if (p->dobpt) {	/* Doing black point scaling */
+
+				for (j = 0; j < 3; j++)
+					PCS[j] -= p->wp[j];
+				icmMulBy3x3(PCS, p->bpt, PCS);
+				for (j = 0; j < 3; j++)
+					PCS[j] += p->wp[j];
+			}
+
+		} else if (p->mlu != NULL) {
+			if (p->spec_n > 0) {
+				xspect out;
+				p->mlu->lookup_spec(p->mlu, &out, sep);
+				for (j = 0; j < p->spec_n; j++)
+					p->pspec[i * p->spec_n + j] = out.spec[j];
+			}
+
+		} else if (p->ti3 != NULL) {
+			cgats *ti3 = p->ti3;
+			int m;
+			double bdif = 1e6;
+			int bix = -1;
+
+			/* Search for the closest device values in TI3 file */
+			for (m = 0; m < p->ti3_npat; m++) {
+				double dif;
+
+				for (dif = 0.0, j = 0; j < p->nchan; j++) {
+					double xx;
+
+					xx = (*((double *)ti3->t[0].fdata[m][p->ti3_chix[j]]) / 100.0) - sep[j];
+					dif += xx * xx;
+				}
+				if (dif < bdif) {
+					bdif = dif;
+					bix = m;
+				}
+			}
+			/* Copy best value over */
+			for (j = 0; j < 3; j++) {
+				PCS[j] = *((double *)ti3->t[0].fdata[bix][p->ti3_pcsix[j]]);
+			}
+			if (p->ti3_isLab && !p->dolab) {	/* Convert Lab to XYZ */
+				icmLab2XYZ(&icmD50, PCS, PCS);
+			} else if (!p->ti3_isLab && p->dolab) {	/* Convert XYZ to Lab */
+				icmXYZ2Lab(&icmD50, PCS, PCS);
+			} else if (!p->ti3_isLab) {		/* Convert XYZ100 to XYZ1 */
+				PCS[0] /= 100.0;
+				PCS[1] /= 100.0;
+				PCS[2] /= 100.0;
+			}
+			for (j = 0; j < p->spec_n; j++) {
+				p->pspec[i * p->spec_n + j] = *((double *)ti3->t[0].fdata[bix][p->ti3_spi[j]]);
+			}
+		}
+	}
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	int j;
@@ -1125,11 +1230,29 @@ int main(int argc, char *argv[])
 		/* Read all the device test patches in, convert them to PCS, */
 		/* and write them out. */
 		if (!revlookup) {
+			double (*podev)[ICX_MXINKS];	/* Original device value of each patch */
+			double (*psep)[ICX_MXINKS];		/* Conversion input value of each patch */
+			double (*ppcs)[3];				/* PCS value of each patch */
+			double (*pnoise)[3] = NULL;		/* PCS noise of each patch */
+			double *pspec = NULL;			/* spec_n spectral values of each patch */
+			double *tin = NULL;				/* MPP lookup_n() device values */
+
+			if ((podev = (double (*)[ICX_MXINKS])malloc(sizeof(double) * npat * ICX_MXINKS)) == NULL
+			 || (psep = (double (*)[ICX_MXINKS])malloc(sizeof(double) * npat * ICX_MXINKS)) == NULL
+			 || (ppcs = (double (*)[3])malloc(sizeof(double) * npat * 3)) == NULL)
+				error("Malloc failed!");
+			if (rplevel > 0.0
+			 && (pnoise = (double (*)[3])malloc(sizeof(double) * npat * 3)) == NULL)
+				error("Malloc failed!");
+			if (dospec && spec_n > 0
+			 && (pspec = (double *)malloc(sizeof(double) * npat * spec_n)) == NULL)
+				error("Malloc failed!");
+
+			/* Prepare the conversion input device values. This, and all */
+			/* the random numbers, are done in patch order, so that a given */
+			/* seed gives the same result as it always has. */
 			for (i = 0; i < npat; i++) {
-				int k = 0;
-				char *id;
-				double odev[ICX_MXINKS], dev[ICX_MXINKS], sep[ICX_MXINKS], PCS[3];
-				xspect out;
+				double *odev = podev[i], dev[ICX_MXINKS], *sep = psep[i];
 				double qscale = (1 << qbits) - 1.0;
 	
 				for (j = 0; j < nchan; j++) {
@@ -1261,83 +1384,61 @@ int main(int argc, char *argv[])
 					}
 					sep[j] = dv;
 				}
-	
-				/* Do color conversion */
-				if (icc_luo != NULL) {
-					if (bt1886) {
-						icmLuMatrix *lu = (icmLuMatrix *)icc_luo;    /* Safe to coerce */
-	//printf("Matrix dev in: %s\n",icmPdv(inn, sep));
-						bt1886_fwd_curve(&bt, sep, sep);
-	//printf("Matrix after bt1886 curve: %s\n",icmPdv(inn, sep));
-						lu->fwd_matrix(lu, PCS, sep);
-	//printf("Matrix after matrix XYZ %s Lab %s\n",icmPdv(3, PCS), icmPLab(PCS));
-						bt1886_wp_adjust(&bt, PCS, PCS);
-	//printf("Matrix after bt1186 wp adj. XYZ %s Lab %s\n",icmPdv(3, PCS), icmPLab(PCS));
-						lu->fwd_abs(lu, PCS, PCS);
-	//printf("Matrix after abs %s\n",icmPdv(3, PCS));
-					} else {
-						if (icc_luo->lookup(icc_luo, PCS, sep) > 1)
-							error ("%d, %s",icc_icco->errc,icc_icco->err);
-					}
-	
-					if (tbp[0] >= 0) {	/* Doing black point scaling */
-	
-						for (j = 0; j < 3; j++)
-							PCS[j] -= wp[j];
-						icmMulBy3x3(PCS, bpt, PCS);
-						for (j = 0; j < 3; j++)
-							PCS[j] += wp[j];
-					}
-		
-				} else if (mlu != NULL) {
-					mlu->lookup(mlu, PCS, sep);
-					if (dospec && spec_n > 0) {
-						mlu->lookup_spec(mlu, &out, sep);
-					}
-				} else if (ti3 != NULL) {
-					int m;
-					double bdif = 1e6;
-					int bix = -1;
-	
-					/* Search for the closest device values in TI3 file */
-					for (m = 0; m < ti3_npat; m++) {
-						double dif;
-	
-						for (dif = 0.0, j = 0; j < nchan; j++) {
-							double xx;
-	
-							xx = (*((double *)ti3->t[0].fdata[m][ti3_chix[j]]) / 100.0) - sep[j];
-							dif += xx * xx;
-						}
-						if (dif < bdif) {
-							bdif = dif;
-							bix = m;
-						}
-					}
-					/* Copy best value over */
-					if (!dosep)		/* Doesn't make sense for separation ??? */
-						for (j = 0; j < nchan; j++) {
-							dev[j] = *((double *)ti3->t[0].fdata[bix][ti3_chix[j]]) / 100.0;
-						}
+
+				/* Pre-compute the PCS randomness */
+				if (rplevel > 0.0) {
 					for (j = 0; j < 3; j++) {
-						PCS[j] = *((double *)ti3->t[0].fdata[bix][ti3_pcsix[j]]);
-					}
-					if (ti3_isLab && !dolab) {	/* Convert Lab to XYZ */
-						icmLab2XYZ(&icmD50, PCS, PCS);
-					} else if (!ti3_isLab && dolab) {	/* Convert XYZ to Lab */
-						icmXYZ2Lab(&icmD50, PCS, PCS);
-					} else if (!ti3_isLab) {		/* Convert XYZ100 to XYZ1 */
-						PCS[0] /= 100.0;
-						PCS[1] /= 100.0;
-						PCS[2] /= 100.0;
-					}
-					if (dospec && spec_n > 0) {
-						for (j = 0; j < spec_n; j++) {
-							out.spec[j] = *((double *)ti3->t[0].fdata[bix][ti3_spi[j]]);
-						}
+						if (unidist)
+							pnoise[i][j] = 100.0 * d_rand(-2.0 * rplevel, 2.0 * rplevel);
+						else
+							pnoise[i][j] = 100.0 * 1.2533 * rplevel * norm_rand();
 					}
 				}
-	
+			}
+
+			/* Do the color conversion of all the patches */
+			if (mlu != NULL) {
+				if ((tin = (double *)malloc(sizeof(double) * npat * inn)) == NULL)
+					error("Malloc failed!");
+				for (i = 0; i < npat; i++) {
+					for (j = 0; j < inn; j++)
+						tin[i * inn + j] = psep[i][j];
+				}
+				mlu->lookup_n(mlu, ppcs[0], tin, npat);
+				free(tin);
+			}
+			{
+				fr_conv_cntx cx;
+
+				cx.icc_luo = icc_luo;
+				cx.bt1886 = bt1886;
+				cx.bt = &bt;
+				cx.dobpt = tbp[0] >= 0;
+				cx.wp = wp;
+				cx.bpt = bpt;
+				cx.mlu = mlu;
+				cx.ti3 = ti3;
+				cx.ti3_npat = ti3_npat;
+				cx.ti3_chix = ti3_chix;
+				cx.ti3_pcsix = ti3_pcsix;
+				cx.ti3_spi = ti3_spi;
+				cx.ti3_isLab = ti3_isLab;
+				cx.nchan = nchan;
+				cx.dolab = dolab;
+				cx.spec_n = pspec != NULL ? spec_n : 0;
+				cx.psep = psep;
+				cx.ppcs = ppcs;
+				cx.pspec = pspec;
+				if (par_for(0, 0, npat, 0, fr_conv_thread, (void *)&cx) != 0)
+					error ("%d, %s",icc_icco->errc,icc_icco->err);
+			}
+
+			/* Write the patches out */
+			for (i = 0; i < npat; i++) {
+				int k = 0;
+				char *id;
+				double *odev = podev[i], *PCS = ppcs[i];
+
 				id = ((char *)icg->t[0].fdata[i][si]);
 				setel[k++].c = id;
 				
@@ -1360,13 +1461,8 @@ int main(int argc, char *argv[])
 						ll = 0.01 * PCS[1];
 					for (j = 0; j < 3; j++) {
 						double dv = PCS[j];
-						double rr;
 						opcs[j] = dv;
-						if (unidist)
-							rr = 100.0 * d_rand(-2.0 * rplevel, 2.0 * rplevel);
-						else
-							rr = 100.0 * 1.2533 * rplevel * norm_rand();
-						dv += ll * rr;
+						dv += ll * pnoise[i][j];
 	
 						/* Don't let L*, X, Y or Z go negative */
 						if ((!dolab || j == 0) && dv < 0.0)
@@ -1382,12 +1478,19 @@ int main(int argc, char *argv[])
 	
 				if (dospec && spec_n > 0) {
 					for (j = 0; j < spec_n; j++) {
-						setel[k++].d = 100.0 * out.spec[j];
+						setel[k++].d = 100.0 * pspec[i * spec_n + j];
 					}
 				}
 	
 				ocg->add_setarr(ocg, 0, setel);
 			}
+			free(podev);
+			free(psep);
+			free(ppcs);
+			if (pnoise != NULL)
+				free(pnoise);
+			if (pspec != NULL)
+				free(pspec);
 
 		/* Do reverse (PCS -> device) lookup */
 		} else {
@@ -58,6 +58,7 @@
 #include "insttypes.h"
 #include "conv.h"
 #include "icoms.h"
+#include "refrdet.h"
 #include "i1d3.h"
 
 #undef PLOT_SPECTRA		/* Plot the sensor senitivity spectra */
@@ -65,7 +66,6 @@
 #undef SAVE_SPECTRA		/* Save the sensor senitivity spectra to "sensors.cmf" */
 #undef SAVE_XYZSPECTRA	/* Save the XYZ senitivity spectra to "sensorsxyz.cmf" (scale 1.4) */
 #undef SAVE_STDXYZ		/* save 1931 2 degree to stdobsxyz.cmf */
-#undef PLOT_REFRESH		/* Plot data used to determine refresh rate */
 #undef PLOT_UPDELAY		/* Plot data used to determine display update delay */
 
 #undef DEBUG_TWEAKS	/* Allow environment variable tweaks to int time etc. */
@@ -77,6 +77,10 @@
 
 #define I1D3_SAT_FREQ 100000.0		/* L2F sensor frequency limit */
 
+#define CACHE_EXTEE			/* [Def] Keep a copy of the external EEProm on the local system */
+#define CACHE_CALMAT		/* [Def] Keep computed ccss matrices on the local system */
+#define I1D3_EEHDR 59		/* Bytes of external EEProm header checked against the copy */
+
 static inst_code i1d3_interp_code(inst *pp, int ec);
 static inst_code i1d3_check_unlock(i1d3 *p);
 
@@ -929,11 +933,13 @@ i1d3_set_LEDs(
 
 	determining the refresh rate for a refresh type display;
 
-	Read 1300 .5 msec samples as fast as possible, and
+	Read up to 1300 .5 msec samples as fast as possible, and
 	timestamp them.
-	Interpolate values up to .05 msec regular samples.
-	Do an auto-correlation on the samples.
-	Pick the longest peak between 10 and 40Hz as the best sample period,
+	Use refr_detect() to auto-correlate the samples and locate
+	the refresh period from the peaks. This is done every so often
+	while sampling, so that we can stop once it is clear.
+	If there is no common refresh period, pick the longest peak
+	between 10 and 40Hz as the best sample period,
 	and halve this to use as the quantization value (ie. make
 	it lie between 20 and 80 Hz).
 
@@ -952,16 +958,10 @@ i1d3_set_LEDs(
 #ifndef PSRAND32L 
 # define PSRAND32L(S) ((S) * 1664525L + 1013904223L)
 #endif
-#undef FREQ_SLOW_PRECISE	/* [und] Interpolate then autocorrelate, else autc & filter */
-#define NFSAMPS 1300		/* Number of samples to read */
+#define NFSAMPS 1300		/* Maximum number of samples to read */
 #define NFMXTIME 6.0		/* Maximum time to take (2000 == 6) */
-#define PBPMS 20			/* bins per msec */
-#define PERMIN ((1000 * PBPMS)/40)	/* 40 Hz */
-#define PERMAX ((1000 * PBPMS)/5)	/* 5 Hz*/
-#define NPER (PERMAX - PERMIN + 1)
-//#define PWIDTH (3 * PBPMS)			/* 3 msec bin spread to look for peak in */
-#define PWIDTH (8 * PBPMS)			/* 3 msec bin spread to look for peak in */
-#define MAXPKS 20					/* Number of peaks to find */
+#define NFCHECK1 300		/* Samples before first check for a distinct rate */
+#define NFCHECKI 200		/* Samples between subsequent checks */
 
 /* Set refperiod, refrate if possible */
 static inst_code
@@ -971,29 +971,20 @@ i1d3_imp_measure_refresh(
 	double *ppval		/* Return period value, 0.0 if none */	
 ) {
 	inst_code ev;
-	int i, j, k;
-	double ucalf = 1.0;				/* usec_time calibration factor */
+	int i;
 	double inttimel = 0.0003;
 	double inttimeh = 0.0040;
-	double sutime, putime, cutime, eutime;
+	double sutime, putime, cutime;
 	static unsigned int randn = 0x12345678;
 	struct {
 		double itime;	/* Integration time */
 		double sec;
 		double rgb[3];
 	} samp[NFSAMPS];
+	refrsamp rsamp[NFSAMPS];	/* Samples for refresh detection */
 	int nfsamps;			/* Actual samples read */
-	double maxt;			/* Time range */
-	double rms[3];			/* RMS value of each channel */
-	double trms;			/* Total RMS */
-	int nbins;
-	double *bins[3];		/* PBPMS sample bins */
-	double tcorr[NPER];		/* Temp for initial autocorrelation */
-	double corr[NPER];		/* Filtered correlation for each period value */
-	double mincv, maxcv;	/* Max and min correlation values */
-	double crange;			/* Correlation range */
-	double peaks[MAXPKS];	/* Each peak from longest to shortest */
-	int npeaks = 0;			/* Number of peaks */
+	double refrate = 0.0;	/* Refresh rate found */
+	double lrefrate = 0.0;	/* Refresh rate found at last check */
 	double pval;			/* Period value */
 	int isdeb;
 	int isth;
@@ -1023,38 +1014,9 @@ i1d3_imp_measure_refresh(
 		}
 	}
 
-#ifdef NEVER		/* This appears to be unnecessary */
-	/* Calibrate the usec timer against the instrument */
-	{
-		double inttime1, inttime2;
-		inttime1 = 0.001; 
-		inttime2 = 0.501; 
-
-		sutime = usec_time();
-
-		if ((ev = i1d3_freq_measure(p, &inttime1, samp[0].rgb)) != inst_ok) {
-			p->log->debug = isdeb;
-			p->th_en = isth;
-	 		return ev;
-		}
-
-		putime = usec_time();
-
-		if ((ev = i1d3_freq_measure(p, &inttime2, samp[0].rgb)) != inst_ok) {
-			p->log->debug = isdeb;
-			p->th_en = isth;
-	 		return ev;
-		}
-
-		cutime = usec_time();
-
-		ucalf = 1000000.0 * (inttime2 - inttime1)/(cutime - 2.0 * putime + sutime);
-
-		a1logd(p->log, 3, "i1d3_measure_refresh: Clock calibration factor = %f\n",ucalf);
-	}
-#endif
-
-	/* Read the samples */
+	/* Read the samples. Every so often check if there is a distinct */
+	/* refresh rate, and stop early if it agrees with the last check */
+	/* or with the rate found last time (i.e. the display mode hasn't changed). */
 	sutime = usec_time();
 	putime = (usec_time() - sutime) / 1000000.0;
 	for (i = 0; i < NFSAMPS; i++) {
@@ -1073,11 +1035,28 @@ i1d3_imp_measure_refresh(
 		}
 		cutime = (usec_time() - sutime) / 1000000.0;
 		samp[i].sec = 0.5 * (putime + cutime);	/* Mean of before and after stamp */
-//samp[i].sec *= 85.0/20.0;		/* Test 20 Hz */
-//samp[i].sec *= 85.0/100.0;		/* Test 100 Hz */
 		putime = cutime;
 		if (cutime > NFMXTIME)
 			break; 
+
+		/* Correlate on the normalised green channel */
+		rsamp[i].sec = samp[i].sec;
+		rsamp[i].lev = samp[i].rgb[1] / samp[i].itime;
+
+		if ((i+1) >= NFCHECK1 && ((i+1 - NFCHECK1) % NFCHECKI) == 0) {
+			if (refr_detect(p->log, rsamp, i+1, 1000.0/sqrt(3.0), &refrate, &pval)) {
+				p->log->debug = isdeb;
+				p->th_en = isth;
+				return inst_internal_error;
+			}
+			if (REFR_SAME(refrate, lrefrate)
+			 || (p->refrvalid && REFR_SAME(refrate, p->refrate))) {
+				i++;
+				break;
+			}
+			lrefrate = refrate;
+			refrate = 0.0;
+		}
 	}
 	/* Restore debug & thread */
 	p->log->debug = isdeb;
@@ -1092,306 +1071,19 @@ i1d3_imp_measure_refresh(
  
 	a1logd(p->log, 3, "i1d3_measure_refresh: Read %d samples for refresh calibration\n",nfsamps);
 
-#ifdef NEVER
-	/* Plot the raw sensor values */
-	{
-		double xx[NFSAMPS];
-		double y1[NFSAMPS];
-		double y2[NFSAMPS];
-		double y3[NFSAMPS];
-
-		for (i = 0; i < nfsamps; i++) {
-			xx[i] = samp[i].sec;
-			y1[i] = samp[i].rgb[0];
-			y2[i] = samp[i].rgb[1];
-			y3[i] = samp[i].rgb[2];
-		//printf("%d: %f -> %f\n",i,samp[i].sec, samp[i].rgb[0]);
-		}
-		printf("Fast scan sensor values and time (sec)\n");
-		do_plot6(xx, y1, y2, y3, NULL, NULL, NULL, nfsamps);
-	}
-#endif
-
-	/* Re-zero the sample times, normalise int time, and calibrate it. */
-	maxt = -1e6;
-	rms[0] = rms[1] = rms[2] = 0.0;
-	for (i = nfsamps-1; i >= 0; i--) {
-		samp[i].sec -= samp[0].sec; 
-		samp[i].sec *= ucalf;
-		if (samp[i].sec > maxt)
-			maxt = samp[i].sec;
-		for (j = 0; j < 3; j++) {
-			samp[i].rgb[j] /= samp[i].itime;
-			rms[j] += samp[i].rgb[j] * samp[i].rgb[j];
-		}
-	}
-	trms = 0.0;
-	for (j = 0; j < 3; j++) {
-		rms[j] /= (double)nfsamps;
-		trms += rms[j];
-		rms[j] = sqrt(rms[j]);
-	}
-	trms = sqrt(trms);
-	a1logd(p->log, 4, "RMS = %f %f %f, total %f\n", rms[0], rms[1], rms[2], trms);
-
-#ifdef FREQ_SLOW_PRECISE	/* Interp then autocorrelate */
-
-	/* Create PBPMS bins and interpolate readings into them */
-	nbins = 1 + (int)(maxt * 1000.0 * PBPMS + 0.5);
-	for (j = 0; j < 3; j++) {
-		if ((bins[j] = (double *)calloc(sizeof(double), nbins)) == NULL) {
-			a1loge(p->log, inst_internal_error, "i1d3_measure_refresh: malloc failed\n");
+	/* If we didn't stop early, use all the samples */
+	if (refrate == 0.0) {
+		if (refr_detect(p->log, rsamp, nfsamps, 1000.0/sqrt(3.0), &refrate, &pval))
 			return inst_internal_error;
-		}
-	}
-
-	/* Do the interpolation */
-	for (k = 0; k < (nfsamps-1); k++) {
-		int sbin, ebin;
-		sbin = (int)(samp[k].sec * 1000.0 * PBPMS + 0.5);
-		ebin = (int)(samp[k+1].sec * 1000.0 * PBPMS + 0.5);
-		for (i = sbin; i <= ebin; i++) {
-			double bl;
-#if defined(__APPLE__) && defined(__POWERPC__)
-			gcc_bug_fix(i);
-#endif
-			bl = (i - sbin)/(double)(ebin - sbin);	/* 0.0 to 1.0 */
-			for (j = 0; j < 3; j++) {
-				bins[j][i] = (1.0 - bl) * samp[k].rgb[j] + bl * samp[k+1].rgb[j];
-			}
-		} 
-	}
-
-#ifdef NEVER
-	/* Plot interpolated values */
-	{
-		double *xx;
-		double *y1;
-		double *y2;
-		double *y3;
-
-		xx = malloc(sizeof(double) * nbins);
-		y1 = malloc(sizeof(double) * nbins);
-		y2 = malloc(sizeof(double) * nbins);
-		y3 = malloc(sizeof(double) * nbins);
-
-		if (xx == NULL || y1 == NULL || y2 == NULL || y3 == NULL) {
-			a1loge(p->log, inst_internal_error, "i1d3_measure_refresh: malloc failed\n");
-			for (j = 0; j < 3; j++)
-				free(bins[j]);
-			return inst_internal_error;
-		}
-		for (i = 0; i < nbins; i++) {
-			xx[i] = i / (double)PBPMS;			/* msec */
-			y1[i] = bins[0][i];
-			y2[i] = bins[1][i];
-			y3[i] = bins[2][i];
-		}
-		printf("Interpolated fast scan sensor values and time (msec)\n");
-		do_plot6(xx, y1, y2, y3, NULL, NULL, NULL, nbins);
-
-		free(xx);
-		free(y1);
-		free(y2);
-		free(y3);
-	}
-#endif /* PLOT_REFRESH */
-
-	/* Compute auto-correlation at 1/PBPMS msec intervals */
-	/* from 25 msec (40Hz) to 100msec (10 Hz) */
-	mincv = 1e48, maxcv = -1e48;
-	for (i = 0; i < NPER; i++) {
-		int poff = PERMIN + i;		/* Offset to corresponding sample */
-		corr[i] = 0.0;
-
-		for (k = 0; (k + poff) < nbins; k++)
-			corr[i] += bins[0][k] * bins[0][k + poff];
-		for (k = 0; (k + poff) < nbins; k++)
-			corr[i] += bins[1][k] * bins[1][k + poff];
-		for (k = 0; (k + poff) < nbins; k++)
-			corr[i] += bins[2][k] * bins[2][k + poff];
-
-		corr[i] /= (double)k;		/* Normalize */
-		if (corr[i] > maxcv)
-			maxcv = corr[i];
-		if (corr[i] < mincv)
-			mincv = corr[i];
-	}
-	for (j = 0; j < 3; j++)
-		free(bins[j]);
-
-#else /* !FREQ_SLOW_PRECISE  Fast - autocorrellate then filter */
-
-	/* Do point by point correllation of samples */
-	for (i = 0; i < NPER; i++)
-		tcorr[i] = 0.0;
-
-	for (j = 0; j < (nfsamps-1); j++) {
-
-		for (k = j+1; k < nfsamps; k++) {
-			double del, cor;
-			int bix;
-
-			del = samp[k].sec - samp[j].sec;
-			bix = (int)(del * 1000.0 * PBPMS + 0.5);
-			if (bix < PERMIN)
-				continue;
-			if (bix > PERMAX)
-				break;
-			bix -= PERMIN;
-		
-//			cor = samp[j].rgb[0] * samp[k].rgb[0]
-//	            + samp[j].rgb[1] * samp[k].rgb[1]
-//	            + samp[j].rgb[2] * samp[k].rgb[2];
-
-			cor = samp[j].rgb[1] * samp[k].rgb[1];
-
-			tcorr[bix] += cor;
-		} 
-	}
-
-#ifdef PLOT_REFRESH
-	/* Plot unfiltered auto correlation */
-	{
-		double xx[NPER];
-		double y1[NPER];
-
-		for (i = 0; i < NPER; i++) {
-			xx[i] = (i + PERMIN) / (double)PBPMS;			/* msec */
-			y1[i] = tcorr[i];
-		}
-		printf("Unfiltered auto correlation (msec)\n");
-		do_plot6(xx, y1, NULL, NULL, NULL, NULL, NULL, NPER);
-	}
-#endif /* PLOT_REFRESH */
-
-	/* Apply a 5 msec gausian filter */
-#define FWIDTH 6
-	{
-		double gaus_[2 * FWIDTH * PBPMS + 1];
-		double *gaus = &gaus_[FWIDTH * PBPMS];
-		double bb = 1.0/pow(2, 5.0);
-	
-		for (j = (-FWIDTH * PBPMS); j <= (FWIDTH * PBPMS); j++) {
-			double tt;
-			tt = (double)j/(FWIDTH * PBPMS);
-			gaus[j] = 1.0/pow(2, 5.0 * tt * tt) - bb;
-		}
-		for (k = 0; k < 1; k++) {
-			for (i = 0; i < NPER; i++) {
-				double sum = 0.0;
-				double wght = 0.0;
-				
-				for (j = (-FWIDTH * PBPMS); j <= (FWIDTH * PBPMS); j++) {
-					double w;
-					int ix = i + j;
-					if (ix < 0)
-						continue;
-					if (ix > (NPER-1))
-						break;
-					w = gaus[j];
-					sum += w * tcorr[ix];
-					wght += w;
-				}
-				corr[i] = sum / wght;
-			}
-		}
 	}
 
-	/* Compute min & max */
-	mincv = 1e48, maxcv = -1e48;
-	for (i = 0; i < NPER; i++) {
-		if (corr[i] > maxcv)
-			maxcv = corr[i];
-		if (corr[i] < mincv)
-			mincv = corr[i];
-	}
-
-#endif /* !FREQ_SLOW_PRECISE  Fast - autocorrellate then filter */
-
-	crange = maxcv - mincv;
-	a1logd(p->log,4,"Correlation value range %f - %f = %f = %f%%\n",mincv, maxcv,crange, 100.0 * (maxcv-mincv)/maxcv);
-
-#ifdef PLOT_REFRESH
-	/* Plot auto correlation */
-	{
-		double xx[NPER];
-		double y1[NPER];
-
-		for (i = 0; i < NPER; i++) {
-			xx[i] = (i + PERMIN) / (double)PBPMS;			/* msec */
-			y1[i] = corr[i];
-		}
-		printf("Auto correlation (msec)\n");
-		do_plot6(xx, y1, NULL, NULL, NULL, NULL, NULL, NPER);
-	}
-#endif /* PLOT_REFRESH */
-
-	/* If there is sufficient level and distict correlations */
-	if (trms >= 1000 && (maxcv-mincv)/maxcv >= 0.10) {
-
-		/* Locate all the peaks starting at the longest correllation */
-		for (i = (NPER-1-PWIDTH); i >= 0 && npeaks < MAXPKS; i--) {
-			double v1, v2, v3;
-			v1 = corr[i];
-			v2 = corr[i + PWIDTH/2];
-			v3 = corr[i + PWIDTH];
-
-			if (fabs(v3 - v1) < (0.05 * crange)
-			 && (v2 - v1) > (0.025 * crange)
-			 && (v2 - v3) > (0.025 * crange)) {
-				double pkv;			/* Peak value */
-				int pki;			/* Peak index */
-				double ii, bl;
-
-				a1logd(p->log,4,"Max between %f and %f msec\n",
-				       (i + PERMIN)/(double)PBPMS,(i + PWIDTH + PERMIN)/(double)PBPMS);
-
-				/* Locate the actual peak */
-				pkv = -1.0;
-				pki = 0;
-				for (j = i; j < (i + PWIDTH); j++) {
-					if (corr[j] > pkv) {
-						pkv = corr[j];
-						pki = j;
-					}
-				}
-				a1logd(p->log,4,"Peak is at %f msec, %f corr\n", (pki + PERMIN)/(double)PBPMS, pkv);
-
-				/* Interpolate the peak value for higher precision */
-				/* j = bigest */
-				if (corr[pki-1] > corr[pki+1])  {
-					j = pki-1;
-					k = pki+1;
-				} else {
-					j = pki+1;
-					k = pki-1;
-				}
-				bl = (corr[pki] - corr[j])/(corr[pki] - corr[k]);
-				bl = (bl + 1.0)/2.0;
-				ii = bl * pki + (1.0 - bl) * j;
-				pval = (ii + PERMIN)/(double)PBPMS;
-
-				a1logd(p->log,4,"Interpolated peak is at %f msec\n", pval);
-
-				peaks[npeaks++] = pval;
-
-				i -= PWIDTH;
-			}
-		}
-	}
-
-	a1logd(p->log,3,"Number of peaks located = %d\n",npeaks);
-	if (npeaks == 0) {
+	if (pval == 0.0) {
 		a1logd(p->log, 2, "i1d3: Couldn't find a distinct refresh frequency\n");
 		a1logv(p->log, 1, "No distict refresh period\n");
 		return inst_ok;
 	}
 
-	if (npeaks == 1) {
-		a1logd(p->log,3,"Only one peak\n");
-		pval = peaks[0] / 2000.0;	/* Scale by half and convert to seconds */
-
+	if (refrate == 0.0) {
 		a1logd(p->log, 1, "Quantizing to %f msec\n",pval);
 		a1logv(p->log, 1, "Quantizing to %f msec\n",pval);
 
@@ -1399,102 +1091,44 @@ i1d3_imp_measure_refresh(
 			*ppval = pval;
 
 	} else {
-		int nfails;
-		double div, avg, ano;
-		/* Try and locate a common divisor amongst all the peaks. */
-		/* This is likely to be the underlying refresh rate. */
-		for (k = 0; k < npeaks; k++) {
-			for (j = 1; j < 20; j++) {
-				avg = ano = 0.0;
-				div = peaks[k]/(double)j;
-				if (div < 9.0)
-					continue;		/* Skip anything over 100Hz */
-				for (nfails = i = 0; i < npeaks; i++) {
-					double rem, cnt;
-
-					rem = peaks[i]/div;
-					cnt = floor(rem + 0.5);
-					rem = fabs(rem - cnt);
-
-					a1logd(p->log, 1, "remainder for peak %d = %f\n",i,rem);
-					if (rem > 0.06) {
-						if (++nfails > 2)
-							break;				/* Fail this divisor */
-					}
-					avg += peaks[i];		/* Already weighted by cnt */
-					ano += cnt;
-				}
-
-//				if (i >= npeaks)
-				if (nfails == 0 || (nfails <= 2 && npeaks >= 6))
-					break;		/* Sucess */
-				/* else go and try a different divisor */
-			}
-			if (j < 20)
-				break;			/* Found common divisor */
-		}
-		if (k >= npeaks) {
-			a1logd(p->log,3,"Failed to locate common divisor\n");
-			pval = peaks[0] / 2000.0;	/* Scale by half and convert to seconds */
-
-			if (ppval != NULL)
-				*ppval = pval;
-
-
-			a1logd(p->log, 1, "Quantizing to %f msec\n",pval);
-			a1logv(p->log, 1, "Quantizing to %f msec\n",pval);
-
-		} else {
-			int mul;
-			double refrate;
-			double pval;
-
-			pval = avg/ano;
-			pval /= 1000.0;		/* Convert to seconds */
-			refrate = 1.0/pval;
-
-			if (prefrate != NULL)
-				*prefrate = refrate;	/* Save it for get_refr_rate() */
-			
-			/* Error against my 85Hz CRT - GWG */
-//			a1logd(p->log, 1, "Refresh rate error = %.4f%%\n",100.0 * fabs(refrate - 85.0)/(85.0));
+		int mul;
 
-			/* Scale to just above 20 Hz, but make it multiple of 2 or 4 */
+		if (prefrate != NULL)
+			*prefrate = refrate;	/* Save it for get_refr_rate() */
+		
+		/* Scale to just above 20 Hz, but make it multiple of 2 or 4 */
 #ifdef DEBUG_TWEAKS
-			{
-				double quanttime = 1.0/20.0;
-				char *cp;
-				if ((cp = getenv("I1D3_MIN_REF_QUANT_TIME")) != NULL)
-					quanttime = atof(cp);
-				mul = (int)floor(quanttime / pval);
-			}
+		{
+			double quanttime = 1.0/20.0;
+			char *cp;
+			if ((cp = getenv("I1D3_MIN_REF_QUANT_TIME")) != NULL)
+				quanttime = atof(cp);
+			mul = (int)floor(quanttime / pval);
+		}
 #else
-			mul = (int)floor((1.0/20.0) / pval);
+		mul = (int)floor((1.0/20.0) / pval);
 #endif
-			if (mul > 1) {
-				if (mul >= 8)
-					mul = (mul + 3) & ~3;	/* Round up to mult of 4 */
-				else
-					mul = (mul + 1) & ~1;	/* Round up to mult of 2 */
-				pval *= mul;
-			}
+		if (mul > 1) {
+			if (mul >= 8)
+				mul = (mul + 3) & ~3;	/* Round up to mult of 4 */
+			else
+				mul = (mul + 1) & ~1;	/* Round up to mult of 2 */
+			pval *= mul;
+		}
 
-			a1logd(p->log, 1, "Refresh rate = %f Hz, quantizing to %f msec\n",refrate,pval);
-			a1logv(p->log, 1, "Refresh rate = %f Hz, quantizing to %f msec\n",refrate,pval);
+		a1logd(p->log, 1, "Refresh rate = %f Hz, quantizing to %f msec\n",refrate,pval);
+		a1logv(p->log, 1, "Refresh rate = %f Hz, quantizing to %f msec\n",refrate,pval);
 
-			if (ppval != NULL)
-				*ppval = pval;
-		}
+		if (ppval != NULL)
+			*ppval = pval;
 	}
 
 	return inst_ok;
 }
 #undef NFSAMPS 
-#undef PBPMS
-#undef PERMIN
-#undef PERMAX
-#undef NPER
-#undef PWIDTH
+#undef NFMXTIME
+#undef NFCHECK1
+#undef NFCHECKI
 
 /* Measure and then set refperiod, refrate if possible */
 static inst_code
@@ -1781,28 +1415,31 @@ i1d3_take_emis_measurement(
 				/* of p->inttime (0.2/0.4 secs) */
 				nedgec = edgec[i] * p->inttime * p->clk_freq/rmeas[i];
 
-				/* If we will get less than 200 edges, raise the target integration */
-				/* time in a curve to aim at a higher edge count up to 200 */
-				if (nedgec < 200.0) {
+				/* If we will get less than p->tedges (200) edges, raise the target */
+				/* integration time in a curve to aim at a higher edge count. */
+				/* The edge count sets the quantization noise, so p->tedges */
+				/* is the target noise level, and p->maxintt the time budget. */
+				if (nedgec < p->tedges) {
 					double bl, tedges;
 					double mint;
 
-					/* Blend down from target of 200 to minimum target of 1 edge over 8 sec. */
+					/* Blend down from target of p->tedges to minimum target of 1 edge */
+					/* over a little more than the time budget. */
 					/* (Allow margine away from max integration time of 6 secs) */
-					mint = p->inttime/6.0;
-					bl = (nedgec - mint)/(200.0 - mint);
+					mint = p->inttime/p->maxintt;
+					bl = (nedgec - mint)/(p->tedges - mint);
 					if (bl < 0.0)
 						bl = 0.0;
 					else {
 						/* This power sets how fast the int. time rises */
 						bl = pow(bl, 0.5);		/* Use longer int. times to increase ecount */
 					}
-					tedges = bl * (200.0 - mint) + mint;
+					tedges = bl * (p->tedges - mint) + mint;
 
 					tintt[i] = tedges/(edgec[i] * p->clk_freq/rmeas[i]);
 
-					if (tintt[i] > 6.0)		/* Maximum possible is 6 seconds */
-						tintt[i] = 6.0;		/* to ensure it completes within the 20 timeout */
+					if (tintt[i] > p->maxintt)	/* Maximum possible is 6 seconds */
+						tintt[i] = p->maxintt;	/* to ensure it completes within the 20 timeout */
 
 					if (p->refperiod > 0.0) {		/* If we have a refresh period */
 						int n;
@@ -2396,18 +2033,181 @@ i1d3_set_matcal(i1d3 *p, double mtx[3][3]) {
 	return inst_ok;
 }
 
+/* Return a signature of the current spectral samples and observer, */
+/* to identify a previously computed calibration matrix. */
+static unsigned int i1d3_calsig(i1d3 *p) {
+	unsigned int sig = 2166136261u;		/* FNV-1a */
+	unsigned char *bp;
+	size_t i, len;
+	int j, k;
+
+#define I1D3_SIGADD(ptr, size) \
+	for (bp = (unsigned char *)(ptr), len = (size), i = 0; i < len; i++) \
+		sig = (sig ^ bp[i]) * 16777619u;
+
+	I1D3_SIGADD(&p->obType, sizeof(p->obType));
+	if (p->obType == icxOT_custom) {
+		for (k = 0; k < 3; k++) {
+			I1D3_SIGADD(&p->custObserver[k].spec_n, sizeof(int));
+			I1D3_SIGADD(&p->custObserver[k].spec_wl_short, sizeof(double));
+			I1D3_SIGADD(&p->custObserver[k].spec_wl_long, sizeof(double));
+			I1D3_SIGADD(&p->custObserver[k].norm, sizeof(double));
+			I1D3_SIGADD(p->custObserver[k].spec, p->custObserver[k].spec_n * sizeof(double));
+		}
+	}
+	for (j = 0; j < p->nsamp; j++) {
+		I1D3_SIGADD(&p->samples[j].spec_n, sizeof(int));
+		I1D3_SIGADD(&p->samples[j].spec_wl_short, sizeof(double));
+		I1D3_SIGADD(&p->samples[j].spec_wl_long, sizeof(double));
+		I1D3_SIGADD(&p->samples[j].norm, sizeof(double));
+		I1D3_SIGADD(p->samples[j].spec, p->samples[j].spec_n * sizeof(double));
+	}
+#undef I1D3_SIGADD
+
+	return sig;
+}
+
+#ifdef CACHE_CALMAT
+
+/* The computed ccss matrices are kept on the local system keyed by */
+/* serial number, so that they don't have to be recomputed each time */
+/* the instrument is opened. The file is only used if the sensor */
+/* sensitivities it was computed with match. */
+
+#define I1D3_CALCACHE_VER 1		/* Bump if i1d3_comp_calmat() changes */
+
+/* Return a signature of the sensor sensitivities */
+static unsigned int i1d3_senssig(i1d3 *p) {
+	unsigned int sig = I1D3_CALCACHE_VER;
+	unsigned char *bp;
+	int i, j;
+
+	for (j = 0; j < 3; j++) {
+		bp = (unsigned char *)p->sens[j].spec;
+		for (i = 0; i < (int)(p->sens[j].spec_n * sizeof(double)); i++)
+			sig = ((sig << 13) | (sig >> (32-13))) + bp[i];
+	}
+	return sig;
+}
+
+/* Read the saved matrices into the cache, if they are valid */
+static void i1d3_restore_calcache(i1d3 *p) {
+	char nmode[10];
+	char cal_name[100];
+	char **cal_paths = NULL;
+	int no_paths = 0;
+	FILE *fp;
+	unsigned int ssig;
+
+	strcpy(nmode, "r");
+#if defined(O_BINARY) || defined(_O_BINARY)
+	strcat(nmode, "b");
+#endif
+	sprintf(cal_name, "ArgyllCMS/.i1d3_%s.cmx", p->serial_no);
+	if ((no_paths = xdg_bds(NULL, &cal_paths, xdg_cache, xdg_read, xdg_user, xdg_none,
+		                                                                     cal_name)) < 1) {
+		a1logd(p->log,3,"i1d3_restore_calcache: no saved matrices\n");
+		return;
+	}
+
+	if ((fp = fopen(cal_paths[0], nmode)) != NULL) {
+		if (fread((void *)&ssig, sizeof(unsigned int), 1, fp) == 1
+		 && ssig == i1d3_senssig(p)
+		 && fread((void *)p->calcache, sizeof(p->calcache), 1, fp) == 1
+		 && fread((void *)&p->calcache_next, sizeof(int), 1, fp) == 1
+		 && p->calcache_next >= 0 && p->calcache_next < I1D3_NCALCACHE) {
+			a1logd(p->log,3,"i1d3_restore_calcache: restored '%s'\n",cal_paths[0]);
+		} else {
+			a1logd(p->log,3,"i1d3_restore_calcache: '%s' isn't valid\n",cal_paths[0]);
+			memset((void *)p->calcache, 0, sizeof(p->calcache));
+			p->calcache_next = 0;
+		}
+		fclose(fp);
+	}
+	xdg_free(cal_paths, no_paths);
+}
+
+/* Save the cache of matrices to the local system */
+static void i1d3_save_calcache(i1d3 *p) {
+	char nmode[10];
+	char cal_name[100];
+	char **cal_paths = NULL;
+	int no_paths = 0;
+	FILE *fp;
+	unsigned int ssig;
+	int ef = 0;
+
+	strcpy(nmode, "w");
+#if defined(O_BINARY) || defined(_O_BINARY)
+	strcat(nmode, "b");
+#endif
+	sprintf(cal_name, "ArgyllCMS/.i1d3_%s.cmx", p->serial_no);
+	if ((no_paths = xdg_bds(NULL, &cal_paths, xdg_cache, xdg_write, xdg_user, xdg_none,
+		                                                                      cal_name)) < 1) {
+		a1logd(p->log,2,"i1d3_save_calcache: xdg_bds returned no paths\n");
+		return;
+	}
+
+	if (create_parent_directories(cal_paths[0])
+	 || (fp = fopen(cal_paths[0], nmode)) == NULL) {
+		a1logd(p->log,2,"i1d3_save_calcache: failed to open '%s' for writing\n",cal_paths[0]);
+		xdg_free(cal_paths, no_paths);
+		return;
+	}
+
+	ssig = i1d3_senssig(p);
+	if (fwrite((void *)&ssig, sizeof(unsigned int), 1, fp) != 1
+	 || fwrite((void *)p->calcache, sizeof(p->calcache), 1, fp) != 1
+	 || fwrite((void *)&p->calcache_next, sizeof(int), 1, fp) != 1)
+		ef = 1;
+	if (fclose(fp) != 0)
+		ef = 2;
+
+	if (ef != 0) {
+		a1logd(p->log,2,"i1d3_save_calcache: writing '%s' failed with %d\n",cal_paths[0],ef);
+		delete_file(cal_paths[0]);
+	} else {
+		a1logd(p->log,3,"i1d3_save_calcache: saved '%s'\n",cal_paths[0]);
+	}
+	xdg_free(cal_paths, no_paths);
+}
+
+#endif /* CACHE_CALMAT */
+
 /* Set the calibration to the currently preset type */
 static inst_code
 i1d3_set_cal(i1d3 *p) {
 	inst_code ev = inst_ok;
 
 	if (p->samples != NULL && p->nsamp > 0) {
+		unsigned int sig = i1d3_calsig(p);
+		int i;
+
+		/* Use the matrix computed earlier for the same samples if we can, */
+		/* so that switching between display types is quick. */
+		for (i = 0; i < I1D3_NCALCACHE; i++) {
+			if (p->calcache[i].nsamp == p->nsamp && p->calcache[i].sig == sig)
+				break;
+		}
+		if (i < I1D3_NCALCACHE) {
+			a1logd(p->log, 4, "i1d3_set_cal: using cached ccss matrix %d\n",i);
+			icmCpy3x3(p->emis_cal, p->calcache[i].emis_cal);
 
 		/* Create matrix for specified samples */
-		if ((ev = i1d3_comp_calmat(p, p->emis_cal, p->obType, p->custObserver,
-			                       p->sens, p->samples, p->nsamp)) != inst_ok) {
-			a1logd(p->log, 1, "i1d3_set_cal: comp_calmat ccss failed with rv = 0x%x\n",ev);
-			return ev;
+		} else {
+			if ((ev = i1d3_comp_calmat(p, p->emis_cal, p->obType, p->custObserver,
+				                       p->sens, p->samples, p->nsamp)) != inst_ok) {
+				a1logd(p->log, 1, "i1d3_set_cal: comp_calmat ccss failed with rv = 0x%x\n",ev);
+				return ev;
+			}
+			i = p->calcache_next;
+			p->calcache_next = (p->calcache_next + 1) % I1D3_NCALCACHE;
+			p->calcache[i].sig = sig;
+			p->calcache[i].nsamp = p->nsamp;
+			icmCpy3x3(p->calcache[i].emis_cal, p->emis_cal);
+#ifdef CACHE_CALMAT
+			i1d3_save_calcache(p);
+#endif
 		}
 		/* Use MIbLSr for ambient */
 		if ((ev = i1d3_comp_calmat(p, p->ambi_cal, p->obType, p->custObserver,
@@ -2580,6 +2380,104 @@ static int i1d3_diff_thread(void *pp) {
 
 static inst_code set_default_disp_type(i1d3 *p);
 
+#ifdef CACHE_EXTEE
+
+/* The external EEProm holds the factory calibration and doesn't change, */
+/* but reading it takes about 140 HID transactions. Keep a copy on the */
+/* local system keyed by serial number, so that only the header has to */
+/* be read to confirm that it belongs to this instrument. */
+
+/* Simple checksum of the copy */
+static unsigned int i1d3_extEE_chsum(unsigned char *buf, int len) {
+	unsigned int chsum = 0;
+	int i;
+
+	for (i = 0; i < len; i++)
+		chsum = ((chsum << 13) | (chsum >> (32-13))) + buf[i];
+	return chsum;
+}
+
+/* Read the local copy of the external EEProm. */
+/* Return nz if there is a valid copy */
+static int i1d3_restore_extEE(i1d3 *p, unsigned char *buf) {
+	char nmode[10];
+	char cal_name[100];
+	char **cal_paths = NULL;
+	int no_paths = 0;
+	FILE *fp;
+	unsigned int chsum;
+	int rv = 0;
+
+	strcpy(nmode, "r");
+#if defined(O_BINARY) || defined(_O_BINARY)
+	strcat(nmode, "b");
+#endif
+	sprintf(cal_name, "ArgyllCMS/.i1d3_%s.ee", p->serial_no);
+	if ((no_paths = xdg_bds(NULL, &cal_paths, xdg_cache, xdg_read, xdg_user, xdg_none,
+		                                                                     cal_name)) < 1) {
+		a1logd(p->log,3,"i1d3_restore_extEE: no copy of the external EEProm\n");
+		return 0;
+	}
+
+	if ((fp = fopen(cal_paths[0], nmode)) != NULL) {
+		if (fread((void *)buf, 1, 8192, fp) == 8192
+		 && fread((void *)&chsum, sizeof(unsigned int), 1, fp) == 1
+		 && chsum == i1d3_extEE_chsum(buf, 8192))
+			rv = 1;
+		fclose(fp);
+	}
+	a1logd(p->log,3,"i1d3_restore_extEE: '%s' %s\n",cal_paths[0], rv ? "is valid" : "failed");
+	xdg_free(cal_paths, no_paths);
+
+	return rv;
+}
+
+/* Save a copy of the external EEProm to the local system */
+static void i1d3_save_extEE(i1d3 *p, unsigned char *buf) {
+	char nmode[10];
+	char cal_name[100];
+	char **cal_paths = NULL;
+	int no_paths = 0;
+	FILE *fp;
+	unsigned int chsum;
+	int ef = 0;
+
+	strcpy(nmode, "w");
+#if defined(O_BINARY) || defined(_O_BINARY)
+	strcat(nmode, "b");
+#endif
+	sprintf(cal_name, "ArgyllCMS/.i1d3_%s.ee", p->serial_no);
+	if ((no_paths = xdg_bds(NULL, &cal_paths, xdg_cache, xdg_write, xdg_user, xdg_none,
+		                                                                      cal_name)) < 1) {
+		a1logd(p->log,2,"i1d3_save_extEE: xdg_bds returned no paths\n");
+		return;
+	}
+
+	if (create_parent_directories(cal_paths[0])
+	 || (fp = fopen(cal_paths[0], nmode)) == NULL) {
+		a1logd(p->log,2,"i1d3_save_extEE: failed to open '%s' for writing\n",cal_paths[0]);
+		xdg_free(cal_paths, no_paths);
+		return;
+	}
+
+	chsum = i1d3_extEE_chsum(buf, 8192);
+	if (fwrite((void *)buf, 1, 8192, fp) != 8192
+	 || fwrite((void *)&chsum, sizeof(unsigned int), 1, fp) != 1)
+		ef = 1;
+	if (fclose(fp) != 0)
+		ef = 2;
+
+	if (ef != 0) {
+		a1logd(p->log,2,"i1d3_save_extEE: writing '%s' failed with %d\n",cal_paths[0],ef);
+		delete_file(cal_paths[0]);
+	} else {
+		a1logd(p->log,3,"i1d3_save_extEE: saved '%s'\n",cal_paths[0]);
+	}
+	xdg_free(cal_paths, no_paths);
+}
+
+#endif /* CACHE_EXTEE */
+
 /* Initialise the I1D3 */
 static inst_code
 i1d3_init_inst(inst *pp) {
@@ -2587,6 +2485,7 @@ i1d3_init_inst(inst *pp) {
 	inst_code ev = inst_ok;
 	int i, stat;
 	unsigned char buf[8192];
+	int eecopy = 0;			/* nz if buf holds the local copy of the external EEProm */
 
 	a1logd(p->log, 2, "i1d3_init_inst: called, debug = %d\n",p->log->debug);
 
@@ -2644,6 +2543,20 @@ i1d3_init_inst(inst *pp) {
 	if ((ev = i1d3_decode_intEE(p, buf)) != inst_ok)
 		return ev;
 
+#ifdef CACHE_EXTEE
+	/* Use the local copy if its header matches the instrument */
+	{
+		unsigned char hbuf[I1D3_EEHDR];
+
+		if ((ev = i1d3_read_external_eeprom(p,0,I1D3_EEHDR,hbuf)) != inst_ok)
+			return ev;
+		if (i1d3_restore_extEE(p, buf) && memcmp(hbuf, buf, I1D3_EEHDR) == 0) {
+			a1logd(p->log, 3, "i1d3_init_inst: using local copy of external EEPROM\n");
+			eecopy = 1;
+		}
+	}
+	if (!eecopy)
+#endif
 	if ((ev = i1d3_read_external_eeprom(p,0,8192,buf)) != inst_ok)
 		return ev;
 	if (p->log->debug >= 8) {
@@ -2653,6 +2566,10 @@ i1d3_init_inst(inst *pp) {
 	/* Decode the External EEPRom */
 	if ((ev = i1d3_decode_extEE(p, buf)) != inst_ok)
 		return ev;
+#ifdef CACHE_EXTEE
+	if (!eecopy)
+		i1d3_save_extEE(p, buf);
+#endif
 
 	/* Set known constants */
 	p->clk_freq = 12e6;				/* 12 Mhz */
@@ -2660,11 +2577,17 @@ i1d3_init_inst(inst *pp) {
 	p->dinttime = 0.2;				/* 0.2 second integration time default */
 	p->inttime = p->dinttime;		/* Start in non-refresh mode */
 	p->mininttime = p->inttime;			/* Current value */
+	p->tedges = 200.0;				/* Adaptive re-measure target edge count */
+	p->maxintt = 6.0;				/* Adaptive re-measure time budget */
 
 	/* Create the default calibrations */
 
 	p->obType = icxOT_CIE_1931_2;	/* Set the default ccss observer */
 
+#ifdef CACHE_CALMAT
+	i1d3_restore_calcache(p);
+#endif
+
 	/* Setup the default display type */
 	if ((ev = set_default_disp_type(p)) != inst_ok) {
 		return ev;
@@ -3242,6 +3165,86 @@ int *pinstmsec) {    /* Return instrument reaction time in msec */
 #undef DINTT
 #undef NDMXTIME
 
+/* Sample a display transition response. It is assumed that */
+/* white_change(init) has been called, and that white_change() */
+/* will be called at the time the patch changes color. */
+#define DINTT 0.005			/* Too short hits blanking */
+
+static inst_code i1d3_meas_response(
+inst *pp,
+int msamp,			/* Maximum number of samples to return */
+double *sec,		/* Return sample time in seconds */
+double *lev,		/* Return sample relative light level */
+int *nsamp,			/* Return number of samples */
+double maxsec) {	/* Maximum time to sample for */
+	i1d3 *p = (i1d3 *)pp;
+	inst_code ev = inst_ok;
+	int i;
+	double putime, cutime, stime;
+	double rgb[3];
+	double inttime = DINTT;
+	int isdeb;
+	int isth;
+
+	*nsamp = 0;
+
+	if (!p->gotcoms)
+		return inst_no_coms;
+
+	if (!p->inited)
+		return inst_no_init;
+
+	if (usec_time() < 0.0) {
+		a1loge(p->log, inst_internal_error, "i1d3_meas_response: No high resolution timers\n");
+		return inst_internal_error; 
+	}
+
+	/* Turn debug and thread off so that they doesn't intefere with measurement timing */
+	isdeb = p->log->debug;
+	p->icom->log->debug = 0;
+	isth = p->th_en;
+	p->th_en = 0;
+
+	/* Read the samples */
+	stime = putime = usec_time() / 1000000.0;
+	for (i = 0; i < msamp; i++) {
+		if ((ev = i1d3_freq_measure(p, &inttime, rgb)) != inst_ok)
+			break;
+		cutime = usec_time() / 1000000.0;
+		sec[i] = 0.5 * (putime + cutime);	/* Mean of before and after stamp */
+		putime = cutime;
+		lev[i] = rgb[0] + rgb[1] + rgb[2];
+		if ((cutime - stime) > maxsec) {
+			i++;
+			break; 
+		}
+	}
+
+	/* Restore debugging & thread */
+	p->log->debug = isdeb;
+	p->th_en = isth;
+
+	if (ev != inst_ok) {
+		a1logd(p->log, 1, "i1d3_meas_response: measurement failed\n");
+		return ev;
+	}
+
+	if (p->whitestamp < 0.0) {
+		a1logd(p->log, 1, "i1d3_meas_response: Transition wasn't timestamped\n");
+		return inst_internal_error; 
+	}
+
+	/* Set the times to be transition relative */
+	for (*nsamp = i, i = 0; i < *nsamp; i++)
+		sec[i] -= p->whitestamp / 1000000.0;
+
+	a1logd(p->log, 2, "i1d3_meas_response: returning %d samples over %f secs\n",
+	                                   *nsamp, *nsamp > 0 ? sec[*nsamp-1] - sec[0] : 0.0);
+
+	return inst_ok;
+}
+#undef DINTT
+
 /* Timestamp the white patch change during meas_delay() */
 /* Initialise the whitestap to invalid if init nz */
 static inst_code i1d3_white_change(
@@ -3478,6 +3481,8 @@ i1d3_del(inst *pp) {
 	if (pp != NULL) {
 		i1d3 *p = (i1d3 *)pp;
 
+		if (p->strm != NULL)		/* Stop any streaming thread */
+			p->stream_stop(pp);
 		if (p->th != NULL) {		/* Terminate diffuser monitor thread  */
 			int i;
 			p->th_term = 1;			/* Tell thread to exit on error */
@@ -3507,6 +3512,7 @@ inst3_capability *pcap3) {
 	i1d3 *p = (i1d3 *)pp;
 	inst_mode cap1 = 0;
 	inst2_capability cap2 = 0;
+	inst3_capability cap3 = 0;
 
 	cap1 |= inst_mode_emis_spot
 	     |  inst_mode_emis_tele
@@ -3528,7 +3534,10 @@ inst3_capability *pcap3) {
 	     |  inst2_set_min_int_time
 	        ;
 
+	cap3 |= inst3_stream;
+
 	if (p->btype != i1d3_munkdisp) {
+		cap3 |= inst3_meas_disp_settle;
 		cap2 |= inst2_meas_disp_update;
 		cap2 |= inst2_get_refresh_rate;
 		cap2 |= inst2_set_refresh_rate;
@@ -3539,7 +3548,7 @@ inst3_capability *pcap3) {
 	if (pcap2 != NULL)
 		*pcap2 = cap2;
 	if (pcap3 != NULL)
-		*pcap3 = inst3_none;
+		*pcap3 = cap3;
 }
 
 /* Return current or given configuration available measurement modes. */
@@ -3883,6 +3892,34 @@ i1d3_get_set_opt(inst *pp, inst_opt_type m, ...) {
 		return inst_ok;
 	}
 
+	/* Set the adaptive dark measurement speed/accuracy trade-off */
+	if (m == inst_opt_set_adapt_speed) {
+		va_list args;
+		double dval;
+
+		va_start(args, m);
+		dval = va_arg(args, double);
+		va_end(args);
+
+		if (dval <= 0.0)
+			dval = 1.0;
+
+		/* Target edge count scales inversely with speed, */
+		/* and the time budget is limited by the 20 second timeout. */
+		p->tedges = 200.0/dval;
+		if (p->tedges < 10.0)
+			p->tedges = 10.0;
+		p->maxintt = 6.0/dval;
+		if (p->maxintt > 6.0)
+			p->maxintt = 6.0;
+		else if (p->maxintt < p->inttime)
+			p->maxintt = p->inttime;
+
+		a1logd(p->log,3,"i1d3: adaptive speed %f, target edges %f, max. int. time %f\n",
+		                                                   dval, p->tedges, p->maxintt);
+		return inst_ok;
+	}
+
 	/* Set the minimum integration time */
 	if (m == inst_opt_set_min_int_time) {
 		va_list args;
@@ -4096,6 +4133,7 @@ extern i1d3 *new_i1d3(icoms *icom, instType dtype) {
 	p->calibrate         = i1d3_calibrate;
 	p->meas_delay        = i1d3_meas_delay;
 	p->white_change      = i1d3_white_change;
+	p->meas_response     = i1d3_meas_response;
 	p->get_refr_rate     = i1d3_get_refr_rate;
 	p->set_refr_rate     = i1d3_set_refr_rate;
 	p->interp_error      = i1d3_interp_error;
@@ -102,6 +102,8 @@ typedef enum {
 	i1d3_period       = 2	/* Adaptive period measurement */
 } i1d3_mmode;
 
+#define I1D3_NCALCACHE 8	/* Number of computed calibration matrices to remember */
+
 /* I1D3 communication object */
 struct _i1d3 {
 	INST_OBJ_BASE
@@ -147,6 +149,14 @@ struct _i1d3 {
 	xspect *samples;			/* Copy of current calibration spectral samples, NULL if none */
 	int nsamp;					/* Number of samples, 0 if none */
 
+	/* Emission calibration matrices already computed from spectral samples */
+	struct {
+		unsigned int sig;		/* Signature of the samples and observer */
+		int nsamp;				/* Number of samples, 0 if entry unused */
+		double emis_cal[3][3];	/* Computed matrix */
+	} calcache[I1D3_NCALCACHE];
+	int calcache_next;			/* Next entry to replace */
+
 	/* Computed factors and state */
 	int    rrset;				/* Flag, nz if the refresh rate has been determined */
 	double refperiod;			/* if > 0.0 in refmode, target int time quantization */
@@ -157,6 +167,8 @@ struct _i1d3 {
 	double dinttime;			/* default integration time = 0.2 seconds */
 	double mininttime;			/* current minimum integration time (doubled for refresh) */
 	double inttime;				/* current (quantized, doubled) integration time = 0.2 seconds */
+	double tedges;				/* Adaptive re-measure target edge count = 200 */
+	double maxintt;				/* Adaptive re-measure maximum integration time = 6 seconds */
 
 	double transblend;			/* Blend between fixed and adaptive integration */
 								/* at low light levels */
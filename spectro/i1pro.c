@@ -182,6 +182,13 @@ i1pro_determine_capabilities(i1pro *p) {
 
 	p->cap3 = inst3_none;
 
+	if (p->m != NULL) {
+		i1proimp *m = (i1proimp *)p->m;
+		i1pro_state *s = &m->ms[m->mmode];
+		if (s->emiss && !s->scan)
+			p->cap3 |= inst3_stream;
+	}
+
 	return inst_ok;
 }
 
@@ -942,6 +949,8 @@ static void
 i1pro_del(inst *pp) {
 	i1pro *p = (i1pro *)pp;
 
+	if (p->strm != NULL)		/* Stop any streaming thread */
+		p->stream_stop(pp);
 	del_i1proimp(p);
 	if (p->icom != NULL)
 		p->icom->del(p->icom);
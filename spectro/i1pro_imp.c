@@ -120,6 +120,8 @@
 #define SW_THREAD_TIMEOUT	(10 * 60.0) 	/* [10 Min] Switch read thread timeout */
 
 #define SINGLE_READ		/* [Def] Use a single USB read for scan to eliminate latency issues. */
+#define BG_SCAN_CONV	/* [Def] Rev D and later, read scans in pieces and convert the */
+						/* readings in a background thread as they arrive. */
 #define HIGH_RES		/* [Def] Enable high resolution spectral mode code. Dissable */
 						/* to break dependency on rspl library. */
 # undef FAST_HIGH_RES_SETUP	/* Slightly better accuracy ? */
@@ -168,6 +170,7 @@
 //								/* These factors get the same behaviour as the GMB drivers. */
 
 #define NSEN_MAX 140			/* Maximum nsen value we can cope with */
+#define WAV_BLK 8				/* Readings per block in raw to wavelength conversion (must be 8) */
 
 /* High res mode settings */
 #define HIGHRES_SHORT 370.0		/* i1pro2 uses more of the CCD, */
@@ -353,6 +356,9 @@ i1pro_code add_i1proimp(i1pro *p) {
 	m->lo_secs = 2000000000;		/* A very long time */
 	m->msec = msec_time();
 
+	amutex_init(m->sc_lock);
+	acond_init(m->sc_cond);
+
 	p->m = (void *)m;
 	return I1PRO_OK;
 }
@@ -441,6 +447,12 @@ void del_i1proimp(i1pro *p) {
 		if (m->raw2wav != NULL)
 			m->raw2wav->del(m->raw2wav);
 
+		/* Background scan conversion */
+		if (m->sc_absraw != NULL)
+			free_dmatrix(m->sc_absraw, 0, m->sc_max-1, -1, m->nraw-1);
+		acond_del(m->sc_cond);
+		amutex_del(m->sc_lock);
+
 		free(m);
 		p->m = NULL;
 	}
@@ -4817,6 +4829,376 @@ i1pro_code i1pro_touch_calibration(i1pro *p) {
 	return ev;
 }
 
+
+#ifdef HIGH_RES
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Cache of the derived high resolution tables. Creating these */
+/* involves fitting rspl's and integrating filter shapes, which */
+/* dominates the instrument open time, so keep the result on the */
+/* local system keyed by serial number, firmware revision and a */
+/* signature of everything they are derived from. */
+
+/* Accumulate the signature of a raw to wav filter table */
+static void i1pro_hr_sig_r2wtab(i1pnonv *x, i1pro_r2wtab *t, int nwav) {
+	int j, nc, has = t->nocoef != NULL;
+
+	update_chsum(x, (unsigned char *)&has, sizeof(int));
+	if (!has)
+		return;
+	for (nc = j = 0; j < nwav; j++)
+		nc += t->nocoef[j];
+	update_chsum(x, (unsigned char *)t->index, nwav * sizeof(int));
+	update_chsum(x, (unsigned char *)t->nocoef, nwav * sizeof(int));
+	update_chsum(x, (unsigned char *)t->coef, nc * sizeof(double));
+}
+
+/* Accumulate the signature of an optional vector */
+static void i1pro_hr_sig_vec(i1pnonv *x, double *v, int n) {
+	int has = v != NULL;
+
+	update_chsum(x, (unsigned char *)&has, sizeof(int));
+	if (has)
+		update_chsum(x, (unsigned char *)v, n * sizeof(double));
+}
+
+/* Return a signature of the calibration the high res tables are derived from */
+static unsigned int i1pro_hr_signature(i1pro *p) {
+	i1proimp *m = (i1proimp *)p->m;
+	i1pnonv x;
+	int i, has;
+
+	x.ef = 0;
+	x.chsum = 0;
+	x.nbytes = 0;
+
+	update_chsum(&x, (unsigned char *)m->wl_short, 2 * sizeof(double));
+	update_chsum(&x, (unsigned char *)m->wl_long, 2 * sizeof(double));
+
+	i1pro_hr_sig_r2wtab(&x, &m->mtx_o, m->nwav[0]);
+	i1pro_hr_sig_r2wtab(&x, &m->mtx[0][0], m->nwav[0]);
+	i1pro_hr_sig_r2wtab(&x, &m->mtx[0][1], m->nwav[0]);
+
+	i1pro_hr_sig_vec(&x, m->white_ref[0], m->nwav[0]);
+	i1pro_hr_sig_vec(&x, m->emis_coef[0], m->nwav[0]);
+	i1pro_hr_sig_vec(&x, m->amb_coef[0], m->nwav[0]);
+	has = m->straylight[0] != NULL;
+	update_chsum(&x, (unsigned char *)&has, sizeof(int));
+	if (has) {
+		for (i = 0; i < m->nwav[0]; i++)
+			update_chsum(&x, (unsigned char *)m->straylight[0][i], m->nwav[0] * sizeof(double));
+	}
+
+	/* Rev E filters depend on the current wavelength calibration */
+	if (p->dtype == instI1Pro2) {
+		update_chsum(&x, (unsigned char *)m->wlpoly1, 4 * sizeof(double));
+		update_chsum(&x, (unsigned char *)m->wlpoly2, 4 * sizeof(double));
+		update_chsum(&x, (unsigned char *)&m->wl_led_ref_off, sizeof(double));
+		update_chsum(&x, (unsigned char *)&m->ms[m->mmode].wl_led_off, sizeof(double));
+	}
+
+	return x.chsum;
+}
+
+/* Save the derived high res tables to the local system */
+static i1pro_code i1pro_save_hr_cache(i1pro *p) {
+	i1proimp *m = (i1proimp *)p->m;
+	int i, j;
+	char nmode[10];
+	char cal_name[100];		/* Name */
+	char **cal_paths = NULL;
+	int no_paths = 0;
+	FILE *fp;
+	i1pnonv x;
+	int ss, nc;
+	int argyllversion = ARGYLL_VERSION;
+	unsigned int sig;
+	int hasref, hasemis, hasamb, hasstray;
+
+	/* emis_coef[1] has been replaced by a calibrated version, */
+	/* so we can't save what it is derived from. */
+	if (m->emis_hr_cal)
+		return I1PRO_OK;
+
+	strcpy(nmode, "w");
+#if !defined(O_CREAT) && !defined(_O_CREAT)
+# error "Need to #include fcntl.h!"
+#endif
+#if defined(O_BINARY) || defined(_O_BINARY)
+	strcat(nmode, "b");
+#endif
+
+	/* Create the file name */
+	sprintf(cal_name, "ArgyllCMS/.i1p_%d_hr.cal", m->serno);
+	if ((no_paths = xdg_bds(NULL, &cal_paths, xdg_cache, xdg_write, xdg_user, xdg_none,
+		                                                                      cal_name)) < 1) {
+		a1logd(p->log,1,"i1pro_save_hr_cache xdg_bds returned no paths\n");
+		return I1PRO_INT_CAL_SAVE;
+	}
+
+	a1logd(p->log,2,"i1pro_save_hr_cache saving to file '%s'\n",cal_paths[0]);
+
+	if (create_parent_directories(cal_paths[0])
+	 || (fp = fopen(cal_paths[0], nmode)) == NULL) {
+		a1logd(p->log,2,"i1pro_save_hr_cache failed to open file for writing\n");
+		xdg_free(cal_paths, no_paths);
+		return I1PRO_INT_CAL_SAVE;
+	}
+	
+	x.ef = 0;
+	x.chsum = 0;
+	x.nbytes = 0;
+
+	ss = sizeof(i1pro_state) + sizeof(i1proimp);
+	sig = i1pro_hr_signature(p);
+	hasref = m->white_ref[1] != NULL;
+	hasemis = m->emis_coef[1] != NULL;
+	hasamb = m->amb_coef[1] != NULL;
+	hasstray = m->straylight[1] != NULL;
+
+	/* Identification */
+	write_ints(&x, fp, &argyllversion, 1);
+	write_ints(&x, fp, &ss, 1);
+	write_ints(&x, fp, &m->serno, 1);
+	write_ints(&x, fp, &m->fwrev, 1);
+	write_ints(&x, fp, (int *)&m->nraw, 1);
+	write_ints(&x, fp, (int *)&m->nwav[0], 1);
+	write_ints(&x, fp, (int *)&m->nwav[1], 1);
+	write_ints(&x, fp, (int *)&sig, 1);
+
+	/* Upsampled references */
+	write_ints(&x, fp, &hasref, 1);
+	write_ints(&x, fp, &hasemis, 1);
+	write_ints(&x, fp, &hasamb, 1);
+	write_ints(&x, fp, &hasstray, 1);
+	if (hasref)
+		write_doubles(&x, fp, m->white_ref[1], m->nwav[1]);
+	if (hasemis)
+		write_doubles(&x, fp, m->emis_coef[1], m->nwav[1]);
+	if (hasamb)
+		write_doubles(&x, fp, m->amb_coef[1], m->nwav[1]);
+	if (hasstray) {
+		for (i = 0; i < m->nwav[1]; i++)
+			write_doubles(&x, fp, m->straylight[1][i], m->nwav[1]);
+	}
+
+	/* High res filters for emis/trans and reflective */
+	for (i = 0; i < 2; i++) {
+		for (nc = j = 0; j < m->nwav[1]; j++)
+			nc += m->mtx_c[1][i].nocoef[j];
+		write_ints(&x, fp, m->mtx_c[1][i].index, m->nwav[1]);
+		write_ints(&x, fp, m->mtx_c[1][i].nocoef, m->nwav[1]);
+		write_ints(&x, fp, &nc, 1);
+		write_doubles(&x, fp, m->mtx_c[1][i].coef, nc);
+	}
+
+	write_ints(&x, fp, (int *)&x.chsum, 1);
+
+	if (fclose(fp) != 0)
+		x.ef = 2;
+
+	if (x.ef != 0) {
+		a1logd(p->log,2,"Writing hi-res cache file failed with %d\n",x.ef);
+		delete_file(cal_paths[0]);
+		xdg_free(cal_paths, no_paths);
+		return I1PRO_INT_CAL_SAVE;
+	}
+	a1logd(p->log,2,"Writing hi-res cache file succeeded\n");
+	xdg_free(cal_paths, no_paths);
+
+	return I1PRO_OK;
+}
+
+/* Restore the derived high res tables from the local system, */
+/* if they match the current calibration. */
+static i1pro_code i1pro_restore_hr_cache(i1pro *p) {
+	i1proimp *m = (i1proimp *)p->m;
+	i1pro_code ev = I1PRO_INT_CAL_RESTORE;
+	int i, j;
+	char nmode[10];
+	char cal_name[100];		/* Name */
+	char **cal_paths = NULL;
+	int no_paths = 0;
+	FILE *fp;
+	i1pnonv x;
+	int argyllversion, ss, serno, fwrev, nraw, nwav0, nwav1, chsum1, chsum2;
+	unsigned int sig;
+	int hasref, hasemis, hasamb, hasstray;
+	double *ref = NULL, *emis = NULL, *amb = NULL, **stray = NULL;
+	i1pro_r2wtab mtx[2];
+
+	memset(mtx, 0, sizeof(mtx));
+
+	strcpy(nmode, "r");
+#if !defined(O_CREAT) && !defined(_O_CREAT)
+# error "Need to #include fcntl.h!"
+#endif
+#if defined(O_BINARY) || defined(_O_BINARY)
+	strcat(nmode, "b");
+#endif
+	/* Create the file name */
+	sprintf(cal_name, "ArgyllCMS/.i1p_%d_hr.cal", m->serno);
+	if ((no_paths = xdg_bds(NULL, &cal_paths, xdg_cache, xdg_read, xdg_user, xdg_none,
+		                                                                     cal_name)) < 1) {
+		a1logd(p->log,2,"i1pro_restore_hr_cache xdg_bds failed to locate file'\n");
+		return I1PRO_INT_CAL_RESTORE;
+	}
+
+	a1logd(p->log,2,"i1pro_restore_hr_cache restoring from file '%s'\n",cal_paths[0]);
+
+	if ((fp = fopen(cal_paths[0], nmode)) == NULL) {
+		a1logd(p->log,2,"i1pro_restore_hr_cache failed to open file for reading\n");
+		xdg_free(cal_paths, no_paths);
+		return I1PRO_INT_CAL_RESTORE;
+	}
+
+	x.ef = 0;
+	x.chsum = 0;
+	x.nbytes = 0;
+
+	/* Check the file identification */
+	read_ints(&x, fp, &argyllversion, 1);
+	read_ints(&x, fp, &ss, 1);
+	read_ints(&x, fp, &serno, 1);
+	read_ints(&x, fp, &fwrev, 1);
+	read_ints(&x, fp, &nraw, 1);
+	read_ints(&x, fp, &nwav0, 1);
+	read_ints(&x, fp, &nwav1, 1);
+	read_ints(&x, fp, (int *)&sig, 1);
+	if (x.ef != 0
+	 || argyllversion != ARGYLL_VERSION
+	 || ss != (sizeof(i1pro_state) + sizeof(i1proimp))
+	 || serno != m->serno
+	 || fwrev != m->fwrev
+	 || nraw != m->nraw
+	 || nwav0 != m->nwav[0]
+	 || nwav1 != m->nwav[1]
+	 || sig != i1pro_hr_signature(p)) {
+		a1logd(p->log,2,"Hi-res cache doesn't match current calibration\n");
+		goto reserr;
+	}
+
+	read_ints(&x, fp, &hasref, 1);
+	read_ints(&x, fp, &hasemis, 1);
+	read_ints(&x, fp, &hasamb, 1);
+	read_ints(&x, fp, &hasstray, 1);
+	if (x.ef != 0)
+		goto reserr;
+
+	if (hasref) {
+		if ((ref = (double *)calloc(m->nwav[1], sizeof(double))) == NULL)
+			goto reserr;
+		read_doubles(&x, fp, ref, m->nwav[1]);
+	}
+	if (hasemis) {
+		if ((emis = (double *)calloc(m->nwav[1], sizeof(double))) == NULL)
+			goto reserr;
+		read_doubles(&x, fp, emis, m->nwav[1]);
+	}
+	if (hasamb) {
+		if ((amb = (double *)calloc(m->nwav[1], sizeof(double))) == NULL)
+			goto reserr;
+		read_doubles(&x, fp, amb, m->nwav[1]);
+	}
+	if (hasstray) {
+		stray = dmatrixz(0, m->nwav[1]-1, 0, m->nwav[1]-1);  
+		for (i = 0; i < m->nwav[1]; i++)
+			read_doubles(&x, fp, stray[i], m->nwav[1]);
+	}
+
+	for (i = 0; i < 2 && x.ef == 0; i++) {
+		int nc, tnc;
+
+		if ((mtx[i].index = (int *)calloc(m->nwav[1], sizeof(int))) == NULL
+		 || (mtx[i].nocoef = (int *)calloc(m->nwav[1], sizeof(int))) == NULL)
+			goto reserr;
+		read_ints(&x, fp, mtx[i].index, m->nwav[1]);
+		read_ints(&x, fp, mtx[i].nocoef, m->nwav[1]);
+		read_ints(&x, fp, &nc, 1);
+		for (tnc = j = 0; j < m->nwav[1]; j++)
+			tnc += mtx[i].nocoef[j];
+		if (x.ef != 0 || nc != tnc || nc <= 0
+		 || (mtx[i].coef = (double *)calloc(nc, sizeof(double))) == NULL)
+			goto reserr;
+		read_doubles(&x, fp, mtx[i].coef, nc);
+	}
+
+	/* Check the checksum */
+	chsum1 = x.chsum;
+	read_ints(&x, fp, &chsum2, 1);
+	if (x.ef != 0 || chsum1 != chsum2) {
+		a1logd(p->log,2,"Hi-res cache checksum didn't verify, bytes %d, got 0x%x, expected 0x%x\n",x.nbytes,chsum1, chsum2);
+		goto reserr;
+	}
+
+	/* All verified, so install the tables */
+	if (ref != NULL) {
+		if (m->white_ref[1] != NULL)
+			free(m->white_ref[1]);
+		m->white_ref[1] = ref;
+		ref = NULL;
+	}
+	if (emis != NULL && !m->emis_hr_cal) {	/* Don't replace a calibrated one */
+		if (m->emis_coef[1] != NULL)
+			free(m->emis_coef[1]);
+		m->emis_coef[1] = emis;
+		emis = NULL;
+	}
+	if (amb != NULL) {
+		if (m->amb_coef[1] != NULL)
+			free(m->amb_coef[1]);
+		m->amb_coef[1] = amb;
+		amb = NULL;
+	}
+	if (stray != NULL) {
+		if (m->straylight[1] != NULL)
+			free_dmatrix(m->straylight[1], 0, m->nwav[1]-1, 0, m->nwav[1]-1);  
+		m->straylight[1] = stray;
+		stray = NULL;
+	}
+	for (i = 0; i < 2; i++) {
+		if (m->mtx_c[1][i].index != NULL)
+			free(m->mtx_c[1][i].index);
+		if (m->mtx_c[1][i].nocoef != NULL)
+			free(m->mtx_c[1][i].nocoef);
+		if (m->mtx_c[1][i].coef != NULL)
+			free(m->mtx_c[1][i].coef);
+		m->mtx_c[1][i] = mtx[i];
+		m->mtx[1][i] = m->mtx_c[1][i];
+		mtx[i].index = NULL;
+		mtx[i].nocoef = NULL;
+		mtx[i].coef = NULL;
+	}
+
+	a1logd(p->log,2,"i1pro_restore_hr_cache done\n");
+	ev = I1PRO_OK;
+
+ reserr:;
+	if (ref != NULL)
+		free(ref);
+	if (emis != NULL)
+		free(emis);
+	if (amb != NULL)
+		free(amb);
+	if (stray != NULL)
+		free_dmatrix(stray, 0, m->nwav[1]-1, 0, m->nwav[1]-1);  
+	for (i = 0; i < 2; i++) {
+		if (mtx[i].index != NULL)
+			free(mtx[i].index);
+		if (mtx[i].nocoef != NULL)
+			free(mtx[i].nocoef);
+		if (mtx[i].coef != NULL)
+			free(mtx[i].coef);
+	}
+
+	fclose(fp);
+	xdg_free(cal_paths, no_paths);
+
+	return ev;
+}
+
+#endif /* HIGH_RES */
+
 #endif /* ENABLE_NONVCAL */
 
 /* ============================================================ */
@@ -5434,10 +5816,12 @@ i1pro_code i1pro_read_patches_1(
 		return ev;
 	}
 
-	if ((ev = i1pro_readmeasurement(p, minnummeas, m->c_measmodeflags & I1PRO_MMF_SCAN,
-	                                             buf, bsize, nmeasuered, mmod)) != I1PRO_OK) {
-		return ev;
-	}
+	/* Convert scan readings as they arrive */
+	i1pro_scan_conv_start(p, *inttime, gainmode, buf, bsize);
+
+	ev = i1pro_readmeasurement(p, minnummeas, m->c_measmodeflags & I1PRO_MMF_SCAN,
+	                                             buf, bsize, nmeasuered, mmod);
+	i1pro_scan_conv_end(p, ev);
 
 	return ev;
 }
@@ -5471,17 +5855,32 @@ i1pro_code i1pro_read_patches_2(
 	if (gainmode)
 		darkthresh *= m->highgain;
 
-	/* Allocate temporaries */
-	multimes = dmatrix(0, nmeasuered-1, -1, m->nraw-1);
 	absraw = dmatrix(0, numpatches-1, -1, m->nraw-1);
 
-	/* Take a buffer full of raw readings, and convert them to */
-	/* absolute linearised sensor values. */
-	if ((ev = i1pro_sens_to_absraw(p, multimes, buf, nmeasuered, inttime, gainmode, &darkthresh))
-		                                                                             != I1PRO_OK) {
-		free_dmatrix(absraw, 0, numpatches-1, -1, m->nraw-1);
-		free_dmatrix(multimes, 0, nmeasuered-1, -1, m->nraw-1);
-		return ev;
+	/* If the scan readings were converted to absolute linearised sensor */
+	/* values as they arrived, take them over. */
+	/* (free_dmatrix() doesn't depend on the number of rows) */
+	if (m->sc_valid && m->sc_buf == buf && m->sc_nconv == nmeasuered
+	 && m->sc_inttime == inttime && m->sc_gainmode == gainmode) {
+		multimes = m->sc_absraw;
+		m->sc_absraw = NULL;
+		m->sc_valid = 0;
+		if (m->nsen > m->nraw)		/* Rev E */
+			darkthresh = m->sc_dtsum/(double)nmeasuered;
+		a1logd(p->log,3,"i1pro_read_patches_2: using %d background converted readings\n",
+		                                                                        nmeasuered);
+
+	} else {
+		multimes = dmatrix(0, nmeasuered-1, -1, m->nraw-1);
+
+		/* Take a buffer full of raw readings, and convert them to */
+		/* absolute linearised sensor values. */
+		if ((ev = i1pro_sens_to_absraw(p, multimes, buf, nmeasuered, inttime, gainmode, &darkthresh))
+			                                                                             != I1PRO_OK) {
+			free_dmatrix(absraw, 0, numpatches-1, -1, m->nraw-1);
+			free_dmatrix(multimes, 0, nmeasuered-1, -1, m->nraw-1);
+			return ev;
+		}
 	}
 
 	/* Subtract the black level */
@@ -6170,6 +6569,32 @@ static int buf2ushort(unsigned char *buf) {
 /* ============================================================ */
 /* lower level reading processing and computation */
 
+/* Apply the linearisation polynomial to a row of sensor values, */
+/* and scale the result. The loops run across the row so that they */
+/* can be vectorized, but compute exactly the same Horner evaluation */
+/* as doing it one value at a time. */
+static void i1pro_lin_row(
+	double *out,			/* Return scale * poly(in[]) */
+	double *in,				/* Sensor values (may be the same as out) */
+	int n,					/* Number of values */
+	double *polys,			/* Linearisation coefficients */
+	int npoly,				/* Number of coefficients */
+	double scale			/* Scale to apply */
+) {
+	double lval[NSEN_MAX];
+	int j, k;
+
+	for (j = 0; j < n; j++)
+		lval[j] = polys[npoly-1];
+	for (k = npoly-2; k >= 0; k--) {
+		double pk = polys[k];
+		for (j = 0; j < n; j++)
+			lval[j] = lval[j] * in[j] + pk;
+	}
+	for (j = 0; j < n; j++)
+		out[j] = lval[j] * scale;
+}
+
 /* Take a buffer full of sensor readings, and convert them to */
 /* absolute raw values. Linearise if Rev A..D */
 /* If RevE, fill in the [-1] value with the shielded cell values */
@@ -6245,16 +6670,25 @@ i1pro_code i1pro_sens_to_absraw(
 			}
 			absraw[i][-1] /= 6.0;
 		
-			for (bp += sskip, j = 0; j < m->nraw; j++, bp += 2) {
-				rval = buf2ushort(bp);
-				a1logd(p->log,9,"% 3d:rval 0x%x, ",j, rval);
-				a1logd(p->log,9,"srval 0x%x, ",rval);
-				fval = (double)(int)rval;
-				a1logd(p->log,9,"fval %.0f, ",fval);
+			bp += sskip;
+			if (p->log->debug >= 9) {
+				for (j = 0; j < m->nraw; j++, bp += 2) {
+					rval = buf2ushort(bp);
+					a1logd(p->log,9,"% 3d:rval 0x%x, ",j, rval);
+					a1logd(p->log,9,"srval 0x%x, ",rval);
+					fval = (double)(int)rval;
+					a1logd(p->log,9,"fval %.0f, ",fval);
+	
+					/* And scale to be an absolute sensor reading */
+					absraw[i][j] = fval * scale;
+					a1logd(p->log,9,"absval %.1f\n",fval * scale);
+				}
+			} else {
+				double *ar = absraw[i];
 
-				/* And scale to be an absolute sensor reading */
-				absraw[i][j] = fval * scale;
-				a1logd(p->log,9,"absval %.1f\n",fval * scale);
+				/* Fast path, with no per value debug */
+				for (j = 0; j < m->nraw; j++, bp += 2)
+					ar[j] = (double)buf2ushort(bp) * scale;
 			}
 		}
 		darkthresh /= ndarkthresh;
@@ -6290,6 +6724,28 @@ i1pro_code i1pro_sens_to_absraw(
 		for (bp = buf, i = 0; i < nummeas; i++) {
 			absraw[i][-1] = 1.0;		/* Not used in RevA-D */
 
+			/* Fast path, with no per value debug */
+			if (p->log->debug < 9) {
+				double *ar = absraw[i];
+
+				for (j = 0; j < 128; j++, bp += 2)  {
+					int rval = buf2ushort(bp);
+					if (rval >= (int)maxpve)
+						rval -= 0x00010000;	/* Convert to -ve */
+					ar[j] = (double)rval - avlastv;
+				}
+#ifdef ENABLE_NONLINCOR	
+				i1pro_lin_row(ar, ar, 128, polys, npoly, scale);
+#else
+				for (j = 0; j < 128; j++)
+					ar[j] *= scale;
+#endif
+				/* Duplicate last values in buffer to make up to 128 */
+				ar[0] = ar[1];
+				ar[127] = ar[126];
+				continue;
+			}
+
 			for (j = 0; j < 128; j++, bp += 2)  {
 				unsigned int rval;
 				double fval, lval;
@@ -6328,6 +6784,124 @@ i1pro_code i1pro_sens_to_absraw(
 	return I1PRO_OK;
 }
 
+/* Background scan conversion thread. */
+/* Converts readings to absolute raw values as they are read, */
+/* so that they are ready as soon as the scan finishes. */
+static int i1pro_scan_conv_thread(void *pp) {
+	i1pro *p = (i1pro *)pp;
+	i1proimp *m = (i1proimp *)p->m;
+	i1pro_code ev;
+
+	amutex_lock(m->sc_lock);
+	for (;;) {
+		int nread, nconv;
+		double darkthresh = 0.0;
+
+		while (m->sc_nconv >= m->sc_nread && !m->sc_end)
+			acond_wait(m->sc_cond, m->sc_lock);
+		nread = m->sc_nread;
+		nconv = m->sc_nconv;
+		if (nconv >= nread)			/* Scan has ended and we're done */
+			break;
+		amutex_unlock(m->sc_lock);
+
+		ev = i1pro_sens_to_absraw(p, m->sc_absraw + nconv, m->sc_buf + nconv * m->nsen * 2,
+		                     nread - nconv, m->sc_inttime, m->sc_gainmode, &darkthresh);
+
+		amutex_lock(m->sc_lock);
+		if (ev != I1PRO_OK) {
+			m->sc_ev = ev;
+			break;
+		}
+		m->sc_dtsum += darkthresh * (double)(nread - nconv);
+		m->sc_nconv = nread;
+	}
+	amutex_unlock(m->sc_lock);
+	return 0;
+}
+
+/* Start converting scan readings to absolute raw values in a background */
+/* thread, as they are read into buf. */
+void i1pro_scan_conv_start(
+	i1pro *p,
+	double inttime, 		/* Integration time used */
+	int gainmode,			/* Gain mode, 0 = normal, 1 = high */
+	unsigned char *buf,		/* Raw USB reading buffer */
+	int bsize				/* Bytes available in buffer */
+) {
+	i1proimp *m = (i1proimp *)p->m;
+	int nmax = bsize / (m->nsen * 2);
+
+	m->sc_valid = 0;
+
+#ifdef BG_SCAN_CONV
+	/* Only Rev D and later are robust to splitting the scan read, and */
+	/* subtmode needs the average of all the readings to convert them. */
+	if ((m->c_measmodeflags & I1PRO_MMF_SCAN) == 0
+	 || m->fwrev < 500 || m->subtmode || nmax <= 0)
+		return;
+
+	if (m->sc_absraw != NULL && m->sc_max < nmax) {
+		free_dmatrix(m->sc_absraw, 0, m->sc_max-1, -1, m->nraw-1);
+		m->sc_absraw = NULL;
+	}
+	if (m->sc_absraw == NULL) {
+		m->sc_absraw = dmatrix(0, nmax-1, -1, m->nraw-1);
+		m->sc_max = nmax;
+	}
+
+	m->sc_buf = buf;
+	m->sc_nread = 0;
+	m->sc_nconv = 0;
+	m->sc_end = 0;
+	m->sc_inttime = inttime;
+	m->sc_gainmode = gainmode;
+	m->sc_dtsum = 0.0;
+	m->sc_ev = I1PRO_OK;
+
+	if ((m->sc_thread = new_athread(i1pro_scan_conv_thread, (void *)p)) == NULL) {
+		a1logd(p->log,2,"i1pro_scan_conv_start: creating thread failed\n");
+		return;
+	}
+	a1logd(p->log,3,"i1pro_scan_conv_start: started background scan conversion\n");
+#endif /* BG_SCAN_CONV */
+}
+
+/* Tell the background conversion that nread readings are now in the buffer */
+void i1pro_scan_conv_add(i1pro *p, int nread) {
+	i1proimp *m = (i1proimp *)p->m;
+
+	if (m->sc_thread == NULL)
+		return;
+
+	amutex_lock(m->sc_lock);
+	m->sc_nread = nread;
+	acond_signal(m->sc_cond);
+	amutex_unlock(m->sc_lock);
+}
+
+/* Finish the background conversion once the scan read is complete */
+void i1pro_scan_conv_end(i1pro *p, i1pro_code ev) {
+	i1proimp *m = (i1proimp *)p->m;
+
+	if (m->sc_thread == NULL)
+		return;
+
+	amutex_lock(m->sc_lock);
+	m->sc_end = 1;
+	acond_signal(m->sc_cond);
+	amutex_unlock(m->sc_lock);
+
+	m->sc_thread->wait(m->sc_thread);
+	m->sc_thread->del(m->sc_thread);
+	m->sc_thread = NULL;
+
+	if (ev == I1PRO_OK && m->sc_ev == I1PRO_OK)
+		m->sc_valid = 1;
+	else
+		a1logd(p->log,3,"i1pro_scan_conv_end: read 0x%x, conversion 0x%x\n",ev,m->sc_ev);
+}
+
 /* Take a raw value, and convert it into an absolute raw value. */
 /* Note that linearisation is ignored, since it is assumed to be insignificant */
 /* to the black threshold and saturation values. */
@@ -7571,27 +8145,21 @@ void i1pro_sub_absraw(
 	
 		/* Subtract the black */
 		for (i = 0; i < nummeas; i++) {
+			double *ar = absraw[i];
+
 			for (j = 0; j < m->nraw; j++) {
 //				xx[j] = j, in[j] = absraw[i][j];
 
-				absraw[i][j] -= asub[j]; 		/* Subtract adjusted black */
+				ar[j] -= asub[j]; 		/* Subtract adjusted black */
 
 //				 res[j] = absraw[i][j] + (double)((int)(avgscell/20.0)) * 20.0;
+			}
 #ifdef ENABLE_NONLINCOR	
-				/* Linearise */
-				{
-					int k;
-					double fval, lval;
-
-					fval = absraw[i][j] / scale;		/* Scale back to sensor value range */
-
-					for (lval = polys[npoly-1], k = npoly-2; k >= 0; k--)
-						lval = lval * fval + polys[k];
-
-					absraw[i][j] = scale * lval;		/* Rescale back to absolute range */
-				}
+			/* Linearise */
+			for (j = 0; j < m->nraw; j++)
+				ar[j] /= scale;			/* Scale back to sensor value range */
+			i1pro_lin_row(ar, ar, m->nraw, polys, npoly, scale);	/* and back to absolute */
 #endif
-			}
 #ifdef PLOT_BLACK_SUBTRACT	/* Plot black adjusted levels */
 			printf("black = meas, red = black, green = adjuste black, blue = result\n"); 
 			do_plot6(xx, in, sub, adjsub, res, NULL, NULL, m->nraw);
@@ -7612,6 +8180,9 @@ void i1pro_sub_absraw(
 
 /* Convert an absraw array from raw wavelengths to output wavelenths */
 /* for a given [std res, high res] and [emis/tras, reflective] mode */
+/* Readings are processed in blocks of WAV_BLK, transposed so that the */
+/* inner loops run across the block and can be vectorized. Each value */
+/* is accumulated in the same order as one reading at a time. */
 void i1pro_absraw_to_abswav(
 	i1pro *p,
 	int highres,			/* 0 for std res, 1 for high res */ 
@@ -7621,44 +8192,97 @@ void i1pro_absraw_to_abswav(
 	double **absraw			/* Source array [-1 nraw] */
 ) {
 	i1proimp *m = (i1proimp *)p->m;
-	int i, j, k, cx, sx;
-	double *tm;			/* Temporary array */
+	i1pro_r2wtab *mtx = &m->mtx[highres][refl];
+	int nwav = m->nwav[highres];
+	int i, j, k, b, nb, cx, sx, nsx;
+	double *rt;			/* Transposed block of raw values [nsx][WAV_BLK] */
+	double *tm;			/* Transposed block of wavelength values [nwav][WAV_BLK] */
 	
-	tm = dvector(0, m->nwav[highres]-1);
+	/* Range of raw values used by the filters */
+	for (nsx = j = 0; j < nwav; j++) {
+		if ((mtx->index[j] + mtx->nocoef[j]) > nsx)
+			nsx = mtx->index[j] + mtx->nocoef[j];
+	}
+
+	rt = dvector(0, nsx * WAV_BLK-1);
+	tm = dvector(0, nwav * WAV_BLK-1);
 	
-	/* For each measurement */
-	for (i = 0; i < nummeas; i++) {
+	/* For each block of measurements */
+	for (i = 0; i < nummeas; i += WAV_BLK) {
+		nb = nummeas - i;
+		if (nb > WAV_BLK)
+			nb = WAV_BLK;
+
+		/* Transpose the raw values, zero filling a short last block */
+		for (sx = 0; sx < nsx; sx++) {
+			for (b = 0; b < nb; b++)
+				rt[sx * WAV_BLK + b] = absraw[i + b][sx];
+			for (; b < WAV_BLK; b++)
+				rt[sx * WAV_BLK + b] = 0.0;
+		}
 
 		/* For each output wavelength */
-		for (cx = j = 0; j < m->nwav[highres]; j++) {
-			double oval = 0.0;
+		for (cx = j = 0; j < nwav; j++) {
+			double *ov = tm + j * WAV_BLK;
+
+			for (b = 0; b < WAV_BLK; b++)
+				ov[b] = 0.0;
 
 			/* For each matrix value */
-			sx = m->mtx[highres][refl].index[j];		/* Starting index */
-			for (k = 0; k < m->mtx[highres][refl].nocoef[j]; k++, cx++, sx++) {
-				oval += m->mtx[highres][refl].coef[cx] * absraw[i][sx];
+			sx = mtx->index[j];		/* Starting index */
+			for (k = 0; k < mtx->nocoef[j]; k++, cx++, sx++) {
+				double cv = mtx->coef[cx];
+				double *rv = rt + sx * WAV_BLK;
+
+				for (b = 0; b < WAV_BLK; b++)
+					ov[b] += cv * rv[b];
 			}
-			abswav[i][j] = tm[j] = oval;
+			for (b = 0; b < nb; b++)
+				abswav[i + b][j] = ov[b];
 		}
 
 		if (p->dtype == instI1Pro2) {
 			/* Now apply stray light compensation */ 
 			/* For each output wavelength */
-			for (j = 0; j < m->nwav[highres]; j++) {
-				double oval = 0.0;
+			for (j = 0; j < nwav; j++) {
+				double *sl = m->straylight[highres][j];
+				double ov[WAV_BLK];
+
+				for (b = 0; b < WAV_BLK; b++)
+					ov[b] = 0.0;
 		
 				/* For each matrix value */
-				for (k = 0; k < m->nwav[highres]; k++)
-					oval += m->straylight[highres][j][k] * tm[k];
-				abswav[i][j] = oval;
+				/* (Written out so that the sums stay in registers) */
+				for (k = 0; k < nwav; k++) {
+					double sv = sl[k];
+					double *tv = tm + k * WAV_BLK;
+
+					ov[0] += sv * tv[0];
+					ov[1] += sv * tv[1];
+					ov[2] += sv * tv[2];
+					ov[3] += sv * tv[3];
+					ov[4] += sv * tv[4];
+					ov[5] += sv * tv[5];
+					ov[6] += sv * tv[6];
+					ov[7] += sv * tv[7];
+				}
+				for (b = 0; b < nb; b++)
+					abswav[i + b][j] = ov[b];
 			}
 #ifdef PLOT_DEBUG
-			printf("Before & after stray light correction:\n");
-			plot_wav_2(m, highres, tm, abswav[i]);
+			for (b = 0; b < nb; b++) {
+				double *tmw = dvector(0, nwav-1);
+				for (j = 0; j < nwav; j++)
+					tmw[j] = tm[j * WAV_BLK + b];
+				printf("Before & after stray light correction:\n");
+				plot_wav_2(m, highres, tmw, abswav[i + b]);
+				free_dvector(tmw, 0, nwav-1);
+			}
 #endif /* PLOT_DEBUG */
 		}
 	}
-	free_dvector(tm, 0, m->nwav[highres]-1);
+	free_dvector(tm, 0, nwav * WAV_BLK-1);
+	free_dvector(rt, 0, nsx * WAV_BLK-1);
 }
 
 /* Convert an abswav array of output wavelengths to scaled output readings. */
@@ -9073,6 +9697,14 @@ i1pro_code i1pro_create_hr(i1pro *p) {
 	double twidth = HIGHRES_WIDTH;
 	int i, j, k, cx, sx;
 	
+#ifdef ENABLE_NONVCAL
+	/* Use the tables derived by a previous run if they still match */
+	if (i1pro_restore_hr_cache(p) == I1PRO_OK) {
+		m->hr_inited = 1;
+		return i1pro_create_hr_calfactors(p, 0);
+	}
+#endif
+
 	/* If we don't have any way of converting raw2wav (ie. RevE polinomial equations), */
 	/* use the orginal filters to figure this out. */
 	if (m->raw2wav == NULL
@@ -10165,6 +10797,11 @@ i1pro_code i1pro_create_hr(i1pro *p) {
 #undef MXNOFC
 	}	/* Do next filter */
 
+#ifdef ENABLE_NONVCAL
+	/* Save the derived tables for next time */
+	i1pro_save_hr_cache(p);
+#endif
+
 	/* Hires has been initialised */
 	m->hr_inited = 1;
 
@@ -11492,7 +12129,7 @@ i1pro_readmeasurement(
 	m->l_inttime = m->c_inttime;
 
 #ifdef SINGLE_READ
-	if (scanflag == 0)
+	if (scanflag == 0 || m->sc_thread != NULL)	/* Not scan or background conversion */
 		nmeas = inummeas;
 	else
 		nmeas = bsize / (m->nsen * 2);		/* Use a single large read */
@@ -11571,6 +12208,10 @@ i1pro_readmeasurement(
 		buf   += rwbytes;
 		treadings += rwbytes/(m->nsen * 2);
 
+		/* Hand them over to any background conversion */
+		if (scanflag)
+			i1pro_scan_conv_add(p, treadings);
+
 		if (scanflag == 0) {	/* Not scanning */
 
 			/* Expect to read exactly what we asked for */
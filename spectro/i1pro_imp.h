@@ -339,6 +339,22 @@ struct _i1proimp {
 	volatile double whitestamp;	/* meas_delay() white timestamp */
 	volatile double trigstamp;	/* meas_delay() trigger timestamp */
 
+	/* Background conversion of scan readings as they arrive */
+	athread *sc_thread;		/* Conversion thread, NULL if not running */
+	amutex sc_lock;			/* Protect the following */
+	acond sc_cond;			/* Signal more readings or end of scan */
+	unsigned char *sc_buf;	/* Raw reading buffer being read into */
+	int sc_nread;			/* Number of readings read so far */
+	int sc_nconv;			/* Number of readings converted so far */
+	int sc_end;				/* Flag, nz when the scan read has finished */
+	double **sc_absraw;		/* [sc_max][-1 nraw] converted readings, NULL if none */
+	int sc_max;				/* Number of rows in sc_absraw */
+	double sc_inttime;		/* Integration time of the scan */
+	int sc_gainmode;		/* Gain mode of the scan */
+	double sc_dtsum;		/* Rev E dark threshold sum, weighted by readings */
+	i1pro_code sc_ev;		/* Conversion error */
+	int sc_valid;			/* nz if sc_absraw holds the last scan's readings */
+
 }; typedef struct _i1proimp i1proimp;
 
 /* Add an implementation structure */
@@ -748,6 +764,24 @@ i1pro_code i1pro_sens_to_absraw(
 	double *pdarkthresh     /* Return a dark threshold value (Rev E) */
 );
 
+/* Start converting scan readings to absolute raw values in a background */
+/* thread, as they are read into buf. Does nothing if this isn't a scan, */
+/* or the instrument needs the whole scan to do the conversion. */
+void i1pro_scan_conv_start(
+	i1pro *p,
+	double inttime, 		/* Integration time used */
+	int gainmode,			/* Gain mode, 0 = normal, 1 = high */
+	unsigned char *buf,		/* Raw USB reading buffer */
+	int bsize				/* Bytes available in buffer */
+);
+
+/* Tell the background conversion that nread readings are now in the buffer */
+void i1pro_scan_conv_add(i1pro *p, int nread);
+
+/* Finish the background conversion once the scan read is complete. */
+/* The results are only kept if ev is I1PRO_OK. */
+void i1pro_scan_conv_end(i1pro *p, i1pro_code ev);
+
 /* Take a raw value, and convert it into an absolute raw value. */
 /* Note that linearisation is ignored, since it is assumed to be insignificant */
 /* to the black threshold and saturation values. */
@@ -506,6 +506,7 @@ static void icoms_close_port(icoms *p) {
 	if (p->is_open) {
 #ifdef ENABLE_USB
 		if (p->usbd) {
+			usb_xfer_shutdown(p);
 			usb_close_port(p);
 		} else if (p->hidd) {
 			hid_close_port(p);
@@ -332,6 +332,9 @@ void usb_uninit_cancel(usb_cancelt *p);
 void usb_reinit_cancel(usb_cancelt *p);
 #endif
 
+/* Asynchronous transfer handle. */
+typedef struct _usb_xfer usb_xfer;
+
 struct _icoms {
   /* Private: */
 
@@ -390,6 +393,8 @@ struct _icoms {
 /* Macro to access end point information */
 #define EPINFO(addr) ep[((addr >> 3) & 0x10) + (addr & 0x0f)]
 
+	struct _usb_xqueue *xq[32];	/* Asynchronous transfer queue for each end point */
+
 	/* HID port parameters */
 	struct hid_idevice *hidd;	/* HID port - copy of ppath->hidd */
 
@@ -559,6 +564,38 @@ struct _icoms {
 	int (*usb_cancel_io)(struct _icoms *p,
 		usb_cancelt *cantelt);			/* Cancel handle */
 
+	/* Queue an asynchronous bulk or interrupt read/write on an end point. */
+	/* Transfers on the same end point complete in order, while transfers */
+	/* on different end points overlap each other and the caller. */
+	/* If callback is not NULL, it is called from the queue thread on completion. */
+	/* If pxf is NULL the transfer is freed on completion, otherwise */
+	/* usb_xfer_wait() must be called to get the result and free it, */
+	/* before the port is closed. Closing the port cancels any transfers. */
+	/* return icom error */
+	int (*usb_submit)(struct _icoms *p,
+		usb_xfer **pxf,			/* Return transfer handle, NULL if not needed */
+		int ep,					/* End point address */
+		unsigned char *buf,		/* Read/Write buffer, must remain valid until complete */
+		int bsize,				/* Bytes to read or write */
+		double tout,			/* Timeout in seconds */
+		void (*callback)(void *cntx, usb_xfer *xf, int rv, int bxfer),
+		void *cntx);			/* Context for callback */
+
+	/* Wait for a submitted transfer to complete and free it. */
+	/* return the transfers icom error */
+	int (*usb_xfer_wait)(struct _icoms *p,
+		usb_xfer *xf,			/* Transfer handle */
+		int *bxfer);			/* Bytes read/written, may be NULL */
+
+	/* Cancel a submitted transfer. usb_xfer_wait() must still be called. */
+	/* return icom error */
+	int (*usb_xfer_cancel)(struct _icoms *p,
+		usb_xfer *xf);			/* Transfer handle */
+
+	/* Wait until all submitted transfers have completed */
+	/* return icom error */
+	int (*usb_xfer_flush)(struct _icoms *p);
+
 	/* Reset and end point toggle state to 0 */
 	/* return icom error */
 	int (*usb_resetep)(struct _icoms *p,
@@ -518,8 +518,12 @@ int          delayms) {		/* Delay after open in msec */
 						);
 
 		/* And configure: */
-		tio.c_cc[VTIME] = 1;		/* 0.1 second timeout */
-		tio.c_cc[VMIN] = 64;		/* Comfortably less than _PF_MAX_INPUT */
+		/* icoms_ser_read() poll()'s for input and then reads whatever */
+		/* is available in one go, so make read() return immediately. */
+		/* (VMIN = 64, VTIME = 1 made every short reply wait out */
+		/*  the 0.1 second inter-character timeout.) */
+		tio.c_cc[VTIME] = 0;		/* No inter-character timeout */
+		tio.c_cc[VMIN] = 0;			/* Return what's available */
 
 		switch (p->fc) {
 			case fc_nc:
@@ -884,8 +888,10 @@ double tout			/* Time out in seconds */
 					return p->lserr;
 				}
 
-				/* We have data to read from input */
+				/* We have data to read from input, so read all that's */
+				/* available, up to the space left in the buffer. */
 				rbytes = read(p->fd, rbuf, bsize);
+				nreads++;
 				if (rbytes < 0) {
 					a1logd(p->log, 8, "icoms_ser_read: read failed with %d, rbuf = '%s'\n",rbytes,icoms_fix(rrbuf));
 					retrv |= ICOM_SERR;
@@ -41,11 +41,11 @@
 #ifndef SALONEINSTLIB
 #include "copyright.h"
 #include "aconfig.h"
-#include "rand.h"
 #else
 #include "sa_config.h"
 #endif /* !SALONEINSTLIB */
 #include "numsup.h"
+#include "rand.h"
 #include "cgats.h"
 #include "xspect.h"
 #include "conv.h"
@@ -332,6 +332,39 @@ instClamping clamp) {		/* NZ to clamp XYZ to be +ve */
 	return inst_unsupported;
 }
 
+/* When tracing, the drivers read_strip() and read_sample() */
+/* are wrapped, so that each read cycle is recorded. */
+static inst_code trc_read_strip(
+inst *p,
+char *name,
+int npatch,
+char *pname,
+int sguide,
+double pwid,
+double gwid,
+double twid,
+ipatch *vals) {
+	inst_code rv;
+
+	a1tr_begin("inst read_strip");
+	rv = p->trc_read_strip(p, name, npatch, pname, sguide, pwid, gwid, twid, vals);
+	a1tr_end();
+	return rv;
+}
+
+static inst_code trc_read_sample(
+inst *p,
+char *name,
+ipatch *val,
+instClamping clamp) {
+	inst_code rv;
+
+	a1tr_begin("inst read_sample");
+	rv = p->trc_read_sample(p, name, val, clamp);
+	a1tr_end();
+	return rv;
+}
+
 /* Measure the emissive refresh rate in Hz. */
 static inst_code read_refrate(
 inst *p,
@@ -439,6 +472,185 @@ static inst_code white_change(
 struct _inst *p, int init) {
 	return inst_unsupported;
 }
+
+/* Sample a display transition response. */
+static inst_code meas_response(
+struct _inst *p,
+int msamp,
+double *sec,
+double *lev,
+int *nsamp,
+double maxsec) {
+	if (nsamp != NULL)
+		*nsamp = 0;
+	return inst_unsupported;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Generic spot reading streaming support. This is used by */
+/* instruments that set inst3_stream and don't provide their own. */
+
+#define INST_STREAM_NBUF 2000		/* Default ring buffer size */
+
+struct _inst_stream {
+	athread *th;			/* Reading thread */
+	amutex lock;			/* Lock for ring buffer and state */
+	volatile int stop;		/* Flag telling thread to stop */
+	double stime;			/* usec_time() at start */
+	int nbuf;				/* Ring buffer size */
+	ipatch *vals;			/* Ring buffer of readings */
+	double *sec;			/* Ring buffer of reading times */
+	int rix;				/* Index of oldest unread reading */
+	int nrd;				/* Number of unread readings */
+	int lost;				/* Readings overwritten since last stream_read() */
+	inst_code ev;			/* Error that stopped the stream */
+}; typedef struct _inst_stream inst_stream;
+
+/* Thread that takes readings back to back */
+static int stream_thread(void *pp) {
+	inst *p = (inst *)pp;
+	inst_stream *s = p->strm;
+	inst_code ev = inst_ok;
+	ipatch val;
+	double stime, etime;
+	int ix;
+
+	while (!s->stop) {
+		stime = usec_time();
+		if ((ev = p->read_sample(p, "STREAM", &val, instNoClamp)) != inst_ok)
+			break;
+		etime = usec_time();
+
+		amutex_lock(s->lock);
+		if (s->nrd >= s->nbuf) {		/* Overwrite the oldest */
+			s->rix = (s->rix + 1) % s->nbuf;
+			s->nrd--;
+			s->lost++;
+		}
+		ix = (s->rix + s->nrd) % s->nbuf;
+		s->vals[ix] = val;
+		s->sec[ix] = 0.5 * (stime + etime - 2.0 * s->stime)/1e6;	/* Mid point of reading */
+		s->nrd++;
+		amutex_unlock(s->lock);
+	}
+
+	amutex_lock(s->lock);
+	s->ev = ev;
+	amutex_unlock(s->lock);
+
+	if (ev != inst_ok)
+		a1logd(p->log, 1, "inst stream_thread: stopped with error 0x%x\n",ev);
+	return 0;
+}
+
+/* Start streaming readings */
+static inst_code stream_start(
+struct _inst *p,
+int nbuf) {
+	inst3_capability cap3 = inst3_none;
+	inst_stream *s;
+
+	p->capabilities(p, NULL, NULL, &cap3);
+	if (!IMODETST(cap3, inst3_stream))
+		return inst_unsupported;
+
+	if (p->strm != NULL)
+		return inst_wrong_setup;
+
+	if (nbuf <= 0)
+		nbuf = INST_STREAM_NBUF;
+
+	if ((s = (inst_stream *)calloc(1, sizeof(inst_stream))) == NULL) {
+		a1loge(p->log, 1, "stream_start: malloc failed!\n");
+		return inst_system_error;
+	}
+	if ((s->vals = (ipatch *)malloc(sizeof(ipatch) * nbuf)) == NULL
+	 || (s->sec = (double *)malloc(sizeof(double) * nbuf)) == NULL) {
+		a1loge(p->log, 1, "stream_start: malloc of %d readings failed!\n",nbuf);
+		free(s->vals);
+		free(s);
+		return inst_system_error;
+	}
+	s->nbuf = nbuf;
+	amutex_init(s->lock);
+	s->stime = usec_time();
+	p->strm = s;
+
+	if ((s->th = new_athread(stream_thread, (void *)p)) == NULL) {
+		a1loge(p->log, 1, "stream_start: failed to create thread\n");
+		p->strm = NULL;
+		amutex_del(s->lock);
+		free(s->sec);
+		free(s->vals);
+		free(s);
+		return inst_system_error;
+	}
+	return inst_ok;
+}
+
+/* Return the readings streamed since the last call */
+static inst_code stream_read(
+struct _inst *p,
+int msamp,
+double *sec,
+ipatch *vals,
+int *nsamp,
+int *lost) {
+	inst_stream *s = p->strm;
+	inst_code ev = inst_ok;
+	int i, n;
+
+	if (nsamp != NULL)
+		*nsamp = 0;
+	if (lost != NULL)
+		*lost = 0;
+
+	if (s == NULL)
+		return inst_wrong_setup;
+
+	amutex_lock(s->lock);
+	for (n = 0; n < msamp && n < s->nrd; n++) {
+		i = (s->rix + n) % s->nbuf;
+		if (sec != NULL)
+			sec[n] = s->sec[i];
+		if (vals != NULL)
+			vals[n] = s->vals[i];
+	}
+	s->rix = (s->rix + n) % s->nbuf;
+	s->nrd -= n;
+	if (lost != NULL)
+		*lost = s->lost;
+	s->lost = 0;
+	if (s->nrd == 0)
+		ev = s->ev;
+	amutex_unlock(s->lock);
+
+	if (nsamp != NULL)
+		*nsamp = n;
+
+	return ev;
+}
+
+/* Stop streaming readings */
+static inst_code stream_stop(
+struct _inst *p) {
+	inst_stream *s = p->strm;
+
+	if (s == NULL)
+		return inst_ok;
+
+	s->stop = 1;
+	s->th->wait(s->th);		/* Let any reading in progress complete */
+	s->th->del(s->th);
+	p->strm = NULL;
+
+	amutex_del(s->lock);
+	free(s->sec);
+	free(s->vals);
+	free(s);
+
+	return inst_ok;
+}
 																				\
 /* Return the last calibrated refresh rate in Hz. Returns: */
 /* inst_unsupported - if this instrument doesn't suport a refresh mode */
@@ -778,6 +990,14 @@ void *cntx			/* Context for callback */
 		p->meas_delay = meas_delay;
 	if (p->white_change == NULL)
 		p->white_change = white_change;
+	if (p->meas_response == NULL)
+		p->meas_response = meas_response;
+	if (p->stream_start == NULL)
+		p->stream_start = stream_start;
+	if (p->stream_read == NULL)
+		p->stream_read = stream_read;
+	if (p->stream_stop == NULL)
+		p->stream_stop = stream_stop;
 	if (p->get_refr_rate == NULL)
 		p->get_refr_rate = get_refr_rate;
 	if (p->set_refr_rate == NULL)
@@ -799,6 +1019,14 @@ void *cntx			/* Context for callback */
 	if (p->config_enum == NULL)
 		p->config_enum = config_enum;
 
+	/* Wrap the read methods if tracing */
+	if (a1tr_enabled()) {
+		p->trc_read_strip = p->read_strip;
+		p->read_strip = trc_read_strip;
+		p->trc_read_sample = p->read_sample;
+		p->read_sample = trc_read_sample;
+	}
+
 	/* Set the provided user interaction callback */
 	p->set_uicallback(p, uicallback, cntx);
 
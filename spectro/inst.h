@@ -358,9 +358,13 @@ typedef enum {
 typedef enum {
 	inst3_none              = 0x00000000, /* No capabilities */
 
-	inst3_average           = 0x00000001  /* Can set to average multiple measurements into 1 */
+	inst3_average           = 0x00000001, /* Can set to average multiple measurements into 1 */
 										  /* See inst_opt_set_averages */
 
+	inst3_meas_disp_settle  = 0x00000002, /* Is able to sample a display transition response */
+
+	inst3_stream            = 0x00000004  /* Is able to stream continuous spot readings */
+
 } inst3_capability;
 
 /* - - - - - - - - - - - - - - - - - - - */
@@ -523,8 +527,11 @@ typedef enum {
 											/*                             [xcalstd *standard] */
 	inst_opt_lamp_remediate     = 0x0026,	/* Remediate i1Pro lamp           [double seconds] */
 
-	inst_opt_set_averages       = 0x0027	/* Set the number of measurements to average [int] */
+	inst_opt_set_averages       = 0x0027,	/* Set the number of measurements to average [int] */
 											/* 0 for default */
+	inst_opt_set_adapt_speed    = 0x0028	/* Set adaptive dark measurement speed/accuracy */
+											/* factor, > 1.0 faster, < 1.0 more accurate, */
+											/* 1.0 or 0.0 for default   [double factor] */
 
 
 } inst_opt_type;
@@ -717,6 +724,12 @@ typedef enum {
 	void *event_cntx;	/* Asynchronous event callback function */				\
 	athread *scan_ready_thread;	/* msec_scan_ready() support */					\
 	int scan_ready_delay;		/* msec_scan_ready() support */					\
+	struct _inst_stream *strm;	/* stream_start() support */					\
+	inst_code (*trc_read_strip)(struct _inst *p, char *name, int npatch,		\
+	           char *pname, int sguide, double pwid, double gwid, double twid,	\
+	           ipatch *vals);		/* Driver read_strip() when tracing */		\
+	inst_code (*trc_read_sample)(struct _inst *p, char *name, ipatch *val,		\
+	           instClamping clamp);	/* Driver read_sample() when tracing */		\
 																				\
 	/* Virtual delete. Cleans up things done by new_inst(). */					\
 	inst_code (*vdel)(															\
@@ -1018,6 +1031,49 @@ typedef enum {
 		struct _inst *p,														\
 		int init);			/* nz to init time stamp, z to mark transition */	\
 																				\
+	/* Sample a display transition response, by reading the relative */		\
+	/* light level as rapidly as possible for up to maxsec seconds. */			\
+	/* As for meas_delay(), white_change() should be called with init=1 */		\
+	/* before, and with init=0 when the displayed color changes. */			\
+	/* The sample times are returned relative to the change time stamp. */	\
+	/* (Available if cap3 & inst3_meas_disp_settle) */							\
+	inst_code (*meas_response)(											        \
+		struct _inst *p,														\
+		int msamp,			/* Maximum number of samples to return */			\
+		double *sec,		/* Return sample time in seconds */					\
+		double *lev,		/* Return sample relative light level */			\
+		int *nsamp,			/* Return number of samples */						\
+		double maxsec);		/* Maximum time to sample for */					\
+																				\
+	/* Start streaming spot readings in the current measurement mode. */		\
+	/* Readings are taken back to back as fast as the instrument allows */		\
+	/* by a background thread, and kept in a ring buffer of nbuf */			\
+	/* timestamped samples. The instrument should be in program trigger */		\
+	/* mode, and no other measurement methods should be called until */		\
+	/* stream_stop(). */														\
+	/* (Available if cap3 & inst3_stream) */									\
+	inst_code (*stream_start)(											        \
+		struct _inst *p,														\
+		int nbuf);			/* Ring buffer size, 0 for default */				\
+																				\
+	/* Return the readings streamed since the last call, oldest first. */		\
+	/* Sample times are in seconds since stream_start(). If the ring */			\
+	/* buffer has overflowed, *lost is set to the number of readings */			\
+	/* that were overwritten before they could be returned. */					\
+	/* Will return any error that has stopped the stream, once the */			\
+	/* readings before it have been returned. */								\
+	inst_code (*stream_read)(											        \
+		struct _inst *p,														\
+		int msamp,			/* Maximum number of samples to return */			\
+		double *sec,		/* Return sample time in seconds */					\
+		ipatch *vals,		/* Return sample values */							\
+		int *nsamp,			/* Return number of samples */						\
+		int *lost);			/* Return number lost to overflow, may be NULL */	\
+																				\
+	/* Stop streaming readings and free the ring buffer. */					\
+	inst_code (*stream_stop)(											        \
+		struct _inst *p);														\
+																				\
 	/* Return the last calibrated refresh rate in Hz. Returns: */				\
 	/* (Available if cap2 & inst2_get_refresh_rate) */ 							\
 	/* inst_unsupported - if this instrument doesn't suport a refresh mode */	\
@@ -90,6 +90,8 @@
 #define SW_THREAD_TIMEOUT (10 * 60.0) 	/* [10 Min] Switch read thread timeout */
 
 #define SINGLE_READ		/* [Def] Use a single USB read for scan to eliminate latency issues. */
+#define BG_SCAN_CONV	/* [Def] Read scans in pieces and convert the readings */
+						/* in a background thread as they arrive. */
 #define HIGH_RES		/* [Def] Enable high resolution spectral mode code. Disable */
 						/* to break dependency on rspl library. */
 # undef FAST_HIGH_RES_SETUP	/* Slightly better accuracy ? */
@@ -286,6 +288,9 @@ munki_code add_munkiimp(munki *p) {
 
 	m->lo_secs = 2000000000;        /* A very long time */
 
+	amutex_init(m->sc_lock);
+	acond_init(m->sc_cond);
+
 	p->m = (void *)m;
 	return MUNKI_OK;
 }
@@ -412,6 +417,14 @@ void del_munkiimp(munki *p) {
 		if (m->emtx_coef2 != NULL)
 			free(m->emtx_coef2);
 
+		/* Background scan conversion */
+		if (m->sc_raw != NULL) {
+			free_dmatrix(m->sc_raw, 0, m->sc_max-1, -1, m->nraw-1);
+			free_dvector(m->sc_ledtemp, 0, m->sc_max-1);
+		}
+		acond_del(m->sc_cond);
+		amutex_del(m->sc_lock);
+
 		free(m);
 		p->m = NULL;
 	}
@@ -4230,10 +4243,14 @@ munki_code munki_read_patches_1(
 		return ev;
 	}
 
-	if ((ev = munki_readmeasurement(p, ninvmeas + minnummeas, m->c_measmodeflags & MUNKI_MMF_SCAN,
-	                                             buf, bsize, nmeasuered, 0, 0)) != MUNKI_OK) {
+	/* Convert scan readings as they arrive */
+	munki_scan_conv_start(p, ninvmeas, buf, bsize);
+
+	ev = munki_readmeasurement(p, ninvmeas + minnummeas, m->c_measmodeflags & MUNKI_MMF_SCAN,
+	                                             buf, bsize, nmeasuered, 0, 0);
+	munki_scan_conv_end(p, ev);
+	if (ev != MUNKI_OK)
 		return ev;
-	}
 
 	if (nmeasuered != NULL)
 		*nmeasuered -= ninvmeas;	/* Correct for invalid number */
@@ -4268,18 +4285,42 @@ munki_code munki_read_patches_2(
 		*duration = 0.0;	/* default value */
 
 	/* Allocate temporaries */
-	multimes = dmatrix(0, nummeas-1, -1, m->nraw-1);
-  	ledtemp = dvector(0, nummeas-1);
 	absraw = dmatrix(0, numpatches-1, -1, m->nraw-1);
 
-	/* Take a buffer full of raw readings, and convert them to */
-	/* floating point sensor readings. Check for saturation */
-	if ((rv = munki_sens_to_raw(p, multimes, ledtemp, buf, ninvmeas, nummeas,
-	                                         m->satlimit, &darkthresh)) != MUNKI_OK) {
-		free_dvector(ledtemp, 0, nummeas-1);
-		free_dmatrix(absraw, 0, numpatches-1, -1, m->nraw-1);
-		free_dmatrix(multimes, 0, nummeas-1, -1, m->nraw-1);
-		return rv;
+	/* If the scan readings were converted to raw values as they arrived, */
+	/* take them over. (free_dmatrix() doesn't depend on the number of rows) */
+	if (m->sc_valid && m->sc_buf == buf && m->sc_ninv == ninvmeas
+	 && (m->sc_nread - m->sc_ninv) == nummeas) {
+		multimes = m->sc_raw;
+		ledtemp = m->sc_ledtemp;
+		m->sc_raw = NULL;
+		m->sc_ledtemp = NULL;
+		m->sc_valid = 0;
+
+		/* Same as munki_sens_to_raw() saturation failure */
+		if (m->sc_ev != MUNKI_OK) {
+			free_dvector(ledtemp, 0, nummeas-1);
+			free_dmatrix(absraw, 0, numpatches-1, -1, m->nraw-1);
+			free_dmatrix(multimes, 0, nummeas-1, -1, m->nraw-1);
+			return m->sc_ev;
+		}
+		darkthresh = m->sc_dtsum/(double)nummeas;
+		a1logd(p->log,3,"munki_read_patches_2: using %d background converted readings\n",
+		                                                                        nummeas);
+
+	} else {
+		multimes = dmatrix(0, nummeas-1, -1, m->nraw-1);
+	  	ledtemp = dvector(0, nummeas-1);
+
+		/* Take a buffer full of raw readings, and convert them to */
+		/* floating point sensor readings. Check for saturation */
+		if ((rv = munki_sens_to_raw(p, multimes, ledtemp, buf, ninvmeas, nummeas,
+		                                         m->satlimit, &darkthresh)) != MUNKI_OK) {
+			free_dvector(ledtemp, 0, nummeas-1);
+			free_dmatrix(absraw, 0, numpatches-1, -1, m->nraw-1);
+			free_dmatrix(multimes, 0, nummeas-1, -1, m->nraw-1);
+			return rv;
+		}
 	}
 
 	/* Subtract the black from sensor values and convert to */
@@ -4903,6 +4944,123 @@ munki_code munki_sens_to_raw(
 	return MUNKI_OK;
 }
 
+/* Background scan conversion thread. */
+/* Converts readings to raw values as they are read, */
+/* so that they are ready as soon as the scan finishes. */
+static int munki_scan_conv_thread(void *pp) {
+	munki *p = (munki *)pp;
+	munkiimp *m = (munkiimp *)p->m;
+	munki_code ev;
+
+	amutex_lock(m->sc_lock);
+	for (;;) {
+		int navail, nconv;
+		double darkthresh = 0.0;
+
+		while ((m->sc_nread - m->sc_ninv) <= m->sc_nconv && !m->sc_end)
+			acond_wait(m->sc_cond, m->sc_lock);
+		navail = m->sc_nread - m->sc_ninv;
+		nconv = m->sc_nconv;
+		if (nconv >= navail)		/* Scan has ended and we're done */
+			break;
+		amutex_unlock(m->sc_lock);
+
+		ev = munki_sens_to_raw(p, m->sc_raw + nconv, m->sc_ledtemp + nconv,
+		                 m->sc_buf + (m->sc_ninv + nconv) * m->nsen * 2, 0, navail - nconv,
+		                 m->satlimit, &darkthresh);
+
+		amutex_lock(m->sc_lock);
+		if (ev != MUNKI_OK) {		/* Saturated, so the scan will fail */
+			m->sc_ev = ev;
+			break;
+		}
+		m->sc_dtsum += darkthresh * (double)(navail - nconv);
+		m->sc_nconv = navail;
+	}
+	amutex_unlock(m->sc_lock);
+	return 0;
+}
+
+/* Start converting scan readings to raw values in a background thread, */
+/* as they are read into buf. */
+void munki_scan_conv_start(
+	munki *p,
+	int ninvmeas,			/* Number of extra invalid measurements at start */
+	unsigned char *buf,		/* Raw USB reading buffer */
+	int bsize				/* Bytes available in buffer */
+) {
+	munkiimp *m = (munkiimp *)p->m;
+	int nmax = bsize / (m->nsen * 2);
+
+	m->sc_valid = 0;
+
+#ifdef BG_SCAN_CONV
+	if ((m->c_measmodeflags & MUNKI_MMF_SCAN) == 0 || nmax <= ninvmeas)
+		return;
+
+	if (m->sc_raw != NULL && m->sc_max < nmax) {
+		free_dmatrix(m->sc_raw, 0, m->sc_max-1, -1, m->nraw-1);
+		free_dvector(m->sc_ledtemp, 0, m->sc_max-1);
+		m->sc_raw = NULL;
+	}
+	if (m->sc_raw == NULL) {
+		m->sc_raw = dmatrix(0, nmax-1, -1, m->nraw-1);
+		m->sc_ledtemp = dvector(0, nmax-1);
+		m->sc_max = nmax;
+	}
+
+	m->sc_buf = buf;
+	m->sc_ninv = ninvmeas;
+	m->sc_nread = 0;
+	m->sc_nconv = 0;
+	m->sc_end = 0;
+	m->sc_dtsum = 0.0;
+	m->sc_ev = MUNKI_OK;
+
+	if ((m->sc_thread = new_athread(munki_scan_conv_thread, (void *)p)) == NULL) {
+		a1logd(p->log,2,"munki_scan_conv_start: creating thread failed\n");
+		return;
+	}
+	a1logd(p->log,3,"munki_scan_conv_start: started background scan conversion\n");
+#endif /* BG_SCAN_CONV */
+}
+
+/* Tell the background conversion that nread readings are now in the buffer */
+void munki_scan_conv_add(munki *p, int nread) {
+	munkiimp *m = (munkiimp *)p->m;
+
+	if (m->sc_thread == NULL)
+		return;
+
+	amutex_lock(m->sc_lock);
+	m->sc_nread = nread;
+	acond_signal(m->sc_cond);
+	amutex_unlock(m->sc_lock);
+}
+
+/* Finish the background conversion once the scan read is complete */
+void munki_scan_conv_end(munki *p, munki_code ev) {
+	munkiimp *m = (munkiimp *)p->m;
+
+	if (m->sc_thread == NULL)
+		return;
+
+	amutex_lock(m->sc_lock);
+	m->sc_end = 1;
+	acond_signal(m->sc_cond);
+	amutex_unlock(m->sc_lock);
+
+	m->sc_thread->wait(m->sc_thread);
+	m->sc_thread->del(m->sc_thread);
+	m->sc_thread = NULL;
+
+	/* A saturation error is kept and reported by munki_read_patches_2() */
+	if (ev == MUNKI_OK)
+		m->sc_valid = 1;
+	else
+		a1logd(p->log,3,"munki_scan_conv_end: read 0x%x, conversion 0x%x\n",ev,m->sc_ev);
+}
+
 /* Subtract the black from raw values and convert to */
 /* absolute (integration & gain scaled), zero offset based, */
 /* linearized raw values. */
@@ -8734,7 +8892,7 @@ munki_readmeasurement(
 	extra = 1.0;		/* Extra timeout margin */
 
 #ifdef SINGLE_READ
-	if (scanflag == 0)
+	if (scanflag == 0 || m->sc_thread != NULL)	/* Not scan or background conversion */
 		nmeas = inummeas;
 	else
 		nmeas = bsize / (m->nsen * 2);		/* Use a single large read */
@@ -8806,6 +8964,10 @@ munki_readmeasurement(
 		buf   += rwbytes;
 		treadings += rwbytes/(m->nsen * 2);
 
+		/* Hand them over to any background conversion */
+		if (scanflag)
+			munki_scan_conv_add(p, treadings);
+
 		if (scanflag == 0) {	/* Not scanning */
 
 			/* Expect to read exactly what we asked for */
@@ -303,6 +303,22 @@ struct _munkiimp {
 	volatile double whitestamp;		/* meas_delay() white timestamp */
 	volatile double trigstamp;		/* meas_delay() trigger timestamp */
 
+	/* Background conversion of scan readings as they arrive */
+	athread *sc_thread;		/* Conversion thread, NULL if not running */
+	amutex sc_lock;			/* Protect the following */
+	acond sc_cond;			/* Signal more readings or end of scan */
+	unsigned char *sc_buf;	/* Raw reading buffer being read into */
+	int sc_ninv;			/* Number of initial invalid readings */
+	int sc_nread;			/* Number of readings read so far, including invalid */
+	int sc_nconv;			/* Number of valid readings converted so far */
+	int sc_end;				/* Flag, nz when the scan read has finished */
+	double **sc_raw;		/* [sc_max][-1 nraw] converted readings, NULL if none */
+	double *sc_ledtemp;		/* [sc_max] LED temperature values */
+	int sc_max;				/* Number of rows in sc_raw */
+	double sc_dtsum;		/* Dark threshold sum, weighted by readings */
+	munki_code sc_ev;		/* Conversion error */
+	int sc_valid;			/* nz if sc_raw holds the last scan's readings */
+
 }; typedef struct _munkiimp munkiimp;
 
 /* Add an implementation structure */
@@ -665,6 +681,22 @@ munki_code munki_sens_to_raw(
 	double *darkthresh		/* Return a dark threshold value */
 );
 
+/* Start converting scan readings to raw values in a background thread, */
+/* as they are read into buf. Does nothing if this isn't a scan. */
+void munki_scan_conv_start(
+	munki *p,
+	int ninvmeas,			/* Number of extra invalid measurements at start */
+	unsigned char *buf,		/* Raw USB reading buffer */
+	int bsize				/* Bytes available in buffer */
+);
+
+/* Tell the background conversion that nread readings are now in the buffer */
+void munki_scan_conv_add(munki *p, int nread);
+
+/* Finish the background conversion once the scan read is complete. */
+/* The results are only kept if ev is MUNKI_OK. */
+void munki_scan_conv_end(munki *p, munki_code ev);
+
 /* Subtract the black from raw values and convert to */
 /* absolute (integration & gain scaled), zero offset based, */
 /* linearized sensor values. */
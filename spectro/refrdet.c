@@ -0,0 +1,363 @@
+
+/*
+ * Display refresh rate detection, shared by instrument drivers.
+ *
+ * This locates the refresh period of a display from a set of fast
+ * light level samples, using an FFT to compute their autocorrelation.
+ */
+
+/*
+ * Author:  Graeme W. Gill
+ * Date:    15/10/2026
+ * Version: 1.00
+ *
+ * Copyright 2026 Graeme W. Gill
+ * All rights reserved.
+ *
+ * This material is licenced under the GNU GENERAL PUBLIC LICENSE Version 2 or later :-
+ * see the License2.txt file for licencing details.
+ *
+ * (Derived from i1d3.c)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifndef SALONEINSTLIB
+#include "copyright.h"
+#include "aconfig.h"
+#include "numlib.h"
+#else	/* !SALONEINSTLIB */
+#include "sa_config.h"
+#include "numsup.h"
+#endif /* !SALONEINSTLIB */
+#ifndef SALONEINSTLIB
+#  include "plot.h"
+#endif
+#include "refrdet.h"
+
+#undef PLOT_REFRESH		/* Plot data used to determine refresh rate */
+
+#define PBPMS 20			/* bins per msec */
+#define PERMIN ((1000 * PBPMS)/40)	/* 40 Hz */
+#define PERMAX ((1000 * PBPMS)/5)	/* 5 Hz*/
+#define NPER (PERMAX - PERMIN + 1)
+#define PWIDTH (8 * PBPMS)			/* 8 msec bin spread to look for peak in */
+#define MAXPKS 20					/* Number of peaks to find */
+#define FWIDTH 6					/* Gausian filter width in msec */
+
+/* In place radix 2 complex FFT of n = 2^k points. */
+/* If inv is nz, do the (unscaled) inverse transform. */
+static void refr_fft(double *re, double *im, int n, int inv) {
+	int i, j, k, m, bit;
+
+	/* Bit reverse re-order */
+	for (i = 1, j = 0; i < n; i++) {
+		for (bit = n >> 1; j & bit; bit >>= 1)
+			j ^= bit;
+		j ^= bit;
+		if (i < j) {
+			double tt;
+			tt = re[i]; re[i] = re[j]; re[j] = tt;
+			tt = im[i]; im[i] = im[j]; im[j] = tt;
+		}
+	}
+
+	/* Butterflies */
+	for (m = 2; m <= n; m <<= 1) {
+		int hm = m/2;
+		double ang = (inv ? 2.0 : -2.0) * DBL_PI/m;
+
+		for (k = 0; k < hm; k++) {
+			double wr = cos(ang * k), wi = sin(ang * k);
+
+			for (i = k; i < n; i += m) {
+				double tr, ti;
+				j = i + hm;
+				tr = re[j] * wr - im[j] * wi;
+				ti = re[j] * wi + im[j] * wr;
+				re[j] = re[i] - tr;
+				im[j] = im[i] - ti;
+				re[i] += tr;
+				im[i] += ti;
+			}
+		}
+	}
+}
+
+/* Compute the autocorrelation of the samples for lags of */
+/* PERMIN to PERMAX bins. Samples are accumulated into 1/PBPMS msec */
+/* bins, so that the correlation of each bin with every other bin */
+/* sums the products of all the sample pairs with that time difference. */
+/* Return nz on malloc failure */
+static int refr_autocorr(refrsamp *samp, int nsamp, double mint, double maxt, double *tcorr) {
+	int i, n, nbins;
+	double *re, *im;
+
+	nbins = 1 + (int)((maxt - mint) * 1000.0 * PBPMS + 0.5);
+
+	/* Pad with zeros so that the correlation doesn't wrap around */
+	for (n = 1; n < (nbins + PERMAX + 1); n <<= 1)
+		;
+
+	if ((re = (double *)calloc(sizeof(double), 2 * n)) == NULL)
+		return 1;
+	im = re + n;
+
+	for (i = 0; i < nsamp; i++) {
+		int bix = (int)((samp[i].sec - mint) * 1000.0 * PBPMS + 0.5);
+		re[bix] += samp[i].lev;
+	}
+
+	/* Autocorrelation is the inverse transform of the power spectrum */
+	refr_fft(re, im, n, 0);
+	for (i = 0; i < n; i++) {
+		re[i] = re[i] * re[i] + im[i] * im[i];
+		im[i] = 0.0;
+	}
+	refr_fft(re, im, n, 1);
+
+	for (i = 0; i < NPER; i++)
+		tcorr[i] = re[PERMIN + i]/(double)n;
+
+	free(re);
+
+	return 0;
+}
+
+/* Locate the refresh rate from a set of samples. */
+int refr_detect(
+	a1log *log,
+	refrsamp *samp,		/* Samples */
+	int nsamp,			/* Number of samples */
+	double minrms,		/* Minimum RMS level to consider */
+	double *prefrate,	/* Return refresh rate in Hz, 0.0 if none */
+	double *pper		/* Return period in seconds, 0.0 if none */
+) {
+	int i, j, k;
+	double mint, maxt;		/* Time range */
+	double rms;				/* RMS value */
+	double tcorr[NPER];		/* Unfiltered autocorrelation */
+	double corr[NPER];		/* Filtered correlation for each period value */
+	double mincv, maxcv;	/* Max and min correlation values */
+	double crange;			/* Correlation range */
+	double peaks[MAXPKS];	/* Each peak from longest to shortest */
+	int npeaks = 0;			/* Number of peaks */
+	double pval;			/* Period value */
+
+	if (prefrate != NULL)
+		*prefrate = 0.0;
+	if (pper != NULL)
+		*pper = 0.0;
+
+	if (nsamp < 2)
+		return 0;
+
+	mint = 1e38, maxt = -1e38;
+	rms = 0.0;
+	for (i = 0; i < nsamp; i++) {
+		if (samp[i].sec < mint)
+			mint = samp[i].sec;
+		if (samp[i].sec > maxt)
+			maxt = samp[i].sec;
+		rms += samp[i].lev * samp[i].lev;
+	}
+	rms = sqrt(rms/(double)nsamp);
+	a1logd(log, 4, "refr_detect: %d samples over %f secs, RMS %f\n",nsamp,maxt - mint,rms);
+
+	if (refr_autocorr(samp, nsamp, mint, maxt, tcorr)) {
+		a1loge(log, 1, "refr_detect: malloc failed\n");
+		return 1;
+	}
+
+#ifdef PLOT_REFRESH
+	/* Plot unfiltered auto correlation */
+	{
+		double xx[NPER];
+		double y1[NPER];
+
+		for (i = 0; i < NPER; i++) {
+			xx[i] = (i + PERMIN) / (double)PBPMS;			/* msec */
+			y1[i] = tcorr[i];
+		}
+		printf("Unfiltered auto correlation (msec)\n");
+		do_plot6(xx, y1, NULL, NULL, NULL, NULL, NULL, NPER);
+	}
+#endif /* PLOT_REFRESH */
+
+	/* Apply a FWIDTH msec gausian filter */
+	{
+		double gaus_[2 * FWIDTH * PBPMS + 1];
+		double *gaus = &gaus_[FWIDTH * PBPMS];
+		double bb = 1.0/pow(2, 5.0);
+
+		for (j = (-FWIDTH * PBPMS); j <= (FWIDTH * PBPMS); j++) {
+			double tt;
+			tt = (double)j/(FWIDTH * PBPMS);
+			gaus[j] = 1.0/pow(2, 5.0 * tt * tt) - bb;
+		}
+		for (i = 0; i < NPER; i++) {
+			double sum = 0.0;
+			double wght = 0.0;
+
+			for (j = (-FWIDTH * PBPMS); j <= (FWIDTH * PBPMS); j++) {
+				double w;
+				int ix = i + j;
+				if (ix < 0)
+					continue;
+				if (ix > (NPER-1))
+					break;
+				w = gaus[j];
+				sum += w * tcorr[ix];
+				wght += w;
+			}
+			corr[i] = sum / wght;
+		}
+	}
+
+	/* Compute min & max */
+	mincv = 1e48, maxcv = -1e48;
+	for (i = 0; i < NPER; i++) {
+		if (corr[i] > maxcv)
+			maxcv = corr[i];
+		if (corr[i] < mincv)
+			mincv = corr[i];
+	}
+
+	crange = maxcv - mincv;
+	a1logd(log,4,"Correlation value range %f - %f = %f = %f%%\n",mincv, maxcv,crange, 100.0 * (maxcv-mincv)/maxcv);
+
+	/* If there is sufficient level and distict correlations */
+	if (rms >= minrms && maxcv > 0.0 && (maxcv-mincv)/maxcv >= 0.10) {
+
+		/* Locate all the peaks starting at the longest correllation */
+		for (i = (NPER-1-PWIDTH); i >= 0 && npeaks < MAXPKS; i--) {
+			double v1, v2, v3;
+			v1 = corr[i];
+			v2 = corr[i + PWIDTH/2];
+			v3 = corr[i + PWIDTH];
+
+			if (fabs(v3 - v1) < (0.05 * crange)
+			 && (v2 - v1) > (0.025 * crange)
+			 && (v2 - v3) > (0.025 * crange)) {
+				double pkv;			/* Peak value */
+				int pki;			/* Peak index */
+				double ii, bl;
+
+				a1logd(log,4,"Max between %f and %f msec\n",
+				       (i + PERMIN)/(double)PBPMS,(i + PWIDTH + PERMIN)/(double)PBPMS);
+
+				/* Locate the actual peak */
+				pkv = -1e48;
+				pki = i;
+				for (j = i; j < (i + PWIDTH); j++) {
+					if (corr[j] > pkv) {
+						pkv = corr[j];
+						pki = j;
+					}
+				}
+				a1logd(log,4,"Peak is at %f msec, %f corr\n", (pki + PERMIN)/(double)PBPMS, pkv);
+
+				/* Interpolate the peak value for higher precision */
+				/* j = bigest */
+				ii = pki;
+				if (pki > 0 && pki < (NPER-1)) {
+					if (corr[pki-1] > corr[pki+1])  {
+						j = pki-1;
+						k = pki+1;
+					} else {
+						j = pki+1;
+						k = pki-1;
+					}
+					if (corr[pki] > corr[k]) {
+						bl = (corr[pki] - corr[j])/(corr[pki] - corr[k]);
+						bl = (bl + 1.0)/2.0;
+						ii = bl * pki + (1.0 - bl) * j;
+					}
+				}
+				pval = (ii + PERMIN)/(double)PBPMS;
+
+				a1logd(log,4,"Interpolated peak is at %f msec\n", pval);
+
+				peaks[npeaks++] = pval;
+
+				i -= PWIDTH;
+			}
+		}
+	}
+
+	a1logd(log,3,"Number of peaks located = %d\n",npeaks);
+	if (npeaks == 0) {
+		a1logd(log, 2, "refr_detect: Couldn't find a distinct refresh frequency\n");
+		return 0;
+	}
+
+	if (npeaks == 1) {
+		a1logd(log,3,"Only one peak\n");
+		if (pper != NULL)
+			*pper = peaks[0] / 2000.0;	/* Scale by half and convert to seconds */
+
+	} else {
+		int nfails;
+		double div, avg = 0.0, ano = 0.0;
+
+		/* Try and locate a common divisor amongst all the peaks. */
+		/* This is likely to be the underlying refresh rate. */
+		for (k = 0; k < npeaks; k++) {
+			for (j = 1; j < 20; j++) {
+				avg = ano = 0.0;
+				div = peaks[k]/(double)j;
+				if (div < 9.0)
+					continue;		/* Skip anything over 100Hz */
+				for (nfails = i = 0; i < npeaks; i++) {
+					double rem, cnt;
+
+					rem = peaks[i]/div;
+					cnt = floor(rem + 0.5);
+					rem = fabs(rem - cnt);
+
+					a1logd(log, 5, "remainder for peak %d = %f\n",i,rem);
+					if (rem > 0.06) {
+						if (++nfails > 2)
+							break;				/* Fail this divisor */
+					}
+					avg += peaks[i];		/* Already weighted by cnt */
+					ano += cnt;
+				}
+
+				if (nfails == 0 || (nfails <= 2 && npeaks >= 6))
+					break;		/* Sucess */
+				/* else go and try a different divisor */
+			}
+			if (j < 20)
+				break;			/* Found common divisor */
+		}
+		if (k >= npeaks) {
+			a1logd(log,3,"Failed to locate common divisor\n");
+			if (pper != NULL)
+				*pper = peaks[0] / 2000.0;	/* Scale by half and convert to seconds */
+
+		} else {
+			pval = avg/ano;
+			pval /= 1000.0;		/* Convert to seconds */
+
+			a1logd(log, 3, "refr_detect: Refresh rate = %f Hz\n",1.0/pval);
+
+			if (prefrate != NULL)
+				*prefrate = 1.0/pval;
+			if (pper != NULL)
+				*pper = pval;
+		}
+	}
+
+	return 0;
+}
+
+#undef PBPMS
+#undef PERMIN
+#undef PERMAX
+#undef NPER
+#undef PWIDTH
+#undef MAXPKS
+#undef FWIDTH
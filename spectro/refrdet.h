@@ -0,0 +1,56 @@
+
+#ifndef REFRDET_H
+#define REFRDET_H
+
+/*
+ * Display refresh rate detection, shared by instrument drivers.
+ *
+ * This locates the refresh period of a display from a set of fast
+ * light level samples, using an FFT to compute their autocorrelation.
+ */
+
+/*
+ * Author:  Graeme W. Gill
+ * Date:    15/10/2026
+ * Version: 1.00
+ *
+ * Copyright 2026 Graeme W. Gill
+ * All rights reserved.
+ *
+ * This material is licenced under the GNU GENERAL PUBLIC LICENSE Version 2 or later :-
+ * see the License2.txt file for licencing details.
+ *
+ * (Derived from i1d3.c)
+ */
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+/* A light level sample */
+typedef struct {
+	double sec;			/* Sample time in seconds */
+	double lev;			/* Light level, normalised by the integration time */
+} refrsamp;
+
+/* Locate the refresh rate from a set of samples, which need not be */
+/* evenly spaced in time, nor be in time order. Periods from 25 to */
+/* 200 msec are looked for in the autocorrelation, and the refresh */
+/* period is the common divisor of the peaks found. */
+/* *prefrate is set to the refresh rate in Hz, or 0.0 if none is found. */
+/* *pper is set to the refresh period in seconds, or a fallback */
+/* quantization period if there is no distinct refresh rate, */
+/* or 0.0 if there is neither. */
+/* minrms is the minimum RMS light level to consider. */
+/* Return nz on a malloc failure. */
+int refr_detect(a1log *log, refrsamp *samp, int nsamp, double minrms,
+                double *prefrate, double *pper);
+
+/* Return nz if two refresh rates are the same, within measurement error */
+#define REFR_SAME(r1, r2) ((r1) > 0.0 && (r2) > 0.0 && fabs((r1) - (r2)) < (0.002 * (r1)))
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif /* REFRDET_H */
@@ -80,6 +80,33 @@
 #endif
 
 
+/* Context for FWA compensating spectra in parallel */
+typedef struct {
+	xsp2cie *sp2cie;
+	xspect *sp;			/* Wavelength range and normalisation */
+	double *vals;		/* npat * spec_n spectral values, replaced by corrected values */
+	double *XYZ;		/* Return npat * 3 XYZ values */
+} s2c_fwa_cntx;
+
+/* FWA compensate spectra i0 .. i1-1, returning the corrected */
+/* spectra as well as the XYZ. */
+static int s2c_fwa_thread(void *cntx, int i0, int i1, int thix) {
+	s2c_fwa_cntx *p = (s2c_fwa_cntx *)cntx;
+	xspect sp = *p->sp;
+	int i, j;
+
+	for (i = i0; i < i1; i++) {
+		double *vals = p->vals + i * sp.spec_n;
+
+		for (j = 0; j < sp.spec_n; j++)
+			sp.spec[j] = vals[j];
+		p->sp2cie->sconvert(p->sp2cie, &sp, p->XYZ + i * 3, &sp);
+		for (j = 0; j < sp.spec_n; j++)
+			vals[j] = sp.spec[j];
+	}
+	return 0;
+}
+
 void
 usage (void)
 {
@@ -658,8 +685,11 @@ main(int argc, char *argv[])
 		int oXi, oYi, oZi, oLi, oai, obi;	/* CGATS indexes for each ouput field */
 		int oL2i, oa2i, ob2i;				/* For illuminant wp L*a*b* output */
 		xsp2cie *sp2cie;				/* Spectral conversion object */
+		xrga_tab *calstdtab = NULL;		/* XRGA conversion, NULL if none */
 		xspect sp;
-		double XYZ[3];
+		double *pvals;					/* npat * spec_n spectral values */
+		double *pXYZ;					/* npat * 3 XYZ values */
+		double *XYZ;
 		double Lab[3], Lab2[3];
 		char buf[100];
 							/* These are only set if fwa is needed */
@@ -959,8 +989,47 @@ main(int argc, char *argv[])
 			ocg->add_kword(ocg, 0, "ILLUMINANT_WHITE_POINT_XYZ",buf, NULL);
 		}
 
-		/* Transform patches from spectral to CIE, */
-		/* after correcting the spectrum for possible XRGA and FWA. */
+		/* Setup the XRGA conversion once for all the patches */
+		if (calstdo != xcalstd_none) {
+			if ((calstdtab = (xrga_tab *)malloc(sizeof(xrga_tab))) == NULL)
+				error("Malloc failed");
+			xrga_tab_init(calstdtab, &sp, calpol, calstdo, calstdi);
+		}
+
+		/* Read all the spectral values, correcting them for possible XRGA */
+		if ((pvals = (double *)malloc(sizeof(double) * npat * sp.spec_n)) == NULL
+		 || (pXYZ = (double *)malloc(sizeof(double) * npat * 3)) == NULL)
+			error("Malloc failed");
+
+		for (i = 0; i < npat; i++) {
+			double *vals = pvals + i * sp.spec_n;
+
+			for (j = 0; j < sp.spec_n; j++)
+				sp.spec[j] = *((double *)icg->t[0].fdata[i][spi[j]]);
+
+			if (calstdtab != NULL)
+				xspec_convert_xrga_tab(calstdtab, &sp, &sp);
+
+			for (j = 0; j < sp.spec_n; j++)
+				vals[j] = sp.spec[j];
+		}
+
+		/* Transform them all from spectral to CIE, correcting for possible FWA. */
+		/* If the FWA corrected spectra are to be output, they each need */
+		/* sconvert(), otherwise convert_n() can do the lot at once. */
+		if (fwacomp && nospec == 0) {
+			s2c_fwa_cntx cx;
+
+			cx.sp2cie = sp2cie;
+			cx.sp = &sp;
+			cx.vals = pvals;
+			cx.XYZ = pXYZ;
+			par_for(0, 0, npat, 0, s2c_fwa_thread, (void *)&cx);
+		} else {
+			sp2cie->convert_n(sp2cie, pXYZ, &sp, pvals, npat);
+		}
+
+		/* Create the output patches */
 		for (i = 0; i < npat; i++) {
 
 			/* copy all input colums to output (except spectral if nospec) */
@@ -1001,19 +1070,10 @@ main(int argc, char *argv[])
 				jj++;
 			}
 
-			/* Read the spectral values for this patch */
+			/* The (corrected) spectral values and XYZ for this patch */
 			for (j = 0; j < sp.spec_n; j++)
-				sp.spec[j] = *((double *)icg->t[0].fdata[i][spi[j]]);
-
-			if (calstdo != xcalstd_none)
-				xspec_convert_xrga(&sp, &sp, calpol, calstdo, calstdi);
-
-			/* Convert it to CIE space */
-			if (fwacomp) {
-				sp2cie->sconvert(sp2cie, &sp, XYZ, &sp);
-			} else {
-				sp2cie->convert(sp2cie, XYZ, &sp);
-			}
+				sp.spec[j] = pvals[i * sp.spec_n + j];
+			XYZ = pXYZ + i * 3;
 
 			/* Standard pseudo-absolute D50 ICC Lab */
 			icmXYZ2Lab(&icmD50, Lab, XYZ);
@@ -1075,6 +1135,10 @@ main(int argc, char *argv[])
 		}
 
 		sp2cie->del (sp2cie);		/* Done with this */
+		if (calstdtab != NULL)
+			free(calstdtab);
+		free(pvals);
+		free(pXYZ);
 
 		ocg->del (ocg);				/* Clean up */
 		icg->del (icg);				/* Clean up */
@@ -2113,6 +2113,8 @@ static void
 specbos_del(inst *pp) {
 	if (pp != NULL) {
 		specbos *p = (specbos *)pp;
+		if (p->strm != NULL)		/* Stop any streaming thread */
+			p->stream_stop(pp);
 		if (p->th != NULL) {		/* Terminate diffuser monitor thread  */
 			int i;
 			p->th_term = 1;			/* Tell thread to exit on error */
@@ -2172,6 +2174,9 @@ inst3_capability *pcap3) {
 	/* Can average multiple measurements */
 	cap3 |= inst3_average;
 
+	/* Can stream readings */
+	cap3 |= inst3_stream;
+
 	if (pcap1 != NULL)
 		*pcap1 = cap1;
 	if (pcap2 != NULL)
@@ -428,7 +428,7 @@ static inst_code uicallback(void *cntx, inst_ui_purp purp) {
   Flags used:
 
          ABCDEFGHIJKLMNOPQRSTUVWXYZ
-  upper     ... .  .  .. . .. ...  
+  upper     ... .  ... .. . .. ...  
   lower  . .... ..      .  .. .... 
 
 */
@@ -531,6 +531,7 @@ usage(char *diag, ...) {
 	fprintf(stderr," -O                   Do one cal. or measure and exit\n");
 #endif
 	fprintf(stderr," -H                   Start in high resolution spectrum mode (if available)\n");
+	fprintf(stderr," -L secs              Stream readings as fast as possible for secs seconds (if available)\n");
 	if (cap2 & inst2_ccmx)
 		fprintf(stderr," -X file.ccmx         Apply Colorimeter Correction Matrix\n");
 	if (cap2 & inst2_ccss) {
@@ -566,6 +567,7 @@ int main(int argc, char *argv[]) {
 	int nocal = 0;					/* Disable auto calibration */
 	int doone = 0;					/* 1 = Do one calibration or measure and exit */
 									/* 2 = + also save result to outspname */
+	double streamsecs = 0.0;		/* > 0.0 = stream readings for this many seconds */
 	int pspec = 0;					/* 1 = Print out the spectrum for each reading */
 									/* 2 = Plot out the spectrum for each reading */
 	int refwr = 0;					/* Reflection mode white relative mode */
@@ -1026,6 +1028,13 @@ int main(int argc, char *argv[]) {
 			} else if (argv[fa][1] == 'H') {
 				highres = 1;
 
+			/* Stream readings */
+			} else if (argv[fa][1] == 'L') {
+				fa = nfa;
+				if (na == NULL) usage("Parameter expected after -L");
+				streamsecs = atof(na);
+				if (streamsecs <= 0.0) usage("-L parameter '%s' is out of range",na);
+
 			/* Colorimeter Correction Matrix or */
 			/* Colorimeter Calibration Spectral Samples */
 			} else if (argv[fa][1] == 'X') {
@@ -1859,6 +1868,81 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	/* Stream readings until the time is up or the user hits a key */
+	if (streamsecs > 0.0) {
+		int msamp = 200;
+		double *ssec;
+		ipatch *svals;
+		int nsamp, lost, tlost = 0, nread = 0;
+		double lsec = 0.0;
+
+		it->capabilities(it, &cap, &cap2, &cap3);
+		if (!IMODETST(cap3, inst3_stream))
+			error("Instrument doesn't support streaming readings in this mode");
+
+		if ((ssec = (double *)malloc(sizeof(double) * msamp)) == NULL
+		 || (svals = (ipatch *)malloc(sizeof(ipatch) * msamp)) == NULL)
+			error("Malloc of stream buffers failed");
+
+		if (it->needs_calibration(it) & inst_calt_n_dfrble_mask) {
+			printf("\nNeed a calibration before continuing\n");
+
+			rv = inst_handle_calibrate(it, inst_calt_needed, inst_calc_none, NULL, NULL, 0);
+			if (rv != inst_ok)	/* Abort or fatal error */
+				error("Got abort or error from calibration");
+		}
+
+		if ((rv = it->get_set_opt(it, inst_opt_trig_prog)) != inst_ok)
+			error("Setting trigger mode failed with error :'%s' (%s)",
+	       	       it->inst_interp_error(it, rv), it->interp_error(it, rv));
+		it->set_uicallback(it, uicallback, NULL);
+
+		printf("\nStreaming readings for %.1f seconds, hit any key to stop:\n",streamsecs);
+		printf("Time\tX\tY\tZ\n");
+		if (fp != NULL)
+			fprintf(fp,"Time\tX\tY\tZ\n");
+
+		empty_con_chars();
+		if ((rv = it->stream_start(it, 0)) != inst_ok)
+			error("Starting stream failed with error :'%s' (%s)",
+	       	       it->inst_interp_error(it, rv), it->interp_error(it, rv));
+
+		for (;;) {
+			msec_sleep(20);
+			rv = it->stream_read(it, msamp, ssec, svals, &nsamp, &lost);
+			tlost += lost;
+			for (i = 0; i < nsamp && ssec[i] <= streamsecs; i++) {
+				lsec = ssec[i];
+				printf("%f\t%f\t%f\t%f\n",ssec[i],
+				       svals[i].XYZ[0], svals[i].XYZ[1], svals[i].XYZ[2]);
+				if (fp != NULL)
+					fprintf(fp,"%f\t%f\t%f\t%f\n",ssec[i],
+					       svals[i].XYZ[0], svals[i].XYZ[1], svals[i].XYZ[2]);
+				nread++;
+			}
+			if (i < nsamp) 				/* Time is up */
+				break;
+			if (rv != inst_ok) {
+				printf("\nStream stopped with error :'%s' (%s)\n",
+		       	       it->inst_interp_error(it, rv), it->interp_error(it, rv));
+				break;
+			}
+			if (poll_con_char() != 0)
+				break;
+		}
+		it->stream_stop(it);
+
+		printf("\nGot %d readings in %.2f seconds (%.1f Hz)",nread, lsec,
+		       lsec > 0.0 ? nread/lsec : 0.0);
+		if (tlost > 0)
+			printf(", %d lost to buffer overflow",tlost);
+		printf("\n");
+
+		free(svals);
+		free(ssec);
+		goto done;
+	}
+
 	/* Read spots until the user quits */
 	for (ix = 1;; ix++) {
 		ipatch val;								/* Raw measurement value */
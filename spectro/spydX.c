@@ -1054,6 +1054,9 @@ static void
 spydX_del(inst *pp) {
 	spydX *p = (spydX *)pp;
 
+	if (p->strm != NULL)		/* Stop any streaming thread */
+		p->stream_stop(pp);
+
 #ifdef ENABLE_NONVCAL
 	/* Touch it so that we know when the instrument was last open */
 	spydX_touch_calibration(p);
@@ -1103,7 +1106,7 @@ inst3_capability *pcap3) {
 	if (pcap2 != NULL)
 		*pcap2 = cap2;
 	if (pcap3 != NULL)
-		*pcap3 = inst3_none;
+		*pcap3 = inst3_stream;
 }
 
 /* Check device measurement mode */
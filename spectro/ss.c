@@ -742,6 +742,15 @@ ipatch *vals) { 		/* Pointer to array of values */
 		p->pisrow = 2 * pis;
 	}
 
+	/* Note that the patches of an XY sheet always lie on a regular */
+	/* (possibly hex offset) grid, and a serpentine path along the fast */
+	/* axis is already a shortest head path over such a grid, so there */
+	/* is nothing to be gained from a general (nearest neighbour + 2-opt) */
+	/* path optimization. Such an ordering would also wander against */
+	/* the fast & quiet direction, and defeat the placement of */
+	/* calibrations at row starts by check_calcount() below. */
+	/* A future XY instrument with arbitrary patch locations should */
+	/* revisit this. */
 	tries = sip * pis;		/* Total grid patch count. Not all may have real patches. */
 
 	/* Read all the patches */
@@ -239,6 +239,256 @@ icoms_usb_rw(icoms *p,
 	return lerr;
 }
 
+/*  - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Asynchronous transfer queues. */
+/* Each end point in use gets a thread that works through its queue */
+/* using the synchronous icoms_usb_rw(), so that transfers to the same */
+/* end point stay in order, while transfers to different end points */
+/* and the callers processing overlap. This works with all the */
+/* platform implementations, since they all support a cancel token. */
+
+/* End point queue thread */
+static int icoms_usb_xq_thread(void *context) {
+	struct _usb_xqueue *q = (struct _usb_xqueue *)context;
+	icoms *p = q->icom;
+
+	a1logd(p->log, 8, "icoms_usb_xq_thread: ep 0x%02x started\n",q->ep);
+
+	for (;;) {
+		usb_xfer *xf;
+		int rv = ICOM_CANC, bxfer = 0;
+
+		amutex_lock(q->lock);
+		while (q->head == NULL && !q->shutdown)
+			acond_wait(q->cond, q->lock);
+		if ((xf = q->head) == NULL) {		/* Shutdown and nothing left */
+			amutex_unlock(q->lock);
+			break;
+		}
+		if (!xf->cancelled) {
+			xf->state = 1;
+			usb_reinit_cancel(&xf->cancelt);
+		}
+		amutex_unlock(q->lock);
+
+		if (xf->state == 1)
+			rv = icoms_usb_rw(p, &xf->cancelt, xf->ep, xf->buf, xf->bsize, &bxfer, xf->tout);
+
+		if (xf->callback != NULL)
+			xf->callback(xf->cntx, xf, rv, bxfer);
+
+		amutex_lock(q->lock);
+		if ((q->head = xf->next) == NULL) {
+			q->tail = NULL;
+			acond_signal(q->idle);
+		}
+		xf->rv = rv;
+		xf->bxfer = bxfer;
+		xf->state = 2;
+		if (xf->autofree) {
+			usb_uninit_cancel(&xf->cancelt);
+			acond_del(xf->done);
+			free(xf);
+		} else {
+			acond_signal(xf->done);
+		}
+		amutex_unlock(q->lock);
+	}
+
+	a1logd(p->log, 8, "icoms_usb_xq_thread: ep 0x%02x exiting\n",q->ep);
+	return 0;
+}
+
+/* Queue an asynchronous transfer */
+static int
+icoms_usb_submit(
+	icoms *p,
+	usb_xfer **pxf,			/* Return transfer handle, NULL if not needed */
+	int ep,					/* End point address */
+	unsigned char *buf,		/* Read/Write buffer */
+	int bsize,				/* Bytes to read or write */
+	double tout,			/* Timeout in seconds */
+	void (*callback)(void *cntx, usb_xfer *xf, int rv, int bxfer),
+	void *cntx				/* Context for callback */
+) {
+	struct _usb_xqueue *q;
+	usb_xfer *xf;
+	int ix = ((ep >> 3) & 0x10) + (ep & 0x0f);
+
+	if (pxf != NULL)
+		*pxf = NULL;
+
+	if (!p->is_open) {
+		a1loge(p->log, ICOM_SYS, "icoms_usb_submit: device not initialised\n");
+		return ICOM_SYS;
+	}
+
+	if (p->EPINFO(ep).valid == 0) {
+		a1loge(p->log, ICOM_SYS, "icoms_usb_submit: invalid end point 0x%02x\n",ep);
+		return ICOM_SYS;
+	}
+
+	/* Create the end point queue and its thread on first use */
+	if ((q = p->xq[ix]) == NULL) {
+		if ((q = (struct _usb_xqueue *)calloc(1, sizeof(struct _usb_xqueue))) == NULL) {
+			a1loge(p->log, ICOM_SYS, "icoms_usb_submit: calloc failed\n");
+			return ICOM_SYS;
+		}
+		q->icom = p;
+		q->ep = ep;
+		amutex_init(q->lock);
+		acond_init(q->cond);
+		acond_init(q->idle);
+		if ((q->th = new_athread(icoms_usb_xq_thread, (void *)q)) == NULL) {
+			a1loge(p->log, ICOM_SYS, "icoms_usb_submit: creating queue thread failed\n");
+			acond_del(q->idle);
+			acond_del(q->cond);
+			amutex_del(q->lock);
+			free(q);
+			return ICOM_SYS;
+		}
+		p->xq[ix] = q;
+	}
+
+	if ((xf = (usb_xfer *)calloc(1, sizeof(usb_xfer))) == NULL) {
+		a1loge(p->log, ICOM_SYS, "icoms_usb_submit: calloc failed\n");
+		return ICOM_SYS;
+	}
+	xf->ep = ep;
+	xf->buf = buf;
+	xf->bsize = bsize;
+	xf->tout = tout;
+	xf->callback = callback;
+	xf->cntx = cntx;
+	xf->autofree = pxf == NULL;
+	usb_init_cancel(&xf->cancelt);
+	acond_init(xf->done);
+
+	a1logd(p->log, 8, "icoms_usb_submit: queuing %d bytes on ep 0x%02x\n",bsize,ep);
+
+	amutex_lock(q->lock);
+	if (q->tail != NULL)
+		q->tail->next = xf;
+	else
+		q->head = xf;
+	q->tail = xf;
+	if (pxf != NULL)
+		*pxf = xf;
+	acond_signal(q->cond);
+	amutex_unlock(q->lock);
+
+	return ICOM_OK;
+}
+
+/* Wait for a transfer to complete and free it */
+static int
+icoms_usb_xfer_wait(
+	icoms *p,
+	usb_xfer *xf,			/* Transfer handle */
+	int *bxfer				/* Bytes read/written, may be NULL */
+) {
+	struct _usb_xqueue *q;
+	int rv;
+
+	if (xf == NULL)
+		return ICOM_SYS;
+	q = p->xq[((xf->ep >> 3) & 0x10) + (xf->ep & 0x0f)];
+
+	amutex_lock(q->lock);
+	while (xf->state != 2)
+		acond_wait(xf->done, q->lock);
+	amutex_unlock(q->lock);
+
+	rv = xf->rv;
+	if (bxfer != NULL)
+		*bxfer = xf->bxfer;
+
+	usb_uninit_cancel(&xf->cancelt);
+	acond_del(xf->done);
+	free(xf);
+
+	return rv;
+}
+
+/* Cancel a queued or in progress transfer */
+static int
+icoms_usb_xfer_cancel(
+	icoms *p,
+	usb_xfer *xf			/* Transfer handle */
+) {
+	struct _usb_xqueue *q;
+	int rv = ICOM_OK;
+
+	if (xf == NULL)
+		return ICOM_SYS;
+	q = p->xq[((xf->ep >> 3) & 0x10) + (xf->ep & 0x0f)];
+
+	amutex_lock(q->lock);
+	if (xf->state == 0)
+		xf->cancelled = 1;
+	else if (xf->state == 1)
+		rv = icoms_usb_cancel_io(p, &xf->cancelt);
+	amutex_unlock(q->lock);
+
+	return rv;
+}
+
+/* Wait until all the queues are empty */
+static int
+icoms_usb_xfer_flush(
+	icoms *p
+) {
+	int i;
+
+	for (i = 0; i < 32; i++) {
+		struct _usb_xqueue *q = p->xq[i];
+
+		if (q == NULL)
+			continue;
+		amutex_lock(q->lock);
+		while (q->head != NULL)
+			acond_wait(q->idle, q->lock);
+		amutex_unlock(q->lock);
+	}
+	return ICOM_OK;
+}
+
+/* Cancel any transfers and shut down the queues */
+void usb_xfer_shutdown(
+	icoms *p
+) {
+	int i;
+
+	for (i = 0; i < 32; i++) {
+		struct _usb_xqueue *q = p->xq[i];
+		usb_xfer *xf;
+
+		if (q == NULL)
+			continue;
+
+		a1logd(p->log, 6, "usb_xfer_shutdown: stopping ep 0x%02x queue\n",q->ep);
+		amutex_lock(q->lock);
+		q->shutdown = 1;
+		for (xf = q->head; xf != NULL; xf = xf->next) {
+			if (xf->state == 0)
+				xf->cancelled = 1;
+			else if (xf->state == 1)
+				icoms_usb_cancel_io(p, &xf->cancelt);
+		}
+		acond_signal(q->cond);
+		amutex_unlock(q->lock);
+
+		q->th->wait(q->th);
+		q->th->del(q->th);
+
+		acond_del(q->idle);
+		acond_del(q->cond);
+		amutex_del(q->lock);
+		free(q);
+		p->xq[i] = NULL;
+	}
+}
+
 /*  - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 /* Static list so that all open USB/HID connections can be closed on a SIGKILL */
@@ -650,6 +900,10 @@ icoms *p
 	p->usb_write        = icoms_usb_rw;
 	p->usb_wait_io      = icoms_usb_wait_io;
 	p->usb_cancel_io    = icoms_usb_cancel_io;
+	p->usb_submit       = icoms_usb_submit;
+	p->usb_xfer_wait    = icoms_usb_xfer_wait;
+	p->usb_xfer_cancel  = icoms_usb_xfer_cancel;
+	p->usb_xfer_flush   = icoms_usb_xfer_flush;
 	p->usb_resetep      = icoms_usb_resetep;
 	p->usb_clearhalt    = icoms_usb_clearhalt;
 }
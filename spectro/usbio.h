@@ -191,6 +191,38 @@ struct _usb_cancelt {
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+/* Asynchronous transfer */
+struct _usb_xfer {
+	struct _usb_xfer *next;	/* Next in end point queue */
+	int ep;					/* End point address */
+	unsigned char *buf;		/* Read/Write buffer */
+	int bsize;				/* Bytes to read/write */
+	double tout;			/* Timeout in seconds */
+	void (*callback)(void *cntx, struct _usb_xfer *xf, int rv, int bxfer);
+	void *cntx;				/* Context for callback */
+	int autofree;			/* NZ if no handle was returned, free on completion */
+	int cancelled;			/* NZ if cancelled before starting */
+	struct _usb_cancelt cancelt;	/* Cancel token while in progress */
+	int state;				/* 0 = queued, 1 = in progress, 2 = complete */
+	int rv;					/* icom error result */
+	int bxfer;				/* Bytes read/written */
+	acond done;				/* Signalled on completion */
+};
+
+/* Per end point asynchronous transfer queue */
+struct _usb_xqueue {
+	struct _icoms *icom;	/* icoms we belong to */
+	int ep;					/* End point address */
+	amutex lock;			/* Protect queue and transfer state */
+	acond cond;				/* Signal queue thread that there is work */
+	acond idle;				/* Signal that the queue has emptied */
+	struct _usb_xfer *head, *tail;	/* Queue of pending transfers */
+	int shutdown;			/* Flag to tell queue thread to exit */
+	athread *th;			/* Queue thread */
+};
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 /* These routines suplement the class code in icoms_nt.c and icoms_ux.c */
 
 /* Add paths to USB connected instruments, to the existing */
@@ -200,6 +232,10 @@ int usb_get_paths(struct _icompaths *p);
 
 void usb_close_port(icoms *p);
 
+/* Cancel any asynchronous transfers and shut down the transfer queues */
+/* (used before usb_close_port()) */
+void usb_xfer_shutdown(icoms *p);
+
 /* Set the USB specific icoms methods */
 void usb_set_usb_methods(icoms *p);
 
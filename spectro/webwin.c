@@ -51,6 +51,67 @@
 # define debugrr2l(lev, xx) if (callback_ddebug >= lev) fprintf xx
 #endif
 
+/* Private webwin context */
+typedef struct {
+	struct mg_context *mg;		/* Web server */
+	amutex lock;				/* Protects ws */
+	struct mg_connection *ws;	/* Current WebSocket connection, NULL if none */
+} webwin_cntx;
+
+/* Send the current color and its change index to the browser */
+/* over the WebSocket connection. Must hold the lock. */
+static void ws_send_color(dispwin *p, struct mg_connection *conn) {
+	unsigned char frame[2 + 40];
+	int len;
+
+	len = sprintf((char *)frame + 2, "#%02X%02X%02X %u",
+			(int)(p->r_rgb[0] * 255.0 + 0.5),
+			(int)(p->r_rgb[1] * 255.0 + 0.5),
+			(int)(p->r_rgb[2] * 255.0 + 0.5),
+			p->ncix);
+	frame[0] = 0x81;			/* Final text frame */
+	frame[1] = (unsigned char)len;	/* Unmasked, < 126 bytes */
+	mg_write(conn, frame, 2 + len);
+}
+
+/* Handle a WebSocket message from the browser. This is the index of the */
+/* color change that has been painted. Return non-NULL to close. */
+static void *ws_get_message(dispwin *p, struct mg_connection *conn) {
+	unsigned char buf[2 + 4 + 125 + 1];
+	int n, len = 0, msg_len = 0, mask_len = 0, i;
+	unsigned int ix;
+
+	/* Read the whole frame. Only small messages are expected */
+	for (;;) {
+		if ((n = mg_read(conn, buf + len, sizeof(buf) - 1 - len)) <= 0)
+			return "";
+		len += n;
+		if (len >= 2) {
+			msg_len = buf[1] & 127;
+			mask_len = (buf[1] & 128) ? 4 : 0;
+			if (msg_len > 125)
+				return "";
+			if (len >= (2 + mask_len + msg_len))
+				break;
+		}
+	}
+
+	if ((buf[0] & 0x0f) == 0x8)		/* Close */
+		return "";
+
+	for (i = 0; i < msg_len; i++)
+		buf[i] = buf[2 + mask_len + i] ^ (mask_len ? buf[2 + (i % 4)] : 0);
+	buf[i] = '\000';
+
+	/* The browser acknowledges the frame after the one the change */
+	/* was painted in, so it has just been presented. */
+	ix = (unsigned int)strtoul((char *)buf, NULL, 10);
+	if (ix == p->ncix)
+		dispwin_presented(p, msec_time());
+	p->ccix = ix;
+	return NULL;
+}
+
 // A handler for the /ajax/get_messages endpoint.
 // Return a list of messages with ID greater than requested.
 static void ajax_get_messages(struct mg_connection *conn,
@@ -85,6 +146,35 @@ static void *webwin_ehandler(enum mg_event event,
 //                           const struct mg_request_info *request_info) {
 	const struct mg_request_info *request_info = mg_get_request_info(conn);
 
+	if (event == MG_WEBSOCKET_READY
+	 || event == MG_WEBSOCKET_MESSAGE
+	 || event == MG_WEBSOCKET_CLOSE) {
+		dispwin *p = (dispwin *)mg_get_user_data(conn);
+		webwin_cntx *wc = (webwin_cntx *)p->pcntx;
+		void *rv = NULL;
+
+		if (event == MG_WEBSOCKET_MESSAGE)
+			return ws_get_message(p, conn);
+
+		amutex_lock(wc->lock);
+		if (event == MG_WEBSOCKET_READY) {
+			wc->ws = conn;
+			ws_send_color(p, conn);
+
+		} else if (wc->ws == conn) {	/* MG_WEBSOCKET_CLOSE */
+			wc->ws = NULL;
+
+			/* Make the AJAX fallback fetch the current color if it */
+			/* hasn't been acknowledged, or wait for the next one. */
+			if (p->ccix != p->ncix)
+				p->ccix = p->ncix - 2;
+			else
+				p->ccix = p->ncix - 1;
+		}
+		amutex_unlock(wc->lock);
+		return rv;
+	}
+
 	if (event != MG_NEW_REQUEST) {
 		return NULL;
 	}
@@ -132,14 +222,41 @@ static void *webwin_ehandler(enum mg_event event,
 	"	oXHR.send();\r\n"
 	"}\r\n"
 	"\r\n"
-	"window.onload = function() {\r\n"
-	"	ccolor = \"#808080\";\r\n"
-	"	document.body.style.background = ccolor;\r\n"
-	"\r\n"
+	"function start_ajax() {\r\n"
 	"	oXHR = new XMLHttpRequest();\r\n"
 	"	oXHR.open(\"GET\", \"/ajax/messages?\" + document.body.style.background, true);\r\n"
 	"	oXHR.onreadystatechange = XHR_response;\r\n"
 	"	oXHR.send();\r\n"
+	"}\r\n"
+	"\r\n"
+	"window.onload = function() {\r\n"
+	"	ccolor = \"#808080\";\r\n"
+	"	document.body.style.background = ccolor;\r\n"
+	"\r\n"
+	"	if (typeof WebSocket == \"undefined\"\r\n"
+	"	 || typeof window.requestAnimationFrame == \"undefined\") {\r\n"
+	"		start_ajax();\r\n"
+	"		return;\r\n"
+	"	}\r\n"
+	"\r\n"
+	"	var ws = new WebSocket(\"ws://\" + window.location.host + \"/ws\");\r\n"
+	"	ws.onmessage = function(e) {\r\n"
+	"		var ss = e.data.split(\" \");\r\n"
+	"		if (ccolor != ss[0]) {\r\n"
+	"			ccolor = ss[0];\r\n"
+	"			document.body.style.background = ccolor;\r\n"
+	"		}\r\n"
+	"		// Acknowledge once the frame with the new color has been painted\r\n"
+	"		window.requestAnimationFrame(function() {\r\n"
+	"			window.requestAnimationFrame(function() {\r\n"
+	"				ws.send(ss[1]);\r\n"
+	"			});\r\n"
+	"		});\r\n"
+	"	};\r\n"
+	"	// Fall back to AJAX if WebSocket fails or closes\r\n"
+	"	ws.onclose = function() {\r\n"
+	"		start_ajax();\r\n"
+	"	};\r\n"
 	"};\r\n";
 	    mg_write(conn, webdisp_js, strlen(webdisp_js));
 #else
@@ -222,6 +339,7 @@ double r, double g, double b	/* Color values 0.0 - 1.0 */
 	double orgb[3];		/* Previous RGB value */
 	double kr, kf;
 	int update_delay = 0;
+	webwin_cntx *wc = (webwin_cntx *)p->pcntx;
 
 	debugr("webwin_set_color called\n");
 
@@ -252,14 +370,21 @@ double r, double g, double b	/* Color values 0.0 - 1.0 */
 	/* This is probably not actually thread safe... */
 	p->ncix++;
 
-	while(p->ncix != p->ccix) {
-		msec_sleep(50);
+	/* Push the change over WebSocket if the browser is using it */
+	amutex_lock(wc->lock);
+	if (wc->ws != NULL)
+		ws_send_color(p, wc->ws);
+	amutex_unlock(wc->lock);
+
+	/* Wait for the browser to fetch or acknowledge the change */
+	while(p->ncix != p->ccix && p->mg_stop == 0) {
+		msec_sleep(wc->ws != NULL ? 1 : 50);
 	}
 
 	/* Allow for display update & instrument delays */
 	update_delay = dispwin_compute_delay(p, orgb);
 	debugr2((errout, "webwin_set_color delaying %d msec\n",update_delay));
-	msec_sleep(update_delay);
+	dispwin_update_sleep(p, update_delay);
 
 	return 0;
 }
@@ -293,7 +418,12 @@ dispwin *p
 		return;
 
 	p->mg_stop = 1;
-	mg_stop((struct mg_context *)p->pcntx);
+	if (p->pcntx != NULL) {
+		webwin_cntx *wc = (webwin_cntx *)p->pcntx;
+		mg_stop(wc->mg);
+		amutex_del(wc->lock);
+		free(wc);
+	}
 
 	if (p->name != NULL)
 		free(p->name);
@@ -327,6 +457,7 @@ int ddebug						/* >0 to print debug statements to stderr */
 	dispwin *p = NULL;
 	char *cp;
 	struct mg_context *mg;
+	webwin_cntx *wc;
 	const char *options[3];
 	char port[50];
 	char *url;
@@ -357,6 +488,8 @@ int ddebug						/* >0 to print debug statements to stderr */
 	p->set_update_delay    = dispwin_set_update_delay;
 	p->set_settling_delay  = dispwin_set_settling_delay;
 	p->enable_update_delay = dispwin_enable_update_delay;
+	p->defer_update_delay  = dispwin_defer_update_delay;
+	p->wait_update         = dispwin_wait_update;
 	p->set_callout         = webwin_set_callout;
 	p->del                 = webwin_del;
 
@@ -387,8 +520,16 @@ int ddebug						/* >0 to print debug statements to stderr */
 	options[1] = port;
 	options[2] = NULL;
 
+	if ((wc = (webwin_cntx *)calloc(sizeof(webwin_cntx), 1)) == NULL) {
+		if (ddebug) fprintf(stderr,"new_webwin failed because malloc failed\n");
+		webwin_del(p);
+		return NULL;
+	}
+	amutex_init(wc->lock);
+	p->pcntx = (void *)wc;
+
 	mg = mg_start(&webwin_ehandler, (void *)p, options);
-	p->pcntx = (void *)mg;
+	wc->mg = mg;
 
 //printf("Domain = %s'\n",mg_get_option(mg, "authentication_domain"));
 
@@ -101,90 +101,136 @@ xrga_eqn xrga_equations[2][3][3] = {
 };
 
 
-/* Core conversion code. dst and src are assumed to be different xspect's */
-static void convert_xrga(xspect *dst, xspect *src, xrga_eqn *eq) {
+/* Setup a conversion table from one calibration standard to another, */
+/* for spectra with the wavelength range and band count of sp. */
+/* Each destination band is the gain times a Lagrange interpolation */
+/* of the 4 source bands around the shifted source wavelength. */
+void xrga_tab_init(xrga_tab *p, xspect *sp, xcalpol pol, xcalstd dsp, xcalstd ssp) {
+	xrga_eqn *eq;
+	double spcing;
 	int j;
 
-	XSPECT_COPY_INFO(dst, src);		/* Copy parameters */
+	p->spec_n = sp->spec_n;
+	p->spec_wl_short = sp->spec_wl_short;
+	p->spec_wl_long = sp->spec_wl_long;
+
+	if (!XCALSTD_NEEDED(ssp, dsp)) {
+		p->ident = 1;
+		return;
+	}
+	p->ident = 0;
+
+	eq = &xrga_equations[pol][ssp][dsp];
+	spcing = (sp->spec_wl_long - sp->spec_wl_short)/(sp->spec_n-1.0);
 
-	for (j = 0; j < dst->spec_n; j++) {
+	for (j = 0; j < p->spec_n; j++) {
 		double dw, sw, ga;
-		double spcing, f;
-		double y[4], yw;
+		double f;
 		double x[4];
 		int i;
 	
-		dw = XSPECT_XWL(dst, j);			/* Destination wavelength */
+		dw = XSPECT_XWL(sp, j);				/* Destination wavelength */
 		sw = dw + eq->wl0;					/* Source wavelength */
 		ga = eq->gain0 + (dw - 550.0) * eq->gain1;	/* Gain at this dest wl */ 
 
 		/* Compute fraction 0.0 - 1.0 out of known spectrum. */
 		/* Place it so that the target wavelength lands in middle section */
 		/* of Lagrange basis points. */
-		spcing = (src->spec_wl_long - src->spec_wl_short)/(src->spec_n-1.0);
-		f = (sw - src->spec_wl_short) / (src->spec_wl_long - src->spec_wl_short);
-		f *= (src->spec_n - 1.0);
+		f = (sw - sp->spec_wl_short) / (sp->spec_wl_long - sp->spec_wl_short);
+		f *= (sp->spec_n - 1.0);
 		i = (int)floor(f);			/* Base grid coordinate */
 	
 		if (i < 1)					/* Limit to valid Lagrange basis index range, */
 			i = 1;					/* and extrapolate from that at the ends. */
-		else if (i > (src->spec_n - 3))
-			i = (src->spec_n - 3);
-	
-		/* Setup the surrounding values */
-		x[0] = src->spec_wl_short + (i-1) * spcing;
-		y[0] = src->spec[i-1];
-		x[1] = src->spec_wl_short + i * spcing;
-		y[1] = src->spec[i];
-		x[2] = src->spec_wl_short + (i+1) * spcing;
-		y[2] = src->spec[i+1];
-		x[3] = src->spec_wl_short + (i+2) * spcing;
-		y[3] = src->spec[i+2];
+		else if (i > (sp->spec_n - 3))
+			i = (sp->spec_n - 3);
 	
+		/* The surrounding wavelengths */
+		x[0] = sp->spec_wl_short + (i-1) * spcing;
+		x[1] = sp->spec_wl_short + i * spcing;
+		x[2] = sp->spec_wl_short + (i+1) * spcing;
+		x[3] = sp->spec_wl_short + (i+2) * spcing;
 
-		/* Compute interpolated value using Lagrange: */
-		yw = y[0] * (sw-x[1]) * (sw-x[2]) * (sw-x[3])/((x[0]-x[1]) * (x[0]-x[2]) * (x[0]-x[3]))
-		   + y[1] * (sw-x[0]) * (sw-x[2]) * (sw-x[3])/((x[1]-x[0]) * (x[1]-x[2]) * (x[1]-x[3]))
-		   + y[2] * (sw-x[0]) * (sw-x[1]) * (sw-x[3])/((x[2]-x[0]) * (x[2]-x[1]) * (x[2]-x[3]))
-		   + y[3] * (sw-x[0]) * (sw-x[1]) * (sw-x[2])/((x[3]-x[0]) * (x[3]-x[1]) * (x[3]-x[2]));
+		/* Lagrange weightings, including the gain */
+		p->ix[j] = i-1;
+		p->w[j][0] = ga * (sw-x[1]) * (sw-x[2]) * (sw-x[3])/((x[0]-x[1]) * (x[0]-x[2]) * (x[0]-x[3]));
+		p->w[j][1] = ga * (sw-x[0]) * (sw-x[2]) * (sw-x[3])/((x[1]-x[0]) * (x[1]-x[2]) * (x[1]-x[3]));
+		p->w[j][2] = ga * (sw-x[0]) * (sw-x[1]) * (sw-x[3])/((x[2]-x[0]) * (x[2]-x[1]) * (x[2]-x[3]));
+		p->w[j][3] = ga * (sw-x[0]) * (sw-x[1]) * (sw-x[2])/((x[3]-x[0]) * (x[3]-x[1]) * (x[3]-x[2]));
+	}
+}
+
+/* Return nz if the table is for spectra with the wavelength range of sp */
+int xrga_tab_match(xrga_tab *p, xspect *sp) {
+	return p->spec_n == sp->spec_n
+	    && p->spec_wl_short == sp->spec_wl_short
+	    && p->spec_wl_long == sp->spec_wl_long;
+}
 
-		yw *= ga;
+/* Apply a conversion table to n spectra of p->spec_n band values */
+/* each, packed one after the other. dst may be the same as src. */
+void xrga_tab_apply_n(xrga_tab *p, double *dst, double *src, int n) {
+	double tmp[XSPECT_MAX_BANDS];
+	int i, j, nb = p->spec_n;
 
-		dst->spec[j] = yw;
+	for (i = 0; i < n; i++, dst += nb, src += nb) {
+		double *s = src;
+
+		if (p->ident) {
+			if (dst != src) {
+				for (j = 0; j < nb; j++)
+					dst[j] = src[j];
+			}
+			continue;
+		}
+
+		if (dst == src) {
+			for (j = 0; j < nb; j++)
+				tmp[j] = src[j];
+			s = tmp;
+		}
+
+		for (j = 0; j < nb; j++) {
+			double *y = s + p->ix[j], *w = p->w[j];
+			dst[j] = w[0] * y[0] + w[1] * y[1] + w[2] * y[2] + w[3] * y[3];
+		}
 	}
 }
 
+/* Apply a conversion table to an xspect. dst may be the same as src */
+void xspec_convert_xrga_tab(xrga_tab *p, xspect *dst, xspect *src) {
+	if (dst != src)
+		XSPECT_COPY_INFO(dst, src);		/* Copy parameters */
+	xrga_tab_apply_n(p, dst->spec, src->spec, 1);
+}
+
 /* Apply a conversion from one calibration standard to another to an xspect */
+/* (Use xrga_tab_init() and xspec_convert_xrga_tab() when converting */
+/*  many spectra.) */
 void xspec_convert_xrga(xspect *dst, xspect *srcp, xcalpol pol, xcalstd dsp, xcalstd ssp) {
-	xrga_eqn *eq;
-	xspect tmp, *src = srcp;
+	xrga_tab *tab;
 
 	/* If no conversion and no copy needed */
-	if (!XCALSTD_NEEDED(ssp, dsp) && dst == src)
+	if (!XCALSTD_NEEDED(ssp, dsp) && dst == srcp)
 		return;
 
 	/* If no conversion needed  */
 	if (!XCALSTD_NEEDED(ssp, dsp)) {
-		*dst = *src;		/* Struct copy */
+		*dst = *srcp;		/* Struct copy */
 		return;
 	}
 
-	/* If the dest is the same as the src, make a temporary copy, */
-	/* since convert_xrga() needs them to be distinct */
-	if (dst == src) {
-		tmp = *src;			/* Struct copy */
-		src = &tmp;
-	}
-
-	eq = &xrga_equations[pol][ssp][dsp];
-	convert_xrga(dst, src, eq);
+	if ((tab = (xrga_tab *)malloc(sizeof(xrga_tab))) == NULL)
+		error("xspec_convert_xrga: malloc failed");
+	xrga_tab_init(tab, srcp, pol, dsp, ssp);
+	xspec_convert_xrga_tab(tab, dst, srcp);
+	free(tab);
 }
 
 /* Apply a conversion from one calibration standard to another to an array of ipatch's */
 void ipatch_convert_xrga(ipatch *vals, int nvals,
                          xcalpol pol, xcalstd dsp, xcalstd ssp, int clamp) {
-	xrga_eqn *eq;
-	xspect tmp;
+	xrga_tab *tab = NULL;	/* Conversion table for the current wavelength range */
 	xsp2cie *conv = NULL;	/* Spectral to XYZ conversion object */
 	int i;
 
@@ -193,16 +239,21 @@ void ipatch_convert_xrga(ipatch *vals, int nvals,
 	 || dsp == ssp || nvals <= 0)
 		return;
 
-	/* Conversion to use */
-	eq = &xrga_equations[pol][ssp][dsp];
-
 	for (i = 0; i < nvals; i++) {
 		if (vals[i].mtype != inst_mrt_reflective
 		 || vals[i].sp.spec_n <= 0) {
 			continue;
 		}
-		tmp = vals[i].sp;		// Struct copy */
-		convert_xrga(&vals[i].sp, &tmp, eq);
+
+		/* (Re-)compute the conversion table for this wavelength range */
+		if (tab == NULL) {
+			if ((tab = (xrga_tab *)malloc(sizeof(xrga_tab))) == NULL)
+				error("ipatch_convert_xrga: malloc failed");
+			xrga_tab_init(tab, &vals[i].sp, pol, dsp, ssp);
+		} else if (!xrga_tab_match(tab, &vals[i].sp)) {
+			xrga_tab_init(tab, &vals[i].sp, pol, dsp, ssp);
+		}
+		xspec_convert_xrga_tab(tab, &vals[i].sp, &vals[i].sp);
 
 		/* Re-compute XYZ */
 		if (vals[i].XYZ_v) {
@@ -219,5 +270,7 @@ void ipatch_convert_xrga(ipatch *vals, int nvals,
 	}
 	if (conv != NULL)
 		conv->del(conv);
+	if (tab != NULL)
+		free(tab);
 }
 
@@ -33,6 +33,29 @@ typedef enum {
 /* Apply a conversion from one calibration standard to another to an xspect. */
 void xspec_convert_xrga(xspect *dst, xspect *srcp, xcalpol pol, xcalstd dsp, xcalstd ssp);
 
+/* Precomputed conversion from one calibration standard to another, */
+/* for spectra with a particular wavelength range and band count. */
+typedef struct {
+	int ident;						/* nz if no conversion is needed */
+	int spec_n;						/* Number of bands */
+	double spec_wl_short, spec_wl_long;	/* Wavelength range */
+	int ix[XSPECT_MAX_BANDS];		/* Index of first of 4 source bands for each band */
+	double w[XSPECT_MAX_BANDS][4];	/* Weighting of each of the 4 source bands */
+} xrga_tab;
+
+/* Setup a conversion table for spectra with the wavelength range of sp. */
+void xrga_tab_init(xrga_tab *p, xspect *sp, xcalpol pol, xcalstd dsp, xcalstd ssp);
+
+/* Return nz if the table is for spectra with the wavelength range of sp */
+int xrga_tab_match(xrga_tab *p, xspect *sp);
+
+/* Apply a conversion table to n spectra of p->spec_n band values */
+/* each, packed one after the other. dst may be the same as src. */
+void xrga_tab_apply_n(xrga_tab *p, double *dst, double *src, int n);
+
+/* Apply a conversion table to an xspect. dst may be the same as src */
+void xspec_convert_xrga_tab(xrga_tab *p, xspect *dst, xspect *src);
+
 /* Apply a conversion from one calibration standard to another to an array of ipatch's */
 void ipatch_convert_xrga(ipatch *vals, int nvals,
                          xcalpol pol, xcalstd dsp, xcalstd ssp, int clamp);
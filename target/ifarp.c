@@ -79,6 +79,8 @@ static void dump_image_final(ifarp *s, int pcp);
 #endif
 
 #define MAX_TRIES   30		/* Maximum itterations */
+#define BFNN_MINDI  4		/* Minimum dimensions to use brute force nn */
+#define BFNN_BLOCK  256		/* Brute force nn block size */
 
 
 /* nn functions */
@@ -418,6 +420,49 @@ void *od				/* context for Perceptual function */
 #define NN_INF 1e307
 #endif
 
+/* Brute force version of nearest(). In higher dimensions the */
+/* axis window search ends up visiting most of the points anyway, */
+/* so simply compute all the distances. The perceptual values are */
+/* held one array per axis, so that the compiler can vectorize the */
+/* distance loops. */
+static double
+nearest_bf(
+ifarp *s,
+double *q		/* Target point location */
+) {
+	int i, j, k, n;
+	int di = s->di;
+	int np = s->np;
+	double *dd = s->sdd;
+	double bdist = NN_INF;
+
+	for (i = 0; i < np; i += BFNN_BLOCK) {
+		n = np - i;
+		if (n > BFNN_BLOCK)
+			n = BFNN_BLOCK;
+
+		{
+			double *sv = s->sv[0] + i, qq = q[0];
+			for (j = 0; j < n; j++) {
+				double tt = sv[j] - qq;
+				dd[j] = tt * tt;
+			}
+		}
+		for (k = 1; k < di; k++) {
+			double *sv = s->sv[k] + i, qq = q[k];
+			for (j = 0; j < n; j++) {
+				double tt = sv[j] - qq;
+				dd[j] += tt * tt;
+			}
+		}
+		for (j = 0; j < n; j++) {
+			if (dd[j] < bdist)
+				bdist = dd[j];
+		}
+	}
+	return sqrt(bdist);	/* Return nearest distance */
+}
+
 /* Given a point, */
 /* return the nearest existint test point. */
 static double
@@ -436,6 +481,9 @@ double *q		/* Target point location */
 
 //printf("~1 nearest called\n");
 
+	if (s->bfnn)
+		return nearest_bf(s, q);
+
 	/* We have to find out which existing point the point will be nearest */
 
 	if ((s->tbase + di) < s->tbase) {	/* Overflow of touch count */
@@ -677,6 +725,20 @@ ifarp *s
 
 //printf("~9 init_nn called\n");
 
+	if (di >= BFNN_MINDI) {
+		s->bfnn = 1;
+
+		for (k = 0; k < di; k++) {
+			if ((s->sv[k] = (double *)malloc(sizeof(double) * s->inp)) == NULL)
+				error("Failed to allocate nn value array");
+			for (i = 0; i < np; i++)
+				s->sv[k][i] = s->nodes[i].v[k];
+		}
+		if ((s->sdd = (double *)malloc(sizeof(double) * BFNN_BLOCK)) == NULL)
+			error("Failed to allocate nn distance array");
+		return;
+	}
+
 	s->tbase = 0;		/* Initialse touch flag */
 
 	/* Allocate the arrays spaces for intended number of points */
@@ -743,6 +805,12 @@ ifarp *s
 
 //printf("~9 add_nn called with point ix %d, pos %f %f\n",ap, s->nodes[ap].v[0],s->nodes[ap].v[1]);
 
+	if (s->bfnn) {
+		for (e = 0; e < di; e++)
+			s->sv[e][ap] = s->nodes[ap].v[e];
+		return;
+	}
+
 	for (e = 0; e < di; e++) {	/* For all axes */
 		int i0, i1, i2;			/* Search indexes */
 		double v0, v1, v2;		/* Box */
@@ -807,6 +875,14 @@ static void del_nn(ifarp *s) {
 	int di = s->di;
 	int k;
 
+	if (s->bfnn) {
+		for (k = 0; k < di; k++)
+			free (s->sv[k]);
+		free(s->sdd);
+		s->bfnn = 0;
+		return;
+	}
+
 	for (k = 0; k < di; k++) {
 		free (s->sax[k]);
 	}
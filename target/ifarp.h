@@ -45,6 +45,11 @@ struct _ifarp {
 	unsigned int tbase;		/* Touch base value for this pass */
 	unsigned int ttarget;	/* Touch target value for this pass */
 
+	/* Brute force nn support, used for higher dimensions */
+	int bfnn;				/* nz if using brute force nn */
+	double *sv[MXTD];		/* Perceptual values, one array for each axis */
+	double *sdd;			/* Distance squared scratch array */
+
 /* public: */
 	/* Initialise, ready to read out all the points */
 	void (*reset)(struct _ifarp *s);
@@ -1088,17 +1088,32 @@ static void vtx_cache_rem(ofps *s, vtx *vv) {
 /* Each vtx returned gets a unique serial number */
 static vtx *new_vtx(ofps *s) {
 	vtx *vv;
+	vtx **nv;
+	int _nnv;
 
-	if (s->fvtx != NULL) {	/* re-use one we've got */
-		vv = s->fvtx;
-		s->fvtx = vv->link;
-		memset((void *)vv, 0, sizeof(vtx));
+	if (s->fvtx == NULL) {	/* Allocate another block of them */
+		vtxblk *bp;
+		int i;
 
-	} else {
-		if ((vv = (vtx *)calloc(sizeof(vtx), 1)) == NULL)
-			error("ofps: malloc failed on new vertex");
+		if ((bp = (vtxblk *)calloc(sizeof(vtxblk), 1)) == NULL)
+			error("ofps: malloc failed on new vertex block");
+		bp->next = s->vblks;
+		s->vblks = bp;
+		for (i = VTXBLKSZ-1; i >= 0; i--) {
+			bp->v[i].link = s->fvtx;
+			s->fvtx = &bp->v[i];
+		}
 	}
 
+	/* Re-use a free one, keeping its vertex net allocation */
+	vv = s->fvtx;
+	s->fvtx = vv->link;
+	nv = vv->nv;
+	_nnv = vv->_nnv;
+	memset((void *)vv, 0, sizeof(vtx));
+	vv->nv = nv;
+	vv->_nnv = _nnv;
+
 	/* Link vertex to currently used list */
 	vv->link = s->uvtx;
 	if (s->uvtx != NULL)
@@ -1190,13 +1205,7 @@ static void del_vtx(ofps *s, vtx *vx) {
 	/* Remove it from various lists */
 	del_vtx1(s, vx);
 
-	/* Free vertex net neighbours list */
-	if (vx->nv != NULL) {
-/* !!!! if we need this, we're referencing deleted vertexes !!!! */
-/*		vx->nnv = vx->_nnv = 0; */
-		free(vx->nv);
-/*		vx->nv = NULL; */
-	}
+	/* (The vertex net neighbours list allocation is kept for re-use) */
 
 	/* Add to free list */
 	vx->link = s->fvtx;
@@ -1395,16 +1404,25 @@ static int vtx_aat_cmp_eserr(const void *p1, const void *p2) {
 static mid *new_mid(ofps *s) {
 	mid *p;
 
-	if (s->fmid != NULL) {	/* re-use one we've got */
-		p = s->fmid;
-		s->fmid = p->link;
-		memset((void *)p, 0, sizeof(mid));
+	if (s->fmid == NULL) {	/* Allocate another block of them */
+		midblk *bp;
+		int i;
 
-	} else {
-		if ((p = (mid *)calloc(sizeof(mid), 1)) == NULL)
-			error("ofps: malloc failed on new midpoint");
+		if ((bp = (midblk *)calloc(sizeof(midblk), 1)) == NULL)
+			error("ofps: malloc failed on new midpoint block");
+		bp->next = s->mblks;
+		s->mblks = bp;
+		for (i = MIDBLKSZ-1; i >= 0; i--) {
+			bp->m[i].link = s->fmid;
+			s->fmid = &bp->m[i];
+		}
 	}
 
+	/* Re-use a free one */
+	p = s->fmid;
+	s->fmid = p->link;
+	memset((void *)p, 0, sizeof(mid));
+
 	/* Link midpoint to currently used list */
 	p->link = s->umid;
 	if (s->umid != NULL)
@@ -2161,6 +2179,7 @@ typedef struct {
 /* Context for callback */
 struct _vopt_cx {
 	ofps *s;
+	ofps_pt *pt;		/* Vertex positioning context */
 	node *nds[MXPD+1];	/* List of real nodes */
 	int nn;				/* Number of real nodes */
 	int on;				/* Index of odd node */ 
@@ -2248,7 +2267,7 @@ int dnsq_solver(	/* Return < 0 on abort */
 		fvec[nn_1 + k] = FGPMUL * v;
 	}
 
-	s->funccount++;
+	cx->pt->funccount++;
 
 //for (k = 0; k < nn_1; k++)
 //printf("~1 fvec[%d] = %f\n",k,fvec[k]);
@@ -2264,6 +2283,7 @@ int dnsq_solver(	/* Return < 0 on abort */
 /* Return 0 if suceeded, 1 if best result is out of tollerance, 2 if failed. */
 static int position_vtx(
 	ofps *s,
+	ofps_pt *pt,		/* Positioning context to use */
 	nodecomb *vv,		/* Return the location and its error */
 	int startex,		/* nz if current position is to be used as initial start point */
 	int repos,			/* nz after an itteration and we expect out of gamut */
@@ -2286,8 +2306,8 @@ static int position_vtx(
 	printf("Position_vtx called for comb %s\n",pcomb(di,vv->nix));
 #endif
 
-	s->positions++;
-	s->sob->reset(s->sob);
+	pt->positions++;
+	pt->sob->reset(pt->sob);
 
 #ifdef DUMP_FERR
 	cx.debug = 0;
@@ -2295,6 +2315,7 @@ static int position_vtx(
 
 	/* Setup for dnsq to optimize for equal eperr */
 	cx.s = s;
+	cx.pt = pt;
 
 	/* Pointers to real nodes. Although we allow for the */
 	/* fake inner/outer nodes, eperr() will fail them later. */
@@ -2480,7 +2501,7 @@ static int position_vtx(
 				double fval[MXPD];
 				int nc;
 
-				s->sob->next(s->sob, cx.stp);
+				pt->sob->next(pt->sob, cx.stp);
 
 				/* Scale random value around original starting point */
 				for (e = 0; e < di; e++) {
@@ -2507,19 +2528,20 @@ static int position_vtx(
 
 //printf("\nStarting location = %s, srad = %f\n",ppos(di,cx.stp),cx.srad);
 		/* Locate vertex */
-		cfunccount = s->funccount;
-		s->dnsqs++;
+		cfunccount = pt->funccount;
+		pt->dnsqs++;
 		if (tcalls == 0)
 			maxfev = 500;
 		else
 			maxfev = 2 * tfev/tcalls; 
-		rv = dnsqe((void *)&cx, dnsq_solver, NULL, di, vv->p, cx.srad, fvec, 0.0, ftol, maxfev, 0);
-		if ((s->funccount - cfunccount) > 20) {
-//printf("More than 20: %d\n",s->funccount - cfunccount);
+		rv = dnsqew(pt->dws, (void *)&cx, dnsq_solver, NULL, di, vv->p, cx.srad, fvec,
+		            0.0, ftol, maxfev, 0);
+		if ((pt->funccount - cfunccount) > 20) {
+//printf("More than 20: %d\n",pt->funccount - cfunccount);
 		}
-		if ((s->funccount - cfunccount) > s->maxfunc) {
-			s->maxfunc = (s->funccount - cfunccount);
-//printf("New maximum %d\n",s->maxfunc);
+		if ((pt->funccount - cfunccount) > pt->maxfunc) {
+			pt->maxfunc = (pt->funccount - cfunccount);
+//printf("New maximum %d\n",pt->maxfunc);
 		}
 
 		if (rv != 1 && rv != 3) {
@@ -2536,7 +2558,7 @@ static int position_vtx(
 
 			/* Update average function evaluations */
 			tcalls++;
-			tfev += s->funccount - cfunccount;
+			tfev += pt->funccount - cfunccount;
 			
 #ifdef DEBUG
 			printf("dnsq pos %s\n",ppos(di,vv->p));
@@ -2585,8 +2607,8 @@ static int position_vtx(
 				/* evaluate the location found. */
 				double ss;
 
-				s->sucfunc += (s->funccount - cfunccount);
-				s->sucdnsq++;
+				pt->sucfunc += (pt->funccount - cfunccount);
+				pt->sucdnsq++;
 
 				/* Compute how much the result is out of gamut */
 				vv->oog = ofps_oog(s, vv->p);
@@ -2610,14 +2632,14 @@ static int position_vtx(
 				   || ( fixup && vv->oog < 20.0 && vv->eperr < (vv->ceperr + 0.01))
 				))) {
 
-					if (tries > s->maxretries)
-						s->maxretries = tries;
+					if (tries > pt->maxretries)
+						pt->maxretries = tries;
 #ifdef DEBUG
-					printf(" - comb %s suceeded on retry %d (max %d)\n",pcomb(di,vv->nix),tries,s->maxretries);
+					printf(" - comb %s suceeded on retry %d (max %d)\n",pcomb(di,vv->nix),tries,pt->maxretries);
 					printf("       oog = %f, eperr = %f, ceperr = %f\n",vv->oog,vv->eperr,vv->ceperr);
 #endif
 //if (tries > 10)
-//	printf(" - comb %s suceeded on retry %d (max %d)\n",pcomb(di,vv->nix),tries,s->maxretries);
+//	printf(" - comb %s suceeded on retry %d (max %d)\n",pcomb(di,vv->nix),tries,pt->maxretries);
 // 
 //printf("Solution for comb %s has eperr %f < ceperr %f and not out of gamut by %f, retry %d\n",pcomb(di,vv->nix),vv->eperr,vv->ceperr,vv->oog,tries+1);
 //printf("Solution is at %s (%s)\n",ppos(di,vv->p),ppos(di,vv->v));
@@ -2698,6 +2720,98 @@ static int position_vtx(
 	return 0;
 }
 
+/* --------------------------------------------------------- */
+/* Locate a list of vertexes using s->npt threads. Each vertex position */
+/* only depends on its own node combination, and position_vtx() resets */
+/* the random start sequence of the context it uses, so the results */
+/* are the same whatever thread a vertex gets located by. */
+
+#define POS_THR_CHUNK 4		/* Number of vertexes a thread locates at a time */
+
+typedef struct {
+	ofps *s;
+	nodecomb **vvs;			/* Combinations to locate */
+	int *rvs;				/* position_vtx() return value for each */
+	int nvvs;				/* Number of combinations */
+	int repos, fixup;		/* position_vtx() flags */
+	amutex lock;			/* Lock for next */
+	int next;				/* Next combination to be located */
+} pos_thr;
+
+static int position_vtx_thread(void *cntx, int ix, int nth) {
+	pos_thr *p = (pos_thr *)cntx;
+	int i, j;
+
+	for (;;) {
+		amutex_lock(p->lock);
+		i = p->next;
+		p->next += POS_THR_CHUNK;
+		amutex_unlock(p->lock);
+
+		if (i >= p->nvvs)
+			break;
+		if ((j = i + POS_THR_CHUNK) > p->nvvs)
+			j = p->nvvs;
+		for (; i < j; i++)
+			p->rvs[i] = position_vtx(p->s, &p->s->pt[ix], p->vvs[i], p->vvs[i]->startex,
+			                         p->repos, p->fixup);
+	}
+	return 0;
+}
+
+/* Locate the nvvs vertexes vvs[], using their startex flag, */
+/* and return the position_vtx() return value for each in rvs[]. */
+static void position_vtxs(
+	ofps *s,
+	nodecomb **vvs,
+	int *rvs,
+	int nvvs,
+	int repos,
+	int fixup
+) {
+	pos_thr tx;
+	int i, nth = s->npt;
+
+	if (nth > (nvvs + POS_THR_CHUNK-1)/POS_THR_CHUNK)
+		nth = (nvvs + POS_THR_CHUNK-1)/POS_THR_CHUNK;
+
+	if (nth <= 1) {
+		for (i = 0; i < nvvs; i++)
+			rvs[i] = position_vtx(s, s->pt, vvs[i], vvs[i]->startex, repos, fixup);
+		return;
+	}
+
+	tx.s = s;
+	tx.vvs = vvs;
+	tx.rvs = rvs;
+	tx.nvvs = nvvs;
+	tx.repos = repos;
+	tx.fixup = fixup;
+	tx.next = 0;
+	amutex_init(tx.lock);
+
+	par_exec(nth, position_vtx_thread, (void *)&tx);
+
+	amutex_del(tx.lock);
+
+	/* Accumulate the other thread's statistics in the first context */
+	for (i = 1; i < nth; i++) {
+		ofps_pt *pt = &s->pt[i];
+
+		s->pt->positions += pt->positions;
+		s->pt->dnsqs += pt->dnsqs;
+		s->pt->funccount += pt->funccount;
+		s->pt->sucfunc += pt->sucfunc;
+		s->pt->sucdnsq += pt->sucdnsq;
+		if (pt->maxfunc > s->pt->maxfunc)
+			s->pt->maxfunc = pt->maxfunc;
+		if (pt->maxretries > s->pt->maxretries)
+			s->pt->maxretries = pt->maxretries;
+		pt->positions = pt->dnsqs = pt->funccount = pt->sucfunc = pt->sucdnsq = 0;
+		pt->maxfunc = pt->maxretries = 0;
+	}
+}
+
 /* --------------------------------------------------------- */
 /* Deal with creating a dummy vertex to represent one that */
 /* can't be positioned. We simply locate the best point we can. */
@@ -2913,6 +3027,7 @@ int abortonfail	/* 0 = ignore position failures, 1 = abort add if there are any
 	vtx *ev1, *ev2;	/* Deleted and non-deleted vertexes */
 	int ndelvtx;	/* Number of vertexes to delete */ 
 	int nncombs;	/* Number of node combinations generated, allocated. */
+	int npcombs;	/* Number of node combinations to be located */
 
 #ifdef DEBUG
 	printf("\nAdd_to_vsurf node ix %d (p %s), i_sm %s, a_sm %s\n",nn->ix, ppos(di,nn->p),psm(s,&s->sc[nn->pmask].i_sm),psm(s,&s->sc[nn->pmask].a_sm));
@@ -3158,7 +3273,16 @@ int abortonfail	/* 0 = ignore position failures, 1 = abort add if there are any
 	printf("\nThere are %d unique node combinations in list, locating combs. in list:\n",nncombs);
 #endif
 
-	/* Locate the replacement vertex positions */
+	/* Locate the replacement vertex positions. Unless we have to abort */
+	/* on the first failure, make a list of the ones that need locating */
+	/* so that they can be located in parallel. */
+	if (nncombs > s->_npcombs) {
+		s->_npcombs = nncombs;
+		if ((s->pcombs = (nodecomb **)realloc(s->pcombs, sizeof(nodecomb *) * s->_npcombs)) == NULL
+		 || (s->prvs = (int *)realloc(s->prvs, sizeof(int) * s->_npcombs)) == NULL)
+			error ("ofps: malloc failed on node combination locate list %d", s->_npcombs);
+	}
+	npcombs = 0;
 	for (i = 0; i < nncombs; i++) { 
 
 		ev1 = s->combs[i].v1[0];
@@ -3219,13 +3343,15 @@ int abortonfail	/* 0 = ignore position failures, 1 = abort add if there are any
 				s->combs[i].startex = 1;
 			}
 			/* find vertex position of max eperr */
-			if (position_vtx(s, &s->combs[i], s->combs[i].startex, 0, fixup) != 0) {
+			if (!abortonfail) {
+				s->pcombs[npcombs++] = &s->combs[i];
+
+			} else if (position_vtx(s, s->pt, &s->combs[i], s->combs[i].startex, 0, fixup) != 0) {
 				if (s->verb > 1)
 					warning("Unable to locate vertex at node comb %s\n",pcomb(di,s->combs[i].nix));
 				s->posfails++;
 				s->posfailstp++;
-				if (abortonfail)
-					break;
+				break;
 
 			} else {
 				s->combs[i].pvalid = 1;
@@ -3233,6 +3359,21 @@ int abortonfail	/* 0 = ignore position failures, 1 = abort add if there are any
 		}
 	}	/* Next replacement vertex */
 
+	if (npcombs > 0) {
+		position_vtxs(s, s->pcombs, s->prvs, npcombs, 0, fixup);
+
+		for (j = 0; j < npcombs; j++) {
+			if (s->prvs[j] != 0) {
+				if (s->verb > 1)
+					warning("Unable to locate vertex at node comb %s\n",pcomb(di,s->pcombs[j]->nix));
+				s->posfails++;
+				s->posfailstp++;
+			} else {
+				s->pcombs[j]->pvalid = 1;
+			}
+		}
+	}
+
 	/* If we aborted because abortonfail is set and we failed to place a new node, */
 	/* erase our tracks and return failure. */
 	if (i < nncombs) {
@@ -7030,6 +7171,17 @@ static vtx *ofps_findhit_vtx(ofps *s, double *ceperr, node *nn) {
 
 /* ----------------------------------------------------------- */
 
+/* Return nz if all the real nodes of a vertex are fixed points */
+static int vtx_is_fixed(ofps *s, vtx *vx) {
+	int e;
+
+	for (e = 0; e <= s->di; e++) {
+		if (vx->nix[e] >= 0 && !s->n[vx->nix[e]]->fx)
+			return 0;
+	}
+	return 1;
+}
+
 /* Re-position the vertexes given the current point positions, */
 /* and fixup the veronoi. */
 static void
@@ -7046,21 +7198,43 @@ ofps *s
 	int nfuxups, l_nfuxups;		/* Count of fixups */
 	int csllow;					/* Count since last low */
 	int mxcsllow = 5;			/* Threshold to give up */
+	int nrv;					/* Number of vertexes to re-position */
+	int nmv;					/* Number that have a moveable node */
+	nodecomb *rcombs;			/* Re-position combination for each vertex */
+	nodecomb **prcombs;			/* Pointers to rcombs[] that need positioning */
+	int *rvs;					/* position_vtx() return value for each */
 
 #ifdef DEBUG
 	printf("Repositioning vertexes\n");
 #endif
 
-	/* Re-position the vertexes to match optimized node positions */
-	s->fchl = NULL;
-	for (vx = s->uvtx; vx != NULL; vx = vx->link) {
-		nodecomb nc;
+	/* Re-position the vertexes to match optimized node positions. */
+	/* Each new position only depends on the nodes, so setup all the */
+	/* vertexes, locate them in parallel, and then update them in order. */
+	/* A vertex whose nodes are all fixed can't have moved, so only those */
+	/* in the neighbourhood of moveable nodes need re-positioning. */
+	for (nrv = 0, vx = s->uvtx; vx != NULL; vx = vx->link) {
+		if (!vx->ifake && !vx->ofake)
+			nrv++;
+	}
+	if ((rcombs = (nodecomb *)malloc(sizeof(nodecomb) * (nrv + 1))) == NULL
+	 || (prcombs = (nodecomb **)malloc(sizeof(nodecomb *) * (nrv + 1))) == NULL
+	 || (rvs = (int *)malloc(sizeof(int) * (nrv + 1))) == NULL)
+		error ("ofps: malloc failed on vertex re-position list %d", nrv);
+
+	for (i = nmv = 0, vx = s->uvtx; vx != NULL; vx = vx->link) {
+		nodecomb *ncp;
 
 		if (vx->ifake || vx->ofake)
 			continue;
+		ncp = &rcombs[i++];
 
 		vx->p_eperr = vx->eperr;
 
+		if (vtx_is_fixed(s, vx))
+			continue;
+		prcombs[nmv++] = ncp;
+
 		/* Pointers to real nodes. */
 		for (ii = e = 0; e <= di; e++) {
 			if (vx->nix[e] >= 0)
@@ -7072,38 +7246,54 @@ ofps *s
 		/* Compute the current eperr at the vertex given the repositioned nodes, */
 		/* to set acceptance threshold for repositioned vertex. */
 		ofps_pn_eperr(s, NULL, ee, vx->v, vx->p, nds, ii);
-		nc.ceperr = ofps_eperr2(ee, ii);
+		ncp->ceperr = ofps_eperr2(ee, ii);
  
 		/* Setup to re-position the vertex */
-		memset((void *)&nc, 0, sizeof(nodecomb));
+		memset((void *)ncp, 0, sizeof(nodecomb));
 		for (e = 0; e < di; e++) {
-			nc.nix[e] = vx->nix[e];
-			nc.p[e] = vx->p[e]; 
-			nc.v[e] = vx->v[e]; 
+			ncp->nix[e] = vx->nix[e];
+			ncp->p[e] = vx->p[e]; 
+			ncp->v[e] = vx->v[e]; 
 		}
-		nc.nix[e] = vx->nix[e];
+		ncp->nix[e] = vx->nix[e];
+		ncp->startex = 1;
 
 #ifdef DEBUG
-		printf("Repositioning vertex no %d nodes %s at %s, ceperr %f\n",vx->no,pcomb(di,vx->nix),ppos(di,vx->p),nc.ceperr);
+		printf("Repositioning vertex no %d nodes %s at %s, ceperr %f\n",vx->no,pcomb(di,vx->nix),ppos(di,vx->p),ncp->ceperr);
 #endif
+	}
+
+	position_vtxs(s, prcombs, rvs, nmv, 1, 0);
+
+	s->fchl = NULL;
+	for (i = k = 0, vx = s->uvtx; vx != NULL; vx = vx->link) {
+		nodecomb *ncp = &rcombs[i];
+
+		if (vx->ifake || vx->ofake)
+			continue;
+		i++;
+
+		/* Unchanged, but a moved node may still have made it invalid */
+		if (vtx_is_fixed(s, vx))
+			goto check;
 
 		/* We're about to change the position and eperr: */
 		ofps_rem_vacc(s, vx);
 		ofps_rem_vseed(s, vx);
 
-		if (position_vtx(s, &nc, 1, 1, 0) == 2) {
+		if (rvs[k++] == 2) {
 			/* Just leave it where it was. Perhaps fixups will delete it */
 			if (s->verb > 1)
 				warning("re_position_vtx failed for vtx no %d at %s",vx->no,ppos(di,vx->p));
 		} else {
-//printf("~1 moved from %s to %s\n",ppos(di,vx->p),ppos(di,nc.p));
+//printf("~1 moved from %s to %s\n",ppos(di,vx->p),ppos(di,ncp->p));
 
 			for (e = 0; e < di; e++) {
-				vx->p[e] = nc.p[e];
-				vx->v[e] = nc.v[e];
+				vx->p[e] = ncp->p[e];
+				vx->v[e] = ncp->v[e];
 			}
-			vx->eperr = nc.eperr;
-			vx->eserr = nc.eserr;
+			vx->eperr = ncp->eperr;
+			vx->eserr = ncp->eserr;
 		}
 
 		/* Count the number of gamut surfaces the vertex falls on */
@@ -7113,6 +7303,7 @@ ofps *s
 		ofps_add_vacc(s, vx);
 		ofps_add_vseed(s, vx);
 
+	  check:;
 		/* Add all vertexes to the "to be checked" list */
 		vx->fchl = s->fchl; /* Add vertex to the "to be checked" list */
 		if (s->fchl != NULL)
@@ -7123,6 +7314,9 @@ ofps *s
 		vx->fupcount = 0;
 		vx->fuptol = NUMTOL;
 	}
+	free(rcombs);
+	free(prcombs);
+	free(rvs);
 
 #ifdef DUMP_PLOT_BEFORFIXUP
 	printf("Before applying fixups:\n");
@@ -7456,7 +7650,7 @@ ofps_create_mids(ofps *s) {
 	double rerr;
 	int nsp = 0;		/* Number of surface points */
 	double dnsqtol = 1e-6;		/* Solution tollerance to aim for */
-	vopt_cx cx;
+	mopt_cx cx;
 	double fvec[1];
 	int rv;
 
@@ -7827,6 +8021,7 @@ ofps *s
 		double hratio, thresh;
 		int doinc = 0;
 
+		a1tr_begin("ofps iteration");
 		s->mxmvsq = 0.0;
 		if (s->optit < transitters)
 			bf = s->optit/(double)transitters;
@@ -7928,13 +8123,16 @@ ofps *s
 //printf("~1 quick check of vertex hits = %d, ratio %f, threshold %f\n",nvxhits,hratio,thresh);
 
 		/* Hmm. Re-seed seems to sometimes be slower than expected for > 3D, */
-		/* so don't use it. */
-		if (hratio < thresh && di < 4) {
+		/* so don't use it. If most of the nodes are fixed (ie. we are */
+		/* extending an existing set of points), only the neighbourhood */
+		/* of the moveable nodes is affected, so always fix up. */
+		if (di < 4 && (hratio < thresh || 2 * s->fnp > s->tinp)) {
 			doinc = 1;
 		}
 
-#ifdef FORCE_RESEED		/* Force reseed after itteration */
-		doinc = 0;
+#ifdef FORCE_RESEED		/* Force reseed after itteration, except when extending */
+		if (di >= 4 || 2 * s->fnp <= s->tinp)
+			doinc = 0;
 #else
 # ifdef FORCE_INCREMENTAL	/* Force incremental update after itteration */
 		doinc = 1;
@@ -7971,8 +8169,8 @@ ofps *s
 		if (s->verb) {
 			printf("It %d: Maxmv = %f, MinPoint = %.3f, Min = %.3f, Avg. = %.3f, Max = %.3f, %.1f secs.\n",s->optit+1,sqrt(s->mxmvsq),s->smns,s->mn,s->av,s->mx,(msec_time() - s->l_mstime) / 1000.0);
 #ifdef STATS
-			printf("Current vtx %d, created %d, deleted %d, positioned %d\n", s->nv,s->nvtxcreated - s->l_nvtxcreated,s->nvtxdeleted - s->l_nvtxdeleted, s->positions - s->l_positions);
-			s->l_positions = s->positions;
+			printf("Current vtx %d, created %d, deleted %d, positioned %d\n", s->nv,s->nvtxcreated - s->l_nvtxcreated,s->nvtxdeleted - s->l_nvtxdeleted, s->pt->positions - s->l_positions);
+			s->l_positions = s->pt->positions;
 			s->l_nvtxcreated = s->nvtxcreated;
 			s->l_nvtxdeleted = s->nvtxdeleted;
 #endif
@@ -8006,8 +8204,8 @@ ofps *s
 		if (s->verb) {
 			printf("It %d: Maxmv = %f, MinPoint = %.3f, Min = %.3f, Avg. = %.3f, Max = %.3f, %.1f secs.\n",s->optit+1,sqrt(s->mxmvsq),s->smns,s->mn,s->av,s->mx,(msec_time() - s->l_mstime) / 1000.0);
 #ifdef STATS
-			printf("Current vtx %d, created %d, deleted %d, positioned %d\n", s->nvtxcreated - s->l_nvtxcreated,s->nvtxdeleted - s->l_nvtxdeleted, s->positions - s->l_positions);
-			s->l_positions = s->positions;
+			printf("Current vtx %d, created %d, deleted %d, positioned %d\n", s->nvtxcreated - s->l_nvtxcreated,s->nvtxdeleted - s->l_nvtxdeleted, s->pt->positions - s->l_positions);
+			s->l_positions = s->pt->positions;
 			s->l_nvtxcreated = s->nvtxcreated;
 			s->l_nvtxdeleted = s->nvtxdeleted;
 #endif
@@ -8034,6 +8232,7 @@ ofps *s
 #endif /* DUMP_PLOT */
 #endif /* SANITY_RESEED_AFTER_FIXUPS */
 
+		a1tr_end();
 		if (sqrt(s->mxmvsq) < stoptol)
 			break;
 	}
@@ -8058,15 +8257,32 @@ ofps_del(ofps *s) {
 	free(s->n);
 	free(s->_n);
 
-	/* Any free vertexes */
-	while (s->fvtx != NULL) {
-		vtx *p = s->fvtx;
-		s->fvtx = p->link;
-		free(p);
+	/* All the vertexes and midpoints */
+	while (s->vblks != NULL) {
+		vtxblk *bp = s->vblks;
+		s->vblks = bp->next;
+		for (i = 0; i < VTXBLKSZ; i++) {
+			if (bp->v[i].nv != NULL)
+				free(bp->v[i].nv);
+		}
+		free(bp);
+	}
+	while (s->mblks != NULL) {
+		midblk *bp = s->mblks;
+		s->mblks = bp->next;
+		free(bp);
 	}
 
 	/* Any other allocations */
-	s->sob->del(s->sob);
+	for (i = 0; i < s->npt; i++) {
+		s->pt[i].sob->del(s->pt[i].sob);
+		del_dnsqws(s->pt[i].dws);
+	}
+	free(s->pt);
+	if (s->pcombs != NULL)
+		free(s->pcombs);
+	if (s->prvs != NULL)
+		free(s->prvs);
 	if (s->combs != NULL) {
 		for (i = 0; i < s->_ncombs; i++) {
 			if (s->combs[i].v1 != NULL)
@@ -8159,8 +8375,18 @@ int nopstop				/* Debug - number of optimizations until diagnostic stop, -1 = no
 	s->ntostop = ntostop;
 	s->nopstop = nopstop;
 
-	if ((s->sob = new_sobol(di)) == NULL)
-		error ("ofps: new_sobol %d failed", di);
+	/* One vertex positioning context per thread */
+	s->npt = num_threads();
+	if (s->npt > NUMTHR_MAX)
+		s->npt = NUMTHR_MAX;
+	if ((s->pt = (ofps_pt *)calloc(sizeof(ofps_pt), s->npt)) == NULL)
+		error ("ofps: malloc failed on vertex positioning contexts");
+	for (i = 0; i < s->npt; i++) {
+		if ((s->pt[i].sob = new_sobol(di)) == NULL)
+			error ("ofps: new_sobol %d failed", di);
+		if ((s->pt[i].dws = new_dnsqws(di)) == NULL)
+			error ("ofps: new_dnsqws %d failed", di);
+	}
 	
 	if (s->verb)
 		printf("Degree of adaptation: %.3f\n", dadaptation);
@@ -8296,7 +8522,7 @@ int nopstop				/* Debug - number of optimizations until diagnostic stop, -1 = no
 
 #ifdef STATS
 	/* Save current counts to report stats after a pass */
-	s->l_positions = s->positions;
+	s->l_positions = s->pt->positions;
 	s->l_nvtxcreated = s->nvtxcreated;
 	s->l_nvtxdeleted = s->nvtxdeleted;
 #endif
@@ -8354,8 +8580,8 @@ int nopstop				/* Debug - number of optimizations until diagnostic stop, -1 = no
 			printf("After seeding points: MinPoint = %.3f, Min = %.3f, Avg. = %.3f, Max = %.3f, %.1f secs\n",s->smns,s->mn,s->av,s->mx,(msec_time() - s->l_mstime) / 1000.0);
 	
 #ifdef STATS
-			printf("Current vtx %d, created %d, deleted %d, positioned %d\n", s->nv,s->nvtxcreated - s->l_nvtxcreated,s->nvtxdeleted - s->l_nvtxdeleted, s->positions - s->l_positions);
-			s->l_positions = s->positions;
+			printf("Current vtx %d, created %d, deleted %d, positioned %d\n", s->nv,s->nvtxcreated - s->l_nvtxcreated,s->nvtxdeleted - s->l_nvtxdeleted, s->pt->positions - s->l_positions);
+			s->l_positions = s->pt->positions;
 			s->l_nvtxcreated = s->nvtxcreated;
 			s->l_nvtxdeleted = s->nvtxdeleted;
 #endif
@@ -8438,15 +8664,15 @@ int nopstop				/* Debug - number of optimizations until diagnostic stop, -1 = no
 		fprintf(stderr,"Average vertexes per vertex %.1f, max %d\n",totvtxverts/(double)novtx,maxvtxverts);
 		fprintf(stderr,"Average hit vertexes per add %.1f\n",s->nhitv/(double)s->nsurfadds,s->maxhitv);
 		fprintf(stderr,"Total number of vertex = %d\n",novtx); 
-		fprintf(stderr,"Total vertex positions = %d\n",s->positions); 
-		fprintf(stderr,"Total dnsqs = %d\n",s->dnsqs); 
-		fprintf(stderr,"Total function calls = %d\n",s->funccount); 
-		fprintf(stderr,"Average dnsqs/position = %.2f\n",s->dnsqs/(double)s->positions); 
-		fprintf(stderr,"Average function calls/dnsq = %.1f\n",s->funccount/(double)s->dnsqs); 
-		fprintf(stderr,"Maximum function calls/dnsq = %d\n",s->maxfunc); 
-		fprintf(stderr,"Average function calls/sucessful dnsq = %.2f\n",s->sucfunc/(double)s->sucdnsq); 
-		fprintf(stderr,"Average function calls/position = %.1f\n",s->funccount/(double)s->positions); 
-		fprintf(stderr,"Maximum tries for dnsq sucess %d\n",s->maxretries); 
+		fprintf(stderr,"Total vertex positions = %d\n",s->pt->positions); 
+		fprintf(stderr,"Total dnsqs = %d\n",s->pt->dnsqs); 
+		fprintf(stderr,"Total function calls = %d\n",s->pt->funccount); 
+		fprintf(stderr,"Average dnsqs/position = %.2f\n",s->pt->dnsqs/(double)s->pt->positions); 
+		fprintf(stderr,"Average function calls/dnsq = %.1f\n",s->pt->funccount/(double)s->pt->dnsqs); 
+		fprintf(stderr,"Maximum function calls/dnsq = %d\n",s->pt->maxfunc); 
+		fprintf(stderr,"Average function calls/sucessful dnsq = %.2f\n",s->pt->sucfunc/(double)s->pt->sucdnsq); 
+		fprintf(stderr,"Average function calls/position = %.1f\n",s->pt->funccount/(double)s->pt->positions); 
+		fprintf(stderr,"Maximum tries for dnsq sucess %d\n",s->pt->maxretries); 
 		fprintf(stderr,"Number of position_vtx failures %d\n",s->posfails); 
 		fprintf(stderr,"Vertex hit check efficiency = %.1f%%\n",100.0 * (1.0 - s->vvchecks/(double)s->vvpchecks));
 		fprintf(stderr,"Average accell cells searched = %.2f\n",s->ncellssch/(double)s->naccsrch);
@@ -9320,7 +9546,7 @@ static void check_for_missing_vertexes(ofps *s) {
 			lsc = vv.nix[di];
 		}
 
-		if (position_vtx(s, &vv, 0, 0, 0) == 0) {
+		if (position_vtx(s, s->pt, &vv, 0, 0, 0) == 0) {
 			int ix;
 			double eperr;
 			node *nn;
@@ -114,6 +114,14 @@ struct _vtx {
 	struct _vtx *dell;	/* Deleted/Not Deleted list */
 }; typedef struct _vtx vtx;
 
+/* Vertexes are allocated in blocks, to keep them close together */
+/* in memory and avoid allocator overhead. */
+#define VTXBLKSZ 256
+struct _vtxblk {
+	struct _vtxblk *next;	/* Next allocated block */
+	vtx v[VTXBLKSZ];
+}; typedef struct _vtxblk vtxblk;
+
 /* A mid point. This is a point that has the highest eserr directly */
 /* between two neighboring nodes. It is used during optimization */
 /* to try and encourage even spacing between nodes. */
@@ -131,6 +139,13 @@ struct _mid {
 	struct _mid **plp;	/* Pointer to link pointer in used list */
 }; typedef struct _mid mid;
 
+/* Block of midpoints */
+#define MIDBLKSZ 256
+struct _midblk {
+	struct _midblk *next;	/* Next allocated block */
+	mid m[MIDBLKSZ];
+}; typedef struct _midblk midblk;
+
 
 /* A measurement sample point node. */
 /* Sample points are the points around which the Voronoi polyhedra */
@@ -226,6 +241,23 @@ struct _surfcomb {
 	struct _surfcomb *ds;	/* Circular list of the disjoint set */
 }; typedef struct _surfcomb surfcomb;
 
+/* Vertex positioning context. There is one for each thread that */
+/* may be positioning vertexes at the same time, the first one also */
+/* being used serially and accumulating the statistics of them all. */
+struct _ofps_pt {
+	sobol *sob;		/* Random starting point offset sequence */
+	dnsqws *dws;	/* dnsq working storage */
+
+	/* Debug/stats */
+	int positions;	/* Number of calls to locate vertex */
+	int dnsqs;		/* Number of dnsq is called */
+	int funccount;	/* Number of times dnsq callback function is called */
+	int maxfunc;	/* Maximum function count per dnsq */
+	int sucfunc;	/* Function count per sucessful dnsq */
+	int sucdnsq;	/* Number of sucessful dnsqs */
+	int maxretries;	/* Maximum retries used on sucessful dnsq */
+}; typedef struct _ofps_pt ofps_pt;
+
 /* Main sample point object */
 struct _ofps {
 /* private: */
@@ -306,6 +338,8 @@ struct _ofps {
 	struct _vtx *hvtx;	/* Linked list of hidden vtx's */
 	struct _mid *umid;	/* Linked list of used mid's */
 	struct _mid *fmid;	/* Linked list of free mid's */
+	vtxblk *vblks;		/* Linked list of vertex allocation blocks */
+	midblk *mblks;		/* Linked list of midpoint allocation blocks */
 
 	/* Unbounded perceptual model */
 	double pmod[MXPD * (1 << MXPD)];
@@ -334,20 +368,17 @@ struct _ofps {
 							/* We get di+2 planes for fake initial nodes */
 
 	/* Utility - avoid re-allocation/initialization */
-	sobol *sob;
+	int npt;			/* Number of vertex positioning threads */
+	ofps_pt *pt;		/* npt vertex positioning contexts */
 	nodecomb *combs;	/* New node combinations being created in add_to_vsurf() */
 	int _ncombs;  /* Number of node combinations allocated. */
+	nodecomb **pcombs;	/* Node combinations to be positioned in add_to_vsurf() */
+	int *prvs;			/* position_vtx() return value for each pcombs[] */
+	int _npcombs;		/* Number of pcombs[] and prvs[] allocated */
 
 	/* Debug/stats */
 	int nopstop;	/* Number of optimization passes before stopping with diagnostics */
 	int ntostop;	/* Number of points before stopping with diagnostics */
-	int positions;	/* Number of calls to locate vertex */
-	int dnsqs;		/* Number of dnsq is called */
-	int funccount;	/* Number of times dnsq callback function is called */
-	int maxfunc;	/* Maximum function count per dnsq */
-	int sucfunc;	/* Function count per sucessful dnsq */
-	int sucdnsq;	/* Number of sucessful dnsqs */
-	int maxretries;	/* Maximum retries used on sucessful dnsq */
 	int posfails;	/* Number of position_vtx failures */
 	int posfailstp;	/* Number of position_vtx failures this pass */
 	int nvtxcreated;	/* Number of vertexes created */
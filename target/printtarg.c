@@ -1726,6 +1726,7 @@ cp->nc[1]->i,cp->nc[1]->id,cp->nc[1]->loc);
 }
 
 #define MAXPPROW 500		/* Absolute maximum patches per pass/row permitted */
+#define OPT_SCALE_STEP 0.005	/* Patch scale search step for -O layout optimization */
 #define MAXROWLEN 2000.0	/* Absolute maximum row length */
 
 void
@@ -1769,7 +1770,10 @@ unsigned char **pprps,	/* Return malloced array holding Passes per strip */
 double *p_patchlen,	/* Return patch length in mm */
 double *p_gaplen,	/* Return gap length in mm */
 double *p_taplen,	/* Return trailer length in mm */
-int *p_npat			/* Return number of patches including padding */
+int *p_npat,		/* Return number of patches including padding */
+int *p_npages,		/* Return number of pages, NULL if not needed */
+int *p_nrows,		/* Return total number of rows (strip reads), NULL if not needed */
+int layonly			/* NZ to return after computing the layout, without output */
 ) {
 	char psname[MAXNAMEL+20];		/* Name of output file */
 	trend *tro = NULL;		/* Target rendering object */
@@ -2313,6 +2317,17 @@ int *p_npat			/* Return number of patches including padding */
 
 	lpprow = rem + nextrap;				/* Patches in last row of last strip of last page */
 
+	if (p_npages != NULL)
+		*p_npages = npages;
+	if (p_nrows != NULL)
+		*p_nrows = (tidnpat + tpprow - 1)/tpprow;
+
+	if (layonly) {			/* Caller just wants to evaluate the layout */
+		free(*pprps);
+		*pprps = NULL;
+		return;
+	}
+
 	if (verb) {
 		fprintf(stderr,"Patches = %d\n",npat);
 		fprintf(stderr,"Test patches per row = %d\n",tpprow);
@@ -2905,6 +2920,7 @@ void usage(char *diag, ...) {
 	fprintf(stderr," -h              Use hexagon patches for SS, double density for CM\n");
 	fprintf(stderr," -a scale        Scale patch size and spacers by factor (e.g. 0.857 or 1.5 etc.)\n");
 	fprintf(stderr," -A scale        Scale spacers by additional factor (e.g. 0.857 or 1.5 etc.)\n");
+	fprintf(stderr," -O minscale     Optimize layout by allowing patch scale to reduce to minscale\n");
 	fprintf(stderr," -r              Don't randomize patch location\n");
 	fprintf(stderr," -s              Create a scan image recognition (.cht) file\n");
 	fprintf(stderr," -S              Same as -s, but don't generate wide orientation strip.\n");
@@ -2951,6 +2967,7 @@ char *argv[];
 	int hflag = 0;			/* Hexagon patches for SS, high density for CM */
 	double pscale = 1.0;	/* Patch size scale */
 	double sscale = 1.0;	/* Spacer size scale */
+	double oscale = 0.0;	/* Minimum patch scale for layout optimization, 0 = none */
 	int rand = 1;
 	int qbits = 0;			/* Quantization bits */
 	int oft = 0;			/* Ouput File type, 0 = PS, 1 = EPS , 2 = TIFF */
@@ -3078,6 +3095,15 @@ char *argv[];
 					usage("Scale factor %f is outside expected range 0.1 - 8.0",sscale);
 			}
 
+			/* Layout optimization */
+			else if (argv[fa][1] == 'O') {
+				fa = nfa;
+				if (na == NULL) usage("Expected minimum scale factor to -O");
+				oscale = atof(na);
+				if (oscale < 0.1 || oscale > 1.0)
+					usage("Minimum scale factor %f is outside expected range 0.1 - 1.0",oscale);
+			}
+
 			/* Scan compatible */
 			else if (argv[fa][1] == 's')
 				scanc = 3;
@@ -3681,12 +3707,45 @@ char *argv[];
 	
 	sprintf(label, "ArgyllCMS - Chart \"%s\" (%s %d) %s",
 	               psname, rand ? "Random Start" : "Chart ID", rstart, atm);
+
+	/* Search for the patch scale between pscale * oscale and pscale that */
+	/* minimizes the number of sheets, and then the number of strips to be read. */
+	if (oscale > 0.0 && oscale < 1.0) {
+		double tscale, bscale = pscale;
+		int tpages, trows, bpages = 0, brows = 0;
+		int opages = 0, orows = 0;
+		int i, nsteps;
+
+		nsteps = (int)((1.0 - oscale)/OPT_SCALE_STEP + 0.5);
+		for (i = 0; i <= nsteps; i++) {
+			tscale = pscale * (1.0 - (1.0 - oscale) * i/(double)nsteps);
+			generate_file(itype, psname, cols, npat, applycal ? cal : NULL, label,
+			            pap != NULL ? pap->w : cwidth, pap != NULL ? pap->h : cheight,
+			            marg, nosubmarg, nollimit, nolpcbord, rand, rstart, saix, paix,	ixord,
+			            tscale, sscale, hflag, 0, scanc, oft, nocups, tiffdpth, tiffres, ncha, tiffdith,
+			            tiffcomp, spacer, nmask, altrep, pcol, wp,
+			            &sip, &pis, &plen, &glen, &tlen, &nppat, &tpages, &trows, 1);
+			if (i == 0) {
+				opages = bpages = tpages;
+				orows = brows = trows;
+			} else if (tpages < bpages || (tpages == bpages && trows < brows)) {
+				bscale = tscale;
+				bpages = tpages;
+				brows = trows;
+			}
+		}
+		if (verb)
+			fprintf(stderr,"Optimized patch scale = %f, %d pages and %d rows (was %d pages and %d rows)\n",
+			               bscale, bpages, brows, opages, orows);
+		pscale = bscale;
+	}
+
 	generate_file(itype, psname, cols, npat, applycal ? cal : NULL, label,
 	            pap != NULL ? pap->w : cwidth, pap != NULL ? pap->h : cheight,
 	            marg, nosubmarg, nollimit, nolpcbord, rand, rstart, saix, paix,	ixord,
 	            pscale, sscale, hflag, verb, scanc, oft, nocups, tiffdpth, tiffres, ncha, tiffdith,
 	            tiffcomp, spacer, nmask, altrep, pcol, wp,
-	            &sip, &pis, &plen, &glen, &tlen, &nppat);
+	            &sip, &pis, &plen, &glen, &tlen, &nppat, NULL, NULL, 0);
 
 	if (itype == instDTP20
 	 || itype == instDTP41) {	/* DTP20/41 needs this */
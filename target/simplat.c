@@ -523,6 +523,73 @@ double *p		/* Perceptual value */
 
 /* Do a pass of seed filling the whole gamut, given a simplex dia. */
 /* Return the number of nodes produced */
+/* Coincident point rationalisation context */
+typedef struct {
+	simplat *s;
+	char *vald;		/* Return the rationalised valid flag of each node */
+} ratcntx;
+
+/* Rationalise nodes i0 .. i1-1 against the fixed points and the */
+/* following nodes. A node is dropped if it's within tol of a fixed point */
+/* or of a later valid node, so that only the last of a cluster survives. */
+/* Since only the unrationalised flags of later nodes are looked at, */
+/* each node can be done independently. */
+static int rationalise_thread(void *cntx, int i0, int i1, int thix) {
+	ratcntx *cx = (ratcntx *)cntx;
+	simplat *s = cx->s;
+	int di = s->di;
+	int i, j, k;
+
+	for (i = i0; i < i1; i++) {
+		cx->vald[i] = 0;
+
+		if (s->nodes[i].vald == 0)
+			continue;
+
+		/* First against fixed points in device space */
+		for (k = 0; k < s->fxno; k++) {
+			double dd;
+
+			/* Compute distance */
+			dd = 0.0;
+			for (j = 0; j < di; j++) {
+				double tt = s->nodes[i].v[j] - s->fxlist[k].v[j];
+				dd += tt * tt;
+			}
+			dd = 0.01 * sqrt(dd);
+
+			if (dd < s->tol)
+				break;		/* Ignore this point */
+		}
+		if (k < s->fxno)
+			continue;
+
+		/* Then against all the other points */
+		for (k = i+1; k < s->np; k++) {
+			double dd;
+
+			if (s->nodes[k].vald == 0)
+				continue;
+
+			/* Compute distance */
+			dd = 0.0;
+			for (j = 0; j < di; j++) {
+				double tt = s->nodes[i].v[j] - s->nodes[k].v[j];
+				dd += tt * tt;
+			}
+			dd = 0.01 * sqrt(dd);
+
+			if (dd < s->tol)
+				break;		/* Ignore this point */
+		}
+		if (k < s->np)
+			continue;
+
+		cx->vald[i] = 1;	/* Found a valid one */
+	}
+	return 0;
+}
+
 static int do_pass(
 simplat *s,
 double dia		/* Simplex diameter to try */
@@ -630,61 +697,21 @@ double dia		/* Simplex diameter to try */
 
 
 	/* Rationalise cooincident points, and count final valid */
-	s->nvp =  0;
-	for (i = 0; i < s->np; i++) {
-
-//printf("~1 rationalising %d, = %f %f\n",i, s->nodes[i].v[0], s->nodes[i].v[1]);
-		if (s->nodes[i].vald == 0) {
-//printf("~1 point %d is not valid\n",i);
-			continue;
-		}
-
-		/* First against fixed points in device space */
-		for (k = 0; k < s->fxno; k++) {
-			double dd;
-
-			/* Compute distance */
-			dd = 0.0;
-			for (j = 0; j < di; j++) {
-				double tt = s->nodes[i].v[j] - s->fxlist[k].v[j];
-				dd += tt * tt;
-			}
-			dd = 0.01 * sqrt(dd);
-
-			if (dd < s->tol) {
-				s->nodes[i].vald = 0;	/* Ignore this point */
-//printf("~1 point %d matches input point %d\n",i, k);
-				break;
-			}
-		}
-
-		if (s->nodes[i].vald == 0)
-			continue;
-
-		/* Then against all the other points */
-		for (k = i+1; k < s->np; k++) {
-			double dd;
-
-			if (s->nodes[k].vald == 0)
-				continue;
-
-			/* Compute distance */
-			dd = 0.0;
-			for (j = 0; j < di; j++) {
-				double tt = s->nodes[i].v[j] - s->nodes[k].v[j];
-				dd += tt * tt;
-			}
-			dd = 0.01 * sqrt(dd);
-
-			if (dd < s->tol) {
-				s->nodes[i].vald = 0;	/* Ignore this point */
-//printf("~1 point %d matches other point %d\n",i, k);
-				break;
-			}
+	{
+		ratcntx cx;
+
+		cx.s = s;
+		if ((cx.vald = (char *)malloc(s->np * sizeof(char))) == NULL)
+			error ("simplat: vald malloc failed");
+		par_for(0, 0, s->np, 0, rationalise_thread, (void *)&cx);
+
+		s->nvp =  0;
+		for (i = 0; i < s->np; i++) {
+			s->nodes[i].vald = cx.vald[i];
+			if (s->nodes[i].vald != 0)
+				s->nvp++;		/* Found a valid one */
 		}
-
-		if (s->nodes[i].vald != 0)
-			s->nvp++;		/* Found a valid one */
+		free(cx.vald);
 	}
 
 #ifdef DUMP_PLOT
@@ -123,6 +123,10 @@
 #define DEFANGLE 0.3333	/* For simdlat and simplat */
 #define SIMDLAT_TYPE SIMDLAT_BCC	/* Simdlat geometry type */
 #define MATCH_TOLL 1e-4	/* Tollerance of device value to consider a patch a duplicate */
+#define PCACHE_MAXDI 4	/* Maximum dimensions to cache the perceptual lookup for */
+#define PCACHE_CHECK 2000	/* Number of points to check the perceptual cache at */
+#define PCACHE_AVGERR 0.2	/* Maximum average perceptual cache error */
+#define PCACHE_MAXERR 2.0	/* Maximum peak perceptual cache error */
 
 /* Display rise and fall time delay model. This is CRT like */
 #define DISPLAY_RISE_TIME DISPTECH_WORST_RISE		/* Assumed rise time to 90% of target level */ 
@@ -184,6 +188,9 @@ struct _pcpt {
 	void (*den_to_dev)(struct _pcpt *s, double *out, double *in);	/* Density to device */
 	void (*rLab_to_dev)(struct _pcpt *s, double *out, double *in);	/* Lab to device */
 
+	/* Cache dev_to_perc in a device space grid, if it's worthwhile */
+	void (*cache_perc)(struct _pcpt *s, int verb);
+
 	/* !!! Should add perc_to_dev using code from prand that uses dnsq !!! */
 
 /* private: */
@@ -211,6 +218,8 @@ struct _pcpt {
 	rspl *nlin[MXTD - 3];	/* Perceptual linearisation for other chanels */
 	int e;					/* Chanel being set */
 
+	rspl *pcache;			/* Cached dev_to_perc, NULL if none */
+
 	/* Reverse lookup support */
 	double ilimit;			/* Ink limit (scale 1.0) */
 	double den[3];			/* Target density or Lab */
@@ -353,6 +362,92 @@ pcpt_to_nLab(pcpt *s, double *out, double *in) {
 }
 
 
+/* Cached perceptual conversion function */
+static void
+pcpt_to_cnLab(pcpt *s, double *out, double *in) {
+	int e;
+	co cp;
+
+	for (e = 0; e < s->di; e++) {
+		if (in[e] < 0.0 || in[e] > 1.0)
+			break;
+		cp.p[e] = in[e];
+	}
+	if (e < s->di) {		/* Outside grid, so do it directly */
+		pcpt_to_nLab(s, out, in);
+		return;
+	}
+	s->pcache->interp(s->pcache, &cp);
+	for (e = 0; e < s->di; e++)
+		out[e] = cp.v[e];
+}
+
+/* Callback to setup s->pcache grid values */
+static void set_pcache(void *cbntx, double *out, double *in) {
+	pcpt *s = (pcpt *)cbntx;
+
+	pcpt_to_nLab(s, out, in);
+}
+
+/* Create the perceptual lookup cache. The grid is set in parallel, */
+/* and then checked against direct lookups at pseudo-random points, */
+/* and not used if the interpolation error is too large. */
+static void pcpt_cache_perc(pcpt *s, int verb) {
+	int e, i, di = s->di;
+	int gres[MXTD];
+	unsigned int seed = 0x12345678;
+	double aerr = 0.0, merr = 0.0;
+	static int cres[PCACHE_MAXDI+1] = { 0, 1025, 257, 65, 25 };
+
+	if (s->pcache != NULL
+	 || di > PCACHE_MAXDI
+	 || (s->luo == NULL && s->mlu == NULL && s->clu == NULL))
+		return;					/* Already done, too big, or trivial lookup */
+
+	if (verb)
+		printf("Creating perceptual lookup cache, resolution %d\n",cres[di]);
+
+	if ((s->pcache = new_rspl(RSPL_NOFLAGS, di, di)) == NULL)
+		error("RSPL creation failed");
+
+	for (e = 0; e < di; e++)
+		gres[e] = cres[di];
+	s->pcache->set_rspl(s->pcache, RSPL_MTHREAD, s, set_pcache,
+	                    NULL, NULL, gres, NULL, NULL);
+
+	for (i = 0; i < PCACHE_CHECK; i++) {
+		double in[MXTD], out[MXTD], cout[MXTD], err;
+
+		for (e = 0; e < di; e++) {
+			seed = PSRAND32(seed);
+			in[e] = seed/4294967295.0;
+		}
+		pcpt_to_nLab(s, out, in);
+		pcpt_to_cnLab(s, cout, in);
+		for (err = 0.0, e = 0; e < di; e++) {
+			double tt = out[e] - cout[e];
+			err += tt * tt;
+		}
+		err = sqrt(err);
+		aerr += err;
+		if (err > merr)
+			merr = err;
+	}
+	aerr /= (double)PCACHE_CHECK;
+
+	if (verb)
+		printf("Perceptual cache error avg = %f, max = %f\n",aerr,merr);
+
+	if (aerr > PCACHE_AVGERR || merr > PCACHE_MAXERR) {
+		if (verb)
+			printf("Perceptual cache is not accurate enough - not using it\n");
+		s->pcache->del(s->pcache);
+		s->pcache = NULL;
+		return;
+	}
+	s->dev_to_perc = pcpt_to_cnLab;
+}
+
 /* Return the largest distance of the point outside the device gamut. */
 /* This will be 0 if inside the gamut, and > 0 if outside.  */
 static double
@@ -639,6 +734,8 @@ static void pcpt_del(pcpt *s) {
 			if (s->nlin[e] != NULL)
 				s->nlin[e]->del(s->nlin[e]);
 		}
+		if (s->pcache != NULL)
+			s->pcache->del(s->pcache);
 		
 		free(s);
 	}
@@ -671,6 +768,7 @@ double xpow				/* Extra device power, default = none */
 	s->dev_to_rLab  = pcpt_to_rLab;
 	s->den_to_dev   = pcpt_den_to_dev;
 	s->rLab_to_dev  = pcpt_rLab_to_dev;
+	s->cache_perc   = pcpt_cache_perc;
 
 	s->xmask = xmask;
 	s->nmask = nmask;
@@ -894,6 +992,7 @@ usage(int level, char *diag, ...) {
 	fprintf(stderr," -p power         Optional power-like value applied to all device values.\n");
 	fprintf(stderr," -c profile       Optional device ICC or MPP pre-conditioning profile filename\n");
 	fprintf(stderr,"                  (Use \"none\" to turn off any conditioning)\n");
+	fprintf(stderr," -x file.ti1     Extend the patches of an existing .ti1 or .ti3 file\n");
 	fprintf(stderr," -N nemphasis     Degree of neutral axis patch concentration 0.0-1.0 (default %.2f)\n",NEMPH_DEFAULT);
 	fprintf(stderr," -V demphasis     Degree of dark region patch concentration 1.0-4.0 (default %.2f = none)\n",DEMPH_DEFAULT);
 	fprintf(stderr," -F L,a,b,rad     Filter out samples outside Lab sphere.\n");
@@ -971,6 +1070,7 @@ int main(int argc, char *argv[]) {
 	double filt[4] = { 50,0,0,0 };	
 	static char fname[MAXNAMEL+1] = { 0 };		/* Output file base name */
 	static char pname[MAXNAMEL+1] = { 0 };		/* Device profile name */
+	static char xname[MAXNAMEL+1] = { 0 };		/* Existing patches to extend */
 	static char wdname[MAXNAMEL+1] = { 0 };		/* Device diagnostic .wrl/.x3d name */
 	static char wlname[MAXNAMEL+1] = { 0 };		/* Lab diagnostic .wrl/.x3d name */
 	char buf[500];			/* Genaral use text buffer */
@@ -1235,6 +1335,13 @@ int main(int argc, char *argv[]) {
 				fa = nfa;
 			}
 
+			/* Existing .ti1 or .ti3 to extend */
+			else if (argv[fa][1] == 'x') {
+				if (na == NULL) usage(0,"Expect argument after -x");
+				strncpy(xname,na,MAXNAMEL-1); xname[MAXNAMEL-1] = '\000';
+				fa = nfa;
+			}
+
 			/* Degree of neutral axis emphasis */
 			else if (argv[fa][1] == 'N') {
 				if (na == NULL) usage(0,"Expected argument to neutral emphasis flag -N");
@@ -1313,8 +1420,17 @@ int main(int argc, char *argv[]) {
 	ident = icx_inkmask2char(xmask, 1); 
 	di = icx_noofinks(nmask);	/* Lookup number of dimensions */
 	stime = clock();
+	a1tm_start("targen");
 
 	/* Implement some defaults */
+	if (xname[0] != '\000') {	/* Existing chart already has its fixed patches */
+		if (esteps < 0)
+			esteps = 0;
+		if (Bsteps < 0)
+			Bsteps = 0;
+		if (ssteps < 0)
+			ssteps = 0;
+	}
 	if (esteps < 0)
 		esteps = 4;
 	if (gsteps < 0)
@@ -1379,6 +1495,8 @@ int main(int argc, char *argv[]) {
 		if (verb) {
 			printf("%s test chart\n",ident);
 
+			if (xname[0] != '\000')
+				printf("Extending patches from '%s'\n",xname);
 			if (esteps > 0)
 				printf("White patches = %d\n",esteps);
 			if (Bsteps > 0)
@@ -1517,6 +1635,102 @@ int main(int argc, char *argv[]) {
 			error ("Failed to malloc fxlist");
 	}
 
+	/* Existing patches being extended. These are copied through first, */
+	/* and become fixed points for the full spread patches added to them. */
+	if (xname[0] != '\000') {
+		cgats *xp;
+		int chix[MXTD];			/* Device field indexes */
+		int e, k, xnp;
+		char *bident = icx_inkmask2char(xmask, 0); 
+
+		xp = new_cgats();
+		xp->add_other(xp, "CTI1");
+		xp->add_other(xp, "CTI3");
+
+		if (xp->read_name(xp, xname))
+			error("CGATS file '%s' read error : %s",xname,xp->err);
+
+		if (xp->t[0].tt != tt_other || (xp->t[0].oi != 0 && xp->t[0].oi != 1))
+			error ("File '%s' isn't a CTI1 or CTI3 format file",xname);
+
+		if ((k = xp->find_kword(xp, 0, "COLOR_REP")) >= 0) {
+			int len = strlen(ident);
+			if (strncmp(xp->t[0].kdata[k], ident, len) != 0
+			 || (xp->t[0].kdata[k][len] != '\000' && xp->t[0].kdata[k][len] != '_'))
+				error ("File '%s' colorspace %s doesn't match %s",xname,xp->t[0].kdata[k],ident);
+		}
+
+		for (j = 0; j < di; j++) {
+			int imask;
+			char fname[100];
+
+			imask = icx_index2ink(xmask, j);
+			sprintf(fname,"%s_%s",nmask == ICX_W || nmask == ICX_K ? "GRAY" : bident,
+			                      icx_ink2char(imask));
+
+			if ((chix[j] = xp->find_field(xp, 0, fname)) < 0)
+				error ("File '%s' doesn't contain field %s",xname,fname);
+			if (xp->t[0].ftype[chix[j]] != r_t)
+				error ("Field %s in '%s' is wrong type",fname,xname);
+		}
+		free(bident);
+
+		xnp = xp->t[0].nsets;
+		if (verb)
+			printf("Read %d existing patches from '%s'\n",xnp,xname);
+		if (fsteps <= xnp)
+			warning("Full spread patches %d doesn't add to the %d existing patches",fsteps,xnp);
+
+		sprintf(buf,"%d",xnp);
+		pp->add_kword(pp, 0, "EXTENDED_PATCHES",buf, NULL);
+
+		for (i = 0; i < xnp; i++) {
+			double val[MXTD], XYZ[3];
+			cgats_set_elem ary[1 + MXTD + 3];
+
+			for (e = 0; e < di; e++) {
+				val[e] = *((double *)xp->t[0].fdata[i][chix[e]]) / 100.0;
+				if (xmask != nmask)
+					val[e] = 1.0 - val[e];
+				if (val[e] < 0.0)
+					val[e] = 0.0;
+				else if (val[e] > 1.0)
+					val[e] = 1.0;
+			}
+
+			sprintf(buf,"%d",id++);
+			ary[0].c = buf;
+
+			if (xmask == nmask) {
+				for (e = 0; e < di; e++)
+					ary[1 + e].d = 100.0 * val[e];
+			} else {
+				for (e = 0; e < di; e++)
+					ary[1 + e].d = 100.0 * (1.0 - val[e]);
+			}
+
+			pdata->dev_to_XYZ(pdata, XYZ, val);		/* Add expected XYZ */
+			ary[1 + di + 0].d = 100.0 * XYZ[0];
+			ary[1 + di + 1].d = 100.0 * XYZ[1];
+			ary[1 + di + 2].d = 100.0 * XYZ[2];
+	
+			pp->add_setarr(pp, 0, ary);
+	
+			if (fxlist != NULL) {		/* Note in fixed list */
+				if (fxno >= fxlist_a) {
+					fxlist_a *= 2;
+					if ((fxlist = (fxpos *)realloc(fxlist, sizeof(fxpos) * fxlist_a)) == NULL)
+						error ("Failed to malloc fxlist");
+				}
+				for (e = 0; e < di; e++)
+					fxlist[fxno].p[e] = val[e];
+				fxlist[fxno].eloc = -1;
+				fxno++;
+			}
+		}
+		xp->del(xp);
+	}
+
 	/* White color patches */
 	if (esteps > 0)	{
 		int j, e;
@@ -2209,6 +2423,7 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	a1tm_start("point generation");
 	if (fsteps > fxno) { /* Top up with full spread (perceptually even) and other patch types */
 
 		/* Generate device random numbers. Don't check for duplicates */
@@ -2306,6 +2521,9 @@ int main(int argc, char *argv[]) {
 			simplat *px = NULL;
 			prand *rx = NULL;
 
+			/* All these make many perceptual lookups */
+			pdata->cache_perc(pdata, verb);
+
 			/* (Note that the ink limit for these algorithms won't take into account the xpow), */
 			/* and that we're not applying the filter until after generation, so the */
 			/* number of patches won't reach the target. This could be fixed fairly easily */
@@ -2411,6 +2629,7 @@ int main(int argc, char *argv[]) {
 			(s ? s->del(s) : t ? t->del(t) : dx ? dx->del(dx) : rx ? rx->del(rx) : px->del(px));
 		}
 	}
+	a1tm_end();
 
 	/* Even the location of marked patches into sequence */
 	{
@@ -2450,7 +2669,8 @@ int main(int argc, char *argv[]) {
 
 	/* If this seems to be for a CRT, optimise the patch order to minimise the */
 	/* response time delays */
-	if (nmask == ICX_RGB && pp->t[0].nsets > 1 && dontreorder == 0) {
+	/* (An extended chart keeps the existing patches first and in order) */
+	if (nmask == ICX_RGB && pp->t[0].nsets > 1 && dontreorder == 0 && xname[0] == '\000') {
 		int npat = pp->t[0].nsets;
 		char *nm;						/* Don't move array */
 		double udelay, *delays, adelay;
@@ -2842,8 +3062,10 @@ int main(int argc, char *argv[]) {
 		printf("Execution time = %f seconds\n",ttime/(double)CLOCKS_PER_SEC);
 	}
 
+	a1tm_start("write .ti1");
 	if (pp->write_name(pp, fname))
 		error("Write error : %s",pp->err);
+	a1tm_end();
 
 #ifdef VRML_DIAG		/* Dump a VRML/X3D of the resulting points */
 	if (dumpvrml & 1) {	/* Lab space */
@@ -2920,6 +3142,9 @@ int main(int argc, char *argv[]) {
 	if (fxlist != NULL)
 		free(fxlist);
 
+	a1tm_end();
+	a1tm_report(g_log);
+
 	return 0;
 }
 
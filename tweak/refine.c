@@ -78,6 +78,7 @@
 #include "numlib.h"
 #include "rspl.h"
 #include "xicc.h"
+#include "gamut.h"
 #include "ui.h"
 
 #define COMPLOOKUP	/* Compound with previous in ICM lookup rather than rspl */
@@ -170,6 +171,7 @@ void usage(char *diag, ...) {
 	fprintf(stderr," -r res          Set abstract profile clut resolution (default %d)\n",DEF_CLUTRES);
 	fprintf(stderr," -d factor       Override default damping factor (default %f, then %f)\n",DEF_DAMP1,DEF_DAMP2);
 	fprintf(stderr," -R              Aim for white point relative match rather than absolute\n");
+	fprintf(stderr," -S session      Keep correction and gamut state across passes in session file\n");
 	fprintf(stderr," -f [illum]      Use Fluorescent Whitening Agent compensation [opt. simulated inst. illum.:\n");
 	fprintf(stderr,"                  M0, M1, M2, A, C, D50 (def.), D50M2, D65, F5, F8, F10 or file.sp]\n");
 	fprintf(stderr," -i illum        Choose illuminant for computation of CIE XYZ from spectral data & FWA:\n");
@@ -192,6 +194,7 @@ struct _callback {
 	int total, count, last;	/* Progress count information */
 	rspl *r;				/* correction transform */
 	icmLuBase *rd_luo;		/* Existing abstract profile (NULL if none) */
+	rspl *pr;				/* Existing session correction (NULL if none) */
 	gamut *dev_gam;			/* Gamut of output device (NULL if none) */
 }; typedef struct _callback callback;
 
@@ -199,9 +202,21 @@ struct _callback {
 /* - - - - */
 /*  clut  */
 
-/* New CLUT table */
-/* Correct for PCS errors */
-void PCSp_PCSp(void *cntx, double *out, double *in) {
+/* Lookup the previous correction, from the session if there is one */
+static void prev_lookup(callback *p, double *out, double *in) {
+	if (p->pr != NULL) {
+		co pp;
+
+		icmAry2Ary(pp.p, in);
+		p->pr->interp(p->pr, &pp);
+		icmAry2Ary(out, pp.v);
+	} else {
+		p->rd_luo->lookup(p->rd_luo, out, in);
+	}
+}
+
+/* Complete correction being created */
+static void correct(void *cntx, double *out, double *in) {
 	callback *p = (callback *)cntx;
 	co pp;
 
@@ -219,8 +234,8 @@ void PCSp_PCSp(void *cntx, double *out, double *in) {
 
 #ifdef COMPLOOKUP
 	/* Compound with previous correction */
-	if (p->rd_luo != NULL) {
-		p->rd_luo->lookup(p->rd_luo, out, out);			/* Previous correction */
+	if (p->rd_luo != NULL || p->pr != NULL) {
+		prev_lookup(p, out, out);			/* Previous correction */
 	}
 #endif
 
@@ -228,6 +243,14 @@ void PCSp_PCSp(void *cntx, double *out, double *in) {
 	printf("Got Lab out %f %f %f\n",out[0],out[1],out[2]);
 	printf("\n");
 #endif
+}
+
+/* New CLUT table */
+/* Correct for PCS errors */
+void PCSp_PCSp(void *cntx, double *out, double *in) {
+	callback *p = (callback *)cntx;
+
+	correct(cntx, out, in);
 
 	if (p->verb) {		/* Output percent intervals */
 		int pc;
@@ -256,6 +279,173 @@ static void wfunc(void *cbntx, double *out, double *in) {
 	out[2] = in[2];
 }
 
+/* ------------------------------------------- */
+/* Session support. A session file holds the complete correction */
+/* applied by the last abstract profile written, as the values of */
+/* a res^3 rspl grid at full precision, along with a cache of the */
+/* output device gamut. The next pass then only has to fit the new */
+/* refining correction, rather than re-reading the previous */
+/* abstract profile and re-creating the device gamut. */
+
+/* Session grid values */
+typedef struct {
+	int res;				/* Grid resolution */
+	double (*v)[3];			/* res^3 grid values */
+} sgrid;
+
+/* Index of a grid point from the grid indexes under in[] */
+static int sgrid_ix(sgrid *p, double *in) {
+	int e, ix;
+
+	for (ix = 0, e = 2; e >= 0; e--)
+		ix = ix * p->res + *((int *)&in[-e-1]);
+	return ix;
+}
+
+/* scan_rspl() function to save the grid values */
+static void sgrid_get(void *cntx, double *out, double *in) {
+	sgrid *p = (sgrid *)cntx;
+	icmAry2Ary(p->v[sgrid_ix(p, in)], out);
+}
+
+/* set_rspl() function to restore the grid values */
+static void sgrid_set(void *cntx, double *out, double *in) {
+	sgrid *p = (sgrid *)cntx;
+	icmAry2Ary(out, p->v[sgrid_ix(p, in)]);
+}
+
+/* Create the session correction rspl over the Lab grid range */
+static rspl *new_sess_rspl(int res, void *cntx, void (*func)(void *cntx, double *out, double *in)) {
+	rspl *r;
+	int e, gres[MXDI];
+	datai mn, mx;
+
+	mn[0] =   0.0, mn[1] = mn[2] = -128.0;			/* Same as refining rspl */
+	mx[0] = 100.0, mx[1] = mx[2] =  (65535.0 * 255.0)/65280.0 - 128.0;
+	for (e = 0; e < 3; e++)
+		gres[e] = res;
+
+	if ((r = new_rspl(RSPL_NOFLAGS, 3, 3)) == NULL)
+		error("new_rspl failed");
+	r->set_rspl(r, 0, cntx, func, mn, mx, gres, NULL, NULL);
+
+	return r;
+}
+
+/* Read a session file. Return nz if it can't be read or */
+/* doesn't match the clut resolution and white point handling. */
+/* *pr is set to the correction if the session was written for abs_name */
+/* (NULL if not), and *devok is set nz if the cached gamut is for dev_name. */
+static int read_session(
+char *sname,			/* Session file name */
+int res,				/* Clut resolution */
+int dorel,				/* White point relative */
+char *abs_name,			/* Abstract profile being refined */
+char *dev_name,			/* Output device profile, NULL if none */
+rspl **pr,				/* Return correction */
+int *devok				/* Return nz if gamut cache is valid */
+) {
+	cgats *icg;
+	sgrid sg;
+	int ti, i, e, fi[3];
+
+	*pr = NULL;
+	*devok = 0;
+
+	icg = new_cgats();
+	icg->add_other(icg, "REFINE");
+
+	if (icg->read_name(icg, sname)) {
+		icg->del(icg);
+		return 1;
+	}
+	if (icg->ntables < 1 || icg->t[0].tt != tt_other || icg->t[0].oi != 0
+	 || (ti = icg->find_kword(icg, 0, "CLUTRES")) < 0
+	 || atoi(icg->t[0].kdata[ti]) != res
+	 || (ti = icg->find_kword(icg, 0, "WHITE_RELATIVE")) < 0
+	 || (strcmp(icg->t[0].kdata[ti], "YES") == 0) != (dorel != 0)
+	 || icg->t[0].nsets != res * res * res) {
+		icg->del(icg);
+		return 1;
+	}
+
+	if (dev_name != NULL
+	 && (ti = icg->find_kword(icg, 0, "DEVICE_PROFILE")) >= 0
+	 && strcmp(icg->t[0].kdata[ti], dev_name) == 0)
+		*devok = 1;
+
+	if ((ti = icg->find_kword(icg, 0, "ABSTRACT_PROFILE")) >= 0
+	 && strcmp(icg->t[0].kdata[ti], abs_name) == 0) {
+
+		if ((fi[0] = icg->find_field(icg, 0, "LAB_L")) < 0
+		 || (fi[1] = icg->find_field(icg, 0, "LAB_A")) < 0
+		 || (fi[2] = icg->find_field(icg, 0, "LAB_B")) < 0) {
+			icg->del(icg);
+			return 1;
+		}
+
+		sg.res = res;
+		if ((sg.v = (double (*)[3])malloc(sizeof(double) * 3 * icg->t[0].nsets)) == NULL)
+			error("Malloc failed - session grid");
+		for (i = 0; i < icg->t[0].nsets; i++) {
+			for (e = 0; e < 3; e++)
+				sg.v[i][e] = *((double *)icg->t[0].fdata[i][fi[e]]);
+		}
+		*pr = new_sess_rspl(res, &sg, sgrid_set);
+		free(sg.v);
+	}
+	icg->del(icg);
+
+	return 0;
+}
+
+/* Write a session file holding the correction r applied by abs_name. */
+static void write_session(
+char *sname,			/* Session file name */
+int res,				/* Clut resolution */
+int dorel,				/* White point relative */
+char *abs_name,			/* Abstract profile written */
+char *dev_name,			/* Output device profile, NULL if none */
+rspl *r					/* Correction */
+) {
+	cgats *ocg;
+	sgrid sg;
+	char buf[50];
+	int i, n = res * res * res;
+
+	sg.res = res;
+	if ((sg.v = (double (*)[3])malloc(sizeof(double) * 3 * n)) == NULL)
+		error("Malloc failed - session grid");
+	r->scan_rspl(r, RSPL_NOFLAGS, &sg, sgrid_get);
+
+	ocg = new_cgats();
+	ocg->binary = 1;			/* Hold the values exactly */
+	ocg->add_other(ocg, "REFINE");
+	ocg->add_table(ocg, tt_other, 0);
+
+	ocg->add_kword(ocg, 0, "DESCRIPTOR", "Argyll refine session", NULL);
+	ocg->add_kword(ocg, 0, "ORIGINATOR", "Argyll refine", NULL);
+	sprintf(buf, "%d", res);
+	ocg->add_kword(ocg, 0, "CLUTRES", buf, NULL);
+	ocg->add_kword(ocg, 0, "WHITE_RELATIVE", dorel ? "YES" : "NO", NULL);
+	ocg->add_kword(ocg, 0, "ABSTRACT_PROFILE", abs_name, NULL);
+	if (dev_name != NULL)
+		ocg->add_kword(ocg, 0, "DEVICE_PROFILE", dev_name, NULL);
+
+	ocg->add_field(ocg, 0, "LAB_L", r_t);
+	ocg->add_field(ocg, 0, "LAB_A", r_t);
+	ocg->add_field(ocg, 0, "LAB_B", r_t);
+
+	for (i = 0; i < n; i++)
+		ocg->add_set(ocg, 0, sg.v[i][0], sg.v[i][1], sg.v[i][2]);
+
+	if (ocg->write_name(ocg, sname))
+		error("Write error to session file '%s' : %s",sname,ocg->err);
+
+	ocg->del(ocg);
+	free(sg.v);
+}
+
 int
 main(int argc, char *argv[]) {
 	int fa,nfa;				/* argument we're looking at */
@@ -267,6 +457,9 @@ main(int argc, char *argv[]) {
 	char dev_name[MAXNAMEL+1];	/* Output device ICC filename for gamut */
 	char rd_name[MAXNAMEL+1];	/* Abstract profile ICC to modify */
 	char wr_name[MAXNAMEL+1];	/* Modified/created abstract profile ICC */
+	char ses_name[MAXNAMEL+1] = "\000";	/* Session file, "" if none */
+	char gam_name[MAXNAMEL+5];	/* Session device gamut cache */
+	int ses_dev = 0;			/* Session gamut cache is valid */
 
 	int dorel = 0;				/* Do white point relative match */
 	int *match;					/* Array mapping first list indexes to corresponding second */
@@ -353,6 +546,12 @@ main(int argc, char *argv[]) {
 			else if (argv[fa][1] == 'R') {
 				dorel = 1;
 			}
+			/* Session file */
+			else if (argv[fa][1] == 'S') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -S");
+				strncpy(ses_name,na,MAXNAMEL); ses_name[MAXNAMEL] = '\000';
+			}
 
 			/* FWA compensation */
 			else if (argv[fa][1] == 'f') {
@@ -816,9 +1015,40 @@ main(int argc, char *argv[]) {
 		fprintf(verbo,"White patch assumed to be patch %s\n",cg[0].pat[whitepatch].sid);
 	}
 
+	/* ======================= */
+	/* Existing session state. A new session is started by -c */
+	cb.pr = NULL;
+	if (ses_name[0] != '\000') {
+		sprintf(gam_name, "%s.gam", ses_name);
+
+		if (docreate == 0) {
+			if (read_session(ses_name, clutres, dorel, rd_name, nogamut ? NULL : dev_name,
+			                 &cb.pr, &ses_dev) != 0) {
+				if (verb)
+					printf("No usable session in '%s', starting a new one\n",ses_name);
+			} else if (verb) {
+				if (cb.pr != NULL)
+					printf("Using the session correction for '%s'\n",rd_name);
+				else
+					printf("Session isn't for '%s', reading it\n",rd_name);
+			}
+		}
+	}
+
 	/* ======================= */
 	/* Possible limiting gamut */
-	if (nogamut == 0) {
+	cb.dev_gam = NULL;
+	if (nogamut == 0 && ses_dev) {
+		if ((cb.dev_gam = new_gamut(0.0, 0, 0)) == NULL)
+			error("Creation of gamut failed");
+
+		if (cb.dev_gam->read_gam(cb.dev_gam, gam_name) != 0) {
+			cb.dev_gam->del(cb.dev_gam);
+			cb.dev_gam = NULL;
+		} else if (verb)
+			printf("Read device gamut from session cache '%s'\n",gam_name);
+	}
+	if (nogamut == 0 && cb.dev_gam == NULL) {
 		icmFile *dev_fp;
 		icc *dev_icc;
 		xicc *dev_xicc;
@@ -867,17 +1097,20 @@ main(int argc, char *argv[]) {
 		if ((cb.dev_gam = dev_luo->get_gamut(dev_luo, GAMRES)) == NULL)
 			error ("%d, %s",dev_xicc->errc, dev_xicc->err);
 
+		/* Cache it for the following passes */
+		if (ses_name[0] != '\000' && cb.dev_gam->write_gam(cb.dev_gam, gam_name) != 0)
+			error("Writing session gamut cache '%s' failed",gam_name);
+
 		dev_luo->del(dev_luo);
 		dev_xicc->del(dev_xicc);
 		dev_icc->del(dev_icc);
 		dev_fp->del(dev_fp);
-	} else {
-		cb.dev_gam = NULL;
 	}
 
 	/* ======================= */
-	/* Open up the existing abstract profile that is to be refined. */
-	if (docreate == 0) {
+	/* Open up the existing abstract profile that is to be refined, */
+	/* unless we have its correction from the session. */
+	if (docreate == 0 && cb.pr == NULL) {
 		if ((rd_fp = new_icmFileStd_name(rd_name,"r")) == NULL)
 			error ("Can't open file '%s'",rd_name);
 	
@@ -935,14 +1168,14 @@ main(int argc, char *argv[]) {
 			printf("%d: Target        %f %f %f\n",i,rp[i].p[0],rp[i].p[1],rp[i].p[2]);
 #endif
 
-			damp = cb.rd_luo != NULL ? damp2 : damp1;
+			damp = docreate == 0 ? damp2 : damp1;
 			ccor[0] = ccor[1] = ccor[2] = 0.0;
 			cmag = 0.0;
 
 			/* Lookup the current correction applied to the target */
-			if (cb.rd_luo != NULL) {		/* Subsequent pass */
+			if (docreate == 0) {		/* Subsequent pass */
 				double corval[3];
-				cb.rd_luo->lookup(cb.rd_luo, corval, cg[0].pat[i].v);
+				prev_lookup(&cb, corval, cg[0].pat[i].v);
 				icmSub3(ccor, corval, cg[0].pat[i].v);
 				cmag = icmNorm3(ccor);
 #ifdef DEBUG1
@@ -956,7 +1189,7 @@ main(int argc, char *argv[]) {
 
 			/* If a first pass and the target or the correction are out of gamut, */
 			/* use a damping factor of 1.0 */
-			if (cb.rd_luo == NULL
+			if (docreate != 0
 			 && cb.dev_gam != NULL
 			 && cb.dev_gam->nradial(cb.dev_gam, temp, rp[i].p) > 1.0
 			 && cb.dev_gam->nradial(cb.dev_gam, temp, rp[i].v) > 1.0) {
@@ -979,7 +1212,7 @@ main(int argc, char *argv[]) {
 
 			/* If this is not the first pass, limit the new correction */
 			/* to be 1 + damp as big as the previous correction */
-			if (cb.rd_luo != NULL) {
+			if (docreate == 0) {
 				if ((nmag/cmag) > (1.0 + damp2)) {
 #ifdef DEBUG1
 					printf("%d: Limited cor mag from %f to %f\n",i, nmag, (1.0 + damp2) * cmag);
@@ -995,7 +1228,7 @@ main(int argc, char *argv[]) {
 			/* If the target point or corrected point is likely to be outside */
 			/* the gamut, limit the magnitude of the correction to be the same */
 			/* as the previous correction. */ 
-			if (cb.rd_luo != NULL && cb.dev_gam != NULL) {
+			if (docreate == 0 && cb.dev_gam != NULL) {
 				if (cb.dev_gam->nradial(cb.dev_gam, temp, rp[i].p) > 1.0
 				 || cb.dev_gam->nradial(cb.dev_gam, temp, rp[i].v) > 1.0) {
 #ifdef DEBUG1
@@ -1084,8 +1317,8 @@ main(int argc, char *argv[]) {
 				corrdelt = icmNorm3(corrdel);
 				fprintf(lf,"CorrDelta  %f %f %f (%f)\n", corrdel[0], corrdel[1], corrdel[2], corrdelt);
 				/* Note the previous correction we're compunded with */
-				if (cb.rd_luo != NULL) {
-					cb.rd_luo->lookup(cb.rd_luo, pcval, cg[0].pat[i].v);
+				if (docreate == 0) {
+					prev_lookup(&cb, pcval, cg[0].pat[i].v);
 					icmSub3(pcorrdel, pcval, cg[0].pat[i].v);
 					pcorrdelt = icmNorm3(pcorrdel);
 					fprintf(lf,"PrevCorrDelta %f %f %f (%f)\n", pcorrdel[0], pcorrdel[1], pcorrdel[2], pcorrdelt);
@@ -1111,7 +1344,8 @@ main(int argc, char *argv[]) {
 
 		cb.r->fit_rspl_w_df(cb.r,
 		           RSPLFLAGS			/* Extra flags */
-		           | verb ? RSPL_VERBOSE : 0,
+		           | RSPL_MTHREAD		/* Fit the output planes in parallel */
+		           | (verb ? RSPL_VERBOSE : 0),
 		           rp,					/* Test points */
 		           npnts,				/* Number of test points */
 		           mn, mx, gres,		/* Low, high, resolution of grid */
@@ -1242,7 +1476,7 @@ main(int argc, char *argv[]) {
 
 #ifdef COMPLOOKUP
 		/* Compound with previous correction */
-		if (cb.rd_luo != NULL)
+		if (docreate == 0)
 			flags = ICM_CLUT_SET_APXLS;	/* Won't be least squares, so do extra sampling */
 #endif
 
@@ -1272,6 +1506,17 @@ main(int argc, char *argv[]) {
 	/* Write the file out */
 	if ((rv = wr_icc->write(wr_icc,wr_fp,0)) != 0)
 		error ("Write file: %d, %s",rv,wr_icc->err);
+
+	/* Save the complete correction for the next pass */
+	if (ses_name[0] != '\000') {
+		rspl *nr;
+
+		nr = new_sess_rspl(clutres, &cb, correct);
+		write_session(ses_name, clutres, dorel, wr_name, nogamut ? NULL : dev_name, nr);
+		nr->del(nr);
+		if (verb)
+			printf("Wrote session '%s'\n",ses_name);
+	}
 	
 	/* ======================================= */
 	
@@ -1279,11 +1524,13 @@ main(int argc, char *argv[]) {
 	wr_icc->del(wr_icc);
 	wr_fp->del(wr_fp);
 
-	if (docreate == 0) {
+	if (cb.rd_luo != NULL) {
 		cb.rd_luo->del(cb.rd_luo);
 		rd_icc->del(rd_icc);
 		rd_fp->del(rd_fp);
 	}
+	if (cb.pr != NULL)
+		cb.pr->del(cb.pr);
 
 	if (nogamut == 0) {
 		cb.dev_gam->del(cb.dev_gam);
@@ -866,6 +866,175 @@ ucmm_error ucmm_uninstall_monitor_profile(
 	return ucmm_ok;
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Looking up the profile of each display means parsing the (locked) */
+/* user and local system config files each time. To save doing this */
+/* for every display, the display records of each config file are kept */
+/* in memory, and re-read only if the file has changed since. */
+
+/* A display record */
+typedef struct {
+	char *mname;			/* Key to match to, "EDID" or "NAME" */
+	char *mval;				/* Value to match */
+	int recno;				/* Record number it was found in */
+	char *profile;			/* Profile path, NULL if none */
+	int perr;				/* nz if ICC_PROFILE isn't a string */
+} ucmm_crec;
+
+/* The display records of a config file */
+typedef struct {
+	char *fname;			/* Config file path, NULL if not valid */
+	dev_t dev;				/* File identity when it was read */
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+	time_t rtime;			/* Time it was read */
+	int nrecs;
+	ucmm_crec *recs;
+} ucmm_ccache;
+
+static ucmm_ccache ucmm_cache[2];		/* User and local system scope */
+
+static void ucmm_free_ccache(ucmm_ccache *c) {
+	int i;
+
+	for (i = 0; i < c->nrecs; i++) {
+		free(c->recs[i].mname);
+		free(c->recs[i].mval);
+		free(c->recs[i].profile);
+	}
+	free(c->recs);
+	free(c->fname);
+	c->fname = NULL;
+	c->nrecs = 0;
+	c->recs = NULL;
+}
+
+/* Load the display records of the given config file into the cache, */
+/* unless it is already loaded and the file hasn't changed. */
+/* Return ucmm_no_profile if the file can't be opened. */
+static ucmm_error ucmm_load_ccache(ucmm_ccache *c, char *conf_name) {
+	struct stat sbuf;
+	jcnf *jc;
+	jc_error ev;
+	int ix, i;
+	int recno = -1;			/* Number of the last record read */
+	char *key, *pp;
+	jc_type type;
+	unsigned char *data;
+	size_t dataSize;
+
+	if (stat(conf_name, &sbuf) != 0) {
+		ucmm_free_ccache(c);
+		return ucmm_no_profile;
+	}
+
+	/* If it is the same file, and it was last changed at least a second */
+	/* before we read it (so that a change in the same second as */
+	/* the read can't have been missed), we can use what we read. */
+	if (c->fname != NULL
+	 && strcmp(c->fname, conf_name) == 0
+	 && sbuf.st_dev == c->dev
+	 && sbuf.st_ino == c->ino
+	 && sbuf.st_size == c->size
+	 && sbuf.st_mtime == c->mtime
+	 && c->mtime < c->rtime) {
+		debug2((errout,"Using cached records of '%s'\n",conf_name));
+		return ucmm_ok;
+	}
+	ucmm_free_ccache(c);
+
+	if ((jc = new_jcnf(&ev, conf_name, jc_read, jc_no_create)) == NULL) {
+		debug2((errout,"new_jcnf '%s' failed with error %d\n",conf_name,ev));
+		return ucmm_no_profile;
+	}
+
+	/* Collect the records in order, the same way ucmm_get_monitor_config() */
+	/* searches them. */
+	for (ix = 0;;ix++) {
+		int ii;
+		ucmm_crec *nrecs;
+
+		if ((ev = jc->locate_key(jc, &ix, "devices/display/", 0, 0)) != jc_ok
+		 || (ev = jc->get_key(jc, ix, &key, &type, &data, &dataSize, NULL)) != jc_ok) {
+			if (ev == jc_ix_oorange)
+				break;
+			debug2((errout,"jcnf locate/get_key failed with error %d\n",ev));
+			jc->del(jc);
+			ucmm_free_ccache(c);
+			return ucmm_open_config;
+		}
+
+		if ((pp = jc_get_nth_elem(key, 2)) == NULL)
+			continue;
+		if ((ii = atoi(pp)) == 0) {
+			free(pp);
+			continue;
+		}
+		free(pp);
+		if (ii > recno)
+			recno = ii;
+
+		if ((pp = jc_get_nth_elem(key, 3)) == NULL)
+			continue;
+		if (type != jc_string
+		 || (strcmp(pp, "EDID") != 0 && strcmp(pp, "NAME") != 0)) {
+			free(pp);
+			continue;
+		}
+
+		if ((nrecs = (ucmm_crec *)realloc(c->recs, (c->nrecs+1) * sizeof(ucmm_crec))) == NULL) {
+			free(pp);
+			jc->del(jc);
+			ucmm_free_ccache(c);
+			return ucmm_resource;
+		}
+		c->recs = nrecs;
+		memset(&c->recs[c->nrecs], 0, sizeof(ucmm_crec));
+		c->recs[c->nrecs].mname = pp;
+		c->recs[c->nrecs].recno = recno;
+		if ((c->recs[c->nrecs++].mval = strdup((char *)data)) == NULL) {
+			jc->del(jc);
+			ucmm_free_ccache(c);
+			return ucmm_resource;
+		}
+	}
+
+	/* Get the profile path of each record */
+	for (i = 0; i < c->nrecs; i++) {
+		char keyn1[100];
+
+		sprintf(keyn1, "devices/display/%d/ICC_PROFILE", c->recs[i].recno);
+		key = keyn1;
+		if ((ev = jc->get_key(jc, -1, &key, &type, &data, &dataSize, NULL)) != jc_ok
+		 || type != jc_string) {
+			if (ev != jc_ix_oorange)
+				c->recs[i].perr = 1;
+			continue;
+		}
+		if ((c->recs[i].profile = strdup((char *)data)) == NULL) {
+			jc->del(jc);
+			ucmm_free_ccache(c);
+			return ucmm_resource;
+		}
+	}
+	jc->del(jc);
+
+	if ((c->fname = strdup(conf_name)) == NULL) {
+		ucmm_free_ccache(c);
+		return ucmm_resource;
+	}
+	c->dev = sbuf.st_dev;
+	c->ino = sbuf.st_ino;
+	c->size = sbuf.st_size;
+	c->mtime = sbuf.st_mtime;
+	c->rtime = time(NULL);
+
+	debug2((errout,"Cached %d records of '%s'\n",c->nrecs,conf_name));
+
+	return ucmm_ok;
+}
+
 /* Get an associated monitor profile. */
 /* Return ucmm_no_profile if there is no installed profile for this */
 /* monitor. */
@@ -877,30 +1046,92 @@ ucmm_error ucmm_get_monitor_profile(
 	char **profile		    /* Return path to profile. free() afterwards. */
 ) {
 	unsigned int edid_hash = 0;
-	jcnf *jc = NULL;
-	int recno;
+	char *config_file = "color.jcnf";
+	char *mname;			/* Name of key to match to */
+	char *mval;				/* Value to match */
+	int scope, i;
 	ucmm_error ev = ucmm_ok;
 
+	*profile = NULL;		/* In case of failure */
+
 	if (edid != NULL)
 		edid_hash = fnv_32_buf(edid, edid_len);
 
 	debug2((errout,"ucmm_get_monitor_profile called with edid hash 0x%x, disp '%s'\n",edid_hash,display_name));
 
-	/* Locate the config record containing the config file entry. */
-	/* (ucmm_user is ignored for jc_read) */
-	if ((ev = ucmm_get_monitor_config(profile, &recno, &jc, edid, edid_len, display_name,
-		                                                 jc_read, ucmm_user)) != ucmm_ok) {
-		return ev;
+	/* if EDID supplied, Locate a matching EDID */
+	if (edid != NULL) {
+		mname = "EDID";
+		if ((mval = buf2hex(edid, edid_len)) == NULL)
+			return ucmm_resource;
+
+	/* Else fall back to X11 display name and screen */
+	} else {
+		if (display_name == NULL)
+			return ucmm_no_edid_or_display;
+		mname = "NAME";
+		if ((mval = strdup(display_name)) == NULL)
+			return ucmm_resource;
 	}
 
-	debug2((errout,"config file = '%s'\n",jc->fname));
-	
-	/* We're done with this */
-	jc->del(jc);
+	/* Look at user then local system scope */
+	for (scope = 0; scope <= 1; scope++) {
+		ucmm_ccache *c = &ucmm_cache[scope];
+		char *conf_name;
+		int npaths;
+		xdg_error er;
+		char **paths;
+
+		if ((npaths = xdg_bds(&er, &paths, xdg_conf, xdg_write, 
+		                     scope == 0 ? xdg_user : xdg_local,
+		                     xdg_none,
+		                     config_file)) == 0) {
+			debug2((errout," xdg_bds returned no paths\n"));
+			continue;
+		}
+		if ((conf_name = strdup(paths[0])) == NULL) {
+			xdg_free(paths, npaths);
+			free(mval);
+			return ucmm_resource;
+		}
+		xdg_free(paths, npaths);
 
-	debug2((errout,"Returning current profile '%s'\n",*profile));
+		ev = ucmm_load_ccache(c, conf_name);
+		free(conf_name);
+		if (ev == ucmm_no_profile)
+			continue;			/* Try the next scope */
+		if (ev != ucmm_ok) {
+			free(mval);
+			return ev;
+		}
 
-	return ucmm_ok;
+		for (i = 0; i < c->nrecs; i++) {
+			if (strcmp(c->recs[i].mname, mname) == 0
+			 && strcmp(c->recs[i].mval, mval) == 0)
+				break;
+		}
+		if (i >= c->nrecs) {
+			debug2((errout,"No matching display was found\n"));
+			continue;			/* On to the next scope */
+		}
+		if (c->recs[i].perr) {
+			free(mval);
+			return ucmm_access_config;
+		}
+		if (c->recs[i].profile == NULL)
+			continue;			/* try the next config */
+
+		free(mval);
+		if ((*profile = strdup(c->recs[i].profile)) == NULL)
+			return ucmm_resource;
+
+		debug2((errout,"Returning current profile '%s'\n",*profile));
+		return ucmm_ok;
+	}
+	free(mval);
+	debug2((errout,"Failed to find a current profile\n"));
+
+	return ucmm_no_profile; 
 }
 	
 
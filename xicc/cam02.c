@@ -200,6 +200,10 @@ static int set_view(struct _cam02 *s, ViewingCondition Ev, double Wxyz[3],
 					int hk, double hkscale, double mtaf, double Wxyz2[3]);
 static int XYZ_to_cam(struct _cam02 *s, double *Jab, double *xyz);
 static int cam_to_XYZ(struct _cam02 *s, double *xyz, double *Jab);
+static int XYZ_to_cam_n(struct _cam02 *s, double *Jab, double *xyz, int n, int fast);
+static int cam_to_XYZ_n(struct _cam02 *s, double *xyz, double *Jab, int n, int fast);
+static int set_lut(struct _cam02 *s, int res, double tol);
+static void free_lut(struct _cam02 *s);
 
 static double spow(double val, double pp) {
 	if (val < 0.0)
@@ -208,6 +212,45 @@ static double spow(double val, double pp) {
 		return pow(val, pp);
 }
 
+#define CAM02_LN2 0.69314718055994530942	/* log(2.0) */
+
+/* Fast pow() for the fast conversions. This uses a table of */
+/* 1/c and log(c) to reduce log(x) to log(1+r), |r| < 1/256, and a table */
+/* of 2^(j/128) to reduce exp(t) to exp(r), |r| < ln(2)/256, so that */
+/* short polynomials are accurate. The relative error is less than 1e-13. */
+/* (pow() is used for x <= 0 and for results near the double range limits.) */
+static double fpow(cam02 *s, double x, double y) {
+	union { double d; ORD64 u; } v;
+	int ex, i, ki;
+	double r, l, t, p;
+
+	if (x <= 0.0)
+		return pow(x, y);
+
+	v.d = x;
+	ex = (int)(v.u >> 52) - 1023;
+	i = (int)(v.u >> (52 - CAM02_FPBITS)) & ((1 << CAM02_FPBITS)-1);
+	v.u = (v.u & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL;	/* 1.0 <= v.d < 2.0 */
+	r = v.d * s->fp_ic[i] - 1.0;
+	l = ((((0.2 * r - 0.25) * r + 1.0/3.0) * r - 0.5) * r + 1.0) * r;
+	l += s->fp_lc[i] + ex * CAM02_LN2;
+
+	t = y * l;
+	if (t < -700.0 || t > 700.0)
+		return pow(x, y);
+
+	t *= (1 << CAM02_FPBITS)/CAM02_LN2;
+	v.d = t + 6755399441055744.0;			/* Round to nearest integer */
+	ki = (int)(v.u & 0xffffffff);
+	r = (t - (v.d - 6755399441055744.0)) * (CAM02_LN2/(1 << CAM02_FPBITS));
+	p = ((((r * (1.0/120.0) + 1.0/24.0) * r + 1.0/6.0) * r + 0.5) * r + 1.0) * r + 1.0;
+	v.u = (ORD64)((ki >> CAM02_FPBITS) + 1023) << 52;
+	return p * s->fp_e2[ki & ((1 << CAM02_FPBITS)-1)] * v.d;
+}
+
+/* pow() for the conversion kernels */
+#define CPOW(xx, yy) (fast ? fpow(s, xx, yy) : pow(xx, yy))
+
 /* Create a cam02 conversion object, with default viewing conditions */
 cam02 *new_cam02(void) {
 	cam02 *s;
@@ -223,10 +266,24 @@ cam02 *new_cam02(void) {
 	s->set_view = set_view;
 	s->XYZ_to_cam = XYZ_to_cam;
 	s->cam_to_XYZ = cam_to_XYZ;
+	s->XYZ_to_cam_n = XYZ_to_cam_n;
+	s->cam_to_XYZ_n = cam_to_XYZ_n;
+	s->set_lut = set_lut;
 
 	/* Initialise default parameters */
 	s->hkscale = 1.0;
 
+	/* Fast pow() tables */
+	{
+		int i;
+		for (i = 0; i < (1 << CAM02_FPBITS); i++) {
+			double c = 1.0 + (i + 0.5)/(1 << CAM02_FPBITS);
+			s->fp_ic[i] = 1.0/c;
+			s->fp_lc[i] = log(c);
+			s->fp_e2[i] = pow(2.0, (double)i/(1 << CAM02_FPBITS));
+		}
+	}
+
 	/* Set default range handling limits */
 	s->nldlimit = NLDLIMIT;
 	s->nldicept = NLDICEPT;
@@ -274,8 +331,10 @@ static void cam_free(cam02 *s) {
 	}
 #endif /* TRACKMINMAX */
 
-	if (s != NULL)
+	if (s != NULL) {
+		free_lut(s);
 		free(s);
+	}
 }
 
 /* Return value is always 0 */
@@ -300,6 +359,8 @@ double Wxyz2[3] /* Mid tone Adapted White XYZ (Y range 0.0 .. 1.0) */
 	double tm[3][3];
 	int i;
 
+	free_lut(s);		/* Any tables are now invalid */
+
 	if (Ev == vc_none) {
 		/* Compute the internal parameters from the */
 		/* ratio of La to Lv by interpolation */
@@ -566,6 +627,7 @@ double Wxyz2[3] /* Mid tone Adapted White XYZ (Y range 0.0 .. 1.0) */
 	/* Background induction factor */
 	s->n = s->Yb/ s->Wxyz[1];
 	s->nn = pow(1.64 - pow(0.29, s->n), 0.73);	/* Pre computed value */
+	s->nnp = pow(s->nn, 1.0/0.9);
 
 	/* Lightness contrast factor ?? */
 	{
@@ -656,11 +718,12 @@ double Wxyz2[3] /* Mid tone Adapted White XYZ (Y range 0.0 .. 1.0) */
 	return 0;
 }
 
-/* Conversions. Return values are always 0 */
-static int XYZ_to_cam(
+/* Conversion kernels. If fast is nz, use fpow() */
+static int XYZ_to_cam_imp(
 struct _cam02 *s,
 double Jab[3],
-double XYZ[3]
+double XYZ[3],
+int fast
 ) {
 	int i;
 	double xyz[3], rgbp[3], rgba[3];
@@ -713,7 +776,7 @@ double XYZ[3]
 			t = 0.0;
 		else if (t > 1.0)
 			t = 1.0;
-		t = pow(t, s->mtap);
+		t = CPOW(t, s->mtap);
 //printf("Blend %f from %f %f %f and %f %f %f\n",t, rgbp2[0], rgbp2[1], rgbp2[2], rgbp[0], rgbp[1], rgbp[2]);
 		icmBlend3(rgbp, rgbp2, rgbp, t);
 	}
@@ -768,7 +831,7 @@ double XYZ[3]
 			TRACE(("isec %f %f %f\n", isec[0], isec[1], isec[2]))
 
 			/* Compute distance from intersection to origin */
-			offs = pow(icmNorm3(isec), 0.85);
+			offs = CPOW(icmNorm3(isec), 0.85);
 
 			range = s->crange[i] * offs;	/* Scale range by distance to origin */
 			if (range > BC_MAXRANGE)		/* so that it tapers down as we approach it */
@@ -808,7 +871,7 @@ double XYZ[3]
 	} else {
 		ss = (rgbp[2]/ss - 1.0/3.0) * 3.0/2.0;
 		if (ss > 0.0)
-			ss = BLUE_BL_MAX * pow(ss, BLUE_BL_POW);
+			ss = BLUE_BL_MAX * CPOW(ss, BLUE_BL_POW);
 	}
 	if (ss < 0.0)
 		ss = 0.0;
@@ -836,7 +899,7 @@ double XYZ[3]
 			rgba[i] = s->nldxval + s->nldxslope * (rgbp[i] - s->nldlimit);
 		} else {
 			if (rgbp[i] <= s->nlulimit) {
-				tt = pow(s->Fl * rgbp[i], 0.42);
+				tt = CPOW(s->Fl * rgbp[i], 0.42);
 				rgba[i] = 400.0 * tt / (tt + 27.13) + 0.1;
 			} else {
 				rgba[i] = s->nluxval + s->nluxslope * (rgbp[i] - s->nlulimit);
@@ -881,23 +944,23 @@ double XYZ[3]
 	/* Cuttover to a straight line segment when J < 0.005, */
 #ifndef SYMETRICJ		/* Cut to a straight line */
 	if (A >= s->lA) {
-		J = pow(A/s->Aw, s->C * s->z);		/* J/100  - keep Sign */
+		J = CPOW(A/s->Aw, s->C * s->z);		/* J/100  - keep Sign */
 	} else {
 		J = s->jlimit/s->lA * A;			/* Straight line */
 		TRACE(("limited Acromatic to straight line\n"))
 	}
 #else			/* Symetric */
 	if (A >= 0.0) {
-		J = pow(A/s->Aw, s->C * s->z);		/* J/100  - keep Sign */
+		J = CPOW(A/s->Aw, s->C * s->z);		/* J/100  - keep Sign */
 	} else {
-		J = -pow(-A/s->Aw, s->C * s->z);		/* J/100  - keep Sign */
+		J = -CPOW(-A/s->Aw, s->C * s->z);		/* J/100  - keep Sign */
 		TRACE(("symetric Acromatic\n"))
 	}
 #endif
 
 	/* Constrained (+ve, non-zero) J */
 	if (A > 0.0) {
-		cJ = pow(A/s->Aw, s->C * s->z);
+		cJ = CPOW(A/s->Aw, s->C * s->z);
 		if (cJ < s->ssmincj)
 			cJ = s->ssmincj;
 	} else {
@@ -914,8 +977,8 @@ double XYZ[3]
 	e = (12500.0/13.0 * s->Nc * s->Ncb * (cos(h * DBL_PI/180.0 + 2.0) + 3.8));
 
 	/* ab scale components */
-	k1 = pow(s->nn, 1.0/0.9) * e * pow(cJ, 1.0/1.8)/pow(rS, 1.0/9.0);
-	k2 = pow(cJ, 1.0/(s->C * s->z)) * s->Aw/s->Nbb + 0.305;
+	k1 = s->nnp * e * CPOW(cJ, 1.0/1.8)/CPOW(rS, 1.0/9.0);
+	k2 = CPOW(cJ, 1.0/(s->C * s->z)) * s->Aw/s->Nbb + 0.305;
 	k3 = s->dcomp[1] * a + s->dcomp[2] * b;
 
 	TRACE(("Raw k1 = %f, k2 = %f, k3 = %f, raw ss = %f\n",k1, k2, k3, pow(k1/(k2 + k3), 0.9)))
@@ -979,12 +1042,12 @@ double XYZ[3]
 
 #ifdef DISABLE_TTD 
 
-	ss = pow((k1/k2), 0.9);
+	ss = CPOW((k1/k2), 0.9);
 
 #else	/* !TRACKMINMAX */
 
 	/* Compute the ab scale factor */
-	ss = pow(k1/(k2 + k3), 0.9);
+	ss = CPOW(k1/(k2 + k3), 0.9);
 
 #endif	/* !ENABLE_DDL */
 
@@ -1078,10 +1141,11 @@ double XYZ[3]
 	return 0;
 }
 
-static int cam_to_XYZ(
+static int cam_to_XYZ_imp(
 struct _cam02 *s,
 double XYZ[3],
-double Jab[3]
+double Jab[3],
+int fast
 ) {
 	int i;
 	double xyz[3], rgbp[3], rgba[3];
@@ -1138,16 +1202,16 @@ double Jab[3]
 	/* Achromatic response */
 #ifndef SYMETRICJ		/* Cut to a straight line */
 	if (J >= s->jlimit) {
-		A = pow(J, 1.0/(s->C * s->z)) * s->Aw;
+		A = CPOW(J, 1.0/(s->C * s->z)) * s->Aw;
 	} else {	/* In the straight line segment */
 		A = s->lA/s->jlimit * J;
 		TRACE(("Undo Acromatic straight line\n"))
 	}
 #else			/* Symetric */
 	if (J >= 0.0) {
-		A = pow(J, 1.0/(s->C * s->z)) * s->Aw;
+		A = CPOW(J, 1.0/(s->C * s->z)) * s->Aw;
 	} else {	/* In the straight line segment */
-		A = -pow(-J, 1.0/(s->C * s->z)) * s->Aw;
+		A = -CPOW(-J, 1.0/(s->C * s->z)) * s->Aw;
 		TRACE(("Undo symetric Acromatic\n"))
 	}
 #endif
@@ -1156,7 +1220,7 @@ double Jab[3]
 	ttA = (A/s->Nbb)+0.305;
 
 	if (A > 0.0) {
-		cJ = pow(A/s->Aw, s->C * s->z);
+		cJ = CPOW(A/s->Aw, s->C * s->z);
 		if (cJ < s->ssmincj)
 			cJ = s->ssmincj;
 	} else {
@@ -1168,8 +1232,8 @@ double Jab[3]
 	e = (12500.0/13.0 * s->Nc * s->Ncb * (cos(h * DBL_PI/180.0 + 2.0) + 3.8));
 
 	/* ab scale components */
-	k1 = pow(s->nn, 1.0/0.9) * e * pow(cJ, 1.0/1.8)/pow(rC, 1.0/9.0);
-	k2 = pow(cJ, 1.0/(s->C * s->z)) * s->Aw/s->Nbb + 0.305;
+	k1 = s->nnp * e * CPOW(cJ, 1.0/1.8)/CPOW(rC, 1.0/9.0);
+	k2 = CPOW(cJ, 1.0/(s->C * s->z)) * s->Aw/s->Nbb + 0.305;
 	k3 = s->dcomp[1] * ja + s->dcomp[2] * jb;
 
 	TRACE(("Raw k1 = %f, k2 = %f, k3 = %f, raw ss = %f\n",k1, k2, k3, (k1 - k3)/k2))
@@ -1250,7 +1314,7 @@ double Jab[3]
 			rgbp[i] = s->nldlimit + (rgba[i] - s->nldxval)/s->nldxslope;
 		} else if (rgba[i] <= s->nluxval) {
 			tt = rgba[i] - 0.1;
-			rgbp[i] = pow((27.13 * tt)/(400.0 - tt), 1.0/0.42)/s->Fl;
+			rgbp[i] = CPOW((27.13 * tt)/(400.0 - tt), 1.0/0.42)/s->Fl;
 //			rgbp[i] = pow((27.13 * tt)/(400.0 - tt), 1.0/1.0)/s->Fl;
 		} else {
 			rgbp[i] = s->nlulimit + (rgba[i] - s->nluxval)/s->nluxslope;
@@ -1267,7 +1331,7 @@ double Jab[3]
 	else {
 		ss = (rgbp[2]/ss - 1.0/3.0) * 3.0/2.0;
 		if (ss > 0.0)
-			ss = BLUE_BL_MAX * pow(ss, BLUE_BL_POW);
+			ss = BLUE_BL_MAX * CPOW(ss, BLUE_BL_POW);
 	}
 	if (ss < 0.0)
 		ss = 0.0;
@@ -1329,7 +1393,7 @@ double Jab[3]
 			TRACE(("isec %f %f %f\n", isec[0], isec[1], isec[2]))
 
 			/* Compute distance from intersection to origin */
-			offs = pow(icmNorm3(isec), 0.85);
+			offs = CPOW(icmNorm3(isec), 0.85);
 
 			range = s->crange[i] * offs;	/* Scale range by distance to origin */
 			if (range > BC_MAXRANGE)		/* so that it tapers down as we approach it */
@@ -1389,7 +1453,7 @@ double Jab[3]
 			t = 0.0;
 		else if (t > 1.0)
 			t = 1.0;
-		t = pow(t, s->mtap);
+		t = CPOW(t, s->mtap);
 		icmBlend3(xyz, xyz2, xyz1, t);
 
 		/* Simple Newton itteration to more accurately invert */
@@ -1405,7 +1469,7 @@ double Jab[3]
 				t = 0.0;
 			else if (t > 1.0)
 				t = 1.0;
-			t = pow(t, s->mtap);
+			t = CPOW(t, s->mtap);
 			icmBlend3(rgbp0, rgbp2, rgbp1, t);
 
 			icmSub3(rgbd, rgbp, rgbp0);			/* Error to input value */
@@ -1450,3 +1514,328 @@ double Jab[3]
 	return 0;
 }
 
+/* ---------------------------------------------------------- */
+/* Table lookup acceleration. */
+
+#define LUT_FMAX 1.2		/* Forward table XYZ range is 0 .. LUT_FMAX * Wxyz */
+#define LUT_BJMAX 120.0		/* Backward table J range is 0 .. LUT_BJMAX */
+#define LUT_BABMAX 130.0	/* Backward table a,b range is -LUT_BABMAX .. LUT_BABMAX */
+
+/* Table lookup is not used if tracing or returning ss */
+#define USE_LUT(s) ((s)->lres != 0 && !(s)->trace && !(s)->retss)
+
+static void free_lut(cam02 *s) {
+	if (s->flut != NULL)
+		free(s->flut);
+	s->flut = NULL;
+	if (s->flok != NULL)
+		free(s->flok);
+	s->flok = NULL;
+	if (s->blut != NULL)
+		free(s->blut);
+	s->blut = NULL;
+	if (s->blok != NULL)
+		free(s->blok);
+	s->blok = NULL;
+	s->lres = 0;
+}
+
+/* Convert an XYZ value to a forward table grid coordinate. */
+/* The grid is in the signed square root of the (flare added) */
+/* cone response, to roughly linearise the conversion. */
+static void lut_fcoord(cam02 *s, double gc[3], double XYZ[3]) {
+	double xyz[3], rgbp[3];
+	int e;
+
+	for (e = 0; e < 3; e++)
+		xyz[e] = s->Fsc * XYZ[e] + s->Fsxyz[e];
+	icmMulBy3x3(rgbp, s->cc, xyz);
+	for (e = 0; e < 3; e++) {
+		double tt = rgbp[e]/s->rgbpW[e];
+		tt = tt < 0.0 ? -sqrt(-tt) : sqrt(tt);
+		gc[e] = (tt - s->fl_min[e]) * s->fl_sc[e] * (s->lres-1);
+	}
+}
+
+/* Forward table grid coordinate back to XYZ */
+static void lut_fxyz(cam02 *s, double XYZ[3], double gc[3]) {
+	double xyz[3], rgbp[3];
+	int e;
+
+	for (e = 0; e < 3; e++) {
+		double tt = gc[e]/((s->lres-1) * s->fl_sc[e]) + s->fl_min[e];
+		rgbp[e] = (tt < 0.0 ? -tt * tt : tt * tt) * s->rgbpW[e];
+	}
+	icmMulBy3x3(xyz, s->icc, rgbp);
+	for (e = 0; e < 3; e++)
+		XYZ[e] = (xyz[e] - s->Fsxyz[e]) * s->Fisc;
+}
+
+/* Convert a Jab value to a backward table grid coordinate */
+static void lut_bcoord(cam02 *s, double gc[3], double Jab[3]) {
+	int e;
+	for (e = 0; e < 3; e++)
+		gc[e] = (Jab[e] - s->bl_min[e]) * s->bl_sc[e] * (s->lres-1);
+}
+
+/* Backward table grid coordinate back to Jab */
+static void lut_bjab(cam02 *s, double Jab[3], double gc[3]) {
+	int e;
+	for (e = 0; e < 3; e++)
+		Jab[e] = gc[e]/((s->lres-1) * s->bl_sc[e]) + s->bl_min[e];
+}
+
+/* Trilinear interpolation of table tab at grid coordinate gc. */
+/* Return nz if gc is outside the table or the cell is not */
+/* within tolerance (ok == NULL to skip this check). */
+static int lut_interp(cam02 *s, double out[3], double (*tab)[3],
+                      unsigned char *ok, double gc[3]) {
+	int res = s->lres, res1 = s->lres-1;
+	int e, ix[3], ci;
+	double fr[3], w0, w1, w2, w3;
+	double *p000, *p001, *p010, *p011;
+	double *p100, *p101, *p110, *p111;
+
+	for (e = 0; e < 3; e++) {
+		if (!(gc[e] >= 0.0 && gc[e] <= (double)res1))	/* (Catches NaN too) */
+			return 1;
+		ix[e] = (int)gc[e];
+		if (ix[e] >= res1)
+			ix[e] = res1-1;
+		fr[e] = gc[e] - (double)ix[e];
+	}
+	if (ok != NULL) {
+		ci = (ix[0] * res1 + ix[1]) * res1 + ix[2];
+		if (!ok[ci])
+			return 1;
+	}
+	p000 = tab[(ix[0] * res + ix[1]) * res + ix[2]];
+	p001 = p000 + 3;
+	p010 = p000 + 3 * res;
+	p011 = p010 + 3;
+	p100 = p000 + 3 * res * res;
+	p101 = p100 + 3;
+	p110 = p100 + 3 * res;
+	p111 = p110 + 3;
+
+	w0 = (1.0 - fr[0]) * (1.0 - fr[1]);
+	w1 = (1.0 - fr[0]) * fr[1];
+	w2 = fr[0] * (1.0 - fr[1]);
+	w3 = fr[0] * fr[1];
+	for (e = 0; e < 3; e++) {
+		out[e] = (1.0 - fr[2]) * (w0 * p000[e] + w1 * p010[e] + w2 * p100[e] + w3 * p110[e])
+		       +        fr[2]  * (w0 * p001[e] + w1 * p011[e] + w2 * p101[e] + w3 * p111[e]);
+	}
+	return 0;
+}
+
+/* Return nz if the interpolation error of the forward (bwd == 0) */
+/* or backward (bwd != 0) table cell i,j,k is within tolerance. */
+/* The error is checked at the center of the cell and the centers */
+/* of its 8 sub-cells, against half the tolerance as a safety margin, */
+/* since the error may be larger elswhere within the cell. The */
+/* backward error is measured in Jab, by converting the interpolated */
+/* XYZ back. */
+static int lut_cellok(cam02 *s, int i, int j, int k, int bwd) {
+	int m, e;
+	double gc[3], XYZ[3], Jab[3], tv[3], ev[3], de;
+
+	for (m = 0; m < 9; m++) {
+		if (m == 8) {
+			gc[0] = i + 0.5;
+			gc[1] = j + 0.5;
+			gc[2] = k + 0.5;
+		} else {
+			gc[0] = i + ((m & 1) ? 0.75 : 0.25);
+			gc[1] = j + ((m & 2) ? 0.75 : 0.25);
+			gc[2] = k + ((m & 4) ? 0.75 : 0.25);
+		}
+		if (bwd) {
+			lut_bjab(s, Jab, gc);
+			lut_interp(s, tv, s->blut, NULL, gc);
+			XYZ_to_cam_imp(s, ev, tv, 0);
+			for (de = 0.0, e = 0; e < 3; e++)
+				de += (Jab[e] - ev[e]) * (Jab[e] - ev[e]);
+		} else {
+			lut_fxyz(s, XYZ, gc);
+			XYZ_to_cam_imp(s, ev, XYZ, 0);
+			lut_interp(s, tv, s->flut, NULL, gc);
+			for (de = 0.0, e = 0; e < 3; e++)
+				de += (tv[e] - ev[e]) * (tv[e] - ev[e]);
+		}
+		if (de > 0.25 * s->ltol * s->ltol)
+			return 0;
+	}
+	return 1;
+}
+
+/* Set up table lookup acceleration for the current viewing conditions, */
+/* res being the table resolution and tol the maximum interpolation */
+/* error allowed in Jab. Return nz on memory allocation error. */
+static int set_lut(cam02 *s, int res, double tol) {
+	int i, j, k, e, res1;
+	double gc[3], XYZ[3], Jab[3];
+
+	free_lut(s);
+
+	if (res < 2 || tol <= 0.0
+	 || s->pmta_en)				/* Grid assumes a single adaptation */
+		return 0;				/* Just disable */
+
+	res1 = res - 1;
+	if ((s->flut = (double (*)[3])malloc(sizeof(double) * 3 * res * res * res)) == NULL
+	 || (s->blut = (double (*)[3])malloc(sizeof(double) * 3 * res * res * res)) == NULL
+	 || (s->flok = (unsigned char *)malloc(res1 * res1 * res1)) == NULL
+	 || (s->blok = (unsigned char *)malloc(res1 * res1 * res1)) == NULL) {
+		free_lut(s);
+		return 1;
+	}
+	s->lres = res;
+	s->ltol = tol;
+
+	/* Forward table range is the XYZ 0 .. LUT_FMAX * Wxyz cube */
+	for (e = 0; e < 3; e++) {
+		s->fl_min[e] = 1e38;
+		s->fl_sc[e] = -1e38;		/* Maximum to begin with */
+	}
+	for (i = 0; i < 8; i++) {
+		double xyz[3], rgbp[3];
+
+		for (e = 0; e < 3; e++) {
+			XYZ[e] = (i & (1 << e)) ? LUT_FMAX * s->Wxyz[e] : 0.0;
+			xyz[e] = s->Fsc * XYZ[e] + s->Fsxyz[e];
+		}
+		icmMulBy3x3(rgbp, s->cc, xyz);
+		for (e = 0; e < 3; e++) {
+			double tt = rgbp[e]/s->rgbpW[e];
+			tt = tt < 0.0 ? -sqrt(-tt) : sqrt(tt);
+			if (tt < s->fl_min[e])
+				s->fl_min[e] = tt;
+			if (tt > s->fl_sc[e])
+				s->fl_sc[e] = tt;
+		}
+	}
+	for (e = 0; e < 3; e++)
+		s->fl_sc[e] = 1.0/(s->fl_sc[e] - s->fl_min[e]);
+
+	for (e = 0; e < 3; e++) {
+		s->bl_min[e] = e == 0 ? 0.0 : -LUT_BABMAX;
+		s->bl_sc[e] = 1.0/(e == 0 ? LUT_BJMAX : 2.0 * LUT_BABMAX);
+	}
+
+	/* Fill the grid points */
+	for (i = 0; i < res; i++) {
+		gc[0] = (double)i;
+		for (j = 0; j < res; j++) {
+			gc[1] = (double)j;
+			for (k = 0; k < res; k++) {
+				int ix = (i * res + j) * res + k;
+				gc[2] = (double)k;
+				lut_fxyz(s, XYZ, gc);
+				XYZ_to_cam_imp(s, s->flut[ix], XYZ, 0);
+				lut_bjab(s, Jab, gc);
+				cam_to_XYZ_imp(s, s->blut[ix], Jab, 0);
+			}
+		}
+	}
+
+	/* Mark the cells whose interpolation error is within tolerance */
+	for (i = 0; i < res1; i++) {
+		for (j = 0; j < res1; j++) {
+			for (k = 0; k < res1; k++) {
+				int ci = (i * res1 + j) * res1 + k;
+				s->flok[ci] = lut_cellok(s, i, j, k, 0);
+				s->blok[ci] = lut_cellok(s, i, j, k, 1);
+			}
+		}
+	}
+	return 0;
+}
+
+/* Forward lookup. Return nz if the exact conversion should be used */
+static int lut_fwd(cam02 *s, double Jab[3], double XYZ[3]) {
+	double gc[3];
+
+	lut_fcoord(s, gc, XYZ);
+	return lut_interp(s, Jab, s->flut, s->flok, gc);
+}
+
+/* Backward lookup. Return nz if the exact conversion should be used */
+static int lut_bwd(cam02 *s, double XYZ[3], double Jab[3]) {
+	double gc[3];
+
+	lut_bcoord(s, gc, Jab);
+	return lut_interp(s, XYZ, s->blut, s->blok, gc);
+}
+
+/* ---------------------------------------------------------- */
+
+/* Conversions. Return values are always 0 */
+static int XYZ_to_cam(
+struct _cam02 *s,
+double Jab[3],
+double XYZ[3]
+) {
+	if (USE_LUT(s) && lut_fwd(s, Jab, XYZ) == 0)
+		return 0;
+	return XYZ_to_cam_imp(s, Jab, XYZ, 0);
+}
+
+static int cam_to_XYZ(
+struct _cam02 *s,
+double XYZ[3],
+double Jab[3]
+) {
+	if (USE_LUT(s) && lut_bwd(s, XYZ, Jab) == 0)
+		return 0;
+	return cam_to_XYZ_imp(s, XYZ, Jab, 0);
+}
+
+/* Convert n values */
+static int XYZ_to_cam_n(
+struct _cam02 *s,
+double *Jab,
+double *XYZ,
+int n,
+int fast
+) {
+	int i;
+
+	if (USE_LUT(s)) {
+		for (i = 0; i < n; i++, Jab += 3, XYZ += 3) {
+			if (lut_fwd(s, Jab, XYZ) != 0)
+				XYZ_to_cam_imp(s, Jab, XYZ, fast);
+		}
+	} else if (fast) {
+		for (i = 0; i < n; i++, Jab += 3, XYZ += 3)
+			XYZ_to_cam_imp(s, Jab, XYZ, 1);
+	} else {
+		for (i = 0; i < n; i++, Jab += 3, XYZ += 3)
+			XYZ_to_cam_imp(s, Jab, XYZ, 0);
+	}
+	return 0;
+}
+
+static int cam_to_XYZ_n(
+struct _cam02 *s,
+double *XYZ,
+double *Jab,
+int n,
+int fast
+) {
+	int i;
+
+	if (USE_LUT(s)) {
+		for (i = 0; i < n; i++, XYZ += 3, Jab += 3) {
+			if (lut_bwd(s, XYZ, Jab) != 0)
+				cam_to_XYZ_imp(s, XYZ, Jab, fast);
+		}
+	} else if (fast) {
+		for (i = 0; i < n; i++, XYZ += 3, Jab += 3)
+			cam_to_XYZ_imp(s, XYZ, Jab, 1);
+	} else {
+		for (i = 0; i < n; i++, XYZ += 3, Jab += 3)
+			cam_to_XYZ_imp(s, XYZ, Jab, 0);
+	}
+	return 0;
+}
@@ -153,6 +153,24 @@ struct _cam02 {
 	int (*XYZ_to_cam)(struct _cam02 *s, double *out, double *in);
 	int (*cam_to_XYZ)(struct _cam02 *s, double *out, double *in);
 
+	/* Convert n values, in[] and out[] being n * 3 doubles. */
+	/* If fast is nz, use a faster pow() approximation (relative error */
+	/* < 1e-13), which gives results within about 1e-9 of the exact */
+	/* conversion. Return nz on error */
+	int (*XYZ_to_cam_n)(struct _cam02 *s, double *out, double *in, int n, int fast);
+	int (*cam_to_XYZ_n)(struct _cam02 *s, double *out, double *in, int n, int fast);
+
+	/* Enable table lookup acceleration of the conversions, for the current */
+	/* viewing conditions. res is the table resolution (ie. 65), and */
+	/* tol the maximum allowed interpolation error in Jab. The error of */
+	/* each table cell is estimated by sampling it, and values in cells */
+	/* that exceed tol, or are outside the table, use the full conversion. */
+	/* (The error can exceed tol near the CAM's internal limits, for */
+	/* very saturated imaginary colors.) Must be called after set_view(), */
+	/* which disables it. res < 2 or tol <= 0 disables. Not used with */
+	/* mid tone partial adaptation. Return nz on memory allocation error. */
+	int (*set_lut)(struct _cam02 *s, int res, double tol);
+
 /* Private: */
 	/* Scene parameters */
 	ViewingCondition Ev;	/* Enumerated Viewing Condition */
@@ -189,6 +207,7 @@ struct _cam02 {
 	double rgbpW[3];	/* Hunt-Pointer-Estevez cone response space white */
 	double n;			/* Background induction factor */
 	double nn;			/* Precomuted function of n */
+	double nnp;			/* pow(nn, 1.0/0.9) */
 	double Fl;			/* Lightness contrast factor ?? */
 	double Nbb;			/* Background brightness induction factors */
 	double Ncb;			/* Chromatic brightness induction factors */
@@ -201,6 +220,24 @@ struct _cam02 {
 	double nluxslope;	/* Non-linearity slope at upper crossover to linear */
 	double lA;			/* JLIMIT Limited A */
 
+	/* Fast pow() tables */
+#define CAM02_FPBITS 7
+	double fp_ic[1 << CAM02_FPBITS];	/* 1/c for each mantissa interval */
+	double fp_lc[1 << CAM02_FPBITS];	/* log(c) for each mantissa interval */
+	double fp_e2[1 << CAM02_FPBITS];	/* 2^(i/size) */
+
+	/* set_lut() tables */
+	int lres;			/* Table resolution, 0 if not enabled */
+	double ltol;		/* Table tolerance */
+	double fl_min[3];	/* Forward sqrt cone table minimum */
+	double fl_sc[3];	/* Forward sqrt cone to index scale */
+	double (*flut)[3];	/* Forward table, lres^3 Jab values */
+	unsigned char *flok;/* Forward table (lres-1)^3 cell within tol flags */
+	double bl_min[3];	/* Backward Jab table minimum */
+	double bl_sc[3];	/* Backward Jab to index scale */
+	double (*blut)[3];	/* Backward table, lres^3 XYZ values */
+	unsigned char *blok;/* Backward table (lres-1)^3 cell within tol flags */
+
 	/* Partial mid-tone adapation hack pre-computed values */
 	int pmta_en;		/* NZ if enabled */
 	double mtap;		/* Mid tone blend rate (power) between Wxyz and Wxyz2 */
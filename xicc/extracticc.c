@@ -31,6 +31,7 @@
 #include "copyright.h"
 #include "aconfig.h"
 #include "icc.h"
+#include "xutils.h"
 
 
 void usage(char *diag, ...) {
@@ -122,6 +123,27 @@ main(int argc, char *argv[]) {
     if (fa >= argc || argv[fa][0] == '-') usage("Missing output ICC profile");
     strncpy(out_name,argv[fa++],MAXNAMEL); out_name[MAXNAMEL] = '\000';
 
+	/* - - - - - - - - - - - - - - - */
+	/* First try reading the profile directly from the TIFF or JPEG headers */
+	if (read_embedded_icc_data(in_name, (unsigned char **)&buf, (unsigned int *)&size) == 0) {
+		if (verb)
+			printf("Found %d byte profile in '%s'\n",size,in_name);
+
+		if ((fp = new_icmFileStd_name(out_name, "w")) == NULL) {
+			error("unable to open output ICC profile '%s'",out_name);
+		}
+	
+		if (fp->write(fp, buf, 1, size) != size) {
+			error("error writing file '%s'",out_name);
+		}
+	
+		if (fp->del(fp) != 0) {
+			error("error closing file '%s'",out_name);
+		}
+		free(buf);
+		return 0;
+	}
+
 	/* - - - - - - - - - - - - - - - */
 	/* Open up input tiff file ready for reading */
 	/* Got arguments, so setup to process the file */
@@ -55,6 +55,8 @@ void usage(char *diag) {
 		fprintf(stderr,"Diagnostic: %s\n",diag);
 	fprintf(stderr," -v            Verbose\n");
 	fprintf(stderr," -d sres       Surface resolution details 1.0 - 50.0\n");
+	fprintf(stderr," -u            Only sample the device space surface (faster, assumes no fold-over)\n");
+	fprintf(stderr," -b nlod       Write a binary .gam file, with nlod coarser levels of detail\n");
 	fprintf(stderr," -w            emit %s %s file as well as CGATS .gam file\n",vrml_format(),vrml_ext());
 	fprintf(stderr," -n            Don't add %s axes or white/black point\n",vrml_format());
 	fprintf(stderr," -k            Add %s markers for prim. & sec. \"cusp\" points\n",vrml_format());
@@ -112,7 +114,9 @@ main(int argc, char *argv[]) {
 	int vrml = 0;
 	int doaxes = 1;
 	int docusps = 0;
+	int nlod = -1;				/* Binary .gam levels of detail, -1 = CGATS */
 	double gamres = GAMRES;		/* Surface resolution */
+	int surf = 0;				/* Only sample the device surface */
 	int special = 0;			/* Special surface plot */
 	int fl = 0;					/* luobj flags */
 	icxInk ink;					/* Ink parameters */
@@ -269,6 +273,10 @@ main(int argc, char *argv[]) {
 			else if (argv[fa][1] == 'k' || argv[fa][1] == 'K') {
 				docusps = 1;
 			}
+			/* Device surface only */
+			else if (argv[fa][1] == 'u' || argv[fa][1] == 'U') {
+				surf = 1;
+			}
 			/* Special */
 			else if (argv[fa][1] == 's' || argv[fa][1] == 'S') {
 				special = 1;
@@ -296,6 +304,15 @@ main(int argc, char *argv[]) {
 					usage("Parameter after flag -d seems out of range");
 			}
 
+			/* Binary gamut file */
+			else if (argv[fa][1] == 'b' || argv[fa][1] == 'B') {
+				fa = nfa;
+				if (na == NULL) usage("No parameter after flag -b");
+				nlod = atoi(na);
+				if (nlod < 0 || nlod > 8)
+					usage("Parameter after flag -b seems out of range");
+			}
+
 			/* Expand gamut cylindrically */
 			else if (argv[fa][1] == 'x') {
 				double rr;
@@ -508,6 +525,9 @@ main(int argc, char *argv[]) {
 
 	fl |= ICX_CLIP_NEAREST;		/* Don't setup rev uncessarily */
 
+	if (surf)
+		fl |= ICX_GAMUT_SURF;
+
 #ifdef USE_CAM_CLIP_OPT
 	 fl |= ICX_CAM_CLIP;
 #endif
@@ -553,7 +573,10 @@ main(int argc, char *argv[]) {
 			gam = xgam;
 		}
 
-		if (gam->write_gam(gam, out_name))
+		if (nlod >= 0) {
+			if (gam->write_bgam(gam, out_name, nlod))
+				error ("write gamut failed on '%s'",out_name);
+		} else if (gam->write_gam(gam, out_name))
 			error ("write gamut failed on '%s'",out_name);
 
 		if (vrml) {
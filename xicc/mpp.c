@@ -103,6 +103,9 @@
 #define SHAPE_PMW 10.0	/* Shape parameter (wiggle) minimisation weight */
 #define COMB_PMW 0.008	/* Primary combination anchor point distance weight */
 
+#define MPP_PBLK 128	/* Test point block size for parallel sums */
+#define MPP_BCHUNK 16	/* Bands evaluated together by bandvals() */
+
 #define verbo stdout
 
 #include <stdio.h>
@@ -130,6 +133,7 @@
 
 /* Forward declarations */
 static double bandval(mpp *p, int band, double *dev);
+static void bandvals(mpp *p, double *ov, int sb, int eb, double *dev);
 static double dbandval(mpp *p, double *dv, int band, double *dev);
 static void forward(mpp *p, double *spec, double *Lab, double *XYZ, double *dev);
 static int create(mpp *p, int verb, int quality, int display, double limit, inkmask devmask,
@@ -770,6 +774,80 @@ double *in					/* Input device values */
 	}
 }
 
+/* lookup_n() context */
+typedef struct {
+	mpp *p;
+	double *out;			/* npix * 3 XYZ or Lab */
+	double *in;				/* npix * n device values */
+	double *spec;			/* npix * spec_n spectral values if spc != NULL */
+} lookup_n_cntx;
+
+/* Evaluate the model for colors i0 .. i1-1 */
+static int lookup_n_thread(void *cntx, int i0, int i1, int thix) {
+	lookup_n_cntx *cx = (lookup_n_cntx *)cntx;
+	mpp *p = cx->p;
+	int i, j;
+
+	for (i = i0; i < i1; i++) {
+		double *in = cx->in + i * p->n;
+
+		if (p->spc == NULL) {
+			double *out = cx->out + i * 3;
+
+			if (p->pcs == icSigLabData)
+				forward(p, NULL, out, NULL, in);
+			else
+				forward(p, NULL, NULL, out, in);
+		} else {
+			double *spec = cx->spec + i * p->spec_n;
+
+			forward(p, spec, NULL, NULL, in);
+			for (j = 0; j < p->spec_n; j++)
+				spec[j] *= p->norm;
+		}
+	}
+	return 0;
+}
+
+/* Lookup npix XYZ or Lab colors */
+static void lookup_n(
+mpp *p,						/* This */
+double *out,				/* Returned npix * 3 XYZ or Lab */
+double *in,					/* Input npix * n device values */
+int npix					/* Number of colors */
+) {
+	lookup_n_cntx cx;
+
+	cx.p = p;
+	cx.out = out;
+	cx.in = in;
+	cx.spec = NULL;
+
+	if (p->spc != NULL) {
+		if ((cx.spec = (double *)malloc(sizeof(double) * npix * p->spec_n)) == NULL) {
+			/* Fall back to one at a time */
+			int i;
+			for (i = 0; i < npix; i++)
+				lookup(p, out + i * 3, in + i * p->n);
+			return;
+		}
+	}
+
+	par_for(p->nthreads, 0, npix, 0, lookup_n_thread, (void *)&cx);
+
+	/* Convert the spectra to CIE */
+	if (p->spc != NULL) {
+		xspect sp;
+
+		sp.norm = p->norm; 
+		sp.spec_n = p->spec_n; 
+		sp.spec_wl_short = p->spec_wl_short; 
+		sp.spec_wl_long = p->spec_wl_long; 
+		p->spc->convert_n(p->spc, out, &sp, cx.spec, npix);
+		free(cx.spec);
+	}
+}
+
 /* Lookup an XYZ or Lab color, plus the partial derivative. */
 /* This is useful if the lookup is being used within */
 /* a minimisation routine */
@@ -1134,6 +1212,8 @@ static void del_mpp(mpp *p) {
 		del_mppcol(&p->black, p->n, p->spec_n);	
 		del_mppcol(&p->kblack, p->n, p->spec_n);	
 		del_mppcols(p->cols, p->nodp, p->n, p->spec_n);	/* Delete array of target points */
+		free(p->brv);
+		free(p->bdv);
 		if (p->spc != NULL)
 			p->spc->del(p->spc);
 
@@ -1155,6 +1235,12 @@ static void del_mpp(mpp *p) {
 	}
 }
 
+/* Set the number of threads used to fit the model */
+static void set_threads(mpp *p, int nthreads, int bandpar) {
+	p->nthreads = nthreads;
+	p->bandpar = bandpar;
+}
+
 /* Allocate a new, uninitialised mpp */
 /* Note thate black and white points aren't allocated */
 mpp *new_mpp(void) {
@@ -1175,9 +1261,11 @@ mpp *new_mpp(void) {
 	p->set_ilob    = set_ilob;
 	p->get_wb      = get_wb;
 	p->lookup      = lookup;
+	p->lookup_n    = lookup_n;
 	p->dlookup     = dlookup;
 	p->lookup_xyz  = lookup_xyz;
 	p->lookup_spec = lookup_spec;
+	p->set_threads = set_threads;
 
 	return p;
 }
@@ -1423,12 +1511,29 @@ static double DEsq(double aa, double bb) {
 #define dDE(aa) ((aa) > 0.008856451586 ? 38.666667 * pow((aa), -2.0/3.0) : 903.2962896)
 
 
+/* Compute the weighting of each primary combination k, given the */
+/* transfer corrected device values, by multiplying out the */
+/* per channel factors one channel at a time. */
+static void comb_weights(int n, double *wt, double *tcnv, double *tcnv1) {
+	int m, k;
+
+	wt[0] = 1.0;
+	for (m = 0; m < n; m++) {
+		int bit = 1 << m;
+		for (k = 0; k < bit; k++) {
+			wt[k | bit] = wt[k] * tcnv[m];
+			wt[k] *= tcnv1[m];
+		}
+	}
+}
+
 /* Given a device value, return the given bands value */
 /* according to the current model. */
 static double bandval(mpp *p, int band, double *dev) {
 	double tcnv[MPP_MXINKS];	/* Transfer curve corrected device values */
 	double tcnv1[MPP_MXINKS];	/* 1.0 - Transfer curve corrected device values */
 	double ww[MPP_MXINKS];		/* Interpolated tweak params for each channel */
+	double wt[MPP_MXCCOMB];		/* Primary combination weights */
 	int m, k;
 	double ov;
 	int j = band;
@@ -1445,16 +1550,10 @@ static double bandval(mpp *p, int band, double *dev) {
 			ww[m] = 0.0;
 
 		/* Lookup the shape values */
+		comb_weights(p->n, wt, tcnv, tcnv1);
 		for (k = 0; k < p->nn; k++) {		/* For each interp vertex */
-			double vv;
-	 		for (vv = 1.0, m = 0; m < p->n; m++) {	/* Compute weighting */
-				if (k & (1 << m))
-					vv *= tcnv[m];
-				else
-					vv *= tcnv1[m];
-			}
 			for (m = 0; m < p->n; m++) {
-				ww[m] += p->shape[m][k & ~(1<<m)][j] * vv;
+				ww[m] += p->shape[m][k & ~(1<<m)][j] * wt[k];
 									/* Apply weighting to shape vertex value */
 			}
 		}
@@ -1474,18 +1573,120 @@ static double bandval(mpp *p, int band, double *dev) {
 	}
 
 	/* Compute the primary combination values */
-	for (ov = 0.0, k = 0; k < p->nn; k++) {
-		double vv = p->pc[k][j];
+	comb_weights(p->n, wt, tcnv, tcnv1);
+	for (ov = 0.0, k = 0; k < p->nn; k++)
+		ov += p->pc[k][j] * wt[k];
+
+	return ov;
+}
+
+/* Given a device value, return the values of bands sb .. eb-1 in */
+/* ov[0 .. eb-sb-1]. This is the same as calling bandval() for each */
+/* band, but is evaluated MPP_BCHUNK bands at a time, so that the */
+/* inner loops run along the band index of the model parameters. */
+static void bandvals(mpp *p, double *ov, int sb, int eb, double *dev) {
+	double tcnv[MPP_MXINKS][MPP_BCHUNK];	/* Transfer curve corrected device values */
+	double tcnv1[MPP_MXINKS][MPP_BCHUNK];	/* 1.0 - Transfer curve corrected device values */
+	double wt[MPP_MXCCOMB][MPP_BCHUNK];		/* Primary combination weights */
+	int m, k, j, b0, nb;
+
+	for (b0 = sb; b0 < eb; b0 += nb, ov += nb) {
+		if ((nb = eb - b0) > MPP_BCHUNK)
+			nb = MPP_BCHUNK;
+
+		/* Compute the tranfer corrected device values. This is */
+		/* icxTransFunc() evaluated for all the bands at once. */
 		for (m = 0; m < p->n; m++) {
-			if (k & (1 << m))
-				vv *= tcnv[m];
-			else
-				vv *= tcnv1[m];
+			int ord;
+
+			for (j = 0; j < nb; j++)
+				tcnv[m][j] = dev[m];
+
+			for (ord = 0; ord < p->cord; ord++) {
+				double nsec = ord + 1.0;	/* Increase sections for each order */
+
+				for (j = 0; j < nb; j++) {
+					double g = p->tc[m][b0 + j][ord];	/* Parameter */
+					double vv = tcnv[m][j] * nsec;
+					double sec = floor(vv);
+
+					if (((int)sec) & 1)
+						g = -g;				/* Alternate action in each section */
+					vv -= sec;
+					if (g >= 0.0) {
+						vv = vv/(g - g * vv + 1.0);
+					} else {
+						vv = (vv - g * vv)/(1.0 - g * vv);
+					}
+					vv += sec;
+					tcnv[m][j] = vv / nsec;
+				}
+			}
+			for (j = 0; j < nb; j++)
+				tcnv1[m][j] = 1.0 - tcnv[m][j];
 		}
-		ov += vv;
-	}
 
-	return ov;
+		for (k = 0; k < 2; k++) {		/* Shape weights, then primary weights */
+			if (k == 0 && !p->useshape)
+				continue;
+
+			/* Compute the primary combination weights for each band */
+			for (j = 0; j < nb; j++)
+				wt[0][j] = 1.0;
+			for (m = 0; m < p->n; m++) {
+				int bit = 1 << m, kk;
+				for (kk = 0; kk < bit; kk++) {
+					double *w0 = wt[kk], *w1 = wt[kk | bit];
+					for (j = 0; j < nb; j++) {
+						w1[j] = w0[j] * tcnv[m][j];
+						w0[j] *= tcnv1[m][j];
+					}
+				}
+			}
+
+			if (k == 0) {
+				double ww[MPP_MXINKS][MPP_BCHUNK];	/* Interpolated tweak params */
+				int kk;
+
+				/* Lookup the shape values */
+				for (m = 0; m < p->n; m++) {
+					for (j = 0; j < nb; j++)
+						ww[m][j] = 0.0;
+				}
+				for (kk = 0; kk < p->nn; kk++) {
+					for (m = 0; m < p->n; m++) {
+						double *sh = p->shape[m][kk & ~(1<<m)] + b0;
+						for (j = 0; j < nb; j++)
+							ww[m][j] += sh[j] * wt[kk][j];
+					}
+				}
+
+				/* Apply the shape values to adjust the primaries */
+				for (m = 0; m < p->n; m++) {
+					for (j = 0; j < nb; j++) {
+						double gg = ww[m][j];		/* Curve adjustment */
+						double vv = tcnv[m][j];		/* Input value to be tweaked */
+						if (gg >= 0.0) {
+							vv = vv/(gg - gg * vv + 1.0);
+						} else {
+							vv = (vv - gg * vv)/(1.0 - gg * vv);
+						}
+						tcnv[m][j] = vv;
+						tcnv1[m][j] = 1.0 - vv;
+					}
+				}
+			}
+		}
+
+		/* Compute the primary combination values */
+		for (j = 0; j < nb; j++)
+			ov[j] = 0.0;
+		for (k = 0; k < p->nn; k++) {
+			double *pc = p->pc[k] + b0;
+			for (j = 0; j < nb; j++)
+				ov[j] += pc[j] * wt[k][j];
+		}
+	}
 }
 
 /* Given a device value, return the given bands value */
@@ -1628,23 +1829,18 @@ static double dbandval(mpp *p, double *dv, int band, double *dev) {
 static void forward(mpp *p, double *spec, double *Lab, double *XYZ, double *dev) {
 	double tXYZ[3];
 	int sb = 3, eb = 3;			/* Start and end bands to compute */
-	int j;
 
 	if (XYZ != NULL || Lab != NULL)
 		sb = 0;
 	if (spec != NULL)
 		eb = 3 + p->spec_n;
 
-	for (j = sb; j < eb; j++) {	/* Compute each bands value */
-		double ov;
-
-		ov = bandval(p, j, dev);
-
-		if (j < 3)
-			tXYZ[j] = ov;
-		else
-			spec[j-3] = ov;
+	if (sb < 3) {				/* Compute the XYZ bands */
+		bandvals(p, tXYZ, 0, 3, dev);
+		sb = 3;
 	}
+	if (sb < eb)				/* Compute the spectral bands */
+		bandvals(p, spec, sb, eb, dev);
 
 #ifdef SHARPEN
 	if (sb == 0)
@@ -1740,6 +1936,83 @@ double *maxse		/* Return maximum Error from spectral bands */
 		*maxse = smax;
 }
 
+/* - - - - - - - - - - - - - - - */
+/* Multi-threaded test point sums */
+
+/* The optimisation functions sum the error (and gradient) over the */
+/* test points. The points are summed in fixed blocks of MPP_PBLK, */
+/* and the block sums added in order, so that the result doesn't */
+/* depend on the number of threads. With less than MPP_PBLK points */
+/* this is the same as a plain serial sum. */
+
+/* Allocate the block sums for the test points */
+static void alloc_sums(mpp *p) {
+	p->nblk = (p->nodp + MPP_PBLK - 1)/MPP_PBLK;
+	if ((p->brv = (double *)malloc(p->nblk * sizeof(double))) == NULL
+	 || (p->bdv = (double *)malloc(p->nblk * 2 * MPP_MXPARMS * sizeof(double))) == NULL)
+		error("Malloc failed!");
+}
+
+/* Sum of func over test points s..e-1, adding any gradient to dv[] */
+typedef double (*mpp_pfunc)(mpp *p, double dv[], double pv[], int s, int e);
+
+typedef struct {
+	mpp *p;
+	mpp_pfunc func;
+	double *pv;				/* Parameter values */
+	int ndv;				/* Number of gradient values, 0 for none */
+} mpp_psum_cx;
+
+static int mpp_psum_thread(void *cntx, int ix, int nth) {
+	mpp_psum_cx *cx = (mpp_psum_cx *)cntx;
+	mpp *p = cx->p;
+	int b, k;
+
+	for (b = ix; b < p->nblk; b += nth) {
+		int s = b * MPP_PBLK, e = s + MPP_PBLK;
+		double *dv = NULL;
+
+		if (e > p->nodp)
+			e = p->nodp;
+		if (cx->ndv > 0) {
+			dv = p->bdv + b * 2 * MPP_MXPARMS;
+			for (k = 0; k < cx->ndv; k++)
+				dv[k] = 0.0;
+		}
+		p->brv[b] = cx->func(p, dv, cx->pv, s, e);
+	}
+	return 0;
+}
+
+/* Return the sum of func over all the test points, and if */
+/* ndv > 0, the sum of the gradient in dv[ndv]. */
+static double mpp_psum(mpp *p, mpp_pfunc func, double dv[], double pv[], int ndv) {
+	mpp_psum_cx cx;
+	double rv = 0.0;
+	int b, k, nth;
+
+	cx.p = p;
+	cx.func = func;
+	cx.pv = pv;
+	cx.ndv = ndv;
+
+	if ((nth = p->nthreads) > p->nblk)
+		nth = p->nblk;
+	if (nth <= 1)
+		mpp_psum_thread((void *)&cx, 0, 1);
+	else
+		par_exec(nth, mpp_psum_thread, (void *)&cx);
+
+	for (k = 0; k < ndv; k++)
+		dv[k] = 0.0;
+	for (b = 0; b < p->nblk; b++) {
+		rv += p->brv[b];
+		for (k = 0; k < ndv; k++)
+			dv[k] += p->bdv[b * 2 * MPP_MXPARMS + k];
+	}
+	return rv;
+}
+
 /* - - - - - - - - - - - - - - - */
 /* Powell optimisation callbacks */
 
@@ -1846,10 +2119,9 @@ static double efunc1(void *adata, double pv[]) {
 }
 #endif /* NEVER */
 
-/* Optimise all transfer curves simultaniously to minimise a particular bands error */
-static double efunc2(void *adata, double pv[]) {
-	mpp *p = (mpp *)adata;
-	double smv, rv = 0.0;
+/* efunc2 band error sum over test points s..e-1 */
+static double efunc2_p(mpp *p, double dv[], double pv[], int s, int e) {
+	double rv = 0.0;
 	double tcnv[MPP_MXINKS];	/* Transfer curve corrected device values */
 	double tcnv1[MPP_MXINKS];	/* 1.0 - Transfer curve corrected device values */
 	double ww[MPP_MXINKS];		/* Interpolated tweak params for each channel */
@@ -1857,7 +2129,7 @@ static double efunc2(void *adata, double pv[]) {
 	int i, m, k;
 
 	/* For each test point */
-	for (i = 0; i < p->nodp; i++) {
+	for (i = s; i < e; i++) {
 		mppcol *c = &p->cols[i];
 		double ov;
 
@@ -1917,7 +2189,16 @@ static double efunc2(void *adata, double pv[]) {
 		ov = lDE(ov) - c->lband[j];
 		rv += ov * ov;
 	}
+	return rv;
+}
+
+/* Optimise all transfer curves simultaniously to minimise a particular bands error */
+static double efunc2(void *adata, double pv[]) {
+	mpp *p = (mpp *)adata;
+	double smv, rv;
+	int i, m, k;
 
+	rv = mpp_psum(p, efunc2_p, NULL, pv, 0);
 	rv /= (double)p->nodp;
 
 	/* Compute weighted magnitude of shaper parameters squared */
@@ -1947,16 +2228,14 @@ static double efunc2(void *adata, double pv[]) {
 	rv += smv;
 
 #ifdef DEBUG
-	printf("efunc2 itt %d/%d band %d returning %f\n",p->oit,p->ott,j,rv);
+	printf("efunc2 itt %d/%d band %d returning %f\n",p->oit,p->ott,p->oba,rv);
 #endif
 	return rv;
 }
 
-/* Return the gradient of the minimisation function at the given location, */
-/* as well as the function value at this location. */
-static double dfunc2(void *adata, double dv[], double pv[]) {
-	mpp *p = (mpp *)adata;
-	double smv, tt, rv = 0.0;
+/* dfunc2 band error and gradient sum over test points s..e-1 */
+static double dfunc2_p(mpp *p, double dv[], double pv[], int s, int e) {
+	double tt, rv = 0.0;
 	double dtcnv_dpv[MPP_MXINKS][MPP_MXTCORD];	/* Del in tcnv[m] due to del in parameter */
 	double dww_dtcnv[MPP_MXINKS][MPP_MXINKS];	/* Del in ww[m] due to del in tcnv[m] */
 	double dtcnv_tc[MPP_MXINKS];				/* Del in tcnv'[m] due to del in tcnv[m] */
@@ -1969,11 +2248,8 @@ static double dfunc2(void *adata, double dv[], double pv[]) {
 	int j = p->oba;			/* Band being optimised */
 	int i, m, k;
 
-	for (k = 0; k < (p->n * p->cord); k++)
-		dv[k] = 0.0;
-
 	/* For each test point */
-	for (i = 0; i < p->nodp; i++) {
+	for (i = s; i < e; i++) {
 		int mo;
 		mppcol *c = &p->cols[i];
 		double ov;
@@ -2235,7 +2511,17 @@ for (m = 0; m < p->n; m++) {
 			}
 		}
 	}
+	return rv;
+}
+
+/* Return the gradient of the minimisation function at the given location, */
+/* as well as the function value at this location. */
+static double dfunc2(void *adata, double dv[], double pv[]) {
+	mpp *p = (mpp *)adata;
+	double smv, tt, rv;
+	int i, m, k;
 
+	rv = mpp_psum(p, dfunc2_p, dv, pv, p->n * p->cord);
 	rv /= (double)p->nodp;
 	for (k = 0; k < (p->n * p->cord); k++)
 		dv[k] /= (double)p->nodp;
@@ -2268,7 +2554,7 @@ for (m = 0; m < p->n; m++) {
 	rv += smv;
 
 #ifdef DEBUG
-	printf("dfunc2 itt %d/%d band %d returning %f\n",p->oit,p->ott,j,rv);
+	printf("dfunc2 itt %d/%d band %d returning %f\n",p->oit,p->ott,p->oba,rv);
 #endif
 	return rv;
 }
@@ -2344,11 +2630,9 @@ static void sfunc3(mpp *p) {
 }
 
 
-/* Optimise all shape parameters simultaniously to minimise a particular bands error */
-/* Assume test point tcnv and pcnv are setup for pre-shape values */
-static double efunc3(void *adata, double pv[]) {
-	mpp *p = (mpp *)adata;
-	double smv, rv = 0.0;
+/* efunc3 band error sum over test points s..e-1 */
+static double efunc3_p(mpp *p, double dv[], double pv[], int s, int e) {
+	double rv = 0.0;
 	double tcnv[MPP_MXINKS];	/* Transfer curve corrected device values */
 	double tcnv1[MPP_MXINKS];	/* 1.0 - Transfer curve corrected device values */
 	double ww[MPP_MXINKS];		/* Interpolated tweak params for each channel */
@@ -2357,7 +2641,7 @@ static double efunc3(void *adata, double pv[]) {
 	int i, m, k;
 
 	/* For each test point */
-	for (i = 0; i < p->nodp; i++) {
+	for (i = s; i < e; i++) {
 		mppcol *c = &p->cols[i];
 		double ov;
 
@@ -2399,7 +2683,17 @@ static double efunc3(void *adata, double pv[]) {
 		ov = lDE(ov) - c->lband[j];
 		rv += ov * ov;
 	}
+	return rv;
+}
+
+/* Optimise all shape parameters simultaniously to minimise a particular bands error */
+/* Assume test point tcnv and pcnv are setup for pre-shape values */
+static double efunc3(void *adata, double pv[]) {
+	mpp *p = (mpp *)adata;
+	double smv, rv;
+	int m;
 
+	rv = mpp_psum(p, efunc3_p, NULL, pv, 0);
 	rv /= (double)p->nodp;
 
 	/* Compute average magnitude of shaper parameters squared */
@@ -2411,16 +2705,14 @@ static double efunc3(void *adata, double pv[]) {
 	rv += SHAPE_PMW * smv;		
 
 #ifdef DEBUG
-	printf("efunc3 itt %d/%d band %d (smv %f) returning %f\n",p->oit,p->ott,j,smv,rv);
+	printf("efunc3 itt %d/%d band %d (smv %f) returning %f\n",p->oit,p->ott,p->oba,smv,rv);
 #endif
 	return rv;
 }
 
-/* Return the gradient of the minimisation function at the given location, */
-/* as well as the function value at this location. */
-static double dfunc3(void *adata, double dv[], double pv[]) {
-	mpp *p = (mpp *)adata;
-	double smv, tt, rv = 0.0;
+/* dfunc3 band error and gradient sum over test points s..e-1 */
+static double dfunc3_p(mpp *p, double dv[], double pv[], int s, int e) {
+	double tt, rv = 0.0;
 	double dtcnv[MPP_MXINKS];	/* Derivative of transfer curve corrected device values */
 	double dov[MPP_MXINKS];		/* Derivative of output interpolation device values */
 	double tcnv[MPP_MXINKS];	/* Transfer curve corrected device values */
@@ -2430,11 +2722,8 @@ static double dfunc3(void *adata, double dv[], double pv[]) {
 	int n1 = p->n - 1;
 	int i, m, k;
 
-	for (k = 0; k < p->nnn2; k++)
-		dv[k] = 0.0;					/* Start with 0 delta */
-
 	/* For each test point */
-	for (i = 0; i < p->nodp; i++) {
+	for (i = s; i < e; i++) {
 		mppcol *c = &p->cols[i];
 		double ov, ddov;
 
@@ -2508,7 +2797,17 @@ static double dfunc3(void *adata, double dv[], double pv[]) {
 			dv[k] += ddov * dov[m] * c->fcnv[k];
 		}
 	}
+	return rv;
+}
+
+/* Return the gradient of the minimisation function at the given location, */
+/* as well as the function value at this location. */
+static double dfunc3(void *adata, double dv[], double pv[]) {
+	mpp *p = (mpp *)adata;
+	double smv, tt, rv;
+	int k;
 
+	rv = mpp_psum(p, dfunc3_p, dv, pv, p->nnn2);
 	rv /= ((double)p->nodp);
 
 	for (k = 0; k < p->nnn2; k++)
@@ -2525,7 +2824,7 @@ static double dfunc3(void *adata, double dv[], double pv[]) {
 	rv += SHAPE_PMW * smv;		
 
 #ifdef DEBUG
-	printf("dfunc3 itt %d/%d band %d (smv %f) returning %f\n",p->oit,p->ott,j,smv,rv);
+	printf("dfunc3 itt %d/%d band %d (smv %f) returning %f\n",p->oit,p->ott,p->oba,smv,rv);
 #endif
 	return rv;
 }
@@ -2626,16 +2925,14 @@ static void sfunc4(mpp *p) {
 	}
 }
 
-/* Optimise all vertex values simultaniously to minimise a particular bands error */
-/* Assume test point tcnv and pcnv are setup for post-shape values */
-static double efunc4(void *adata, double pv[]) {
-	mpp *p = (mpp *)adata;
-	double smv = 0.0, rv = 0.0;
+/* efunc4 band error sum over test points s..e-1 */
+static double efunc4_p(mpp *p, double dv[], double pv[], int s, int e) {
+	double rv = 0.0;
 	int j = p->oba;				/* Band being optimised */
 	int i, k;
 
 	/* For each test point */
-	for (i = 0; i < p->nodp; i++) {
+	for (i = s; i < e; i++) {
 		mppcol *c = &p->cols[i];
 		double ov = 0.0;
 
@@ -2651,7 +2948,18 @@ static double efunc4(void *adata, double pv[]) {
 		ov = lDE(ov) - c->lband[j];
 		rv += ov * ov;
 	}
+	return rv;
+}
+
+/* Optimise all vertex values simultaniously to minimise a particular bands error */
+/* Assume test point tcnv and pcnv are setup for post-shape values */
+static double efunc4(void *adata, double pv[]) {
+	mpp *p = (mpp *)adata;
+	double smv = 0.0, rv;
+	int j = p->oba;				/* Band being optimised */
+	int i;
 
+	rv = mpp_psum(p, efunc4_p, NULL, pv, 0);
 	rv /= p->nodp;
 
 	/* Compute anchor point error */
@@ -2670,22 +2978,16 @@ static double efunc4(void *adata, double pv[]) {
 	return rv;
 }
 
-/* Return the gradient of the minimisation function at the given location, */
-/* as well as the function value at this location. */
-static double dfunc4(void *adata, double dv[], double pv[]) {
-	mpp *p = (mpp *)adata;
-	double smv = 0.0, rv = 0.0;
-	double drv[MPP_MXCCOMB];	/* Delta in rv */
+/* dfunc4 band error and gradient sum over test points s..e-1. */
+/* The gradient of the < 0 penalty is returned in dv[nn..2nn-1] */
+static double dfunc4_p(mpp *p, double dv[], double pv[], int s, int e) {
+	double rv = 0.0;
+	double *drv = dv + p->nn;	/* Delta in rv */
 	int j = p->oba;				/* Band being optimised */
 	int i, k;
 
-	for (k = 0; k < p->nn; k++) {
-		dv[k] = 0.0;
-		drv[k] = 0.0;
-	}
-
 	/* For each test point */
-	for (i = 0; i < p->nodp; i++) {
+	for (i = s; i < e; i++) {
 		mppcol *c = &p->cols[i];
 		double ov = 0.0, ddov;
 
@@ -2710,6 +3012,22 @@ static double dfunc4(void *adata, double dv[], double pv[]) {
 			dv[k] += ddov * c->pcnv[k];
 		}
 	}
+	return rv;
+}
+
+/* Return the gradient of the minimisation function at the given location, */
+/* as well as the function value at this location. */
+static double dfunc4(void *adata, double dv[], double pv[]) {
+	mpp *p = (mpp *)adata;
+	double smv = 0.0, rv;
+	double tdv[2 * MPP_MXCCOMB];	/* Point gradient sum and delta in rv */
+	double *drv = tdv + p->nn;
+	int j = p->oba;				/* Band being optimised */
+	int k;
+
+	rv = mpp_psum(p, dfunc4_p, tdv, pv, 2 * p->nn);
+	for (k = 0; k < p->nn; k++)
+		dv[k] = tdv[k];
 
 	rv /= p->nodp;
 	for (k = 0; k < p->nn; k++)
@@ -3600,51 +3918,423 @@ mpp *p
 	}
 }
 
-/* ===================================== */
-
-/* Create the mpp from scattered data points */
-/* Returns nz on error */
-static int create(
-	mpp *p,					/* This */
-	int verb,				/* Vebosity level, 0 = none */
-	int quality,			/* Profile quality, 0..3 */
-	int display,			/* non-zero if display device */
-	double limit,			/* Total ink limit (if not display) */
-	inkmask devmask,		/* Inkmask describing device colorspace */
-	int    spec_n,			/* Number of spectral bands, 0 if not valid */
-	double spec_wl_short,	/* First reading wavelength in nm (shortest) */
-	double spec_wl_long,	/* Last reading wavelength in nm (longest) */
-	double norm,			/* Normalising scale value for spectral values */
-	instType itype,			/* Spectral instrument type (if not display) */
-	int nodp,				/* Number of points */
-	mppcol *points			/* Array of input points */
-) {
-	int it, i, j, k;
-	double de, mxde;		/* Average Delta E and maximum Delta E */
-	double sde, mxsde;		/* Average Spectral error and maximum spectral error */
-	int mxtcord;			/* maximum transfer curve order */
-	int maxit;				/* Maximum number of tuning itterations */
+/* Fit the model parameters for band j, starting with the */
+/* parameters of band lj if they are better (lj < 0 for none). */
+static void fit_band(mpp *p, int j, int lj, int maxit, int useshape, int mxtcord) {
+	double pv[MPP_MXPARMS];		/* Parameter values */
+	double sr[MPP_MXPARMS];		/* search radius */
 	double thr;				/* Powell threshold multiplier at each tuning pass */
-	int useshape;			/* Make use of shaping parameters */
-	int mode;				/* Band scanning mode */
+	int it, i, k;
+#ifdef BIGBANG
+	double sde, mxsde;
+#endif
 
-	/* Convert quality into operation counts */
-	switch (quality) {
-		case 0:				/* Low */
-			useshape = 0;
-			mxtcord = 8;
-			maxit = 3;
-			break;
-		case 1:
-		default:			/* Medium */
-			useshape = 1;
-			mxtcord = 10;
-			maxit = 4;
-			break;
-		case 2:				/* High */
-			useshape = 1;
-			mxtcord = 14;
-			maxit = 5;
+	p->oba = j;					/* Band being optimised */
+
+	if (p->verb)
+		printf("Doing band %d, last band %d\n",j,lj);
+
+	/* See if the last bands values are a good place to start */
+	if (lj >= 0) {
+		double cval, pval, p0val;
+
+		banderr(p, &cval, NULL, j);		/* Current error */
+
+		/* Copy previous band transfer and shape into current band */
+		for (k = 0; k < p->n; k++)
+			for (i = 0; i < p->cord; i++) {
+				pv[k * p->cord + i] = p->tc[k][j][i];	/* Save current for restore */
+				p->tc[k][j][i] = p->tc[k][lj][i];
+			}
+		for (i = 0; i < p->nnn2; i++) { 
+			int m = p->c2f[i].ink;
+			int n = p->c2f[i].comb;
+			
+			sr[i] = p->shape[m][n][j];
+			p->shape[m][n][j] = p->shape[m][n][lj];
+		}
+		banderr(p, &pval, NULL, j);
+
+		/* Try out the urrent order 0 transfer values with rest of transfer and shape */
+		for (k = 0; k < p->n; k++)
+			p->tc[k][j][0] = pv[k * p->cord];
+		banderr(p, &p0val, NULL, j);
+
+		/* See which was best out of the three */
+		if (pval >= cval && p0val >= pval) {			/* Original was the best */
+			for (k = 0; k < p->n; k++)
+				for (i = 0; i < p->cord; i++)
+					p->tc[k][j][i] = pv[k * p->cord + i];	/* Restore previous values */
+			for (i = 0; i < p->nnn2; i++) { 
+				int m = p->c2f[i].ink;
+				int n = p->c2f[i].comb;
+				p->shape[m][n][j] = sr[i];	/* Restore previous value */
+			}
+//printf("~1 Starting values were best (%f && %f > %f)\n",pval,p0val,cval);
+		} else if (p0val >= pval) {						/* Copying all was best */
+
+			for (k = 0; k < p->n; k++)
+				p->tc[k][j][0] = p->tc[k][lj][0];		/* Back to order 0 values */
+
+//printf("~1 copying all previous bands values was best (%f < %f && %f)\n",pval,cval,p0val);
+		} else {
+//printf("~1 copying except order 0 values was best (%f < %f && %f)\n",p0val,cval,pval);
+		}
+	}
+
+#ifdef MULTIPASS	/* Multipass in parts */
+	for (it = 0, p->ott = maxit, thr = 1.0; it < maxit; it++, thr *= 0.2) {
+		double sde, mxsde;
+		double resid;
+
+		p->oit = it+1;
+
+		/* Optimise main transfer curve to minimise each bands error */
+		/* Initially using only first transfer curve order */
+
+		if (p->verb)
+			printf("Fine tuning device transfer curves itteration %d\n",it);
+
+		/* Get the current values */
+		for (k = 0; k < p->n; k++) {
+			for (i = 0; i < p->cord; i++) { 
+				pv[k * p->cord + i] = p->tc[k][j][i];
+				sr[k * p->cord + i] = 0.05;
+			}
+		}
+#ifdef TESTDFUNC
+		test_dfunc2(p, p->n * p->cord, pv);
+#endif /* TESTDFUNC */
+#ifdef NODDV
+		if (powell(&resid, p->n * p->cord, pv, sr, thr * 0.01, 200,
+		                          efunc2, (void *)p, mppprog, (void *)p) != 0)
+			error ("Powell failed");
+#else /* !NODDV */
+		if (conjgrad(&resid, p->n * p->cord, pv, sr, thr * 0.01, 200,
+		                   efunc2, dfunc2, (void *)p, mppprog, (void *)p)!= 0)
+			error ("ConjGrad failed");
+#endif /* !NODDV */
+
+		/* Put results back into place */
+		for (k = 0; k < p->n; k++) {
+			for (i = 0; i < p->cord; i++) 
+				p->tc[k][j][i] = pv[k * p->cord + i];
+		}
+
+#ifndef DEBUG
+		if (p->verb)
+#endif /* !DEBUG */
+		{
+			banderr(p, &sde, &mxsde, j);		/* Current error */
+			printf("\nNow got avg E of %f, max %f for this band\n",sde, mxsde);
+		}
+
+		p->cord = mxtcord;			/* maximum transfer curve order after very first run */
+
+		/* Tune the shaping parameters */
+		if (useshape) {
+
+			if (p->verb)
+				printf("Tuning detailed shaping parameters itteration %d\n",it);
+	
+			sfunc3(p);	/* Setup test point values for this band */
+
+			/* Get the current values */
+			for (i = 0; i < p->nnn2; i++) { 
+				int m = p->c2f[i].ink;
+				int n = p->c2f[i].comb;
+				
+				pv[i] = p->shape[m][n][j];
+				sr[i] = 0.01;
+			}
+
+#ifdef TESTDFUNC
+			test_dfunc3(p, p->nnn2, pv);
+#endif /* TESTDFUNC */
+#ifdef NODDV
+			if (powell(&resid, p->nnn2, pv, sr, thr * 0.05, 2000,
+			           efunc3, (void *)p, mppprog, (void *)p) != 0)
+				error ("Powell failed");
+
+#else /* !NODDV */
+			if (conjgrad(&resid, p->nnn2, pv, sr, thr * 0.05, 2000,
+			          efunc3, dfunc3, (void *)p, mppprog, (void *)p) != 0.0)
+				error ("ConjGrad failed");
+#endif /* !NODDV */
+
+			/* Put results back into place */
+			for (i = 0; i < p->nnn2; i++) { 
+				int m = p->c2f[i].ink;
+				int n = p->c2f[i].comb;
+				
+				p->shape[m][n][j] = pv[i];
+//printf("~1 shape[%d][%d] = %f\n",m,n,pv[i]);
+			}
+
+#ifndef DEBUG
+			if (p->verb)
+#endif /* !DEBUG */
+			{
+				banderr(p, &sde, &mxsde, j);		/* Current error */
+				printf("\nNow got avg E of %f, max %f for this band\n",sde, mxsde);
+			}
+#ifdef DEBUG
+			dump_shape(p, 0, "After efunc3:");
+#endif /* DEBUG */
+
+			p->useshape = 1;		/* Would be nice to flag this on a per band basis */
+		}
+
+		/* Tune the vertex parameters */
+
+		if (p->verb)
+			printf("Optimising device combination values itteration %d\n",it);
+	
+		sfunc4(p);	/* Setup test point values for this band */
+
+		/* Get the current values */
+		for (k = 0; k < p->nn; k++) {
+			pv[k] = p->pc[k][j];
+			sr[k] = 0.01;
+		}
+
+#ifdef TESTDFUNC
+		test_dfunc4(p, p->nn, pv);
+#endif /* TESTDFUNC */
+#ifdef NODDV
+		if (powell(&resid, p->nn, pv, sr, thr * 0.01, 500,
+		                 efunc4, (void *)p, mppprog, (void *)p) != 0)
+			error ("Powell failed");
+#else /* !NODDV */
+		if (conjgrad(&resid, p->nn, pv, sr, thr * 0.01, 500,
+		          efunc4, dfunc4, (void *)p, mppprog, (void *)p) != 0)
+			error ("ConjGrad failed");
+#endif /* !NODDV */
+
+		/* Put results back into place */
+		for (k = 0; k < p->nn; k++) {
+			double pp = pv[k];
+			if (pp < 0.0)
+				pp = 0.0;
+			p->pc[k][j] = pp;
+		}
+
+#ifndef DEBUG
+		if (p->verb)
+#endif /* !DEBUG */
+		{
+			banderr(p, &sde, &mxsde, j);		/* Current error */
+			printf("\nNow got avg E of %f, max %f for this band\n",sde, mxsde);
+		}
+	}
+#endif /* MULTIPASS	*/
+
+#ifdef BIGBANG
+	/* Do optimisation with one big bang */
+	{
+		double resid;
+		double *pv2, *pv3, *pv4;	/* Pointers to each group of parameters */
+		double *sr2, *sr3, *sr4;	/* Pointers to each group of search radius */
+		int tparms = p->n * p->cord + p->nnn2 + p->nn;
+
+		pv2 = pv;
+		pv3 = pv + (p->n * p->cord);
+		pv4 = pv + (p->n * p->cord) + p->nnn2;
+		sr2 = sr;
+		sr3 = sr + (p->n * p->cord);
+		sr4 = sr + (p->n * p->cord) + p->nnn2;
+
+		/* Get the current transfer values */
+		for (k = 0; k < p->n; k++) {
+			for (i = 0; i < p->cord; i++) { 
+				pv2[k * p->cord + i] = p->tc[k][j][i];
+				sr2[k * p->cord + i] = 0.005;
+			}
+		}
+		/* Get the current shaper values */
+		for (i = 0; i < p->nnn2; i++) { 
+			int m = p->c2f[i].ink;
+			int n = p->c2f[i].comb;
+			
+			pv3[i] = p->shape[m][n][j];
+			sr3[i] = 0.005;
+		}
+		/* Get the current device combination values */
+		for (k = 0; k < p->nn; k++) {
+			pv4[k] = p->pc[k][j];
+			sr4[k] = 0.005;
+		}
+
+#ifdef TESTDFUNC
+		test_dfunc0(p, tparms, pv);
+#endif /* TESTDFUNC */
+
+		if (conjgrad(&resid, tparms, pv, sr, 0.001, 4000, efunc0, dfunc0, (void *)p,
+		                                                     mppprog, (void *)p) != 0)
+			error ("ConjGrad failed");
+
+		/* Put results back into place */
+		for (k = 0; k < p->n; k++) {
+			for (i = 0; i < p->cord; i++) 
+				p->tc[k][j][i] = pv2[k * p->cord + i];
+		}
+		for (i = 0; i < p->nnn2; i++) { 
+			int m = p->c2f[i].ink;
+			int n = p->c2f[i].comb;
+			
+			p->shape[m][n][j] = pv3[i];
+		}
+		for (k = 0; k < p->nn; k++) {
+			double pp = pv4[k];
+			if (pp < 0.0)
+				pp = 0.0;
+			p->pc[k][j] = pp;
+		}
+
+#ifndef DEBUG
+		if (p->verb)
+#endif /* !DEBUG */
+		{
+			banderr(p, &sde, &mxsde, j);		/* Current error */
+			printf("\nNow got avg E of %f, max %f for this band\n",sde, mxsde);
+		}
+	}
+#endif /* BIGBANG */
+}
+
+/* A band to fit, and the band to start from */
+typedef struct {
+	int j, lj;
+} mpp_band;
+
+/* Band fitting thread context */
+typedef struct {
+	mpp *p;
+	mpp **cl;				/* Per thread copies of p */
+	mpp_band *bo;			/* Bands to fit */
+	int nbo;
+	int maxit, useshape, mxtcord;
+} mpp_fit_cx;
+
+/* Thread to fit every nth band. Each thread has a copy of the mpp */
+/* with its own test point values, and the results are put back */
+/* into the original. (The shape parameters are shared.) */
+static int fit_bands_thread(void *cntx, int ix, int nth) {
+	mpp_fit_cx *cx = (mpp_fit_cx *)cntx;
+	mpp *p = cx->p, *c = cx->cl[ix];
+	int b, k, m;
+
+	for (b = ix; b < cx->nbo; b += nth) {
+		int j = cx->bo[b].j;
+
+		fit_band(c, j, cx->bo[b].lj, cx->maxit, cx->useshape, cx->mxtcord);
+
+		for (m = 0; m < p->n; m++) {
+			for (k = 0; k < MPP_MXTCORD; k++)
+				p->tc[m][j][k] = c->tc[m][j][k];
+		}
+		for (k = 0; k < p->nn; k++)
+			p->pc[k][j] = c->pc[k][j];
+	}
+	return 0;
+}
+
+/* Fit the nbo bands in bo[] in parallel. Each band's starting */
+/* band must already have been fitted. */
+static void fit_bands(mpp *p, mpp_band *bo, int nbo, int maxit, int useshape, int mxtcord) {
+	mpp_fit_cx cx;
+	int i, j, nth;
+
+	if (nbo <= 0)
+		return;
+
+	if ((nth = p->nthreads) > nbo)
+		nth = nbo;
+
+	if (p->verb)
+		printf("Doing %d bands using %d threads\n",nbo,nth);
+
+	cx.p = p;
+	cx.bo = bo;
+	cx.nbo = nbo;
+	cx.maxit = maxit;
+	cx.useshape = useshape;
+	cx.mxtcord = mxtcord;
+
+	if ((cx.cl = (mpp **)calloc(nth, sizeof(mpp *))) == NULL)
+		error("Malloc failed!");
+	for (i = 0; i < nth; i++) {
+		if ((cx.cl[i] = (mpp *)malloc(sizeof(mpp))) == NULL)
+			error("Malloc failed!");
+		*cx.cl[i] = *p;
+		cx.cl[i]->verb = 0;
+		cx.cl[i]->nthreads = 1;
+		if ((cx.cl[i]->cols = new_mppcols(p->nodp, p->n, p->spec_n)) == NULL)
+			error("Malloc failed!");
+		for (j = 0; j < p->nodp; j++)
+			copy_mppcol(&cx.cl[i]->cols[j], &p->cols[j], p->n, p->spec_n);
+		alloc_sums(cx.cl[i]);
+	}
+
+	par_exec(nth, fit_bands_thread, (void *)&cx);
+
+	for (i = 0; i < nth; i++) {
+		if (cx.cl[i]->useshape)
+			p->useshape = 1;
+		del_mppcols(cx.cl[i]->cols, p->nodp, p->n, p->spec_n);
+		free(cx.cl[i]->brv);
+		free(cx.cl[i]->bdv);
+		free(cx.cl[i]);
+	}
+	free(cx.cl);
+}
+
+/* ===================================== */
+
+/* Create the mpp from scattered data points */
+/* Returns nz on error */
+static int create(
+	mpp *p,					/* This */
+	int verb,				/* Vebosity level, 0 = none */
+	int quality,			/* Profile quality, 0..3 */
+	int display,			/* non-zero if display device */
+	double limit,			/* Total ink limit (if not display) */
+	inkmask devmask,		/* Inkmask describing device colorspace */
+	int    spec_n,			/* Number of spectral bands, 0 if not valid */
+	double spec_wl_short,	/* First reading wavelength in nm (shortest) */
+	double spec_wl_long,	/* Last reading wavelength in nm (longest) */
+	double norm,			/* Normalising scale value for spectral values */
+	instType itype,			/* Spectral instrument type (if not display) */
+	int nodp,				/* Number of points */
+	mppcol *points			/* Array of input points */
+) {
+	int i, j, k;
+	double de, mxde;		/* Average Delta E and maximum Delta E */
+	double sde, mxsde;		/* Average Spectral error and maximum spectral error */
+	int mxtcord;			/* maximum transfer curve order */
+	int maxit;				/* Maximum number of tuning itterations */
+	int useshape;			/* Make use of shaping parameters */
+	int mode;				/* Band scanning mode */
+	mpp_band bo[3+MPP_MXBANDS];	/* Band fitting order */
+	int nbo, yj;			/* Number of bands, peak Y band */
+
+	/* Convert quality into operation counts */
+	switch (quality) {
+		case 0:				/* Low */
+			useshape = 0;
+			mxtcord = 8;
+			maxit = 3;
+			break;
+		case 1:
+		default:			/* Medium */
+			useshape = 1;
+			mxtcord = 10;
+			maxit = 4;
+			break;
+		case 2:				/* High */
+			useshape = 1;
+			mxtcord = 14;
+			maxit = 5;
 			break;
 		case 3:				/* Ultra high */
 			useshape = 1;
@@ -3706,6 +4396,9 @@ static int create(
 	if ((new_mppcol(&p->kblack, p->n, p->spec_n)) != 0) {
 		error("Malloc failed!");
 	}
+	alloc_sums(p);
+	if (p->nthreads <= 0)
+		p->nthreads = num_threads();
 
 	p->spmax = -1e6;
 	for (i = 0; i < p->nodp; i++) {
@@ -3919,6 +4612,7 @@ static int create(
 #ifdef NEVER		// Skip efunc1 passes for now.
 	/* Do initial fast pass of optimisations */
 	/* using only first transfer curve order */
+	int it;
 	for (it = 0, p->ott = 3; it < p->ott; it++) {
 		double resid;
 
@@ -3994,11 +4688,11 @@ static int create(
 	p->cord = mxtcord;
 
 	/* - - - - - - - - - - - - - - - - - */
-	/* Fine tune all parameters in the model */
-	for (mode = 0;;) {
-		double pv[MPP_MXPARMS];		/* Parameter values */
-		double sr[MPP_MXPARMS];		/* search radius */
-		int lj, yj = 0;				/* Last band, peak Y band */
+	/* Fine tune all parameters in the model. */
+	/* First decide the order to do the bands in, and the band */
+	/* that each starts from. */
+	for (nbo = 0, yj = 0, mode = 0;;) {
+		int lj;					/* Last band */
 	
 		/* Decide which band to do next */
 		if (mode == 0) {				/* Start at the beginning */
@@ -4073,277 +4767,23 @@ static int create(
 			break;						/* we're now done */
 		}
 
-		p->oba = j;					/* Band being optimised */
-
-		if (p->verb)
-			printf("Doing band %d, last band %d\n",j,lj);
-
-		/* See if the last bands values are a good place to start */
-		if (lj >= 0) {
-			double cval, pval, p0val;
-
-			banderr(p, &cval, NULL, j);		/* Current error */
-
-			/* Copy previous band transfer and shape into current band */
-			for (k = 0; k < p->n; k++)
-				for (i = 0; i < p->cord; i++) {
-					pv[k * p->cord + i] = p->tc[k][j][i];	/* Save current for restore */
-					p->tc[k][j][i] = p->tc[k][lj][i];
-				}
-			for (i = 0; i < p->nnn2; i++) { 
-				int m = p->c2f[i].ink;
-				int n = p->c2f[i].comb;
-				
-				sr[i] = p->shape[m][n][j];
-				p->shape[m][n][j] = p->shape[m][n][lj];
-			}
-			banderr(p, &pval, NULL, j);
-
-			/* Try out the urrent order 0 transfer values with rest of transfer and shape */
-			for (k = 0; k < p->n; k++)
-				p->tc[k][j][0] = pv[k * p->cord];
-			banderr(p, &p0val, NULL, j);
-
-			/* See which was best out of the three */
-			if (pval >= cval && p0val >= pval) {			/* Original was the best */
-				for (k = 0; k < p->n; k++)
-					for (i = 0; i < p->cord; i++)
-						p->tc[k][j][i] = pv[k * p->cord + i];	/* Restore previous values */
-				for (i = 0; i < p->nnn2; i++) { 
-					int m = p->c2f[i].ink;
-					int n = p->c2f[i].comb;
-					p->shape[m][n][j] = sr[i];	/* Restore previous value */
-				}
-//printf("~1 Starting values were best (%f && %f > %f)\n",pval,p0val,cval);
-			} else if (p0val >= pval) {						/* Copying all was best */
-
-				for (k = 0; k < p->n; k++)
-					p->tc[k][j][0] = p->tc[k][lj][0];		/* Back to order 0 values */
-
-//printf("~1 copying all previous bands values was best (%f < %f && %f)\n",pval,cval,p0val);
-			} else {
-//printf("~1 copying except order 0 values was best (%f < %f && %f)\n",p0val,cval,pval);
-			}
-		}
-
-#ifdef MULTIPASS	/* Multipass in parts */
-		for (it = 0, p->ott = maxit, thr = 1.0; it < maxit; it++, thr *= 0.2) {
-			double sde, mxsde;
-			double resid;
-	
-			p->oit = it+1;
-	
-			/* Optimise main transfer curve to minimise each bands error */
-			/* Initially using only first transfer curve order */
-
-			if (p->verb)
-				printf("Fine tuning device transfer curves itteration %d\n",it);
-	
-			/* Get the current values */
-			for (k = 0; k < p->n; k++) {
-				for (i = 0; i < p->cord; i++) { 
-					pv[k * p->cord + i] = p->tc[k][j][i];
-					sr[k * p->cord + i] = 0.05;
-				}
-			}
-#ifdef TESTDFUNC
-			test_dfunc2(p, p->n * p->cord, pv);
-#endif /* TESTDFUNC */
-#ifdef NODDV
-			if (powell(&resid, p->n * p->cord, pv, sr, thr * 0.01, 200,
-			                          efunc2, (void *)p, mppprog, (void *)p) != 0)
-				error ("Powell failed");
-#else /* !NODDV */
-			if (conjgrad(&resid, p->n * p->cord, pv, sr, thr * 0.01, 200,
-			                   efunc2, dfunc2, (void *)p, mppprog, (void *)p)!= 0)
-				error ("ConjGrad failed");
-#endif /* !NODDV */
-
-			/* Put results back into place */
-			for (k = 0; k < p->n; k++) {
-				for (i = 0; i < p->cord; i++) 
-					p->tc[k][j][i] = pv[k * p->cord + i];
-			}
-
-#ifndef DEBUG
-			if (p->verb)
-#endif /* !DEBUG */
-			{
-				banderr(p, &sde, &mxsde, j);		/* Current error */
-				printf("\nNow got avg E of %f, max %f for this band\n",sde, mxsde);
-			}
-
-			p->cord = mxtcord;			/* maximum transfer curve order after very first run */
-
-			/* Tune the shaping parameters */
-			if (useshape) {
-
-				if (p->verb)
-					printf("Tuning detailed shaping parameters itteration %d\n",it);
-		
-				sfunc3(p);	/* Setup test point values for this band */
 
-				/* Get the current values */
-				for (i = 0; i < p->nnn2; i++) { 
-					int m = p->c2f[i].ink;
-					int n = p->c2f[i].comb;
-					
-					pv[i] = p->shape[m][n][j];
-					sr[i] = 0.01;
-				}
-
-#ifdef TESTDFUNC
-				test_dfunc3(p, p->nnn2, pv);
-#endif /* TESTDFUNC */
-#ifdef NODDV
-				if (powell(&resid, p->nnn2, pv, sr, thr * 0.05, 2000,
-				           efunc3, (void *)p, mppprog, (void *)p) != 0)
-					error ("Powell failed");
-
-#else /* !NODDV */
-				if (conjgrad(&resid, p->nnn2, pv, sr, thr * 0.05, 2000,
-				          efunc3, dfunc3, (void *)p, mppprog, (void *)p) != 0.0)
-					error ("ConjGrad failed");
-#endif /* !NODDV */
-
-				/* Put results back into place */
-				for (i = 0; i < p->nnn2; i++) { 
-					int m = p->c2f[i].ink;
-					int n = p->c2f[i].comb;
-					
-					p->shape[m][n][j] = pv[i];
-//printf("~1 shape[%d][%d] = %f\n",m,n,pv[i]);
-				}
-
-#ifndef DEBUG
-				if (p->verb)
-#endif /* !DEBUG */
-				{
-					banderr(p, &sde, &mxsde, j);		/* Current error */
-					printf("\nNow got avg E of %f, max %f for this band\n",sde, mxsde);
-				}
-#ifdef DEBUG
-				dump_shape(p, 0, "After efunc3:");
-#endif /* DEBUG */
-
-				p->useshape = 1;		/* Would be nice to flag this on a per band basis */
-			}
-
-			/* Tune the vertex parameters */
-
-			if (p->verb)
-				printf("Optimising device combination values itteration %d\n",it);
-		
-			sfunc4(p);	/* Setup test point values for this band */
-
-			/* Get the current values */
-			for (k = 0; k < p->nn; k++) {
-				pv[k] = p->pc[k][j];
-				sr[k] = 0.01;
-			}
-
-#ifdef TESTDFUNC
-			test_dfunc4(p, p->nn, pv);
-#endif /* TESTDFUNC */
-#ifdef NODDV
-			if (powell(&resid, p->nn, pv, sr, thr * 0.01, 500,
-			                 efunc4, (void *)p, mppprog, (void *)p) != 0)
-				error ("Powell failed");
-#else /* !NODDV */
-			if (conjgrad(&resid, p->nn, pv, sr, thr * 0.01, 500,
-			          efunc4, dfunc4, (void *)p, mppprog, (void *)p) != 0)
-				error ("ConjGrad failed");
-#endif /* !NODDV */
-
-			/* Put results back into place */
-			for (k = 0; k < p->nn; k++) {
-				double pp = pv[k];
-				if (pp < 0.0)
-					pp = 0.0;
-				p->pc[k][j] = pp;
-			}
-
-#ifndef DEBUG
-			if (p->verb)
-#endif /* !DEBUG */
-			{
-				banderr(p, &sde, &mxsde, j);		/* Current error */
-				printf("\nNow got avg E of %f, max %f for this band\n",sde, mxsde);
-			}
-		}
-#endif /* MULTIPASS	*/
-
-#ifdef BIGBANG
-		/* Do optimisation with one big bang */
-		{
-			double resid;
-			double *pv2, *pv3, *pv4;	/* Pointers to each group of parameters */
-			double *sr2, *sr3, *sr4;	/* Pointers to each group of search radius */
-			int tparms = p->n * p->cord + p->nnn2 + p->nn;
-
-			pv2 = pv;
-			pv3 = pv + (p->n * p->cord);
-			pv4 = pv + (p->n * p->cord) + p->nnn2;
-			sr2 = sr;
-			sr3 = sr + (p->n * p->cord);
-			sr4 = sr + (p->n * p->cord) + p->nnn2;
-
-			/* Get the current transfer values */
-			for (k = 0; k < p->n; k++) {
-				for (i = 0; i < p->cord; i++) { 
-					pv2[k * p->cord + i] = p->tc[k][j][i];
-					sr2[k * p->cord + i] = 0.005;
-				}
-			}
-			/* Get the current shaper values */
-			for (i = 0; i < p->nnn2; i++) { 
-				int m = p->c2f[i].ink;
-				int n = p->c2f[i].comb;
-				
-				pv3[i] = p->shape[m][n][j];
-				sr3[i] = 0.005;
-			}
-			/* Get the current device combination values */
-			for (k = 0; k < p->nn; k++) {
-				pv4[k] = p->pc[k][j];
-				sr4[k] = 0.005;
-			}
-
-#ifdef TESTDFUNC
-			test_dfunc0(p, tparms, pv);
-#endif /* TESTDFUNC */
-
-			if (conjgrad(&resid, tparms, pv, sr, 0.001, 4000, efunc0, dfunc0, (void *)p,
-			                                                     mppprog, (void *)p) != 0)
-				error ("ConjGrad failed");
-
-			/* Put results back into place */
-			for (k = 0; k < p->n; k++) {
-				for (i = 0; i < p->cord; i++) 
-					p->tc[k][j][i] = pv2[k * p->cord + i];
-			}
-			for (i = 0; i < p->nnn2; i++) { 
-				int m = p->c2f[i].ink;
-				int n = p->c2f[i].comb;
-				
-				p->shape[m][n][j] = pv3[i];
-			}
-			for (k = 0; k < p->nn; k++) {
-				double pp = pv4[k];
-				if (pp < 0.0)
-					pp = 0.0;
-				p->pc[k][j] = pp;
-			}
+		bo[nbo].j = j;
+		bo[nbo].lj = lj;
+		nbo++;
+	}
 
-#ifndef DEBUG
-			if (p->verb)
-#endif /* !DEBUG */
-			{
-				banderr(p, &sde, &mxsde, j);		/* Current error */
-				printf("\nNow got avg E of %f, max %f for this band\n",sde, mxsde);
-			}
-		}
-#endif /* BIGBANG */
+	if (p->bandpar && nbo > 1) {
+		/* Do the first band, then the other spectral bands in parallel */
+		/* starting from it, then the XYZ bands in parallel. */
+		fit_band(p, bo[0].j, bo[0].lj, maxit, useshape, mxtcord);
+		for (k = 1; k < nbo && bo[k].j >= 3; k++)
+			bo[k].lj = bo[0].j;
+		fit_bands(p, bo + 1, k - 1, maxit, useshape, mxtcord);
+		fit_bands(p, bo + k, nbo - k, maxit, useshape, mxtcord);
+	} else {
+		for (k = 0; k < nbo; k++)
+			fit_band(p, bo[k].j, bo[k].lj, maxit, useshape, mxtcord);
 	}
 #endif /* NOPROCESS */
 
@@ -4388,6 +4828,10 @@ static int create(
 	free (p->cols);
 	p->nodp = 0;
 	p->cols = NULL;
+	free(p->brv);
+	free(p->bdv);
+	p->brv = p->bdv = NULL;
+	p->nblk = 0;
 
 	return 0;
 }
@@ -114,6 +114,15 @@ struct _mpp {
 	               double *out,					/* Returned XYZ or Lab */
 	               double *in);					/* Input device values */
 
+	/* Lookup npix XYZ or Lab colors, from in[npix * n] device values */
+	/* to out[npix * 3]. The model is evaluated in parallel, and */
+	/* spectral values are converted to CIE as a batch. */
+	/* [will use spectral and FWA if configured] */
+	void (*lookup_n) (struct _mpp *p,
+	               double *out,					/* Returned XYZ or Lab values */
+	               double *in,					/* Input device values */
+	               int npix);					/* Number of colors */
+
 	/* Lookup an XYZ or Lab color with its partial derivative. */
 	/* [will ignore spectral and FWA even if configured] */
 	void (*dlookup)(struct _mpp *p,
@@ -134,6 +143,15 @@ struct _mpp {
 	/* Return a gamut object, return NULL on error */
 	gamut *(*get_gamut)(struct _mpp *p, double detail);	/* detail level 0.0 = default */
 
+	/* Set the number of threads create() uses to fit the model, */
+	/* and lookup_n() uses to evaluate it, */
+	/* 0 for the default of num_threads(). If bandpar is NZ, the */
+	/* spectral bands are fitted in parallel, each starting from the */
+	/* peak Y band, rather than one after the other each starting from */
+	/* its neighbour. Otherwise the error sums over the test points are */
+	/* done in parallel. The model doesn't depend on the number of threads. */
+	void (*set_threads)(struct _mpp *p, int nthreads, int bandpar);
+
   /* Private: */
 	int verb;				/* Verbose */
 
@@ -175,6 +193,13 @@ struct _mpp {
 	mppcol *cols;			/* List of test points */
 	double spmax;			/* Maximum spectral value of any sample and band */
 
+	/* Threading */
+	int nthreads;			/* Number of threads to use, 0 = default */
+	int bandpar;			/* NZ to fit spectral bands in parallel */
+	int nblk;				/* Number of test point sum blocks */
+	double *brv;			/* [nblk] Block error sums */
+	double *bdv;			/* [nblk * 2 * MPP_MXPARMS] Block gradient sums */
+
 	/* Lookup */
 	icColorSpaceSignature pcs;	/* PCS to return, XYZ, Lab */
 	xsp2cie *spc;			/* Spectral to CIE converter (NULL if using XYZ model) */
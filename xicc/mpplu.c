@@ -23,6 +23,9 @@
 #include <fcntl.h>
 #include <string.h>
 #include <math.h>
+#if defined(O_BINARY) || defined(_O_BINARY)
+# include <io.h>
+#endif
 #include "aconfig.h"
 #include "numlib.h"
 #include "xicc.h"
@@ -30,6 +33,8 @@
 #include "vrml.h"
 #include "ui.h"
 
+#define STRM_BLOCK 4096		/* [4096] Colors per binary stream block */
+
 void usage(void) {
 	fprintf(stderr,"Translate colors through an MPP profile, V1.00\n");
 	fprintf(stderr,"Author: Graeme W. Gill\n");
@@ -48,6 +53,7 @@ void usage(void) {
 	fprintf(stderr," -n         Don't add %s axes\n",vrml_format());
 	fprintf(stderr," -a n       Gamut transparency level\n");
 	fprintf(stderr," -d n       Gamut surface detail level\n");
+	fprintf(stderr," -x f|d     Binary stream of packed float or double values in and out\n");
 	fprintf(stderr," -t num     Invoke debugging test code \"num\" 1..n\n");
 	fprintf(stderr,"            1 - check partial derivative for device input\n");
 	fprintf(stderr,"            2 - create overlap diagnostic %s gamut surface\n",vrml_format());
@@ -61,6 +67,7 @@ void usage(void) {
 
 static void diag_gamut(mpp *p, double gamres, int doaxes, double trans, char *outname);
 static void mpp_rev(mpp *mppo, double limit, double *out, double *in);
+static void stream_lu(mpp *mppo, int devn, int spec_n, int repYxy, int repSpec, int dsz);
 
 int
 main(int argc, char *argv[]) {
@@ -77,6 +84,7 @@ main(int argc, char *argv[]) {
 	int repYxy = 0;			/* Report Yxy */
 	int repSpec = 0;		/* Report Spectral */
 	int bwd = 0;			/* Do reverse lookup */
+	int strm = 0;			/* Binary stream value size, 0 for text */
 	double dlimit;			/* Device ink limit */
 	double limit = -1.0;	/* Used ink limit */
 	int display = 0;		/* NZ if display type */
@@ -299,6 +307,18 @@ main(int argc, char *argv[]) {
 				dogam = 1;
 			}
 
+			/* Binary stream */
+			else if (argv[fa][1] == 'x' || argv[fa][1] == 'X') {
+				fa = nfa;
+				if (na == NULL) usage();
+				if (na[0] == 'f')
+					strm = sizeof(float);
+				else if (na[0] == 'd')
+					strm = sizeof(double);
+				else
+					usage();
+			}
+
 			/* Test code */
 			else if (argv[fa][1] == 't' || argv[fa][1] == 'T') {
 				fa = nfa;
@@ -324,6 +344,10 @@ main(int argc, char *argv[]) {
 	mppo->get_info(mppo, &imask, &devn, &dlimit, &spec_n, &spec_wl_short, &spec_wl_long, NULL, &display);
 	ident = icx_inkmask2char(imask, 1); 
 
+	/* Keep stdout clean for the binary stream */
+	if (strm != 0 && test == 0 && !dogam)
+		verb = 0;
+
 	if (verb) {
 		printf("MPP profile with %d colorants, type %s, TAC %f\n",devn,ident, dlimit);
 		if (display)
@@ -476,8 +500,14 @@ main(int argc, char *argv[]) {
 				pcss = icSigYxyData; 
 		}
 
+		/* Binary stream of colors to translate */
+		if (strm != 0) {
+			if (bwd)
+				error("Binary stream only supports forward lookups");
+			stream_lu(mppo, devn, spec_n, repYxy && pcss == icSigYxyData, repSpec, strm);
+
 		/* Process colors to translate */
-		for (;;) {
+		} else for (;;) {
 			int i,j;
 			char *bp, *nbp;
 
@@ -610,6 +640,101 @@ main(int argc, char *argv[]) {
 }
 
 
+/* Translate a binary stream of packed float (dsz = 4) or double (dsz = 8) */
+/* device values from stdin to stdout, a block of colors at a time. */
+/* PCS lookups use the bulk lookup function. */
+static void stream_lu(
+mpp *mppo,
+int devn,				/* Number of device channels */
+int spec_n,				/* Number of spectral bands */
+int repYxy,				/* nz to convert XYZ to Yxy */
+int repSpec,			/* nz to return spectral values */
+int dsz					/* Size of a stream value */
+) {
+	int inn = devn, outn = repSpec ? spec_n : 3;
+	unsigned char *ibuf, *obuf;
+	double *in, *out;
+
+#if defined(O_BINARY) || defined(_O_BINARY)
+	setmode(fileno(stdin), O_BINARY);
+	setmode(fileno(stdout), O_BINARY);
+#endif
+
+	if ((ibuf = (unsigned char *)malloc(STRM_BLOCK * inn * dsz)) == NULL
+	 || (obuf = (unsigned char *)malloc(STRM_BLOCK * outn * dsz)) == NULL
+	 || (in = (double *)malloc(STRM_BLOCK * inn * sizeof(double))) == NULL
+	 || (out = (double *)malloc(STRM_BLOCK * outn * sizeof(double))) == NULL)
+		error("Malloc of stream buffers failed");
+
+	for (;;) {
+		size_t nr;
+		int i, j, n, ni, no;
+
+		if ((nr = fread(ibuf, inn * dsz, STRM_BLOCK, stdin)) == 0)
+			break;
+		n = (int)nr;
+		ni = n * inn;
+		no = n * outn;
+
+		if (dsz == 4) {
+			float *fp = (float *)ibuf;
+			for (i = 0; i < ni; i++)
+				in[i] = (double)fp[i];
+		} else {
+			memcpy(in, ibuf, ni * sizeof(double));
+		}
+
+		if (repSpec) {
+			xspect ospec;
+
+			for (i = 0; i < n; i++) {
+				mppo->lookup_spec(mppo, &ospec, in + i * inn);
+				for (j = 0; j < outn; j++)
+					out[i * outn + j] = ospec.spec[j];
+			}
+		} else {
+			mppo->lookup_n(mppo, out, in, n);
+
+			if (repYxy) {
+				for (i = 0; i < no; i += outn) {
+					double X = out[i+0];
+					double Y = out[i+1];
+					double Z = out[i+2];
+					double sum = X + Y + Z;
+					if (sum < 1e-6) {
+						out[i+0] = out[i+1] = out[i+2] = 0.0;
+					} else {
+						out[i+0] = Y;
+						out[i+1] = X/sum;
+						out[i+2] = Y/sum;
+					}
+				}
+			}
+		}
+
+		if (dsz == 4) {
+			float *fp = (float *)obuf;
+			for (i = 0; i < no; i++)
+				fp[i] = (float)out[i];
+		} else {
+			memcpy(obuf, out, no * sizeof(double));
+		}
+		if (fwrite(obuf, outn * dsz, n, stdout) != nr)
+			error("Write to stdout failed");
+
+		if (nr < STRM_BLOCK)
+			break;
+	}
+	if (ferror(stdin))
+		error("Read from stdin failed");
+	fflush(stdout);
+
+	free(out);
+	free(in);
+	free(obuf);
+	free(ibuf);
+}
+
 /* -------------------------------------------- */
 /* Code for special gamut surface plot */
 
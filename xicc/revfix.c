@@ -60,6 +60,7 @@ void usage(void) {
 	fprintf(stderr," -l tlimit      set total ink limit, 0 - 400%% (estimate by default)\n");
 	fprintf(stderr," -L klimit      set black ink limit, 0 - 100%% (estimate by default)\n");
 	fprintf(stderr," -p absprof     Include abstract profile in output tables\n");
+	fprintf(stderr," -j n           Use n threads to invert the AtoB1 table (default %d)\n",num_threads());
 //	fprintf(stderr," -s             Use internal optimized separation for CMYK\n");
 	exit(1);
 }
@@ -81,6 +82,8 @@ struct _callback {
 	icRenderingIntent abs_intent;	/* Desired abstract profile rendering intent */
 	icxLuBase *abs_luo;				/* abstract profile tranform in PCS, NULL if none */
 
+	amutex *bwdlock;	/* If not NULL, lock to hold for BtoA inverse lookups */
+
 }; typedef struct _callback callback;
 
 
@@ -194,8 +197,12 @@ void Labp_CMYKp(void *cntx, double out[4], double in[3]) {
 
 		/* Can't assume B2A in/out tables are inverses of AtoB */
 		/* Convert PCS' -> PCS for this table */
+		if (p->bwdlock != NULL)
+			amutex_lock(*p->bwdlock);
 		if (p->BtoA->inv_input(p->BtoA, temp, temp) > 1)
 			error ("%d, %s",p->BtoA->pp->errc,p->BtoA->pp->err);
+		if (p->bwdlock != NULL)
+			amutex_unlock(*p->bwdlock);
 		/* Convert PCS -> PCS' for colorimetric */
 		if (p->AtoB1->inv_output(p->AtoB1, temp, temp) > 1)
 			error ("%d, %s",p->AtoB->pp->errc,p->AtoB->pp->err);
@@ -229,8 +236,12 @@ void Labp_CMYKp(void *cntx, double out[4], double in[3]) {
 		if (p->AtoB1->inv_input(p->AtoB1, out, out) > 1)
 			error ("%d, %s",p->AtoB->pp->errc,p->AtoB->pp->err);
 		/* Convert DEV -> DEV' for this table */
+		if (p->bwdlock != NULL)
+			amutex_lock(*p->bwdlock);
 		if (p->BtoA->inv_output(p->BtoA, out, out) > 1)
 			error ("%d, %s",p->BtoA->pp->errc,p->BtoA->pp->err);
+		if (p->bwdlock != NULL)
+			amutex_unlock(*p->bwdlock);
 	}
 #ifdef DEBUG
 	printf("New CMYK' %f %f %f %f\n",out[0],out[1],out[2],out[3]);
@@ -271,6 +282,171 @@ void CMYKp_CMYK(void *cntx, double out[4], double in[4]) {
 }
 
 
+/* ------------------------------------------- */
+/* Setting the tables using threads. The clut points that set_tables() */
+/* needs are recorded first, then computed by the threads, each with */
+/* its own AtoB1 inverse lookup context, and then played back. */
+
+#define THR_CHUNK 64		/* Points a thread takes at a time */
+
+typedef struct {
+	callback *cb;			/* Callback context for the input and output tables */
+	callback *tcb;			/* Per thread callback contexts */
+	int npts, apts;			/* Number of points recorded, allocated */
+	double *in;				/* npts Lab' values */
+	double *out;			/* npts CMYK' results */
+	int ix;					/* Next point to play back */
+	amutex lock;			/* Lock for next and the progress count */
+	int next;				/* Next point to be computed */
+} thrcntx;
+
+static void Lab_Labp_thr(void *cntx, double out[3], double in[3]) {
+	Lab_Labp((void *)((thrcntx *)cntx)->cb, out, in);
+}
+
+static void CMYKp_CMYK_thr(void *cntx, double out[4], double in[4]) {
+	CMYKp_CMYK((void *)((thrcntx *)cntx)->cb, out, in);
+}
+
+/* Record clut callback */
+static void Labp_CMYKp_rec(void *cntx, double out[4], double in[3]) {
+	thrcntx *p = (thrcntx *)cntx;
+
+	if (p->npts >= p->apts) {
+		p->apts = p->apts * 2 + 1024;
+		if ((p->in = (double *)realloc(p->in, p->apts * 3 * sizeof(double))) == NULL
+		 || (p->out = (double *)realloc(p->out, p->apts * 4 * sizeof(double))) == NULL)
+			error("Malloc of BtoA point list failed");
+	}
+	p->in[p->npts * 3 + 0] = in[0];
+	p->in[p->npts * 3 + 1] = in[1];
+	p->in[p->npts * 3 + 2] = in[2];
+	p->npts++;
+
+	out[0] = out[1] = out[2] = out[3] = 0.0;	/* Something harmless */
+}
+
+/* Playback clut callback */
+static void Labp_CMYKp_play(void *cntx, double out[4], double in[3]) {
+	thrcntx *p = (thrcntx *)cntx;
+
+	if (p->ix >= p->npts
+	 || in[0] != p->in[p->ix * 3 + 0]
+	 || in[1] != p->in[p->ix * 3 + 1]
+	 || in[2] != p->in[p->ix * 3 + 2])
+		error("Internal, BtoA playback doesn't match the recording");
+
+	out[0] = p->out[p->ix * 4 + 0];
+	out[1] = p->out[p->ix * 4 + 1];
+	out[2] = p->out[p->ix * 4 + 2];
+	out[3] = p->out[p->ix * 4 + 3];
+	p->ix++;
+}
+
+/* Compute thread */
+static int Labp_CMYKp_thread(void *cntx, int ix, int nth) {
+	thrcntx *p = (thrcntx *)cntx;
+	callback *cb = p->cb;
+	int i, j, done = 0;
+
+	for (;;) {
+		amutex_lock(p->lock);
+		if (cb->verb && done > 0) {		/* Output percent intervals */
+			int pc;
+			cb->count += done;
+			pc = (int)(cb->count * 100.0/cb->total + 0.5);
+			if (pc != cb->last) {
+				printf("%c%2d%%",cr_char,pc), fflush(stdout);
+				cb->last = pc;
+			}
+		}
+		i = p->next;
+		p->next += THR_CHUNK;
+		amutex_unlock(p->lock);
+
+		if (i >= p->npts)
+			break;
+		if ((j = i + THR_CHUNK) > p->npts)
+			j = p->npts;
+		for (done = 0; i < j; i++, done++) {
+			double *out = p->out + i * 4;
+			out[0] = p->in[i * 3 + 0];		/* Same aliasing as set_tables() */
+			out[1] = p->in[i * 3 + 1];
+			out[2] = p->in[i * 3 + 2];
+			Labp_CMYKp((void *)&p->tcb[ix], out, out);
+		}
+	}
+	return 0;
+}
+
+/* Set the Lab->CMYK table using nthreads, 0 for the default number. */
+/* Return as set_tables() */
+static int set_tables_thr(int nthreads, callback *cb, icmLut *wo) {
+	thrcntx tx;
+	amutex bwdlock;
+	int i, rv;
+
+	if (nthreads <= 0)
+		nthreads = num_threads();
+	if (nthreads > NUMTHR_MAX)
+		nthreads = NUMTHR_MAX;
+
+	if (nthreads == 1) {
+		return wo->set_tables(wo, ICM_CLUT_SET_APXLS, cb,
+		                      icSigLabData, icSigCmykData,
+		                      Lab_Labp, NULL, NULL, Labp_CMYKp, NULL, NULL,
+		                      CMYKp_CMYK, NULL, NULL);
+	}
+
+	memset((void *)&tx, 0, sizeof(thrcntx));
+	tx.cb = cb;
+
+	/* Find out what points are needed */
+	if ((rv = wo->set_tables(wo, ICM_CLUT_SET_APXLS, &tx,
+	                      icSigLabData, icSigCmykData,
+	                      Lab_Labp_thr, NULL, NULL, Labp_CMYKp_rec, NULL, NULL,
+	                      CMYKp_CMYK_thr, NULL, NULL)) != 0) {
+		free(tx.in);
+		free(tx.out);
+		return rv;
+	}
+
+	/* Create the per thread contexts. The BtoA inverse lookups */
+	/* are only 1D, so they are serialized rather than duplicated. */
+	if ((tx.tcb = (callback *)calloc(nthreads, sizeof(callback))) == NULL)
+		error("Malloc of BtoA thread contexts failed");
+	amutex_init(bwdlock);
+	for (i = 0; i < nthreads; i++) {
+		tx.tcb[i] = *cb;
+		tx.tcb[i].verb = 0;		/* Progress is done by Labp_CMYKp_thread() */
+		tx.tcb[i].bwdlock = &bwdlock;
+		if ((tx.tcb[i].AtoB1 = cb->AtoB1->inv_thread_ctx(cb->AtoB1, nthreads)) == NULL)
+			error("Creating BtoA thread context failed: %d, %s",cb->AtoB1->pp->errc,cb->AtoB1->pp->err);
+		if (cb->AtoB == cb->AtoB1)
+			tx.tcb[i].AtoB = tx.tcb[i].AtoB1;
+	}
+	amutex_init(tx.lock);
+
+	par_exec(nthreads, Labp_CMYKp_thread, (void *)&tx);
+
+	amutex_del(tx.lock);
+	for (i = 0; i < nthreads; i++)
+		tx.tcb[i].AtoB1->del((icxLuBase *)tx.tcb[i].AtoB1);
+	free(tx.tcb);
+	amutex_del(bwdlock);
+
+	/* Set the tables from the results */
+	tx.ix = 0;
+	rv = wo->set_tables(wo, ICM_CLUT_SET_APXLS, &tx,
+	                    icSigLabData, icSigCmykData,
+	                    Lab_Labp_thr, NULL, NULL, Labp_CMYKp_play, NULL, NULL,
+	                    CMYKp_CMYK_thr, NULL, NULL);
+
+	free(tx.in);
+	free(tx.out);
+	return rv;
+}
+
 /* ------------------------------------------- */
 
 int
@@ -292,6 +468,7 @@ main(int argc, char *argv[]) {
 	double tlimit = -1.0;	/* Total ink limit */
 	double klimit = -1.0;	/* Black ink limit */
 	int intsep = 0;			/* Not implimented in xicc yet ??? */
+	int nthreads = 0;		/* Threads to use, 0 = default */
 	int rv = 0;
 
 	error_program = argv[0];
@@ -418,6 +595,15 @@ main(int argc, char *argv[]) {
 				strncpy(abs_name,na,MAXNAMEL); abs_name[MAXNAMEL] = '\000';
 			}
 
+			/* Number of threads */
+			else if (argv[fa][1] == 'j' || argv[fa][1] == 'J') {
+				fa = nfa;
+				if (na == NULL) usage();
+				nthreads = atoi(na);
+				if (nthreads < 1)
+					usage();
+			}
+
 			else 
 				usage();
 		} else
@@ -593,6 +779,7 @@ main(int argc, char *argv[]) {
 		cb.count = 0;
 		cb.last = -1;
 		cb.inking = inking;
+		cb.bwdlock = NULL;
 
 		/* Setup our access to the device characteristic */
 		if ((cb.AtoB1 = (icxLuLut *)xicco->get_luobj(xicco,
@@ -745,18 +932,7 @@ main(int argc, char *argv[]) {
 					printf(" 0%%"), fflush(stdout);
 				}
 				/* Use helper function to do the hard work. */
-				if (wo->set_tables(wo,
-						ICM_CLUT_SET_APXLS,
-						&cb,				/* Context */
-						icSigLabData, 		/* Input color space */
-						icSigCmykData, 		/* Output color space */
-						Lab_Labp,			/* Linear input transform Lab->Lab' */
-						NULL, NULL,			/* Use default Lab' range */
-						Labp_CMYKp,			/* Lab' -> CMYK' transfer function */
-						NULL, NULL,			/* Use default CMYK' range */
-						CMYKp_CMYK,		 	/* Output transfer function, CMYK'->CMYK */
-						NULL, NULL			/* default APXLS range */
-				) != 0)
+				if (set_tables_thr(nthreads, &cb, wo) != 0)
 					error("Setting 16 bit Lab->CMYK Lut failed: %d, %s",icco->errc,icco->err);
 	
 				if (verb)
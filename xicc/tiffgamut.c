@@ -50,13 +50,15 @@
 #undef NOCAMGAM_CLIP		/* No clip to CAM gamut before CAM lookup */
 #undef DEBUG				/* Dump filter cell contents */
 
+#define GBUFPTS 1048576		/* Number of pixels buffered for gamut expand_n() */
+
 #if !defined(O_CREAT) && !defined(_O_CREAT)
 # error "Need to #include fcntl.h!"
 #endif
 
 void set_fminmax(double min[3], double max[3]);
 void reset_filter();
-void add_fpixel(double val[3]);
+void add_fpixel(double val[3], unsigned int count);
 void flush_filter(int verb, gamut *gam, double filtperc);
 void del_filter();
 
@@ -67,11 +69,16 @@ void usage(void) {
 	fprintf(stderr,"usage: tiffgamut [-v level] [profile.icm | embedded.tif/jpg] infile1.tif/jpg [infile2.tif/jpg ...] \n");
 	fprintf(stderr," -v            Verbose\n");
 	fprintf(stderr," -d sres       Surface resolution details 1.0 - 50.0\n");
+	fprintf(stderr," -b nlod       Write a binary .gam file, with nlod coarser levels of detail\n");
 	fprintf(stderr," -w            emit %s %s file as well as CGATS .gam file\n",vrml_format(),vrml_ext());
 	fprintf(stderr," -n            Don't add %s axes or white/black point\n",vrml_format());
 	fprintf(stderr," -k            Add %s markers for prim. & sec. \"cusp\" points\n",vrml_format());
 	fprintf(stderr,"               (set env. ARGYLL_3D_DISP_FORMAT to VRML, X3D or X3DOM to change format)\n");
 	fprintf(stderr," -f perc       Filter by popularity, perc = percent to use\n");
+	fprintf(stderr," -u            Only convert the unique device values of each raster\n");
+	fprintf(stderr," -q bits       Quantize the unique device values to bits per channel (implies -u)\n");
+	fprintf(stderr," -s n          Subsample, only using every n'th pixel of every n'th line\n");
+	fprintf(stderr," -j n          Use n threads to convert unique values (default %d)\n",num_threads());
 	fprintf(stderr," -i intent     p = perceptual, r = relative colorimetric,\n");
 	fprintf(stderr,"               s = saturation, a = absolute (default), d = profile default\n");
 //  fprintf(stderr,"               P = absolute perceptual, S = absolute saturation\n");
@@ -330,6 +337,230 @@ J_COLOR_SPACE cspace
 	return buf;
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Device pixel value to PCS conversion */
+
+typedef struct {
+	icxLuBase *luo;					/* Device to PCS lookup, NULL if Lab raster */
+	icc *icco;						/* Profile of luo */
+	icColorSpaceSignature outs;		/* Output space of luo */
+	icxcam *cam;					/* Lab to Jab conversion, NULL if none */
+	void (*cvt)(double *out, double *in);	/* TIFF conversion function, NULL if none */
+} pixconv;
+
+/* Convert a 0.0 .. 1.0 device value to PCS. */
+/* The luo and cam lookups are thread safe once set up, */
+/* so this may be called by several threads at once. */
+/* Return nz on an error */
+static int pixel2pcs(pixconv *p, double out[MAX_CHAN], double in[MAX_CHAN]) {
+	int i, rv;
+
+	if (p->cvt != NULL) {	/* Undo TIFF encoding */
+		p->cvt(in, in);
+	}
+	/* ICC profile to convert RGB to Lab or Jab */
+	if (p->luo != NULL) {
+		if ((rv = p->luo->lookup(p->luo, out, in)) > 1)
+			return rv;
+		
+		if (p->outs == icSigXYZData) {	/* Convert to Lab */
+			icmXYZ2Lab(&p->icco->header->illuminant, out, out);
+		}
+	/* Lab TIFF - may need to convert to Jab */
+	} else if (p->cam != NULL) {
+		icmLab2XYZ(&icmD50, out, in);
+		p->cam->XYZ_to_cam(p->cam, out, out);
+
+	} else {
+		for (i = 0; i < 3; i++)
+			out[i] = in[i];
+	}
+	return 0;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* A device value occupancy grid. Each pixels device value is quantized */
+/* and packed into a 64 bit key, and the occupied cells are kept in an */
+/* open addressing hash table, so that only the unique device values */
+/* need to be converted to PCS. */
+
+#define DGRIDBITS 12		/* Maximum bits per channel 16 bit values are quantized to */
+#define DGRIDISIZE 65536	/* Initial hash table size (power of 2) */
+
+/* An occupied cell */
+typedef struct {
+	ORD64 key;				/* Packed quantized device value */
+	unsigned int count;		/* Number of pixels in this cell, 0 if empty */
+} dent;
+
+typedef struct {
+	int di;					/* Number of device channels */
+	int bps;				/* Bits per sample of the raster */
+	int bits;				/* Quantized bits per channel */
+	unsigned int size;		/* Size of hash table, power of 2 */
+	unsigned int n;			/* Number of occupied cells */
+	dent *ents;				/* Hash table */
+} dgrid;
+
+/* Create a grid for di channels of bps bits, quantized */
+/* to qbits per channel if qbits > 0 */
+static dgrid *new_dgrid(int di, int bps, int qbits) {
+	dgrid *p;
+
+	if ((p = (dgrid *) calloc(1, sizeof(dgrid))) == NULL)
+		error("dgrid: calloc failed");
+
+	p->di = di;
+	p->bps = bps;
+	p->bits = bps > DGRIDBITS ? DGRIDBITS : bps;
+	if (qbits > 0 && qbits < p->bits)
+		p->bits = qbits;
+	if (p->bits * di > 64)
+		p->bits = 64/di;
+	p->size = DGRIDISIZE;
+	if ((p->ents = (dent *) calloc(p->size, sizeof(dent))) == NULL)
+		error("dgrid: calloc failed");
+
+	return p;
+}
+
+static void del_dgrid(dgrid *p) {
+	if (p != NULL) {
+		free(p->ents);
+		free(p);
+	}
+}
+
+/* Return the hash table index to start probing for a key at */
+static unsigned int dgrid_hash(dgrid *p, ORD64 key) {
+	key *= 0x9E3779B97F4A7C15ULL;
+	return (unsigned int)(key >> 32) & (p->size-1);
+}
+
+/* Add count pixels with the given packed key */
+static void dgrid_addkey(dgrid *p, ORD64 key, unsigned int count) {
+	unsigned int i;
+
+	for (i = dgrid_hash(p, key); p->ents[i].count != 0; i = (i + 1) & (p->size-1)) {
+		if (p->ents[i].key == key) {
+			p->ents[i].count += count;
+			return;
+		}
+	}
+	p->ents[i].key = key;
+	p->ents[i].count = count;
+
+	/* Keep the table at most half full */
+	if (++p->n > (p->size/2)) {
+		dent *oents = p->ents;
+		unsigned int j, osize = p->size;
+
+		p->size *= 2;
+		p->n = 0;
+		if ((p->ents = (dent *) calloc(p->size, sizeof(dent))) == NULL)
+			error("dgrid: calloc failed on %u entries",p->size);
+		for (j = 0; j < osize; j++) {
+			if (oents[j].count != 0)
+				dgrid_addkey(p, oents[j].key, oents[j].count);
+		}
+		free(oents);
+	}
+}
+
+/* Add a pixel of sign corrected raw bps bit values */
+static void add_dpixel(dgrid *p, int *v) {
+	int i, sh = p->bps - p->bits;
+	unsigned int qmax = (1 << p->bits) - 1;
+	unsigned int vmax = (1 << p->bps) - 1;
+	ORD64 key = 0;
+
+	for (i = 0; i < p->di; i++) {
+		unsigned int q = v[i];
+		if (sh > 0)		/* Round to the nearest quantized value */
+			q = (q * qmax + vmax/2)/vmax;
+		key = (key << p->bits) | q;
+	}
+	dgrid_addkey(p, key, 1);
+}
+
+/* Unpack a key into a 0.0 .. 1.0 device value */
+static void dgrid_dev(dgrid *p, double *in, ORD64 key) {
+	int i;
+	unsigned int qmax = (1 << p->bits) - 1;
+
+	for (i = p->di-1; i >= 0; i--) {
+		in[i] = (key & qmax)/(double)qmax;
+		key >>= p->bits;
+	}
+}
+
+/* Context for converting the occupied cells in parallel */
+typedef struct {
+	pixconv *pc;
+	dgrid *g;
+	dent **ents;		/* Occupied cells */
+	unsigned int n;		/* Number of occupied cells */
+	double *pcs;		/* Returned PCS values, n * 3 */
+} dconv_cx;
+
+static int dconv_thread(void *cntx, int ix, int nth) {
+	dconv_cx *cx = (dconv_cx *)cntx;
+	unsigned int i, si, ei;
+	int rv;
+
+	si = (unsigned int)(((double)cx->n * ix)/nth);
+	ei = (unsigned int)(((double)cx->n * (ix+1))/nth);
+
+	for (i = si; i < ei; i++) {
+		double in[MAX_CHAN], out[MAX_CHAN];
+
+		dgrid_dev(cx->g, in, cx->ents[i]->key);
+		if ((rv = pixel2pcs(cx->pc, out, in)) != 0)
+			return rv;
+		cx->pcs[3 * i + 0] = out[0];
+		cx->pcs[3 * i + 1] = out[1];
+		cx->pcs[3 * i + 2] = out[2];
+	}
+	return 0;
+}
+
+/* Convert the occupied cells to PCS using nthreads threads. */
+/* Return the number of cells, and the PCS values and their pixel */
+/* counts in allocated arrays. */
+static unsigned int dgrid_convert(dgrid *p, pixconv *pc, int nthreads,
+                                  double **ppcs, unsigned int **pcount) {
+	dconv_cx cx;
+	unsigned int i, j;
+	int rv;
+
+	cx.pc = pc;
+	cx.g = p;
+	cx.n = p->n;
+	if ((cx.ents = (dent **) malloc(sizeof(dent *) * (p->n + 1))) == NULL
+	 || (cx.pcs = (double *) malloc(sizeof(double) * 3 * (p->n + 1))) == NULL
+	 || (*pcount = (unsigned int *) malloc(sizeof(unsigned int) * (p->n + 1))) == NULL)
+		error("dgrid: malloc failed on %u cells",p->n);
+
+	for (i = j = 0; i < p->size; i++) {
+		if (p->ents[i].count != 0) {
+			(*pcount)[j] = p->ents[i].count;
+			cx.ents[j++] = &p->ents[i];
+		}
+	}
+
+	if (nthreads > (int)(cx.n/1000))		/* Not worth a thread each */
+		nthreads = cx.n/1000;
+	if (nthreads < 1)
+		nthreads = 1;
+
+	if ((rv = par_exec(nthreads, dconv_thread, (void *)&cx)) != 0)
+		error ("%d, %s",pc->icco->errc,pc->icco->err);
+
+	free(cx.ents);
+	*ppcs = cx.pcs;
+	return cx.n;
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 int
 main(int argc, char *argv[]) {
@@ -342,9 +573,9 @@ main(int argc, char *argv[]) {
 	int vrml = 0;
 	int doaxes = 1;
 	int docusps = 0;
+	int nlod = -1;				/* Binary .gam levels of detail, -1 = CGATS */
 	int filter = 0;
 	double filtperc = 100.0;
-	int rv = 0;
 
 	icc *icco = NULL;
 	xicc *xicco = NULL;
@@ -398,6 +629,14 @@ main(int argc, char *argv[]) {
 
 	double gamres = GAMRES;				/* Surface resolution */
 	gamut *gam;
+	double *gbuf = NULL;				/* Buffered points to expand gamut with */
+	int gbn = 0;						/* Number of buffered points */
+	int unique = 0;						/* Convert unique device values only */
+	int nthreads = 0;					/* Threads for unique conversion, 0 = default */
+	int qbits = 0;						/* Unique value quantization bits, 0 = default */
+	int subs = 1;						/* Pixel subsampling factor */
+	dgrid *dg = NULL;					/* Device value occupancy grid */
+	pixconv pc;							/* Pixel conversion context */
 
 	double apcsmin[3], apcsmax[3];		/* Actual PCS range */
 
@@ -595,6 +834,12 @@ main(int argc, char *argv[]) {
 				if (na == NULL) usage();
 				gamres = atof(na);
 			}
+			/* Binary gamut file */
+			else if (argv[fa][1] == 'b' || argv[fa][1] == 'B') {
+				fa = nfa;
+				if (na == NULL) usage();
+				nlod = atoi(na);
+			}
 			/* Filtering */
 			else if (argv[fa][1] == 'f' || argv[fa][1] == 'F') {
 				fa = nfa;
@@ -604,6 +849,35 @@ main(int argc, char *argv[]) {
 					usage();
 				filter = 1;
 			}
+			/* Unique device values */
+			else if (argv[fa][1] == 'u' || argv[fa][1] == 'U') {
+				unique = 1;
+			}
+			/* Unique device value quantization */
+			else if (argv[fa][1] == 'q' || argv[fa][1] == 'Q') {
+				fa = nfa;
+				if (na == NULL) usage();
+				qbits = atoi(na);
+				if (qbits < 2 || qbits > 16)
+					usage();
+				unique = 1;
+			}
+			/* Subsampling */
+			else if (argv[fa][1] == 's' || argv[fa][1] == 'S') {
+				fa = nfa;
+				if (na == NULL) usage();
+				subs = atoi(na);
+				if (subs < 1)
+					usage();
+			}
+			/* Number of threads */
+			else if (argv[fa][1] == 'j' || argv[fa][1] == 'J') {
+				fa = nfa;
+				if (na == NULL) usage();
+				nthreads = atoi(na);
+				if (nthreads < 1)
+					usage();
+			}
 
 			/* Expand gamut cylindrically */
 			else if (argv[fa][1] == 'x') {
@@ -875,6 +1149,19 @@ main(int argc, char *argv[]) {
 	/* Creat a raster gamut surface */
 	gam = new_gamut(gamres, pcsor == icxSigJabData, 1);
 
+	pc.luo = luo;
+	pc.icco = icco;
+	pc.outs = outs;
+	pc.cam = cam;
+
+	if (nthreads <= 0)
+		nthreads = num_threads();
+
+	if (!filter && !unique) {
+		if ((gbuf = (double *)malloc(GBUFPTS * 3 * sizeof(double))) == NULL)
+			error("Malloc failed on gamut point buffer");
+	}
+
 	apcsmin[0] = apcsmin[1] = apcsmin[2] = 1e6;
 	apcsmax[0] = apcsmax[1] = apcsmax[2] = -1e6;
 
@@ -1065,11 +1352,17 @@ main(int argc, char *argv[]) {
 				error("failed to read JPEG line of file '%s' [%s]",in_name, jpeg_rerr.message);
 			}
 		}
+		pc.cvt = cvt;
+
+		if (unique)
+			dg = new_dgrid(samplesperpixel - extrasamples, bitspersample, qbits);
 
 		for (y = 0; y < height; y++) {
 
 			/* Read in the next line */
 			if (rh) {
+				if ((y % subs) != 0)
+					continue;
 				if (TIFFReadScanline(rh, inbuf, y, 0) < 0)
 					error ("Failed to read TIFF line %d",y);
 			} else {
@@ -1079,14 +1372,35 @@ main(int argc, char *argv[]) {
 					for (cp = (unsigned char *)inbuf; cp < ep; cp++)
 						*cp = ~*cp;
 				}
+				if ((y % subs) != 0)
+					continue;
 			}
 
 			/* Do floating point conversion */
-			for (x = 0; x < width; x++) {
+			for (x = 0; x < width; x += subs) {
 				int i;
 				double in[MAX_CHAN], out[MAX_CHAN];
 				
 //printf("~1 location %d,%d\n",x,y);
+				/* Just note the device value in the occupancy grid */
+				if (dg != NULL) {
+					int v[MAX_CHAN];
+
+					for (i = 0; i < dg->di; i++) {
+						if (bitspersample == 8) {
+							v[i] = ((unsigned char *)inbuf)[x * samplesperpixel + i];
+							if (sign_mask & (1 << i))
+								v[i] = (v[i] & 0x80) ? v[i] - 0x80 : v[i] + 0x80;
+						} else {
+							v[i] = ((unsigned short *)inbuf)[x * samplesperpixel + i];
+							if (sign_mask & (1 << i))
+								v[i] = (v[i] & 0x8000) ? v[i] - 0x8000 : v[i] + 0x8000;
+						}
+					}
+					add_dpixel(dg, v);
+					continue;
+				}
+
 				if (bitspersample == 8) {
 					for (i = 0; i < samplesperpixel; i++) {
 						int v = ((unsigned char *)inbuf)[x * samplesperpixel + i];
@@ -1108,33 +1422,8 @@ main(int argc, char *argv[]) {
 //printf("~1 in[%d] = %f\n",i,in[i]);
 					}
 				}
-				if (cvt != NULL) {	/* Undo TIFF encoding */
-					cvt(in, in);
-				}
-				/* ICC profile to convert RGB to Lab or Jab */
-				if (luo != NULL) {
-//printf("~1 RGB in value = %f %f %f\n",in[0],in[1],in[2]);
-					if ((rv = luo->lookup(luo, out, in)) > 1)
-						error ("%d, %s",icco->errc,icco->err);
-//printf("~1 after luo = %f %f %f\n",out[0],out[1],out[2]);
-					
-					if (outs == icSigXYZData) {	/* Convert to Lab */
-						icmXYZ2Lab(&icco->header->illuminant, out, out);
-//printf("~1 after XYZ2Lab = %f %f %f\n",out[0],out[1],out[2]);
-					}
-				/* Lab TIFF - may need to convert to Jab */
-				} else if (cam != NULL) {
-//printf("~1 Lab in value = %f %f %f\n",in[0],in[1],in[2]);
-					icmLab2XYZ(&icmD50, out, in);
-//printf("~1 XYZ = %f %f %f\n",out[0],out[1],out[2]);
-					cam->XYZ_to_cam(cam, out, out);
-//printf("~1 Jab = %f %f %f\n",out[0],out[1],out[2]);
-
-				} else {
-//printf("~1 Lab value = %f %f %f\n",in[0],in[1],in[2]);
-					for (i = 0; i < samplesperpixel; i++)
-						out[i] = in[i];
-				}
+				if (pixel2pcs(&pc, out, in) != 0)
+					error ("%d, %s",icco->errc,icco->err);
 
 				for (i = 0; i < 3; i++) {
 					if (out[i] < apcsmin[i]) {
@@ -1147,9 +1436,15 @@ main(int argc, char *argv[]) {
 					}
 				}
 				if (filter)
-					add_fpixel(out);
-				else
-					gam->expand(gam, out);
+					add_fpixel(out, 1);
+				else {
+					for (i = 0; i < 3; i++)
+						gbuf[3 * gbn + i] = out[i];
+					if (++gbn >= GBUFPTS) {
+						gam->expand_n(gam, gbuf, gbn, 0);
+						gbn = 0;
+					}
+				}
 			}
 		}
 
@@ -1167,9 +1462,42 @@ main(int argc, char *argv[]) {
 				error("Error closing JPEG input file '%s'\n",in_name);
 		}
 
+		/* Convert the unique device values */
+		if (dg != NULL) {
+			double *pcs;
+			unsigned int *count, n, j;
+
+			n = dgrid_convert(dg, &pc, nthreads, &pcs, &count);
+
+			if (verb)
+				printf("%d x %d pixels had %u unique device values\n\n",width,height,n);
+
+			for (j = 0; j < n; j++) {
+				int i;
+				for (i = 0; i < 3; i++) {
+					if (pcs[3 * j + i] < apcsmin[i])
+						apcsmin[i] = pcs[3 * j + i];
+					if (pcs[3 * j + i] > apcsmax[i])
+						apcsmax[i] = pcs[3 * j + i];
+				}
+				if (filter)
+					add_fpixel(pcs + 3 * j, count[j]);
+			}
+			if (!filter && n > 0)
+				gam->expand_n(gam, pcs, n, 0);
+
+			free(pcs);
+			free(count);
+			del_dgrid(dg);
+			dg = NULL;
+		}
+
 		/* If filtering, flush filtered points to the gamut */
 		if (filter) {
 			flush_filter(verb, gam, filtperc);
+		} else if (gbn > 0) {
+			gam->expand_n(gam, gbuf, gbn, 0);
+			gbn = 0;
 		}
 	}
 
@@ -1178,6 +1506,8 @@ main(int argc, char *argv[]) {
 
 	if (filter)
 		del_filter();
+	if (gbuf != NULL)
+		free(gbuf);
 	
 	/* Get White and Black points from the profile, and set them in the gamut. */
 	if (luo != NULL) {
@@ -1218,7 +1548,10 @@ main(int argc, char *argv[]) {
 	}
 
 	/* Create the VRML/X3D file */
-	if (gam->write_gam(gam,out_name))
+	if (nlod >= 0) {
+		if (gam->write_bgam(gam, out_name, nlod))
+			error ("write gamut failed on '%s'",out_name);
+	} else if (gam->write_gam(gam,out_name))
 		error ("write gamut failed on '%s'",out_name);
 
 	if (vrml) {
@@ -1280,7 +1613,7 @@ void set_fminmax(double min[3], double max[3]) {
 }
 
 /* Add another pixel to the filter */
-void add_fpixel(double val[3]) {
+void add_fpixel(double val[3], unsigned int count) {
 	int j;
 	int qv[3];
 	fent *fe;
@@ -1320,7 +1653,7 @@ void add_fpixel(double val[3]) {
 		fe->pcs[2] = val[2];
 //printf("Updated pcs to %f %f %f\n", val[0],val[1],val[2]);
 	}
-	fe->count++;
+	fe->count += count;
 //printf("Cell count = %d\n",fe->count);
 }
 
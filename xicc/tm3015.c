@@ -251,41 +251,18 @@ static void ciecam02_ucs(double Jabd[3], double Aw, double mat[3][3], double inX
 /* IES TM-30-15 evaluation samples */
 static xspect TM3015_ECS[IES_TM_30_15_ESAMPLES];	/* Forward declaration */
 
-/* Comute IES TM-30-15 */
+/* Create the reference illuminant for the test sample tsamp, */
+/* and compute its CCT and signed dU'V' to the locus. */
 /* Return 1 on invalid, 2 on error */
-/* Invalid is when sample is not white enough. */
-int icx_IES_TM_30_15(
-double *pRf,			/* Return Rf */
-double *pRg,			/* Return Rg */
+static int tm3015_ref(
+xspect *rspec,			/* Return reference illuminant spectrum */
 double *pcct,			/* Return correlated color temperature */
 double *pdc,			/* Return signed dU'V' to locus */
-double pbins[IES_TM_30_15_BINS][2][3],		/* If not NULL, return ref & tsamp Jab */
-xspect *tsamp			/* Illuminant test sample to compute TLCI of */
+xsp2cie *tocie2,		/* 2 degree spectral illuminant to XYZ conversion */
+xspect *tsamp			/* Illuminant test sample */
 ) {
-	// Test source = input test sample
-	// Ref. source = reference Plankian/D type illuminant
-
-	// Use 380 - 780 nm, 1nm spectral calculation
-
-	// XYZ values are normalized to have Y == 1
-
-	// Normalize plankian and D type to have Y == 100 before blending
-	// and scale result so that Y == 100
-
-	// Compute 10 degree XYZ values for all CES for test & ref. illuminants,
-	// and normalize each to Y = 100.
-	
-	// Convert to CIECAM02 Jab using the fom detailed in 3.7.1 thru 3.7.23
-
-	// Compute Rf according to 3.9.1 & 3.9.2
-	// Compute Rg according to 3.10.1
-
 	int i;
 	double cct;			/* CCT of test sample */
-	xsp2cie *tocie2;	/* spectral illuminant to XYZ conversion 2 degree */
-	xsp2cie *tocie10;	/* spectral illuminant to XYZ conversion 10 degree */
-	xsp2cie *tocie10r, *tocie10s;	/* spectral reflectance to XYZ conversion 10 degree */
-	xspect rspec;		/* Reference white spectrum */
 	double tiXYZ[3];	/* Sample illuminant XYZ */
 	double riXYZ[3];	/* Reference illuminant XYZ */
 	double tUCS[3];		/* Sample CIE 1960 UCS */
@@ -293,39 +270,8 @@ xspect *tsamp			/* Illuminant test sample to compute TLCI of */
 	double tYxy[3], rYxy[3];
 	double tsampnorm;
 	double dc;			/* delta of test sample to reference white in 1960 UCS */
-
-	double rcat[3][3], tcat[3][3];	/* Ref White chromatic adapation matrix */
-	double rAw, tAw;	/* acromatic response of white */
-	double mdE;			/* Mean delta E */
-	double Rfd;
-
-	double esamps[IES_TM_30_15_ESAMPLES][2][3];	/* Evaluation sample Jab values */
-
-	int bcount[IES_TM_30_15_BINS];
-	double _bins[IES_TM_30_15_BINS][2][3];
-	double (*bins)[2][3];
-
-	double rArea, tArea;
-
-	double Rf = -1.0, Rg = -1.0;
 	int rv = 0;
 
-	DBGF((DBGA,"icx_IES_TM_30_15 called\n"))
-
-	bins = (pbins != NULL) ? pbins : _bins;
-
-	// Use CIE1931 2 deg for CCT, xy anxd u'v'
-	/* Create spectral to XYZ for CCT etc. */
-	if ((tocie2 = new_xsp2cie(icxIT_none, 0.0, NULL, icxOT_CIE_1931_2, NULL, icSigXYZData, 1)) == NULL) {
-		//DBGF((DBGA,"Ref new_xsp2cie 2 degreefailed\n"))
-		return 2;   
-	}
-
-#ifdef USE_5NM
-#   pragma message("###### tm3015.c set to 5nm !!! ######")
-	tocie2->set_int_steps(tocie2, 5.0, 380.0, 780.0);
-#endif
-
 	/* Compute the 2 degree XYZ of the test sample */
 	tocie2->convert(tocie2, tiXYZ, tsamp);
 
@@ -345,12 +291,12 @@ xspect *tsamp			/* Illuminant test sample to compute TLCI of */
 
 	/* Create a reference white spectrum with the same CCT. */
 	if (cct <= 4500.0) {
-		if (standardIlluminant(&rspec, icxIT_Ptemp, cct)) {
+		if (standardIlluminant(rspec, icxIT_Ptemp, cct)) {
 			//DBGF((DBGA,"planckian_il failed\n"))
 			return 2;
 		}
 	} else if (cct >= 5500.0) {
-		if (standardIlluminant(&rspec, icxIT_Dtemp, cct)) {
+		if (standardIlluminant(rspec, icxIT_Dtemp, cct)) {
 			//DBGF((DBGA,"daylight_il failed\n"))
 			return 2;
 		}
@@ -361,11 +307,11 @@ xspect *tsamp			/* Illuminant test sample to compute TLCI of */
 		xspect dspec;		/* Daylight spectrum */
 		double pXYZ[3], dXYZ[3];		/* Plankian and Dalight Y values */
 
-		if (standardIlluminant(&rspec, icxIT_Ptemp, 4500.0)) {
+		if (standardIlluminant(rspec, icxIT_Ptemp, 4500.0)) {
 			//DBGF((DBGA,"planckian_il failed\n"))
 			return 2;
 		}
-		tocie2->convert(tocie2, pXYZ, &rspec);
+		tocie2->convert(tocie2, pXYZ, rspec);
 
 		DBGF((DBGA," plank Y %f\n", pXYZ[1]))
 		
@@ -381,25 +327,26 @@ xspect *tsamp			/* Illuminant test sample to compute TLCI of */
 		DBGF((DBGA,"creating hybrid spectrum with %f Plankian & %f Daylight\n",(1.0 - dwt),dwt))
 
 		/* Blend Y normalized values */
-		for (i = 0; i < rspec.spec_n; i++) {
-			double wl = XSPECT_XWL(&rspec, i);			/* Wavelength in meters */
-			rspec.spec[i] =        dwt  * 1.0/dXYZ[1] * value_xspect(&dspec, wl)
-			              + (1.0 - dwt) * 1.0/pXYZ[1] * rspec.spec[i];
+		for (i = 0; i < rspec->spec_n; i++) {
+			double wl = XSPECT_XWL(rspec, i);			/* Wavelength in meters */
+			rspec->spec[i] =        dwt  * 1.0/dXYZ[1] * value_xspect(&dspec, wl)
+			               + (1.0 - dwt) * 1.0/pXYZ[1] * rspec->spec[i];
 		}
 	}
 
 	/* Compute the 2 degree XYZ of the reference white */
-	tocie2->convert(tocie2, riXYZ, &rspec);
+	tocie2->convert(tocie2, riXYZ, rspec);
 
 	DBGF((DBGA,"ref. XYZ = %f %f %f\n",riXYZ[0],riXYZ[1],riXYZ[2]))
 	DBGF((DBGA,"test XYZ = %f %f %f\n",tiXYZ[0],tiXYZ[1],tiXYZ[2]))
 
 	/* Normalize the spectra so as to create a Y = 1.0 normalized white */
-	rspec.norm *= riXYZ[1];
+	rspec->norm *= riXYZ[1];
 	tsampnorm = tsamp->norm;		/* Save this so we can restore it before returning */
 	tsamp->norm *= tiXYZ[1];
-	tocie2->convert(tocie2, riXYZ, &rspec);
+	tocie2->convert(tocie2, riXYZ, rspec);
 	tocie2->convert(tocie2, tiXYZ, tsamp);
+	tsamp->norm = tsampnorm;		/* Restore this */
 
 	DBGF((DBGA,"norm XYZ ref. = %f %f %f\n",riXYZ[0],riXYZ[1],riXYZ[2]))
 	DBGF((DBGA,"norm XYZ test = %f %f %f\n",tiXYZ[0],tiXYZ[1],tiXYZ[2]))
@@ -434,7 +381,166 @@ xspect *tsamp			/* Illuminant test sample to compute TLCI of */
 	if ((tYxy[1] - rYxy[1]) * (rYxy[1] - 0.5)
 	  + (tYxy[2] - rYxy[2]) * (rYxy[2] - 0.25) < 0.0)
 		dc = -dc;
-			
+
+	*pcct = cct;
+	*pdc = dc;
+
+	return rv;
+}
+
+/* Compute Rf, Rg and the hue bins from the reference and test */
+/* sample Jab values of the evaluation samples. */
+static void tm3015_metrics(
+double *pRf,			/* Return Rf */
+double *pRg,			/* Return Rg */
+double bins[IES_TM_30_15_BINS][2][3],		/* Return ref & tsamp Jab */
+double esamps[IES_TM_30_15_ESAMPLES][2][3]	/* Evaluation sample Jab values */
+) {
+	int i;
+	double mdE;			/* Mean delta E */
+	double Rfd;
+	int bcount[IES_TM_30_15_BINS];
+	double rArea, tArea;
+
+	/* Compute delta Jab for each evaluation sample from reference white */
+	mdE = 0.0;
+	for (i = 0; i < IES_TM_30_15_ESAMPLES; i++)
+		mdE += icmNorm33(esamps[i][0], esamps[i][1]);
+
+	/* Note that CIE244 uses a scaling factor of 6.73 rather than 7.54 */
+	mdE /= (double)i;
+	Rfd = 100.0 - 7.54 * mdE;
+	if (Rfd < 0.0)
+		Rfd = 0.0;
+	*pRf = 10.0 * log(exp(Rfd/10.0) + 1.0);
+
+	/* ------------------------------------------------------ */
+	/* Average evaluation sample Jab values into the hue bins */
+	for (i = 0; i < IES_TM_30_15_BINS; i++) {
+		icmSet3(bins[i][0], 0.0);
+		icmSet3(bins[i][1], 0.0);
+		bcount[i] = 0;
+	}
+
+	for (i = 0; i < IES_TM_30_15_ESAMPLES; i++) {
+		double h;
+		int bix;
+
+		h = atan2(esamps[i][0][2], esamps[i][0][1]) / (2.0 * DBL_PI);	/* Reference ab */
+		h = (h < 0.0) ? h + 1.0 : h;
+
+		bix = (int)floor(IES_TM_30_15_BINS * h);
+		if (bix > (IES_TM_30_15_BINS-1))		/* Just in case */
+			bix = 0;
+		
+		DBGF((DBGA," esamp %d Jab ref. %f %f %f test %f %f %f Bin %d\n",i, esamps[i][0][0], esamps[i][0][1], esamps[i][0][2], esamps[i][1][0], esamps[i][1][1], esamps[i][1][2], bix))
+
+		icmAdd3(bins[bix][0], bins[bix][0], esamps[i][0]);
+		icmAdd3(bins[bix][1], bins[bix][1], esamps[i][1]);
+		bcount[bix]++;
+
+//DBGF((DBGA," Bin %d: ab ref. %f %f test %f %f cnt %d\n", bix, bins[bix][0][1], bins[bix][0][2], bins[bix][1][1], bins[bix][1][2], bcount[bix]))
+	}
+
+	for (i = 0; i < IES_TM_30_15_BINS; i++) {
+		if (bcount[i] > 0) {
+			icmScale3(bins[i][0], bins[i][0], 1.0/bcount[i]);
+			icmScale3(bins[i][1], bins[i][1], 1.0/bcount[i]);
+		}
+		DBGF((DBGA," Bin %d: ab ref. %f %f test %f %f\n", i, bins[i][0][1], bins[i][0][2], bins[i][1][1], bins[i][1][2]))
+	}
+
+	/* Compute areas */
+	rArea = tArea = 0.0;
+	for (i = 0; i < IES_TM_30_15_BINS; i++) {
+		int j = i < (IES_TM_30_15_BINS-1) ? i + 1 : 0;
+
+		rArea += bins[i][0][1] * bins[j][0][2] - bins[j][0][1] * bins[i][0][2];
+		tArea += bins[i][1][1] * bins[j][1][2] - bins[j][1][1] * bins[i][1][2];
+	}
+	rArea *= 0.5;
+	tArea *= 0.5;
+
+	DBGF((DBGA," Area: ref. %f test %f\n", rArea, tArea))
+
+	*pRg = 100.0 * tArea/rArea;
+}
+
+/* Comute IES TM-30-15 */
+/* Return 1 on invalid, 2 on error */
+/* Invalid is when sample is not white enough. */
+int icx_IES_TM_30_15(
+double *pRf,			/* Return Rf */
+double *pRg,			/* Return Rg */
+double *pcct,			/* Return correlated color temperature */
+double *pdc,			/* Return signed dU'V' to locus */
+double pbins[IES_TM_30_15_BINS][2][3],		/* If not NULL, return ref & tsamp Jab */
+xspect *tsamp			/* Illuminant test sample to compute TLCI of */
+) {
+	// Test source = input test sample
+	// Ref. source = reference Plankian/D type illuminant
+
+	// Use 380 - 780 nm, 1nm spectral calculation
+
+	// XYZ values are normalized to have Y == 1
+
+	// Normalize plankian and D type to have Y == 100 before blending
+	// and scale result so that Y == 100
+
+	// Compute 10 degree XYZ values for all CES for test & ref. illuminants,
+	// and normalize each to Y = 100.
+	
+	// Convert to CIECAM02 Jab using the fom detailed in 3.7.1 thru 3.7.23
+
+	// Compute Rf according to 3.9.1 & 3.9.2
+	// Compute Rg according to 3.10.1
+
+	int i;
+	double cct;			/* CCT of test sample */
+	double dc;			/* delta of test sample to reference white in 1960 UCS */
+	xsp2cie *tocie2;	/* spectral illuminant to XYZ conversion 2 degree */
+	xsp2cie *tocie10;	/* spectral illuminant to XYZ conversion 10 degree */
+	xsp2cie *tocie10r, *tocie10s;	/* spectral reflectance to XYZ conversion 10 degree */
+	xspect rspec;		/* Reference white spectrum */
+	double tiXYZ[3];	/* Sample illuminant XYZ */
+	double riXYZ[3];	/* Reference illuminant XYZ */
+	double tsampnorm;
+
+	double rcat[3][3], tcat[3][3];	/* Ref White chromatic adapation matrix */
+	double rAw, tAw;	/* acromatic response of white */
+
+	double esamps[IES_TM_30_15_ESAMPLES][2][3];	/* Evaluation sample Jab values */
+
+	double _bins[IES_TM_30_15_BINS][2][3];
+	double (*bins)[2][3];
+
+	double Rf = -1.0, Rg = -1.0;
+	int rv = 0;
+
+	DBGF((DBGA,"icx_IES_TM_30_15 called\n"))
+
+	bins = (pbins != NULL) ? pbins : _bins;
+
+	// Use CIE1931 2 deg for CCT, xy anxd u'v'
+	/* Create spectral to XYZ for CCT etc. */
+	if ((tocie2 = new_xsp2cie(icxIT_none, 0.0, NULL, icxOT_CIE_1931_2, NULL, icSigXYZData, 1)) == NULL) {
+		//DBGF((DBGA,"Ref new_xsp2cie 2 degreefailed\n"))
+		return 2;   
+	}
+
+#ifdef USE_5NM
+#   pragma message("###### tm3015.c set to 5nm !!! ######")
+	tocie2->set_int_steps(tocie2, 5.0, 380.0, 780.0);
+#endif
+
+	/* Create the reference white, and locate the sample CCT */
+	if ((rv = tm3015_ref(&rspec, &cct, &dc, tocie2, tsamp)) > 1) {
+		tocie2->del(tocie2);
+		return rv;
+	}
+	tocie2->del(tocie2);
+	tocie2 = NULL;
+
 	// Use CIE1931 10 deg for comparison tristimulus values
 	if ((tocie10 = new_xsp2cie(icxIT_none, 0.0, &rspec, icxOT_CIE_1964_10, NULL, icSigXYZData, 0)) == NULL) {
 		//DBGF((DBGA,"Ref new_xsp2cie 10 degree failed\n"))
@@ -459,6 +565,7 @@ xspect *tsamp			/* Illuminant test sample to compute TLCI of */
 #endif
 
 	/* Compute the 10 degree XYZ of the test sample and reference */
+	tsampnorm = tsamp->norm;		/* Save this so we can restore it before returning */
 	rspec.norm = 1.0;
 	tsamp->norm = 1.0;
 
@@ -479,12 +586,10 @@ xspect *tsamp			/* Illuminant test sample to compute TLCI of */
 	DBGF((DBGA,"rAw %f tAw\n",rAw, tAw))
 
 	/* ------------------------------------------------------ */
-	/* Compute delta Jab for each evaluation sample from reference white */
-	mdE = 0.0;
+	/* Compute Jab for each evaluation sample under reference and test */
 	for (i = 0; i < IES_TM_30_15_ESAMPLES; i++) {
 		double rXYZ[3];
 		double sXYZ[3];
-		double dE;
 
 		tocie10r->convert(tocie10r, rXYZ, &TM3015_ECS[i]);
 
@@ -502,93 +607,261 @@ xspect *tsamp			/* Illuminant test sample to compute TLCI of */
 
 		ciecam02_ucs(esamps[i][1], tAw, tcat, sXYZ);
 
-		dE = icmNorm33(esamps[i][0], esamps[i][1]);
-
 		DBGF((DBGA," Sample %d XYZ ref. %f %f %f test %f %f %f\n", i, rXYZ[0], rXYZ[1], rXYZ[2], sXYZ[0], sXYZ[1], sXYZ[2]))
-		DBGF((DBGA,"          Jab ref. %f %f %f test %f %f %f dE %f\n", esamps[i][0][0], esamps[i][0][1], esamps[i][0][2], esamps[i][1][0], esamps[i][1][1], esamps[i][1][2], dE))
-
-		mdE += dE;
+		DBGF((DBGA,"          Jab ref. %f %f %f test %f %f %f dE %f\n", esamps[i][0][0], esamps[i][0][1], esamps[i][0][2], esamps[i][1][0], esamps[i][1][1], esamps[i][1][2], icmNorm33(esamps[i][0], esamps[i][1])))
 	}
 
-	/* Note that CIE244 uses a scaling factor of 6.73 rather than 7.54 */
-	mdE /= (double)i;
-	Rfd = 100.0 - 7.54 * mdE;
-	if (Rfd < 0.0)
-		Rfd = 0.0;
-	Rf = 10.0 * log(exp(Rfd/10.0) + 1.0);
+	tm3015_metrics(&Rf, &Rg, bins, esamps);
 
-	/* ------------------------------------------------------ */
-	/* Average evaluation sample Jab values into the hue bins */
-	for (i = 0; i < IES_TM_30_15_BINS; i++) {
-		icmSet3(bins[i][0], 0.0);
-		icmSet3(bins[i][1], 0.0);
-		bcount[i] = 0;
-	}
+	tsamp->norm = tsampnorm;		/* Restore this */
 
-	for (i = 0; i < IES_TM_30_15_ESAMPLES; i++) {
-		double h;
-		int bix;
+	tocie10->del(tocie10);
+	tocie10r->del(tocie10r);
+	tocie10s->del(tocie10s);
 
-		h = atan2(esamps[i][0][2], esamps[i][0][1]) / (2.0 * DBL_PI);	/* Reference ab */
-		h = (h < 0.0) ? h + 1.0 : h;
+	//DBGF((DBGA,"returning Rf %f Rg %f\n",Rf,Rg))
 
-		bix = (int)floor(IES_TM_30_15_BINS * h);
-		if (bix > (IES_TM_30_15_BINS-1))		/* Just in case */
-			bix = 0;
-		
-		DBGF((DBGA," esamp %d Jab ref. %f %f %f test %f %f %f Bin %d\n",i, esamps[i][0][0], esamps[i][0][1], esamps[i][0][2], esamps[i][1][0], esamps[i][1][1], esamps[i][1][2], bix))
+	if (pRf != NULL)
+		*pRf = Rf;
 
-		icmAdd3(bins[bix][0], bins[bix][0], esamps[i][0]);
-		icmAdd3(bins[bix][1], bins[bix][1], esamps[i][1]);
-		bcount[bix]++;
+	if (pRg != NULL)
+		*pRg = Rg;
 
-//DBGF((DBGA," Bin %d: ab ref. %f %f test %f %f cnt %d\n", bix, bins[bix][0][1], bins[bix][0][2], bins[bix][1][1], bins[bix][1][2], bcount[bix]))
+	if (pcct != NULL)
+		*pcct = cct;
+
+	if (pdc != NULL)
+		*pdc = dc;
+
+	return rv;
+}
+
+/* ------------------------------------------------------ */
+/* Batch TM-30-15 */
+
+/* The 10 degree evaluation sample XYZ values under an illuminant I are */
+/* sum(I * O * S)/sum(I * Oy) over the 1nm integration range, so the */
+/* observer * sample reflectance products can be computed once as a matrix, */
+/* and each illuminant evaluated by sampling it once and multiplying. */
+
+/* Batch context */
+typedef struct {
+	int nw;				/* Number of 1nm integration steps */
+	double wl_short;	/* First integration wavelength */
+	double bw;			/* Integration step */
+	double *ow;			/* [3][nw] 10 degree observer */
+	double *esw;		/* [ESAMPLES][3][nw] evaluation sample * 10 degree observer */
+
+	xspect *tsamps;		/* Test samples */
+	double *pRf, *pRg, *pcct, *pdc;
+	double (*pbins)[IES_TM_30_15_BINS][2][3];
+	int *prv;
+
+	xsp2cie **tocie2;	/* Per thread 2 degree conversion */
+	double *ill;		/* Per thread [2][nw] sampled illuminants */
+} tm3015_batch;
+
+/* Compute the 10 degree white XYZ and evaluation sample CIECAM02 */
+/* Jab values for the illuminant sampled at 1nm in ill[] */
+static void tm3015_batch_jab(
+tm3015_batch *b,
+double esamps[IES_TM_30_15_ESAMPLES][2][3],
+int ix,					/* 0 for reference, 1 for test */
+double *ill
+) {
+	int i, j, k, nw = b->nw;
+	double wXYZ[3], XYZ[3], sc;
+	double cat[3][3], Aw;
+	double *ew;
+
+	for (j = 0; j < 3; j++) {
+		double *ow = b->ow + j * nw;
+		wXYZ[j] = 0.0;
+		for (k = 0; k < nw; k++)
+			wXYZ[j] += ill[k] * ow[k];
 	}
+	sc = 1.0/wXYZ[1];
+	icmScale3(wXYZ, wXYZ, sc);		/* Y = 1.0 normalized white */
 
-	for (i = 0; i < IES_TM_30_15_BINS; i++) {
-		if (bcount[i] > 0) {
-			icmScale3(bins[i][0], bins[i][0], 1.0/bcount[i]);
-			icmScale3(bins[i][1], bins[i][1], 1.0/bcount[i]);
+	Aw = comp_rgbd_mtx(cat, wXYZ);
+
+	ew = b->esw;
+	for (i = 0; i < IES_TM_30_15_ESAMPLES; i++) {
+		for (j = 0; j < 3; j++, ew += nw) {
+			XYZ[j] = 0.0;
+			for (k = 0; k < nw; k++)
+				XYZ[j] += ill[k] * ew[k];
 		}
-		DBGF((DBGA," Bin %d: ab ref. %f %f test %f %f\n", i, bins[i][0][1], bins[i][0][2], bins[i][1][1], bins[i][1][2]))
+		icmScale3(XYZ, XYZ, sc);
+		ciecam02_ucs(esamps[i][ix], Aw, cat, XYZ);
 	}
+}
 
-	/* Compute areas */
-	rArea = tArea = 0.0;
-	for (i = 0; i < IES_TM_30_15_BINS; i++) {
-		int j = i < (IES_TM_30_15_BINS-1) ? i + 1 : 0;
+static int tm3015_batch_thread(void *cntx, int i0, int i1, int thix) {
+	tm3015_batch *b = (tm3015_batch *)cntx;
+	double *rill = b->ill + 2 * thix * b->nw;
+	double *till = rill + b->nw;
+	int i, k;
+
+	for (i = i0; i < i1; i++) {
+		xspect rspec;
+		double cct = -1.0, dc = -1.0;
+		double Rf = -1.0, Rg = -1.0;
+		double esamps[IES_TM_30_15_ESAMPLES][2][3];
+		double _bins[IES_TM_30_15_BINS][2][3];
+		double (*bins)[2][3];
+		int rv;
+
+		bins = (b->pbins != NULL) ? b->pbins[i] : _bins;
+
+		if ((rv = tm3015_ref(&rspec, &cct, &dc, b->tocie2[thix], &b->tsamps[i])) <= 1) {
+
+			/* Sample the illuminants at the integration wavelengths. */
+			/* Normalisation doesn't matter, as the XYZ are normalized */
+			/* to the illuminant Y. */
+			for (k = 0; k < b->nw; k++) {
+				double ww = b->wl_short + k * b->bw;
+				getval_xspec(&rspec, &rill[k], ww);
+				getval_xspec(&b->tsamps[i], &till[k], ww);
+			}
 
-		rArea += bins[i][0][1] * bins[j][0][2] - bins[j][0][1] * bins[i][0][2];
-		tArea += bins[i][1][1] * bins[j][1][2] - bins[j][1][1] * bins[i][1][2];
-	}
-	rArea *= 0.5;
-	tArea *= 0.5;
+			tm3015_batch_jab(b, esamps, 0, rill);
+			tm3015_batch_jab(b, esamps, 1, till);
 
-	DBGF((DBGA," Area: ref. %f test %f\n", rArea, tArea))
+			tm3015_metrics(&Rf, &Rg, bins, esamps);
+		}
+
+		if (b->pRf != NULL)
+			b->pRf[i] = Rf;
+		if (b->pRg != NULL)
+			b->pRg[i] = Rg;
+		if (b->pcct != NULL)
+			b->pcct[i] = cct;
+		if (b->pdc != NULL)
+			b->pdc[i] = dc;
+		if (b->prv != NULL)
+			b->prv[i] = rv;
+	}
+	return 0;
+}
 
-	Rg = 100.0 * tArea/rArea;
+/* Compute IES TM-30-15 for n illuminant test samples. */
+/* The evaluation sample weightings are computed once for the batch, */
+/* and the test samples are evaluated using nth threads (<= 0 for default). */
+/* The results and return value for each sample are as for icx_IES_TM_30_15(), */
+/* returned in the arrays that are not NULL. Return 2 on an error in */
+/* setting up, 0 otherwise. */
+int icx_IES_TM_30_15_n(
+double *pRf,			/* Return n Rf */
+double *pRg,			/* Return n Rg */
+double *pcct,			/* Return n correlated color temperature */
+double *pdc,			/* Return n signed Du'v' to locus */
+double (*pbins)[IES_TM_30_15_BINS][2][3],	/* If not NULL, return n ref & tsamp Jab */
+int *prv,				/* Return n icx_IES_TM_30_15() return values */
+xspect *tsamps,			/* n Illuminant samples */
+int n,
+int nth					/* Number of threads, <= 0 for default */
+) {
+	tm3015_batch b;
+	xspect *obs[3];
+	double ww, wl_long;
+	int i, j, k, rv = 0;
+
+	DBGF((DBGA,"icx_IES_TM_30_15_n called with %d samples\n",n))
+
+	if (n <= 0)
+		return 0;
+
+	memset((void *)&b, 0, sizeof(tm3015_batch));
+	b.tsamps = tsamps;
+	b.pRf = pRf;
+	b.pRg = pRg;
+	b.pcct = pcct;
+	b.pdc = pdc;
+	b.pbins = pbins;
+	b.prv = prv;
+
+	/* Integration range and steps as per xsp2cie */
+	if (standardObserver(obs, icxOT_CIE_1964_10))
+		return 2;
+	b.bw = 1.0;
+	b.wl_short = obs[1]->spec_wl_short;
+	wl_long = obs[1]->spec_wl_long;
+#ifdef USE_5NM
+	b.bw = 5.0;
+	b.wl_short = 380.0;
+	wl_long = 780.0;
+#endif
+	for (ww = b.wl_short; ww <= wl_long; ww += b.bw)
+		b.nw++;
 
-	tsamp->norm = tsampnorm;		/* Restore this */
+	if ((b.ow = (double *)malloc(sizeof(double) * 3 * b.nw)) == NULL
+	 || (b.esw = (double *)malloc(sizeof(double) * IES_TM_30_15_ESAMPLES * 3 * b.nw)) == NULL) {
+		free(b.ow);
+		return 2;
+	}
 
-	tocie2->del(tocie2);
-	tocie2 = NULL;
-	tocie10->del(tocie10);
-	tocie10r->del(tocie10r);
-	tocie10s->del(tocie10s);
+	/* Observer, and evaluation sample * observer weightings */
+	for (k = 0; k < b.nw; k++) {
+		ww = b.wl_short + k * b.bw;
+		for (j = 0; j < 3; j++)
+			getval_xspec(obs[j], &b.ow[j * b.nw + k], ww);
+	}
+	for (i = 0; i < IES_TM_30_15_ESAMPLES; i++) {
+		double *ew = b.esw + i * 3 * b.nw;
+		for (k = 0; k < b.nw; k++) {
+			double S;
+			getval_xspec(&TM3015_ECS[i], &S, b.wl_short + k * b.bw);
+			for (j = 0; j < 3; j++)
+				ew[j * b.nw + k] = S * b.ow[j * b.nw + k];
+		}
+	}
 
-	//DBGF((DBGA,"returning Rf %f Rg %f\n",Rf,Rg))
+#ifndef SALONEINSTLIB
+	if (nth <= 0)
+		nth = num_threads();
+	if (nth > n)
+		nth = n;
+#else
+	nth = 1;
+#endif
 
-	if (pRf != NULL)
-		*pRf = Rf;
+	if ((b.tocie2 = (xsp2cie **)calloc(nth, sizeof(xsp2cie *))) == NULL
+	 || (b.ill = (double *)malloc(sizeof(double) * 2 * b.nw * nth)) == NULL) {
+		free(b.tocie2);
+		free(b.ow);
+		free(b.esw);
+		return 2;
+	}
 
-	if (pRg != NULL)
-		*pRg = Rg;
+	// Use CIE1931 2 deg for CCT, xy anxd u'v'
+	for (i = 0; i < nth; i++) {
+		if ((b.tocie2[i] = new_xsp2cie(icxIT_none, 0.0, NULL, icxOT_CIE_1931_2, NULL, icSigXYZData, 1)) == NULL) {
+			rv = 2;
+			break;
+		}
+#ifdef USE_5NM
+		b.tocie2[i]->set_int_steps(b.tocie2[i], 5.0, 380.0, 780.0);
+#endif
+	}
 
-	if (pcct != NULL)
-		*pcct = cct;
+	if (rv == 0) {
+#ifndef SALONEINSTLIB
+		if (nth > 1)
+			par_for(nth, 0, n, 0, tm3015_batch_thread, (void *)&b);
+		else
+#endif
+			tm3015_batch_thread((void *)&b, 0, n, 0);
+	}
 
-	if (pdc != NULL)
-		*pdc = dc;
+	for (i = 0; i < nth; i++) {
+		if (b.tocie2[i] != NULL)
+			b.tocie2[i]->del(b.tocie2[i]);
+	}
+	free(b.tocie2);
+	free(b.ill);
+	free(b.ow);
+	free(b.esw);
 
 	return rv;
 }
@@ -43,6 +43,24 @@ double pbins[IES_TM_30_15_BINS][2][3],		/* If not NULL, return ref & tsamp Jab *
 xspect *tsamp			/* Illuminant sample to compute TLCI of */
 );
 
+/* Compute IES TM-30-15 for n illuminant test samples. */
+/* The evaluation sample weightings are computed once for the batch, */
+/* and the test samples are evaluated using nth threads (<= 0 for default). */
+/* The results and return value for each sample are as for icx_IES_TM_30_15(), */
+/* returned in the arrays that are not NULL. Return 2 on an error in */
+/* setting up, 0 otherwise. */
+int icx_IES_TM_30_15_n(
+double *pRf,			/* Return n Rf */
+double *pRg,			/* Return n Rg */
+double *pcct,			/* Return n correlated color temperature */
+double *pdc,			/* Return n signed Du'v' to locus */
+double (*pbins)[IES_TM_30_15_BINS][2][3],	/* If not NULL, return n ref & tsamp Jab */
+int *prv,				/* Return n icx_IES_TM_30_15() return values */
+xspect *tsamps,			/* n Illuminant samples */
+int n,
+int nth					/* Number of threads, <= 0 for default */
+);
+
 
 #ifdef __cplusplus
 	}
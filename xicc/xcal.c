@@ -53,6 +53,9 @@
 # define stricmp strcasecmp
 #endif
 
+#define XCAL_MINTRES 4096	/* Minimum forward table resolution */
+#define XCAL_ITRES 16384	/* Inverse table resolution */
+
 /* rspl setting functions */
 static void xcal_rsplset(void *cbntx, double *out, double *in) {
 	co *dpoints = (co *)cbntx;
@@ -62,6 +65,144 @@ static void xcal_rsplset(void *cbntx, double *out, double *in) {
 	out[0] = dpoints[ix].v[0];
 }
 
+/* Free the curve tables */
+static void xcal_free_tabs(xcal *p) {
+	int j;
+
+	for (j = 0; j < MAX_CHAN; j++) {
+		if (p->ftab[j] != NULL)
+			free(p->ftab[j]);
+		p->ftab[j] = NULL;
+		if (p->itab[j] != NULL)
+			free(p->itab[j]);
+		p->itab[j] = NULL;
+	}
+	p->tres = 0;
+}
+
+/* Resample the curves into dense tables. The forward table resolution */
+/* is a multiple of the rspl grid spacing, so that linear interpolation */
+/* of the table gives the same values as the rspl. Strictly monotonic */
+/* curves also get an inverse table. If there isn't enough memory the */
+/* rspl is used instead, so this doesn't fail. */
+static void xcal_tabulate(xcal *p, int gres) {
+	int i, j, tres;
+	co tp;
+
+	xcal_free_tabs(p);
+
+	if (gres < 2)
+		return;
+	tres = (XCAL_MINTRES + gres - 3)/(gres - 1) * (gres - 1) + 1;
+
+	for (j = 0; j < p->devchan; j++) {
+		double *ft;
+		int inc = 1, dec = 1;
+
+		if ((ft = p->ftab[j] = (double *)malloc(tres * sizeof(double))) == NULL) {
+			xcal_free_tabs(p);
+			return;
+		}
+		for (i = 0; i < tres; i++) {
+			tp.p[0] = i/(tres - 1.0);
+			p->cals[j]->interp(p->cals[j], &tp);
+			ft[i] = tp.v[0];
+			if (i > 0) {
+				if (ft[i] <= ft[i-1])
+					inc = 0;
+				if (ft[i] >= ft[i-1])
+					dec = 0;
+			}
+		}
+		p->imin[j] = inc ? ft[0] : ft[tres-1];
+		p->imax[j] = inc ? ft[tres-1] : ft[0];
+
+#ifndef SALONEINSTLIB
+		/* Index the segments of the curve by evenly spaced output values */
+		p->idec[j] = dec;
+		if (inc || dec) {
+			int *it;
+			int k;
+
+			if ((it = p->itab[j] = (int *)malloc(XCAL_ITRES * sizeof(int))) != NULL) {
+				for (i = k = 0; k < XCAL_ITRES; k++) {
+					double v = p->imin[j] + k/(XCAL_ITRES - 1.0) * (p->imax[j] - p->imin[j]);
+
+					/* Last segment of the increasing curve starting at or below v */
+					while (i < (tres-2) && (inc ? ft[i+1] : ft[tres-2-i]) <= v)
+						i++;
+					it[k] = i;
+				}
+			}
+		}
+#endif /* !SALONEINSTLIB */
+	}
+	p->tres = tres;
+}
+
+/* Linearly interpolate a table of res entries covering 0.0 .. 1.0 */
+static double xcal_tlookup(double *tab, int res, double in) {
+	double fi;
+	int ix;
+
+	if (in <= 0.0)
+		return tab[0];
+	if (in >= 1.0)
+		return tab[res-1];
+	fi = in * (res - 1);
+	ix = (int)fi;
+	if (ix > (res-2))
+		ix = res-2;
+	fi -= (double)ix;
+	return tab[ix] + fi * (tab[ix+1] - tab[ix]);
+}
+
+#ifndef SALONEINSTLIB
+
+/* Invert a strictly monotonic curve using its forward table. The inverse */
+/* table gives the range of segments to search, and the segment found */
+/* is inverted exactly, so the result is the same as rspl rev_interp(). */
+static double xcal_ilookup(xcal *p, int ch, double in) {
+	double *ft = p->ftab[ch];
+	int *it = p->itab[ch];
+	int tres = p->tres, dec = p->idec[ch];
+	int k, lo, hi;
+	double fk, v0, v1, bf;
+
+	if (in <= p->imin[ch])
+		return dec ? 1.0 : 0.0;
+	if (in >= p->imax[ch])
+		return dec ? 0.0 : 1.0;
+
+	fk = (in - p->imin[ch])/(p->imax[ch] - p->imin[ch]) * (XCAL_ITRES - 1);
+	k = (int)fk;
+	if (k > (XCAL_ITRES-2))
+		k = XCAL_ITRES-2;
+	lo = it[k];
+	hi = it[k+1];
+
+	/* Find the last segment of the increasing curve starting at or below in */
+	while (lo < hi) {
+		int mid = (lo + hi + 1)/2;
+		if ((dec ? ft[tres-1-mid] : ft[mid]) <= in)
+			lo = mid;
+		else
+			hi = mid-1;
+	}
+	v0 = dec ? ft[tres-1-lo] : ft[lo];
+	v1 = dec ? ft[tres-2-lo] : ft[lo+1];
+	bf = (in - v0)/(v1 - v0);
+	if (bf < 0.0)
+		bf = 0.0;
+	else if (bf > 1.0)
+		bf = 1.0;
+	bf = (lo + bf)/(tres - 1.0);
+
+	return dec ? 1.0 - bf : bf;
+}
+
+#endif /* !SALONEINSTLIB */
+
 /* Read a calibration file from a cgats table */
 /* Return nz if this fails */
 static int xcal_read_cgats(xcal *p, cgats *tcg, int table, char *filename) {
@@ -207,6 +348,8 @@ static int xcal_read_cgats(xcal *p, cgats *tcg, int table, char *filename) {
 	free(ident);
 	free(bident);
 
+	xcal_tabulate(p, tcg->t[table].nsets);
+
 	return 0;
 }
 
@@ -294,6 +437,8 @@ int xcal_read_icc(xcal *p, icc *c) {
 		free(dpoints);
 	}
 
+	xcal_tabulate(p, res);
+
 	return 0;
 }
 
@@ -464,6 +609,12 @@ static void xcal_interp(xcal *p, double *out, double *in) {
 	int j;
 	co tp;
 
+	if (p->tres > 0) {
+		for (j = 0; j < p->devchan; j++)
+			out[j] = xcal_tlookup(p->ftab[j], p->tres, in[j]);
+		return;
+	}
+
 	for (j = 0; j < p->devchan; j++) {
 		tp.p[0] = in[j];
 		p->cals[j]->interp(p->cals[j], &tp);
@@ -485,6 +636,12 @@ static int xcal_inv_interp(xcal *p, double *out, double *in) {
 	int rv = 0;
 
 	for (j = 0; j < p->devchan; j++) {
+
+		if (p->itab[j] != NULL) {
+			out[j] = xcal_ilookup(p, j, in[j]);
+			continue;
+		}
+
 		pp[0].v[0] = in[j];
 
 		nsoln = p->cals[j]->rev_interp (
@@ -531,6 +688,9 @@ static double xcal_interp_ch(xcal *p, int ch, double in) {
 	if (ch < 0 || ch >= p->devchan)
 		return -1.0;
 
+	if (p->tres > 0)
+		return xcal_tlookup(p->ftab[ch], p->tres, in);
+
 	tp.p[0] = in;
 	p->cals[ch]->interp(p->cals[ch], &tp);
 	return tp.v[0];
@@ -549,6 +709,9 @@ static double xcal_inv_interp_ch(xcal *p, int ch, double in) {
 	if (ch < 0 || ch >= p->devchan)
 		return -1.0;
 
+	if (p->itab[ch] != NULL)
+		return xcal_ilookup(p, ch, in);
+
 	pp[0].v[0] = in;
 
 	nsoln = p->cals[ch]->rev_interp(
@@ -601,6 +764,7 @@ static void xcal_del(xcal *p) {
 		if (p->cals[j] != NULL)
 			p->cals[j]->del(p->cals[j]);
 	}
+	xcal_free_tabs(p);
 	free(p);
 }
 
@@ -94,6 +94,14 @@ struct _xcal {
 	int errc;							/* Error code */
 
 	rspl *cals[MAX_CHAN];
+
+	/* Dense tables of the curves, for fast lookup */
+	int tres;				/* Forward table resolution, 0 if not tabulated */
+	double *ftab[MAX_CHAN];	/* Forward tables */
+	int idec[MAX_CHAN];		/* nz if the curve is decreasing */
+	double imin[MAX_CHAN], imax[MAX_CHAN];	/* Output range of each curve */
+	int *itab[MAX_CHAN];	/* Inverse tables of the forward table segment each */
+							/* output value is in, NULL if not strictly monotonic */
 	
 }; typedef struct _xcal xcal;
 
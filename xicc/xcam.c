@@ -27,6 +27,8 @@ static int icx_set_view(icxcam *s, ViewingCondition Ev, double Wxyz[3],
 						int hk, double hkscale, double mtaf, double Wxyz2[3]);
 static int icx_XYZ_to_cam(struct _icxcam *s, double Jab[3], double XYZ[3]);
 static int icx_cam_to_XYZ(struct _icxcam *s, double XYZ[3], double Jab[3]);
+static int icx_XYZ_to_cam_n(struct _icxcam *s, double *Jab, double *XYZ, int n, int fast);
+static int icx_cam_to_XYZ_n(struct _icxcam *s, double *XYZ, double *Jab, int n, int fast);
 static void settrace(struct _icxcam *s, int tracev);
 
 /* Return the default CAM */
@@ -65,6 +67,8 @@ icxcam *new_icxcam(icxCAM which) {
 	s->set_view   = icx_set_view;
 	s->XYZ_to_cam = icx_XYZ_to_cam;
 	s->cam_to_XYZ = icx_cam_to_XYZ;
+	s->XYZ_to_cam_n = icx_XYZ_to_cam_n;
+	s->cam_to_XYZ_n = icx_cam_to_XYZ_n;
 	s->settrace   = settrace;
 
 	/* We set the default CAM here */
@@ -193,6 +197,56 @@ double Jab[3]
 	return 0;
 }
 
+static int icx_XYZ_to_cam_n(
+struct _icxcam *s,
+double *Jab,
+double *XYZ,
+int n,
+int fast
+) {
+	switch(s->tag) {
+		case cam_CIECAM97s3: {
+			cam97s3 *pp = (cam97s3 *)s->p;
+			int i, rv = 0;
+			for (i = 0; i < n; i++, Jab += 3, XYZ += 3)
+				rv |= pp->XYZ_to_cam(pp, Jab, XYZ);
+			return rv;
+		}
+		case cam_CIECAM02: {
+			cam02 *pp = (cam02 *)s->p;
+			return pp->XYZ_to_cam_n(pp, Jab, XYZ, n, fast);
+		}
+		default:
+			break;
+	}
+	return 0;
+}
+
+static int icx_cam_to_XYZ_n(
+struct _icxcam *s,
+double *XYZ,
+double *Jab,
+int n,
+int fast
+) {
+	switch(s->tag) {
+		case cam_CIECAM97s3: {
+			cam97s3 *pp = (cam97s3 *)s->p;
+			int i, rv = 0;
+			for (i = 0; i < n; i++, XYZ += 3, Jab += 3)
+				rv |= pp->cam_to_XYZ(pp, XYZ, Jab);
+			return rv;
+		}
+		case cam_CIECAM02: {
+			cam02 *pp = (cam02 *)s->p;
+			return pp->cam_to_XYZ_n(pp, XYZ, Jab, n, fast);
+		}
+		default:
+			break;
+	}
+	return 0;
+}
+
 /* Debug */
 static void settrace(
 struct _icxcam *s,
@@ -62,6 +62,12 @@ struct _icxcam {
 	int (*XYZ_to_cam)(struct _icxcam *s, double *out, double *in);
 	int (*cam_to_XYZ)(struct _icxcam *s, double *out, double *in);
 
+	/* Convert n values, in[] and out[] being n * 3 doubles. */
+	/* If fast is nz, the CAM may use faster, slightly less accurate */
+	/* arithmetic (CIECAM02: results within about 1e-9 of exact). */
+	int (*XYZ_to_cam_n)(struct _icxcam *s, double *out, double *in, int n, int fast);
+	int (*cam_to_XYZ_n)(struct _icxcam *s, double *out, double *in, int n, int fast);
+
 	/* Debug */
 	void (*settrace)(struct _icxcam *s, int tracev);
 
@@ -138,7 +138,13 @@ static void set_curve(void *cbntx, double *out, double *in) {
 		tin[e] = p->pol ? p->max[e] : p->min[e];
 	tin[ee] = in[0];
 
-	p->lookup(p->lucntx, tout, tin);
+	/* The end points were already looked up to find lmin and lmax */
+	if (in[0] == p->min[ee])
+		tout[0] = p->lmin;
+	else if (in[0] == p->max[ee])
+		tout[0] = p->lmax;
+	else
+		p->lookup(p->lucntx, tout, tin);
 
 	tt = (tout[0] - p->lmin)/(p->lmax - p->lmin);	/* Normalise from L */
 
@@ -155,6 +161,7 @@ void *lucntx,			/* Context for callback */
 void (*lookup) (void *lucntx, double *lin, double *dev)
 ) {
 	int ee, e;
+	double l00, l01, l10, l11;		/* Levels at the device corners */
 	xdevlin *p;
 
 	/* Do the basic class initialisation */
@@ -179,7 +186,6 @@ void (*lookup) (void *lucntx, double *lin, double *dev)
 	/* Determine what level to set the chanels we're not interested in */
 	{
 		double tin[MXDI], tout[MXDO];
-		double l00, l01, l10, l11;		/* Resulting levels */
 
 		for (e = 0; e < p->di; e++)
 			tin[e] = min[e];
@@ -222,15 +228,28 @@ void (*lookup) (void *lucntx, double *lin, double *dev)
 
 		p->setch = ee;
 
-		/* Figure the L min and max */
+		/* Figure the L min and max. The combinations used */
+		/* to choose the polarity needn't be looked up again. */
 		for (e = 0; e < p->di; e++)
 			tin[e] = p->pol ? max[e] : min[e];
 		tin[ee] = min[ee];
-		lookup(lucntx, tout, tin);
-		p->lmin = tout[0];
+		if (p->pol == 0)
+			p->lmin = l00;
+		else if (ee == 0)
+			p->lmin = l10;
+		else {
+			lookup(lucntx, tout, tin);
+			p->lmin = tout[0];
+		}
 		tin[ee] = max[ee];
-		lookup(lucntx, tout, tin);
-		p->lmax = tout[0];
+		if (p->pol != 0)
+			p->lmax = l11;
+		else if (ee == 0)
+			p->lmax = l01;
+		else {
+			lookup(lucntx, tout, tin);
+			p->lmax = tout[0];
+		}
 
 		p->curves[ee]->set_rspl(
 			p->curves[ee],
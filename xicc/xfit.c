@@ -107,6 +107,7 @@
 #define POWTOL 1e-5			/* Shaper Powell optimiser tollerance in delta E squared ^ CURVEPOW */
 #define MAXITS 4000			/* Shaper number of itterations before giving up */
 #define PDDEL  1e-6			/* Fake partial derivative del */
+#define XFIT_PBLK 128		/* Data point block size for parallel sums */
 
 /* Weights for shaper in/out curve parameters, to minimise unconstrained "wiggles" */
 #define SHAPE_WEIGHT	1.0		/* Overal shaper weight contribution - err on side of smoothness */
@@ -857,42 +858,104 @@ static void xfitprog(void *pdata, int perc) {
 }
 
 
-int xfitfunc_trace = 1;
+/* - - - - - - - - - - - - - - - */
+/* Multi-threaded data point sums */
+
+/* The optimisation functions sum the error (and partial derivatives) */
+/* over the data points. The points are summed in fixed blocks of */
+/* XFIT_PBLK, and the block sums added in order, so that the result */
+/* doesn't depend on the number of threads. With less than XFIT_PBLK */
+/* points this is the same as a plain serial sum. */
+
+/* Allocate the block sums for the data points. Return nz on error */
+static int alloc_sums(xfit *p) {
+	free(p->bev);
+	free(p->btw);
+	free(p->bdv);
+	p->nblk = (p->nodp + XFIT_PBLK - 1)/XFIT_PBLK;
+	if ((p->bev = (double *)malloc(p->nblk * sizeof(double))) == NULL
+	 || (p->btw = (double *)malloc(p->nblk * sizeof(double))) == NULL
+	 || (p->bdv = (double *)malloc(p->nblk * MXPARMS * sizeof(double))) == NULL)
+		return 1;
+	return 0;
+}
 
-/* Shaper+Matrix optimisation function handed to powell() */
-/* We simply minimize the total delta E squared, consistent with smoothness */
-static double xfitfunc(void *edata, double *v) {
-	xfit *p = (xfit *)edata;
-	double tw = 0.0;				/* Total weight */
-	double ev = 0.0, rv, smv;
-	double tin[MXDI], out[MXDO];
-	int di = p->di;
-	int fdi = p->fdi;
-	int i, e, f;
+/* Sum over data points i0..i1-1, returning the weight sum in *ptw, */
+/* and adding any partial derivatives to dav[] */
+typedef double (*xfit_pfunc)(xfit *p, double *ptw, double dav[], int i0, int i1);
 
-	/* Copy the parameters being optimised into xfit structure */
+typedef struct {
+	xfit *p;
+	xfit_pfunc func;
+	int ndv;				/* Number of partial derivatives, 0 for none */
+} xfit_psum_cx;
 
-	/* Special case - a single shaper curve. The first sm_iluord params */
-	/* are the common curve parameters, and the remainder are the matrix onwards */
-	if (p->opt_ssch) {
+static int xfit_psum_thread(void *cntx, int ix, int nth) {
+	xfit_psum_cx *cx = (xfit_psum_cx *)cntx;
+	xfit *p = cx->p;
+	int b, k;
 
-		for (e = 0; e < di; e++) {	/* Duplicate and extend to per channel curve params */
-			for (i = 0; i < p->sm_iluord; i++)
-				p->v[p->shp_offs[e] + i] = v[i];
-			for (; i < p->iluord[e]; i++)
-				p->v[p->shp_offs[e] + i] = 0.0;
-		}
-		for (i = p->sm_iluord; i < p->opt_cnt; i++)
-			p->v[p->mat_off + i - p->sm_iluord] = v[i];
-	} else {
-		for (i = 0; i < p->opt_cnt; i++) { 
-//printf("~1 param %d = %f\n",i,v[i]);
-			p->v[p->opt_off + i] = v[i];
+	for (b = ix; b < p->nblk; b += nth) {
+		int i0 = b * XFIT_PBLK, i1 = i0 + XFIT_PBLK;
+		double *dv = NULL;
+
+		if (i1 > p->nodp)
+			i1 = p->nodp;
+		if (cx->ndv > 0) {
+			dv = p->bdv + b * MXPARMS;
+			for (k = 0; k < cx->ndv; k++)
+				dv[k] = 0.0;
 		}
+		p->btw[b] = 0.0;
+		p->bev[b] = cx->func(p, &p->btw[b], dv, i0, i1);
 	}
+	return 0;
+}
 
-	/* For all our data points */
-	for (i = 0; i < p->nodp; i++) {
+/* Return the sum of func over all the data points, with the */
+/* weight sum in *ptw, and if ndv > 0, the sum of the partial */
+/* derivatives in dav[ndv]. */
+static double xfit_psum(xfit *p, xfit_pfunc func, double *ptw, double dav[], int ndv) {
+	xfit_psum_cx cx;
+	double ev = 0.0;
+	int b, k, nth;
+
+	cx.p = p;
+	cx.func = func;
+	cx.ndv = ndv;
+
+	if ((nth = p->nthreads) > p->nblk)
+		nth = p->nblk;
+	if (nth <= 1)
+		xfit_psum_thread((void *)&cx, 0, 1);
+	else
+		par_exec(nth, xfit_psum_thread, (void *)&cx);
+
+	*ptw = 0.0;
+	for (k = 0; k < ndv; k++)
+		dav[k] = 0.0;
+	for (b = 0; b < p->nblk; b++) {
+		ev += p->bev[b];
+		*ptw += p->btw[b];
+		for (k = 0; k < ndv; k++)
+			dav[k] += p->bdv[b * MXPARMS + k];
+	}
+	return ev;
+}
+
+/* - - - - - - - - - - - - - - - */
+
+/* Sum of the weighted delta E squared of data points i0..i1-1 */
+/* for the current parameters, with their weight sum in *ptw. */
+/* (dav[] is unused) */
+static double xfitfunc_pts(xfit *p, double *ptw, double dav[], int i0, int i1) {
+	double ev = 0.0;
+	double tin[MXDI], out[MXDO];
+	int di = p->di;
+	int fdi = p->fdi;
+	int i, e, f;
+
+	for (i = i0; i < i1; i++) {
 		double del;
 
 		/* Apply input shaper channel curves */
@@ -933,10 +996,48 @@ static double xfitfunc(void *edata, double *v) {
 		}
 		if (CURVEPOW > 1.0)
 			del = pow(del, CURVEPOW);
-		tw += p->rpoints[i].w;
+		*ptw += p->rpoints[i].w;
 		ev += p->rpoints[i].w * del;
 	}
 
+	return ev;
+}
+
+int xfitfunc_trace = 1;
+
+/* Shaper+Matrix optimisation function handed to powell() */
+/* We simply minimize the total delta E squared, consistent with smoothness */
+static double xfitfunc(void *edata, double *v) {
+	xfit *p = (xfit *)edata;
+	double tw = 0.0;				/* Total weight */
+	double ev, rv, smv;
+	int di = p->di;
+	int i, e;
+
+	/* Copy the parameters being optimised into xfit structure */
+
+	/* Special case - a single shaper curve. The first sm_iluord params */
+	/* are the common curve parameters, and the remainder are the matrix onwards */
+	if (p->opt_ssch) {
+
+		for (e = 0; e < di; e++) {	/* Duplicate and extend to per channel curve params */
+			for (i = 0; i < p->sm_iluord; i++)
+				p->v[p->shp_offs[e] + i] = v[i];
+			for (; i < p->iluord[e]; i++)
+				p->v[p->shp_offs[e] + i] = 0.0;
+		}
+		for (i = p->sm_iluord; i < p->opt_cnt; i++)
+			p->v[p->mat_off + i - p->sm_iluord] = v[i];
+	} else {
+		for (i = 0; i < p->opt_cnt; i++) { 
+//printf("~1 param %d = %f\n",i,v[i]);
+			p->v[p->opt_off + i] = v[i];
+		}
+	}
+
+	/* For all our data points */
+	ev = xfit_psum(p, xfitfunc_pts, &tw, NULL, 0);
+
 	/* Normalise error to be an average delta E squared */
 	ev /= tw;
 
@@ -955,17 +1056,13 @@ fprintf(stdout,"~1(sm %f, ev %f)xfitfunc returning %f\n",smv,ev,rv);
 	return rv;
 }
 
-/* Shaper+Matrix optimisation function with partial derivatives, */
-/* handed to conjgrad() */
-static double dxfitfunc(void *edata, double *dv, double *v) {
-	xfit *p = (xfit *)edata;
-	double tw = 0.0;				/* Total weight */
-	double ev = 0.0, rv, smv;
+/* Sum of the weighted delta E squared of data points i0..i1-1 */
+/* for the current parameters, with their weight sum in *ptw, */
+/* and add the weighted partial derivatives to dav[tot_cnt]. */
+static double dxfitfunc_pts(xfit *p, double *ptw, double dav[], int i0, int i1) {
+	double ev = 0.0;
 	double tin[MXDI], out[MXDO];
 
-	double dav[MXPARMS];				/* Overall del due to del param vals */
-	double sdav[MXPARMS];				/* Overall del due to del smooth param vals */
-
 	double dtin_iv[MXDI * MXLUORD];		/* Del in itrans out due to del itrans param vals */
 	double dmato_mv[1 << MXDI];			/* Del in mat out due to del in matrix param vals */
 	double dmato_tin[MXDO * MXDI];		/* Del in mat out due to del in matrix input values */
@@ -978,33 +1075,7 @@ static double dxfitfunc(void *edata, double *dv, double *v) {
 	int fdi = p->fdi;
 	int i, jj, k, e, ee, f, ff;
 
-	/* Copy the parameters being optimised into xfit structure */
-
-	/* Special case - a single shaper curve. The first sm_iluord params */
-	/* are the common curve parameters, and the remainder are the matrix onwards */
-	if (p->opt_ssch) {
-		for (e = 0; e < di; e++) {	/* Duplicate and extend to per channel curve params */
-			for (i = 0; i < p->sm_iluord; i++)
-				p->v[p->shp_offs[e] + i] = v[i];
-			for (; i < p->iluord[e]; i++)
-				p->v[p->shp_offs[e] + i] = 0.0;
-		}
-		for (i = p->sm_iluord; i < p->opt_cnt; i++) 
-			p->v[p->mat_off + i - p->sm_iluord] = v[i];
-
-	} else {
-		for (i = 0; i < p->opt_cnt; i++) { 
-			p->v[p->opt_off + i] = v[i];
-		}
-	}
-
-	/* Zero the accumulated partial derivatives */
-	/* We compute deriv for all parameters (not just current optimised) */
-	for (i = 0; i < p->tot_cnt; i++)
-		dav[i] = 0.0;
-
-	/* For all our data points */
-	for (i = 0; i < p->nodp; i++) {
+	for (i = i0; i < i1; i++) {
 		double del;
 
 		/* Apply input channel curves */
@@ -1069,7 +1140,7 @@ static double dxfitfunc(void *edata, double *dv, double *v) {
 		}
 
 		/* Accumulate total weighted delta E squared */
-		tw += p->rpoints[i].w;
+		*ptw += p->rpoints[i].w;
 		ev += p->rpoints[i].w * del;
 
 		/* Compute and accumulate partial difference values for each parameter value */
@@ -1117,6 +1188,46 @@ static double dxfitfunc(void *edata, double *dv, double *v) {
 		}
 	}
 
+	return ev;
+}
+
+/* Shaper+Matrix optimisation function with partial derivatives, */
+/* handed to conjgrad() */
+static double dxfitfunc(void *edata, double *dv, double *v) {
+	xfit *p = (xfit *)edata;
+	double tw = 0.0;				/* Total weight */
+	double ev, rv, smv;
+
+	double dav[MXPARMS];				/* Overall del due to del param vals */
+	double sdav[MXPARMS];				/* Overall del due to del smooth param vals */
+
+	int di = p->di;
+	int i, e;
+
+	/* Copy the parameters being optimised into xfit structure */
+
+	/* Special case - a single shaper curve. The first sm_iluord params */
+	/* are the common curve parameters, and the remainder are the matrix onwards */
+	if (p->opt_ssch) {
+		for (e = 0; e < di; e++) {	/* Duplicate and extend to per channel curve params */
+			for (i = 0; i < p->sm_iluord; i++)
+				p->v[p->shp_offs[e] + i] = v[i];
+			for (; i < p->iluord[e]; i++)
+				p->v[p->shp_offs[e] + i] = 0.0;
+		}
+		for (i = p->sm_iluord; i < p->opt_cnt; i++) 
+			p->v[p->mat_off + i - p->sm_iluord] = v[i];
+
+	} else {
+		for (i = 0; i < p->opt_cnt; i++) { 
+			p->v[p->opt_off + i] = v[i];
+		}
+	}
+
+	/* For all our data points, */
+	/* computing deriv for all parameters (not just current optimised) */
+	ev = xfit_psum(p, dxfitfunc_pts, &tw, dav, p->tot_cnt);
+
 	/* Normalise error to be an average delta E squared */
 	ev /= tw;
 	for (i = 0; i < p->tot_cnt; i++) {
@@ -1728,6 +1839,9 @@ static int xfit_fit(
 	p->to_de2  = to_de2;
 	p->to_dde2 = to_dde2;
 
+	if (alloc_sums(p))
+		return 1;
+
 #ifdef DEBUG
 	printf("xfit_fit called with flags = 0x%x, di = %d, fdi = %d, nodp = %d, tcomb = 0x%x\n",flags,di,fdi,nodp,tcomb);
 #endif
@@ -3080,6 +3194,9 @@ static void xfit_del(xfit *p) {
 		free(p->piv);
 	if (p->uerrv != NULL)
 		free(p->uerrv);
+	free(p->bev);
+	free(p->btw);
+	free(p->bdv);
 	free(p);
 }
 
@@ -3095,6 +3212,7 @@ icc *picc			/* ICC profile used to set cone space matrix, NULL for Bradford. */
 	}
 
 	p->picc = picc;
+	p->nthreads = num_threads();
 
 	/* Set method pointers */
 	p->fit         = xfit_fit;
@@ -133,6 +133,12 @@ struct _xfit {
 	xfit_piv *piv;			/* Point inverse information for XFIT_FM_INPUT         */
 	double *uerrv;			/* Array holding span width in DE for current opt chan */
 
+	int nthreads;			/* Number of threads to use for the data point sums */
+	int nblk;				/* Number of data point sum blocks */
+	double *bev;			/* [nblk] Block weighted error sums */
+	double *btw;			/* [nblk] Block weight sums */
+	double *bdv;			/* [nblk * MXPARMS] Block partial derivative sums */
+
 	double mat[3][3];		/* XYZ White point aprox relative to accurate relative matrix */
 	double cmat[3][3];		/* Final rspl correction matrix */
 
@@ -55,6 +55,7 @@
 #define MAX_INVSOLN 4
 
 static void xicc_del(xicc *p);
+static int xicc_set_cache(xicc *p, char *dir);
 icxLuBase * xicc_get_luobj(xicc *p, int flags, icmLookupFunc func, icRenderingIntent intent,
                            icColorSpaceSignature pcsor, icmLookupOrder order,
                            icxViewCond *vc, icxInk *ink);
@@ -77,6 +78,8 @@ static void icxLu_get_native_ranges (icxLuBase *p,
 static void icxLu_get_ranges (icxLuBase *p,
                               double *inmin, double *inmax, double *outmin, double *outmax);
 static void icxLuEfv_wh_bk_points(icxLuBase *p, double *wht, double *blk, double *kblk);
+static int icxLu_lookup_n(icxLuBase *p, double *out, double *in, int n);
+static int icxLu_inv_lookup_n(icxLuBase *p, double *out, double *in, int n);
 int xicc_get_viewcond(xicc *p, icxViewCond *vc);
 
 /* The different profile types are in their own source filesm */
@@ -226,6 +229,43 @@ double *outmin, double *outmax		/* Return maximum range of outspace values */
 	}
 }
 
+/* Translate n values through lookup(), a value at a time. */
+/* (Used by types that don't have a faster way of doing it.) */
+static int
+icxLu_lookup_n (
+icxLuBase *p,
+double *out,		/* n * outputChan output values */
+double *in,			/* n * inputChan input values */
+int n
+) {
+	int i, rv = 0;
+
+	for (i = 0; i < n; i++, in += p->inputChan, out += p->outputChan) {
+		int trv = p->lookup(p, out, in);
+		if (trv > rv)
+			rv = trv;
+	}
+	return rv;
+}
+
+/* Translate n values through inv_lookup(), a value at a time. */
+static int
+icxLu_inv_lookup_n (
+icxLuBase *p,
+double *out,		/* n * inputChan output values */
+double *in,			/* n * outputChan input values */
+int n
+) {
+	int i, rv = 0;
+
+	for (i = 0; i < n; i++, in += p->outputChan, out += p->inputChan) {
+		int trv = p->inv_lookup(p, out, in);
+		if (trv > rv)
+			rv = trv;
+	}
+	return rv;
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /* Routine to figure out a suitable black point for CMYK */
 
@@ -886,6 +926,12 @@ icc *picc		/* icc we are expanding */
 	p->get_luobj     = xicc_get_luobj;
 	p->set_luobj     = xicc_set_luobj;
 	p->get_viewcond  = xicc_get_viewcond;
+	p->set_cache     = xicc_set_cache;
+
+	/* Have matrix profile bwd lookups use dense inverse TRC tables */
+	/* for monotonic table curves, unless the caller has chosen. */
+	if (picc->bwdcurveres == 0)
+		picc->bwdcurveres = XICC_BWDCURVERES;
 
 	/* Create an xcal if there is the right tag in the profile */
 	p->cal = xiccReadCalTag(p->pp);
@@ -900,9 +946,29 @@ xicc *p
 ) {
 	if (p->cal != NULL && p->nodel_cal == 0)
 		p->cal->del(p->cal);
+	free(p->cachedir);
 	free (p);
 }
 
+/* Set the gamut and cusp map cache directory, NULL for none */
+static int xicc_set_cache(
+xicc *p,
+char *dir
+) {
+	free(p->cachedir);
+	p->cachedir = NULL;
+
+	if (dir != NULL) {
+		if ((p->cachedir = (char *)malloc(strlen(dir) + 1)) == NULL) {
+			p->errc = 2;
+			sprintf(p->err,"Malloc of cache directory name failed");
+			return p->errc;
+		}
+		strcpy(p->cachedir, dir);
+	}
+	return 0;
+}
+
 /* return nz if the intent implies Jab space */
 int xiccIsIntentJab(icRenderingIntent intent) {
 
@@ -3807,6 +3873,112 @@ void icxdpdiMulBy3x3Parm(
 	out[2] = ov[2];
 }
 
+/* - - - - - - - - - - */
+/* icc and cgats objects with allocators that account for their */
+/* memory use in the a1ma subsystem totals. */
+
+#if !defined(ICC_DEBUG_MALLOC) && !defined(CGATS_DEBUG_MALLOC)
+
+static void *icmAllocA1ma_malloc(icmAlloc *pp, size_t size) {
+	return a1ma_malloc(a1ma_icc, size);
+}
+
+static void *icmAllocA1ma_calloc(icmAlloc *pp, size_t num, size_t size) {
+	return a1ma_calloc(a1ma_icc, num, size);
+}
+
+static void *icmAllocA1ma_realloc(icmAlloc *pp, void *ptr, size_t size) {
+	return a1ma_realloc(a1ma_icc, ptr, size);
+}
+
+static void icmAllocA1ma_free(icmAlloc *pp, void *ptr) {
+	a1ma_free(a1ma_icc, ptr);
+}
+
+static void icmAllocA1ma_del(icmAlloc *pp) {
+	free(pp);
+}
+
+static void *cgatsAllocA1ma_malloc(cgatsAlloc *pp, size_t size) {
+	return a1ma_malloc(a1ma_cgats, size);
+}
+
+static void *cgatsAllocA1ma_calloc(cgatsAlloc *pp, size_t num, size_t size) {
+	return a1ma_calloc(a1ma_cgats, num, size);
+}
+
+static void *cgatsAllocA1ma_realloc(cgatsAlloc *pp, void *ptr, size_t size) {
+	return a1ma_realloc(a1ma_cgats, ptr, size);
+}
+
+static void cgatsAllocA1ma_free(cgatsAlloc *pp, void *ptr) {
+	a1ma_free(a1ma_cgats, ptr);
+}
+
+static void cgatsAllocA1ma_del(cgatsAlloc *pp) {
+	free(pp);
+}
+
+#endif /* !ICC_DEBUG_MALLOC && !CGATS_DEBUG_MALLOC */
+
+/* Create an icc with the default allocator, or an accounting */
+/* allocator if memory accounting is on. Return NULL on error. */
+icc *new_icc_a1ma(void) {
+#if !defined(ICC_DEBUG_MALLOC) && !defined(CGATS_DEBUG_MALLOC)
+	icmAlloc *al;
+	icc *p;
+
+	if (!a1ma_enabled())
+		return new_icc();
+
+	if ((al = (icmAlloc *)calloc(1, sizeof(icmAlloc))) == NULL)
+		return NULL;
+	al->malloc  = icmAllocA1ma_malloc;
+	al->calloc  = icmAllocA1ma_calloc;
+	al->realloc = icmAllocA1ma_realloc;
+	al->free    = icmAllocA1ma_free;
+	al->del     = icmAllocA1ma_del;
+
+	if ((p = new_icc_a(al)) == NULL) {
+		al->del(al);
+		return NULL;
+	}
+	p->del_al = 1;		/* Get icc->del to cleanup allocator */
+	return p;
+#else
+	return new_icc();
+#endif
+}
+
+/* Create a cgats with the default allocator, or an accounting */
+/* allocator if memory accounting is on. Return NULL on error. */
+cgats *new_cgats_a1ma(void) {
+#if !defined(ICC_DEBUG_MALLOC) && !defined(CGATS_DEBUG_MALLOC)
+	cgatsAlloc *al;
+	cgats *p;
+
+	if (!a1ma_enabled())
+		return new_cgats();
+
+	if ((al = (cgatsAlloc *)calloc(1, sizeof(cgatsAlloc))) == NULL)
+		return NULL;
+	al->malloc  = cgatsAllocA1ma_malloc;
+	al->calloc  = cgatsAllocA1ma_calloc;
+	al->realloc = cgatsAllocA1ma_realloc;
+	al->free    = cgatsAllocA1ma_free;
+	al->del     = cgatsAllocA1ma_del;
+
+	if ((p = new_cgats_al(al)) == NULL) {
+		al->del(al);
+		return NULL;
+	}
+	p->del_al = 1;		/* Get cgats->del to cleanup allocator */
+	return p;
+#else
+	return new_cgats();
+#endif
+}
+
 /* - - - - - - - - - - */
 #undef stricmp
 
@@ -48,6 +48,7 @@
 #define XICC_NEUTRAL_CMYK_BLACK		/* Use neutral axis black, else use K direction black. */
 #define XICC_BLACK_POINT_TOLL 0.5			/* Tollerance of CMYK black point location */ 
 #define XICC_BLACK_FIND_ABERR_WEIGHT 10.0	/* Weight of ab error against min L in BP */
+#define XICC_BWDCURVERES 4096				/* Default icc bwdcurveres for matrix profiles */
 
 /* ------------------------------------------------------------------------------ */
 
@@ -241,6 +242,7 @@ struct _xicc {
 
 	struct _xcal *cal;	/* Optional device cal, NULL if none */
 	int nodel_cal;		/* Flag, nz if cal was provided externally and shouldn't be deleted */
+	char *cachedir;		/* Gamut and cusp map cache directory, NULL if none */
 
 	/* Public: */
 	void                 (*del)(struct _xicc *p);
@@ -262,6 +264,13 @@ struct _xicc {
 									/* than a point by point inverse locus lookup . */
 									/* NOT IMPLEMENTED YET */
 #define ICX_FAST_SETUP   0x0800		/* Improve initial setup speed at the cost of throughput */
+#define ICX_REV_HINT     0x0200		/* Start each clut inverse search at the previous solution. */
+									/* Faster when successive lookups are close together, */
+									/* but returns one of multiple solutions rather than */
+									/* their average. */
+#define ICX_GAMUT_SURF   0x1000		/* Lut: get_gamut() only samples the device space */
+									/* surface and the ink limit, skipping the interior. */
+									/* Faster, but assumes the device space doesn't fold over. */
 #define ICX_VERBOSE      0x8000		/* Turn on verboseness during creation */
 
 	                                /* Returm a lookup object from the icc */
@@ -331,6 +340,13 @@ struct _xicc {
 								/* Return value 2 if it is not possible/appropriate */
 	int     (*get_viewcond)(struct _xicc *p, icxViewCond *vc);
 
+								/* Set a directory to cache the gamut surfaces and cusp */
+								/* maps of Lut lookup objects in, so that they are loaded */
+								/* rather than re-computed on later runs. NULL to turn */
+								/* caching off. The profile shouldn't be modified while set. */
+								/* Return nz on a malloc error. */
+	int     (*set_cache)(struct _xicc *p, char *dir);
+
 	char             err[512];			/* Error message */
 	int              errc;				/* Error code */
 }; typedef struct _xicc xicc;
@@ -381,6 +397,7 @@ xicc *new_xicc(icc *picc);
 	int camclip;	/* Flag - If LuLut: Use CIECAM for clut reverse lookup clipping */ \
 	int intsep;		/* Flag - If LuLut: Do internal separation for 4d device */			\
 	int fastsetup;	/* Flag - If LuLut: Do fast setup at cost of slower throughput */	\
+	int revhint;	/* Flag - If LuLut: Start clut inverse at the previous solution */	\
 																						\
 	/* Public: */																		\
 	void    (*del)(struct _icxLuBase *p);												\
@@ -426,6 +443,13 @@ xicc *new_xicc(icc *picc);
 	int			   (*inv_lookup) (struct _icxLuBase *p, double *out, double *in);		\
 											/* Inverse conversion */					\
 																						\
+	/* Translate n values through the profile, with the same results as n calls */		\
+	/* of lookup() or inv_lookup(). in[] and out[] hold the values packed one after */	\
+	/* the other, with the number of channels of the input and output of that */		\
+	/* direction. Returns the worst of the individual return values. */					\
+	int            (*lookup_n) (struct _icxLuBase *p, double *out, double *in, int n);	\
+	int            (*inv_lookup_n) (struct _icxLuBase *p, double *out, double *in, int n); \
+																						\
 	/* Given an xicc lookup object, returm a gamut object. */							\
 	/* Note that the Effective PCS must be Lab or Jab */								\
 	/* A icxLuLut type must be icmFwd or icmBwd, */										\
@@ -605,6 +629,17 @@ struct _icxLuLut {
 	/* Get the matrix contents */
 	void (*get_matrix) (struct _icxLuLut *p, double m[3][3]);
 
+	/* Create a copy of this LuLut for use by another thread. All the lookups */
+	/* of the copy, including the inverse ones, may be called at the same time */
+	/* as those of this LuLut and of its other copies. The copy shares */
+	/* everything except the rspl reverse lookup state (see rspl rev_thread_ctx()), */
+	/* so any ink limit or clipping setup must be done before copies are made. */
+	/* nctx is the total number of copies that will be made. */
+	/* Copies must be created and del()'d from one thread, and all must */
+	/* be del()'d before this LuLut is deleted. */
+	/* Return NULL on error, with the error in the xicc. */
+	struct _icxLuLut *(*inv_thread_ctx) (struct _icxLuLut *p, int nctx);
+
 }; typedef struct _icxLuLut icxLuLut;
 
 /* ------------------------------------------------------------------------------ */
@@ -967,6 +1002,14 @@ struct _icxCuspMap {
 }; typedef struct _icxCuspMap icxCuspMap;
 
 
+/* - - - - - - - - - - */
+
+/* Create an icc or cgats object whose memory use is accounted */
+/* for if ARGYLL_MEM_REPORT is set (see numsup.h a1ma_*()), */
+/* or with the default allocator if not. Return NULL on error. */
+icc *new_icc_a1ma(void);
+cgats *new_cgats_a1ma(void);
+
 /* - - - - - - - - - - */
 
 #include "xcal.h"
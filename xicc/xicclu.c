@@ -31,6 +31,9 @@
 #include <fcntl.h>
 #include <string.h>
 #include <math.h>
+#if defined(O_BINARY) || defined(_O_BINARY)
+# include <io.h>
+#endif
 #include "copyright.h"
 #include "aconfig.h"
 #include "numlib.h"
@@ -44,6 +47,7 @@
 #define USE_FASTNNSETP		/* [def] Make it more responsive, but not same alg. */
 							/* NOTE camclip & merglut are runtime options! */
 #define XRES 128			/* [128] Plotting resolution */
+#define STRM_BLOCK 4096		/* [4096] Colors per binary stream block */
 
 #ifndef USE_NEARCLIP
 # pragma message("!!!!!!!!!!!! USE_NEARCLIP turned off  !!!!!!!!!")
@@ -103,6 +107,7 @@ void usage(char *diag) {
 	fprintf(stderr," -u             warn if output PCS is outside the spectrum locus\n");
 	fprintf(stderr," -m             merge output processing into clut\n");
 	fprintf(stderr," -b             use CAM Jab for clipping\n");
+	fprintf(stderr," -x f|d         Binary stream of packed float or double values in and out\n");
 //	fprintf(stderr," -S             Use internal optimised separation for inverse 4d [NOT IMPLEMENTED]\n");
 
 #ifdef SPTEST
@@ -140,6 +145,8 @@ void usage(char *diag) {
 	fprintf(stderr,"    A line starting with a # will be ignored.\n");
 	fprintf(stderr,"    A line not starting with a number will terminate the program.\n");
 	fprintf(stderr,"    Use -v0 for just output colors.\n");
+	fprintf(stderr,"    With -x, input is native byte order packed input channel values,\n");
+	fprintf(stderr,"    and output is packed output channel values, until end of input.\n");
 	exit(1);
 }
 
@@ -166,6 +173,254 @@ void spioutf(void *cbntx, double *out, double *in) {
 
 #endif /* SPTEST */
 
+/* Conversion between the user and lookup input and output values */
+typedef struct {
+	icColorSpaceSignature ins, outs;	/* User input and output spaces */
+	int inn, outn;			/* Number of input and output components */
+	double scale;			/* Device value scale factor, 0.0 if none */
+	int in_tvenc, out_tvenc;	/* Video encoding */
+	int repYxy, repYuv, repJCh, repLCh, repXYZ100;
+	int absmeas;			/* Display absolute measurement */
+	double dispLuminance;	/* Luminance value for absmeas */
+} uconv;
+
+/* Return nz if the colorspace is a device space */
+static int is_dev(icColorSpaceSignature sig) {
+	return sig != icxSigJabData
+	    && sig != icxSigJChData
+	    && sig != icSigXYZData
+	    && sig != icSigLabData
+	    && sig != icxSigLChData
+	    && sig != icSigLuvData
+	    && sig != icSigYCbCrData
+	    && sig != icSigYxyData
+	    && sig != icSigHsvData
+	    && sig != icSigHlsData;
+}
+
+/* Convert nch user input values to lookup input values in place */
+static void uconv_in(uconv *p, double *in, int nch) {
+	int i;
+
+	/* If device data and scale */
+	if (is_dev(p->ins)) {
+		if (p->scale > 0.0) {
+			for (i = 0; i < nch; i++)
+				in[i] /= p->scale;
+		}
+		if (p->inn == 3 && p->in_tvenc != 0) {
+			if (p->in_tvenc == 1) {			/* Video 16-235 range */
+				icmRGB_2_VidRGB(in, in);
+			} else if (p->in_tvenc == 2) {		/* Rec601 YCbCr */
+				icmRec601_RGBd_2_YPbPr(in, in);
+				icmRecXXX_YPbPr_2_YCbCr(in, in);
+			} else if (p->in_tvenc == 3) {		/* Rec709 YCbCr */
+				icmRec709_RGBd_2_YPbPr(in, in);
+				icmRecXXX_YPbPr_2_YCbCr(in, in);
+			} else if (p->out_tvenc == 4) {		/* Rec709 1250/50/2:1 YCbCr */
+				icmRec709_50_RGBd_2_YPbPr(in, in);
+				icmRecXXX_YPbPr_2_YCbCr(in, in);
+			} else if (p->out_tvenc == 5) {		/* Rec2020 Non-constant Luminance YCbCr */
+				icmRec2020_NCL_RGBd_2_YPbPr(in, in);
+				icmRecXXX_YPbPr_2_YCbCr(in, in);
+			} else if (p->out_tvenc == 6) {		/* Rec2020 Non-constant Luminance YCbCr */
+				icmRec2020_CL_RGBd_2_YPbPr(in, in);
+				icmRecXXX_YPbPr_2_YCbCr(in, in);
+			}
+		}
+	}
+
+	if (p->repXYZ100 && p->ins == icSigXYZData) {
+		in[0] /= 100.0;
+		in[1] /= 100.0;
+		in[2] /= 100.0;
+	}
+
+	if (p->repYxy && p->ins == icSigYxyData) {
+		icmYxy2XYZ(in, in);
+	}
+
+	if (p->repYuv && p->ins == icmSigYuvData) {
+		icmYuv2XYZ(in, in);
+	}
+
+	/* JCh -> Jab & LCh -> Lab */
+	if ((p->repJCh && p->ins == icxSigJChData) 
+	 || (p->repLCh && p->ins == icxSigLChData)) {
+		double C = in[1];
+		double h = in[2];
+		in[1] = C * cos(3.14159265359/180.0 * h);
+		in[2] = C * sin(3.14159265359/180.0 * h);
+	}
+
+	/* display absolute measurement */
+	if (p->absmeas && p->ins == icSigXYZData) {
+		in[0] /= p->dispLuminance;
+		in[1] /= p->dispLuminance;
+		in[2] /= p->dispLuminance;
+	}
+}
+
+/* Convert nch lookup output values to user output values in place */
+static void uconv_out(uconv *p, double *uout, int nch) {
+	int i;
+
+	/* display absolute measurement */
+	if (p->absmeas && p->outs == icSigXYZData) {
+		uout[0] *= p->dispLuminance;
+		uout[1] *= p->dispLuminance;
+		uout[2] *= p->dispLuminance;
+	}
+
+	if (p->repXYZ100 && p->outs == icSigXYZData) {
+		uout[0] *= 100.0;
+		uout[1] *= 100.0;
+		uout[2] *= 100.0;
+	}
+
+	if (p->repYxy && p->outs == icSigYxyData) {
+		icmXYZ2Yxy(uout, uout);
+	}
+
+	if (p->repYuv && p->outs == icmSigYuvData) {
+		icmXYZ2Yuv(uout, uout);
+	}
+
+	/* Jab -> JCh and Lab -> LCh */
+	if ((p->repJCh && p->outs == icxSigJChData) 
+	 || (p->repLCh && p->outs == icxSigLChData)) {
+		double a = uout[1];
+		double b = uout[2];
+		uout[1] = sqrt(a * a + b * b);
+	    uout[2] = (180.0/3.14159265359) * atan2(b, a);
+		uout[2] = (uout[2] < 0.0) ? uout[2] + 360.0 : uout[2];
+	}
+
+	/* If device data and scale */
+	if (is_dev(p->outs)) {
+		if (p->outn == 3 && p->out_tvenc != 0) {
+			if (p->out_tvenc == 1) {				/* Video 16-235 range */
+				icmVidRGB_2_RGB(uout, uout);
+			} else if (p->out_tvenc == 2) {		/* Rec601 YCbCr */
+				icmRecXXX_YCbCr_2_YPbPr(uout, uout);
+				icmRec601_YPbPr_2_RGBd(uout, uout);
+			} else if (p->out_tvenc == 3) {		/* Rec709 1150/60/2:1 YCbCr */
+				icmRecXXX_YCbCr_2_YPbPr(uout, uout);
+				icmRec709_YPbPr_2_RGBd(uout, uout);
+			} else if (p->out_tvenc == 4) {		/* Rec709 1250/50/2:1 YCbCr */
+				icmRecXXX_YCbCr_2_YPbPr(uout, uout);
+				icmRec709_50_YPbPr_2_RGBd(uout, uout);
+			} else if (p->out_tvenc == 5) {		/* Rec2020 Non-constant Luminance YCbCr */
+				icmRecXXX_YCbCr_2_YPbPr(uout, uout);
+				icmRec2020_NCL_YPbPr_2_RGBd(uout, uout);
+			} else if (p->out_tvenc == 6) {		/* Rec2020 Non-constant Luminance YCbCr */
+				icmRecXXX_YCbCr_2_YPbPr(uout, uout);
+				icmRec2020_CL_YPbPr_2_RGBd(uout, uout);
+			}
+		}
+		if (p->scale > 0.0) {
+			for (i = 0; i < nch; i++)
+				uout[i] *= p->scale;
+		}
+	}
+}
+
+/* Translate a binary stream of packed float (dsz = 4) or double (dsz = 8) */
+/* values from stdin to stdout, a block of colors at a time using the bulk */
+/* lookup functions. Auxiliary inverse lookup targets aren't supported. */
+static void stream_lu(
+uconv *uc,
+xicc *xicco,
+icxLuBase *luo,			/* ICC lookup, NULL if cal */
+xcal *cal,				/* cal lookup, NULL if ICC */
+int inv,				/* nz to do inverse lookup */
+int dsz					/* Size of a stream value */
+) {
+	int inn = uc->inn, outn = uc->outn;
+	unsigned char *ibuf, *obuf;
+	double *in, *out;
+
+#if defined(O_BINARY) || defined(_O_BINARY)
+	setmode(fileno(stdin), O_BINARY);
+	setmode(fileno(stdout), O_BINARY);
+#endif
+
+	if ((ibuf = (unsigned char *)malloc(STRM_BLOCK * inn * dsz)) == NULL
+	 || (obuf = (unsigned char *)malloc(STRM_BLOCK * outn * dsz)) == NULL
+	 || (in = (double *)malloc(STRM_BLOCK * inn * sizeof(double))) == NULL
+	 || (out = (double *)malloc(STRM_BLOCK * outn * sizeof(double))) == NULL)
+		error("Malloc of stream buffers failed");
+
+	for (;;) {
+		size_t nr;
+		int i, j, n, ni, no;
+
+		if ((nr = fread(ibuf, inn * dsz, STRM_BLOCK, stdin)) == 0)
+			break;
+		n = (int)nr;
+		ni = n * inn;
+		no = n * outn;
+
+		if (dsz == 4) {
+			float *fp = (float *)ibuf;
+			for (i = 0; i < ni; i++)
+				in[i] = (double)fp[i];
+		} else {
+			memcpy(in, ibuf, ni * sizeof(double));
+		}
+
+		for (i = 0; i < ni; i += inn)
+			uconv_in(uc, in + i, inn);
+
+		if (cal != NULL) {	/* .cal */
+			for (i = 0; i < n; i++) {
+				if (inv) {
+					if (cal->inv_interp(cal, out + i * outn, in + i * inn) != 0)
+						error ("%d, %s",cal->errc,cal->err);
+				} else {
+					cal->interp(cal, out + i * outn, in + i * inn);
+				}
+			}
+		} else {			/* ICC */
+			if (inv) {
+				for (i = 0; i < n; i++) {
+					for (j = 0; j < outn; j++)
+						out[i * outn + j] = j < inn ? in[i * inn + j] : 0.0;
+				}
+				if (luo->inv_lookup_n(luo, out, in, n) > 1)
+					error ("%d, %s",xicco->errc,xicco->err);
+			} else {
+				if (luo->lookup_n(luo, out, in, n) > 1)
+					error ("%d, %s",xicco->errc,xicco->err);
+			}
+		}
+
+		for (i = 0; i < no; i += outn)
+			uconv_out(uc, out + i, outn);
+
+		if (dsz == 4) {
+			float *fp = (float *)obuf;
+			for (i = 0; i < no; i++)
+				fp[i] = (float)out[i];
+		} else {
+			memcpy(obuf, out, no * sizeof(double));
+		}
+		if (fwrite(obuf, outn * dsz, n, stdout) != nr)
+			error("Write to stdout failed");
+
+		if (nr < STRM_BLOCK)
+			break;
+	}
+	if (ferror(stdin))
+		error("Read from stdin failed");
+	fflush(stdout);
+
+	free(out);
+	free(in);
+	free(obuf);
+	free(ibuf);
+}
+
 int
 main(int argc, char *argv[]) {
 	int fa, nfa, mfa;				/* argument we're looking at */
@@ -210,9 +465,11 @@ main(int argc, char *argv[]) {
 	double scale = 0.0;		/* Device value scale factor */
 	int in_tvenc = 0;		/* 1 to use RGB Video Level encoding, 2 = Rec601, 3 = Rec709 YCbCr */
 	int out_tvenc = 0;		/* 1 to use RGB Video Level encoding, 2 = Rec601, 3 = Rec709 YCbCr */
+	int strm = 0;			/* Binary stream value size, 0 for text */
 	int rv = 0;
 	char buf[200];
 	double uin[MAX_CHAN], in[MAX_CHAN], out[MAX_CHAN], uout[MAX_CHAN];
+	uconv uc;				/* User value conversion */
 
 	icxLuBase *luo = NULL, *aluo = NULL;
 	icColorSpaceSignature ins, outs;	/* Type of input and output spaces */
@@ -326,6 +583,17 @@ main(int argc, char *argv[]) {
 			else if (argv[fa][1] == 'S') {
 				intsep = 1;
 			}
+			/* Binary stream */
+			else if (argv[fa][1] == 'x') {
+				if (na == NULL) usage("No parameter after flag -x");
+				fa = nfa;
+				if (na[0] == 'f')
+					strm = sizeof(float);
+				else if (na[0] == 'd')
+					strm = sizeof(double);
+				else
+					usage("Unknown parameter after flag -x");
+			}
 			/* Device scale */
 			else if (argv[fa][1] == 's') {
 				if (na == NULL) usage("No parameter after flag -s");
@@ -733,6 +1001,10 @@ main(int argc, char *argv[]) {
 	if (fa >= argc || argv[fa][0] == '-') usage("Expecting profile file name");
 	strncpy(prof_name,argv[fa],MAXNAMEL); prof_name[MAXNAMEL] = '\000';
 
+	/* Keep stdout clean for the binary stream */
+	if (strm != 0 && !doplot)
+		verb = 0;
+
 	if (slocwarn) {
 		if ((chlp = chrom_locus_poligon(0, icxOT_CIE_1931_2, 0)) == NULL)
 			error("chrom_locus_poligon failed");
@@ -1206,261 +1478,151 @@ main(int argc, char *argv[]) {
 			error("Can't warn if outside spectrum locus unless XYZ like space");
 		}
 
-		/* Process colors to translate */
-		for (;;) {
-			int i,j;
-			char *bp, *nbp;
-			int outsloc = 0;
-
-			/* Read in the next line */
-			if (fgets(buf, 200, stdin) == NULL)
-				break;
-			if (buf[0] == '#') {
-				if (verb > 0)
-					fprintf(stdout,"%s\n",buf);
-				continue;
-			}
-			/* For each input number */
-			for (nbp = buf, i = 0; i < MAX_CHAN; i++) {
-				bp = nbp;
-				uout[i] = out[i] = in[i] = uin[i] = strtod(bp, &nbp);
-				if (nbp == bp)
-					break;			/* Failed */
-			}
-			if (i == 0)
-				break;
-
-			/* If device data and scale */
-			if( ins != icxSigJabData
-			 && ins != icxSigJChData
-			 && ins != icSigXYZData
-			 && ins != icSigLabData
-			 && ins != icxSigLChData
-			 && ins != icSigLuvData
-			 && ins != icSigYCbCrData
-			 && ins != icSigYxyData
-			 && ins != icSigHsvData
-			 && ins != icSigHlsData) {
-				if (scale > 0.0) {
-					for (i = 0; i < MAX_CHAN; i++)
-						in[i] /= scale;
-				}
-				if (inn == 3 && in_tvenc != 0) {
-					if (in_tvenc == 1) {			/* Video 16-235 range */
-						icmRGB_2_VidRGB(in, in);
-					} else if (in_tvenc == 2) {		/* Rec601 YCbCr */
-						icmRec601_RGBd_2_YPbPr(in, in);
-						icmRecXXX_YPbPr_2_YCbCr(in, in);
-					} else if (in_tvenc == 3) {		/* Rec709 YCbCr */
-						icmRec709_RGBd_2_YPbPr(in, in);
-						icmRecXXX_YPbPr_2_YCbCr(in, in);
-					} else if (out_tvenc == 4) {		/* Rec709 1250/50/2:1 YCbCr */
-						icmRec709_50_RGBd_2_YPbPr(in, in);
-						icmRecXXX_YPbPr_2_YCbCr(in, in);
-					} else if (out_tvenc == 5) {		/* Rec2020 Non-constant Luminance YCbCr */
-						icmRec2020_NCL_RGBd_2_YPbPr(in, in);
-						icmRecXXX_YPbPr_2_YCbCr(in, in);
-					} else if (out_tvenc == 6) {		/* Rec2020 Non-constant Luminance YCbCr */
-						icmRec2020_CL_RGBd_2_YPbPr(in, in);
-						icmRecXXX_YPbPr_2_YCbCr(in, in);
-					}
-				}
-			}
-
-			if (repXYZ100 && ins == icSigXYZData) {
-				in[0] /= 100.0;
-				in[1] /= 100.0;
-				in[2] /= 100.0;
-			}
-
-			if (repYxy && ins == icSigYxyData) {
-				icmYxy2XYZ(in, in);
-			}
-
-			if (repYuv && ins == icmSigYuvData) {
-				icmYuv2XYZ(in, in);
-			}
-
-			/* JCh -> Jab & LCh -> Lab */
-			if ((repJCh && ins == icxSigJChData) 
-			 || (repLCh && ins == icxSigLChData)) {
-				double C = in[1];
-				double h = in[2];
-				in[1] = C * cos(3.14159265359/180.0 * h);
-				in[2] = C * sin(3.14159265359/180.0 * h);
-			}
+		uc.ins = ins;
+		uc.outs = outs;
+		uc.inn = inn;
+		uc.outn = outn;
+		uc.scale = scale;
+		uc.in_tvenc = in_tvenc;
+		uc.out_tvenc = out_tvenc;
+		uc.repYxy = repYxy;
+		uc.repYuv = repYuv;
+		uc.repJCh = repJCh;
+		uc.repLCh = repLCh;
+		uc.repXYZ100 = repXYZ100;
+		uc.absmeas = absmeas;
+		uc.dispLuminance = dispLuminance;
+
+		/* Binary stream of colors to translate */
+		if (strm != 0) {
+			stream_lu(&uc, xicco, luo, cal, cal != NULL ? (func == icmBwd || invert) : invert, strm);
 
-			/* display absolute measurement */
-			if (absmeas && ins == icSigXYZData) {
-				in[0] /= dispLuminance;
-				in[1] /= dispLuminance;
-				in[2] /= dispLuminance;
-			}
+		/* Process colors to translate */
+		} else {
+			for (;;) {
+				int i,j;
+				char *bp, *nbp;
+				int outsloc = 0;
 
-			/* Do conversion */
-			if (cal != NULL) {	/* .cal */
-				if (func == icmBwd || invert) {
-					if ((rv = cal->inv_interp(cal, out, in)) != 0)
-						error ("%d, %s",cal->errc,cal->err);
-				} else {
-					cal->interp(cal, out, in);
-					rv = 0;
+				/* Read in the next line */
+				if (fgets(buf, 200, stdin) == NULL)
+					break;
+				if (buf[0] == '#') {
+					if (verb > 0)
+						fprintf(stdout,"%s\n",buf);
+					continue;
 				}
-
-			} else {	/* ICC */
-				if (invert) {
-					for (j = 0; j < MAX_CHAN; j++)
-						out[j] = in[j];		/* Carry any auxiliary value to out for lookup */
-					if ((rv = luo->inv_lookup(luo, out, in)) > 1)
-						error ("%d, %s",xicco->errc,xicco->err);
-				} else {
-					if ((rv = luo->lookup(luo, out, in)) > 1)
-						error ("%d, %s",xicco->errc,xicco->err);
+				/* For each input number */
+				for (nbp = buf, i = 0; i < MAX_CHAN; i++) {
+					bp = nbp;
+					uout[i] = out[i] = in[i] = uin[i] = strtod(bp, &nbp);
+					if (nbp == bp)
+						break;			/* Failed */
 				}
-			}
-
-			if (slocwarn) {
-				double xyz[3];
+				if (i == 0)
+					break;
 
-				if (outs == icSigLabData || outs == icxSigLChData)
-					icmLab2XYZ(&icmD50, out, xyz);	
-				else
-					icmCpy3(xyz, out);
+				uconv_in(&uc, in, MAX_CHAN);
 
-				outsloc = icx_outside_spec_locus(chlp, xyz);
-			}
+				/* Do conversion */
+				if (cal != NULL) {	/* .cal */
+					if (func == icmBwd || invert) {
+						if ((rv = cal->inv_interp(cal, out, in)) != 0)
+							error ("%d, %s",cal->errc,cal->err);
+					} else {
+						cal->interp(cal, out, in);
+						rv = 0;
+					}
 
-			/* Copy conversion out value so that we can create user values */
-			for (i = 0; i < MAX_CHAN; i++)
-				uout[i] = out[i];
+				} else {	/* ICC */
+					if (invert) {
+						for (j = 0; j < MAX_CHAN; j++)
+							out[j] = in[j];		/* Carry any auxiliary value to out for lookup */
+						if ((rv = luo->inv_lookup(luo, out, in)) > 1)
+							error ("%d, %s",xicco->errc,xicco->err);
+					} else {
+						if ((rv = luo->lookup(luo, out, in)) > 1)
+							error ("%d, %s",xicco->errc,xicco->err);
+					}
+				}
 
-			/* display absolute measurement */
-			if (absmeas && outs == icSigXYZData) {
-				uout[0] *= dispLuminance;
-				uout[1] *= dispLuminance;
-				uout[2] *= dispLuminance;
-			}
+				if (slocwarn) {
+					double xyz[3];
 
-			if (repXYZ100 && outs == icSigXYZData) {
-				uout[0] *= 100.0;
-				uout[1] *= 100.0;
-				uout[2] *= 100.0;
-			}
+					if (outs == icSigLabData || outs == icxSigLChData)
+						icmLab2XYZ(&icmD50, out, xyz);	
+					else
+						icmCpy3(xyz, out);
 
-			if (repYxy && outs == icSigYxyData) {
-				icmXYZ2Yxy(uout, uout);
-			}
+					outsloc = icx_outside_spec_locus(chlp, xyz);
+				}
 
-			if (repYuv && outs == icmSigYuvData) {
-				icmXYZ2Yuv(uout, uout);
-			}
+				/* Copy conversion out value so that we can create user values */
+				for (i = 0; i < MAX_CHAN; i++)
+					uout[i] = out[i];
 
-			/* Jab -> JCh and Lab -> LCh */
-			if ((repJCh && outs == icxSigJChData) 
-			 || (repLCh && outs == icxSigLChData)) {
-				double a = uout[1];
-				double b = uout[2];
-				uout[1] = sqrt(a * a + b * b);
-			    uout[2] = (180.0/3.14159265359) * atan2(b, a);
-				uout[2] = (uout[2] < 0.0) ? uout[2] + 360.0 : uout[2];
-			}
+				uconv_out(&uc, uout, MAX_CHAN);
 
-			/* If device data and scale */
-			if( outs != icxSigJabData
-			 && outs != icxSigJChData
-			 && outs != icSigXYZData
-			 && outs != icSigLabData
-			 && outs != icxSigLChData
-			 && outs != icSigLuvData
-			 && outs != icSigYCbCrData
-			 && outs != icSigYxyData
-			 && outs != icSigHsvData
-			 && outs != icSigHlsData) {
-				if (outn == 3 && out_tvenc != 0) {
-					if (out_tvenc == 1) {				/* Video 16-235 range */
-						icmVidRGB_2_RGB(uout, uout);
-					} else if (out_tvenc == 2) {		/* Rec601 YCbCr */
-						icmRecXXX_YCbCr_2_YPbPr(uout, uout);
-						icmRec601_YPbPr_2_RGBd(uout, uout);
-					} else if (out_tvenc == 3) {		/* Rec709 1150/60/2:1 YCbCr */
-						icmRecXXX_YCbCr_2_YPbPr(uout, uout);
-						icmRec709_YPbPr_2_RGBd(uout, uout);
-					} else if (out_tvenc == 4) {		/* Rec709 1250/50/2:1 YCbCr */
-						icmRecXXX_YCbCr_2_YPbPr(uout, uout);
-						icmRec709_50_YPbPr_2_RGBd(uout, uout);
-					} else if (out_tvenc == 5) {		/* Rec2020 Non-constant Luminance YCbCr */
-						icmRecXXX_YCbCr_2_YPbPr(uout, uout);
-						icmRec2020_NCL_YPbPr_2_RGBd(uout, uout);
-					} else if (out_tvenc == 6) {		/* Rec2020 Non-constant Luminance YCbCr */
-						icmRecXXX_YCbCr_2_YPbPr(uout, uout);
-						icmRec2020_CL_YPbPr_2_RGBd(uout, uout);
+				/* Output the results */
+				if (verb > 0) {
+					for (j = 0; j < inn; j++) {
+						if (j > 0)
+							fprintf(stdout," %f",uin[j]);
+						else
+							fprintf(stdout,"%f",uin[j]);
 					}
+					if (cal != NULL)
+						printf(" [%s] -> ", icx2str(icmColorSpaceSignature, ins));
+					else
+						printf(" [%s] -> %s -> ", icx2str(icmColorSpaceSignature, ins),
+						                          icm2str(icmLuAlg, alg));
 				}
-				if (scale > 0.0) {
-					for (i = 0; i < MAX_CHAN; i++)
-						uout[i] *= scale;
-				}
-			}
 
-			/* Output the results */
-			if (verb > 0) {
-				for (j = 0; j < inn; j++) {
+				for (j = 0; j < outn; j++) {
 					if (j > 0)
-						fprintf(stdout," %f",uin[j]);
+						fprintf(stdout," %f",uout[j]);
 					else
-						fprintf(stdout,"%f",uin[j]);
+						fprintf(stdout,"%f",uout[j]);
 				}
-				if (cal != NULL)
-					printf(" [%s] -> ", icx2str(icmColorSpaceSignature, ins));
-				else
-					printf(" [%s] -> %s -> ", icx2str(icmColorSpaceSignature, ins),
-					                          icm2str(icmLuAlg, alg));
-			}
-
-			for (j = 0; j < outn; j++) {
-				if (j > 0)
-					fprintf(stdout," %f",uout[j]);
-				else
-					fprintf(stdout,"%f",uout[j]);
-			}
-			if (verb > 0)
-				printf(" [%s]", icx2str(icmColorSpaceSignature, outs));
-
-			if (verb > 0 && tlimit >= 0) {
-				double tot;	
-				for (tot = 0.0, j = 0; j < outn; j++) {
-					tot += out[j];
-				}
-				printf(" Lim %f",tot);
-			}
-			if (outsloc)
-				fprintf(stdout,"(Imaginary)");
-
-			if (verb == 0 || rv == 0)
-				fprintf(stdout,"\n");
-			else {
-				fprintf(stdout," (clip)\n");
-
-				/* This probably isn't right - we need to convert */
-				/* in[] to Lab to Jab if it is not in that space, */
-				/* so we can do a delta E on it. */
-				if (actual && aluo != NULL) {
-					double cin[MAX_CHAN], de;
-					if ((rv = aluo->lookup(aluo, cin, out)) > 1)
-						error ("%d, %s",xicco->errc,xicco->err);
+				if (verb > 0)
+					printf(" [%s]", icx2str(icmColorSpaceSignature, outs));
 
-					for (de = 0.0, j = 0; j < inn; j++) {
-						de += (cin[j] - in[j]) * (cin[j] - in[j]);
+				if (verb > 0 && tlimit >= 0) {
+					double tot;	
+					for (tot = 0.0, j = 0; j < outn; j++) {
+						tot += out[j];
 					}
-					de = sqrt(de);
-					printf("[Actual ");
-					for (j = 0; j < inn; j++) {
-						if (j > 0)
-							fprintf(stdout," %f",cin[j]);
-						else
-							fprintf(stdout,"%f",cin[j]);
+					printf(" Lim %f",tot);
+				}
+				if (outsloc)
+					fprintf(stdout,"(Imaginary)");
+
+				if (verb == 0 || rv == 0)
+					fprintf(stdout,"\n");
+				else {
+					fprintf(stdout," (clip)\n");
+
+					/* This probably isn't right - we need to convert */
+					/* in[] to Lab to Jab if it is not in that space, */
+					/* so we can do a delta E on it. */
+					if (actual && aluo != NULL) {
+						double cin[MAX_CHAN], de;
+						if ((rv = aluo->lookup(aluo, cin, out)) > 1)
+							error ("%d, %s",xicco->errc,xicco->err);
+
+						for (de = 0.0, j = 0; j < inn; j++) {
+							de += (cin[j] - in[j]) * (cin[j] - in[j]);
+						}
+						de = sqrt(de);
+						printf("[Actual ");
+						for (j = 0; j < inn; j++) {
+							if (j > 0)
+								fprintf(stdout," %f",cin[j]);
+							else
+								fprintf(stdout,"%f",cin[j]);
+						}
+						printf(", deltaE %f]\n",de);
 					}
-					printf(", deltaE %f]\n",de);
 				}
 			}
 		}
@@ -74,6 +74,9 @@
  */
 
 #include "xfit.h"
+#ifdef UNIX
+# include <unistd.h>
+#endif
 
 #undef USE_CIE94_DE				/* [Undef] Use CIE94 delta E measure when creating in/out curves */
 								/* Don't use CIE94 because it makes peak error worse ? */
@@ -112,6 +115,8 @@
 #define KLOCUS2BLACKONLY		/* [def] Make K locus inking rules from zero to max */
 								/*       rather than min to max of locus */
 
+#define GAMBUFPTS 65536			/* [65536] Surface points buffered for gamut expand_n() */
+
 /*
  * TTBD:
  *
@@ -128,6 +133,7 @@ static double icxLimitD(icxLuLut *p, double *in);		/* For input' */
 #define icxLimitD_void ((double (*)(void *, double *))icxLimitD)	/* Cast with void 1st arg */
 static double icxLimit(icxLuLut *p, double *in);		/* For input */
 static int icxLuLut_init_clut_camclip(icxLuLut *p);
+static char *icxLuLut_cache_name(icxLuLut *p, char *kind, double detail, ORD8 key[16]);
 
 /* Debug overall lookup */
 #ifdef DEBUG_OLUT
@@ -358,6 +364,81 @@ double *in			/* Vector of input values */
 	return rv;
 }
 
+/* Bulk lookup. The values are converted a block of ICX_LU_NBLK at a time, */
+/* with the per channel and clut rspl's being interpolated a whole block */
+/* at a time using interp_batch(). */
+
+#define ICX_LU_NBLK 64		/* Values per block */
+
+static int
+icxLuLut_lookup_n (
+icxLuBase *pp,		/* This */
+double *out,		/* n * outputChan output values */
+double *in,			/* n * inputChan input values */
+int n
+) {
+	icxLuLut *p = (icxLuLut *)pp;
+	co tc[ICX_LU_NBLK];			/* clut values */
+	co tt[ICX_LU_NBLK];			/* Per channel table values */
+	int rv = 0;
+	int i, j, e, m;
+
+	/* Fall back to the generic version if a component has been replaced */
+	if (p->lookup != icxLuLut_lookup
+	 || p->input  != icxLuLut_input
+	 || p->clut   != icxLuLut_clut
+	 || p->output != icxLuLut_output)
+		return icxLu_lookup_n(pp, out, in, n);
+
+	for (i = 0; i < n; i += m, in += m * p->inputChan, out += m * p->outputChan) {
+		if ((m = n - i) > ICX_LU_NBLK)
+			m = ICX_LU_NBLK;
+
+		/* Absolute and matrix conversion, a value at a time */
+		for (j = 0; j < m; j++) {
+			rv |= p->in_abs(p, tc[j].p, in + j * p->inputChan);
+			rv |= p->matrix(p, tc[j].p, tc[j].p);
+		}
+
+		/* Input tables, a channel at a time */
+		for (e = 0; e < p->inputChan; e++) {
+			for (j = 0; j < m; j++)
+				tt[j].p[0] = tc[j].p[e];
+			if (p->inputTable[e]->interp_batch(p->inputTable[e], tt, m) != 0)
+				rv |= 1;
+			for (j = 0; j < m; j++)
+				tc[j].p[e] = tt[j].v[0];
+		}
+
+		/* Multi-dimensional table */
+		if (p->clutTable->interp_batch(p->clutTable, tc, m) != 0)
+			rv |= 1;
+
+		if (p->mergeclut != 0) {
+			for (j = 0; j < m; j++) {
+				for (e = 0; e < p->outputChan; e++)
+					out[j * p->outputChan + e] = tc[j].v[e];
+			}
+			continue;
+		}
+
+		/* Output tables, a channel at a time */
+		for (e = 0; e < p->outputChan; e++) {
+			for (j = 0; j < m; j++)
+				tt[j].p[0] = tc[j].v[e];
+			if (p->outputTable[e]->interp_batch(p->outputTable[e], tt, m) != 0)
+				rv |= 1;
+			for (j = 0; j < m; j++)
+				out[j * p->outputChan + e] = tt[j].v[0];
+		}
+
+		/* Absolute conversion, a value at a time */
+		for (j = 0; j < m; j++)
+			rv |= p->out_abs(p, out + j * p->outputChan, out + j * p->outputChan);
+	}
+	return rv;
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /* Given a relative XYZ or Lab PCS value, convert in the fwd direction into */ 
 /* the nominated output PCS (ie. Absolute, Jab etc.) */
@@ -986,6 +1067,7 @@ double *in		/* Function input values to invert (== clut output' values) */
 	co pp[MAX_INVSOLN];		/* Room for all the solutions found */
 	co upp;					/* pp[0] value sent to rev_interp() for replay. */
 	int nsoln;			/* Number of solutions found */
+	int mxsoln = MAX_INVSOLN;	/* Maximum number of solutions wanted */
 	double *cdir, cdirv[MXDO];	/* Clip vector direction and length/LCh weighting */
 	int e,f,i;
 	int fdi = p->clutTable->fdi;
@@ -999,6 +1081,11 @@ double *in		/* Function input values to invert (== clut output' values) */
 	if (p->nearclip != 0)
 		flags |= RSPL_NEARCLIP;			/* Use nearest clipping rather than clip vector */
 
+	if (p->revhint != 0) {
+		flags |= RSPL_HINT;				/* Search near the previous solution first */
+		mxsoln = 1;						/* and accept the first one found */
+	}
+
 	DBR(("inv_clut_aux input is %f %f %f\n",in[0], in[1], in[2]))
 
 	if (auxr != NULL) {		/* Set a default locus range */
@@ -1319,7 +1406,7 @@ double *in		/* Function input values to invert (== clut output' values) */
 		nsoln = p->clutTable->rev_interp(
 			p->clutTable, 	/* rspl object */
 			uflags,
-			MAX_INVSOLN, 	/* Maxumum solutions to return */
+			mxsoln, 	 	/* Maxumum solutions to return */
 			NULL, 			/* No auxiliary input targets */
 			cdir,			/* Clip vector direction/LCh weighting */
 			pp);			/* Input target and output solutions */
@@ -1884,6 +1971,88 @@ icxLuBase *pp
 	free(p);
 }
 
+/* Free a copy made by icxLuLut_inv_thread_ctx() */
+static void
+icxLuLut_thr_free(
+icxLuBase *pp
+) {
+	icxLuLut *p = (icxLuLut *)pp;
+	int i;
+
+	for (i = 0; i < p->inputChan; i++) {
+		if (p->inputTable[i] != NULL)
+			p->inputTable[i]->del(p->inputTable[i]);
+	}
+
+	if (p->clutTable != NULL)
+		p->clutTable->del(p->clutTable);
+
+	if (p->cclutTable != NULL)
+		p->cclutTable->del(p->cclutTable);
+
+	for (i = 0; i < p->outputChan; i++) {
+		if (p->outputTable[i] != NULL)
+			p->outputTable[i]->del(p->outputTable[i]);
+	}
+
+	free(p);
+}
+
+/* Create a copy of the LuLut that can do inverse lookups in another thread. */
+/* The copy shares everything with the original, except that it has */
+/* its own reverse contexts for the rspl's that get inverted. */
+/* Return NULL on error, with the error in the xicc. */
+static icxLuLut *
+icxLuLut_inv_thread_ctx(
+icxLuLut *p,
+int nctx
+) {
+	icxLuLut *t;
+	int i;
+
+	/* The CAM clip rspl is normally created on demand, */
+	/* so create it now rather than in each thread. */
+	if (p->camclip && p->nearclip && p->cclutTable == NULL) {
+		if (icxLuLut_init_clut_camclip(p))
+			return NULL;
+	}
+
+	if ((t = (icxLuLut *)calloc(1, sizeof(icxLuLut))) == NULL) {
+		p->pp->errc = 2;
+		sprintf(p->pp->err,"icxLuLut_inv_thread_ctx: malloc failed");
+		return NULL;
+	}
+	*t = *p;
+	t->del = icxLuLut_thr_free;
+
+	for (i = 0; i < p->inputChan; i++)
+		t->inputTable[i] = NULL;
+	t->clutTable = t->cclutTable = NULL;
+	for (i = 0; i < p->outputChan; i++)
+		t->outputTable[i] = NULL;
+
+	for (i = 0; i < p->inputChan; i++) {
+		if ((t->inputTable[i] = p->inputTable[i]->rev_thread_ctx(p->inputTable[i], nctx)) == NULL)
+			goto fail;
+	}
+	if ((t->clutTable = p->clutTable->rev_thread_ctx(p->clutTable, nctx)) == NULL)
+		goto fail;
+	if (p->cclutTable != NULL
+	 && (t->cclutTable = p->cclutTable->rev_thread_ctx(p->cclutTable, nctx)) == NULL)
+		goto fail;
+	for (i = 0; i < p->outputChan; i++) {
+		if ((t->outputTable[i] = p->outputTable[i]->rev_thread_ctx(p->outputTable[i], nctx)) == NULL)
+			goto fail;
+	}
+	return t;
+
+  fail:;
+	t->del((icxLuBase *)t);
+	p->pp->errc = 2;
+	sprintf(p->pp->err,"icxLuLut_inv_thread_ctx: creating rspl reverse context failed");
+	return NULL;
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 static gamut *icxLuLutGamut(icxLuBase *plu, double detail); 
@@ -1920,8 +2089,10 @@ alloc_icxLuLut(
 	p->noipluts = 0;
 	p->nooluts = 0;
 	p->intsep = 0;
+	p->revhint = 0;
 
 	p->lookup   = icxLuLut_lookup;
+	p->lookup_n = icxLuLut_lookup_n;
 	p->in_abs   = icxLuLut_in_abs;
 	p->matrix   = icxLuLut_matrix;
 	p->input    = icxLuLut_input;
@@ -1931,6 +2102,7 @@ alloc_icxLuLut(
 	p->out_abs  = icxLuLut_out_abs;
 
 	p->inv_lookup   = icxLuLut_inv_lookup;
+	p->inv_lookup_n = icxLu_inv_lookup_n;
 	p->inv_in_abs   = icxLuLut_inv_in_abs;
 	p->inv_matrix   = icxLuLut_inv_matrix;
 	p->inv_input    = icxLuLut_inv_input;
@@ -1944,6 +2116,8 @@ alloc_icxLuLut(
 	p->get_info   = icxLuLut_get_info;
 	p->get_matrix = icxLuLut_get_matrix;
 
+	p->inv_thread_ctx = icxLuLut_inv_thread_ctx;
+
 	/* Setup all the rspl analogs of the icc Lut */
 	/* NOTE: We assume that none of this relies on the flag settings, */
 	/* since they will be set on our return. */
@@ -2269,6 +2443,9 @@ icxInk                *ink			/* inking details (NULL for default) */
 	if (flags & ICX_FAST_SETUP)
 		p->fastsetup = 1;
 
+	if (flags & ICX_REV_HINT)
+		p->revhint = 1;
+
 	/* We're only implementing this under specific conditions. */
 	if (flags & ICX_CAM_CLIP
 	 && func == icmFwd
@@ -2487,6 +2664,7 @@ fprintf(stderr,"~1 Internal optimised 4D separations not yet implemented!\n");
 
 /* Function to pass to rspl to set clut up, when camclip is going to be used. */
 /* We use the temporary icm fwd absolute xyz lookup, then convert to CAM Jab. */
+/* (This is called from multiple threads) */
 static void
 icxLuLut_clut_camclip_func(
 	void *pp,			/* icxLuLut */
@@ -2505,6 +2683,7 @@ icxLuLut_clut_camclip_func(
 /* Initialise the additional CAM space clut rspl, used to compute */
 /* reverse lookup CAM clipping results when the camclip flag is set. */
 /* We weight the CAM nn clipping, to give a more L* and H* preserving clip direction. */
+/* If the xicc has a cache directory, the grid is kept there. */
 /* Return error code. */
 /* (We are assuming nearest clipping - we aren't setting up properly for */
 /* vector clipping) */
@@ -2513,6 +2692,8 @@ icxLuLut_init_clut_camclip(
 icxLuLut *p) {
 	int e, gres[MXDI];
 	double lchw[MXRO] = { JCCWEIGHT, CCCWEIGHT, HCCWEIGHT };
+	char *cname;
+	ORD8 key[16];
 
 	/* Setup so clut contains transform to CAM Jab */
 	/* (camclip is only used in fwd or invfwd direction lookup) */
@@ -2538,19 +2719,26 @@ icxLuLut *p) {
 		return p->pp->errc;
 	}
 
+	for (e = 0; e < p->inputChan; e++)
+		gres[e] = p->lut->clutPoints;
+
+	/* Setup our special CAM space rspl, or restore it from the cache */
+	cname = icxLuLut_cache_name(p, "camclip", (double)p->lut->clutPoints, key);
+	if (cname == NULL || p->cclutTable->load_rspl(p->cclutTable, cname) != 0) {
+		p->cclutTable->set_rspl(p->cclutTable, RSPL_MTHREAD, (void *)p,
+		           icxLuLut_clut_camclip_func,
+	               p->ninmin, p->ninmax, gres, cmin, cmax);
+
+		if (cname != NULL)
+			p->cclutTable->save_rspl(p->cclutTable, cname);	/* Failure isn't fatal */
+	}
+	free(cname);
+
 #ifdef USELCHWEIGHT
 	/* Set the Nearest Neighbor clipping Weighting */
 	p->cclutTable->rev_set_lchw(p->cclutTable, lchw);
 #endif /* USELCHWEIGHT */
 
-	for (e = 0; e < p->inputChan; e++)
-		gres[e] = p->lut->clutPoints;
-
-	/* Setup our special CAM space rspl */
-	p->cclutTable->set_rspl(p->cclutTable, RSPL_NOFLAGS, (void *)p,
-	           icxLuLut_clut_camclip_func,
-               p->ninmin, p->ninmax, gres, cmin, cmax);
-
 	/* Duplicate the ink limit information for any reverse interpolation. */
 	p->cclutTable->rev_set_limit(
 		p->cclutTable,		/* this */
@@ -3924,11 +4112,161 @@ int                quality			/* Quality metric, 0..3 */
 /* ========================================================== */
 
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Gamut surface, cusp map and CAM clip grid cache files. */
+
+/* If the xicc has a cache directory (see set_cache()), gamut surfaces */
+/* are kept there as binary .gam files, and cusp maps as a small header */
+/* followed by the L and C arrays, and CAM clip grids as save_rspl() */
+/* files. Each is named from an MD5 key of the */
+/* profile contents plus everything else that determines the result. */
+/* Files are written to a temporary name and renamed, so that an */
+/* incomplete file is never used. Cusp map files can only be used by */
+/* the same build on the same type of machine. */
+
+#define ICXCM_MAGIC "ICXCMAP1"
+#define ICXCM_ENDIAN 0x01020304	/* Check for byte order */
+
+typedef struct {
+	char magic[8];
+	int hsize;					/* sizeof(icxcm_chdr) */
+	unsigned int endian;		/* ICXCM_ENDIAN */
+	ORD8 key[16];				/* Key the entry was created for */
+	int res;					/* Hue resolution */
+	double Lmax[3], Lmin[3];	/* L* limits */
+} icxcm_chdr;
+
+/* Compute the cache key for a kind of result with the given detail */
+/* parameter, and return the allocated entry file name. */
+/* Return NULL if there is no cache or on error. */
+static char *icxLuLut_cache_name(
+icxLuLut *p,
+char *kind,				/* "gamut", "cuspmap" or "camclip" */
+double detail,			/* Detail or resolution */
+ORD8 key[16]			/* Return the key */
+) {
+	xicc *x = p->pp;
+	icmMD5 *md5;
+	ORD8 chsum[16];
+	int iv[7];
+	double dv[19];
+	char *cname;
+	int i;
+
+	if (x->cachedir == NULL)
+		return NULL;
+
+	if (x->pp->get_hash(x->pp, chsum) != 0
+	 || (md5 = new_icmMD5()) == NULL)
+		return NULL;
+
+	md5->add(md5, (ORD8 *)ICXCM_MAGIC, 8);
+	md5->add(md5, (ORD8 *)ARGYLL_VERSION_STR, strlen(ARGYLL_VERSION_STR) + 1);
+	md5->add(md5, (ORD8 *)kind, strlen(kind) + 1);
+	md5->add(md5, chsum, 16);
+
+	iv[0] = (int)p->func;
+	iv[1] = (int)p->intent;
+	iv[2] = (int)p->ins;
+	iv[3] = (int)p->outs;
+	iv[4] = (int)p->pcs;
+	iv[5] = p->flags & ~ICX_VERBOSE;
+	iv[6] = (int)p->vc.Ev;
+	md5->add(md5, (ORD8 *)iv, sizeof(iv));
+
+	dv[0] = detail;
+	dv[1] = p->ink.tlimit;
+	dv[2] = p->ink.klimit;
+	for (i = 0; i < 3; i++) {
+		dv[3 + i] = p->vc.Wxyz[i];
+		dv[6 + i] = p->vc.Gxyz[i];
+		dv[9 + i] = p->vc.Wxyz2[i];
+	}
+	dv[12] = p->vc.La;
+	dv[13] = p->vc.Yb;
+	dv[14] = p->vc.Lv;
+	dv[15] = p->vc.Yf;
+	dv[16] = p->vc.Yg;
+	dv[17] = p->vc.hkscale;
+	dv[18] = p->vc.mtaf;
+	md5->add(md5, (ORD8 *)dv, sizeof(dv));
+
+	md5->get(md5, key);
+	md5->del(md5);
+
+	if ((cname = malloc(strlen(x->cachedir) + strlen(kind) + 40)) == NULL)
+		return NULL;
+	sprintf(cname, "%s/%s_", x->cachedir, kind);
+	for (i = 0; i < 16; i++)
+		sprintf(cname + strlen(cname), "%02x", key[i]);
+
+	return cname;
+}
+
+/* Return an allocated temporary file name for writing a cache entry */
+static char *icxLuLut_cache_tname(char *cname) {
+	char *tname;
+
+	if ((tname = malloc(strlen(cname) + 30)) == NULL)
+		return NULL;
+#ifdef UNIX
+	sprintf(tname, "%s.%d.tmp", cname, (int)getpid());
+#else
+	sprintf(tname, "%s.tmp", cname);
+#endif
+	return tname;
+}
+
+/* Rename a written temporary file to the cache entry name. */
+/* Return nz on error */
+static int icxLuLut_cache_commit(char *tname, char *cname) {
+#ifndef UNIX
+	remove(cname);			/* MSWin rename() won't replace a file */
+#endif
+	if (rename(tname, cname) != 0) {
+		remove(tname);
+		return 1;
+	}
+	return 0;
+}
+
+/* Load a gamut from a cache entry. Return NULL if there isn't one */
+static gamut *icxLuLut_load_gamut(char *cname, double detail, int isJab) {
+	gamut *gam;
+	FILE *fp;
+
+	if ((fp = fopen(cname, "rb")) == NULL)
+		return NULL;
+	fclose(fp);
+
+	if ((gam = new_gamut(detail, isJab, 0)) == NULL)
+		return NULL;
+	if (gam->read_gam(gam, cname) != 0) {
+		gam->del(gam);
+		return NULL;
+	}
+	return gam;
+}
+
+/* Save a gamut to a cache entry. Failure isn't fatal. */
+static void icxLuLut_save_gamut(gamut *gam, char *cname) {
+	char *tname;
+
+	if ((tname = icxLuLut_cache_tname(cname)) == NULL)
+		return;
+	if (gam->write_bgam(gam, tname, 0) == 0)
+		icxLuLut_cache_commit(tname, cname);
+	else
+		remove(tname);
+	free(tname);
+}
+
 /* Context for creating gamut boundary points from, xicc */
 typedef struct {
 	gamut *g;				/* Gamut being created */
 	icxLuLut *x;			/* xLut we are working from */
 	icxLuBase *flu;			/* Forward xlookup */
+	int surf;				/* nz to skip grid points inside the device space */
 	double in[MAX_CHAN];	/* Device input values */
 } lutgamctx;
 
@@ -3985,6 +4323,20 @@ lutfwdgam_func(
 		p->x->output(p->x, pcso, pcso);	
 		p->x->out_abs(p->x, pcso, pcso);	
 	} else {	/* No ink limiting */
+
+		/* Skip points that aren't on the device space surface */
+		if (p->surf) {
+			rspl *r = p->x->clutTable;
+			int i;
+
+			for (i = 0; i < p->x->inputChan; i++) {
+				if (in[i] <= (r->g.l[i] + 1e-9) || in[i] >= (r->g.h[i] - 1e-9))
+					break;
+			}
+			if (i >= p->x->inputChan)
+				return;
+		}
+
 		/* Convert the clut PCS' values to PCS output values */
 		p->x->output(p->x, pcso, out);
 		p->x->out_abs(p->x, pcso, pcso);	
@@ -4022,6 +4374,56 @@ lutbwdgam_func(
 	/* Leave out[] unchanged */
 }
 
+/* Context for looking up the device surface points in parallel */
+typedef struct {
+	icxLuLut *x;			/* xLut we are working from */
+	int res;				/* Sampling resolution of each face */
+	int nfaces;				/* Number of faces */
+	int (*faces)[3];		/* Base corner bits, first and second scan coord of each face */
+	int r0;					/* First face row of current batch */
+	double *buf;			/* res PCS values for each row of the batch */
+	int *cnt;				/* Number of values in each row of the batch */
+} lutsurfctx;
+
+/* Lookup the surface points of face rows i0 .. i1-1. Each row is */
+/* a face and a first scan coord value, stepped over the second. */
+static int lutsurf_thread(void *cntx, int i0, int i1, int thix) {
+	lutsurfctx *p = (lutsurfctx *)cntx;
+	icxLuLut *x = p->x;
+	int ix, e;
+
+	for (ix = i0; ix < i1; ix++) {
+		int *face = p->faces[ix / p->res];
+		int m1 = face[1], m2 = face[2];
+		double *buf = p->buf + (ix - p->r0) * p->res * 3;
+		double in[MAX_CHAN];
+		int y, n = 0;
+
+		for (e = 0; e < x->inputChan; e++) {	/* Base value */
+			in[e] = (double)((face[0] >> e) & 1);
+			in[e] = in[e] * (x->inmax[e] - x->inmin[e]) + x->inmin[e];
+		}
+		in[m1] = (ix % p->res)/(p->res - 1.0);
+		in[m1] = in[m1] * (x->inmax[m1] - x->inmin[m1]) + x->inmin[m1];
+
+		for (y = 0; y < p->res; y++) {
+			in[m2] = y/(p->res - 1.0);
+			in[m2] = in[m2] * (x->inmax[m2] - x->inmin[m2]) + x->inmin[m2];
+
+   			/* Figure if we are over the ink limit. */
+			if (   (x->ink.tlimit >= 0.0 || x->ink.klimit >= 0.0)
+		        && icxLimit(x, in) > 0.0) {
+				continue;		/* Skip points over limit */
+			}
+
+			x->lookup((icxLuBase *)x, buf + 3 * n, in);
+			n++;
+		}
+		p->cnt[ix - p->r0] = n;
+	}
+	return 0;
+}
+
 /* Given an xicc lookup object, return a gamut object. */
 /* Note that the PCS must be Lab or Jab */
 /* An icxLuLut type must be icmFwd or icmBwd, */
@@ -4039,6 +4441,8 @@ double       detail		/* gamut detail level, 0.0 = def */
 	double white[3], black[3], kblack[3];
 	int inn, outn;
 	gamut *gam;
+	ORD8 key[16];
+	char *cname;
 
 	/* get some details */
 	plu->spaces(plu, &ins, &inn, &outs, &outn, NULL, &intent, &func, &pcs);
@@ -4055,11 +4459,19 @@ double       detail		/* gamut detail level, 0.0 = def */
 		return NULL;
 	}
 
+	/* Use a cached gamut if there is one */
+	if ((cname = icxLuLut_cache_name(luluto, "gamut", detail, key)) != NULL
+	 && (gam = icxLuLut_load_gamut(cname, detail, pcs == icxSigJabData)) != NULL) {
+		free(cname);
+		return gam;
+	}
+
 	if (func == icmFwd) {
 		lutgamctx cx;
 
 		cx.g = gam = new_gamut(detail, pcs == icxSigJabData, 0);
 		cx.x = luluto;
+		cx.surf = (plu->flags & ICX_GAMUT_SURF) ? 1 : 0;
 
 		/* Scan through grid. */
 		/* (Note this can give problems for a strange input space - ie. Lab */
@@ -4080,24 +4492,46 @@ double       detail		/* gamut detail level, 0.0 = def */
 
 		/* If the gamut is more than cursary, add some more detail surface points */
 		if (detail < 20.0 || luluto->clutTable->g.mres < 4) {
-			int res;
+			lutsurfctx sx;
+			int nrows, bsize, r0, r1;
+			double *gbuf;			/* Buffered surface points */
+			int gbn = 0;
 			DCOUNT(co, MAX_CHAN, inn, 0, 0, 2);
 		
-			res = (int)(500.0/detail);	/* Establish an appropriate sampling density */
-			if (res < 10)
-				res = 10;
+			sx.x = luluto;
+			sx.res = (int)(500.0/detail);	/* Establish an appropriate sampling density */
+			if (sx.res < 10)
+				sx.res = 10;
+			bsize = GAMBUFPTS/sx.res;		/* Rows per batch */
+
+			sx.nfaces = 0;
+			sx.buf = NULL;
+			sx.cnt = NULL;
+			if ((sx.faces = (int (*)[3])malloc(((1 << inn) * inn * (inn-1)/2 + 1) * sizeof(int [3]))) == NULL
+			 || (sx.buf = (double *)malloc(bsize * sx.res * 3 * sizeof(double))) == NULL
+			 || (sx.cnt = (int *)malloc(bsize * sizeof(int))) == NULL
+			 || (gbuf = (double *)malloc(GAMBUFPTS * 3 * sizeof(double))) == NULL) {
+				free(sx.faces);
+				free(sx.buf);
+				free(sx.cnt);
+				gam->del(gam);
+				free(cname);
+				p->errc = 2;
+				sprintf(p->err,"Malloc of gamut point buffer failed");
+				return NULL;
+			}
 
 			/* Itterate over all the faces in the device space */
 			DC_INIT(co);
 			while(!DC_DONE(co)) {		/* Count through the corners of hyper cube */
-				int e, m1, m2;
+				int e, m1, m2, cbits;
 				double in[MAX_CHAN];
-				double out[3];
 		
-				for (e = 0; e < inn; e++) {	/* Base value */
+				for (cbits = e = 0; e < inn; e++) {	/* Base value */
 					in[e] = (double)co[e];      /* Base value */
 					in[e] = in[e] * (luluto->inmax[e] - luluto->inmin[e])
 					       + luluto->inmin[e];
+					cbits |= co[e] << e;
 				}
 
    				/* Figure if we are over the ink limit. */
@@ -4112,35 +4546,52 @@ double       detail		/* gamut detail level, 0.0 = def */
 					if (co[m1] != 0)
 						continue;						/* Not at lower corner */
 					for (m2 = m1 + 1; m2 < inn; m2++) {	/* Choose second coord to scan */
-						int x, y;
-		
 						if (co[m2] != 0)
 							continue;					/* Not at lower corner */
-		
-						for (x = 0; x < res; x++) {				/* step over surface */
-							in[m1] = x/(res - 1.0);
-							in[m1] = in[m1] * (luluto->inmax[m1] - luluto->inmin[m1])
-							       + luluto->inmin[m1];
-							for (y = 0; y < res; y++) {
-								in[m2] = y/(res - 1.0);
-								in[m2] = in[m2] * (luluto->inmax[m2] - luluto->inmin[m2])
-								       + luluto->inmin[m2];
-
-				   				/* Figure if we are over the ink limit. */
-								if (   (luluto->ink.tlimit >= 0.0 || luluto->ink.klimit >= 0.0)
-							        && icxLimit(luluto, in) > 0.0) {
-									continue;		/* Skip points over limit */
-								}
-		
-								luluto->lookup((icxLuBase *)luluto, out, in);
-								gam->expand(gam, out);
-							}
-						}
+						sx.faces[sx.nfaces][0] = cbits;
+						sx.faces[sx.nfaces][1] = m1;
+						sx.faces[sx.nfaces][2] = m2;
+						sx.nfaces++;
+
+						/* The scan leaves the coords at their maximum */
+						/* for the following faces of this corner. */
+						cbits |= (1 << m1) | (1 << m2);
 					}
 				}
 				/* Increment index within block */
 				DC_INC(co);
 			}
+
+			/* Lookup the face rows a batch at a time in parallel, */
+			/* and expand the gamut with them in order. */
+			nrows = sx.nfaces * sx.res;
+			for (r0 = 0; r0 < nrows; r0 = r1) {
+				int i, j;
+
+				if ((r1 = r0 + bsize) > nrows)
+					r1 = nrows;
+				sx.r0 = r0;
+				par_for(0, r0, r1, 0, lutsurf_thread, (void *)&sx);
+
+				for (i = 0; i < (r1 - r0); i++) {
+					double *rbuf = sx.buf + i * sx.res * 3;
+
+					for (j = 0; j < sx.cnt[i]; j++) {
+						gbuf[3 * gbn + 0] = rbuf[3 * j + 0];
+						gbuf[3 * gbn + 1] = rbuf[3 * j + 1];
+						gbuf[3 * gbn + 2] = rbuf[3 * j + 2];
+						if (++gbn >= GAMBUFPTS) {
+							gam->expand_n(gam, gbuf, gbn, 0);
+							gbn = 0;
+						}
+					}
+				}
+			}
+			gam->expand_n(gam, gbuf, gbn, 0);
+			free(gbuf);
+			free(sx.cnt);
+			free(sx.buf);
+			free(sx.faces);
 		}
 
 		/* Now set the cusp points by itterating through colorant 0 & 100% combinations */
@@ -4230,6 +4681,7 @@ double       detail		/* gamut detail level, 0.0 = def */
 		}
 		if ((cx.flu = p->get_luobj(p, ICX_CLIP_NEAREST, icmFwd, intent, pcs, icmLuOrdNorm,
 		                              &plu->vc, NULL)) == NULL) {
+			free(cname);
 			return NULL;	/* oops */
 		}
 
@@ -4323,6 +4775,19 @@ double       detail		/* gamut detail level, 0.0 = def */
 	gam->setwb(gam, white, black, kblack);				/* Put it back as colorspace one */
 #endif
 
+	/* Save it to the cache, and return the saved version so that the */
+	/* result is the same whether or not the cache was used. */
+	if (cname != NULL) {
+		gamut *cgam;
+
+		icxLuLut_save_gamut(gam, cname);
+		if ((cgam = icxLuLut_load_gamut(cname, detail, pcs == icxSigJabData)) != NULL) {
+			gam->del(gam);
+			gam = cgam;
+		}
+		free(cname);
+	}
+
 	return gam;
 }
 
@@ -4530,6 +4995,80 @@ static void cuspmap_del(icxCuspMap *p) {
 	}
 }
 
+/* Load a cusp map from a cache entry. Return NULL if there isn't a valid one */
+static icxCuspMap *icxLuLut_load_cuspmap(char *cname, ORD8 key[16], int res) {
+	icxcm_chdr h;
+	icxCuspMap *cm;
+	FILE *fp;
+
+	if ((fp = fopen(cname, "rb")) == NULL)
+		return NULL;
+	if (fread((void *)&h, sizeof(icxcm_chdr), 1, fp) != 1
+	 || strncmp(h.magic, ICXCM_MAGIC, 8) != 0
+	 || h.hsize != sizeof(icxcm_chdr)
+	 || h.endian != ICXCM_ENDIAN
+	 || memcmp((void *)h.key, (void *)key, 16) != 0
+	 || h.res != res) {
+		fclose(fp);
+		return NULL;
+	}
+
+	if ((cm = (icxCuspMap *) calloc(1, sizeof(icxCuspMap))) == NULL
+	 || (cm->L = (double *)malloc(sizeof(double) * res)) == NULL
+	 || (cm->C = (double *)malloc(sizeof(double) * res)) == NULL
+	 || fread((void *)cm->L, sizeof(double), res, fp) != res
+	 || fread((void *)cm->C, sizeof(double), res, fp) != res) {
+		cuspmap_del(cm);
+		fclose(fp);
+		return NULL;
+	}
+	fclose(fp);
+
+	cm->res = res;
+	icmCpy3(cm->Lmax, h.Lmax);
+	icmCpy3(cm->Lmin, h.Lmin);
+	cm->expand = cuspmap_expand;
+	cm->getCusp = cuspmap_getCusp;
+	cm->del = cuspmap_del;
+
+	return cm;
+}
+
+/* Save a cusp map to a cache entry. Failure isn't fatal. */
+static void icxLuLut_save_cuspmap(icxCuspMap *cm, char *cname, ORD8 key[16]) {
+	icxcm_chdr h;
+	char *tname;
+	FILE *fp;
+	int rv = 0;
+
+	memset((void *)&h, 0, sizeof(icxcm_chdr));	/* Make padding repeatable */
+	strncpy(h.magic, ICXCM_MAGIC, 8);
+	h.hsize = sizeof(icxcm_chdr);
+	h.endian = ICXCM_ENDIAN;
+	memcpy((void *)h.key, (void *)key, 16);
+	h.res = cm->res;
+	icmCpy3(h.Lmax, cm->Lmax);
+	icmCpy3(h.Lmin, cm->Lmin);
+
+	if ((tname = icxLuLut_cache_tname(cname)) == NULL)
+		return;
+	if ((fp = fopen(tname, "wb")) == NULL) {
+		free(tname);
+		return;
+	}
+	if (fwrite((void *)&h, sizeof(icxcm_chdr), 1, fp) != 1
+	 || fwrite((void *)cm->L, sizeof(double), cm->res, fp) != cm->res
+	 || fwrite((void *)cm->C, sizeof(double), cm->res, fp) != cm->res)
+		rv = 1;
+	if (fclose(fp) != 0)
+		rv = 1;
+	if (rv == 0)
+		icxLuLut_cache_commit(tname, cname);
+	else
+		remove(tname);
+	free(tname);
+}
+
 /* Given an xicc lookup object, return an icxCuspMap object. */
 /* Note that the PCS must be Lab or Jab. */
 /* An icxLuLut type must be icmFwd, and the ink limit (if supplied) */
@@ -4547,6 +5086,8 @@ int          res		/* Hue resolution */
 	int inn, outn;
 	lutcuspmapctx cx;
 	icxCuspMap *cm;
+	ORD8 key[16];
+	char *cname;
 	int i;
 
 	/* get some details */
@@ -4564,12 +5105,20 @@ int          res		/* Hue resolution */
 		return NULL;
 	}
 
+	/* Use a cached cusp map if there is one */
+	if ((cname = icxLuLut_cache_name(luluto, "cuspmap", (double)res, key)) != NULL
+	 && (cm = icxLuLut_load_cuspmap(cname, key, res)) != NULL) {
+		free(cname);
+		return cm;
+	}
+
 	cx.cm = cm = (icxCuspMap *) calloc(1, sizeof(icxCuspMap));
 	cx.x = luluto;
 
 	if (cx.cm == NULL) {
 		p->errc = 2;
 		sprintf(p->err,"Malloc of icxCuspMap failed");
+		free(cname);
 		return NULL;
 	}
 
@@ -4577,6 +5126,7 @@ int          res		/* Hue resolution */
 		free(cm);
 		p->errc = 2;
 		sprintf(p->err,"Malloc of icxCuspMap failed");
+		free(cname);
 		return NULL;
 	}
 
@@ -4585,6 +5135,7 @@ int          res		/* Hue resolution */
 		free(cm);
 		p->errc = 2;
 		sprintf(p->err,"Malloc of icxCuspMap failed");
+		free(cname);
 		return NULL;
 	}
 
@@ -4621,6 +5172,11 @@ int          res		/* Hue resolution */
 	/* Fill in any gaps */
 	cuspmap_complete(cm);
 
+	if (cname != NULL) {
+		icxLuLut_save_cuspmap(cm, cname, key);
+		free(cname);
+	}
+
 	return cm;
 }
 
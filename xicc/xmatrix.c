@@ -275,6 +275,8 @@ alloc_icxLuMatrix(
 		p->lookup     = icxLuMatrixFwd_lookup;
 		p->inv_lookup = icxLuMatrixBwd_lookup;
 	}
+	p->lookup_n     = icxLu_lookup_n;
+	p->inv_lookup_n = icxLu_inv_lookup_n;
 
 	/* There are no matrix specific flags */
 	p->flags = flags;
@@ -248,6 +248,8 @@ int                   dir			/* 0 = fwd, 1 = bwd */
 		p->lookup     = icxLuMonoFwd_lookup;
 		p->inv_lookup = icxLuMonoBwd_lookup;
 	}
+	p->lookup_n     = icxLu_lookup_n;
+	p->inv_lookup_n = icxLu_inv_lookup_n;
 
 	/* There are no mono specific flags */
 	p->flags = flags;
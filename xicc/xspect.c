@@ -4517,6 +4517,193 @@ void xspect_plotNp(xspect *sp[MXGPHS], int n) {
 	xspect_plotNp_w(sp, n, 1);
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Packed spectral tables */
+
+/* Compute the band index and weights that getval_raw_xspec() would */
+/* use to interpolate a spectrum with the given sampling at wavelength wl. */
+/* Return the number of weights, 2 for linear, 4 for poly3. */
+static int xspect_interp_wts(xspect *sp, int *pix, double *wt, double wl) {
+	double spcg = (sp->spec_wl_long - sp->spec_wl_short)/(sp->spec_n-1.0);
+	double f, w;
+	int i;
+
+	if (wl < sp->spec_wl_short)
+		wl = sp->spec_wl_short;
+	if (wl > sp->spec_wl_long)
+		wl = sp->spec_wl_long;
+
+	f = (wl - sp->spec_wl_short) / (sp->spec_wl_long - sp->spec_wl_short);
+	f *= (sp->spec_n - 1.0);
+	i = (int)floor(f);			/* Base grid coordinate */
+
+	if (spcg < 5.01) {			/* Linear */
+		if (i < 0)
+			i = 0;
+		else if (i > (sp->spec_n - 2))
+			i = (sp->spec_n - 2);
+		w = f - (double)i;
+		*pix = i;
+		wt[0] = 1.0 - w;
+		wt[1] = w;
+		return 2;
+
+	} else {					/* Lagrange poly3 */
+		double x[4];
+
+		if (i < 1)
+			i = 1;
+		else if (i > (sp->spec_n - 3))
+			i = (sp->spec_n - 3);
+
+		x[0] = sp->spec_wl_short + (i-1) * spcg;
+		x[1] = sp->spec_wl_short + i * spcg;
+		x[2] = sp->spec_wl_short + (i+1) * spcg;
+		x[3] = sp->spec_wl_short + (i+2) * spcg;
+
+		*pix = i-1;
+		wt[0] = (wl-x[1]) * (wl-x[2]) * (wl-x[3])/((x[0]-x[1]) * (x[0]-x[2]) * (x[0]-x[3]));
+		wt[1] = (wl-x[0]) * (wl-x[2]) * (wl-x[3])/((x[1]-x[0]) * (x[1]-x[2]) * (x[1]-x[3]));
+		wt[2] = (wl-x[0]) * (wl-x[1]) * (wl-x[3])/((x[2]-x[0]) * (x[2]-x[1]) * (x[2]-x[3]));
+		wt[3] = (wl-x[0]) * (wl-x[1]) * (wl-x[2])/((x[3]-x[0]) * (x[3]-x[1]) * (x[3]-x[2]));
+		return 4;
+	}
+}
+
+/* Create a table of nspec spectra with the sampling and norm of */
+/* the given xspect. The values are initialised to zero. */
+/* Return NULL on malloc failure */
+xspect_tab *new_xspect_tab(int nspec, xspect *info) {
+	xspect_tab *p;
+
+	if ((p = (xspect_tab *)calloc(1, sizeof(xspect_tab))) == NULL)
+		return NULL;
+
+	XSPECT_COPY_INFO(p, info);
+	p->nspec = nspec;
+
+	if ((p->spec = (float *)calloc((size_t)nspec * p->spec_n, sizeof(float))) == NULL) {
+		free(p);
+		return NULL;
+	}
+	return p;
+}
+
+void del_xspect_tab(xspect_tab *p) {
+	if (p != NULL) {
+		free(p->spec);
+		free(p);
+	}
+}
+
+/* Set spectrum ix of the table from an xspect. It will be */
+/* converted to the table sampling and norm if needed. */
+void xspect_tab_set(xspect_tab *p, int ix, xspect *src) {
+	float *dp = p->spec + (size_t)ix * p->spec_n;
+	xspect tmp;
+	int j;
+
+	if (!XSPECT_SAME_INFO(p, src)) {
+		XSPECT_COPY_INFO(&tmp, p);
+		xspect2xspect(&tmp, &tmp, src);
+		src = &tmp;
+	}
+	for (j = 0; j < p->spec_n; j++)
+		dp[j] = (float)src->spec[j];
+}
+
+/* Get spectrum ix of the table as an xspect */
+void xspect_tab_get(xspect_tab *p, int ix, xspect *dst) {
+	float *sp = p->spec + (size_t)ix * p->spec_n;
+	int j;
+
+	XSPECT_COPY_INFO(dst, p);
+	for (j = 0; j < p->spec_n; j++)
+		dst->spec[j] = (double)sp[j];
+}
+
+/* Resample all the spectra in src into dst, which must have the same */
+/* number of spectra. The interpolation is the same as xspect2xspect(), */
+/* but the band weights are only computed once for the whole table. */
+/* Return NZ on error */
+int xspect_tab_resample(xspect_tab *dst, xspect_tab *src) {
+	xspect sinfo;
+	int *ix = NULL;			/* [dst->spec_n] base source band index */
+	double (*wt)[4] = NULL;	/* [dst->spec_n] source band weights */
+	double scale = dst->norm/src->norm;
+	int nw = 0, i, j;
+
+	if (dst->nspec != src->nspec)
+		return 1;
+
+	if (dst->spec_n == src->spec_n
+	 && dst->spec_wl_short == src->spec_wl_short
+	 && dst->spec_wl_long == src->spec_wl_long) {
+		size_t k, n = (size_t)dst->nspec * dst->spec_n;
+		float fscale = (float)scale;
+
+		for (k = 0; k < n; k++)
+			dst->spec[k] = fscale * src->spec[k];
+		return 0;
+	}
+
+	if ((ix = (int *)malloc(dst->spec_n * sizeof(int))) == NULL
+	 || (wt = (double (*)[4])malloc(dst->spec_n * sizeof(double [4]))) == NULL) {
+		free(ix);
+		return 1;
+	}
+
+	XSPECT_COPY_INFO(&sinfo, src);
+	for (j = 0; j < dst->spec_n; j++) {
+		nw = xspect_interp_wts(&sinfo, &ix[j], wt[j], XSPECT_XWL(dst, j));
+		for (i = 0; i < nw; i++)
+			wt[j][i] *= scale;
+	}
+
+	for (i = 0; i < dst->nspec; i++) {
+		float *sp = src->spec + (size_t)i * src->spec_n;
+		float *dp = dst->spec + (size_t)i * dst->spec_n;
+
+		if (nw == 2) {
+			for (j = 0; j < dst->spec_n; j++) {
+				float *ssp = sp + ix[j];
+				dp[j] = (float)(wt[j][0] * ssp[0] + wt[j][1] * ssp[1]);
+			}
+		} else {
+			for (j = 0; j < dst->spec_n; j++) {
+				float *ssp = sp + ix[j];
+				dp[j] = (float)(wt[j][0] * ssp[0] + wt[j][1] * ssp[1]
+				              + wt[j][2] * ssp[2] + wt[j][3] * ssp[3]);
+			}
+		}
+	}
+	free(wt);
+	free(ix);
+	return 0;
+}
+
+/* Return the average of n spectra in the table in dst. */
+/* If pix is NULL the first n spectra are averaged, else */
+/* the n spectra with indexes pix[]. */
+void xspect_tab_average(xspect_tab *p, xspect *dst, int *pix, int n) {
+	int i, j;
+
+	XSPECT_COPY_INFO(dst, p);
+	for (j = 0; j < p->spec_n; j++)
+		dst->spec[j] = 0.0;
+
+	for (i = 0; i < n; i++) {
+		float *sp = p->spec + (size_t)(pix != NULL ? pix[i] : i) * p->spec_n;
+		for (j = 0; j < p->spec_n; j++)
+			dst->spec[j] += sp[j];
+	}
+
+	if (n > 0) {
+		for (j = 0; j < p->spec_n; j++)
+			dst->spec[j] /= (double)n;
+	}
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 /* Given an emission spectrum, set the UV output to the given level. */
@@ -5048,6 +5235,8 @@ static int xsp2cie_set_fwa_imp(xsp2cie *p) {
 	p->FWAc /= p->Sm;		/* Divided by stimulation */
 	DBGF((DBGA,"FWA content = %f\n",p->FWAc));
 
+	p->fwat_n = 0;				/* Batch templates are now invalid */
+
 	/* Turn on FWA compensation */
 	p->convert  = xsp2cie_fwa_convert;
 	p->sconvert = xsp2cie_fwa_sconvert;
@@ -5129,6 +5318,7 @@ xspect *custIllum	/* Spectrum of observer model illuminant */
 
 	if (custIllum != NULL) {
 		p->illuminant = *custIllum;		/* Updated observer model illuminant */
+		p->bw_n = 0;					/* Batch weightings are now invalid */
 	}
 
 	return xsp2cie_set_fwa_imp(p);
@@ -5668,6 +5858,397 @@ xspect *in				/* Colorant reflectance to be applied */
 	return 0;
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Batch FWA compensation. */
+
+/* The FWA compensated conversion of a spectrum needs the illuminants, */
+/* base media and FWA emission at each integration wavelength, as well */
+/* as the spectrum itself. These are the same for every spectrum, */
+/* so are sampled once into templates for a given spectrum */
+/* wavelength range, together with the spectrum interpolation index */
+/* and weighting. The computations are otherwise identical to */
+/* xsp2cie_fwa_sconvert() and xsp2cie_fwa_apply(). */
+
+#define FWA_THR_MIN 64		/* Minimum spectra per thread */
+
+/* Free the templates */
+static void xsp2cie_free_fwat(xsp2cie *p) {
+	free(p->fs);
+	free(p->fi);
+	free(p->fb);
+	p->fs = p->fi = p->fb = NULL;
+	p->fs_n = p->fi_n = 0;
+	p->fwat_n = 0;
+}
+
+/* Sample the template values at wavelength ww, */
+/* with interpolation of spectrum sp. */
+static void xsp2cie_fwat_samp(xsp2cie *p, xsp_fwat *t, xspect *sp, double ww) {
+	double f, wl = ww;
+	int j;
+
+	getval_lxspec(&p->emits, &t->Eu, ww);
+	getval_lxspec(&p->iillum, &t->Ii, ww);
+	getval_lxspec(&p->tillum, &t->It, ww);
+	getval_lxspec(&p->media, &t->Rmb, ww);
+	getval_lxspec(&FWA1_stim, &t->Su, ww);
+	getval_lxspec(&p->oillum, &t->Io, ww);
+	for (j = 0; j < 3; j++)
+		getval_lxspec(&p->observer[j], &t->O[j], ww);
+
+	/* Same as getval_raw_xspec_lin() */
+	if (wl < sp->spec_wl_short)
+		wl = sp->spec_wl_short;
+	if (wl > sp->spec_wl_long)
+		wl = sp->spec_wl_long;
+	f = (wl - sp->spec_wl_short) / (sp->spec_wl_long - sp->spec_wl_short);
+	f *= (sp->spec_n - 1.0);
+	t->ix = (int)floor(f);
+	if (t->ix < 0)
+		t->ix = 0;
+	else if (t->ix > (sp->spec_n - 2))
+		t->ix = (sp->spec_n - 2);
+	t->w = f - (double)t->ix;
+}
+
+/* Set the templates for spectra with the wavelength range of sp. */
+/* Return NZ on malloc failure */
+static int xsp2cie_set_fwat(xsp2cie *p, xspect *sp) {
+	double ww;
+	int i, n;
+
+	xsp2cie_free_fwat(p);
+
+	/* (Step the wavelength the same way as the per spectrum code) */
+	for (n = 0, ww = FWA1_stim.spec_wl_short; ww <= FWA1_stim.spec_wl_long; ww += p->fwa_bw)
+		n++;
+	if ((p->fs = (xsp_fwat *)malloc(n * sizeof(xsp_fwat))) == NULL)
+		return 1;
+	for (i = 0, ww = FWA1_stim.spec_wl_short; i < n; ww += p->fwa_bw, i++)
+		xsp2cie_fwat_samp(p, &p->fs[i], sp, ww);
+	p->fs_n = n;
+
+	for (n = 0, ww = p->spec_wl_short; ww <= p->spec_wl_long; ww += p->spec_bw)
+		n++;
+	if ((p->fi = (xsp_fwat *)malloc(n * sizeof(xsp_fwat))) == NULL) {
+		xsp2cie_free_fwat(p);
+		return 1;
+	}
+	for (i = 0, ww = p->spec_wl_short; i < n; ww += p->spec_bw, i++)
+		xsp2cie_fwat_samp(p, &p->fi[i], sp, ww);
+	p->fi_n = n;
+
+	if ((p->fb = (xsp_fwat *)malloc(sp->spec_n * sizeof(xsp_fwat))) == NULL) {
+		xsp2cie_free_fwat(p);
+		return 1;
+	}
+	for (i = 0; i < sp->spec_n; i++) {
+		ww = (sp->spec_wl_long - sp->spec_wl_short)
+		   * ((double)i/(sp->spec_n-1.0)) + sp->spec_wl_short;
+		xsp2cie_fwat_samp(p, &p->fb[i], sp, ww);
+	}
+
+	p->fwat_n = sp->spec_n;
+	p->fwat_short = sp->spec_wl_short;
+	p->fwat_long = sp->spec_wl_long;
+	return 0;
+}
+
+/* Return NZ if the templates don't suit spectra like sp */
+#define FWAT_NOTSET(p, sp) ((p)->fwat_n != (sp)->spec_n		\
+                         || (p)->fwat_short != (sp)->spec_wl_short	\
+                         || (p)->fwat_long != (sp)->spec_wl_long)
+
+/* Value of batch spectrum at template wavelength */
+#define FWAT_VAL(t, vals, norm) \
+	(((1.0 - (t)->w) * (vals)[(t)->ix] + (t)->w * (vals)[(t)->ix+1]) / (norm))
+
+#define MIN_ILLUM 1e-7		/* Minimum assumed illumination level at wavelength */
+#define MIN_REFL  1e-6		/* Minimum assumed reflectance at wavelength */
+
+/* FWA compensated conversion of one spectrum using the templates */
+static void xsp2cie_fwat_convert(xsp2cie *p, double *out, double *vals, double norm) {
+	int i, j, k;
+	double Emc, Smc;	/* Emission and Stimulation multipiers for instrument meas. */
+	double Emct, Smct;	/* Emission and Stimulation multipiers for target illum. */
+	double scale = 0.0;
+
+	/* Itterate the FWA stimulation estimate */
+	Emc = Emct = 0.0;
+	for (k = 0; k < 4; k++) {
+		Smct = Smc = 0.0;
+		for (i = 0; i < p->fs_n; i++) {
+			xsp_fwat *t = &p->fs[i];
+			double Kc, Kct, Ii, It, Rc, Rmb, Rcch;
+
+			Kc  = Emc * t->Eu;
+			Kct = Emct * t->Eu;
+
+			if ((Ii = t->Ii) < MIN_ILLUM)
+				Ii = MIN_ILLUM;
+			if ((It = t->It) < MIN_ILLUM)
+				It = MIN_ILLUM;
+			if ((Rmb = t->Rmb) < MIN_REFL)
+				Rmb = MIN_REFL;
+			if ((Rc = FWAT_VAL(t, vals, norm)) < 0.0)
+				Rc = 0.0;
+
+			if (Rmb <= MIN_REFL) /* Hmm. */
+				Rcch = sqrt(fabs(Rmb));
+			else
+				Rcch = (-Kc + sqrt(Kc * Kc + 4.0 * Ii * Ii * Rmb * Rc))/(2.0 * Ii * Rmb);
+
+			Smc  += t->Su * (Ii * Rcch + Kc);
+			Smct += t->Su * (It * Rcch + Kct);
+		}
+		Emc  = Smc/p->Sm;
+		Emct = Smct/p->Sm;
+	}
+
+	out[0] = out[1] = out[2] = 0.0;
+
+	/* Compute CIE output over observer range */
+	for (i = 0; i < p->fi_n; i++) {
+		xsp_fwat *t = &p->fi[i];
+		double Kc, Kct, Ii, It, Rc, Rmb, Rcch, Rct;
+
+		Kc  = Emc * t->Eu;
+		Kct = Emct * t->Eu;
+
+		if ((Ii = t->Ii) < MIN_ILLUM)
+			Ii = MIN_ILLUM;
+		if ((It = t->It) < MIN_ILLUM)
+			It = MIN_ILLUM;
+		if ((Rmb = t->Rmb) < MIN_REFL)
+			Rmb = MIN_REFL;
+		if ((Rc = FWAT_VAL(t, vals, norm)) < 0.0)
+			Rc = 0.0;
+
+		if (Rmb <= MIN_REFL) /* Hmm. */
+			Rcch = sqrt(fabs(Rmb));
+		else
+			Rcch = (-Kc + sqrt(Kc * Kc + 4.0 * Ii * Ii * Rmb * Rc))/(2.0 * Ii * Rmb);
+
+		if (It <= MIN_ILLUM)	/* Hmm */
+			Rct = Rmb;
+		else
+			Rct = ((It * Rcch * Rmb + Kct) * Rcch)/It;
+
+		if (p->insteqtarget)
+			Rct = Rc;
+
+		scale += t->Io * t->O[1];
+		for (j = 0; j < 3; j++)
+			out[j] += Rct * t->Io * t->O[j];
+	}
+	if (p->isemis) {
+		scale = 0.683002;
+		scale *= p->spec_bw;
+	} else {
+		scale = 1.0/scale;
+	}
+	for (j = 0; j < 3; j++) {
+		out[j] *= scale;
+#ifdef CLAMP_XYZ
+		if (p->clamp && out[j] < 0.0)
+			out[j] = 0.0;
+#endif /* CLAMP_XYZ */
+	}
+
+	if (p->doLab == 1) {
+		icmXYZ2Lab(&icmD50, out, out);
+	} else if (p->doLab == 2) {
+		icmXYZ2Lpt(&icmD50, out, out);
+	}
+}
+
+#undef MIN_ILLUM
+#undef MIN_REFL
+
+/* FWA compensated apply of one colorant reflectance using the templates */
+static void xsp2cie_fwat_apply(xsp2cie *p, double *ovals, double *vals, double norm) {
+	int i, k;
+	double Emc, Smc;	/* Emission and Stimulation multipiers for instrument meas. */
+
+	Emc = 0.0;
+	for (k = 0; k < 4; k++) {
+		Smc = 0.0;
+		for (i = 0; i < p->fs_n; i++) {
+			xsp_fwat *t = &p->fs[i];
+			double Kc, Ii, Rcch;
+
+			Kc  = Emc * t->Eu;
+			Rcch = sqrt(FWAT_VAL(t, vals, norm));
+			if ((Ii = t->Ii) < 1e-9)
+				Ii = 1e-9;
+			Smc  += t->Su * (Ii * Rcch + Kc);
+		}
+		Emc  = Smc/p->Sm;
+	}
+
+	for (i = 0; i < p->fwat_n; i++) {
+		xsp_fwat *t = &p->fb[i];
+		double Kc, Ii, Rmb, Rcch, RcI;
+
+		Kc  = Emc * t->Eu;
+		Rmb = t->Rmb;
+		Rcch = sqrt(FWAT_VAL(t, vals, norm));
+		if (Rmb < 1e-9) /* Hmm. */
+			Rcch = sqrt(fabs(Rmb));
+		if ((Ii = t->Ii) < 1e-9)
+			Ii = 1e-9;
+
+		RcI = (Ii * Rcch * Rmb + Kc) * Rcch;
+		ovals[i] = norm * RcI/Ii;
+	}
+}
+
+/* Batch thread context */
+typedef struct {
+	xsp2cie *p;
+	double *out;		/* n * 3 XYZ, or n * nb applied values */
+	double *vals;		/* n * nb spectral values */
+	int nb;				/* Number of bands */
+	double norm;		/* Spectral values normalisation */
+	int n;				/* Number of spectra */
+	int apply;			/* nz for apply, else convert */
+} xsp2cie_fwat_thr;
+
+/* Each thread does a contiguous range of spectra */
+static int xsp2cie_fwat_thread(void *cntx, int ix, int nth) {
+	xsp2cie_fwat_thr *tx = (xsp2cie_fwat_thr *)cntx;
+	int i, e;
+
+	i = (int)((double)tx->n * ix / nth);
+	e = (int)((double)tx->n * (ix+1) / nth);
+	for (; i < e; i++) {
+		if (tx->apply)
+			xsp2cie_fwat_apply(tx->p, tx->out + i * tx->nb, tx->vals + i * tx->nb, tx->norm);
+		else
+			xsp2cie_fwat_convert(tx->p, tx->out + i * 3, tx->vals + i * tx->nb, tx->norm);
+	}
+	return 0;
+}
+
+/* Do a batch FWA convert or apply. Return NZ on error */
+static int xsp2cie_fwat_batch(xsp2cie *p, double *out, xspect *sp, double *vals,
+                              int n, int apply) {
+	xsp2cie_fwat_thr tx;
+	int nth;
+
+	if (sp->spec_n < 2)
+		return 1;
+
+	if (FWAT_NOTSET(p, sp) && xsp2cie_set_fwat(p, sp))
+		return 1;
+
+	tx.p = p;
+	tx.out = out;
+	tx.vals = vals;
+	tx.nb = sp->spec_n;
+	tx.norm = sp->norm;
+	tx.n = n;
+	tx.apply = apply;
+
+	if ((nth = p->nthreads) <= 0)
+		nth = num_threads();
+	if (nth > NUMTHR_MAX)
+		nth = NUMTHR_MAX;
+	if (nth > n/FWA_THR_MIN)
+		nth = n/FWA_THR_MIN;
+	if (nth < 1)
+		nth = 1;
+
+	if (nth == 1)
+		xsp2cie_fwat_thread((void *)&tx, 0, 1);
+	else
+		par_exec(nth, xsp2cie_fwat_thread, (void *)&tx);
+
+	return 0;
+}
+
+/* Batch apply of n colorant reflectances */
+static int xsp2cie_apply_n(xsp2cie *p, double *ovals, xspect *sp, double *vals, int n) {
+	int i, k, nb = sp->spec_n;
+
+	if (p->apply == xsp2cie_fwa_apply)
+		return xsp2cie_fwat_batch(p, ovals, sp, vals, n, 1);
+
+	/* Media white only */
+	for (i = 0; i < n; i++, ovals += nb, vals += nb) {
+		xspect tin = *sp, tout;
+
+		for (k = 0; k < nb; k++)
+			tin.spec[k] = vals[k];
+		if (p->apply(p, &tout, &tin))
+			return 1;
+		for (k = 0; k < nb; k++)
+			ovals[k] = tout.spec[k];
+	}
+	return 0;
+}
+
+static void xsp2cie_set_nthreads(xsp2cie *p, int nthreads) {
+	p->nthreads = nthreads;
+}
+
+/* Save the FWA media estimates */
+static int xsp2cie_write_fwa(xsp2cie *p, char *fname) {
+	xspect sp[3];
+
+	if (p->convert != xsp2cie_fwa_convert)
+		return 1;				/* FWA not set */
+
+	sp[0] = p->imedia;
+	xspect_denorm(&sp[0]);
+	sp[1] = p->media;
+	sp[2] = p->emits;
+
+	return write_nxspect(fname, inst_mrt_reflective, sp, 3, 0);
+}
+
+/* Set FWA from saved media estimates */
+static int xsp2cie_read_fwa(xsp2cie *p,	/* this */
+xspect *iillum,		/* Spectrum of instrument illuminent */
+xspect *tillum,		/* Spectrum of target/simulated instrument illuminant */
+					/* NULL to use observer model illuminant. */
+char *fname			/* File saved by write_fwa() */
+) {
+	xspect sp[3];
+	inst_meas_type mt;
+	double ww;
+	int rv, nret = 0;
+
+	if (read_nxspect(sp, &mt, fname, &nret, 0, 3, 1) != 0 || nret != 3)
+		return 1;
+
+	if (!XSPECT_SAME_INFO(&sp[0], &sp[1])
+	 || !XSPECT_SAME_INFO(&sp[0], &sp[2]))
+		return 1;
+
+	/* Setup as for the measured media, then substitute the saved estimates */
+	if ((rv = xsp2cie_set_fwa(p, iillum, tillum, &sp[0])) != 0)
+		return rv;
+
+	p->media = sp[1];
+	xspect_denorm(&p->media);
+	p->emits = sp[2];
+	xspect_denorm(&p->emits);
+	p->fwat_n = 0;			/* Templates are now invalid */
+
+	/* Re-compute FWA content of this media */
+	p->FWAc = 0.0;
+	for (ww = p->emits.spec_wl_short; ww <= p->emits.spec_wl_long; ww += p->fwa_bw) {
+		double Eu; 
+
+		getval_lxspec(&p->emits, &Eu, ww);	/* FWA emission at this wavelength */
+		p->FWAc += Eu;
+	}
+	p->FWAc /= p->Sm;		/* Divided by stimulation */
+
+	return 0;
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 #endif /* !SALONEINSTLIB */
 
@@ -5766,6 +6347,10 @@ double wl_long		/* Ending nm */
 	p->spec_bw		 = bw;
 	p->spec_wl_short = wl_short;
 	p->spec_wl_long  = wl_long;
+	p->bw_n = 0;			/* Batch weightings are now invalid */
+#ifndef SALONEINSTLIB
+	p->fwat_n = 0;			/* and batch FWA templates */
+#endif /* !SALONEINSTLIB */
 }
 
 /* Do the normal spectral to CIE conversion. */
@@ -5839,6 +6424,108 @@ void xsp2cie_convert(xsp2cie *p, double *out, xspect *in) {
 	xsp2cie_sconvert(p, NULL, out, in);
 }
 
+/* Compute the batch conversion weightings for spectra with */
+/* the wavelength range and number of bands of sp. Because the */
+/* interpolation of the spectrum values is linear in them, the */
+/* integration can be pre-computed as a weighting for each band, */
+/* by integrating each unit band spectrum. */
+static void xsp2cie_set_bweights(xsp2cie *p, xspect *sp) {
+	xspect bs;
+	double ww, scale = 0.0;
+	int i, j;
+
+	bs = *sp;
+	bs.norm = 1.0;
+	for (i = 0; i < bs.spec_n; i++)
+		bs.spec[i] = 0.0;
+
+	for (i = 0; i < bs.spec_n; i++) {
+		bs.spec[i] = 1.0;
+		for (j = 0; j < 3; j++) {
+			p->bw_w[j][i] = 0.0;
+			for (ww = p->spec_wl_short; ww <= p->spec_wl_long; ww += p->spec_bw) {
+				double I = 1.0, O, S;
+				if (!p->isemis)
+					getval_xspec(&p->illuminant, &I, ww);
+				getval_xspec(&p->observer[j], &O, ww);
+				getval_xspec(&bs, &S, ww);
+				if (i == 0 && j == 1)
+					scale += I * O;
+				p->bw_w[j][i] += I * O * S;
+			}
+		}
+		bs.spec[i] = 0.0;
+	}
+	if (p->isemis)
+		scale = 0.683002 * p->spec_bw;
+	else
+		scale = 1.0/scale;
+	for (j = 0; j < 3; j++) {
+		for (i = 0; i < bs.spec_n; i++)
+			p->bw_w[j][i] *= scale;
+	}
+
+	p->bw_n = sp->spec_n;
+	p->bw_short = sp->spec_wl_short;
+	p->bw_long = sp->spec_wl_long;
+}
+
+/* Batch Tristumulus conversion of n spectra, given as n * sp->spec_n */
+/* band values in vals[], having the wavelength range, number of bands */
+/* and normalisation of sp. out[] is n * 3 values. */
+void xsp2cie_convert_n(xsp2cie *p, double *out, xspect *sp, double *vals, int n) {
+	int i, j, k, nb = sp->spec_n;
+	double inorm = 1.0/sp->norm;
+
+#ifndef SALONEINSTLIB
+	/* If FWA is set, use the batch FWA templates */
+	if (p->convert == xsp2cie_fwa_convert
+	 && xsp2cie_fwat_batch(p, out, sp, vals, n, 0) == 0)
+		return;
+#endif /* !SALONEINSTLIB */
+
+	/* Otherwise convert each spectrum in turn */
+	if (p->convert != xsp2cie_convert) {
+		xspect tsp = *sp;
+		for (i = 0; i < n; i++, out += 3, vals += nb) {
+			for (k = 0; k < nb; k++)
+				tsp.spec[k] = vals[k];
+			p->convert(p, out, &tsp);
+		}
+		return;
+	}
+
+	if (p->bw_n != sp->spec_n
+	 || p->bw_short != sp->spec_wl_short
+	 || p->bw_long != sp->spec_wl_long)
+		xsp2cie_set_bweights(p, sp);
+
+	for (i = 0; i < n; i++, out += 3, vals += nb) {
+		double X = 0.0, Y = 0.0, Z = 0.0;
+		for (k = 0; k < nb; k++) {
+			X += p->bw_w[0][k] * vals[k];
+			Y += p->bw_w[1][k] * vals[k];
+			Z += p->bw_w[2][k] * vals[k];
+		}
+		out[0] = X * inorm;
+		out[1] = Y * inorm;
+		out[2] = Z * inorm;
+
+#ifdef CLAMP_XYZ
+		for (j = 0; j < 3; j++) {
+			if (p->clamp && out[j] < 0.0)
+				out[j] = 0.0;		/* Just to be sure we don't get silly values */
+		}
+#endif /* CLAMP_XYZ */
+
+		if (p->doLab == 1) {
+			icmXYZ2Lab(&icmD50, out, out);
+		} else if (p->doLab == 2) {
+			icmXYZ2Lpt(&icmD50, out, out);
+		}
+	}
+}
+
 /* Return the illuminant XYZ being used in the CIE XYZ/Lab conversion. */ 
 /* Note that this will returne the 'E' illuminant XYZ for emissive. */
 void xsp2cie_get_cie_il(xsp2cie *p, double *xyz) {
@@ -5855,6 +6542,9 @@ void xsp2cie_get_cie_il(xsp2cie *p, double *xyz) {
 void xsp2cie_del(
 xsp2cie *p
 ) {
+#ifndef SALONEINSTLIB
+	xsp2cie_free_fwat(p);
+#endif /* !SALONEINSTLIB */
 	free(p);
 	return;
 }
@@ -5935,14 +6625,19 @@ icxClamping clamp				/* NZ to clamp XYZ/Lab to be +ve */
 	p->photo2rad     = xsp2cie_photo2rad;
 	p->convert       = xsp2cie_convert;
 	p->sconvert      = xsp2cie_sconvert;
+	p->convert_n     = xsp2cie_convert_n;
 	p->get_cie_il    = xsp2cie_get_cie_il;
 #ifndef SALONEINSTLIB
 	p->set_mw        = xsp2cie_set_mw;		/* Default no media white */
 	p->set_fwa       = xsp2cie_set_fwa;		/* Default no FWA compensation */
 	p->update_fwa_custillum = xsp2cie_update_fwa_custillum;
 	p->get_fwa_info  = xsp2cie_get_fwa_info;
+	p->write_fwa     = xsp2cie_write_fwa;
+	p->read_fwa      = xsp2cie_read_fwa;
+	p->set_nthreads  = xsp2cie_set_nthreads;
 	p->extract       = xsp2cie_extract;
 	p->apply         = xsp2cie_apply;
+	p->apply_n       = xsp2cie_apply_n;
 #endif /* !SALONEINSTLIB */
 	p->del           = xsp2cie_del;
 
@@ -205,6 +205,36 @@ void xspect_plotNp(xspect *sp[MXGPHS], int n);
 /* Plot up to 12 spectra pointed to by an array */
 void xspect_plotNp_w(xspect *sp[MXGPHS], int n, int wait);
 
+/* A table of spectra that share one wavelength sampling and norm, */
+/* stored compactly as floats, one spectrum after another. */
+typedef struct {
+	int    nspec;					/* Number of spectra */
+	int    spec_n;					/* Number of spectral bands */
+	double spec_wl_short;			/* First reading wavelength in nm (shortest) */
+	double spec_wl_long;			/* Last reading wavelength in nm (longest) */
+	double norm;					/* Normalising scale value, ie. 1, 100 etc. */
+	float *spec;					/* [nspec * spec_n] Spectral values */
+} xspect_tab;
+
+/* Create a table of nspec zero spectra with the sampling and norm of info. */
+/* Return NULL on malloc failure. */
+xspect_tab *new_xspect_tab(int nspec, xspect *info);
+void del_xspect_tab(xspect_tab *p);
+
+/* Set spectrum ix, converting it to the table sampling and norm if needed */
+void xspect_tab_set(xspect_tab *p, int ix, xspect *src);
+
+/* Get spectrum ix as an xspect */
+void xspect_tab_get(xspect_tab *p, int ix, xspect *dst);
+
+/* Resample and renormalise all the spectra of src into dst, */
+/* the same as xspect2xspect(). Return NZ if error */
+int xspect_tab_resample(xspect_tab *dst, xspect_tab *src);
+
+/* Average n spectra of the table, the first n if pix == NULL, */
+/* else those with indexes pix[n]. */
+void xspect_tab_average(xspect_tab *p, xspect *dst, int *pix, int n);
+
 #endif /* !SALONEINSTLIB*/
 
 /* ------------------------------------------------------------------------------ */
@@ -297,6 +327,22 @@ typedef enum {
     icxClamp			= 1,	/* Clamp XYZ/Lab to +ve */
 } icxClamping;
 
+#ifndef SALONEINSTLIB
+/* FWA compensation values at one wavelength, precomputed for */
+/* batch conversion. Values are not clamped. */
+typedef struct {
+	double Eu;		/* FWA emission */
+	double Ii;		/* Normalised instrument illuminant */
+	double It;		/* Normalised target illuminant */
+	double Rmb;		/* Base media reflectance */
+	double Su;		/* FWA stimulation sensitivity */
+	double Io;		/* Normalised observer illuminant */
+	double O[3];	/* Observer weightings */
+	int    ix;		/* Spectrum band index and weight to interpolate */
+	double w;		/* the batch spectra at this wavelength. */
+} xsp_fwat;
+#endif /* !SALONEINSTLIB*/
+
 /* The conversion object */
 struct _xsp2cie {
 	/* Private: */
@@ -311,6 +357,12 @@ struct _xsp2cie {
 	double spec_wl_short;		/* Start wavelength (nm) */
 	double spec_wl_long;		/* End wavelength (nm) */
 
+	/* convert_n() weightings */
+	int    bw_n;				/* Number of bands weighted, 0 if not set */
+	double bw_short;			/* Wavelength range weighted */
+	double bw_long;
+	double bw_w[3][XSPECT_MAX_BANDS];	/* Scaled XYZ weighting per band */
+
 #ifndef SALONEINSTLIB
 	/* FWA compensation */
 	double fwa_bw;	/* Integration bandwidth */
@@ -324,6 +376,18 @@ struct _xsp2cie {
 	double Sm;		/* FWA Stimulation level for emits contribution */
 	double FWAc;	/* FWA content (informational) */
 	int    insteqtarget;	/* iillum == tillum, bypass FWA */
+
+	/* FWA convert_n() and apply_n() templates, for spectra */
+	/* of fwat_n bands from fwat_short to fwat_long. */
+	int    fwat_n;			/* Number of bands, 0 if not set */
+	double fwat_short;		/* Wavelength range */
+	double fwat_long;
+	int    fs_n;			/* Number of FWA stimulation range samples */
+	xsp_fwat *fs;			/* FWA stimulation range samples */
+	int    fi_n;			/* Number of integration range samples */
+	xsp_fwat *fi;			/* Integration range samples */
+	xsp_fwat *fb;			/* fwat_n samples at the band wavelengths */
+	int    nthreads;		/* Batch FWA threads, 0 for default */
 #endif /* !SALONEINSTLIB*/
 
 	/* Public: */
@@ -361,6 +425,20 @@ struct _xsp2cie {
 	                 xspect *in				/* Spectrum to be converted, normalised by norm */
 	                );
 
+	/* Convert n spectra, given as n * sp->spec_n band values in vals[], */
+	/* that have the wavelength range, number of bands and normalisation */
+	/* of spectrum sp, returning n * 3 values in out[]. This uses */
+	/* per-band weightings that are computed once for the wavelength range, */
+	/* and only differs from convert() by rounding. FWA compensated */
+	/* spectra use values precomputed for the wavelength range, and are */
+	/* converted using set_nthreads() threads. Not thread safe. */
+	void (*convert_n) (struct _xsp2cie *p,	/* this */
+	                 double *out,			/* Return n * XYZ or D50 Lab values */
+	                 xspect *sp,			/* Wavelength range and normalisation */
+	                 double *vals,			/* n * sp->spec_n spectral values */
+	                 int n					/* Number of spectra */
+	                );
+
 	/* Convert and also return (possibly corrected) reflectance spectrum */
 	/* Spectrum will be same wlength range and readings as input spectrum */
 	/* Note that the returned XYZ is 0..1 range for reflectance. */
@@ -404,6 +482,33 @@ struct _xsp2cie {
 					double *FWAc		/* FWA content as a ratio. */
 	                );
 
+	/* Save the FWA media estimates made by set_fwa(), so that they can */
+	/* be re-used with read_fwa() for other charts measured on the same */
+	/* media. The file has the measured media, estimated base media and */
+	/* estimated FWA emission spectra. */
+	/* return NZ if error */
+	int (*write_fwa) (struct _xsp2cie *p,	/* this */
+	                char *fname			/* File to write */
+	                );
+
+	/* Set Fluorescent Whitening Agent compensation using media */
+	/* estimates saved by write_fwa(), rather than estimating them */
+	/* from a media measurement. */
+	/* return NZ if error */
+	int (*read_fwa) (struct _xsp2cie *p,	/* this */
+					xspect *iillum,		/* Spectrum of instrument illuminant */
+					xspect *tillum,		/* Spectrum of target/simulated instrument illuminant, */
+										/* NULL to use observer illuminant. */
+	                char *fname			/* File to read */
+	                );
+
+	/* Set the number of threads used by convert_n() and apply_n() */
+	/* for FWA compensated spectra. 0 for the default of num_threads(). */
+	/* Results don't depend on the number of threads. */
+	void (*set_nthreads) (struct _xsp2cie *p,	/* this */
+	                int nthreads		/* Number of threads */
+	                );
+
 
 	/* Set Media White. This enables extracting and applying the */
 	/* colorant reflectance value from/to the meadia. */
@@ -428,6 +533,20 @@ struct _xsp2cie {
 	                 xspect *out,			/* Applied refl. spectrum */
 	                 xspect *in				/* Colorant reflectance to be applied */
 	                );
+
+	/* Apply n colorant reflectances given as n * sp->spec_n band */
+	/* values in vals[], that have the wavelength range, number of */
+	/* bands and normalisation of spectrum sp, returning n * sp->spec_n */
+	/* applied reflectance values in ovals[]. As apply(), but with FWA */
+	/* uses values precomputed for the wavelength range, and */
+	/* set_nthreads() threads. Not thread safe. */
+	/* return NZ if error */
+	int (*apply_n) (struct _xsp2cie *p,	/* this */
+	                 double *ovals,			/* Return n * sp->spec_n applied refl. values */
+	                 xspect *sp,			/* Wavelength range and normalisation */
+	                 double *vals,			/* n * sp->spec_n colorant reflectance values */
+	                 int n					/* Number of spectra */
+	                );
 #endif /* !SALONEINSTLIB*/
 
 }; typedef struct _xsp2cie xsp2cie;
@@ -19,10 +19,12 @@
  */
 
 #include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <setjmp.h>
-#ifdef __sun
+#if defined(__sun) || defined(UNIX)
 #include <unistd.h>
 #endif
 #if defined(__IBMC__) && defined(_M_IX86)
@@ -103,6 +105,219 @@ static void jpeg_error(j_common_ptr cinfo) {
 
 /* ------------------------------------------------------ */
 
+/* ------------------------------------------------------ */
+/* Fast location of an embedded ICC profile, by reading just the */
+/* TIFF first directory or the JPEG markers ahead of the image data, */
+/* rather than opening the file with libtiff or libjpeg. */
+
+/* Read a big or little endian 16 or 32 bit value */
+static unsigned int emb_get16(unsigned char *p, int be) {
+	return be ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+}
+
+static unsigned int emb_get32(unsigned char *p, int be) {
+	return be ? ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]
+	          : ((unsigned int)p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+#define TIFFTAG_ICC 34675		/* TIFF ICC profile tag */
+#define TIFF_UNDEFINED 7		/* TIFF UNDEFINED field type */
+
+/* Look for the ICC profile tag in the first directory of a classic TIFF file */
+static int emb_tiff_icc(FILE *fp, unsigned char hdr[8], unsigned char **pbuf, unsigned int *psize) {
+	int be = hdr[0] == 'M';
+	unsigned char ent[12];
+	unsigned int i, n, off, size;
+
+	off = emb_get32(hdr + 4, be);
+	if (fseek(fp, off, SEEK_SET) != 0 || fread(ent, 1, 2, fp) != 2)
+		return 2;
+	n = emb_get16(ent, be);
+
+	for (i = 0; i < n; i++) {
+		unsigned int tag;
+
+		if (fread(ent, 1, 12, fp) != 12)
+			return 2;
+		if ((tag = emb_get16(ent, be)) > TIFFTAG_ICC)
+			return 1;			/* Tags are in ascending order */
+		if (tag != TIFFTAG_ICC)
+			continue;
+		if (emb_get16(ent + 2, be) != TIFF_UNDEFINED
+		 || (size = emb_get32(ent + 4, be)) < 128)
+			return 2;
+		off = emb_get32(ent + 8, be);
+		if ((*pbuf = (unsigned char *)malloc(size)) == NULL)
+			return 2;
+		if (fseek(fp, off, SEEK_SET) != 0 || fread(*pbuf, 1, size, fp) != size) {
+			free(*pbuf);
+			*pbuf = NULL;
+			return 2;
+		}
+		*psize = size;
+		return 0;
+	}
+	return 1;
+}
+
+#define ICC_MARKER 0xE2			/* JPEG APP2 marker */
+#define ICC_OVERHEAD 14			/* "ICC_PROFILE\0" + sequence number + count */
+#define MAX_SEQ_NO 255
+
+/* Look for ICC profile APP2 markers before the first JPEG scan */
+static int emb_jpeg_icc(FILE *fp, unsigned char **pbuf, unsigned int *psize) {
+	unsigned char *chunk[MAX_SEQ_NO+1];
+	unsigned int clen[MAX_SEQ_NO+1];
+	unsigned char mk[2 + ICC_OVERHEAD];
+	unsigned int nchunks = 0, ngot = 0, size, len, i;
+	int c, rv = 1;
+
+	memset((void *)chunk, 0, sizeof(chunk));
+
+	for (;;) {
+		/* Find the next marker, skipping any fill bytes */
+		if ((c = getc(fp)) != 0xFF) {
+			rv = 2;
+			break;
+		}
+		while ((c = getc(fp)) == 0xFF)
+			;
+		if (c == EOF) {
+			rv = 2;
+			break;
+		}
+		if (c == 0xDA || c == 0xD9)		/* SOS or EOI, so no more headers */
+			break;
+		if ((c >= 0xD0 && c <= 0xD7) || c == 0x01)
+			continue;					/* Markers without a length */
+
+		if (fread(mk, 1, 2, fp) != 2 || (len = emb_get16(mk, 1)) < 2) {
+			rv = 2;
+			break;
+		}
+		len -= 2;
+
+		if (c == ICC_MARKER && len > ICC_OVERHEAD) {
+			if (fread(mk, 1, ICC_OVERHEAD, fp) != ICC_OVERHEAD) {
+				rv = 2;
+				break;
+			}
+			len -= ICC_OVERHEAD;
+			if (memcmp(mk, "ICC_PROFILE", 12) == 0) {
+				unsigned int seq = mk[12];
+
+				if (nchunks == 0)
+					nchunks = mk[13];
+				if (seq == 0 || seq > nchunks || mk[13] != nchunks || chunk[seq] != NULL) {
+					rv = 2;
+					break;
+				}
+				if ((chunk[seq] = (unsigned char *)malloc(len)) == NULL
+				 || fread(chunk[seq], 1, len, fp) != len) {
+					rv = 2;
+					break;
+				}
+				clen[seq] = len;
+				ngot++;
+				continue;
+			}
+		}
+		if (fseek(fp, len, SEEK_CUR) != 0) {
+			rv = 2;
+			break;
+		}
+	}
+
+	if (rv == 1 && nchunks > 0) {
+		if (ngot != nchunks)
+			rv = 2;
+		else {
+			for (size = 0, i = 1; i <= nchunks; i++)
+				size += clen[i];
+			if ((*pbuf = (unsigned char *)malloc(size)) == NULL)
+				rv = 2;
+			else {
+				for (size = 0, i = 1; i <= nchunks; i++) {
+					memcpy(*pbuf + size, chunk[i], clen[i]);
+					size += clen[i];
+				}
+				*psize = size;
+				rv = 0;
+			}
+		}
+	}
+	for (i = 0; i <= MAX_SEQ_NO; i++)
+		free(chunk[i]);
+	return rv;
+}
+
+/* Read an ICC profile embedded in a TIFF or JPEG file, by reading */
+/* just the TIFF first directory or JPEG header markers. */
+/* Return 0 and a malloc'd buffer holding the profile on success, */
+/* 1 if the file isn't a classic TIFF or JPEG file or has no profile, */
+/* 2 if the file or the profile looks to be damaged. */
+int read_embedded_icc_data(char *file_name, unsigned char **pbuf, unsigned int *psize) {
+	FILE *fp;
+	unsigned char hdr[8];
+	int rv = 1;
+
+	*pbuf = NULL;
+	*psize = 0;
+
+#if defined(O_BINARY) || defined(_O_BINARY)
+	if ((fp = fopen(file_name,"rb")) == NULL)
+#else
+	if ((fp = fopen(file_name,"r")) == NULL)
+#endif
+		return 1;
+
+	if (fread(hdr, 1, 8, fp) == 8) {
+		if ((hdr[0] == 'I' && hdr[1] == 'I' && hdr[2] == 42 && hdr[3] == 0)
+		 || (hdr[0] == 'M' && hdr[1] == 'M' && hdr[2] == 0 && hdr[3] == 42)) {
+			rv = emb_tiff_icc(fp, hdr, pbuf, psize);
+
+		} else if (hdr[0] == 0xFF && hdr[1] == 0xD8) {
+			if (fseek(fp, 2, SEEK_SET) == 0)
+				rv = emb_jpeg_icc(fp, pbuf, psize);
+		}
+	}
+	fclose(fp);
+	return rv;
+}
+
+/* ------------------------------------------------------ */
+
+/* Open an icc from a profile in the buffer buf allocated with al. */
+/* The buffer and al are deleted with the icc. Return NULL on error */
+static icc *read_embedded_icc_buf(char *file_name, void *buf, int size, icmAlloc *al) {
+	icmFile *fp;
+	icc *icco;
+	int rv;
+
+	/* Memory File fp that will free the buffer when deleted: */
+	if ((fp = new_icmFileMem_ad(buf, size, al)) == NULL) {
+		debug("Creating memory file from CMProfileLocation failed");
+		al->free(al, buf);
+		al->del(al);
+		return NULL;
+	}
+
+	if ((icco = new_icc()) == NULL) {
+		debug("Creation of ICC object failed\n");
+		fp->del(fp);	/* fp will delete al */
+		return NULL;
+	}
+
+	if ((rv = icco->read_x(icco,fp,0,1)) == 0) {
+		debug2((errout,"Opened '%s' embedded icc profile\n",file_name));
+		return icco;
+	}
+
+	debug2((errout,"Failed to read '%s' embedded icc profile\n",file_name));
+	icco->del(icco);	/* icco will delete fp and al */
+	return NULL;
+}
+
 /* Open an ICC file or a TIFF or JPEG  file with an embedded ICC profile for reading. */
 /* Return NULL on error */
 icc *read_embedded_icc(char *file_name) {
@@ -136,7 +351,32 @@ icc *read_embedded_icc(char *file_name) {
 	debug2((errout,"icc read failed with %d, %s\n",rv,icco->err));
 	icco->del(icco);		/* icc wil fp->del() */
 
-	/* Not an ICC profile, see if it's a TIFF file */
+	/* Not an ICC profile, see if the profile can be found directly */
+	/* in a TIFF or JPEG file, without opening it with libtiff or libjpeg. */
+	{
+		unsigned char *pdata;
+		unsigned int plen;
+
+		if ((rv = read_embedded_icc_data(file_name, &pdata, &plen)) == 0) {
+			if ((al = new_icmAllocStd()) == NULL) {
+				debug("new_icmAllocStd failed\n");
+				free(pdata);
+			    return NULL;
+			}
+			if ((buf = al->malloc(al, plen)) == NULL) {
+				debug("malloc of profile buffer failed\n");
+				al->del(al);
+				free(pdata);
+			    return NULL;
+			}
+			memmove(buf, pdata, plen);
+			free(pdata);
+			return read_embedded_icc_buf(file_name, buf, (int)plen, al);
+		}
+		debug2((errout,"Direct search of '%s' failed with %d\n",file_name,rv));
+	}
+
+	/* See if it's a TIFF file */
 	olderrh = TIFFSetErrorHandler(NULL);
 	oldwarnh = TIFFSetWarningHandler(NULL);
 	olderrhx = TIFFSetErrorHandlerExt(NULL);
@@ -243,52 +483,207 @@ icc *read_embedded_icc(char *file_name) {
 		free(pdata);
 	}
 
-	/* Memory File fp that will free the buffer when deleted: */
-	if ((fp = new_icmFileMem_ad(buf, size, al)) == NULL) {
-		debug("Creating memory file from CMProfileLocation failed");
-		al->free(al, buf);
-		al->del(al);
-		return NULL;
-	}
-
-	if ((icco = new_icc()) == NULL) {
-		debug("Creation of ICC object failed\n");
-		fp->del(fp);	/* fp will delete al */
-		return NULL;
-	}
-
-	if ((rv = icco->read_x(icco,fp,0,1)) == 0) {
-		debug2((errout,"Opened '%s' embedded icc profile\n",file_name));
-		return icco;
-	}
-
-	debug2((errout,"Failed to read '%s' embedded icc profile\n",file_name));
-	icco->del(icco);	/* icco will delete fp and al */
-	return NULL;
+	return read_embedded_icc_buf(file_name, buf, size, al);
 }
 
 /* ------------------------------------------------------ */
+/* Checkpoint files, so that a long computation can resume after */
+/* being interrupted. Each file is a header, an optional block of */
+/* state (such as a random number generator state) and the results */
+/* of the first ndone points. The header holds an MD5 of the input */
+/* points, so that a file is only used for an identical computation. */
 
+#define CKPT_MAGIC "ACKPT01"
+#define CKPT_ENDIAN 0x01020304	/* Check for byte order */
 
+typedef struct {
+	char magic[8];
+	int hsize;					/* sizeof(ckpt_hdr) */
+	unsigned int endian;		/* CKPT_ENDIAN */
+	int nin, nout;				/* Input and output values per point */
+	int npts;					/* Number of points */
+	int ndone;					/* Number of points with saved results */
+	int stsz;					/* Size of the state block in bytes */
+	ORD8 inchsum[16];			/* MD5 of the input values */
+} ckpt_hdr;
+
+/* Add a file's contents to an MD5. Return nz if it can't be read. */
+static int ckpt_add_file(icmMD5 *md5, char *fname) {
+	FILE *fp;
+	ORD8 buf[8192];
+	size_t n;
+
+	if ((fp = fopen(fname, "rb")) == NULL)
+		return 1;
+	while ((n = fread((void *)buf, 1, sizeof(buf), fp)) > 0)
+		md5->add(md5, buf, (unsigned int)n);
+	fclose(fp);
+	return 0;
+}
 
+/* Compute a checkpoint key from the command line arguments, and the */
+/* contents of any arguments or flag values that name readable files. */
+/* Flags that don't affect the result (such as verbosity or a thread */
+/* count) are left out, so that they can change between runs. Flags */
+/* with a letter in ignf take no separate value, and flags with a */
+/* letter in ignv may do. xfile is an extra file to include, and */
+/* ofile an output file whose contents aren't included, NULL if none. */
+/* The key is returned as 32 hex characters. Return nz on error. */
+int ckpt_key(char key[33], int argc, char *argv[], char *ignf, char *ignv,
+             char *xfile, char *ofile) {
+	char *fname;
+	icmMD5 *md5;
+	ORD8 chsum[16];
+	int i;
+
+	if ((md5 = new_icmMD5()) == NULL)
+		return 1;
+
+	for (i = 1; i < argc; i++) {
+		if (argv[i][0] == '-' && argv[i][1] != '\000') {
+			if (ignf != NULL && strchr(ignf, argv[i][1]) != NULL)
+				continue;
+			if (ignv != NULL && strchr(ignv, argv[i][1]) != NULL) {
+				if (argv[i][2] == '\000' && (i+1) < argc && argv[i+1][0] != '-')
+					i++;			/* Skip separate value too */
+				continue;
+			}
+		}
+		md5->add(md5, (ORD8 *)argv[i], strlen(argv[i]) + 1);
+		if (argv[i][0] != '-')
+			fname = argv[i];
+		else if (argv[i][1] != '\000' && argv[i][2] != '\000')
+			fname = argv[i] + 2;
+		else
+			continue;
+		if (ofile == NULL || strcmp(fname, ofile) != 0)
+			ckpt_add_file(md5, fname);
+	}
+	if (xfile != NULL)
+		ckpt_add_file(md5, xfile);
 
+	md5->get(md5, chsum);
+	md5->del(md5);
 
+	for (i = 0; i < 16; i++)
+		sprintf(key + 2 * i, "%02x", chsum[i]);
+	return 0;
+}
 
+/* Return an allocated checkpoint file name for the given directory, */
+/* key and stage. Return NULL on malloc failure. */
+char *ckpt_name(char *dir, char *key, char *stage) {
+	char *fname;
 
+	if ((fname = malloc(strlen(dir) + strlen(key) + strlen(stage) + 10)) == NULL)
+		return NULL;
+	sprintf(fname, "%s/ckpt_%s.%s", dir, key, stage);
+	return fname;
+}
 
+/* MD5 of npts * nin input values */
+static void ckpt_in_chsum(ORD8 chsum[16], int nin, int npts, double *in) {
+	icmMD5 *md5;
+
+	memset((void *)chsum, 0, 16);
+	if ((md5 = new_icmMD5()) == NULL)
+		return;
+	if (nin > 0 && npts > 0)
+		md5->add(md5, (ORD8 *)in, nin * npts * sizeof(double));
+	md5->get(md5, chsum);
+	md5->del(md5);
+}
 
+/* Save the results of the first ndone of npts points to a checkpoint file. */
+/* in[] is npts * nin input values (may be NULL if nin == 0), and out[] */
+/* holds at least ndone * nout result values. st is stsz bytes of state */
+/* to save with them (NULL if none). The file is written to a temporary */
+/* name and then renamed, so a partial file is never seen. */
+/* Return nz on error. */
+int ckpt_save_pts(char *fname, int nin, int nout, int npts, double *in, int ndone, double *out,
+                  void *st, int stsz) {
+	ckpt_hdr h;
+	char *tname;
+	FILE *fp;
+	int rv = 0;
+
+	memset((void *)&h, 0, sizeof(ckpt_hdr));	/* Make padding repeatable */
+	strcpy(h.magic, CKPT_MAGIC);
+	h.hsize = sizeof(ckpt_hdr);
+	h.endian = CKPT_ENDIAN;
+	h.nin = nin;
+	h.nout = nout;
+	h.npts = npts;
+	h.ndone = ndone;
+	h.stsz = st != NULL ? stsz : 0;
+	ckpt_in_chsum(h.inchsum, nin, npts, in);
+
+	if ((tname = malloc(strlen(fname) + 30)) == NULL)
+		return 1;
+#ifdef UNIX
+	sprintf(tname, "%s.%d.tmp", fname, (int)getpid());
+#else
+	sprintf(tname, "%s.tmp", fname);
+#endif
+	if ((fp = fopen(tname, "wb")) == NULL) {
+		free(tname);
+		return 1;
+	}
+	if (fwrite((void *)&h, sizeof(ckpt_hdr), 1, fp) != 1
+	 || (h.stsz > 0 && fwrite(st, h.stsz, 1, fp) != 1)
+	 || (ndone > 0 && nout > 0
+	  && fwrite((void *)out, nout * sizeof(double), ndone, fp) != (size_t)ndone))
+		rv = 1;
+	if (fclose(fp) != 0)
+		rv = 1;
+	if (rv == 0) {
+#ifndef UNIX
+		remove(fname);			/* MSWin rename() won't replace a file */
+#endif
+		if (rename(tname, fname) != 0)
+			rv = 1;
+	}
+	if (rv != 0)
+		remove(tname);
+	free(tname);
 
+	return rv;
+}
 
+/* Restore the results saved by ckpt_save_pts() for the same input */
+/* points into out[], and the stsz bytes of state into st if it is */
+/* not NULL. Return the number of points restored, -1 if the file */
+/* doesn't exist or doesn't match. */
+int ckpt_load_pts(char *fname, int nin, int nout, int npts, double *in, double *out,
+                  void *st, int stsz) {
+	ckpt_hdr h;
+	ORD8 chsum[16];
+	FILE *fp;
+
+	if ((fp = fopen(fname, "rb")) == NULL)
+		return -1;
+	if (fread((void *)&h, sizeof(ckpt_hdr), 1, fp) != 1) {
+		fclose(fp);
+		return -1;
+	}
+	ckpt_in_chsum(chsum, nin, npts, in);
+
+	if (strncmp(h.magic, CKPT_MAGIC, 8) != 0
+	 || h.hsize != sizeof(ckpt_hdr)
+	 || h.endian != CKPT_ENDIAN
+	 || h.nin != nin || h.nout != nout || h.npts != npts
+	 || h.ndone < 0 || h.ndone > npts
+	 || memcmp((void *)h.inchsum, (void *)chsum, 16) != 0
+	 || h.stsz != (st != NULL ? stsz : 0)
+	 || (h.stsz > 0 && fread(st, h.stsz, 1, fp) != 1)
+	 || (h.ndone > 0 && nout > 0
+	  && fread((void *)out, nout * sizeof(double), h.ndone, fp) != (size_t)h.ndone)) {
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
 
+	return h.ndone;
+}
 
-
-
-
-
-
-
-
-
-
-
-
+/* ------------------------------------------------------ */
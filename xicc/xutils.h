@@ -31,6 +31,36 @@ int dim_to_clutres(int dim, int quality);
 /* Return NULL on error */
 icc *read_embedded_icc(char *file_name);
 
+/* Read an ICC profile embedded in a TIFF or JPEG file, by reading */
+/* just the TIFF first directory or JPEG header markers. */
+/* Return 0 and a malloc'd buffer holding the profile on success, */
+/* 1 if the file isn't a classic TIFF or JPEG file or has no profile, */
+/* 2 if the file or the profile looks to be damaged. */
+int read_embedded_icc_data(char *file_name, unsigned char **pbuf, unsigned int *psize);
+
+/* Checkpoint files for resuming long computations. */
+
+/* Compute a 32 hex character key from the command line arguments, less */
+/* any flags in ignf, or flags in ignv and their value, the contents of */
+/* any arguments that name files other than ofile, and xfile if not NULL. */
+/* Return nz on error. */
+int ckpt_key(char key[33], int argc, char *argv[], char *ignf, char *ignv,
+             char *xfile, char *ofile);
+
+/* Return an allocated "dir/ckpt_key.stage" file name, NULL on error */
+char *ckpt_name(char *dir, char *key, char *stage);
+
+/* Save the nout results of the first ndone of npts points with nin */
+/* input values each, plus stsz bytes of state st if not NULL. */
+/* Return nz on error. */
+int ckpt_save_pts(char *fname, int nin, int nout, int npts, double *in, int ndone, double *out,
+                  void *st, int stsz);
+
+/* Restore the results and state saved for the same input points. Return */
+/* the number of points restored, -1 if there is no matching checkpoint. */
+int ckpt_load_pts(char *fname, int nin, int nout, int npts, double *in, double *out,
+                  void *st, int stsz);
+
 #endif /* XUTILS_H */
 
 